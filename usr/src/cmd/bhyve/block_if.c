@@ -85,6 +85,13 @@ __FBSDID("$FreeBSD$");
 #endif
 #define BLOCKIF_MAXREQ	(BLOCKIF_RING_MAX + BLOCKIF_NUMTHR)
 
+/*
+ * Limits on how far a worker will grow a read or write by merging the
+ * requests queued directly behind it into a single preadv()/pwritev().
+ */
+#define	BLOCKIF_MERGE_IOV	(4 * BLOCKIF_IOV_MAX)
+#define	BLOCKIF_MERGE_MAX	(1024 * 1024)
+
 enum blockop {
 	BOP_READ,
 	BOP_WRITE,
@@ -110,6 +117,7 @@ struct blockif_elem {
 	enum blockstat	     be_status;
 	pthread_t            be_tid;
 	off_t		     be_block;
+	struct blockif_elem *be_next;	/* merged request that follows */
 };
 
 #ifndef __FreeBSD__
@@ -135,6 +143,7 @@ struct blockif_ctxt {
 	int			bc_psectsz;
 	int			bc_psectoff;
 	int			bc_closing;
+	int			bc_nworkers;
 	pthread_t		bc_btid[BLOCKIF_NUMTHR];
 	pthread_mutex_t		bc_mtx;
 	pthread_cond_t		bc_cond;
@@ -204,6 +213,53 @@ blockif_enqueue(struct blockif_ctxt *bc, struct blockif_req *breq,
 	return (be->be_status == BST_PEND);
 }
 
+/*
+ * A sequential stream shows up as a run of requests that are each blocked
+ * on the one before them (see blockif_enqueue()).  Take the rest of such a
+ * run along with 'be', so that one system call services all of it instead
+ * of each request waiting for its predecessor to finish.
+ */
+static void
+blockif_merge(struct blockif_ctxt *bc, struct blockif_elem *be, pthread_t t)
+{
+	struct blockif_elem *last, *tbe;
+	off_t len;
+	int iovcnt;
+
+	be->be_next = NULL;
+	if ((be->be_op != BOP_READ && be->be_op != BOP_WRITE) ||
+	    bc->bc_isgeom)
+		return;
+
+	last = be;
+	iovcnt = be->be_req->br_iovcnt;
+	len = be->be_block - be->be_req->br_offset;
+	for (;;) {
+		TAILQ_FOREACH(tbe, &bc->bc_pendq, be_link) {
+			if (tbe->be_status == BST_BLOCK &&
+			    tbe->be_op == be->be_op &&
+			    tbe->be_req->br_offset == last->be_block)
+				break;
+		}
+		if (tbe == NULL ||
+		    iovcnt + tbe->be_req->br_iovcnt > BLOCKIF_MERGE_IOV ||
+		    len + (tbe->be_block - tbe->be_req->br_offset) >
+		    BLOCKIF_MERGE_MAX)
+			break;
+
+		TAILQ_REMOVE(&bc->bc_pendq, tbe, be_link);
+		tbe->be_status = BST_BUSY;
+		tbe->be_tid = t;
+		tbe->be_next = NULL;
+		TAILQ_INSERT_TAIL(&bc->bc_busyq, tbe, be_link);
+
+		last->be_next = tbe;
+		last = tbe;
+		iovcnt += tbe->be_req->br_iovcnt;
+		len += tbe->be_block - tbe->be_req->br_offset;
+	}
+}
+
 static int
 blockif_dequeue(struct blockif_ctxt *bc, pthread_t t, struct blockif_elem **bep)
 {
@@ -220,6 +276,7 @@ blockif_dequeue(struct blockif_ctxt *bc, pthread_t t, struct blockif_elem **bep)
 	be->be_status = BST_BUSY;
 	be->be_tid = t;
 	TAILQ_INSERT_TAIL(&bc->bc_busyq, be, be_link);
+	blockif_merge(bc, be, t);
 	*bep = be;
 	return (1);
 }
@@ -411,11 +468,55 @@ blockif_proc(struct blockif_ctxt *bc, struct blockif_elem *be, uint8_t *buf)
 	(*br->br_callback)(br, err);
 }
 
+/*
+ * Service a chain of requests built by blockif_merge() with one vectored
+ * read or write, then split the result back out across the requests.
+ */
+static void
+blockif_proc_merged(struct blockif_ctxt *bc, struct blockif_elem *be)
+{
+	struct iovec iov[BLOCKIF_MERGE_IOV];
+	struct blockif_elem *tbe, *next;
+	struct blockif_req *br;
+	ssize_t len, n;
+	int i, iovcnt, err;
+
+	iovcnt = 0;
+	for (tbe = be; tbe != NULL; tbe = tbe->be_next) {
+		br = tbe->be_req;
+		for (i = 0; i < br->br_iovcnt; i++)
+			iov[iovcnt++] = br->br_iov[i];
+	}
+
+	err = 0;
+	if (be->be_op == BOP_READ)
+		len = preadv(bc->bc_fd, iov, iovcnt, be->be_req->br_offset);
+	else if (bc->bc_rdonly) {
+		len = 0;
+		err = EROFS;
+	} else
+		len = pwritev(bc->bc_fd, iov, iovcnt, be->be_req->br_offset);
+	if (len < 0) {
+		err = errno;
+		len = 0;
+	}
+
+	for (tbe = be; tbe != NULL; tbe = next) {
+		next = tbe->be_next;
+		br = tbe->be_req;
+		n = MIN(len, br->br_resid);
+		br->br_resid -= n;
+		len -= n;
+		tbe->be_status = BST_DONE;
+		(*br->br_callback)(br, err);
+	}
+}
+
 static void *
 blockif_thr(void *arg)
 {
 	struct blockif_ctxt *bc;
-	struct blockif_elem *be;
+	struct blockif_elem *be, *next;
 	pthread_t t;
 	uint8_t *buf;
 
@@ -430,9 +531,15 @@ blockif_thr(void *arg)
 	for (;;) {
 		while (blockif_dequeue(bc, t, &be)) {
 			pthread_mutex_unlock(&bc->bc_mtx);
-			blockif_proc(bc, be, buf);
+			if (be->be_next != NULL)
+				blockif_proc_merged(bc, be);
+			else
+				blockif_proc(bc, be, buf);
 			pthread_mutex_lock(&bc->bc_mtx);
-			blockif_complete(bc, be);
+			for (; be != NULL; be = next) {
+				next = be->be_next;
+				blockif_complete(bc, be);
+			}
 		}
 		/* Check ctxt status here to see if exit requested */
 		if (bc->bc_closing)
@@ -508,7 +615,7 @@ blockif_open(const char *optstr, const char *ident)
 	off_t size, psectsz, psectoff;
 	int extra, fd, i, sectsz;
 	int nocache, sync, ro, candelete, geom, ssopt, pssopt;
-	int nodelete;
+	int nodelete, nworkers;
 
 #ifndef WITHOUT_CAPSICUM
 	cap_rights_t rights;
@@ -523,6 +630,7 @@ blockif_open(const char *optstr, const char *ident)
 	sync = 0;
 	ro = 0;
 	nodelete = 0;
+	nworkers = BLOCKIF_NUMTHR;
 
 	/*
 	 * The first element in the optstring is always a pathname.
@@ -541,7 +649,13 @@ blockif_open(const char *optstr, const char *ident)
 			sync = 1;
 		else if (!strcmp(cp, "ro"))
 			ro = 1;
-		else if (sscanf(cp, "sectorsize=%d/%d", &ssopt, &pssopt) == 2)
+		else if (sscanf(cp, "workers=%d", &nworkers) == 1) {
+			if (nworkers < 1 || nworkers > BLOCKIF_NUMTHR) {
+				EPRINTLN("workers must be between 1 and %d",
+				    BLOCKIF_NUMTHR);
+				goto err;
+			}
+		} else if (sscanf(cp, "sectorsize=%d/%d", &ssopt, &pssopt) == 2)
 			;
 		else if (sscanf(cp, "sectorsize=%d", &ssopt) == 1)
 			pssopt = ssopt;
@@ -739,6 +853,7 @@ blockif_open(const char *optstr, const char *ident)
 	bc->bc_sectsz = sectsz;
 	bc->bc_psectsz = psectsz;
 	bc->bc_psectoff = psectoff;
+	bc->bc_nworkers = nworkers;
 	pthread_mutex_init(&bc->bc_mtx, NULL);
 	pthread_cond_init(&bc->bc_cond, NULL);
 	TAILQ_INIT(&bc->bc_freeq);
@@ -749,7 +864,7 @@ blockif_open(const char *optstr, const char *ident)
 		TAILQ_INSERT_HEAD(&bc->bc_freeq, &bc->bc_reqs[i], be_link);
 	}
 
-	for (i = 0; i < BLOCKIF_NUMTHR; i++) {
+	for (i = 0; i < bc->bc_nworkers; i++) {
 		pthread_create(&bc->bc_btid[i], NULL, blockif_thr, bc);
 		snprintf(tname, sizeof(tname), "blk-%s-%d", ident, i);
 		pthread_set_name_np(bc->bc_btid[i], tname);
@@ -916,7 +1031,7 @@ blockif_close(struct blockif_ctxt *bc)
 	bc->bc_closing = 1;
 	pthread_mutex_unlock(&bc->bc_mtx);
 	pthread_cond_broadcast(&bc->bc_cond);
-	for (i = 0; i < BLOCKIF_NUMTHR; i++)
+	for (i = 0; i < bc->bc_nworkers; i++)
 		pthread_join(bc->bc_btid[i], &jval);
 
 	/* XXX Cancel queued i/o's ??? */
@@ -35,6 +35,13 @@
 /*
  * Micro event library for FreeBSD, designed for a single i/o thread 
  * using kqueue, and having events be persistent by default.
+ *
+ * On illumos, events are spread across a small pool of worker threads, each
+ * blocking on its own event port.  Every mevent is bound to one worker, chosen
+ * by its callback parameter, so the events belonging to a single consumer are
+ * still delivered serially while unrelated devices are serviced in parallel.
+ * The number of workers can be set with the BHYVE_MEVENT_THREADS environment
+ * variable.
  */
 
 #include <sys/cdefs.h>
@@ -54,6 +61,7 @@ __FBSDID("$FreeBSD$");
 #include <unistd.h>
 
 #include <sys/types.h>
+#include <sys/param.h>
 #ifndef WITHOUT_CAPSICUM
 #include <sys/capsicum.h>
 #endif
@@ -82,11 +90,18 @@ __FBSDID("$FreeBSD$");
 #define	EV_DELETE	0x04
 #endif
 
+#ifndef __FreeBSD__
+#define	MEVENT_WORKERS_DEFAULT	4
+#define	MEVENT_WORKERS_MAX	16
+#endif
+
 extern char *vmname;
 
+#ifdef __FreeBSD__
 static pthread_t mevent_tid;
-static int mevent_timid = 43;
 static int mevent_pipefd[2];
+#endif
+static int mevent_timid = 43;
 static pthread_mutex_t mevent_lmutex = PTHREAD_MUTEX_INITIALIZER;
 
 struct mevent {
@@ -107,11 +122,30 @@ struct mevent {
 	port_notify_t	me_notify;
 	struct sigevent	me_sigev;
 	boolean_t	me_auto_requeue;
+	struct mevent_worker *me_worker;
 #endif
 	LIST_ENTRY(mevent) me_list;
 };
 
-static LIST_HEAD(listhead, mevent) global_head, change_head;
+static LIST_HEAD(listhead, mevent) global_head;
+#ifdef __FreeBSD__
+static struct listhead change_head;
+#else
+/*
+ * Each worker owns an event port and the list of pending changes to the
+ * events bound to it.  Only the owning worker applies those changes, so an
+ * event is never freed or re-associated while its callback is running.
+ */
+struct mevent_worker {
+	pthread_t	mw_tid;
+	int		mw_portfd;
+	struct listhead	mw_change_head;
+};
+
+static struct mevent_worker mevent_workers[MEVENT_WORKERS_MAX];
+static uint_t mevent_nworkers;
+static pthread_once_t mevent_once = PTHREAD_ONCE_INIT;
+#endif
 
 static void
 mevent_qlock(void)
@@ -125,6 +159,7 @@ mevent_qunlock(void)
 	pthread_mutex_unlock(&mevent_lmutex);
 }
 
+#ifdef __FreeBSD__
 static void
 mevent_pipe_read(int fd, enum ev_type type, void *param)
 {
@@ -140,8 +175,15 @@ mevent_pipe_read(int fd, enum ev_type type, void *param)
 	} while (status == MEVENT_MAX);
 }
 
+static struct listhead *
+mevent_change_head(struct mevent *mevp)
+{
+
+	return (&change_head);
+}
+
 static void
-mevent_notify(void)
+mevent_notify(struct mevent *mevp)
 {
 	char c = '\0';
 	
@@ -153,7 +195,7 @@ mevent_notify(void)
 		write(mevent_pipefd[1], &c, 1);
 	}
 }
-#ifdef __FreeBSD__
+
 static int
 mevent_kq_filter(struct mevent *mevp)
 {
@@ -261,6 +303,69 @@ mevent_handle(struct kevent *kev, int numev)
 
 #else /* __FreeBSD__ */
 
+static void
+mevent_init(void)
+{
+	const char *val;
+	uint_t i;
+
+	mevent_nworkers = MEVENT_WORKERS_DEFAULT;
+	if ((val = getenv("BHYVE_MEVENT_THREADS")) != NULL) {
+		mevent_nworkers = strtoul(val, NULL, 10);
+	}
+	if (mevent_nworkers == 0) {
+		mevent_nworkers = 1;
+	} else if (mevent_nworkers > MEVENT_WORKERS_MAX) {
+		mevent_nworkers = MEVENT_WORKERS_MAX;
+	}
+
+	for (i = 0; i < mevent_nworkers; i++) {
+		struct mevent_worker *mw = &mevent_workers[i];
+
+		mw->mw_portfd = port_create();
+		if (mw->mw_portfd < 0) {
+			err(EX_OSERR, "port_create");
+		}
+		LIST_INIT(&mw->mw_change_head);
+	}
+}
+
+/*
+ * Bind an event to a worker.  Hashing on the callback parameter keeps every
+ * event of a given device on the same worker, preserving the serialization
+ * that device emulations have always been able to rely upon.
+ */
+static struct mevent_worker *
+mevent_worker_pick(void *param)
+{
+	uintptr_t h = (uintptr_t)param;
+
+	h ^= h >> 12;
+	return (&mevent_workers[(h >> 4) % mevent_nworkers]);
+}
+
+static struct listhead *
+mevent_change_head(struct mevent *mevp)
+{
+
+	return (&mevp->me_worker->mw_change_head);
+}
+
+static void
+mevent_notify(struct mevent *mevp)
+{
+	struct mevent_worker *mw = mevp->me_worker;
+
+	/*
+	 * If calling from outside the owning worker, send it a user event to
+	 * force it out of port_get() so that the change is applied.  A worker
+	 * which has yet to start will pick up its changes when it does.
+	 */
+	if (mw->mw_tid != 0 && !pthread_equal(pthread_self(), mw->mw_tid)) {
+		(void) port_send(mw->mw_portfd, 0, NULL);
+	}
+}
+
 static boolean_t
 mevent_clarify_state(struct mevent *mevp)
 {
@@ -384,15 +489,13 @@ abort:
 }
 
 static void
-mevent_update_pending(int portfd)
+mevent_update_pending(struct mevent_worker *mw)
 {
 	struct mevent *mevp, *tmpp;
 
 	mevent_qlock();
 
-	LIST_FOREACH_SAFE(mevp, &change_head, me_list, tmpp) {
-		mevp->me_notify.portnfy_port = portfd;
-		mevp->me_notify.portnfy_user = mevp;
+	LIST_FOREACH_SAFE(mevp, &mw->mw_change_head, me_list, tmpp) {
 		if (mevp->me_closefd) {
 			/*
 			 * A close of the file descriptor will remove the
@@ -424,8 +527,6 @@ mevent_handle_pe(port_event_t *pe)
 {
 	struct mevent *mevp = pe->portev_user;
 
-	mevent_qunlock();
-
 	(*mevp->me_func)(mevp->me_fd, mevp->me_type, mevp->me_param);
 
 	mevent_qlock();
@@ -434,6 +535,48 @@ mevent_handle_pe(port_event_t *pe)
 	}
 	mevent_qunlock();
 }
+
+static void *
+mevent_worker_thread(void *arg)
+{
+	struct mevent_worker *mw = arg;
+	const uint_t id = mw - mevent_workers;
+	char tname[MAXCOMLEN + 1];
+
+	mevent_qlock();
+	mw->mw_tid = pthread_self();
+	mevent_qunlock();
+
+	if (id == 0) {
+		(void) strlcpy(tname, "mevent", sizeof (tname));
+	} else {
+		(void) snprintf(tname, sizeof (tname), "mevent-%u", id);
+	}
+	pthread_set_name_np(mw->mw_tid, tname);
+
+	for (;;) {
+		port_event_t pev;
+
+		/* Handle any pending updates */
+		mevent_update_pending(mw);
+
+		/* Block awaiting events */
+		if (port_get(mw->mw_portfd, &pev, NULL) != 0) {
+			if (errno != EINTR)
+				perror("Error return from port_get");
+			continue;
+		}
+
+		/* A user event is only a nudge to apply pending updates */
+		if (pev.portev_source == PORT_SOURCE_USER)
+			continue;
+
+		/* Handle reported event */
+		mevent_handle_pe(&pev);
+	}
+
+	return (NULL);
+}
 #endif
 
 static struct mevent *
@@ -449,6 +592,10 @@ mevent_add_state(int tfd, enum ev_type type,
 
 	mevp = NULL;
 
+#ifndef __FreeBSD__
+	(void) pthread_once(&mevent_once, mevent_init);
+#endif
+
 	mevent_qlock();
 
 	/*
@@ -461,12 +608,23 @@ mevent_add_state(int tfd, enum ev_type type,
 		}
 	}
 
+#ifdef __FreeBSD__
 	LIST_FOREACH(lp, &change_head, me_list) {
 		if (type != EVF_TIMER && lp->me_fd == tfd &&
 		    lp->me_type == type) {
 			goto exit;
 		}
 	}
+#else
+	for (uint_t i = 0; i < mevent_nworkers; i++) {
+		LIST_FOREACH(lp, &mevent_workers[i].mw_change_head, me_list) {
+			if (type != EVF_TIMER && lp->me_fd == tfd &&
+			    lp->me_type == type) {
+				goto exit;
+			}
+		}
+	}
+#endif
 
 	/*
 	 * Allocate an entry, populate it, and add it to the change list.
@@ -484,11 +642,16 @@ mevent_add_state(int tfd, enum ev_type type,
 	mevp->me_type = type;
 	mevp->me_func = func;
 	mevp->me_param = param;
+#ifndef __FreeBSD__
+	mevp->me_worker = mevent_worker_pick(param);
+	mevp->me_notify.portnfy_port = mevp->me_worker->mw_portfd;
+	mevp->me_notify.portnfy_user = mevp;
+#endif
 
-	LIST_INSERT_HEAD(&change_head, mevp, me_list);
+	LIST_INSERT_HEAD(mevent_change_head(mevp), mevp, me_list);
 	mevp->me_cq = 1;
 	mevp->me_state = state;
-	mevent_notify();
+	mevent_notify(mevp);
 
 exit:
 	mevent_qunlock();
@@ -546,8 +709,9 @@ mevent_update(struct mevent *evp, bool enable)
 		if (evp->me_cq == 0) {
 			evp->me_cq = 1;
 			LIST_REMOVE(evp, me_list);
-			LIST_INSERT_HEAD(&change_head, evp, me_list);
-			mevent_notify();
+			LIST_INSERT_HEAD(mevent_change_head(evp), evp,
+			    me_list);
+			mevent_notify(evp);
 		}
 	}
 
@@ -582,8 +746,8 @@ mevent_delete_event(struct mevent *evp, int closefd)
         if (evp->me_cq == 0) {
 		evp->me_cq = 1;
 		LIST_REMOVE(evp, me_list);
-		LIST_INSERT_HEAD(&change_head, evp, me_list);
-		mevent_notify();
+		LIST_INSERT_HEAD(mevent_change_head(evp), evp, me_list);
+		mevent_notify(evp);
         }
 	evp->me_state = EV_DELETE;
 
@@ -609,6 +773,7 @@ mevent_delete_close(struct mevent *evp)
 	return (mevent_delete_event(evp, 1));
 }
 
+#ifdef __FreeBSD__
 static void
 mevent_set_name(void)
 {
@@ -619,16 +784,11 @@ mevent_set_name(void)
 void
 mevent_dispatch(void)
 {
-#ifdef __FreeBSD__
 	struct kevent changelist[MEVENT_MAX];
 	struct kevent eventlist[MEVENT_MAX];
 	struct mevent *pipev;
 	int mfd;
 	int numev;
-#else
-	struct mevent *pipev;
-	int portfd;
-#endif
 	int ret;
 #ifndef WITHOUT_CAPSICUM
 	cap_rights_t rights;
@@ -637,13 +797,8 @@ mevent_dispatch(void)
 	mevent_tid = pthread_self();
 	mevent_set_name();
 
-#ifdef __FreeBSD__
 	mfd = kqueue();
 	assert(mfd > 0);
-#else
-	portfd = port_create();
-	assert(portfd >= 0);
-#endif
 
 #ifndef WITHOUT_CAPSICUM
 	cap_rights_init(&rights, CAP_KQUEUE);
@@ -677,7 +832,6 @@ mevent_dispatch(void)
 	assert(pipev != NULL);
 
 	for (;;) {
-#ifdef __FreeBSD__
 		/*
 		 * Build changelist if required.
 		 * XXX the changelist can be put into the blocking call
@@ -704,23 +858,28 @@ mevent_dispatch(void)
 		 * Handle reported events
 		 */
 		mevent_handle(eventlist, ret);
+	}			
+}
 
 #else /* __FreeBSD__ */
-		port_event_t pev;
 
-		/* Handle any pending updates */
-		mevent_update_pending(portfd);
+void
+mevent_dispatch(void)
+{
+	uint_t i;
 
-		/* Block awaiting events */
-		ret = port_get(portfd, &pev, NULL);
-		if (ret != 0) {
-			if (errno != EINTR)
-				perror("Error return from port_get");
-			continue;
+	(void) pthread_once(&mevent_once, mevent_init);
+
+	for (i = 1; i < mevent_nworkers; i++) {
+		pthread_t tid;
+
+		if (pthread_create(&tid, NULL, mevent_worker_thread,
+		    &mevent_workers[i]) != 0) {
+			errx(EX_OSERR, "Unable to create mevent worker");
 		}
+	}
 
-		/* Handle reported event */
-		mevent_handle_pe(&pev);
-#endif /* __FreeBSD__ */
-	}			
+	/* The calling thread becomes the first worker. */
+	(void) mevent_worker_thread(&mevent_workers[0]);
 }
+#endif /* __FreeBSD__ */
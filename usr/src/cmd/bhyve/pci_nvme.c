@@ -158,6 +158,8 @@ struct nvme_completion_queue {
 	uint16_t	head; /* guest progress */
 	uint16_t	intr_vec;
 	uint32_t	intr_en;
+	uint32_t	intr_pending;	/* posted since last interrupt */
+	u_int		inflight;	/* fetched, not yet completed */
 	pthread_mutex_t	mtx;
 };
 
@@ -542,6 +544,7 @@ pci_nvme_reset_locked(struct pci_nvme_softc *sc)
 
 			sc->compl_queues[i].tail = 0;
 			sc->compl_queues[i].head = 0;
+			sc->compl_queues[i].intr_pending = 0;
 		}
 	} else {
 		sc->compl_queues = calloc(sc->num_cqueues + 1,
@@ -734,7 +737,10 @@ nvme_opc_create_io_cq(struct pci_nvme_softc* sc, struct nvme_command* command,
 		}
 
 		ncq = &sc->compl_queues[qid];
-		ncq->intr_en = (command->cdw11 & NVME_CMD_CDW11_IEN) >> 1;
+		/* I/O queues coalesce unless the guest disables it */
+		ncq->intr_en = ((command->cdw11 & NVME_CMD_CDW11_IEN) >> 1) |
+		    NVME_CQ_INTCOAL;
+		ncq->intr_pending = 0;
 		ncq->intr_vec = (command->cdw11 >> 16) & 0xffff;
 		ncq->size = ONE_BASED((command->cdw10 >> 16) & 0xffff);
 
@@ -931,13 +937,14 @@ nvme_opc_set_features(struct pci_nvme_softc* sc, struct nvme_command* command,
 		        command->cdw11));
 
 		for (uint32_t i = 0; i < sc->num_cqueues + 1; i++) {
-			if (sc->compl_queues[i].intr_vec == iv) {
+			/* Bit 16 is Coalescing Disable (CD) */
+			if (i != 0 && sc->compl_queues[i].intr_vec == iv) {
 				if (command->cdw11 & (1 << 16))
-					sc->compl_queues[i].intr_en |=
-					                      NVME_CQ_INTCOAL;  
-				else
 					sc->compl_queues[i].intr_en &=
-					                     ~NVME_CQ_INTCOAL;  
+					    ~NVME_CQ_INTCOAL;
+				else
+					sc->compl_queues[i].intr_en |=
+					    NVME_CQ_INTCOAL;
 			}
 		}
 		break;
@@ -1280,7 +1287,8 @@ pci_nvme_set_completion(struct pci_nvme_softc *sc,
 {
 	struct nvme_completion_queue *cq = &sc->compl_queues[sq->cqid];
 	struct nvme_completion *compl;
-	int phase;
+	u_int inflight = 0;
+	int phase, intr;
 
 	DPRINTF(("%s sqid %d cqid %u cid %u status: 0x%x 0x%x",
 		 __func__, sqid, sq->cqid, cid, NVME_STATUS_GET_SCT(status),
@@ -1304,9 +1312,27 @@ pci_nvme_set_completion(struct pci_nvme_softc *sc,
 
 	cq->tail = (cq->tail + 1) % cq->size;
 
+	/*
+	 * Interrupt coalescing: hold the interrupt back until the guest's
+	 * aggregation threshold (a 0's based count) is reached, but never
+	 * past the completion of the last command outstanding on this
+	 * queue, so a deferred entry can't be left without an interrupt.
+	 * The aggregation time is not implemented; the outstanding commands
+	 * bound the delay instead.
+	 */
+	if (sq->cqid != 0)
+		inflight = atomic_fetchadd_int(&cq->inflight, -1) - 1;
+	if ((cq->intr_en & NVME_CQ_INTCOAL) && inflight != 0 &&
+	    ++cq->intr_pending <= sc->intr_coales_aggr_thresh) {
+		intr = 0;
+	} else {
+		cq->intr_pending = 0;
+		intr = 1;
+	}
+
 	pthread_mutex_unlock(&cq->mtx);
 
-	if (cq->head != cq->tail) {
+	if (intr && cq->head != cq->tail) {
 		if (cq->intr_en & NVME_CQ_INTEN) {
 			pci_generate_msix(sc->nsc_pi, cq->intr_vec);
 		} else {
@@ -1551,6 +1577,10 @@ pci_nvme_handle_io_cmd(struct pci_nvme_softc* sc, uint16_t idx)
 		cmd = &sq->qbase[sqhead];
 		sqhead = (sqhead + 1) % sq->size;
 
+		/* Each command fetched gets one pci_nvme_set_completion() */
+		(void) atomic_fetchadd_int(&sc->compl_queues[sq->cqid].inflight,
+		    1);
+
 		lba = ((uint64_t)cmd->cdw11 << 32) | cmd->cdw10;
 
 		if (cmd->opc == NVME_OPC_FLUSH) {
@@ -104,6 +104,7 @@ _Static_assert(VTBLK_RINGSZ <= BLOCKIF_RING_MAX, "Each ring entry must be able t
     VTBLK_F_BLK_SIZE |						    \
     VTBLK_F_FLUSH    |						    \
     VTBLK_F_TOPOLOGY |						    \
+    VIRTIO_RING_F_EVENT_IDX |	/* event-index kick/intr suppression */	    \
     VIRTIO_RING_F_INDIRECT_DESC )	/* indirect descriptors */
 
 /*
@@ -411,8 +412,18 @@ pci_vtblk_notify(void *vsc, struct vqueue_info *vq)
 {
 	struct pci_vtblk_softc *sc = vsc;
 
-	while (vq_has_descs(vq))
-		pci_vtblk_proc(sc, vq);
+	/*
+	 * Each guest kick is a VM exit.  Suppress further kicks while the
+	 * ring is being drained, and check it once more after re-enabling
+	 * them to close the race with a guest adding descriptors just as
+	 * we finish.
+	 */
+	do {
+		vq_kick_disable(vq);
+		while (vq_has_descs(vq))
+			pci_vtblk_proc(sc, vq);
+		vq_kick_enable(vq);
+	} while (vq_has_descs(vq));
 }
 
 static int
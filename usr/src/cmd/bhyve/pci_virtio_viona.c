@@ -68,6 +68,7 @@
 #include "virtio.h"
 
 #define	VIONA_RINGSZ	1024
+#define	VIONA_CTLQ_SZ	64
 
 /*
  * PCI config-space register offsets
@@ -80,18 +81,35 @@
 #define	VIONA_R_CFG5	29
 #define	VIONA_R_CFG6	30
 #define	VIONA_R_CFG7	31
-#define	VIONA_R_MAX	31
+#define	VIONA_R_CFG8	32
+#define	VIONA_R_CFG9	33
+#define	VIONA_R_MAX	33
 
 #define	VIONA_REGSZ	VIONA_R_MAX+1
 
 /*
- * Queue definitions.
+ * Queue definitions.  The RX and TX queues of pair N are found at 2N and
+ * 2N + 1.  The control queue follows the last pair when VIRTIO_NET_F_MQ has
+ * been negotiated, and is at index 2 otherwise.
  */
 #define	VIONA_RXQ	0
 #define	VIONA_TXQ	1
 #define	VIONA_CTLQ	2
 
-#define	VIONA_MAXQ	3
+#define	VIONA_MAXQ	(VIONA_MAX_QUEUES + 1)
+#define	VIONA_CTLQ_MAXSEGS	8
+
+/*
+ * Feature bits and control queue commands handled here, rather than in viona
+ */
+#define	VIRTIO_NET_F_CTRL_VQ	(1 << 17)
+#define	VIRTIO_NET_F_MQ		(1 << 22)
+
+#define	VIRTIO_NET_CTRL_MQ		4
+#define	VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET	0
+
+#define	VIRTIO_NET_OK		0
+#define	VIRTIO_NET_ERR		1
 
 /*
  * Debug printf
@@ -118,13 +136,25 @@ struct pci_viona_softc {
 	char		vsc_linkname[MAXLINKNAMELEN];
 	uint32_t	vsc_feature_mask;
 	uint16_t	vsc_vq_size;
+	uint16_t	vsc_max_qpairs;
 
 	uint32_t	vsc_features;
 	uint8_t		vsc_macaddr[6];
 
 	uint64_t	vsc_pfn[VIONA_MAXQ];
 	uint16_t	vsc_msix_table_idx[VIONA_MAXQ];
+	uint16_t	vsc_msix_cfg_idx;
 	boolean_t	vsc_msix_active;
+
+	/* Control queue, emulated with the generic virtio ring helpers */
+	struct virtio_softc	vsc_ctlvs;
+	struct vqueue_info	vsc_ctlvq;
+};
+
+static struct virtio_consts viona_ctl_vc = {
+	.vc_name =	"viona-ctl",
+	.vc_nvq =	1,
+	.vc_hv_caps =	VIRTIO_RING_F_INDIRECT_DESC,
 };
 
 /*
@@ -141,28 +171,68 @@ pci_viona_iosize(struct pci_devinst *pi)
 		return (VIONA_REGSZ - (VTCFG_R_CFG1 - VTCFG_R_MSIX));
 }
 
+/*
+ * The control queue is only offered alongside multiqueue support.
+ */
+static boolean_t
+pci_viona_has_ctlq(struct pci_viona_softc *sc)
+{
+	return (sc->vsc_max_qpairs > 1);
+}
+
+static int
+pci_viona_ctlq(struct pci_viona_softc *sc)
+{
+	if ((sc->vsc_features & VIRTIO_NET_F_MQ) != 0) {
+		return (sc->vsc_max_qpairs * 2);
+	}
+	return (VIONA_CTLQ);
+}
+
+/*
+ * Is the queue one of the in-kernel viona rings?
+ */
+static boolean_t
+pci_viona_is_ring(struct pci_viona_softc *sc, int qnum)
+{
+	if (qnum == pci_viona_ctlq(sc)) {
+		return (B_FALSE);
+	}
+	if ((sc->vsc_features & VIRTIO_NET_F_MQ) != 0) {
+		return (qnum < sc->vsc_max_qpairs * 2);
+	}
+	return (qnum == VIONA_RXQ || qnum == VIONA_TXQ);
+}
+
 static uint16_t
 pci_viona_qsize(struct pci_viona_softc *sc, int qnum)
 {
-	/* XXX no ctl queue currently */
-	if (qnum == VIONA_CTLQ) {
+	if (qnum == pci_viona_ctlq(sc)) {
+		return (pci_viona_has_ctlq(sc) ? VIONA_CTLQ_SZ : 0);
+	}
+	if (!pci_viona_is_ring(sc, qnum)) {
 		return (0);
 	}
 
 	return (sc->vsc_vq_size);
 }
 
+static void
+pci_viona_ctlq_reset(struct pci_viona_softc *sc)
+{
+	sc->vsc_ctlvq.vq_flags = 0;
+	sc->vsc_ctlvq.vq_last_avail = 0;
+	sc->vsc_ctlvq.vq_next_used = 0;
+	sc->vsc_ctlvq.vq_save_used = 0;
+	sc->vsc_ctlvq.vq_pfn = 0;
+}
+
 static void
 pci_viona_ring_reset(struct pci_viona_softc *sc, int ring)
 {
 	assert(ring < VIONA_MAXQ);
 
-	switch (ring) {
-	case VIONA_RXQ:
-	case VIONA_TXQ:
-		break;
-	case VIONA_CTLQ:
-	default:
+	if (ring >= sc->vsc_max_qpairs * 2) {
 		return;
 	}
 
@@ -187,9 +257,19 @@ pci_viona_update_status(struct pci_viona_softc *sc, uint32_t value)
 {
 
 	if (value == 0) {
+		int i;
+
 		DPRINTF(("viona: device reset requested !\n"));
-		pci_viona_ring_reset(sc, VIONA_RXQ);
-		pci_viona_ring_reset(sc, VIONA_TXQ);
+		for (i = 0; i < sc->vsc_max_qpairs * 2; i++) {
+			pci_viona_ring_reset(sc, i);
+		}
+		pci_viona_ctlq_reset(sc);
+		sc->vsc_pfn[pci_viona_ctlq(sc)] = 0;
+		if (sc->vsc_max_qpairs > 1 &&
+		    ioctl(sc->vsc_vnafd, VNA_IOC_SET_QPAIRS, 1) != 0) {
+			WPRINTF(("ioctl viona set qpairs failed %d\n", errno));
+		}
+		sc->vsc_features = 0;
 	}
 
 	sc->vsc_status = value;
@@ -216,15 +296,15 @@ pci_viona_poll_thread(void *param)
 			}
 		}
 		if (pollset.revents & POLLRDBAND) {
-			vioc_intr_poll_t vip;
+			vioc_intr_poll_mq_t vipm;
 			uint_t i;
 			int res;
 			boolean_t assert_lintr = B_FALSE;
 			const boolean_t do_msix = pci_msix_enabled(sc->vsc_pi);
 
-			res = ioctl(fd, VNA_IOC_INTR_POLL, &vip);
-			for (i = 0; res > 0 && i < VIONA_VQ_MAX; i++) {
-				if (vip.vip_status[i] == 0) {
+			res = ioctl(fd, VNA_IOC_INTR_POLL_MQ, &vipm);
+			for (i = 0; res > 0 && i < vipm.vipm_nrings; i++) {
+				if (vipm.vipm_status[i] == 0) {
 					continue;
 				}
 				if (do_msix) {
@@ -260,7 +340,17 @@ pci_viona_ring_init(struct pci_viona_softc *sc, uint64_t pfn)
 
 	assert(qnum < VIONA_MAXQ);
 
-	if (qnum == VIONA_CTLQ) {
+	if (qnum == pci_viona_ctlq(sc)) {
+		if (pci_viona_has_ctlq(sc)) {
+			sc->vsc_pfn[qnum] = (pfn << VRING_PFN);
+			sc->vsc_ctlvq.vq_qsize = VIONA_CTLQ_SZ;
+			sc->vsc_ctlvq.vq_msix_idx =
+			    sc->vsc_msix_table_idx[qnum];
+			vi_vq_init(&sc->vsc_ctlvs, pfn);
+		}
+		return;
+	}
+	if (!pci_viona_is_ring(sc, qnum)) {
 		return;
 	}
 
@@ -307,6 +397,7 @@ pci_viona_parse_opts(struct pci_viona_softc *sc, char *opts)
 	int err = 0;
 
 	sc->vsc_vq_size = VIONA_RINGSZ;
+	sc->vsc_max_qpairs = 1;
 	sc->vsc_feature_mask = 0;
 
 	for (; opts != NULL && *opts != '\0'; opts = next) {
@@ -365,6 +456,19 @@ pci_viona_parse_opts(struct pci_viona_softc *sc, char *opts)
 			} else {
 				sc->vsc_vq_size = num;
 			}
+		} else if (strcmp(opts, "qpairs") == 0) {
+			long num;
+
+			errno = 0;
+			num = strtol(val, NULL, 0);
+			if (errno != 0 || num < 1 || num > VIONA_MAX_QPAIRS) {
+				fprintf(stderr,
+				    "viona: qpairs must be between 1 and %d",
+				    VIONA_MAX_QPAIRS);
+				err = -1;
+			} else {
+				sc->vsc_max_qpairs = num;
+			}
 		} else {
 			fprintf(stderr,
 			    "viona: unrecognized option '%s'", opts);
@@ -379,8 +483,9 @@ pci_viona_parse_opts(struct pci_viona_softc *sc, char *opts)
 		(void) strlcpy(sc->vsc_linkname, vnic, MAXLINKNAMELEN);
 	}
 
-	DPRINTF(("viona=%p dev=%s vqsize=%x feature_mask=%x\n", sc,
-	    sc->vsc_linkname, sc->vsc_vq_size, sc->vsc_feature_mask));
+	DPRINTF(("viona=%p dev=%s vqsize=%x qpairs=%u feature_mask=%x\n", sc,
+	    sc->vsc_linkname, sc->vsc_vq_size, sc->vsc_max_qpairs,
+	    sc->vsc_feature_mask));
 	return (err);
 }
 
@@ -457,12 +562,22 @@ pci_viona_init(struct vmctx *ctx, struct pci_devinst *pi, char *opts)
 	pci_set_cfgdata16(pi, PCIR_SUBDEV_0, VIRTIO_TYPE_NET);
 	pci_set_cfgdata16(pi, PCIR_SUBVEND_0, VIRTIO_VENDOR);
 
+	/* Control queue state */
+	sc->vsc_ctlvs.vs_vc = &viona_ctl_vc;
+	sc->vsc_ctlvs.vs_pi = pi;
+	sc->vsc_ctlvs.vs_queues = &sc->vsc_ctlvq;
+	sc->vsc_ctlvq.vq_vs = &sc->vsc_ctlvs;
+
 	/* MSI-X support */
 	for (i = 0; i < VIONA_MAXQ; i++)
 		sc->vsc_msix_table_idx[i] = VIRTIO_MSI_NO_VECTOR;
+	sc->vsc_msix_cfg_idx = VIRTIO_MSI_NO_VECTOR;
 
-	/* BAR 1 used to map MSI-X table and PBA */
-	if (pci_emul_add_msixcap(pi, VIONA_MAXQ, 1)) {
+	/*
+	 * BAR 1 used to map MSI-X table and PBA.  Provide a vector for each
+	 * queue (including the control queue) plus one for config changes.
+	 */
+	if (pci_emul_add_msixcap(pi, sc->vsc_max_qpairs * 2 + 2, 1)) {
 		free(sc);
 		return (1);
 	}
@@ -517,7 +632,7 @@ pci_viona_ring_set_msix(struct pci_devinst *pi, uint_t ring)
 	vioc_ring_msi_t vrm;
 	int res;
 
-	assert(ring <= VIONA_VQ_TX);
+	assert(ring < sc->vsc_max_qpairs * 2);
 
 	vrm.rm_index = ring;
 	vrm.rm_addr = 0;
@@ -552,7 +667,7 @@ pci_viona_lintrupdate(struct pci_devinst *pi)
 
 		sc->vsc_msix_active = msix_on;
 		/* Update in-kernel ring configs */
-		for (i = 0; i <= VIONA_VQ_TX; i++) {
+		for (i = 0; i < sc->vsc_max_qpairs * 2; i++) {
 			pci_viona_ring_set_msix(pi, i);
 		}
 	}
@@ -579,7 +694,7 @@ pci_viona_msix_update(struct pci_devinst *pi, uint64_t offset)
 	 */
 	tab_index = offset / MSIX_TABLE_ENTRY_SIZE;
 
-	for (i = 0; i <= VIONA_VQ_TX; i++) {
+	for (i = 0; i < sc->vsc_max_qpairs * 2; i++) {
 		if (sc->vsc_msix_table_idx[i] != tab_index) {
 			continue;
 		}
@@ -589,25 +704,119 @@ pci_viona_msix_update(struct pci_devinst *pi, uint64_t offset)
 	pthread_mutex_unlock(&sc->vsc_mtx);
 }
 
+/*
+ * Handle a single control queue command, returning the status to be written
+ * into its ack byte.
+ */
+static uint8_t
+pci_viona_ctl_cmd(struct pci_viona_softc *sc, const uint8_t *cmd, size_t len)
+{
+	uint16_t npairs;
+
+	if (len < 2) {
+		return (VIRTIO_NET_ERR);
+	}
+
+	switch (cmd[0]) {
+	case VIRTIO_NET_CTRL_MQ:
+		if (cmd[1] != VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET ||
+		    len < 2 + sizeof (npairs) ||
+		    (sc->vsc_features & VIRTIO_NET_F_MQ) == 0) {
+			return (VIRTIO_NET_ERR);
+		}
+		memcpy(&npairs, &cmd[2], sizeof (npairs));
+		if (npairs < 1 || npairs > sc->vsc_max_qpairs) {
+			return (VIRTIO_NET_ERR);
+		}
+		if (ioctl(sc->vsc_vnafd, VNA_IOC_SET_QPAIRS, npairs) != 0) {
+			WPRINTF(("ioctl viona set qpairs %u failed %d\n",
+			    npairs, errno));
+			return (VIRTIO_NET_ERR);
+		}
+		DPRINTF(("viona: %u queue pairs active\n", npairs));
+		return (VIRTIO_NET_OK);
+	default:
+		DPRINTF(("viona: unsupported control class %u\n", cmd[0]));
+		return (VIRTIO_NET_ERR);
+	}
+}
+
+/*
+ * Process the control queue.  Each request is a header (class and command)
+ * and its payload in guest-readable descriptors, followed by a single
+ * guest-writable ack byte.
+ */
+static void
+pci_viona_ctl_process(struct pci_viona_softc *sc)
+{
+	struct vqueue_info *vq = &sc->vsc_ctlvq;
+	struct iovec iov[VIONA_CTLQ_MAXSEGS];
+	uint16_t flags[VIONA_CTLQ_MAXSEGS];
+	boolean_t used = B_FALSE;
+
+	if (!vq_ring_ready(vq)) {
+		return;
+	}
+
+	while (vq_has_descs(vq)) {
+		uint8_t cmd[64];
+		size_t len = 0;
+		uint16_t idx;
+		int i, n;
+
+		n = vq_getchain(vq, &idx, iov, VIONA_CTLQ_MAXSEGS, flags);
+		if (n <= 0) {
+			break;
+		}
+		if (n < 2 || (flags[n - 1] & VRING_DESC_F_WRITE) == 0 ||
+		    iov[n - 1].iov_len < 1) {
+			WPRINTF(("viona: malformed control request\n"));
+			vq_relchain(vq, idx, 0);
+			used = B_TRUE;
+			continue;
+		}
+
+		for (i = 0; i < n - 1; i++) {
+			size_t chunk = MIN(iov[i].iov_len, sizeof (cmd) - len);
+
+			if ((flags[i] & VRING_DESC_F_WRITE) != 0) {
+				break;
+			}
+			memcpy(&cmd[len], iov[i].iov_base, chunk);
+			len += chunk;
+		}
+
+		*(uint8_t *)iov[n - 1].iov_base = pci_viona_ctl_cmd(sc, cmd,
+		    len);
+		vq_relchain(vq, idx, sizeof (uint8_t));
+		used = B_TRUE;
+	}
+
+	if (!used ||
+	    (vq->vq_avail->va_flags & VRING_AVAIL_F_NO_INTERRUPT) != 0) {
+		return;
+	}
+	if (pci_msix_enabled(sc->vsc_pi)) {
+		pci_generate_msix(sc->vsc_pi, vq->vq_msix_idx);
+	} else {
+		sc->vsc_isr |= VTCFG_ISR_QUEUES;
+		pci_lintr_assert(sc->vsc_pi);
+	}
+}
+
 static void
 pci_viona_qnotify(struct pci_viona_softc *sc, int ring)
 {
 	int error;
 
-	switch (ring) {
-	case VIONA_TXQ:
-	case VIONA_RXQ:
+	if (ring == pci_viona_ctlq(sc)) {
+		pci_viona_ctl_process(sc);
+	} else if (pci_viona_is_ring(sc, ring)) {
 		error = ioctl(sc->vsc_vnafd, VNA_IOC_RING_KICK, ring);
 		if (error != 0) {
 			WPRINTF(("ioctl viona ring %d kick failed %d\n",
 			    ring, errno));
 		}
-		break;
-	case VIONA_CTLQ:
-		DPRINTF(("viona: control qnotify!\n"));
-		break;
-	default:
-		break;
 	}
 }
 
@@ -671,13 +880,16 @@ pci_viona_write(struct vmctx *ctx, int vcpu, struct pci_devinst *pi,
 		break;
 	case VTCFG_R_CFGVEC:
 		assert(size == 2);
-		sc->vsc_msix_table_idx[VIONA_CTLQ] = value;
+		sc->vsc_msix_cfg_idx = value;
 		break;
 	case VTCFG_R_QVEC:
 		assert(size == 2);
-		assert(sc->vsc_curq != VIONA_CTLQ);
 		sc->vsc_msix_table_idx[sc->vsc_curq] = value;
-		pci_viona_ring_set_msix(pi, sc->vsc_curq);
+		if (sc->vsc_curq == pci_viona_ctlq(sc)) {
+			sc->vsc_ctlvq.vq_msix_idx = value;
+		} else if (pci_viona_is_ring(sc, sc->vsc_curq)) {
+			pci_viona_ring_set_msix(pi, sc->vsc_curq);
+		}
 		break;
 	case VIONA_R_CFG0:
 	case VIONA_R_CFG1:
@@ -704,6 +916,8 @@ pci_viona_write(struct vmctx *ctx, int vcpu, struct pci_devinst *pi,
 	case VTCFG_R_ISR:
 	case VIONA_R_CFG6:
 	case VIONA_R_CFG7:
+	case VIONA_R_CFG8:
+	case VIONA_R_CFG9:
 		DPRINTF(("viona: write to readonly reg %ld\n\r", offset));
 		break;
 	default:
@@ -749,6 +963,15 @@ pci_viona_read(struct vmctx *ctx, int vcpu, struct pci_devinst *pi,
 			WPRINTF(("ioctl get host features returned"
 			    " err = %d\n", errno));
 		}
+		/*
+		 * Offer multiqueue, and the control queue it requires, only
+		 * when more than one queue pair has been configured.
+		 */
+		if (pci_viona_has_ctlq(sc) && (value & VIRTIO_NET_F_MQ) != 0) {
+			value |= VIRTIO_NET_F_CTRL_VQ;
+		} else {
+			value &= ~VIRTIO_NET_F_MQ;
+		}
 		value &= ~sc->vsc_feature_mask;
 		break;
 	case VTCFG_R_GUESTCAP:
@@ -785,11 +1008,10 @@ pci_viona_read(struct vmctx *ctx, int vcpu, struct pci_devinst *pi,
 		break;
 	case VTCFG_R_CFGVEC:
 		assert(size == 2);
-		value = sc->vsc_msix_table_idx[VIONA_CTLQ];
+		value = sc->vsc_msix_cfg_idx;
 		break;
 	case VTCFG_R_QVEC:
 		assert(size == 2);
-		assert(sc->vsc_curq != VIONA_CTLQ);
 		value = sc->vsc_msix_table_idx[sc->vsc_curq];
 		break;
 	case VIONA_R_CFG0:
@@ -816,6 +1038,15 @@ pci_viona_read(struct vmctx *ctx, int vcpu, struct pci_devinst *pi,
 		assert(size == 1);
 		value = 0;	/* XXX link status in LSB */
 		break;
+	case VIONA_R_CFG8:
+		/* max_virtqueue_pairs */
+		value = (size == 1) ? (sc->vsc_max_qpairs & 0xff) :
+		    sc->vsc_max_qpairs;
+		break;
+	case VIONA_R_CFG9:
+		assert(size == 1);
+		value = sc->vsc_max_qpairs >> 8;
+		break;
 	default:
 		DPRINTF(("viona: unknown i/o read offset %ld\n\r", offset));
 		value = 0;
@@ -465,15 +465,23 @@ vq_interrupt(struct virtio_softc *vs, struct vqueue_info *vq)
 	}
 }
 
+/*
+ * With EVENT_IDX the guest ignores VRING_USED_F_NO_NOTIFY and instead
+ * kicks only when its avail index moves past <avail_event>.  Leaving
+ * that field behind vq_last_avail while kicks are "disabled" keeps the
+ * guest quiet; vq_kick_enable() brings it up to date again.
+ */
 static inline void
 vq_kick_enable(struct vqueue_info *vq)
 {
 
 	vq->vq_used->vu_flags &= ~VRING_USED_F_NO_NOTIFY;
+	if (vq->vq_vs->vs_negotiated_caps & VIRTIO_RING_F_EVENT_IDX)
+		VQ_AVAIL_EVENT_IDX(vq) = vq->vq_last_avail;
 	/*
 	 * Full memory barrier to make sure the store to vu_flags
-	 * happens before the load from va_idx, which results from
-	 * a subsequent call to vq_has_descs().
+	 * (or avail_event) happens before the load from va_idx, which
+	 * results from a subsequent call to vq_has_descs().
 	 */
 	atomic_thread_fence_seq_cst();
 }
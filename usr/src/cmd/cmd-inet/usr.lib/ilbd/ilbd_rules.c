@@ -21,6 +21,7 @@
 
 /*
  * Copyright (c) 2009, 2010, Oracle and/or its affiliates. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <stdlib.h>
@@ -74,6 +75,8 @@ algo_impl2lib(ilb_algo_impl_t a)
 		return (ILB_ALG_HASH_IP_SPORT);
 	case ILB_ALG_IMPL_HASH_IP_VIP:
 		return (ILB_ALG_HASH_IP_VIP);
+	case ILB_ALG_IMPL_MAGLEV:
+		return (ILB_ALG_MAGLEV);
 	}
 	return (0);
 }
@@ -104,6 +107,8 @@ algo_lib2impl(ilb_algo_t a)
 		return (ILB_ALG_IMPL_HASH_IP_SPORT);
 	case ILB_ALG_HASH_IP_VIP:
 		return (ILB_ALG_IMPL_HASH_IP_VIP);
+	case ILB_ALG_MAGLEV:
+		return (ILB_ALG_IMPL_MAGLEV);
 	}
 	return (0);
 }
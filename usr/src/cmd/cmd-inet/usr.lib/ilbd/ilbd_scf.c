@@ -21,6 +21,7 @@
 
 /*
  * Copyright (c) 2009, 2010, Oracle and/or its affiliates. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <stdlib.h>
@@ -319,7 +320,8 @@ struct algo_tbl_entry {
 	{ILB_ALG_ROUNDROBIN, "ROUNDROBIN"},
 	{ILB_ALG_HASH_IP, "HASH-IP"},
 	{ILB_ALG_HASH_IP_SPORT, "HASH-IP-PORT"},
-	{ILB_ALG_HASH_IP_VIP, "HASH-IP-VIP"}
+	{ILB_ALG_HASH_IP_VIP, "HASH-IP-VIP"},
+	{ILB_ALG_MAGLEV, "MAGLEV"}
 };
 
 #define	ILBD_ALGO_TBL_SIZE (sizeof (algo_tbl) / \
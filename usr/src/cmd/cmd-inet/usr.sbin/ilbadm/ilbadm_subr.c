@@ -23,6 +23,7 @@
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
  * Copyright 2012 Milan Jurik. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <stdio.h>
@@ -54,6 +55,7 @@ ilbadm_val_type_t algo_types[] = {
 	{(int)ILB_ALG_HASH_IP, "hash-ip", "hip"},
 	{(int)ILB_ALG_HASH_IP_SPORT, "hash-ip-port", "hipp"},
 	{(int)ILB_ALG_HASH_IP_VIP, "hash-ip-vip", "hipv"},
+	{(int)ILB_ALG_MAGLEV, "maglev", "mglv"},
 	{ILBD_BAD_VAL, 0, 0}
 };
 
@@ -289,6 +289,8 @@ typedef struct rx_lane_fields_buf_s {
 	char rl_chl10[MAXSTATLEN];
 	char rl_ch10_50[MAXSTATLEN];
 	char rl_chg50[MAXSTATLEN];
+	char rl_lropkts[MAXSTATLEN];
+	char rl_lrosegs[MAXSTATLEN];
 } rx_lane_fields_buf_t;
 
 static ofmt_field_t rx_lane_s_fields[] = {
@@ -316,6 +318,10 @@ static ofmt_field_t rx_lane_s_fields[] = {
     offsetof(rx_lane_fields_buf_t, rl_ch10_50),		print_default_cb},
 { "CH>50",	8,
     offsetof(rx_lane_fields_buf_t, rl_chg50),		print_default_cb},
+{ "LROPKTS",	8,
+    offsetof(rx_lane_fields_buf_t, rl_lropkts),		print_default_cb},
+{ "LROSEGS",	8,
+    offsetof(rx_lane_fields_buf_t, rl_lrosegs),		print_default_cb},
 { NULL,		0,		0,		NULL}};
 
 /*
@@ -1288,6 +1294,12 @@ print_rx_lane_stats(const char *linkname, const char *zonename, void *statentry,
 	map_to_units(buf->rl_chg50, sizeof (buf->rl_chg50),
 	    link_stats->rl_chg50, unit, parsable);
 
+	map_to_units(buf->rl_lropkts, sizeof (buf->rl_lropkts),
+	    link_stats->rl_lropkts, unit, parsable);
+
+	map_to_units(buf->rl_lrosegs, sizeof (buf->rl_lrosegs),
+	    link_stats->rl_lrosegs, unit, parsable);
+
 done:
 	return (buf);
 }
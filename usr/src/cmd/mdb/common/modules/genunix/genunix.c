@@ -2140,7 +2140,8 @@ static datafmt_t kmemfmt[] = {
 	{ "      buf",	"    total",	"---------",	"%9u "		},
 	{ "memory",	"in use",	"------",	"%6lH "		},
 	{ "     alloc",	"   succeed",	"----------",	"%10u "		},
-	{ "alloc",	" fail",	"-----",	"%5u"		},
+	{ "alloc",	" fail",	"-----",	"%5u "		},
+	{ "remote",	"  free",	"------",	"%6llu"		},
 	{ NULL,		NULL,		NULL,		NULL		}
 };
 
@@ -2208,6 +2209,9 @@ kmastat_cache(uintptr_t addr, const kmem_cache_t *cp, kmastat_vmem_t **kvpp)
 	kmastat_vmem_t *kv;
 	datafmt_t *dfp = kmemfmt;
 	int magsize;
+	kmem_lgrp_depot_t *kld;
+	uint_t i, ndepot;
+	uint64_t remote = 0;
 
 	int avail, alloc, total;
 	size_t meminuse = (cp->cache_slab_create - cp->cache_slab_destroy) *
@@ -2223,6 +2227,13 @@ kmastat_cache(uintptr_t addr, const kmem_cache_t *cp, kmastat_vmem_t **kvpp)
 	avail = cp->cache_full.ml_total * magsize;
 	total = cp->cache_buftotal;
 
+	ndepot = kmem_read_lgrp_depots(cp, &kld, UM_SLEEP | UM_GC);
+	for (i = 0; i < ndepot; i++) {
+		alloc += kld[i].kld_full.ml_alloc;
+		avail += kld[i].kld_full.ml_total * magsize;
+		remote += kld[i].kld_remote;
+	}
+
 	(void) mdb_pwalk("kmem_cpu_cache", cpu_alloc, &alloc, addr);
 	(void) mdb_pwalk("kmem_cpu_cache", cpu_avail, &avail, addr);
 	(void) mdb_pwalk("kmem_slab_partial", slab_avail, &avail, addr);
@@ -2248,6 +2259,7 @@ out:
 	mdb_printf((dfp++)->fmt, meminuse);
 	mdb_printf((dfp++)->fmt, alloc);
 	mdb_printf((dfp++)->fmt, cp->cache_alloc_fail);
+	mdb_printf((dfp++)->fmt, remote);
 	mdb_printf("\n");
 
 	return (WALK_NEXT);
@@ -34,6 +34,7 @@
 #include <mdb/mdb_whatis.h>
 #include <sys/cpuvar.h>
 #include <sys/kmem_impl.h>
+#include <sys/lgrp.h>
 #include <sys/vmem_impl.h>
 #include <sys/machelf.h>
 #include <sys/modctl.h>
@@ -935,6 +936,44 @@ kmem_estimate_slab(uintptr_t addr, const kmem_slab_t *sp, size_t *est)
 	return (WALK_NEXT);
 }
 
+/*
+ * Read cp's per-lgroup depots into *kldp and return how many there are.
+ * Returns 0, with *kldp set to NULL, if the cache has none or they can't be
+ * read.  Unless alloc_flags includes UM_GC, the caller frees *kldp.
+ */
+uint_t
+kmem_read_lgrp_depots(const kmem_cache_t *cp, kmem_lgrp_depot_t **kldp,
+    int alloc_flags)
+{
+	uint_t ndepot = cp->cache_lgrp_ndepot;
+	kmem_lgrp_depot_t *kld;
+
+	*kldp = NULL;
+	if (ndepot == 0 || cp->cache_lgrp_depot == NULL)
+		return (0);
+
+	if (ndepot > NLGRPS_MAX) {
+		mdb_warn("cache '%s' has invalid lgroup depot count (%u)\n",
+		    cp->cache_name, ndepot);
+		return (0);
+	}
+
+	if ((kld = mdb_alloc(ndepot * sizeof (*kld), alloc_flags)) == NULL)
+		return (0);
+
+	if (mdb_vread(kld, ndepot * sizeof (*kld),
+	    (uintptr_t)cp->cache_lgrp_depot) == -1) {
+		mdb_warn("couldn't read lgroup depots at %p",
+		    cp->cache_lgrp_depot);
+		if (!(alloc_flags & UM_GC))
+			mdb_free(kld, ndepot * sizeof (*kld));
+		return (0);
+	}
+
+	*kldp = kld;
+	return (ndepot);
+}
+
 /*
  * Returns an upper bound on the number of allocated buffers in a given
  * cache.
@@ -944,6 +983,8 @@ kmem_estimate_allocated(uintptr_t addr, const kmem_cache_t *cp)
 {
 	int magsize;
 	size_t cache_est;
+	kmem_lgrp_depot_t *kld;
+	uint_t i, ndepot;
 
 	cache_est = cp->cache_buftotal;
 
@@ -953,6 +994,10 @@ kmem_estimate_allocated(uintptr_t addr, const kmem_cache_t *cp)
 	if ((magsize = kmem_get_magsize(cp)) != 0) {
 		size_t mag_est = cp->cache_full.ml_total * magsize;
 
+		ndepot = kmem_read_lgrp_depots(cp, &kld, UM_SLEEP | UM_GC);
+		for (i = 0; i < ndepot; i++)
+			mag_est += kld[i].kld_full.ml_total * magsize;
+
 		if (cache_est >= mag_est) {
 			cache_est -= mag_est;
 		} else {
@@ -983,10 +1028,13 @@ kmem_read_magazines(kmem_cache_t *cp, uintptr_t addr, int ncpus,
     void ***maglistp, size_t *magcntp, size_t *magmaxp, int alloc_flags)
 {
 	kmem_magazine_t *kmp, *mp;
+	kmem_lgrp_depot_t *kld = NULL;
 	void **maglist = NULL;
 	int i, cpu;
+	uint_t d, ndepot = 0;
 	size_t magsize, magmax, magbsize;
 	size_t magcnt = 0;
+	long nfull;
 
 	/*
 	 * Read the magtype out of the cache, after verifying the pointer's
@@ -1007,17 +1055,23 @@ kmem_read_magazines(kmem_cache_t *cp, uintptr_t addr, int ncpus,
 	 *
 	 * For an upper bound on the number of buffers in the magazine
 	 * layer, we have the number of magazines on the cache_full
-	 * list plus at most two magazines per CPU (the loaded and the
-	 * spare).  Toss in 100 magazines as a fudge factor in case this
-	 * is live (the number "100" comes from the same fudge factor in
-	 * crash(1M)).
+	 * list and the per-lgroup full lists plus at most two magazines
+	 * per CPU (the loaded and the spare).  Toss in 100 magazines as a
+	 * fudge factor in case this is live (the number "100" comes from
+	 * the same fudge factor in crash(1M)).
 	 */
-	magmax = (cp->cache_full.ml_total + 2 * ncpus + 100) * magsize;
+	nfull = cp->cache_full.ml_total;
+	ndepot = kmem_read_lgrp_depots(cp, &kld, alloc_flags);
+	for (d = 0; d < ndepot; d++)
+		nfull += kld[d].kld_full.ml_total;
+	magmax = (nfull + 2 * ncpus + 100) * magsize;
 	magbsize = offsetof(kmem_magazine_t, mag_round[magsize]);
 
 	if (magbsize >= PAGESIZE / 2) {
 		mdb_warn("magazine size for cache %p unreasonable (%x)\n",
 		    addr, magbsize);
+		if (kld != NULL && !(alloc_flags & UM_GC))
+			mdb_free(kld, ndepot * sizeof (kmem_lgrp_depot_t));
 		return (WALK_ERR);
 	}
 
@@ -1039,6 +1093,18 @@ kmem_read_magazines(kmem_cache_t *cp, uintptr_t addr, int ncpus,
 
 	dprintf(("cache_full list done\n"));
 
+	for (d = 0; d < ndepot; d++) {
+		for (kmp = kld[d].kld_full.ml_list; kmp != NULL; ) {
+			READMAG_ROUNDS(magsize);
+			kmp = mp->mag_next;
+
+			if (kmp == kld[d].kld_full.ml_list)
+				break; /* kld_full list loop detected */
+		}
+	}
+
+	dprintf(("lgroup depot lists done\n"));
+
 	/*
 	 * Now whip through the CPUs, snagging the loaded magazines
 	 * and full spares.
@@ -1077,8 +1143,11 @@ kmem_read_magazines(kmem_cache_t *cp, uintptr_t addr, int ncpus,
 
 	dprintf(("magazine layer: %d buffers\n", magcnt));
 
-	if (!(alloc_flags & UM_GC))
+	if (!(alloc_flags & UM_GC)) {
 		mdb_free(mp, magbsize);
+		if (kld != NULL)
+			mdb_free(kld, ndepot * sizeof (kmem_lgrp_depot_t));
+	}
 
 	*maglistp = maglist;
 	*magcntp = magcnt;
@@ -1092,6 +1161,8 @@ fail:
 			mdb_free(mp, magbsize);
 		if (maglist)
 			mdb_free(maglist, magmax * sizeof (void *));
+		if (kld != NULL)
+			mdb_free(kld, ndepot * sizeof (kmem_lgrp_depot_t));
 	}
 	return (WALK_ERR);
 }
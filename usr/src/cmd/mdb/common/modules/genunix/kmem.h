@@ -113,6 +113,8 @@ extern void kmem_init(void);
 extern void kmem_statechange(void);
 extern int kmem_get_magsize(const kmem_cache_t *);
 extern size_t kmem_estimate_allocated(uintptr_t, const kmem_cache_t *);
+extern uint_t kmem_read_lgrp_depots(const kmem_cache_t *,
+    kmem_lgrp_depot_t **, int);
 
 #ifdef	__cplusplus
 }
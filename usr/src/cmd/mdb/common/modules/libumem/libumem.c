@@ -24,7 +24,7 @@
  */
 
 /*
- * Copyright (c) 2012, Joyent, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include "umem.h"
@@ -76,6 +76,7 @@ static datafmt_t vmemfmt[] = {
 	{ "   memory",	"   in use",	"---------",	"%9H "		},
 	{ "    memory",	"     total",	"----------",	"%10H "		},
 	{ "   memory",	"   import",	"---------",	"%9H "		},
+	{ "   memory",	" released",	"---------",	"%9H "		},
 	{ "    alloc",	"  succeed",	"---------",	"%9llu "	},
 	{ "alloc",	" fail",	"-----",	"%5llu "	},
 	{ NULL,		NULL,		NULL,		NULL		}
@@ -317,6 +318,7 @@ umastat_vmem(uintptr_t addr, const vmem_t *v, void *ignored)
 	mdb_printf((dfp++)->fmt, v->vm_kstat.vk_mem_inuse);
 	mdb_printf((dfp++)->fmt, v->vm_kstat.vk_mem_total);
 	mdb_printf((dfp++)->fmt, v->vm_kstat.vk_mem_import);
+	mdb_printf((dfp++)->fmt, v->vm_kstat.vk_mem_release);
 	mdb_printf((dfp++)->fmt, v->vm_kstat.vk_alloc);
 	mdb_printf((dfp++)->fmt, v->vm_kstat.vk_fail);
 
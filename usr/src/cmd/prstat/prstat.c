@@ -26,10 +26,11 @@
  * Use is subject to license terms.
  *
  * Portions Copyright 2009 Chad Mynhier
- * Copyright 2018 Joyent, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/resource.h>
 #include <sys/loadavg.h>
 #include <sys/time.h>
@@ -82,6 +83,9 @@
 #define	ZONE_WIDTH	28
 #define	PROJECT_WIDTH	28
 
+#define	PIDSTR_LEN	12	/* room for any pid_t, in decimal */
+#define	ALLPSINFO_SLACK	64	/* extra /proc/psinfo entries to allow for */
+
 #define	PSINFO_HEADER_PROC \
 "   PID USERNAME  SIZE   RSS STATE  PRI NICE      TIME  CPU PROCESS/NLWP       "
 #define	PSINFO_HEADER_PROC_LGRP \
@@ -295,8 +299,11 @@ list_getsize(list_t *list)
 		flags |= VMUSAGE_COL_PROJECTS;
 
 	} else if (opts.o_outpmode & OPT_ZONES) {
-		/* Gather rss for all zones */
-		flags |= VMUSAGE_ALL_ZONES;
+		/*
+		 * Gather rss for all zones, from the kernel's per-zone
+		 * counters rather than a walk of every process.
+		 */
+		flags |= VMUSAGE_ALL_ZONES | VMUSAGE_FAST;
 
 	} else {
 		Die(gettext(
@@ -337,7 +344,7 @@ list_getsize(list_t *list)
 		match = NULL;
 		next = results;
 		for (i = 0; i < nres; i++, next++) {
-			switch (flags) {
+			switch (flags & ~VMUSAGE_FAST) {
 			case VMUSAGE_COL_RUSERS:
 				if (next->vmu_id == id->id_uid)
 					match = next;
@@ -889,6 +896,53 @@ read_procfile(fd_t **fd, char *pidstr, char *file, void *buf, size_t bufsize)
 	return (0);
 }
 
+/*
+ * Read /proc/psinfo, which holds the psinfo of every process in /proc, in a
+ * single pread(2).  Returns NULL if the file is not there (or cannot be read),
+ * in which case the caller falls back to reading each /proc/<pid>/psinfo.
+ */
+static prheader_t *
+read_allpsinfo(void)
+{
+	static int fd = -2;
+	static char *buf = NULL;
+	static size_t bufsize = 0;
+	struct stat64 st;
+	prheader_t *php;
+	size_t want;
+	ssize_t n;
+
+	if (fd == -2)
+		fd = open("/proc/psinfo", O_RDONLY);
+	if (fd < 0 || fstat64(fd, &st) != 0)
+		return (NULL);
+
+	/*
+	 * Leave room for processes created since the fstat(); if the buffer
+	 * still fills up, grow it until the whole snapshot fits.
+	 */
+	want = st.st_size + ALLPSINFO_SLACK * sizeof (psinfo_t);
+	if (want > bufsize) {
+		free(buf);
+		buf = Malloc(want);
+		bufsize = want;
+	}
+	while ((n = pread(fd, buf, bufsize, 0)) == bufsize) {
+		free(buf);
+		bufsize *= 2;
+		buf = Malloc(bufsize);
+	}
+	if (n < (ssize_t)sizeof (prheader_t))
+		return (NULL);
+
+	/*LINTED ALIGNMENT*/
+	php = (prheader_t *)buf;
+	if (php->pr_entsize < sizeof (psinfo_t) ||
+	    sizeof (prheader_t) + php->pr_nent * php->pr_entsize > n)
+		return (NULL);
+	return (php);
+}
+
 static void
 add_proc(psinfo_t *psinfo)
 {
@@ -947,17 +1001,21 @@ static void
 prstat_scandir(DIR *procdir)
 {
 	char *pidstr;
+	char pidbuf[PIDSTR_LEN];
 	pid_t pid;
 	id_t lwpid;
 	size_t entsz;
 	long nlwps, nent, i;
+	long allnent = 0;
 	char *buf, *ptr;
+	char *allptr = NULL;
 
 	fds_t *fds;
 	lwp_info_t *lwp;
 	dirent_t *direntp;
 
 	prheader_t	header;
+	prheader_t	*allpsinfo;
 	psinfo_t	psinfo;
 	prusage_t	usage;
 	lwpsinfo_t	*lwpsinfo;
@@ -969,19 +1027,45 @@ prstat_scandir(DIR *procdir)
 	total_mem = 0;
 
 	convert_zone(&zone_tbl);
-	for (rewinddir(procdir); (direntp = readdir(procdir)); ) {
-		pidstr = direntp->d_name;
-		if (pidstr[0] == '.')	/* skip "." and ".."  */
-			continue;
-		pid = atoi(pidstr);
+
+	/*
+	 * If the system can give us every process's psinfo at once, walk
+	 * that snapshot instead of reading /proc/<pid>/psinfo for each entry
+	 * in /proc; the other files are still read per process, as needed.
+	 */
+	if ((allpsinfo = read_allpsinfo()) != NULL) {
+		allnent = allpsinfo->pr_nent;
+		allptr = (char *)(allpsinfo + 1);
+	} else {
+		rewinddir(procdir);
+	}
+
+	for (;;) {
+		if (allpsinfo != NULL) {
+			if (allnent-- == 0)
+				break;
+			(void) memcpy(&psinfo, allptr, sizeof (psinfo_t));
+			allptr += allpsinfo->pr_entsize;
+			pid = psinfo.pr_pid;
+			(void) snprintf(pidbuf, sizeof (pidbuf), "%d",
+			    (int)pid);
+			pidstr = pidbuf;
+		} else {
+			if ((direntp = readdir(procdir)) == NULL)
+				break;
+			pidstr = direntp->d_name;
+			if (pidstr[0] == '.')	/* skip "." and ".."  */
+				continue;
+			pid = atoi(pidstr);
+		}
 		if (pid == 0 || pid == 2 || pid == 3)
 			continue;	/* skip sched, pageout and fsflush */
 		if (has_element(&pid_tbl, pid) == 0)
 			continue;	/* check if we really want this pid */
 		fds = fds_get(pid);	/* get ptr to file descriptors */
 
-		if (read_procfile(&fds->fds_psinfo, pidstr,
-		    "psinfo", &psinfo, sizeof (psinfo_t)) != 0)
+		if (allpsinfo == NULL && read_procfile(&fds->fds_psinfo,
+		    pidstr, "psinfo", &psinfo, sizeof (psinfo_t)) != 0)
 			continue;
 		if (!has_uid(&ruid_tbl, psinfo.pr_uid) ||
 		    !has_uid(&euid_tbl, psinfo.pr_euid) ||
@@ -27,7 +27,7 @@
  */
 
 /*
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*	Copyright (c) 1984, 1986, 1987, 1988, 1989 AT&T	*/
@@ -330,6 +330,8 @@ static	void	przom(psinfo_t *);
 static	int	namencnt(char *, int, int);
 static	char	*err_string(int);
 static	int	print_proc(char *pname);
+static	int	print_info(char *pname, int pdlen, psinfo_t *info);
+static	prheader_t *read_allpsinfo(void);
 static	time_t	delta_secs(const timestruc_t *);
 static	int	str2id(const char *, pid_t *, long, long);
 static	int	str2uid(const char *,  uid_t *, unsigned long, unsigned long);
@@ -916,6 +918,39 @@ stdmain(int argc, char **argv)
 				retcode = 0;
 		}
 	} else {
+		prheader_t *php;
+
+		/*
+		 * If the system can give us every process's psinfo at once,
+		 * use that rather than opening each /proc/<pid>/psinfo.
+		 */
+		if ((php = read_allpsinfo()) != NULL) {
+			char *ptr = (char *)(php + 1);
+			char pname[PATH_MAX];
+			char pidstr[12];
+			psinfo_t info;
+			int i, pdlen, ret;
+
+			for (i = 0; i < php->pr_nent;
+			    i++, ptr += php->pr_entsize) {
+				(void) memcpy(&info, ptr, sizeof (info));
+				(void) sprintf(pidstr, "%d", (int)info.pr_pid);
+				pdlen = snprintf(pname, sizeof (pname),
+				    "%s/%s/", procdir, pidstr);
+				if (pdlen >= sizeof (pname) - 10)
+					continue;
+				/*
+				 * If the process changed under us, go back
+				 * to reading its own files.
+				 */
+				if ((ret = print_info(pname, pdlen, &info)) < 0)
+					ret = print_proc(pidstr);
+				if (ret == 0)
+					retcode = 0;
+			}
+			return (retcode);
+		}
+
 		/*
 		 * Determine which processes to print info about by searching
 		 * the /proc directory and looking at each process.
@@ -946,11 +981,9 @@ print_proc(char *pid_name)
 {
 	char	pname[PATH_MAX];
 	int	pdlen;
-	int	found;
 	int	procfd; /* filedescriptor for /proc/nnnnn/psinfo */
-	char	*tp;    /* ptr to ttyname,  if any */
 	psinfo_t info;  /* process information from /proc */
-	lwpsinfo_t *lwpsinfo;   /* array of lwpsinfo structs */
+	int	ret;
 
 	pdlen = snprintf(pname, sizeof (pname), "%s/%s/", procdir, pid_name);
 	if (pdlen >= sizeof (pname) - 10)
@@ -978,6 +1011,27 @@ retry:
 	}
 	(void) close(procfd);
 
+	if ((ret = print_info(pname, pdlen, &info)) < 0)
+		goto retry;
+	return (ret);
+}
+
+/*
+ * Print the process described by info, if it is one we are interested in.
+ * pname is the process's /proc directory, of length pdlen, and is used as a
+ * scratch buffer for the names of its other files.  Returns 0 if something
+ * was printed, 1 if not, or -1 if the process changed while we were looking
+ * at it and its psinfo should be read again.
+ */
+static int
+print_info(char *pname, int pdlen, psinfo_t *infop)
+{
+	int	found;
+	int	procfd;
+	char	*tp;    /* ptr to ttyname,  if any */
+	psinfo_t info = *infop;
+	lwpsinfo_t *lwpsinfo;   /* array of lwpsinfo structs */
+
 	found = 0;
 	if (info.pr_lwp.pr_state == 0)	/* can't happen? */
 		return (1);
@@ -1028,7 +1082,7 @@ retry:
 
 			(void) close(procfd);
 			if (saverr == EAGAIN)
-				goto retry;
+				return (-1);
 			if (saverr != ENOENT)
 				(void) fprintf(stderr,
 				    gettext("ps: read() on %s: %s\n"),
@@ -1043,10 +1097,10 @@ retry:
 			 */
 			lpbufsize *= 2;
 			lpsinfobuf = Realloc(lpsinfobuf, lpbufsize);
-			goto retry;
+			return (-1);
 		}
 		if (lpsinfobuf->pr_nent != (info.pr_nlwp + info.pr_nzomb))
-			goto retry;
+			return (-1);
 		lwpsinfo = (lwpsinfo_t *)(lpsinfobuf + 1);
 	}
 	if (!Lflg || (info.pr_nlwp + info.pr_nzomb) <= 1) {
@@ -2484,6 +2538,50 @@ err_string(int err)
 	return (str);
 }
 
+/*
+ * Read the psinfo of every process at once from <procdir>/psinfo.  Returns
+ * NULL if that file is not there, in which case the caller reads each
+ * process's psinfo file instead.
+ */
+static prheader_t *
+read_allpsinfo(void)
+{
+	char pname[PATH_MAX];
+	struct stat64 st;
+	prheader_t *php;
+	size_t bufsize;
+	ssize_t n;
+	int fd;
+
+	(void) snprintf(pname, sizeof (pname), "%s/psinfo", procdir);
+	if ((fd = open(pname, O_RDONLY)) == -1)
+		return (NULL);
+	if (fstat64(fd, &st) != 0) {
+		(void) close(fd);
+		return (NULL);
+	}
+
+	/*
+	 * Leave some room for processes created since the fstat(); if the
+	 * buffer is filled anyway, grow it until the whole table fits.
+	 */
+	bufsize = st.st_size + 64 * sizeof (psinfo_t);
+	php = Realloc(NULL, bufsize);
+	while ((n = pread(fd, php, bufsize, 0)) == bufsize) {
+		bufsize *= 2;
+		php = Realloc(php, bufsize);
+	}
+	(void) close(fd);
+
+	if (n < (ssize_t)sizeof (prheader_t) ||
+	    php->pr_entsize < sizeof (psinfo_t) ||
+	    sizeof (prheader_t) + php->pr_nent * php->pr_entsize > n) {
+		free(php);
+		return (NULL);
+	}
+	return (php);
+}
+
 /* If allocation fails, die */
 static void *
 Realloc(void *ptr, size_t size)
@@ -125,8 +125,11 @@ run_gen_bench(void)
 	for (impl_name = (char **)raidz_impl_names; *impl_name != NULL;
 	    impl_name++) {
 
-		if (vdev_raidz_impl_set(*impl_name) != 0)
+		if (vdev_raidz_impl_set(*impl_name) != 0) {
+			LOG(D_INFO, "[%s] not supported, skipping\n",
+			    *impl_name);
 			continue;
+		}
 
 		run_gen_bench_impl(*impl_name);
 	}
@@ -209,8 +212,11 @@ run_rec_bench(void)
 	for (impl_name = (char **)raidz_impl_names; *impl_name != NULL;
 	    impl_name++) {
 
-		if (vdev_raidz_impl_set(*impl_name) != 0)
+		if (vdev_raidz_impl_set(*impl_name) != 0) {
+			LOG(D_INFO, "[%s] not supported, skipping\n",
+			    *impl_name);
 			continue;
+		}
 
 		run_rec_bench_impl(*impl_name);
 	}
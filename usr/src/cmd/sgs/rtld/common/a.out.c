@@ -21,6 +21,7 @@
 
 /*
  * Copyright (c) 1991, 2010, Oracle and/or its affiliates. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -697,6 +698,8 @@ aout_dlsym_handle(Grp_hdl *ghp, Slookup *slp, Sresult *srp, uint_t *binfo,
 
 	sl = *slp;
 	sl.sl_name = (const char *)buffer;
+	sl.sl_hash = 0;
+	sl.sl_gnuhash = 0;
 
 	return (dlsym_handle(ghp, &sl, srp, binfo, in_nfavl));
 }
@@ -22,7 +22,7 @@
 /*
  * Copyright 2010 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
- * Copyright 2017 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -488,6 +488,29 @@ backend_is_readonly(struct sqlite *db, const char *path)
 	return (r);
 }
 
+/*
+ * Nothing but svc.configd changes a repository it has open, so SQLite can
+ * keep its page cache from one transaction to the next instead of reading
+ * back every page each transaction touches.  The cache is made large enough
+ * to hold a typical repository.  This is only an optimization, so failure
+ * is not fatal.
+ */
+#define	BACKEND_CACHE_PAGES	8192
+
+static void
+backend_db_setup(struct sqlite *db)
+{
+	char *errmsg;
+
+	if (sqlite_exec_printf(db,
+	    "PRAGMA cache_size = %d; PRAGMA retain_cache = ON;",
+	    NULL, NULL, &errmsg, BACKEND_CACHE_PAGES) != SQLITE_OK) {
+		configd_info("unable to set up repository cache: %s\n",
+		    errmsg);
+		free(errmsg);
+	}
+}
+
 static void
 backend_trace_sql(void *arg, const char *sql)
 {
@@ -1327,6 +1350,7 @@ backend_check_readonly(sqlite_backend_t *be, int writing, hrtime_t t)
 		    BE_FLIGHT_ST_SWITCH);
 		sqlite_close(be->be_db);
 		be->be_db = new;
+		backend_db_setup(be->be_db);
 	}
 
 	if (be->be_type == BACKEND_TYPE_NORMAL)
@@ -1687,6 +1711,7 @@ backend_switch(int dir)
 			} else {
 				sqlite_close(be->be_db);
 				be->be_db = new;
+				backend_db_setup(be->be_db);
 				if (dir) {
 					/* We're back on permanent storage. */
 					be->be_ppath = NULL;
@@ -1870,6 +1895,7 @@ backend_create(backend_type_t backend_id, const char *db_file,
 		errp = NULL;
 		goto integrity_fail;
 	}
+	backend_db_setup(be->be_db);
 
 	/*
 	 * check if we are inited and of the correct schema version
@@ -2157,6 +2183,7 @@ backend_tx_end(backend_tx_t *tx)
 		if (new != NULL) {
 			sqlite_close(be->be_db);
 			be->be_db = new;
+			backend_db_setup(be->be_db);
 		}
 	}
 	backend_unlock(be);
@@ -2704,6 +2731,7 @@ backend_init(const char *db_file, const char *npdb_file, int have_np)
 				    BE_FLIGHT_ST_RO);
 				sqlite_close(be->be_db);
 				be->be_db = fast_db;
+				backend_db_setup(be->be_db);
 				be->be_ppath = be->be_path;
 				be->be_path = db_name_copy;
 			}
@@ -252,7 +252,7 @@ const struct systable systable[] = {
 {"alarm",	1, DEC, NOV, UNS},				/*  27 */
 {"fstat",	2, DEC, NOV, DEC, HEX},				/*  28 */
 {"pause",	0, DEC, NOV},					/*  29 */
-{ NULL,		8, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX},
+{"recvmmsg",	5, DEC, NOV, DEC, HEX, UNS, HEX, HEX},		/*  30 */
 {"stty",	2, DEC, NOV, DEC, DEC},				/*  31 */
 {"gtty",	2, DEC, NOV, DEC, DEC},				/*  32 */
 {"access",	2, DEC, NOV, STG, ACC},				/*  33 */
@@ -298,7 +298,7 @@ const struct systable systable[] = {
 {"getpagesizes", 2, DEC, NOV, HEX, DEC},			/*  73 */
 {"rctlsys",	6, DEC, NOV, RSC, STG, HEX, HEX, DEC, DEC},	/*  74 */
 {"sidsys",	4, UNS, UNS, DEC, DEC, DEC, DEC},		/*  75 */
-{ NULL,		8, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX},
+{"sendmmsg",	4, DEC, NOV, DEC, HEX, UNS, HEX},		/*  76 */
 {"lwp_park",	3, DEC, NOV, DEC, HEX, DEC},			/*  77 */
 {"sendfilev",	5, DEC, NOV, DEC, DEC, HEX, DEC, HEX},		/*  78 */
 {"rmdir",	1, DEC, NOV, STG},				/*  79 */
@@ -23,7 +23,7 @@
  * Copyright (c) 2005, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright (c) 2011, 2016 by Delphix. All rights reserved.
  * Copyright 2012 Milan Jurik. All rights reserved.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2011-2012 Pawel Jakub Dawidek. All rights reserved.
  * Copyright (c) 2013 Steven Hartland.  All rights reserved.
  * Copyright (c) 2014 Integros [integros.com]
@@ -1138,6 +1138,10 @@ typedef struct destroy_cbdata {
 	boolean_t	cb_dryrun;
 	nvlist_t	*cb_nvl;
 	nvlist_t	*cb_batchedsnaps;
+	/* unmounted filesystems awaiting zfs_destroy_batch() */
+	zfs_handle_t	**cb_batchedfs;
+	uint_t		cb_nbatchedfs;
+	uint_t		cb_batchedfs_alloc;
 
 	/* first snap in contiguous run */
 	char		*cb_firstsnap;
@@ -1208,6 +1212,23 @@ out:
 	return (0);
 }
 
+/*
+ * Destroy the filesystems batched up by destroy_callback().
+ */
+static int
+destroy_batched_fs(destroy_cbdata_t *cbp)
+{
+	int err;
+	uint_t i;
+
+	err = zfs_destroy_batch(g_zfs, cbp->cb_batchedfs, cbp->cb_nbatchedfs);
+	for (i = 0; i < cbp->cb_nbatchedfs; i++)
+		zfs_close(cbp->cb_batchedfs[i]);
+	cbp->cb_nbatchedfs = 0;
+
+	return (err);
+}
+
 static int
 destroy_callback(zfs_handle_t *zhp, void *data)
 {
@@ -1253,6 +1274,14 @@ destroy_callback(zfs_handle_t *zhp, void *data)
 		goto out;
 	}
 
+	/*
+	 * Filesystems batched up so far may be clones of the snapshots
+	 * batched up since, so they have to go first.
+	 */
+	if (!nvlist_empty(cbp->cb_batchedsnaps) &&
+	    (err = destroy_batched_fs(cbp)) != 0)
+		goto out;
+
 	if (cbp->cb_wait)
 		libzfs_print_on_error(g_zfs, B_FALSE);
 
@@ -1294,6 +1323,23 @@ destroy_callback(zfs_handle_t *zhp, void *data)
 	if (err != 0)
 		goto out;
 
+	/*
+	 * Rather than destroying each filesystem with its own sync task,
+	 * save them up and destroy as many as possible together.  Volumes,
+	 * and requests to retry on EBUSY, are still handled one at a time.
+	 */
+	if (!cbp->cb_wait && zfs_get_type(zhp) == ZFS_TYPE_FILESYSTEM) {
+		if (cbp->cb_nbatchedfs == cbp->cb_batchedfs_alloc) {
+			cbp->cb_batchedfs_alloc = cbp->cb_batchedfs_alloc == 0 ?
+			    64 : cbp->cb_batchedfs_alloc * 2;
+			cbp->cb_batchedfs = safe_realloc(cbp->cb_batchedfs,
+			    cbp->cb_batchedfs_alloc * sizeof (zfs_handle_t *));
+		}
+		cbp->cb_batchedfs[cbp->cb_nbatchedfs++] = zhp;
+		libzfs_print_on_error(g_zfs, B_TRUE);
+		return (0);
+	}
+
 	while ((err = zfs_destroy(zhp, cbp->cb_defer_destroy)) != 0) {
 		if (cbp->cb_wait && libzfs_errno(g_zfs) == EZFS_BUSY) {
 			(void) nanosleep(&ts, NULL);
@@ -1449,7 +1495,7 @@ destroy_clones(destroy_cbdata_t *cb)
 				return (err);
 		}
 	}
-	return (0);
+	return (destroy_batched_fs(cb));
 }
 
 static int
@@ -1670,6 +1716,8 @@ zfs_do_destroy(int argc, char **argv)
 		 */
 		err = destroy_callback(zhp, &cb);
 		zhp = NULL;
+		if (err == 0)
+			err = destroy_batched_fs(&cb);
 		if (err == 0) {
 			err = zfs_destroy_snaps_nvl(g_zfs,
 			    cb.cb_batchedsnaps, cb.cb_defer_destroy);
@@ -1679,6 +1727,8 @@ zfs_do_destroy(int argc, char **argv)
 	}
 
 out:
+	(void) destroy_batched_fs(&cb);
+	free(cb.cb_batchedfs);
 	fnvlist_free(cb.cb_batchedsnaps);
 	fnvlist_free(cb.cb_nvl);
 	if (zhp != NULL)
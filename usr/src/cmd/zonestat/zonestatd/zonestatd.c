@@ -21,7 +21,7 @@
 
 /*
  * Copyright (c) 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright (c) 2011, Joyent, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 #include <alloca.h>
 #include <assert.h>
@@ -3385,8 +3385,13 @@ vmusage_again:
 	vmusage = ctl->zsctl_vmusage_cache;
 	num_vmusage = ctl->zsctl_vmusage_cache_num;
 
-	ret = zsd_getvmusage(ctl, VMUSAGE_SYSTEM | VMUSAGE_ALL_ZONES, 0,
-	    vmusage, &num_vmusage);
+	/*
+	 * The per-zone counters behind VMUSAGE_FAST charge pages shared
+	 * between zones to none of them, so the zones sum to the system
+	 * total and there is nothing to credit back below.
+	 */
+	ret = zsd_getvmusage(ctl, VMUSAGE_SYSTEM | VMUSAGE_ALL_ZONES |
+	    VMUSAGE_FAST, 0, vmusage, &num_vmusage);
 
 	if (ret != 0) {
 		/* Unexpected error.  Use existing data */
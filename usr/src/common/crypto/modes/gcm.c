@@ -20,7 +20,7 @@
  */
 /*
  * Copyright (c) 2008, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright 2018, Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 
@@ -44,21 +44,33 @@
 #include <sys/cpuvar.h>		/* cpu_t, CPU */
 #include <sys/x86_archext.h>	/* x86_featureset, X86FSET_*, CPUID_* */
 #include <sys/disp.h>		/* kpreempt_disable(), kpreempt_enable */
+#include <sys/thread.h>		/* curthread, T_KFPU */
+#include <sys/kfpu.h>		/* kernel_fpu_begin(), kernel_fpu_end() */
 /* Workaround for no XMM kernel thread save/restore */
 #define	KPREEMPT_DISABLE	kpreempt_disable()
 #define	KPREEMPT_ENABLE		kpreempt_enable()
 
 #else
 #include <sys/auxv.h>		/* getisax() */
-#include <sys/auxv_386.h>	/* AV_386_PCLMULQDQ bit */
+#include <sys/auxv_386.h>	/* AV_386_PCLMULQDQ, AV_386_SSSE3 bits */
 #define	KPREEMPT_DISABLE
 #define	KPREEMPT_ENABLE
 #endif	/* _KERNEL */
 
 extern void gcm_mul_pclmulqdq(uint64_t *x_in, uint64_t *y, uint64_t *res);
 static int intel_pclmulqdq_instruction_present(void);
+static int gcm_ghash_multi_present(void);
 #endif	/* __amd64 */
 
+#define	GCM_BLOCK_LEN		16
+
+/*
+ * Ciphertext blocks saved up by the encrypt path before being hashed
+ * together, and the fewest blocks worth handing to the multi-block GHASH.
+ */
+#define	GCM_GHASH_BATCH		8
+#define	GCM_GHASH_MIN_BLOCKS	4
+
 struct aes_block {
 	uint64_t a;
 	uint64_t b;
@@ -122,6 +134,191 @@ gcm_mul(uint64_t *x_in, uint64_t *y, uint64_t *res)
 	gcm_mul((uint64_t *)(void *)(c)->gcm_ghash, (c)->gcm_H, \
 	(uint64_t *)(void *)(t));
 
+#ifdef __amd64
+/*
+ * Multi-block GHASH using PCLMULQDQ, after Gueron and Kounavis, "Intel
+ * Carry-Less Multiplication Instruction and its Usage for Computing the GCM
+ * Mode".  Blocks are byte-reflected with pshufb so that each 128-bit
+ * carry-less product, shifted left by one bit, can be reduced modulo the
+ * GCM polynomial.  Four blocks at a time are multiplied by H^4 ... H^1 and
+ * their (linear) unreduced products summed, so that the reduction, which
+ * dominates the cost of a single-block multiply, is done once per four
+ * blocks.  Any remaining blocks are hashed singly.
+ *
+ * Register usage: xmm0 is the hash, xmm1-xmm4 hold H^4 ... H^1, xmm10-xmm12
+ * accumulate the low, high and middle product terms, xmm15 is the byte
+ * reflection mask and the rest are temporaries.
+ */
+
+/* Accumulate the 256-bit product of a and b; a is destroyed */
+#define	GHASH_MULACC(a, b)						\
+	"movdqa %%" a ", %%xmm13\n"					\
+	"pclmulqdq $0x00, %%" b ", %%xmm13\n"				\
+	"pxor %%xmm13, %%xmm10\n"					\
+	"movdqa %%" a ", %%xmm13\n"					\
+	"pclmulqdq $0x11, %%" b ", %%xmm13\n"				\
+	"pxor %%xmm13, %%xmm11\n"					\
+	"movdqa %%" a ", %%xmm13\n"					\
+	"pclmulqdq $0x10, %%" b ", %%xmm13\n"				\
+	"pxor %%xmm13, %%xmm12\n"					\
+	"pclmulqdq $0x01, %%" b ", %%" a "\n"				\
+	"pxor %%" a ", %%xmm12\n"
+
+#define	GHASH_LOAD(off, reg)						\
+	"movdqu " #off "(%[in]), %%" reg "\n"				\
+	"pshufb %%xmm15, %%" reg "\n"
+
+static const uint8_t gcm_bswap_mask[16] __attribute__((aligned(16))) = {
+	15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+};
+
+static void
+gcm_ghash_blocks_pclmulqdq(uint64_t *ghash, uint64_t *H,
+    uint64_t (*H_pow)[2], const uint8_t *in, size_t nblocks)
+{
+	__asm__ __volatile__(
+	    "movdqa (%[mask]), %%xmm15\n"
+	    "movdqu (%[ghash]), %%xmm0\n"
+	    "pshufb %%xmm15, %%xmm0\n"
+	    "movdqu 0x20(%[hpow]), %%xmm1\n"
+	    "pshufb %%xmm15, %%xmm1\n"
+	    "movdqu 0x10(%[hpow]), %%xmm2\n"
+	    "pshufb %%xmm15, %%xmm2\n"
+	    "movdqu 0x00(%[hpow]), %%xmm3\n"
+	    "pshufb %%xmm15, %%xmm3\n"
+	    "movdqu (%[h]), %%xmm4\n"
+	    "pshufb %%xmm15, %%xmm4\n"
+
+	    "1:\n"
+	    "test %[n], %[n]\n"
+	    "jz 9f\n"
+	    "pxor %%xmm10, %%xmm10\n"
+	    "pxor %%xmm11, %%xmm11\n"
+	    "pxor %%xmm12, %%xmm12\n"
+	    "cmp $4, %[n]\n"
+	    "jb 2f\n"
+
+	    /* ((X ^ C1) * H^4) ^ (C2 * H^3) ^ (C3 * H^2) ^ (C4 * H) */
+	    GHASH_LOAD(0x00, "xmm5")
+	    "pxor %%xmm0, %%xmm5\n"
+	    GHASH_MULACC("xmm5", "xmm1")
+	    GHASH_LOAD(0x10, "xmm5")
+	    GHASH_MULACC("xmm5", "xmm2")
+	    GHASH_LOAD(0x20, "xmm5")
+	    GHASH_MULACC("xmm5", "xmm3")
+	    GHASH_LOAD(0x30, "xmm5")
+	    GHASH_MULACC("xmm5", "xmm4")
+	    "add $0x40, %[in]\n"
+	    "sub $4, %[n]\n"
+	    "jmp 3f\n"
+
+	    /* (X ^ C1) * H */
+	    "2:\n"
+	    GHASH_LOAD(0x00, "xmm5")
+	    "pxor %%xmm0, %%xmm5\n"
+	    GHASH_MULACC("xmm5", "xmm4")
+	    "add $0x10, %[in]\n"
+	    "dec %[n]\n"
+
+	    /* Fold the middle terms into the 256-bit product xmm11:xmm10 */
+	    "3:\n"
+	    "movdqa %%xmm12, %%xmm13\n"
+	    "psrldq $8, %%xmm12\n"
+	    "pslldq $8, %%xmm13\n"
+	    "pxor %%xmm13, %%xmm10\n"
+	    "pxor %%xmm12, %%xmm11\n"
+
+	    /* Shift the product left by one bit */
+	    "movdqa %%xmm10, %%xmm5\n"
+	    "movdqa %%xmm11, %%xmm6\n"
+	    "pslld $1, %%xmm10\n"
+	    "pslld $1, %%xmm11\n"
+	    "psrld $31, %%xmm5\n"
+	    "psrld $31, %%xmm6\n"
+	    "movdqa %%xmm5, %%xmm7\n"
+	    "pslldq $4, %%xmm6\n"
+	    "pslldq $4, %%xmm5\n"
+	    "psrldq $12, %%xmm7\n"
+	    "por %%xmm5, %%xmm10\n"
+	    "por %%xmm6, %%xmm11\n"
+	    "por %%xmm7, %%xmm11\n"
+
+	    /* Reduce modulo x^128 + x^7 + x^2 + x + 1 */
+	    "movdqa %%xmm10, %%xmm5\n"
+	    "movdqa %%xmm10, %%xmm6\n"
+	    "movdqa %%xmm10, %%xmm7\n"
+	    "pslld $31, %%xmm5\n"
+	    "pslld $30, %%xmm6\n"
+	    "pslld $25, %%xmm7\n"
+	    "pxor %%xmm6, %%xmm5\n"
+	    "pxor %%xmm7, %%xmm5\n"
+	    "movdqa %%xmm5, %%xmm6\n"
+	    "pslldq $12, %%xmm5\n"
+	    "psrldq $4, %%xmm6\n"
+	    "pxor %%xmm5, %%xmm10\n"
+	    "movdqa %%xmm10, %%xmm8\n"
+	    "movdqa %%xmm10, %%xmm9\n"
+	    "movdqa %%xmm10, %%xmm13\n"
+	    "psrld $1, %%xmm8\n"
+	    "psrld $2, %%xmm9\n"
+	    "psrld $7, %%xmm13\n"
+	    "pxor %%xmm9, %%xmm8\n"
+	    "pxor %%xmm13, %%xmm8\n"
+	    "pxor %%xmm6, %%xmm8\n"
+	    "pxor %%xmm8, %%xmm10\n"
+	    "pxor %%xmm10, %%xmm11\n"
+	    "movdqa %%xmm11, %%xmm0\n"
+	    "jmp 1b\n"
+
+	    "9:\n"
+	    "pshufb %%xmm15, %%xmm0\n"
+	    "movdqu %%xmm0, (%[ghash])\n"
+	    : [in] "+r" (in), [n] "+r" (nblocks)
+	    : [ghash] "r" (ghash), [h] "r" (H), [hpow] "r" (H_pow),
+	    [mask] "r" (gcm_bswap_mask)
+	    : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+	    "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm15",
+	    "cc", "memory");
+}
+#endif	/* __amd64 */
+
+/*
+ * Add nblocks contiguous blocks of data to the hash.
+ */
+static void
+gcm_ghash_blocks(gcm_ctx_t *ctx, const uint8_t *data, size_t nblocks,
+    void (*xor_block)(uint8_t *, uint8_t *))
+{
+#ifdef __amd64
+	if (nblocks >= GCM_GHASH_MIN_BLOCKS && gcm_ghash_multi_present()) {
+#ifdef _KERNEL
+		/*
+		 * Kernel FPU use cannot nest and is not permitted in
+		 * interrupt context; callers there hash a block at a time.
+		 */
+		if ((curthread->t_flag & T_KFPU) == 0 &&
+		    !servicing_interrupt()) {
+			kpreempt_disable();
+			kernel_fpu_begin(NULL, KFPU_NO_STATE);
+			gcm_ghash_blocks_pclmulqdq(ctx->gcm_ghash, ctx->gcm_H,
+			    ctx->gcm_H_pow, data, nblocks);
+			kernel_fpu_end(NULL, KFPU_NO_STATE);
+			kpreempt_enable();
+			return;
+		}
+#else
+		gcm_ghash_blocks_pclmulqdq(ctx->gcm_ghash, ctx->gcm_H,
+		    ctx->gcm_H_pow, data, nblocks);
+		return;
+#endif	/* _KERNEL */
+	}
+#endif	/* __amd64 */
+
+	for (; nblocks > 0; nblocks--, data += GCM_BLOCK_LEN) {
+		GHASH(ctx, data, ctx->gcm_ghash);
+	}
+}
+
 
 /*
  * Encrypt multiple blocks of data in GCM mode.  Decrypt for GCM mode
@@ -146,6 +343,9 @@ gcm_mode_encrypt_contiguous_blocks(gcm_ctx_t *ctx, char *data, size_t length,
 	size_t out_data_1_len;
 	uint64_t counter;
 	uint64_t counter_mask = ntohll(0x00000000ffffffffULL);
+	uint64_t cbuf[GCM_GHASH_BATCH][2];
+	size_t ncbuf = 0;
+	int rv = CRYPTO_SUCCESS;
 
 	if (length + ctx->gcm_remainder_len < block_size) {
 		/* accumulate bytes here and return */
@@ -166,8 +366,10 @@ gcm_mode_encrypt_contiguous_blocks(gcm_ctx_t *ctx, char *data, size_t length,
 		if (ctx->gcm_remainder_len > 0) {
 			need = block_size - ctx->gcm_remainder_len;
 
-			if (need > remainder)
-				return (CRYPTO_DATA_LEN_RANGE);
+			if (need > remainder) {
+				rv = CRYPTO_DATA_LEN_RANGE;
+				goto out;
+			}
 
 			bcopy(datap, &((uint8_t *)ctx->gcm_remainder)
 			    [ctx->gcm_remainder_len], need);
@@ -220,8 +422,16 @@ gcm_mode_encrypt_contiguous_blocks(gcm_ctx_t *ctx, char *data, size_t length,
 			out->cd_offset += block_size;
 		}
 
-		/* add ciphertext to the hash */
-		GHASH(ctx, ctx->gcm_tmp, ctx->gcm_ghash);
+		/*
+		 * Save the ciphertext up to be added to the hash several
+		 * blocks at a time.
+		 */
+		copy_block((uint8_t *)ctx->gcm_tmp, (uint8_t *)cbuf[ncbuf]);
+		if (++ncbuf == GCM_GHASH_BATCH) {
+			gcm_ghash_blocks(ctx, (uint8_t *)cbuf, ncbuf,
+			    xor_block);
+			ncbuf = 0;
+		}
 
 		/* Update pointer to next block of data to be processed. */
 		if (ctx->gcm_remainder_len != 0) {
@@ -244,7 +454,9 @@ gcm_mode_encrypt_contiguous_blocks(gcm_ctx_t *ctx, char *data, size_t length,
 
 	} while (remainder > 0);
 out:
-	return (CRYPTO_SUCCESS);
+	/* add the remaining ciphertext to the hash */
+	gcm_ghash_blocks(ctx, (uint8_t *)cbuf, ncbuf, xor_block);
+	return (rv);
 }
 
 /* ARGSUSED */
@@ -425,6 +637,14 @@ gcm_decrypt_final(gcm_ctx_t *ctx, crypto_data_t *out, size_t block_size,
 	ghash = (uint8_t *)ctx->gcm_ghash;
 	blockp = ctx->gcm_pt_buf;
 	remainder = pt_len;
+
+	/*
+	 * All of the ciphertext is at hand, so add its complete blocks to
+	 * the hash in one go; any incomplete last block is added by
+	 * gcm_decrypt_incomplete_block().
+	 */
+	gcm_ghash_blocks(ctx, blockp, pt_len / block_size, xor_block);
+
 	while (remainder > 0) {
 		/* Incomplete last block */
 		if (remainder < block_size) {
@@ -439,8 +659,6 @@ gcm_decrypt_final(gcm_ctx_t *ctx, crypto_data_t *out, size_t block_size,
 			ctx->gcm_remainder_len = 0;
 			goto out;
 		}
-		/* add ciphertext to the hash */
-		GHASH(ctx, blockp, ghash);
 
 		/*
 		 * Increment counter.
@@ -567,7 +785,7 @@ gcm_init(gcm_ctx_t *ctx, unsigned char *iv, size_t iv_len,
     void (*copy_block)(uint8_t *, uint8_t *),
     void (*xor_block)(uint8_t *, uint8_t *))
 {
-	uint8_t *ghash, *datap, *authp;
+	uint8_t *ghash, *authp;
 	size_t remainder, processed;
 
 	/* encrypt zero block to get subkey H */
@@ -575,6 +793,15 @@ gcm_init(gcm_ctx_t *ctx, unsigned char *iv, size_t iv_len,
 	encrypt_block(ctx->gcm_keysched, (uint8_t *)ctx->gcm_H,
 	    (uint8_t *)ctx->gcm_H);
 
+#ifdef __amd64
+	/* powers of H for the multi-block GHASH */
+	if (gcm_ghash_multi_present()) {
+		gcm_mul(ctx->gcm_H, ctx->gcm_H, ctx->gcm_H_pow[0]);
+		gcm_mul(ctx->gcm_H_pow[0], ctx->gcm_H, ctx->gcm_H_pow[1]);
+		gcm_mul(ctx->gcm_H_pow[1], ctx->gcm_H, ctx->gcm_H_pow[2]);
+	}
+#endif	/* __amd64 */
+
 	gcm_format_initial_blocks(iv, iv_len, ctx, block_size,
 	    copy_block, xor_block);
 
@@ -583,28 +810,19 @@ gcm_init(gcm_ctx_t *ctx, unsigned char *iv, size_t iv_len,
 	bzero(authp, block_size);
 	bzero(ghash, block_size);
 
-	processed = 0;
-	remainder = auth_data_len;
-	do {
-		if (remainder < block_size) {
-			/*
-			 * There's not a block full of data, pad rest of
-			 * buffer with zero
-			 */
-			bzero(authp, block_size);
-			bcopy(&(auth_data[processed]), authp, remainder);
-			datap = (uint8_t *)authp;
-			remainder = 0;
-		} else {
-			datap = (uint8_t *)(&(auth_data[processed]));
-			processed += block_size;
-			remainder -= block_size;
-		}
-
-		/* add auth data to the hash */
-		GHASH(ctx, datap, ghash);
+	/* add auth data to the hash */
+	processed = auth_data_len - auth_data_len % block_size;
+	remainder = auth_data_len - processed;
+	gcm_ghash_blocks(ctx, auth_data, processed / block_size, xor_block);
 
-	} while (remainder > 0);
+	if (remainder > 0) {
+		/*
+		 * There's not a block full of data, pad rest of
+		 * buffer with zero
+		 */
+		bcopy(&(auth_data[processed]), authp, remainder);
+		GHASH(ctx, authp, ghash);
+	}
 
 	return (CRYPTO_SUCCESS);
 }
@@ -751,4 +969,29 @@ intel_pclmulqdq_instruction_present(void)
 
 	return (cached_result);
 }
+
+/*
+ * Return 1 if the multi-block GHASH, which needs PCLMULQDQ and SSSE3, can
+ * be used, otherwise 0.
+ */
+static int
+gcm_ghash_multi_present(void)
+{
+	static int	cached_result = -1;
+
+	if (cached_result == -1) { /* first time */
+#ifdef _KERNEL
+		cached_result = intel_pclmulqdq_instruction_present() &&
+		    is_x86_feature(x86_featureset, X86FSET_SSSE3);
+#else
+		uint_t		ui = 0;
+
+		(void) getisax(&ui, 1);
+		cached_result = (ui & AV_386_PCLMULQDQ) != 0 &&
+		    (ui & AV_386_SSSE3) != 0;
+#endif	/* _KERNEL */
+	}
+
+	return (cached_result);
+}
 #endif	/* __amd64 */
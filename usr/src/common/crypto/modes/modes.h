@@ -23,7 +23,7 @@
  * Use is subject to license terms.
  *
  * Copyright 2014 Nexenta Systems, Inc.  All rights reserved.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_COMMON_CRYPTO_MODES_H
@@ -207,6 +207,10 @@ typedef struct ccm_ctx {
  *
  * gcm_H:		Subkey.
  *
+ * gcm_H_pow:		H^2, H^3 and H^4, used to hash several blocks at a
+ *			time.  Only computed when multi-block GHASH is
+ *			available.
+ *
  * gcm_J0:		Pre-counter block generated from the IV.
  *
  * gcm_len_a_len_c:	64-bit representations of the bit lengths of
@@ -223,6 +227,7 @@ typedef struct gcm_ctx {
 	uint32_t gcm_tmp[4];
 	uint64_t gcm_ghash[2];
 	uint64_t gcm_H[2];
+	uint64_t gcm_H_pow[3][2];
 	uint64_t gcm_J0[2];
 	uint64_t gcm_len_a_len_c[2];
 	uint8_t *gcm_pt_buf;
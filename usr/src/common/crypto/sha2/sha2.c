@@ -53,8 +53,19 @@
 
 #ifdef _KERNEL
 #include <sys/cmn_err.h>
+#if defined(__amd64)
+#include <sys/x86_archext.h>	/* x86_featureset, X86FSET_SHA */
+#include <sys/disp.h>		/* kpreempt_disable(), kpreempt_enable */
+#include <sys/thread.h>		/* curthread, T_KFPU */
+#include <sys/kfpu.h>		/* kernel_fpu_begin(), kernel_fpu_end() */
+#endif	/* __amd64 */
 
 #else
+#if defined(__amd64)
+#include <sys/auxv.h>		/* getisax() */
+#include <sys/auxv_386.h>	/* AV_386_2_SHA bit */
+#endif	/* __amd64 */
+
 #pragma weak SHA256Update = SHA2Update
 #pragma weak SHA384Update = SHA2Update
 #pragma weak SHA512Update = SHA2Update
@@ -75,10 +86,12 @@ static void Encode64(uint8_t *, uint64_t *, size_t);
 
 #if	defined(__amd64)
 #define	SHA512Transform(ctx, in) SHA512TransformBlocks((ctx), (in), 1)
-#define	SHA256Transform(ctx, in) SHA256TransformBlocks((ctx), (in), 1)
+#define	SHA256Transform(ctx, in) sha256_transform_blocks((ctx), (in), 1)
 
 void SHA512TransformBlocks(SHA2_CTX *ctx, const void *in, size_t num);
 void SHA256TransformBlocks(SHA2_CTX *ctx, const void *in, size_t num);
+static void sha256_transform_blocks(SHA2_CTX *ctx, const void *in,
+    size_t num);
 
 #else
 static void SHA256Transform(SHA2_CTX *, const uint8_t *);
@@ -150,6 +163,206 @@ static uint8_t PADDING[128] = { 0x80, /* all zeros */ };
 #endif	/* _BIG_ENDIAN */
 
 
+#if	defined(__amd64)
+/*
+ * SHA-256 using the Intel SHA extensions (SHA-NI).
+ *
+ * The SHA-512 family has no equivalent instructions on the processors we
+ * support, so SHA384/512 always use the generic SHA512TransformBlocks().
+ * SHA256TransformBlocks() remains the fallback for processors without
+ * SHA-NI and for the kernel contexts in which the FPU may not be used.
+ */
+static const uint32_t sha256_ni_consts[64] __attribute__((aligned(16))) = {
+	SHA256_CONST_0, SHA256_CONST_1, SHA256_CONST_2,
+	SHA256_CONST_3, SHA256_CONST_4, SHA256_CONST_5,
+	SHA256_CONST_6, SHA256_CONST_7, SHA256_CONST_8,
+	SHA256_CONST_9, SHA256_CONST_10, SHA256_CONST_11,
+	SHA256_CONST_12, SHA256_CONST_13, SHA256_CONST_14,
+	SHA256_CONST_15, SHA256_CONST_16, SHA256_CONST_17,
+	SHA256_CONST_18, SHA256_CONST_19, SHA256_CONST_20,
+	SHA256_CONST_21, SHA256_CONST_22, SHA256_CONST_23,
+	SHA256_CONST_24, SHA256_CONST_25, SHA256_CONST_26,
+	SHA256_CONST_27, SHA256_CONST_28, SHA256_CONST_29,
+	SHA256_CONST_30, SHA256_CONST_31, SHA256_CONST_32,
+	SHA256_CONST_33, SHA256_CONST_34, SHA256_CONST_35,
+	SHA256_CONST_36, SHA256_CONST_37, SHA256_CONST_38,
+	SHA256_CONST_39, SHA256_CONST_40, SHA256_CONST_41,
+	SHA256_CONST_42, SHA256_CONST_43, SHA256_CONST_44,
+	SHA256_CONST_45, SHA256_CONST_46, SHA256_CONST_47,
+	SHA256_CONST_48, SHA256_CONST_49, SHA256_CONST_50,
+	SHA256_CONST_51, SHA256_CONST_52, SHA256_CONST_53,
+	SHA256_CONST_54, SHA256_CONST_55, SHA256_CONST_56,
+	SHA256_CONST_57, SHA256_CONST_58, SHA256_CONST_59,
+	SHA256_CONST_60, SHA256_CONST_61, SHA256_CONST_62,
+	SHA256_CONST_63
+};
+
+/* pshufb mask converting each big-endian message word to host order */
+static const uint8_t sha256_ni_bswap[16] __attribute__((aligned(16))) = {
+	3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+};
+
+/*
+ * Register usage: xmm0 is the implicit message operand of sha256rnds2,
+ * xmm1/xmm2 hold the state as ABEF/CDGH, xmm3-xmm6 are the message
+ * schedule, xmm7 is a temporary, xmm8 the byte swap mask and xmm9/xmm10
+ * the state at the start of the block.
+ */
+#define	SHA256_NI_LOAD(off, msg)					\
+	"movdqu " #off "(%[in]), %%" msg "\n"				\
+	"pshufb %%xmm8, %%" msg "\n"
+
+/* First two of four rounds, using message words from msg */
+#define	SHA256_NI_RND_A(g, msg)						\
+	"movdqa %%" msg ", %%xmm0\n"					\
+	"paddd " #g "*16(%[k]), %%xmm0\n"				\
+	"sha256rnds2 %%xmm0, %%xmm1, %%xmm2\n"
+
+/* Last two of four rounds */
+#define	SHA256_NI_RND_B							\
+	"pshufd $0x0e, %%xmm0, %%xmm0\n"				\
+	"sha256rnds2 %%xmm0, %%xmm2, %%xmm1\n"
+
+/* Finish the schedule of next: next += (msg:prev >> 32); msg2(next, msg) */
+#define	SHA256_NI_MSG2(msg, prev, next)					\
+	"movdqa %%" msg ", %%xmm7\n"					\
+	"palignr $4, %%" prev ", %%xmm7\n"				\
+	"paddd %%xmm7, %%" next "\n"					\
+	"sha256msg2 %%" msg ", %%" next "\n"
+
+#define	SHA256_NI_MSG1(msg, prev)					\
+	"sha256msg1 %%" msg ", %%" prev "\n"
+
+#define	SHA256_NI_RNDS(g, msg, prev, next)				\
+	SHA256_NI_RND_A(g, msg)						\
+	SHA256_NI_MSG2(msg, prev, next)					\
+	SHA256_NI_RND_B							\
+	SHA256_NI_MSG1(msg, prev)
+
+static void
+SHA256TransformBlocksNI(SHA2_CTX *ctx, const void *in, size_t num)
+{
+	__asm__ __volatile__(
+	    "movdqa (%[mask]), %%xmm8\n"
+	    /* DCBA, HGFE -> ABEF, CDGH */
+	    "movdqu 0x00(%[state]), %%xmm7\n"
+	    "movdqu 0x10(%[state]), %%xmm2\n"
+	    "pshufd $0xb1, %%xmm7, %%xmm7\n"
+	    "pshufd $0x1b, %%xmm2, %%xmm2\n"
+	    "movdqa %%xmm7, %%xmm1\n"
+	    "palignr $8, %%xmm2, %%xmm1\n"
+	    "pblendw $0xf0, %%xmm7, %%xmm2\n"
+
+	    "1:\n"
+	    "movdqa %%xmm1, %%xmm9\n"
+	    "movdqa %%xmm2, %%xmm10\n"
+
+	    SHA256_NI_LOAD(0x00, "xmm3")
+	    SHA256_NI_RND_A(0, "xmm3")
+	    SHA256_NI_RND_B
+	    SHA256_NI_LOAD(0x10, "xmm4")
+	    SHA256_NI_RND_A(1, "xmm4")
+	    SHA256_NI_RND_B
+	    SHA256_NI_MSG1("xmm4", "xmm3")
+	    SHA256_NI_LOAD(0x20, "xmm5")
+	    SHA256_NI_RND_A(2, "xmm5")
+	    SHA256_NI_RND_B
+	    SHA256_NI_MSG1("xmm5", "xmm4")
+	    SHA256_NI_LOAD(0x30, "xmm6")
+	    SHA256_NI_RNDS(3, "xmm6", "xmm5", "xmm3")
+	    SHA256_NI_RNDS(4, "xmm3", "xmm6", "xmm4")
+	    SHA256_NI_RNDS(5, "xmm4", "xmm3", "xmm5")
+	    SHA256_NI_RNDS(6, "xmm5", "xmm4", "xmm6")
+	    SHA256_NI_RNDS(7, "xmm6", "xmm5", "xmm3")
+	    SHA256_NI_RNDS(8, "xmm3", "xmm6", "xmm4")
+	    SHA256_NI_RNDS(9, "xmm4", "xmm3", "xmm5")
+	    SHA256_NI_RNDS(10, "xmm5", "xmm4", "xmm6")
+	    SHA256_NI_RNDS(11, "xmm6", "xmm5", "xmm3")
+	    SHA256_NI_RNDS(12, "xmm3", "xmm6", "xmm4")
+	    SHA256_NI_RND_A(13, "xmm4")
+	    SHA256_NI_MSG2("xmm4", "xmm3", "xmm5")
+	    SHA256_NI_RND_B
+	    SHA256_NI_RND_A(14, "xmm5")
+	    SHA256_NI_MSG2("xmm5", "xmm4", "xmm6")
+	    SHA256_NI_RND_B
+	    SHA256_NI_RND_A(15, "xmm6")
+	    SHA256_NI_RND_B
+
+	    "paddd %%xmm9, %%xmm1\n"
+	    "paddd %%xmm10, %%xmm2\n"
+	    "add $64, %[in]\n"
+	    "dec %[num]\n"
+	    "jnz 1b\n"
+
+	    /* ABEF, CDGH -> DCBA, HGFE */
+	    "pshufd $0x1b, %%xmm1, %%xmm7\n"
+	    "pshufd $0xb1, %%xmm2, %%xmm2\n"
+	    "movdqa %%xmm7, %%xmm1\n"
+	    "pblendw $0xf0, %%xmm2, %%xmm1\n"
+	    "palignr $8, %%xmm7, %%xmm2\n"
+	    "movdqu %%xmm1, 0x00(%[state])\n"
+	    "movdqu %%xmm2, 0x10(%[state])\n"
+	    : [in] "+r" (in), [num] "+r" (num)
+	    : [state] "r" (ctx->state.s32), [k] "r" (sha256_ni_consts),
+	    [mask] "r" (sha256_ni_bswap)
+	    : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+	    "xmm8", "xmm9", "xmm10", "cc", "memory");
+}
+
+/*
+ * Note: the userland version uses getisax().  The kernel version uses
+ * global variable x86_featureset.
+ */
+static int
+intel_sha_instructions_present(void)
+{
+	static int	cached_result = -1;
+
+	if (cached_result == -1) { /* first time */
+#ifdef _KERNEL
+		cached_result = is_x86_feature(x86_featureset, X86FSET_SHA) &&
+		    is_x86_feature(x86_featureset, X86FSET_SSE4_1);
+#else
+		uint_t		ui[2] = { 0 };
+
+		(void) getisax(ui, 2);
+		cached_result = (ui[1] & AV_386_2_SHA) != 0 &&
+		    (ui[0] & AV_386_SSE4_1) != 0;
+#endif	/* _KERNEL */
+	}
+
+	return (cached_result);
+}
+
+static void
+sha256_transform_blocks(SHA2_CTX *ctx, const void *in, size_t num)
+{
+	if (!intel_sha_instructions_present()) {
+		SHA256TransformBlocks(ctx, in, num);
+		return;
+	}
+
+#ifdef _KERNEL
+	/*
+	 * Kernel FPU use cannot nest and is not permitted in interrupt
+	 * context; callers there get the integer implementation.
+	 */
+	if ((curthread->t_flag & T_KFPU) != 0 || servicing_interrupt()) {
+		SHA256TransformBlocks(ctx, in, num);
+		return;
+	}
+
+	kpreempt_disable();
+	kernel_fpu_begin(NULL, KFPU_NO_STATE);
+	SHA256TransformBlocksNI(ctx, in, num);
+	kernel_fpu_end(NULL, KFPU_NO_STATE);
+	kpreempt_enable();
+#else
+	SHA256TransformBlocksNI(ctx, in, num);
+#endif	/* _KERNEL */
+}
+#endif	/* __amd64 */
+
 #if	!defined(__amd64)
 /* SHA256 Transform */
 
@@ -865,7 +1078,7 @@ SHA2Update(SHA2_CTX *ctx, const void *inptr, size_t input_len)
 		if (algotype <= SHA256_HMAC_GEN_MECH_INFO_TYPE) {
 			block_count = (input_len - i) >> 6;
 			if (block_count > 0) {
-				SHA256TransformBlocks(ctx, &input[i],
+				sha256_transform_blocks(ctx, &input[i],
 				    block_count);
 				i += block_count << 6;
 			}
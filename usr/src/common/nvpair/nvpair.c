@@ -23,6 +23,7 @@
  * Copyright (c) 2000, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright (c) 2015, 2017 by Delphix. All rights reserved.
  * Copyright 2018 RackTop Systems.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/stropts.h>
@@ -334,14 +335,19 @@ nvt_lookup_name_type(nvlist_t *nvl, const char *name, data_type_t type)
 		ASSERT(priv->nvp_nbuckets != 0);
 	}
 
-	uint64_t hash = nvt_hash(name);
+	uint32_t hash = nvt_hash(name);
 	uint64_t index = hash & (priv->nvp_nbuckets - 1);
 
 	ASSERT3U(index, <, priv->nvp_nbuckets);
 	i_nvp_t *entry = tab[index];
 
+	/*
+	 * Each entry caches the hash of its name; compare that first so that
+	 * walking a chain rarely has to touch the names of other pairs.
+	 */
 	for (i_nvp_t *e = entry; e != NULL; e = e->nvi_hashtable_next) {
-		if (strcmp(NVP_NAME(&e->nvi_nvp), name) == 0 &&
+		if (e->nvi_hash == hash &&
+		    strcmp(NVP_NAME(&e->nvi_nvp), name) == 0 &&
 		    (type == DATA_TYPE_DONTCARE ||
 		    NVP_TYPE(&e->nvi_nvp) == type))
 			return (&e->nvi_nvp);
@@ -380,8 +386,7 @@ nvt_resize(nvpriv_t *priv, uint32_t new_size)
 		while (e != NULL) {
 			next = e->nvi_hashtable_next;
 
-			uint32_t hash = nvt_hash(NVP_NAME(&e->nvi_nvp));
-			uint32_t index = hash & new_mask;
+			uint32_t index = e->nvi_hash & new_mask;
 
 			e->nvi_hashtable_next = new_tab[index];
 			new_tab[index] = e;
@@ -467,8 +472,7 @@ nvt_remove_nvpair(nvlist_t *nvl, nvpair_t *nvp)
 	}
 	i_nvp_t **tab = priv->nvp_hashtable;
 
-	char *name = NVP_NAME(nvp);
-	uint64_t hash = nvt_hash(name);
+	uint32_t hash = NVPAIR2I_NVP(nvp)->nvi_hash;
 	uint64_t index = hash & (priv->nvp_nbuckets - 1);
 
 	ASSERT3U(index, <, priv->nvp_nbuckets);
@@ -476,7 +480,8 @@ nvt_remove_nvpair(nvlist_t *nvl, nvpair_t *nvp)
 
 	for (i_nvp_t *prev = NULL, *e = bucket;
 	    e != NULL; prev = e, e = e->nvi_hashtable_next) {
-		if (nvt_nvpair_match(&e->nvi_nvp, nvp, nvl->nvl_nvflag)) {
+		if (e->nvi_hash == hash &&
+		    nvt_nvpair_match(&e->nvi_nvp, nvp, nvl->nvl_nvflag)) {
 			if (prev != NULL) {
 				prev->nvi_hashtable_next =
 				    e->nvi_hashtable_next;
@@ -497,6 +502,13 @@ static int
 nvt_add_nvpair(nvlist_t *nvl, nvpair_t *nvp)
 {
 	nvpriv_t *priv = (nvpriv_t *)(uintptr_t)nvl->nvl_priv;
+	i_nvp_t *new_entry = NVPAIR2I_NVP(nvp);
+
+	/*
+	 * Hash the name once; the removal below, lookups and any later
+	 * resizing of the table all use the cached value.
+	 */
+	new_entry->nvi_hash = nvt_hash(NVP_NAME(nvp));
 
 	/* initialize nvpair table now if it doesn't exist. */
 	if (priv->nvp_hashtable == NULL) {
@@ -522,15 +534,12 @@ nvt_add_nvpair(nvlist_t *nvl, nvpair_t *nvp)
 	}
 	i_nvp_t **tab = priv->nvp_hashtable;
 
-	char *name = NVP_NAME(nvp);
-	uint64_t hash = nvt_hash(name);
-	uint64_t index = hash & (priv->nvp_nbuckets - 1);
+	uint64_t index = new_entry->nvi_hash & (priv->nvp_nbuckets - 1);
 
 	ASSERT3U(index, <, priv->nvp_nbuckets);
 	i_nvp_t *bucket = tab[index];
 
 	/* insert link at the beginning of the bucket */
-	i_nvp_t *new_entry = NVPAIR2I_NVP(nvp);
 	ASSERT3P(new_entry->nvi_hashtable_next, ==, NULL);
 	new_entry->nvi_hashtable_next = bucket;
 	tab[index] = new_entry;
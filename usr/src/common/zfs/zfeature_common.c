@@ -377,4 +377,14 @@ zpool_feature_init(void)
 	    "flush them periodically.",
 	    ZFEATURE_FLAG_READONLY_COMPAT,
 	    log_spacemap_deps);
+
+	zfeature_register(SPA_FEATURE_ZSTD_COMPRESS,
+	    "com.joyent:zstd_compress", "zstd_compress",
+	    "zstd compression algorithm support.",
+	    ZFEATURE_FLAG_ACTIVATE_ON_ENABLE, NULL);
+
+	zfeature_register(SPA_FEATURE_DDT_LOG,
+	    "com.joyent:ddt_log", "ddt_log",
+	    "Log dedup table changes and flush them to the DDT incrementally.",
+	    ZFEATURE_FLAG_READONLY_COMPAT, NULL);
 }
@@ -69,6 +69,8 @@ typedef enum spa_feature {
 	SPA_FEATURE_USEROBJ_ACCOUNTING,
 	SPA_FEATURE_PROJECT_QUOTA,
 	SPA_FEATURE_LOG_SPACEMAP,
+	SPA_FEATURE_ZSTD_COMPRESS,
+	SPA_FEATURE_DDT_LOG,
 	SPA_FEATURES
 } spa_feature_t;
 
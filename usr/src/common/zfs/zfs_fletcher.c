@@ -25,6 +25,7 @@
 /*
  * Copyright 2013 Saso Kiselkov. All rights reserved.
  * Copyright (c) 2016 by Delphix. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -127,15 +128,49 @@
  *
  * For both cached and uncached data, both fletcher checksums are much faster
  * than sha-256, and slower than 'off', which doesn't touch the data at all.
+ *
+ * ----------------------
+ * Vectorized fletcher-4
+ * ----------------------
+ *
+ * Each step of the fletcher-4 recurrence depends on the previous one, so the
+ * scalar loop cannot make use of SIMD units directly.  Instead, a vector
+ * implementation with N lanes runs N independent fletcher-4 computations,
+ * lane j consuming the words f_j, f_(j+N), f_(j+2N), ...  Once the buffer
+ * has been consumed, the per-lane accumulators are folded back into the
+ * single checksum that the scalar loop would have produced (see
+ * fletcher_4_fold()).
+ *
+ * The available implementations are benchmarked when the module is loaded
+ * (fletcher_4_init()) and the fastest one is used by default; the results
+ * are exported in the zfs:0:fletcher_4_bench kstat.  Buffers smaller than
+ * SPA_MINBLOCKSIZE are always checksummed by the scalar code, and the tail
+ * of a buffer which is not a multiple of FLETCHER_4_SIMD_SIZE is finished
+ * by the scalar code as well.
+ *
+ * The incremental interfaces checksum each chunk from zero and then combine
+ * the result with the running checksum (see fletcher_4_combine()).
  */
 
 #include <sys/types.h>
 #include <sys/sysmacros.h>
 #include <sys/byteorder.h>
+#include <sys/errno.h>
+#include <sys/atomic.h>
 #include <sys/zio.h>
 #include <sys/spa.h>
+#include <sys/simd.h>
 #include <zfs_fletcher.h>
 
+#ifdef _KERNEL
+#include <sys/systm.h>
+#include <sys/kmem.h>
+#include <sys/kstat.h>
+#include <sys/time.h>
+#else
+#include <string.h>
+#endif
+
 void
 fletcher_init(zio_cksum_t *zcp)
 {
@@ -210,8 +245,8 @@ fletcher_2_byteswap(const void *buf, size_t size,
 	(void) fletcher_2_incremental_byteswap((void *) buf, size, zcp);
 }
 
-int
-fletcher_4_incremental_native(void *buf, size_t size, void *data)
+static int
+fletcher_4_scalar_incremental_native(void *buf, size_t size, void *data)
 {
 	zio_cksum_t *zcp = data;
 
@@ -235,17 +270,9 @@ fletcher_4_incremental_native(void *buf, size_t size, void *data)
 	return (0);
 }
 
-/*ARGSUSED*/
-void
-fletcher_4_native(const void *buf, size_t size,
-    const void *ctx_template, zio_cksum_t *zcp)
-{
-	fletcher_init(zcp);
-	(void) fletcher_4_incremental_native((void *) buf, size, zcp);
-}
 
-int
-fletcher_4_incremental_byteswap(void *buf, size_t size, void *data)
+static int
+fletcher_4_scalar_incremental_byteswap(void *buf, size_t size, void *data)
 {
 	zio_cksum_t *zcp = data;
 
@@ -269,11 +296,472 @@ fletcher_4_incremental_byteswap(void *buf, size_t size, void *data)
 	return (0);
 }
 
+static void
+fletcher_4_scalar_native(fletcher_4_ctx_t *ctx, const void *buf, size_t size)
+{
+	zio_cksum_t zc;
+
+	fletcher_init(&zc);
+	(void) fletcher_4_scalar_incremental_native((void *)buf, size, &zc);
+	for (int i = 0; i < 4; i++)
+		ctx->f4c_acc[i][0] = zc.zc_word[i];
+}
+
+static void
+fletcher_4_scalar_byteswap(fletcher_4_ctx_t *ctx, const void *buf,
+    size_t size)
+{
+	zio_cksum_t zc;
+
+	fletcher_init(&zc);
+	(void) fletcher_4_scalar_incremental_byteswap((void *)buf, size, &zc);
+	for (int i = 0; i < 4; i++)
+		ctx->f4c_acc[i][0] = zc.zc_word[i];
+}
+
+static boolean_t
+fletcher_4_scalar_valid(void)
+{
+	return (B_TRUE);
+}
+
+static const fletcher_4_ops_t fletcher_4_scalar_ops = {
+	.compute_native = fletcher_4_scalar_native,
+	.compute_byteswap = fletcher_4_scalar_byteswap,
+	.valid = fletcher_4_scalar_valid,
+	.lanes = 1,
+	.name = "scalar"
+};
+
+/* All compiled in implementations */
+static const fletcher_4_ops_t *fletcher_4_all_impls[] = {
+	&fletcher_4_scalar_ops,
+#if defined(__amd64)
+	&fletcher_4_sse2_ops,
+	&fletcher_4_ssse3_ops,
+	&fletcher_4_avx2_ops,
+	&fletcher_4_avx512f_ops,
+#endif
+};
+
+#define	FLETCHER_4_NIMPLS	\
+	(sizeof (fletcher_4_all_impls) / sizeof (fletcher_4_all_impls[0]))
+
+/* Select fletcher-4 implementation */
+#define	IMPL_FASTEST	(UINT32_MAX)
+#define	IMPL_CYCLE	(UINT32_MAX - 1)
+#define	IMPL_SCALAR	(0)
+
+#define	FLETCHER_4_IMPL_READ(i)	(*(volatile uint32_t *) &(i))
+
+static uint32_t fletcher_4_impl = IMPL_SCALAR;
+static uint32_t fletcher_4_user_sel_impl = IMPL_FASTEST;
+
+/* Indicate that benchmark has been completed */
+static boolean_t fletcher_4_initialized = B_FALSE;
+
+/* Hold all supported implementations */
+static uint32_t fletcher_4_supp_impls_cnt = 0;
+static const fletcher_4_ops_t *fletcher_4_supp_impls[FLETCHER_4_NIMPLS];
+
+/*
+ * The fastest implementation may differ between the native and byteswap
+ * variants, so each is tracked separately.
+ */
+static const fletcher_4_ops_t *fletcher_4_fastest_native =
+	&fletcher_4_scalar_ops;
+static const fletcher_4_ops_t *fletcher_4_fastest_byteswap =
+	&fletcher_4_scalar_ops;
+
+/*
+ * Buffers passed to the incremental interfaces are checksummed in chunks of
+ * at most this size, which keeps the coefficients in fletcher_4_combine()
+ * from overflowing.
+ */
+#define	FLETCHER_4_INC_MAX_SIZE	(8ULL << 20)
+
+static const fletcher_4_ops_t *
+fletcher_4_impl_get(boolean_t byteswap)
+{
+	const uint32_t impl = FLETCHER_4_IMPL_READ(fletcher_4_impl);
+	const fletcher_4_ops_t *ops;
+
+	if (!fletcher_4_initialized)
+		return (&fletcher_4_scalar_ops);
+
+	switch (impl) {
+	case IMPL_FASTEST:
+		ops = byteswap ? fletcher_4_fastest_byteswap :
+		    fletcher_4_fastest_native;
+		break;
+	case IMPL_CYCLE: {
+		/* Cycle through all supported implementations */
+		static uint32_t cycle_impl_idx = 0;
+		uint32_t idx = (++cycle_impl_idx) % fletcher_4_supp_impls_cnt;
+		ops = fletcher_4_supp_impls[idx];
+		break;
+	}
+	default:
+		ASSERT3U(impl, <, fletcher_4_supp_impls_cnt);
+		ops = (impl < fletcher_4_supp_impls_cnt) ?
+		    fletcher_4_supp_impls[impl] : &fletcher_4_scalar_ops;
+		break;
+	}
+
+	return (ops);
+}
+
+/* p * (p + 1) * (p + 2) / 6; exact for any integer p */
+static int64_t
+fletcher_4_tet(int64_t p)
+{
+	return (p * (p + 1) * (p + 2) / 6);
+}
+
+/*
+ * Fold the per-lane accumulators of an N-lane implementation into a single
+ * fletcher-4 checksum.
+ *
+ * Over a buffer of n words, the scalar checksum weighs the word with k
+ * words after it (k = n - i) by 1, k, k(k+1)/2 and k(k+1)(k+2)/6 in a, b, c
+ * and d respectively.  Lane j consumed m = n / N words, and weighs its word
+ * with x - 1 lane words after it by 1, x, x(x+1)/2 and x(x+1)(x+2)/6.  That
+ * word is followed by k = N * x - j words of the whole buffer, so each
+ * scalar weight is a polynomial in x which can be written as a combination
+ * of the lane weights.  The cubic one is solved for from its values at
+ * x = 0 .. 3.
+ */
+static void
+fletcher_4_fold(const fletcher_4_ctx_t *ctx, uint_t lanes, zio_cksum_t *zcp)
+{
+	const int64_t n = lanes;
+	uint64_t A = 0, B = 0, C = 0, D = 0;
+
+	for (int64_t j = 0; j < n; j++) {
+		const uint64_t a = ctx->f4c_acc[0][j];
+		const uint64_t b = ctx->f4c_acc[1][j];
+		const uint64_t c = ctx->f4c_acc[2][j];
+		const uint64_t d = ctx->f4c_acc[3][j];
+
+		const int64_t q0 = fletcher_4_tet(-j);
+		const int64_t s1 = fletcher_4_tet(n - j) - q0;
+		const int64_t s2 = fletcher_4_tet(2 * n - j) - q0;
+		const int64_t s3 = fletcher_4_tet(3 * n - j) - q0;
+		const int64_t dd = s3 - 3 * s2 + 3 * s1;
+		const int64_t dc = s2 - 2 * s1 - 2 * dd;
+		const int64_t db = s1 - dc - dd;
+
+		A += a;
+		B += (uint64_t)n * b - (uint64_t)j * a;
+		C += (uint64_t)(n * n) * c +
+		    (uint64_t)(n * (1 - 2 * j - n) / 2) * b +
+		    (uint64_t)(j * (j - 1) / 2) * a;
+		D += (uint64_t)dd * d + (uint64_t)dc * c + (uint64_t)db * b +
+		    (uint64_t)q0 * a;
+	}
+
+	ZIO_SET_CHECKSUM(zcp, A, B, C, D);
+}
+
+/*
+ * Append the checksum nzcp of a size byte buffer to the running checksum
+ * zcp, as if the scalar loop had continued over that buffer.
+ */
+static void
+fletcher_4_combine(zio_cksum_t *zcp, uint64_t size, const zio_cksum_t *nzcp)
+{
+	const uint64_t c1 = size / sizeof (uint32_t);
+	const uint64_t c2 = c1 * (c1 + 1) / 2;
+	const uint64_t c3 = c2 * (c1 + 2) / 3;
+
+	zcp->zc_word[3] += nzcp->zc_word[3] + c1 * zcp->zc_word[2] +
+	    c2 * zcp->zc_word[1] + c3 * zcp->zc_word[0];
+	zcp->zc_word[2] += nzcp->zc_word[2] + c1 * zcp->zc_word[1] +
+	    c2 * zcp->zc_word[0];
+	zcp->zc_word[1] += nzcp->zc_word[1] + c1 * zcp->zc_word[0];
+	zcp->zc_word[0] += nzcp->zc_word[0];
+}
+
+static void
+fletcher_4_compute_impl(const fletcher_4_ops_t *ops, const void *buf,
+    size_t size, boolean_t byteswap, zio_cksum_t *zcp)
+{
+	fletcher_4_ctx_t ctx;
+	size_t bulk = P2ALIGN(size, FLETCHER_4_SIMD_SIZE);
+
+	fletcher_init(zcp);
+	if (size < SPA_MINBLOCKSIZE || ops->lanes == 1) {
+		if (byteswap) {
+			(void) fletcher_4_scalar_incremental_byteswap(
+			    (void *)buf, size, zcp);
+		} else {
+			(void) fletcher_4_scalar_incremental_native(
+			    (void *)buf, size, zcp);
+		}
+		return;
+	}
+
+	if (byteswap)
+		ops->compute_byteswap(&ctx, buf, bulk);
+	else
+		ops->compute_native(&ctx, buf, bulk);
+	fletcher_4_fold(&ctx, ops->lanes, zcp);
+
+	/* finish any tail with the scalar code */
+	if (size > bulk) {
+		if (byteswap) {
+			(void) fletcher_4_scalar_incremental_byteswap(
+			    (char *)buf + bulk, size - bulk, zcp);
+		} else {
+			(void) fletcher_4_scalar_incremental_native(
+			    (char *)buf + bulk, size - bulk, zcp);
+		}
+	}
+}
+
+static void
+fletcher_4_incremental(void *buf, size_t size, boolean_t byteswap,
+    zio_cksum_t *zcp)
+{
+	const fletcher_4_ops_t *ops = fletcher_4_impl_get(byteswap);
+
+	if (size < SPA_MINBLOCKSIZE || ops->lanes == 1) {
+		if (byteswap)
+			(void) fletcher_4_scalar_incremental_byteswap(buf,
+			    size, zcp);
+		else
+			(void) fletcher_4_scalar_incremental_native(buf,
+			    size, zcp);
+		return;
+	}
+
+	while (size > 0) {
+		zio_cksum_t nzc;
+		uint64_t len = MIN(size, FLETCHER_4_INC_MAX_SIZE);
+
+		fletcher_4_compute_impl(ops, buf, len, byteswap, &nzc);
+		fletcher_4_combine(zcp, len, &nzc);
+
+		buf = (char *)buf + len;
+		size -= len;
+	}
+}
+
+/*ARGSUSED*/
+void
+fletcher_4_native(const void *buf, size_t size,
+    const void *ctx_template, zio_cksum_t *zcp)
+{
+	fletcher_4_compute_impl(fletcher_4_impl_get(B_FALSE), buf, size,
+	    B_FALSE, zcp);
+}
+
+int
+fletcher_4_incremental_native(void *buf, size_t size, void *data)
+{
+	fletcher_4_incremental(buf, size, B_FALSE, data);
+	return (0);
+}
+
 /*ARGSUSED*/
 void
 fletcher_4_byteswap(const void *buf, size_t size,
     const void *ctx_template, zio_cksum_t *zcp)
 {
-	fletcher_init(zcp);
-	(void) fletcher_4_incremental_byteswap((void *) buf, size, zcp);
+	fletcher_4_compute_impl(fletcher_4_impl_get(B_TRUE), buf, size,
+	    B_TRUE, zcp);
+}
+
+int
+fletcher_4_incremental_byteswap(void *buf, size_t size, void *data)
+{
+	fletcher_4_incremental(buf, size, B_TRUE, data);
+	return (0);
+}
+
+#if defined(_KERNEL)
+
+#define	FLETCHER_4_BENCH_SIZE	(1ULL << SPA_OLD_MAXBLOCKSHIFT)	/* 128 kiB */
+#define	FLETCHER_4_BENCH_NS	MSEC2NSEC(5)			/* 5ms */
+
+/*
+ * Benchmark results, in bytes per second, for each supported implementation
+ * followed by the names of the fastest native and byteswap implementations.
+ */
+static kstat_t *fletcher_4_ksp;
+static kstat_named_t fletcher_4_kstat_data[2 * FLETCHER_4_NIMPLS + 2];
+
+static uint64_t
+fletcher_4_bench_impl(const fletcher_4_ops_t *ops, const void *buf,
+    boolean_t byteswap)
+{
+	uint64_t run_cnt = 0;
+	hrtime_t t_start, t_diff;
+	zio_cksum_t zc;
+
+	t_start = gethrtime();
+	do {
+		for (int i = 0; i < 32; i++, run_cnt++) {
+			fletcher_4_compute_impl(ops, buf,
+			    FLETCHER_4_BENCH_SIZE, byteswap, &zc);
+		}
+		t_diff = gethrtime() - t_start;
+	} while (t_diff < FLETCHER_4_BENCH_NS);
+
+	return (run_cnt * FLETCHER_4_BENCH_SIZE * NANOSEC / t_diff);
+}
+
+static void
+fletcher_4_benchmark(void)
+{
+	uint64_t best_native = 0, best_byteswap = 0;
+	kstat_named_t *knp = fletcher_4_kstat_data;
+	uint8_t *buf;
+
+	buf = kmem_alloc(FLETCHER_4_BENCH_SIZE, KM_SLEEP);
+	for (int i = 0; i < FLETCHER_4_BENCH_SIZE; i++)
+		buf[i] = (uint8_t)(i * 79 + 13);
+
+	kstat_named_init(knp++, "fastest_native", KSTAT_DATA_CHAR);
+	kstat_named_init(knp++, "fastest_byteswap", KSTAT_DATA_CHAR);
+
+	for (uint32_t i = 0; i < fletcher_4_supp_impls_cnt; i++) {
+		const fletcher_4_ops_t *ops = fletcher_4_supp_impls[i];
+		char name[KSTAT_STRLEN];
+		uint64_t speed;
+
+		speed = fletcher_4_bench_impl(ops, buf, B_FALSE);
+		(void) snprintf(name, sizeof (name), "%s_native", ops->name);
+		kstat_named_init(knp, name, KSTAT_DATA_UINT64);
+		(knp++)->value.ui64 = speed;
+		if (speed > best_native) {
+			best_native = speed;
+			fletcher_4_fastest_native = ops;
+		}
+
+		speed = fletcher_4_bench_impl(ops, buf, B_TRUE);
+		(void) snprintf(name, sizeof (name), "%s_byteswap", ops->name);
+		kstat_named_init(knp, name, KSTAT_DATA_UINT64);
+		(knp++)->value.ui64 = speed;
+		if (speed > best_byteswap) {
+			best_byteswap = speed;
+			fletcher_4_fastest_byteswap = ops;
+		}
+	}
+
+	(void) strlcpy(fletcher_4_kstat_data[0].value.c,
+	    fletcher_4_fastest_native->name,
+	    sizeof (fletcher_4_kstat_data[0].value.c));
+	(void) strlcpy(fletcher_4_kstat_data[1].value.c,
+	    fletcher_4_fastest_byteswap->name,
+	    sizeof (fletcher_4_kstat_data[1].value.c));
+
+	kmem_free(buf, FLETCHER_4_BENCH_SIZE);
+
+	fletcher_4_ksp = kstat_create("zfs", 0, "fletcher_4_bench", "misc",
+	    KSTAT_TYPE_NAMED, knp - fletcher_4_kstat_data, KSTAT_FLAG_VIRTUAL);
+	if (fletcher_4_ksp != NULL) {
+		fletcher_4_ksp->ks_data = fletcher_4_kstat_data;
+		kstat_install(fletcher_4_ksp);
+	}
+}
+#endif /* _KERNEL */
+
+/*
+ * Determine the supported implementations and pick the fastest one.
+ */
+void
+fletcher_4_init(void)
+{
+	uint32_t c = 0;
+
+	for (uint_t i = 0; i < FLETCHER_4_NIMPLS; i++) {
+		if (fletcher_4_all_impls[i]->valid())
+			fletcher_4_supp_impls[c++] = fletcher_4_all_impls[i];
+	}
+	membar_producer();		/* complete fletcher_4_supp_impls[] */
+	fletcher_4_supp_impls_cnt = c;
+
+#if defined(_KERNEL)
+	fletcher_4_benchmark();
+#else
+	/*
+	 * Skip the benchmark in user space to avoid impacting libzpool
+	 * consumers (zdb, zhack, zinject, ztest).  The last implementation
+	 * is assumed to be the fastest and used by default.
+	 */
+	fletcher_4_fastest_native = fletcher_4_supp_impls[c - 1];
+	fletcher_4_fastest_byteswap = fletcher_4_supp_impls[c - 1];
+#endif
+
+	/* Finish initialization */
+	atomic_swap_32(&fletcher_4_impl, fletcher_4_user_sel_impl);
+	membar_producer();
+	fletcher_4_initialized = B_TRUE;
+}
+
+void
+fletcher_4_fini(void)
+{
+	fletcher_4_initialized = B_FALSE;
+	membar_producer();
+
+#if defined(_KERNEL)
+	if (fletcher_4_ksp != NULL) {
+		kstat_delete(fletcher_4_ksp);
+		fletcher_4_ksp = NULL;
+	}
+#endif
+	fletcher_4_fastest_native = &fletcher_4_scalar_ops;
+	fletcher_4_fastest_byteswap = &fletcher_4_scalar_ops;
+}
+
+static const struct {
+	char *name;
+	uint32_t sel;
+} fletcher_4_impl_opts[] = {
+		{ "cycle",	IMPL_CYCLE },
+		{ "fastest",	IMPL_FASTEST },
+		{ "scalar",	IMPL_SCALAR }
+};
+
+/*
+ * Select the fletcher-4 implementation by name.  As with the raidz math
+ * selection, a choice made before fletcher_4_init() is saved and applied
+ * once the supported implementations are known.
+ */
+int
+fletcher_4_impl_set(const char *val)
+{
+	int err = EINVAL;
+	uint32_t impl = FLETCHER_4_IMPL_READ(fletcher_4_user_sel_impl);
+	size_t i;
+
+	for (i = 0; i < sizeof (fletcher_4_impl_opts) /
+	    sizeof (fletcher_4_impl_opts[0]); i++) {
+		if (strcmp(val, fletcher_4_impl_opts[i].name) == 0) {
+			impl = fletcher_4_impl_opts[i].sel;
+			err = 0;
+			break;
+		}
+	}
+
+	if (err != 0 && fletcher_4_initialized) {
+		for (i = 0; i < fletcher_4_supp_impls_cnt; i++) {
+			if (strcmp(val, fletcher_4_supp_impls[i]->name) == 0) {
+				impl = i;
+				err = 0;
+				break;
+			}
+		}
+	}
+
+	if (err == 0) {
+		if (fletcher_4_initialized)
+			atomic_swap_32(&fletcher_4_impl, impl);
+		else
+			atomic_swap_32(&fletcher_4_user_sel_impl, impl);
+	}
+
+	return (err);
 }
@@ -25,6 +25,7 @@
 /*
  * Copyright 2013 Saso Kiselkov. All rights reserved.
  * Copyright (c) 2016 by Delphix. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_ZFS_FLETCHER_H
@@ -50,6 +51,47 @@ void fletcher_4_native(const void *, size_t, const void *, zio_cksum_t *);
 void fletcher_4_byteswap(const void *, size_t, const void *, zio_cksum_t *);
 int fletcher_4_incremental_native(void *, size_t, void *);
 int fletcher_4_incremental_byteswap(void *, size_t, void *);
+void fletcher_4_init(void);
+void fletcher_4_fini(void);
+int fletcher_4_impl_set(const char *);
+
+/*
+ * Vectorized fletcher-4 implementations.
+ *
+ * A vector implementation runs FLETCHER_4_MAX_LANES or fewer independent
+ * fletcher-4 computations side by side, lane i summing the data words
+ * whose index is congruent to i modulo the lane count.  The compute
+ * function starts from zeroed accumulators, consumes a buffer whose size is
+ * a multiple of FLETCHER_4_SIMD_SIZE, and leaves the per-lane accumulators
+ * in the context; the generic code then folds the lanes into a single
+ * checksum.
+ */
+#define	FLETCHER_4_MAX_LANES	8
+#define	FLETCHER_4_SIMD_SIZE	64
+
+typedef struct fletcher_4_ctx {
+	uint64_t	f4c_acc[4][FLETCHER_4_MAX_LANES];	/* a, b, c, d */
+} fletcher_4_ctx_t;
+
+typedef void (*fletcher_4_compute_f)(fletcher_4_ctx_t *, const void *,
+    size_t);
+
+#define	FLETCHER_4_IMPL_NAME_MAX	16
+
+typedef struct fletcher_4_ops {
+	fletcher_4_compute_f	compute_native;
+	fletcher_4_compute_f	compute_byteswap;
+	boolean_t		(*valid)(void);
+	uint_t			lanes;
+	const char		*name;
+} fletcher_4_ops_t;
+
+#if defined(__amd64)
+extern const fletcher_4_ops_t fletcher_4_sse2_ops;
+extern const fletcher_4_ops_t fletcher_4_ssse3_ops;
+extern const fletcher_4_ops_t fletcher_4_avx2_ops;
+extern const fletcher_4_ops_t fletcher_4_avx512f_ops;
+#endif
 
 #ifdef	__cplusplus
 }
@@ -0,0 +1,121 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2020 Joyent, Inc.
+ */
+
+/*
+ * AVX-512F fletcher-4 implementation.  Each 512-bit register holds eight
+ * 64-bit lanes of one accumulator (a, b, c and d live in zmm0-zmm3); every
+ * 32 bytes of input are zero-extended into one register of eight lanes.
+ *
+ * AVX-512F alone has no 512-bit byte shuffle, so the byteswap variant swaps
+ * each 32-byte load with the AVX2 vpshufb before widening it.  Every CPU
+ * implementing AVX-512F also implements AVX2.
+ */
+
+#if defined(__amd64)
+
+#include <sys/types.h>
+#include <sys/simd.h>
+#include <zfs_fletcher.h>
+
+#define	__asm __asm__ __volatile__
+
+#define	FLETCHER_4_AVX512_INIT						\
+	"vpxorq %%zmm0, %%zmm0, %%zmm0\n"				\
+	"vpxorq %%zmm1, %%zmm1, %%zmm1\n"				\
+	"vpxorq %%zmm2, %%zmm2, %%zmm2\n"				\
+	"vpxorq %%zmm3, %%zmm3, %%zmm3\n"
+
+#define	FLETCHER_4_AVX512_STEP						\
+	"vpaddq %%zmm4, %%zmm0, %%zmm0\n"				\
+	"vpaddq %%zmm0, %%zmm1, %%zmm1\n"				\
+	"vpaddq %%zmm1, %%zmm2, %%zmm2\n"				\
+	"vpaddq %%zmm2, %%zmm3, %%zmm3\n"				\
+	"add $32, %[IP]\n"						\
+	"cmp %[END], %[IP]\n"						\
+	"jb 1b\n"
+
+#define	FLETCHER_4_AVX512_SAVE						\
+	"vmovdqu64 %%zmm0, 0x00(%[ACC])\n"				\
+	"vmovdqu64 %%zmm1, 0x40(%[ACC])\n"				\
+	"vmovdqu64 %%zmm2, 0x80(%[ACC])\n"				\
+	"vmovdqu64 %%zmm3, 0xc0(%[ACC])\n"				\
+	"vzeroupper\n"
+
+#define	FLETCHER_4_AVX512_CLOBBERS					\
+	"cc", "memory", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5"
+
+static void
+fletcher_4_avx512f_native(fletcher_4_ctx_t *ctx, const void *buf, size_t size)
+{
+	const uint8_t *ip = buf;
+	const uint8_t *ipend = ip + size;
+
+	kfpu_begin();
+	__asm(FLETCHER_4_AVX512_INIT
+	    "1:\n"
+	    "vpmovzxdq (%[IP]), %%zmm4\n"
+	    FLETCHER_4_AVX512_STEP
+	    FLETCHER_4_AVX512_SAVE
+	    : [IP] "+r" (ip)
+	    : [END] "r" (ipend), [ACC] "r" (ctx->f4c_acc)
+	    : FLETCHER_4_AVX512_CLOBBERS);
+	kfpu_end();
+}
+
+static const uint8_t fletcher_4_avx512_bswap_mask[32]
+    __attribute__((aligned(32))) = {
+	3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+	3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+};
+
+static void
+fletcher_4_avx512f_byteswap(fletcher_4_ctx_t *ctx, const void *buf,
+    size_t size)
+{
+	const uint8_t *ip = buf;
+	const uint8_t *ipend = ip + size;
+
+	kfpu_begin();
+	__asm(FLETCHER_4_AVX512_INIT
+	    "vmovdqa %[MASK], %%ymm5\n"
+	    "1:\n"
+	    "vmovdqu (%[IP]), %%ymm4\n"
+	    "vpshufb %%ymm5, %%ymm4, %%ymm4\n"
+	    "vpmovzxdq %%ymm4, %%zmm4\n"
+	    FLETCHER_4_AVX512_STEP
+	    FLETCHER_4_AVX512_SAVE
+	    : [IP] "+r" (ip)
+	    : [END] "r" (ipend), [ACC] "r" (ctx->f4c_acc),
+	    [MASK] "m" (fletcher_4_avx512_bswap_mask)
+	    : FLETCHER_4_AVX512_CLOBBERS);
+	kfpu_end();
+}
+
+static boolean_t
+fletcher_4_avx512f_valid(void)
+{
+	return (kfpu_allowed() && zfs_avx2_available() &&
+	    zfs_avx512f_available());
+}
+
+const fletcher_4_ops_t fletcher_4_avx512f_ops = {
+	.compute_native = fletcher_4_avx512f_native,
+	.compute_byteswap = fletcher_4_avx512f_byteswap,
+	.valid = fletcher_4_avx512f_valid,
+	.lanes = 8,
+	.name = "avx512f"
+};
+
+#endif /* defined(__amd64) */
@@ -0,0 +1,115 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2020 Joyent, Inc.
+ */
+
+/*
+ * AVX2 fletcher-4 implementation.  Each 256-bit register holds four 64-bit
+ * lanes of one accumulator (a, b, c and d live in ymm0-ymm3); every 16
+ * bytes of input are zero-extended into one register of four lanes.
+ */
+
+#if defined(__amd64)
+
+#include <sys/types.h>
+#include <sys/simd.h>
+#include <zfs_fletcher.h>
+
+#define	__asm __asm__ __volatile__
+
+#define	FLETCHER_4_AVX2_INIT						\
+	"vpxor %%ymm0, %%ymm0, %%ymm0\n"				\
+	"vpxor %%ymm1, %%ymm1, %%ymm1\n"				\
+	"vpxor %%ymm2, %%ymm2, %%ymm2\n"				\
+	"vpxor %%ymm3, %%ymm3, %%ymm3\n"
+
+#define	FLETCHER_4_AVX2_STEP						\
+	"vpaddq %%ymm4, %%ymm0, %%ymm0\n"				\
+	"vpaddq %%ymm0, %%ymm1, %%ymm1\n"				\
+	"vpaddq %%ymm1, %%ymm2, %%ymm2\n"				\
+	"vpaddq %%ymm2, %%ymm3, %%ymm3\n"				\
+	"add $16, %[IP]\n"						\
+	"cmp %[END], %[IP]\n"						\
+	"jb 1b\n"
+
+#define	FLETCHER_4_AVX2_SAVE						\
+	"vmovdqu %%ymm0, 0x00(%[ACC])\n"				\
+	"vmovdqu %%ymm1, 0x40(%[ACC])\n"				\
+	"vmovdqu %%ymm2, 0x80(%[ACC])\n"				\
+	"vmovdqu %%ymm3, 0xc0(%[ACC])\n"				\
+	"vzeroupper\n"
+
+#define	FLETCHER_4_AVX2_CLOBBERS					\
+	"cc", "memory", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5"
+
+static void
+fletcher_4_avx2_native(fletcher_4_ctx_t *ctx, const void *buf, size_t size)
+{
+	const uint8_t *ip = buf;
+	const uint8_t *ipend = ip + size;
+
+	kfpu_begin();
+	__asm(FLETCHER_4_AVX2_INIT
+	    "1:\n"
+	    "vpmovzxdq (%[IP]), %%ymm4\n"
+	    FLETCHER_4_AVX2_STEP
+	    FLETCHER_4_AVX2_SAVE
+	    : [IP] "+r" (ip)
+	    : [END] "r" (ipend), [ACC] "r" (ctx->f4c_acc)
+	    : FLETCHER_4_AVX2_CLOBBERS);
+	kfpu_end();
+}
+
+static const uint8_t fletcher_4_avx2_bswap_mask[16]
+    __attribute__((aligned(16))) = {
+	3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+};
+
+static void
+fletcher_4_avx2_byteswap(fletcher_4_ctx_t *ctx, const void *buf, size_t size)
+{
+	const uint8_t *ip = buf;
+	const uint8_t *ipend = ip + size;
+
+	kfpu_begin();
+	__asm(FLETCHER_4_AVX2_INIT
+	    "vmovdqa %[MASK], %%xmm5\n"
+	    "1:\n"
+	    "vmovdqu (%[IP]), %%xmm4\n"
+	    "vpshufb %%xmm5, %%xmm4, %%xmm4\n"
+	    "vpmovzxdq %%xmm4, %%ymm4\n"
+	    FLETCHER_4_AVX2_STEP
+	    FLETCHER_4_AVX2_SAVE
+	    : [IP] "+r" (ip)
+	    : [END] "r" (ipend), [ACC] "r" (ctx->f4c_acc),
+	    [MASK] "m" (fletcher_4_avx2_bswap_mask)
+	    : FLETCHER_4_AVX2_CLOBBERS);
+	kfpu_end();
+}
+
+static boolean_t
+fletcher_4_avx2_valid(void)
+{
+	return (kfpu_allowed() && zfs_avx_available() &&
+	    zfs_avx2_available());
+}
+
+const fletcher_4_ops_t fletcher_4_avx2_ops = {
+	.compute_native = fletcher_4_avx2_native,
+	.compute_byteswap = fletcher_4_avx2_byteswap,
+	.valid = fletcher_4_avx2_valid,
+	.lanes = 4,
+	.name = "avx2"
+};
+
+#endif /* defined(__amd64) */
@@ -0,0 +1,179 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2020 Joyent, Inc.
+ */
+
+/*
+ * SSE2 and SSSE3 fletcher-4 implementations.  Each 128-bit register holds
+ * two 64-bit lanes of one accumulator (a, b, c and d live in xmm0-xmm3);
+ * every 16 bytes of input are split into two pairs of zero-extended words,
+ * giving two recurrence steps per load.
+ *
+ * Each kernel is a single asm statement, so the accumulators never have to
+ * survive compiler-generated code between statements.
+ */
+
+#if defined(__amd64)
+
+#include <sys/types.h>
+#include <sys/simd.h>
+#include <zfs_fletcher.h>
+
+#define	__asm __asm__ __volatile__
+
+#define	FLETCHER_4_SSE_INIT						\
+	"pxor %%xmm0, %%xmm0\n"						\
+	"pxor %%xmm1, %%xmm1\n"						\
+	"pxor %%xmm2, %%xmm2\n"						\
+	"pxor %%xmm3, %%xmm3\n"						\
+	"pxor %%xmm7, %%xmm7\n"
+
+/*
+ * Two recurrence steps: one for the low pair of words in xmm4 and one for
+ * the high pair which is unpacked into xmm5.
+ */
+#define	FLETCHER_4_SSE_STEP						\
+	"movdqa %%xmm4, %%xmm5\n"					\
+	"punpckldq %%xmm7, %%xmm4\n"					\
+	"punpckhdq %%xmm7, %%xmm5\n"					\
+	"paddq %%xmm4, %%xmm0\n"					\
+	"paddq %%xmm0, %%xmm1\n"					\
+	"paddq %%xmm1, %%xmm2\n"					\
+	"paddq %%xmm2, %%xmm3\n"					\
+	"paddq %%xmm5, %%xmm0\n"					\
+	"paddq %%xmm0, %%xmm1\n"					\
+	"paddq %%xmm1, %%xmm2\n"					\
+	"paddq %%xmm2, %%xmm3\n"
+
+#define	FLETCHER_4_SSE_NEXT						\
+	"add $16, %[IP]\n"						\
+	"cmp %[END], %[IP]\n"						\
+	"jb 1b\n"
+
+#define	FLETCHER_4_SSE_SAVE						\
+	"movdqu %%xmm0, 0x00(%[ACC])\n"					\
+	"movdqu %%xmm1, 0x40(%[ACC])\n"					\
+	"movdqu %%xmm2, 0x80(%[ACC])\n"					\
+	"movdqu %%xmm3, 0xc0(%[ACC])\n"
+
+#define	FLETCHER_4_SSE_CLOBBERS						\
+	"cc", "memory", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5",	\
+	"xmm6", "xmm7"
+
+static void
+fletcher_4_sse2_native(fletcher_4_ctx_t *ctx, const void *buf, size_t size)
+{
+	const uint8_t *ip = buf;
+	const uint8_t *ipend = ip + size;
+
+	kfpu_begin();
+	__asm(FLETCHER_4_SSE_INIT
+	    "1:\n"
+	    "movdqu (%[IP]), %%xmm4\n"
+	    FLETCHER_4_SSE_STEP
+	    FLETCHER_4_SSE_NEXT
+	    FLETCHER_4_SSE_SAVE
+	    : [IP] "+r" (ip)
+	    : [END] "r" (ipend), [ACC] "r" (ctx->f4c_acc)
+	    : FLETCHER_4_SSE_CLOBBERS);
+	kfpu_end();
+}
+
+/*
+ * SSE2 has no byte shuffle, so swap each word by rotating it by 16 bits and
+ * then swapping the two bytes within each 16-bit half.
+ */
+static void
+fletcher_4_sse2_byteswap(fletcher_4_ctx_t *ctx, const void *buf, size_t size)
+{
+	const uint8_t *ip = buf;
+	const uint8_t *ipend = ip + size;
+
+	kfpu_begin();
+	__asm(FLETCHER_4_SSE_INIT
+	    "1:\n"
+	    "movdqu (%[IP]), %%xmm4\n"
+	    "movdqa %%xmm4, %%xmm5\n"
+	    "pslld $16, %%xmm4\n"
+	    "psrld $16, %%xmm5\n"
+	    "por %%xmm5, %%xmm4\n"
+	    "movdqa %%xmm4, %%xmm5\n"
+	    "psllw $8, %%xmm4\n"
+	    "psrlw $8, %%xmm5\n"
+	    "por %%xmm5, %%xmm4\n"
+	    FLETCHER_4_SSE_STEP
+	    FLETCHER_4_SSE_NEXT
+	    FLETCHER_4_SSE_SAVE
+	    : [IP] "+r" (ip)
+	    : [END] "r" (ipend), [ACC] "r" (ctx->f4c_acc)
+	    : FLETCHER_4_SSE_CLOBBERS);
+	kfpu_end();
+}
+
+static boolean_t
+fletcher_4_sse2_valid(void)
+{
+	return (kfpu_allowed() && zfs_sse2_available());
+}
+
+const fletcher_4_ops_t fletcher_4_sse2_ops = {
+	.compute_native = fletcher_4_sse2_native,
+	.compute_byteswap = fletcher_4_sse2_byteswap,
+	.valid = fletcher_4_sse2_valid,
+	.lanes = 2,
+	.name = "sse2"
+};
+
+static const uint8_t fletcher_4_sse_bswap_mask[16]
+    __attribute__((aligned(16))) = {
+	3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+};
+
+static void
+fletcher_4_ssse3_byteswap(fletcher_4_ctx_t *ctx, const void *buf, size_t size)
+{
+	const uint8_t *ip = buf;
+	const uint8_t *ipend = ip + size;
+
+	kfpu_begin();
+	__asm(FLETCHER_4_SSE_INIT
+	    "movdqa %[MASK], %%xmm6\n"
+	    "1:\n"
+	    "movdqu (%[IP]), %%xmm4\n"
+	    "pshufb %%xmm6, %%xmm4\n"
+	    FLETCHER_4_SSE_STEP
+	    FLETCHER_4_SSE_NEXT
+	    FLETCHER_4_SSE_SAVE
+	    : [IP] "+r" (ip)
+	    : [END] "r" (ipend), [ACC] "r" (ctx->f4c_acc),
+	    [MASK] "m" (fletcher_4_sse_bswap_mask)
+	    : FLETCHER_4_SSE_CLOBBERS);
+	kfpu_end();
+}
+
+static boolean_t
+fletcher_4_ssse3_valid(void)
+{
+	return (kfpu_allowed() && zfs_sse2_available() &&
+	    zfs_ssse3_available());
+}
+
+const fletcher_4_ops_t fletcher_4_ssse3_ops = {
+	.compute_native = fletcher_4_sse2_native,
+	.compute_byteswap = fletcher_4_ssse3_byteswap,
+	.valid = fletcher_4_ssse3_valid,
+	.lanes = 2,
+	.name = "ssse3"
+};
+
+#endif /* defined(__amd64) */
@@ -42,6 +42,7 @@ extern "C" {
 
 int	port_create(void);
 int	port_associate(int, int, uintptr_t, int, void *);
+int	port_associaten(int, port_assoc_t [], int [], uint_t);
 int	port_dissociate(int, int, uintptr_t);
 int	port_send(int, int, void *);
 int	port_sendn(int [], int [], uint_t, int, void *);
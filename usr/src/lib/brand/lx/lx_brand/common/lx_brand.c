@@ -1091,8 +1091,8 @@ static lx_syscall_handler_t lx_handlers[] = {
 	NULL,				/*  73: flock */
 	lx_fsync,			/*  74: fsync */
 	lx_fdatasync,			/*  75: fdatasync */
-	lx_truncate,			/*  76: truncate */
-	lx_ftruncate,			/*  77: ftruncate */
+	NULL,				/*  76: truncate */
+	NULL,				/*  77: ftruncate */
 	NULL,				/*  78: getdents */
 	NULL,				/*  79: getcwd */
 	NULL,				/*  80: chdir */
@@ -1438,8 +1438,8 @@ static lx_syscall_handler_t lx_handlers[] = {
 	lx_readdir,			/*  89: readdir */
 	NULL,				/*  90: mmap */
 	NULL,				/*  91: munmap */
-	lx_truncate,			/*  92: truncate */
-	lx_ftruncate,			/*  93: ftruncate */
+	NULL,				/*  92: truncate */
+	NULL,				/*  93: ftruncate */
 	NULL,				/*  94: fchmod */
 	NULL,				/*  95: fchown16 */
 	NULL,				/*  96: getpriority */
@@ -1539,8 +1539,8 @@ static lx_syscall_handler_t lx_handlers[] = {
 	lx_vfork,			/* 190: vfork */
 	NULL,				/* 191: getrlimit */
 	NULL,				/* 192: mmap2 */
-	lx_truncate64,			/* 193: truncate64 */
-	lx_ftruncate64,			/* 194: ftruncate64 */
+	NULL,				/* 193: truncate64 */
+	NULL,				/* 194: ftruncate64 */
 	NULL,				/* 195: stat64 */
 	NULL,				/* 196: lstat64 */
 	NULL,				/* 197: fstat64 */
@@ -76,10 +76,6 @@ extern long lx_timer_gettime(timer_t, struct itimerspec *);
 extern long lx_timer_getoverrun(timer_t);
 extern long lx_timer_delete(timer_t);
 
-extern long lx_truncate(uintptr_t, uintptr_t);
-extern long lx_ftruncate(uintptr_t, uintptr_t);
-extern long lx_truncate64(uintptr_t, uintptr_t, uintptr_t);
-extern long lx_ftruncate64(uintptr_t, uintptr_t, uintptr_t);
 
 extern long lx_sysctl(uintptr_t);
 extern long lx_fsync(uintptr_t);
@@ -29,6 +29,10 @@
  * All rights reserved.
  */
 
+/*
+ * Copyright 2020 Joyent, Inc.
+ */
+
 /*
  * memcpy.s - copies two blocks of memory
  *	Implements memcpy() and memmove() libc primitives.
@@ -64,7 +68,9 @@
  * } else {
  *	Align destination to 16-byte boundary
  *
- *      if (NO_SSE) {
+ *	if (USE_ERMS && size >= 2K && size <= half of the largest level cache) {
+ *		Use rep movsb
+ *	} else if (!USE_SSE2) {
  *		If (size > half of the largest level cache) {
  *			Use 8-byte non-temporal stores (64-bytes/loop)
  *		} else {
@@ -936,8 +942,29 @@ L(ck_use_sse2):
 	jnz    L(ShrtAlignNew)
 
 L(now_qw_aligned):
-	cmpl   $NO_SSE,.memops_method(%rip) 
-	je     L(Loop8byte_pre)
+	/*
+	 * With enhanced rep movsb, the microcode copies in whole cache lines
+	 * and beats the loops below for anything that is not so large as to
+	 * want non-temporal stores.
+	 */
+	testl  $USE_ERMS,.memops_method(%rip)
+	jz     L(ck_sse)
+	cmp    $0x800,%r8		# 2K
+	jl     L(ck_sse)
+	mov    .largest_level_cache_size(%rip),%r9d
+	shr    %r9		# take half of it
+	cmp    %r9,%r8
+	jg     L(ck_sse)
+	mov    %rdx,%rsi		# %rsi = source
+	mov    %rcx,%rdi		# %rdi = destination
+	mov    %r8,%rcx			# %rcx = count
+	rep
+	  movsb
+	ret
+
+L(ck_sse):
+	testl  $USE_SSE2,.memops_method(%rip)
+	jz     L(Loop8byte_pre)
 
 	/*
 	 * The fall-through path is to do SSE2 16-byte load/stores
@@ -2429,8 +2456,8 @@ L(bk_got3):
 
 	.balign 16
 L(bk_ck_sse2_alignment):
-	cmpl   $NO_SSE,.memops_method(%rip)
-	je     L(bk_use_rep)
+	testl  $USE_SSE2,.memops_method(%rip)
+	jz     L(bk_use_rep)
 	# check alignment of last byte
 	test   $0xf,%rcx
 	jz     L(bk_sse2_cpy)
@@ -31,6 +31,10 @@
 
 /*
  * Portions Copyright 2009 Advanced Micro Devices, Inc.
+ */
+
+/*
+ * Copyright 2020 Joyent, Inc.
  */
 
 	.file	"memset.s"
@@ -61,7 +65,9 @@
  * } else {
  *	Align destination to 16-byte boundary
  *
- *      if (NO_SSE) {
+ *	if (USE_ERMS && size >= 2K && size <= largest level cache) {
+ *		Use rep stosb
+ *	} else if (!USE_SSE2) {
  *		If (size > largest level cache) {
  *			Use 8-byte non-temporal stores (64-bytes/loop)
  *		} else {
@@ -539,8 +545,24 @@ L(aligned_now):
 		/*
 		 * Check memops method
 		 */
-		cmpl   $NO_SSE,.memops_method(%rip)
-		je     L(Loop8byte_pre)
+		testl  $USE_ERMS,.memops_method(%rip)
+		jz     L(ck_sse)
+		cmp    $0x800,%r8		# Use rep stosb
+		jl     L(ck_sse)
+		mov    .largest_level_cache_size(%rip),%r9d
+		cmp    %r9,%r8
+		jg     L(ck_sse)
+		mov    %rax,%r9		# save the return value
+		mov    %rdx,%rax	# pattern in %al
+		mov    %r8,%rcx
+		rep
+		  stosb
+		mov    %r9,%rax
+		ret
+
+L(ck_sse):
+		testl  $USE_SSE2,.memops_method(%rip)
+		jz     L(Loop8byte_pre)
 
 		/*
 		 * Use SSE2 instructions
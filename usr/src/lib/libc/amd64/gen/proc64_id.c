@@ -28,6 +28,10 @@
  * Portions Copyright 2009 Advanced Micro Devices, Inc.
  */
 
+/*
+ * Copyright 2020 Joyent, Inc.
+ */
+
 #include <sys/types.h>
 #include "proc64_id.h"
 
@@ -162,6 +166,28 @@ get_amd_cache_info(void)
 	    largest_level_cache);
 }
 
+/*
+ * get_erms()
+ *	Return USE_ERMS if the processor implements enhanced REP MOVSB/STOSB,
+ *	with which a byte-granular rep movsb or rep stosb beats any of our
+ *	explicit loops for large in-cache copies and fills.  maxeax is the
+ *	highest standard cpuid function.
+ */
+static int
+get_erms(uint_t maxeax)
+{
+	struct cpuid_values cpuid_info;
+
+	if (maxeax < 7)
+		return (NO_SSE);
+
+	__libc_get_cpuid(7, &cpuid_info, 0);
+	if (cpuid_info.ebx & CPUID_INTC_EBX_7_0_ENH_REP_MOV)
+		return (USE_ERMS);
+
+	return (NO_SSE);
+}
+
 /*
  * proc64_id()
  *	Determine cache and SSE level to use for memops and strops specific to
@@ -172,8 +198,10 @@ __proc64id(void)
 {
 	int use_sse = NO_SSE;
 	struct cpuid_values cpuid_info;
+	uint_t maxeax;
 
 	__libc_get_cpuid(0, &cpuid_info, 0);
+	maxeax = cpuid_info.eax;
 
 	/*
 	 * Check for AuthenticAMD
@@ -182,6 +210,12 @@ __proc64id(void)
 	    (cpuid_info.edx == 0x69746e65) && /* enti */
 	    (cpuid_info.ecx == 0x444d4163)) { /* cAMD */
 		get_amd_cache_info();
+		/*
+		 * The SSE paths remain disabled on AMD (see memcpy.s), but
+		 * processors which advertise ERMS get the rep movsb and
+		 * rep stosb paths.
+		 */
+		__intel_set_memops_method(get_erms(maxeax));
 		return;
 	}
 
@@ -228,6 +262,7 @@ __proc64id(void)
 			use_sse |= USE_SSE2;
 		}
 		use_sse |= USE_BSF;
+		use_sse |= get_erms(maxeax);
 		__intel_set_memops_method(use_sse);
 	} else {
 		__set_cache_sizes(INTEL_DFLT_L1_CACHE_SIZE,
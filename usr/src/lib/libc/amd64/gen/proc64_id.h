@@ -28,6 +28,10 @@
  * Portions Copyright 2009 Advanced Micro Devices, Inc.
  */
 
+/*
+ * Copyright 2020 Joyent, Inc.
+ */
+
 #ifndef	_PROC64_ID_H
 #define	_PROC64_ID_H
 
@@ -47,6 +51,7 @@ extern "C" {
 #define	USE_SSE4_1	0x08	/* SSE 4.1 */
 #define	USE_SSE4_2	0x10	/* SSE 4.2 */
 #define	USE_BSF		0x20	/* USE BSF class of instructions */
+#define	USE_ERMS	0x40	/* Enhanced REP MOVSB/STOSB */
 
 /*
  * Cache size defaults for Core 2 Duo
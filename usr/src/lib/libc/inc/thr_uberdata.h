@@ -24,7 +24,7 @@
  */
 
 /*
- * Copyright 2016 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright 2018 Nexenta Systems, Inc.
  */
 
@@ -500,7 +500,7 @@ typedef struct {
  * to track the total amount of data stored across those linked lists. For more
  * information, see libumem's big theory statement.
  */
-#define	NTMEMBASE	16
+#define	NTMEMBASE	32
 
 typedef struct {
 	size_t		tm_size;
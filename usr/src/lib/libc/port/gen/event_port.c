@@ -62,6 +62,45 @@ port_associate(int port, int source, uintptr_t object, int events, void *user)
 	return (r.r_val1);
 }
 
+/*
+ * Associate a list of objects with a port.  As with port_sendn(), the
+ * number of successful associations is returned, and if that is less than
+ * nent, errors[] holds the error for every entry which failed.
+ */
+int
+port_associaten(int port, port_assoc_t list[], int errors[], uint_t nent)
+{
+	rval_t	r;
+	uint_t	offset;
+	uint_t	lnent;
+	uint_t	nassoc;
+
+	if (nent <= PORT_MAX_LIST) {
+		r.r_vals = _portfs(PORT_ASSOCIATEN, port, (uintptr_t)list,
+		    (uintptr_t)errors, nent, 0);
+		return (r.r_val1);
+	}
+
+	/* use chunks of max PORT_MAX_LIST elements per syscall */
+	nassoc = 0;
+	for (offset = 0; offset < nent; offset += lnent) {
+		if (nent - offset > PORT_MAX_LIST)
+			lnent = PORT_MAX_LIST;
+		else
+			lnent = nent - offset;
+		r.r_vals = _portfs(PORT_ASSOCIATEN, port,
+		    (uintptr_t)&list[offset], (uintptr_t)&errors[offset],
+		    lnent, 0);
+		if (r.r_val1 == -1) {
+			/* global error, return what was associated so far */
+			if (nassoc)
+				return (nassoc);
+			return (-1);
+		}
+		nassoc += r.r_val1;
+	}
+	return (nassoc);
+}
 
 int
 port_get(int port, port_event_t *pe, struct timespec *to)
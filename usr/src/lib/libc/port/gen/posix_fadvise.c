@@ -30,21 +30,32 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/filio.h>
+#include <unistd.h>
 #include <errno.h>
 
 /*
  * SUSv3 - file advisory information
  *
- * This function does nothing, but that's OK because the
- * Posix specification doesn't require it to do anything
- * other than return appropriate error numbers.
- *
- * In the future, a file system dependent fadvise() or fcntl()
- * interface, similar to madvise(), should be developed to enable
- * the kernel to optimize I/O operations based on the given advice.
+ * The advice for a regular file is handed to its file system through the
+ * _FIO_ADVISE ioctl.  Advice is only a hint: the Posix specification
+ * doesn't require it to do anything other than return appropriate error
+ * numbers, so file systems that ignore it (or fail to act on it) don't
+ * change the result.
  */
 
-/* ARGSUSED1 */
+static void
+fadvise_fs(int fd, off64_t offset, off64_t len, int advice)
+{
+	fio_advise_t fa;
+
+	fa.fa_offset = offset;
+	fa.fa_len = len;
+	fa.fa_advice = advice;
+	fa.fa_pad = 0;
+	(void) ioctl(fd, _FIO_ADVISE, &fa);
+}
+
 int
 posix_fadvise(int fd, off_t offset, off_t len, int advice)
 {
@@ -67,12 +78,13 @@ posix_fadvise(int fd, off_t offset, off_t len, int advice)
 		return (EBADF);
 	if (S_ISFIFO(statb.st_mode))
 		return (ESPIPE);
+	if (S_ISREG(statb.st_mode))
+		fadvise_fs(fd, offset, len, advice);
 	return (0);
 }
 
 #if !defined(_LP64)
 
-/* ARGSUSED1 */
 int
 posix_fadvise64(int fd, off64_t offset, off64_t len, int advice)
 {
@@ -95,6 +107,8 @@ posix_fadvise64(int fd, off64_t offset, off64_t len, int advice)
 		return (EBADF);
 	if (S_ISFIFO(statb.st_mode))
 		return (ESPIPE);
+	if (S_ISREG(statb.st_mode))
+		fadvise_fs(fd, offset, len, advice);
 	return (0);
 }
 
@@ -21,6 +21,7 @@
 
 /*
  * Copyright (c) 2010, Oracle and/or its affiliates. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include "lint.h"
@@ -33,6 +34,7 @@
 #include <unistd.h>
 #include <limits.h>
 #include <malloc.h>
+#include <string.h>
 #include <sys/types.h>
 #include "stdiom.h"
 
@@ -44,9 +46,10 @@ getdelim(char **_RESTRICT_KYWD lineptr, size_t *_RESTRICT_KYWD n,
 {
 	rmutex_t *lk;
 	char *ptr;
+	Uchar *p;
 	size_t size;
-	int c;
 	size_t cnt;
+	size_t len;
 
 	if (lineptr == NULL || n == NULL ||
 	    delimiter < 0 || delimiter > UCHAR_MAX) {
@@ -69,26 +72,49 @@ getdelim(char **_RESTRICT_KYWD lineptr, size_t *_RESTRICT_KYWD n,
 
 	_SET_ORIENTATION_BYTE(iop);
 
-	do {
-		c = (--iop->_cnt < 0) ? __filbuf(iop) : *iop->_ptr++;
-		if (c == EOF)
-			break;
-		*ptr++ = c;
-		if (++cnt == size) {	/* must reallocate */
-			if ((ptr = realloc(*lineptr, 2 * size)) == NULL) {
+	/*
+	 * Rather than a character at a time, search what's left of the buffer
+	 * for the delimiter and copy up to it in one go.
+	 */
+	for (;;) {
+		/* empty buffer */
+		if (iop->_cnt <= 0) {
+			if (__filbuf(iop) == EOF)
+				break;
+			iop->_ptr--;	/* put back the character */
+			iop->_cnt++;
+		}
+		if ((p = memchr(iop->_ptr, delimiter,
+		    (size_t)iop->_cnt)) != NULL)
+			len = (size_t)(p - iop->_ptr) + 1;
+		else
+			len = (size_t)iop->_cnt;
+
+		if (cnt + len >= size) {	/* must reallocate */
+			size_t nsize = size;
+
+			while (cnt + len >= nsize && nsize <= SIZE_MAX / 2)
+				nsize *= 2;
+			if (cnt + len >= nsize ||
+			    (ptr = realloc(*lineptr, nsize)) == NULL) {
 				FUNLOCKFILE(lk);
-				ptr = *lineptr + size - 1;
-				*ptr = '\0';
+				(*lineptr)[cnt] = '\0';
 				errno = ENOMEM;
 				return (-1);
 			}
 			*lineptr = ptr;
-			ptr += size;
-			*n = size = 2 * size;
+			*n = size = nsize;
 		}
-	} while (c != delimiter);
 
-	*ptr = '\0';
+		(void) memcpy(*lineptr + cnt, iop->_ptr, len);
+		cnt += len;
+		iop->_ptr += len;
+		iop->_cnt -= len;
+		if (p != NULL)
+			break;		/* delimiter found */
+	}
+
+	(*lineptr)[cnt] = '\0';
 
 	FUNLOCKFILE(lk);
 	if (cnt > SSIZE_MAX) {
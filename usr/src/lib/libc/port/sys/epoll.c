@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <string.h>
 
 /*
  * Events that match their epoll(7) equivalents.
@@ -65,6 +66,12 @@
 #define	EPOLLSWIZZLED	\
 	(EPOLLRDHUP | EPOLLONESHOT | EPOLLET | EPOLLWRBAND | EPOLLWRNORM)
 
+/*
+ * Events which may accompany EPOLLEXCLUSIVE.
+ */
+#define	EPOLLEXCLUSIVE_OK	(EPOLLIN | EPOLLOUT | EPOLLERR | EPOLLHUP | \
+	EPOLLWAKEUP | EPOLLET | EPOLLEXCLUSIVE)
+
 /*
  * The defined behavior for epoll_wait/epoll_pwait when using a timeout less
  * than 0 is to wait for events until they arrive (or interrupted by a signal).
@@ -133,6 +140,7 @@ epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
 	uint32_t events, ev = 0;
 	int i = 0, res;
 
+	(void) memset(epoll, 0, sizeof (epoll));
 	epoll[i].dpep_pollfd.fd = fd;
 
 	switch (op) {
@@ -163,6 +171,18 @@ epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
 		events = event->events;
 		ev = events & ~(EPOLLIGNORED | EPOLLSWIZZLED);
 
+		/*
+		 * EPOLLEXCLUSIVE is passed to /dev/poll out-of-band, and
+		 * only a limited set of other events may accompany it.
+		 */
+		if ((events & EPOLLEXCLUSIVE) != 0) {
+			if ((events & ~EPOLLEXCLUSIVE_OK) != 0) {
+				errno = EINVAL;
+				return (-1);
+			}
+			epoll[i].dpep_pollfd.revents = DP_EPOLL_EXCLUSIVE;
+		}
+
 		if (events & EPOLLRDHUP)
 			ev |= POLLRDHUP;
 
@@ -22,6 +22,7 @@
 /*
  * Copyright (c) 1999, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright (c) 2016 by Delphix. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include "lint.h"
@@ -366,6 +367,61 @@ write_unlock_try(rwlock_t *rwlp)
 	return (0);
 }
 
+/*
+ * Spin for a while, trying to grab a process-private rwlock that is held by
+ * a writer, before going off to sleep in rwlock_lock().  This is the rwlock
+ * equivalent of mutex_trylock_adaptive(): it is bounded by the thread's
+ * adaptive spin count, and we stop as soon as the writer is seen not to be
+ * running on a processor, since it will not drop the lock any time soon.
+ * See mutex_trylock_adaptive() for why looking at the owner's schedctl data
+ * is safe.
+ *
+ * A writer waiting for readers to drain has no single owner to watch, and
+ * once threads are queued on the lock the fast-path attempts cannot succeed,
+ * so in both cases we give up immediately and let rwlock_lock() queue us.
+ * Return true if the lock was acquired.
+ */
+static int
+rwlock_spin(rwlock_t *rwlp, int rd_wr)
+{
+	volatile uint32_t *rwstate = (volatile uint32_t *)&rwlp->rwlock_readers;
+	volatile uint64_t *ownerp = (volatile uint64_t *)&rwlp->rwlock_owner;
+	ulwp_t *self = curthread;
+	volatile sc_shared_t *scp;
+	ulwp_t *ulwp;
+	uint32_t readers;
+	int max_count;
+	int count;
+
+	ASSERT(rwlp->rwlock_type != USYNC_PROCESS);
+
+	if (self->ul_max_spinners == 0 ||
+	    (max_count = self->ul_adaptive_spin) == 0)
+		return (0);
+
+	for (count = 0; count < max_count; count++) {
+		SMT_PAUSE();
+		readers = *rwstate;
+		if (readers & URW_HAS_WAITERS)
+			break;
+		if (readers & URW_WRITE_LOCKED) {
+			if ((ulwp = (ulwp_t *)(uintptr_t)*ownerp) != NULL &&
+			    ((scp = ulwp->ul_schedctl) == NULL ||
+			    scp->sc_state != SC_ONPROC))
+				break;
+		} else if (rd_wr == READ_LOCK) {
+			if (read_lock_try(rwlp, 0))
+				return (1);
+		} else if ((readers & URW_READERS_MASK) == 0) {
+			if (write_lock_try(rwlp, 0))
+				return (1);
+		} else {
+			break;
+		}
+	}
+	return (0);
+}
+
 /*
  * Release a process-private rwlock and wake up any thread(s) sleeping on it.
  * This is called when a thread releases a lock that appears to have waiters.
@@ -746,7 +802,9 @@ rw_rdlock_impl(rwlock_t *rwlp, timespec_t *tsp)
 		error = 0;
 	else if (rwlp->rwlock_type == USYNC_PROCESS)	/* kernel-level */
 		error = shared_rwlock_lock(rwlp, tsp, READ_LOCK);
-	else						/* user-level */
+	else if (rwlock_spin(rwlp, READ_LOCK))		/* user-level */
+		error = 0;
+	else
 		error = rwlock_lock(rwlp, tsp, READ_LOCK);
 
 out:
@@ -843,7 +901,9 @@ rw_wrlock_impl(rwlock_t *rwlp, timespec_t *tsp)
 		error = 0;
 	else if (rwlp->rwlock_type == USYNC_PROCESS)	/* kernel-level */
 		error = shared_rwlock_lock(rwlp, tsp, WRITE_LOCK);
-	else						/* user-level */
+	else if (rwlock_spin(rwlp, WRITE_LOCK))		/* user-level */
+		error = 0;
+	else
 		error = rwlock_lock(rwlp, tsp, WRITE_LOCK);
 
 out:
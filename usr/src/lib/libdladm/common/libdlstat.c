@@ -284,7 +284,9 @@ static	stat_info_t	rx_hwlane_stats_list[] = {
 	{"rxsdrops",		RL_OFF(rl_sdrops)},
 	{"chainunder10",	RL_OFF(rl_chl10)},
 	{"chain10to50", 	RL_OFF(rl_ch10_50)},
-	{"chainover50", 	RL_OFF(rl_chg50)}
+	{"chainover50", 	RL_OFF(rl_chg50)},
+	{"lropkts",		RL_OFF(rl_lropkts)},
+	{"lrosegs",		RL_OFF(rl_lrosegs)}
 };
 #define	RX_HWLANE_STAT_SIZE	A_CNT(rx_hwlane_stats_list)
 
@@ -295,7 +297,9 @@ static	stat_info_t	rx_swlane_stats_list[] = {
 	{"localbytes",		RL_OFF(rl_lclbytes)},
 	{"intrs",		RL_OFF(rl_intrs)},
 	{"intrbytes",		RL_OFF(rl_intrbytes)},
-	{"rxsdrops",		RL_OFF(rl_sdrops)}
+	{"rxsdrops",		RL_OFF(rl_sdrops)},
+	{"lropkts",		RL_OFF(rl_lropkts)},
+	{"lrosegs",		RL_OFF(rl_lrosegs)}
 };
 #define	RX_SWLANE_STAT_SIZE	A_CNT(rx_swlane_stats_list)
 
@@ -311,7 +315,9 @@ static	stat_info_t	rx_lane_stats_list[] = {
 	{"pollbytes",		RL_OFF(rl_pollbytes)},
 	{"chainunder10",	RL_OFF(rl_chl10)},
 	{"chain10to50", 	RL_OFF(rl_ch10_50)},
-	{"chainover50", 	RL_OFF(rl_chg50)}
+	{"chainover50", 	RL_OFF(rl_chg50)},
+	{"lropkts",		RL_OFF(rl_lropkts)},
+	{"lrosegs",		RL_OFF(rl_lrosegs)}
 };
 #define	RX_LANE_STAT_SIZE	A_CNT(rx_lane_stats_list)
 
@@ -88,6 +88,8 @@ typedef struct rx_lane_stat_s {
 	uint64_t	rl_chl10;
 	uint64_t	rl_ch10_50;
 	uint64_t	rl_chg50;
+	uint64_t	rl_lropkts;
+	uint64_t	rl_lrosegs;
 } rx_lane_stat_t;
 
 typedef enum {
@@ -25,7 +25,7 @@
  */
 
 /*
- * Copyright (c) 2016, Joyent, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2012 by Delphix. All rights reserved.
  */
 
@@ -39,6 +39,7 @@
 #include <limits.h>
 
 #define	DTRACE_AHASHSIZE	32779		/* big 'ol prime */
+#define	DTRACE_AHASHLOAD	2		/* max mean chain length */
 
 /*
  * Because qsort(3C) does not allow an argument to be passed to a comparison
@@ -329,7 +330,7 @@ dt_aggregate_usym(dtrace_hdl_t *dtp, uint64_t *data)
 	uint64_t pid = data[0];
 	uint64_t *pc = &data[1];
 	struct ps_prochandle *P;
-	GElf_Sym sym;
+	const dt_usym_t *dus;
 
 	if (dtp->dt_vector != NULL)
 		return;
@@ -339,8 +340,8 @@ dt_aggregate_usym(dtrace_hdl_t *dtp, uint64_t *data)
 
 	dt_proc_lock(dtp, P);
 
-	if (Plookup_by_addr(P, *pc, NULL, 0, &sym) == 0)
-		*pc = sym.st_value;
+	if ((dus = dt_proc_usym(dtp, P, *pc)) != NULL && dus->dus_name != NULL)
+		*pc -= dus->dus_delta;
 
 	dt_proc_unlock(dtp, P);
 	dt_proc_release(dtp, P);
@@ -428,6 +429,39 @@ dt_aggregate_aggvarid(dt_ahashent_t *ent)
 }
 
 
+/*
+ * Grow the aggregation hash table once its mean chain length exceeds
+ * DTRACE_AHASHLOAD, so that high-cardinality aggregations (keyed by file,
+ * connection and the like) don't degrade into walking long chains on every
+ * snapshot.  The hash value of each element is retained, so this is simply
+ * a matter of relinking.  Failure to allocate the larger table isn't fatal:
+ * we carry on with the table we have.
+ */
+static void
+dt_aggregate_hashgrow(dt_ahash_t *hash)
+{
+	size_t ndx, nsize = (hash->dtah_size << 1) + 1;
+	dt_ahashent_t **nhash, *h;
+
+	if ((nhash = calloc(nsize, sizeof (dt_ahashent_t *))) == NULL)
+		return;
+
+	for (h = hash->dtah_all; h != NULL; h = h->dtahe_nextall) {
+		ndx = h->dtahe_hashval % nsize;
+
+		h->dtahe_prev = NULL;
+
+		if ((h->dtahe_next = nhash[ndx]) != NULL)
+			nhash[ndx]->dtahe_prev = h;
+
+		nhash[ndx] = h;
+	}
+
+	free(hash->dtah_hash);
+	hash->dtah_hash = nhash;
+	hash->dtah_size = nsize;
+}
+
 static int
 dt_aggregate_snap_cpu(dtrace_hdl_t *dtp, processorid_t cpu)
 {
@@ -535,10 +569,22 @@ dt_aggregate_snap_cpu(dtrace_hdl_t *dtp, processorid_t cpu)
 				break;
 			}
 
-			for (i = 0; i < rec->dtrd_size; i++)
-				hashval += addr[roffs + i];
+			/*
+			 * As in the kernel, this is Bob Jenkins' one-at-a-time
+			 * hash; a simple sum of the key bytes clusters badly
+			 * for keys such as strings that share a byte sum.
+			 */
+			for (i = 0; i < rec->dtrd_size; i++) {
+				hashval += (uint8_t)addr[roffs + i];
+				hashval += (hashval << 10);
+				hashval ^= (hashval >> 6);
+			}
 		}
 
+		hashval += (hashval << 3);
+		hashval ^= (hashval >> 11);
+		hashval += (hashval << 15);
+
 		ndx = hashval % hash->dtah_size;
 
 		for (h = hash->dtah_hash[ndx]; h != NULL; h = h->dtahe_next) {
@@ -678,6 +724,11 @@ hashnext:
 			return (dt_set_errno(dtp, EDT_BADAGG));
 		}
 
+		if (++hash->dtah_nelems > hash->dtah_size * DTRACE_AHASHLOAD) {
+			dt_aggregate_hashgrow(hash);
+			ndx = hashval % hash->dtah_size;
+		}
+
 		if (hash->dtah_hash[ndx] != NULL)
 			hash->dtah_hash[ndx]->dtahe_prev = h;
 
@@ -1222,6 +1273,8 @@ dt_aggwalk_rval(dtrace_hdl_t *dtp, dt_ahashent_t *h, int rval)
 		if (h->dtahe_nextall != NULL)
 			h->dtahe_nextall->dtahe_prevall = h->dtahe_prevall;
 
+		agp->dtat_hash.dtah_nelems--;
+
 		/*
 		 * We're unlinked.  We can safely destroy the data.
 		 */
@@ -2188,6 +2241,7 @@ dt_aggregate_destroy(dtrace_hdl_t *dtp)
 		hash->dtah_hash = NULL;
 		hash->dtah_all = NULL;
 		hash->dtah_size = 0;
+		hash->dtah_nelems = 0;
 	}
 
 	free(agp->dtat_buf.dtbd_data);
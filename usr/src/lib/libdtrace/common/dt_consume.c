@@ -24,7 +24,7 @@
  */
 
 /*
- * Copyright (c) 2017, Joyent, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2012 by Delphix. All rights reserved.
  */
 
@@ -1330,9 +1330,9 @@ dt_print_ustack(dtrace_hdl_t *dtp, FILE *fp, const char *format,
 	const char *str = strsize ? strbase : NULL;
 	int err = 0;
 
-	char name[PATH_MAX], objname[PATH_MAX], c[PATH_MAX * 2];
+	char c[PATH_MAX * 2];
 	struct ps_prochandle *P;
-	GElf_Sym sym;
+	const dt_usym_t *dus;
 	int i, indent;
 	pid_t pid;
 
@@ -1371,17 +1371,19 @@ dt_print_ustack(dtrace_hdl_t *dtp, FILE *fp, const char *format,
 		if ((err = dt_printf(dtp, fp, "%*s", indent, "")) < 0)
 			break;
 
-		if (P != NULL && Plookup_by_addr(P, pc[i],
-		    name, sizeof (name), &sym) == 0) {
-			(void) Pobjname(P, pc[i], objname, sizeof (objname));
+		dus = P != NULL ? dt_proc_usym(dtp, P, pc[i]) : NULL;
+
+		if (dus != NULL && dus->dus_name != NULL) {
+			const char *obj = dus->dus_obj != NULL ?
+			    dus->dus_obj : "";
 
-			if (pc[i] > sym.st_value) {
+			if ((int64_t)dus->dus_delta > 0) {
 				(void) snprintf(c, sizeof (c),
-				    "%s`%s+0x%llx", dt_basename(objname), name,
-				    (u_longlong_t)(pc[i] - sym.st_value));
+				    "%s`%s+0x%llx", obj, dus->dus_name,
+				    (u_longlong_t)dus->dus_delta);
 			} else {
 				(void) snprintf(c, sizeof (c),
-				    "%s`%s", dt_basename(objname), name);
+				    "%s`%s", obj, dus->dus_name);
 			}
 		} else if (str != NULL && str[0] != '\0' && str[0] != '@' &&
 		    (P == NULL || (map = Paddr_to_map(P, pc[i])) == NULL ||
@@ -1404,10 +1406,9 @@ dt_print_ustack(dtrace_hdl_t *dtp, FILE *fp, const char *format,
 			 */
 			(void) snprintf(c, sizeof (c), "%s", str);
 		} else {
-			if (P != NULL && Pobjname(P, pc[i], objname,
-			    sizeof (objname)) != NULL) {
+			if (dus != NULL && dus->dus_obj != NULL) {
 				(void) snprintf(c, sizeof (c), "%s`0x%llx",
-				    dt_basename(objname), (u_longlong_t)pc[i]);
+				    dus->dus_obj, (u_longlong_t)pc[i]);
 			} else {
 				(void) snprintf(c, sizeof (c), "0x%llx",
 				    (u_longlong_t)pc[i]);
@@ -1470,12 +1471,13 @@ dt_print_usym(dtrace_hdl_t *dtp, FILE *fp, caddr_t addr, dtrace_actkind_t act)
 
 		if ((P = dt_proc_grab(dtp, pid,
 		    PGRAB_RDONLY | PGRAB_FORCE, 0)) != NULL) {
-			GElf_Sym sym;
+			const dt_usym_t *dus;
 
 			dt_proc_lock(dtp, P);
 
-			if (Plookup_by_addr(P, pc, NULL, 0, &sym) == 0)
-				pc = sym.st_value;
+			if ((dus = dt_proc_usym(dtp, P, pc)) != NULL &&
+			    dus->dus_name != NULL)
+				pc -= dus->dus_delta;
 
 			dt_proc_unlock(dtp, P);
 			dt_proc_release(dtp, P);
@@ -2548,6 +2550,43 @@ nextepid:
  * Note, we need to preserve the alignment of the data at dtbd_oldest, which is
  * only 4-byte aligned.
  */
+/*
+ * Snapshot data buffers are bufsize bytes, and we need one per CPU on every
+ * pass through dtrace_consume().  Rather than allocate (and fault in) that
+ * much memory each time, we keep one such buffer on the handle for reuse.
+ */
+static char *
+dt_alloc_bufdata(dtrace_hdl_t *dtp, size_t size)
+{
+	if (dtp->dt_bufcachebusy)
+		return (dt_alloc(dtp, size));
+
+	if (dtp->dt_bufcachesz != size) {
+		dt_free(dtp, dtp->dt_bufcache);
+		dtp->dt_bufcachesz = 0;
+
+		if ((dtp->dt_bufcache = dt_alloc(dtp, size)) == NULL)
+			return (NULL);
+
+		dtp->dt_bufcachesz = size;
+	}
+
+	dtp->dt_bufcachebusy = B_TRUE;
+	return (dtp->dt_bufcache);
+}
+
+static void
+dt_free_bufdata(dtrace_hdl_t *dtp, char *data)
+{
+	if (data != NULL && data == dtp->dt_bufcache) {
+		assert(dtp->dt_bufcachebusy);
+		dtp->dt_bufcachebusy = B_FALSE;
+		return;
+	}
+
+	dt_free(dtp, data);
+}
+
 static void
 dt_realloc_buf(dtrace_hdl_t *dtp, dtrace_bufdesc_t *buf, int cursize)
 {
@@ -2560,7 +2599,7 @@ dt_realloc_buf(dtrace_hdl_t *dtp, dtrace_bufdesc_t *buf, int cursize)
 		bzero(newdata, misalign);
 		bcopy(buf->dtbd_data + buf->dtbd_oldest,
 		    newdata + misalign, used);
-		dt_free(dtp, buf->dtbd_data);
+		dt_free_bufdata(dtp, buf->dtbd_data);
 		buf->dtbd_oldest = misalign;
 		buf->dtbd_size = used + misalign;
 		buf->dtbd_data = newdata;
@@ -2598,7 +2637,7 @@ dt_unring_buf(dtrace_hdl_t *dtp, dtrace_bufdesc_t *buf)
 
 	bcopy(buf->dtbd_data, ndp, buf->dtbd_oldest);
 
-	dt_free(dtp, buf->dtbd_data);
+	dt_free_bufdata(dtp, buf->dtbd_data);
 	buf->dtbd_oldest = 0;
 	buf->dtbd_data = newdata;
 	buf->dtbd_size += misalign;
@@ -2609,7 +2648,7 @@ dt_unring_buf(dtrace_hdl_t *dtp, dtrace_bufdesc_t *buf)
 static void
 dt_put_buf(dtrace_hdl_t *dtp, dtrace_bufdesc_t *buf)
 {
-	dt_free(dtp, buf->dtbd_data);
+	dt_free_bufdata(dtp, buf->dtbd_data);
 	dt_free(dtp, buf);
 }
 
@@ -2629,7 +2668,7 @@ dt_get_buf(dtrace_hdl_t *dtp, int cpu, dtrace_bufdesc_t **bufp)
 		return (-1);
 
 	(void) dtrace_getopt(dtp, "bufsize", &size);
-	buf->dtbd_data = dt_alloc(dtp, size);
+	buf->dtbd_data = dt_alloc_bufdata(dtp, size);
 	if (buf->dtbd_data == NULL) {
 		dt_free(dtp, buf);
 		return (-1);
@@ -2657,7 +2696,14 @@ dt_get_buf(dtrace_hdl_t *dtp, int cpu, dtrace_bufdesc_t **bufp)
 		dt_put_buf(dtp, buf);
 		return (error);
 	}
-	dt_realloc_buf(dtp, buf, size);
+
+	/*
+	 * Only the temporal consumer holds on to buffers across passes (and
+	 * holds one per CPU at once); otherwise, the buffer is consumed and
+	 * released immediately and shrinking it would be a wasted copy.
+	 */
+	if (dtp->dt_options[DTRACEOPT_TEMPORAL] != DTRACEOPT_UNSET)
+		dt_realloc_buf(dtp, buf, size);
 
 	*bufp = buf;
 	return (0);
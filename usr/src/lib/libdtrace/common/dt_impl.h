@@ -25,7 +25,7 @@
  */
 
 /*
- * Copyright (c) 2013, Joyent, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2011, 2016 by Delphix. All rights reserved.
  */
 
@@ -163,6 +163,7 @@ typedef struct dt_ahash {
 	dt_ahashent_t	**dtah_hash;		/* hash table */
 	dt_ahashent_t	*dtah_all;		/* list of all elements */
 	size_t		dtah_size;		/* size of hash table */
+	size_t		dtah_nelems;		/* number of elements */
 } dt_ahash_t;
 
 typedef struct dt_aggregate {
@@ -254,6 +255,9 @@ struct dtrace_hdl {
 	char **dt_strdata;	/* pointer to strdata array */
 	dt_aggregate_t dt_aggregate; /* aggregate */
 	dt_pq_t *dt_bufq;	/* CPU-specific data queue */
+	char *dt_bufcache;	/* reusable snapshot data buffer */
+	size_t dt_bufcachesz;	/* size of dt_bufcache */
+	boolean_t dt_bufcachebusy; /* dt_bufcache is in use */
 	struct dt_pfdict *dt_pfdict; /* dictionary of printf conversions */
 	dt_version_t dt_vmax;	/* optional ceiling on program API binding */
 	dtrace_attribute_t dt_amin; /* optional floor on program attributes */
@@ -677,6 +681,8 @@ extern int _dtrace_intbuckets;		/* number of hash buckets for ints */
 extern uint_t _dtrace_stkindent;	/* default indent for stack/ustack */
 extern uint_t _dtrace_pidbuckets;	/* number of hash buckets for pids */
 extern uint_t _dtrace_pidlrulim;	/* number of proc handles to cache */
+extern uint_t _dtrace_usymbuckets;	/* number of hash buckets for usyms */
+extern uint_t _dtrace_usymlim;		/* number of user symbols to cache */
 extern int _dtrace_debug;		/* debugging messages enabled */
 extern size_t _dtrace_bufsize;		/* default dt_buf_create() size */
 extern int _dtrace_argmax;		/* default maximum probe arguments */
@@ -23,6 +23,7 @@
  * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
  * Copyright 2016 Mark Johnston.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #define	ELF_TARGET_ALL
@@ -874,6 +875,7 @@ dt_modtext(dtrace_hdl_t *dtp, char *p, int isenabled, GElf_Rela *rela,
 #define	DT_OP_REX_RAX		0x48
 #define	DT_OP_XOR_EAX_0		0x33
 #define	DT_OP_XOR_EAX_1		0xc0
+#define	DT_OP_MOVL_EAX_IMM	0xb8
 
 static int
 dt_modtext(dtrace_hdl_t *dtp, char *p, int isenabled, GElf_Rela *rela,
@@ -887,7 +889,7 @@ dt_modtext(dtrace_hdl_t *dtp, char *p, int isenabled, GElf_Rela *rela,
 	 * the next four bytes are the 32-bit address; the relocation is for
 	 * the address operand. We back up the offset to the first byte of
 	 * the instruction. For is-enabled probes, we later advance the offset
-	 * so that it hits the first nop in the instruction sequence.
+	 * to the byte of the instruction sequence that the kernel modifies.
 	 */
 	(*off) -= 1;
 
@@ -903,15 +905,19 @@ dt_modtext(dtrace_hdl_t *dtp, char *p, int isenabled, GElf_Rela *rela,
 	/*
 	 * We may have already processed this object file in an earlier linker
 	 * invocation. Check to see if the present instruction sequence matches
-	 * the one we would install. For is-enabled probes, we advance the
-	 * offset to the first nop instruction in the sequence to match the
-	 * text modification code below.
+	 * the one we would install (or one that an older version would have).
+	 * For is-enabled probes, we advance the offset to match the text
+	 * modification code below.
 	 */
 	if (!isenabled) {
 		if ((ip[0] == DT_OP_NOP || ip[0] == DT_OP_RET) &&
 		    ip[1] == DT_OP_NOP && ip[2] == DT_OP_NOP &&
 		    ip[3] == DT_OP_NOP && ip[4] == DT_OP_NOP)
 			return (0);
+	} else if (ip[0] == DT_OP_MOVL_EAX_IMM && ip[1] == 0 && ip[2] == 0 &&
+	    ip[3] == 0 && ip[4] == 0) {
+		(*off) += 1;
+		return (0);
 	} else if (dtp->dt_oflags & DTRACE_O_LP64) {
 		if (ip[0] == DT_OP_REX_RAX &&
 		    ip[1] == DT_OP_XOR_EAX_0 && ip[2] == DT_OP_XOR_EAX_1 &&
@@ -942,11 +948,15 @@ dt_modtext(dtrace_hdl_t *dtp, char *p, int isenabled, GElf_Rela *rela,
 	ret = (ip[0] == DT_OP_JMP32) ? DT_OP_RET : DT_OP_NOP;
 
 	/*
-	 * Establish the instruction sequence -- all nops for probes, and an
-	 * instruction to clear the return value register (%eax/%rax) followed
-	 * by nops for is-enabled probes. For is-enabled probes, we advance
-	 * the offset to the first nop. This isn't stricly necessary but makes
-	 * for more readable disassembly when the probe is enabled.
+	 * Establish the instruction sequence -- all nops for probes, and
+	 * "movl $0, %eax" for is-enabled probes.  For the latter, the offset
+	 * is that of the immediate operand: the kernel enables the probe by
+	 * making it 1, so an is-enabled test costs the same few cycles
+	 * whether or not anyone is tracing and never traps.  A tail-call has
+	 * no room for both that and a ret, so it instead gets an instruction
+	 * to clear the return value register (%eax/%rax) followed by the ret,
+	 * and is enabled with a trap on the ret; for these we advance the
+	 * offset to the ret.
 	 */
 	if (!isenabled) {
 		ip[0] = ret;
@@ -954,6 +964,13 @@ dt_modtext(dtrace_hdl_t *dtp, char *p, int isenabled, GElf_Rela *rela,
 		ip[2] = DT_OP_NOP;
 		ip[3] = DT_OP_NOP;
 		ip[4] = DT_OP_NOP;
+	} else if (ret == DT_OP_NOP) {
+		ip[0] = DT_OP_MOVL_EAX_IMM;
+		ip[1] = 0;
+		ip[2] = 0;
+		ip[3] = 0;
+		ip[4] = 0;
+		(*off) += 1;
 	} else if (dtp->dt_oflags & DTRACE_O_LP64) {
 		ip[0] = DT_OP_REX_RAX;
 		ip[1] = DT_OP_XOR_EAX_0;
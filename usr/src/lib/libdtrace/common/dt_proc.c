@@ -25,6 +25,7 @@
  */
 
 /*
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2012 by Delphix. All rights reserved.
  */
 
@@ -49,6 +50,15 @@
  * until a pre-defined LRU cache limit is exceeded, permitting repeated calls
  * to ustack() to avoid the overhead of releasing and re-grabbing processes.
  *
+ * Symbol Caching: Looking up a user symbol through libproc loads the symbol
+ * tables of the object for each process, which dominates consumer time when
+ * profiling many short-lived processes.  dt_proc_usym() therefore caches the
+ * result of each lookup in dph_usyms, keyed by the device and inode of the
+ * mapped object and the offset of the pc within it, so that the same pc in
+ * any process running that object is found without libproc.  Writable and
+ * anonymous mappings are never cached.  When _dtrace_usymlim entries are
+ * cached, the cache is emptied and starts over.
+ *
  * Process Control: For processes that are grabbed for control (~PGRAB_RDONLY)
  * or created by dt_proc_create(), a control thread is created to provide
  * callbacks on process exit and symbol table caching on dlopen()s.
@@ -82,7 +92,9 @@
 
 #include <sys/wait.h>
 #include <sys/lwp.h>
+#include <sys/stat.h>
 #include <strings.h>
+#include <limits.h>
 #include <signal.h>
 #include <assert.h>
 #include <errno.h>
@@ -1038,6 +1050,118 @@ dt_proc_unlock(dtrace_hdl_t *dtp, struct ps_prochandle *P)
 	assert(err == 0); /* check for unheld lock */
 }
 
+static void
+dt_proc_usym_free(dtrace_hdl_t *dtp, dt_usym_t *dus)
+{
+	dt_free(dtp, dus->dus_name);
+	dt_free(dtp, dus->dus_obj);
+	dus->dus_name = NULL;
+	dus->dus_obj = NULL;
+}
+
+static void
+dt_proc_usym_flush(dtrace_hdl_t *dtp)
+{
+	dt_proc_hash_t *dph = dtp->dt_procs;
+	dt_usym_t *dus, *next;
+	uint_t i;
+
+	for (i = 0; i < dph->dph_usymlen; i++) {
+		for (dus = dph->dph_usyms[i]; dus != NULL; dus = next) {
+			next = dus->dus_next;
+			dt_proc_usym_free(dtp, dus);
+			dt_free(dtp, dus);
+		}
+		dph->dph_usyms[i] = NULL;
+	}
+
+	dph->dph_usymcnt = 0;
+}
+
+/*
+ * Look up the symbol and object containing pc in the process, which the
+ * caller has locked with dt_proc_lock().  NULL is returned if pc is not
+ * mapped; otherwise the result remains valid until the next call.
+ */
+const dt_usym_t *
+dt_proc_usym(dtrace_hdl_t *dtp, struct ps_prochandle *P, uint64_t pc)
+{
+	dt_proc_hash_t *dph = dtp->dt_procs;
+	char name[PATH_MAX], objname[PATH_MAX], path[PATH_MAX];
+	dt_usym_t *dus = NULL;
+	const prmap_t *map;
+	struct stat64 st;
+	GElf_Sym sym;
+	uint64_t off = 0;
+	uint_t h = 0;
+	int cacheable, lost = 0;
+
+	if ((map = Paddr_to_map(P, pc)) == NULL)
+		return (NULL);
+
+	cacheable = dph->dph_usymlen != 0 &&
+	    !(map->pr_mflags & MA_WRITE) && map->pr_mapname[0] != '\0' &&
+	    snprintf(path, sizeof (path), "/proc/%d/object/%s",
+	    (int)Pstatus(P)->pr_pid, map->pr_mapname) < sizeof (path) &&
+	    stat64(path, &st) == 0;
+
+	if (cacheable) {
+		off = pc - map->pr_vaddr + map->pr_offset;
+		h = (uint_t)(st.st_ino ^ off) & (dph->dph_usymlen - 1);
+
+		for (dus = dph->dph_usyms[h]; dus != NULL;
+		    dus = dus->dus_next) {
+			if (dus->dus_off == off && dus->dus_ino == st.st_ino &&
+			    dus->dus_dev == st.st_dev)
+				return (dus);
+		}
+
+		if (dph->dph_usymcnt >= _dtrace_usymlim)
+			dt_proc_usym_flush(dtp);
+
+		dus = dt_zalloc(dtp, sizeof (dt_usym_t));
+	}
+
+	if (dus == NULL) {
+		cacheable = 0;
+		dus = &dph->dph_usym;
+		dt_proc_usym_free(dtp, dus);
+	}
+
+	if (Plookup_by_addr(P, pc, name, sizeof (name), &sym) == 0) {
+		lost |= (dus->dus_name = strdup(name)) == NULL;
+		dus->dus_delta = pc - sym.st_value;
+	} else {
+		dus->dus_delta = 0;
+	}
+
+	if (Pobjname(P, pc, objname, sizeof (objname)) != NULL)
+		lost |= (dus->dus_obj = strdup(dt_basename(objname))) == NULL;
+
+	if (!cacheable)
+		return (dus);
+
+	/*
+	 * Don't cache a result that is incomplete due to a failed allocation;
+	 * hand it back through dph_usym instead.
+	 */
+	if (lost) {
+		dt_proc_usym_free(dtp, &dph->dph_usym);
+		dph->dph_usym = *dus;
+		dt_free(dtp, dus);
+		return (&dph->dph_usym);
+	}
+
+	dus->dus_dev = st.st_dev;
+	dus->dus_ino = st.st_ino;
+	dus->dus_off = off;
+	dus->dus_next = dph->dph_usyms[h];
+	dph->dph_usyms[h] = dus;
+	dph->dph_usymcnt++;
+
+	return (dus);
+}
+
 void
 dt_proc_init(dtrace_hdl_t *dtp)
 {
@@ -1059,6 +1183,13 @@ dt_proc_init(dtrace_hdl_t *dtp)
 	dtp->dt_procs->dph_hashlen = _dtrace_pidbuckets;
 	dtp->dt_procs->dph_lrulim = _dtrace_pidlrulim;
 
+	/*
+	 * If the symbol cache can't be allocated, lookups are simply not
+	 * cached.
+	 */
+	if ((dtp->dt_procs->dph_usyms = dt_zalloc(dtp,
+	    sizeof (dt_usym_t *) * _dtrace_usymbuckets)) != NULL)
+		dtp->dt_procs->dph_usymlen = _dtrace_usymbuckets;
 
 	/*
 	 * Count how big our environment needs to be.
@@ -1100,6 +1231,10 @@ dt_proc_fini(dtrace_hdl_t *dtp)
 	while ((dpr = dt_list_next(&dph->dph_lrulist)) != NULL)
 		dt_proc_destroy(dtp, dpr->dpr_proc);
 
+	dt_proc_usym_flush(dtp);
+	dt_proc_usym_free(dtp, &dph->dph_usym);
+	dt_free(dtp, dph->dph_usyms);
+
 	dtp->dt_procs = NULL;
 	dt_free(dtp, dph);
 
@@ -25,6 +25,7 @@
  */
 
 /*
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2012 by Delphix. All rights reserved.
  */
 
@@ -87,6 +88,16 @@ typedef struct dt_bkpt {
 	int dbp_active;			/* flag indicating breakpoint is on */
 } dt_bkpt_t;
 
+typedef struct dt_usym {
+	struct dt_usym *dus_next;	/* next pointer for usym hash chain */
+	dev_t dus_dev;			/* device of mapped object */
+	ino64_t dus_ino;		/* inode of mapped object */
+	uint64_t dus_off;		/* offset of pc within object */
+	uint64_t dus_delta;		/* pc minus symbol value */
+	char *dus_name;			/* symbol name, or NULL if none */
+	char *dus_obj;			/* object basename, or NULL if none */
+} dt_usym_t;
+
 typedef struct dt_proc_hash {
 	pthread_mutex_t dph_lock;	/* lock protecting dph_notify list */
 	pthread_cond_t dph_cv;		/* cond for waiting for dph_notify */
@@ -94,6 +105,10 @@ typedef struct dt_proc_hash {
 	dt_list_t dph_lrulist;		/* list of dt_proc_t's in lru order */
 	uint_t dph_lrulim;		/* limit on number of procs to hold */
 	uint_t dph_lrucnt;		/* count of cached process handles */
+	dt_usym_t **dph_usyms;		/* hash chains of cached user symbols */
+	uint_t dph_usymlen;		/* size of usym hash chains array */
+	uint_t dph_usymcnt;		/* count of cached user symbols */
+	dt_usym_t dph_usym;		/* result of last uncached lookup */
 	uint_t dph_hashlen;		/* size of hash chains array */
 	dt_proc_t *dph_hash[1];		/* hash chains array */
 } dt_proc_hash_t;
@@ -107,6 +122,8 @@ extern void dt_proc_continue(dtrace_hdl_t *, struct ps_prochandle *);
 extern void dt_proc_lock(dtrace_hdl_t *, struct ps_prochandle *);
 extern void dt_proc_unlock(dtrace_hdl_t *, struct ps_prochandle *);
 extern dt_proc_t *dt_proc_lookup(dtrace_hdl_t *, struct ps_prochandle *, int);
+extern const dt_usym_t *dt_proc_usym(dtrace_hdl_t *, struct ps_prochandle *,
+    uint64_t);
 
 extern void dt_proc_init(dtrace_hdl_t *);
 extern void dt_proc_fini(dtrace_hdl_t *);
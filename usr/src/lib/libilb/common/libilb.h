@@ -22,6 +22,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_LIBILB_H
@@ -136,7 +137,8 @@ typedef enum {
 	ILB_ALG_ROUNDROBIN = 1,
 	ILB_ALG_HASH_IP,
 	ILB_ALG_HASH_IP_SPORT,
-	ILB_ALG_HASH_IP_VIP
+	ILB_ALG_HASH_IP_VIP,
+	ILB_ALG_MAGLEV
 } ilb_algo_t;
 
 /* Supported load balancing method */
@@ -25,7 +25,7 @@
  */
 
 /*
- * Copyright (c) 2013, Joyent, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <kvm.h>
@@ -42,6 +42,30 @@
 #include <sys/mman.h>
 #include <sys/dumphdr.h>
 #include <sys/sysmacros.h>
+#include <sys/bitmap.h>
+
+/*
+ * Debuggers walking large data structures in a crash dump (kmem caches, for
+ * example) make a great many small reads, each of which must translate an
+ * address by walking a dump map hash chain (or, for physical addresses, by
+ * binary search of the PFN table).  We keep a direct-mapped cache of recent
+ * page translations -- KVM_TLB_SIZE entries, or the power of two given by
+ * $KVM_TLB_SIZE -- so that repeated reads of the same pages skip the walk.
+ *
+ * A read that faults in part of the mapped corefile costs a disk I/O per
+ * page.  Since nearby pages in the dump are often read together, the first
+ * read within each KVM_RA_SIZE chunk of the corefile advises the system that
+ * we will soon need the whole chunk.
+ */
+#define	KVM_TLB_SIZE	(1 << 16)
+#define	KVM_RA_SHIFT	20
+#define	KVM_RA_SIZE	(1ULL << KVM_RA_SHIFT)
+
+typedef struct kvm_tlb {
+	struct as	*kt_as;
+	uint64_t	kt_page;
+	offset_t	kt_off;		/* 0 if the entry is empty */
+} kvm_tlb_t;
 
 struct _kvmd {
 	struct dumphdr	kvm_dump;
@@ -60,6 +84,9 @@ struct _kvmd {
 	char		kvm_namelist[MAXNAMELEN + 1];
 	boolean_t	kvm_namelist_core;
 	proc_t		kvm_proc;
+	kvm_tlb_t	*kvm_tlb;
+	uint64_t	kvm_tlbmask;
+	ulong_t		*kvm_ramap;
 };
 
 #define	PREAD	(ssize_t (*)(int, void *, size_t, offset_t))pread64
@@ -67,6 +94,44 @@ struct _kvmd {
 
 static int kvm_nlist_core(kvm_t *kd, struct nlist nl[], const char *err);
 
+/*
+ * Allocate the translation cache and read-ahead map for a crash dump.
+ * Neither is necessary, so we carry on without them if memory is short.
+ */
+static void
+kvm_cache_init(kvm_t *kd)
+{
+	uint64_t size = KVM_TLB_SIZE;
+	const char *env;
+
+	if ((env = getenv("KVM_TLB_SIZE")) != NULL) {
+		size = strtoull(env, NULL, 0);
+		if (!ISP2(size))
+			size = KVM_TLB_SIZE;
+	}
+
+	if (size != 0 &&
+	    (kd->kvm_tlb = calloc(size, sizeof (kvm_tlb_t))) != NULL)
+		kd->kvm_tlbmask = size - 1;
+
+	kd->kvm_ramap = calloc(BT_BITOUL(howmany(kd->kvm_coremapsize,
+	    KVM_RA_SIZE)), sizeof (ulong_t));
+}
+
+static void
+kvm_readahead(kvm_t *kd, offset_t off)
+{
+	uint64_t chunk = (uint64_t)off >> KVM_RA_SHIFT;
+	uint64_t start = chunk << KVM_RA_SHIFT;
+
+	if (kd->kvm_ramap == NULL || BT_TEST(kd->kvm_ramap, chunk))
+		return;
+
+	BT_SET(kd->kvm_ramap, chunk);
+	(void) madvise(kd->kvm_core + start,
+	    MIN(KVM_RA_SIZE, kd->kvm_coremapsize - start), MADV_WILLNEED);
+}
+
 static kvm_t *
 fail(kvm_t *kd, const char *err, const char *message, ...)
 {
@@ -163,6 +228,7 @@ kvm_open(const char *namelist, const char *corefile, const char *swapfile,
 		}
 		kd->kvm_map = (void *)(kd->kvm_core + kd->kvm_dump.dump_map);
 		kd->kvm_pfn = (void *)(kd->kvm_core + kd->kvm_dump.dump_pfn);
+		kvm_cache_init(kd);
 	}
 
 	if (namelist == NULL)
@@ -200,6 +266,8 @@ kvm_close(kvm_t *kd)
 		(void) close(kd->kvm_memfd);
 	if (kd->kvm_namelist_core)
 		(void) unlink(kd->kvm_namelist);
+	free(kd->kvm_tlb);
+	free(kd->kvm_ramap);
 	free(kd);
 	return (0);
 }
@@ -283,6 +351,17 @@ kvm_lookup(kvm_t *kd, struct as *as, uint64_t addr)
 	uintptr_t pageoff = addr & (kd->kvm_dump.dump_pagesize - 1);
 	uint64_t page = addr - pageoff;
 	offset_t off = 0;
+	kvm_tlb_t *tlb = NULL;
+
+	if (kd->kvm_tlb != NULL) {
+		uint64_t h = (page >> kd->kvm_dump.dump_pageshift) ^
+		    ((uintptr_t)as >> 4);
+
+		tlb = &kd->kvm_tlb[(h ^ (h >> 17)) & kd->kvm_tlbmask];
+		if (tlb->kt_off != 0 && tlb->kt_page == page &&
+		    tlb->kt_as == as)
+			return (tlb->kt_off + pageoff);
+	}
 
 	if (kd->kvm_debug)
 		fprintf(stderr, "kvm_lookup(%p, %llx):", (void *)as, addr);
@@ -332,6 +411,12 @@ kvm_lookup(kvm_t *kd, struct as *as, uint64_t addr)
 	}
 	if (kd->kvm_debug)
 		fprintf(stderr, "%s found: %llx\n", off ? "" : " not", off);
+
+	if (tlb != NULL && off != 0) {
+		tlb->kt_as = as;
+		tlb->kt_page = page;
+		tlb->kt_off = off - pageoff;
+	}
 	return (off);
 }
 
@@ -373,9 +458,10 @@ kvm_rw(kvm_t *kd, uint64_t addr, void *buf, size_t size,
 		if ((off = kvm_lookup(kd, as, addr)) == 0)
 			break;
 
-		if (prw == PREAD && off < kd->kvm_coremapsize)
+		if (prw == PREAD && off < kd->kvm_coremapsize) {
+			kvm_readahead(kd, off);
 			bcopy(kd->kvm_core + off, buf, len);
-		else if ((len = prw(kd->kvm_corefd, buf, len, off)) <= 0)
+		} else if ((len = prw(kd->kvm_corefd, buf, len, off)) <= 0)
 			break;
 		resid -= len;
 		addr += len;
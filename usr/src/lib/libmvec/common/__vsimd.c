@@ -0,0 +1,116 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2020 Joyent, Inc.
+ */
+
+/*
+ * Entry points for the x86-64 vector function ABI.
+ *
+ * When a compiler vectorizes a loop calling a function declared with
+ * "#pragma omp declare simd" (or __attribute__((simd))), it calls a variant
+ * of the function which takes and returns packed arguments in SIMD
+ * registers, and whose name encodes the register class and lane count:
+ *
+ *	_ZGV<isa>N<lanes><args>_<name>
+ *
+ * where <isa> is 'b' (SSE2, xmm), 'c' (AVX, ymm), 'd' (AVX2, ymm) or 'e'
+ * (AVX-512, zmm), and <args> has one 'v' per vector argument.  These are the
+ * names GCC emits and glibc's libmvec provides, so code built for that
+ * environment links against this library unchanged.
+ *
+ * Each variant simply hands its lanes to the corresponding __v* routine,
+ * which computes them with the same accuracy as the rest of this library.
+ * The AVX and AVX-512 variants are compiled for those instruction sets only
+ * so that their arguments arrive in the registers the ABI specifies; they are
+ * only ever called by code which was itself built for (and is running on)
+ * such a processor.
+ */
+
+#if defined(__amd64) && defined(__GNUC__)
+
+extern void __vexp(int, double *, int, double *, int);
+extern void __vlog(int, double *, int, double *, int);
+extern void __vsin(int, double *, int, double *, int);
+extern void __vcos(int, double *, int, double *, int);
+extern void __vpow(int, double *, int, double *, int, double *, int);
+
+extern void __vexpf(int, float *, int, float *, int);
+extern void __vlogf(int, float *, int, float *, int);
+extern void __vsinf(int, float *, int, float *, int);
+extern void __vcosf(int, float *, int, float *, int);
+extern void __vpowf(int, float *, int, float *, int, float *, int);
+
+typedef double	v2df_t __attribute__((__vector_size__(16)));
+typedef double	v4df_t __attribute__((__vector_size__(32)));
+typedef double	v8df_t __attribute__((__vector_size__(64)));
+typedef float	v4sf_t __attribute__((__vector_size__(16)));
+typedef float	v8sf_t __attribute__((__vector_size__(32)));
+typedef float	v16sf_t __attribute__((__vector_size__(64)));
+
+#define	ISA_b
+#define	ISA_c	__attribute__((__target__("avx")))
+#define	ISA_d	__attribute__((__target__("avx2")))
+#define	ISA_e	__attribute__((__target__("avx512f")))
+
+/*
+ * One-argument variant: isa, lanes, function, element type, vector type.
+ */
+#define	SIMD_V(isa, n, fn, type, vtype)					\
+ISA_##isa vtype								\
+_ZGV##isa##N##n##v_##fn(vtype x)					\
+{									\
+	vtype y;							\
+									\
+	__v##fn(n, (type *)&x, 1, (type *)&y, 1);			\
+	return (y);							\
+}
+
+/*
+ * Two-argument variant, for pow: __vpow(n, x, sx, y, sy, z, sz) computes
+ * z = x ** y.
+ */
+#define	SIMD_VV(isa, n, fn, type, vtype)				\
+ISA_##isa vtype								\
+_ZGV##isa##N##n##vv_##fn(vtype x, vtype y)				\
+{									\
+	vtype z;							\
+									\
+	__v##fn(n, (type *)&x, 1, (type *)&y, 1, (type *)&z, 1);	\
+	return (z);							\
+}
+
+#define	SIMD_DOUBLE(isa, n, vtype)					\
+	SIMD_V(isa, n, exp, double, vtype)				\
+	SIMD_V(isa, n, log, double, vtype)				\
+	SIMD_V(isa, n, sin, double, vtype)				\
+	SIMD_V(isa, n, cos, double, vtype)				\
+	SIMD_VV(isa, n, pow, double, vtype)
+
+#define	SIMD_FLOAT(isa, n, vtype)					\
+	SIMD_V(isa, n, expf, float, vtype)				\
+	SIMD_V(isa, n, logf, float, vtype)				\
+	SIMD_V(isa, n, sinf, float, vtype)				\
+	SIMD_V(isa, n, cosf, float, vtype)				\
+	SIMD_VV(isa, n, powf, float, vtype)
+
+SIMD_DOUBLE(b, 2, v2df_t)
+SIMD_DOUBLE(c, 4, v4df_t)
+SIMD_DOUBLE(d, 4, v4df_t)
+SIMD_DOUBLE(e, 8, v8df_t)
+
+SIMD_FLOAT(b, 4, v4sf_t)
+SIMD_FLOAT(c, 8, v8sf_t)
+SIMD_FLOAT(d, 8, v8sf_t)
+SIMD_FLOAT(e, 16, v16sf_t)
+
+#endif	/* __amd64 && __GNUC__ */
@@ -146,7 +146,7 @@ static const char *const systable[] = {
 	"alarm",		/* 27 */
 	"fstat",		/* 28 */
 	"pause",		/* 29 */
-	NULL,			/* 30 */
+	"recvmmsg",		/* 30 */
 	"stty",			/* 31 */
 	"gtty",			/* 32 */
 	"access",		/* 33 */
@@ -192,7 +192,7 @@ static const char *const systable[] = {
 	"getpagesizes",		/* 73 */
 	"rctlsys",		/* 74 */
 	"issetugid",		/* 75 */
-	"fsat",			/* 76 */
+	"sendmmsg",		/* 76 */
 	"lwp_park",		/* 77 */
 	"sendfilev",		/* 78 */
 	"rmdir",		/* 79 */
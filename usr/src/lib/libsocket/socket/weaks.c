@@ -32,6 +32,7 @@
 #include <sys/stream.h>
 #include <sys/socketvar.h>
 #include <sys/sockio.h>
+#include <sys/syscall.h>
 
 #include <errno.h>
 #include <stdlib.h>
@@ -57,6 +58,8 @@
 #pragma weak getsockname = _getsockname
 #pragma weak getsockopt = _getsockopt
 #pragma weak setsockopt = _setsockopt
+#pragma weak recvmmsg = _recvmmsg
+#pragma weak sendmmsg = _sendmmsg
 
 extern int _so_bind();
 extern int _so_listen();
@@ -154,6 +157,20 @@ _sendto(int sock, const void *buf, size_t len, int flags,
 	    addr, addrlen));
 }
 
+int
+_recvmmsg(int sock, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+    struct timespec *timeout)
+{
+	return (syscall(SYS_recvmmsg, sock, msgvec, vlen, flags & ~MSG_XPG4_2,
+	    timeout));
+}
+
+int
+_sendmmsg(int sock, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+	return (syscall(SYS_sendmmsg, sock, msgvec, vlen, flags & ~MSG_XPG4_2));
+}
+
 int
 _getpeername(int sock, struct sockaddr *name, int *namelen)
 {
@@ -256,6 +273,21 @@ __xnet_sendto(int sock, const void *buf, size_t len, int flags,
 	    addr, addrlen));
 }
 
+int
+__xnet_recvmmsg(int sock, struct mmsghdr *msgvec, unsigned int vlen,
+    int flags, struct timespec *timeout)
+{
+	return (syscall(SYS_recvmmsg, sock, msgvec, vlen, flags | MSG_XPG4_2,
+	    timeout));
+}
+
+int
+__xnet_sendmmsg(int sock, struct mmsghdr *msgvec, unsigned int vlen,
+    int flags)
+{
+	return (syscall(SYS_sendmmsg, sock, msgvec, vlen, flags | MSG_XPG4_2));
+}
+
 int
 __xnet_getsockopt(int sock, int level, int option_name,
     void *option_value, socklen_t *option_lenp)
@@ -192,6 +192,7 @@ struct Pager {
   u8 needSync;                /* True if an fsync() is needed on the journal */
   u8 dirtyFile;               /* True if database file has changed in any way */
   u8 alwaysRollback;          /* Disable dont_rollback() for all pages */
+  u8 retainCache;             /* Keep the page cache while unlocked */
   u8 *aInJournal;             /* One bit for each page in the database file */
   u8 *aInCkpt;                /* One bit for each page in the database */
   PgHdr *pFirst, *pLast;      /* List of free pages */
@@ -440,12 +441,9 @@ static PgHdr *pager_lookup(Pager *pPager, Pgno pgno){
 }
 
 /*
-** Unlock the database and clear the in-memory cache.  This routine
-** sets the state of the pager back to what it was when it was first
-** opened.  Any outstanding pages are invalidated and subsequent attempts
-** to access those pages will likely result in a coredump.
+** Free every page in the in-memory cache.
 */
-static void pager_reset(Pager *pPager){
+static void pager_clear_cache(Pager *pPager){
   PgHdr *pPg, *pNext;
   for(pPg=pPager->pAll; pPg; pPg=pNext){
     pNext = pPg->pNextAll;
@@ -457,6 +455,16 @@ static void pager_reset(Pager *pPager){
   pPager->pAll = 0;
   memset(pPager->aHash, 0, sizeof(pPager->aHash));
   pPager->nPage = 0;
+}
+
+/*
+** Unlock the database and clear the in-memory cache.  This routine
+** sets the state of the pager back to what it was when it was first
+** opened.  Any outstanding pages are invalidated and subsequent attempts
+** to access those pages will likely result in a coredump.
+*/
+static void pager_reset(Pager *pPager){
+  pager_clear_cache(pPager);
   if( pPager->state>=SQLITE_WRITELOCK ){
     sqlitepager_rollback(pPager);
   }
@@ -467,6 +475,24 @@ static void pager_reset(Pager *pPager){
   assert( pPager->journalOpen==0 );
 }
 
+/*
+** Called when the last reference to a page is dropped.  Normally this
+** resets the pager, because once the read lock is released another
+** process may change the file.  If the pager has been told that no other
+** process modifies the file (see sqlitepager_set_retain()), only the lock
+** is dropped and the cache is kept for the next transaction.
+*/
+static void pager_release(Pager *pPager){
+  if( !pPager->retainCache || pPager->errMask
+      || pPager->state>=SQLITE_WRITELOCK ){
+    pager_reset(pPager);
+    return;
+  }
+  sqliteOsUnlock(&pPager->fd);
+  pPager->state = SQLITE_UNLOCK;
+  pPager->dbSize = -1;
+}
+
 /*
 ** When this routine is called, the pager has the journal file open and
 ** a write lock on the database.  This routine releases the database
@@ -860,6 +886,16 @@ void sqlitepager_set_cachesize(Pager *pPager, int mxPage){
   }
 }
 
+/*
+** Keep the page cache when the database is unlocked between
+** transactions, so that pages need not be read back in by the next one.
+** This is only safe if no other process will modify the database file
+** while it is open here.
+*/
+void sqlitepager_set_retain(Pager *pPager, int retain){
+  pPager->retainCache = retain!=0;
+}
+
 /*
 ** Adjust the robustness of the database to damage due to OS crashes
 ** or power failures by changing the number of syncs()s when writing
@@ -1345,6 +1381,10 @@ int sqlitepager_get(Pager *pPager, Pgno pgno, void **ppPage){
     if( pPager->useJournal && sqliteOsFileExists(pPager->zJournal) ){
        int rc;
 
+       /* Whatever was retained predates the interrupted transaction.
+       */
+       pager_clear_cache(pPager);
+
        /* Get a write lock on the database
        */
        rc = sqliteOsWriteLock(&pPager->fd);
@@ -1382,7 +1422,7 @@ int sqlitepager_get(Pager *pPager, Pgno pgno, void **ppPage){
          return rc;
        }
     }
-    pPg = 0;
+    pPg = pPager->retainCache ? pager_lookup(pPager, pgno) : 0;
   }else{
     /* Search for page in cache */
     pPg = pager_lookup(pPager, pgno);
@@ -1626,7 +1666,7 @@ int sqlitepager_unref(void *pData){
     pPager->nRef--;
     assert( pPager->nRef>=0 );
     if( pPager->nRef==0 ){
-      pager_reset(pPager);
+      pager_release(pPager);
     }
   }
   return SQLITE_OK;
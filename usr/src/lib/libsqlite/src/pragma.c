@@ -17,6 +17,7 @@
 ** $Id: pragma.c,v 1.19 2004/04/23 17:04:45 drh Exp $
 */
 #include "sqliteInt.h"
+#include "pager.h"
 #include <ctype.h>
 
 /*
@@ -261,6 +262,22 @@ void sqlitePragma(Parse *pParse, Token *pLeft, Token *pRight, int minusFlag){
     }
   }else
 
+  /*
+  **  PRAGMA retain_cache=ON|OFF
+  **
+  ** When ON, the page cache of the main database is kept after each
+  ** transaction rather than being discarded when the file lock is
+  ** released.  This is only safe when no other process modifies the
+  ** database file while this connection has it open.  The setting is
+  ** not persistent.
+  */
+  if( sqliteStrICmp(zLeft,"retain_cache")==0 ){
+    Pager *pPager = sqliteBtreePager(db->aDb[0].pBt);
+    if( pPager ){
+      sqlitepager_set_retain(pPager, getBoolean(zRight));
+    }
+  }else
+
   /*
   **  PRAGMA default_synchronous
   **  PRAGMA default_synchronous=ON|OFF|NORMAL|FULL
@@ -25,7 +25,7 @@
  */
 
 /*
- * Copyright (c) 2019 Joyent, Inc.
+ * Copyright (c) 2020 Joyent, Inc.
  * Copyright (c) 2015 by Delphix. All rights reserved.
  */
 
@@ -154,6 +154,10 @@ static umem_env_item_t umem_options_items[] = {
 		"The preferred page size for the sbrk(2) heap.",
 		NULL, 0, NULL,	&vmem_sbrk_pagesize
 	},
+	{ "sbrk_releasesize",	"Private",	ITEM_SIZE,
+		"Return free sbrk(2) heap chunks of this size to the system.",
+		NULL, 0, NULL,	&vmem_sbrk_releasesize
+	},
 #endif
 	{ "perthread_cache",	"Evolving",	ITEM_SIZE,
 		"Size (in bytes) of per-thread allocation cache",
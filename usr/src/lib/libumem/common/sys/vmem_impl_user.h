@@ -22,6 +22,7 @@
 /*
  * Copyright 1999-2002 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef _SYS_VMEM_IMPL_USER_H
@@ -104,6 +105,8 @@ typedef struct vmem_kstat {
 	uint64_t	vk_populate_fail;	/* populates that failed */
 	uint64_t	vk_contains;		/* vmem_contains() calls */
 	uint64_t	vk_contains_search;	/* vmem_contains() search cnt */
+	uint64_t	vk_release;	/* number of releases to the system */
+	uint64_t	vk_mem_release;	/* memory released to the system */
 } vmem_kstat_t;
 
 struct vmem {
@@ -132,6 +135,7 @@ struct vmem {
 	void		*vm_qcache[VMEM_NQCACHE_MAX];	/* quantum caches */
 	vmem_freelist_t	vm_freelist[VMEM_FREELISTS + 1]; /* power-of-2 flists */
 	vmem_kstat_t	vm_kstat;	/* kstat data */
+	size_t		vm_release;	/* MADV_FREE granularity, if any */
 };
 
 /*
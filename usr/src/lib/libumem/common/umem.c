@@ -25,7 +25,7 @@
  */
 
 /*
- * Copyright (c) 2019 Joyent, Inc.
+ * Copyright (c) 2020 Joyent, Inc.
  * Copyright (c) 2015 by Delphix. All rights reserved.
  */
 
@@ -396,7 +396,7 @@
  *
  * typedef struct {
  *	size_t	tm_size;
- *	void	*tm_roots[NTMEMBASE];  (Currently 16)
+ *	void	*tm_roots[NTMEMBASE];  (Currently 32)
  * } tmem_t;
  *
  * Each of the roots is treated as the head of a linked list. Each entry in the
@@ -412,12 +412,15 @@
  * entry in a given root's list will be able to satisfy the same requests as the
  * corresponding cache.
  *
- * The choice of sixteen roots is based on where we believe we get the biggest
- * bang for our buck. The per-thread caches will cache up to 256 byte and 448
- * byte allocations on ILP32 and LP64 respectively. Generally applications plan
- * more carefully how they do larger allocations than smaller ones. Therefore
- * sixteen roots is a reasonable compromise between the amount of additional
- * overhead per thread, and the likelihood of a program to benefit from it.
+ * The choice of thirty-two roots is based on where we believe we get the
+ * biggest bang for our buck. The per-thread caches will cache up to 8192 byte
+ * and 16384 byte allocations on ILP32 and LP64 respectively, which covers
+ * every cache below the page-multiple sizes in the default table. (Sixteen
+ * roots, the original choice, stopped at 256 and 448 bytes, which left the
+ * allocations of heavily threaded C++ programs on the per-CPU magazine path.)
+ * The cost is sixteen more pointers in each ulwp_t, and larger allocations
+ * pass through more size checks in ptcmalloc before reaching their root; the
+ * checks are ordered by size, so small allocations are unaffected.
  *
  * The maximum amount of memory that can be cached in each thread is determined
  * by the perthread_cache UMEM_OPTION. It corresponds to the umem_ptc_size
@@ -22,7 +22,7 @@
 /*
  * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
- * Copyright 2019, Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2017 by Delphix. All rights reserved.
  */
 
@@ -114,6 +114,10 @@
 #include <stdio.h>
 #include <strings.h>
 #include <atomic.h>
+#ifndef UMEM_STANDALONE
+#include <errno.h>
+#include <sys/mman.h>
+#endif
 
 #include "vmem_base.h"
 #include "umem_base.h"
@@ -1004,6 +1008,37 @@ vmem_xalloc(vmem_t *vmp, size_t size, size_t align, size_t phase,
 	return (NULL);
 }
 
+/*
+ * Hand back to the system the pages behind any vm_release-aligned chunks
+ * which the free of [start, end) has made entirely free.  Each chunk is
+ * released once, when the last allocation overlapping it is freed; the
+ * pages stay mapped, and are simply zero-filled if they are touched again
+ * after the system has reclaimed them.  This must be done with vm_lock
+ * held, since the chunk could otherwise be reallocated (and written to)
+ * before the advice takes effect.
+ */
+static void
+vmem_madvise_free(vmem_t *vmp, vmem_seg_t *vsp, uintptr_t start, uintptr_t end)
+{
+#ifndef UMEM_STANDALONE
+	size_t chunk = vmp->vm_release;
+	uintptr_t lo, hi;
+	int old_errno = errno;
+
+	ASSERT(MUTEX_HELD(&vmp->vm_lock));
+	ASSERT(vsp->vs_start <= start && end <= vsp->vs_end);
+
+	lo = MAX(P2ALIGN(start, chunk), P2ROUNDUP(vsp->vs_start, chunk));
+	hi = MIN(P2ROUNDUP(end, chunk), P2ALIGN(vsp->vs_end, chunk));
+
+	if (lo < hi && madvise((caddr_t)lo, hi - lo, MADV_FREE) == 0) {
+		vmp->vm_kstat.vk_release++;
+		vmp->vm_kstat.vk_mem_release += hi - lo;
+	}
+	errno = old_errno;
+#endif
+}
+
 /*
  * Free the segment [vaddr, vaddr + size), where vaddr was a constrained
  * allocation.  vmem_xalloc() and vmem_xfree() must always be paired because
@@ -1013,11 +1048,14 @@ void
 vmem_xfree(vmem_t *vmp, void *vaddr, size_t size)
 {
 	vmem_seg_t *vsp, *vnext, *vprev;
+	uintptr_t start, end;
 
 	(void) mutex_lock(&vmp->vm_lock);
 
 	vsp = vmem_hash_delete(vmp, (uintptr_t)vaddr, size);
 	vsp->vs_end = P2ROUNDUP(vsp->vs_end, vmp->vm_quantum);
+	start = vsp->vs_start;
+	end = vsp->vs_end;
 
 	/*
 	 * Attempt to coalesce with the next segment.
@@ -1042,6 +1080,9 @@ vmem_xfree(vmem_t *vmp, void *vaddr, size_t size)
 		vsp = vprev;
 	}
 
+	if (vmp->vm_release != 0)
+		vmem_madvise_free(vmp, vsp, start, end);
+
 	/*
 	 * If the entire span is free, return it to the source.
 	 */
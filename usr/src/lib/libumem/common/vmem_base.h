@@ -21,7 +21,7 @@
 /*
  * Copyright 2006 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
- * Copyright 2012 Joyent, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_VMEM_BASE_H
@@ -59,6 +59,7 @@ extern void vmem_reap(void);		/* vmem_populate()-safe reap */
 extern size_t pagesize;
 extern size_t vmem_sbrk_pagesize;
 extern size_t vmem_sbrk_minalloc;
+extern size_t vmem_sbrk_releasesize;
 
 extern uint_t vmem_backend;
 #define	VMEM_BACKEND_SBRK	0x0000001
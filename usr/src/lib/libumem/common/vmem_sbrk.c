@@ -22,6 +22,7 @@
 /*
  * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #pragma ident	"%Z%%M%	%I%	%E% SMI"
@@ -49,12 +50,19 @@
  *
  * Instead, we put it on a doubly-linked list, sbrk_fails, which we search
  * before calling sbrk().
+ *
+ * The heap never shrinks, so by default memory freed into sbrk_heap stays
+ * resident.  If vmem_sbrk_releasesize is set, each aligned chunk of that size
+ * in sbrk_heap is handed back to the system with madvise(MADV_FREE) whenever
+ * it becomes entirely free (see vmem_madvise_free()).  It is never smaller
+ * than the heap page size, so that large pages are not demoted.
  */
 
 #include <errno.h>
 #include <limits.h>
 #include <sys/sysmacros.h>
 #include <sys/mman.h>
+#include <sys/vmem_impl_user.h>
 #include <unistd.h>
 
 #include "vmem_base.h"
@@ -66,6 +74,8 @@ size_t vmem_sbrk_pagesize = 0; /* the preferred page size of the heap */
 #define	VMEM_SBRK_MINALLOC	(64 * 1024)
 size_t vmem_sbrk_minalloc = VMEM_SBRK_MINALLOC; /* minimum allocation */
 
+size_t vmem_sbrk_releasesize = 0; /* chunk size to release; 0 = never */
+
 static size_t real_pagesize;
 static vmem_t *sbrk_heap;
 
@@ -253,10 +263,22 @@ vmem_sbrk_arena(vmem_alloc_t **a_out, vmem_free_t **f_out)
 			vmem_sbrk_minalloc = VMEM_SBRK_MINALLOC;
 		vmem_sbrk_minalloc = P2ROUNDUP(vmem_sbrk_minalloc, heap_size);
 
+		/* validate vmem_sbrk_releasesize */
+		if (vmem_sbrk_releasesize != 0 &&
+		    !ISP2(vmem_sbrk_releasesize)) {
+			log_message("ignoring bad releasesize: 0x%p\n",
+			    vmem_sbrk_releasesize);
+			vmem_sbrk_releasesize = 0;
+		}
+		if (vmem_sbrk_releasesize != 0)
+			vmem_sbrk_releasesize = MAX(vmem_sbrk_releasesize,
+			    heap_size);
+
 		sbrk_heap = vmem_init("sbrk_top", real_pagesize,
 		    vmem_sbrk_alloc, vmem_free,
 		    "sbrk_heap", NULL, 0, real_pagesize,
 		    vmem_alloc, vmem_free);
+		sbrk_heap->vm_release = vmem_sbrk_releasesize;
 	}
 
 	if (a_out != NULL)
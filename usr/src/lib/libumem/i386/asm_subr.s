@@ -22,6 +22,7 @@
 /*
  * Copyright 2004 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/asm_linkage.h>
@@ -91,12 +92,17 @@ _breakpoint(void)
 	SET_SIZE(_breakpoint)
 #endif
 
+	/*
+	 * The padding after each jump must be at least umem_genasm_msize and
+	 * umem_genasm_fsize bytes respectively; see umem_genasm.c.
+	 */
 	ENTRY(_malloc)
 	jmp umem_malloc;
 	NOP256
 	NOP256
+	NOP256
 #if defined(__amd64)
-	NOP64
+	NOP256
 #endif
 	SET_SIZE(_malloc)
 
@@ -104,8 +110,9 @@ _breakpoint(void)
 	jmp umem_malloc_free;
 	NOP256
 	NOP256
+	NOP256
 #if defined(__amd64)
-	NOP64
+	NOP256
 #endif
 	SET_SIZE(_free)
 
@@ -19,7 +19,7 @@
  * CDDL HEADER END
  */
 /*
- * Copyright (c) 2019 Joyent, Inc.  All rights reserved.
+ * Copyright (c) 2020 Joyent, Inc.  All rights reserved.
  */
 
 /*
@@ -74,9 +74,9 @@
 
 const int umem_genasm_supported = 1;
 static uintptr_t umem_genasm_mptr = (uintptr_t)&_malloc;
-static size_t umem_genasm_msize = 512;
+static size_t umem_genasm_msize = 768;
 static uintptr_t umem_genasm_fptr = (uintptr_t)&_free;
-static size_t umem_genasm_fsize = 512;
+static size_t umem_genasm_fsize = 768;
 static uintptr_t umem_genasm_omptr = (uintptr_t)umem_malloc;
 static uintptr_t umem_genasm_ofptr = (uintptr_t)umem_malloc_free;
 /*
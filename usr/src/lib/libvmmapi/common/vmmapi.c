@@ -1834,6 +1834,58 @@ vm_wrlock_cycle(struct vmctx *ctx)
 	}
 	return (0);
 }
+
+int
+vm_doorbell_bind(struct vmctx *ctx, int id, uint16_t port)
+{
+	struct vm_doorbell vdb;
+
+	bzero(&vdb, sizeof (vdb));
+	vdb.id = id;
+	vdb.port = port;
+
+	return (ioctl(ctx->fd, VM_DOORBELL_BIND, &vdb));
+}
+
+int
+vm_doorbell_unbind(struct vmctx *ctx, int id)
+{
+	struct vm_doorbell vdb;
+
+	bzero(&vdb, sizeof (vdb));
+	vdb.id = id;
+
+	return (ioctl(ctx->fd, VM_DOORBELL_UNBIND, &vdb));
+}
+
+/*
+ * Collect and clear the mask of doorbells rung since the last call.  The
+ * device fd (vm_get_device_fd()) polls readable while it is non-zero.
+ */
+int
+vm_doorbell_pending(struct vmctx *ctx, uint64_t *pendp)
+{
+
+	return (ioctl(ctx->fd, VM_DOORBELL_PENDING, pendp));
+}
+
+/*
+ * Collect and clear the dirty state of the guest pages in [gpa, gpa + len).
+ * The caller-supplied bitmap must hold one bit per page of the region.
+ */
+int
+vm_track_dirty_pages(struct vmctx *ctx, uint64_t gpa, size_t len,
+    uint8_t *bitmap)
+{
+	struct vm_dirty_tracker vdt;
+
+	bzero(&vdt, sizeof (vdt));
+	vdt.vdt_start_gpa = gpa;
+	vdt.vdt_len = len;
+	vdt.vdt_pfns = bitmap;
+
+	return (ioctl(ctx->fd, VM_TRACK_DIRTY_PAGES, &vdt));
+}
 #endif /* __FreeBSD__ */
 
 #ifdef __FreeBSD__
@@ -301,6 +301,11 @@ int	vm_get_topology(struct vmctx *ctx, uint16_t *sockets, uint16_t *cores,
 #ifndef	__FreeBSD__
 /* illumos-specific APIs */
 int	vm_wrlock_cycle(struct vmctx *ctx);
+int	vm_doorbell_bind(struct vmctx *ctx, int id, uint16_t port);
+int	vm_doorbell_unbind(struct vmctx *ctx, int id);
+int	vm_doorbell_pending(struct vmctx *ctx, uint64_t *pendp);
+int	vm_track_dirty_pages(struct vmctx *ctx, uint64_t gpa, size_t len,
+	    uint8_t *bitmap);
 #endif	/* __FreeBSD__ */
 
 #ifdef	__FreeBSD__
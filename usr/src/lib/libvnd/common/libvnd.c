@@ -26,6 +26,7 @@
 #include <zone.h>
 #include <assert.h>
 #include <sys/sysmacros.h>
+#include <sys/mman.h>
 
 #include <sys/vnd.h>
 #include <libvnd.h>
@@ -34,6 +35,8 @@ struct vnd_handle {
 	int vh_fd;
 	uint32_t vh_errno;
 	int vh_syserr;
+	void *vh_ring;
+	size_t vh_ringlen;
 };
 
 static const char *vnd_strerror_tbl[] = {
@@ -75,6 +78,9 @@ static const char *vnd_strerror_tbl[] = {
 	"unexpected system error",			/* VND_E_SYS */
 	"capabilities invalid, pass-through module detected",
 							/* VND_E_CAPABPASS */
+	"device already has rings",			/* VND_E_RINGEXISTS */
+	"device has no rings",				/* VND_E_NORING */
+	"invalid ring geometry or index",		/* VND_E_BADRING */
 	"unknown error"					/* VND_E_UNKNOWN */
 };
 
@@ -124,6 +130,11 @@ vnd_close(vnd_handle_t *vhp)
 {
 	int ret;
 
+	if (vhp->vh_ring != NULL) {
+		ret = munmap(vhp->vh_ring, vhp->vh_ringlen);
+		assert(ret == 0);
+	}
+
 	if (vhp->vh_fd >= 0) {
 		ret = close(vhp->vh_fd);
 		assert(ret == 0);
@@ -548,3 +559,49 @@ vnd_frameio_write(vnd_handle_t *vhp, frameio_t *fiop)
 
 	return (ret);
 }
+
+int
+vnd_ring_setup(vnd_handle_t *vhp, uint32_t nslots, uint32_t slotsize,
+    void **mapp, size_t *lenp)
+{
+	vnd_ioc_ring_t vir;
+	void *map;
+
+	bzero(&vir, sizeof (vir));
+	vir.vir_nslots = nslots;
+	vir.vir_slotsize = slotsize;
+	vir.vir_errno = VND_E_SUCCESS;
+
+	if (ioctl(vhp->vh_fd, VND_IOC_RING_SETUP, &vir) != 0)
+		return (vnd_ioc_return(vhp, vir.vir_errno));
+
+	map = mmap(NULL, vir.vir_mapsize, PROT_READ | PROT_WRITE, MAP_SHARED,
+	    vhp->vh_fd, 0);
+	if (map == MAP_FAILED) {
+		vhp->vh_errno = VND_E_SYS;
+		vhp->vh_syserr = errno;
+		return (-1);
+	}
+
+	vhp->vh_ring = map;
+	vhp->vh_ringlen = vir.vir_mapsize;
+	*mapp = map;
+	*lenp = vir.vir_mapsize;
+	return (0);
+}
+
+int
+vnd_ring_txkick(vnd_handle_t *vhp, uint32_t *ntxp)
+{
+	vnd_ioc_ring_t vir;
+
+	bzero(&vir, sizeof (vir));
+	vir.vir_errno = VND_E_SUCCESS;
+
+	if (ioctl(vhp->vh_fd, VND_IOC_RING_TXKICK, &vir) != 0)
+		return (vnd_ioc_return(vhp, vir.vir_errno));
+
+	if (ntxp != NULL)
+		*ntxp = vir.vir_ntx;
+	return (0);
+}
@@ -77,6 +77,14 @@ extern int vnd_prop_iter(vnd_handle_t *, vnd_prop_iter_f, void *);
 extern int vnd_frameio_read(vnd_handle_t *, frameio_t *);
 extern int vnd_frameio_write(vnd_handle_t *, frameio_t *);
 
+/*
+ * Shared memory rings; the mapping is laid out as described in <sys/vnd.h>
+ * and is unmapped by vnd_close().
+ */
+extern int vnd_ring_setup(vnd_handle_t *, uint32_t, uint32_t, void **,
+    size_t *);
+extern int vnd_ring_txkick(vnd_handle_t *, uint32_t *);
+
 #ifdef __cplusplus
 }
 #endif
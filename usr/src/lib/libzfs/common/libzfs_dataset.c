@@ -24,7 +24,7 @@
  */
 
 /*
- * Copyright (c) 2013, Joyent, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2011, 2016 by Delphix. All rights reserved.
  * Copyright (c) 2012 DEY Storage Systems, Inc.  All rights reserved.
  * Copyright (c) 2011-2012 Pawel Jakub Dawidek. All rights reserved.
@@ -376,16 +376,17 @@ get_recvd_props_ioctl(zfs_handle_t *zhp)
 	return (0);
 }
 
+/*
+ * Store the given stats and property nvlist in the handle.  The handle takes
+ * ownership of 'allprops'.
+ */
 static int
-put_stats_zhdl(zfs_handle_t *zhp, zfs_cmd_t *zc)
+put_stats_zhdl_nvl(zfs_handle_t *zhp, const dmu_objset_stats_t *stats,
+    nvlist_t *allprops)
 {
-	nvlist_t *allprops, *userprops;
+	nvlist_t *userprops;
 
-	zhp->zfs_dmustats = zc->zc_objset_stats; /* structure assignment */
-
-	if (zcmd_read_dst_nvlist(zhp->zfs_hdl, zc, &allprops) != 0) {
-		return (-1);
-	}
+	zhp->zfs_dmustats = *stats; /* structure assignment */
 
 	/*
 	 * XXX Why do we store the user props separately, in addition to
@@ -405,6 +406,18 @@ put_stats_zhdl(zfs_handle_t *zhp, zfs_cmd_t *zc)
 	return (0);
 }
 
+static int
+put_stats_zhdl(zfs_handle_t *zhp, zfs_cmd_t *zc)
+{
+	nvlist_t *allprops;
+
+	if (zcmd_read_dst_nvlist(zhp->zfs_hdl, zc, &allprops) != 0) {
+		return (-1);
+	}
+
+	return (put_stats_zhdl_nvl(zhp, &zc->zc_objset_stats, allprops));
+}
+
 static int
 get_stats(zfs_handle_t *zhp)
 {
@@ -435,11 +448,8 @@ zfs_refresh_properties(zfs_handle_t *zhp)
  * zfs_iter_* to create child handles on the fly.
  */
 static int
-make_dataset_handle_common(zfs_handle_t *zhp, zfs_cmd_t *zc)
+make_dataset_handle_type(zfs_handle_t *zhp)
 {
-	if (put_stats_zhdl(zhp, zc) != 0)
-		return (-1);
-
 	/*
 	 * We've managed to open the dataset and gather statistics.  Determine
 	 * the high-level type.
@@ -468,6 +478,15 @@ make_dataset_handle_common(zfs_handle_t *zhp, zfs_cmd_t *zc)
 	return (0);
 }
 
+static int
+make_dataset_handle_common(zfs_handle_t *zhp, zfs_cmd_t *zc)
+{
+	if (put_stats_zhdl(zhp, zc) != 0)
+		return (-1);
+
+	return (make_dataset_handle_type(zhp));
+}
+
 zfs_handle_t *
 make_dataset_handle(libzfs_handle_t *hdl, const char *path)
 {
@@ -514,6 +533,37 @@ make_dataset_handle_zc(libzfs_handle_t *hdl, zfs_cmd_t *zc)
 	return (zhp);
 }
 
+/*
+ * Make a handle from stats and properties which have already been retrieved,
+ * such as those returned by a batched snapshot listing.  'props' is copied.
+ */
+zfs_handle_t *
+make_dataset_handle_nvl(libzfs_handle_t *hdl, const char *name,
+    const dmu_objset_stats_t *stats, nvlist_t *props)
+{
+	zfs_handle_t *zhp = calloc(sizeof (zfs_handle_t), 1);
+	nvlist_t *allprops;
+
+	if (zhp == NULL)
+		return (NULL);
+
+	zhp->zfs_hdl = hdl;
+	(void) strlcpy(zhp->zfs_name, name, sizeof (zhp->zfs_name));
+	if (nvlist_dup(props, &allprops, 0) != 0) {
+		(void) no_memory(hdl);
+		free(zhp);
+		return (NULL);
+	}
+	if (put_stats_zhdl_nvl(zhp, stats, allprops) != 0 ||
+	    make_dataset_handle_type(zhp) != 0) {
+		nvlist_free(zhp->zfs_props);
+		nvlist_free(zhp->zfs_user_props);
+		free(zhp);
+		return (NULL);
+	}
+	return (zhp);
+}
+
 zfs_handle_t *
 make_dataset_simple_handle_zc(zfs_handle_t *pzhp, zfs_cmd_t *zc)
 {
@@ -3872,6 +3922,81 @@ zfs_destroy_snaps_nvl(libzfs_handle_t *hdl, nvlist_t *snaps, boolean_t defer)
 	return (ret);
 }
 
+/*
+ * Destroy the given filesystems and volumes, which have already been
+ * unmounted and have no snapshots left, in the order given.  Children and
+ * clones must come before their parents and origins, as they do when
+ * iterating over dependents.
+ *
+ * Where possible, all of them are destroyed by one channel program, in a
+ * single txg, rather than by a sync task each.  Any that this fails to
+ * destroy (because of an error, or because the caller isn't allowed to run
+ * channel programs) are destroyed one at a time with zfs_destroy(), which
+ * reports the errors.  Returns 0 if all were destroyed.
+ */
+int
+zfs_destroy_batch(libzfs_handle_t *hdl, zfs_handle_t **zhps, uint_t count)
+{
+	const char *program =
+	    "args = ...\n"
+	    "failed = {}\n"
+	    "for _, ds in ipairs(args['datasets']) do\n"
+	    "    err = zfs.sync.destroy(ds)\n"
+	    "    if err ~= 0 then\n"
+	    "        failed[ds] = err\n"
+	    "    end\n"
+	    "end\n"
+	    "return failed\n";
+	const char *pool;
+	const char **names;
+	nvlist_t *argnvl, *outnvl = NULL, *failed = NULL;
+	boolean_t batched = B_FALSE;
+	int ret = 0;
+	uint_t i;
+
+	if (count == 0)
+		return (0);
+
+	pool = zfs_get_pool_name(zhps[0]);
+	for (i = 1; i < count; i++) {
+		if (strcmp(zfs_get_pool_name(zhps[i]), pool) != 0)
+			break;
+	}
+
+	if (count > 1 && i == count &&
+	    (names = zfs_alloc(hdl, count * sizeof (char *))) != NULL) {
+		for (i = 0; i < count; i++)
+			names[i] = zfs_get_name(zhps[i]);
+
+		argnvl = fnvlist_alloc();
+		fnvlist_add_string_array(argnvl, "datasets", (char **)names,
+		    count);
+		if (lzc_channel_program(pool, program, ZCP_DEFAULT_INSTRLIMIT,
+		    ZCP_DEFAULT_MEMLIMIT, argnvl, &outnvl) == 0) {
+			batched = B_TRUE;
+			(void) nvlist_lookup_nvlist(outnvl, ZCP_RET_RETURN,
+			    &failed);
+		}
+		fnvlist_free(argnvl);
+		free(names);
+	}
+
+	for (i = 0; i < count; i++) {
+		zfs_handle_t *zhp = zhps[i];
+
+		if (batched && (failed == NULL ||
+		    !nvlist_exists(failed, zfs_get_name(zhp)))) {
+			remove_mountpoint(zhp);
+			continue;
+		}
+		if (zfs_destroy(zhp, B_FALSE) != 0)
+			ret = -1;
+	}
+
+	nvlist_free(outnvl);
+	return (ret);
+}
+
 /*
  * Clones the given dataset.  The target must be of the same type as the source.
  */
@@ -209,6 +209,15 @@ int zpool_standard_error_fmt(libzfs_handle_t *, int, const char *, ...);
 int get_dependents(libzfs_handle_t *, boolean_t, const char *, char ***,
     size_t *);
 zfs_handle_t *make_dataset_handle_zc(libzfs_handle_t *, zfs_cmd_t *);
+/*
+ * Snapshots requested per batched ZFS_IOC_SNAPSHOT_LIST_NEXT, and the initial
+ * size of the buffer they are returned in.
+ */
+#define	ZFS_SNAPSHOT_LIST_BATCH		256
+#define	ZFS_SNAPSHOT_LIST_BUFSIZE	(256 * 1024)
+
+zfs_handle_t *make_dataset_handle_nvl(libzfs_handle_t *, const char *,
+    const dmu_objset_stats_t *, nvlist_t *);
 zfs_handle_t *make_dataset_simple_handle_zc(zfs_handle_t *, zfs_cmd_t *);
 int libzfs_cmd_set_cachedprops(libzfs_handle_t *, zfs_cmd_t *);
 
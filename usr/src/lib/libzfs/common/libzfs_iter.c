@@ -24,7 +24,7 @@
  * Copyright (c) 2013, 2015 by Delphix. All rights reserved.
  * Copyright (c) 2012 Pawel Jakub Dawidek. All rights reserved.
  * Copyright 2014 Nexenta Systems, Inc.  All rights reserved.
- * Copyright (c) 2012, Joyent, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <stdio.h>
@@ -139,6 +139,46 @@ zfs_iter_filesystems(zfs_handle_t *zhp, zfs_iter_f func, void *data)
 	return ((ret < 0) ? ret : 0);
 }
 
+/*
+ * Iterate over a batch of snapshots returned by ZFS_IOC_SNAPSHOT_LIST_NEXT
+ * in a single nvlist.  Returns 0 to continue iterating, -1 on error, or the
+ * non-zero value with which 'func' stopped the iteration.
+ */
+static int
+zfs_iter_snapshot_batch(zfs_handle_t *zhp, nvlist_t *snaps, zfs_iter_f func,
+    void *data)
+{
+	libzfs_handle_t *hdl = zhp->zfs_hdl;
+	nvpair_t *pair;
+	int ret;
+
+	for (pair = nvlist_next_nvpair(snaps, NULL); pair != NULL;
+	    pair = nvlist_next_nvpair(snaps, pair)) {
+		nvlist_t *snap, *props;
+		zfs_handle_t *nzhp;
+		uchar_t *stats;
+		uint_t len;
+
+		if (nvpair_value_nvlist(pair, &snap) != 0 ||
+		    nvlist_lookup_uint8_array(snap, "stats", &stats,
+		    &len) != 0 || len != sizeof (dmu_objset_stats_t) ||
+		    nvlist_lookup_nvlist(snap, "props", &props) != 0) {
+			(void) zfs_error(hdl, EZFS_BADVERSION,
+			    dgettext(TEXT_DOMAIN, "cannot iterate snapshots"));
+			return (-1);
+		}
+
+		nzhp = make_dataset_handle_nvl(hdl, nvpair_name(pair),
+		    (dmu_objset_stats_t *)(uintptr_t)stats, props);
+		if (nzhp == NULL)
+			continue;
+
+		if ((ret = func(nzhp, data)) != 0)
+			return (ret);
+	}
+	return (0);
+}
+
 /*
  * Iterate over all snapshots
  */
@@ -146,36 +186,77 @@ int
 zfs_iter_snapshots(zfs_handle_t *zhp, boolean_t simple, zfs_iter_f func,
     void *data)
 {
+	libzfs_handle_t *hdl = zhp->zfs_hdl;
 	zfs_cmd_t zc = { 0 };
 	zfs_handle_t *nzhp;
+	size_t bufsize;
 	int ret;
 
 	if (zhp->zfs_type == ZFS_TYPE_SNAPSHOT ||
 	    zhp->zfs_type == ZFS_TYPE_BOOKMARK)
 		return (0);
 
-
-	if (zhp->zfs_hdl->libzfs_cachedprops &&
-	    libzfs_cmd_set_cachedprops(zhp->zfs_hdl, &zc) != 0)
-		return (-1);
+	/*
+	 * Unless only names are wanted, ask the kernel for the stats and
+	 * properties of many snapshots per ioctl; see
+	 * zfs_ioc_snapshot_list_batch().  A kernel which doesn't know about
+	 * batching ignores the request and returns one snapshot at a time.
+	 */
+	if (hdl->libzfs_cachedprops || !simple) {
+		nvlist_t *nvl;
+
+		if (nvlist_alloc(&nvl, NV_UNIQUE_NAME, 0) != 0 ||
+		    (hdl->libzfs_cachedprops && nvlist_add_boolean_value(nvl,
+		    "cachedpropsonly", B_TRUE) != 0) ||
+		    (!simple && nvlist_add_uint64(nvl, "batch",
+		    ZFS_SNAPSHOT_LIST_BATCH) != 0)) {
+			nvlist_free(nvl);
+			return (no_memory(hdl));
+		}
+		ret = zcmd_write_src_nvlist(hdl, &zc, nvl);
+		nvlist_free(nvl);
+		if (ret != 0)
+			return (-1);
+	}
 
 	zc.zc_simple = simple;
 
-
-	if (zcmd_alloc_dst_nvlist(zhp->zfs_hdl, &zc, 0) != 0)
+	bufsize = simple ? 0 : ZFS_SNAPSHOT_LIST_BUFSIZE;
+	if (zcmd_alloc_dst_nvlist(hdl, &zc, bufsize) != 0) {
+		zcmd_free_nvlists(&zc);
 		return (-1);
+	}
+	bufsize = zc.zc_nvlist_dst_size;
 
 	while ((ret = zfs_do_list_ioctl(zhp, ZFS_IOC_SNAPSHOT_LIST_NEXT,
 	    &zc)) == 0) {
+		nvlist_t *nvl = NULL, *snaps;
 
-		if (simple)
+		nzhp = NULL;
+		if (simple) {
 			nzhp = make_dataset_simple_handle_zc(zhp, &zc);
-		else
-			nzhp = make_dataset_handle_zc(zhp->zfs_hdl, &zc);
-		if (nzhp == NULL)
-			continue;
+		} else if (zcmd_read_dst_nvlist(hdl, &zc, &nvl) != 0) {
+			zcmd_free_nvlists(&zc);
+			return (-1);
+		} else if (nvlist_lookup_nvlist(nvl, "snapshots",
+		    &snaps) == 0) {
+			ret = zfs_iter_snapshot_batch(zhp, snaps, func, data);
+		} else {
+			nzhp = make_dataset_handle_zc(hdl, &zc);
+		}
+		nvlist_free(nvl);
 
-		if ((ret = func(nzhp, data)) != 0) {
+		/*
+		 * The kernel sets zc_nvlist_dst_size to the size of what it
+		 * returned, and cuts a batch short to fit within the size we
+		 * pass in; hand it the whole buffer each time.
+		 */
+		bufsize = MAX(bufsize, zc.zc_nvlist_dst_size);
+		zc.zc_nvlist_dst_size = bufsize;
+
+		if (ret == 0 && nzhp != NULL)
+			ret = func(nzhp, data);
+		if (ret != 0) {
 			zcmd_free_nvlists(&zc);
 			return (ret);
 		}
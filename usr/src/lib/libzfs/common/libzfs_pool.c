@@ -3037,10 +3037,12 @@ is_replacing_spare(nvlist_t *search, nvlist_t *tgt, int which)
 /*
  * Attach new_disk (fully described by nvroot) to old_disk.
  * If 'replacing' is specified, the new disk will replace the old one.
+ * If 'rebuild' is specified, the new disk is rebuilt sequentially from the
+ * allocated space of its mirror rather than resilvered.
  */
 int
-zpool_vdev_attach(zpool_handle_t *zhp,
-    const char *old_disk, const char *new_disk, nvlist_t *nvroot, int replacing)
+zpool_vdev_attach(zpool_handle_t *zhp, const char *old_disk,
+    const char *new_disk, nvlist_t *nvroot, int replacing, boolean_t rebuild)
 {
 	zfs_cmd_t zc = { 0 };
 	char msg[1024];
@@ -3075,6 +3077,7 @@ zpool_vdev_attach(zpool_handle_t *zhp,
 
 	verify(nvlist_lookup_uint64(tgt, ZPOOL_CONFIG_GUID, &zc.zc_guid) == 0);
 	zc.zc_cookie = replacing;
+	zc.zc_simple = rebuild;
 
 	if (nvlist_lookup_nvlist_array(nvroot, ZPOOL_CONFIG_CHILDREN,
 	    &child, &children) != 0 || children != 1) {
@@ -3136,7 +3139,11 @@ zpool_vdev_attach(zpool_handle_t *zhp,
 		/*
 		 * Can't attach to or replace this type of vdev.
 		 */
-		if (replacing) {
+		if (rebuild) {
+			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+			    "sequential rebuild is only supported for "
+			    "mirrors and top-level disks"));
+		} else if (replacing) {
 			uint64_t version = zpool_get_prop_int(zhp,
 			    ZPOOL_PROP_VERSION, NULL);
 
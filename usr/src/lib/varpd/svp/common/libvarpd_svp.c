@@ -61,7 +61,7 @@
  * server, sdc-portolan (see https://github.com/joyent/sdc-portolan).
  *
  * At this time, we don't quite support everything that we need to. Including
- * the SVP_R_BULK_REQ and SVP_R_SHOOTDOWN.
+ * SVP_R_SHOOTDOWN and the SVP_BULK_VL3 form of SVP_R_BULK_REQ.
  *
  * ---------------------------------
  * General Design and Considerations
@@ -163,8 +163,12 @@
  * connection life cycle, see the next section.
  *
  * By default, each connection maintains its own back off timer and list of
- * queries it's servicing. Only one request is generally outstanding at a time
- * and requests are round robined across the various connections.
+ * queries it's servicing. Requests are round robined across the various
+ * connections. A connection doesn't wait for a reply before sending the next
+ * query; whenever the socket is writable it batches up all of the queries that
+ * haven't been sent yet into a single writev(2), and when it's readable it
+ * drains every reply that's available. Replies are matched to queries by their
+ * id, so the server is free to answer them in any order.
  *
  * The query itself represents the svp request that's going on and keep track of
  * its state and is a place for data that's read and written to as part of the
@@ -334,6 +338,25 @@
  * turn that info a VL3 request. We hold the general request as outstanding
  * until we receive all of the callbacks for the VL3 invalidations, at which
  * point we go through and do the log removal request.
+ *
+ * ------------------
+ * Bulk VL2 Downloads
+ * ------------------
+ *
+ * Rather than taking a round trip to the remote for the first packet to every
+ * destination, an instance can download the VL2->UL3 table of its virtual
+ * network up front with SVP_R_BULK_REQ and inject it into the kernel. As not
+ * every server supports this, it's only done when svp_bulk_enable is set.
+ *
+ * When an instance is started, a periodic timer is armed. When it fires and
+ * the download isn't finished, it issues a request for the next page of
+ * entries, starting from the number of entries received so far. When a full
+ * page comes back, we inject it and immediately ask for the next one. A page
+ * that isn't full marks the end of the table. If the query couldn't be sent at
+ * all, say because no connection is up yet, the timer will try again later;
+ * any other error from the server marks the download as done and we stick with
+ * on-demand lookups. As with shootdowns, stopping the instance has to wait for
+ * any outstanding page to come back.
  */
 
 #include <umem.h>
@@ -499,6 +522,146 @@ static svp_cb_t svp_defops = {
 	svp_shootdown_cb
 };
 
+/*
+ * Bulk prefetching of the VL2->UL3 table is opt-in, as it requires the remote
+ * to implement SVP_R_BULK_REQ. While enabled, we check every svp_bulk_interval
+ * seconds whether the download still needs to be (re)started, which also
+ * covers the window after start up where no connection has been established.
+ * The buffer size gives us about 340 entries per page.
+ */
+int svp_bulk_enable = 0;
+static int svp_bulk_interval = 2;
+static int svp_bulk_buf = 8192;
+
+void
+svp_bulk_cb(svp_t *svp, svp_status_t status, void *data, size_t size)
+{
+	svp_bulk_t *sbk = &svp->svp_bulk;
+	svp_bulk_ack_t *svba = data;
+	svp_bulk_vl2_t *ent;
+	overlay_target_point_t point;
+	uint32_t nents, i;
+	boolean_t full;
+
+	if (status != SVP_S_OK || ntohl(svba->svba_type) != SVP_BULK_VL2) {
+		mutex_enter(&sbk->sbk_lock);
+		/*
+		 * A fatal status means that we couldn't get the query out,
+		 * which we'll retry when the timer next fires. Anything else
+		 * means that the remote can't help us and we give up.
+		 */
+		if (status != SVP_S_FATAL)
+			sbk->sbk_flags |= SVP_BK_DONE;
+		sbk->sbk_flags &= ~SVP_BK_RUNNING;
+		(void) cond_broadcast(&sbk->sbk_cond);
+		mutex_exit(&sbk->sbk_lock);
+		return;
+	}
+
+	nents = (size - sizeof (svp_bulk_ack_t)) / sizeof (svp_bulk_vl2_t);
+	full = svp_bulk_buf - size < sizeof (svp_bulk_vl2_t);
+	ent = (svp_bulk_vl2_t *)svba->svba_data;
+	for (i = 0; i < nents; i++, ent++) {
+		bcopy(ent->svbl2_addr, &point.otp_ip, sizeof (struct in6_addr));
+		point.otp_port = ntohs(ent->svbl2_port);
+		libvarpd_inject_varp(svp->svp_hdl, ent->svbl2_mac, &point);
+	}
+
+	mutex_enter(&sbk->sbk_lock);
+	sbk->sbk_offset += nents;
+	if (full == B_FALSE || nents == 0)
+		sbk->sbk_flags |= SVP_BK_DONE;
+	if ((sbk->sbk_flags & (SVP_BK_QUIESCE | SVP_BK_DONE)) != 0) {
+		sbk->sbk_flags &= ~SVP_BK_RUNNING;
+		(void) cond_broadcast(&sbk->sbk_cond);
+		mutex_exit(&sbk->sbk_lock);
+		return;
+	}
+	mutex_exit(&sbk->sbk_lock);
+
+	/*
+	 * There's more to come, go straight on to the next page while we're
+	 * still marked as running.
+	 */
+	bzero(&sbk->sbk_query, sizeof (svp_query_t));
+	svp_remote_bulk_request(svp, &sbk->sbk_query, sbk->sbk_offset,
+	    sbk->sbk_buf, svp_bulk_buf);
+}
+
+static void
+svp_bulk_timer(void *arg)
+{
+	svp_t *svp = arg;
+	svp_bulk_t *sbk = &svp->svp_bulk;
+
+	mutex_enter(&sbk->sbk_lock);
+	if ((sbk->sbk_flags &
+	    (SVP_BK_RUNNING | SVP_BK_QUIESCE | SVP_BK_DONE)) != 0) {
+		mutex_exit(&sbk->sbk_lock);
+		return;
+	}
+	sbk->sbk_flags |= SVP_BK_RUNNING;
+	mutex_exit(&sbk->sbk_lock);
+
+	bzero(&sbk->sbk_query, sizeof (svp_query_t));
+	svp_remote_bulk_request(svp, &sbk->sbk_query, sbk->sbk_offset,
+	    sbk->sbk_buf, svp_bulk_buf);
+}
+
+static void
+svp_bulk_start(svp_t *svp)
+{
+	svp_bulk_t *sbk = &svp->svp_bulk;
+
+	if (svp_bulk_enable == 0)
+		return;
+
+	/*
+	 * The download is purely an optimization, if we can't get the memory
+	 * for it, we'll just fall back to on-demand lookups.
+	 */
+	if ((sbk->sbk_buf = umem_alloc(svp_bulk_buf, UMEM_DEFAULT)) == NULL)
+		return;
+
+	mutex_enter(&sbk->sbk_lock);
+	sbk->sbk_flags = 0;
+	sbk->sbk_offset = 0;
+	mutex_exit(&sbk->sbk_lock);
+
+	sbk->sbk_timer.st_func = svp_bulk_timer;
+	sbk->sbk_timer.st_arg = svp;
+	sbk->sbk_timer.st_oneshot = B_FALSE;
+	sbk->sbk_timer.st_value = svp_bulk_interval;
+	svp_timer_add(&sbk->sbk_timer);
+}
+
+static void
+svp_bulk_stop(svp_t *svp)
+{
+	svp_bulk_t *sbk = &svp->svp_bulk;
+
+	if (sbk->sbk_buf == NULL)
+		return;
+
+	mutex_enter(&sbk->sbk_lock);
+	sbk->sbk_flags |= SVP_BK_QUIESCE;
+	mutex_exit(&sbk->sbk_lock);
+
+	svp_timer_remove(&sbk->sbk_timer);
+
+	/*
+	 * As with shootdowns, a page may be outstanding outside of the timer,
+	 * so we must wait for it to come back before we can tear down.
+	 */
+	mutex_enter(&sbk->sbk_lock);
+	while (sbk->sbk_flags & SVP_BK_RUNNING)
+		(void) cond_wait(&sbk->sbk_cond, &sbk->sbk_lock);
+	mutex_exit(&sbk->sbk_lock);
+
+	umem_free(sbk->sbk_buf, svp_bulk_buf);
+	sbk->sbk_buf = NULL;
+}
+
 static boolean_t
 varpd_svp_valid_dest(overlay_plugin_dest_t dest)
 {
@@ -528,6 +691,21 @@ varpd_svp_create(varpd_provider_handle_t *hdl, void **outp,
 		return (ret);
 	}
 
+	if ((ret = mutex_init(&svp->svp_bulk.sbk_lock,
+	    USYNC_THREAD | LOCK_ERRORCHECK, NULL)) != 0) {
+		(void) mutex_destroy(&svp->svp_lock);
+		umem_free(svp, sizeof (svp_t));
+		return (ret);
+	}
+
+	if ((ret = cond_init(&svp->svp_bulk.sbk_cond, USYNC_THREAD,
+	    NULL)) != 0) {
+		(void) mutex_destroy(&svp->svp_bulk.sbk_lock);
+		(void) mutex_destroy(&svp->svp_lock);
+		umem_free(svp, sizeof (svp_t));
+		return (ret);
+	}
+
 	svp->svp_port = svp_defport;
 	svp->svp_uport = svp_defuport;
 	svp->svp_cb = svp_defops;
@@ -561,6 +739,8 @@ varpd_svp_start(void *arg)
 		return (ret);
 	}
 
+	svp_bulk_start(svp);
+
 	return (0);
 }
 
@@ -569,6 +749,7 @@ varpd_svp_stop(void *arg)
 {
 	svp_t *svp = arg;
 
+	svp_bulk_stop(svp);
 	svp_remote_detach(svp);
 }
 
@@ -582,6 +763,10 @@ varpd_svp_destroy(void *arg)
 
 	if (mutex_destroy(&svp->svp_lock) != 0)
 		libvarpd_panic("failed to destroy svp_t`svp_lock");
+	if (cond_destroy(&svp->svp_bulk.sbk_cond) != 0)
+		libvarpd_panic("failed to destroy svp_t`sbk_cond");
+	if (mutex_destroy(&svp->svp_bulk.sbk_lock) != 0)
+		libvarpd_panic("failed to destroy svp_t`sbk_lock");
 
 	umem_free(svp, sizeof (svp_t));
 }
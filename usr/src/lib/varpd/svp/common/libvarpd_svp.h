@@ -73,6 +73,7 @@ typedef union svp_query_data {
 	svp_vl3_req_t	sdq_vl3r;
 	svp_vl3_ack_t	sdq_vl3a;
 	svp_log_req_t	sdq_logr;
+	svp_bulk_req_t	sdq_bulkr;
 	svp_lrm_ack_t	sdq_lrma;
 } svp_query_data_t;
 
@@ -206,6 +207,27 @@ typedef struct svp_sdlog {
 	void			*sdl_remote;
 } svp_sdlog_t;
 
+typedef enum svp_bulk_flags {
+	SVP_BK_RUNNING		= 0x01,
+	SVP_BK_QUIESCE		= 0x02,
+	SVP_BK_DONE		= 0x04
+} svp_bulk_flags_t;
+
+/*
+ * Each svp_t may prefetch the VL2->UL3 table of its virtual network from the
+ * remote with SVP_R_BULK_REQ. The svp_bulk_t tracks that download. See the big
+ * theory statement for more information.
+ */
+typedef struct svp_bulk {
+	mutex_t			sbk_lock;
+	cond_t			sbk_cond;
+	svp_timer_t		sbk_timer;
+	svp_bulk_flags_t	sbk_flags;
+	uint32_t		sbk_offset;
+	svp_query_t		sbk_query;
+	void			*sbk_buf;
+} svp_bulk_t;
+
 struct svp_remote {
 	char			*sr_hostname;	/* RO */
 	uint16_t		sr_rport;	/* RO */
@@ -270,6 +292,7 @@ struct svp {
 	uint16_t		svp_uport;	/* svp_lock */
 	boolean_t		svp_huip;	/* svp_lock */
 	struct in6_addr		svp_uip;	/* svp_lock */
+	svp_bulk_t		svp_bulk;
 };
 
 extern bunyan_logger_t *svp_bunyan;
@@ -350,6 +373,13 @@ extern int svp_shootdown_init(svp_remote_t *);
 extern void svp_shootdown_fini(svp_remote_t *);
 extern void svp_shootdown_start(svp_remote_t *);
 
+/*
+ * Bulk download related
+ */
+extern void svp_remote_bulk_request(svp_t *, svp_query_t *, uint32_t, void *,
+    size_t);
+extern void svp_bulk_cb(svp_t *, svp_status_t, void *, size_t);
+
 #ifdef __cplusplus
 }
 #endif
@@ -35,6 +35,11 @@ int svp_conn_query_timeout = 30;
 static int svp_conn_backoff_tbl[] = { 1, 2, 4, 8, 16, 32 };
 static int svp_conn_nbackoff = sizeof (svp_conn_backoff_tbl) / sizeof (int);
 
+/*
+ * The maximum number of queries we'll hand to a single writev(2).
+ */
+#define	SVP_CONN_WBATCH	16
+
 typedef enum svp_conn_act {
 	SVP_RA_NONE	= 0x00,
 	SVP_RA_DEGRADE	= 0x01,
@@ -305,82 +310,128 @@ svp_conn_poll_connect(port_event_t *pe, svp_conn_t *scp)
 	return (SVP_RA_DEGRADE);
 }
 
+/*
+ * Write out as many queries as we can. Rather than sending a single query and
+ * waiting for the next POLLOUT, we gather up to SVP_CONN_WBATCH queries into a
+ * single writev(2) and keep going until either the socket fills up or we've
+ * run out of work. The server is free to answer queries in any order, so a
+ * burst of misses doesn't have to serialise behind a single round trip.
+ */
 static svp_conn_act_t
 svp_conn_pollout(svp_conn_t *scp)
 {
-	svp_query_t *sqp;
-	svp_req_t *req;
-	size_t off;
-	struct iovec iov[2];
-	int nvecs = 0;
+	svp_query_t *sqp, *qs[SVP_CONN_WBATCH];
+	struct iovec iov[SVP_CONN_WBATCH * 2];
+	int nvecs, nq, i;
+	size_t off, left;
 	ssize_t ret;
+	hrtime_t now;
 
 	assert(MUTEX_HELD(&scp->sc_lock));
 
-	/*
-	 * We need to find a query and start writing it out.
-	 */
-	if (scp->sc_output.sco_query == NULL) {
-		for (sqp = list_head(&scp->sc_queries); sqp != NULL;
+	for (;;) {
+		nvecs = 0;
+		nq = 0;
+
+		/*
+		 * A partially written query must always be finished first, as
+		 * the server reads them off of the stream in order.
+		 */
+		if ((sqp = scp->sc_output.sco_query) != NULL) {
+			off = scp->sc_output.sco_offset;
+			if (off < sizeof (svp_req_t)) {
+				iov[nvecs].iov_base = (void *)
+				    ((uintptr_t)&sqp->sq_header + off);
+				iov[nvecs].iov_len = sizeof (svp_req_t) - off;
+				nvecs++;
+				off = 0;
+			} else {
+				off -= sizeof (svp_req_t);
+			}
+			iov[nvecs].iov_base =
+			    (void *)((uintptr_t)sqp->sq_rdata + off);
+			iov[nvecs].iov_len = sqp->sq_rsize - off;
+			nvecs++;
+			qs[nq++] = sqp;
+		}
+
+		for (sqp = list_head(&scp->sc_queries);
+		    sqp != NULL && nq < SVP_CONN_WBATCH;
 		    sqp = list_next(&scp->sc_queries, sqp)) {
 			if (sqp->sq_state != SVP_QUERY_INIT)
 				continue;
-			break;
+
+			svp_query_crc32(&sqp->sq_header, sqp->sq_rdata,
+			    sqp->sq_rsize);
+			iov[nvecs].iov_base = &sqp->sq_header;
+			iov[nvecs].iov_len = sizeof (svp_req_t);
+			nvecs++;
+			iov[nvecs].iov_base = sqp->sq_rdata;
+			iov[nvecs].iov_len = sqp->sq_rsize;
+			nvecs++;
+			qs[nq++] = sqp;
 		}
 
-		if (sqp == NULL) {
+		if (nq == 0) {
 			scp->sc_event.se_events &= ~POLLOUT;
 			return (SVP_RA_NONE);
 		}
 
-		scp->sc_output.sco_query = sqp;
-		scp->sc_output.sco_offset = 0;
-		sqp->sq_state = SVP_QUERY_WRITING;
-		svp_query_crc32(&sqp->sq_header, sqp->sq_rdata, sqp->sq_rsize);
-	}
+		do {
+			ret = writev(scp->sc_socket, iov, nvecs);
+		} while (ret == -1 && errno == EINTR);
+		if (ret == -1) {
+			switch (errno) {
+			case EAGAIN:
+				scp->sc_event.se_events |= POLLOUT;
+				return (SVP_RA_NONE);
+			case EIO:
+			case ENXIO:
+			case ECONNRESET:
+				return (SVP_RA_ERROR);
+			default:
+				libvarpd_panic("unexpected errno: %d", errno);
+			}
+		}
 
-	sqp = scp->sc_output.sco_query;
-	req = &sqp->sq_header;
-	off = scp->sc_output.sco_offset;
-	if (off < sizeof (svp_req_t)) {
-		iov[nvecs].iov_base = (void *)((uintptr_t)req + off);
-		iov[nvecs].iov_len = sizeof (svp_req_t) - off;
-		nvecs++;
-		off = 0;
-	} else {
-		off -= sizeof (svp_req_t);
-	}
+		/*
+		 * Walk the queries we handed to writev(2) in order, retiring
+		 * the ones that made it out in their entirety. At most one can
+		 * have been partially written; anything after it is still in
+		 * the INIT state and will be picked up again.
+		 */
+		now = gethrtime();
+		for (i = 0; i < nq && ret > 0; i++) {
+			sqp = qs[i];
+			off = 0;
+			if (sqp == scp->sc_output.sco_query)
+				off = scp->sc_output.sco_offset;
+			left = sizeof (svp_req_t) + sqp->sq_rsize - off;
+			sqp->sq_acttime = now;
+			if ((size_t)ret < left) {
+				sqp->sq_state = SVP_QUERY_WRITING;
+				scp->sc_output.sco_query = sqp;
+				scp->sc_output.sco_offset = off + ret;
+				break;
+			}
 
-	iov[nvecs].iov_base = (void *)((uintptr_t)sqp->sq_rdata + off);
-	iov[nvecs].iov_len = sqp->sq_rsize - off;
-	nvecs++;
+			ret -= left;
+			sqp->sq_state = SVP_QUERY_READING;
+			if (sqp == scp->sc_output.sco_query) {
+				scp->sc_output.sco_query = NULL;
+				scp->sc_output.sco_offset = 0;
+			}
+		}
 
-	do {
-		ret = writev(scp->sc_socket, iov, nvecs);
-	} while (ret == -1 && errno == EAGAIN);
-	if (ret == -1) {
-		switch (errno) {
-		case EAGAIN:
+		/*
+		 * A short write means the socket buffer is full, wait for it
+		 * to drain rather than spinning on EAGAIN.
+		 */
+		if (i < nq) {
 			scp->sc_event.se_events |= POLLOUT;
 			return (SVP_RA_NONE);
-		case EIO:
-		case ENXIO:
-		case ECONNRESET:
-			return (SVP_RA_ERROR);
-		default:
-			libvarpd_panic("unexpected errno: %d", errno);
 		}
 	}
-
-	sqp->sq_acttime = gethrtime();
-	scp->sc_output.sco_offset += ret;
-	if (ret >= sizeof (svp_req_t) + sqp->sq_rsize) {
-		sqp->sq_state = SVP_QUERY_READING;
-		scp->sc_output.sco_query = NULL;
-		scp->sc_output.sco_offset = 0;
-		scp->sc_event.se_events |= POLLOUT;
-	}
-	return (SVP_RA_NONE);
 }
 
 static boolean_t
@@ -409,7 +460,8 @@ svp_conn_pollin_validate(svp_conn_t *scp)
 	}
 
 	if (nop != SVP_R_VL2_ACK && nop != SVP_R_VL3_ACK &&
-	    nop != SVP_R_LOG_ACK && nop != SVP_R_LOG_RM_ACK) {
+	    nop != SVP_R_LOG_ACK && nop != SVP_R_LOG_RM_ACK &&
+	    nop != SVP_R_BULK_ACK) {
 		(void) bunyan_warn(svp_bunyan, "unsupported operation",
 		    BUNYAN_T_IP, "remote_ip", &scp->sc_addr,
 		    BUNYAN_T_INT32, "remote_port", scp->sc_remote->sr_rport,
@@ -464,13 +516,25 @@ svp_conn_pollin_validate(svp_conn_t *scp)
 
 	/*
 	 * The valid size is anything <= to what the user requested, but at
-	 * least svp_log_ack_t bytes large.
+	 * least svp_log_ack_t (or svp_bulk_ack_t) bytes large.
 	 */
-	if (nop == SVP_R_LOG_ACK) {
+	if (nop == SVP_R_LOG_ACK || nop == SVP_R_BULK_ACK) {
 		const char *msg = NULL;
-		if (nsize < sizeof (svp_log_ack_t))
+		uint32_t min, max;
+
+		if (nop == SVP_R_LOG_ACK) {
+			min = sizeof (svp_log_ack_t);
+			max = ntohl(
+			    ((svp_log_req_t *)sqp->sq_rdata)->svlr_count);
+		} else {
+			min = sizeof (svp_bulk_ack_t);
+			max = ntohl(
+			    ((svp_bulk_req_t *)sqp->sq_rdata)->svbr_count);
+		}
+
+		if (nsize < min)
 			msg = "response size too small";
-		else if (nsize > ((svp_log_req_t *)sqp->sq_rdata)->svlr_count)
+		else if (nsize > max)
 			msg = "response size too large";
 		if (msg != NULL) {
 			(void) bunyan_warn(svp_bunyan, msg,
@@ -481,8 +545,7 @@ svp_conn_pollin_validate(svp_conn_t *scp)
 			    BUNYAN_T_INT32, "operation", nop,
 			    BUNYAN_T_INT32, "response_id", resp->svp_id,
 			    BUNYAN_T_INT32, "response_size", nsize,
-			    BUNYAN_T_INT32, "expected_size",
-			    ((svp_log_req_t *)sqp->sq_rdata)->svlr_count,
+			    BUNYAN_T_INT32, "expected_size", max,
 			    BUNYAN_T_INT32, "query_state", sqp->sq_state,
 			    BUNYAN_T_END);
 			return (B_FALSE);
@@ -496,7 +559,7 @@ svp_conn_pollin_validate(svp_conn_t *scp)
 		sqp->sq_wdata = &sqp->sq_wdun;
 		sqp->sq_wsize = sizeof (svp_query_data_t);
 	} else {
-		VERIFY(nop == SVP_R_LOG_ACK);
+		VERIFY(nop == SVP_R_LOG_ACK || nop == SVP_R_BULK_ACK);
 		assert(sqp->sq_wdata != NULL);
 		assert(sqp->sq_wsize != 0);
 	}
@@ -505,7 +568,7 @@ svp_conn_pollin_validate(svp_conn_t *scp)
 }
 
 static svp_conn_act_t
-svp_conn_pollin(svp_conn_t *scp)
+svp_conn_pollin_one(svp_conn_t *scp, boolean_t *donep)
 {
 	size_t off, total;
 	ssize_t ret;
@@ -556,6 +619,9 @@ svp_conn_pollin(svp_conn_t *scp)
 			return (SVP_RA_NONE);
 		}
 
+		/* The offset now refers to the body of the response. */
+		scp->sc_input.sci_offset = 0;
+		off = 0;
 		if (svp_conn_pollin_validate(scp) != B_TRUE)
 			return (SVP_RA_ERROR);
 	}
@@ -589,6 +655,7 @@ svp_conn_pollin(svp_conn_t *scp)
 
 	if (ret + off < total) {
 		scp->sc_input.sci_offset += ret;
+		scp->sc_event.se_events |= POLLIN | POLLRDNORM;
 		return (SVP_RA_NONE);
 	}
 
@@ -626,6 +693,9 @@ svp_conn_pollin(svp_conn_t *scp)
 	} else if (nop == SVP_R_LOG_RM_ACK) {
 		svp_lrm_ack_t *svra = sqp->sq_wdata;
 		sqp->sq_status = ntohl(svra->svra_status);
+	} else if (nop == SVP_R_BULK_ACK) {
+		svp_bulk_ack_t *svba = sqp->sq_wdata;
+		sqp->sq_status = ntohl(svba->svba_status);
 	} else {
 		libvarpd_panic("unhandled nop: %d", nop);
 	}
@@ -642,10 +712,33 @@ svp_conn_pollin(svp_conn_t *scp)
 	sqp->sq_func(sqp, sqp->sq_arg);
 	mutex_enter(&scp->sc_lock);
 	scp->sc_event.se_events |= POLLIN | POLLRDNORM;
+	*donep = B_TRUE;
 
 	return (SVP_RA_NONE);
 }
 
+/*
+ * With several queries outstanding, a single POLLIN may well have several
+ * responses behind it. Keep draining them until the socket runs dry rather
+ * than going back through the event port for each one. If someone has asked
+ * for this connection to be torn down while we dropped the lock to run a
+ * callback, stop and let the handler deal with it.
+ */
+static svp_conn_act_t
+svp_conn_pollin(svp_conn_t *scp)
+{
+	svp_conn_act_t ret;
+	boolean_t done;
+
+	do {
+		done = B_FALSE;
+		ret = svp_conn_pollin_one(scp, &done);
+	} while (ret == SVP_RA_NONE && done == B_TRUE &&
+	    (scp->sc_flags & SVP_CF_UFLAG) == 0);
+
+	return (ret);
+}
+
 static svp_conn_act_t
 svp_conn_reset(svp_conn_t *scp)
 {
@@ -129,17 +129,36 @@ typedef enum svp_bulk_type {
 	SVP_BULK_VL3	= 0x02
 } svp_bulk_type_t;
 
+/*
+ * A bulk request asks for the table entries belonging to svbr_vnetid. As a
+ * table may be arbitrarily large, it is retrieved a page at a time: svbr_offset
+ * is the number of entries the client has already received and svbr_count is
+ * the maximum number of bytes the client is prepared to receive in the reply,
+ * including the svp_bulk_ack_t header. As with the log, the server must not
+ * block and may return fewer entries than would fit.
+ */
 typedef struct svp_bulk_req {
 	uint32_t	svbr_type;
+	uint32_t	svbr_vnetid;
+	uint32_t	svbr_offset;
+	uint32_t	svbr_count;
 } svp_bulk_req_t;
 
 /*
- * When replying to a bulk request (SVP_R_BULK_ACK), data is streamed back
- * across.  The format of the data is currently undefined and as we work on the
- * system, we'll get a better understanding of what this should look like. A
- * client may need to stream such a request to disk, or the format will need to
- * be in a streamable format that allows the client to construct data.
+ * When replying to a bulk request (SVP_R_BULK_ACK), the svba_data member
+ * contains an array of entries, the kind of which is indicated by svba_type.
+ * For SVP_BULK_VL2, each entry is an svp_bulk_vl2_t, which carries the same
+ * VL2->UL3 information as an svp_vl2_ack_t. A reply that is not completely
+ * full indicates to the client that it has reached the end of the table. The
+ * format of SVP_BULK_VL3 data is currently undefined and servers should reply
+ * to it with SVP_S_BADBULK.
  */
+typedef struct svp_bulk_vl2 {
+	uint8_t		svbl2_mac[ETHERADDRL];
+	uint16_t	svbl2_port;
+	uint8_t		svbl2_addr[16];
+} svp_bulk_vl2_t;
+
 typedef struct svp_bulk_ack {
 	uint32_t	svba_status;
 	uint32_t	svba_type;
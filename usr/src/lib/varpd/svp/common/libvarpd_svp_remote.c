@@ -536,6 +536,56 @@ svp_remote_lrm_request(svp_remote_t *srp, svp_query_t *sqp, void *buf,
 		svp_shootdown_logr_cb(srp, SVP_S_FATAL, NULL, 0);
 }
 
+static void
+svp_remote_bulk_request_cb(svp_query_t *sqp, void *arg)
+{
+	svp_t *svp = arg;
+
+	assert(sqp->sq_wdata != NULL);
+	if (sqp->sq_status == SVP_S_OK)
+		svp_bulk_cb(svp, sqp->sq_status, sqp->sq_wdata, sqp->sq_size);
+	else
+		svp_bulk_cb(svp, sqp->sq_status, NULL, 0);
+}
+
+void
+svp_remote_bulk_request(svp_t *svp, svp_query_t *sqp, uint32_t offset,
+    void *buf, size_t buflen)
+{
+	svp_remote_t *srp = svp->svp_remote;
+	svp_bulk_req_t *bulkr = &sqp->sq_rdun.sdq_bulkr;
+	boolean_t queued;
+
+	sqp->sq_func = svp_remote_bulk_request_cb;
+	sqp->sq_state = SVP_QUERY_INIT;
+	sqp->sq_arg = svp;
+	sqp->sq_svp = svp;
+	sqp->sq_header.svp_ver = htons(SVP_CURRENT_VERSION);
+	sqp->sq_header.svp_op = htons(SVP_R_BULK_REQ);
+	sqp->sq_header.svp_size = htonl(sizeof (svp_bulk_req_t));
+	sqp->sq_header.svp_id = id_alloc(svp_idspace);
+	if (sqp->sq_header.svp_id == (id_t)-1)
+		libvarpd_panic("failed to allcoate from svp_idspace: %d",
+		    errno);
+	sqp->sq_header.svp_crc32 = htonl(0);
+	sqp->sq_rdata = bulkr;
+	sqp->sq_rsize = sizeof (svp_bulk_req_t);
+	sqp->sq_wdata = buf;
+	sqp->sq_wsize = buflen;
+
+	bulkr->svbr_type = htonl(SVP_BULK_VL2);
+	bulkr->svbr_vnetid = htonl(svp->svp_vid);
+	bulkr->svbr_offset = htonl(offset);
+	bulkr->svbr_count = htonl(buflen);
+
+	mutex_enter(&srp->sr_lock);
+	queued = svp_remote_conn_queue(srp, sqp);
+	mutex_exit(&srp->sr_lock);
+
+	if (queued == B_FALSE)
+		svp_bulk_cb(svp, SVP_S_FATAL, NULL, 0);
+}
+
 /* ARGSUSED */
 void
 svp_remote_dns_timer(void *unused)
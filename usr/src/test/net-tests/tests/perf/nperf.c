@@ -0,0 +1,515 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2020 Joyent, Inc.
+ */
+
+/*
+ * nperf: a small network benchmark for the net-tests performance suite.
+ *
+ *	nperf -s [-p port]
+ *	nperf -t test [-H host] [-p port] [-d secs] [-l len] [-L label]
+ *
+ * With -s, nperf serves all of the tests below on the given TCP and UDP
+ * port until it is killed.  Otherwise it runs one test against the server
+ * on host (or, if no host is given, against a server it starts itself on
+ * the loopback address) and prints a single line of JSON describing the
+ * result, so that runs from different builds can be compared mechanically.
+ *
+ *	tcp_stream	bulk transfer of len-byte writes; reports Mbit/s
+ *	tcp_rr		len-byte request/response on one connection;
+ *			reports transactions/s and p50/p99/max latency
+ *	tcp_crr		connect, one-byte request/response, close;
+ *			reports connections/s
+ *	udp_pps		len-byte datagrams as fast as possible; reports the
+ *			packets/s sent and received by the server
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <err.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define	NPERF_PORT	"12865"
+#define	NPERF_MAXLEN	65536
+
+#define	NPERF_STREAM	'S'
+#define	NPERF_RR	'R'
+#define	NPERF_CRR	'C'
+#define	NPERF_UDP	'U'
+
+typedef struct nperf_test {
+	const char	*nt_name;
+	char		nt_code;
+	size_t		nt_deflen;
+	void		(*nt_func)(const struct nperf_test *);
+} nperf_test_t;
+
+static struct sockaddr_storage nperf_addr;
+static socklen_t nperf_addrlen;
+static hrtime_t nperf_dur = 10 * NANOSEC;
+static size_t nperf_len;
+static const char *nperf_label = "";
+static uint8_t nperf_buf[NPERF_MAXLEN];
+
+static void
+nperf_readn(int fd, void *buf, size_t len)
+{
+	uint8_t *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = read(fd, p, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, "read");
+		}
+		if (n == 0)
+			errx(EXIT_FAILURE, "unexpected EOF");
+		p += n;
+		len -= n;
+	}
+}
+
+static void
+nperf_writen(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, p, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, "write");
+		}
+		p += n;
+		len -= n;
+	}
+}
+
+static int
+nperf_connect(char code)
+{
+	int fd, one = 1;
+
+	if ((fd = socket(nperf_addr.ss_family, SOCK_STREAM, 0)) < 0)
+		err(EXIT_FAILURE, "socket");
+	(void) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+	if (connect(fd, (struct sockaddr *)&nperf_addr, nperf_addrlen) != 0)
+		err(EXIT_FAILURE, "connect");
+	nperf_writen(fd, &code, 1);
+	return (fd);
+}
+
+/*
+ * Server side.  Each control connection is handled by a child of its own;
+ * the first byte says which test it is for.
+ */
+static void
+nperf_serve_conn(int fd, int ufd)
+{
+	char code;
+	uint32_t len;
+	uint64_t count;
+	struct pollfd pfd[2];
+	ssize_t n;
+
+	nperf_readn(fd, &code, 1);
+	switch (code) {
+	case NPERF_STREAM:
+		while ((n = read(fd, nperf_buf, sizeof (nperf_buf))) > 0)
+			;
+		break;
+	case NPERF_RR:
+		nperf_readn(fd, &len, sizeof (len));
+		if ((len = ntohl(len)) == 0 || len > NPERF_MAXLEN)
+			errx(EXIT_FAILURE, "bad request size %u", len);
+		for (;;) {
+			/* a clean EOF between transactions ends the test */
+			if ((n = read(fd, nperf_buf, 1)) <= 0)
+				break;
+			nperf_readn(fd, nperf_buf + 1, len - 1);
+			nperf_writen(fd, nperf_buf, len);
+		}
+		break;
+	case NPERF_CRR:
+		nperf_readn(fd, nperf_buf, 1);
+		nperf_writen(fd, nperf_buf, 1);
+		break;
+	case NPERF_UDP:
+		/*
+		 * Count datagrams until the client tells us it has stopped
+		 * sending, then report the count back.
+		 */
+		while (recv(ufd, nperf_buf, sizeof (nperf_buf),
+		    MSG_DONTWAIT) >= 0)
+			;
+		nperf_writen(fd, &code, 1);
+		pfd[0].fd = fd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = ufd;
+		pfd[1].events = POLLIN;
+		for (count = 0; ; ) {
+			if (poll(pfd, 2, -1) < 0) {
+				if (errno == EINTR)
+					continue;
+				err(EXIT_FAILURE, "poll");
+			}
+			while (recv(ufd, nperf_buf, sizeof (nperf_buf),
+			    MSG_DONTWAIT) >= 0)
+				count++;
+			if (pfd[0].revents != 0)
+				break;
+		}
+		nperf_readn(fd, &code, 1);
+		nperf_writen(fd, &count, sizeof (count));
+		break;
+	default:
+		errx(EXIT_FAILURE, "unknown test code 0x%x", code);
+	}
+	(void) close(fd);
+}
+
+static void
+nperf_serve(int lfd, int ufd)
+{
+	int fd;
+
+	(void) signal(SIGCHLD, SIG_IGN);
+	for (;;) {
+		if ((fd = accept(lfd, NULL, NULL)) < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			err(EXIT_FAILURE, "accept");
+		}
+		switch (fork()) {
+		case -1:
+			err(EXIT_FAILURE, "fork");
+			break;
+		case 0:
+			(void) close(lfd);
+			nperf_serve_conn(fd, ufd);
+			_exit(EXIT_SUCCESS);
+			break;
+		default:
+			(void) close(fd);
+			break;
+		}
+	}
+}
+
+static void
+nperf_listen(int *lfdp, int *ufdp)
+{
+	int lfd, ufd, one = 1, bufsz = 4 * 1024 * 1024;
+
+	if ((lfd = socket(nperf_addr.ss_family, SOCK_STREAM, 0)) < 0 ||
+	    (ufd = socket(nperf_addr.ss_family, SOCK_DGRAM, 0)) < 0)
+		err(EXIT_FAILURE, "socket");
+	(void) setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+	(void) setsockopt(ufd, SOL_SOCKET, SO_RCVBUF, &bufsz, sizeof (bufsz));
+	if (bind(lfd, (struct sockaddr *)&nperf_addr, nperf_addrlen) != 0)
+		err(EXIT_FAILURE, "bind");
+	/* the UDP test uses the same port number as the listener */
+	nperf_addrlen = sizeof (nperf_addr);
+	if (getsockname(lfd, (struct sockaddr *)&nperf_addr,
+	    &nperf_addrlen) != 0)
+		err(EXIT_FAILURE, "getsockname");
+	if (bind(ufd, (struct sockaddr *)&nperf_addr, nperf_addrlen) != 0)
+		err(EXIT_FAILURE, "bind");
+	if (listen(lfd, 128) != 0)
+		err(EXIT_FAILURE, "listen");
+	*lfdp = lfd;
+	*ufdp = ufd;
+}
+
+/*
+ * Client side.  Each test runs for nperf_dur and prints one JSON object.
+ */
+static void
+nperf_report_head(const nperf_test_t *nt, hrtime_t elapsed)
+{
+	(void) printf("{\"test\": \"%s\", \"label\": \"%s\", \"len\": %zu, "
+	    "\"secs\": %.3f", nt->nt_name, nperf_label, nperf_len,
+	    (double)elapsed / NANOSEC);
+}
+
+static void
+nperf_tcp_stream(const nperf_test_t *nt)
+{
+	hrtime_t start, now;
+	uint64_t bytes = 0;
+	int fd;
+
+	fd = nperf_connect(nt->nt_code);
+	start = now = gethrtime();
+	while (now - start < nperf_dur) {
+		nperf_writen(fd, nperf_buf, nperf_len);
+		bytes += nperf_len;
+		now = gethrtime();
+	}
+	/* wait for the server to drain everything we sent */
+	(void) shutdown(fd, SHUT_WR);
+	(void) read(fd, nperf_buf, 1);
+	now = gethrtime();
+	(void) close(fd);
+
+	nperf_report_head(nt, now - start);
+	(void) printf(", \"bytes\": %llu, \"mbits_per_sec\": %.2f}\n",
+	    (u_longlong_t)bytes, (double)bytes * 8 * NANOSEC /
+	    (now - start) / 1000000);
+}
+
+static int
+nperf_cmp(const void *l, const void *r)
+{
+	hrtime_t a = *(const hrtime_t *)l, b = *(const hrtime_t *)r;
+
+	return (a < b ? -1 : a > b);
+}
+
+static void
+nperf_tcp_rr(const nperf_test_t *nt)
+{
+	hrtime_t start, t0, now;
+	hrtime_t *lat = NULL;
+	size_t n = 0, nalloc = 0;
+	uint32_t len = htonl(nperf_len);
+	int fd;
+
+	fd = nperf_connect(nt->nt_code);
+	nperf_writen(fd, &len, sizeof (len));
+	start = now = gethrtime();
+	while (now - start < nperf_dur) {
+		t0 = now;
+		nperf_writen(fd, nperf_buf, nperf_len);
+		nperf_readn(fd, nperf_buf, nperf_len);
+		now = gethrtime();
+		if (n == nalloc) {
+			nalloc = nalloc == 0 ? 65536 : nalloc * 2;
+			if ((lat = realloc(lat, nalloc * sizeof (*lat))) ==
+			    NULL)
+				err(EXIT_FAILURE, "realloc");
+		}
+		lat[n++] = now - t0;
+	}
+	(void) close(fd);
+	if (n == 0)
+		errx(EXIT_FAILURE, "no transactions completed");
+	qsort(lat, n, sizeof (*lat), nperf_cmp);
+
+	nperf_report_head(nt, now - start);
+	(void) printf(", \"transactions\": %zu, \"trans_per_sec\": %.1f, "
+	    "\"p50_usec\": %.1f, \"p99_usec\": %.1f, \"max_usec\": %.1f}\n",
+	    n, (double)n * NANOSEC / (now - start),
+	    (double)lat[n / 2] / 1000, (double)lat[(n * 99) / 100] / 1000,
+	    (double)lat[n - 1] / 1000);
+	free(lat);
+}
+
+static void
+nperf_tcp_crr(const nperf_test_t *nt)
+{
+	hrtime_t start, now;
+	uint64_t conns = 0;
+	int fd;
+
+	start = now = gethrtime();
+	while (now - start < nperf_dur) {
+		fd = nperf_connect(nt->nt_code);
+		nperf_writen(fd, nperf_buf, 1);
+		nperf_readn(fd, nperf_buf, 1);
+		(void) close(fd);
+		conns++;
+		now = gethrtime();
+	}
+
+	nperf_report_head(nt, now - start);
+	(void) printf(", \"connections\": %llu, \"conns_per_sec\": %.1f}\n",
+	    (u_longlong_t)conns, (double)conns * NANOSEC / (now - start));
+}
+
+static void
+nperf_udp_pps(const nperf_test_t *nt)
+{
+	hrtime_t start, now;
+	uint64_t sent = 0, rcvd;
+	char code;
+	int fd, ufd;
+
+	fd = nperf_connect(nt->nt_code);
+	/* wait until the server is ready to count */
+	nperf_readn(fd, &code, 1);
+	if ((ufd = socket(nperf_addr.ss_family, SOCK_DGRAM, 0)) < 0)
+		err(EXIT_FAILURE, "socket");
+	if (connect(ufd, (struct sockaddr *)&nperf_addr, nperf_addrlen) != 0)
+		err(EXIT_FAILURE, "connect");
+
+	start = now = gethrtime();
+	while (now - start < nperf_dur) {
+		/* ENOBUFS and friends just mean the packet was dropped */
+		if (send(ufd, nperf_buf, nperf_len, 0) >= 0)
+			sent++;
+		if ((sent & 0xff) == 0)
+			now = gethrtime();
+	}
+	now = gethrtime();
+	(void) close(ufd);
+
+	/* give stragglers a moment to arrive before asking for the count */
+	(void) poll(NULL, 0, 100);
+	nperf_writen(fd, &code, 1);
+	nperf_readn(fd, &rcvd, sizeof (rcvd));
+	(void) close(fd);
+
+	nperf_report_head(nt, now - start);
+	(void) printf(", \"sent\": %llu, \"received\": %llu, "
+	    "\"sent_pps\": %.0f, \"received_pps\": %.0f}\n",
+	    (u_longlong_t)sent, (u_longlong_t)rcvd,
+	    (double)sent * NANOSEC / (now - start),
+	    (double)rcvd * NANOSEC / (now - start));
+}
+
+static const nperf_test_t nperf_tests[] = {
+	{ "tcp_stream",	NPERF_STREAM,	65536,	nperf_tcp_stream },
+	{ "tcp_rr",	NPERF_RR,	1,	nperf_tcp_rr },
+	{ "tcp_crr",	NPERF_CRR,	1,	nperf_tcp_crr },
+	{ "udp_pps",	NPERF_UDP,	64,	nperf_udp_pps },
+	{ NULL }
+};
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr, "Usage: nperf -s [-p port]\n"
+	    "       nperf -t test [-H host] [-p port] [-d secs] [-l len] "
+	    "[-L label]\n"
+	    "tests: tcp_stream, tcp_rr, tcp_crr, udp_pps\n");
+	exit(2);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const nperf_test_t *nt = NULL;
+	const char *host = NULL, *port = NULL;
+	struct addrinfo hints, *ai;
+	boolean_t server = B_FALSE;
+	pid_t pid = -1;
+	int c, ret, lfd = -1, ufd = -1;
+	char *eptr;
+	long val;
+
+	while ((c = getopt(argc, argv, "d:H:l:L:p:st:")) != -1) {
+		switch (c) {
+		case 'd':
+			errno = 0;
+			val = strtol(optarg, &eptr, 10);
+			if (errno != 0 || *eptr != '\0' || val <= 0)
+				errx(2, "invalid duration: %s", optarg);
+			nperf_dur = (hrtime_t)val * NANOSEC;
+			break;
+		case 'H':
+			host = optarg;
+			break;
+		case 'l':
+			errno = 0;
+			val = strtol(optarg, &eptr, 10);
+			if (errno != 0 || *eptr != '\0' || val <= 0 ||
+			    val > NPERF_MAXLEN)
+				errx(2, "invalid length: %s", optarg);
+			nperf_len = val;
+			break;
+		case 'L':
+			nperf_label = optarg;
+			break;
+		case 'p':
+			port = optarg;
+			break;
+		case 's':
+			server = B_TRUE;
+			break;
+		case 't':
+			for (nt = nperf_tests; nt->nt_name != NULL; nt++) {
+				if (strcmp(nt->nt_name, optarg) == 0)
+					break;
+			}
+			if (nt->nt_name == NULL)
+				errx(2, "unknown test: %s", optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || server == (nt != NULL))
+		usage();
+
+	/*
+	 * A server with no host binds to the wildcard address; a client with
+	 * no host starts its own server on the loopback address with an
+	 * ephemeral port unless one was given.
+	 */
+	bzero(&hints, sizeof (hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (server && host == NULL)
+		hints.ai_flags = AI_PASSIVE;
+	if (host == NULL && !server)
+		host = "127.0.0.1";
+	if (port == NULL) {
+		port = (server || strcmp(host, "127.0.0.1") != 0) ?
+		    NPERF_PORT : "0";
+	}
+	if ((ret = getaddrinfo(host, port, &hints, &ai)) != 0)
+		errx(EXIT_FAILURE, "%s: %s", host, gai_strerror(ret));
+	bcopy(ai->ai_addr, &nperf_addr, ai->ai_addrlen);
+	nperf_addrlen = ai->ai_addrlen;
+	freeaddrinfo(ai);
+
+	if (server || strcmp(port, "0") == 0) {
+		nperf_listen(&lfd, &ufd);
+		if (server)
+			nperf_serve(lfd, ufd);
+		if ((pid = fork()) == -1)
+			err(EXIT_FAILURE, "fork");
+		if (pid == 0)
+			nperf_serve(lfd, ufd);
+		(void) close(lfd);
+		(void) close(ufd);
+	}
+
+	if (nperf_len == 0)
+		nperf_len = nt->nt_deflen;
+	nt->nt_func(nt);
+	(void) fflush(stdout);
+
+	if (pid != -1) {
+		(void) kill(pid, SIGTERM);
+		(void) waitpid(pid, NULL, 0);
+	}
+	return (EXIT_SUCCESS);
+}
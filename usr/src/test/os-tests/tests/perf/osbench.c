@@ -0,0 +1,644 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2020 Joyent, Inc.
+ */
+
+/*
+ * Kernel micro-benchmarks, in the manner of libMicro: each benchmark times
+ * a batch of operations, repeats that for a number of samples, and reports
+ * the distribution of the per-operation cost in nanoseconds.
+ *
+ *	osbench [-b batch] [-s samples] [-c cpu[,cpu]] [-n nfds]
+ *	    [-m max-median-ns] benchmark ...
+ *	osbench -l
+ *
+ * With -c the benchmark thread (and, for the wakeup benchmarks, its partner
+ * thread) is bound to the given CPUs.  With -m the exit status is 1 if any
+ * benchmark's median exceeds the given cost, so that test-runner can guard
+ * against regressions.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <port.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/processor.h>
+#include <sys/procset.h>
+#include <sys/resource.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define	OSB_SAMPLES	100
+
+extern char **environ;
+
+typedef struct osb_bench {
+	const char	*ob_name;
+	const char	*ob_desc;
+	uint64_t	ob_batch;	/* default operations per sample */
+	void		(*ob_init)(void);
+	void		(*ob_run)(uint64_t);
+	void		(*ob_fini)(void);
+} osb_bench_t;
+
+static processorid_t osb_cpu[2] = { PBIND_NONE, PBIND_NONE };
+static int osb_nfds = 1;
+
+static void
+osb_bind(processorid_t cpu)
+{
+	if (cpu != PBIND_NONE &&
+	    processor_bind(P_LWPID, P_MYID, cpu, NULL) != 0)
+		err(EXIT_FAILURE, "failed to bind to cpu %d", cpu);
+}
+
+/*
+ * System call entry and exit.
+ */
+static void
+osb_getpid_run(uint64_t n)
+{
+	while (n-- > 0)
+		(void) getpid();
+}
+
+static int osb_null_fd;
+
+static void
+osb_write_init(void)
+{
+	if ((osb_null_fd = open("/dev/null", O_WRONLY)) < 0)
+		err(EXIT_FAILURE, "failed to open /dev/null");
+}
+
+static void
+osb_write_run(uint64_t n)
+{
+	char c = 0;
+
+	while (n-- > 0) {
+		if (write(osb_null_fd, &c, 1) != 1)
+			err(EXIT_FAILURE, "write failed");
+	}
+}
+
+static void
+osb_write_fini(void)
+{
+	(void) close(osb_null_fd);
+}
+
+/*
+ * Wakeup latency: two threads, optionally bound to different CPUs, hand a
+ * token back and forth; each operation is one round trip, and so two
+ * sleeps and two wakeups.  Condition variables and semaphores both sleep
+ * in lwp_park() or the kernel's lwp semaphores.
+ */
+static pthread_mutex_t osb_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t osb_cv = PTHREAD_COND_INITIALIZER;
+static uint64_t osb_turn;
+static boolean_t osb_use_sema;
+static sem_t osb_sem[2];
+static pthread_t osb_partner;
+static boolean_t osb_partner_started;
+
+static void *
+osb_partner_thr(void *arg)
+{
+	uint64_t i;
+
+	osb_bind(osb_cpu[1] != PBIND_NONE ? osb_cpu[1] : osb_cpu[0]);
+
+	for (i = 1; ; i += 2) {
+		if (osb_use_sema) {
+			while (sem_wait(&osb_sem[1]) != 0)
+				;
+			(void) sem_post(&osb_sem[0]);
+			continue;
+		}
+		(void) pthread_mutex_lock(&osb_mtx);
+		while (osb_turn < i)
+			(void) pthread_cond_wait(&osb_cv, &osb_mtx);
+		osb_turn++;
+		(void) pthread_cond_broadcast(&osb_cv);
+		(void) pthread_mutex_unlock(&osb_mtx);
+	}
+
+	return (arg);
+}
+
+static void
+osb_partner_start(void)
+{
+	int ret;
+
+	/* The partner never exits, so there can only be one. */
+	if (osb_partner_started)
+		errx(2, "only one wakeup benchmark may be run at a time");
+	osb_partner_started = B_TRUE;
+
+	if ((ret = pthread_create(&osb_partner, NULL, osb_partner_thr,
+	    NULL)) != 0)
+		errc(EXIT_FAILURE, ret, "failed to create partner thread");
+}
+
+static void
+osb_cond_init(void)
+{
+	osb_use_sema = B_FALSE;
+	osb_partner_start();
+}
+
+static void
+osb_cond_run(uint64_t n)
+{
+	(void) pthread_mutex_lock(&osb_mtx);
+	while (n-- > 0) {
+		osb_turn++;
+		(void) pthread_cond_broadcast(&osb_cv);
+		while (osb_turn & 1)
+			(void) pthread_cond_wait(&osb_cv, &osb_mtx);
+	}
+	(void) pthread_mutex_unlock(&osb_mtx);
+}
+
+static void
+osb_sema_init(void)
+{
+	if (sem_init(&osb_sem[0], 0, 0) != 0 ||
+	    sem_init(&osb_sem[1], 0, 0) != 0)
+		err(EXIT_FAILURE, "failed to initialize semaphores");
+	osb_use_sema = B_TRUE;
+	osb_partner_start();
+}
+
+static void
+osb_sema_run(uint64_t n)
+{
+	while (n-- > 0) {
+		(void) sem_post(&osb_sem[1]);
+		while (sem_wait(&osb_sem[0]) != 0)
+			;
+	}
+}
+
+/*
+ * Page faults: map anonymous memory, touch every base page of it and unmap
+ * it again.  Each operation is one base page, so the small and large page
+ * results are directly comparable; with large pages only one touch in each
+ * large page takes a fault.
+ */
+static size_t osb_pgsz;
+static size_t osb_lpgsz;
+
+static void
+osb_fault_init(void)
+{
+	osb_pgsz = sysconf(_SC_PAGESIZE);
+}
+
+static void
+osb_fault_large_init(void)
+{
+	size_t sizes[16];
+	int n;
+
+	osb_fault_init();
+	if ((n = getpagesizes(sizes, ARRAY_SIZE(sizes))) <= 1)
+		errx(EXIT_FAILURE, "no large page sizes are supported");
+	osb_lpgsz = sizes[n - 1];
+}
+
+static void
+osb_fault_common(uint64_t n, size_t lpgsz)
+{
+	size_t len = n * osb_pgsz;
+	char *addr, *p;
+
+	if (lpgsz != 0)
+		len = P2ROUNDUP(len, lpgsz);
+
+	/* With MAP_ALIGN, the address argument is the alignment wanted. */
+	addr = mmap((caddr_t)lpgsz, len, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANON | (lpgsz != 0 ? MAP_ALIGN : 0), -1, 0);
+	if (addr == MAP_FAILED)
+		err(EXIT_FAILURE, "failed to map %zu bytes", len);
+
+	if (lpgsz != 0) {
+		struct memcntl_mha mha;
+
+		bzero(&mha, sizeof (mha));
+		mha.mha_cmd = MHA_MAPSIZE_VA;
+		mha.mha_pagesize = lpgsz;
+		if (memcntl(addr, len, MC_HAT_ADVISE, (caddr_t)&mha, 0, 0) != 0)
+			err(EXIT_FAILURE, "failed to advise %zu byte pages",
+			    lpgsz);
+	}
+
+	for (p = addr; n-- > 0; p += osb_pgsz)
+		*p = 1;
+
+	(void) munmap(addr, len);
+}
+
+static void
+osb_fault_run(uint64_t n)
+{
+	osb_fault_common(n, 0);
+}
+
+static void
+osb_fault_large_run(uint64_t n)
+{
+	osb_fault_common(n, osb_lpgsz);
+}
+
+/*
+ * Process creation.
+ */
+static void
+osb_wait(pid_t pid)
+{
+	int status;
+
+	if (pid < 0)
+		err(EXIT_FAILURE, "failed to create process");
+	while (waitpid(pid, &status, 0) != pid) {
+		if (errno != EINTR)
+			err(EXIT_FAILURE, "waitpid failed");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		errx(EXIT_FAILURE, "child %d failed", (int)pid);
+}
+
+static void
+osb_fork_run(uint64_t n)
+{
+	pid_t pid;
+
+	while (n-- > 0) {
+		if ((pid = fork()) == 0)
+			_exit(0);
+		osb_wait(pid);
+	}
+}
+
+static void
+osb_forkexec_run(uint64_t n)
+{
+	pid_t pid;
+
+	while (n-- > 0) {
+		if ((pid = fork()) == 0) {
+			(void) execl("/bin/true", "true", NULL);
+			_exit(127);
+		}
+		osb_wait(pid);
+	}
+}
+
+static void
+osb_spawn_run(uint64_t n)
+{
+	char *argv[] = { "true", NULL };
+	pid_t pid;
+	int ret;
+
+	while (n-- > 0) {
+		if ((ret = posix_spawn(&pid, "/bin/true", NULL, NULL, argv,
+		    environ)) != 0)
+			errc(EXIT_FAILURE, ret, "posix_spawn failed");
+		osb_wait(pid);
+	}
+}
+
+/*
+ * Event notification scalability: with osb_nfds pipes registered, make one
+ * of them readable, retrieve the event and drain the pipe.  Event ports are
+ * one-shot, so each port operation also re-associates the pipe.
+ */
+static int (*osb_pipes)[2];
+static int osb_evfd;
+
+static void
+osb_pipes_init(void)
+{
+	struct rlimit rl;
+	int i;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 &&
+	    rl.rlim_cur < 2 * osb_nfds + 16) {
+		rl.rlim_cur = MIN(rl.rlim_max, 2 * osb_nfds + 16);
+		(void) setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	if ((osb_pipes = calloc(osb_nfds, sizeof (*osb_pipes))) == NULL)
+		err(EXIT_FAILURE, "failed to allocate %d pipes", osb_nfds);
+	for (i = 0; i < osb_nfds; i++) {
+		if (pipe(osb_pipes[i]) != 0)
+			err(EXIT_FAILURE, "failed to create pipe %d", i);
+	}
+}
+
+static void
+osb_pipes_fini(void)
+{
+	int i;
+
+	for (i = 0; i < osb_nfds; i++) {
+		(void) close(osb_pipes[i][0]);
+		(void) close(osb_pipes[i][1]);
+	}
+	free(osb_pipes);
+	(void) close(osb_evfd);
+}
+
+static void
+osb_pipe_kick(uint64_t i)
+{
+	char c = 0;
+
+	if (write(osb_pipes[i % osb_nfds][1], &c, 1) != 1)
+		err(EXIT_FAILURE, "write failed");
+}
+
+static void
+osb_pipe_drain(int fd)
+{
+	char c;
+
+	if (read(fd, &c, 1) != 1)
+		err(EXIT_FAILURE, "read failed");
+}
+
+static void
+osb_port_init(void)
+{
+	int i;
+
+	osb_pipes_init();
+	if ((osb_evfd = port_create()) < 0)
+		err(EXIT_FAILURE, "failed to create event port");
+	for (i = 0; i < osb_nfds; i++) {
+		if (port_associate(osb_evfd, PORT_SOURCE_FD,
+		    osb_pipes[i][0], POLLIN, NULL) != 0)
+			err(EXIT_FAILURE, "port_associate failed");
+	}
+}
+
+static void
+osb_port_run(uint64_t n)
+{
+	port_event_t pe;
+	uint64_t i;
+
+	for (i = 0; i < n; i++) {
+		osb_pipe_kick(i);
+		if (port_get(osb_evfd, &pe, NULL) != 0)
+			err(EXIT_FAILURE, "port_get failed");
+		osb_pipe_drain((int)pe.portev_object);
+		if (port_associate(osb_evfd, PORT_SOURCE_FD,
+		    pe.portev_object, POLLIN, NULL) != 0)
+			err(EXIT_FAILURE, "port_associate failed");
+	}
+}
+
+static void
+osb_epoll_init(void)
+{
+	struct epoll_event ev;
+	int i;
+
+	osb_pipes_init();
+	if ((osb_evfd = epoll_create1(0)) < 0)
+		err(EXIT_FAILURE, "failed to create epoll instance");
+	for (i = 0; i < osb_nfds; i++) {
+		ev.events = EPOLLIN;
+		ev.data.fd = osb_pipes[i][0];
+		if (epoll_ctl(osb_evfd, EPOLL_CTL_ADD, osb_pipes[i][0],
+		    &ev) != 0)
+			err(EXIT_FAILURE, "epoll_ctl failed");
+	}
+}
+
+static void
+osb_epoll_run(uint64_t n)
+{
+	struct epoll_event ev;
+	uint64_t i;
+
+	for (i = 0; i < n; i++) {
+		osb_pipe_kick(i);
+		if (epoll_wait(osb_evfd, &ev, 1, -1) != 1)
+			err(EXIT_FAILURE, "epoll_wait failed");
+		osb_pipe_drain(ev.data.fd);
+	}
+}
+
+static osb_bench_t osb_benches[] = {
+	{ "getpid", "getpid(2) system call", 100000,
+	    NULL, osb_getpid_run, NULL },
+	{ "write", "one byte write(2) to /dev/null", 100000,
+	    osb_write_init, osb_write_run, osb_write_fini },
+	{ "cond_wakeup", "condition variable ping-pong round trip", 1000,
+	    osb_cond_init, osb_cond_run, NULL },
+	{ "sema_wakeup", "semaphore ping-pong round trip", 1000,
+	    osb_sema_init, osb_sema_run, NULL },
+	{ "fault", "anonymous page fault, per base page", 4096,
+	    osb_fault_init, osb_fault_run, NULL },
+	{ "fault_large", "anonymous large page fault, per base page", 16384,
+	    osb_fault_large_init, osb_fault_large_run, NULL },
+	{ "fork", "fork(2), exit and wait", 100,
+	    NULL, osb_fork_run, NULL },
+	{ "forkexec", "fork(2), exec /bin/true and wait", 50,
+	    NULL, osb_forkexec_run, NULL },
+	{ "spawn", "posix_spawn(3C) /bin/true and wait", 50,
+	    NULL, osb_spawn_run, NULL },
+	{ "port", "event port event on one of nfds pipes", 10000,
+	    osb_port_init, osb_port_run, osb_pipes_fini },
+	{ "epoll", "epoll event on one of nfds pipes", 10000,
+	    osb_epoll_init, osb_epoll_run, osb_pipes_fini },
+};
+
+static int
+osb_cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x < y ? -1 : x > y ? 1 : 0);
+}
+
+/*
+ * Run one benchmark and print its statistics.  Returns the median cost.
+ */
+static double
+osb_run(const osb_bench_t *ob, uint64_t batch, int nsamples)
+{
+	double *v, mean = 0, var = 0, median;
+	char name[32];
+	hrtime_t start;
+	int i;
+
+	if (batch == 0)
+		batch = ob->ob_batch;
+	/* Don't let a sample cover less than one large page. */
+	if (ob->ob_run == osb_fault_large_run)
+		batch = MAX(batch, osb_lpgsz / osb_pgsz);
+
+	if ((v = calloc(nsamples, sizeof (double))) == NULL)
+		err(EXIT_FAILURE, "failed to allocate samples");
+
+	/* One untimed sample to warm up caches and start threads. */
+	ob->ob_run(batch);
+
+	for (i = 0; i < nsamples; i++) {
+		start = gethrtime();
+		ob->ob_run(batch);
+		v[i] = (double)(gethrtime() - start) / batch;
+		mean += v[i];
+	}
+	mean /= nsamples;
+	for (i = 0; i < nsamples; i++)
+		var += (v[i] - mean) * (v[i] - mean);
+	if (nsamples > 1)
+		var /= nsamples - 1;
+
+	qsort(v, nsamples, sizeof (double), osb_cmp);
+	median = (nsamples & 1) ? v[nsamples / 2] :
+	    (v[nsamples / 2 - 1] + v[nsamples / 2]) / 2;
+
+	if (ob->ob_fini == osb_pipes_fini)
+		(void) snprintf(name, sizeof (name), "%s/%d", ob->ob_name,
+		    osb_nfds);
+	else
+		(void) strlcpy(name, ob->ob_name, sizeof (name));
+
+	(void) printf("%-16s %7d %7llu %10.1f %10.1f %10.1f %10.1f %10.1f "
+	    "%10.1f\n", name, nsamples, (u_longlong_t)batch, v[0], median,
+	    mean, sqrt(var), v[MIN(nsamples - 1, nsamples * 95 / 100)],
+	    v[nsamples - 1]);
+	(void) fflush(stdout);
+
+	free(v);
+	return (median);
+}
+
+static void
+osb_usage(void)
+{
+	(void) fprintf(stderr, "Usage: osbench [-b batch] [-s samples] "
+	    "[-c cpu[,cpu]] [-n nfds]\n\t[-m max-median-ns] benchmark ...\n"
+	    "       osbench -l\n");
+	exit(2);
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint64_t batch = 0;
+	int nsamples = OSB_SAMPLES;
+	double limit = 0;
+	int c, ret = 0;
+	uint_t i;
+	char *eptr;
+
+	while ((c = getopt(argc, argv, "b:c:lm:n:s:")) != -1) {
+		switch (c) {
+		case 'b':
+			batch = strtoull(optarg, &eptr, 10);
+			if (*eptr != '\0' || batch == 0)
+				errx(2, "invalid batch size: %s", optarg);
+			break;
+		case 'c':
+			osb_cpu[0] = strtol(optarg, &eptr, 10);
+			if (*eptr == ',')
+				osb_cpu[1] = strtol(eptr + 1, &eptr, 10);
+			if (*eptr != '\0')
+				errx(2, "invalid cpu list: %s", optarg);
+			break;
+		case 'l':
+			for (i = 0; i < ARRAY_SIZE(osb_benches); i++) {
+				(void) printf("%-16s %s\n",
+				    osb_benches[i].ob_name,
+				    osb_benches[i].ob_desc);
+			}
+			return (0);
+		case 'm':
+			limit = strtod(optarg, &eptr);
+			if (*eptr != '\0' || limit < 0)
+				errx(2, "invalid limit: %s", optarg);
+			break;
+		case 'n':
+			osb_nfds = strtol(optarg, &eptr, 10);
+			if (*eptr != '\0' || osb_nfds < 1)
+				errx(2, "invalid number of fds: %s", optarg);
+			break;
+		case 's':
+			nsamples = strtol(optarg, &eptr, 10);
+			if (*eptr != '\0' || nsamples < 1)
+				errx(2, "invalid number of samples: %s",
+				    optarg);
+			break;
+		default:
+			osb_usage();
+		}
+	}
+
+	if (optind == argc)
+		osb_usage();
+
+	osb_bind(osb_cpu[0]);
+
+	(void) printf("%-16s %7s %7s %10s %10s %10s %10s %10s %10s\n",
+	    "NAME", "SAMPLES", "BATCH", "MIN", "MEDIAN", "MEAN", "STDDEV",
+	    "P95", "MAX");
+
+	for (; optind < argc; optind++) {
+		const osb_bench_t *ob = NULL;
+		double median;
+
+		for (i = 0; i < ARRAY_SIZE(osb_benches); i++) {
+			if (strcmp(argv[optind], osb_benches[i].ob_name) == 0)
+				ob = &osb_benches[i];
+		}
+		if (ob == NULL)
+			errx(2, "unknown benchmark: %s", argv[optind]);
+
+		if (ob->ob_init != NULL)
+			ob->ob_init();
+		median = osb_run(ob, batch, nsamples);
+		if (ob->ob_fini != NULL)
+			ob->ob_fini();
+
+		if (limit != 0 && median > limit) {
+			warnx("%s: median %.1f ns exceeds limit %.1f ns",
+			    ob->ob_name, median, limit);
+			ret = 1;
+		}
+	}
+
+	return (ret);
+}
@@ -0,0 +1,115 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2020 Joyent, Inc.
+ */
+
+/*
+ * Basic tests for recvmmsg() and sendmmsg() on a datagram socket pair.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+
+#define	NMSGS	8
+
+static struct mmsghdr hdrs[NMSGS];
+static struct iovec iovs[NMSGS];
+static char bufs[NMSGS][64];
+
+static void
+setup(void)
+{
+	bzero(hdrs, sizeof (hdrs));
+	for (int i = 0; i < NMSGS; i++) {
+		iovs[i].iov_base = bufs[i];
+		iovs[i].iov_len = sizeof (bufs[i]);
+		hdrs[i].msg_hdr.msg_iov = &iovs[i];
+		hdrs[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+int
+main(void)
+{
+	int fds[2];
+	int ret;
+
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) != 0)
+		err(EXIT_FAILURE, "socketpair");
+
+	setup();
+	for (int i = 0; i < NMSGS; i++) {
+		(void) snprintf(bufs[i], sizeof (bufs[i]), "message %d", i);
+		iovs[i].iov_len = strlen(bufs[i]) + 1;
+	}
+
+	ret = sendmmsg(fds[0], hdrs, NMSGS, 0);
+	if (ret != NMSGS)
+		err(EXIT_FAILURE, "sendmmsg returned %d", ret);
+	for (int i = 0; i < NMSGS; i++) {
+		if (hdrs[i].msg_len != strlen(bufs[i]) + 1) {
+			errx(EXIT_FAILURE, "sent message %d has length %u",
+			    i, hdrs[i].msg_len);
+		}
+	}
+
+	/*
+	 * With MSG_WAITFORONE, everything queued is returned without
+	 * blocking for the rest of the vector.
+	 */
+	setup();
+	ret = recvmmsg(fds[1], hdrs, NMSGS,
+	    MSG_WAITFORONE, NULL);
+	if (ret != NMSGS)
+		err(EXIT_FAILURE, "recvmmsg returned %d", ret);
+	for (int i = 0; i < NMSGS; i++) {
+		char expect[64];
+
+		(void) snprintf(expect, sizeof (expect), "message %d", i);
+		if (hdrs[i].msg_len != strlen(expect) + 1 ||
+		    strcmp(bufs[i], expect) != 0) {
+			errx(EXIT_FAILURE, "received message %d is wrong "
+			    "(%u bytes, '%s')", i, hdrs[i].msg_len, bufs[i]);
+		}
+	}
+
+	/*
+	 * A partial batch returns what was queued.
+	 */
+	setup();
+	if (sendmmsg(fds[0], hdrs, 2, 0) != 2)
+		err(EXIT_FAILURE, "sendmmsg of 2 messages");
+	setup();
+	ret = recvmmsg(fds[1], hdrs, NMSGS, MSG_WAITFORONE, NULL);
+	if (ret != 2)
+		errx(EXIT_FAILURE, "recvmmsg of partial batch returned %d",
+		    ret);
+
+	/*
+	 * Nothing queued and not allowed to block.
+	 */
+	setup();
+	ret = recvmmsg(fds[1], hdrs, NMSGS, MSG_DONTWAIT, NULL);
+	if (ret != -1 || errno != EAGAIN) {
+		errx(EXIT_FAILURE, "recvmmsg on empty socket returned %d "
+		    "(errno %d)", ret, errno);
+	}
+
+	(void) printf("TEST PASSED\n");
+	return (EXIT_SUCCESS);
+}
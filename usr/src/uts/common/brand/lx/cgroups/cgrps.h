@@ -10,7 +10,7 @@
  */
 
 /*
- * Copyright 2016 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_LXCGRPS_H
@@ -76,6 +76,7 @@ typedef struct cgrpmgr_info32 {
  */
 typedef enum cgrp_ssid {
 	CG_SSID_GENERIC = 1,
+	CG_SSID_UNIFIED,	/* cgroup v2 unified hierarchy */
 	CG_SSID_NUM		/* last ssid for range checking */
 } cgrp_ssid_t;
 
@@ -85,11 +86,18 @@ typedef enum cgrp_nodetype {
 	CG_PROCS,		/* cgroup.procs file */
 	CG_REL_AGENT,		/* release_agent file */
 	CG_TASKS,		/* tasks file */
+	CG_CONTROLLERS,		/* cgroup.controllers file (v2) */
+	CG_CPU_MAX,		/* cpu.max file (v2) */
+	CG_CPU_STAT,		/* cpu.stat file (v2) */
+	CG_IO_STAT,		/* io.stat file (v2) */
+	CG_MEM_CURRENT,		/* memory.current file (v2) */
+	CG_MEM_MAX,		/* memory.max file (v2) */
 } cgrp_nodetype_t;
 
 typedef struct cgrp_subsys_dirent {
 	cgrp_nodetype_t cgrp_ssd_type;
 	char		*cgrp_ssd_name;
+	mode_t		cgrp_ssd_mode;
 } cgrp_subsys_dirent_t;
 
 #define	N_DIRENTS(m)	(cgrp_num_pseudo_ents((m)->cg_ssid) + 2)
@@ -10,7 +10,7 @@
  */
 
 /*
- * Copyright 2016 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/types.h>
@@ -35,9 +35,24 @@ static int cgrp_dirmakecgnode(cgrp_node_t *, cgrp_mnt_t *, struct vattr *,
 static int cgrp_diraddentry(cgrp_node_t *, cgrp_node_t *, char *);
 
 static cgrp_subsys_dirent_t cgrp_generic_dir[] = {
-	{ CG_PROCS,		"cgroup.procs" },
-	{ CG_NOTIFY,		"notify_on_release" },
-	{ CG_TASKS,		"tasks" }
+	{ CG_PROCS,		"cgroup.procs",		0644 },
+	{ CG_NOTIFY,		"notify_on_release",	0644 },
+	{ CG_TASKS,		"tasks",		0644 }
+};
+
+/*
+ * The cgroup v2 interface files.  The controller files report zone-wide
+ * values taken from the zone's resource controls; the limits are managed
+ * from the global zone so they cannot be written here.
+ */
+static cgrp_subsys_dirent_t cgrp_unified_dir[] = {
+	{ CG_PROCS,		"cgroup.procs",		0644 },
+	{ CG_CONTROLLERS,	"cgroup.controllers",	0444 },
+	{ CG_CPU_MAX,		"cpu.max",		0444 },
+	{ CG_CPU_STAT,		"cpu.stat",		0444 },
+	{ CG_IO_STAT,		"io.stat",		0444 },
+	{ CG_MEM_CURRENT,	"memory.current",	0444 },
+	{ CG_MEM_MAX,		"memory.max",		0444 }
 };
 
 typedef struct cgrp_ssde {
@@ -56,6 +71,9 @@ static cgrp_ssde_t cg_ssde_dir[] = {
 
 	/* CG_SSID_GENERIC */
 	{cgrp_generic_dir, CGDIRLISTSZ(cgrp_generic_dir)},
+
+	/* CG_SSID_UNIFIED */
+	{cgrp_unified_dir, CGDIRLISTSZ(cgrp_unified_dir)},
 };
 
 
@@ -816,17 +834,18 @@ cgrp_dirinit(cgrp_node_t *parent, cgrp_node_t *dir, cred_t *cr)
 	nattr.va_rdev = 0;
 
 	/*
-	 * If this is the top-level dir in the file system then it always
+	 * If this is the top-level dir in a v1 file system then it always
 	 * has a release_agent pseudo file. Only the top-level dir has this
 	 * file.
 	 */
-	if (parent == dir) {
+	if (parent == dir && cgm->cg_ssid != CG_SSID_UNIFIED) {
 		cgrp_addnode(cgm, dir, "release_agent", CG_REL_AGENT, &nattr,
 		    cr);
 	}
 
 	pseudo_files = ssdp->cg_ssde_files;
 	for (i = 0; i < ssdp->cg_ssde_nfiles; i++) {
+		nattr.va_mode = pseudo_files[i].cgrp_ssd_mode;
 		cgrp_addnode(cgm, dir, pseudo_files[i].cgrp_ssd_name,
 		    pseudo_files[i].cgrp_ssd_type, &nattr, cr);
 	}
@@ -10,7 +10,7 @@
  */
 
 /*
- * Copyright 2016 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -129,7 +129,8 @@
  * lxpr_read_cgroups function in lx_procfs so that the subsystem is reported
  * by proc.
  *
- * Although we don't currently support any subsystem controllers, the design
+ * Apart from the cgroup v2 files (CG_SSID_UNIFIED), which report zone-wide
+ * values, we don't currently emulate any subsystem controllers, but the design
  * allows for the file system to be extended to add controller emulation
  * if needed. New controller IDs (i.e. different subsystems) for a mount can
  * be defined in the cgrp_ssid_t enum (e.g. CG_SSID_CPUSET or CG_SSID_MEMORY)
@@ -421,7 +422,12 @@ cgrp_mount(vfs_t *vfsp, vnode_t *mvp, struct mounta *uap, cred_t *cr)
 	 *	}
 	 *	ssid = CG_SSID_CPUSET;
 	 * }
+	 *
+	 * lx_mount translates a Linux "cgroup2" mount into a mount with the
+	 * 'unified' option, which selects the v2 hierarchy.
 	 */
+	if (vfs_optionisset(vfsp, "unified", NULL))
+		ssid = CG_SSID_UNIFIED;
 
 	error = pn_get(uap->dir,
 	    (uap->flags & MS_SYSSPACE) ? UIO_SYSSPACE : UIO_USERSPACE, &dpn);
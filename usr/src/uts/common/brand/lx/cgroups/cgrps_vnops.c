@@ -10,7 +10,7 @@
  */
 
 /*
- * Copyright 2016 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/types.h>
@@ -43,6 +43,9 @@
 #include <sys/ddi.h>
 #include <sys/sunddi.h>
 #include <sys/brand.h>
+#include <sys/zone.h>
+#include <sys/cpucaps.h>
+#include <sys/cpu_uarray.h>
 #include <sys/lx_brand.h>
 
 #include "cgrps.h"
@@ -52,6 +55,9 @@ typedef enum cgrp_wr_type {
 	CG_WR_TASKS
 } cgrp_wr_type_t;
 
+/* cpu.max reports the zone's CPU cap against a fixed 100ms period */
+#define	CG_CPU_PERIOD	100000
+
 /* ARGSUSED1 */
 static int
 cgrp_open(struct vnode **vpp, int flag, struct cred *cred, caller_context_t *ct)
@@ -436,6 +442,15 @@ cgrp_wr(cgrp_mnt_t *cgm, cgrp_node_t *cn, struct uio *uio)
 	case CG_TASKS:
 		error = cgrp_wr_proc_or_task(cgm, cn, uio, CG_WR_TASKS);
 		break;
+	case CG_CONTROLLERS:
+	case CG_CPU_MAX:
+	case CG_CPU_STAT:
+	case CG_IO_STAT:
+	case CG_MEM_CURRENT:
+	case CG_MEM_MAX:
+		/* The v2 controller files are read-only */
+		error = EINVAL;
+		break;
 	default:
 		VERIFY(0);
 	}
@@ -790,6 +805,117 @@ cgrp_rd_tasks(cgrp_mnt_t *cgm, cgrp_node_t *cn, struct uio *uio)
 	return (0);
 }
 
+/*
+ * Copy out the part of a formatted pseudo file covered by the read.
+ */
+static int
+cgrp_rd_buf(char *buf, int len, struct uio *uio)
+{
+	if (uio->uio_offset >= len)
+		return (0);
+
+	len -= uio->uio_offset;
+	len = (uio->uio_resid < len) ? uio->uio_resid : len;
+
+	return (uiomove(&buf[uio->uio_offset], len, UIO_READ, uio));
+}
+
+/*
+ * The v2 controller files report zone-wide values, since the zone's resource
+ * controls are the only limits we can honestly describe.  Each is generated
+ * from counters which the zone already maintains, so a read costs no more
+ * than a few loads; there is no per-cgroup accounting to sum up.
+ */
+static int
+cgrp_rd_controller(cgrp_mnt_t *cgm, cgrp_node_t *cn, struct uio *uio)
+{
+	zone_t *zone = cgm->cg_vfsp->vfs_zone;
+	zone_persist_t *zp = &zone_pdata[zone->zone_id];
+	char buf[256];
+	int len;
+
+	switch (cn->cgn_type) {
+	case CG_CONTROLLERS:
+		len = snprintf(buf, sizeof (buf), "cpu io memory\n");
+		break;
+
+	case CG_CPU_MAX: {
+		rctl_qty_t cap = cpucaps_zone_get_value(zone);
+
+		/* The cap is a percentage of a single CPU */
+		if (cap == 0) {
+			len = snprintf(buf, sizeof (buf), "max %u\n",
+			    CG_CPU_PERIOD);
+		} else {
+			len = snprintf(buf, sizeof (buf), "%llu %u\n",
+			    (u_longlong_t)(cap * CG_CPU_PERIOD / 100),
+			    CG_CPU_PERIOD);
+		}
+		break;
+	}
+
+	case CG_CPU_STAT: {
+		hrtime_t utime, stime;
+		u_longlong_t above, below;
+
+		utime = (hrtime_t)cpu_uarray_sum(zone->zone_ustate,
+		    ZONE_USTATE_UTIME);
+		stime = (hrtime_t)cpu_uarray_sum(zone->zone_ustate,
+		    ZONE_USTATE_STIME);
+		scalehrtime(&utime);
+		scalehrtime(&stime);
+
+		/*
+		 * The cap is enforced once per clock tick, so a tick plays
+		 * the part of a CFS bandwidth period.
+		 */
+		cpucaps_zone_get_ticks(zone, &above, &below);
+
+		len = snprintf(buf, sizeof (buf),
+		    "usage_usec %llu\nuser_usec %llu\nsystem_usec %llu\n"
+		    "nr_periods %llu\nnr_throttled %llu\n"
+		    "throttled_usec %llu\n",
+		    (u_longlong_t)NSEC2USEC(utime + stime),
+		    (u_longlong_t)NSEC2USEC(utime),
+		    (u_longlong_t)NSEC2USEC(stime),
+		    above + below, above,
+		    (u_longlong_t)NSEC2USEC(TICK_TO_NSEC(above)));
+		break;
+	}
+
+	case CG_IO_STAT: {
+		kstat_io_t kio;
+
+		zone_get_zfs_iostats(zone->zone_id, &kio);
+		len = snprintf(buf, sizeof (buf),
+		    "0:0 rbytes=%llu wbytes=%llu rios=%u wios=%u "
+		    "dbytes=0 dios=0\n",
+		    (u_longlong_t)kio.nread, (u_longlong_t)kio.nwritten,
+		    kio.reads, kio.writes);
+		break;
+	}
+
+	case CG_MEM_CURRENT:
+		len = snprintf(buf, sizeof (buf), "%llu\n",
+		    (u_longlong_t)ptob((pgcnt_t)zp->zpers_pg_cnt));
+		break;
+
+	case CG_MEM_MAX:
+		if (zp->zpers_pg_limit == UINT32_MAX) {
+			len = snprintf(buf, sizeof (buf), "max\n");
+		} else {
+			len = snprintf(buf, sizeof (buf), "%llu\n",
+			    (u_longlong_t)ptob((pgcnt_t)zp->zpers_pg_limit));
+		}
+		break;
+
+	default:
+		VERIFY(0);
+	}
+
+	return (cgrp_rd_buf(buf, len, uio));
+}
+
 static int
 cgrp_rd(cgrp_mnt_t *cgm, cgrp_node_t *cn, struct uio *uio)
 {
@@ -815,6 +941,14 @@ cgrp_rd(cgrp_mnt_t *cgm, cgrp_node_t *cn, struct uio *uio)
 	case CG_TASKS:
 		error = cgrp_rd_tasks(cgm, cn, uio);
 		break;
+	case CG_CONTROLLERS:
+	case CG_CPU_MAX:
+	case CG_CPU_STAT:
+	case CG_IO_STAT:
+	case CG_MEM_CURRENT:
+	case CG_MEM_MAX:
+		error = cgrp_rd_controller(cgm, cn, uio);
+		break;
 	default:
 		VERIFY(0);
 	}
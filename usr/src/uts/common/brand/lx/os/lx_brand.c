@@ -2014,6 +2014,9 @@ lx_copy_procdata(proc_t *cp, proc_t *pp)
 	 */
 	cpd->l_ptrace = 0;
 
+	/* membarrier(2) registration is not inherited across fork. */
+	cpd->l_flags &= ~LX_PROC_MEMBARRIER_PRIV;
+
 	cpd->l_fake_limits[LX_RLFAKE_LOCKS].rlim_cur = LX_RLIM64_INFINITY;
 	cpd->l_fake_limits[LX_RLFAKE_LOCKS].rlim_max = LX_RLIM64_INFINITY;
 
@@ -2650,11 +2653,13 @@ _init(void)
 	lx_hz_scale = hz / LX_USERHZ;
 
 	lx_syscall_init();
+	lx_syscall_kstat_init();
 	lx_pid_init();
 	lx_ioctl_init();
 	lx_futex_init();
 	lx_ptrace_init();
 	lx_socket_init();
+	lx_perf_init();
 	lx_audit_ld();
 
 	err = mod_install(&modlinkage);
@@ -2668,8 +2673,10 @@ _init(void)
 		 * wasn't loaded there should be no Linux processes, and
 		 * thus no way for these data structures to be modified.
 		 */
+		lx_syscall_kstat_fini();
 		lx_pid_fini();
 		lx_ioctl_fini();
+		lx_perf_fini();
 		if (lx_futex_fini())
 			panic("lx brand module cannot be loaded or unloaded.");
 	}
@@ -2699,7 +2706,9 @@ _fini(void)
 	lx_pid_fini();
 	lx_ioctl_fini();
 	lx_socket_fini();
+	lx_perf_fini();
 	lx_audit_unld();
+	lx_syscall_kstat_fini();
 
 	if ((err = lx_futex_fini()) != 0) {
 		goto done;
@@ -2718,6 +2727,7 @@ done:
 		lx_pid_init();
 		lx_ioctl_init();
 		lx_socket_init();
+		lx_syscall_kstat_init();
 
 		if (futex_done) {
 			lx_futex_init();
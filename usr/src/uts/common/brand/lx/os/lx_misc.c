@@ -91,6 +91,11 @@ lx_exec()
 	 */
 	pd->l_handler = (uintptr_t)NULL;
 
+	/* The new image must register for membarrier(2) again. */
+	mutex_enter(&p->p_lock);
+	pd->l_flags &= ~LX_PROC_MEMBARRIER_PRIV;
+	mutex_exit(&p->p_lock);
+
 	/*
 	 * If this was a multi-threaded Linux process and this lwp wasn't the
 	 * main lwp, then we need to make its Illumos and Linux PIDs match.
@@ -22,7 +22,7 @@
 /*
  * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright 2019 OmniOS Community Edition (OmniOSce) Association.
  */
 
@@ -39,6 +39,8 @@
 #include <sys/brand.h>
 #include <sys/machbrand.h>
 #include <sys/sdt.h>
+#include <sys/kstat.h>
+#include <sys/atomic.h>
 #include <sys/lx_syscalls.h>
 #include <sys/lx_brand.h>
 #include <sys/lx_impl.h>
@@ -97,6 +99,32 @@ int lx_nsysent64;
 lx_sysent_t lx_sysent32[LX_NSYSCALLS + 1];
 int lx_nsysent32;
 
+/*
+ * Per-syscall counts of the calls handed to the usermode emulation library,
+ * exported through the "lx:0:usermode_syscalls" kstat (and, for 32-bit
+ * processes, "usermode_syscalls32").  These show which system calls are
+ * still paying for the trip out to userland and back.
+ */
+typedef struct lx_usermode_stats {
+	const char	*lus_name;
+	lx_sysent_t	*lus_sysent;
+	kstat_t		*lus_ksp;
+	uint64_t	lus_count[LX_NSYSCALLS + 1];
+} lx_usermode_stats_t;
+
+#if defined(_LP64)
+static lx_usermode_stats_t lx_usermode_stats64 = {
+	"usermode_syscalls", lx_sysent64
+};
+static lx_usermode_stats_t lx_usermode_stats32 = {
+	"usermode_syscalls32", lx_sysent32
+};
+#else
+static lx_usermode_stats_t lx_usermode_stats32 = {
+	"usermode_syscalls", lx_sysent32
+};
+#endif
+
 #if defined(_LP64)
 struct lx_vsyscall
 {
@@ -313,6 +341,7 @@ lx_syscall_enter(void)
 	int error;
 	long ret = 0;
 	lx_sysent_t *s;
+	lx_usermode_stats_t *lus;
 	uintptr_t args[6];
 	unsigned int unsup_reason;
 
@@ -365,10 +394,12 @@ lx_syscall_enter(void)
 #if defined(_LP64)
 	if (lwp_getdatamodel(lwp) == DATAMODEL_NATIVE) {
 		s = &lx_sysent64[syscall_num];
+		lus = &lx_usermode_stats64;
 	} else
 #endif
 	{
 		s = &lx_sysent32[syscall_num];
+		lus = &lx_usermode_stats32;
 	}
 
 	/*
@@ -412,6 +443,7 @@ lx_syscall_enter(void)
 		/*
 		 * Pass to the usermode emulation routine.
 		 */
+		atomic_inc_64(&lus->lus_count[syscall_num]);
 #if defined(_LP64)
 		if (get_udatamodel() != DATAMODEL_NATIVE) {
 			lx_emulate_user32(lwp, syscall_num, args);
@@ -434,6 +466,93 @@ lx_syscall_enter(void)
 	}
 }
 
+static boolean_t
+lx_sysent_usermode(const lx_sysent_t *s)
+{
+	return (s->sy_name != NULL && s->sy_callc == NULL &&
+	    (s->sy_flags & LX_SYS_NOSYS_REASON) == NOSYS_USERMODE);
+}
+
+static int
+lx_usermode_kstat_update(kstat_t *ksp, int rw)
+{
+	lx_usermode_stats_t *lus = ksp->ks_private;
+	kstat_named_t *knp = ksp->ks_data;
+	int i;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	for (i = 0; i <= LX_NSYSCALLS; i++) {
+		if (!lx_sysent_usermode(&lus->lus_sysent[i]))
+			continue;
+		knp->value.ui64 = lus->lus_count[i];
+		knp++;
+	}
+
+	return (0);
+}
+
+static void
+lx_usermode_kstat_create(lx_usermode_stats_t *lus)
+{
+	kstat_t *ksp;
+	kstat_named_t *knp;
+	uint_t i, nstats = 0;
+
+	for (i = 0; i <= LX_NSYSCALLS; i++) {
+		if (lx_sysent_usermode(&lus->lus_sysent[i]))
+			nstats++;
+	}
+	if (nstats == 0)
+		return;
+
+	ksp = kstat_create("lx", 0, lus->lus_name, "misc", KSTAT_TYPE_NAMED,
+	    nstats, 0);
+	if (ksp == NULL)
+		return;
+
+	knp = ksp->ks_data;
+	for (i = 0; i <= LX_NSYSCALLS; i++) {
+		if (!lx_sysent_usermode(&lus->lus_sysent[i]))
+			continue;
+		kstat_named_init(knp, lus->lus_sysent[i].sy_name,
+		    KSTAT_DATA_UINT64);
+		knp++;
+	}
+	ksp->ks_update = lx_usermode_kstat_update;
+	ksp->ks_private = lus;
+	kstat_install(ksp);
+	lus->lus_ksp = ksp;
+}
+
+static void
+lx_usermode_kstat_delete(lx_usermode_stats_t *lus)
+{
+	if (lus->lus_ksp != NULL) {
+		kstat_delete(lus->lus_ksp);
+		lus->lus_ksp = NULL;
+	}
+}
+
+void
+lx_syscall_kstat_init(void)
+{
+#if defined(_LP64)
+	lx_usermode_kstat_create(&lx_usermode_stats64);
+#endif
+	lx_usermode_kstat_create(&lx_usermode_stats32);
+}
+
+void
+lx_syscall_kstat_fini(void)
+{
+#if defined(_LP64)
+	lx_usermode_kstat_delete(&lx_usermode_stats64);
+#endif
+	lx_usermode_kstat_delete(&lx_usermode_stats32);
+}
+
 #if defined(_LP64)
 /*
  * Emulate vsyscall support.
@@ -621,8 +740,8 @@ lx_sysent_t lx_sysent32[] = {
 	{"readdir",	NULL,			0,		3}, /* 89 */
 	{"mmap",	lx_mmap,		0,		6}, /* 90 */
 	{"munmap",	lx_munmap,		0,		2}, /* 91 */
-	{"truncate",	NULL,			0,		2}, /* 92 */
-	{"ftruncate",	NULL,			0,		2}, /* 93 */
+	{"truncate",	lx_truncate32,		0,		2}, /* 92 */
+	{"ftruncate",	lx_ftruncate32,		0,		2}, /* 93 */
 	{"fchmod",	lx_fchmod,		0,		2}, /* 94 */
 	{"fchown16",	lx_fchown16,		0,		3}, /* 95 */
 	{"getpriority",	lx_getpriority,		0,		2}, /* 96 */
@@ -722,8 +841,8 @@ lx_sysent_t lx_sysent32[] = {
 	{"vfork",	NULL,			0,		0}, /* 190 */
 	{"getrlimit",	lx_getrlimit,		0,		2}, /* 191 */
 	{"mmap2",	lx_mmap2,		LX_SYS_EBPARG6,	6}, /* 192 */
-	{"truncate64",	NULL,			0,		3}, /* 193 */
-	{"ftruncate64",	NULL,			0,		3}, /* 194 */
+	{"truncate64",	lx_truncate64,		0,		3}, /* 193 */
+	{"ftruncate64",	lx_ftruncate64,		0,		3}, /* 194 */
 	{"stat64",	lx_stat64,		0,		2}, /* 195 */
 	{"lstat64",	lx_lstat64,		0,		2}, /* 196 */
 	{"fstat64",	lx_fstat64,		0,		2}, /* 197 */
@@ -754,7 +873,7 @@ lx_sysent_t lx_sysent32[] = {
 	{"tux",		NULL,			NOSYS_NO_EQUIV,	0}, /* 222 */
 	{"security",	NULL,			NOSYS_NO_EQUIV,	0}, /* 223 */
 	{"gettid",	lx_gettid,		0,		0}, /* 224 */
-	{"readahead",	NULL,			NOSYS_NO_EQUIV,	0}, /* 225 */
+	{"readahead",	lx_readahead_32,	0,		4}, /* 225 */
 	{"setxattr",	lx_setxattr,		0,		5}, /* 226 */
 	{"lsetxattr",	lx_lsetxattr,		0,		5}, /* 227 */
 	{"fsetxattr",	lx_fsetxattr,		0,		5}, /* 228 */
@@ -869,7 +988,7 @@ lx_sysent_t lx_sysent32[] = {
 	{"preadv",	lx_preadv32,		0,		5}, /* 333 */
 	{"pwritev",	lx_pwritev32,		0,		5}, /* 334 */
 	{"rt_tgsigqueueinfo", NULL,		0,		4}, /* 335 */
-	{"perf_event_open", NULL,		NOSYS_NULL,	0}, /* 336 */
+	{"perf_event_open", lx_perf_event_open, 0,	5}, /* 336 */
 	{"recvmmsg",	lx_recvmmsg,		0,		5}, /* 337 */
 	{"fanotify_init", NULL,			NOSYS_NULL,	0}, /* 338 */
 	{"fanotify_mark", NULL,			NOSYS_NULL,	0}, /* 339 */
@@ -892,6 +1011,75 @@ lx_sysent_t lx_sysent32[] = {
 	{"memfd_create", NULL,			NOSYS_NULL,	0}, /* 356 */
 	{"bpf",		NULL,			NOSYS_NULL,	0}, /* 357 */
 	{"execveat",	NULL,			NOSYS_NULL,	0}, /* 358 */
+	{"socket",	NULL,			NOSYS_NULL,	0}, /* 359 */
+	{"socketpair",	NULL,			NOSYS_NULL,	0}, /* 360 */
+	{"bind",	NULL,			NOSYS_NULL,	0}, /* 361 */
+	{"connect",	NULL,			NOSYS_NULL,	0}, /* 362 */
+	{"listen",	NULL,			NOSYS_NULL,	0}, /* 363 */
+	{"accept4",	NULL,			NOSYS_NULL,	0}, /* 364 */
+	{"getsockopt",	NULL,			NOSYS_NULL,	0}, /* 365 */
+	{"setsockopt",	NULL,			NOSYS_NULL,	0}, /* 366 */
+	{"getsockname",	NULL,			NOSYS_NULL,	0}, /* 367 */
+	{"getpeername",	NULL,			NOSYS_NULL,	0}, /* 368 */
+	{"sendto",	NULL,			NOSYS_NULL,	0}, /* 369 */
+	{"sendmsg",	NULL,			NOSYS_NULL,	0}, /* 370 */
+	{"recvfrom",	NULL,			NOSYS_NULL,	0}, /* 371 */
+	{"recvmsg",	NULL,			NOSYS_NULL,	0}, /* 372 */
+	{"shutdown",	NULL,			NOSYS_NULL,	0}, /* 373 */
+	{"userfaultfd",	NULL,			NOSYS_NULL,	0}, /* 374 */
+	{"membarrier",	lx_membarrier,		0,		2}, /* 375 */
+	{"mlock2",	NULL,			NOSYS_NULL,	0}, /* 376 */
+	{"copy_file_range", lx_copy_file_range,	LX_SYS_EBPARG6,	6}, /* 377 */
+	{"preadv2",	NULL,			NOSYS_NULL,	0}, /* 378 */
+	{"pwritev2",	NULL,			NOSYS_NULL,	0}, /* 379 */
+	{"pkey_mprotect", NULL,			NOSYS_NULL,	0}, /* 380 */
+	{"pkey_alloc",	NULL,			NOSYS_NULL,	0}, /* 381 */
+	{"pkey_free",	NULL,			NOSYS_NULL,	0}, /* 382 */
+	{"statx",	NULL,			NOSYS_NULL,	0}, /* 383 */
+	{"arch_prctl",	NULL,			NOSYS_NULL,	0}, /* 384 */
+	{"io_pgetevents", NULL,			NOSYS_NULL,	0}, /* 385 */
+	{"rseq",	NULL,			NOSYS_NULL,	0}, /* 386 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 387 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 388 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 389 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 390 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 391 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 392 */
+	{"semget",	NULL,			NOSYS_NULL,	0}, /* 393 */
+	{"semctl",	NULL,			NOSYS_NULL,	0}, /* 394 */
+	{"shmget",	NULL,			NOSYS_NULL,	0}, /* 395 */
+	{"shmctl",	NULL,			NOSYS_NULL,	0}, /* 396 */
+	{"shmat",	NULL,			NOSYS_NULL,	0}, /* 397 */
+	{"shmdt",	NULL,			NOSYS_NULL,	0}, /* 398 */
+	{"msgget",	NULL,			NOSYS_NULL,	0}, /* 399 */
+	{"msgsnd",	NULL,			NOSYS_NULL,	0}, /* 400 */
+	{"msgrcv",	NULL,			NOSYS_NULL,	0}, /* 401 */
+	{"msgctl",	NULL,			NOSYS_NULL,	0}, /* 402 */
+	{"clock_gettime64", NULL,		NOSYS_NULL,	0}, /* 403 */
+	{"clock_settime64", NULL,		NOSYS_NULL,	0}, /* 404 */
+	{"clock_adjtime64", NULL,		NOSYS_NULL,	0}, /* 405 */
+	{"clock_getres_time64", NULL,		NOSYS_NULL,	0}, /* 406 */
+	{"clock_nanosleep_time64", NULL,	NOSYS_NULL,	0}, /* 407 */
+	{"timer_gettime64", NULL,		NOSYS_NULL,	0}, /* 408 */
+	{"timer_settime64", NULL,		NOSYS_NULL,	0}, /* 409 */
+	{"timerfd_gettime64", NULL,		NOSYS_NULL,	0}, /* 410 */
+	{"timerfd_settime64", NULL,		NOSYS_NULL,	0}, /* 411 */
+	{"utimensat_time64", NULL,		NOSYS_NULL,	0}, /* 412 */
+	{"pselect6_time64", NULL,		NOSYS_NULL,	0}, /* 413 */
+	{"ppoll_time64", NULL,			NOSYS_NULL,	0}, /* 414 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 415 */
+	{"io_pgetevents_time64", NULL,		NOSYS_NULL,	0}, /* 416 */
+	{"recvmmsg_time64", NULL,		NOSYS_NULL,	0}, /* 417 */
+	{"mq_timedsend_time64", NULL,		NOSYS_NULL,	0}, /* 418 */
+	{"mq_timedreceive_time64", NULL,	NOSYS_NULL,	0}, /* 419 */
+	{"semtimedop_time64", NULL,		NOSYS_NULL,	0}, /* 420 */
+	{"rt_sigtimedwait_time64", NULL,	NOSYS_NULL,	0}, /* 421 */
+	{"futex_time64", NULL,			NOSYS_NULL,	0}, /* 422 */
+	{"sched_rr_get_interval_time64", NULL,	NOSYS_NULL,	0}, /* 423 */
+	{"pidfd_send_signal", NULL,		NOSYS_NULL,	0}, /* 424 */
+	{"io_uring_setup", lx_io_uring_setup,	0,		2}, /* 425 */
+	{"io_uring_enter", lx_io_uring_enter,	0,		6}, /* 426 */
+	{"io_uring_register", lx_io_uring_register, 0,		4}, /* 427 */
 };
 
 #if defined(_LP64)
@@ -976,8 +1164,8 @@ lx_sysent_t lx_sysent64[] = {
 	{"flock",	lx_flock,		0,		2}, /* 73 */
 	{"fsync",	NULL,			0,		1}, /* 74 */
 	{"fdatasync",	NULL,			0,		1}, /* 75 */
-	{"truncate",	NULL,			0,		2}, /* 76 */
-	{"ftruncate",	NULL,			0,		2}, /* 77 */
+	{"truncate",	lx_truncate,		0,		2}, /* 76 */
+	{"ftruncate",	lx_ftruncate,		0,		2}, /* 77 */
 	{"getdents",	lx_getdents_64,		0,		3}, /* 78 */
 	{"getcwd",	lx_getcwd,		0,		2}, /* 79 */
 	{"chdir",	lx_chdir,		0,		1}, /* 80 */
@@ -1087,7 +1275,7 @@ lx_sysent_t lx_sysent64[] = {
 	{"tux",		NULL,			NOSYS_NO_EQUIV,	0}, /* 184 */
 	{"security",	NULL,			NOSYS_NO_EQUIV,	0}, /* 185 */
 	{"gettid",	lx_gettid,		0,		0}, /* 186 */
-	{"readahead",	NULL,			NOSYS_NO_EQUIV,	0}, /* 187 */
+	{"readahead",	lx_readahead,		0,		3}, /* 187 */
 	{"setxattr",	lx_setxattr,		0,		5}, /* 188 */
 	{"lsetxattr",	lx_lsetxattr,		0,		5}, /* 189 */
 	{"fsetxattr",	lx_fsetxattr,		0,		5}, /* 190 */
@@ -1198,7 +1386,7 @@ lx_sysent_t lx_sysent64[] = {
 	{"preadv",	lx_preadv,		0,		4}, /* 295 */
 	{"pwritev",	lx_pwritev,		0,		4}, /* 296 */
 	{"rt_tgsigqueueinfo", NULL,		0,		4}, /* 297 */
-	{"perf_event_open", NULL,		NOSYS_NULL,	0}, /* 298 */
+	{"perf_event_open", lx_perf_event_open, 0,	5}, /* 298 */
 	{"recvmmsg",	lx_recvmmsg,		0,		5}, /* 299 */
 	{"fanotify_init", NULL,			NOSYS_NULL,	0}, /* 300 */
 	{"fanotify_mark", NULL,			NOSYS_NULL,	0}, /* 301 */
@@ -1223,6 +1411,111 @@ lx_sysent_t lx_sysent64[] = {
 	{"kexec_file_load", NULL,		NOSYS_NULL,	0}, /* 320 */
 	{"bpf",		NULL,			NOSYS_NULL,	0}, /* 321 */
 	{"execveat",	NULL,			NOSYS_NULL,	0}, /* 322 */
+	{"userfaultfd",	NULL,			NOSYS_NULL,	0}, /* 323 */
+	{"membarrier",	lx_membarrier,		0,		2}, /* 324 */
+	{"mlock2",	NULL,			NOSYS_NULL,	0}, /* 325 */
+	{"copy_file_range", lx_copy_file_range,	0,		6}, /* 326 */
+	{"preadv2",	NULL,			NOSYS_NULL,	0}, /* 327 */
+	{"pwritev2",	NULL,			NOSYS_NULL,	0}, /* 328 */
+	{"pkey_mprotect", NULL,			NOSYS_NULL,	0}, /* 329 */
+	{"pkey_alloc",	NULL,			NOSYS_NULL,	0}, /* 330 */
+	{"pkey_free",	NULL,			NOSYS_NULL,	0}, /* 331 */
+	{"statx",	NULL,			NOSYS_NULL,	0}, /* 332 */
+	{"io_pgetevents", NULL,			NOSYS_NULL,	0}, /* 333 */
+	{"rseq",	NULL,			NOSYS_NULL,	0}, /* 334 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 335 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 336 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 337 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 338 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 339 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 340 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 341 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 342 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 343 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 344 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 345 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 346 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 347 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 348 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 349 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 350 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 351 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 352 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 353 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 354 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 355 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 356 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 357 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 358 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 359 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 360 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 361 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 362 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 363 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 364 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 365 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 366 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 367 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 368 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 369 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 370 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 371 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 372 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 373 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 374 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 375 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 376 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 377 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 378 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 379 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 380 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 381 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 382 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 383 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 384 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 385 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 386 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 387 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 388 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 389 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 390 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 391 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 392 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 393 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 394 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 395 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 396 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 397 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 398 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 399 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 400 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 401 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 402 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 403 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 404 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 405 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 406 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 407 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 408 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 409 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 410 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 411 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 412 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 413 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 414 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 415 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 416 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 417 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 418 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 419 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 420 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 421 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 422 */
+	{"nosys",	NULL,			NOSYS_NONE,	0}, /* 423 */
+	{"pidfd_send_signal", NULL,		NOSYS_NULL,	0}, /* 424 */
+	{"io_uring_setup", lx_io_uring_setup,	0,		2}, /* 425 */
+	{"io_uring_enter", lx_io_uring_enter,	0,		6}, /* 426 */
+	{"io_uring_register", lx_io_uring_register, 0,		4}, /* 427 */
 
 	/* XXX TBD gap then x32 syscalls from 512 - 544 */
 };
@@ -1487,6 +1487,9 @@ lxpr_read_pid_auxv(lxpr_node_t *lxpnp, lxpr_uiobuf_t *uiobuf)
 static void
 lxpr_read_pid_cgroup(lxpr_node_t *lxpnp, lxpr_uiobuf_t *uiobuf)
 {
+	lx_zone_data_t *lxzd = ztolxzd(LXPTOZ(lxpnp));
+	boolean_t unified = B_FALSE;
+	vfs_t *vfsp;
 	proc_t *p;
 
 	ASSERT(lxpnp->lxpr_type == LXPR_PID_CGROUP ||
@@ -1499,8 +1502,21 @@ lxpr_read_pid_cgroup(lxpr_node_t *lxpnp, lxpr_uiobuf_t *uiobuf)
 	}
 	lxpr_unlock(p);
 
+	mutex_enter(&lxzd->lxzd_lock);
+	if ((vfsp = lxzd->lxzd_cgroup) != NULL)
+		VFS_HOLD(vfsp);
+	mutex_exit(&lxzd->lxzd_lock);
+	if (vfsp != NULL) {
+		unified = vfs_optionisset(vfsp, "unified", NULL);
+		VFS_RELE(vfsp);
+	}
+
 	/* basic stub, 3rd field will need to be populated */
-	lxpr_uiobuf_printf(uiobuf, "1:name=systemd:/\n");
+	if (unified) {
+		lxpr_uiobuf_printf(uiobuf, "0::/\n");
+	} else {
+		lxpr_uiobuf_printf(uiobuf, "1:name=systemd:/\n");
+	}
 }
 
 /*
@@ -1824,6 +1840,9 @@ lxpr_read_pid_maps(lxpr_node_t *lxpnp, lxpr_uiobuf_t *uiobuf)
 	} *print_head = NULL;
 	struct print_data **print_tail = &print_head;
 	struct print_data *pbuf;
+	vnode_t *cached_vp = NULL;
+	int cached_maj = 0, cached_min = 0;
+	ino_t cached_inode = 0;
 
 	ASSERT(lxpnp->lxpr_type == LXPR_PID_MAPS ||
 	    lxpnp->lxpr_type == LXPR_PID_TID_MAPS);
@@ -1911,19 +1930,38 @@ lxpr_read_pid_maps(lxpr_node_t *lxpnp, lxpr_uiobuf_t *uiobuf)
 		int maj = 0;
 		int min = 0;
 		ino_t inode = 0;
+		const char *name = "";
 
-		*buf = '\0';
 		if (pbuf->name_override != NULL) {
-			(void) strncpy(buf, pbuf->name_override, buflen);
+			name = pbuf->name_override;
 		} else if (pbuf->vp != NULL) {
-			vattr.va_mask = AT_FSID | AT_NODEID;
-			if (VOP_GETATTR(pbuf->vp, &vattr, 0, CRED(),
-			    NULL) == 0) {
-				maj = getmajor(vattr.va_fsid);
-				min = getminor(vattr.va_fsid);
-				inode = vattr.va_nodeid;
+			/*
+			 * A mapped object usually spans a run of adjacent
+			 * segments (text, data, relro, ...), so only resolve
+			 * its attributes and path when the vnode changes.
+			 * Every vnode in the list is held until its own entry
+			 * is printed, so a stale cached_vp cannot be confused
+			 * with a later one.
+			 */
+			if (pbuf->vp != cached_vp) {
+				cached_maj = cached_min = 0;
+				cached_inode = 0;
+				vattr.va_mask = AT_FSID | AT_NODEID;
+				if (VOP_GETATTR(pbuf->vp, &vattr, 0, CRED(),
+				    NULL) == 0) {
+					cached_maj = getmajor(vattr.va_fsid);
+					cached_min = getminor(vattr.va_fsid);
+					cached_inode = vattr.va_nodeid;
+				}
+				*buf = '\0';
+				(void) vnodetopath(NULL, pbuf->vp, buf, buflen,
+				    CRED());
+				cached_vp = pbuf->vp;
 			}
-			(void) vnodetopath(NULL, pbuf->vp, buf, buflen, CRED());
+			maj = cached_maj;
+			min = cached_min;
+			inode = cached_inode;
+			name = buf;
 			VN_RELE(pbuf->vp);
 		}
 
@@ -1931,13 +1969,13 @@ lxpr_read_pid_maps(lxpr_node_t *lxpnp, lxpr_uiobuf_t *uiobuf)
 			lxpr_uiobuf_printf(uiobuf,
 			    "%08llx-%08llx %s %08llx %02x:%02x %llu%s%s\n",
 			    pbuf->saddr, pbuf->eaddr, pbuf->prot, pbuf->offset,
-			    maj, min, inode, *buf != '\0' ? " " : "", buf);
+			    maj, min, inode, *name != '\0' ? " " : "", name);
 		} else {
 			lxpr_uiobuf_printf(uiobuf,
 			    "%08x-%08x %s %08x %02x:%02x %llu%s%s\n",
 			    (uint32_t)pbuf->saddr, (uint32_t)pbuf->eaddr,
 			    pbuf->prot, (uint32_t)pbuf->offset, maj, min,
-			    inode, *buf != '\0' ? " " : "", buf);
+			    inode, *name != '\0' ? " " : "", name);
 		}
 
 		pbuf_next = pbuf->next;
@@ -6132,6 +6170,7 @@ lxpr_read_filesystems(lxpr_node_t *lxpnp, lxpr_uiobuf_t *uiobuf)
 {
 	lxpr_uiobuf_printf(uiobuf, "%s\t%s\n", "nodev", "autofs");
 	lxpr_uiobuf_printf(uiobuf, "%s\t%s\n", "nodev", "cgroup");
+	lxpr_uiobuf_printf(uiobuf, "%s\t%s\n", "nodev", "cgroup2");
 	lxpr_uiobuf_printf(uiobuf, "%s\t%s\n", "nodev", "nfs");
 	lxpr_uiobuf_printf(uiobuf, "%s\t%s\n", "nodev", "proc");
 	lxpr_uiobuf_printf(uiobuf, "%s\t%s\n", "nodev", "sysfs");
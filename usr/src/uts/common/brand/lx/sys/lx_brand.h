@@ -78,7 +78,7 @@ extern "C" {
 /*
  * This must be large enough for both the 32-bit table and 64-bit table.
  */
-#define	LX_NSYSCALLS		358
+#define	LX_NSYSCALLS		427
 
 /* Highest capability we know about */
 #define	LX_CAP_MAX_VALID	36
@@ -264,7 +264,8 @@ typedef enum lx_proc_flags {
 	LX_PROC_STRICT_MODE	= 0x02,
 	/* internal flags */
 	LX_PROC_CHILD_DEATHSIG	= 0x04,
-	LX_PROC_NO_DUMP		= 0x08	/* for lx_prctl LX_PR_[GS]ET_DUMPABLE */
+	LX_PROC_NO_DUMP		= 0x08,	/* for lx_prctl LX_PR_[GS]ET_DUMPABLE */
+	LX_PROC_MEMBARRIER_PRIV	= 0x10	/* registered for membarrier(2) */
 } lx_proc_flags_t;
 
 #define	LX_PROC_ALL	(LX_PROC_INSTALL_MODE | LX_PROC_STRICT_MODE)
@@ -344,6 +345,7 @@ typedef struct lx_proc_data {
 	kcondvar_t l_io_destroy_cv;
 	uint_t l_io_ctx_cnt;
 	struct lx_io_ctx  **l_io_ctxs;
+	struct lx_uring *l_io_rings;
 
 	/* Override zone-wide settings for uname release and version */
 	char l_uname_release[LX_KERN_RELEASE_MAX];
@@ -764,6 +766,9 @@ extern int lx_nsysent64;
 extern lx_sysent_t lx_sysent32[LX_NSYSCALLS + 1];
 extern int lx_nsysent32;
 
+extern void lx_syscall_kstat_init(void);
+extern void lx_syscall_kstat_fini(void);
+
 #endif	/* _KERNEL */
 #endif /* _ASM */
 
@@ -10,7 +10,7 @@
  */
 
 /*
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef _SYS__LX_MISC_H
@@ -122,6 +122,19 @@ extern void lx_vsyscall_enter(proc_t *, klwp_t *, int);
 extern void lx_check_strict_failure(lx_lwp_data_t *);
 
 extern boolean_t lx_is_eventfd(file_t *);
+extern void lx_uring_close(int);
+extern void *lx_uring_mmap(int, size_t, int, off64_t);
+extern void lx_uring_munmap(uintptr_t, size_t);
+
+/* perf_event_open(2) descriptor ioctls */
+#define	LX_PERF_EVENT_IOC_ENABLE	0x2400
+#define	LX_PERF_EVENT_IOC_DISABLE	0x2401
+#define	LX_PERF_EVENT_IOC_RESET		0x2403
+#define	LX_PERF_EVENT_IOC_ID		0x80082407
+
+extern int lx_perf_ioctl(file_t *, int, intptr_t, int);
+extern void lx_perf_init(void);
+extern void lx_perf_fini(void);
 
 extern int lx_read_common(file_t *, uio_t *, size_t *, boolean_t);
 extern int lx_write_common(file_t *, uio_t *, size_t *, boolean_t);
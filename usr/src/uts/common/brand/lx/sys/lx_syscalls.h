@@ -22,7 +22,7 @@
 /*
  * Copyright 2006 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
- * Copyright 2018 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright 2019 OmniOS Community Edition (OmniOSce) Association.
  */
 
@@ -53,6 +53,7 @@ extern long lx_clock_gettime();
 extern long lx_clock_settime();
 extern long lx_close();
 extern long lx_connect();
+extern long lx_copy_file_range();
 extern long lx_creat();
 extern long lx_dup();
 extern long lx_dup2();
@@ -86,6 +87,9 @@ extern long lx_fsetxattr();
 extern long lx_fstat32();
 extern long lx_fstat64();
 extern long lx_fstatat64();
+extern long lx_ftruncate();
+extern long lx_ftruncate32();
+extern long lx_ftruncate64();
 extern long lx_futex();
 extern long lx_get_robust_list();
 extern long lx_get_thread_area();
@@ -127,6 +131,9 @@ extern long lx_io_destroy();
 extern long lx_io_getevents();
 extern long lx_io_setup();
 extern long lx_io_submit();
+extern long lx_io_uring_enter();
+extern long lx_io_uring_register();
+extern long lx_io_uring_setup();
 extern long lx_ioctl();
 extern long lx_ioprio_get();
 extern long lx_ioprio_set();
@@ -147,6 +154,7 @@ extern long lx_lstat32();
 extern long lx_lstat64();
 extern long lx_listxattr();
 extern long lx_madvise();
+extern long lx_membarrier();
 extern long lx_mincore();
 extern long lx_mkdir();
 extern long lx_mkdirat();
@@ -168,6 +176,7 @@ extern long lx_oldgetrlimit();
 extern long lx_open();
 extern long lx_openat();
 extern long lx_pause();
+extern long lx_perf_event_open();
 extern long lx_personality();
 extern long lx_pipe();
 extern long lx_pipe2();
@@ -186,6 +195,8 @@ extern long lx_pwrite32();
 extern long lx_pwritev();
 extern long lx_pwritev32();
 extern long lx_read();
+extern long lx_readahead();
+extern long lx_readahead_32();
 extern long lx_readlink();
 extern long lx_readlinkat();
 extern long lx_readv();
@@ -264,6 +275,9 @@ extern long lx_time();
 extern long lx_times();
 extern long lx_timer_create();
 extern long lx_tkill();
+extern long lx_truncate();
+extern long lx_truncate32();
+extern long lx_truncate64();
 extern long lx_umask();
 extern long lx_umount();
 extern long lx_umount2();
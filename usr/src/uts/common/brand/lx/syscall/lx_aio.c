@@ -114,10 +114,13 @@
 #include <sys/sdt.h>
 #include <sys/procfs.h>
 #include <sys/eventfd.h>
+#include <sys/poll.h>
+#include <vm/as.h>
 
 #include <sys/lx_brand.h>
 #include <sys/lx_syscalls.h>
 #include <sys/lx_misc.h>
+#include <sys/lx_socket.h>
 #include <lx_errno.h>
 
 /* These constants match Linux */
@@ -161,6 +164,8 @@ typedef ulong_t lx_aio_context_t;
 uint_t	lx_aio_base_workers = 16;	/* num threads/context before scaling */
 uint_t	lx_aio_max_workers = 32;	/* upper limit on threads/context */
 
+struct lx_uring;
+
 /*
  * Internal representation of an aio context.
  */
@@ -178,6 +183,8 @@ typedef struct lx_io_ctx {
 	kcondvar_t	lxioctx_done_cv;	/* done list cv */
 	uint_t		lxioctx_done_cnt;	/* num. elements in done list */
 	list_t		lxioctx_done;		/* done list */
+	list_t		lxioctx_running;	/* ring ops being worked on */
+	struct lx_uring	*lxioctx_ring;		/* io_uring, if any */
 } lx_io_ctx_t;
 
 /*
@@ -222,6 +229,8 @@ typedef struct lx_io_elem {
 	uint64_t	lxioelem_data;
 	ssize_t		lxioelem_res;
 	void		*lxioelem_cbp;		/* ptr to iocb in userspace */
+	uint32_t	lxioelem_rwflags;	/* io_uring op flags */
+	volatile uint_t	lxioelem_cancel;	/* io_uring cancel requested */
 } lx_io_elem_t;
 
 /* From lx_rw.c */
@@ -233,6 +242,11 @@ extern int fdsync(int, int);
 /* From common/os/grow.c */
 extern caddr_t smmap64(caddr_t, size_t, int, int, int, off_t);
 
+static void lx_uring_unlink(lx_proc_data_t *, struct lx_uring *);
+static void lx_uring_free(struct lx_uring *);
+static void lx_uring_do_op(lx_io_ctx_t *, lx_io_elem_t *);
+static void lx_uring_complete(lx_io_ctx_t *, lx_io_elem_t *);
+
 /*
  * Given an aio_context ID, return our internal context pointer with an
  * additional ref. count, or NULL if cp not found.
@@ -262,6 +276,10 @@ lx_io_cp_hold(lx_aio_context_t cid)
 	if (cp->lxioctx_shutdown)
 		goto bad;
 
+	/* io_uring contexts are only reachable through their ring fd */
+	if (cp->lxioctx_ring != NULL)
+		goto bad;
+
 	atomic_inc_32(&cp->lxioctx_in_use);
 	mutex_exit(&lxpd->l_io_ctx_lock);
 	return (cp);
@@ -303,6 +321,8 @@ lx_io_cp_rele(lx_io_ctx_t *cp)
 		}
 	}
 	ASSERT(i < lxpd->l_io_ctx_cnt);
+	if (cp->lxioctx_ring != NULL)
+		lx_uring_unlink(lxpd, cp->lxioctx_ring);
 	/* wake all threads waiting on context destruction */
 	cv_broadcast(&lxpd->l_io_destroy_cv);
 	ASSERT(cp->lxioctx_shutdown == B_TRUE);
@@ -358,6 +378,11 @@ lx_io_cp_rele(lx_io_ctx_t *cp)
 	list_destroy(&cp->lxioctx_pending);
 	ASSERT(list_is_empty(&cp->lxioctx_done));
 	list_destroy(&cp->lxioctx_done);
+	ASSERT(list_is_empty(&cp->lxioctx_running));
+	list_destroy(&cp->lxioctx_running);
+
+	if (cp->lxioctx_ring != NULL)
+		lx_uring_free(cp->lxioctx_ring);
 
 	kmem_free(cp, sizeof (lx_io_ctx_t));
 }
@@ -549,18 +574,26 @@ lx_io_worker(void *a)
 		}
 
 		ep = list_remove_head(&cp->lxioctx_pending);
+		if (ep != NULL && cp->lxioctx_ring != NULL)
+			list_insert_tail(&cp->lxioctx_running, ep);
 		mutex_exit(&cp->lxioctx_p_lock);
 
 		while (ep != NULL) {
-			lx_io_do_op(ep);
-
-			lx_io_finish_op(cp, ep, B_TRUE);
+			if (cp->lxioctx_ring != NULL) {
+				lx_uring_do_op(cp, ep);
+				lx_uring_complete(cp, ep);
+			} else {
+				lx_io_do_op(ep);
+				lx_io_finish_op(cp, ep, B_TRUE);
+			}
 
 			if (lx_io_worker_chk_status(cp, B_FALSE))
 				break;
 
 			mutex_enter(&cp->lxioctx_p_lock);
 			ep = list_remove_head(&cp->lxioctx_pending);
+			if (ep != NULL && cp->lxioctx_ring != NULL)
+				list_insert_tail(&cp->lxioctx_running, ep);
 			mutex_exit(&cp->lxioctx_p_lock);
 		}
 	}
@@ -573,10 +606,14 @@ lx_io_worker(void *a)
 }
 
 /*
- * LTP passes -1 for nr_events but we're limited by LX_AIO_MAX_NR anyway.
+ * Create a context with room for nr_events operations, along with its worker
+ * threads, and return its ID.  This backs both io_setup and io_uring_setup;
+ * for the latter, ring is the io_uring the context serves.  The caller keeps
+ * ownership of the ring if this fails.
  */
-long
-lx_io_setup(uint_t nr_events, void *ctxp)
+static int
+lx_io_ctx_create(uint_t nr_events, struct lx_uring *ring,
+    lx_aio_context_t *cidp)
 {
 	int i, slot;
 	proc_t *p = curproc;
@@ -588,26 +625,13 @@ lx_io_setup(uint_t nr_events, void *ctxp)
 	uint_t nworkers;
 	k_sigset_t hold_set;
 
-#ifdef _SYSCALL32_IMPL
-	if (get_udatamodel() != DATAMODEL_NATIVE) {
-		uintptr32_t cid32;
-
-		if (copyin(ctxp, &cid32, sizeof (cid32)) != 0)
-			return (set_errno(EFAULT));
-		cid = (uintptr_t)cid32;
-	} else
-#endif
-	if (copyin(ctxp, &cid, sizeof (cid)) != 0)
-		return (set_errno(EFAULT));
-
-	/* The cid in user-land must be NULL to start */
-	if (cid != (uintptr_t)NULL || nr_events > LX_AIO_MAX_NR)
-		return (set_errno(EINVAL));
+	if (nr_events > LX_AIO_MAX_NR)
+		return (EINVAL);
 
 	mutex_enter(&lxzd->lxzd_lock);
 	if ((nr_events + lxzd->lxzd_aio_nr) > LX_AIO_MAX_NR) {
 		mutex_exit(&lxzd->lxzd_lock);
-		return (set_errno(EAGAIN));
+		return (EAGAIN);
 	}
 	lxzd->lxzd_aio_nr += nr_events;
 	mutex_exit(&lxzd->lxzd_lock);
@@ -629,7 +653,11 @@ lx_io_setup(uint_t nr_events, void *ctxp)
 		    MAP_SHARED | MAP_ANON, -1, 0);
 		if (ttolwp(curthread)->lwp_errno != 0) {
 			mutex_exit(&lxpd->l_io_ctx_lock);
-			return (set_errno(ENOMEM));
+			ttolwp(curthread)->lwp_errno = 0;
+			mutex_enter(&lxzd->lxzd_lock);
+			lxzd->lxzd_aio_nr -= nr_events;
+			mutex_exit(&lxzd->lxzd_lock);
+			return (ENOMEM);
 		}
 
 		lxpd->l_io_ctxpage = ctxpage;
@@ -658,7 +686,7 @@ lx_io_setup(uint_t nr_events, void *ctxp)
 				mutex_enter(&lxzd->lxzd_lock);
 				lxzd->lxzd_aio_nr -= nr_events;
 				mutex_exit(&lxzd->lxzd_lock);
-				return (set_errno(ENOMEM));
+				return (ENOMEM);
 			}
 
 			/* See big theory comment explaining context ID. */
@@ -680,6 +708,8 @@ lx_io_setup(uint_t nr_events, void *ctxp)
 	    offsetof(lx_io_elem_t, lxioelem_link));
 	list_create(&cp->lxioctx_done, sizeof (lx_io_elem_t),
 	    offsetof(lx_io_elem_t, lxioelem_link));
+	list_create(&cp->lxioctx_running, sizeof (lx_io_elem_t),
+	    offsetof(lx_io_elem_t, lxioelem_link));
 	mutex_init(&cp->lxioctx_f_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&cp->lxioctx_p_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&cp->lxioctx_d_lock, NULL, MUTEX_DEFAULT, NULL);
@@ -688,6 +718,7 @@ lx_io_setup(uint_t nr_events, void *ctxp)
 
 	/* Add a hold on this context until we're done setting up */
 	cp->lxioctx_in_use = 1;
+	cp->lxioctx_ring = ring;
 	lxpd->l_io_ctxs[slot] = cp;
 
 	cid = CTXID_TO_PTR(lxpd, slot);
@@ -751,9 +782,10 @@ lx_io_setup(uint_t nr_events, void *ctxp)
 				cp->lxioctx_shutdown = B_TRUE;
 				mutex_enter(&lxpd->l_io_ctx_lock);
 				cp->lxioctx_maxn = nr_events;
+				cp->lxioctx_ring = NULL;
 				mutex_exit(&lxpd->l_io_ctx_lock);
 				lx_io_cp_rele(cp);
-				return (set_errno(ENOMEM));
+				return (ENOMEM);
 			} else {
 				/*
 				 * No new lwp but we already have at least 1
@@ -787,6 +819,38 @@ lx_io_setup(uint_t nr_events, void *ctxp)
 	/* Release our hold, worker thread refs keep ctx alive. */
 	lx_io_cp_rele(cp);
 
+	*cidp = cid;
+	return (0);
+}
+
+/*
+ * LTP passes -1 for nr_events but we're limited by LX_AIO_MAX_NR anyway.
+ */
+long
+lx_io_setup(uint_t nr_events, void *ctxp)
+{
+	lx_aio_context_t cid;
+	int err;
+
+#ifdef _SYSCALL32_IMPL
+	if (get_udatamodel() != DATAMODEL_NATIVE) {
+		uintptr32_t cid32;
+
+		if (copyin(ctxp, &cid32, sizeof (cid32)) != 0)
+			return (set_errno(EFAULT));
+		cid = (uintptr_t)cid32;
+	} else
+#endif
+	if (copyin(ctxp, &cid, sizeof (cid)) != 0)
+		return (set_errno(EFAULT));
+
+	/* The cid in user-land must be NULL to start */
+	if (cid != (uintptr_t)NULL)
+		return (set_errno(EINVAL));
+
+	if ((err = lx_io_ctx_create(nr_events, NULL, &cid)) != 0)
+		return (set_errno(err));
+
 #ifdef _SYSCALL32_IMPL
 	if (get_udatamodel() != DATAMODEL_NATIVE) {
 		uintptr32_t cid32 = (uintptr32_t)cid;
@@ -1309,6 +1373,7 @@ lx_io_clear(lx_proc_data_t *cpd)
 	cpd->l_io_ctxs = NULL;
 	cpd->l_io_ctx_cnt = 0;
 	cpd->l_io_ctxpage = (uintptr_t)NULL;
+	cpd->l_io_rings = NULL;
 }
 
 /*
@@ -1327,6 +1392,7 @@ lx_io_cleanup(proc_t *p)
 	mutex_exit(&p->p_lock);
 
 	mutex_enter(&lxpd->l_io_ctx_lock);
+	ASSERT(lxpd->l_io_rings == NULL);
 	if (lxpd->l_io_ctxs == NULL) {
 		ASSERT(lxpd->l_io_ctx_cnt == 0);
 		mutex_exit(&lxpd->l_io_ctx_lock);
@@ -1343,3 +1409,1329 @@ lx_io_cleanup(proc_t *p)
 	lxpd->l_io_ctx_cnt = 0;
 	mutex_exit(&lxpd->l_io_ctx_lock);
 }
+
+/*
+ * Linux io_uring support.
+ *
+ * io_uring replaces the one-syscall-per-operation model of io_submit with a
+ * pair of rings shared between the kernel and the application.  The
+ * application fills in submission queue entries (SQEs) and advances the SQ
+ * tail; a single io_uring_enter call then hands the kernel any number of
+ * them and optionally waits for completions.  The kernel posts completion
+ * queue entries (CQEs) and advances the CQ tail, and the application reaps
+ * them without a syscall at all.
+ *
+ * We build this on the aio engine above.  io_uring_setup creates an aio
+ * context with one lx_io_elem_t for every CQ slot, which also bounds the
+ * number of operations in flight, so the CQ can never overflow.  Submitted
+ * operations go onto the context's pending list and are executed by the
+ * context's worker LWPs, which post the CQE directly into the ring instead
+ * of queueing the element for io_getevents.  Worker LWPs run in the process
+ * so they can copy in and out of the ring like any other user memory.
+ * An operation being executed sits on the context's running list so that
+ * IORING_OP_ASYNC_CANCEL and IORING_OP_POLL_REMOVE can find it.
+ *
+ * Linux hands the rings out by mmap(2)ing the io_uring fd at well-known
+ * offsets.  We have no driver behind the fd, so instead setup maps the rings
+ * as shared anonymous memory, and lx_mmap notices the io_uring fd and
+ * returns those mappings.  The fd itself is an eventfd, which gives us a
+ * unique vnode to identify the ring by and ordinary close and poll behavior;
+ * the ring is torn down when the last reference to the fd is closed with
+ * close(2) or when the process exits.  Since the kernel writes CQEs into
+ * user memory, a ring is also marked dead once the application unmaps it.
+ *
+ * Socket and poll operations must not tie up a worker while the caller
+ * closes the fd or cancels the request, so they are attempted non-blocking
+ * and the worker re-polls the file every lx_uring_poll_ticks until it's
+ * ready, the request is cancelled, the fd is closed or the ring goes away.
+ *
+ * Only the parts of the interface that fit this model are supported: no
+ * SQ polling thread, no IOPOLL, no linked or drained SQEs, and registered
+ * buffers are accepted but only counted.  Unsupported opcodes complete with
+ * -EINVAL, as they do on older Linux kernels, and IORING_REGISTER_PROBE
+ * reports which ones we do support.
+ */
+
+/* These constants and structures match Linux */
+#define	LX_IORING_SETUP_IOPOLL		0x01
+#define	LX_IORING_SETUP_SQPOLL		0x02
+#define	LX_IORING_SETUP_SQ_AFF		0x04
+#define	LX_IORING_SETUP_CQSIZE		0x08
+#define	LX_IORING_SETUP_CLAMP		0x10
+
+#define	LX_IORING_FEAT_SINGLE_MMAP	0x01
+#define	LX_IORING_FEAT_SUBMIT_STABLE	0x04
+
+#define	LX_IORING_ENTER_GETEVENTS	0x01
+#define	LX_IORING_ENTER_SQ_WAKEUP	0x02
+
+#define	LX_IORING_OFF_SQ_RING		0ULL
+#define	LX_IORING_OFF_CQ_RING		0x8000000ULL
+#define	LX_IORING_OFF_SQES		0x10000000ULL
+
+#define	LX_IOSQE_FIXED_FILE		0x01
+#define	LX_IOSQE_IO_DRAIN		0x02
+#define	LX_IOSQE_IO_LINK		0x04
+#define	LX_IOSQE_IO_HARDLINK		0x08
+#define	LX_IOSQE_ASYNC			0x10
+
+#define	LX_IORING_FSYNC_DATASYNC	0x01
+
+#define	LX_IORING_OP_NOP		0
+#define	LX_IORING_OP_READV		1
+#define	LX_IORING_OP_WRITEV		2
+#define	LX_IORING_OP_FSYNC		3
+#define	LX_IORING_OP_READ_FIXED		4
+#define	LX_IORING_OP_WRITE_FIXED	5
+#define	LX_IORING_OP_POLL_ADD		6
+#define	LX_IORING_OP_POLL_REMOVE	7
+#define	LX_IORING_OP_SENDMSG		9
+#define	LX_IORING_OP_RECVMSG		10
+#define	LX_IORING_OP_ASYNC_CANCEL	14
+#define	LX_IORING_OP_READ		22
+#define	LX_IORING_OP_WRITE		23
+#define	LX_IORING_OP_SEND		26
+#define	LX_IORING_OP_RECV		27
+#define	LX_IORING_OP_LAST		28
+
+#define	LX_IORING_REGISTER_BUFFERS	0
+#define	LX_IORING_UNREGISTER_BUFFERS	1
+#define	LX_IORING_REGISTER_FILES	2
+#define	LX_IORING_UNREGISTER_FILES	3
+#define	LX_IORING_REGISTER_EVENTFD	4
+#define	LX_IORING_UNREGISTER_EVENTFD	5
+#define	LX_IORING_REGISTER_EVENTFD_ASYNC 7
+#define	LX_IORING_REGISTER_PROBE	8
+
+#define	LX_IO_URING_OP_SUPPORTED	0x01
+
+/* Limits; Linux allows up to 32768 entries. */
+#define	LX_URING_MAX_ENTRIES		4096
+#define	LX_URING_MAX_FILES		32768
+#define	LX_URING_MAX_BUFS		1024
+
+typedef struct lx_io_uring_sqe {
+	uint8_t		lxsqe_opcode;
+	uint8_t		lxsqe_flags;
+	uint16_t	lxsqe_ioprio;
+	int32_t		lxsqe_fd;
+	uint64_t	lxsqe_off;
+	uint64_t	lxsqe_addr;
+	uint32_t	lxsqe_len;
+	uint32_t	lxsqe_op_flags;		/* rw, fsync, poll, msg flags */
+	uint64_t	lxsqe_user_data;
+	uint16_t	lxsqe_buf_index;
+	uint16_t	lxsqe_personality;
+	int32_t		lxsqe_splice_fd_in;
+	uint64_t	lxsqe_pad[2];
+} lx_io_uring_sqe_t;
+
+typedef struct lx_io_uring_cqe {
+	uint64_t	lxcqe_user_data;
+	int32_t		lxcqe_res;
+	uint32_t	lxcqe_flags;
+} lx_io_uring_cqe_t;
+
+typedef struct lx_io_sqring_offsets {
+	uint32_t	lxsqo_head;
+	uint32_t	lxsqo_tail;
+	uint32_t	lxsqo_ring_mask;
+	uint32_t	lxsqo_ring_entries;
+	uint32_t	lxsqo_flags;
+	uint32_t	lxsqo_dropped;
+	uint32_t	lxsqo_array;
+	uint32_t	lxsqo_resv1;
+	uint64_t	lxsqo_resv2;
+} lx_io_sqring_offsets_t;
+
+typedef struct lx_io_cqring_offsets {
+	uint32_t	lxcqo_head;
+	uint32_t	lxcqo_tail;
+	uint32_t	lxcqo_ring_mask;
+	uint32_t	lxcqo_ring_entries;
+	uint32_t	lxcqo_overflow;
+	uint32_t	lxcqo_cqes;
+	uint32_t	lxcqo_flags;
+	uint32_t	lxcqo_resv1;
+	uint64_t	lxcqo_resv2;
+} lx_io_cqring_offsets_t;
+
+typedef struct lx_io_uring_params {
+	uint32_t	lxurp_sq_entries;
+	uint32_t	lxurp_cq_entries;
+	uint32_t	lxurp_flags;
+	uint32_t	lxurp_sq_thread_cpu;
+	uint32_t	lxurp_sq_thread_idle;
+	uint32_t	lxurp_features;
+	uint32_t	lxurp_wq_fd;
+	uint32_t	lxurp_resv[3];
+	lx_io_sqring_offsets_t lxurp_sq_off;
+	lx_io_cqring_offsets_t lxurp_cq_off;
+} lx_io_uring_params_t;
+
+typedef struct lx_io_uring_probe_op {
+	uint8_t		lxpo_op;
+	uint8_t		lxpo_resv;
+	uint16_t	lxpo_flags;
+	uint32_t	lxpo_resv2;
+} lx_io_uring_probe_op_t;
+
+typedef struct lx_io_uring_probe {
+	uint8_t		lxpr_last_op;
+	uint8_t		lxpr_ops_len;
+	uint16_t	lxpr_resv;
+	uint32_t	lxpr_resv2[3];
+} lx_io_uring_probe_t;
+
+/*
+ * Layout of the start of the shared ring mapping.  The CQE array follows
+ * directly at LX_URING_CQES, then the SQ index array.
+ */
+typedef struct lx_uring_hdr {
+	uint32_t	lxurh_sq_head;
+	uint32_t	lxurh_sq_tail;
+	uint32_t	lxurh_sq_mask;
+	uint32_t	lxurh_sq_entries;
+	uint32_t	lxurh_sq_flags;
+	uint32_t	lxurh_sq_dropped;
+	uint32_t	lxurh_cq_head;
+	uint32_t	lxurh_cq_tail;
+	uint32_t	lxurh_cq_mask;
+	uint32_t	lxurh_cq_entries;
+	uint32_t	lxurh_cq_overflow;
+	uint32_t	lxurh_cq_flags;
+} lx_uring_hdr_t;
+
+#define	LX_URING_CQES		64
+#define	LX_URING_HDR(rp, f)	\
+	((void *)((rp)->lxur_ring + offsetof(lx_uring_hdr_t, f)))
+
+/* Internal elem ops for io_uring, kept clear of the LX_IOCB_CMD_* space */
+#define	LX_URING_ELEM_OP(op)	((op) + 0x100)
+
+typedef struct lx_uring {
+	struct lx_uring	*lxur_next;		/* on l_io_rings */
+	lx_io_ctx_t	*lxur_cp;		/* our aio context */
+	vnode_t		*lxur_vp;		/* vnode behind the ring fd */
+	uintptr_t	lxur_ring;		/* SQ/CQ ring mapping */
+	size_t		lxur_ring_sz;
+	uintptr_t	lxur_sqes;		/* SQE array mapping */
+	size_t		lxur_sqes_sz;
+	uint32_t	lxur_sq_entries;
+	uint32_t	lxur_cq_entries;
+	kmutex_t	lxur_sq_lock;		/* serializes submitters */
+	uint32_t	lxur_sq_head;		/* under lxur_sq_lock */
+	uint32_t	lxur_sq_dropped;	/* under lxur_sq_lock */
+	int		*lxur_files;		/* under lxur_sq_lock */
+	uint_t		lxur_nfiles;
+	uint_t		lxur_nbufs;
+	volatile uint_t	lxur_inflight;		/* ops not yet posted */
+	uint32_t	lxur_cq_tail;		/* under lxioctx_d_lock */
+	uint32_t	lxur_overflow;		/* under lxioctx_d_lock */
+	boolean_t	lxur_dead;		/* under lxioctx_d_lock */
+	vnode_t		*lxur_evfd_vp;		/* under lxioctx_d_lock */
+	cred_t		*lxur_evfd_cr;
+} lx_uring_t;
+
+clock_t	lx_uring_poll_ticks = 1;	/* re-poll interval for waiting ops */
+
+/*
+ * Remove a ring from the process's list; called with l_io_ctx_lock held
+ * when its context is going away.
+ */
+static void
+lx_uring_unlink(lx_proc_data_t *lxpd, lx_uring_t *rp)
+{
+	lx_uring_t **rpp;
+
+	ASSERT(MUTEX_HELD(&lxpd->l_io_ctx_lock));
+	for (rpp = &lxpd->l_io_rings; *rpp != NULL;
+	    rpp = &(*rpp)->lxur_next) {
+		if (*rpp == rp) {
+			*rpp = rp->lxur_next;
+			break;
+		}
+	}
+}
+
+static void
+lx_uring_free(lx_uring_t *rp)
+{
+	if (rp->lxur_evfd_vp != NULL) {
+		VN_RELE(rp->lxur_evfd_vp);
+		crfree(rp->lxur_evfd_cr);
+	}
+	if (rp->lxur_files != NULL)
+		kmem_free(rp->lxur_files, rp->lxur_nfiles * sizeof (int));
+	VN_RELE(rp->lxur_vp);
+	mutex_destroy(&rp->lxur_sq_lock);
+	kmem_free(rp, sizeof (lx_uring_t));
+}
+
+/*
+ * Find the ring behind an fd and return its context with a hold.  The error
+ * for a non-ring fd matches Linux.
+ */
+static lx_io_ctx_t *
+lx_uring_hold(int fd, int *errp)
+{
+	lx_proc_data_t *lxpd = ptolxproc(curproc);
+	lx_io_ctx_t *cp = NULL;
+	lx_uring_t *rp;
+	file_t *fp;
+
+	if ((fp = getf(fd)) == NULL) {
+		*errp = EBADF;
+		return (NULL);
+	}
+
+	mutex_enter(&lxpd->l_io_ctx_lock);
+	for (rp = lxpd->l_io_rings; rp != NULL; rp = rp->lxur_next) {
+		if (rp->lxur_vp == fp->f_vnode)
+			break;
+	}
+	if (rp != NULL && !rp->lxur_cp->lxioctx_shutdown) {
+		cp = rp->lxur_cp;
+		atomic_inc_32(&cp->lxioctx_in_use);
+	}
+	mutex_exit(&lxpd->l_io_ctx_lock);
+	releasef(fd);
+
+	if (cp == NULL)
+		*errp = EOPNOTSUPP;
+	return (cp);
+}
+
+/*
+ * Post a completion to the CQ.  Callers have reserved the slot by holding
+ * an element, or by accounting for an inline completion at submit time, so
+ * the ring can only be full if the application moved the CQ head itself.
+ */
+static void
+lx_uring_post(lx_io_ctx_t *cp, uint64_t user_data, int32_t res)
+{
+	lx_uring_t *rp = cp->lxioctx_ring;
+	lx_io_uring_cqe_t cqe;
+	uint32_t head, idx;
+	vnode_t *evfd_vp = NULL;
+	cred_t *evfd_cr = NULL;
+
+	cqe.lxcqe_user_data = user_data;
+	cqe.lxcqe_res = res;
+	cqe.lxcqe_flags = 0;
+
+	mutex_enter(&cp->lxioctx_d_lock);
+	if (rp->lxur_dead ||
+	    copyin(LX_URING_HDR(rp, lxurh_cq_head), &head, sizeof (head)) != 0)
+		goto out;
+
+	if (rp->lxur_cq_tail - head >= rp->lxur_cq_entries) {
+		rp->lxur_overflow++;
+		(void) copyout(&rp->lxur_overflow,
+		    LX_URING_HDR(rp, lxurh_cq_overflow), sizeof (uint32_t));
+		goto out;
+	}
+
+	idx = rp->lxur_cq_tail & (rp->lxur_cq_entries - 1);
+	if (copyout(&cqe, (void *)(rp->lxur_ring + LX_URING_CQES +
+	    idx * sizeof (cqe)), sizeof (cqe)) != 0)
+		goto out;
+
+	/* The CQE must be visible before the tail that covers it. */
+	membar_producer();
+	rp->lxur_cq_tail++;
+	(void) copyout(&rp->lxur_cq_tail, LX_URING_HDR(rp, lxurh_cq_tail),
+	    sizeof (uint32_t));
+
+	if ((evfd_vp = rp->lxur_evfd_vp) != NULL) {
+		VN_HOLD(evfd_vp);
+		evfd_cr = rp->lxur_evfd_cr;
+		crhold(evfd_cr);
+	}
+out:
+	cv_broadcast(&cp->lxioctx_done_cv);
+	mutex_exit(&cp->lxioctx_d_lock);
+
+	if (evfd_vp != NULL) {
+		uint64_t val = 1;
+
+		/* As for LX_IOCB_FLAG_RESFD, this must not block. */
+		(void) VOP_IOCTL(evfd_vp, EVENTFDIOC_POST, (intptr_t)&val,
+		    FKIOCTL, evfd_cr, NULL, NULL);
+		VN_RELE(evfd_vp);
+		crfree(evfd_cr);
+	}
+}
+
+/*
+ * Called by a worker once a ring operation is done: post its completion and
+ * return the element to the free list.
+ */
+static void
+lx_uring_complete(lx_io_ctx_t *cp, lx_io_elem_t *ep)
+{
+	lx_uring_t *rp = cp->lxioctx_ring;
+
+	mutex_enter(&cp->lxioctx_p_lock);
+	list_remove(&cp->lxioctx_running, ep);
+	mutex_exit(&cp->lxioctx_p_lock);
+
+	lx_uring_post(cp, ep->lxioelem_data, (int32_t)ep->lxioelem_res);
+	atomic_dec_uint(&rp->lxur_inflight);
+
+	ep->lxioelem_data = 0;
+	ep->lxioelem_res = 0;
+	ep->lxioelem_cancel = 0;
+	mutex_enter(&cp->lxioctx_f_lock);
+	list_insert_head(&cp->lxioctx_free, ep);
+	cp->lxioctx_free_cnt++;
+	mutex_exit(&cp->lxioctx_f_lock);
+}
+
+/*
+ * Wait for the file behind a waiting operation to become ready.  See the
+ * theory statement above for why this polls.
+ */
+static int
+lx_uring_wait(lx_io_ctx_t *cp, lx_io_elem_t *ep, short events,
+    short *reventsp)
+{
+	vnode_t *vp = ep->lxioelem_fp->f_vnode;
+	struct pollhead *php;
+	short revents;
+	int err;
+
+	for (;;) {
+		php = NULL;
+		revents = 0;
+		err = VOP_POLL(vp, events, 1, &revents, &php, NULL);
+		if (err != 0)
+			return (err);
+		if (revents != 0) {
+			*reventsp = revents;
+			return (0);
+		}
+		if (ep->lxioelem_cancel)
+			return (ECANCELED);
+		if (curthread->t_activefd.a_stale)
+			return (EBADF);
+		if (cp->lxioctx_ring->lxur_dead ||
+		    lx_io_worker_chk_status(cp, B_FALSE))
+			return (ECANCELED);
+		(void) delay_sig(lx_uring_poll_ticks);
+	}
+}
+
+/*
+ * The io_uring equivalent of lx_io_do_op.
+ */
+static void
+lx_uring_do_op(lx_io_ctx_t *cp, lx_io_elem_t *ep)
+{
+	klwp_t *lwp = ttolwp(curthread);
+	file_t *fp = ep->lxioelem_fp;
+	int fd = ep->lxioelem_fd;
+	void *buf = ep->lxioelem_buf;
+	size_t len = (size_t)ep->lxioelem_nbytes;
+	int flags = (int)ep->lxioelem_rwflags;
+	boolean_t nonblock;
+	short events, revents;
+	int64_t res = 0;
+	int err;
+
+	set_active_fd(fd);
+	lwp->lwp_errno = 0;
+
+	nonblock = (flags & LX_MSG_DONTWAIT) != 0 ||
+	    (fp->f_flag & (FNONBLOCK | FNDELAY)) != 0;
+
+	if (ep->lxioelem_cancel) {
+		/* Cancelled while it was still pending */
+		(void) set_errno(ECANCELED);
+		goto done;
+	}
+
+	switch (ep->lxioelem_op) {
+	case LX_URING_ELEM_OP(LX_IORING_OP_READ):
+	case LX_URING_ELEM_OP(LX_IORING_OP_READ_FIXED):
+		if (ep->lxioelem_offset == -1)
+			res = lx_read(fd, buf, len);
+		else
+			res = lx_pread_fp(fp, buf, len, ep->lxioelem_offset);
+		break;
+
+	case LX_URING_ELEM_OP(LX_IORING_OP_WRITE):
+	case LX_URING_ELEM_OP(LX_IORING_OP_WRITE_FIXED):
+		if (ep->lxioelem_offset == -1)
+			res = lx_write(fd, buf, len);
+		else
+			res = lx_pwrite_fp(fp, buf, len, ep->lxioelem_offset);
+		break;
+
+	case LX_URING_ELEM_OP(LX_IORING_OP_READV):
+		if (ep->lxioelem_offset == -1)
+			res = lx_readv(fd, buf, (int)len);
+		else
+			res = lx_preadv(fd, buf, (int)len, ep->lxioelem_offset);
+		break;
+
+	case LX_URING_ELEM_OP(LX_IORING_OP_WRITEV):
+		if (ep->lxioelem_offset == -1)
+			res = lx_writev(fd, buf, (int)len);
+		else
+			res = lx_pwritev(fd, buf, (int)len,
+			    ep->lxioelem_offset);
+		break;
+
+	case LX_URING_ELEM_OP(LX_IORING_OP_FSYNC):
+		err = VOP_FSYNC(fp->f_vnode,
+		    (flags & LX_IORING_FSYNC_DATASYNC) ? FDSYNC : FSYNC,
+		    fp->f_cred, NULL);
+		if (err != 0)
+			(void) set_errno(err);
+		break;
+
+	case LX_URING_ELEM_OP(LX_IORING_OP_POLL_ADD):
+		events = (short)(flags & (POLLIN | POLLPRI | POLLOUT |
+		    POLLERR | POLLHUP | POLLRDNORM));
+		if ((err = lx_uring_wait(cp, ep, events, &revents)) != 0)
+			(void) set_errno(err);
+		else
+			res = revents;
+		break;
+
+	case LX_URING_ELEM_OP(LX_IORING_OP_SEND):
+	case LX_URING_ELEM_OP(LX_IORING_OP_SENDMSG):
+	case LX_URING_ELEM_OP(LX_IORING_OP_RECV):
+	case LX_URING_ELEM_OP(LX_IORING_OP_RECVMSG):
+		events = (ep->lxioelem_op ==
+		    LX_URING_ELEM_OP(LX_IORING_OP_SEND) ||
+		    ep->lxioelem_op == LX_URING_ELEM_OP(LX_IORING_OP_SENDMSG)) ?
+		    POLLOUT : POLLIN;
+		for (;;) {
+			switch (ep->lxioelem_op) {
+			case LX_URING_ELEM_OP(LX_IORING_OP_SEND):
+				res = lx_send(fd, buf, len,
+				    flags | LX_MSG_DONTWAIT);
+				break;
+			case LX_URING_ELEM_OP(LX_IORING_OP_SENDMSG):
+				res = lx_sendmsg(fd, buf,
+				    flags | LX_MSG_DONTWAIT);
+				break;
+			case LX_URING_ELEM_OP(LX_IORING_OP_RECV):
+				res = lx_recv(fd, buf, len,
+				    flags | LX_MSG_DONTWAIT);
+				break;
+			default:
+				res = lx_recvmsg(fd, buf,
+				    flags | LX_MSG_DONTWAIT);
+				break;
+			}
+			if (lwp->lwp_errno != EAGAIN || nonblock)
+				break;
+			lwp->lwp_errno = 0;
+			if ((err = lx_uring_wait(cp, ep, events,
+			    &revents)) != 0) {
+				(void) set_errno(err);
+				break;
+			}
+		}
+		break;
+
+	default:
+		/* We validated the op at submit time */
+		VERIFY(0);
+		break;
+	}
+done:
+	if (lwp->lwp_errno != 0)
+		res = -lx_errno(lwp->lwp_errno, EINVAL);
+
+	ep->lxioelem_res = res;
+	lwp->lwp_errno = 0;
+
+	releasef(fd);
+	ep->lxioelem_fd = 0;
+	ep->lxioelem_fp = NULL;
+}
+
+/*
+ * Cancel a queued or waiting operation on behalf of ASYNC_CANCEL or
+ * POLL_REMOVE.  Returns the result for the cancelling request's CQE.  The
+ * worker that picks the operation up (or is waiting on it) completes it
+ * with -ECANCELED.
+ */
+static int32_t
+lx_uring_cancel(lx_io_ctx_t *cp, uint64_t user_data)
+{
+	lx_io_elem_t *ep;
+	int32_t res;
+
+	mutex_enter(&cp->lxioctx_p_lock);
+	for (ep = list_head(&cp->lxioctx_pending); ep != NULL;
+	    ep = list_next(&cp->lxioctx_pending, ep)) {
+		if (ep->lxioelem_data == user_data && !ep->lxioelem_cancel) {
+			ep->lxioelem_cancel = 1;
+			mutex_exit(&cp->lxioctx_p_lock);
+			return (0);
+		}
+	}
+
+	res = -lx_errno(ENOENT, EINVAL);
+	for (ep = list_head(&cp->lxioctx_running); ep != NULL;
+	    ep = list_next(&cp->lxioctx_running, ep)) {
+		if (ep->lxioelem_data != user_data || ep->lxioelem_cancel)
+			continue;
+		/* Only ops waiting in lx_uring_wait can stop early */
+		switch (ep->lxioelem_op) {
+		case LX_URING_ELEM_OP(LX_IORING_OP_POLL_ADD):
+		case LX_URING_ELEM_OP(LX_IORING_OP_SEND):
+		case LX_URING_ELEM_OP(LX_IORING_OP_SENDMSG):
+		case LX_URING_ELEM_OP(LX_IORING_OP_RECV):
+		case LX_URING_ELEM_OP(LX_IORING_OP_RECVMSG):
+			ep->lxioelem_cancel = 1;
+			res = 0;
+			break;
+		default:
+			res = -lx_errno(EALREADY, EINVAL);
+			break;
+		}
+		break;
+	}
+	mutex_exit(&cp->lxioctx_p_lock);
+
+	return (res);
+}
+
+/*
+ * Turn one SQE into either an inline completion or a queued operation.  The
+ * caller has checked that there is room in the CQ for its completion.
+ */
+static void
+lx_uring_submit_one(lx_io_ctx_t *cp, lx_io_uring_sqe_t *sqe)
+{
+	lx_uring_t *rp = cp->lxioctx_ring;
+	lx_io_elem_t *ep;
+	file_t *fp;
+	int fd = sqe->lxsqe_fd;
+	int err = 0;
+
+	if (sqe->lxsqe_flags & ~(LX_IOSQE_FIXED_FILE | LX_IOSQE_ASYNC)) {
+		err = EINVAL;
+		goto inline_done;
+	}
+
+	switch (sqe->lxsqe_opcode) {
+	case LX_IORING_OP_NOP:
+		goto inline_done;
+
+	case LX_IORING_OP_ASYNC_CANCEL:
+	case LX_IORING_OP_POLL_REMOVE:
+		atomic_inc_uint(&rp->lxur_inflight);
+		lx_uring_post(cp, sqe->lxsqe_user_data,
+		    lx_uring_cancel(cp, sqe->lxsqe_addr));
+		atomic_dec_uint(&rp->lxur_inflight);
+		return;
+
+	case LX_IORING_OP_READ_FIXED:
+	case LX_IORING_OP_WRITE_FIXED:
+		if (sqe->lxsqe_buf_index >= rp->lxur_nbufs) {
+			err = EFAULT;
+			goto inline_done;
+		}
+		break;
+
+	case LX_IORING_OP_READ:
+	case LX_IORING_OP_WRITE:
+	case LX_IORING_OP_READV:
+	case LX_IORING_OP_WRITEV:
+	case LX_IORING_OP_FSYNC:
+	case LX_IORING_OP_POLL_ADD:
+	case LX_IORING_OP_SEND:
+	case LX_IORING_OP_SENDMSG:
+	case LX_IORING_OP_RECV:
+	case LX_IORING_OP_RECVMSG:
+		break;
+
+	default:
+		err = EINVAL;
+		goto inline_done;
+	}
+
+	if (sqe->lxsqe_flags & LX_IOSQE_FIXED_FILE) {
+		if (fd < 0 || fd >= rp->lxur_nfiles ||
+		    rp->lxur_files[fd] < 0) {
+			err = EBADF;
+			goto inline_done;
+		}
+		fd = rp->lxur_files[fd];
+	}
+
+	if ((fp = getf(fd)) == NULL) {
+		err = EBADF;
+		goto inline_done;
+	}
+
+	switch (sqe->lxsqe_opcode) {
+	case LX_IORING_OP_READ:
+	case LX_IORING_OP_READ_FIXED:
+	case LX_IORING_OP_READV:
+		if ((fp->f_flag & FREAD) == 0)
+			err = EBADF;
+		break;
+	case LX_IORING_OP_WRITE:
+	case LX_IORING_OP_WRITE_FIXED:
+	case LX_IORING_OP_WRITEV:
+		if ((fp->f_flag & FWRITE) == 0)
+			err = EBADF;
+		break;
+	case LX_IORING_OP_SEND:
+	case LX_IORING_OP_SENDMSG:
+	case LX_IORING_OP_RECV:
+	case LX_IORING_OP_RECVMSG:
+		if (fp->f_vnode->v_type != VSOCK)
+			err = ENOTSOCK;
+		break;
+	}
+
+	mutex_enter(&cp->lxioctx_f_lock);
+	if (err == 0 && cp->lxioctx_free_cnt == 0)
+		err = EAGAIN;
+	if (err != 0) {
+		mutex_exit(&cp->lxioctx_f_lock);
+		releasef(fd);
+		goto inline_done;
+	}
+	ep = list_remove_head(&cp->lxioctx_free);
+	cp->lxioctx_free_cnt--;
+	ASSERT(ep != NULL);
+	mutex_exit(&cp->lxioctx_f_lock);
+
+	ep->lxioelem_op = LX_URING_ELEM_OP(sqe->lxsqe_opcode);
+	ep->lxioelem_flags = 0;
+	ep->lxioelem_fd = fd;
+	ep->lxioelem_fp = fp;
+	ep->lxioelem_buf = (void *)(uintptr_t)sqe->lxsqe_addr;
+	ep->lxioelem_nbytes = sqe->lxsqe_len;
+	ep->lxioelem_offset = (int64_t)sqe->lxsqe_off;
+	ep->lxioelem_data = sqe->lxsqe_user_data;
+	ep->lxioelem_rwflags = sqe->lxsqe_op_flags;
+	ep->lxioelem_cancel = 0;
+	ep->lxioelem_cbp = NULL;
+
+	/* Hang on to the fp but setup to hand it off to a worker */
+	clear_active_fd(fd);
+
+	atomic_inc_uint(&rp->lxur_inflight);
+	mutex_enter(&cp->lxioctx_p_lock);
+	list_insert_tail(&cp->lxioctx_pending, ep);
+	cv_signal(&cp->lxioctx_pending_cv);
+	mutex_exit(&cp->lxioctx_p_lock);
+	return;
+
+inline_done:
+	atomic_inc_uint(&rp->lxur_inflight);
+	lx_uring_post(cp, sqe->lxsqe_user_data,
+	    err == 0 ? 0 : -lx_errno(err, EINVAL));
+	atomic_dec_uint(&rp->lxur_inflight);
+}
+
+/*
+ * Consume up to to_submit SQEs.  Returns the number consumed, or -1 with
+ * *errp set if none could be.
+ */
+static int
+lx_uring_submit(lx_io_ctx_t *cp, uint32_t to_submit, int *errp)
+{
+	lx_uring_t *rp = cp->lxioctx_ring;
+	lx_io_uring_sqe_t sqe;
+	uint32_t tail, cq_head, idx;
+	int n = 0;
+
+	*errp = 0;
+	mutex_enter(&rp->lxur_sq_lock);
+	if (copyin(LX_URING_HDR(rp, lxurh_sq_tail), &tail,
+	    sizeof (tail)) != 0 ||
+	    copyin(LX_URING_HDR(rp, lxurh_cq_head), &cq_head,
+	    sizeof (cq_head)) != 0) {
+		mutex_exit(&rp->lxur_sq_lock);
+		*errp = EFAULT;
+		return (-1);
+	}
+	/* Don't look at SQEs until we've seen the tail that covers them. */
+	membar_consumer();
+
+	while (n < to_submit && rp->lxur_sq_head != tail) {
+		if (cp->lxioctx_shutdown || rp->lxur_dead) {
+			*errp = EBADF;
+			break;
+		}
+
+		/*
+		 * Every SQE ends up as a CQE, so don't take one unless
+		 * there's room for its completion.
+		 */
+		if (rp->lxur_inflight + (rp->lxur_cq_tail - cq_head) >=
+		    rp->lxur_cq_entries) {
+			*errp = EBUSY;
+			break;
+		}
+
+		if (copyin((void *)(rp->lxur_ring + LX_URING_CQES +
+		    rp->lxur_cq_entries * sizeof (lx_io_uring_cqe_t) +
+		    (rp->lxur_sq_head & (rp->lxur_sq_entries - 1)) *
+		    sizeof (uint32_t)), &idx, sizeof (idx)) != 0) {
+			*errp = EFAULT;
+			break;
+		}
+		rp->lxur_sq_head++;
+		if (idx >= rp->lxur_sq_entries) {
+			rp->lxur_sq_dropped++;
+			continue;
+		}
+		if (copyin((void *)(rp->lxur_sqes + idx * sizeof (sqe)), &sqe,
+		    sizeof (sqe)) != 0) {
+			rp->lxur_sq_dropped++;
+			continue;
+		}
+
+		lx_uring_submit_one(cp, &sqe);
+		n++;
+	}
+
+	/* Release the SQ slots we consumed back to the application. */
+	membar_producer();
+	(void) copyout(&rp->lxur_sq_head, LX_URING_HDR(rp, lxurh_sq_head),
+	    sizeof (uint32_t));
+	(void) copyout(&rp->lxur_sq_dropped,
+	    LX_URING_HDR(rp, lxurh_sq_dropped), sizeof (uint32_t));
+	mutex_exit(&rp->lxur_sq_lock);
+
+	if (n == 0 && *errp != 0)
+		return (-1);
+	return (n);
+}
+
+long
+lx_io_uring_setup(uint32_t entries, lx_io_uring_params_t *uparams)
+{
+	lx_proc_data_t *lxpd = ptolxproc(curproc);
+	lx_io_uring_params_t p;
+	lx_uring_hdr_t hdr;
+	lx_aio_context_t cid;
+	lx_io_ctx_t *cp;
+	lx_uring_t *rp;
+	uint32_t sq, cq;
+	size_t ring_sz, sqes_sz;
+	uintptr_t ring = 0, sqes = 0;
+	file_t *fp;
+	vnode_t *vp;
+	int i, fd, err;
+
+	if (copyin(uparams, &p, sizeof (p)) != 0)
+		return (set_errno(EFAULT));
+
+	for (i = 0; i < 3; i++) {
+		if (p.lxurp_resv[i] != 0)
+			return (set_errno(EINVAL));
+	}
+	if (p.lxurp_flags & ~(LX_IORING_SETUP_CQSIZE | LX_IORING_SETUP_CLAMP))
+		return (set_errno(EINVAL));
+
+	if (entries == 0)
+		return (set_errno(EINVAL));
+	if (entries > LX_URING_MAX_ENTRIES) {
+		if ((p.lxurp_flags & LX_IORING_SETUP_CLAMP) == 0)
+			return (set_errno(EINVAL));
+		entries = LX_URING_MAX_ENTRIES;
+	}
+	sq = 1U << highbit(entries - 1);
+
+	if (p.lxurp_flags & LX_IORING_SETUP_CQSIZE) {
+		cq = p.lxurp_cq_entries;
+		if (cq == 0)
+			return (set_errno(EINVAL));
+		if (cq > 2 * LX_URING_MAX_ENTRIES) {
+			if ((p.lxurp_flags & LX_IORING_SETUP_CLAMP) == 0)
+				return (set_errno(EINVAL));
+			cq = 2 * LX_URING_MAX_ENTRIES;
+		}
+		cq = 1U << highbit(cq - 1);
+		if (cq < sq)
+			return (set_errno(EINVAL));
+	} else {
+		cq = 2 * sq;
+	}
+
+	/*
+	 * Map the rings.  With IORING_FEAT_SINGLE_MMAP the SQ and CQ rings
+	 * share one mapping.
+	 */
+	ring_sz = P2ROUNDUP(LX_URING_CQES + cq * sizeof (lx_io_uring_cqe_t) +
+	    sq * sizeof (uint32_t), PAGESIZE);
+	sqes_sz = P2ROUNDUP(sq * sizeof (lx_io_uring_sqe_t), PAGESIZE);
+
+	ttolwp(curthread)->lwp_errno = 0;
+	ring = (uintptr_t)smmap64(0, ring_sz, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_ANON, -1, 0);
+	if (ttolwp(curthread)->lwp_errno != 0) {
+		ring = 0;
+		err = ENOMEM;
+		goto fail;
+	}
+	sqes = (uintptr_t)smmap64(0, sqes_sz, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_ANON, -1, 0);
+	if (ttolwp(curthread)->lwp_errno != 0) {
+		sqes = 0;
+		err = ENOMEM;
+		goto fail;
+	}
+
+	bzero(&hdr, sizeof (hdr));
+	hdr.lxurh_sq_mask = sq - 1;
+	hdr.lxurh_sq_entries = sq;
+	hdr.lxurh_cq_mask = cq - 1;
+	hdr.lxurh_cq_entries = cq;
+	if (copyout(&hdr, (void *)ring, sizeof (hdr)) != 0) {
+		err = EFAULT;
+		goto fail;
+	}
+
+	/* The ring fd; io_uring fds are always close-on-exec. */
+	if ((fd = (int)lx_eventfd2(0, EFD_CLOEXEC)) < 0) {
+		err = ttolwp(curthread)->lwp_errno;
+		ttolwp(curthread)->lwp_errno = 0;
+		goto fail;
+	}
+	VERIFY((fp = getf(fd)) != NULL);
+	vp = fp->f_vnode;
+	VN_HOLD(vp);
+	releasef(fd);
+
+	rp = kmem_zalloc(sizeof (lx_uring_t), KM_SLEEP);
+	mutex_init(&rp->lxur_sq_lock, NULL, MUTEX_DEFAULT, NULL);
+	rp->lxur_vp = vp;
+	rp->lxur_ring = ring;
+	rp->lxur_ring_sz = ring_sz;
+	rp->lxur_sqes = sqes;
+	rp->lxur_sqes_sz = sqes_sz;
+	rp->lxur_sq_entries = sq;
+	rp->lxur_cq_entries = cq;
+
+	/* One element per CQ slot; see the theory statement. */
+	if ((err = lx_io_ctx_create(cq, rp, &cid)) != 0) {
+		lx_uring_free(rp);
+		(void) closeandsetf(fd, NULL);
+		goto fail;
+	}
+
+	/*
+	 * lx_io_cp_hold() won't hand out a ring's context, so it can't have
+	 * gone away since we created it.
+	 */
+	mutex_enter(&lxpd->l_io_ctx_lock);
+	cp = lxpd->l_io_ctxs[PTR_TO_CTXID(lxpd, cid)];
+	ASSERT(cp != NULL && cp->lxioctx_ring == rp);
+	rp->lxur_cp = cp;
+	rp->lxur_next = lxpd->l_io_rings;
+	lxpd->l_io_rings = rp;
+	mutex_exit(&lxpd->l_io_ctx_lock);
+
+	p.lxurp_sq_entries = sq;
+	p.lxurp_cq_entries = cq;
+	p.lxurp_features = LX_IORING_FEAT_SINGLE_MMAP |
+	    LX_IORING_FEAT_SUBMIT_STABLE;
+	bzero(&p.lxurp_sq_off, sizeof (p.lxurp_sq_off));
+	p.lxurp_sq_off.lxsqo_head = offsetof(lx_uring_hdr_t, lxurh_sq_head);
+	p.lxurp_sq_off.lxsqo_tail = offsetof(lx_uring_hdr_t, lxurh_sq_tail);
+	p.lxurp_sq_off.lxsqo_ring_mask =
+	    offsetof(lx_uring_hdr_t, lxurh_sq_mask);
+	p.lxurp_sq_off.lxsqo_ring_entries =
+	    offsetof(lx_uring_hdr_t, lxurh_sq_entries);
+	p.lxurp_sq_off.lxsqo_flags = offsetof(lx_uring_hdr_t, lxurh_sq_flags);
+	p.lxurp_sq_off.lxsqo_dropped =
+	    offsetof(lx_uring_hdr_t, lxurh_sq_dropped);
+	p.lxurp_sq_off.lxsqo_array = LX_URING_CQES +
+	    cq * sizeof (lx_io_uring_cqe_t);
+	bzero(&p.lxurp_cq_off, sizeof (p.lxurp_cq_off));
+	p.lxurp_cq_off.lxcqo_head = offsetof(lx_uring_hdr_t, lxurh_cq_head);
+	p.lxurp_cq_off.lxcqo_tail = offsetof(lx_uring_hdr_t, lxurh_cq_tail);
+	p.lxurp_cq_off.lxcqo_ring_mask =
+	    offsetof(lx_uring_hdr_t, lxurh_cq_mask);
+	p.lxurp_cq_off.lxcqo_ring_entries =
+	    offsetof(lx_uring_hdr_t, lxurh_cq_entries);
+	p.lxurp_cq_off.lxcqo_overflow =
+	    offsetof(lx_uring_hdr_t, lxurh_cq_overflow);
+	p.lxurp_cq_off.lxcqo_cqes = LX_URING_CQES;
+	p.lxurp_cq_off.lxcqo_flags = offsetof(lx_uring_hdr_t, lxurh_cq_flags);
+
+	if (copyout(&p, uparams, sizeof (p)) != 0) {
+		/* Closing the fd tears the ring down. */
+		lx_uring_close(fd);
+		(void) closeandsetf(fd, NULL);
+		return (set_errno(EFAULT));
+	}
+
+	return (fd);
+
+fail:
+	if (ring != 0)
+		(void) as_unmap(curproc->p_as, (caddr_t)ring, ring_sz);
+	if (sqes != 0)
+		(void) as_unmap(curproc->p_as, (caddr_t)sqes, sqes_sz);
+	return (set_errno(err));
+}
+
+long
+lx_io_uring_enter(uint_t fd, uint32_t to_submit, uint32_t min_complete,
+    uint32_t flags, void *sig, size_t sigsz)
+{
+	lx_io_ctx_t *cp;
+	lx_uring_t *rp;
+	uint32_t head;
+	int n = 0, err = 0;
+
+	if (flags & ~(LX_IORING_ENTER_GETEVENTS | LX_IORING_ENTER_SQ_WAKEUP))
+		return (set_errno(EINVAL));
+
+	/* We don't support swapping the signal mask while waiting. */
+	if (sig != NULL || sigsz != 0)
+		return (set_errno(EINVAL));
+
+	if ((cp = lx_uring_hold(fd, &err)) == NULL)
+		return (set_errno(err));
+	rp = cp->lxioctx_ring;
+
+	if (to_submit != 0 && (n = lx_uring_submit(cp, to_submit, &err)) < 0) {
+		lx_io_cp_rele(cp);
+		return (set_errno(err));
+	}
+
+	if ((flags & LX_IORING_ENTER_GETEVENTS) && min_complete != 0) {
+		if (min_complete > rp->lxur_cq_entries)
+			min_complete = rp->lxur_cq_entries;
+
+		for (;;) {
+			if (copyin(LX_URING_HDR(rp, lxurh_cq_head), &head,
+			    sizeof (head)) != 0) {
+				err = EFAULT;
+				break;
+			}
+
+			mutex_enter(&cp->lxioctx_d_lock);
+			if (rp->lxur_cq_tail - head >= min_complete ||
+			    cp->lxioctx_shutdown || rp->lxur_dead) {
+				mutex_exit(&cp->lxioctx_d_lock);
+				break;
+			}
+			if (cv_wait_sig(&cp->lxioctx_done_cv,
+			    &cp->lxioctx_d_lock) == 0) {
+				mutex_exit(&cp->lxioctx_d_lock);
+				err = EINTR;
+				break;
+			}
+			mutex_exit(&cp->lxioctx_d_lock);
+		}
+	}
+
+	lx_io_cp_rele(cp);
+
+	if (n == 0 && err != 0)
+		return (set_errno(err));
+	return (n);
+}
+
+long
+lx_io_uring_register(uint_t fd, uint_t opcode, void *arg, uint_t nr_args)
+{
+	lx_io_ctx_t *cp;
+	lx_uring_t *rp;
+	vnode_t *vp;
+	cred_t *cr;
+	file_t *fp;
+	int *files;
+	int efd, i, err = 0;
+
+	if ((cp = lx_uring_hold(fd, &err)) == NULL)
+		return (set_errno(err));
+	rp = cp->lxioctx_ring;
+
+	mutex_enter(&rp->lxur_sq_lock);
+	switch (opcode) {
+	case LX_IORING_REGISTER_BUFFERS:
+		if (rp->lxur_nbufs != 0)
+			err = EBUSY;
+		else if (nr_args == 0 || nr_args > LX_URING_MAX_BUFS)
+			err = EINVAL;
+		else
+			rp->lxur_nbufs = nr_args;
+		break;
+
+	case LX_IORING_UNREGISTER_BUFFERS:
+		if (rp->lxur_nbufs == 0)
+			err = ENXIO;
+		rp->lxur_nbufs = 0;
+		break;
+
+	case LX_IORING_REGISTER_FILES:
+		if (rp->lxur_files != NULL) {
+			err = EBUSY;
+			break;
+		}
+		if (nr_args == 0 || nr_args > LX_URING_MAX_FILES) {
+			err = EINVAL;
+			break;
+		}
+		files = kmem_alloc(nr_args * sizeof (int), KM_SLEEP);
+		if (copyin(arg, files, nr_args * sizeof (int)) != 0) {
+			kmem_free(files, nr_args * sizeof (int));
+			err = EFAULT;
+			break;
+		}
+		rp->lxur_files = files;
+		rp->lxur_nfiles = nr_args;
+		break;
+
+	case LX_IORING_UNREGISTER_FILES:
+		if (rp->lxur_files == NULL) {
+			err = ENXIO;
+			break;
+		}
+		kmem_free(rp->lxur_files, rp->lxur_nfiles * sizeof (int));
+		rp->lxur_files = NULL;
+		rp->lxur_nfiles = 0;
+		break;
+
+	case LX_IORING_REGISTER_EVENTFD:
+	case LX_IORING_REGISTER_EVENTFD_ASYNC:
+		if (nr_args != 1) {
+			err = EINVAL;
+			break;
+		}
+		if (copyin(arg, &efd, sizeof (efd)) != 0) {
+			err = EFAULT;
+			break;
+		}
+		if ((fp = getf(efd)) == NULL) {
+			err = EBADF;
+			break;
+		}
+		if (!lx_is_eventfd(fp)) {
+			releasef(efd);
+			err = EINVAL;
+			break;
+		}
+		vp = fp->f_vnode;
+		VN_HOLD(vp);
+		cr = fp->f_cred;
+		crhold(cr);
+		releasef(efd);
+
+		mutex_enter(&cp->lxioctx_d_lock);
+		if (rp->lxur_evfd_vp == NULL) {
+			rp->lxur_evfd_vp = vp;
+			rp->lxur_evfd_cr = cr;
+			vp = NULL;
+		}
+		mutex_exit(&cp->lxioctx_d_lock);
+		if (vp != NULL) {
+			VN_RELE(vp);
+			crfree(cr);
+			err = EBUSY;
+		}
+		break;
+
+	case LX_IORING_UNREGISTER_EVENTFD:
+		mutex_enter(&cp->lxioctx_d_lock);
+		vp = rp->lxur_evfd_vp;
+		cr = rp->lxur_evfd_cr;
+		rp->lxur_evfd_vp = NULL;
+		rp->lxur_evfd_cr = NULL;
+		mutex_exit(&cp->lxioctx_d_lock);
+		if (vp == NULL) {
+			err = ENXIO;
+			break;
+		}
+		VN_RELE(vp);
+		crfree(cr);
+		break;
+
+	case LX_IORING_REGISTER_PROBE: {
+		lx_io_uring_probe_t probe;
+		lx_io_uring_probe_op_t op;
+
+		bzero(&probe, sizeof (probe));
+		probe.lxpr_last_op = LX_IORING_OP_LAST - 1;
+		probe.lxpr_ops_len = MIN(nr_args, LX_IORING_OP_LAST);
+		if (copyout(&probe, arg, sizeof (probe)) != 0) {
+			err = EFAULT;
+			break;
+		}
+		for (i = 0; i < probe.lxpr_ops_len; i++) {
+			bzero(&op, sizeof (op));
+			op.lxpo_op = i;
+			switch (i) {
+			case LX_IORING_OP_NOP:
+			case LX_IORING_OP_READV:
+			case LX_IORING_OP_WRITEV:
+			case LX_IORING_OP_FSYNC:
+			case LX_IORING_OP_READ_FIXED:
+			case LX_IORING_OP_WRITE_FIXED:
+			case LX_IORING_OP_POLL_ADD:
+			case LX_IORING_OP_POLL_REMOVE:
+			case LX_IORING_OP_SENDMSG:
+			case LX_IORING_OP_RECVMSG:
+			case LX_IORING_OP_ASYNC_CANCEL:
+			case LX_IORING_OP_READ:
+			case LX_IORING_OP_WRITE:
+			case LX_IORING_OP_SEND:
+			case LX_IORING_OP_RECV:
+				op.lxpo_flags = LX_IO_URING_OP_SUPPORTED;
+				break;
+			}
+			if (copyout(&op, (caddr_t)arg + sizeof (probe) +
+			    i * sizeof (op), sizeof (op)) != 0) {
+				err = EFAULT;
+				break;
+			}
+		}
+		break;
+	}
+
+	default:
+		err = EINVAL;
+		break;
+	}
+	mutex_exit(&rp->lxur_sq_lock);
+	lx_io_cp_rele(cp);
+
+	if (err != 0)
+		return (set_errno(err));
+	return (0);
+}
+
+/*
+ * Shut a ring down.  The workers finish what they are doing and exit, and
+ * the last of them frees the context and the ring.
+ */
+static void
+lx_uring_shutdown(lx_io_ctx_t *cp)
+{
+	mutex_enter(&cp->lxioctx_p_lock);
+	cp->lxioctx_shutdown = B_TRUE;
+	cv_broadcast(&cp->lxioctx_pending_cv);
+	mutex_exit(&cp->lxioctx_p_lock);
+
+	mutex_enter(&cp->lxioctx_d_lock);
+	cv_broadcast(&cp->lxioctx_done_cv);
+	mutex_exit(&cp->lxioctx_d_lock);
+
+	lx_io_cp_rele(cp);
+}
+
+/*
+ * Called from lx_close: if this is the last reference to a ring fd, tear
+ * the ring down.
+ */
+void
+lx_uring_close(int fd)
+{
+	lx_proc_data_t *lxpd = ptolxproc(curproc);
+	lx_io_ctx_t *cp = NULL;
+	lx_uring_t *rp;
+	file_t *fp;
+
+	if (lxpd->l_io_rings == NULL || (fp = getf(fd)) == NULL)
+		return;
+
+	if (fp->f_count == 1) {
+		mutex_enter(&lxpd->l_io_ctx_lock);
+		for (rp = lxpd->l_io_rings; rp != NULL; rp = rp->lxur_next) {
+			if (rp->lxur_vp == fp->f_vnode)
+				break;
+		}
+		if (rp != NULL && !rp->lxur_cp->lxioctx_shutdown) {
+			cp = rp->lxur_cp;
+			atomic_inc_32(&cp->lxioctx_in_use);
+		}
+		mutex_exit(&lxpd->l_io_ctx_lock);
+	}
+	releasef(fd);
+
+	if (cp != NULL)
+		lx_uring_shutdown(cp);
+}
+
+/*
+ * Called from lx_mmap for file mappings.  Returns NULL if fd isn't a ring,
+ * otherwise the address of the requested ring, or (void *)-1 with errno
+ * set.
+ */
+void *
+lx_uring_mmap(int fd, size_t len, int flags, off64_t off)
+{
+	lx_proc_data_t *lxpd = ptolxproc(curproc);
+	lx_io_ctx_t *cp;
+	lx_uring_t *rp;
+	uintptr_t addr;
+	size_t sz;
+	int err;
+
+	if (lxpd->l_io_rings == NULL)
+		return (NULL);
+	if ((cp = lx_uring_hold(fd, &err)) == NULL)
+		return (NULL);
+	rp = cp->lxioctx_ring;
+
+	switch (off) {
+	case LX_IORING_OFF_SQ_RING:
+	case LX_IORING_OFF_CQ_RING:
+		addr = rp->lxur_ring;
+		sz = rp->lxur_ring_sz;
+		break;
+	case LX_IORING_OFF_SQES:
+		addr = rp->lxur_sqes;
+		sz = rp->lxur_sqes_sz;
+		break;
+	default:
+		addr = 0;
+		sz = 0;
+		break;
+	}
+	lx_io_cp_rele(cp);
+
+	/* The rings are already mapped; we can't move them. */
+	if (addr == 0 || len > sz || (flags & MAP_FIXED)) {
+		(void) set_errno(EINVAL);
+		return ((void *)-1);
+	}
+	return ((void *)addr);
+}
+
+/*
+ * Called from lx_munmap.  Once the application unmaps a ring the kernel
+ * must stop writing to that address range.
+ */
+void
+lx_uring_munmap(uintptr_t addr, size_t len)
+{
+	lx_proc_data_t *lxpd = ptolxproc(curproc);
+	lx_uring_t *rp;
+
+	if (lxpd->l_io_rings == NULL)
+		return;
+
+	mutex_enter(&lxpd->l_io_ctx_lock);
+	for (rp = lxpd->l_io_rings; rp != NULL; rp = rp->lxur_next) {
+		if ((addr < rp->lxur_ring + rp->lxur_ring_sz &&
+		    addr + len > rp->lxur_ring) ||
+		    (addr < rp->lxur_sqes + rp->lxur_sqes_sz &&
+		    addr + len > rp->lxur_sqes)) {
+			mutex_enter(&rp->lxur_cp->lxioctx_d_lock);
+			rp->lxur_dead = B_TRUE;
+			cv_broadcast(&rp->lxur_cp->lxioctx_done_cv);
+			mutex_exit(&rp->lxur_cp->lxioctx_d_lock);
+		}
+	}
+	mutex_exit(&lxpd->l_io_ctx_lock);
+}
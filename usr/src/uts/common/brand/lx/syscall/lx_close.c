@@ -19,6 +19,7 @@
 
 #include <sys/lx_brand.h>
 #include <sys/lx_syscalls.h>
+#include <sys/lx_misc.h>
 
 
 extern int close(int);
@@ -26,5 +27,6 @@ extern int close(int);
 long
 lx_close(int fdes)
 {
+	lx_uring_close(fdes);
 	return (close(fdes));
 }
@@ -111,9 +111,11 @@ lx_epoll_create(int size)
 
 
 /* Match values from libc implementation */
-#define	EPOLLIGNORED 	(EPOLLMSG | EPOLLWAKEUP)
+#define	EPOLLIGNORED 	(EPOLLMSG | EPOLLWAKEUP | EPOLLEXCLUSIVE)
 #define	EPOLLSWIZZLED	\
 	(EPOLLRDHUP | EPOLLONESHOT | EPOLLET | EPOLLWRBAND | EPOLLWRNORM)
+#define	EPOLLEXCLUSIVE_OK	(EPOLLIN | EPOLLOUT | EPOLLERR | EPOLLHUP | \
+	EPOLLWAKEUP | EPOLLET | EPOLLEXCLUSIVE)
 #define	EPOLL_TIMEOUT_CLAMP(t)	(((t) < -1) ? -1 : (t))
 
 long
@@ -127,6 +129,7 @@ lx_epoll_ctl(int fd, int op, int pfd, void *event)
 	uint32_t events, ev = 0;
 	int error = 0, i = 0;
 
+	bzero(dpevent, sizeof (dpevent));
 	dpevent[i].dpep_pollfd.fd = pfd;
 	switch (op) {
 	case EPOLL_CTL_DEL:
@@ -146,6 +149,17 @@ lx_epoll_ctl(int fd, int op, int pfd, void *event)
 		if (copyin(event, &epevent, sizeof (epevent)) != 0)
 			return (set_errno(EFAULT));
 
+		/*
+		 * EPOLLEXCLUSIVE may only be set when adding an fd, and only
+		 * together with a limited set of other events.
+		 */
+		if (epevent.events & EPOLLEXCLUSIVE) {
+			if (op == EPOLL_CTL_MOD ||
+			    (epevent.events & ~EPOLLEXCLUSIVE_OK) != 0)
+				return (set_errno(EINVAL));
+			dpevent[i].dpep_pollfd.revents = DP_EPOLL_EXCLUSIVE;
+		}
+
 		/*
 		 * Mask off the events that we ignore, and then swizzle the
 		 * events for which our values differ from their epoll(7)
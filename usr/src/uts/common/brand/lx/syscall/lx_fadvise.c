@@ -14,10 +14,13 @@
  */
 
 #include <sys/fcntl.h>
+#include <sys/filio.h>
+#include <sys/vnode.h>
 #include <sys/lx_misc.h>
 
 /*
- * Based on illumos posix_fadvise which does nothing. The only difference is
+ * Based on illumos posix_fadvise, which hands the advice for a regular file
+ * to its file system via _FIO_ADVISE. The only difference is
  * that on Linux an fd refering to a pipe or FIFO returns EINVAL. The Linux
  * POSIX_FADV_* values are the same as the illumos values. See how the 32-bit
  * glibc calls fadvise64; the offeset is a 64-bit value, but the length is not.
@@ -25,11 +28,28 @@
  * fadvise64 caller always passes 64-bit values for the offset and length.
  */
 
+/*
+ * Advice is only a hint, so a file system that doesn't act on it (ENOTTY) or
+ * fails to is not an error for the caller.
+ */
+static void
+lx_fadvise_vp(file_t *fp, off64_t offset, off64_t len, int advice)
+{
+	fio_advise_t fa;
+	int rval;
+
+	fa.fa_offset = offset;
+	fa.fa_len = len;
+	fa.fa_advice = advice;
+	fa.fa_pad = 0;
+	(void) VOP_IOCTL(fp->f_vnode, _FIO_ADVISE, (intptr_t)&fa,
+	    FKIOCTL | fp->f_flag, fp->f_cred, &rval, NULL);
+}
+
 /*
  * This is the fadvise64 function used by 64-bit callers, and by 32-bit callers
  * after they have adjusted their arguments.
  */
-/* ARGSUSED */
 int
 lx_fadvise64(int fd, off64_t offset, off64_t len, int advice)
 {
@@ -54,6 +74,8 @@ lx_fadvise64(int fd, off64_t offset, off64_t len, int advice)
 	if ((fp = getf(fd)) == NULL)
 		return (set_errno(EBADF));
 	is_fifo = (fp->f_vnode->v_type == VFIFO);
+	if (fp->f_vnode->v_type == VREG)
+		lx_fadvise_vp(fp, offset, len, advice);
 	releasef(fd);
 
 	if (is_fifo)
@@ -62,6 +84,46 @@ lx_fadvise64(int fd, off64_t offset, off64_t len, int advice)
 	return (0);
 }
 
+/*
+ * readahead(2) is POSIX_FADV_WILLNEED on a file open for reading.
+ */
+long
+lx_readahead(int fd, off64_t offset, size_t count)
+{
+	file_t *fp;
+	int error = 0;
+
+	if ((fp = getf(fd)) == NULL)
+		return (set_errno(EBADF));
+	if ((fp->f_flag & FREAD) == 0)
+		error = EBADF;
+	else if (fp->f_vnode->v_type != VREG)
+		error = EINVAL;
+	else if (offset < 0)
+		error = EINVAL;
+	else
+		lx_fadvise_vp(fp, offset, (off64_t)count, POSIX_FADV_WILLNEED);
+	releasef(fd);
+
+	return (error != 0 ? set_errno(error) : 0);
+}
+
+/*
+ * This is the readahead function used by 32-bit callers, which pass the
+ * 64-bit offset by concatenating consecutive arguments.
+ */
+long
+lx_readahead_32(int fd, uint32_t off_lo, uint32_t off_hi, uint32_t count)
+{
+	off64_t offset;
+
+	offset = off_hi;
+	offset = offset << 32;
+	offset |= off_lo;
+
+	return (lx_readahead(fd, offset, (size_t)count));
+}
+
 /*
  * This is the fadvise64 function used by 32-bit callers. Linux passes the
  * 64-bit offset by concatenating consecutive arguments. We must perform the
@@ -46,6 +46,10 @@
 #include <sys/lx_futex.h>
 #include <sys/lx_impl.h>
 #include <sys/sdt.h>
+#include <sys/disp.h>
+#include <sys/kmem.h>
+#include <sys/cpuvar.h>
+#include <sys/bitmap.h>
 
 /*
  * Futexes are a Linux-specific implementation of inter-process mutexes.
@@ -290,22 +294,29 @@ typedef struct futex_robust_list32 {
 
 /*
  * Because collisions on this hash table can be a source of negative
- * scalability, we make it pretty large: 4,096 entries -- 64K.  If this
- * size is found to be insufficient, the size should be made dynamic.
- * (Making it dynamic will be delicate because the per-chain locking will
- * necessitate memory retiring or similar; see the 2008 ACM Queue article
- * "Real-world concurrency" for details on this technique.)
+ * scalability, we make it pretty large: at least 4,096 entries, and more on
+ * larger machines, where more threads can contend on futexes at once.  The
+ * table is sized (to lx_futex_hash_per_cpu entries per CPU, rounded up to a
+ * power of two) when the brand is loaded; resizing it on the fly would be
+ * delicate because the per-chain locking would necessitate memory retiring or
+ * similar.  (See the 2008 ACM Queue article "Real-world concurrency" for
+ * details on this technique.)
+ *
+ * The memid is hashed multiplicatively: the two halves of the key (the
+ * address space or vnode, and the futex address or offset within it) are
+ * combined and the top bits of their product with a large odd constant used
+ * as the index.  This spreads the 4-byte aligned futexes of a single process
+ * as well as those shared between processes through a vnode.
  */
-#define	HASH_SHIFT_SZ	12
-#define	HASH_SIZE	(1 << HASH_SHIFT_SZ)
-#define	HASH_FUNC(id)						\
-	((((uintptr_t)((id)->val[1]) >> 3) +			\
-	((uintptr_t)((id)->val[1]) >> (3 + HASH_SHIFT_SZ)) +		\
-	((uintptr_t)((id)->val[1]) >> (3 + 2 * HASH_SHIFT_SZ)) +	\
-	((uintptr_t)((id)->val[0]) >> 3) +				\
-	((uintptr_t)((id)->val[0]) >> (3 + HASH_SHIFT_SZ)) +		\
-	((uintptr_t)((id)->val[0]) >> (3 + 2 * HASH_SHIFT_SZ))) &	\
-	(HASH_SIZE - 1))
+#define	HASH_MIN_SHIFT	12
+#define	HASH_MAX_SHIFT	20
+#define	HASH_MULT	0x9e3779b97f4a7c15ULL
+#define	HASH_FUNC(id)	futex_hash_index(id)
+
+uint_t lx_futex_hash_per_cpu = 256;
+
+static uint_t futex_hash_shift;
+static uint_t futex_hash_size;
 
 /*
  * A small, invalid value we can compare against to find the highest scheduling
@@ -330,7 +341,16 @@ typedef struct futex_hash {
 	fwaiter_t *fh_waiters;
 } futex_hash_t;
 
-static futex_hash_t futex_hash[HASH_SIZE];
+static futex_hash_t *futex_hash;
+
+static uint_t
+futex_hash_index(memid_t *memid)
+{
+	const uint64_t key = ((uint64_t)(uintptr_t)memid->val[0] >> 3) ^
+	    ((uint64_t)(uintptr_t)memid->val[1] >> 2);
+
+	return ((uint_t)((key * HASH_MULT) >> (64 - futex_hash_shift)));
+}
 
 static void
 futex_hashin(fwaiter_t *fwp)
@@ -478,6 +498,13 @@ futex_wake(memid_t *memid, int wake_threads, uint32_t mask)
 
 	index = HASH_FUNC(memid);
 
+	/*
+	 * A single wakeup is the producer/consumer handoff case that
+	 * directed wakeups are meant for; see disp_dirwake.
+	 */
+	if (wake_threads == 1)
+		curthread->t_dirwake = (disp_dirwake != 0);
+
 	mutex_enter(&futex_hash[index].fh_lock);
 
 	for (fwp = futex_hash[index].fh_waiters;
@@ -490,6 +517,7 @@ futex_wake(memid_t *memid, int wake_threads, uint32_t mask)
 				 * non-PI usage on the same futex.
 				 */
 				mutex_exit(&futex_hash[index].fh_lock);
+				curthread->t_dirwake = 0;
 				return (set_errno(EINVAL));
 			}
 
@@ -503,6 +531,7 @@ futex_wake(memid_t *memid, int wake_threads, uint32_t mask)
 	}
 
 	mutex_exit(&futex_hash[index].fh_lock);
+	curthread->t_dirwake = 0;
 
 	return (ret);
 }
@@ -758,16 +787,25 @@ futex_requeue(memid_t *memid, memid_t *requeue_memid, int wake_threads,
 		if (!MEMID_EQUAL(&fwp->fw_memid, memid))
 			continue;
 
-		futex_hashout(fwp);
+		/*
+		 * Stop as soon as everything asked for has been woken or
+		 * requeued, rather than walking the rest of the chain.
+		 */
+		if (ret >= wake_threads &&
+		    (ulong_t)(ret - wake_threads) >= requeue_threads)
+			break;
+
 		if (ret++ < wake_threads) {
+			futex_hashout(fwp);
 			fwp->fw_woken = 1;
 			cv_signal(&fwp->fw_cv);
+		} else if (index1 == index2) {
+			/* Same chain: relabeling the waiter is enough. */
+			MEMID_COPY(requeue_memid, &fwp->fw_memid);
 		} else {
+			futex_hashout(fwp);
 			MEMID_COPY(requeue_memid, &fwp->fw_memid);
 			futex_hashin(fwp);
-
-			if ((ret - wake_threads) >= requeue_threads)
-				break;
 		}
 	}
 
@@ -1693,23 +1731,40 @@ out:
 void
 lx_futex_init(void)
 {
-	int i;
+	uint_t i;
+
+	futex_hash_shift = highbit(MAX(max_ncpus, 1) * lx_futex_hash_per_cpu);
+	futex_hash_shift = MIN(MAX(futex_hash_shift, HASH_MIN_SHIFT),
+	    HASH_MAX_SHIFT);
+	futex_hash_size = 1U << futex_hash_shift;
+	futex_hash = kmem_zalloc(futex_hash_size * sizeof (futex_hash_t),
+	    KM_SLEEP);
 
-	for (i = 0; i < HASH_SIZE; i++)
+	for (i = 0; i < futex_hash_size; i++)
 		mutex_init(&futex_hash[i].fh_lock, NULL, MUTEX_DEFAULT, NULL);
 }
 
 int
 lx_futex_fini(void)
 {
-	int i, err;
+	uint_t i;
+	int err;
 
 	err = 0;
-	for (i = 0; (err == 0) && (i < HASH_SIZE); i++) {
+	for (i = 0; (err == 0) && (i < futex_hash_size); i++) {
 		mutex_enter(&futex_hash[i].fh_lock);
 		if (futex_hash[i].fh_waiters != NULL)
 			err = EBUSY;
 		mutex_exit(&futex_hash[i].fh_lock);
 	}
-	return (err);
+	if (err != 0)
+		return (err);
+
+	for (i = 0; i < futex_hash_size; i++)
+		mutex_destroy(&futex_hash[i].fh_lock);
+	kmem_free(futex_hash, futex_hash_size * sizeof (futex_hash_t));
+	futex_hash = NULL;
+	futex_hash_size = 0;
+
+	return (0);
 }
@@ -20,7 +20,7 @@
  */
 
 /*
- * Copyright 2017 Joyent, Inc.
+ * Copyright 2019 Joyent, Inc.
  */
 
 #include <sys/systm.h>
@@ -28,8 +28,10 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/inttypes.h>
+#include <sys/vfs.h>
 #include <sys/vnode.h>
 #include <sys/dirent.h>
+#include <sys/extdirent.h>
 #include <sys/errno.h>
 #include <sys/file.h>
 #include <sys/sysmacros.h>
@@ -73,6 +75,20 @@ int (*lx_sysfs_vtype)(ino_t);
 #define	LTOS_GETDENTS_BUFSZ(bufsz, datasz)	\
 	(((bufsz) / (((datasz) + 15) & ~7)) * sizeof (struct dirent))
 
+/*
+ * File systems which support VFSFT_DIRENTTYPE can hand back edirent_t
+ * records carrying the type of each entry, which saves looking it up.  An
+ * edirent_t is never smaller than the Linux record it is translated into, so
+ * in that case the native buffer can be as large as the Linux one.
+ */
+#define	LX_GETDENTS_SBUFSZ(bufsz, datasz, fmt)		\
+	(((fmt) & LX_GETDENTS_EDIRENT) != 0 ? (bufsz) :	\
+	LTOS_GETDENTS_BUFSZ(bufsz, datasz))
+
+/* Flags describing the native records handed to the format callbacks. */
+#define	LX_GETDENTS_SYSFS	0x01	/* d_type is looked up in lx_sysfs */
+#define	LX_GETDENTS_EDIRENT	0x02	/* records are edirent_t */
+
 /*
  * Linux d_type offset is at (d_reclen - 1). See the Linux getdents(2) man page.
  * This macro assumes d_reclen is already set correctly.
@@ -113,10 +129,10 @@ struct lx_dirent_64 {
 
 static long
 lx_getdents_common(int fd, caddr_t uptr, size_t count,
-    unsigned int lx_size, int (*outcb)(caddr_t, caddr_t, int, boolean_t))
+    unsigned int lx_size, int (*outcb)(caddr_t, caddr_t, int, int))
 {
 	vnode_t *vp;
-	boolean_t is_sysfs = B_FALSE;
+	int fmt = 0, rdflags = 0;
 	file_t *fp;
 	struct uio auio;
 	struct iovec aiov;
@@ -142,7 +158,10 @@ lx_getdents_common(int fd, caddr_t uptr, size_t count,
 	}
 
 	if (vp->v_vfsp->vfs_fstype == lx_sysfs_vfs_type) {
-		is_sysfs = B_TRUE;
+		fmt |= LX_GETDENTS_SYSFS;
+	} else if (vfs_has_feature(vp->v_vfsp, VFSFT_DIRENTTYPE)) {
+		fmt |= LX_GETDENTS_EDIRENT;
+		rdflags |= V_RDDIR_DTYPE;
 	}
 
 	if (count > LX_GETDENTS_MAX_BUFSZ) {
@@ -152,7 +171,8 @@ lx_getdents_common(int fd, caddr_t uptr, size_t count,
 		 * used to fill the request.
 		 */
 		lbufsz = LX_GETDENTS_MAX_BUFSZ;
-		sbufsz = LTOS_GETDENTS_BUFSZ(LX_GETDENTS_MAX_BUFSZ, lx_size);
+		sbufsz = LX_GETDENTS_SBUFSZ(LX_GETDENTS_MAX_BUFSZ, lx_size,
+		    fmt);
 	} else if (count < (lx_size + MAXPATHLEN)) {
 		/*
 		 * If the target buffer is tiny, allocate a Linux-format buffer
@@ -163,11 +183,11 @@ lx_getdents_common(int fd, caddr_t uptr, size_t count,
 		 * result will not fit and an EINVAL will be tossed.
 		 */
 		lbufsz = (lx_size + MAXPATHLEN);
-		sbufsz = MAX((LTOS_GETDENTS_BUFSZ(count, lx_size)),
+		sbufsz = MAX((LX_GETDENTS_SBUFSZ(count, lx_size, fmt)),
 		    sizeof (struct dirent));
 	} else {
 		lbufsz = count;
-		sbufsz = LTOS_GETDENTS_BUFSZ(count, lx_size);
+		sbufsz = LX_GETDENTS_SBUFSZ(count, lx_size, fmt);
 	}
 	bufsz = sbufsz;
 	lbuf = kmem_alloc(lbufsz, KM_SLEEP);
@@ -194,12 +214,13 @@ lx_getdents_common(int fd, caddr_t uptr, size_t count,
 		int res;
 
 		(void) VOP_RWLOCK(vp, V_WRITELOCK_FALSE, NULL);
-		error = VOP_READDIR(vp, &auio, fp->f_cred, &at_eof, NULL, 0);
+		error = VOP_READDIR(vp, &auio, fp->f_cred, &at_eof, NULL,
+		    rdflags);
 		VOP_RWUNLOCK(vp, V_WRITELOCK_FALSE, NULL);
 		if (error != 0 || auio.uio_resid == sbufsz) {
 			break;
 		}
-		res = outcb(sbuf, lbuf, bufsz - auio.uio_resid, is_sysfs);
+		res = outcb(sbuf, lbuf, bufsz - auio.uio_resid, fmt);
 		VERIFY(res <= lbufsz);
 		if (res == 0) {
 			/* no records to copyout from this batch */
@@ -224,7 +245,8 @@ lx_getdents_common(int fd, caddr_t uptr, size_t count,
 		 * We undershot the request buffer.
 		 * Reset for another READDIR, taking care not to overshoot.
 		 */
-		bufsz = MIN(sbufsz, LTOS_GETDENTS_BUFSZ(count - outb, lx_size));
+		bufsz = MIN(sbufsz,
+		    LX_GETDENTS_SBUFSZ(count - outb, lx_size, fmt));
 		auio.uio_resid = bufsz;
 		aiov.iov_len = bufsz;
 		aiov.iov_base = sbuf;
@@ -268,75 +290,110 @@ lx_get_sysfs_dtype(ino_t ino)
 	}
 }
 
+/*
+ * Decode the native record at sbuf, returning its length.  The types held in
+ * an edirent_t are IFTODT() values, which are the same as the Linux d_type
+ * values.
+ */
+static int
+lx_getdents_decode(caddr_t sbuf, int fmt, ino64_t *inop, off64_t *offp,
+    char **namep, uchar_t *typep)
+{
+	if (fmt & LX_GETDENTS_EDIRENT) {
+		/* LINTED: alignment */
+		edirent_t *ed = (edirent_t *)sbuf;
+
+		*inop = ed->ed_ino;
+		*offp = ed->ed_off;
+		*namep = ed->ed_name;
+		*typep = ED_DTYPE(ed);
+		return (ed->ed_reclen);
+	} else {
+		/* LINTED: alignment */
+		struct dirent *sd = (struct dirent *)sbuf;
+
+		*inop = sd->d_ino;
+		*offp = sd->d_off;
+		*namep = sd->d_name;
+		*typep = (fmt & LX_GETDENTS_SYSFS) ?
+		    lx_get_sysfs_dtype(sd->d_ino) : LX_DT_UNKNOWN;
+		return (sd->d_reclen);
+	}
+}
+
 static int
-lx_getdents_format32(caddr_t sbuf, caddr_t lbuf, int len, boolean_t is_sysfs)
+lx_getdents_format32(caddr_t sbuf, caddr_t lbuf, int len, int fmt)
 {
-	struct dirent *sd;
 	struct lx_dirent_32 *ld;
 	int namelen;
 	int size = 0;
 
 	while (len > 0) {
-		/* LINTED: alignment */
-		sd = (struct dirent *)sbuf;
+		ino64_t ino;
+		off64_t off;
+		char *name;
+		uchar_t type;
+		int sreclen;
+
+		sreclen = lx_getdents_decode(sbuf, fmt, &ino, &off, &name,
+		    &type);
 		/* LINTED: alignment */
 		ld = (struct lx_dirent_32 *)lbuf;
-		namelen = MIN(strlen(sd->d_name), LX_NAMEMAX - 1);
+		namelen = MIN(strlen(name), LX_NAMEMAX - 1);
 
-		ld->d_ino = sd->d_ino;
-		ld->d_off = sd->d_off;
-		(void) strncpy(ld->d_name, sd->d_name, namelen);
+		ld->d_ino = ino;
+		ld->d_off = off;
+		(void) strncpy(ld->d_name, name, namelen);
 		ld->d_name[namelen] = 0;
 		ld->d_reclen = (ushort_t)LX_RECLEN(namelen,
 		    struct lx_dirent_32);
 		/* Zero out any alignment padding and d_type */
 		bzero(ld->d_name + namelen,
 		    LX_ZEROLEN(namelen, struct lx_dirent_32));
+		LX_DTYPE(ld) = type;
 
-		if (is_sysfs) {
-			LX_DTYPE(ld) = lx_get_sysfs_dtype(ld->d_ino);
-		}
-
-		len -= sd->d_reclen;
+		len -= sreclen;
 		size += ld->d_reclen;
-		sbuf += sd->d_reclen;
+		sbuf += sreclen;
 		lbuf += ld->d_reclen;
 	}
 	return (size);
 }
 
 static int
-lx_getdents_format64(caddr_t sbuf, caddr_t lbuf, int len, boolean_t is_sysfs)
+lx_getdents_format64(caddr_t sbuf, caddr_t lbuf, int len, int fmt)
 {
-	struct dirent *sd;
 	struct lx_dirent_64 *ld;
 	int namelen;
 	int size = 0;
 
 	while (len > 0) {
-		/* LINTED: alignment */
-		sd = (struct dirent *)sbuf;
+		ino64_t ino;
+		off64_t off;
+		char *name;
+		uchar_t type;
+		int sreclen;
+
+		sreclen = lx_getdents_decode(sbuf, fmt, &ino, &off, &name,
+		    &type);
 		/* LINTED: alignment */
 		ld = (struct lx_dirent_64 *)lbuf;
-		namelen = MIN(strlen(sd->d_name), LX_NAMEMAX - 1);
+		namelen = MIN(strlen(name), LX_NAMEMAX - 1);
 
-		ld->d_ino = sd->d_ino;
-		ld->d_off = sd->d_off;
-		(void) strncpy(ld->d_name, sd->d_name, namelen);
+		ld->d_ino = ino;
+		ld->d_off = off;
+		(void) strncpy(ld->d_name, name, namelen);
 		ld->d_name[namelen] = 0;
 		ld->d_reclen = (ushort_t)LX_RECLEN(namelen,
 		    struct lx_dirent_64);
 		/* Zero out any alignment padding and d_type */
 		bzero(ld->d_name + namelen,
 		    LX_ZEROLEN(namelen, struct lx_dirent_64));
+		LX_DTYPE(ld) = type;
 
-		if (is_sysfs) {
-			LX_DTYPE(ld) = lx_get_sysfs_dtype(ld->d_ino);
-		}
-
-		len -= sd->d_reclen;
+		len -= sreclen;
 		size += ld->d_reclen;
-		sbuf += sd->d_reclen;
+		sbuf += sreclen;
 		lbuf += ld->d_reclen;
 	}
 	return (size);
@@ -372,36 +429,37 @@ struct lx_dirent64 {
 	((offsetof(struct lx_dirent64, d_name) + (namelen))))
 
 static int
-lx_getdents64_format(caddr_t sbuf, caddr_t lbuf, int len, boolean_t is_sysfs)
+lx_getdents64_format(caddr_t sbuf, caddr_t lbuf, int len, int fmt)
 {
-	struct dirent *sd;
 	struct lx_dirent64 *ld;
 	int namelen;
 	int size = 0;
 
 	while (len > 0) {
-		/* LINTED: alignment */
-		sd = (struct dirent *)sbuf;
+		ino64_t ino;
+		off64_t off;
+		char *name;
+		uchar_t type;
+		int sreclen;
+
+		sreclen = lx_getdents_decode(sbuf, fmt, &ino, &off, &name,
+		    &type);
 		/* LINTED: alignment */
 		ld = (struct lx_dirent64 *)lbuf;
-		namelen = MIN(strlen(sd->d_name), LX_NAMEMAX - 1);
+		namelen = MIN(strlen(name), LX_NAMEMAX - 1);
 
-		ld->d_ino = sd->d_ino;
-		ld->d_off = sd->d_off;
-		ld->d_type = LX_DT_UNKNOWN;
-		(void) strncpy(ld->d_name, sd->d_name, namelen);
+		ld->d_ino = ino;
+		ld->d_off = off;
+		ld->d_type = type;
+		(void) strncpy(ld->d_name, name, namelen);
 		ld->d_name[namelen] = 0;
 		ld->d_reclen = (ushort_t)LX_RECLEN64(namelen);
 		/* Zero out any alignment padding */
 		bzero(ld->d_name + namelen, LX_ZEROLEN64(namelen));
 
-		if (is_sysfs) {
-			ld->d_type = lx_get_sysfs_dtype(ld->d_ino);
-		}
-
-		len -= sd->d_reclen;
+		len -= sreclen;
 		size += ld->d_reclen;
-		sbuf += sd->d_reclen;
+		sbuf += sreclen;
 		lbuf += ld->d_reclen;
 	}
 	return (size);
@@ -10,7 +10,7 @@
  */
 
 /*
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright 2020 OmniOS Community Edition (OmniOSce) Association.
  */
 
@@ -59,6 +59,7 @@
 #define	LX_IOC_TYPE_HD		0x03
 #define	LX_IOC_TYPE_BLK		0x12
 #define	LX_IOC_TYPE_FD		0x54
+#define	LX_IOC_TYPE_PERF	0x24
 #define	LX_IOC_TYPE_DTRACE	0x68
 #define	LX_IOC_TYPE_SOCK	0x89
 #define	LX_IOC_TYPE_AUTOFS	0x93
@@ -1778,6 +1779,15 @@ static lx_ioc_cmd_translator_t lx_ioc_xlate_hd[] = {
 	LX_IOC_CMD_TRANSLATOR_END
 };
 
+static lx_ioc_cmd_translator_t lx_ioc_xlate_perf[] = {
+	LX_IOC_CMD_TRANSLATOR_CUSTOM(LX_PERF_EVENT_IOC_ENABLE, lx_perf_ioctl)
+	LX_IOC_CMD_TRANSLATOR_CUSTOM(LX_PERF_EVENT_IOC_DISABLE, lx_perf_ioctl)
+	LX_IOC_CMD_TRANSLATOR_CUSTOM(LX_PERF_EVENT_IOC_RESET, lx_perf_ioctl)
+	LX_IOC_CMD_TRANSLATOR_CUSTOM(LX_PERF_EVENT_IOC_ID, lx_perf_ioctl)
+
+	LX_IOC_CMD_TRANSLATOR_END
+};
+
 static lx_ioc_cmd_translator_t lx_ioc_xlate_blk[] = {
 	LX_IOC_CMD_TRANSLATOR_CUSTOM(LX_BLKGETSIZE, ict_blkgetsize)
 	LX_IOC_CMD_TRANSLATOR_CUSTOM(LX_BLKSSZGET, ict_blkgetssize)
@@ -1868,6 +1878,10 @@ lx_ioctl(int fdes, int cmd, intptr_t arg)
 		ict = lx_ioc_xlate_hd;
 		break;
 
+	case LX_IOC_TYPE_PERF:
+		ict = lx_ioc_xlate_perf;
+		break;
+
 	default:
 		releasef(fdes);
 		return (set_errno(ENOTTY));
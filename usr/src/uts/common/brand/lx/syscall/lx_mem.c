@@ -23,6 +23,7 @@
 #include <sys/sysmacros.h>
 #include <sys/policy.h>
 #include <sys/lx_brand.h>
+#include <sys/lx_misc.h>
 #include <sys/fcntl.h>
 #include <sys/pathname.h>
 #include <vm/seg_vn.h>
@@ -380,6 +381,14 @@ lx_mmap_common(void *addr, size_t len, int prot, int flags, int fd, off64_t off)
 	if (flags & LX_MAP_ANONYMOUS)
 		fd = -1;
 
+	/*
+	 * The rings of an io_uring are mapped by mapping its fd; they already
+	 * exist, so hand back their address.
+	 */
+	if (fd != -1 &&
+	    (ret = lx_uring_mmap(fd, len, flags, off)) != NULL)
+		return (ret);
+
 	/*
 	 * We refuse, as a matter of principle, to overcommit memory.
 	 * Unfortunately, several bits of important and popular software expect
@@ -465,6 +474,8 @@ lx_munmap(void *addr, size_t len)
 	lx_remap_anoncache_invalidate((uintptr_t)addr, len);
 	mutex_exit(&lxpd->l_remap_anoncache_lock);
 
+	lx_uring_munmap((uintptr_t)addr, len);
+
 	return (munmap(addr, len));
 }
 
@@ -830,6 +841,42 @@ lx_remap_anon(lx_segmap_t *mapin, size_t new_size, uint_t flags,
 			hint = base;
 	}
 
+	/*
+	 * Where we know the destination, first try to move the existing pages
+	 * there rather than copying them.  Any growth is mapped beyond the
+	 * destination before the move, so that a failure can be backed out
+	 * without having disturbed the original mapping.
+	 */
+	if (hint != NULL && ((uintptr_t)hint >= m.lxsm_vaddr + m.lxsm_size ||
+	    (uintptr_t)hint + new_size <= m.lxsm_vaddr)) {
+		size_t movesz = MIN(m.lxsm_size, new_size);
+		caddr_t tail = (caddr_t)hint + movesz;
+
+		if (flags & LX_MREMAP_FIXED)
+			(void) munmap(hint, new_size);
+
+		if (movesz < new_size) {
+			addr = smmap64(tail, new_size - movesz, prot,
+			    mflags | MAP_FIXED, -1, 0);
+		}
+		if (ttolwp(curthread)->lwp_errno == 0) {
+			if (as_move(curproc->p_as, (caddr_t)m.lxsm_vaddr,
+			    movesz, hint) == 0) {
+				if (movesz < m.lxsm_size) {
+					(void) munmap((caddr_t)m.lxsm_vaddr +
+					    movesz, m.lxsm_size - movesz);
+				}
+				m.lxsm_vaddr = (uintptr_t)hint;
+				lx_remap_anoncache_load(&m, new_size);
+				return ((long)hint);
+			}
+			if (movesz < new_size)
+				(void) munmap(tail, new_size - movesz);
+		}
+		/* Fall back to copying, clearing any error from the above. */
+		ttolwp(curthread)->lwp_errno = 0;
+	}
+
 	addr = smmap64(hint, new_size, prot, mflags, -1, 0);
 	if (ttolwp(curthread)->lwp_errno != 0) {
 		return (ttolwp(curthread)->lwp_errno);
@@ -0,0 +1,140 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2019 Joyent, Inc.
+ */
+
+#include <sys/types.h>
+#include <sys/systm.h>
+#include <sys/proc.h>
+#include <sys/thread.h>
+#include <sys/cpuvar.h>
+#include <sys/x_call.h>
+#include <sys/atomic.h>
+#include <sys/lx_brand.h>
+
+/*
+ * membarrier(2)
+ *
+ * Linux provides membarrier so that a thread can force memory barriers on
+ * other threads, allowing the fast side of an asymmetric synchronization
+ * scheme (userspace RCU, for instance) to use plain compiler barriers.
+ *
+ * We implement it with cross-calls.  Once a CPU has taken (and returned from)
+ * the cross-call interrupt, any thread of the process which was running there
+ * has passed through a full memory barrier.  Threads which were not on a CPU
+ * will pass through one on their next context switch in.
+ */
+
+#define	LX_MEMBARRIER_CMD_QUERY				0x00
+#define	LX_MEMBARRIER_CMD_GLOBAL			0x01
+#define	LX_MEMBARRIER_CMD_GLOBAL_EXPEDITED		0x02
+#define	LX_MEMBARRIER_CMD_REGISTER_GLOBAL_EXPEDITED	0x04
+#define	LX_MEMBARRIER_CMD_PRIVATE_EXPEDITED		0x08
+#define	LX_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED	0x10
+
+#define	LX_MEMBARRIER_SUPPORTED	(LX_MEMBARRIER_CMD_GLOBAL |		\
+	LX_MEMBARRIER_CMD_PRIVATE_EXPEDITED |				\
+	LX_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED)
+
+/* ARGSUSED */
+static int
+lx_membarrier_xc(xc_arg_t arg1, xc_arg_t arg2, xc_arg_t arg3)
+{
+	membar_enter();
+	return (0);
+}
+
+static void
+lx_membarrier_cpus(cpuset_t *set)
+{
+	membar_enter();
+	if (!CPUSET_ISNULL(*set)) {
+		kpreempt_disable();
+		xc_call(0, 0, 0, CPUSET2BV(*set), lx_membarrier_xc);
+		kpreempt_enable();
+	}
+	membar_exit();
+}
+
+/*
+ * Issue a barrier on every CPU which is running a thread of this process,
+ * other than the calling thread.
+ */
+static void
+lx_membarrier_private(void)
+{
+	proc_t *p = curproc;
+	kthread_t *t;
+	cpuset_t set;
+
+	CPUSET_ZERO(set);
+
+	mutex_enter(&p->p_lock);
+	if ((t = p->p_tlist) != NULL) {
+		do {
+			if (t != curthread && t->t_state == TS_ONPROC) {
+				CPUSET_ADD(set, t->t_cpu->cpu_id);
+			}
+		} while ((t = t->t_forw) != p->p_tlist);
+	}
+	mutex_exit(&p->p_lock);
+
+	lx_membarrier_cpus(&set);
+}
+
+long
+lx_membarrier(int cmd, int flags)
+{
+	lx_proc_data_t *pd;
+	cpuset_t set;
+
+	if (flags != 0)
+		return (set_errno(EINVAL));
+
+	switch (cmd) {
+	case LX_MEMBARRIER_CMD_QUERY:
+		return (LX_MEMBARRIER_SUPPORTED);
+
+	case LX_MEMBARRIER_CMD_GLOBAL:
+		/*
+		 * Every thread on the system must have passed through a
+		 * barrier.  A cross-call to all other CPUs accomplishes that
+		 * without the grace period Linux waits out.
+		 */
+		CPUSET_ALL_BUT(set, CPU->cpu_id);
+		lx_membarrier_cpus(&set);
+		return (0);
+
+	case LX_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED:
+		mutex_enter(&curproc->p_lock);
+		VERIFY((pd = ptolxproc(curproc)) != NULL);
+		pd->l_flags |= LX_PROC_MEMBARRIER_PRIV;
+		mutex_exit(&curproc->p_lock);
+		return (0);
+
+	case LX_MEMBARRIER_CMD_PRIVATE_EXPEDITED:
+		mutex_enter(&curproc->p_lock);
+		VERIFY((pd = ptolxproc(curproc)) != NULL);
+		if ((pd->l_flags & LX_PROC_MEMBARRIER_PRIV) == 0) {
+			mutex_exit(&curproc->p_lock);
+			return (set_errno(EPERM));
+		}
+		mutex_exit(&curproc->p_lock);
+
+		lx_membarrier_private();
+		return (0);
+
+	default:
+		return (set_errno(EINVAL));
+	}
+}
@@ -10,7 +10,7 @@
  */
 
 /*
- * Copyright 2016 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/ctype.h>
@@ -566,6 +566,15 @@ lx_mount(const char *sourcep, const char *targetp, const char *fstypep,
 		 * Currently don't verify Linux mount options since we can
 		 * have a subsystem string provided.
 		 */
+	} else if (strcmp(fstype, "cgroup2") == 0) {
+		/*
+		 * The v2 unified hierarchy is provided by lx_cgroup, selected
+		 * with the 'unified' mount option.
+		 */
+		(void) strcpy(fstype, "lx_cgroup");
+		if ((rv = lx_mnt_add_opt("unified", options,
+		    sizeof (options))) != 0)
+			return (set_errno(rv));
 	} else if (strcmp(fstype, "autofs") == 0) {
 		/* Translate autofs mount requests to lxautofs requests. */
 		(void) strcpy(fstype, LX_AUTOFS_NAME);
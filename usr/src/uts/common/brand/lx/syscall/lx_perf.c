@@ -0,0 +1,578 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2020 Joyent, Inc.
+ */
+
+#include <sys/types.h>
+#include <sys/systm.h>
+#include <sys/errno.h>
+#include <sys/file.h>
+#include <sys/fcntl.h>
+#include <sys/vnode.h>
+#include <sys/vfs.h>
+#include <sys/vfs_opreg.h>
+#include <sys/uio.h>
+#include <sys/kmem.h>
+#include <sys/cmn_err.h>
+#include <sys/atomic.h>
+#include <sys/policy.h>
+#include <sys/sysmacros.h>
+#include <fs/fs_subr.h>
+#include <sys/kcpc.h>
+#include <sys/cpc_impl.h>
+#include <sys/lx_brand.h>
+#include <sys/lx_misc.h>
+
+/*
+ * perf_event_open(2)
+ *
+ * We provide counting-mode hardware events for the calling thread, backed by
+ * a thread-bound kcpc set.  This is the same facility that native libcpc
+ * uses for per-LWP counters, so the counters are virtualized across context
+ * switches by the existing kcpc context ops.
+ *
+ * A thread can only have one kcpc set bound to it, so each thread can have at
+ * most one perf event open at a time, and event groups are not supported.
+ * Since kcpc only samples the hardware on behalf of the thread which owns the
+ * counters, reads and ioctls from the owning thread see live values; any
+ * other thread sees the value as of the owner's last read or ioctl.
+ *
+ * Sampling (a non-zero sample_period) and the mmap ring buffer are not
+ * supported; those requests fail with EOPNOTSUPP and ENODEV respectively so
+ * that tools fall back to counting mode.
+ */
+
+#define	LX_PERF_TYPE_HARDWARE		0
+
+#define	LX_PERF_COUNT_HW_CPU_CYCLES		0
+#define	LX_PERF_COUNT_HW_INSTRUCTIONS		1
+#define	LX_PERF_COUNT_HW_CACHE_REFERENCES	2
+#define	LX_PERF_COUNT_HW_CACHE_MISSES		3
+#define	LX_PERF_COUNT_HW_BRANCH_INSTRUCTIONS	4
+#define	LX_PERF_COUNT_HW_BRANCH_MISSES		5
+
+#define	LX_PERF_FORMAT_TOTAL_TIME_ENABLED	0x1
+#define	LX_PERF_FORMAT_TOTAL_TIME_RUNNING	0x2
+#define	LX_PERF_FORMAT_ID			0x4
+#define	LX_PERF_FORMAT_GROUP			0x8
+
+#define	LX_PERF_FLAG_FD_NO_GROUP	0x1
+#define	LX_PERF_FLAG_FD_OUTPUT		0x2
+#define	LX_PERF_FLAG_PID_CGROUP		0x4
+#define	LX_PERF_FLAG_FD_CLOEXEC		0x8
+
+/* perf_event_attr flag bits */
+#define	LX_PERF_ATTR_DISABLED		(1ULL << 0)
+#define	LX_PERF_ATTR_INHERIT		(1ULL << 1)
+#define	LX_PERF_ATTR_EXCL_USER		(1ULL << 4)
+#define	LX_PERF_ATTR_EXCL_KERNEL	(1ULL << 5)
+#define	LX_PERF_ATTR_EXCL_HV		(1ULL << 6)
+#define	LX_PERF_ATTR_FREQ		(1ULL << 10)
+#define	LX_PERF_ATTR_ENABLE_ON_EXEC	(1ULL << 12)
+
+/* The flags which can be honored (or safely ignored) */
+#define	LX_PERF_ATTR_SUPPORTED	(LX_PERF_ATTR_DISABLED |		\
+	LX_PERF_ATTR_EXCL_USER | LX_PERF_ATTR_EXCL_KERNEL |		\
+	LX_PERF_ATTR_EXCL_HV)
+
+/*
+ * The version 0 attribute layout, which contains every field we look at.
+ * Newer, larger layouts are accepted as long as the fields we don't know
+ * about are zero.
+ */
+typedef struct lx_perf_event_attr {
+	uint32_t	lpa_type;
+	uint32_t	lpa_size;
+	uint64_t	lpa_config;
+	uint64_t	lpa_sample_period;
+	uint64_t	lpa_sample_type;
+	uint64_t	lpa_read_format;
+	uint64_t	lpa_flags;
+	uint32_t	lpa_wakeup_events;
+	uint32_t	lpa_bp_type;
+	uint64_t	lpa_config1;
+} lx_perf_event_attr_t;
+
+#define	LX_PERF_ATTR_SIZE_VER0	64
+#define	LX_PERF_ATTR_SIZE_MAX	PAGESIZE
+
+typedef struct lx_perf_event {
+	kmutex_t	lpe_lock;
+	vnode_t		*lpe_vnode;
+	uint64_t	lpe_id;		/* unique event ID */
+	uint64_t	lpe_read_format;
+	uint64_t	lpe_count;	/* last sampled counter value */
+	hrtime_t	lpe_time;	/* time enabled before lpe_start */
+	hrtime_t	lpe_start;	/* when enabled, or 0 if disabled */
+} lx_perf_event_t;
+
+/*
+ * The generic event names, in order of preference, for each of the Linux
+ * hardware events.
+ */
+static char *lx_perf_hw_events[][2] = {
+	{ "PAPI_tot_cyc", NULL },		/* CPU_CYCLES */
+	{ "PAPI_tot_ins", NULL },		/* INSTRUCTIONS */
+	{ "PAPI_l3_tca", "PAPI_l2_tca" },	/* CACHE_REFERENCES */
+	{ "PAPI_l3_tcm", "PAPI_l2_tcm" },	/* CACHE_MISSES */
+	{ "PAPI_br_ins", NULL },		/* BRANCH_INSTRUCTIONS */
+	{ "PAPI_br_msp", NULL }			/* BRANCH_MISSES */
+};
+
+static vnodeops_t *lx_perf_vnodeops;
+static uint64_t lx_perf_next_id;
+
+/*
+ * Return the calling thread's kcpc set if it is the one backing this event.
+ */
+static kcpc_set_t *
+lx_perf_owner_set(lx_perf_event_t *lpe)
+{
+	kcpc_set_t *set = curthread->t_cpc_set;
+
+	if (set != NULL && set->ks_nreqs == 1 &&
+	    set->ks_req[0].kr_ptr == (void *)(uintptr_t)lpe->lpe_id)
+		return (set);
+	return (NULL);
+}
+
+/*
+ * Refresh the cached count from the hardware if we are the owning thread.
+ */
+static void
+lx_perf_update(lx_perf_event_t *lpe)
+{
+	kcpc_set_t *set;
+	uint64_t val;
+
+	ASSERT(MUTEX_HELD(&lpe->lpe_lock));
+
+	if ((set = lx_perf_owner_set(lpe)) != NULL &&
+	    kcpc_sample_kernel(set, &val) == 0)
+		lpe->lpe_count = val;
+}
+
+static int
+lx_perf_enable(lx_perf_event_t *lpe, boolean_t enable)
+{
+	int error;
+
+	ASSERT(MUTEX_HELD(&lpe->lpe_lock));
+
+	if (lx_perf_owner_set(lpe) == NULL)
+		return (EINVAL);
+	if (enable == (lpe->lpe_start != 0))
+		return (0);
+
+	rw_enter(&kcpc_cpuctx_lock, RW_READER);
+	error = kcpc_enable(curthread, enable ? CPC_ENABLE : CPC_DISABLE, 0);
+	rw_exit(&kcpc_cpuctx_lock);
+	if (error != 0)
+		return (error);
+
+	if (enable) {
+		lpe->lpe_start = gethrtime();
+	} else {
+		lpe->lpe_time += gethrtime() - lpe->lpe_start;
+		lpe->lpe_start = 0;
+	}
+	lx_perf_update(lpe);
+	return (0);
+}
+
+static int
+lx_perf_reset(lx_perf_event_t *lpe)
+{
+	kcpc_set_t *set;
+	int error;
+
+	ASSERT(MUTEX_HELD(&lpe->lpe_lock));
+
+	if ((set = lx_perf_owner_set(lpe)) == NULL)
+		return (EINVAL);
+
+	if (lpe->lpe_start == 0) {
+		/*
+		 * The counter is frozen, and will be reloaded from the data
+		 * store when it is next enabled.
+		 */
+		*(set->ks_req[0].kr_data) = 0;
+	} else {
+		if ((error = kcpc_preset(set, 0, 0)) != 0)
+			return (error);
+		if ((error = kcpc_restart(set)) != 0)
+			return (error);
+	}
+	lpe->lpe_count = 0;
+	return (0);
+}
+
+/* ARGSUSED */
+int
+lx_perf_ioctl(file_t *fp, int cmd, intptr_t arg, int lxcmd)
+{
+	vnode_t *vp = fp->f_vnode;
+	lx_perf_event_t *lpe;
+	int error = 0;
+
+	if (vn_getops(vp) != lx_perf_vnodeops)
+		return (set_errno(ENOTTY));
+	lpe = vp->v_data;
+
+	mutex_enter(&lpe->lpe_lock);
+	switch (lxcmd) {
+	case LX_PERF_EVENT_IOC_ENABLE:
+		error = lx_perf_enable(lpe, B_TRUE);
+		break;
+	case LX_PERF_EVENT_IOC_DISABLE:
+		error = lx_perf_enable(lpe, B_FALSE);
+		break;
+	case LX_PERF_EVENT_IOC_RESET:
+		error = lx_perf_reset(lpe);
+		break;
+	case LX_PERF_EVENT_IOC_ID:
+		if (copyout(&lpe->lpe_id, (void *)arg, sizeof (uint64_t)) != 0)
+			error = EFAULT;
+		break;
+	default:
+		error = ENOTTY;
+		break;
+	}
+	mutex_exit(&lpe->lpe_lock);
+
+	return (error != 0 ? set_errno(error) : 0);
+}
+
+/* ARGSUSED */
+static int
+lx_perf_read(vnode_t *vp, uio_t *uio, int ioflag, cred_t *cr,
+    caller_context_t *ct)
+{
+	lx_perf_event_t *lpe = vp->v_data;
+	uint64_t vals[4];
+	hrtime_t enabled;
+	int n = 0;
+
+	mutex_enter(&lpe->lpe_lock);
+	lx_perf_update(lpe);
+	enabled = lpe->lpe_time;
+	if (lpe->lpe_start != 0)
+		enabled += gethrtime() - lpe->lpe_start;
+
+	vals[n++] = lpe->lpe_count;
+	/* The counter is never multiplexed, so it runs whenever enabled */
+	if (lpe->lpe_read_format & LX_PERF_FORMAT_TOTAL_TIME_ENABLED)
+		vals[n++] = (uint64_t)enabled;
+	if (lpe->lpe_read_format & LX_PERF_FORMAT_TOTAL_TIME_RUNNING)
+		vals[n++] = (uint64_t)enabled;
+	if (lpe->lpe_read_format & LX_PERF_FORMAT_ID)
+		vals[n++] = lpe->lpe_id;
+	mutex_exit(&lpe->lpe_lock);
+
+	/* Like Linux, refuse a buffer which can't hold the whole record */
+	if (uio->uio_resid < n * sizeof (uint64_t))
+		return (ENOSPC);
+
+	return (uiomove(vals, n * sizeof (uint64_t), UIO_READ, uio));
+}
+
+/* ARGSUSED */
+static int
+lx_perf_close(vnode_t *vp, int flag, int count, offset_t offset, cred_t *cr,
+    caller_context_t *ct)
+{
+	lx_perf_event_t *lpe = vp->v_data;
+	kcpc_set_t *set;
+
+	if (count > 1)
+		return (0);
+
+	/*
+	 * If the owning thread closes the event we can release its counters.
+	 * Otherwise they stay bound until the owner exits.
+	 */
+	mutex_enter(&lpe->lpe_lock);
+	if ((set = lx_perf_owner_set(lpe)) != NULL)
+		(void) kcpc_unbind(set);
+	mutex_exit(&lpe->lpe_lock);
+
+	return (0);
+}
+
+/* ARGSUSED */
+static int
+lx_perf_getattr(vnode_t *vp, vattr_t *vap, int flags, cred_t *cr,
+    caller_context_t *ct)
+{
+	lx_perf_event_t *lpe = vp->v_data;
+
+	bzero(vap, sizeof (*vap));
+	vap->va_type = VNON;
+	vap->va_mode = 0600;
+	vap->va_uid = crgetuid(cr);
+	vap->va_gid = crgetgid(cr);
+	vap->va_nodeid = lpe->lpe_id;
+	vap->va_nlink = 1;
+	vap->va_blksize = PAGESIZE;
+	return (0);
+}
+
+/* ARGSUSED */
+static void
+lx_perf_inactive(vnode_t *vp, cred_t *cr, caller_context_t *ct)
+{
+	lx_perf_event_t *lpe = vp->v_data;
+
+	mutex_enter(&vp->v_lock);
+	ASSERT(vp->v_count >= 1);
+	if (--vp->v_count != 0) {
+		mutex_exit(&vp->v_lock);
+		return;
+	}
+	mutex_exit(&vp->v_lock);
+
+	vn_free(vp);
+	mutex_destroy(&lpe->lpe_lock);
+	kmem_free(lpe, sizeof (*lpe));
+}
+
+static const fs_operation_def_t lx_perf_vnodeops_template[] = {
+	VOPNAME_READ,		{ .vop_read = lx_perf_read },
+	VOPNAME_CLOSE,		{ .vop_close = lx_perf_close },
+	VOPNAME_GETATTR,	{ .vop_getattr = lx_perf_getattr },
+	VOPNAME_INACTIVE,	{ .vop_inactive = lx_perf_inactive },
+	VOPNAME_MAP,		{ .error = fs_nodev },
+	NULL,			NULL
+};
+
+/*
+ * Copy in the caller's attributes, checking that any part of a newer layout
+ * which we don't understand is zeroed.
+ */
+static int
+lx_perf_copyin_attr(void *uattr, lx_perf_event_attr_t *attr)
+{
+	uint8_t buf[LX_PERF_ATTR_SIZE_VER0];
+	uint32_t size;
+	size_t off, len, i;
+
+	if (copyin((uint8_t *)uattr + offsetof(lx_perf_event_attr_t, lpa_size),
+	    &size, sizeof (size)) != 0)
+		return (EFAULT);
+
+	if (size == 0)
+		size = LX_PERF_ATTR_SIZE_VER0;
+	if (size < LX_PERF_ATTR_SIZE_VER0 || size > LX_PERF_ATTR_SIZE_MAX)
+		return (E2BIG);
+
+	if (copyin(uattr, attr, sizeof (*attr)) != 0)
+		return (EFAULT);
+
+	for (off = sizeof (*attr); off < size; off += len) {
+		len = MIN(sizeof (buf), size - off);
+		if (copyin((uint8_t *)uattr + off, buf, len) != 0)
+			return (EFAULT);
+		for (i = 0; i < len; i++) {
+			if (buf[i] != 0)
+				return (E2BIG);
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * Build a set counting the requested hardware event and bind it to the
+ * calling thread.
+ */
+static int
+lx_perf_bind(lx_perf_event_t *lpe, lx_perf_event_attr_t *attr)
+{
+	kcpc_set_t *set;
+	kcpc_request_t *rp;
+	char *event = NULL;
+	int i, subcode, error;
+
+	if (attr->lpa_config >= ARRAY_SIZE(lx_perf_hw_events))
+		return (ENOENT);
+	if (kcpc_pcbe_loaded() == 0)
+		return (ENOENT);
+	for (i = 0; i < 2; i++) {
+		char *ev = lx_perf_hw_events[attr->lpa_config][i];
+
+		if (ev != NULL && kcpc_event_supported(ev)) {
+			event = ev;
+			break;
+		}
+	}
+	if (event == NULL)
+		return (ENOENT);
+
+	set = kmem_zalloc(sizeof (kcpc_set_t), KM_SLEEP);
+	set->ks_req = kmem_zalloc(sizeof (kcpc_request_t), KM_SLEEP);
+	set->ks_nreqs = 1;
+	set->ks_flags = 0;
+
+	rp = &set->ks_req[0];
+	rp->kr_picnum = -1;
+	rp->kr_index = 0;
+	(void) strlcpy(rp->kr_event, event, CPC_MAX_EVENT_LEN);
+	rp->kr_ptr = (void *)(uintptr_t)lpe->lpe_id;
+	if ((attr->lpa_flags & LX_PERF_ATTR_EXCL_USER) == 0)
+		rp->kr_flags |= CPC_COUNT_USER;
+	if ((attr->lpa_flags & LX_PERF_ATTR_EXCL_KERNEL) == 0)
+		rp->kr_flags |= CPC_COUNT_SYSTEM;
+
+	/*
+	 * As with the default Linux perf_event_paranoid setting, counting
+	 * kernel events requires privilege.
+	 */
+	if ((rp->kr_flags & CPC_COUNT_SYSTEM) != 0 &&
+	    secpolicy_cpc_cpu(CRED()) != 0) {
+		kcpc_free_set(set);
+		return (EACCES);
+	}
+	if (rp->kr_flags == 0) {
+		kcpc_free_set(set);
+		return (EINVAL);
+	}
+
+	rw_enter(&kcpc_cpuctx_lock, RW_READER);
+	if (kcpc_cpuctx || dtrace_cpc_in_use) {
+		rw_exit(&kcpc_cpuctx_lock);
+		kcpc_free_set(set);
+		return (EBUSY);
+	}
+	if (kcpc_hw_lwp_hook() != 0) {
+		rw_exit(&kcpc_cpuctx_lock);
+		kcpc_free_set(set);
+		return (EACCES);
+	}
+	if (curthread->t_cpc_set != NULL) {
+		rw_exit(&kcpc_cpuctx_lock);
+		kcpc_free_set(set);
+		return (EBUSY);
+	}
+
+	curthread->t_cpc_set = set;
+	if ((error = kcpc_bind_thread(set, curthread, &subcode)) != 0) {
+		curthread->t_cpc_set = NULL;
+		rw_exit(&kcpc_cpuctx_lock);
+		kcpc_free_set(set);
+		return (error);
+	}
+
+	/* Counters start out running; freeze them if asked to */
+	if ((attr->lpa_flags & LX_PERF_ATTR_DISABLED) != 0) {
+		VERIFY0(kcpc_enable(curthread, CPC_DISABLE, 0));
+	} else {
+		lpe->lpe_start = gethrtime();
+	}
+	rw_exit(&kcpc_cpuctx_lock);
+
+	return (0);
+}
+
+long
+lx_perf_event_open(void *uattr, pid_t pid, int cpu, int group_fd,
+    ulong_t flags)
+{
+	lx_perf_event_attr_t attr;
+	lx_perf_event_t *lpe;
+	vnode_t *vp;
+	file_t *fp;
+	int fd, error;
+
+	if (lx_perf_vnodeops == NULL)
+		return (set_errno(ENOSYS));
+	if ((flags & ~(LX_PERF_FLAG_FD_NO_GROUP | LX_PERF_FLAG_FD_CLOEXEC)) !=
+	    0)
+		return (set_errno(EINVAL));
+
+	if ((error = lx_perf_copyin_attr(uattr, &attr)) != 0)
+		return (set_errno(error));
+
+	/* Only the calling thread can be measured */
+	if (cpu != -1 || group_fd != -1)
+		return (set_errno(EINVAL));
+	if (pid != 0) {
+		pid_t spid;
+		id_t stid;
+
+		if (lx_lpid_to_spair(pid, &spid, &stid) < 0)
+			return (set_errno(ESRCH));
+		if (spid != curproc->p_pid || stid != curthread->t_tid)
+			return (set_errno(EINVAL));
+	}
+
+	if (attr.lpa_type != LX_PERF_TYPE_HARDWARE)
+		return (set_errno(ENOENT));
+	if (attr.lpa_sample_period != 0 ||
+	    (attr.lpa_flags & LX_PERF_ATTR_FREQ) != 0)
+		return (set_errno(EOPNOTSUPP));
+	if ((attr.lpa_flags & ~LX_PERF_ATTR_SUPPORTED) != 0)
+		return (set_errno(EINVAL));
+	if ((attr.lpa_read_format & ~(LX_PERF_FORMAT_TOTAL_TIME_ENABLED |
+	    LX_PERF_FORMAT_TOTAL_TIME_RUNNING | LX_PERF_FORMAT_ID)) != 0)
+		return (set_errno(EINVAL));
+
+	lpe = kmem_zalloc(sizeof (*lpe), KM_SLEEP);
+	mutex_init(&lpe->lpe_lock, NULL, MUTEX_DEFAULT, NULL);
+	lpe->lpe_id = atomic_inc_64_nv(&lx_perf_next_id);
+	lpe->lpe_read_format = attr.lpa_read_format;
+
+	if ((error = lx_perf_bind(lpe, &attr)) != 0) {
+		mutex_destroy(&lpe->lpe_lock);
+		kmem_free(lpe, sizeof (*lpe));
+		return (set_errno(error));
+	}
+
+	vp = vn_alloc(KM_SLEEP);
+	vn_setops(vp, lx_perf_vnodeops);
+	vp->v_type = VNON;
+	vp->v_vfsp = rootvfs;
+	vp->v_data = lpe;
+	lpe->lpe_vnode = vp;
+	vn_exists(vp);
+
+	if (falloc(vp, FREAD, &fp, &fd) != 0) {
+		mutex_enter(&lpe->lpe_lock);
+		(void) kcpc_unbind(curthread->t_cpc_set);
+		mutex_exit(&lpe->lpe_lock);
+		VN_RELE(vp);
+		return (set_errno(EMFILE));
+	}
+	mutex_exit(&fp->f_tlock);
+	setf(fd, fp);
+	if (flags & LX_PERF_FLAG_FD_CLOEXEC)
+		f_setfd(fd, FD_CLOEXEC);
+
+	return (fd);
+}
+
+void
+lx_perf_init(void)
+{
+	if (vn_make_ops("lx_perf", lx_perf_vnodeops_template,
+	    &lx_perf_vnodeops) != 0)
+		cmn_err(CE_WARN, "lx_perf_init: bad vnode ops template");
+}
+
+void
+lx_perf_fini(void)
+{
+	if (lx_perf_vnodeops != NULL) {
+		vn_freevnodeops(lx_perf_vnodeops);
+		lx_perf_vnodeops = NULL;
+	}
+}
@@ -298,6 +298,7 @@ static lx_flag_map_t lx_flag_map_tbl[] = {
 	{ LXFM_MAP,	MSG_DONTWAIT,		LX_MSG_DONTWAIT,	NULL },
 	{ LXFM_MAP,	MSG_EOR,		LX_MSG_EOR,		NULL },
 	{ LXFM_MAP,	MSG_WAITALL,		LX_MSG_WAITALL,		NULL },
+	{ LXFM_MAP,	MSG_FASTOPEN,		LX_MSG_FASTOPEN,	NULL },
 	/* MSG_CONFIRM is safe to ignore */
 	{ LXFM_IGNORE,	0,			LX_MSG_CONFIRM,		NULL },
 	/*
@@ -313,7 +314,6 @@ static lx_flag_map_t lx_flag_map_tbl[] = {
 	{ LXFM_UNSUP,	LX_MSG_ERRQUEUE,	0,	"MSG_ERRQUEUE" },
 	{ LXFM_UNSUP,	LX_MSG_MORE,		0,	"MSG_MORE" },
 	{ LXFM_UNSUP,	LX_MSG_WAITFORONE,	0,	"MSG_WAITFORONE" },
-	{ LXFM_UNSUP,	LX_MSG_FASTOPEN,	0,	"MSG_FASTOPEN" },
 };
 
 #define	LX_FLAG_MAP_MAX	\
@@ -2833,7 +2833,7 @@ static const lx_sockopt_map_t ltos_tcp_sockopts[LX_TCP_NOTSENT_LOWAT + 1] = {
 	{ OPTNOTSUP, 0 },			/* TCP_REPAIR_QUEUE	*/
 	{ OPTNOTSUP, 0 },			/* TCP_QUEUE_SEQ	*/
 	{ OPTNOTSUP, 0 },			/* TCP_REPAIR_OPTIONS	*/
-	{ OPTNOTSUP, 0 },			/* TCP_FASTOPEN		*/
+	{ TCP_FASTOPEN, sizeof (int) },		/* TCP_FASTOPEN		*/
 	{ OPTNOTSUP, 0 },			/* TCP_TIMESTAMP	*/
 	{ OPTNOTSUP, 0 }			/* TCP_NOTSENT_LOWAT	*/
 };
@@ -2921,7 +2921,7 @@ static const lx_sockopt_map_t ltos_socket_sockopts[LX_SO_BPF_EXTENSIONS + 1] = {
 	{ OPTNOTSUP, 0 },		/* SO_LOCK_FILTER		*/
 	{ OPTNOTSUP, 0 },		/* SO_SELECT_ERR_QUEUE		*/
 	{ OPTNOTSUP, 0 },		/* SO_BUSY_POLL			*/
-	{ OPTNOTSUP, 0 },		/* SO_MAX_PACING_RATE		*/
+	{ SO_MAX_PACING_RATE, sizeof (int) }, /* SO_MAX_PACING_RATE	*/
 	{ OPTNOTSUP, 0 }		/* SO_BPF_EXTENSIONS		*/
 };
 
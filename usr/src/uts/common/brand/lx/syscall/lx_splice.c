@@ -10,7 +10,7 @@
  */
 
 /*
- * Copyright 2017, Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/types.h>
@@ -40,6 +40,14 @@
  */
 #define	LX_SPL_BUF_SIZE		(32 * 1024)
 
+/*
+ * copy_file_range moves data in chunks of this size.  Since neither end is a
+ * pipe there is no reason to keep it small, and a chunk which covers whole
+ * records of the default ZFS recordsize lets a copy into a new file be written
+ * without any read-modify-write of partial blocks.
+ */
+#define	LX_CFR_BUF_SIZE		(128 * 1024)
+
 /*
  * We only want to read as much from the input fd as we can write into the
  * output fd, up to our buffer size. Figure out what that quantity is.
@@ -489,3 +497,149 @@ done:
 
 	return (total);
 }
+
+/*
+ * Copy a range of one regular file to another without the data passing
+ * through user space.  The data moves through a single kernel buffer using
+ * our normal read and write paths, just as for splice, but with the Linux
+ * copy_file_range semantics: neither descriptor may be a pipe, the output
+ * may not be opened for append, and a copy within one file may not overlap
+ * itself.  Offsets are taken from (and returned to) off_in and off_out when
+ * given, otherwise from the file offsets, which are only updated once the
+ * copy is done so that a short write does not leave the input offset ahead
+ * of the data actually copied.
+ */
+long
+lx_copy_file_range(int fd_in, off_t *off_in, int fd_out, off_t *off_out,
+    size_t len, uint_t flags)
+{
+	int error = 0;
+	file_t *fp_in = NULL, *fp_out = NULL;
+	iovec_t iov;
+	uio_t uio;
+	void *buf = NULL;
+	off_t r_off, w_off;
+	size_t bsize = 0, nread, nwrite, total = 0;
+
+	if (flags != 0)
+		return (set_errno(EINVAL));
+
+	if ((fp_in = getf(fd_in)) == NULL) {
+		error = EBADF;
+		goto done;
+	}
+	if ((fp_out = getf(fd_out)) == NULL) {
+		error = EBADF;
+		goto done;
+	}
+	if ((fp_in->f_flag & FREAD) == 0 || (fp_out->f_flag & FWRITE) == 0 ||
+	    (fp_out->f_flag & FAPPEND) != 0) {
+		error = EBADF;
+		goto done;
+	}
+	if (fp_in->f_vnode->v_type == VDIR || fp_out->f_vnode->v_type == VDIR) {
+		error = EISDIR;
+		goto done;
+	}
+	if (fp_in->f_vnode->v_type != VREG || fp_out->f_vnode->v_type != VREG) {
+		error = EINVAL;
+		goto done;
+	}
+
+	if (off_in != NULL) {
+		if (copyin(off_in, &r_off, sizeof (r_off)) != 0) {
+			error = EFAULT;
+			goto done;
+		}
+	} else {
+		r_off = fp_in->f_offset;
+	}
+	if (off_out != NULL) {
+		if (copyin(off_out, &w_off, sizeof (w_off)) != 0) {
+			error = EFAULT;
+			goto done;
+		}
+	} else {
+		w_off = fp_out->f_offset;
+	}
+	if (r_off < 0 || w_off < 0) {
+		error = EINVAL;
+		goto done;
+	}
+
+	if (fp_in->f_vnode == fp_out->f_vnode &&
+	    r_off < w_off + len && w_off < r_off + len) {
+		error = EINVAL;
+		goto done;
+	}
+
+	if (len == 0)
+		goto done;
+
+	bsize = MIN(LX_CFR_BUF_SIZE, len);
+
+	buf = kmem_alloc(bsize, KM_SLEEP);
+	bzero(&uio, sizeof (uio));
+	uio.uio_iovcnt = 1;
+	uio.uio_iov = &iov;
+	uio.uio_segflg = UIO_SYSSPACE;
+	uio.uio_llimit = curproc->p_fsz_ctl;
+
+	while (len > 0) {
+		uio.uio_resid = iov.iov_len = MIN(bsize, len);
+		iov.iov_base = buf;
+		uio.uio_offset = r_off;
+		uio.uio_extflg = UIO_COPY_CACHED;
+		uio.uio_fmode = fp_in->f_flag;
+		error = lx_read_common(fp_in, &uio, &nread, B_TRUE);
+		if (error != 0 || nread == 0)
+			break;
+
+		uio.uio_resid = iov.iov_len = nread;
+		iov.iov_base = buf;
+		uio.uio_offset = w_off;
+		uio.uio_extflg = UIO_COPY_DEFAULT;
+		uio.uio_fmode = fp_out->f_flag;
+		error = lx_write_common(fp_out, &uio, &nwrite, B_TRUE);
+
+		r_off += nwrite;
+		w_off += nwrite;
+		total += nwrite;
+		len -= nwrite;
+		if (error != 0 || nwrite < nread)
+			break;
+	}
+
+	/*
+	 * As with read and write, an error after some data has been copied
+	 * is not reported; the caller sees the short count instead.
+	 */
+	if (total != 0)
+		error = 0;
+
+	if (off_in != NULL) {
+		if (copyout(&r_off, off_in, sizeof (r_off)) != 0 && error == 0)
+			error = EFAULT;
+	} else {
+		fp_in->f_offset = r_off;
+	}
+	if (off_out != NULL) {
+		if (copyout(&w_off, off_out, sizeof (w_off)) != 0 &&
+		    error == 0)
+			error = EFAULT;
+	} else {
+		fp_out->f_offset = w_off;
+	}
+
+done:
+	if (buf != NULL)
+		kmem_free(buf, bsize);
+	if (fp_in != NULL)
+		releasef(fd_in);
+	if (fp_out != NULL)
+		releasef(fd_out);
+	if (error != 0)
+		return (set_errno(error));
+
+	return (total);
+}
@@ -86,7 +86,7 @@ static lx_clock_backend_t lx_clock_backends[] = {
 	EMUL(CLOCK_PROCESS_CPUTIME_ID),	/* LX_CLOCK_PROCESS_CPUTIME_ID */
 	EMUL(CLOCK_THREAD_CPUTIME_ID),	/* LX_CLOCK_THREAD_CPUTIME_ID */
 	NATIVE(CLOCK_HIGHRES),		/* LX_CLOCK_MONOTONIC_RAW */
-	NATIVE(CLOCK_REALTIME),		/* LX_CLOCK_REALTIME_COARSE */
+	EMUL(CLOCK_REALTIME),		/* LX_CLOCK_REALTIME_COARSE */
 	NATIVE(CLOCK_HIGHRES),		/* LX_CLOCK_MONOTONIC_COARSE */
 	NATIVE(CLOCK_HIGHRES)		/* LX_CLOCK_BOOTTIME */
 };
@@ -165,6 +165,16 @@ lx_emul_clock_gettime(clockid_t clock, timespec_t *tp)
 	timespec_t t;
 
 	switch (clock) {
+	case CLOCK_REALTIME:
+		/*
+		 * Only LX_CLOCK_REALTIME_COARSE is emulated this way.  Callers
+		 * of the coarse clock ask for speed over precision, so rather
+		 * than reading the TSC (and possibly spinning on the hres lock)
+		 * return the time as of the last clock tick.
+		 */
+		gethrestime_lasttick(&t);
+		break;
+
 	case CLOCK_PROCESS_CPUTIME_ID: {
 		proc_t *p = ttoproc(curthread);
 		hrtime_t snsecs, unsecs;
@@ -237,6 +247,12 @@ lx_emul_clock_getres(clockid_t clock, timespec_t *tp)
 	}
 
 	switch (clock) {
+	case CLOCK_REALTIME:
+		/* LX_CLOCK_REALTIME_COARSE only advances each clock tick */
+		t.tv_sec = 0;
+		t.tv_nsec = nsec_per_tick;
+		break;
+
 	case CLOCK_PROCESS_CPUTIME_ID:
 	case CLOCK_THREAD_CPUTIME_ID:
 		/*
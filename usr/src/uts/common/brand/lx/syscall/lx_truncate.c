@@ -0,0 +1,194 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2019 Joyent, Inc.
+ */
+
+#include <sys/systm.h>
+#include <sys/types.h>
+#include <sys/file.h>
+#include <sys/fcntl.h>
+#include <sys/vnode.h>
+#include <sys/nbmlock.h>
+#include <sys/proc.h>
+#include <sys/lx_impl.h>
+#include <sys/lx_brand.h>
+
+extern int flock_check(vnode_t *, flock64_t *, offset_t, offset_t);
+
+/*
+ * Set the size of an open regular file, as the native F_FREESP fcntl does.
+ *
+ * ZFS does not enforce the process.max-file-size rctl on a file which is
+ * grown via truncate/ftruncate, since that is simply metadata which does not
+ * consume any additional space.  Linux does (and LTP truncate03 depends on
+ * this behavior) so we enforce it here.
+ */
+static int
+lx_truncate_vp(vnode_t *vp, offset_t length, int flag, offset_t offset,
+    cred_t *cr)
+{
+	struct flock64 bf;
+	vattr_t vattr;
+	boolean_t in_crit = B_FALSE;
+	int error;
+
+	if (vp->v_type == VDIR)
+		return (EISDIR);
+	if (vp->v_type != VREG)
+		return (EINVAL);
+
+	vattr.va_mask = AT_SIZE;
+	if ((error = VOP_GETATTR(vp, &vattr, 0, cr, NULL)) != 0)
+		return (error);
+	if ((u_offset_t)length > vattr.va_size &&
+	    (rlim64_t)length > curproc->p_fsz_ctl)
+		return (EFBIG);
+
+	bzero(&bf, sizeof (bf));
+	bf.l_whence = 0;
+	bf.l_start = length;
+	bf.l_len = 0;
+
+	if ((error = flock_check(vp, &bf, offset, MAXOFFSET_T)) != 0)
+		return (error);
+
+	/*
+	 * Make sure that there are no conflicting non-blocking mandatory
+	 * locks in the region being manipulated.
+	 */
+	if (nbl_need_check(vp)) {
+		u_offset_t begin;
+		ssize_t len;
+
+		nbl_start_crit(vp, RW_READER);
+		in_crit = B_TRUE;
+		vattr.va_mask = AT_SIZE;
+		if ((error = VOP_GETATTR(vp, &vattr, 0, cr, NULL)) != 0)
+			goto done;
+		begin = MIN((u_offset_t)length, vattr.va_size);
+		len = ((u_offset_t)length > vattr.va_size) ?
+		    length - vattr.va_size : vattr.va_size - length;
+		if (nbl_conflict(vp, NBL_WRITE, begin, len, 0, NULL)) {
+			error = EACCES;
+			goto done;
+		}
+	}
+
+	error = VOP_SPACE(vp, F_FREESP, &bf, flag, offset, cr, NULL);
+
+done:
+	if (in_crit)
+		nbl_end_crit(vp);
+	return (error);
+}
+
+static long
+lx_truncate_common(char *path, offset_t length)
+{
+	vnode_t *vp;
+	int error;
+
+	if (length < 0)
+		return (set_errno(EINVAL));
+
+	if ((error = vn_open(path, UIO_USERSPACE, FWRITE, 0, &vp, 0, 0)) != 0)
+		return (set_errno(error));
+
+	error = lx_truncate_vp(vp, length, FWRITE, 0, CRED());
+
+	(void) VOP_CLOSE(vp, FWRITE, 1, (offset_t)0, CRED(), NULL);
+	VN_RELE(vp);
+
+	if (error != 0)
+		return (set_errno(error));
+	return (0);
+}
+
+static long
+lx_ftruncate_common(int fd, offset_t length)
+{
+	file_t *fp;
+	int error;
+
+	if (length < 0)
+		return (set_errno(EINVAL));
+
+	if ((fp = getf(fd)) == NULL)
+		return (set_errno(EBADF));
+
+	/*
+	 * On Linux, truncating a file which is not open for writing returns
+	 * EINVAL, whereas illumos returns EBADF.
+	 */
+	if ((fp->f_flag & FWRITE) == 0) {
+		error = EINVAL;
+	} else {
+		error = lx_truncate_vp(fp->f_vnode, length, fp->f_flag,
+		    fp->f_offset, fp->f_cred);
+	}
+
+	releasef(fd);
+	if (error != 0)
+		return (set_errno(error));
+	return (0);
+}
+
+long
+lx_truncate(char *path, off_t length)
+{
+	return (lx_truncate_common(path, (offset_t)length));
+}
+
+long
+lx_ftruncate(int fd, off_t length)
+{
+	return (lx_ftruncate_common(fd, (offset_t)length));
+}
+
+/*
+ * 32-bit callers pass a (signed) 32-bit length to truncate and ftruncate, and
+ * split the 64-bit length across two arguments for truncate64/ftruncate64.
+ */
+long
+lx_truncate32(char *path, int32_t length)
+{
+	return (lx_truncate_common(path, (offset_t)length));
+}
+
+long
+lx_ftruncate32(int fd, int32_t length)
+{
+	return (lx_ftruncate_common(fd, (offset_t)length));
+}
+
+long
+lx_truncate64(char *path, uint32_t len_lo, uint32_t len_hi)
+{
+	const uint64_t len = ((uint64_t)len_hi << 32) | len_lo;
+
+	if (len >= (uint64_t)MAXOFFSET_T)
+		return (set_errno(EFBIG));
+
+	return (lx_truncate_common(path, (offset_t)len));
+}
+
+long
+lx_ftruncate64(int fd, uint32_t len_lo, uint32_t len_hi)
+{
+	const uint64_t len = ((uint64_t)len_hi << 32) | len_lo;
+
+	if (len >= (uint64_t)MAXOFFSET_T)
+		return (set_errno(EFBIG));
+
+	return (lx_ftruncate_common(fd, (offset_t)len));
+}
@@ -263,7 +263,7 @@ aui_null,	AUE_NULL,	aus_null,	/* 28 fstat */
 		auf_null,	0,
 aui_null,	AUE_NULL,	aus_null,	/* 29 pause */
 		auf_null,	0,
-aui_null,	AUE_NULL,	aus_null,	/* 30 (loadable) was utime */
+aui_null,	AUE_NULL,	aus_null,	/* 30 recvmmsg */
 		auf_null,	0,
 aui_null,	AUE_NULL,	aus_null,	/* 31 stty (TIOCSETP-audit?) */
 		auf_null,	0,
@@ -360,7 +360,7 @@ aui_null,	AUE_NULL,	aus_null,	/* 74 rctlsys */
 		auf_null,	0,
 aui_null,	AUE_NULL,	aus_null,	/* 75 sidsys */
 		auf_null,	0,
-aui_null,	AUE_NULL,	aus_null,	/* 76 (loadable) was fsat */
+aui_null,	AUE_NULL,	aus_null,	/* 76 sendmmsg */
 		auf_null,	0,
 aui_null,	AUE_NULL,	aus_null,	/* 77 syslwp_park */
 		auf_null,	0,
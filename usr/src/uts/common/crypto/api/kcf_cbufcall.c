@@ -22,6 +22,7 @@
 /*
  * Copyright 2003 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #pragma ident	"%Z%%M%	%I%	%E% SMI"
@@ -194,10 +195,10 @@ crypto_unbufcall(crypto_bc_t bc)
 }
 
 /*
- * We sample the number of jobs. We do not hold the lock
+ * We sample the number of jobs. We do not hold the locks
  * as it is not necessary to get the exact count.
  */
-#define	KCF_GSWQ_AVAIL	(gswq->gs_maxjobs - gswq->gs_njobs)
+#define	KCF_GSWQ_AVAIL	kcf_swq_avail()
 
 /*
  * One queue space each for init, update, and final.
@@ -24,6 +24,7 @@
 
 /*
  * Copyright 2011 Nexenta Systems, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -54,13 +55,35 @@
 #include <sys/sunddi.h>
 
 
-kcf_global_swq_t *gswq;	/* Global software queue */
+/*
+ * Software provider queues. Asynchronous requests for software providers
+ * are queued on the queue of the submitting CPU (modulo kcf_nswq), and each
+ * queue has its own lock and its own threads, so that CPUs submitting
+ * requests concurrently do not all contend for a single queue lock. A
+ * thread whose own queue is empty helps out with the others before going
+ * to sleep. Each queue is padded out to a cache line.
+ */
+#define	KCF_SWQ_SLOTSIZE	P2ROUNDUP(sizeof (kcf_global_swq_t), 64)
+
+typedef union kcf_swq_slot {
+	kcf_global_swq_t	ss_swq;
+	char			ss_pad[KCF_SWQ_SLOTSIZE];
+} kcf_swq_slot_t;
+
+static kcf_swq_slot_t *kcf_swqs;
+kcf_global_swq_t *gswq;		/* First software queue */
+uint_t kcf_nswq;		/* Number of software queues */
+uint_t kcf_swq_max = 32;	/* Boot-time tunable: most queues */
+
+#define	KCF_SWQ(i)	(&kcf_swqs[(i)].ss_swq)
+#define	KCF_SWQ_INDEX(swq)	((kcf_swq_slot_t *)(swq) - kcf_swqs)
 
 /* Thread pool related variables */
 static kcf_pool_t *kcfpool;	/* Thread pool of kcfd LWPs */
 int kcf_maxthreads = 2;
 int kcf_minthreads = 1;
 int kcf_thr_multiple = 2;	/* Boot-time tunable for experimentation */
+static int kcf_swq_minthreads = 1;	/* Threads kept for each queue */
 static ulong_t	kcf_idlethr_timeout;
 static boolean_t kcf_sched_running = B_FALSE;
 #define	KCF_DEFAULT_THRTIMEOUT	60000000	/* 60 seconds */
@@ -93,7 +116,8 @@ static kcf_areq_node_t *kcf_areqnode_alloc(kcf_provider_desc_t *,
     kcf_context_t *, crypto_call_req_t *, kcf_req_params_t *, boolean_t);
 static int kcf_disp_sw_request(kcf_areq_node_t *);
 static void process_req_hwp(void *);
-static kcf_areq_node_t	*kcf_dequeue(void);
+static kcf_areq_node_t	*kcf_dequeue(kcf_global_swq_t *);
+static kcf_areq_node_t	*kcf_dequeue_other(kcf_global_swq_t *);
 static int kcf_enqueue(kcf_areq_node_t *);
 static void kcfpool_alloc(void);
 static void kcf_reqid_delete(kcf_areq_node_t *areq);
@@ -165,6 +189,7 @@ kcf_areqnode_alloc(kcf_provider_desc_t *pd, kcf_context_t *ictx,
 	arptr->an_isdual = isdual;
 
 	arptr->an_next = arptr->an_prev = NULL;
+	arptr->an_swq = KCF_SWQ(CPU->cpu_seqid % kcf_nswq);
 	KCF_PROV_REFHOLD(pd);
 	arptr->an_provider = pd;
 	arptr->an_tried_plist = NULL;
@@ -208,16 +233,17 @@ kcf_areqnode_alloc(kcf_provider_desc_t *pd, kcf_context_t *ictx,
 static int
 kcf_disp_sw_request(kcf_areq_node_t *areq)
 {
+	kcf_global_swq_t *swq = areq->an_swq;
 	int err;
 
 	if ((err = kcf_enqueue(areq)) != 0)
 		return (err);
 
-	if (kcfpool->kp_idlethreads > 0) {
-		/* Signal an idle thread to run */
-		mutex_enter(&gswq->gs_lock);
-		cv_signal(&gswq->gs_cv);
-		mutex_exit(&gswq->gs_lock);
+	if (swq->gs_idlethreads > 0) {
+		/* Signal an idle thread of the queue to run */
+		mutex_enter(&swq->gs_lock);
+		cv_signal(&swq->gs_cv);
+		mutex_exit(&swq->gs_lock);
 
 		return (CRYPTO_QUEUED);
 	}
@@ -907,60 +933,92 @@ kcf_removereq_in_ctxchain(kcf_context_t *ictx, kcf_areq_node_t *areq)
 }
 
 /*
- * Remove the specified node from the global software queue.
+ * Remove the specified node from its software queue.
  *
  * The caller must hold the queue lock and request lock (an_lock).
  */
 void
 kcf_remove_node(kcf_areq_node_t *node)
 {
+	kcf_global_swq_t *swq = node->an_swq;
 	kcf_areq_node_t *nextp = node->an_next;
 	kcf_areq_node_t *prevp = node->an_prev;
 
-	ASSERT(mutex_owned(&gswq->gs_lock));
+	ASSERT(mutex_owned(&swq->gs_lock));
 
 	if (nextp != NULL)
 		nextp->an_prev = prevp;
 	else
-		gswq->gs_last = prevp;
+		swq->gs_last = prevp;
 
 	if (prevp != NULL)
 		prevp->an_next = nextp;
 	else
-		gswq->gs_first = nextp;
+		swq->gs_first = nextp;
 
 	ASSERT(mutex_owned(&node->an_lock));
 	node->an_state = REQ_CANCELED;
 }
 
 /*
- * Remove and return the first node in the global software queue.
+ * Remove and return the first node in the given software queue.
  *
  * The caller must hold the queue lock.
  */
 static kcf_areq_node_t *
-kcf_dequeue(void)
+kcf_dequeue(kcf_global_swq_t *swq)
 {
 	kcf_areq_node_t *tnode = NULL;
 
-	ASSERT(mutex_owned(&gswq->gs_lock));
-	if ((tnode = gswq->gs_first) == NULL) {
+	ASSERT(mutex_owned(&swq->gs_lock));
+	if ((tnode = swq->gs_first) == NULL) {
 		return (NULL);
 	} else {
-		ASSERT(gswq->gs_first->an_prev == NULL);
-		gswq->gs_first = tnode->an_next;
+		ASSERT(swq->gs_first->an_prev == NULL);
+		swq->gs_first = tnode->an_next;
 		if (tnode->an_next == NULL)
-			gswq->gs_last = NULL;
+			swq->gs_last = NULL;
 		else
 			tnode->an_next->an_prev = NULL;
 	}
 
-	gswq->gs_njobs--;
+	swq->gs_njobs--;
 	return (tnode);
 }
 
 /*
- * Add the request node to the end of the global software queue.
+ * Remove and return the first node of some software queue other than the
+ * given one, if any has work waiting. The queues are sampled without their
+ * locks, so this may miss a request that is racing in; that is fine, as
+ * every queue has threads of its own.
+ *
+ * The caller must not hold any queue lock.
+ */
+static kcf_areq_node_t *
+kcf_dequeue_other(kcf_global_swq_t *home)
+{
+	kcf_global_swq_t *swq;
+	kcf_areq_node_t *req;
+	uint_t i, start;
+
+	start = KCF_SWQ_INDEX(home);
+	for (i = 1; i < kcf_nswq; i++) {
+		swq = KCF_SWQ((start + i) % kcf_nswq);
+		if (swq->gs_njobs == 0)
+			continue;
+
+		mutex_enter(&swq->gs_lock);
+		req = kcf_dequeue(swq);
+		mutex_exit(&swq->gs_lock);
+		if (req != NULL)
+			return (req);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Add the request node to the end of its software queue.
  *
  * The caller should not hold the queue lock. Returns 0 if the
  * request is successfully queued. Returns CRYPTO_BUSY if the limit
@@ -969,45 +1027,66 @@ kcf_dequeue(void)
 static int
 kcf_enqueue(kcf_areq_node_t *node)
 {
+	kcf_global_swq_t *swq = node->an_swq;
 	kcf_areq_node_t *tnode;
 
-	mutex_enter(&gswq->gs_lock);
+	mutex_enter(&swq->gs_lock);
 
-	if (gswq->gs_njobs >= gswq->gs_maxjobs) {
-		mutex_exit(&gswq->gs_lock);
+	if (swq->gs_njobs >= swq->gs_maxjobs) {
+		mutex_exit(&swq->gs_lock);
 		return (CRYPTO_BUSY);
 	}
 
-	if (gswq->gs_last == NULL) {
-		gswq->gs_first = gswq->gs_last = node;
+	if (swq->gs_last == NULL) {
+		swq->gs_first = swq->gs_last = node;
 	} else {
-		ASSERT(gswq->gs_last->an_next == NULL);
-		tnode = gswq->gs_last;
+		ASSERT(swq->gs_last->an_next == NULL);
+		tnode = swq->gs_last;
 		tnode->an_next = node;
-		gswq->gs_last = node;
+		swq->gs_last = node;
 		node->an_prev = tnode;
 	}
 
-	gswq->gs_njobs++;
+	swq->gs_njobs++;
 
 	/* an_lock not needed here as we hold gs_lock */
 	node->an_state = REQ_WAITING;
 
-	mutex_exit(&gswq->gs_lock);
+	mutex_exit(&swq->gs_lock);
 
 	return (0);
 }
 
 /*
- * Function run by a thread from kcfpool to work on global software queue.
+ * Return an estimate of the number of requests which can still be queued
+ * for software providers.
+ */
+uint_t
+kcf_swq_avail(void)
+{
+	kcf_global_swq_t *swq;
+	uint_t i, avail = 0;
+
+	for (i = 0; i < kcf_nswq; i++) {
+		swq = KCF_SWQ(i);
+		if (swq->gs_maxjobs > swq->gs_njobs)
+			avail += swq->gs_maxjobs - swq->gs_njobs;
+	}
+
+	return (avail);
+}
+
+/*
+ * Function run by a thread from kcfpool to work on a software queue. The
+ * argument is the index of the queue the thread was created to serve.
  */
 void
 kcfpool_svc(void *arg)
 {
-	_NOTE(ARGUNUSED(arg));
 	int error = 0;
 	clock_t rv;
 	clock_t timeout_val = drv_usectohz(kcf_idlethr_timeout);
+	kcf_global_swq_t *swq = KCF_SWQ((uintptr_t)arg);
 	kcf_areq_node_t *req;
 	kcf_context_t *ictx;
 	kcf_provider_desc_t *pd;
@@ -1015,12 +1094,25 @@ kcfpool_svc(void *arg)
 	KCF_ATOMIC_INCR(kcfpool->kp_threads);
 
 	for (;;) {
-		mutex_enter(&gswq->gs_lock);
+		mutex_enter(&swq->gs_lock);
+
+		while ((req = kcf_dequeue(swq)) == NULL) {
+			/*
+			 * Our own queue is empty; help out with the others
+			 * before going to sleep.
+			 */
+			mutex_exit(&swq->gs_lock);
+			if ((req = kcf_dequeue_other(swq)) != NULL)
+				goto run;
+			mutex_enter(&swq->gs_lock);
+			if (swq->gs_first != NULL)
+				continue;
 
-		while ((req = kcf_dequeue()) == NULL) {
 			KCF_ATOMIC_INCR(kcfpool->kp_idlethreads);
-			rv = cv_reltimedwait(&gswq->gs_cv,
-			    &gswq->gs_lock, timeout_val, TR_CLOCK_TICK);
+			swq->gs_idlethreads++;
+			rv = cv_reltimedwait(&swq->gs_cv,
+			    &swq->gs_lock, timeout_val, TR_CLOCK_TICK);
+			swq->gs_idlethreads--;
 			KCF_ATOMIC_DECR(kcfpool->kp_idlethreads);
 
 			switch (rv) {
@@ -1029,11 +1121,14 @@ kcfpool_svc(void *arg)
 				/*
 				 * Woke up with no work to do. Check if we
 				 * should lwp_exit() (which won't return). We
-				 * keep at least kcf_minthreads.
+				 * keep at least kcf_minthreads, and at least
+				 * kcf_swq_minthreads for this queue.
 				 */
-				if (kcfpool->kp_threads > kcf_minthreads) {
+				if (kcfpool->kp_threads > kcf_minthreads &&
+				    swq->gs_threads > kcf_swq_minthreads) {
 					KCF_ATOMIC_DECR(kcfpool->kp_threads);
-					mutex_exit(&gswq->gs_lock);
+					KCF_ATOMIC_DECR(swq->gs_threads);
+					mutex_exit(&swq->gs_lock);
 
 					/*
 					 * lwp_exit() assumes it is called
@@ -1058,8 +1153,8 @@ kcfpool_svc(void *arg)
 			}
 		}
 
-		mutex_exit(&gswq->gs_lock);
-
+		mutex_exit(&swq->gs_lock);
+run:
 		ictx = req->an_context;
 		if (ictx == NULL) {	/* Context-less operation */
 			pd = req->an_provider;
@@ -1085,7 +1180,9 @@ kcfpool_svc(void *arg)
 		mutex_enter(&req->an_lock);
 		while (req->an_is_my_turn == B_FALSE) {
 			KCF_ATOMIC_INCR(kcfpool->kp_blockedthreads);
+			KCF_ATOMIC_INCR(swq->gs_blockedthreads);
 			cv_wait(&req->an_turn_cv, &req->an_lock);
+			KCF_ATOMIC_DECR(swq->gs_blockedthreads);
 			KCF_ATOMIC_DECR(kcfpool->kp_blockedthreads);
 		}
 
@@ -1210,13 +1307,24 @@ kcf_sched_init(void)
 	    sizeof (struct kcf_context), 64, kcf_context_cache_constructor,
 	    kcf_context_cache_destructor, NULL, NULL, NULL, 0);
 
-	gswq = kmem_alloc(sizeof (kcf_global_swq_t), KM_SLEEP);
-
-	mutex_init(&gswq->gs_lock, NULL, MUTEX_DEFAULT, NULL);
-	cv_init(&gswq->gs_cv, NULL, CV_DEFAULT, NULL);
-	gswq->gs_njobs = 0;
-	gswq->gs_maxjobs = kcf_maxthreads * crypto_taskq_maxalloc;
-	gswq->gs_first = gswq->gs_last = NULL;
+	/*
+	 * One software queue per CPU, up to kcf_swq_max; beyond that, CPUs
+	 * share queues.
+	 */
+	kcf_nswq = MAX(1, MIN(max_ncpus, kcf_swq_max));
+	kcf_swqs = kmem_zalloc(kcf_nswq * sizeof (kcf_swq_slot_t), KM_SLEEP);
+	gswq = KCF_SWQ(0);
+
+	for (i = 0; i < kcf_nswq; i++) {
+		kcf_global_swq_t *swq = KCF_SWQ(i);
+
+		mutex_init(&swq->gs_lock, NULL, MUTEX_DEFAULT, NULL);
+		cv_init(&swq->gs_cv, NULL, CV_DEFAULT, NULL);
+		swq->gs_njobs = 0;
+		swq->gs_maxjobs = MAX(1,
+		    kcf_maxthreads * crypto_taskq_maxalloc / kcf_nswq);
+		swq->gs_first = swq->gs_last = NULL;
+	}
 
 	/* Initialize the global reqid table */
 	for (i = 0; i < REQID_TABLES; i++) {
@@ -1396,6 +1504,8 @@ kcfpoold(void *arg)
 	callb_cpr_t	cprinfo;
 	user_t		*pu = PTOU(curproc);
 	int		cnt;
+	uint_t		i;
+	kcf_global_swq_t *swq;
 	clock_t		timeout_val = drv_usectohz(kcf_idlethr_timeout);
 	_NOTE(ARGUNUSED(arg));
 
@@ -1433,22 +1543,39 @@ kcfpoold(void *arg)
 		}
 
 		/*
-		 * We keep the number of running threads to be at
-		 * kcf_minthreads to reduce gs_lock contention.
+		 * For each queue which is in use, keep the number of
+		 * running threads at kcf_swq_minthreads, or at this
+		 * queue's share of kcf_minthreads if that is greater.
+		 * Queues of CPUs which have never queued a request get
+		 * no threads.
 		 */
-		cnt = kcf_minthreads -
-		    (kcfpool->kp_threads - kcfpool->kp_blockedthreads);
-		if (cnt > 0) {
-			/*
-			 * The following ensures the number of threads in pool
-			 * does not exceed kcf_maxthreads.
-			 */
-			cnt = min(cnt, kcf_maxthreads - kcfpool->kp_threads);
-		}
+		for (i = 0; i < kcf_nswq; i++) {
+			swq = KCF_SWQ(i);
+			if (swq->gs_threads == 0 && swq->gs_njobs == 0)
+				continue;
+
+			cnt = MAX(kcf_swq_minthreads,
+			    kcf_minthreads / (int)kcf_nswq) -
+			    (int)(swq->gs_threads - swq->gs_blockedthreads);
+			if (cnt > 0 && swq->gs_threads >
+			    swq->gs_blockedthreads) {
+				/*
+				 * The following ensures the number of
+				 * threads in pool does not exceed
+				 * kcf_maxthreads; but a queue all of whose
+				 * threads are blocked always gets one more,
+				 * so that its requests are not stranded.
+				 */
+				cnt = min(cnt,
+				    kcf_maxthreads - kcfpool->kp_threads);
+			}
 
-		for (int i = 0; i < cnt; i++) {
-			(void) lwp_kernel_create(curproc,
-			    kcfpool_svc, NULL, TS_RUN, curthread->t_pri);
+			for (; cnt > 0; cnt--) {
+				KCF_ATOMIC_INCR(swq->gs_threads);
+				(void) lwp_kernel_create(curproc, kcfpool_svc,
+				    (void *)(uintptr_t)i, TS_RUN,
+				    curthread->t_pri);
+			}
 		}
 	}
 }
@@ -1479,21 +1606,27 @@ kcfpool_alloc(void)
 }
 
 /*
- * This routine introduces a locking order for gswq->gs_lock followed
- * by cpu_lock.
- * This means that no consumer of the k-api should hold cpu_lock when calling
- * k-api routines.
+ * Recompute the limits on the number of threads, and the limit on the
+ * number of jobs in each software queue.
  */
 static void
 compute_min_max_threads(void)
 {
-	mutex_enter(&gswq->gs_lock);
+	kcf_global_swq_t *swq;
+	uint_t i;
+
 	mutex_enter(&cpu_lock);
 	kcf_minthreads = curthread->t_cpupart->cp_ncpus;
 	mutex_exit(&cpu_lock);
 	kcf_maxthreads = kcf_thr_multiple * kcf_minthreads;
-	gswq->gs_maxjobs = kcf_maxthreads * crypto_taskq_maxalloc;
-	mutex_exit(&gswq->gs_lock);
+
+	for (i = 0; i < kcf_nswq; i++) {
+		swq = KCF_SWQ(i);
+		mutex_enter(&swq->gs_lock);
+		swq->gs_maxjobs = MAX(1,
+		    kcf_maxthreads * crypto_taskq_maxalloc / kcf_nswq);
+		mutex_exit(&swq->gs_lock);
+	}
 }
 
 /*
@@ -1574,7 +1707,7 @@ kcf_reqid_delete(kcf_areq_node_t *areq)
  *
  * NOTE: We acquire the following locks in this routine (in order):
  *	- rt_lock (kcf_reqid_table_t)
- *	- gswq->gs_lock
+ *	- areq->an_swq->gs_lock
  *	- areq->an_lock
  *	- ictx->kc_in_use_lock (from kcf_removereq_in_ctxchain())
  *
@@ -1604,18 +1737,18 @@ crypto_cancel_req(crypto_req_id_t id)
 
 		switch (pd->pd_prov_type) {
 		case CRYPTO_SW_PROVIDER:
-			mutex_enter(&gswq->gs_lock);
+			mutex_enter(&areq->an_swq->gs_lock);
 			mutex_enter(&areq->an_lock);
 
 			/* This request can be safely canceled. */
 			if (areq->an_state <= REQ_WAITING) {
-				/* Remove from gswq, global software queue. */
+				/* Remove from its software queue. */
 				kcf_remove_node(areq);
 				if ((ictx = areq->an_context) != NULL)
 					kcf_removereq_in_ctxchain(ictx, areq);
 
 				mutex_exit(&areq->an_lock);
-				mutex_exit(&gswq->gs_lock);
+				mutex_exit(&areq->an_swq->gs_lock);
 				mutex_exit(&rt->rt_lock);
 
 				/* Remove areq from hash table and free it. */
@@ -1625,7 +1758,7 @@ crypto_cancel_req(crypto_req_id_t id)
 			}
 
 			mutex_exit(&areq->an_lock);
-			mutex_exit(&gswq->gs_lock);
+			mutex_exit(&areq->an_swq->gs_lock);
 			break;
 
 		case CRYPTO_HW_PROVIDER:
@@ -1705,6 +1838,7 @@ static int
 kcf_misc_kstat_update(kstat_t *ksp, int rw)
 {
 	kcf_stats_t *ks_data;
+	uint_t i;
 
 	if (rw == KSTAT_WRITE)
 		return (EACCES);
@@ -1715,8 +1849,12 @@ kcf_misc_kstat_update(kstat_t *ksp, int rw)
 	ks_data->ks_idle_thrs.value.ui32 = kcfpool->kp_idlethreads;
 	ks_data->ks_minthrs.value.ui32 = kcf_minthreads;
 	ks_data->ks_maxthrs.value.ui32 = kcf_maxthreads;
-	ks_data->ks_swq_njobs.value.ui32 = gswq->gs_njobs;
-	ks_data->ks_swq_maxjobs.value.ui32 = gswq->gs_maxjobs;
+	ks_data->ks_swq_njobs.value.ui32 = 0;
+	ks_data->ks_swq_maxjobs.value.ui32 = 0;
+	for (i = 0; i < kcf_nswq; i++) {
+		ks_data->ks_swq_njobs.value.ui32 += KCF_SWQ(i)->gs_njobs;
+		ks_data->ks_swq_maxjobs.value.ui32 += KCF_SWQ(i)->gs_maxjobs;
+	}
 	ks_data->ks_taskq_threads.value.ui32 = crypto_taskq_threads;
 	ks_data->ks_taskq_minalloc.value.ui32 = crypto_taskq_minalloc;
 	ks_data->ks_taskq_maxalloc.value.ui32 = crypto_taskq_maxalloc;
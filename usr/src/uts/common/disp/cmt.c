@@ -157,6 +157,23 @@ static void		cmt_ev_thread_swtch_pwr(pg_t *, cpu_t *, hrtime_t,
 static void		cmt_ev_thread_remain_pwr(pg_t *, cpu_t *, kthread_t *);
 static cmt_lineage_validation_t	pg_cmt_lineage_validate(pg_cmt_t **, int *,
 			    cpu_pg_t *);
+static void		pg_cmt_kstat_create(pg_cmt_t *);
+static int		pg_cmt_kstat_update(kstat_t *, int);
+
+/*
+ * Last level cache PG kstats, see cmt_llc_place() in cmt_policy.c
+ */
+struct pg_cmt_kstat {
+	kstat_named_t	cmt_llc_affine;
+	kstat_named_t	cmt_llc_migrate;
+	kstat_named_t	cmt_llc_deferred;
+} pg_cmt_kstat = {
+	{ "affine_placements",		KSTAT_DATA_UINT64 },
+	{ "cross_llc_placements",	KSTAT_DATA_UINT64 },
+	{ "deferred_balance",		KSTAT_DATA_UINT64 },
+};
+
+static kmutex_t		pg_cmt_kstat_lock;
 
 /*
  * CMT PG ops
@@ -223,6 +240,46 @@ pg_cmt_alloc(void)
 	return (kmem_zalloc(sizeof (pg_cmt_t), KM_NOSLEEP));
 }
 
+/*
+ * Create the kstat counting the LLC affinity decisions made for a last
+ * level cache PG.
+ */
+static void
+pg_cmt_kstat_create(pg_cmt_t *pg)
+{
+	char name[KSTAT_STRLEN + 1];
+
+	(void) strncpy(name, pghw_type_string(((pghw_t *)pg)->pghw_hw),
+	    KSTAT_STRLEN + 1);
+	strident_canon(name, KSTAT_STRLEN + 1);
+
+	if ((pg->cmt_kstat = kstat_create("pg_cmt", ((pg_t *)pg)->pg_id,
+	    name, "processor_group", KSTAT_TYPE_NAMED,
+	    sizeof (pg_cmt_kstat) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL)) != NULL) {
+		pg->cmt_kstat->ks_lock = &pg_cmt_kstat_lock;
+		pg->cmt_kstat->ks_data = &pg_cmt_kstat;
+		pg->cmt_kstat->ks_update = pg_cmt_kstat_update;
+		pg->cmt_kstat->ks_private = pg;
+		kstat_install(pg->cmt_kstat);
+	}
+}
+
+static int
+pg_cmt_kstat_update(kstat_t *ksp, int rw)
+{
+	struct pg_cmt_kstat	*pgsp = &pg_cmt_kstat;
+	pg_cmt_t		*pg = ksp->ks_private;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	pgsp->cmt_llc_affine.value.ui64 = pg->cmt_llc_affine;
+	pgsp->cmt_llc_migrate.value.ui64 = pg->cmt_llc_migrate;
+	pgsp->cmt_llc_deferred.value.ui64 = pg->cmt_llc_deferred;
+	return (0);
+}
+
 /*
  * Class specific PG de-allocation
  */
@@ -579,6 +636,9 @@ pg_cmt_cpu_init(cpu_t *cp, cpu_pg_t *pgdata)
 
 			bitset_init(&pg->cmt_cpus_actv_set);
 			group_create(&pg->cmt_cpus_actv);
+
+			if (hw == PGHW_CACHE)
+				pg_cmt_kstat_create(pg);
 		} else {
 			ASSERT(IS_CMT_PG(pg));
 		}
@@ -872,6 +932,10 @@ pg_cmt_cpu_fini(cpu_t *cp, cpu_pg_t *pgdata)
 			 */
 			group_destroy(&pg->cmt_cpus_actv);
 			bitset_fini(&pg->cmt_cpus_actv_set);
+			if (pg->cmt_kstat != NULL) {
+				kstat_delete(pg->cmt_kstat);
+				pg->cmt_kstat = NULL;
+			}
 			pghw_fini((pghw_t *)pg);
 
 			pg_destroy((pg_t *)pg);
@@ -35,6 +35,9 @@
 #include <sys/bitset.h>
 #include <sys/lgrp.h>
 #include <sys/cmt.h>
+#include <sys/pghw.h>
+#include <sys/smt.h>
+#include <sys/atomic.h>
 
 /*
  * CMT dispatcher policies
@@ -56,15 +59,62 @@
  * The dispatcher will implement CMT policy across lgroups however, if
  * it can do so with a thread homed to the root lgroup, since root homed
  * threads have no lgroup affinity.
+ *
+ * Last level caches (PGHW_CACHE PGs) get some extra care, since a thread
+ * moved to a CPU under a different LLC (e.g. another CCX on AMD Zen) has to
+ * refill its whole working set from memory.  A thread that last ran less
+ * than cmt_llc_rechoose_interval ticks ago is assumed to still have a
+ * useful footprint in its old LLC; this window is much longer than
+ * rechoose_interval, which models the private caches.  For such threads:
+ *
+ *   - cmt_balance() only moves the thread to a sibling LLC if that reduces
+ *     the imbalance by more than cmt_llc_migrate_cost running threads,
+ *     i.e. the estimated cost of losing LLC residency must be outweighed
+ *     by the gain in balance.
+ *
+ *   - cmt_llc_place() redirects a placement that would leave the old LLC
+ *     to an idle CPU still sharing the old LLC, if there is one.
+ *
+ * Setting cmt_llc_affinity to 0 disables both.  The "pg_cmt" kstat of each
+ * LLC PG counts the affine placements, the placements that arrived from
+ * another LLC, and the balancing moves that were deferred.
  */
 
+int		cmt_llc_affinity = 1;
+int		cmt_llc_rechoose_interval = 20;
+uint32_t	cmt_llc_migrate_cost = 1;
+
+#define	CMT_LLC_WARM(tp)						\
+	(cmt_llc_affinity != 0 && ((tp) == curthread ||			\
+	(ddi_get_lbolt() - (tp)->t_disp_time) <= cmt_llc_rechoose_interval))
+
+/*
+ * Return the last level cache PG in cp's CMT lineage, if any.
+ */
+static pg_cmt_t *
+cmt_llc_pg(cpu_t *cp)
+{
+	group_t		*cmt_pgs = &cp->cpu_pg->cmt_pgs;
+	pg_cmt_t	*pg;
+	uint_t		i;
+
+	for (i = 0; i < GROUP_SIZE(cmt_pgs); i++) {
+		pg = GROUP_ACCESS(cmt_pgs, i);
+		if (((pghw_t *)pg)->pghw_hw == PGHW_CACHE)
+			return (pg);
+	}
+	return (NULL);
+}
+
 /*
  * Return non-zero if, given the policy, we should migrate from running
- * somewhere "here" to somewhere "there".
+ * somewhere "here" to somewhere "there".  "cost" is the estimated cost of
+ * the migration, in units of running threads, that the improvement in
+ * balance has to exceed.
  */
 static int
 cmt_should_migrate(pg_cmt_t *here, pg_cmt_t *there, pg_cmt_policy_t policy,
-    int self)
+    int self, uint32_t cost)
 {
 	uint32_t here_util, there_util;
 
@@ -91,8 +141,8 @@ cmt_should_migrate(pg_cmt_t *here, pg_cmt_t *there, pg_cmt_policy_t policy,
 		 * (either in an absolute sense, or scaled by capacity),
 		 * then choose to balance.
 		 */
-		if ((here_util > there_util) ||
-		    (here_util == there_util &&
+		if ((here_util > there_util + cost) ||
+		    (cost == 0 && here_util == there_util &&
 		    (CMT_CAPACITY(there) > CMT_CAPACITY(here)))) {
 			return (1);
 		}
@@ -124,6 +174,7 @@ cmt_balance(kthread_t *tp, cpu_t *cp)
 	group_t		*cmt_pgs, *siblings;
 	pg_cmt_t	*pg, *pg_tmp, *tpg = NULL;
 	int		level = 0;
+	uint32_t	cost;
 	cpu_t		*newcp;
 	extern cmt_lgrp_t *cmt_root;
 
@@ -191,10 +242,18 @@ cmt_balance(kthread_t *tp, cpu_t *cp)
 
 		/*
 		 * Decide if we should migrate from the current PG to a
-		 * target PG given a policy
+		 * target PG given a policy.  Leaving a last level cache
+		 * the thread is still warm in has to pay for itself.
 		 */
-		if (cmt_should_migrate(pg, tpg, pg->cmt_policy, self))
+		cost = 0;
+		if (((pghw_t *)pg)->pghw_hw == PGHW_CACHE && CMT_LLC_WARM(tp))
+			cost = cmt_llc_migrate_cost;
+
+		if (cmt_should_migrate(pg, tpg, pg->cmt_policy, self, cost))
 			break;
+		if (cost != 0 &&
+		    cmt_should_migrate(pg, tpg, pg->cmt_policy, self, 0))
+			atomic_inc_64(&pg->cmt_llc_deferred);
 		tpg = NULL;
 
 next_level:
@@ -227,3 +286,52 @@ next_level:
 
 	return (cp);
 }
+
+/*
+ * Cache-affine placement.
+ *
+ * tp is the thread being enqueued, cp is the CPU chosen for it so far.  If
+ * cp is under a different last level cache than the CPU tp last ran on,
+ * and tp is likely to still be warm there, return an idle CPU under the
+ * old LLC instead, if one is available to tp.
+ */
+cpu_t *
+cmt_llc_place(kthread_t *tp, cpu_t *cp)
+{
+	pg_cmt_t	*home, *there;
+	cpu_t		*newcp;
+	uint_t		i, hint, size;
+
+	ASSERT(THREAD_LOCK_HELD(tp));
+
+	if (cp == tp->t_cpu || (home = cmt_llc_pg(tp->t_cpu)) == NULL)
+		return (cp);
+
+	if ((there = cmt_llc_pg(cp)) == home)
+		return (cp);
+
+	size = GROUP_SIZE(&home->cmt_cpus_actv);
+	if (size != 0 && CMT_LLC_WARM(tp)) {
+		hint = CPU_PSEUDO_RANDOM() % size;
+		i = hint;
+		do {
+			newcp = GROUP_ACCESS(&home->cmt_cpus_actv, i);
+			if (newcp->cpu_part == tp->t_cpupart &&
+			    newcp->cpu_dispatch_pri == -1 &&
+			    newcp != cpu_inmotion &&
+			    (newcp->cpu_flags & CPU_QUIESCED) == 0 &&
+			    LGRP_CONTAINS_CPU(tp->t_lpl->lpl_lgrp, newcp) &&
+			    smt_should_run(tp, newcp)) {
+				atomic_inc_64(&home->cmt_llc_affine);
+				return (newcp);
+			}
+			if (++i == size)
+				i = 0;
+		} while (i != hint);
+	}
+
+	if (there != NULL)
+		atomic_inc_64(&there->cmt_llc_migrate);
+
+	return (cp);
+}
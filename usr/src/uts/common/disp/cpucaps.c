@@ -22,7 +22,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
- * Copyright 2013 Joyent, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.  All rights reserved.
  */
 
 #include <sys/disp.h>
@@ -36,6 +36,8 @@
 #include <sys/debug.h>
 #include <sys/rctl.h>
 #include <sys/errno.h>
+#include <sys/cpupart.h>
+#include <sys/bitset.h>
 
 /*
  * CPU Caps implementation
@@ -101,6 +103,27 @@
  * the full burst value and the bursting_sec value will begin to increase
  * again.
  *
+ * Burst credits
+ * =============
+ *
+ * A zone with a burst credit limit (zone.cpu-burst-credit, in seconds of
+ * CPU time at the cap rate) has a token bucket attached to its cap.  Every
+ * tick the bucket is filled with one tick's worth of CPU at the cap rate,
+ * up to the limit, and every charge of on-CPU time to any of the zone's
+ * projects is taken out of it.  A zone that runs below its cap therefore
+ * accumulates credit, and one above its cap spends it.
+ *
+ * While the zone has a positive balance and its threads' processor set
+ * has idle (halted) CPUs, the zone is not throttled at its effective cap:
+ * it borrows idle CPU and pays for it out of the bucket.  Because the
+ * balance is debited on every charge, i.e. at the nanosecond granularity of
+ * microstate accounting rather than once per tick, the decision to throttle
+ * is taken at the first charge after the credit runs out.  A zone that
+ * overdrew its bucket has to pay the debt back by running below its cap
+ * before it can borrow again.  The "burst_credit_msec", "burst_credit_max_sec"
+ * and "borrowed_sec" kstats show the balance, the limit and the cumulative
+ * time spent borrowing.
+ *
  * Accounting
  * ==========
  *
@@ -225,6 +248,21 @@ static hrtime_t cap_tick_cost;
 
 static void caps_update();
 
+/*
+ * A cap with burst credits may be exceeded while it has credit left and,
+ * if cp is given, cp has idle CPUs to lend.
+ */
+#define	CAP_CAN_BORROW(cap, cp)						\
+	((cap)->cap_credit_limit != 0 && (cap)->cap_credit > 0 &&	\
+	((cp) == NULL || !bitset_is_null(&(cp)->cp_haltset)))
+
+/*
+ * CPU time a cap allows per tick, and the maximum burst credit balance.
+ */
+#define	CAP_TICK_VALUE(cap)	((cap)->cap_value / CAP_DECAY_FACTOR)
+#define	CAP_CREDIT_MAX(cap)						\
+	(CAP_TICK_VALUE(cap) * (hrtime_t)(cap)->cap_credit_limit)
+
 /*
  * CAP kstats.
  */
@@ -241,6 +279,9 @@ struct cap_kstat {
 	kstat_named_t	cap_above_base;
 	kstat_named_t	cap_maxusage;
 	kstat_named_t	cap_zonename;
+	kstat_named_t	cap_credit;
+	kstat_named_t	cap_credit_max;
+	kstat_named_t	cap_borrowed;
 } cap_kstat = {
 	{ "value",	KSTAT_DATA_UINT64 },
 	{ "baseline",	KSTAT_DATA_UINT64 },
@@ -254,6 +295,9 @@ struct cap_kstat {
 	{ "above_base_sec", KSTAT_DATA_UINT64 },
 	{ "maxusage",	KSTAT_DATA_UINT64 },
 	{ "zonename",	KSTAT_DATA_STRING },
+	{ "burst_credit_msec", KSTAT_DATA_INT64 },
+	{ "burst_credit_max_sec", KSTAT_DATA_UINT64 },
+	{ "borrowed_sec", KSTAT_DATA_UINT64 },
 };
 
 
@@ -573,7 +617,28 @@ cap_poke_waitq(cpucap_t *cap, int64_t gen)
 		}
 	}
 
-	if (cap->cap_usage >= cap->cap_chk_value) {
+	if (cap->cap_credit_limit != 0) {
+		hrtime_t credit_max = CAP_CREDIT_MAX(cap);
+
+		/*
+		 * Refill the burst credit bucket with one tick worth of CPU
+		 * at the cap rate.  Charges drain it in caps_charge_adjust().
+		 */
+		disp_lock_enter(&cap->cap_usagelock);
+		cap->cap_credit += CAP_TICK_VALUE(cap);
+		if (cap->cap_credit > credit_max)
+			cap->cap_credit = credit_max;
+		else if (cap->cap_credit < -credit_max)
+			cap->cap_credit = -credit_max;
+		disp_lock_exit(&cap->cap_usagelock);
+
+		if (cap->cap_usage >= cap->cap_chk_value &&
+		    CAP_CAN_BORROW(cap, NULL))
+			cap->cap_borrowed++;
+	}
+
+	if (cap->cap_usage >= cap->cap_chk_value &&
+	    !CAP_CAN_BORROW(cap, NULL)) {
 		cap->cap_above++;
 	} else {
 		waitq_t *wq = &cap->cap_waitq;
@@ -976,6 +1041,61 @@ cpucaps_zone_set_burst_time(zone_t *zone, rctl_qty_t base_val)
 	return (0);
 }
 
+/*
+ * Set zone's burst credit limit in seconds of CPU time at the cap rate.  A
+ * limit of 0 disables burst credits.  The current balance is kept, clamped
+ * to the new limit.
+ */
+int
+cpucaps_zone_set_burst_credit(zone_t *zone, rctl_qty_t credit_val)
+{
+	cpucap_t *cap = NULL;
+	hrtime_t credit_max;
+
+	ASSERT(credit_val <= INT_MAX);
+	/* Treat the default as 0 - no burst credits */
+	if (credit_val >= INT_MAX)
+		credit_val = 0;
+
+	if (CPUCAPS_OFF() || !ZONE_IS_CAPPED(zone))
+		return (0);
+
+	if (zone->zone_cpucap == NULL)
+		cap = cap_alloc();
+
+	mutex_enter(&caps_lock);
+
+	if (cpucaps_busy) {
+		mutex_exit(&caps_lock);
+		return (EBUSY);
+	}
+
+	/*
+	 * Double-check whether zone->zone_cpucap is NULL, now with caps_lock
+	 * held. If it is still NULL, assign a newly allocated cpucap to it.
+	 */
+	if (zone->zone_cpucap == NULL) {
+		zone->zone_cpucap = cap;
+	} else if (cap != NULL) {
+		cap_free(cap);
+	}
+
+	cap = zone->zone_cpucap;
+
+	disp_lock_enter(&cap->cap_usagelock);
+	cap->cap_credit_limit = SEC_TO_TICK(credit_val);
+	credit_max = CAP_CREDIT_MAX(cap);
+	if (cap->cap_credit > credit_max)
+		cap->cap_credit = credit_max;
+	else if (cap->cap_credit < -credit_max)
+		cap->cap_credit = -credit_max;
+	disp_lock_exit(&cap->cap_usagelock);
+
+	mutex_exit(&caps_lock);
+
+	return (0);
+}
+
 /*
  * The project is going away so disable its cap.
  */
@@ -1177,6 +1297,28 @@ cpucaps_zone_get_base(zone_t *zone)
 	    (rctl_qty_t)(zone->zone_cpucap->cap_base / cap_tick_cost) : 0);
 }
 
+/*
+ * Get current zone cap value.
+ */
+rctl_qty_t
+cpucaps_zone_get_value(zone_t *zone)
+{
+	return (ZONE_IS_CAPPED(zone) ?
+	    (rctl_qty_t)(zone->zone_cpucap->cap_value / cap_tick_cost) : 0);
+}
+
+/*
+ * Get the number of ticks the zone has spent above and below its cap.
+ */
+void
+cpucaps_zone_get_ticks(zone_t *zone, u_longlong_t *above, u_longlong_t *below)
+{
+	cpucap_t *cap = zone->zone_cpucap;
+
+	*above = (cap != NULL) ? cap->cap_above : 0;
+	*below = (cap != NULL) ? cap->cap_below : 0;
+}
+
 /*
  * Get current zone maximum burst time.
  */
@@ -1187,6 +1329,16 @@ cpucaps_zone_get_burst_time(zone_t *zone)
 	    (rctl_qty_t)(TICK_TO_SEC(zone->zone_cpucap->cap_burst_limit)) : 0);
 }
 
+/*
+ * Get current zone burst credit limit.
+ */
+rctl_qty_t
+cpucaps_zone_get_burst_credit(zone_t *zone)
+{
+	return (zone->zone_cpucap != NULL ?
+	    (rctl_qty_t)(TICK_TO_SEC(zone->zone_cpucap->cap_credit_limit)) : 0);
+}
+
 /*
  * Charge project of thread t the time thread t spent on CPU since previously
  * adjusted.
@@ -1244,6 +1396,16 @@ caps_charge_adjust(kthread_id_t t, caps_sc_t *csc)
 		 */
 		if (cap->cap_usage > cap->cap_maxusage)
 			cap->cap_maxusage = cap->cap_usage;
+
+		/*
+		 * Spend the zone's burst credit, if it has any.
+		 */
+		cap = kpj->kpj_zone->zone_cpucap;
+		if (cap != NULL && cap->cap_credit_limit != 0) {
+			disp_lock_enter_high(&cap->cap_usagelock);
+			cap->cap_credit -= usage_delta;
+			disp_lock_exit_high(&cap->cap_usagelock);
+		}
 	}
 }
 
@@ -1299,7 +1461,8 @@ cpucaps_charge(kthread_id_t t, caps_sc_t *csc, cpucaps_charge_t charge_type)
 	} else {
 		cpucap_t *zone_cap = zone->zone_cpucap;
 
-		if (zone_cap->cap_usage >= zone_cap->cap_chk_value) {
+		if (zone_cap->cap_usage >= zone_cap->cap_chk_value &&
+		    !CAP_CAN_BORROW(zone_cap, t->t_cpupart)) {
 			t->t_schedflag |= TS_ZONEWAITQ;
 			rc = B_TRUE;
 		} else if (t->t_schedflag & TS_ZONEWAITQ) {
@@ -1391,6 +1554,11 @@ cap_kstat_update(kstat_t *ksp, int rw)
 	    ROUND_SCALE(cap->cap_above_base, tick_sec);
 	capsp->cap_bursting.value.ui64 =
 	    ROUND_SCALE(cap->cap_bursting, tick_sec);
+	capsp->cap_credit.value.i64 = cap->cap_credit / (NANOSEC / MILLISEC);
+	capsp->cap_credit_max.value.ui64 =
+	    ROUND_SCALE(cap->cap_credit_limit, tick_sec);
+	capsp->cap_borrowed.value.ui64 =
+	    ROUND_SCALE(cap->cap_borrowed, tick_sec);
 	kstat_named_setstr(&capsp->cap_zonename, zonename);
 
 	return (0);
@@ -1188,6 +1188,53 @@ cpu_resched(cpu_t *cp, pri_t tpri)
 #define	THREAD_HAS_CACHE_WARMTH(thread)	\
 	((thread == curthread) ||	\
 	((ddi_get_lbolt() - thread->t_disp_time) <= rechoose_interval))
+
+/*
+ * Directed wakeups.
+ *
+ * Producer/consumer pairs that wake each other through user-level
+ * condition variables or futexes pay for a trip through a remote CPU's
+ * run queue on every wakeup.  While curthread->t_dirwake is set (see
+ * lwp_cond_signal() and the lx brand's futex_wake()), a thread woken by
+ * curthread may be placed on the waker's CPU instead of the CPU chosen for
+ * it:
+ *
+ *   disp_dirwake == 1:	if the waker's CPU has nothing else to run and the
+ *			chosen CPU is busy.  The woken thread then runs,
+ *			with the waker's data still in cache, as soon as
+ *			the waker blocks.
+ *
+ *   disp_dirwake == 2:	also if the woken thread outranks the waker, which
+ *			it then preempts, i.e. the waker hands its CPU
+ *			directly to the woken thread.
+ *
+ * disp_dirwake == 0 disables directed wakeups.
+ */
+int	disp_dirwake = 0;
+
+static cpu_t *
+disp_dirwake_cpu(kthread_t *tp, cpu_t *cp, pri_t tpri)
+{
+	cpu_t	*wcp = CPU;
+
+	if (curthread->t_dirwake == 0 || tp == curthread || cp == wcp)
+		return (cp);
+
+	if (wcp->cpu_part != tp->t_cpupart || wcp == cpu_inmotion ||
+	    !LGRP_CONTAINS_CPU(tp->t_lpl->lpl_lgrp, wcp) ||
+	    !smt_should_run(tp, wcp))
+		return (cp);
+
+	if ((disp_dirwake >= 2 && tpri > DISP_PRIO(curthread)) ||
+	    (wcp->cpu_disp->disp_nrunnable == 0 &&
+	    cp->cpu_dispatch_pri != -1)) {
+		DTRACE_PROBE3(dirwake, kthread_t *, tp, cpu_t *, cp,
+		    cpu_t *, wcp);
+		return (wcp);
+	}
+
+	return (cp);
+}
 /*
  * Put the specified thread on the back of the dispatcher
  * queue corresponding to its current priority.
@@ -1285,6 +1332,13 @@ setbackdq(kthread_t *tp)
 					cp = newcp;
 				}
 			}
+
+			/*
+			 * Keep the thread under the last level cache it
+			 * is warm in, if an idle CPU there allows it.
+			 */
+			cp = cmt_llc_place(tp, cp);
+			cp = disp_dirwake_cpu(tp, cp, tpri);
 		} else {
 			/*
 			 * Migrate to a cpu in the new partition.
@@ -1440,7 +1494,9 @@ setfrontdq(kthread_t *tp)
 			    (tpri < cp->cpu_disp->disp_maxrunpri &&
 			    !THREAD_HAS_CACHE_WARMTH(tp))) {
 				cp = disp_lowpri_cpu(tp->t_cpu, tp, tpri);
+				cp = cmt_llc_place(tp, cp);
 			}
+			cp = disp_dirwake_cpu(tp, cp, tpri);
 		} else {
 			/*
 			 * Migrate to a cpu in the new partition.
@@ -21,7 +21,7 @@
 
 /*
  * Copyright (c) 2003, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2012, 2014 by Delphix. All rights reserved.
  */
 
@@ -115,6 +115,7 @@
  * /etc/system.
  */
 int		dtrace_destructive_disallow = 0;
+int		dtrace_difo_fastpath = 1;
 dtrace_optval_t	dtrace_nonroot_maxsize = (16 * 1024 * 1024);
 size_t		dtrace_difo_maxsize = (256 * 1024);
 dtrace_optval_t	dtrace_dof_maxsize = (8 * 1024 * 1024);
@@ -5779,6 +5780,20 @@ dtrace_dif_emulate(dtrace_difo_t *difo, dtrace_mstate_t *mstate,
 	 */
 	mstate->dtms_difo = difo;
 
+	/*
+	 * DIFOs which simply return a constant or a built-in variable were
+	 * recognized by dtrace_difo_fastpath(); evaluate them directly.  A
+	 * pending fault is handled as the interpreter loop would handle it.
+	 */
+	if (difo->dtdo_fastop != DTRACE_DIFO_FAST_NONE &&
+	    !(*flags & CPU_DTRACE_FAULT)) {
+		if (difo->dtdo_fastop == DTRACE_DIFO_FAST_CONST)
+			return (difo->dtdo_fastval);
+
+		return (dtrace_dif_variable(mstate, state,
+		    difo->dtdo_fastarg, 0));
+	}
+
 	regs[DIF_REG_R0] = 0;		/* %r0 is fixed at zero */
 
 	while (pc < textlen && !(*flags & CPU_DTRACE_FAULT)) {
@@ -10122,6 +10137,71 @@ dtrace_difo_chunksize(dtrace_difo_t *dp, dtrace_vstate_t *vstate)
 	}
 }
 
+/*
+ * Determine whether a validated DIFO is one of the trivial forms that
+ * dtrace_dif_emulate() can evaluate without interpreting it:
+ *
+ *	ret	%r0			-> 0
+ *	setx	DT_INTEGER[n], %rd	-> inttab[n]
+ *	ret	%rd
+ *	ldgs	DT_VAR(id), %rd		-> built-in variable id
+ *	ret	%rd
+ *
+ * User-defined globals are not handled, as their values change under us;
+ * built-in variables are always fetched through dtrace_dif_variable() so
+ * that its privilege and fault checks are preserved.
+ */
+static void
+dtrace_difo_fastpath(dtrace_difo_t *dp)
+{
+	dif_instr_t i0, i1;
+	uint_t rd;
+
+	dp->dtdo_fastop = DTRACE_DIFO_FAST_NONE;
+
+	if (!dtrace_difo_fastpath)
+		return;
+
+	i0 = dp->dtdo_buf[0];
+
+	if (dp->dtdo_len == 1) {
+		if (DIF_INSTR_OP(i0) == DIF_OP_RET &&
+		    DIF_INSTR_RD(i0) == DIF_REG_R0) {
+			dp->dtdo_fastval = 0;
+			dp->dtdo_fastop = DTRACE_DIFO_FAST_CONST;
+		}
+		return;
+	}
+
+	if (dp->dtdo_len != 2)
+		return;
+
+	i1 = dp->dtdo_buf[1];
+	rd = DIF_INSTR_RD(i0);
+
+	if (DIF_INSTR_OP(i1) != DIF_OP_RET || DIF_INSTR_RD(i1) != rd)
+		return;
+
+	switch (DIF_INSTR_OP(i0)) {
+	case DIF_OP_SETX:
+		ASSERT(DIF_INSTR_INTEGER(i0) < dp->dtdo_intlen);
+		dp->dtdo_fastval = dp->dtdo_inttab[DIF_INSTR_INTEGER(i0)];
+		dp->dtdo_fastop = DTRACE_DIFO_FAST_CONST;
+		break;
+
+	case DIF_OP_LDGS:
+		if (DIF_INSTR_VAR(i0) >= DIF_VAR_OTHER_UBASE)
+			break;
+
+		dp->dtdo_fastarg = DIF_INSTR_VAR(i0);
+		dp->dtdo_fastop = DTRACE_DIFO_FAST_VAR;
+		break;
+
+	default:
+		break;
+	}
+}
+
 static void
 dtrace_difo_init(dtrace_difo_t *dp, dtrace_vstate_t *vstate)
 {
@@ -10232,6 +10312,7 @@ dtrace_difo_init(dtrace_difo_t *dp, dtrace_vstate_t *vstate)
 	}
 
 	dtrace_difo_chunksize(dp, vstate);
+	dtrace_difo_fastpath(dp);
 	dtrace_difo_hold(dp);
 }
 
@@ -21,6 +21,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 
@@ -40,6 +41,10 @@
 #include <sys/lockstat.h>
 #include <sys/atomic.h>
 #include <sys/dtrace.h>
+#include <sys/cpuvar.h>
+#include <sys/x_call.h>
+#include <sys/policy.h>
+#include <sys/zone.h>
 
 #include <sys/ddi.h>
 #include <sys/sunddi.h>
@@ -82,19 +87,590 @@ static dev_info_t	*lockstat_devi;	/* saved in xxattach() for xxinfo() */
 static kmutex_t		lockstat_test;	/* for testing purposes only */
 static dtrace_provider_id_t lockstat_id;
 
+/*
+ * Continuous contention profiling (see <sys/lockstat.h>)
+ *
+ * The profiler enables the lockstat probes it needs just as DTrace does, by
+ * setting their lockstat_probemap entries and hot-patching the lock
+ * primitives.  Where DTrace has not also enabled a probe, the entry is set
+ * to an ID with the high bit set (which no DTrace probe can have) encoding
+ * the probe, and lockstat_probe is pointed at lsprof_probe() rather than
+ * dtrace_probe() for the duration.  Probes enabled by both are passed on to
+ * DTrace after being recorded.  lsprof_lock serializes changes to
+ * lockstat_probemap made on behalf of either.
+ *
+ * Each CPU present when profiling starts has two tables of records, keyed
+ * by caller and lock type, used in the same way as stkprof's: the probe
+ * records into the active table with interrupts disabled, and a read
+ * switches tables with a cross-call to the CPU before draining the inactive
+ * one.  Sampling is by a simple per-CPU countdown.
+ *
+ * Hold times are measured by noting each sampled acquisition of an
+ * adaptive or reader/writer lock in a small global table hashed by lock and
+ * thread; a release by the same thread of a lock found there records the
+ * hold time against the site which acquired it.  A sampled acquisition
+ * whose slot is in use is simply not measured.
+ */
+#define	LSPROF_IDBIT		0x80000000U
+#define	LSPROF_ID(probe)	((dtrace_id_t)(LSPROF_IDBIT | (probe)))
+#define	LSPROF_ISID(id)		(((id) & LSPROF_IDBIT) != 0)
+#define	LSPROF_PROBE(id)	((int)((id) & ~LSPROF_IDBIT))
+
+#define	LSPROF_EV_NONE		0
+#define	LSPROF_EV_SPIN		1
+#define	LSPROF_EV_BLOCK		2
+#define	LSPROF_EV_ACQUIRE	3
+#define	LSPROF_EV_RELEASE	4
+
+typedef struct lsprof_ent {
+	uint32_t	lpe_hash;
+	uint32_t	lpe_used;
+	lsprof_rec_t	lpe_rec;
+} lsprof_ent_t;
+
+typedef struct lsprof_cpu {
+	lsprof_ent_t	*lpc_tab[2];		/* record tables */
+	uint64_t	lpc_drops[2];		/* drops, per table */
+	uint_t		lpc_active;		/* table being recorded to */
+	uint_t		lpc_countdown;		/* events until next sample */
+	processorid_t	lpc_cpuid;		/* CPU ID */
+} lsprof_cpu_t;
+
+typedef struct lsprof_held {
+	volatile uintptr_t lph_lock;		/* lock held, or 0 */
+	kthread_t	*lph_thread;		/* thread holding it */
+	uintptr_t	lph_caller;		/* site which acquired it */
+	hrtime_t	lph_start;		/* time of acquisition */
+	uint32_t	lph_type;		/* LSPROF_T_* lock type */
+} lsprof_held_t;
+
+/*
+ * Tunables.  lsprof_nentries is the number of distinct sites each CPU can
+ * record between reads, and lsprof_nprobes bounds the probe sequence in each
+ * table; lsprof_nheld (rounded up to a power of two) is the number of
+ * sampled acquisitions whose hold times can be measured at once.
+ * lsprof_aframes is the number of frames between lsprof_probe() and the
+ * caller of the lock primitive.
+ */
+uint_t	lsprof_nentries = 256;
+uint_t	lsprof_nprobes = 8;
+uint_t	lsprof_nheld = 1024;
+int	lsprof_aframes = 1;
+
+static kmutex_t		lsprof_lock;
+static volatile boolean_t lsprof_active;
+static volatile uint32_t lsprof_mask;	/* probes the profiler wants */
+static lsprof_conf_t	lsprof_conf;
+static lsprof_cpu_t	**lsprof_cpus;
+static uint_t		lsprof_tabents;
+static lsprof_held_t	*lsprof_held;
+static uint_t		lsprof_heldmask;
+static volatile uint32_t lsprof_nheldbusy;
+
+static void
+lockstat_quiesce(void)
+{
+	/*
+	 * The delay() here isn't as cheesy as you might think.  We don't
+	 * want to busy-loop in the kernel, so we have to give up the
+	 * CPU between calls to lockstat_active_threads(); that much is
+	 * obvious.  But the reason it's a do..while loop rather than a
+	 * while loop is subtle.  The memory barrier above guarantees that
+	 * no threads will enter the lockstat code from this point forward.
+	 * However, another thread could already be executing lockstat code
+	 * without our knowledge if the update to its t_lockstat field hasn't
+	 * cleared its CPU's store buffer.  Delaying for one clock tick
+	 * guarantees that either (1) the thread will have *ample* time to
+	 * complete its work, or (2) the thread will be preempted, in which
+	 * case it will have to grab and release a dispatcher lock, which
+	 * will flush that CPU's store buffer.  Either way we're covered.
+	 */
+	do {
+		delay(1);
+	} while (lockstat_active_threads());
+}
+
+static int
+lsprof_event(int probe, uint32_t *typep)
+{
+	switch (probe) {
+	case LS_MUTEX_ENTER_SPIN:
+		*typep = LSPROF_T_ADAPTIVE;
+		return (LSPROF_EV_SPIN);
+	case LS_MUTEX_ENTER_BLOCK:
+		*typep = LSPROF_T_ADAPTIVE;
+		return (LSPROF_EV_BLOCK);
+	case LS_MUTEX_ENTER_ACQUIRE:
+	case LS_MUTEX_TRYENTER_ACQUIRE:
+		*typep = LSPROF_T_ADAPTIVE;
+		return (LSPROF_EV_ACQUIRE);
+	case LS_MUTEX_EXIT_RELEASE:
+	case LS_MUTEX_DESTROY_RELEASE:
+		*typep = LSPROF_T_ADAPTIVE;
+		return (LSPROF_EV_RELEASE);
+	case LS_LOCK_SET_SPIN:
+	case LS_LOCK_SET_SPL_SPIN:
+		*typep = LSPROF_T_SPIN;
+		return (LSPROF_EV_SPIN);
+	case LS_RW_ENTER_BLOCK:
+		*typep = LSPROF_T_RW;
+		return (LSPROF_EV_BLOCK);
+	case LS_RW_ENTER_ACQUIRE:
+	case LS_RW_TRYENTER_ACQUIRE:
+		*typep = LSPROF_T_RW;
+		return (LSPROF_EV_ACQUIRE);
+	case LS_RW_EXIT_RELEASE:
+		*typep = LSPROF_T_RW;
+		return (LSPROF_EV_RELEASE);
+	case LS_THREAD_LOCK_SPIN:
+	case LS_THREAD_LOCK_HIGH_SPIN:
+		*typep = LSPROF_T_THREAD;
+		return (LSPROF_EV_SPIN);
+	default:
+		return (LSPROF_EV_NONE);
+	}
+}
+
+static lsprof_held_t *
+lsprof_held_slot(uintptr_t lp)
+{
+	uintptr_t h = (lp >> 3) ^ ((uintptr_t)curthread >> 7);
+
+	return (&lsprof_held[(h ^ (h >> 11)) & lsprof_heldmask]);
+}
+
+static lsprof_rec_t *
+lsprof_lookup(lsprof_cpu_t *lpc, uintptr_t caller, uint32_t type)
+{
+	lsprof_ent_t *tab = lpc->lpc_tab[lpc->lpc_active], *ent;
+	uint64_t h = (uint64_t)caller * 0x9e3779b97f4a7c15ULL;
+	uint32_t hashval = (uint32_t)(h >> 32) ^ type;
+	uint_t i, ndx = hashval % lsprof_tabents;
+
+	for (i = 0; i < lsprof_nprobes; i++) {
+		ent = &tab[(ndx + i) % lsprof_tabents];
+
+		if (!ent->lpe_used) {
+			ent->lpe_used = 1;
+			ent->lpe_hash = hashval;
+			ent->lpe_rec.lspr_caller = caller;
+			ent->lpe_rec.lspr_type = type;
+			ent->lpe_rec.lspr_cpu = lpc->lpc_cpuid;
+			return (&ent->lpe_rec);
+		}
+
+		if (ent->lpe_hash == hashval &&
+		    ent->lpe_rec.lspr_caller == caller &&
+		    ent->lpe_rec.lspr_type == type)
+			return (&ent->lpe_rec);
+	}
+
+	lpc->lpc_drops[lpc->lpc_active]++;
+	return (NULL);
+}
+
+static void
+lsprof_probe(dtrace_id_t id, uintptr_t lp, uintptr_t arg0, uintptr_t arg1,
+    uintptr_t arg2, uintptr_t arg3)
+{
+	dtrace_icookie_t cookie;
+	lsprof_cpu_t *lpc;
+	lsprof_held_t *lph;
+	lsprof_rec_t *rec;
+	pc_t caller;
+	hrtime_t hold;
+	uint32_t type;
+	int probe, ev;
+
+	if (!lsprof_active)
+		goto out;
+
+	if (LSPROF_ISID(id)) {
+		probe = LSPROF_PROBE(id);
+	} else {
+		/*
+		 * This probe was enabled by DTrace; see if we want it too.
+		 */
+		for (probe = 0; probe < LS_NPROBES; probe++) {
+			if (lockstat_probemap[probe] == id)
+				break;
+		}
+	}
+
+	if (probe >= LS_NPROBES || !(lsprof_mask & (1U << probe)))
+		goto out;
+
+	/*
+	 * As in stkprof, disabling interrupts keeps both the table switch
+	 * cross-call and any lock activity in interrupt context from landing
+	 * while we update the tables.
+	 */
+	cookie = dtrace_interrupt_disable();
+
+	if ((lpc = lsprof_cpus[CPU->cpu_id]) == NULL)
+		goto enable;
+
+	switch (ev = lsprof_event(probe, &type)) {
+	case LSPROF_EV_RELEASE:
+		if (lsprof_nheldbusy == 0)
+			break;
+
+		lph = lsprof_held_slot(lp);
+		if (lph->lph_lock != lp || lph->lph_thread != curthread)
+			break;
+
+		hold = gethrtime_waitfree() - lph->lph_start;
+		if ((rec = lsprof_lookup(lpc, lph->lph_caller,
+		    lph->lph_type)) != NULL) {
+			rec->lspr_nhold++;
+			rec->lspr_holdtime += hold;
+			rec->lspr_holdhist[MIN(hold <= 1 ? 0 :
+			    highbit64(hold) - 1, LSPROF_NBUCKETS - 1)]++;
+		}
+
+		lph->lph_thread = NULL;
+		membar_producer();
+		lph->lph_lock = 0;
+		atomic_dec_32(&lsprof_nheldbusy);
+		break;
+
+	case LSPROF_EV_ACQUIRE:
+	case LSPROF_EV_SPIN:
+	case LSPROF_EV_BLOCK:
+		if (--lpc->lpc_countdown != 0)
+			break;
+		lpc->lpc_countdown = lsprof_conf.lspc_rate;
+
+		dtrace_getpcstack(&caller, 1, lsprof_aframes, NULL);
+
+		if (ev == LSPROF_EV_ACQUIRE) {
+			lph = lsprof_held_slot(lp);
+			if (atomic_cas_ulong((ulong_t *)&lph->lph_lock, 0,
+			    lp) != 0)
+				break;
+			lph->lph_thread = curthread;
+			lph->lph_caller = (uintptr_t)caller;
+			lph->lph_type = type;
+			lph->lph_start = gethrtime_waitfree();
+			atomic_inc_32(&lsprof_nheldbusy);
+			break;
+		}
+
+		if ((rec = lsprof_lookup(lpc, (uintptr_t)caller,
+		    type)) == NULL)
+			break;
+
+		/* For spin and block events, arg0 is the time taken. */
+		if (ev == LSPROF_EV_SPIN) {
+			rec->lspr_nspin++;
+			rec->lspr_spintime += arg0;
+		} else {
+			rec->lspr_nblock++;
+			rec->lspr_blocktime += arg0;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+enable:
+	dtrace_interrupt_enable(cookie);
+out:
+	/*
+	 * Calling dtrace_probe() last allows it to be a tail call, leaving
+	 * the artificial frames of the lockstat probes as DTrace expects.
+	 */
+	if (!LSPROF_ISID(id))
+		dtrace_probe(id, lp, arg0, arg1, arg2, arg3);
+}
+
+/*
+ * Set the lockstat_probemap entry of a probe which is not enabled by DTrace
+ * to reflect whether the profiler wants it.
+ */
+static dtrace_id_t
+lsprof_mapid(int probe)
+{
+	ASSERT(MUTEX_HELD(&lsprof_lock));
+
+	return ((lsprof_mask & (1U << probe)) ? LSPROF_ID(probe) : 0);
+}
+
+static int
+lsprof_start(lsprof_conf_t *conf)
+{
+	size_t tabsz;
+	uint32_t mask = 0, type;
+	uint_t nheld;
+	int i, ev;
+
+	ASSERT(MUTEX_HELD(&lsprof_lock));
+
+	if (conf->lspc_rate == 0 || (conf->lspc_flags & ~LSPROF_F_ALL))
+		return (EINVAL);
+
+	if (lsprof_cpus != NULL)
+		return (EBUSY);
+
+	for (i = 0; i < LS_NPROBES; i++) {
+		ev = lsprof_event(i, &type);
+		if (ev == LSPROF_EV_SPIN || ev == LSPROF_EV_BLOCK ||
+		    ((ev == LSPROF_EV_ACQUIRE || ev == LSPROF_EV_RELEASE) &&
+		    (conf->lspc_flags & LSPROF_F_HOLD)))
+			mask |= (1U << i);
+	}
+
+	lsprof_conf = *conf;
+	lsprof_tabents = MAX(lsprof_nentries, 1);
+	tabsz = lsprof_tabents * sizeof (lsprof_ent_t);
+
+	for (nheld = 1; nheld < lsprof_nheld; nheld <<= 1)
+		continue;
+	lsprof_heldmask = nheld - 1;
+	lsprof_held = kmem_zalloc(nheld * sizeof (lsprof_held_t), KM_SLEEP);
+	lsprof_nheldbusy = 0;
+
+	/*
+	 * CPUs configured after this point are not profiled.
+	 */
+	lsprof_cpus = kmem_zalloc(max_ncpus * sizeof (lsprof_cpu_t *),
+	    KM_SLEEP);
+	mutex_enter(&cpu_lock);
+	for (i = 0; i < max_ncpus; i++) {
+		lsprof_cpu_t *lpc;
+
+		if (cpu_get(i) == NULL)
+			continue;
+
+		lpc = kmem_zalloc(sizeof (lsprof_cpu_t), KM_SLEEP);
+		lpc->lpc_tab[0] = kmem_zalloc(tabsz, KM_SLEEP);
+		lpc->lpc_tab[1] = kmem_zalloc(tabsz, KM_SLEEP);
+		lpc->lpc_countdown = conf->lspc_rate;
+		lpc->lpc_cpuid = i;
+		lsprof_cpus[i] = lpc;
+	}
+	mutex_exit(&cpu_lock);
+
+	/*
+	 * lockstat_probe must point at us before any probe can carry one of
+	 * our IDs.
+	 */
+	lockstat_probe = lsprof_probe;
+	membar_producer();
+	lsprof_mask = mask;
+	lsprof_active = B_TRUE;
+	membar_producer();
+
+	for (i = 0; i < LS_NPROBES; i++) {
+		if (lockstat_probemap[i] == 0)
+			lockstat_probemap[i] = lsprof_mapid(i);
+	}
+	membar_producer();
+
+	lockstat_hot_patch();
+	membar_producer();
+
+	return (0);
+}
+
+static void
+lsprof_stop(void)
+{
+	size_t tabsz = lsprof_tabents * sizeof (lsprof_ent_t);
+	int i;
+
+	ASSERT(MUTEX_HELD(&lsprof_lock));
+
+	if (lsprof_cpus == NULL)
+		return;
+
+	lsprof_active = B_FALSE;
+	lsprof_mask = 0;
+	membar_producer();
+
+	for (i = 0; i < LS_NPROBES; i++) {
+		if (LSPROF_ISID(lockstat_probemap[i]))
+			lockstat_probemap[i] = 0;
+	}
+	lockstat_hot_patch();
+	membar_producer();
+
+	/*
+	 * Once no thread is in lockstat code, none can be in lsprof_probe()
+	 * or hold one of our IDs, and it is safe to free our state.
+	 */
+	lockstat_quiesce();
+	lockstat_probe = dtrace_probe;
+	membar_producer();
+
+	for (i = 0; i < max_ncpus; i++) {
+		lsprof_cpu_t *lpc;
+
+		if ((lpc = lsprof_cpus[i]) == NULL)
+			continue;
+
+		kmem_free(lpc->lpc_tab[0], tabsz);
+		kmem_free(lpc->lpc_tab[1], tabsz);
+		kmem_free(lpc, sizeof (lsprof_cpu_t));
+	}
+	kmem_free(lsprof_cpus, max_ncpus * sizeof (lsprof_cpu_t *));
+	lsprof_cpus = NULL;
+
+	kmem_free(lsprof_held, (lsprof_heldmask + 1) * sizeof (lsprof_held_t));
+	lsprof_held = NULL;
+}
+
+/*ARGSUSED*/
+static int
+lsprof_switch(xc_arg_t arg1, xc_arg_t arg2, xc_arg_t arg3)
+{
+	lsprof_cpu_t *lpc = (lsprof_cpu_t *)arg1;
+
+	lpc->lpc_active ^= 1;
+	return (0);
+}
+
+static int
+lsprof_read(lsprof_read_t *rd)
+{
+	lsprof_rec_t *staging;
+	uint64_t left = rd->lsprd_bufsize / sizeof (lsprof_rec_t);
+	uintptr_t ubuf = (uintptr_t)rd->lsprd_buf;
+	size_t stagesz;
+	int i, error = 0;
+
+	ASSERT(MUTEX_HELD(&lsprof_lock));
+
+	if (lsprof_cpus == NULL)
+		return (ENXIO);
+
+	rd->lsprd_nrecs = 0;
+	rd->lsprd_drops = 0;
+
+	stagesz = lsprof_tabents * sizeof (lsprof_rec_t);
+	staging = kmem_alloc(stagesz, KM_SLEEP);
+
+	for (i = 0; i < max_ncpus; i++) {
+		lsprof_cpu_t *lpc;
+		lsprof_ent_t *tab;
+		cpuset_t set;
+		uint_t j, n = 0, inactive;
+
+		if ((lpc = lsprof_cpus[i]) == NULL)
+			continue;
+
+		CPUSET_ONLY(set, i);
+		kpreempt_disable();
+		xc_call((xc_arg_t)lpc, 0, 0, CPUSET2BV(set), lsprof_switch);
+		kpreempt_enable();
+
+		inactive = lpc->lpc_active ^ 1;
+		tab = lpc->lpc_tab[inactive];
+
+		for (j = 0; j < lsprof_tabents; j++) {
+			lsprof_rec_t *rec = &tab[j].lpe_rec;
+
+			if (!tab[j].lpe_used)
+				continue;
+
+			if (n < left) {
+				bcopy(rec, &staging[n], sizeof (lsprof_rec_t));
+				n++;
+			} else {
+				rd->lsprd_drops += rec->lspr_nspin +
+				    rec->lspr_nblock + rec->lspr_nhold;
+			}
+
+			bzero(&tab[j], sizeof (lsprof_ent_t));
+		}
+
+		rd->lsprd_drops += lpc->lpc_drops[inactive];
+		lpc->lpc_drops[inactive] = 0;
+
+		if (n == 0)
+			continue;
+
+		if (copyout(staging, (void *)ubuf,
+		    n * sizeof (lsprof_rec_t)) != 0) {
+			error = EFAULT;
+			break;
+		}
+
+		ubuf += n * sizeof (lsprof_rec_t);
+		rd->lsprd_nrecs += n;
+		left -= n;
+	}
+
+	kmem_free(staging, stagesz);
+	return (error);
+}
+
+/*ARGSUSED*/
+static int
+lockstat_ioctl(dev_t dev, int cmd, intptr_t arg, int md, cred_t *cr, int *rv)
+{
+	lsprof_conf_t conf;
+	lsprof_read_t rd;
+	int error;
+
+	if (crgetzoneid(cr) != GLOBAL_ZONEID ||
+	    secpolicy_sys_config(cr, B_FALSE) != 0)
+		return (EPERM);
+
+	switch (cmd) {
+	case LSPROFIOC_START:
+		if (ddi_copyin((void *)arg, &conf, sizeof (conf), md) != 0)
+			return (EFAULT);
+
+		mutex_enter(&lsprof_lock);
+		error = lsprof_start(&conf);
+		mutex_exit(&lsprof_lock);
+		return (error);
+
+	case LSPROFIOC_STOP:
+		mutex_enter(&lsprof_lock);
+		lsprof_stop();
+		mutex_exit(&lsprof_lock);
+		return (0);
+
+	case LSPROFIOC_READ:
+		if (ddi_copyin((void *)arg, &rd, sizeof (rd), md) != 0)
+			return (EFAULT);
+
+		mutex_enter(&lsprof_lock);
+		error = lsprof_read(&rd);
+		mutex_exit(&lsprof_lock);
+
+		if (error != 0)
+			return (error);
+
+		if (ddi_copyout(&rd, (void *)arg, sizeof (rd), md) != 0)
+			return (EFAULT);
+
+		return (0);
+
+	default:
+		return (ENOTTY);
+	}
+}
+
 /*ARGSUSED*/
 static int
 lockstat_enable(void *arg, dtrace_id_t id, void *parg)
 {
 	lockstat_probe_t *probe = parg;
 
-	ASSERT(!lockstat_probemap[probe->lsp_probe]);
+	mutex_enter(&lsprof_lock);
+	ASSERT(lockstat_probemap[probe->lsp_probe] == 0 ||
+	    LSPROF_ISID(lockstat_probemap[probe->lsp_probe]));
 
 	lockstat_probemap[probe->lsp_probe] = id;
 	membar_producer();
 
 	lockstat_hot_patch();
 	membar_producer();
+	mutex_exit(&lsprof_lock);
 
 	/*
 	 * Immediately generate a record for the lockstat_test mutex
@@ -112,11 +688,13 @@ lockstat_disable(void *arg, dtrace_id_t id, void *parg)
 	lockstat_probe_t *probe = parg;
 	int i;
 
+	mutex_enter(&lsprof_lock);
 	ASSERT(lockstat_probemap[probe->lsp_probe]);
 
-	lockstat_probemap[probe->lsp_probe] = 0;
+	lockstat_probemap[probe->lsp_probe] = lsprof_mapid(probe->lsp_probe);
 	lockstat_hot_patch();
 	membar_producer();
+	mutex_exit(&lsprof_lock);
 
 	/*
 	 * See if we have any probes left enabled.
@@ -132,24 +710,7 @@ lockstat_disable(void *arg, dtrace_id_t id, void *parg)
 		}
 	}
 
-	/*
-	 * The delay() here isn't as cheesy as you might think.  We don't
-	 * want to busy-loop in the kernel, so we have to give up the
-	 * CPU between calls to lockstat_active_threads(); that much is
-	 * obvious.  But the reason it's a do..while loop rather than a
-	 * while loop is subtle.  The memory barrier above guarantees that
-	 * no threads will enter the lockstat code from this point forward.
-	 * However, another thread could already be executing lockstat code
-	 * without our knowledge if the update to its t_lockstat field hasn't
-	 * cleared its CPU's store buffer.  Delaying for one clock tick
-	 * guarantees that either (1) the thread will have *ample* time to
-	 * complete its work, or (2) the thread will be preempted, in which
-	 * case it will have to grab and release a dispatcher lock, which
-	 * will flush that CPU's store buffer.  Either way we're covered.
-	 */
-	do {
-		delay(1);
-	} while (lockstat_active_threads());
+	lockstat_quiesce();
 }
 
 /*ARGSUSED*/
@@ -159,6 +720,16 @@ lockstat_open(dev_t *devp, int flag, int otyp, cred_t *cred_p)
 	return (0);
 }
 
+/*ARGSUSED*/
+static int
+lockstat_close(dev_t dev, int flag, int otyp, cred_t *cred_p)
+{
+	mutex_enter(&lsprof_lock);
+	lsprof_stop();
+	mutex_exit(&lsprof_lock);
+	return (0);
+}
+
 /* ARGSUSED */
 static int
 lockstat_info(dev_info_t *dip, ddi_info_cmd_t infocmd, void *arg, void **result)
@@ -271,6 +842,13 @@ lockstat_detach(dev_info_t *devi, ddi_detach_cmd_t cmd)
 		return (DDI_FAILURE);
 	}
 
+	mutex_enter(&lsprof_lock);
+	if (lsprof_cpus != NULL) {
+		mutex_exit(&lsprof_lock);
+		return (DDI_FAILURE);
+	}
+	mutex_exit(&lsprof_lock);
+
 	if (dtrace_unregister(lockstat_id) != 0)
 		return (DDI_FAILURE);
 
@@ -283,13 +861,13 @@ lockstat_detach(dev_info_t *devi, ddi_detach_cmd_t cmd)
  */
 static struct cb_ops lockstat_cb_ops = {
 	lockstat_open,		/* open */
-	nodev,			/* close */
+	lockstat_close,		/* close */
 	nulldev,		/* strategy */
 	nulldev,		/* print */
 	nodev,			/* dump */
 	nodev,			/* read */
 	nodev,			/* write */
-	nodev,			/* ioctl */
+	lockstat_ioctl,		/* ioctl */
 	nodev,			/* devmap */
 	nodev,			/* mmap */
 	nodev,			/* segmap */
@@ -54,6 +54,11 @@
 #include <sys/kstat.h>
 #include <sys/atomic.h>
 #include <sys/taskq.h>
+#include <sys/cpuvar.h>
+#include <sys/disp.h>
+#include <sys/cpu.h>
+#include <sys/errno.h>
+#include <sys/zone.h>
 
 /*
  * Directory name lookup cache.
@@ -205,6 +210,11 @@ struct nc_stats ncs = {
 	{ "pick_free",			KSTAT_DATA_UINT64 },
 	{ "pick_heuristic",		KSTAT_DATA_UINT64 },
 	{ "pick_last",			KSTAT_DATA_UINT64 },
+	{ "lockless_hits",		KSTAT_DATA_UINT64 },
+	{ "zone_limit",			KSTAT_DATA_UINT64 },
+	{ "negative_limit",		KSTAT_DATA_UINT64 },
+	{ "invalidations",		KSTAT_DATA_UINT64 },
+	{ "stale",			KSTAT_DATA_UINT64 },
 
 	/* directory caching stats */
 
@@ -229,6 +239,236 @@ static int doingcache = 1;
 
 vnode_t negative_cache_vnode;
 
+/*
+ * Lockless lookups
+ * ================
+ *
+ * A handful of popular directories make every stat() and open() in a busy
+ * zone hash to the same few buckets, and the bucket mutex becomes the
+ * bottleneck.  So dnlc_lookup() first walks the hash chain without
+ * hash_lock, and takes the bucket lock only when that finds nothing.
+ *
+ * A reader on the lockless path marks its CPU's slot in dnlc_readers
+ * active, with kernel preemption disabled, for as long as it is looking at
+ * the chain.  It must not block while marked.  So it only tries the
+ * v_lock of the vnode it found; if that fails it goes back to the locked
+ * path.
+ *
+ * Writers still change the chains under hash_lock.  An entry that has been
+ * unlinked keeps its hash_next pointer, so a reader standing on it can
+ * carry on walking.  Before a writer frees an unlinked entry, or drops the
+ * DNLC holds on vnodes that a reader might have picked up from it, it calls
+ * dnlc_sync().  That waits until every CPU has been seen outside a lockless
+ * walk.  Any reader that starts after the unlink cannot find the entry, so
+ * the entry and its vnodes stay valid for as long as any reader can see
+ * them.  Life cycles of entries and DNLC holds are otherwise unchanged.
+ *
+ * Set dnlc_lockless to 0 to always take the bucket lock.
+ */
+typedef struct dnlc_reader {
+	volatile uint_t	dr_active;	/* in a lockless walk */
+	uint64_t	dr_hits;	/* lockless hits on this CPU */
+	uint64_t	dr_neg_hits;	/* ... of which negative */
+	char		dr_pad[64 - sizeof (uint_t) - 2 * sizeof (uint64_t)];
+} dnlc_reader_t;
+
+int dnlc_lockless = 1;
+uint_t dnlc_lockless_maxdepth = 64;	/* give up walking after this */
+
+static dnlc_reader_t *dnlc_readers;
+static uint64_t dnlc_lockless_hits_seen;
+static uint64_t dnlc_lockless_neg_hits_seen;
+
+/*
+ * Wait until no CPU is in a lockless walk that started before the caller
+ * unlinked its entries.
+ */
+static void
+dnlc_sync(void)
+{
+	int i;
+
+	if (dnlc_readers == NULL)
+		return;
+
+	membar_sync();
+	for (i = 0; i < max_ncpus; i++) {
+		while (dnlc_readers[i].dr_active != 0)
+			SMT_PAUSE();
+	}
+}
+
+static int
+dnlc_kstat_update(kstat_t *ksp, int rw)
+{
+	uint64_t hits = 0, neg_hits = 0;
+	int i;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	if (dnlc_readers == NULL)
+		return (0);
+
+	for (i = 0; i < max_ncpus; i++) {
+		hits += dnlc_readers[i].dr_hits;
+		neg_hits += dnlc_readers[i].dr_neg_hits;
+	}
+
+	/*
+	 * Fold the per-CPU counts into the shared totals.
+	 */
+	ncs.ncs_hits.value.ui64 += hits - dnlc_lockless_hits_seen;
+	ncs.ncs_neg_hits.value.ui64 += neg_hits - dnlc_lockless_neg_hits_seen;
+	ncs.ncs_lockless_hits.value.ui64 = hits;
+	dnlc_lockless_hits_seen = hits;
+	dnlc_lockless_neg_hits_seen = neg_hits;
+
+	return (0);
+}
+
+/*
+ * Zone shares and directory generations
+ * =====================================
+ *
+ * Every entry is charged to the zone that entered it.  A non-global zone
+ * may hold at most dnlc_zone_max_pct percent of ncsize entries, so that a
+ * single zone walking a huge tree can't push everybody else's names out.
+ * The global zone is bounded only by ncsize.  Within any zone, negative
+ * entries may make up at most dnlc_neg_max_pct percent of the zone's
+ * share; a zone stat()ing lots of names that don't exist otherwise fills
+ * the cache with DNLC_NO_VNODE.  An enter that would exceed a limit is
+ * dropped and a taskq trims the zone back to 90% of the limit.
+ *
+ * Directories also carry a generation number, kept in dnlc_dgen hashed on
+ * the vnode address.  Each entry records its directory's generation when
+ * it's entered, and dnlc_invalidate() bumps it.  Lookups treat an entry
+ * whose generation no longer matches as a miss and remove it, and the
+ * reduce code picks stale entries first.  This invalidates every name
+ * under a directory without the full table walk of dnlc_purge_vp().
+ * Directories that collide in dnlc_dgen are invalidated together, which
+ * only costs some misses.  Entries naming the directory itself, in its
+ * parent, are not affected.
+ */
+typedef struct dnlc_zone {
+	volatile uint32_t dz_nentries;	/* entries charged to the zone */
+	volatile uint32_t dz_nneg;	/* ... of which negative */
+	volatile uint_t	dz_reducing;	/* zone reduce queued or running */
+	zoneid_t	dz_zoneid;
+} dnlc_zone_t;
+
+uint_t dnlc_zone_max_pct = 50;	/* share of ncsize per non-global zone */
+uint_t dnlc_neg_max_pct = 25;	/* share of a zone's limit, negative */
+
+static volatile uint32_t *dnlc_dgen;
+
+#define	DNLC_DGEN(dp)	\
+	dnlc_dgen[((uintptr_t)(dp) >> 8) & nc_hashmask]
+#define	DNLC_STALE(ncp)	((ncp)->gen != DNLC_DGEN((ncp)->dp))
+
+#define	DNLC_ZONE_MAX(dz)						\
+	((dz)->dz_zoneid == GLOBAL_ZONEID ? (uint_t)ncsize :		\
+	    (uint_t)ncsize / 100 * dnlc_zone_max_pct)
+#define	DNLC_ZONE_NEG_MAX(dz)	(DNLC_ZONE_MAX(dz) / 100 * dnlc_neg_max_pct)
+
+/*
+ * Return the accounting for a zone, setting it up on first use.  Returns
+ * NULL if there's no memory, in which case entries go uncharged.
+ */
+static dnlc_zone_t *
+dnlc_zone_get(zone_t *zone)
+{
+	dnlc_zone_t *dz;
+
+	if ((dz = zone->zone_dnlc) != NULL)
+		return (dz);
+
+	if ((dz = kmem_zalloc(sizeof (*dz), KM_NOSLEEP)) == NULL)
+		return (NULL);
+	dz->dz_zoneid = zone->zone_id;
+	if (atomic_cas_ptr(&zone->zone_dnlc, NULL, dz) != NULL) {
+		kmem_free(dz, sizeof (*dz));
+		dz = zone->zone_dnlc;
+	}
+	return (dz);
+}
+
+static void do_dnlc_reduce_zone(void *);
+
+static void
+dnlc_zone_reduce(dnlc_zone_t *dz)
+{
+	if (atomic_cas_uint(&dz->dz_reducing, 0, 1) != 0)
+		return;
+	if (taskq_dispatch(system_taskq, do_dnlc_reduce_zone, dz,
+	    TQ_NOSLEEP) == TASKQID_INVALID)
+		dz->dz_reducing = 0;
+}
+
+/*
+ * Charge a new entry to the current zone.  Returns 0 if the zone is at
+ * one of its limits and the entry should not be cached.
+ */
+static int
+dnlc_zone_charge(ncache_t *ncp)
+{
+	dnlc_zone_t *dz;
+
+	if ((dz = dnlc_zone_get(curzone)) == NULL)
+		return (1);
+
+	if (dz->dz_nentries >= DNLC_ZONE_MAX(dz)) {
+		ncs.ncs_zone_limit.value.ui64++;
+		dnlc_zone_reduce(dz);
+		return (0);
+	}
+	if (ncp->vp == DNLC_NO_VNODE) {
+		if (dz->dz_nneg >= DNLC_ZONE_NEG_MAX(dz)) {
+			ncs.ncs_neg_limit.value.ui64++;
+			dnlc_zone_reduce(dz);
+			return (0);
+		}
+		atomic_inc_32(&dz->dz_nneg);
+	}
+	atomic_inc_32(&dz->dz_nentries);
+	ncp->zone = dz;
+	return (1);
+}
+
+static void
+dnlc_zone_uncharge(ncache_t *ncp)
+{
+	dnlc_zone_t *dz = ncp->zone;
+
+	if (dz == NULL)
+		return;
+	if (ncp->vp == DNLC_NO_VNODE)
+		atomic_dec_32(&dz->dz_nneg);
+	atomic_dec_32(&dz->dz_nentries);
+}
+
+/*
+ * Point an entry at a new vnode and bring it up to date, with the hash
+ * lock held.  Returns the old vnode, whose DNLC hold the caller drops
+ * after dnlc_sync().
+ */
+static vnode_t *
+dnlc_replace_vp(ncache_t *ncp, vnode_t *vp, uint32_t gen)
+{
+	vnode_t *ovp = ncp->vp;
+	dnlc_zone_t *dz = ncp->zone;
+
+	if (dz != NULL && (ovp == DNLC_NO_VNODE) != (vp == DNLC_NO_VNODE)) {
+		if (vp == DNLC_NO_VNODE)
+			atomic_inc_32(&dz->dz_nneg);
+		else
+			atomic_dec_32(&dz->dz_nneg);
+	}
+	ncp->vp = vp;
+	ncp->gen = gen;
+	return (ovp);
+}
+
 /*
  * Insert entry at the front of the queue
  */
@@ -236,19 +476,31 @@ vnode_t negative_cache_vnode;
 { \
 	(ncp)->hash_next = (hp)->hash_next; \
 	(ncp)->hash_prev = (ncache_t *)(hp); \
+	membar_producer(); /* for lockless readers */ \
 	(hp)->hash_next->hash_prev = (ncp); \
 	(hp)->hash_next = (ncp); \
 }
 
 /*
- * Remove entry from hash queue
+ * Remove entry from hash queue.  hash_next is left alone so that a lockless
+ * reader on the entry can keep walking the chain.
  */
 #define	nc_rmhash(ncp) \
 { \
 	(ncp)->hash_prev->hash_next = (ncp)->hash_next; \
 	(ncp)->hash_next->hash_prev = (ncp)->hash_prev; \
 	(ncp)->hash_prev = NULL; \
-	(ncp)->hash_next = NULL; \
+}
+
+/*
+ * Remove an entry from its hash queue and put it on a list of entries to
+ * be freed after dnlc_sync(), chained on hash_prev.
+ */
+#define	nc_rmhash_defer(ncp, list) \
+{ \
+	nc_rmhash(ncp); \
+	(ncp)->hash_prev = (list); \
+	(list) = (ncp); \
 }
 
 /*
@@ -256,10 +508,25 @@ vnode_t negative_cache_vnode;
  */
 #define	dnlc_free(ncp) \
 { \
+	dnlc_zone_uncharge(ncp); \
 	kmem_free((ncp), sizeof (ncache_t) + (ncp)->namlen); \
 	atomic_dec_32(&dnlc_nentries); \
 }
 
+/*
+ * Free a list of unlinked entries, chained on hash_prev.
+ */
+static void
+dnlc_free_list(ncache_t *ncp)
+{
+	ncache_t *np;
+
+	for (; ncp != NULL; ncp = np) {
+		np = ncp->hash_prev;
+		dnlc_free(ncp);
+	}
+}
+
 
 /*
  * Cached directory info.
@@ -376,6 +643,9 @@ dnlc_init()
 	nc_hashsz = 1 << highbit(nc_hashsz);
 	nc_hashmask = nc_hashsz - 1;
 	nc_hash = kmem_zalloc(nc_hashsz * sizeof (*nc_hash), KM_SLEEP);
+	dnlc_readers = kmem_zalloc(max_ncpus * sizeof (dnlc_reader_t),
+	    KM_SLEEP);
+	dnlc_dgen = kmem_zalloc(nc_hashsz * sizeof (*dnlc_dgen), KM_SLEEP);
 	for (i = 0; i < nc_hashsz; i++) {
 		hp = (nc_hash_t *)&nc_hash[i];
 		mutex_init(&hp->hash_lock, NULL, MUTEX_DEFAULT, NULL);
@@ -426,6 +696,7 @@ dnlc_init()
 	    sizeof (ncs) / sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
 	if (ksp) {
 		ksp->ks_data = (void *) &ncs;
+		ksp->ks_update = dnlc_kstat_update;
 		kstat_install(ksp);
 	}
 }
@@ -437,8 +708,11 @@ void
 dnlc_enter(vnode_t *dp, const char *name, vnode_t *vp)
 {
 	ncache_t *ncp;
+	ncache_t *tcp;
+	vnode_t *tvp;
 	nc_hash_t *hp;
 	uchar_t namlen;
+	uint32_t gen;
 	int hash;
 
 	TRACE_0(TR_FAC_NFS, TR_DNLC_ENTER_START, "dnlc_enter_start:");
@@ -454,6 +728,7 @@ dnlc_enter(vnode_t *dp, const char *name, vnode_t *vp)
 	 * and initialize it now
 	 */
 	DNLCHASH(name, dp, hash, namlen);
+	gen = DNLC_DGEN(dp);
 	if ((ncp = dnlc_get(namlen)) == NULL)
 		return;
 	ncp->dp = dp;
@@ -462,10 +737,28 @@ dnlc_enter(vnode_t *dp, const char *name, vnode_t *vp)
 	VN_HOLD_DNLC(vp);
 	bcopy(name, ncp->name, namlen + 1); /* name and null */
 	ncp->hash = hash;
+	ncp->gen = gen;
 	hp = &nc_hash[hash & nc_hashmask];
 
 	mutex_enter(&hp->hash_lock);
-	if (dnlc_search(dp, name, namlen, hash) != NULL) {
+	if ((tcp = dnlc_search(dp, name, namlen, hash)) != NULL) {
+		if (tcp->gen != gen) {
+			/*
+			 * The cached entry was invalidated; reuse it for
+			 * the new vnode, as dnlc_update() would.
+			 */
+			tvp = dnlc_replace_vp(tcp, vp, gen);
+			mutex_exit(&hp->hash_lock);
+			dnlc_sync();
+			VN_RELE_DNLC(tvp);
+			VN_RELE_DNLC(dp);
+			dnlc_free(ncp);
+			ncstats.enters++;
+			ncs.ncs_enters.value.ui64++;
+			TRACE_2(TR_FAC_NFS, TR_DNLC_ENTER_END,
+			    "dnlc_enter_end:(%S) %d", "done", ncstats.enters);
+			return;
+		}
 		mutex_exit(&hp->hash_lock);
 		ncstats.dbl_enters++;
 		ncs.ncs_dbl_enters.value.ui64++;
@@ -476,6 +769,15 @@ dnlc_enter(vnode_t *dp, const char *name, vnode_t *vp)
 		    "dnlc_enter_end:(%S) %d", "dbl enter", ncstats.dbl_enters);
 		return;
 	}
+	if (!dnlc_zone_charge(ncp)) {
+		mutex_exit(&hp->hash_lock);
+		VN_RELE_DNLC(dp);
+		VN_RELE_DNLC(vp);
+		dnlc_free(ncp);
+		TRACE_2(TR_FAC_NFS, TR_DNLC_ENTER_END,
+		    "dnlc_enter_end:(%S) %d", "zone limit", 0);
+		return;
+	}
 	/*
 	 * Insert back into the hash chain.
 	 */
@@ -508,6 +810,7 @@ dnlc_update(vnode_t *dp, const char *name, vnode_t *vp)
 	nc_hash_t *hp;
 	int hash;
 	uchar_t namlen;
+	uint32_t gen;
 
 	TRACE_0(TR_FAC_NFS, TR_DNLC_ENTER_START, "dnlc_update_start:");
 
@@ -526,6 +829,7 @@ dnlc_update(vnode_t *dp, const char *name, vnode_t *vp)
 	 * lookup (negative/stale entry).
 	 */
 	DNLCHASH(name, dp, hash, namlen);
+	gen = DNLC_DGEN(dp);
 	if ((ncp = dnlc_get(namlen)) == NULL) {
 		dnlc_remove(dp, name);
 		return;
@@ -536,20 +840,22 @@ dnlc_update(vnode_t *dp, const char *name, vnode_t *vp)
 	VN_HOLD_DNLC(vp);
 	bcopy(name, ncp->name, namlen + 1); /* name and null */
 	ncp->hash = hash;
+	ncp->gen = gen;
 	hp = &nc_hash[hash & nc_hashmask];
 
 	mutex_enter(&hp->hash_lock);
 	if ((tcp = dnlc_search(dp, name, namlen, hash)) != NULL) {
 		if (tcp->vp != vp) {
-			tvp = tcp->vp;
-			tcp->vp = vp;
+			tvp = dnlc_replace_vp(tcp, vp, gen);
 			mutex_exit(&hp->hash_lock);
+			dnlc_sync();
 			VN_RELE_DNLC(tvp);
 			ncstats.enters++;
 			ncs.ncs_enters.value.ui64++;
 			TRACE_2(TR_FAC_NFS, TR_DNLC_ENTER_END,
 			    "dnlc_update_end:(%S) %d", "done", ncstats.enters);
 		} else {
+			tcp->gen = gen;
 			mutex_exit(&hp->hash_lock);
 			VN_RELE_DNLC(vp);
 			ncstats.dbl_enters++;
@@ -562,6 +868,15 @@ dnlc_update(vnode_t *dp, const char *name, vnode_t *vp)
 		dnlc_free(ncp);		/* crfree done here */
 		return;
 	}
+	if (!dnlc_zone_charge(ncp)) {
+		mutex_exit(&hp->hash_lock);
+		VN_RELE_DNLC(dp);
+		VN_RELE_DNLC(vp);
+		dnlc_free(ncp);
+		TRACE_2(TR_FAC_NFS, TR_DNLC_ENTER_END,
+		    "dnlc_update_end:(%S) %d", "zone limit", 0);
+		return;
+	}
 	/*
 	 * insert the new entry, since it is not in dnlc yet
 	 */
@@ -573,6 +888,53 @@ dnlc_update(vnode_t *dp, const char *name, vnode_t *vp)
 	    "dnlc_update_end:(%S) %d", "done", ncstats.enters);
 }
 
+/*
+ * Walk a hash chain without its lock; see "Lockless lookups" above.
+ * Returns a held vnode, or NULL if the caller must use the locked path.
+ */
+static vnode_t *
+dnlc_lookup_lockless(nc_hash_t *hp, vnode_t *dp, const char *name,
+    uchar_t namlen, int hash)
+{
+	dnlc_reader_t *dr;
+	ncache_t *ncp;
+	vnode_t *vp = NULL;
+	uint_t depth = 0;
+
+	kpreempt_disable();
+	dr = &dnlc_readers[CPU->cpu_seqid];
+	dr->dr_active = 1;
+	membar_enter();
+
+	for (ncp = hp->hash_next; ncp != (ncache_t *)hp &&
+	    depth < dnlc_lockless_maxdepth; ncp = ncp->hash_next, depth++) {
+		if (ncp->hash == hash &&
+		    ncp->dp == dp &&
+		    ncp->namlen == namlen &&
+		    bcmp(ncp->name, name, namlen) == 0) {
+			if (DNLC_STALE(ncp))
+				break;	/* locked path removes it */
+			vp = ncp->vp;
+			if (mutex_tryenter(&vp->v_lock)) {
+				VN_HOLD_LOCKED(vp);
+				mutex_exit(&vp->v_lock);
+				dr->dr_hits++;
+				if (vp == DNLC_NO_VNODE)
+					dr->dr_neg_hits++;
+			} else {
+				vp = NULL;
+			}
+			break;
+		}
+	}
+
+	membar_exit();
+	dr->dr_active = 0;
+	kpreempt_enable();
+
+	return (vp);
+}
+
 /*
  * Look up a name in the directory name cache.
  *
@@ -601,8 +963,17 @@ dnlc_lookup(vnode_t *dp, const char *name)
 	}
 
 	DNLCHASH(name, dp, hash, namlen);
-	depth = 1;
 	hp = &nc_hash[hash & nc_hashmask];
+
+	if (dnlc_lockless && dnlc_readers != NULL &&
+	    (vp = dnlc_lookup_lockless(hp, dp, name, namlen, hash)) != NULL) {
+		TRACE_4(TR_FAC_NFS, TR_DNLC_LOOKUP_END,
+		    "dnlc_lookup_end:%S %d vp %x name %s", "hit",
+		    ncstats.hits, vp, name);
+		return (vp);
+	}
+
+	depth = 1;
 	mutex_enter(&hp->hash_lock);
 
 	for (ncp = hp->hash_next; ncp != (ncache_t *)hp;
@@ -611,6 +982,20 @@ dnlc_lookup(vnode_t *dp, const char *name)
 		    ncp->dp == dp &&
 		    ncp->namlen == namlen &&
 		    bcmp(ncp->name, name, namlen) == 0) {
+			if (DNLC_STALE(ncp)) {
+				/*
+				 * The directory was invalidated since this
+				 * entry was made.  Drop it and miss.
+				 */
+				nc_rmhash(ncp);
+				mutex_exit(&hp->hash_lock);
+				ncs.ncs_stale.value.ui64++;
+				dnlc_sync();
+				VN_RELE_DNLC(ncp->vp);
+				VN_RELE_DNLC(ncp->dp);
+				dnlc_free(ncp);
+				goto miss;
+			}
 			/*
 			 * Move this entry to the head of its hash chain
 			 * if it's not already close.
@@ -651,6 +1036,7 @@ dnlc_lookup(vnode_t *dp, const char *name)
 	}
 
 	mutex_exit(&hp->hash_lock);
+miss:
 	ncstats.misses++;
 	ncs.ncs_misses.value.ui64++;
 	TRACE_4(TR_FAC_NFS, TR_DNLC_LOOKUP_END,
@@ -682,6 +1068,7 @@ dnlc_remove(vnode_t *dp, const char *name)
 		 */
 		nc_rmhash(ncp);
 		mutex_exit(&hp->hash_lock);
+		dnlc_sync();
 		VN_RELE_DNLC(ncp->vp);
 		VN_RELE_DNLC(ncp->dp);
 		dnlc_free(ncp);
@@ -701,6 +1088,7 @@ dnlc_purge()
 	int index;
 	int i;
 	vnode_t *nc_rele[DNLC_MAX_RELE];
+	ncache_t *dead;
 
 	if (!doingcache)
 		return;
@@ -710,6 +1098,7 @@ dnlc_purge()
 
 	for (nch = nc_hash; nch < &nc_hash[nc_hashsz]; nch++) {
 		index = 0;
+		dead = NULL;
 		mutex_enter(&nch->hash_lock);
 		ncp = nch->hash_next;
 		while (ncp != (ncache_t *)nch) {
@@ -719,8 +1108,7 @@ dnlc_purge()
 			nc_rele[index++] = ncp->vp;
 			nc_rele[index++] = ncp->dp;
 
-			nc_rmhash(ncp);
-			dnlc_free(ncp);
+			nc_rmhash_defer(ncp, dead);
 			ncp = np;
 			ncs.ncs_purge_total.value.ui64++;
 			if (index == DNLC_MAX_RELE)
@@ -728,6 +1116,11 @@ dnlc_purge()
 		}
 		mutex_exit(&nch->hash_lock);
 
+		if (dead != NULL) {
+			dnlc_sync();
+			dnlc_free_list(dead);
+		}
+
 		/* Release holds on all the vnodes now that we have no locks */
 		for (i = 0; i < index; i++) {
 			VN_RELE_DNLC(nc_rele[i]);
@@ -749,6 +1142,7 @@ dnlc_purge_vp(vnode_t *vp)
 	ncache_t *ncp;
 	int index;
 	vnode_t *nc_rele[DNLC_MAX_RELE];
+	ncache_t *dead;
 
 	ASSERT(vp->v_count > 0);
 	if (vp->v_count_dnlc == 0) {
@@ -763,6 +1157,7 @@ dnlc_purge_vp(vnode_t *vp)
 
 	for (nch = nc_hash; nch < &nc_hash[nc_hashsz]; nch++) {
 		index = 0;
+		dead = NULL;
 		mutex_enter(&nch->hash_lock);
 		ncp = nch->hash_next;
 		while (ncp != (ncache_t *)nch) {
@@ -772,8 +1167,7 @@ dnlc_purge_vp(vnode_t *vp)
 			if (ncp->dp == vp || ncp->vp == vp) {
 				nc_rele[index++] = ncp->vp;
 				nc_rele[index++] = ncp->dp;
-				nc_rmhash(ncp);
-				dnlc_free(ncp);
+				nc_rmhash_defer(ncp, dead);
 				ncs.ncs_purge_total.value.ui64++;
 				if (index == DNLC_MAX_RELE) {
 					ncp = np;
@@ -784,6 +1178,11 @@ dnlc_purge_vp(vnode_t *vp)
 		}
 		mutex_exit(&nch->hash_lock);
 
+		if (dead != NULL) {
+			dnlc_sync();
+			dnlc_free_list(dead);
+		}
+
 		/* Release holds on all the vnodes now that we have no locks */
 		while (index) {
 			VN_RELE_DNLC(nc_rele[--index]);
@@ -799,6 +1198,22 @@ dnlc_purge_vp(vnode_t *vp)
 	}
 }
 
+/*
+ * Invalidate all the names cached under a directory, without walking the
+ * table; see "Zone shares and directory generations" above.  Unlike
+ * dnlc_purge_vp(), the entries and their vnode holds go away lazily, and
+ * entries naming dp itself are kept.
+ */
+void
+dnlc_invalidate(vnode_t *dp)
+{
+	if (!doingcache || dp->v_count_dnlc == 0)
+		return;
+
+	atomic_inc_32(&DNLC_DGEN(dp));
+	ncs.ncs_invalidate.value.ui64++;
+}
+
 /*
  * Purge cache entries referencing a vfsp.  Caller supplies a count
  * of entries to purge; up to that many will be freed.  A count of
@@ -814,6 +1229,7 @@ dnlc_purge_vfsp(vfs_t *vfsp, int count)
 	int index;
 	int i;
 	vnode_t *nc_rele[DNLC_MAX_RELE];
+	ncache_t *dead;
 
 	if (!doingcache)
 		return (0);
@@ -823,6 +1239,7 @@ dnlc_purge_vfsp(vfs_t *vfsp, int count)
 
 	for (nch = nc_hash; nch < &nc_hash[nc_hashsz]; nch++) {
 		index = 0;
+		dead = NULL;
 		mutex_enter(&nch->hash_lock);
 		ncp = nch->hash_next;
 		while (ncp != (ncache_t *)nch) {
@@ -836,8 +1253,7 @@ dnlc_purge_vfsp(vfs_t *vfsp, int count)
 				n++;
 				nc_rele[index++] = ncp->vp;
 				nc_rele[index++] = ncp->dp;
-				nc_rmhash(ncp);
-				dnlc_free(ncp);
+				nc_rmhash_defer(ncp, dead);
 				ncs.ncs_purge_total.value.ui64++;
 				if (index == DNLC_MAX_RELE) {
 					ncp = np;
@@ -850,6 +1266,10 @@ dnlc_purge_vfsp(vfs_t *vfsp, int count)
 			ncp = np;
 		}
 		mutex_exit(&nch->hash_lock);
+		if (dead != NULL) {
+			dnlc_sync();
+			dnlc_free_list(dead);
+		}
 		/* Release holds on all the vnodes now that we have no locks */
 		for (i = 0; i < index; i++) {
 			VN_RELE_DNLC(nc_rele[i]);
@@ -911,6 +1331,7 @@ dnlc_fs_purge1(vnodeops_t *vop)
 		if (ncp != (ncache_t *)hp) {
 			nc_rmhash(ncp);
 			mutex_exit(&hp->hash_lock);
+			dnlc_sync();
 			VN_RELE_DNLC(ncp->dp);
 			VN_RELE_DNLC(vp)
 			dnlc_free(ncp);
@@ -982,6 +1403,7 @@ dnlc_get(uchar_t namlen)
 		return (NULL);
 	}
 	ncp->namlen = namlen;
+	ncp->zone = NULL;
 	atomic_inc_32(&dnlc_nentries);
 	dnlc_reduce_cache(NULL);
 	return (ncp);
@@ -1047,10 +1469,11 @@ do_dnlc_reduce_cache(void *reduce_percent)
 			/*
 			 * A name cache entry with a reference count
 			 * of one is only referenced by the dnlc.
-			 * Also negative cache entries are purged first.
+			 * Also stale and negative cache entries are
+			 * purged first.
 			 */
-			if (!vn_has_cached_data(vp) &&
-			    ((vp->v_count == 1) || (vp == DNLC_NO_VNODE))) {
+			if (DNLC_STALE(ncp) || (!vn_has_cached_data(vp) &&
+			    ((vp->v_count == 1) || (vp == DNLC_NO_VNODE)))) {
 				ncs.ncs_pick_heur.value.ui64++;
 				goto found;
 			}
@@ -1080,6 +1503,7 @@ found:
 		 */
 		nc_rmhash(ncp);
 		mutex_exit(&hp->hash_lock);
+		dnlc_sync();
 		VN_RELE_DNLC(vp);
 		VN_RELE_DNLC(ncp->dp);
 		dnlc_free(ncp);
@@ -1089,6 +1513,128 @@ found:
 	dnlc_reduce_idle = 1;
 }
 
+/*
+ * Taskq routine to trim a zone that hit one of its limits back to 90% of
+ * them.  Only stale, negative and otherwise unreferenced entries are
+ * taken, and each hash chain is visited at most once.
+ */
+static void
+do_dnlc_reduce_zone(void *arg)
+{
+	dnlc_zone_t *dz = arg;
+	nc_hash_t *hp = dnlc_free_rotor, *start_hp = hp;
+	ncache_t *ncp, *prev;
+	ncache_t *dead;
+	vnode_t *nc_rele[DNLC_MAX_RELE];
+	vnode_t *vp;
+	uint_t max, negmax;
+	int over, negover;
+	int index;
+
+	max = DNLC_ZONE_MAX(dz);
+	max -= max / 10;
+	negmax = DNLC_ZONE_NEG_MAX(dz);
+	negmax -= negmax / 10;
+
+	do {
+		over = (dz->dz_nentries > max);
+		negover = (dz->dz_nneg > negmax);
+		if (!over && !negover)
+			break;
+
+		if (++hp == &nc_hash[nc_hashsz])
+			hp = nc_hash;
+		if (hp->hash_next == (ncache_t *)hp)
+			continue;
+
+		index = 0;
+		dead = NULL;
+		mutex_enter(&hp->hash_lock);
+		for (ncp = hp->hash_prev; ncp != (ncache_t *)hp; ncp = prev) {
+			prev = ncp->hash_prev;
+			if (ncp->zone != dz)
+				continue;
+			vp = ncp->vp;
+			if (!DNLC_STALE(ncp) && vp != DNLC_NO_VNODE &&
+			    (!over || vn_has_cached_data(vp) ||
+			    vp->v_count != 1))
+				continue;
+			nc_rele[index++] = vp;
+			nc_rele[index++] = ncp->dp;
+			nc_rmhash_defer(ncp, dead);
+			ncs.ncs_purge_total.value.ui64++;
+			if (index == DNLC_MAX_RELE)
+				break;
+		}
+		mutex_exit(&hp->hash_lock);
+
+		if (dead != NULL) {
+			dnlc_sync();
+			dnlc_free_list(dead);
+		}
+		while (index) {
+			VN_RELE_DNLC(nc_rele[--index]);
+		}
+	} while (hp != start_hp);
+
+	dz->dz_reducing = 0;
+}
+
+/*
+ * Called when a zone is destroyed: purge whatever it still has cached and
+ * free its accounting.  Entries can still be in flight from threads that
+ * were charged just before they left, so wait for them to drain as well.
+ */
+void
+dnlc_zone_fini(zone_t *zone)
+{
+	dnlc_zone_t *dz = zone->zone_dnlc;
+	nc_hash_t *nch;
+	ncache_t *ncp, *np;
+	ncache_t *dead;
+	vnode_t *nc_rele[DNLC_MAX_RELE];
+	int index;
+
+	if (dz == NULL)
+		return;
+
+	while (dz->dz_nentries != 0 || dz->dz_reducing) {
+		for (nch = nc_hash; nch < &nc_hash[nc_hashsz]; nch++) {
+			index = 0;
+			dead = NULL;
+			mutex_enter(&nch->hash_lock);
+			for (ncp = nch->hash_next; ncp != (ncache_t *)nch;
+			    ncp = np) {
+				np = ncp->hash_next;
+				if (ncp->zone != dz)
+					continue;
+				nc_rele[index++] = ncp->vp;
+				nc_rele[index++] = ncp->dp;
+				nc_rmhash_defer(ncp, dead);
+				ncs.ncs_purge_total.value.ui64++;
+				if (index == DNLC_MAX_RELE)
+					break;
+			}
+			mutex_exit(&nch->hash_lock);
+
+			if (dead != NULL) {
+				dnlc_sync();
+				dnlc_free_list(dead);
+			}
+			while (index) {
+				VN_RELE_DNLC(nc_rele[--index]);
+			}
+			if (ncp != (ncache_t *)nch)
+				nch--; /* Do current hash chain again */
+		}
+		if (dz->dz_nentries != 0 || dz->dz_reducing)
+			delay(1);
+	}
+
+	zone->zone_dnlc = NULL;
+	kmem_free(dz, sizeof (*dz));
+}
+
 /*
  * Directory caching routines
  * ==========================
@@ -22,6 +22,7 @@
 /*
  * Copyright (c) 2006, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright (c) 2016 by Delphix. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -341,7 +342,7 @@ static int door_create_common(void (*)(), void *, uint_t, int, int *,
 static int door_overflow(kthread_t *, caddr_t, size_t, door_desc_t *, uint_t);
 static int door_args(kthread_t *, int);
 static int door_results(kthread_t *, caddr_t, size_t, door_desc_t *, uint_t);
-static int door_copy(struct as *, caddr_t, caddr_t, uint_t);
+static int door_copy(struct as *, caddr_t, caddr_t, size_t);
 static void	door_server_exit(proc_t *, kthread_t *);
 static void	door_release_server(door_node_t *, kthread_t *);
 static kthread_t	*door_get_server(door_node_t *);
@@ -2307,7 +2308,6 @@ door_overflow(
 	door_client_t *ct = DOOR_CLIENT(caller->t_door);
 	caddr_t	addr;			/* Resulting address in target */
 	size_t	rlen;			/* Rounded len */
-	size_t	len;
 	uint_t	i;
 	size_t	ds = desc_num * sizeof (door_desc_t);
 
@@ -2341,23 +2341,12 @@ door_overflow(
 		goto out;
 
 	if (data_size != 0) {
-		caddr_t	src = data_ptr;
-		caddr_t saddr = addr;
+		int	error;
 
 		/* Copy any data */
-		len = data_size;
-		while (len != 0) {
-			int	amount;
-			int	error;
-
-			amount = len > PAGESIZE ? PAGESIZE : len;
-			if ((error = door_copy(as, src, saddr, amount)) != 0) {
-				(void) as_unmap(as, addr, rlen);
-				return (error);
-			}
-			saddr += amount;
-			src += amount;
-			len -= amount;
+		if ((error = door_copy(as, data_ptr, addr, data_size)) != 0) {
+			(void) as_unmap(as, addr, rlen);
+			return (error);
 		}
 	}
 	/* Copy any fd's */
@@ -2469,58 +2458,17 @@ door_args(kthread_t *server, int is_private)
 				return (EFAULT);
 			}
 		} else {
-			struct as	*as;
-			caddr_t		src;
-			caddr_t		dest;
-			size_t		len = ct->d_args.data_size;
-			uintptr_t	base;
-
-			/*
-			 * Use a 1 copy method
-			 */
-			as = ttoproc(server)->p_as;
-			src = ct->d_args.data_ptr;
-
-			dest = st->d_layout.dl_datap;
-			base = (uintptr_t)dest;
-
 			/*
-			 * Copy data directly into server.  We proceed
-			 * downward from the top of the stack, to mimic
-			 * normal stack usage. This allows the guard page
-			 * to stop us before we corrupt anything.
+			 * Use a 1 copy method, directly into the server's
+			 * stack.  door_copy() locks the whole destination
+			 * first, so the guard page stops us before we
+			 * corrupt anything.
 			 */
-			while (len != 0) {
-				uintptr_t start;
-				uintptr_t end;
-				uintptr_t offset;
-				size_t	amount;
-
-				/*
-				 * Locate the next part to copy.
-				 */
-				end = base + len;
-				start = P2ALIGN(end - 1, PAGESIZE);
-
-				/*
-				 * if we are on the final (first) page, fix
-				 * up the start position.
-				 */
-				if (P2ALIGN(base, PAGESIZE) == start)
-					start = base;
-
-				offset = start - base;	/* the copy offset */
-				amount = end - start;	/* # bytes to copy */
-
-				ASSERT(amount > 0 && amount <= len &&
-				    amount <= PAGESIZE);
-
-				error = door_copy(as, src + offset,
-				    dest + offset, amount);
-				if (error != 0)
-					return (error);
-				len -= amount;
-			}
+			error = door_copy(ttoproc(server)->p_as,
+			    ct->d_args.data_ptr, st->d_layout.dl_datap,
+			    ct->d_args.data_size);
+			if (error != 0)
+				return (error);
 		}
 	}
 	/*
@@ -2798,31 +2746,13 @@ door_results(kthread_t *caller, caddr_t data_ptr, size_t data_size,
 			if (copyin_nowatch(data_ptr, ct->d_buf, data_size) != 0)
 				return (EFAULT);
 		} else {
-			struct as *as = ttoproc(caller)->p_as;
-			caddr_t	dest = ct->d_args.rbuf;
-			caddr_t	src = data_ptr;
-			size_t	len = data_size;
+			int	error;
 
 			/* Copy data directly into client */
-			while (len != 0) {
-				uint_t	amount;
-				uint_t	max;
-				uint_t	off;
-				int	error;
-
-				off = (uintptr_t)dest & PAGEOFFSET;
-				if (off)
-					max = PAGESIZE - off;
-				else
-					max = PAGESIZE;
-				amount = len > max ? max : len;
-				error = door_copy(as, src, dest, amount);
-				if (error != 0)
-					return (error);
-				dest += amount;
-				src += amount;
-				len -= amount;
-			}
+			error = door_copy(ttoproc(caller)->p_as, data_ptr,
+			    ct->d_args.rbuf, data_size);
+			if (error != 0)
+				return (error);
 		}
 	}
 
@@ -2986,86 +2916,103 @@ door_fp_close(struct file **fp, uint_t n)
  * Copy data from 'src' in current address space to 'dest' in 'as' for 'len'
  * bytes.
  *
- * Performs this using 1 mapin and 1 copy operation.
- *
- * We really should do more than 1 page at a time to improve
- * performance, but for now this is treated as an anomalous condition.
+ * The whole destination range is locked down with a single as_pagelock(),
+ * then each page is mapped into the kernel in turn and copied into with a
+ * single copyin.  If any part of the range is unmapped, including a stack
+ * guard page, nothing is copied.
  */
 static int
-door_copy(struct as *as, caddr_t src, caddr_t dest, uint_t len)
+door_copy(struct as *as, caddr_t src, caddr_t dest, size_t len)
 {
 	caddr_t	kaddr;
 	caddr_t	rdest;
-	uint_t	off;
+	caddr_t	pgaddr;
+	size_t	rlen;
+	size_t	off;
+	size_t	amount;
 	page_t	**pplist;
-	page_t	*pp = NULL;
+	page_t	*pp;
+	pgcnt_t	i;
 	int	error = 0;
 
-	ASSERT(len <= PAGESIZE);
-	off = (uintptr_t)dest & PAGEOFFSET;	/* offset within the page */
-	rdest = (caddr_t)((uintptr_t)dest &
-	    (uintptr_t)PAGEMASK);	/* Page boundary */
-	ASSERT(off + len <= PAGESIZE);
+	ASSERT(len != 0);
+	rdest = (caddr_t)P2ALIGN((uintptr_t)dest, PAGESIZE);
+	rlen = P2ROUNDUP((uintptr_t)dest + len, PAGESIZE) - (uintptr_t)rdest;
 
 	/*
-	 * Lock down destination page.
+	 * Lock down destination pages.
 	 */
-	if (as_pagelock(as, &pplist, rdest, PAGESIZE, S_WRITE))
+	if (as_pagelock(as, &pplist, rdest, rlen, S_WRITE))
 		return (E2BIG);
-	/*
-	 * Check if we have a shadow page list from as_pagelock. If not,
-	 * we took the slow path and have to find our page struct the hard
-	 * way.
-	 */
-	if (pplist == NULL) {
-		pfn_t	pfnum;
-
-		/* MMU mapping is already locked down */
-		AS_LOCK_ENTER(as, RW_READER);
-		pfnum = hat_getpfnum(as->a_hat, rdest);
-		AS_LOCK_EXIT(as);
 
+	off = (uintptr_t)dest & PAGEOFFSET;	/* offset within first page */
+	for (i = 0, pgaddr = rdest; len != 0; i++, pgaddr += PAGESIZE) {
 		/*
-		 * TODO: The pfn step should not be necessary - need
-		 * a hat_getpp() function.
+		 * Check if we have a shadow page list from as_pagelock. If
+		 * not, we took the slow path and have to find our page struct
+		 * the hard way.
 		 */
-		if (pf_is_memory(pfnum)) {
-			pp = page_numtopp_nolock(pfnum);
-			ASSERT(pp == NULL || PAGE_LOCKED(pp));
-		} else
-			pp = NULL;
-		if (pp == NULL) {
-			as_pageunlock(as, pplist, rdest, PAGESIZE, S_WRITE);
-			return (E2BIG);
+		if (pplist == NULL) {
+			pfn_t	pfnum;
+
+			/* MMU mapping is already locked down */
+			AS_LOCK_ENTER(as, RW_READER);
+			pfnum = hat_getpfnum(as->a_hat, pgaddr);
+			AS_LOCK_EXIT(as);
+
+			/*
+			 * TODO: The pfn step should not be necessary - need
+			 * a hat_getpp() function.
+			 */
+			if (pf_is_memory(pfnum)) {
+				pp = page_numtopp_nolock(pfnum);
+				ASSERT(pp == NULL || PAGE_LOCKED(pp));
+			} else
+				pp = NULL;
+			if (pp == NULL) {
+				error = E2BIG;
+				break;
+			}
+		} else {
+			pp = pplist[i];
 		}
-	} else {
-		pp = *pplist;
+
+		/*
+		 * Map destination page into kernel address
+		 */
+		if (kpm_enable)
+			kaddr = (caddr_t)hat_kpm_mapin(pp, (struct kpme *)NULL);
+		else
+			kaddr = (caddr_t)ppmapin(pp, PROT_READ | PROT_WRITE,
+			    (caddr_t)-1);
+
+		/*
+		 * Copy from src to dest
+		 */
+		amount = MIN(len, PAGESIZE - off);
+		if (copyin_nowatch(src, kaddr + off, amount) != 0)
+			error = EFAULT;
+
+		/*
+		 * Unmap destination page from kernel
+		 */
+		if (kpm_enable)
+			hat_kpm_mapout(pp, (struct kpme *)NULL, kaddr);
+		else
+			ppmapout(kaddr);
+
+		if (error != 0)
+			break;
+
+		src += amount;
+		len -= amount;
+		off = 0;
 	}
-	/*
-	 * Map destination page into kernel address
-	 */
-	if (kpm_enable)
-		kaddr = (caddr_t)hat_kpm_mapin(pp, (struct kpme *)NULL);
-	else
-		kaddr = (caddr_t)ppmapin(pp, PROT_READ | PROT_WRITE,
-		    (caddr_t)-1);
 
 	/*
-	 * Copy from src to dest
-	 */
-	if (copyin_nowatch(src, kaddr + off, len) != 0)
-		error = EFAULT;
-	/*
-	 * Unmap destination page from kernel
-	 */
-	if (kpm_enable)
-		hat_kpm_mapout(pp, (struct kpme *)NULL, kaddr);
-	else
-		ppmapout(kaddr);
-	/*
-	 * Unlock destination page
+	 * Unlock destination pages
 	 */
-	as_pageunlock(as, pplist, rdest, PAGESIZE, S_WRITE);
+	as_pageunlock(as, pplist, rdest, rlen, S_WRITE);
 	return (error);
 }
 
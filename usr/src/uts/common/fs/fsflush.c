@@ -25,6 +25,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/types.h>
@@ -51,6 +52,7 @@
 #include <sys/time.h>
 #include <sys/fs/ufs_inode.h>
 #include <sys/fs/ufs_bio.h>
+#include <sys/mman.h>
 
 #include <vm/hat.h>
 #include <vm/page.h>
@@ -96,6 +98,37 @@ typedef struct {
 fsf_stat_t fsf_recent;	/* counts for most recent duty cycle */
 fsf_stat_t fsf_total;	/* total of counts */
 ulong_t fsf_cycles;	/* number of runs refelected in fsf_total */
+ulong_t fsf_skipped;	/* number of runs which had no pages to scan */
+
+/*
+ * When no page could be found modified only by scanning memory (see
+ * page_scan_count()), skip the scan entirely.  This is normally the case when
+ * all file systems in use are ZFS, whose modified pages are found through
+ * the list of mapped vnodes below instead.  Set to 0 to always scan.
+ */
+int fsflush_scan_skip = 1;
+
+/*
+ * Vnodes marked VNOPGSCAN which have had shared writable mappings.  Each is
+ * held while it is on the list.  Every v_autoup seconds fsflush writes back
+ * its modified pages, as the memory scan would have done. Once its last
+ * writable mapping is gone, fsflush writes back the pages a final time and
+ * drops the vnode.
+ */
+typedef struct fsf_vnode {
+	vnode_t			*fv_vp;
+	clock_t			fv_flushed;	/* lbolt of last write back */
+	boolean_t		fv_added;	/* mapped since last check */
+	struct fsf_vnode	*fv_next;
+} fsf_vnode_t;
+
+#define	FSF_VNODE_HASHSZ	256
+#define	FSF_VNODE_HASH(vp)	\
+	((((uintptr_t)(vp)) >> 8) & (FSF_VNODE_HASHSZ - 1))
+
+static kmutex_t		fsf_vnode_lock;
+static fsf_vnode_t	*fsf_vnode_hash[FSF_VNODE_HASHSZ];
+static uint_t		fsf_vnode_cnt;
 
 /*
  * data used to determine when we can coalesce consecutive free pages
@@ -107,6 +140,119 @@ static pgcnt_t		fsf_pgcnt[MAX_PAGESIZES];
 static pgcnt_t		fsf_mask[MAX_PAGESIZES];
 
 
+/*
+ * Called by a file system when a shared writable mapping is added to one of
+ * its VNOPGSCAN vnodes.  The caller's v_mmap_write count is not raised until
+ * after this returns, so fv_added tells fsflush_do_vnodes() not to trust a
+ * zero count it reads later.
+ */
+void
+fsflush_vnode_add(vnode_t *vp)
+{
+	fsf_vnode_t *fv, *nfv;
+	fsf_vnode_t **bucket;
+
+	ASSERT(vp->v_flag & VNOPGSCAN);
+
+	bucket = &fsf_vnode_hash[FSF_VNODE_HASH(vp)];
+	nfv = kmem_alloc(sizeof (fsf_vnode_t), KM_SLEEP);
+
+	mutex_enter(&fsf_vnode_lock);
+	for (fv = *bucket; fv != NULL; fv = fv->fv_next) {
+		if (fv->fv_vp == vp) {
+			fv->fv_added = B_TRUE;
+			mutex_exit(&fsf_vnode_lock);
+			kmem_free(nfv, sizeof (fsf_vnode_t));
+			return;
+		}
+	}
+	VN_HOLD(vp);
+	nfv->fv_vp = vp;
+	nfv->fv_flushed = ddi_get_lbolt();
+	nfv->fv_added = B_TRUE;
+	nfv->fv_next = *bucket;
+	*bucket = nfv;
+	fsf_vnode_cnt++;
+	mutex_exit(&fsf_vnode_lock);
+}
+
+/*
+ * Write back the modified pages of the mapped vnodes which were last written
+ * back at least `autoup' ticks ago, or which may no longer be mapped for
+ * writing.  Those which are no longer mapped are released.
+ *
+ * The vnodes are taken off the list while they are written back, since
+ * VOP_PUTPAGE() may block on locks held by a thread in fsflush_vnode_add().
+ * A vnode mapped again meanwhile is simply added back by that thread.
+ */
+static void
+fsflush_do_vnodes(clock_t autoup)
+{
+	fsf_vnode_t *fv, **fvp, *dfv;
+	fsf_vnode_t *due = NULL;
+	clock_t now = ddi_get_lbolt();
+	int i;
+
+	if (fsf_vnode_cnt == 0)
+		return;
+
+	mutex_enter(&fsf_vnode_lock);
+	for (i = 0; i < FSF_VNODE_HASHSZ; i++) {
+		fvp = &fsf_vnode_hash[i];
+		while ((fv = *fvp) != NULL) {
+			if (fv->fv_vp->v_mmap_write != 0 &&
+			    now - fv->fv_flushed < autoup) {
+				fvp = &fv->fv_next;
+				continue;
+			}
+			*fvp = fv->fv_next;
+			fv->fv_next = due;
+			due = fv;
+			fsf_vnode_cnt--;
+		}
+	}
+	mutex_exit(&fsf_vnode_lock);
+
+	while ((fv = due) != NULL) {
+		vnode_t *vp = fv->fv_vp;
+		fsf_vnode_t **bucket = &fsf_vnode_hash[FSF_VNODE_HASH(vp)];
+		boolean_t unmapped;
+
+		due = fv->fv_next;
+
+		/*
+		 * Check for mappings before writing back, so that no page can
+		 * be modified after the final write back.  fv_added can no
+		 * longer change now that the vnode is off the list.
+		 */
+		unmapped = !fv->fv_added &&
+		    atomic_add_64_nv(&vp->v_mmap_write, 0) == 0;
+		fv->fv_added = B_FALSE;
+
+		(void) VOP_PUTPAGE(vp, (offset_t)0, (size_t)0, B_ASYNC,
+		    kcred, NULL);
+
+		if (!unmapped) {
+			mutex_enter(&fsf_vnode_lock);
+			for (dfv = *bucket; dfv != NULL; dfv = dfv->fv_next) {
+				if (dfv->fv_vp == vp)
+					break;
+			}
+			if (dfv == NULL) {
+				fv->fv_flushed = now;
+				fv->fv_next = *bucket;
+				*bucket = fv;
+				fsf_vnode_cnt++;
+				mutex_exit(&fsf_vnode_lock);
+				continue;
+			}
+			mutex_exit(&fsf_vnode_lock);
+		}
+		VN_RELE(vp);
+		kmem_free(fv, sizeof (fsf_vnode_t));
+	}
+}
+
 /*
  * Scan page_t's and issue I/O's for modified pages.
  *
@@ -147,6 +293,11 @@ fsflush_do_pages()
 		nscan = (last_total_pages * (tune.t_fsflushr))/v.v_autoup;
 	}
 
+	if (fsflush_scan_skip && page_scan_count() == 0) {
+		fsf_skipped++;
+		return;
+	}
+
 	if (pp == NULL)
 		pp = memsegs->pages;
 
@@ -450,8 +601,10 @@ loop:
 	 */
 	bfreelist.b_bcount = bcount;
 
-	if (dopageflush)
+	if (dopageflush) {
 		fsflush_do_pages();
+		fsflush_do_vnodes(autoup);
+	}
 
 	if (!doiflush)
 		goto loop;
@@ -232,6 +232,14 @@ gfs_readdir_init(gfs_readdir_state_t *st, int name_max, int ureclen,
 	    (uiop->uio_loffset % ureclen) != 0)
 		return (EINVAL);
 
+	/*
+	 * A request for dirent types is also a request for edirent_t
+	 * records.  GFS directories have no type to offer, so their entries
+	 * are simply returned with none.
+	 */
+	if (flags & V_RDDIR_DTYPE)
+		flags |= V_RDDIR_ENTFLAGS;
+
 	st->grd_ureclen = ureclen;
 	st->grd_oresid = uiop->uio_resid;
 	st->grd_namlen = name_max;
@@ -1032,7 +1040,7 @@ gfs_dir_readdir(vnode_t *dvp, uio_t *uiop, int *eofp, void *data, cred_t *cr,
 
 			if ((error = dp->gfsd_readdir(dvp,
 			    gstate.grd_dirent, &eof, &off, &next,
-			    data, flags)) != 0 || eof)
+			    data, gstate.grd_flags)) != 0 || eof)
 				break;
 
 			off += dp->gfsd_nstatic + 2;
@@ -256,10 +256,13 @@ nfs4_purge_caches(vnode_t *vp, int purge_dnlc, cred_t *cr, int asyncpg)
 	int pgflush;			/* are we the page flush thread? */
 
 	/*
-	 * Purge the DNLC for any entries which refer to this file.
+	 * Purge the DNLC for any entries which refer to this file.  If only
+	 * the names in a directory are suspect, invalidating them is much
+	 * cheaper than a purge.
 	 */
-	if (vp->v_count > 1 &&
-	    (vp->v_type == VDIR || purge_dnlc == NFS4_PURGE_DNLC))
+	if (vp->v_type == VDIR && purge_dnlc != NFS4_PURGE_DNLC)
+		dnlc_invalidate(vp);
+	else if (vp->v_count > 1 && purge_dnlc == NFS4_PURGE_DNLC)
 		dnlc_purge_vp(vp);
 
 	/*
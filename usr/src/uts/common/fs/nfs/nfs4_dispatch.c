@@ -26,9 +26,11 @@
 
 /*
  * Copyright 2018 Nexenta Systems, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/systm.h>
+#include <sys/sysmacros.h>
 #include <sys/sdt.h>
 #include <rpc/types.h>
 #include <rpc/auth.h>
@@ -53,6 +55,12 @@ uint32_t nfs4_drc_max = 8 * 1024;
  */
 uint32_t nfs4_drc_hash = 541;
 
+/*
+ * The number of independently locked shards the cache, and its
+ * buckets, are split into.  Only read when the cache is created.
+ */
+uint32_t nfs4_drc_shards = 16;
+
 static void rfs4_resource_err(struct svc_req *req, COMPOUND4args *argsp);
 
 /*
@@ -62,29 +70,45 @@ rfs4_drc_t *
 rfs4_init_drc(uint32_t drc_size, uint32_t drc_hash_size)
 {
 	rfs4_drc_t *drc;
-	uint32_t   bki;
+	rfs4_drc_shard_t *ds;
+	uint32_t   bki, si, nshards;
 
 	ASSERT(drc_size);
 	ASSERT(drc_hash_size);
 
+	/*
+	 * Each shard gets an equal part of the cache and of the buckets,
+	 * so the chains are as long as they would be unsharded.
+	 */
+	nshards = MAX(1, MIN(nfs4_drc_shards, drc_size));
+
 	drc = kmem_alloc(sizeof (rfs4_drc_t), KM_SLEEP);
 
-	drc->max_size = drc_size;
-	drc->in_use = 0;
+	drc->dr_hash = MAX(1, drc_hash_size / nshards);
+	drc->dr_nshards = nshards;
+	drc->dr_shards = kmem_zalloc(sizeof (rfs4_drc_shard_t) * nshards,
+	    KM_SLEEP);
+
+	for (si = 0; si < nshards; si++) {
+		ds = &drc->dr_shards[si];
 
-	mutex_init(&drc->lock, NULL, MUTEX_DEFAULT, NULL);
+		ds->max_size = drc_size / nshards;
+		ds->in_use = 0;
 
-	drc->dr_hash = drc_hash_size;
+		mutex_init(&ds->lock, NULL, MUTEX_DEFAULT, NULL);
 
-	drc->dr_buckets = kmem_alloc(sizeof (list_t)*drc_hash_size, KM_SLEEP);
+		ds->dr_buckets = kmem_alloc(sizeof (list_t)*drc->dr_hash,
+		    KM_SLEEP);
 
-	for (bki = 0; bki < drc_hash_size; bki++) {
-		list_create(&drc->dr_buckets[bki], sizeof (rfs4_dupreq_t),
-		    offsetof(rfs4_dupreq_t, dr_bkt_next));
-	}
+		for (bki = 0; bki < drc->dr_hash; bki++) {
+			list_create(&ds->dr_buckets[bki],
+			    sizeof (rfs4_dupreq_t),
+			    offsetof(rfs4_dupreq_t, dr_bkt_next));
+		}
 
-	list_create(&(drc->dr_cache), sizeof (rfs4_dupreq_t),
-	    offsetof(rfs4_dupreq_t, dr_next));
+		list_create(&(ds->dr_cache), sizeof (rfs4_dupreq_t),
+		    offsetof(rfs4_dupreq_t, dr_next));
+	}
 
 	return (drc);
 }
@@ -97,25 +121,34 @@ rfs4_fini_drc(void)
 {
 	nfs4_srv_t *nsrv4 = nfs4_get_srv();
 	rfs4_drc_t *drc = nsrv4->nfs4_drc;
+	rfs4_drc_shard_t *ds;
 	rfs4_dupreq_t *drp, *drp_next;
+	uint32_t si;
 
-	/* iterate over the dr_cache and free the enties */
-	for (drp = list_head(&(drc->dr_cache)); drp != NULL; drp = drp_next) {
+	for (si = 0; si < drc->dr_nshards; si++) {
+		ds = &drc->dr_shards[si];
 
-		if (drp->dr_state == NFS4_DUP_REPLAY)
-			rfs4_compound_free(&(drp->dr_res));
+		/* iterate over the dr_cache and free the enties */
+		for (drp = list_head(&(ds->dr_cache)); drp != NULL;
+		    drp = drp_next) {
 
-		if (drp->dr_addr.buf != NULL)
-			kmem_free(drp->dr_addr.buf, drp->dr_addr.maxlen);
+			if (drp->dr_state == NFS4_DUP_REPLAY)
+				rfs4_compound_free(&(drp->dr_res));
 
-		drp_next = list_next(&(drc->dr_cache), drp);
+			if (drp->dr_addr.buf != NULL)
+				kmem_free(drp->dr_addr.buf,
+				    drp->dr_addr.maxlen);
 
-		kmem_free(drp, sizeof (rfs4_dupreq_t));
-	}
+			drp_next = list_next(&(ds->dr_cache), drp);
 
-	mutex_destroy(&drc->lock);
-	kmem_free(drc->dr_buckets,
-	    sizeof (list_t)*drc->dr_hash);
+			kmem_free(drp, sizeof (rfs4_dupreq_t));
+		}
+
+		mutex_destroy(&ds->lock);
+		kmem_free(ds->dr_buckets,
+		    sizeof (list_t)*drc->dr_hash);
+	}
+	kmem_free(drc->dr_shards, sizeof (rfs4_drc_shard_t) * drc->dr_nshards);
 	kmem_free(drc, sizeof (rfs4_drc_t));
 }
 
@@ -130,7 +163,7 @@ rfs4_fini_drc(void)
 void
 rfs4_dr_chstate(rfs4_dupreq_t *drp, int new_state)
 {
-	rfs4_drc_t *drc;
+	rfs4_drc_shard_t *drc;
 
 	ASSERT(drp);
 	ASSERT(drp->drc);
@@ -162,7 +195,7 @@ rfs4_dr_chstate(rfs4_dupreq_t *drp, int new_state)
  * NFS4_DUP_REPLAY state.
  */
 rfs4_dupreq_t *
-rfs4_alloc_dr(rfs4_drc_t *drc)
+rfs4_alloc_dr(rfs4_drc_shard_t *drc)
 {
 	rfs4_dupreq_t *drp_tail, *drp = NULL;
 
@@ -208,7 +241,7 @@ rfs4_alloc_dr(rfs4_drc_t *drc)
 			/* NOTREACHED */
 		}
 	}
-	DTRACE_PROBE1(nfss__i__drc_full, rfs4_drc_t *, drc);
+	DTRACE_PROBE1(nfss__i__drc_full, rfs4_drc_shard_t *, drc);
 	return (NULL);
 }
 
@@ -216,29 +249,31 @@ rfs4_alloc_dr(rfs4_drc_t *drc)
  * rfs4_find_dr:
  *
  * Search for an entry in the duplicate request cache by
- * calculating the hash index based on the XID, and examining
- * the entries in the hash bucket. If we find a match, return.
- * Once we have searched the bucket we call rfs4_alloc_dr() to
- * allocate a new entry, or reuse one that is available.
+ * calculating the shard and hash index based on the XID, and
+ * examining the entries in the hash bucket. If we find a match,
+ * return. Once we have searched the bucket we call rfs4_alloc_dr()
+ * to allocate a new entry in the shard, or reuse one that is available.
  */
 int
-rfs4_find_dr(struct svc_req *req, rfs4_drc_t *drc, rfs4_dupreq_t **dup)
+rfs4_find_dr(struct svc_req *req, rfs4_drc_t *drcp, rfs4_dupreq_t **dup)
 {
 
 	uint32_t	the_xid;
 	list_t		*dr_bkt;
 	rfs4_dupreq_t	*drp;
+	rfs4_drc_shard_t *drc;
 	int		bktdex;
 
 	/*
-	 * Get the XID, calculate the bucket and search to
-	 * see if we need to replay from the cache.
+	 * Get the XID, calculate the shard and bucket and search to
+	 * see if we need to replay from the cache.  Consecutive XIDs
+	 * go to different shards, and then to consecutive buckets.
 	 */
 	the_xid = req->rq_xprt->xp_xid;
-	bktdex = the_xid % drc->dr_hash;
+	drc = &drcp->dr_shards[the_xid % drcp->dr_nshards];
+	bktdex = (the_xid / drcp->dr_nshards) % drcp->dr_hash;
 
-	dr_bkt = (list_t *)
-	    &(drc->dr_buckets[(the_xid % drc->dr_hash)]);
+	dr_bkt = (list_t *)&(drc->dr_buckets[bktdex]);
 
 	DTRACE_PROBE3(nfss__i__drc_bktdex,
 	    int, bktdex,
@@ -201,11 +201,14 @@ nfs_purge_caches(vnode_t *vp, int purge_dnlc, cred_t *cr)
 	/*
 	 * Purge the DNLC for any entries which refer to this file.
 	 * Avoid recursive entry into dnlc_purge_vp() in case of a directory.
+	 * If only the names in a directory are suspect, invalidating them
+	 * is much cheaper than a purge.
 	 */
 	rp = VTOR(vp);
+	if (vp->v_type == VDIR && purge_dnlc != NFS_PURGE_DNLC)
+		dnlc_invalidate(vp);
 	mutex_enter(&rp->r_statelock);
-	if (vp->v_count > 1 &&
-	    (vp->v_type == VDIR || purge_dnlc == NFS_PURGE_DNLC) &&
+	if (vp->v_count > 1 && purge_dnlc == NFS_PURGE_DNLC &&
 	    !(rp->r_flags & RINDNLCPURGE)) {
 		/*
 		 * Set the RINDNLCPURGE flag to prevent recursive entry
@@ -449,6 +449,7 @@ struct port_ksource port_ksource_tab[] = {
 static int port_getn(port_t *, port_event_t *, uint_t, uint_t *,
     port_gettimer_t *);
 static int port_sendn(int [], int [], uint_t, int, void *, uint_t *);
+static int port_associaten(port_t *, void *, int [], uint_t, uint_t *);
 static int port_alert(port_t *, int, int, void *);
 static int port_dispatch_event(port_t *, int, int, int, uintptr_t, void *);
 static int port_send(port_t *, int, int, void *);
@@ -658,6 +659,18 @@ portfs(int opcode, uintptr_t a0, uintptr_t a1, uintptr_t a2, uintptr_t a3,
 		}
 		break;
 	}
+	case	PORT_ASSOCIATEN:
+	{
+		/*
+		 * As with PORT_SENDN, EIO only says that errors[] holds the
+		 * per-entry errors; the caller gets the association count.
+		 */
+		error = port_associaten(pp, (void *)a1, (int *)a2, (uint_t)a3,
+		    (uint_t *)&r.r_val1);
+		if (error == EIO)
+			error = 0;
+		break;
+	}
 	case	PORT_SEND:
 	{
 		/* user-defined events */
@@ -1051,6 +1064,89 @@ port_sendn(int ports[], int errors[], uint_t nent, int events, void *user,
 	return (error);
 }
 
+/*
+ * port_associaten() associates a list of PORT_SOURCE_FD and PORT_SOURCE_FILE
+ * objects with a port in a single system call, which saves an event loop
+ * one port_associate() per re-armed object.  Errors are reported per entry
+ * the same way port_sendn() reports them.
+ */
+static int
+port_associaten(port_t *pp, void *ulist, int errors[], uint_t nent,
+    uint_t *nassoc)
+{
+	port_assoc_t	*alist, *pa;
+	int		*elist = NULL;
+	int		errorcnt = 0;
+	int		error = 0;
+	int		count;
+	size_t		size;
+
+	if (nent == 0 || nent > port_max_list)
+		return (EINVAL);
+
+	size = nent * sizeof (port_assoc_t);
+	alist = kmem_alloc(size, KM_SLEEP);
+	if (get_udatamodel() == DATAMODEL_NATIVE) {
+		if (copyin(ulist, alist, size)) {
+			kmem_free(alist, size);
+			return (EFAULT);
+		}
+	}
+#ifdef	_SYSCALL32_IMPL
+	else {
+		port_assoc32_t	*alist32;
+		size_t		size32 = nent * sizeof (port_assoc32_t);
+
+		alist32 = kmem_alloc(size32, KM_SLEEP);
+		if (copyin(ulist, alist32, size32)) {
+			kmem_free(alist32, size32);
+			kmem_free(alist, size);
+			return (EFAULT);
+		}
+		for (count = 0; count < nent; count++) {
+			alist[count].pa_source = alist32[count].pa_source;
+			alist[count].pa_events = alist32[count].pa_events;
+			alist[count].pa_object =
+			    (uintptr_t)alist32[count].pa_object;
+			alist[count].pa_user =
+			    (void *)(uintptr_t)alist32[count].pa_user;
+		}
+		kmem_free(alist32, size32);
+	}
+#endif	/* _SYSCALL32_IMPL */
+
+	for (count = 0, pa = alist; count < nent; count++, pa++) {
+		switch (pa->pa_source) {
+		case PORT_SOURCE_FD:
+			error = port_associate_fd(pp, pa->pa_source,
+			    pa->pa_object, pa->pa_events, pa->pa_user);
+			break;
+		case PORT_SOURCE_FILE:
+			error = port_associate_fop(pp, pa->pa_source,
+			    pa->pa_object, pa->pa_events, pa->pa_user);
+			break;
+		default:
+			error = EINVAL;
+			break;
+		}
+		if (error) {
+			elist = port_errorn(elist, nent, error, count);
+			errorcnt++;
+		}
+	}
+
+	error = 0;
+	if (errorcnt) {
+		error = EIO;
+		if (copyout(elist, (void *)errors, nent * sizeof (int)))
+			error = EFAULT;
+		kmem_free(elist, nent * sizeof (int));
+	}
+	*nassoc = nent - errorcnt;
+	kmem_free(alist, size);
+	return (error);
+}
+
 static int *
 port_errorn(int *elist, int nent, int error, int index)
 {
@@ -262,6 +262,7 @@ port_associate_fd(port_t *pp, int source, uintptr_t object, int events,
 		 * is closed.
 		 */
 		addfd_port(fd, pfd);
+		mutex_enter(&pkevp->portkev_lock);
 	} else {
 		/*
 		 * The file descriptor is already associated with the port
@@ -274,11 +275,13 @@ port_associate_fd(port_t *pp, int source, uintptr_t object, int events,
 		 * submitted event of the file descriptor was retrieved.
 		 * Clear the PORT_KEV_VALID flag if set. No new events
 		 * should get submitted after this flag is cleared.
+		 *
+		 * The usual case is re-arming a one-shot association
+		 * whose event was already retrieved; that takes the
+		 * portkev_lock only once.
 		 */
 		mutex_enter(&pkevp->portkev_lock);
-		if (pkevp->portkev_flags & PORT_KEV_VALID) {
-			pkevp->portkev_flags &= ~PORT_KEV_VALID;
-		}
+		pkevp->portkev_flags &= ~PORT_KEV_VALID;
 		if (pkevp->portkev_flags & PORT_KEV_DONEQ) {
 			mutex_exit(&pkevp->portkev_lock);
 			/*
@@ -286,14 +289,13 @@ port_associate_fd(port_t *pp, int source, uintptr_t object, int events,
 			 * for this fd and are still in the port queue.
 			 */
 			(void) port_remove_done_event(pkevp);
-		} else {
-			mutex_exit(&pkevp->portkev_lock);
+			mutex_enter(&pkevp->portkev_lock);
 		}
 		pkevp->portkev_user = user;
 	}
 
 	pfd->pfd_thread = curthread;
-	mutex_enter(&pkevp->portkev_lock);
+	ASSERT(MUTEX_HELD(&pkevp->portkev_lock));
 	pkevp->portkev_events = 0;	/* no fired events */
 	pdp->pd_events = events;	/* events associated */
 	/*
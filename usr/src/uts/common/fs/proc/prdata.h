@@ -27,7 +27,7 @@
 /*	  All Rights Reserved	*/
 
 /*
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright 2020 OmniOS Community Edition (OmniOSce) Association.
  */
 
@@ -162,6 +162,7 @@ typedef enum prnodetype {
 	PR_PIDFILE,		/* old process file			*/
 	PR_LWPIDFILE,		/* old lwp file				*/
 	PR_OPAGEDATA,		/* old page data file			*/
+	PR_ALLPSINFO,		/* /proc/psinfo				*/
 	PR_NFILES		/* number of /proc node types		*/
 } prnodetype_t;
 
@@ -21,7 +21,7 @@
 
 /*
  * Copyright (c) 1989, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2017 by Delphix. All rights reserved.
  * Copyright 2020 OmniOS Community Edition (OmniOSce) Association.
  */
@@ -246,9 +246,10 @@ propen(vnode_t **vpp, int flag, cred_t *cr, caller_context_t *ct)
 	prnode_t *npnp = NULL;
 
 	/*
-	 * Nothing to do for the /proc directory itself.
+	 * Nothing to do for the /proc directory itself, nor for
+	 * /proc/psinfo, which is not associated with any one process.
 	 */
-	if (type == PR_PROCDIR)
+	if (type == PR_PROCDIR || type == PR_ALLPSINFO)
 		return (0);
 
 	/*
@@ -437,9 +438,10 @@ prclose(vnode_t *vp, int flag, int count, offset_t offset, cred_t *cr,
 	user_t *up;
 
 	/*
-	 * Nothing to do for the /proc directory itself.
+	 * Nothing to do for the /proc directory itself, nor for
+	 * /proc/psinfo.
 	 */
-	if (type == PR_PROCDIR)
+	if (type == PR_PROCDIR || type == PR_ALLPSINFO)
 		return (0);
 
 	ASSERT(type != PR_OBJECT && type != PR_FD &&
@@ -605,7 +607,7 @@ static int pr_read_inval(), pr_read_as(), pr_read_status(),
 	pr_read_gwindows(), pr_read_asrs(),
 #endif
 	pr_read_piddir(), pr_read_pidfile(), pr_read_opagedata(),
-	pr_read_fdinfo();
+	pr_read_fdinfo(), pr_read_allpsinfo();
 
 static int (*pr_read_function[PR_NFILES])() = {
 	pr_read_inval,		/* /proc				*/
@@ -664,6 +666,7 @@ static int (*pr_read_function[PR_NFILES])() = {
 	pr_read_pidfile,	/* old process file			*/
 	pr_read_pidfile,	/* old lwp file				*/
 	pr_read_opagedata,	/* old pagedata file			*/
+	pr_read_allpsinfo,	/* /proc/psinfo				*/
 };
 
 /* ARGSUSED */
@@ -1049,6 +1052,90 @@ pr_read_lpsinfo(prnode_t *pnp, uio_t *uiop, cred_t *cr)
 	return (error);
 }
 
+/*
+ * Find and lock the next process, starting at process table slot *np, which
+ * is visible through the /proc mounted in zone zoneid.  This is the same test
+ * pr_readdir_procdir() applies, so /proc/psinfo covers exactly the processes
+ * which appear in /proc.  Returns with p->p_lock held and P_PR_LOCK set, and
+ * *np set to the slot found, or NULL once the table has been exhausted.
+ */
+static proc_t *
+pr_allpsinfo_next(zoneid_t zoneid, int *np)
+{
+	proc_t *p;
+	int n = *np;
+
+	for (;;) {
+		mutex_enter(&pidlock);
+		while (n < v.v_proc &&
+		    ((p = pid_entry(n)) == NULL || p->p_stat == SIDL ||
+		    (zoneid != GLOBAL_ZONEID && p->p_zone->zone_id != zoneid) ||
+		    secpolicy_basic_procinfo(CRED(), p, curproc) != 0))
+			n++;
+		if (n >= v.v_proc) {
+			mutex_exit(&pidlock);
+			return (NULL);
+		}
+		mutex_enter(&p->p_lock);
+		mutex_exit(&pidlock);
+
+		if (!(p->p_proc_flag & P_PR_LOCK))
+			break;
+		/*
+		 * Someone else has the process locked; wait for them and
+		 * look at the slot again, since the process may be gone.
+		 */
+		sprwaitlock_proc(p);
+	}
+	p->p_proc_flag |= P_PR_LOCK;
+	*np = n;
+	return (p);
+}
+
+/*
+ * /proc/psinfo is a prheader_t followed by the psinfo_t of every process in
+ * /proc, so that ps(1) and prstat(1M) can take their snapshot of the system
+ * with one read(2) rather than opening and reading every /proc/<pid>/psinfo.
+ * Each process is locked only while its own entry is filled in; processes
+ * created while the read is in progress may be missed.
+ */
+/* ARGSUSED */
+static int
+pr_read_allpsinfo(prnode_t *pnp, uio_t *uiop, cred_t *cr)
+{
+	extern uint_t nproc;
+	zoneid_t zoneid = VTOZONE(PTOV(pnp))->zone_id;
+	proc_t *p;
+	prheader_t *php;
+	psinfo_t *sp;
+	size_t size;
+	uint_t maxent, nent;
+	int error;
+	int n;
+
+	ASSERT(pnp->pr_type == PR_ALLPSINFO);
+
+	maxent = nproc;
+	size = sizeof (prheader_t) + maxent * LSPAN(psinfo_t);
+	php = kmem_zalloc(size, KM_SLEEP);
+
+	sp = (psinfo_t *)(php + 1);
+	for (n = 0, nent = 0; nent < maxent &&
+	    (p = pr_allpsinfo_next(zoneid, &n)) != NULL; n++, nent++) {
+		prgetpsinfo(p, sp);
+		sprunlock(p);
+		sp = (psinfo_t *)((caddr_t)sp + LSPAN(psinfo_t));
+	}
+
+	php->pr_nent = nent;
+	php->pr_entsize = LSPAN(psinfo_t);
+
+	error = pr_uioread(php, sizeof (prheader_t) + nent * LSPAN(psinfo_t),
+	    uiop);
+	kmem_free(php, size);
+	return (error);
+}
+
 static int
 pr_read_map_common(prnode_t *pnp, uio_t *uiop, prnodetype_t type)
 {
@@ -1977,7 +2064,7 @@ static int pr_read_status_32(),
 #if defined(__sparc)
 	pr_read_gwindows_32(),
 #endif
-	pr_read_opagedata_32();
+	pr_read_opagedata_32(), pr_read_allpsinfo_32();
 
 static int (*pr_read_function_32[PR_NFILES])() = {
 	pr_read_inval,		/* /proc				*/
@@ -2036,6 +2123,7 @@ static int (*pr_read_function_32[PR_NFILES])() = {
 	pr_read_pidfile,	/* old process file			*/
 	pr_read_pidfile,	/* old lwp file				*/
 	pr_read_opagedata_32,	/* old pagedata file			*/
+	pr_read_allpsinfo_32,	/* /proc/psinfo				*/
 };
 
 static int
@@ -2217,6 +2305,43 @@ pr_read_lpsinfo_32(prnode_t *pnp, uio_t *uiop, cred_t *cr)
 	return (error);
 }
 
+/* ARGSUSED */
+static int
+pr_read_allpsinfo_32(prnode_t *pnp, uio_t *uiop, cred_t *cr)
+{
+	extern uint_t nproc;
+	zoneid_t zoneid = VTOZONE(PTOV(pnp))->zone_id;
+	proc_t *p;
+	prheader32_t *php;
+	psinfo32_t *sp;
+	size_t size;
+	uint_t maxent, nent;
+	int error;
+	int n;
+
+	ASSERT(pnp->pr_type == PR_ALLPSINFO);
+
+	maxent = nproc;
+	size = sizeof (prheader32_t) + maxent * LSPAN32(psinfo32_t);
+	php = kmem_zalloc(size, KM_SLEEP);
+
+	sp = (psinfo32_t *)(php + 1);
+	for (n = 0, nent = 0; nent < maxent &&
+	    (p = pr_allpsinfo_next(zoneid, &n)) != NULL; n++, nent++) {
+		prgetpsinfo32(p, sp);
+		sprunlock(p);
+		sp = (psinfo32_t *)((caddr_t)sp + LSPAN32(psinfo32_t));
+	}
+
+	php->pr_nent = nent;
+	php->pr_entsize = LSPAN32(psinfo32_t);
+
+	error = pr_uioread(php,
+	    sizeof (prheader32_t) + nent * LSPAN32(psinfo32_t), uiop);
+	kmem_free(php, size);
+	return (error);
+}
+
 static int
 pr_read_map_common_32(prnode_t *pnp, uio_t *uiop, prnodetype_t type)
 {
@@ -3284,6 +3409,24 @@ prgetattr(vnode_t *vp, vattr_t *vap, int flags, cred_t *cr,
 		return (0);
 	}
 
+	/*
+	 * /proc/psinfo has no prcommon member either.  Its size depends on
+	 * the number of processes at the time it is read; report what it
+	 * would be now so that consumers can size their buffers.
+	 */
+	if (type == PR_ALLPSINFO) {
+		vap->va_uid = 0;
+		vap->va_gid = 0;
+		vap->va_nodeid = (ino64_t)PR_ALLPSINFO;
+		gethrestime(&now);
+		vap->va_atime = vap->va_mtime = vap->va_ctime = now;
+		vap->va_nlink = 1;
+		vap->va_size = PR_OBJSIZE(prheader32_t, prheader_t) +
+		    nproc * PR_OBJSPAN(psinfo32_t, psinfo_t);
+		vap->va_nblocks = btod(vap->va_size);
+		return (0);
+	}
+
 	p = pr_p_lock(pnp);
 	mutex_exit(&pr_pidlock);
 	if (p == NULL)
@@ -3620,6 +3763,7 @@ praccess(vnode_t *vp, int mode, int flags, cred_t *cr, caller_context_t *ct)
 
 	switch (type) {
 	case PR_PROCDIR:
+	case PR_ALLPSINFO:
 		break;
 
 	case PR_OBJECT:
@@ -3772,6 +3916,7 @@ static vnode_t *(*pr_lookup_function[PR_NFILES])() = {
 	pr_lookup_notdir,	/* old process file			*/
 	pr_lookup_notdir,	/* old lwp file				*/
 	pr_lookup_notdir,	/* old pagedata file			*/
+	pr_lookup_notdir,	/* /proc/psinfo				*/
 };
 
 static int
@@ -3923,6 +4068,9 @@ pr_lookup_procdir(vnode_t *dp, char *comp)
 	if (strcmp(comp, "self") == 0) {
 		pnp = prgetnode(dp, PR_SELF);
 		return (PTOV(pnp));
+	} else if (strcmp(comp, "psinfo") == 0) {
+		pnp = prgetnode(dp, PR_ALLPSINFO);
+		return (PTOV(pnp));
 	} else {
 		pid = 0;
 		while ((c = *comp++) != '\0') {
@@ -5076,6 +5224,7 @@ prgetnode(vnode_t *dp, prnodetype_t type)
 	case PR_LWPUSAGE:
 	case PR_ARGV:
 	case PR_CMDLINE:
+	case PR_ALLPSINFO:
 		pnp->pr_mode = 0444;	/* read-only by all */
 		break;
 
@@ -5219,6 +5368,7 @@ static int (*pr_readdir_function[PR_NFILES])() = {
 	pr_readdir_notdir,	/* old process file			*/
 	pr_readdir_notdir,	/* old lwp file				*/
 	pr_readdir_notdir,	/* old pagedata file			*/
+	pr_readdir_notdir,	/* /proc/psinfo				*/
 };
 
 /* ARGSUSED */
@@ -6123,6 +6273,7 @@ prinactive(vnode_t *vp, cred_t *cr, caller_context_t *ct)
 	case PR_FDINFO:
 	case PR_SELF:
 	case PR_PATH:
+	case PR_ALLPSINFO:
 		/* These are not linked into the usual lists */
 		ASSERT(vp->v_count == 1);
 		if ((dp = pnp->pr_parent) != NULL)
@@ -6487,6 +6638,14 @@ prpoll(vnode_t *vp, short events, int anyyet, short *reventsp,
 	*reventsp = revents = 0;
 	*phpp = (pollhead_t *)NULL;
 
+	/*
+	 * /proc/psinfo is not tied to a process; it is always readable.
+	 */
+	if (pnp->pr_type == PR_ALLPSINFO) {
+		*reventsp = events & (POLLIN | POLLRDNORM);
+		return (0);
+	}
+
 	if (vp->v_type == VDIR) {
 		*reventsp |= POLLNVAL;
 		return (0);
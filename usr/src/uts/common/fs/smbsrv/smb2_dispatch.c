@@ -12,6 +12,7 @@
 /*
  * Copyright 2019 Nexenta Systems, Inc.  All rights reserved.
  * Copyright 2020 RackTop Systems, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 
@@ -1503,7 +1504,7 @@ smb2_send_reply(smb_request_t *sr)
 	buflen = SMB3_TFORM_HDR_SIZE + sr->msgsize;
 
 	/* taken from smb_request_init_command_mbuf */
-	tmpbuf = kmem_alloc(buflen, KM_SLEEP);
+	tmpbuf = smb_reqbuf_alloc(buflen);
 	MBC_ATTACH_BUF(&enc_reply, tmpbuf, buflen);
 	enc_reply.flags = 0;
 	enc_reply.shadow_of = NULL;
@@ -1518,11 +1519,11 @@ smb2_send_reply(smb_request_t *sr)
 	}
 
 	(void) smb_session_send(sr->session, 0, &enc_reply);
-	kmem_free(tmpbuf, buflen);
+	smb_reqbuf_free(tmpbuf, buflen);
 	return;
 
 errout:
-	kmem_free(tmpbuf, buflen);
+	smb_reqbuf_free(tmpbuf, buflen);
 	smb_session_disconnect(sr->session);
 }
 
@@ -11,6 +11,7 @@
 
 /*
  * Copyright 2018 Nexenta Systems, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -337,7 +338,7 @@ smb2_dh_import_share(void *arg)
 	 * Also a buffer for the stream name info.
 	 */
 	sr->sr_req_length = smb2_dh_max_cah_size;
-	sr->sr_request_buf = kmem_alloc(sr->sr_req_length, KM_SLEEP);
+	sr->sr_request_buf = smb_reqbuf_alloc(sr->sr_req_length);
 	str_info = kmem_alloc(sizeof (smb_streaminfo_t), KM_SLEEP);
 
 	/*
@@ -12,6 +12,7 @@
 /*
  * Copyright 2019 Nexenta Systems, Inc.  All rights reserved.
  * Copyright 2020 RackTop Systems, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -48,15 +49,18 @@ uint32_t smb2srv_capabilities =
  *
  * smb2_max_rwsize is what we put in the SMB2 negotiate response to tell
  * the client the largest read and write request size we'll support.
- * For now, we're using contiguous allocations, so keep this at 64KB
- * so that (even with message overhead) allocations stay below 128KB,
- * avoiding kmem_alloc -> page_create_va thrashing.
+ * Read data goes in a chain of cluster mbufs (smb_mbuf_allocate), and
+ * request buffers too big for kmem_alloc's caches come from a cache of
+ * their own (smb_reqbuf_alloc), so large I/O sizes don't cause
+ * kmem_alloc -> page_create_va thrashing.  Clients that copy big files
+ * keep far fewer requests in flight with 1MB I/O than with 64KB.
+ * The request buffer cache is sized from this when the module loads.
  *
  * smb2_max_trans is the largest "transact" send or receive, which is
  * used for directory listings and info set/get operations.
  */
 uint32_t smb2_tcp_bufsize = (1<<22);	/* 4MB */
-uint32_t smb2_max_rwsize = (1<<16);	/* 64KB */
+uint32_t smb2_max_rwsize = (1<<20);	/* 1MB */
 uint32_t smb2_max_trans  = (1<<16);	/* 64KB */
 
 /*
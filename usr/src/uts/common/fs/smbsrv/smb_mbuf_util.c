@@ -21,6 +21,7 @@
 /*
  * Copyright 2015 Nexenta Systems, Inc.  All rights reserved.
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  * Use is subject to license terms.
  */
 
@@ -178,35 +179,59 @@ smb_mbuf_kmem_ref(void *p, uint_t sz, int incr)
  * Allocate enough mbufs to accommodate the residual count in uio,
  * and setup the uio_iov to point to them.
  *
- * This is used by the various SMB read code paths.  That code is
- * going to do a disk read into this buffer, so we'd like it to be
- * large and contiguous.  Use an external (M_EXT) buffer.
+ * This is used by the various SMB read code paths, which do a disk
+ * read into this buffer.  Build a chain of cluster mbufs with one
+ * uio_iov entry for each, so that large reads don't need large
+ * contiguous allocations (which come from the VM system every time
+ * once they're bigger than the largest kmem_alloc cache).
+ *
+ * On entry, uio_iovcnt is the number of entries available in uio_iov.
+ * If the read needs more mbufs than that, the last one gets an external
+ * (M_EXT) buffer big enough for the remainder.
  */
 struct mbuf *
 smb_mbuf_allocate(struct uio *uio)
 {
-	mbuf_t	*m = 0;
+	mbuf_t	*mhead = NULL;
+	mbuf_t	*m, **mpp = &mhead;
 	int	len = uio->uio_resid;
+	int	niov = uio->uio_iovcnt;
+	int	count;
+	int	i = 0;
 
-	MGET(m, M_WAIT, MT_DATA);
-	if (len > MCLBYTES) {
-		/* Like MCLGET(), but bigger buf. */
-		m->m_ext.ext_buf = kmem_zalloc(len, KM_SLEEP);
-		m->m_data = m->m_ext.ext_buf;
-		m->m_flags |= M_EXT;
-		m->m_ext.ext_size = len;
-		m->m_ext.ext_ref = smb_mbuf_kmem_ref;
-	} else if (len > MLEN) {
-		/* Use the kmem cache. */
-		MCLGET(m, M_WAIT);
-	}
-	m->m_len = len;
+	ASSERT(niov > 0);
 
-	uio->uio_iov->iov_base = m->m_data;
-	uio->uio_iov->iov_len = m->m_len;
-	uio->uio_iovcnt = 1;
+	do {
+		MGET(m, M_WAIT, MT_DATA);
+		if (len > MCLBYTES && i == niov - 1) {
+			/* Like MCLGET(), but bigger buf. */
+			m->m_ext.ext_buf = kmem_zalloc(len, KM_SLEEP);
+			m->m_data = m->m_ext.ext_buf;
+			m->m_flags |= M_EXT;
+			m->m_ext.ext_size = len;
+			m->m_ext.ext_ref = smb_mbuf_kmem_ref;
+			count = len;
+		} else {
+			count = MIN(len, MCLBYTES);
+			if (count > MLEN) {
+				/* Use the kmem cache. */
+				MCLGET(m, M_WAIT);
+			}
+		}
+		m->m_len = count;
 
-	return (m);
+		uio->uio_iov[i].iov_base = m->m_data;
+		uio->uio_iov[i].iov_len = count;
+		i++;
+
+		*mpp = m;
+		mpp = &m->m_next;
+		len -= count;
+	} while (len > 0);
+
+	uio->uio_iovcnt = i;
+
+	return (mhead);
 }
 
 /*
@@ -23,6 +23,7 @@
  * Copyright (c) 2017 by Delphix. All rights reserved.
  * Copyright 2019 Nexenta by DDN, Inc. All rights reserved.
  * Copyright 2020 RackTop Systems, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -278,6 +279,14 @@ kmem_cache_t		*smb_cache_odir;
 kmem_cache_t		*smb_cache_opipe;
 kmem_cache_t		*smb_cache_event;
 kmem_cache_t		*smb_cache_lock;
+kmem_cache_t		*smb_cache_reqbuf;
+
+/*
+ * Size of the buffers in smb_cache_reqbuf: the largest SMB2 write we
+ * allow, plus room for the headers around it.  Fixed when the cache is
+ * created, so later changes to smb2_max_rwsize don't affect it.
+ */
+size_t			smb_reqbuf_size;
 
 /*
  * *****************************************************************************
@@ -336,6 +345,9 @@ smb_server_g_init(void)
 	    sizeof (smb_event_t), 8, NULL, NULL, NULL, NULL, NULL, 0);
 	smb_cache_lock = kmem_cache_create("smb_lock_cache",
 	    sizeof (smb_lock_t), 8, NULL, NULL, NULL, NULL, NULL, 0);
+	smb_reqbuf_size = smb2_max_rwsize + SMB_REQBUF_SLOP;
+	smb_cache_reqbuf = kmem_cache_create("smb_reqbuf_cache",
+	    smb_reqbuf_size, 8, NULL, NULL, NULL, NULL, NULL, 0);
 
 	smb_llist_init();
 	smb_llist_constructor(&smb_servers, sizeof (smb_server_t),
@@ -372,6 +384,7 @@ smb_server_g_fini(void)
 	kmem_cache_destroy(smb_cache_opipe);
 	kmem_cache_destroy(smb_cache_event);
 	kmem_cache_destroy(smb_cache_lock);
+	kmem_cache_destroy(smb_cache_reqbuf);
 
 	smb2_lease_fini();
 	smb_node_fini();
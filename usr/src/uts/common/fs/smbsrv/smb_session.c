@@ -22,6 +22,7 @@
  * Copyright (c) 2007, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright 2019 Nexenta Systems, Inc.  All rights reserved.
  * Copyright 2020 RackTop Systems, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/atomic.h>
@@ -1342,6 +1343,28 @@ smb_session_isclient(smb_session_t *sn, const char *client)
 	return (B_FALSE);
 }
 
+/*
+ * Allocate a buffer for a request of len bytes.  Large SMB2 writes
+ * would otherwise need a contiguous allocation straight from the VM
+ * system for every request, so those come from smb_cache_reqbuf.
+ */
+void *
+smb_reqbuf_alloc(size_t len)
+{
+	if (len > SMB_REQBUF_SMALL && len <= smb_reqbuf_size)
+		return (kmem_cache_alloc(smb_cache_reqbuf, KM_SLEEP));
+	return (kmem_alloc(len, KM_SLEEP));
+}
+
+void
+smb_reqbuf_free(void *buf, size_t len)
+{
+	if (len > SMB_REQBUF_SMALL && len <= smb_reqbuf_size)
+		kmem_cache_free(smb_cache_reqbuf, buf);
+	else
+		kmem_free(buf, len);
+}
+
 /*
  * smb_request_alloc
  *
@@ -1378,7 +1401,7 @@ smb_request_alloc(smb_session_t *session, int req_length)
 	sr->reply.max_bytes = session->reply_max_bytes;
 	sr->sr_req_length = req_length;
 	if (req_length)
-		sr->sr_request_buf = kmem_alloc(req_length, KM_SLEEP);
+		sr->sr_request_buf = smb_reqbuf_alloc(req_length);
 	sr->sr_magic = SMB_REQ_MAGIC;
 	sr->sr_state = SMB_REQ_STATE_INITIALIZING;
 
@@ -1402,7 +1425,7 @@ smb_request_alloc(smb_session_t *session, int req_length)
 	case SMB_SESSION_STATE_TERMINATED:
 		/* Disallow new requests in these states. */
 		if (sr->sr_request_buf)
-			kmem_free(sr->sr_request_buf, sr->sr_req_length);
+			smb_reqbuf_free(sr->sr_request_buf, sr->sr_req_length);
 		sr->session = NULL;
 		sr->sr_magic = 0;
 		mutex_destroy(&sr->sr_mutex);
@@ -1453,7 +1476,7 @@ smb_request_free(smb_request_t *sr)
 	smb_srm_fini(sr);
 
 	if (sr->sr_request_buf)
-		kmem_free(sr->sr_request_buf, sr->sr_req_length);
+		smb_reqbuf_free(sr->sr_request_buf, sr->sr_req_length);
 	if (sr->command.chain)
 		m_freem(sr->command.chain);
 	if (sr->reply.chain)
@@ -479,10 +479,13 @@ sonode_constructor(void *buf, void *cdrarg, int kmflags)
 	    offsetof(struct sonode, so_acceptq_node));
 	list_create(&so->so_acceptq_defer, sizeof (struct sonode),
 	    offsetof(struct sonode, so_acceptq_node));
+	list_create(&so->so_zcopy_list, sizeof (so_zcopy_done_t),
+	    offsetof(so_zcopy_done_t, szd_node));
 	list_link_init(&so->so_acceptq_node);
 	so->so_acceptq_len	= 0;
 	so->so_backlog		= 0;
 	so->so_listener		= NULL;
+	so->so_acceptq_cpu	= NULL;
 
 	so->so_snd_qfull	= B_FALSE;
 
@@ -527,6 +530,7 @@ sonode_destructor(void *buf, void *cdrarg)
 
 	list_destroy(&so->so_acceptq_list);
 	list_destroy(&so->so_acceptq_defer);
+	list_destroy(&so->so_zcopy_list);
 	ASSERT(!list_link_active(&so->so_acceptq_node));
 	ASSERT(so->so_listener == NULL);
 
@@ -602,6 +606,11 @@ sonode_init(struct sonode *so, struct sockparams *sp, int family,
 	so->so_downcalls = NULL;
 
 	so->so_copyflag = 0;
+	so->so_zcopy = B_FALSE;
+	so->so_zcopy_next = 0;
+	so->so_acceptq_percpu = B_FALSE;
+	so->so_acceptq_cpu_len = 0;
+	so->so_acceptq_waiters = 0;
 
 	vn_reinit(vp);
 	vp->v_vfsp	= rootvfs;
@@ -661,6 +670,10 @@ sonode_fini(struct sonode *so)
 	if (so->so_filter_top != NULL)
 		sof_sonode_cleanup(so);
 
+	/* Drop zero-copy completions that were never collected */
+	so_zcopy_flush(so);
+	so_acceptq_cpu_fini(so);
+
 	/* Clean up any remnants of krecv callbacks */
 	so->so_krecv_cb = NULL;
 	so->so_krecv_arg = NULL;
@@ -175,6 +175,25 @@ extern int	so_acceptq_dequeue(struct sonode *, boolean_t,
     struct sonode **);
 extern void	so_acceptq_flush(struct sonode *, boolean_t);
 
+	/* per-CPU accept queues, see sockcommon_subr.c */
+typedef struct so_acceptq_cpu {
+	kmutex_t	sac_lock;
+	list_t		sac_list;	/* pending conns */
+	unsigned int	sac_len;	/* # of conns on sac_list */
+	char		sac_pad[64 - sizeof (kmutex_t) - sizeof (list_t) -
+			    sizeof (unsigned int)];
+} so_acceptq_cpu_t;
+
+#define	SO_ACCEPTQ_NONEMPTY(so)						\
+	(!list_is_empty(&(so)->so_acceptq_list) ||			\
+	(so)->so_acceptq_cpu_len != 0)
+
+extern void	so_acceptq_cpu_enable(struct sonode *);
+extern void	so_acceptq_cpu_fini(struct sonode *);
+extern boolean_t so_acceptq_cpu_enqueue(struct sonode *, struct sonode *);
+extern void	so_acceptq_cpu_merge(struct sonode *);
+extern void	so_acceptq_cpu_sync(struct sonode *);
+
 	/* connect */
 extern int	so_wait_connected(struct sonode *, boolean_t, sock_connid_t);
 
@@ -215,6 +234,20 @@ extern int socket_strioc_common(struct sonode *, int, intptr_t, int,
     struct cred *, int32_t *);
 
 extern int so_zcopy_wait(struct sonode *);
+
+/* MSG_ZEROCOPY */
+typedef struct so_zcopy_done {
+	list_node_t		szd_node;
+	struct sock_zcopy_info	szd_info;
+} so_zcopy_done_t;
+
+typedef struct so_zcopy_req so_zcopy_req_t;
+
+extern so_zcopy_req_t *so_zcopy_start(struct sonode *, struct uio *);
+extern mblk_t	*so_zcopy_uio(so_zcopy_req_t *, struct uio *, int *);
+extern void	so_zcopy_end(so_zcopy_req_t *, boolean_t);
+extern int	so_zcopy_recverr(struct sonode *, struct nmsghdr *);
+extern void	so_zcopy_flush(struct sonode *);
 extern int so_get_mod_version(struct sockparams *);
 
 /* Notification functions */
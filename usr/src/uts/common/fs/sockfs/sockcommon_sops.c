@@ -32,6 +32,7 @@
 #include <sys/param.h>
 #include <sys/systm.h>
 #include <sys/sysmacros.h>
+#include <sys/atomic.h>
 #include <sys/debug.h>
 #include <sys/cmn_err.h>
 
@@ -371,8 +372,9 @@ so_sendmsg(struct sonode *so, struct nmsghdr *msg, struct uio *uiop,
 {
 	int error, flags;
 	boolean_t dontblock;
-	ssize_t orig_resid;
+	ssize_t orig_resid, start_resid;
 	mblk_t  *mp;
+	so_zcopy_req_t *szr = NULL;
 
 	SO_BLOCK_FALLBACK(so, SOP_SENDMSG(so, msg, uiop, cr));
 
@@ -396,6 +398,12 @@ so_sendmsg(struct sonode *so, struct nmsghdr *msg, struct uio *uiop,
 		return (EMSGSIZE);
 	}
 
+	/* MSG_ZEROCOPY is ignored unless SO_ZEROCOPY has been enabled. */
+	if ((flags & MSG_ZEROCOPY) && so->so_zcopy &&
+	    so->so_downcalls->sd_send != NULL)
+		szr = so_zcopy_start(so, uiop);
+	start_resid = uiop->uio_resid;
+
 	/*
 	 * For atomic sends we will only do one iteration.
 	 */
@@ -445,13 +453,17 @@ so_sendmsg(struct sonode *so, struct nmsghdr *msg, struct uio *uiop,
 			/* save the resid in case of failure */
 			orig_resid = uiop->uio_resid;
 
-			if ((mp = socopyinuio(uiop,
-			    so->so_proto_props.sopp_maxpsz,
-			    so->so_proto_props.sopp_wroff,
-			    so->so_proto_props.sopp_maxblk,
-			    so->so_proto_props.sopp_tail, &error)) == NULL) {
-				break;
+			if (szr != NULL) {
+				mp = so_zcopy_uio(szr, uiop, &error);
+			} else {
+				mp = socopyinuio(uiop,
+				    so->so_proto_props.sopp_maxpsz,
+				    so->so_proto_props.sopp_wroff,
+				    so->so_proto_props.sopp_maxblk,
+				    so->so_proto_props.sopp_tail, &error);
 			}
+			if (mp == NULL)
+				break;
 			ASSERT(uiop->uio_resid >= 0);
 
 			if (so->so_filter_active > 0 &&
@@ -476,6 +488,9 @@ so_sendmsg(struct sonode *so, struct nmsghdr *msg, struct uio *uiop,
 		}
 	} while (uiop->uio_resid > 0);
 
+	if (szr != NULL)
+		so_zcopy_end(szr, uiop->uio_resid != start_resid);
+
 	SO_UNBLOCK_FALLBACK(so);
 
 	return (error);
@@ -851,6 +866,36 @@ so_setsockopt(struct sonode *so, int level, int option_name,
 			 */
 			so->so_xpg_rcvbuf = *(int32_t *)optval;
 			break;
+		case SO_ZEROCOPY:
+			/*
+			 * Handled entirely by sockfs; MSG_ZEROCOPY needs
+			 * nothing from the protocol beyond sd_send.
+			 */
+			if (optlen != sizeof (int32_t)) {
+				error = EINVAL;
+			} else if (so->so_downcalls->sd_send == NULL ||
+			    (so->so_type != SOCK_STREAM &&
+			    so->so_type != SOCK_DGRAM)) {
+				error = EOPNOTSUPP;
+			} else {
+				mutex_enter(&so->so_lock);
+				so->so_zcopy = (*(int32_t *)optval != 0);
+				mutex_exit(&so->so_lock);
+			}
+			goto done;
+		case SO_ACCEPTQ_PERCPU:
+			/* The queues stay allocated once enabled. */
+			if (optlen != sizeof (int32_t)) {
+				error = EINVAL;
+			} else if (!(so->so_mode & SM_CONNREQUIRED)) {
+				error = EOPNOTSUPP;
+			} else if (*(int32_t *)optval != 0) {
+				so_acceptq_cpu_enable(so);
+				so->so_acceptq_percpu = B_TRUE;
+			} else {
+				so->so_acceptq_percpu = B_FALSE;
+			}
+			goto done;
 		}
 	}
 	error = (*so->so_downcalls->sd_setsockopt)
@@ -915,6 +960,10 @@ so_poll(struct sonode *so, short events, int anyyet, short *reventsp,
 		return (0);
 	}
 
+	/* Uncollected MSG_ZEROCOPY completions */
+	if (!list_is_empty(&so->so_zcopy_list))
+		*reventsp |= POLLERR;
+
 	/*
 	 * If the socket is in a state where it can send data
 	 * turn on POLLWRBAND and POLLOUT events.
@@ -946,7 +995,7 @@ so_poll(struct sonode *so, short events, int anyyet, short *reventsp,
 	 */
 
 	/* Pending connections */
-	if (!list_is_empty(&so->so_acceptq_list))
+	if (SO_ACCEPTQ_NONEMPTY(so))
 		*reventsp |= (POLLIN|POLLRDNORM) & events;
 
 	/*
@@ -995,8 +1044,7 @@ so_poll(struct sonode *so, short events, int anyyet, short *reventsp,
 		/* Check for read events again, but this time under lock */
 		if (events & (POLLIN|POLLRDNORM)) {
 			mutex_enter(&so->so_lock);
-			if (SO_HAVE_DATA(so) ||
-			    !list_is_empty(&so->so_acceptq_list)) {
+			if (SO_HAVE_DATA(so) || SO_ACCEPTQ_NONEMPTY(so)) {
 				if (events & POLLET) {
 					so->so_pollev |= SO_POLLEV_IN;
 					*phpp = &so->so_poll_list;
@@ -1157,6 +1205,17 @@ so_newconn(sock_upper_handle_t parenthandle,
 	 */
 	*sock_upcallsp = &so_upcalls;
 
+	/*
+	 * A per-CPU enqueue only fails if the listener is closing or
+	 * falling back, in which case nso is dropped below.
+	 */
+	if (so->so_acceptq_percpu && !(nso->so_state & SS_FIL_DEFER) &&
+	    so_acceptq_cpu_enqueue(so, nso)) {
+		mutex_enter(&so->so_lock);
+		so_notify_newconn(so);
+		return ((sock_upper_handle_t)nso);
+	}
+
 	mutex_enter(&so->so_acceptq_lock);
 	if (so->so_state & (SS_CLOSING|SS_FALLBACK_PENDING|SS_FALLBACK_COMP)) {
 		mutex_exit(&so->so_acceptq_lock);
@@ -1168,7 +1227,7 @@ so_newconn(sock_upper_handle_t parenthandle,
 		socket_destroy(nso);
 		return (NULL);
 	} else {
-		so->so_acceptq_len++;
+		atomic_inc_uint(&so->so_acceptq_len);
 		if (nso->so_state & SS_FIL_DEFER) {
 			list_insert_tail(&so->so_acceptq_defer, nso);
 			mutex_exit(&so->so_acceptq_lock);
@@ -1535,6 +1594,7 @@ so_close(struct sonode *so, int flag, struct cred *cr)
 		 */
 		mutex_enter(&so->so_acceptq_lock);
 		mutex_exit(&so->so_acceptq_lock);
+		so_acceptq_cpu_sync(so);
 
 		so_acceptq_flush(so, B_TRUE);
 	}
@@ -1629,6 +1689,12 @@ so_recvmsg(struct sonode *so, struct nmsghdr *msg, struct uio *uiop,
 
 	SO_BLOCK_FALLBACK(so, SOP_RECVMSG(so, msg, uiop, cr));
 
+	if (msg->msg_flags & MSG_ERRQUEUE) {
+		error = so_zcopy_recverr(so, msg);
+		SO_UNBLOCK_FALLBACK(so);
+		return (error);
+	}
+
 	if ((so->so_state & (SS_ISCONNECTED|SS_CANTRCVMORE)) == 0 &&
 	    (so->so_mode & SM_CONNREQUIRED)) {
 		SO_UNBLOCK_FALLBACK(so);
@@ -40,6 +40,10 @@
 #include <sys/strsun.h>
 #include <sys/atomic.h>
 #include <sys/tihdr.h>
+#include <sys/buf.h>
+#include <sys/proc.h>
+#include <sys/cpuvar.h>
+#include <vm/as.h>
 
 #include <fs/sockfs/sockcommon.h>
 #include <fs/sockfs/sockfilter_impl.h>
@@ -58,20 +62,197 @@ extern clock_t sock_test_timelimit;
 #define	MBLK_PULL_LEN 64
 uint32_t so_mblk_pull_len = MBLK_PULL_LEN;
 
+/*
+ * MSG_ZEROCOPY sends shorter than so_zcopy_minsz are copied, since pinning
+ * and mapping the pages costs more than the copy; so_zcopy_blksz bounds the
+ * size of each lent mblk.
+ */
+ssize_t so_zcopy_minsz = 16384;
+ssize_t so_zcopy_blksz = 65536;
+
 #ifdef DEBUG
 boolean_t so_debug_length = B_FALSE;
 static boolean_t so_check_length(sonode_t *so);
 #endif
 
+/*
+ * Per-CPU accept queues
+ *
+ * A listener with SO_ACCEPTQ_PERCPU set queues each new connection on the
+ * queue of the CPU that runs so_newconn(). For TCP that is the CPU of the
+ * eager's squeue, so handshakes completing on many squeues at once do not
+ * all serialize on so_acceptq_lock. accept() takes a connection from its
+ * own CPU's queue first, without acquiring so_acceptq_lock. After that it
+ * tries the shared queue, then the other CPUs' queues. Connections deferred
+ * by a filter always use the shared lists.
+ *
+ * The enqueuer publishes the connection and then checks
+ * so_acceptq_waiters. A thread about to sleep in accept() bumps
+ * so_acceptq_waiters and then rechecks so_acceptq_cpu_len. Either the
+ * sleeper sees the connection, or the enqueuer sees the sleeper and
+ * signals so_acceptq_cv under so_acceptq_lock.
+ */
+static void
+so_acceptq_cpu_free(so_acceptq_cpu_t *sacp)
+{
+	int i;
+
+	for (i = 0; i < max_ncpus; i++) {
+		ASSERT(list_is_empty(&sacp[i].sac_list));
+		list_destroy(&sacp[i].sac_list);
+		mutex_destroy(&sacp[i].sac_lock);
+	}
+	kmem_free(sacp, max_ncpus * sizeof (so_acceptq_cpu_t));
+}
+
+void
+so_acceptq_cpu_enable(struct sonode *so)
+{
+	so_acceptq_cpu_t *sacp;
+	int i;
+
+	if (so->so_acceptq_cpu != NULL)
+		return;
+
+	sacp = kmem_zalloc(max_ncpus * sizeof (so_acceptq_cpu_t), KM_SLEEP);
+	for (i = 0; i < max_ncpus; i++) {
+		mutex_init(&sacp[i].sac_lock, NULL, MUTEX_DEFAULT, NULL);
+		list_create(&sacp[i].sac_list, sizeof (struct sonode),
+		    offsetof(struct sonode, so_acceptq_node));
+	}
+	if (atomic_cas_ptr(&so->so_acceptq_cpu, NULL, sacp) != NULL)
+		so_acceptq_cpu_free(sacp);
+	membar_producer();
+}
+
+void
+so_acceptq_cpu_fini(struct sonode *so)
+{
+	if (so->so_acceptq_cpu != NULL) {
+		ASSERT(so->so_acceptq_cpu_len == 0);
+		so_acceptq_cpu_free(so->so_acceptq_cpu);
+		so->so_acceptq_cpu = NULL;
+	}
+}
+
+/*
+ * Queue nso on the current CPU's accept queue. Returns B_FALSE if the
+ * listener is closing or falling back to TPI, and the caller then
+ * destroys nso.
+ */
+boolean_t
+so_acceptq_cpu_enqueue(struct sonode *so, struct sonode *nso)
+{
+	so_acceptq_cpu_t *sac = &so->so_acceptq_cpu[CPU->cpu_seqid];
+
+	mutex_enter(&sac->sac_lock);
+	if (so->so_state & (SS_CLOSING|SS_FALLBACK_PENDING|SS_FALLBACK_COMP)) {
+		mutex_exit(&sac->sac_lock);
+		return (B_FALSE);
+	}
+	list_insert_tail(&sac->sac_list, nso);
+	sac->sac_len++;
+	atomic_inc_uint(&so->so_acceptq_len);
+	atomic_inc_uint(&so->so_acceptq_cpu_len);
+	mutex_exit(&sac->sac_lock);
+
+	membar_enter();
+	if (so->so_acceptq_waiters != 0) {
+		mutex_enter(&so->so_acceptq_lock);
+		cv_signal(&so->so_acceptq_cv);
+		mutex_exit(&so->so_acceptq_lock);
+	}
+	return (B_TRUE);
+}
+
+/*
+ * Take a connection off the current CPU's queue or, if localonly is not
+ * set, off the first non-empty per-CPU queue.
+ */
+static struct sonode *
+so_acceptq_cpu_remove(struct sonode *so, boolean_t localonly)
+{
+	so_acceptq_cpu_t *sacp = so->so_acceptq_cpu;
+	so_acceptq_cpu_t *sac;
+	struct sonode *nso;
+	int i, start, n;
+
+	if (sacp == NULL || so->so_acceptq_cpu_len == 0)
+		return (NULL);
+
+	start = CPU->cpu_seqid;
+	n = localonly ? 1 : max_ncpus;
+	for (i = 0; i < n; i++) {
+		sac = &sacp[(start + i) % max_ncpus];
+		if (sac->sac_len == 0)
+			continue;
+		mutex_enter(&sac->sac_lock);
+		if ((nso = list_remove_head(&sac->sac_list)) != NULL) {
+			sac->sac_len--;
+			atomic_dec_uint(&so->so_acceptq_cpu_len);
+		}
+		mutex_exit(&sac->sac_lock);
+		if (nso != NULL)
+			return (nso);
+	}
+	return (NULL);
+}
+
+/*
+ * Move everything on the per-CPU queues to the shared queue. Used by
+ * fallback, which walks so_acceptq_list, after SS_FALLBACK_PENDING has
+ * stopped further per-CPU enqueues.
+ */
+void
+so_acceptq_cpu_merge(struct sonode *so)
+{
+	so_acceptq_cpu_t *sac;
+	int i;
+
+	if (so->so_acceptq_cpu == NULL)
+		return;
+
+	mutex_enter(&so->so_acceptq_lock);
+	for (i = 0; i < max_ncpus; i++) {
+		sac = &so->so_acceptq_cpu[i];
+		mutex_enter(&sac->sac_lock);
+		list_move_tail(&so->so_acceptq_list, &sac->sac_list);
+		sac->sac_len = 0;
+		mutex_exit(&sac->sac_lock);
+	}
+	so->so_acceptq_cpu_len = 0;
+	mutex_exit(&so->so_acceptq_lock);
+}
+
+/*
+ * Wait for any so_acceptq_cpu_enqueue() in progress to finish; later ones
+ * observe SS_CLOSING.
+ */
+void
+so_acceptq_cpu_sync(struct sonode *so)
+{
+	int i;
+
+	if (so->so_acceptq_cpu == NULL)
+		return;
+
+	for (i = 0; i < max_ncpus; i++) {
+		mutex_enter(&so->so_acceptq_cpu[i].sac_lock);
+		mutex_exit(&so->so_acceptq_cpu[i].sac_lock);
+	}
+}
+
 static int
 so_acceptq_dequeue_locked(struct sonode *so, boolean_t dontblock,
     struct sonode **nsop)
 {
 	struct sonode *nso = NULL;
+	int rv;
 
 	*nsop = NULL;
 	ASSERT(MUTEX_HELD(&so->so_acceptq_lock));
-	while ((nso = list_remove_head(&so->so_acceptq_list)) == NULL) {
+	while ((nso = list_remove_head(&so->so_acceptq_list)) == NULL &&
+	    (nso = so_acceptq_cpu_remove(so, B_FALSE)) == NULL) {
 		/*
 		 * No need to check so_error here, because it is not
 		 * possible for a listening socket to be reset or otherwise
@@ -84,14 +265,22 @@ so_acceptq_dequeue_locked(struct sonode *so, boolean_t dontblock,
 		if (so->so_state & (SS_CLOSING | SS_FALLBACK_PENDING))
 			return (EINTR);
 
-		if (cv_wait_sig_swap(&so->so_acceptq_cv,
-		    &so->so_acceptq_lock) == 0)
+		/* Let per-CPU enqueuers know to signal us */
+		so->so_acceptq_waiters++;
+		membar_enter();
+		if (so->so_acceptq_cpu_len != 0) {
+			so->so_acceptq_waiters--;
+			continue;
+		}
+		rv = cv_wait_sig_swap(&so->so_acceptq_cv, &so->so_acceptq_lock);
+		so->so_acceptq_waiters--;
+		if (rv == 0)
 			return (EINTR);
 	}
 
 	ASSERT(nso != NULL);
 	ASSERT(so->so_acceptq_len > 0);
-	so->so_acceptq_len--;
+	atomic_dec_uint(&so->so_acceptq_len);
 	nso->so_listener = NULL;
 
 	*nsop = nso;
@@ -123,8 +312,18 @@ int
 so_acceptq_dequeue(struct sonode *so, boolean_t dontblock,
     struct sonode **nsop)
 {
+	struct sonode *nso;
 	int error;
 
+	/* The local CPU's queue does not need so_acceptq_lock */
+	if ((nso = so_acceptq_cpu_remove(so, B_TRUE)) != NULL) {
+		ASSERT(so->so_acceptq_len > 0);
+		atomic_dec_uint(&so->so_acceptq_len);
+		nso->so_listener = NULL;
+		*nsop = nso;
+		return (0);
+	}
+
 	mutex_enter(&so->so_acceptq_lock);
 	error = so_acceptq_dequeue_locked(so, dontblock, nsop);
 	mutex_exit(&so->so_acceptq_lock);
@@ -182,8 +381,18 @@ so_acceptq_flush_impl(struct sonode *so, list_t *list, boolean_t doclose)
 void
 so_acceptq_flush(struct sonode *so, boolean_t doclose)
 {
+	int i;
+
 	so_acceptq_flush_impl(so, &so->so_acceptq_list, doclose);
 	so_acceptq_flush_impl(so, &so->so_acceptq_defer, doclose);
+	if (so->so_acceptq_cpu != NULL) {
+		for (i = 0; i < max_ncpus; i++) {
+			so_acceptq_flush_impl(so,
+			    &so->so_acceptq_cpu[i].sac_list, doclose);
+			so->so_acceptq_cpu[i].sac_len = 0;
+		}
+		so->so_acceptq_cpu_len = 0;
+	}
 
 	so->so_acceptq_len = 0;
 }
@@ -497,6 +706,303 @@ done:
 	return (head);
 }
 
+/*
+ * MSG_ZEROCOPY
+ *
+ * A send with MSG_ZEROCOPY on a socket with SO_ZEROCOPY enabled lends the
+ * caller's pages to the transport instead of copying them. The user buffer
+ * is locked with as_pagelock(), mapped into the kernel with bp_mapin() and
+ * sent down as esballoca'ed mblks marked STRUIO_ZC. Every such mblk holds a
+ * reference on the send's so_zcopy_req_t; when the transport frees the last
+ * of them, normally once the data has been acknowledged, the pages are
+ * unlocked and a completion carrying the send's sequence number is queued on
+ * the sonode. The application collects completions with
+ * recvmsg(MSG_ERRQUEUE), and POLLERR is raised while any are queued.
+ * Consecutive completions with the same flags are merged into one range.
+ *
+ * Sends that cannot lend their pages (short ones, or a socket with filters
+ * or a protocol that consumes the uio directly) are copied as usual and
+ * their completion is flagged SZC_COPIED.
+ */
+struct so_zcopy_req {
+	struct sonode	*szr_so;
+	struct as	*szr_as;	/* address space of the buffer */
+	uint32_t	szr_ref;	/* one for the send, one per mblk */
+	uint32_t	szr_flags;	/* SZC_* */
+	uint32_t	szr_id;		/* sequence number */
+	boolean_t	szr_sent;	/* any data accepted by the protocol */
+};
+
+typedef struct so_zcopy_buf {
+	frtn_t		szb_frtn;
+	struct buf	szb_buf;
+	caddr_t		szb_uaddr;
+	size_t		szb_len;
+	page_t		**szb_pplist;
+	so_zcopy_req_t	*szb_req;
+} so_zcopy_buf_t;
+
+static void
+so_zcopy_post(so_zcopy_req_t *szr)
+{
+	struct sonode *so = szr->szr_so;
+	so_zcopy_done_t *szd, *nszd;
+
+	nszd = kmem_alloc(sizeof (*nszd), KM_SLEEP);
+
+	mutex_enter(&so->so_lock);
+	szd = list_tail(&so->so_zcopy_list);
+	if (szd != NULL && szd->szd_info.szc_hi + 1 == szr->szr_id &&
+	    szd->szd_info.szc_flags == szr->szr_flags) {
+		szd->szd_info.szc_hi = szr->szr_id;
+	} else {
+		nszd->szd_info.szc_lo = szr->szr_id;
+		nszd->szd_info.szc_hi = szr->szr_id;
+		nszd->szd_info.szc_flags = szr->szr_flags;
+		list_insert_tail(&so->so_zcopy_list, nszd);
+		nszd = NULL;
+	}
+	mutex_exit(&so->so_lock);
+
+	if (nszd != NULL)
+		kmem_free(nszd, sizeof (*nszd));
+	pollwakeup(&so->so_poll_list, POLLERR);
+}
+
+static void
+so_zcopy_rele(so_zcopy_req_t *szr)
+{
+	membar_exit();
+	if (atomic_dec_32_nv(&szr->szr_ref) != 0)
+		return;
+
+	if (szr->szr_sent)
+		so_zcopy_post(szr);
+	VN_RELE(SOTOV(szr->szr_so));
+	kmem_free(szr, sizeof (*szr));
+}
+
+/*
+ * Free routine of a lent mblk. esballoca() runs it from a taskq, so it can
+ * block.
+ */
+static void
+so_zcopy_free(so_zcopy_buf_t *szb)
+{
+	so_zcopy_req_t *szr = szb->szb_req;
+
+	bp_mapout(&szb->szb_buf);
+	as_pageunlock(szr->szr_as, szb->szb_pplist, szb->szb_uaddr,
+	    szb->szb_len, S_READ);
+	biofini(&szb->szb_buf);
+	kmem_free(szb, sizeof (*szb));
+	so_zcopy_rele(szr);
+}
+
+/*
+ * Lock len bytes of user memory at uaddr and wrap them in an mblk. Returns
+ * NULL if the pages cannot be lent, in which case the caller copies them.
+ */
+static mblk_t *
+so_zcopy_pin(so_zcopy_req_t *szr, caddr_t uaddr, size_t len)
+{
+	so_zcopy_buf_t *szb;
+	struct buf *bp;
+	mblk_t *mp;
+
+	szb = kmem_alloc(sizeof (*szb), KM_SLEEP);
+	if (as_pagelock(szr->szr_as, &szb->szb_pplist, uaddr, len,
+	    S_READ) != 0) {
+		kmem_free(szb, sizeof (*szb));
+		return (NULL);
+	}
+	szb->szb_uaddr = uaddr;
+	szb->szb_len = len;
+	szb->szb_req = szr;
+
+	bp = &szb->szb_buf;
+	bioinit(bp);
+	bp->b_flags = B_BUSY | B_PHYS | B_WRITE;
+	if (szb->szb_pplist != NULL) {
+		bp->b_flags |= B_SHADOW;
+		bp->b_shadow = szb->szb_pplist;
+	}
+	bp->b_proc = curproc;
+	bp->b_un.b_addr = uaddr;
+	bp->b_bcount = len;
+	bp_mapin(bp);
+
+	szb->szb_frtn.free_func = so_zcopy_free;
+	szb->szb_frtn.free_arg = (caddr_t)szb;
+	mp = esballoca((uchar_t *)bp->b_un.b_addr, len, BPRI_HI,
+	    &szb->szb_frtn);
+	if (mp == NULL) {
+		bp_mapout(bp);
+		as_pageunlock(szr->szr_as, szb->szb_pplist, uaddr, len,
+		    S_READ);
+		biofini(bp);
+		kmem_free(szb, sizeof (*szb));
+		return (NULL);
+	}
+	mp->b_wptr += len;
+	mp->b_datap->db_struioflag |= STRUIO_ZC;
+	atomic_inc_32(&szr->szr_ref);
+
+	return (mp);
+}
+
+/*
+ * Start a MSG_ZEROCOPY send. The request holds the sonode until its
+ * completion has been queued.
+ */
+so_zcopy_req_t *
+so_zcopy_start(struct sonode *so, struct uio *uiop)
+{
+	so_zcopy_req_t *szr;
+
+	szr = kmem_zalloc(sizeof (*szr), KM_SLEEP);
+	szr->szr_so = so;
+	szr->szr_as = curproc->p_as;
+	szr->szr_ref = 1;
+	if (uiop->uio_segflg != UIO_USERSPACE ||
+	    uiop->uio_resid < so_zcopy_minsz || so->so_filter_active > 0 ||
+	    so->so_downcalls->sd_send_uio != NULL)
+		szr->szr_flags = SZC_COPIED;
+	VN_HOLD(SOTOV(so));
+
+	return (szr);
+}
+
+/*
+ * The MSG_ZEROCOPY counterpart of socopyinuio(): build up to one
+ * sopp_maxpsz worth of mblks from the uio, lending the pages where possible.
+ */
+mblk_t *
+so_zcopy_uio(so_zcopy_req_t *szr, struct uio *uiop, int *errorp)
+{
+	struct sock_proto_props *sopp = &szr->szr_so->so_proto_props;
+	mblk_t *head = NULL, **tail = &head;
+	ssize_t iosize = sopp->sopp_maxpsz;
+
+	if (szr->szr_flags & SZC_COPIED) {
+		return (socopyinuio(uiop, iosize, sopp->sopp_wroff,
+		    sopp->sopp_maxblk, sopp->sopp_tail, errorp));
+	}
+
+	if (iosize == INFPSZ || iosize > uiop->uio_resid)
+		iosize = uiop->uio_resid;
+
+	*errorp = 0;
+	while (iosize > 0) {
+		struct iovec *iov = uiop->uio_iov;
+		size_t len;
+		mblk_t *mp;
+
+		if (iov->iov_len == 0) {
+			uiop->uio_iov++;
+			uiop->uio_iovcnt--;
+			continue;
+		}
+		len = MIN(MIN(iosize, so_zcopy_blksz), iov->iov_len);
+
+		if ((mp = so_zcopy_pin(szr, iov->iov_base, len)) != NULL) {
+			uioskip(uiop, len);
+		} else {
+			/* Fall back to copying this piece. */
+			szr->szr_flags |= SZC_COPIED;
+			if ((mp = allocb(len, BPRI_MED)) == NULL) {
+				*errorp = ENOMEM;
+				return (head);
+			}
+			if ((*errorp = uiomove(mp->b_wptr, len, UIO_WRITE,
+			    uiop)) != 0) {
+				freeb(mp);
+				freemsg(head);
+				return (NULL);
+			}
+			mp->b_wptr += len;
+		}
+		*tail = mp;
+		tail = &mp->b_cont;
+		iosize -= len;
+	}
+
+	return (head);
+}
+
+/*
+ * Finish a MSG_ZEROCOPY send. If the protocol accepted any of the data the
+ * send is given the next sequence number, and its completion is queued once
+ * the last lent mblk is freed.
+ */
+void
+so_zcopy_end(so_zcopy_req_t *szr, boolean_t sent)
+{
+	struct sonode *so = szr->szr_so;
+
+	if (sent) {
+		mutex_enter(&so->so_lock);
+		szr->szr_id = so->so_zcopy_next++;
+		mutex_exit(&so->so_lock);
+		szr->szr_sent = B_TRUE;
+	}
+	so_zcopy_rele(szr);
+}
+
+/*
+ * recvmsg(MSG_ERRQUEUE): return the oldest queued completion as a
+ * SCM_ZEROCOPY control message.
+ */
+int
+so_zcopy_recverr(struct sonode *so, struct nmsghdr *msg)
+{
+	so_zcopy_done_t *szd;
+	struct sock_zcopy_info info;
+	struct cmsghdr *cmsg;
+
+	if (!(msg->msg_flags & MSG_XPG4_2))
+		return (EOPNOTSUPP);
+
+	mutex_enter(&so->so_lock);
+	if ((szd = list_head(&so->so_zcopy_list)) == NULL) {
+		mutex_exit(&so->so_lock);
+		return (EAGAIN);
+	}
+	info = szd->szd_info;
+	if (!(msg->msg_flags & MSG_PEEK))
+		list_remove(&so->so_zcopy_list, szd);
+	else
+		szd = NULL;
+	mutex_exit(&so->so_lock);
+
+	if (szd != NULL)
+		kmem_free(szd, sizeof (*szd));
+
+	msg->msg_namelen = 0;
+	msg->msg_controllen = CMSG_SPACE(sizeof (info));
+	msg->msg_control = kmem_zalloc(msg->msg_controllen, KM_SLEEP);
+	cmsg = msg->msg_control;
+	cmsg->cmsg_len = CMSG_LEN(sizeof (info));
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_ZEROCOPY;
+	bcopy(&info, CMSG_DATA(cmsg), sizeof (info));
+	msg->msg_flags = (msg->msg_flags & MSG_XPG4_2) | MSG_ERRQUEUE;
+
+	return (0);
+}
+
+/*
+ * Discard completions nobody collected.
+ */
+void
+so_zcopy_flush(struct sonode *so)
+{
+	so_zcopy_done_t *szd;
+
+	while ((szd = list_remove_head(&so->so_zcopy_list)) != NULL)
+		kmem_free(szd, sizeof (*szd));
+}
+
 mblk_t *
 socopyoutuio(mblk_t *mp, struct uio *uiop, ssize_t max_read, int *errorp)
 {
@@ -1699,7 +2205,9 @@ socket_getopt_common(struct sonode *so, int level, int option_name,
 	case SO_ERROR:
 	case SO_DOMAIN:
 	case SO_TYPE:
-	case SO_ACCEPTCONN: {
+	case SO_ACCEPTCONN:
+	case SO_ZEROCOPY:
+	case SO_ACCEPTQ_PERCPU: {
 		int32_t value;
 		socklen_t optlen = *optlenp;
 
@@ -1725,6 +2233,12 @@ socket_getopt_common(struct sonode *so, int level, int option_name,
 			else
 				value = 0;
 			break;
+		case SO_ZEROCOPY:
+			value = so->so_zcopy ? 1 : 0;
+			break;
+		case SO_ACCEPTQ_PERCPU:
+			value = so->so_acceptq_percpu ? 1 : 0;
+			break;
 		}
 
 		bcopy(&value, optval, sizeof (value));
@@ -2386,6 +2900,7 @@ so_tpi_fallback(struct sonode *so, struct cred *cr)
 	 * Walk the accept queue and notify the proto that they should
 	 * fall back to TPI. The protocol will send up the T_CONN_IND.
 	 */
+	so_acceptq_cpu_merge(so);
 	nso = list_head(&so->so_acceptq_list);
 	while (nso != NULL) {
 		int rval;
@@ -2412,7 +2927,7 @@ so_tpi_fallback(struct sonode *so, struct cred *cr)
 			    "Pid = %d\n", curproc->p_pid);
 			next = list_next(&so->so_acceptq_list, nso);
 			list_remove(&so->so_acceptq_list, nso);
-			so->so_acceptq_len--;
+			atomic_dec_uint(&so->so_acceptq_len);
 
 			(void) socket_close(nso, 0, CRED());
 			socket_destroy(nso);
@@ -25,6 +25,7 @@
 
 #include <sys/systm.h>
 #include <sys/sysmacros.h>
+#include <sys/atomic.h>
 #include <sys/cmn_err.h>
 #include <sys/disp.h>
 #include <sys/list.h>
@@ -681,7 +682,7 @@ sof_sonode_drop_deferred(struct sonode *so)
 	if ((def = list_head(&so->so_acceptq_defer)) != NULL &&
 	    (now - def->so_filter_defertime) > sof_defer_drop_time) {
 		list_remove(&so->so_acceptq_defer, def);
-		so->so_acceptq_len--;
+		atomic_dec_uint(&so->so_acceptq_len);
 		mutex_exit(&so->so_acceptq_lock);
 		def->so_listener = NULL;
 	} else {
@@ -1818,13 +1819,13 @@ sof_newconn_move(sof_handle_t handle, sof_handle_t newparent)
 	old = so->so_listener;
 	mutex_enter(&old->so_acceptq_lock);
 	list_remove(&old->so_acceptq_defer, so);
-	old->so_acceptq_len--;
+	atomic_dec_uint(&old->so_acceptq_len);
 	mutex_exit(&old->so_acceptq_lock);
 
 	new = newpinst->sofi_sonode;
 	mutex_enter(&new->so_acceptq_lock);
 	list_insert_tail(&new->so_acceptq_defer, so);
-	new->so_acceptq_len++;
+	atomic_inc_uint(&new->so_acceptq_len);
 	mutex_exit(&new->so_acceptq_lock);
 
 	so->so_listener = new;
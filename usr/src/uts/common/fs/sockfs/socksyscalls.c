@@ -821,14 +821,12 @@ shutdown(int sock, int how, int version)
 }
 
 /*
- * Common receive routine.
+ * Common receive routine, called with a hold on the socket's file.
  */
 static ssize_t
-recvit(int sock, struct nmsghdr *msg, struct uio *uiop, int flags,
-    socklen_t *namelenp, socklen_t *controllenp, int *flagsp)
+sorecvit(struct sonode *so, file_t *fp, struct nmsghdr *msg, struct uio *uiop,
+    int flags, socklen_t *namelenp, socklen_t *controllenp, int *flagsp)
 {
-	struct sonode *so;
-	file_t *fp;
 	void *name;
 	socklen_t namelen;
 	void *control;
@@ -836,9 +834,6 @@ recvit(int sock, struct nmsghdr *msg, struct uio *uiop, int flags,
 	ssize_t len;
 	int error;
 
-	if ((so = getsonode(sock, &error, &fp)) == NULL)
-		return (set_errno(error));
-
 	len = uiop->uio_resid;
 	uiop->uio_fmode = fp->f_flag;
 	uiop->uio_extflg = UIO_COPY_CACHED;
@@ -849,15 +844,12 @@ recvit(int sock, struct nmsghdr *msg, struct uio *uiop, int flags,
 	controllen = msg->msg_controllen;
 
 	msg->msg_flags = flags & (MSG_OOB | MSG_PEEK | MSG_WAITALL |
-	    MSG_DONTWAIT | MSG_XPG4_2);
+	    MSG_DONTWAIT | MSG_ERRQUEUE | MSG_XPG4_2);
 
 	error = socket_recvmsg(so, msg, uiop, CRED());
-	if (error) {
-		releasef(sock);
+	if (error)
 		return (set_errno(error));
-	}
 	lwp_stat_update(LWP_STAT_MSGRCV, 1);
-	releasef(sock);
 
 	free_controllen = msg->msg_controllen;
 
@@ -961,6 +953,25 @@ err:
 	return (set_errno(error));
 }
 
+static ssize_t
+recvit(int sock, struct nmsghdr *msg, struct uio *uiop, int flags,
+    socklen_t *namelenp, socklen_t *controllenp, int *flagsp)
+{
+	struct sonode *so;
+	file_t *fp;
+	ssize_t rval;
+	int error;
+
+	if ((so = getsonode(sock, &error, &fp)) == NULL)
+		return (set_errno(error));
+
+	rval = sorecvit(so, fp, msg, uiop, flags, namelenp, controllenp,
+	    flagsp);
+	releasef(sock);
+
+	return (rval);
+}
+
 /*
  * Native system call
  */
@@ -1032,11 +1043,11 @@ recvfrom(int sock, void *buffer, size_t len, int flags, struct sockaddr *name,
 }
 
 /*
- * Uses the MSG_XPG4_2 flag to determine if the caller is using
- * struct omsghdr or struct nmsghdr.
+ * Receive into a user msghdr on a held socket.  Uses the MSG_XPG4_2 flag
+ * to determine if the caller is using struct omsghdr or struct nmsghdr.
  */
-ssize_t
-recvmsg(int sock, struct nmsghdr *msg, int flags)
+static ssize_t
+recvmsg_so(struct sonode *so, file_t *fp, struct nmsghdr *msg, int flags)
 {
 	STRUCT_DECL(nmsghdr, u_lmsg);
 	STRUCT_HANDLE(nmsghdr, umsgptr);
@@ -1050,9 +1061,6 @@ recvmsg(int sock, struct nmsghdr *msg, int flags)
 	int *flagsp;
 	model_t	model;
 
-	dprint(1, ("recvmsg(%d, %p, %d)\n",
-	    sock, (void *)msg, flags));
-
 	model = get_udatamodel();
 	STRUCT_INIT(u_lmsg, model);
 	STRUCT_SET_HANDLE(umsgptr, model, msg);
@@ -1178,7 +1186,7 @@ recvmsg(int sock, struct nmsghdr *msg, int flags)
 		return (set_errno(EFAULT));
 	}
 
-	rval = recvit(sock, &lmsg, &auio, flags,
+	rval = sorecvit(so, fp, &lmsg, &auio, flags,
 	    STRUCT_FADDR(umsgptr, msg_namelen),
 	    STRUCT_FADDR(umsgptr, msg_controllen), flagsp);
 
@@ -1188,14 +1196,33 @@ recvmsg(int sock, struct nmsghdr *msg, int flags)
 	return (rval);
 }
 
+ssize_t
+recvmsg(int sock, struct nmsghdr *msg, int flags)
+{
+	struct sonode *so;
+	file_t *fp;
+	ssize_t rval;
+	int error;
+
+	dprint(1, ("recvmsg(%d, %p, %d)\n",
+	    sock, (void *)msg, flags));
+
+	if ((so = getsonode(sock, &error, &fp)) == NULL)
+		return (set_errno(error));
+
+	rval = recvmsg_so(so, fp, msg, flags);
+	releasef(sock);
+
+	return (rval);
+}
+
 /*
- * Common send function.
+ * Common send function, called with a hold on the socket's file.
  */
 static ssize_t
-sendit(int sock, struct nmsghdr *msg, struct uio *uiop, int flags)
+sosendit(struct sonode *so, file_t *fp, struct nmsghdr *msg, struct uio *uiop,
+    int flags)
 {
-	struct sonode *so;
-	file_t *fp;
 	void *name;
 	socklen_t namelen;
 	void *control;
@@ -1203,9 +1230,6 @@ sendit(int sock, struct nmsghdr *msg, struct uio *uiop, int flags)
 	ssize_t len;
 	int error;
 
-	if ((so = getsonode(sock, &error, &fp)) == NULL)
-		return (set_errno(error));
-
 	uiop->uio_fmode = fp->f_flag;
 
 	if (so->so_family == AF_UNIX)
@@ -1266,15 +1290,29 @@ done2:
 	if (name != NULL)
 		kmem_free(name, namelen);
 done3:
-	if (error != 0) {
-		releasef(sock);
+	if (error != 0)
 		return (set_errno(error));
-	}
 	lwp_stat_update(LWP_STAT_MSGSND, 1);
-	releasef(sock);
 	return (len - uiop->uio_resid);
 }
 
+static ssize_t
+sendit(int sock, struct nmsghdr *msg, struct uio *uiop, int flags)
+{
+	struct sonode *so;
+	file_t *fp;
+	ssize_t rval;
+	int error;
+
+	if ((so = getsonode(sock, &error, &fp)) == NULL)
+		return (set_errno(error));
+
+	rval = sosendit(so, fp, msg, uiop, flags);
+	releasef(sock);
+
+	return (rval);
+}
+
 /*
  * Native system call
  */
@@ -1314,11 +1352,11 @@ send(int sock, void *buffer, size_t len, int flags)
 }
 
 /*
- * Uses the MSG_XPG4_2 flag to determine if the caller is using
- * struct omsghdr or struct nmsghdr.
+ * Send from a user msghdr on a held socket.  Uses the MSG_XPG4_2 flag to
+ * determine if the caller is using struct omsghdr or struct nmsghdr.
  */
-ssize_t
-sendmsg(int sock, struct nmsghdr *msg, int flags)
+static ssize_t
+sendmsg_so(struct sonode *so, file_t *fp, struct nmsghdr *msg, int flags)
 {
 	struct nmsghdr lmsg;
 	STRUCT_DECL(nmsghdr, u_lmsg);
@@ -1330,8 +1368,6 @@ sendmsg(int sock, struct nmsghdr *msg, int flags)
 	int i;
 	model_t	model;
 
-	dprint(1, ("sendmsg(%d, %p, %d)\n", sock, (void *)msg, flags));
-
 	model = get_udatamodel();
 	STRUCT_INIT(u_lmsg, model);
 
@@ -1457,7 +1493,7 @@ sendmsg(int sock, struct nmsghdr *msg, int flags)
 	auio.uio_segflg = UIO_USERSPACE;
 	auio.uio_limit = 0;
 
-	rval = sendit(sock, &lmsg, &auio, flags);
+	rval = sosendit(so, fp, &lmsg, &auio, flags);
 
 	if (iovsize != 0)
 		kmem_free(aiov, iovsize);
@@ -1465,6 +1501,193 @@ sendmsg(int sock, struct nmsghdr *msg, int flags)
 	return (rval);
 }
 
+ssize_t
+sendmsg(int sock, struct nmsghdr *msg, int flags)
+{
+	struct sonode *so;
+	file_t *fp;
+	ssize_t rval;
+	int error;
+
+	dprint(1, ("sendmsg(%d, %p, %d)\n", sock, (void *)msg, flags));
+
+	if ((so = getsonode(sock, &error, &fp)) == NULL)
+		return (set_errno(error));
+
+	rval = sendmsg_so(so, fp, msg, flags);
+	releasef(sock);
+
+	return (rval);
+}
+
+/*
+ * Return the offset of msg_len in an element of a recvmmsg() or sendmmsg()
+ * vector, and the size of each element, according to the data model and
+ * whether the caller is using struct omsghdr or struct nmsghdr.
+ */
+static size_t
+mmsghdr_len_offset(model_t model, int flags, size_t *stridep)
+{
+#ifdef _SYSCALL32_IMPL
+	if (model == DATAMODEL_ILP32) {
+		if (flags & MSG_XPG4_2) {
+			*stridep = sizeof (struct mmsghdr32);
+			return (offsetof(struct mmsghdr32, msg_len));
+		}
+		*stridep = sizeof (struct ommsghdr32);
+		return (offsetof(struct ommsghdr32, msg_len));
+	}
+#endif /* _SYSCALL32_IMPL */
+	if (flags & MSG_XPG4_2) {
+		*stridep = sizeof (struct mmsghdr);
+		return (offsetof(struct mmsghdr, msg_len));
+	}
+	*stridep = sizeof (struct ommsghdr);
+	return (offsetof(struct ommsghdr, msg_len));
+}
+
+/*
+ * Batched datagram receive.  The socket is held once for the whole vector
+ * and each element is received exactly as recvmsg() would receive it.  As
+ * on Linux, the call blocks until vlen messages have arrived unless
+ * MSG_WAITFORONE is given, in which case only the first receive may block,
+ * and the timeout is only checked after each message.  If any message was
+ * received, the count is returned and a later error is dropped; the error
+ * will be seen again by the next call.
+ *
+ * vlen is capped at IOV_MAX so that a single call cannot monopolize the
+ * thread in the kernel; callers must be prepared for a short count anyway.
+ */
+int
+recvmmsg(int sock, struct mmsghdr *msgvec, uint_t vlen, int flags,
+    timespec_t *timeout)
+{
+	struct sonode *so;
+	file_t *fp;
+	model_t model = get_udatamodel();
+	hrtime_t deadline = 0;
+	size_t stride, lenoff;
+	boolean_t waitforone;
+	ssize_t rval = 0;
+	uint_t rcvd = 0;
+	int error;
+
+	dprint(1, ("recvmmsg(%d, %p, %u, %d, %p)\n",
+	    sock, (void *)msgvec, vlen, flags, (void *)timeout));
+
+	if (timeout != NULL) {
+		timespec_t ts;
+		hrtime_t now = gethrtime();
+
+		if (model == DATAMODEL_NATIVE) {
+			if (copyin(timeout, &ts, sizeof (ts)))
+				return (set_errno(EFAULT));
+		}
+#ifdef _SYSCALL32_IMPL
+		else {
+			timespec32_t ts32;
+
+			if (copyin(timeout, &ts32, sizeof (ts32)))
+				return (set_errno(EFAULT));
+			TIMESPEC32_TO_TIMESPEC(&ts, &ts32);
+		}
+#endif /* _SYSCALL32_IMPL */
+		if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= NANOSEC ||
+		    ts.tv_sec >= HRTIME_MAX / NANOSEC)
+			return (set_errno(EINVAL));
+		deadline = ts2hrt(&ts);
+		deadline = deadline > HRTIME_MAX - now ?
+		    HRTIME_MAX : now + deadline;
+	}
+
+	if (vlen > IOV_MAX)
+		vlen = IOV_MAX;
+
+	waitforone = (flags & MSG_WAITFORONE) != 0;
+	flags &= ~MSG_WAITFORONE;
+	lenoff = mmsghdr_len_offset(model, flags, &stride);
+
+	if ((so = getsonode(sock, &error, &fp)) == NULL)
+		return (set_errno(error));
+
+	while (rcvd < vlen) {
+		caddr_t hdr = (caddr_t)msgvec + rcvd * stride;
+		uint_t len;
+
+		rval = recvmsg_so(so, fp, (struct nmsghdr *)hdr, flags);
+		if (rval < 0)
+			break;
+		len = (uint_t)rval;
+		if (copyout(&len, hdr + lenoff, sizeof (len))) {
+			rval = set_errno(EFAULT);
+			break;
+		}
+		rcvd++;
+
+		if (waitforone)
+			flags |= MSG_DONTWAIT;
+		if (timeout != NULL && gethrtime() >= deadline)
+			break;
+	}
+	releasef(sock);
+
+	if (rcvd > 0) {
+		ttolwp(curthread)->lwp_errno = 0;
+		return (rcvd);
+	}
+
+	return ((int)rval);
+}
+
+/*
+ * Batched datagram send, the counterpart of recvmmsg().  Sending stops at
+ * the first message that fails.
+ */
+int
+sendmmsg(int sock, struct mmsghdr *msgvec, uint_t vlen, int flags)
+{
+	struct sonode *so;
+	file_t *fp;
+	size_t stride, lenoff;
+	ssize_t rval = 0;
+	uint_t sent = 0;
+	int error;
+
+	dprint(1, ("sendmmsg(%d, %p, %u, %d)\n",
+	    sock, (void *)msgvec, vlen, flags));
+
+	if (vlen > IOV_MAX)
+		vlen = IOV_MAX;
+
+	lenoff = mmsghdr_len_offset(get_udatamodel(), flags, &stride);
+
+	if ((so = getsonode(sock, &error, &fp)) == NULL)
+		return (set_errno(error));
+
+	while (sent < vlen) {
+		caddr_t hdr = (caddr_t)msgvec + sent * stride;
+		uint_t len;
+
+		rval = sendmsg_so(so, fp, (struct nmsghdr *)hdr, flags);
+		if (rval < 0)
+			break;
+		len = (uint_t)rval;
+		if (copyout(&len, hdr + lenoff, sizeof (len))) {
+			rval = set_errno(EFAULT);
+			break;
+		}
+		sent++;
+	}
+	releasef(sock);
+
+	if (sent > 0) {
+		ttolwp(curthread)->lwp_errno = 0;
+		return (sent);
+	}
+
+	return ((int)rval);
+}
+
 ssize_t
 sendto(int sock, void *buffer, size_t len, int flags,
     struct sockaddr *name, socklen_t namelen)
@@ -2483,6 +2706,22 @@ typedef struct {
 	vnode_t		*snfi_vp;
 } snf_smap_desbinfo;
 
+typedef struct {
+	xuio_t		snfz_xuio;
+	unsigned int	snfz_ref;
+	frtn_t		snfz_frtn;
+	vnode_t		*snfz_vp;
+} snf_zcbuf_desbinfo;
+
+/*
+ * File systems that implement VOP_REQZCBUF (ZFS) can loan their own
+ * buffers out for a read, which saves staging the data through the page
+ * cache before handing it to the transport.  snf_zcbuf_maxsize bounds how
+ * much is loaned out per mblk chain.
+ */
+int snf_zcbuf_enable = 1;
+size_t snf_zcbuf_maxsize = 1024 * 1024;
+
 /*
  * The callback function used for vpm mapped mblks called when the last ref of
  * the mblk is dropped which normally occurs when TCP receives the ack. But it
@@ -2527,9 +2766,113 @@ snf_smap_desbfree(snf_smap_desbinfo *snfi)
 }
 
 /*
- * Use segmap or vpm instead of bcopy to send down a desballoca'ed, mblk.
- * When segmap is used, the mblk contains a segmap slot of no more
- * than MAXBSIZE.
+ * The callback function used for mblks built on loaned file system buffers.
+ * The buffers go back to the file system once every mblk referring to them
+ * has been freed.
+ */
+void
+snf_zcbuf_desbfree(snf_zcbuf_desbinfo *snfz)
+{
+	ASSERT(snfz->snfz_ref != 0);
+	if (atomic_dec_32_nv(&snfz->snfz_ref) == 0) {
+		(void) VOP_RETZCBUF(snfz->snfz_vp, &snfz->snfz_xuio, kcred,
+		    NULL);
+		VN_RELE(snfz->snfz_vp);
+		kmem_free(snfz, sizeof (snf_zcbuf_desbinfo));
+	}
+}
+
+/*
+ * Read up to size bytes at fileoff into buffers loaned by the file system
+ * and return them as a chain of esballoca'ed mblks, with the number of
+ * bytes in *chain_size.  The loaned buffers belong to us until they are
+ * returned, so later writes to the file cannot change data which is still
+ * queued in the transport.
+ *
+ * NULL is returned when the file system will not loan buffers for this
+ * range (e.g. the file is mapped or smaller than a block), and the caller
+ * falls back to mapping the file's pages.
+ */
+static mblk_t *
+snf_zcbuf(vnode_t *fvp, u_offset_t fileoff, u_offset_t size, int *chain_size)
+{
+	snf_zcbuf_desbinfo *snfz;
+	xuio_t *xuio;
+	uio_t *uio;
+	mblk_t *mp = NULL;
+	mblk_t *nmp;
+	ssize_t nread;
+	size_t mblk_size;
+	int i;
+
+	snfz = kmem_zalloc(sizeof (snf_zcbuf_desbinfo), KM_SLEEP);
+	xuio = &snfz->snfz_xuio;
+	xuio->xu_type = UIOTYPE_ZEROCOPY;
+	uio = &xuio->xu_uio;
+	uio->uio_segflg = UIO_SYSSPACE;
+	uio->uio_loffset = fileoff;
+	uio->uio_resid = (ssize_t)MIN(size, snf_zcbuf_maxsize);
+	nread = uio->uio_resid;
+
+	if (VOP_REQZCBUF(fvp, UIO_READ, xuio, CRED(), NULL) != 0) {
+		kmem_free(snfz, sizeof (snf_zcbuf_desbinfo));
+		return (NULL);
+	}
+
+	/*
+	 * If the file picked up cached pages while we read, the data was
+	 * copied into the buffers rather than loaned; the page path will do
+	 * at least as well in that case.
+	 */
+	if (VOP_READ(fvp, uio, 0, CRED(), NULL) != 0 ||
+	    uio->uio_resid == nread || vn_has_cached_data(fvp))
+		goto giveback;
+	nread -= uio->uio_resid;
+
+	snfz->snfz_frtn.free_func = snf_zcbuf_desbfree;
+	snfz->snfz_frtn.free_arg = (caddr_t)snfz;
+
+	*chain_size = 0;
+	for (i = 0; i < uio->uio_iovcnt && *chain_size < nread; i++) {
+		mblk_size = MIN(uio->uio_iov[i].iov_len, nread - *chain_size);
+		if (mblk_size == 0)
+			continue;
+		nmp = esballoca((uchar_t *)uio->uio_iov[i].iov_base,
+		    mblk_size, BPRI_HI, &snfz->snfz_frtn);
+		/*
+		 * Send what we have so far if an mblk can't be allocated;
+		 * the caller picks up the rest of the range on its next pass.
+		 */
+		if (nmp == NULL)
+			break;
+		nmp->b_wptr += mblk_size;
+		*chain_size += mblk_size;
+		snfz->snfz_ref++;
+		if (mp != NULL)
+			linkb(mp, nmp);
+		else
+			mp = nmp;
+	}
+	if (mp == NULL)
+		goto giveback;
+
+	VN_HOLD(fvp);
+	snfz->snfz_vp = fvp;
+	return (mp);
+
+giveback:
+	/* uio_iovcnt is still zero if the file system set up no buffers. */
+	if (uio->uio_iovcnt != 0)
+		(void) VOP_RETZCBUF(fvp, xuio, CRED(), NULL);
+	kmem_free(snfz, sizeof (snf_zcbuf_desbinfo));
+	return (NULL);
+}
+
+/*
+ * Use loaned file system buffers, segmap or vpm instead of bcopy to send
+ * down a desballoca'ed, mblk.  Loaned buffers are tried first (see
+ * snf_zcbuf()).  When segmap is used, the mblk contains a segmap slot of
+ * no more than MAXBSIZE.
  *
  * With vpm, a maximum of SNF_MAXVMAPS page-sized mappings can be obtained
  * in each iteration and sent by socket_sendmblk until an error occurs or
@@ -2573,7 +2916,11 @@ snf_segmap(file_t *fp, vnode_t *fvp, u_offset_t fileoff, u_offset_t total_size,
 			break;
 		}
 
-		if (vpm_enable) {
+		if (snf_zcbuf_enable && (mp = snf_zcbuf(fvp, fileoff,
+		    total_size, &chain_size)) != NULL) {
+			fileoff += chain_size;
+			total_size -= chain_size;
+		} else if (vpm_enable) {
 			snf_vmap_desbinfo *snfv;
 			mblk_t *nmp;
 			int mblk_size;
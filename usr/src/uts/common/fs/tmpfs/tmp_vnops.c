@@ -452,8 +452,7 @@ rdtmp(
 	struct uio *uio,
 	struct caller_context *ct)
 {
-	ulong_t pageoffset;	/* offset in tmpfs file (uio_offset) */
-	ulong_t segmap_offset;	/* pagesize byte offset into segmap */
+	ulong_t mapon;		/* byte offset into the MAXBSIZE window */
 	caddr_t base;		/* base of segmap */
 	ssize_t bytes;		/* bytes to uiomove */
 	struct vnode *vp;
@@ -505,9 +504,15 @@ rdtmp(
 		long diff;
 		long offset;
 
+		/*
+		 * Copy up to a whole MAXBSIZE window per pass, as rdip()
+		 * does, so that a large read takes the contents lock and
+		 * a kernel mapping once per window rather than once per
+		 * page.
+		 */
 		offset = uio->uio_offset;
-		pageoffset = offset & PAGEOFFSET;
-		bytes = MIN(PAGESIZE - pageoffset, uio->uio_resid);
+		mapon = offset & MAXBOFFSET;
+		bytes = MIN(MAXBSIZE - mapon, uio->uio_resid);
 
 		diff = tp->tn_size - offset;
 
@@ -532,24 +537,22 @@ rdtmp(
 			error = vpm_data_copy(vp, offset, bytes, uio, 1, NULL,
 			    0, S_READ);
 		} else {
-			segmap_offset = (offset & PAGEMASK) & MAXBOFFSET;
-			base = segmap_getmapflt(segkmap, vp, offset & MAXBMASK,
-			    bytes, 1, S_READ);
+			base = segmap_getmapflt(segkmap, vp, offset, bytes, 1,
+			    S_READ);
 
-			error = uiomove(base + segmap_offset + pageoffset,
-			    (long)bytes, UIO_READ, uio);
+			error = uiomove(base + mapon, (long)bytes, UIO_READ,
+			    uio);
 		}
 
 		if (error) {
 			if (vpm_enable) {
-				(void) vpm_sync_pages(vp, offset, PAGESIZE, 0);
+				(void) vpm_sync_pages(vp, offset, bytes, 0);
 			} else {
 				(void) segmap_release(segkmap, base, 0);
 			}
 		} else {
 			if (vpm_enable) {
-				error = vpm_sync_pages(vp, offset, PAGESIZE,
-				    0);
+				error = vpm_sync_pages(vp, offset, bytes, 0);
 			} else {
 				error = segmap_release(segkmap, base, 0);
 			}
@@ -3531,6 +3531,7 @@ fop_read(
 		mutex_exit(&zonep->zone_vfs_lock);
 
 		lat = gethrtime() - start;
+		zone_lat_vfs_record(zonep, ZONE_LAT_VFS_READ, lat);
 
 		if (lat >= VOP_LATENCY_10MS) {
 			if (lat < VOP_LATENCY_100MS)
@@ -3599,6 +3600,7 @@ fop_write(
 		mutex_exit(&zonep->zone_vfs_lock);
 
 		lat = gethrtime() - start;
+		zone_lat_vfs_record(zonep, ZONE_LAT_VFS_WRITE, lat);
 
 		if (lat >= VOP_LATENCY_10MS) {
 			if (lat < VOP_LATENCY_100MS)
@@ -3994,6 +3996,9 @@ fop_readdir(
 	if (flags & V_RDDIR_ENTFLAGS &&
 	    vfs_has_feature(vp->v_vfsp, VFSFT_DIRENTFLAGS) == 0)
 		return (EINVAL);
+	if (flags & V_RDDIR_DTYPE &&
+	    vfs_has_feature(vp->v_vfsp, VFSFT_DIRENTTYPE) == 0)
+		return (EINVAL);
 
 	VOPXID_MAP_CR(vp, cr);
 
@@ -4064,12 +4069,22 @@ fop_fsync(
 	cred_t *cr,
 	caller_context_t *ct)
 {
+	hrtime_t start = 0;
 	int	err;
 
+	if (vp->v_vfsp != NULL && (vp->v_vfsp->vfs_flag & VFS_STATS))
+		start = gethrtime();
+
 	VOPXID_MAP_CR(vp, cr);
 
 	err = (*(vp)->v_op->vop_fsync)(vp, syncflag, cr, ct);
 	VOPSTATS_UPDATE(vp, fsync);
+
+	if (start != 0) {
+		zone_lat_vfs_record(curzone, ZONE_LAT_VFS_FSYNC,
+		    gethrtime() - start);
+	}
+
 	return (err);
 }
 
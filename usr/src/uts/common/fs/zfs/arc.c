@@ -20,7 +20,7 @@
  */
 /*
  * Copyright (c) 2005, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright (c) 2019, Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2011, 2018 by Delphix. All rights reserved.
  * Copyright (c) 2014 by Saso Kiselkov. All rights reserved.
  * Copyright 2017 Nexenta Systems, Inc.  All rights reserved.
@@ -332,6 +332,24 @@ uint_t arc_reduce_dnlc_percent = 3;
  */
 int zfs_arc_evict_batch_limit = 10;
 
+/*
+ * Number of threads used by arc_evict_state() to evict from the sublists
+ * of an arc state in parallel when reducing the size of the ARC. With a
+ * single thread all sublists are evicted from by the arc_adjust_zthr
+ * itself, which can become the bottleneck of memory reclaim on systems
+ * with many CPUs. The default of 0 picks one thread per 8 CPUs.
+ */
+int zfs_arc_evict_threads = 0;
+static taskq_t *arc_evict_taskq;
+
+/*
+ * Insert headers into the sublist belonging to the CPU the insertion is
+ * made on, rather than the one selected by the header's hash. This keeps
+ * CPUs which are concurrently moving buffers between the arc states from
+ * contending on the same sublist locks.
+ */
+boolean_t zfs_arc_sublist_cpu_affinity = B_TRUE;
+
 /* number of seconds before growing cache again */
 int arc_grow_retry = 60;
 
@@ -709,6 +727,21 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_l2_psize;
 	/* Not updated directly; only synced in arc_kstat_update. */
 	kstat_named_t arcstat_l2_hdr_size;
+	/*
+	 * Persistent L2ARC: outcome of device rebuilds, the number of
+	 * buffers restored (or skipped because they were already cached)
+	 * and the number of log blocks read and written.
+	 */
+	kstat_named_t arcstat_l2_rebuild_success;
+	kstat_named_t arcstat_l2_rebuild_unsupported;
+	kstat_named_t arcstat_l2_rebuild_io_errors;
+	kstat_named_t arcstat_l2_rebuild_dh_errors;
+	kstat_named_t arcstat_l2_rebuild_cksum_lb_errors;
+	kstat_named_t arcstat_l2_rebuild_lowmem;
+	kstat_named_t arcstat_l2_rebuild_bufs;
+	kstat_named_t arcstat_l2_rebuild_bufs_precached;
+	kstat_named_t arcstat_l2_rebuild_log_blks;
+	kstat_named_t arcstat_l2_log_blk_writes;
 	kstat_named_t arcstat_memory_throttle_count;
 	/* Not updated directly; only synced in arc_kstat_update. */
 	kstat_named_t arcstat_meta_used;
@@ -796,6 +829,16 @@ static arc_stats_t arc_stats = {
 	{ "l2_size",			KSTAT_DATA_UINT64 },
 	{ "l2_asize",			KSTAT_DATA_UINT64 },
 	{ "l2_hdr_size",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_success",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_unsupported",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_io_errors",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_dh_errors",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_cksum_lb_errors",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_lowmem",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_bufs",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_bufs_precached",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_log_blks",	KSTAT_DATA_UINT64 },
+	{ "l2_log_blk_writes",		KSTAT_DATA_UINT64 },
 	{ "memory_throttle_count",	KSTAT_DATA_UINT64 },
 	{ "arc_meta_used",		KSTAT_DATA_UINT64 },
 	{ "arc_meta_limit",		KSTAT_DATA_UINT64 },
@@ -970,6 +1013,8 @@ typedef struct l1arc_buf_hdr {
 	/* for waiting on writes to complete */
 	kcondvar_t		b_cv;
 	uint8_t			b_byteswap;
+	/* index of the sublist of b_state holding b_arc_node */
+	uint16_t		b_arc_sublist;
 
 	/* protected by arc state mutex */
 	arc_state_t		*b_state;
@@ -1144,7 +1189,7 @@ struct ht_lock {
 #endif
 };
 
-#define	BUF_LOCKS 256
+#define	BUF_LOCKS 2048
 typedef struct buf_hash_table {
 	uint64_t ht_mask;
 	arc_buf_hdr_t **ht_table;
@@ -1190,6 +1235,125 @@ boolean_t l2arc_noprefetch = B_TRUE;		/* don't cache prefetch bufs */
 boolean_t l2arc_feed_again = B_TRUE;		/* turbo warmup */
 boolean_t l2arc_norw = B_TRUE;			/* no reads during writes */
 
+/*
+ * Persistent L2ARC Tunables
+ *
+ * l2arc_rebuild_enabled controls whether the contents of a cache device
+ * are reconstructed from its on-device log when the device is added to
+ * the ARC (typically on pool import).  Devices smaller than
+ * l2arc_rebuild_blocks_min_l2size are not worth the metadata overhead and
+ * are neither logged nor rebuilt.
+ */
+boolean_t l2arc_rebuild_enabled = B_TRUE;
+uint64_t l2arc_rebuild_blocks_min_l2size = 1024 * 1024 * 1024;
+
+/*
+ * Persistent L2ARC
+ *
+ * To avoid having to re-warm the L2ARC every time a pool is imported, the
+ * feed thread interleaves small metadata "log blocks" with the buffers it
+ * writes to a cache device.  Each log block describes up to
+ * L2ARC_LOG_BLK_ENTRIES buffers (DVA, birth txg, sizes, compression and
+ * device address) and links back to the log block written before it.  A
+ * fixed device header, stored immediately after the front vdev labels,
+ * points at the most recently written log block and records the region of
+ * the device that is about to be overwritten:
+ *
+ *	+--------+-----------+------+------+------+-----+------+------+-----
+ *	| labels | dev hdr   | data | data | lb 1 | ... | data | lb n | ...
+ *	+--------+-----------+------+------+------+-----+------+------+-----
+ *	                                       ^                 |
+ *	                                       +--- lb_prev -----+
+ *
+ * When the device is added to the ARC, a rebuild thread walks the log
+ * block chain from its newest entry backwards and re-creates L2-only ARC
+ * headers for every buffer it finds, until it reaches a log block that
+ * lies in the region being overwritten (dh_hand to dh_evict), fails its
+ * checksum, or would take the walk around the device a second time.  The
+ * device is not fed while it is being rebuilt.
+ *
+ * Nothing here is required for correctness: every L2ARC read is still
+ * verified against the block pointer checksum, so a stale or torn log can
+ * at worst cause L2ARC misses.
+ */
+#define	L2ARC_DEV_HDR_MAGIC	0x5a46534341434845ULL	/* ASCII: ZFSCACHE */
+#define	L2ARC_LOG_BLK_MAGIC	0x4c4f47424c4b4844ULL	/* ASCII: LOGBLKHD */
+#define	L2ARC_PERSIST_VERSION	1ULL
+
+#define	L2ARC_DEV_HDR_SIZE	512
+#define	L2ARC_LOG_BLK_SIZE	(128 * 512)
+#define	L2ARC_LOG_BLK_ENTRIES	1022
+
+/* dh_flags */
+#define	L2ARC_DEV_HDR_FIRST	(1ULL << 0)	/* still on first sweep */
+
+/*
+ * Layout of le_prop, which records the ARC header properties needed to
+ * re-create an L2-only header for a buffer.
+ */
+#define	L2BLK_GET_LSIZE(field)	\
+	BF64_GET_SB((field), 0, SPA_LSIZEBITS, SPA_MINBLOCKSHIFT, 1)
+#define	L2BLK_SET_LSIZE(field, x)	\
+	BF64_SET_SB((field), 0, SPA_LSIZEBITS, SPA_MINBLOCKSHIFT, 1, x)
+#define	L2BLK_GET_PSIZE(field)	\
+	BF64_GET_SB((field), 16, SPA_PSIZEBITS, SPA_MINBLOCKSHIFT, 1)
+#define	L2BLK_SET_PSIZE(field, x)	\
+	BF64_SET_SB((field), 16, SPA_PSIZEBITS, SPA_MINBLOCKSHIFT, 1, x)
+#define	L2BLK_GET_COMPRESS(field)	BF64_GET((field), 32, SPA_COMPRESSBITS)
+#define	L2BLK_SET_COMPRESS(field, x)	\
+	BF64_SET((field), 32, SPA_COMPRESSBITS, x)
+#define	L2BLK_GET_TYPE(field)		BF64_GET((field), 48, 8)
+#define	L2BLK_SET_TYPE(field, x)	BF64_SET((field), 48, 8, x)
+#define	L2BLK_GET_PROTECTED(field)	BF64_GET((field), 56, 1)
+#define	L2BLK_SET_PROTECTED(field, x)	BF64_SET((field), 56, 1, x)
+
+/*
+ * Pointer to a log block on a cache device.  The checksum covers the
+ * l2arc_log_blk_phys_t being pointed to.
+ */
+typedef struct l2arc_log_blkptr {
+	uint64_t	lbp_daddr;		/* device address of log block */
+	uint64_t	lbp_payload_start;	/* first data address described */
+	uint64_t	lbp_asize;		/* allocated size of log block */
+	uint64_t	lbp_nentries;		/* valid entries in log block */
+	zio_cksum_t	lbp_cksum;		/* fletcher4 of log block */
+} l2arc_log_blkptr_t;
+
+typedef struct l2arc_dev_hdr_phys {
+	uint64_t	dh_magic;		/* L2ARC_DEV_HDR_MAGIC */
+	uint64_t	dh_version;		/* L2ARC_PERSIST_VERSION */
+	uint64_t	dh_spa_guid;		/* owning pool */
+	uint64_t	dh_vdev_guid;		/* this cache device */
+	uint64_t	dh_log_entries;		/* L2ARC_LOG_BLK_ENTRIES */
+	uint64_t	dh_flags;		/* L2ARC_DEV_HDR_* */
+	uint64_t	dh_start;		/* first usable data address */
+	uint64_t	dh_end;			/* last usable data address */
+	uint64_t	dh_hand;		/* start of region being evicted */
+	uint64_t	dh_evict;		/* end of region being evicted */
+	uint64_t	dh_lb_count;		/* log blocks written */
+	l2arc_log_blkptr_t dh_start_lbp;	/* most recent log block */
+	uint64_t	dh_pad[41];
+	zio_cksum_t	dh_self_cksum;		/* fletcher4 of the above */
+} l2arc_dev_hdr_phys_t;
+
+typedef struct l2arc_log_ent_phys {
+	dva_t		le_dva;			/* block identity */
+	uint64_t	le_birth;		/* block identity */
+	uint64_t	le_prop;		/* see L2BLK_* above */
+	uint64_t	le_daddr;		/* device address of buffer */
+	uint64_t	le_pad[3];
+} l2arc_log_ent_phys_t;
+
+typedef struct l2arc_log_blk_phys {
+	uint64_t		lb_magic;	/* L2ARC_LOG_BLK_MAGIC */
+	l2arc_log_blkptr_t	lb_prev;	/* previous log block */
+	uint64_t		lb_pad[7];
+	l2arc_log_ent_phys_t	lb_entries[L2ARC_LOG_BLK_ENTRIES];
+} l2arc_log_blk_phys_t;
+
+CTASSERT(sizeof (l2arc_dev_hdr_phys_t) == L2ARC_DEV_HDR_SIZE);
+CTASSERT(sizeof (l2arc_log_blk_phys_t) == L2ARC_LOG_BLK_SIZE);
+
 /*
  * L2ARC Internals
  */
@@ -1205,6 +1369,17 @@ struct l2arc_dev {
 	list_t			l2ad_buflist;	/* buffer list */
 	list_node_t		l2ad_node;	/* device list node */
 	zfs_refcount_t		l2ad_alloc;	/* allocated bytes */
+	/* persistent L2ARC state, see above */
+	boolean_t		l2ad_persist;	/* write log blocks */
+	uint64_t		l2ad_evict;	/* last evicted address */
+	l2arc_dev_hdr_phys_t	*l2ad_dev_hdr;	/* in-core device header */
+	uint64_t		l2ad_dev_hdr_asize; /* dev hdr size on vdev */
+	l2arc_log_blk_phys_t	*l2ad_log_blk;	/* log block being filled */
+	uint64_t		l2ad_log_ent_idx; /* next free log entry */
+	uint64_t		l2ad_log_payload_start; /* first logged daddr */
+	boolean_t		l2ad_rebuild;	/* rebuild pending or active */
+	boolean_t		l2ad_rebuild_cancel; /* stop rebuilding */
+	kcondvar_t		l2ad_rebuild_cv; /* rebuild thread exit */
 };
 
 static list_t L2ARC_dev_list;			/* device list */
@@ -1241,6 +1416,11 @@ static kmutex_t l2arc_feed_thr_lock;
 static kcondvar_t l2arc_feed_thr_cv;
 static uint8_t l2arc_thread_exit;
 
+static boolean_t l2arc_log_blk_insert(l2arc_dev_t *, const arc_buf_hdr_t *);
+static uint64_t l2arc_log_blk_commit(l2arc_dev_t *, zio_t *);
+static void l2arc_dev_hdr_update(l2arc_dev_t *);
+static void l2arc_dev_rebuild_thread(void *);
+
 static abd_t *arc_get_data_abd(arc_buf_hdr_t *, uint64_t, void *);
 typedef enum arc_fill_flags {
 	ARC_FILL_LOCKED		= 1 << 0, /* hdr lock is held */
@@ -1258,6 +1438,7 @@ static void arc_free_data_impl(arc_buf_hdr_t *hdr, uint64_t size, void *tag);
 static void arc_hdr_free_pabd(arc_buf_hdr_t *, boolean_t);
 static void arc_hdr_alloc_pabd(arc_buf_hdr_t *, boolean_t);
 static void arc_access(arc_buf_hdr_t *, kmutex_t *);
+static void arc_state_multilist_insert(multilist_t *, arc_buf_hdr_t *);
 static boolean_t arc_is_overflowing();
 static void arc_buf_watch(arc_buf_t *);
 
@@ -1320,6 +1501,19 @@ buf_hash_find(uint64_t spa, const blkptr_t *bp, kmutex_t **lockp)
 	kmutex_t *hash_lock = BUF_HASH_LOCK(idx);
 	arc_buf_hdr_t *hdr;
 
+	/*
+	 * Most lookups which miss hit an empty bucket. Detect this case
+	 * without acquiring the hash lock; it's safe since we don't touch
+	 * any header. A header inserted concurrently is treated just as if
+	 * it had been inserted right after we dropped the lock, which the
+	 * callers have to handle anyway (see buf_hash_insert()).
+	 */
+	if (*(arc_buf_hdr_t * volatile *)&buf_hash_table.ht_table[idx] ==
+	    NULL) {
+		*lockp = NULL;
+		return (NULL);
+	}
+
 	mutex_enter(hash_lock);
 	for (hdr = buf_hash_table.ht_table[idx]; hdr != NULL;
 	    hdr = hdr->b_hash_next) {
@@ -1621,6 +1815,18 @@ arc_buf_lsize(arc_buf_t *buf)
 	return (HDR_GET_LSIZE(buf->b_hdr));
 }
 
+/*
+ * Returns B_TRUE if the buffer's data has been found in the ARC more than
+ * once recently, i.e. its header has been promoted to the MFU state.  This
+ * is read without the hash lock, so it is only a hint.
+ */
+boolean_t
+arc_buf_is_mfu(arc_buf_t *buf)
+{
+	ASSERT(HDR_HAS_L1HDR(buf->b_hdr));
+	return (buf->b_hdr->b_l1hdr.b_state == arc_mfu);
+}
+
 /*
  * This function will return B_TRUE if the buffer is encrypted in memory.
  * This buffer can be decrypted by calling arc_untransform().
@@ -2677,7 +2883,8 @@ remove_reference(arc_buf_hdr_t *hdr, kmutex_t *hash_lock, void *tag)
 	 */
 	if (((cnt = zfs_refcount_remove(&hdr->b_l1hdr.b_refcnt, tag)) == 0) &&
 	    (state != arc_anon)) {
-		multilist_insert(state->arcs_list[arc_buf_type(hdr)], hdr);
+		arc_state_multilist_insert(state->arcs_list[arc_buf_type(hdr)],
+		    hdr);
 		ASSERT3U(hdr->b_l1hdr.b_bufcnt, >, 0);
 		arc_evictable_space_increment(hdr, state);
 	}
@@ -2750,7 +2957,8 @@ arc_change_state(arc_state_t *new_state, arc_buf_hdr_t *hdr,
 			 * beforehand.
 			 */
 			ASSERT(HDR_HAS_L1HDR(hdr));
-			multilist_insert(new_state->arcs_list[buftype], hdr);
+			arc_state_multilist_insert(
+			    new_state->arcs_list[buftype], hdr);
 
 			if (GHOST_STATE(new_state)) {
 				ASSERT0(bufcnt);
@@ -4295,6 +4503,36 @@ arc_evict_state_impl(multilist_t *ml, int idx, arc_buf_hdr_t *marker,
 	return (bytes_evicted);
 }
 
+typedef struct arc_evict_arg {
+	multilist_t	*eva_ml;
+	int		eva_idx;
+	arc_buf_hdr_t	*eva_marker;
+	uint64_t	eva_spa;
+	uint64_t	eva_bytes;
+	uint64_t	eva_evicted;
+} arc_evict_arg_t;
+
+/*
+ * Evict up to eva_bytes from a single sublist; one of these is dispatched
+ * for each sublist by arc_evict_state() when evicting in parallel.
+ */
+static void
+arc_evict_task(void *arg)
+{
+	arc_evict_arg_t *eva = arg;
+	uint64_t evicted;
+
+	eva->eva_evicted = 0;
+	while (eva->eva_evicted < eva->eva_bytes) {
+		evicted = arc_evict_state_impl(eva->eva_ml, eva->eva_idx,
+		    eva->eva_marker, eva->eva_spa,
+		    eva->eva_bytes - eva->eva_evicted);
+		if (evicted == 0)
+			break;
+		eva->eva_evicted += evicted;
+	}
+}
+
 /*
  * Evict buffers from the given arc state, until we've removed the
  * specified number of bytes. Move the removed buffers to the
@@ -4316,11 +4554,23 @@ arc_evict_state(arc_state_t *state, uint64_t spa, int64_t bytes,
 	multilist_t *ml = state->arcs_list[type];
 	int num_sublists;
 	arc_buf_hdr_t **markers;
+	arc_evict_arg_t *evas = NULL;
 
 	IMPLY(bytes < 0, bytes == ARC_EVICT_ALL);
 
 	num_sublists = multilist_get_num_sublists(ml);
 
+	/*
+	 * Only targeted eviction, which is done by the arc_adjust_zthr, is
+	 * done in parallel; there is no need to hurry arc_flush(). As a
+	 * result arc_evict_taskq only ever has a single dispatcher, which
+	 * is what lets us use taskq_wait() below.
+	 */
+	if (arc_evict_taskq != NULL && bytes != ARC_EVICT_ALL &&
+	    num_sublists > 1) {
+		evas = kmem_zalloc(sizeof (*evas) * num_sublists, KM_SLEEP);
+	}
+
 	/*
 	 * If we've tried to evict from each sublist, made some
 	 * progress, but still have not hit the target number of bytes
@@ -4349,6 +4599,40 @@ arc_evict_state(arc_state_t *state, uint64_t spa, int64_t bytes,
 	 * we're evicting all available buffers.
 	 */
 	while (total_evicted < bytes || bytes == ARC_EVICT_ALL) {
+		if (evas != NULL) {
+			/*
+			 * Evenly divide what is left to evict between the
+			 * sublists, and evict from all of them at once.
+			 */
+			uint64_t share = MAX((bytes - total_evicted) /
+			    num_sublists, SPA_MINBLOCKSIZE);
+			uint64_t scan_evicted = 0;
+
+			for (int i = 0; i < num_sublists; i++) {
+				arc_evict_arg_t *eva = &evas[i];
+
+				eva->eva_ml = ml;
+				eva->eva_idx = i;
+				eva->eva_marker = markers[i];
+				eva->eva_spa = spa;
+				eva->eva_bytes = share;
+				(void) taskq_dispatch(arc_evict_taskq,
+				    arc_evict_task, eva, TQ_SLEEP);
+			}
+			taskq_wait(arc_evict_taskq);
+
+			for (int i = 0; i < num_sublists; i++)
+				scan_evicted += evas[i].eva_evicted;
+			total_evicted += scan_evicted;
+
+			if (scan_evicted == 0) {
+				ASSERT3S(total_evicted, <, bytes);
+				ARCSTAT_BUMP(arcstat_evict_not_enough);
+				break;
+			}
+			continue;
+		}
+
 		/*
 		 * Start eviction using a randomly selected sublist,
 		 * this is to try and evenly balance eviction across all
@@ -4413,6 +4697,8 @@ arc_evict_state(arc_state_t *state, uint64_t spa, int64_t bytes,
 		kmem_cache_free(hdr_full_cache, markers[i]);
 	}
 	kmem_free(markers, sizeof (*markers) * num_sublists);
+	if (evas != NULL)
+		kmem_free(evas, sizeof (*evas) * num_sublists);
 
 	return (total_evicted);
 }
@@ -7202,27 +7488,48 @@ arc_state_multilist_index_func(multilist_t *ml, void *obj)
 {
 	arc_buf_hdr_t *hdr = obj;
 
+	/*
+	 * The sublist index is selected by arc_state_multilist_insert()
+	 * and stored in the header, so that it can be found again on
+	 * removal.
+	 */
+	ASSERT3U(hdr->b_l1hdr.b_arc_sublist, <,
+	    multilist_get_num_sublists(ml));
+	return (hdr->b_l1hdr.b_arc_sublist);
+}
+
+/*
+ * Insert a header into an arc state's multilist. The sublist is either
+ * that of the current CPU (see zfs_arc_sublist_cpu_affinity), or the one
+ * selected by the header's hash.
+ */
+static void
+arc_state_multilist_insert(multilist_t *ml, arc_buf_hdr_t *hdr)
+{
+	unsigned int num_sublists = multilist_get_num_sublists(ml);
+
 	/*
 	 * We rely on b_dva to generate evenly distributed index
 	 * numbers using buf_hash below. So, as an added precaution,
 	 * let's make sure we never add empty buffers to the arc lists.
 	 */
 	ASSERT(!HDR_EMPTY(hdr));
+	ASSERT3U(num_sublists, <=, UINT16_MAX + 1);
 
 	/*
-	 * The assumption here, is the hash value for a given
-	 * arc_buf_hdr_t will remain constant throughout its lifetime
-	 * (i.e. its b_spa, b_dva, and b_birth fields don't change).
-	 * Thus, we don't need to store the header's sublist index
-	 * on insertion, as this index can be recalculated on removal.
-	 *
-	 * Also, the low order bits of the hash value are thought to be
+	 * The low order bits of the hash value are thought to be
 	 * distributed evenly. Otherwise, in the case that the multilist
 	 * has a power of two number of sublists, each sublists' usage
 	 * would not be evenly distributed.
 	 */
-	return (buf_hash(hdr->b_spa, &hdr->b_dva, hdr->b_birth) %
-	    multilist_get_num_sublists(ml));
+	if (zfs_arc_sublist_cpu_affinity) {
+		hdr->b_l1hdr.b_arc_sublist = CPU_SEQID % num_sublists;
+	} else {
+		hdr->b_l1hdr.b_arc_sublist = buf_hash(hdr->b_spa,
+		    &hdr->b_dva, hdr->b_birth) % num_sublists;
+	}
+
+	multilist_insert(ml, hdr);
 }
 
 static void
@@ -7471,6 +7778,14 @@ arc_init(void)
 		kstat_install(arc_ksp);
 	}
 
+	if (zfs_arc_evict_threads == 0)
+		zfs_arc_evict_threads = MAX(1, boot_ncpus / 8);
+	if (zfs_arc_evict_threads > 1) {
+		arc_evict_taskq = taskq_create("arc_evict",
+		    zfs_arc_evict_threads, minclsyspri, zfs_arc_evict_threads,
+		    INT_MAX, TASKQ_PREPOPULATE);
+	}
+
 	arc_adjust_zthr = zthr_create(arc_adjust_cb_check,
 	    arc_adjust_cb, NULL);
 	arc_reap_zthr = zthr_create_timer(arc_reap_cb_check,
@@ -7511,6 +7826,11 @@ arc_fini(void)
 	(void) zthr_cancel(arc_adjust_zthr);
 	zthr_destroy(arc_adjust_zthr);
 
+	if (arc_evict_taskq != NULL) {
+		taskq_destroy(arc_evict_taskq);
+		arc_evict_taskq = NULL;
+	}
+
 	(void) zthr_cancel(arc_reap_zthr);
 	zthr_destroy(arc_reap_zthr);
 
@@ -7775,10 +8095,14 @@ l2arc_dev_get_next(void)
 		else if (next == first)
 			break;
 
-	} while (vdev_is_dead(next->l2ad_vdev));
+	} while (vdev_is_dead(next->l2ad_vdev) || next->l2ad_rebuild);
 
-	/* if we were unable to find any usable vdevs, return NULL */
-	if (vdev_is_dead(next->l2ad_vdev))
+	/*
+	 * If we were unable to find any usable vdevs, return NULL.  Devices
+	 * whose contents are still being rebuilt are not fed until the
+	 * rebuild completes.
+	 */
+	if (vdev_is_dead(next->l2ad_vdev) || next->l2ad_rebuild)
 		next = NULL;
 
 	l2arc_dev_last = next;
@@ -8236,6 +8560,17 @@ l2arc_evict(l2arc_dev_t *dev, uint64_t distance, boolean_t all)
 	DTRACE_PROBE4(l2arc__evict, l2arc_dev_t *, dev, list_t *, buflist,
 	    uint64_t, taddr, boolean_t, all);
 
+	/*
+	 * Record the region we are about to overwrite in the device header
+	 * before any of it is written over, so that a rebuild never trusts
+	 * a log block describing data in that region.
+	 */
+	if (!all && dev->l2ad_persist) {
+		dev->l2ad_evict = taddr;
+		dev->l2ad_dev_hdr->dh_hand = dev->l2ad_hand;
+		l2arc_dev_hdr_update(dev);
+	}
+
 top:
 	mutex_enter(&dev->l2ad_mtx);
 	for (hdr = list_tail(buflist); hdr; hdr = hdr_prev) {
@@ -8444,9 +8779,21 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 	l2arc_write_callback_t *cb;
 	zio_t *pio, *wzio;
 	uint64_t guid = spa_load_guid(spa);
+	uint64_t lb_asize = 0;
+	boolean_t lb_committed = B_FALSE;
 
 	ASSERT3P(dev->l2ad_vdev, !=, NULL);
 
+	/*
+	 * Always leave enough room in this write for a log block, so that
+	 * a full log block can be committed (or a partial one flushed when
+	 * the write hand wraps) without exceeding target_sz.
+	 */
+	if (dev->l2ad_persist) {
+		lb_asize = vdev_psize_to_asize(dev->l2ad_vdev,
+		    sizeof (l2arc_log_blk_phys_t));
+	}
+
 	pio = NULL;
 	write_lsize = write_asize = write_psize = 0;
 	full = B_FALSE;
@@ -8524,7 +8871,7 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 			uint64_t asize = vdev_psize_to_asize(dev->l2ad_vdev,
 			    psize);
 
-			if ((write_asize + asize) > target_sz) {
+			if ((write_asize + asize + lb_asize) > target_sz) {
 				full = B_TRUE;
 				mutex_exit(hash_lock);
 				break;
@@ -8626,6 +8973,16 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 			dev->l2ad_hand += asize;
 			vdev_space_update(dev->l2ad_vdev, asize, 0, 0);
 
+			/*
+			 * Describe the buffer in the current log block and
+			 * write the log block out once it fills up.
+			 */
+			if (dev->l2ad_persist &&
+			    l2arc_log_blk_insert(dev, hdr)) {
+				write_asize += l2arc_log_blk_commit(dev, pio);
+				lb_committed = B_TRUE;
+			}
+
 			mutex_exit(hash_lock);
 
 			(void) zio_nowait(wzio);
@@ -8654,8 +9011,14 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 	/*
 	 * Bump device hand to the device start if it is approaching the end.
 	 * l2arc_evict() will already have evicted ahead for this case.
+	 * A log block may never describe buffers on both sides of the wrap,
+	 * so flush out any partially filled one first.
 	 */
 	if (dev->l2ad_hand >= (dev->l2ad_end - target_sz)) {
+		if (dev->l2ad_persist && dev->l2ad_log_ent_idx > 0) {
+			write_asize += l2arc_log_blk_commit(dev, pio);
+			lb_committed = B_TRUE;
+		}
 		dev->l2ad_hand = dev->l2ad_start;
 		dev->l2ad_first = B_FALSE;
 	}
@@ -8664,9 +9027,149 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 	(void) zio_wait(pio);
 	dev->l2ad_writing = B_FALSE;
 
+	/*
+	 * Only point the device header at new log blocks once they (and the
+	 * buffers they describe) have made it to the device.
+	 */
+	if (lb_committed)
+		l2arc_dev_hdr_update(dev);
+
 	return (write_asize);
 }
 
+/*
+ * Append a log entry describing a buffer that has just been queued for
+ * writing to the L2ARC device.  Returns B_TRUE if the current log block
+ * is now full and must be committed.
+ */
+static boolean_t
+l2arc_log_blk_insert(l2arc_dev_t *dev, const arc_buf_hdr_t *hdr)
+{
+	l2arc_log_blk_phys_t *lb = dev->l2ad_log_blk;
+	l2arc_log_ent_phys_t *le;
+
+	ASSERT(dev->l2ad_persist);
+	ASSERT(HDR_HAS_L2HDR(hdr));
+	ASSERT3U(dev->l2ad_log_ent_idx, <, L2ARC_LOG_BLK_ENTRIES);
+
+	if (dev->l2ad_log_ent_idx == 0)
+		dev->l2ad_log_payload_start = hdr->b_l2hdr.b_daddr;
+
+	le = &lb->lb_entries[dev->l2ad_log_ent_idx++];
+	bzero(le, sizeof (*le));
+	le->le_dva = hdr->b_dva;
+	le->le_birth = hdr->b_birth;
+	le->le_daddr = hdr->b_l2hdr.b_daddr;
+	L2BLK_SET_LSIZE(le->le_prop, HDR_GET_LSIZE(hdr));
+	L2BLK_SET_PSIZE(le->le_prop, HDR_GET_PSIZE(hdr));
+	L2BLK_SET_COMPRESS(le->le_prop, HDR_GET_COMPRESS(hdr));
+	L2BLK_SET_TYPE(le->le_prop, hdr->b_type);
+	L2BLK_SET_PROTECTED(le->le_prop, !!HDR_PROTECTED(hdr));
+
+	return (dev->l2ad_log_ent_idx == L2ARC_LOG_BLK_ENTRIES);
+}
+
+/*
+ * Write out the current (possibly partially filled) log block at the
+ * device write hand as a child of pio, and make it the newest block in
+ * the in-core device header.  The on-disk header is only updated by the
+ * caller once pio has completed.  Returns the allocated size of the log
+ * block on the device.
+ */
+static uint64_t
+l2arc_log_blk_commit(l2arc_dev_t *dev, zio_t *pio)
+{
+	l2arc_log_blk_phys_t *lb = dev->l2ad_log_blk;
+	l2arc_dev_hdr_phys_t *dh = dev->l2ad_dev_hdr;
+	l2arc_log_blkptr_t *lbp = &dh->dh_start_lbp;
+	uint64_t nentries = dev->l2ad_log_ent_idx;
+	uint64_t asize;
+	abd_t *abd;
+	zio_t *wzio;
+
+	ASSERT(dev->l2ad_persist);
+	ASSERT3U(nentries, >, 0);
+
+	asize = vdev_psize_to_asize(dev->l2ad_vdev, sizeof (*lb));
+	ASSERT3U(dev->l2ad_hand + asize, <=, dev->l2ad_end);
+
+	/* Unused entries are zeroed so the checksum is reproducible. */
+	if (nentries < L2ARC_LOG_BLK_ENTRIES) {
+		bzero(&lb->lb_entries[nentries],
+		    (L2ARC_LOG_BLK_ENTRIES - nentries) *
+		    sizeof (l2arc_log_ent_phys_t));
+	}
+	lb->lb_magic = L2ARC_LOG_BLK_MAGIC;
+	lb->lb_prev = *lbp;
+	bzero(lb->lb_pad, sizeof (lb->lb_pad));
+
+	lbp->lbp_daddr = dev->l2ad_hand;
+	lbp->lbp_payload_start = dev->l2ad_log_payload_start;
+	lbp->lbp_asize = asize;
+	lbp->lbp_nentries = nentries;
+	fletcher_4_native(lb, sizeof (*lb), NULL, &lbp->lbp_cksum);
+
+	abd = abd_alloc_for_io(asize, B_TRUE);
+	abd_copy_from_buf(abd, lb, sizeof (*lb));
+	if (asize > sizeof (*lb))
+		abd_zero_off(abd, sizeof (*lb), asize - sizeof (*lb));
+
+	wzio = zio_write_phys(pio, dev->l2ad_vdev, lbp->lbp_daddr, asize,
+	    abd, ZIO_CHECKSUM_OFF, NULL, NULL, ZIO_PRIORITY_ASYNC_WRITE,
+	    ZIO_FLAG_CANFAIL, B_FALSE);
+	l2arc_free_abd_on_write(abd, asize, ARC_BUFC_METADATA);
+	DTRACE_PROBE2(l2arc__log__blk__write, l2arc_dev_t *, dev,
+	    zio_t *, wzio);
+	(void) zio_nowait(wzio);
+
+	dev->l2ad_hand += asize;
+	dh->dh_hand = dev->l2ad_hand;
+	dh->dh_lb_count++;
+	dev->l2ad_log_ent_idx = 0;
+
+	ARCSTAT_BUMP(arcstat_l2_log_blk_writes);
+
+	return (asize);
+}
+
+/*
+ * Synchronously write the in-core device header out to the cache device.
+ * The caller must hold SCL_L2ARC (or otherwise prevent device removal).
+ */
+static void
+l2arc_dev_hdr_update(l2arc_dev_t *dev)
+{
+	l2arc_dev_hdr_phys_t *dh = dev->l2ad_dev_hdr;
+	abd_t *abd;
+	int err;
+
+	ASSERT(dev->l2ad_persist);
+
+	dh->dh_magic = L2ARC_DEV_HDR_MAGIC;
+	dh->dh_version = L2ARC_PERSIST_VERSION;
+	dh->dh_spa_guid = spa_guid(dev->l2ad_spa);
+	dh->dh_vdev_guid = dev->l2ad_vdev->vdev_guid;
+	dh->dh_log_entries = L2ARC_LOG_BLK_ENTRIES;
+	dh->dh_flags = dev->l2ad_first ? L2ARC_DEV_HDR_FIRST : 0;
+	dh->dh_start = dev->l2ad_start;
+	dh->dh_end = dev->l2ad_end;
+	dh->dh_evict = dev->l2ad_evict;
+	fletcher_4_native(dh, offsetof(l2arc_dev_hdr_phys_t, dh_self_cksum),
+	    NULL, &dh->dh_self_cksum);
+
+	abd = abd_get_from_buf(dh, dev->l2ad_dev_hdr_asize);
+	err = zio_wait(zio_write_phys(NULL, dev->l2ad_vdev,
+	    VDEV_LABEL_START_SIZE, dev->l2ad_dev_hdr_asize, abd,
+	    ZIO_CHECKSUM_OFF, NULL, NULL, ZIO_PRIORITY_ASYNC_WRITE,
+	    ZIO_FLAG_CANFAIL, B_FALSE));
+	abd_put(abd);
+
+	if (err != 0) {
+		zfs_dbgmsg("L2ARC device header write failed on vdev %llu "
+		    "(error %d)", (u_longlong_t)dev->l2ad_vdev->vdev_guid, err);
+	}
+}
+
 /*
  * This thread feeds the L2ARC at regular intervals.  This is the beating
  * heart of the L2ARC.
@@ -8798,13 +9301,39 @@ l2arc_add_vdev(spa_t *spa, vdev_t *vd)
 	adddev = kmem_zalloc(sizeof (l2arc_dev_t), KM_SLEEP);
 	adddev->l2ad_spa = spa;
 	adddev->l2ad_vdev = vd;
-	adddev->l2ad_start = VDEV_LABEL_START_SIZE;
+	/*
+	 * The persistent L2ARC device header lives right after the front
+	 * vdev labels, ahead of the area used for buffers.
+	 */
+	adddev->l2ad_dev_hdr_asize = vdev_psize_to_asize(vd,
+	    sizeof (l2arc_dev_hdr_phys_t));
+	adddev->l2ad_start = VDEV_LABEL_START_SIZE +
+	    adddev->l2ad_dev_hdr_asize;
 	adddev->l2ad_end = VDEV_LABEL_START_SIZE + vdev_get_min_asize(vd);
 	adddev->l2ad_hand = adddev->l2ad_start;
+	adddev->l2ad_evict = adddev->l2ad_start;
 	adddev->l2ad_first = B_TRUE;
 	adddev->l2ad_writing = B_FALSE;
 
 	mutex_init(&adddev->l2ad_mtx, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&adddev->l2ad_rebuild_cv, NULL, CV_DEFAULT, NULL);
+
+	/*
+	 * Only bother logging the contents of devices large enough for a
+	 * warm restart to be worth it.  Such devices are rebuilt from their
+	 * log asynchronously; the feed thread leaves them alone until then.
+	 */
+	if (adddev->l2ad_end > adddev->l2ad_start &&
+	    adddev->l2ad_end - adddev->l2ad_start >=
+	    MAX(l2arc_rebuild_blocks_min_l2size,
+	    2 * l2arc_write_max + L2ARC_LOG_BLK_SIZE)) {
+		adddev->l2ad_persist = B_TRUE;
+		adddev->l2ad_dev_hdr = kmem_zalloc(adddev->l2ad_dev_hdr_asize,
+		    KM_SLEEP);
+		adddev->l2ad_log_blk = kmem_zalloc(
+		    sizeof (l2arc_log_blk_phys_t), KM_SLEEP);
+		adddev->l2ad_rebuild = B_TRUE;
+	}
 	/*
 	 * This is a list of all ARC buffers that are still valid on the
 	 * device.
@@ -8822,6 +9351,16 @@ l2arc_add_vdev(spa_t *spa, vdev_t *vd)
 	list_insert_head(l2arc_dev_list, adddev);
 	atomic_inc_64(&l2arc_ndev);
 	mutex_exit(&l2arc_dev_mtx);
+
+	/*
+	 * Our caller usually holds the spa config lock as writer; the
+	 * rebuild thread waits for it to be dropped before touching the
+	 * device.
+	 */
+	if (adddev->l2ad_rebuild) {
+		(void) thread_create(NULL, 0, l2arc_dev_rebuild_thread,
+		    adddev, 0, &p0, TS_RUN, minclsyspri);
+	}
 }
 
 /*
@@ -8853,16 +9392,451 @@ l2arc_remove_vdev(vdev_t *vd)
 	atomic_dec_64(&l2arc_ndev);
 	mutex_exit(&l2arc_dev_mtx);
 
+	/*
+	 * Stop any rebuild still running against this device.  The rebuild
+	 * thread never blocks on the spa config lock, so this is safe even
+	 * though our caller may be holding it as writer.
+	 */
+	mutex_enter(&remdev->l2ad_mtx);
+	remdev->l2ad_rebuild_cancel = B_TRUE;
+	while (remdev->l2ad_rebuild)
+		cv_wait(&remdev->l2ad_rebuild_cv, &remdev->l2ad_mtx);
+	mutex_exit(&remdev->l2ad_mtx);
+
 	/*
 	 * Clear all buflists and ARC references.  L2ARC device flush.
 	 */
 	l2arc_evict(remdev, 0, B_TRUE);
 	list_destroy(&remdev->l2ad_buflist);
 	mutex_destroy(&remdev->l2ad_mtx);
+	cv_destroy(&remdev->l2ad_rebuild_cv);
 	zfs_refcount_destroy(&remdev->l2ad_alloc);
+	if (remdev->l2ad_persist) {
+		kmem_free(remdev->l2ad_dev_hdr, remdev->l2ad_dev_hdr_asize);
+		kmem_free(remdev->l2ad_log_blk,
+		    sizeof (l2arc_log_blk_phys_t));
+	}
 	kmem_free(remdev, sizeof (l2arc_dev_t));
 }
 
+/*
+ * Acquire SCL_L2ARC for the rebuild of dev without ever blocking on it,
+ * giving up if the rebuild is cancelled in the meantime.  Device removal
+ * waits for the rebuild thread while holding the config lock as writer,
+ * so waiting for the lock here could deadlock.
+ */
+static int
+l2arc_rebuild_enter(l2arc_dev_t *dev)
+{
+	for (;;) {
+		mutex_enter(&dev->l2ad_mtx);
+		if (dev->l2ad_rebuild_cancel) {
+			mutex_exit(&dev->l2ad_mtx);
+			return (SET_ERROR(ECANCELED));
+		}
+		mutex_exit(&dev->l2ad_mtx);
+
+		if (spa_config_tryenter(dev->l2ad_spa, SCL_L2ARC, dev,
+		    RW_READER))
+			return (0);
+		delay(MAX(hz / 100, 1));
+	}
+}
+
+/*
+ * Read and validate the on-device header of a cache device.  Returns 0
+ * and fills in dh if the header belongs to this device and pool.
+ */
+static int
+l2arc_dev_hdr_read(l2arc_dev_t *dev, l2arc_dev_hdr_phys_t *dh)
+{
+	vdev_t *vd = dev->l2ad_vdev;
+	uint64_t asize = dev->l2ad_dev_hdr_asize;
+	zio_cksum_t cksum;
+	abd_t *abd;
+	int err;
+
+	abd = abd_get_from_buf(dh, asize);
+	err = zio_wait(zio_read_phys(NULL, vd, VDEV_LABEL_START_SIZE, asize,
+	    abd, ZIO_CHECKSUM_OFF, NULL, NULL, ZIO_PRIORITY_ASYNC_READ,
+	    ZIO_FLAG_DONT_CACHE | ZIO_FLAG_CANFAIL | ZIO_FLAG_DONT_PROPAGATE |
+	    ZIO_FLAG_DONT_RETRY, B_FALSE));
+	abd_put(abd);
+	if (err != 0) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_io_errors);
+		return (err);
+	}
+
+	/*
+	 * A device that has never been used by a persistent L2ARC (or that
+	 * was written by a host of the other byte order) simply has nothing
+	 * to rebuild from.
+	 */
+	if (dh->dh_magic != L2ARC_DEV_HDR_MAGIC ||
+	    dh->dh_version != L2ARC_PERSIST_VERSION) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_unsupported);
+		return (SET_ERROR(ENOTSUP));
+	}
+
+	fletcher_4_native(dh, offsetof(l2arc_dev_hdr_phys_t, dh_self_cksum),
+	    NULL, &cksum);
+	if (!ZIO_CHECKSUM_EQUAL(cksum, dh->dh_self_cksum) ||
+	    dh->dh_spa_guid != spa_guid(dev->l2ad_spa) ||
+	    dh->dh_vdev_guid != vd->vdev_guid ||
+	    dh->dh_log_entries != L2ARC_LOG_BLK_ENTRIES ||
+	    dh->dh_start != dev->l2ad_start ||
+	    dh->dh_end != dev->l2ad_end ||
+	    dh->dh_hand < dev->l2ad_start || dh->dh_hand > dev->l2ad_end ||
+	    dh->dh_evict < dev->l2ad_start || dh->dh_evict > dev->l2ad_end) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_dh_errors);
+		return (SET_ERROR(EINVAL));
+	}
+
+	return (0);
+}
+
+/*
+ * Determine whether the log block pointed to by lbp can still be trusted,
+ * i.e. that neither it nor the buffers it describes lie in the region of
+ * the device the feed thread was about to overwrite (dh_hand to dh_evict).
+ */
+static boolean_t
+l2arc_log_blkptr_valid(l2arc_dev_t *dev, const l2arc_dev_hdr_phys_t *dh,
+    const l2arc_log_blkptr_t *lbp)
+{
+	uint64_t start = lbp->lbp_payload_start;
+	uint64_t end = lbp->lbp_daddr + lbp->lbp_asize;
+
+	if (lbp->lbp_asize != vdev_psize_to_asize(dev->l2ad_vdev,
+	    sizeof (l2arc_log_blk_phys_t)) ||
+	    lbp->lbp_nentries == 0 ||
+	    lbp->lbp_nentries > L2ARC_LOG_BLK_ENTRIES ||
+	    start < dev->l2ad_start || start > lbp->lbp_daddr ||
+	    end > dev->l2ad_end)
+		return (B_FALSE);
+
+	if (dh->dh_evict > dh->dh_hand &&
+	    start < dh->dh_evict && end > dh->dh_hand)
+		return (B_FALSE);
+
+	return (B_TRUE);
+}
+
+/*
+ * Wait for a log block read issued under pio and verify its contents.
+ */
+static int
+l2arc_log_blk_read_done(zio_t *pio, const l2arc_log_blkptr_t *lbp,
+    l2arc_log_blk_phys_t *lb)
+{
+	zio_cksum_t cksum;
+	int err;
+
+	if ((err = zio_wait(pio)) != 0) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_io_errors);
+		return (err);
+	}
+
+	fletcher_4_native(lb, sizeof (*lb), NULL, &cksum);
+	if (lb->lb_magic != L2ARC_LOG_BLK_MAGIC ||
+	    !ZIO_CHECKSUM_EQUAL(cksum, lbp->lbp_cksum)) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_cksum_lb_errors);
+		return (SET_ERROR(ECKSUM));
+	}
+
+	return (0);
+}
+
+/*
+ * Start an asynchronous read of the log block pointed to by lbp into lb.
+ * The returned root zio must be waited on with l2arc_log_blk_read_done().
+ */
+static zio_t *
+l2arc_log_blk_read(l2arc_dev_t *dev, const l2arc_log_blkptr_t *lbp,
+    l2arc_log_blk_phys_t *lb, abd_t *abd)
+{
+	zio_t *pio;
+
+	pio = zio_root(dev->l2ad_spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	(void) zio_nowait(zio_read_phys(pio, dev->l2ad_vdev, lbp->lbp_daddr,
+	    lbp->lbp_asize, abd, ZIO_CHECKSUM_OFF, NULL, NULL,
+	    ZIO_PRIORITY_ASYNC_READ, ZIO_FLAG_DONT_CACHE | ZIO_FLAG_CANFAIL |
+	    ZIO_FLAG_DONT_PROPAGATE | ZIO_FLAG_DONT_RETRY, B_FALSE));
+
+	return (pio);
+}
+
+/*
+ * Re-create an L2-only ARC header for a buffer described by a log entry,
+ * unless the buffer is already known to the ARC.
+ */
+static void
+l2arc_hdr_restore(l2arc_dev_t *dev, const l2arc_log_ent_phys_t *le)
+{
+	arc_buf_hdr_t *hdr, *exists;
+	kmutex_t *hash_lock;
+	arc_buf_contents_t type = L2BLK_GET_TYPE(le->le_prop);
+	uint64_t lsize = L2BLK_GET_LSIZE(le->le_prop);
+	uint64_t psize = L2BLK_GET_PSIZE(le->le_prop);
+	enum zio_compress compress = L2BLK_GET_COMPRESS(le->le_prop);
+	uint64_t asize = vdev_psize_to_asize(dev->l2ad_vdev, psize);
+
+	/* Sanity check what we are about to trust. */
+	if (DVA_IS_EMPTY(&le->le_dva) || le->le_birth == 0 ||
+	    (type != ARC_BUFC_DATA && type != ARC_BUFC_METADATA) ||
+	    compress >= ZIO_COMPRESS_FUNCTIONS ||
+	    le->le_daddr < dev->l2ad_start ||
+	    le->le_daddr + asize > dev->l2ad_end)
+		return;
+
+	hdr = kmem_cache_alloc(hdr_l2only_cache, KM_SLEEP);
+	ASSERT(HDR_EMPTY(hdr));
+	HDR_SET_PSIZE(hdr, psize);
+	HDR_SET_LSIZE(hdr, lsize);
+	hdr->b_spa = spa_load_guid(dev->l2ad_spa);
+	hdr->b_type = type;
+	hdr->b_flags = 0;
+	hdr->b_hash_next = NULL;
+	arc_hdr_set_flags(hdr, arc_bufc_to_flags(type) | ARC_FLAG_HAS_L2HDR);
+	arc_hdr_set_compress(hdr, compress);
+	if (L2BLK_GET_PROTECTED(le->le_prop))
+		arc_hdr_set_flags(hdr, ARC_FLAG_PROTECTED);
+	hdr->b_l2hdr.b_dev = dev;
+	hdr->b_l2hdr.b_daddr = le->le_daddr;
+	hdr->b_dva = le->le_dva;
+	hdr->b_birth = le->le_birth;
+
+	exists = buf_hash_insert(hdr, &hash_lock);
+	if (exists != NULL) {
+		/* The buffer was cached again before we got to it. */
+		mutex_exit(hash_lock);
+		buf_discard_identity(hdr);
+		kmem_cache_free(hdr_l2only_cache, hdr);
+		ARCSTAT_BUMP(arcstat_l2_rebuild_bufs_precached);
+		return;
+	}
+
+	/*
+	 * Log blocks are restored newest first, so appending keeps the
+	 * buffer list ordered the way l2arc_evict() expects.
+	 */
+	mutex_enter(&dev->l2ad_mtx);
+	list_insert_tail(&dev->l2ad_buflist, hdr);
+	(void) zfs_refcount_add_many(&dev->l2ad_alloc, arc_hdr_size(hdr), hdr);
+	mutex_exit(&dev->l2ad_mtx);
+	mutex_exit(hash_lock);
+
+	vdev_space_update(dev->l2ad_vdev, asize, 0, 0);
+	ARCSTAT_INCR(arcstat_l2_lsize, lsize);
+	ARCSTAT_INCR(arcstat_l2_psize, psize);
+	ARCSTAT_BUMP(arcstat_l2_rebuild_bufs);
+}
+
+/*
+ * Walk the log block chain of a cache device from the newest block
+ * backwards, restoring the buffers each block describes.  The read of
+ * the next log block is overlapped with restoring the current one.
+ */
+static int
+l2arc_rebuild(l2arc_dev_t *dev)
+{
+	l2arc_dev_hdr_phys_t *dh;
+	l2arc_log_blk_phys_t *this_lb, *next_lb;
+	abd_t *this_abd, *next_abd;
+	l2arc_log_blkptr_t lbp;
+	zio_t *this_io = NULL, *next_io = NULL;
+	uint64_t asize = vdev_psize_to_asize(dev->l2ad_vdev,
+	    sizeof (l2arc_log_blk_phys_t));
+	uint64_t traveled = 0, devsize = dev->l2ad_end - dev->l2ad_start;
+	boolean_t first = B_TRUE;
+	int wraps;
+	int err;
+
+	dh = kmem_zalloc(dev->l2ad_dev_hdr_asize, KM_SLEEP);
+	this_lb = kmem_zalloc(asize, KM_SLEEP);
+	next_lb = kmem_zalloc(asize, KM_SLEEP);
+	this_abd = abd_get_from_buf(this_lb, asize);
+	next_abd = abd_get_from_buf(next_lb, asize);
+
+	if ((err = l2arc_rebuild_enter(dev)) != 0)
+		goto out;
+	err = l2arc_dev_hdr_read(dev, dh);
+	spa_config_exit(dev->l2ad_spa, SCL_L2ARC, dev);
+	if (err != 0)
+		goto out;
+
+	/*
+	 * Resume writing where the device left off.  Everything between
+	 * dh_hand and dh_evict was not logged, or was being overwritten.
+	 */
+	bcopy(dh, dev->l2ad_dev_hdr, sizeof (*dh));
+	dev->l2ad_hand = dh->dh_hand;
+	dev->l2ad_evict = dh->dh_evict;
+	dev->l2ad_first = !!(dh->dh_flags & L2ARC_DEV_HDR_FIRST);
+
+	/*
+	 * The log chain may only wrap around the end of the device if the
+	 * write hand has not wrapped since the newest log block (in which
+	 * case the chain continues into the previous sweep).
+	 */
+	lbp = dh->dh_start_lbp;
+	if (dev->l2ad_first || lbp.lbp_daddr + lbp.lbp_asize > dh->dh_hand)
+		wraps = 0;
+	else
+		wraps = 1;
+
+	if (!l2arc_log_blkptr_valid(dev, dh, &lbp))
+		goto out;
+
+	for (;;) {
+		l2arc_log_blkptr_t prev;
+
+		if (arc_reclaim_needed()) {
+			ARCSTAT_BUMP(arcstat_l2_rebuild_lowmem);
+			err = SET_ERROR(ENOMEM);
+			break;
+		}
+
+		if ((err = l2arc_rebuild_enter(dev)) != 0)
+			break;
+
+		if (first) {
+			this_io = l2arc_log_blk_read(dev, &lbp, this_lb,
+			    this_abd);
+			first = B_FALSE;
+		}
+		if (this_io != NULL) {
+			err = l2arc_log_blk_read_done(this_io, &lbp, this_lb);
+			this_io = NULL;
+		}
+		if (err != 0) {
+			spa_config_exit(dev->l2ad_spa, SCL_L2ARC, dev);
+			break;
+		}
+
+		/*
+		 * Decide whether the previous log block is still worth
+		 * reading and, if so, start reading it while we restore
+		 * this one.
+		 */
+		prev = this_lb->lb_prev;
+		if (prev.lbp_daddr >= lbp.lbp_daddr) {
+			/* The chain wraps around the end of the device. */
+			if (wraps > 0) {
+				wraps--;
+				traveled += (dev->l2ad_end - prev.lbp_daddr) +
+				    (lbp.lbp_daddr - dev->l2ad_start);
+			} else {
+				prev.lbp_daddr = 0;
+			}
+		} else if (prev.lbp_daddr != 0) {
+			traveled += lbp.lbp_daddr - prev.lbp_daddr;
+		}
+		if (prev.lbp_daddr != 0 && traveled < devsize &&
+		    l2arc_log_blkptr_valid(dev, dh, &prev)) {
+			next_io = l2arc_log_blk_read(dev, &prev, next_lb,
+			    next_abd);
+		}
+
+		for (int i = lbp.lbp_nentries - 1; i >= 0; i--)
+			l2arc_hdr_restore(dev, &this_lb->lb_entries[i]);
+		ARCSTAT_BUMP(arcstat_l2_rebuild_log_blks);
+
+		if (next_io == NULL) {
+			spa_config_exit(dev->l2ad_spa, SCL_L2ARC, dev);
+			break;
+		}
+
+		/*
+		 * Don't drop the config lock with I/O outstanding; the
+		 * prefetched block is verified on the next iteration.
+		 */
+		err = l2arc_log_blk_read_done(next_io, &prev, next_lb);
+		next_io = NULL;
+		spa_config_exit(dev->l2ad_spa, SCL_L2ARC, dev);
+		if (err != 0)
+			break;
+
+		lbp = prev;
+		l2arc_log_blk_phys_t *tmp_lb = this_lb;
+		abd_t *tmp_abd = this_abd;
+		this_lb = next_lb;
+		this_abd = next_abd;
+		next_lb = tmp_lb;
+		next_abd = tmp_abd;
+	}
+
+	/*
+	 * Running out of log blocks is how every successful rebuild ends,
+	 * and a broken or stale older block only costs us its buffers.
+	 */
+	if (err != ECANCELED && err != ENOMEM)
+		err = 0;
+
+out:
+	abd_put(this_abd);
+	abd_put(next_abd);
+	kmem_free(this_lb, asize);
+	kmem_free(next_lb, asize);
+	kmem_free(dh, dev->l2ad_dev_hdr_asize);
+
+	return (err);
+}
+
+/*
+ * Rebuild the contents of a newly added persistent cache device, then
+ * hand the device over to the feed thread.
+ */
+static void
+l2arc_dev_rebuild_thread(void *arg)
+{
+	l2arc_dev_t *dev = arg;
+	int err = SET_ERROR(ENOTSUP);
+
+	ASSERT(dev->l2ad_persist);
+
+	if (l2arc_rebuild_enabled && spa_writeable(dev->l2ad_spa))
+		err = l2arc_rebuild(dev);
+
+	if (err == 0) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_success);
+	} else if (err != ECANCELED) {
+		/*
+		 * Start over with an empty log; we may have picked up some
+		 * buffers before failing, but these are all still valid.
+		 */
+		bzero(&dev->l2ad_dev_hdr->dh_start_lbp,
+		    sizeof (l2arc_log_blkptr_t));
+		if (list_is_empty(&dev->l2ad_buflist)) {
+			dev->l2ad_hand = dev->l2ad_start;
+			dev->l2ad_evict = dev->l2ad_start;
+			dev->l2ad_first = B_TRUE;
+		}
+	}
+
+	/*
+	 * Make sure the header on the device reflects where we'll resume
+	 * writing (and forgets any log we could not use) before the feed
+	 * thread gets to write over anything.
+	 */
+	if (err != ECANCELED && spa_writeable(dev->l2ad_spa) &&
+	    l2arc_rebuild_enter(dev) == 0) {
+		dev->l2ad_dev_hdr->dh_hand = dev->l2ad_hand;
+		l2arc_dev_hdr_update(dev);
+		spa_config_exit(dev->l2ad_spa, SCL_L2ARC, dev);
+	}
+
+	zfs_dbgmsg("L2ARC rebuild of vdev %llu finished (error %d)",
+	    (u_longlong_t)dev->l2ad_vdev->vdev_guid, err);
+
+	mutex_enter(&dev->l2ad_mtx);
+	dev->l2ad_rebuild = B_FALSE;
+	cv_broadcast(&dev->l2ad_rebuild_cv);
+	mutex_exit(&dev->l2ad_mtx);
+
+	thread_exit();
+}
+
 void
 l2arc_init(void)
 {
@@ -23,7 +23,7 @@
  * Copyright 2011 Nexenta Systems, Inc.  All rights reserved.
  * Copyright (c) 2012, 2018 by Delphix. All rights reserved.
  * Copyright (c) 2013 by Saso Kiselkov. All rights reserved.
- * Copyright (c) 2013, Joyent, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2014 Spectra Logic Corporation, All rights reserved.
  * Copyright (c) 2014 Integros [integros.com]
  */
@@ -71,6 +71,7 @@ static kthread_t *dbuf_cache_evict_thread;
 static kmutex_t dbuf_evict_lock;
 static kcondvar_t dbuf_evict_cv;
 static boolean_t dbuf_evict_thread_exit;
+static boolean_t dbuf_hash_grow_wanted;
 
 /*
  * There are two dbuf caches; each dbuf can only be in one of them at a time.
@@ -123,6 +124,16 @@ int dbuf_metadata_cache_shift = 6;
  */
 uint64_t dbuf_metadata_cache_overflow;
 
+/*
+ * When a file block which the ARC has found to be frequently read (it is in
+ * the MFU state) is rewritten, place the new copy in the special class if the
+ * pool has one, as if it were a small block of up to this many bytes.  This
+ * migrates hot data onto the faster devices as it is modified, subject to
+ * the same zfs_special_class_metadata_reserve_pct reserve as small blocks.
+ * Zero disables this.
+ */
+uint64_t zfs_special_class_hot_max_blksz = 128 * 1024;
+
 /*
  * The LRU dbuf cache uses a three-stage eviction policy:
  *	- A low water marker designates when the dbuf eviction thread
@@ -201,6 +212,47 @@ static dbuf_hash_table_t dbuf_hash_table;
 
 static uint64_t dbuf_hash_count;
 
+/*
+ * The hash table is doubled in size (by the dbuf eviction thread) whenever
+ * the average chain grows longer than this.
+ */
+int dbuf_hash_load_max = 2;
+
+typedef struct dbuf_stats {
+	kstat_named_t hash_buckets;
+	kstat_named_t hash_elements;
+	kstat_named_t hash_elements_max;
+	kstat_named_t hash_collisions;
+	kstat_named_t hash_chains;
+	kstat_named_t hash_chain_max;
+	kstat_named_t hash_grows;
+	kstat_named_t hash_grow_failed;
+} dbuf_stats_t;
+
+static dbuf_stats_t dbuf_stats = {
+	{ "hash_buckets",		KSTAT_DATA_UINT64 },
+	{ "hash_elements",		KSTAT_DATA_UINT64 },
+	{ "hash_elements_max",		KSTAT_DATA_UINT64 },
+	{ "hash_collisions",		KSTAT_DATA_UINT64 },
+	{ "hash_chains",		KSTAT_DATA_UINT64 },
+	{ "hash_chain_max",		KSTAT_DATA_UINT64 },
+	{ "hash_grows",			KSTAT_DATA_UINT64 },
+	{ "hash_grow_failed",		KSTAT_DATA_UINT64 }
+};
+
+static kstat_t *dbuf_ksp;
+
+#define	DBUF_STAT_BUMP(stat) \
+	atomic_inc_64(&dbuf_stats.stat.value.ui64)
+#define	DBUF_STAT_BUMPDOWN(stat) \
+	atomic_dec_64(&dbuf_stats.stat.value.ui64)
+#define	DBUF_STAT_MAX(stat, val) {					\
+	uint64_t m;							\
+	while ((val) > (m = dbuf_stats.stat.value.ui64) &&		\
+	    m != atomic_cas_64(&dbuf_stats.stat.value.ui64, m, (val)))	\
+		continue;						\
+}
+
 /*
  * We use Cityhash for this. It's fast, and has good hash properties without
  * requiring any large static buffers.
@@ -217,26 +269,41 @@ dbuf_hash(void *os, uint64_t obj, uint8_t lvl, uint64_t blkid)
 	(dbuf)->db_level == (level) &&			\
 	(dbuf)->db_blkid == (blkid))
 
+/*
+ * Return the chain which holds dbufs with hash value hv.  The caller must
+ * hold DBUF_HASH_MUTEX(h, hv), which also keeps hash_rehash_idx from moving
+ * past this bucket.
+ */
+static dmu_buf_impl_t **
+dbuf_hash_chain(dbuf_hash_table_t *h, uint64_t hv)
+{
+	uint64_t idx = hv & h->hash_table_mask;
+
+	ASSERT(MUTEX_HELD(DBUF_HASH_MUTEX(h, hv)));
+	if (h->hash_new_table != NULL && idx < h->hash_rehash_idx)
+		return (&h->hash_new_table[hv & h->hash_new_mask]);
+	return (&h->hash_table[idx]);
+}
+
 dmu_buf_impl_t *
 dbuf_find(objset_t *os, uint64_t obj, uint8_t level, uint64_t blkid)
 {
 	dbuf_hash_table_t *h = &dbuf_hash_table;
 	uint64_t hv = dbuf_hash(os, obj, level, blkid);
-	uint64_t idx = hv & h->hash_table_mask;
 	dmu_buf_impl_t *db;
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
-	for (db = h->hash_table[idx]; db != NULL; db = db->db_hash_next) {
+	mutex_enter(DBUF_HASH_MUTEX(h, hv));
+	for (db = *dbuf_hash_chain(h, hv); db != NULL; db = db->db_hash_next) {
 		if (DBUF_EQUAL(db, os, obj, level, blkid)) {
 			mutex_enter(&db->db_mtx);
 			if (db->db_state != DB_EVICTING) {
-				mutex_exit(DBUF_HASH_MUTEX(h, idx));
+				mutex_exit(DBUF_HASH_MUTEX(h, hv));
 				return (db);
 			}
 			mutex_exit(&db->db_mtx);
 		}
 	}
-	mutex_exit(DBUF_HASH_MUTEX(h, idx));
+	mutex_exit(DBUF_HASH_MUTEX(h, hv));
 	return (NULL);
 }
 
@@ -273,15 +340,17 @@ dbuf_hash_insert(dmu_buf_impl_t *db)
 	int level = db->db_level;
 	uint64_t blkid = db->db_blkid;
 	uint64_t hv = dbuf_hash(os, obj, level, blkid);
-	uint64_t idx = hv & h->hash_table_mask;
-	dmu_buf_impl_t *dbf;
+	dmu_buf_impl_t *dbf, **chain;
+	boolean_t grow;
+	uint64_t i, n;
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
-	for (dbf = h->hash_table[idx]; dbf != NULL; dbf = dbf->db_hash_next) {
+	mutex_enter(DBUF_HASH_MUTEX(h, hv));
+	chain = dbuf_hash_chain(h, hv);
+	for (dbf = *chain, i = 0; dbf != NULL; dbf = dbf->db_hash_next, i++) {
 		if (DBUF_EQUAL(dbf, os, obj, level, blkid)) {
 			mutex_enter(&dbf->db_mtx);
 			if (dbf->db_state != DB_EVICTING) {
-				mutex_exit(DBUF_HASH_MUTEX(h, idx));
+				mutex_exit(DBUF_HASH_MUTEX(h, hv));
 				return (dbf);
 			}
 			mutex_exit(&dbf->db_mtx);
@@ -289,10 +358,26 @@ dbuf_hash_insert(dmu_buf_impl_t *db)
 	}
 
 	mutex_enter(&db->db_mtx);
-	db->db_hash_next = h->hash_table[idx];
-	h->hash_table[idx] = db;
-	mutex_exit(DBUF_HASH_MUTEX(h, idx));
-	atomic_inc_64(&dbuf_hash_count);
+	db->db_hash_next = *chain;
+	*chain = db;
+	n = atomic_inc_64_nv(&dbuf_hash_count);
+	grow = (h->hash_new_table == NULL &&
+	    n > (h->hash_table_mask + 1) * dbuf_hash_load_max);
+	mutex_exit(DBUF_HASH_MUTEX(h, hv));
+
+	/* collect some hash table performance data */
+	DBUF_STAT_MAX(hash_elements_max, n);
+	if (i > 0) {
+		DBUF_STAT_BUMP(hash_collisions);
+		if (i == 1)
+			DBUF_STAT_BUMP(hash_chains);
+		DBUF_STAT_MAX(hash_chain_max, i);
+	}
+
+	if (grow && !dbuf_hash_grow_wanted) {
+		dbuf_hash_grow_wanted = B_TRUE;
+		cv_signal(&dbuf_evict_cv);
+	}
 
 	return (NULL);
 }
@@ -306,8 +391,7 @@ dbuf_hash_remove(dmu_buf_impl_t *db)
 	dbuf_hash_table_t *h = &dbuf_hash_table;
 	uint64_t hv = dbuf_hash(db->db_objset, db->db.db_object,
 	    db->db_level, db->db_blkid);
-	uint64_t idx = hv & h->hash_table_mask;
-	dmu_buf_impl_t *dbf, **dbp;
+	dmu_buf_impl_t *dbf, **chain, **dbp;
 
 	/*
 	 * We mustn't hold db_mtx to maintain lock ordering:
@@ -317,18 +401,119 @@ dbuf_hash_remove(dmu_buf_impl_t *db)
 	ASSERT(db->db_state == DB_EVICTING);
 	ASSERT(!MUTEX_HELD(&db->db_mtx));
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
-	dbp = &h->hash_table[idx];
+	mutex_enter(DBUF_HASH_MUTEX(h, hv));
+	chain = dbp = dbuf_hash_chain(h, hv);
 	while ((dbf = *dbp) != db) {
 		dbp = &dbf->db_hash_next;
 		ASSERT(dbf != NULL);
 	}
 	*dbp = db->db_hash_next;
 	db->db_hash_next = NULL;
-	mutex_exit(DBUF_HASH_MUTEX(h, idx));
+	if (*chain != NULL && (*chain)->db_hash_next == NULL)
+		DBUF_STAT_BUMPDOWN(hash_chains);
+	mutex_exit(DBUF_HASH_MUTEX(h, hv));
 	atomic_dec_64(&dbuf_hash_count);
 }
 
+static void
+dbuf_hash_enter_all(dbuf_hash_table_t *h)
+{
+	for (int i = 0; i < DBUF_MUTEXES; i++)
+		mutex_enter(&h->hash_mutexes[i].dhl_lock);
+}
+
+static void
+dbuf_hash_exit_all(dbuf_hash_table_t *h)
+{
+	for (int i = DBUF_MUTEXES - 1; i >= 0; i--)
+		mutex_exit(&h->hash_mutexes[i].dhl_lock);
+}
+
+/*
+ * Double the size of the hash table.  All of the hash mutexes are taken only
+ * to install the new table and to retire the old one; in between, each old
+ * bucket is split into its two new buckets under its own mutex, so lookups
+ * and inserts elsewhere in the table carry on while the rehash progresses.
+ * Called only from the dbuf eviction thread.
+ */
+static void
+dbuf_hash_grow(void)
+{
+	dbuf_hash_table_t *h = &dbuf_hash_table;
+	uint64_t oldsize = h->hash_table_mask + 1;
+	uint64_t newsize = oldsize << 1;
+	dmu_buf_impl_t **oldtab, **newtab;
+
+	newtab = kmem_zalloc(newsize * sizeof (void *), KM_NOSLEEP);
+	if (newtab == NULL) {
+		DBUF_STAT_BUMP(hash_grow_failed);
+		return;
+	}
+
+	dbuf_hash_enter_all(h);
+	h->hash_new_mask = newsize - 1;
+	h->hash_rehash_idx = 0;
+	h->hash_new_table = newtab;
+	dbuf_hash_exit_all(h);
+
+	for (uint64_t idx = 0; idx < oldsize; idx++) {
+		kmutex_t *hm = DBUF_HASH_MUTEX(h, idx);
+		dmu_buf_impl_t *db, *next;
+
+		mutex_enter(hm);
+		db = h->hash_table[idx];
+		if (db != NULL && db->db_hash_next != NULL)
+			DBUF_STAT_BUMPDOWN(hash_chains);
+		for (; db != NULL; db = next) {
+			uint64_t nidx = dbuf_hash(db->db_objset,
+			    db->db.db_object, db->db_level, db->db_blkid) &
+			    h->hash_new_mask;
+
+			next = db->db_hash_next;
+			if (newtab[nidx] != NULL &&
+			    newtab[nidx]->db_hash_next == NULL)
+				DBUF_STAT_BUMP(hash_chains);
+			db->db_hash_next = newtab[nidx];
+			newtab[nidx] = db;
+		}
+		h->hash_table[idx] = NULL;
+		h->hash_rehash_idx = idx + 1;
+		mutex_exit(hm);
+	}
+
+	dbuf_hash_enter_all(h);
+	oldtab = h->hash_table;
+	h->hash_table = newtab;
+	h->hash_table_mask = newsize - 1;
+	h->hash_new_table = NULL;
+	h->hash_new_mask = 0;
+	h->hash_rehash_idx = 0;
+	dbuf_hash_exit_all(h);
+
+	kmem_free(oldtab, oldsize * sizeof (void *));
+	DBUF_STAT_BUMP(hash_grows);
+
+	/*
+	 * The longest chain seen so far is most likely gone now; let inserts
+	 * into the larger table establish a new maximum.
+	 */
+	dbuf_stats.hash_chain_max.value.ui64 = 0;
+}
+
+static int
+dbuf_kstat_update(kstat_t *ksp, int rw)
+{
+	dbuf_stats_t *ds = ksp->ks_data;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	ds->hash_buckets.value.ui64 = dbuf_hash_table.hash_table_mask + 1;
+	ds->hash_elements.value.ui64 = dbuf_hash_count;
+
+	return (0);
+}
+
 typedef enum {
 	DBVU_EVICTING,
 	DBVU_NOT_EVICTING
@@ -562,7 +747,8 @@ dbuf_evict_thread(void *unused)
 
 	mutex_enter(&dbuf_evict_lock);
 	while (!dbuf_evict_thread_exit) {
-		while (!dbuf_cache_above_lowater() && !dbuf_evict_thread_exit) {
+		while (!dbuf_cache_above_lowater() && !dbuf_evict_thread_exit &&
+		    !dbuf_hash_grow_wanted) {
 			CALLB_CPR_SAFE_BEGIN(&cpr);
 			(void) cv_timedwait_hires(&dbuf_evict_cv,
 			    &dbuf_evict_lock, SEC2NSEC(1), MSEC2NSEC(1), 0);
@@ -570,6 +756,11 @@ dbuf_evict_thread(void *unused)
 		}
 		mutex_exit(&dbuf_evict_lock);
 
+		if (dbuf_hash_grow_wanted && !dbuf_evict_thread_exit) {
+			dbuf_hash_grow();
+			dbuf_hash_grow_wanted = B_FALSE;
+		}
+
 		/*
 		 * Keep evicting as long as we're above the low water mark
 		 * for the cache. We do this without holding the locks to
@@ -629,7 +820,7 @@ retry:
 	h->hash_table = kmem_zalloc(hsize * sizeof (void *), KM_NOSLEEP);
 	if (h->hash_table == NULL) {
 		/* XXX - we should really return an error instead of assert */
-		ASSERT(hsize > (1ULL << 10));
+		ASSERT(hsize > DBUF_MUTEXES);
 		hsize >>= 1;
 		goto retry;
 	}
@@ -638,8 +829,19 @@ retry:
 	    sizeof (dmu_buf_impl_t),
 	    0, dbuf_cons, dbuf_dest, NULL, NULL, NULL, 0);
 
-	for (i = 0; i < DBUF_MUTEXES; i++)
-		mutex_init(&h->hash_mutexes[i], NULL, MUTEX_DEFAULT, NULL);
+	for (i = 0; i < DBUF_MUTEXES; i++) {
+		mutex_init(&h->hash_mutexes[i].dhl_lock, NULL, MUTEX_DEFAULT,
+		    NULL);
+	}
+
+	dbuf_ksp = kstat_create("zfs", 0, "dbufstats", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (dbuf_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (dbuf_ksp != NULL) {
+		dbuf_ksp->ks_data = &dbuf_stats;
+		dbuf_ksp->ks_update = dbuf_kstat_update;
+		kstat_install(dbuf_ksp);
+	}
 
 	/*
 	 * Setup the parameters for the dbuf caches. We set the sizes of the
@@ -685,12 +887,10 @@ dbuf_fini(void)
 	dbuf_hash_table_t *h = &dbuf_hash_table;
 	int i;
 
-	for (i = 0; i < DBUF_MUTEXES; i++)
-		mutex_destroy(&h->hash_mutexes[i]);
-	kmem_free(h->hash_table, (h->hash_table_mask + 1) * sizeof (void *));
-	kmem_cache_destroy(dbuf_kmem_cache);
-	taskq_destroy(dbu_evict_taskq);
-
+	/*
+	 * Stop the eviction thread first, since it is also the one which
+	 * grows the hash table.
+	 */
 	mutex_enter(&dbuf_evict_lock);
 	dbuf_evict_thread_exit = B_TRUE;
 	while (dbuf_evict_thread_exit) {
@@ -699,6 +899,18 @@ dbuf_fini(void)
 	}
 	mutex_exit(&dbuf_evict_lock);
 
+	if (dbuf_ksp != NULL) {
+		kstat_delete(dbuf_ksp);
+		dbuf_ksp = NULL;
+	}
+
+	ASSERT3P(h->hash_new_table, ==, NULL);
+	for (i = 0; i < DBUF_MUTEXES; i++)
+		mutex_destroy(&h->hash_mutexes[i].dhl_lock);
+	kmem_free(h->hash_table, (h->hash_table_mask + 1) * sizeof (void *));
+	kmem_cache_destroy(dbuf_kmem_cache);
+	taskq_destroy(dbu_evict_taskq);
+
 	mutex_destroy(&dbuf_evict_lock);
 	cv_destroy(&dbuf_evict_cv);
 
@@ -1790,6 +2002,9 @@ dbuf_dirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 				 * syncing state (since they are only modified
 				 * then).
 				 */
+				dr->dt.dl.dr_hot =
+				    zfs_special_class_hot_max_blksz != 0 &&
+				    arc_buf_is_mfu(db->db_buf);
 				arc_release(db->db_buf, db);
 				dbuf_fix_old_data(db, tx->tx_txg);
 				data_old = db->db_buf;
@@ -1810,6 +2025,14 @@ dbuf_dirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 	dr->dr_next = *drp;
 	*drp = dr;
 
+	/*
+	 * A block that is dirty in an earlier txg has already been released
+	 * from the ARC; it stays as hot as it was when first dirtied.
+	 */
+	if (db->db_level == 0 && dr->dr_next != NULL &&
+	    dr->dr_next->dt.dl.dr_hot)
+		dr->dt.dl.dr_hot = B_TRUE;
+
 	/*
 	 * We could have been freed_in_flight between the dbuf_noread
 	 * and dbuf_dirty.  We win, as though the dbuf_noread() had
@@ -2492,6 +2715,7 @@ dbuf_create(dnode_t *dn, uint8_t level, uint64_t blkid,
 	db->db_user_immediate_evict = FALSE;
 	db->db_freed_in_flight = FALSE;
 	db->db_pending_evict = FALSE;
+	db->db_uncached = FALSE;
 
 	if (blkid == DMU_BONUS_BLKID) {
 		ASSERT3P(parent, ==, dn->dn_dbuf);
@@ -4114,6 +4338,9 @@ dbuf_write(dbuf_dirty_record_t *dr, arc_buf_t *data, dmu_tx_t *tx)
 	wp_flag |= (db->db_state == DB_NOFILL) ? WP_NOFILL : 0;
 
 	dmu_write_policy(os, dn, db->db_level, wp_flag, &zp);
+	if (db->db_level == 0 && dr->dt.dl.dr_hot &&
+	    zp.zp_zpl_smallblk < zfs_special_class_hot_max_blksz)
+		zp.zp_zpl_smallblk = zfs_special_class_hot_max_blksz;
 
 	DB_DNODE_EXIT(db);
 
@@ -37,12 +37,35 @@
 #include <sys/zio_compress.h>
 #include <sys/dsl_scan.h>
 #include <sys/abd.h>
+#include <sys/zfeature.h>
 
 /*
  * Enable/disable prefetching of dedup-ed blocks which are going to be freed.
  */
 int zfs_dedup_prefetch = 1;
 
+/*
+ * DDT log tunables.  Rather than updating the DDT ZAPs directly in every
+ * txg, changed entries are appended to a per-table log object and kept in
+ * memory; zfs_ddt_log_flush_entries of them are then written back to the
+ * ZAPs each txg, in key order.  A txg whose changes fit in the flush budget
+ * while the log is empty updates the ZAPs directly, as before.  Once the
+ * in-core log exceeds zfs_ddt_log_mem_max, unique entries are flushed first
+ * since they are the least likely to be referenced again.  The on-disk log
+ * is rewritten when it holds more than zfs_ddt_log_compact_ratio times the
+ * live records and is larger than zfs_ddt_log_compact_min.
+ */
+int zfs_ddt_log_enabled = 1;
+uint64_t zfs_ddt_log_flush_entries = 1000;
+uint64_t zfs_ddt_log_mem_max = 64 << 20;
+int zfs_ddt_log_compact_ratio = 4;
+uint64_t zfs_ddt_log_compact_min = 16 << 20;
+
+#define	DDT_LOG_BUF_RECORDS	\
+	(SPA_OLD_MAXBLOCKSIZE / sizeof (ddt_log_record_t))
+#define	DDT_LOG_BUF_SIZE	\
+	(DDT_LOG_BUF_RECORDS * sizeof (ddt_log_record_t))
+
 static const ddt_ops_t *ddt_ops[DDT_TYPES] = {
 	&ddt_zap_ops,
 };
@@ -243,6 +266,13 @@ ddt_object_name(ddt_t *ddt, enum ddt_type type, enum ddt_class class,
 	    ddt_ops[type]->ddt_op_name, ddt_class_name[class]);
 }
 
+static void
+ddt_log_name(ddt_t *ddt, char *name)
+{
+	(void) sprintf(name, DMU_POOL_DDT_LOG,
+	    zio_checksum_table[ddt->ddt_checksum].ci_name);
+}
+
 void
 ddt_bp_fill(const ddt_phys_t *ddp, blkptr_t *bp, uint64_t txg)
 {
@@ -346,6 +376,27 @@ ddt_phys_select(const ddt_entry_t *dde, const blkptr_t *bp)
 	return (NULL);
 }
 
+/*
+ * Return the class an entry with these phys belongs in, or DDT_CLASSES if
+ * nothing references it any more.
+ */
+static enum ddt_class
+ddt_phys_class(const ddt_phys_t *ddp)
+{
+	uint64_t refcnt = 0;
+
+	for (int p = DDT_PHYS_SINGLE; p < DDT_PHYS_TYPES; p++)
+		refcnt += ddp[p].ddp_refcnt;
+
+	if (refcnt == 0)
+		return (DDT_CLASSES);
+	if (ddp[DDT_PHYS_DITTO].ddp_phys_birth != 0)
+		return (DDT_CLASS_DITTO);
+	if (refcnt > 1)
+		return (DDT_CLASS_DUPLICATE);
+	return (DDT_CLASS_UNIQUE);
+}
+
 uint64_t
 ddt_phys_total_refcnt(const ddt_entry_t *dde)
 {
@@ -674,6 +725,18 @@ ddt_free(ddt_entry_t *dde)
 	kmem_free(dde, sizeof (*dde));
 }
 
+static ddt_log_entry_t *
+ddt_log_find(ddt_t *ddt, const ddt_key_t *ddk)
+{
+	ddt_log_entry_t dle_search;
+
+	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+
+	dle_search.dle_key = *ddk;
+
+	return (avl_find(&ddt->ddt_log_tree, &dle_search, NULL));
+}
+
 void
 ddt_remove(ddt_t *ddt, ddt_entry_t *dde)
 {
@@ -687,6 +750,7 @@ ddt_entry_t *
 ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 {
 	ddt_entry_t *dde, dde_search;
+	ddt_log_entry_t *dle;
 	enum ddt_type type;
 	enum ddt_class class;
 	avl_index_t where;
@@ -710,6 +774,25 @@ ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 	if (dde->dde_loaded)
 		return (dde);
 
+	/*
+	 * An entry in the DDT log is newer than anything in the ZAPs.
+	 */
+	if ((dle = ddt_log_find(ddt, &dde->dde_key)) != NULL) {
+		class = ddt_phys_class(dle->dle_phys);
+		if (class != DDT_CLASSES) {
+			bcopy(dle->dle_phys, dde->dde_phys,
+			    sizeof (dde->dde_phys));
+			dde->dde_type = DDT_TYPE_CURRENT;
+			dde->dde_class = class;
+			ddt_stat_update(ddt, dde, -1ULL);
+		} else {
+			dde->dde_type = DDT_TYPES;
+			dde->dde_class = DDT_CLASSES;
+		}
+		dde->dde_loaded = B_TRUE;
+		return (dde);
+	}
+
 	dde->dde_loading = B_TRUE;
 
 	ddt_exit(ddt);
@@ -779,13 +862,11 @@ typedef struct ddt_key_cmp {
 	uint16_t	u16[DDT_KEY_CMP_LEN];
 } ddt_key_cmp_t;
 
-int
-ddt_entry_compare(const void *x1, const void *x2)
+static int
+ddt_key_compare(const ddt_key_t *ddk1, const ddt_key_t *ddk2)
 {
-	const ddt_entry_t *dde1 = x1;
-	const ddt_entry_t *dde2 = x2;
-	const ddt_key_cmp_t *k1 = (const ddt_key_cmp_t *)&dde1->dde_key;
-	const ddt_key_cmp_t *k2 = (const ddt_key_cmp_t *)&dde2->dde_key;
+	const ddt_key_cmp_t *k1 = (const ddt_key_cmp_t *)ddk1;
+	const ddt_key_cmp_t *k2 = (const ddt_key_cmp_t *)ddk2;
 	int32_t cmp = 0;
 
 	for (int i = 0; i < DDT_KEY_CMP_LEN; i++) {
@@ -797,6 +878,24 @@ ddt_entry_compare(const void *x1, const void *x2)
 	return (TREE_ISIGN(cmp));
 }
 
+int
+ddt_entry_compare(const void *x1, const void *x2)
+{
+	const ddt_entry_t *dde1 = x1;
+	const ddt_entry_t *dde2 = x2;
+
+	return (ddt_key_compare(&dde1->dde_key, &dde2->dde_key));
+}
+
+int
+ddt_log_entry_compare(const void *x1, const void *x2)
+{
+	const ddt_log_entry_t *dle1 = x1;
+	const ddt_log_entry_t *dle2 = x2;
+
+	return (ddt_key_compare(&dle1->dle_key, &dle2->dle_key));
+}
+
 static ddt_t *
 ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 {
@@ -809,6 +908,8 @@ ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 	    sizeof (ddt_entry_t), offsetof(ddt_entry_t, dde_node));
 	avl_create(&ddt->ddt_repair_tree, ddt_entry_compare,
 	    sizeof (ddt_entry_t), offsetof(ddt_entry_t, dde_node));
+	avl_create(&ddt->ddt_log_tree, ddt_log_entry_compare,
+	    sizeof (ddt_log_entry_t), offsetof(ddt_log_entry_t, dle_node));
 	ddt->ddt_checksum = c;
 	ddt->ddt_spa = spa;
 	ddt->ddt_os = spa->spa_meta_objset;
@@ -819,14 +920,76 @@ ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 static void
 ddt_table_free(ddt_t *ddt)
 {
+	ddt_log_entry_t *dle;
+	void *cookie = NULL;
+
 	ASSERT(avl_numnodes(&ddt->ddt_tree) == 0);
 	ASSERT(avl_numnodes(&ddt->ddt_repair_tree) == 0);
+	ASSERT0(ddt->ddt_log_buf_count);
+	while ((dle = avl_destroy_nodes(&ddt->ddt_log_tree, &cookie)) != NULL)
+		kmem_free(dle, sizeof (*dle));
+	if (ddt->ddt_log_buf != NULL)
+		zio_buf_free(ddt->ddt_log_buf, SPA_OLD_MAXBLOCKSIZE);
 	avl_destroy(&ddt->ddt_tree);
 	avl_destroy(&ddt->ddt_repair_tree);
+	avl_destroy(&ddt->ddt_log_tree);
 	mutex_destroy(&ddt->ddt_lock);
 	kmem_free(ddt, sizeof (*ddt));
 }
 
+typedef struct ddt_log_kstat {
+	kstat_named_t dlk_entries;
+	kstat_named_t dlk_mem_bytes;
+	kstat_named_t dlk_log_bytes;
+	kstat_named_t dlk_appended;
+	kstat_named_t dlk_flushed;
+	kstat_named_t dlk_pruned;
+	kstat_named_t dlk_compactions;
+} ddt_log_kstat_t;
+
+static const ddt_log_kstat_t ddt_log_kstat_template = {
+	/* entries waiting to be flushed to the ZAPs */
+	{ "entries",			KSTAT_DATA_UINT64 },
+	{ "mem_bytes",			KSTAT_DATA_UINT64 },
+	/* size of the on-disk logs */
+	{ "log_bytes",			KSTAT_DATA_UINT64 },
+	{ "appended",			KSTAT_DATA_UINT64 },
+	{ "flushed",			KSTAT_DATA_UINT64 },
+	/* unique entries flushed early to stay under the memory cap */
+	{ "pruned",			KSTAT_DATA_UINT64 },
+	{ "compactions",		KSTAT_DATA_UINT64 },
+};
+
+static int
+ddt_log_kstat_update(kstat_t *ksp, int rw)
+{
+	spa_t *spa = ksp->ks_private;
+	ddt_log_kstat_t *dlk = ksp->ks_data;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	bcopy(&ddt_log_kstat_template, dlk, sizeof (ddt_log_kstat_t));
+	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		ddt_t *ddt = spa->spa_ddt[c];
+		uint64_t entries;
+
+		if (ddt == NULL)
+			continue;
+		entries = avl_numnodes(&ddt->ddt_log_tree);
+		dlk->dlk_entries.value.ui64 += entries;
+		dlk->dlk_mem_bytes.value.ui64 +=
+		    entries * sizeof (ddt_log_entry_t);
+		dlk->dlk_log_bytes.value.ui64 += ddt->ddt_log_length;
+		dlk->dlk_appended.value.ui64 += ddt->ddt_log_appended;
+		dlk->dlk_flushed.value.ui64 += ddt->ddt_log_flushed;
+		dlk->dlk_pruned.value.ui64 += ddt->ddt_log_pruned;
+		dlk->dlk_compactions.value.ui64 += ddt->ddt_log_compactions;
+	}
+
+	return (0);
+}
+
 void
 ddt_create(spa_t *spa)
 {
@@ -834,6 +997,103 @@ ddt_create(spa_t *spa)
 
 	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++)
 		spa->spa_ddt[c] = ddt_table_alloc(spa, c);
+
+	spa->spa_ddt_log_kstat = kstat_create(spa_name(spa), 0, "ddt_log",
+	    "misc", KSTAT_TYPE_NAMED,
+	    sizeof (ddt_log_kstat_t) / sizeof (kstat_named_t), 0);
+	if (spa->spa_ddt_log_kstat != NULL) {
+		bcopy(&ddt_log_kstat_template, spa->spa_ddt_log_kstat->ks_data,
+		    sizeof (ddt_log_kstat_t));
+		spa->spa_ddt_log_kstat->ks_private = spa;
+		spa->spa_ddt_log_kstat->ks_update = ddt_log_kstat_update;
+		kstat_install(spa->spa_ddt_log_kstat);
+	}
+}
+
+/*
+ * Replay the on-disk DDT log into the in-core log tree.  Later records
+ * supersede earlier ones for the same key.  Once the latest state of each
+ * entry is known, find where it currently lives in the ZAPs so that the
+ * flush can move or remove it.
+ */
+static int
+ddt_log_load(ddt_t *ddt)
+{
+	char name[DDT_NAMELEN];
+	uint64_t val[2];
+	ddt_log_record_t *buf;
+	ddt_log_entry_t *dle;
+	ddt_entry_t *dde;
+	avl_index_t where;
+	int error;
+
+	ddt_log_name(ddt, name);
+
+	error = zap_lookup(ddt->ddt_os, DMU_POOL_DIRECTORY_OBJECT, name,
+	    sizeof (uint64_t), 2, val);
+	if (error != 0)
+		return (error == ENOENT ? 0 : error);
+
+	ddt->ddt_log_object = val[0];
+	ddt->ddt_log_length = val[1];
+
+	buf = zio_buf_alloc(SPA_OLD_MAXBLOCKSIZE);
+	for (uint64_t off = 0; off < ddt->ddt_log_length;
+	    off += DDT_LOG_BUF_SIZE) {
+		uint64_t size = MIN(DDT_LOG_BUF_SIZE,
+		    ddt->ddt_log_length - off);
+
+		error = dmu_read(ddt->ddt_os, ddt->ddt_log_object, off, size,
+		    buf, DMU_READ_PREFETCH);
+		if (error != 0)
+			break;
+
+		for (int i = 0; i < size / sizeof (ddt_log_record_t); i++) {
+			ddt_log_entry_t dle_search;
+
+			dle_search.dle_key = buf[i].dlr_key;
+			dle = avl_find(&ddt->ddt_log_tree, &dle_search, &where);
+			if (dle == NULL) {
+				dle = kmem_zalloc(sizeof (*dle), KM_SLEEP);
+				dle->dle_key = buf[i].dlr_key;
+				avl_insert(&ddt->ddt_log_tree, dle, where);
+			}
+			bcopy(buf[i].dlr_phys, dle->dle_phys,
+			    sizeof (dle->dle_phys));
+		}
+	}
+	zio_buf_free(buf, SPA_OLD_MAXBLOCKSIZE);
+
+	if (error != 0)
+		return (error);
+
+	dde = ddt_alloc(&ddt->ddt_log_cursor);
+	for (dle = avl_first(&ddt->ddt_log_tree); dle != NULL;
+	    dle = AVL_NEXT(&ddt->ddt_log_tree, dle)) {
+		enum ddt_type type;
+		enum ddt_class class;
+
+		dde->dde_key = dle->dle_key;
+		error = ENOENT;
+		for (type = 0; type < DDT_TYPES; type++) {
+			for (class = 0; class < DDT_CLASSES; class++) {
+				error = ddt_object_lookup(ddt, type, class,
+				    dde);
+				if (error != ENOENT)
+					break;
+			}
+			if (error != ENOENT)
+				break;
+		}
+		if (error != 0 && error != ENOENT)
+			break;
+		dle->dle_type = type;
+		dle->dle_class = class;
+		error = 0;
+	}
+	ddt_free(dde);
+
+	return (error);
 }
 
 int
@@ -861,6 +1121,10 @@ ddt_load(spa_t *spa)
 			}
 		}
 
+		error = ddt_log_load(ddt);
+		if (error != 0)
+			return (error);
+
 		/*
 		 * Seed the cached histograms.
 		 */
@@ -874,6 +1138,11 @@ ddt_load(spa_t *spa)
 void
 ddt_unload(spa_t *spa)
 {
+	if (spa->spa_ddt_log_kstat != NULL) {
+		kstat_delete(spa->spa_ddt_log_kstat);
+		spa->spa_ddt_log_kstat = NULL;
+	}
+
 	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
 		if (spa->spa_ddt[c]) {
 			ddt_table_free(spa->spa_ddt[c]);
@@ -898,6 +1167,17 @@ ddt_class_contains(spa_t *spa, enum ddt_class max_class, const blkptr_t *bp)
 
 	ddt_key_fill(&dde.dde_key, bp);
 
+	/*
+	 * ddt_walk() only visits the ZAPs, so a block whose latest state is
+	 * still in the DDT log must be visited by the regular traversal.
+	 */
+	ddt_enter(ddt);
+	if (ddt_log_find(ddt, &dde.dde_key) != NULL) {
+		ddt_exit(ddt);
+		return (B_FALSE);
+	}
+	ddt_exit(ddt);
+
 	for (enum ddt_type type = 0; type < DDT_TYPES; type++)
 		for (enum ddt_class class = 0; class <= max_class; class++)
 			if (ddt_object_lookup(ddt, type, class, &dde) == 0)
@@ -911,11 +1191,23 @@ ddt_repair_start(ddt_t *ddt, const blkptr_t *bp)
 {
 	ddt_key_t ddk;
 	ddt_entry_t *dde;
+	ddt_log_entry_t *dle;
 
 	ddt_key_fill(&ddk, bp);
 
 	dde = ddt_alloc(&ddk);
 
+	ddt_enter(ddt);
+	if ((dle = ddt_log_find(ddt, &ddk)) != NULL) {
+		if (ddt_phys_class(dle->dle_phys) < DDT_CLASS_UNIQUE) {
+			bcopy(dle->dle_phys, dde->dde_phys,
+			    sizeof (dde->dde_phys));
+		}
+		ddt_exit(ddt);
+		return (dde);
+	}
+	ddt_exit(ddt);
+
 	for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
 		for (enum ddt_class class = 0; class < DDT_CLASSES; class++) {
 			/*
@@ -1011,7 +1303,253 @@ ddt_repair_table(ddt_t *ddt, zio_t *rio)
 }
 
 static void
-ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
+ddt_log_create(ddt_t *ddt, dmu_tx_t *tx)
+{
+	char name[DDT_NAMELEN];
+	uint64_t val[2];
+
+	ASSERT0(ddt->ddt_log_object);
+	ASSERT0(ddt->ddt_log_length);
+
+	ddt_log_name(ddt, name);
+
+	ddt->ddt_log_object = dmu_object_alloc(ddt->ddt_os,
+	    DMU_OTN_UINT64_METADATA, SPA_OLD_MAXBLOCKSIZE, DMU_OT_NONE, 0, tx);
+	val[0] = ddt->ddt_log_object;
+	val[1] = 0;
+	VERIFY0(zap_add(ddt->ddt_os, DMU_POOL_DIRECTORY_OBJECT, name,
+	    sizeof (uint64_t), 2, val, tx));
+	spa_feature_incr(ddt->ddt_spa, SPA_FEATURE_DDT_LOG, tx);
+}
+
+static void
+ddt_log_destroy(ddt_t *ddt, dmu_tx_t *tx)
+{
+	char name[DDT_NAMELEN];
+
+	ASSERT(ddt->ddt_log_object != 0);
+
+	ddt_log_name(ddt, name);
+
+	VERIFY0(zap_remove(ddt->ddt_os, DMU_POOL_DIRECTORY_OBJECT, name, tx));
+	VERIFY0(dmu_object_free(ddt->ddt_os, ddt->ddt_log_object, tx));
+	spa_feature_decr(ddt->ddt_spa, SPA_FEATURE_DDT_LOG, tx);
+
+	ddt->ddt_log_object = 0;
+	ddt->ddt_log_length = 0;
+}
+
+/*
+ * Write out the buffered log records at the end of the log.
+ */
+static void
+ddt_log_write(ddt_t *ddt, dmu_tx_t *tx)
+{
+	uint64_t size = ddt->ddt_log_buf_count * sizeof (ddt_log_record_t);
+
+	if (size == 0)
+		return;
+
+	if (ddt->ddt_log_object == 0)
+		ddt_log_create(ddt, tx);
+
+	dmu_write(ddt->ddt_os, ddt->ddt_log_object, ddt->ddt_log_length, size,
+	    ddt->ddt_log_buf, tx);
+	ddt->ddt_log_length += size;
+	ddt->ddt_log_buf_count = 0;
+}
+
+static void
+ddt_log_append(ddt_t *ddt, ddt_log_entry_t *dle, dmu_tx_t *tx)
+{
+	ddt_log_record_t *dlr;
+
+	if (ddt->ddt_log_buf == NULL)
+		ddt->ddt_log_buf = zio_buf_alloc(SPA_OLD_MAXBLOCKSIZE);
+
+	dlr = &ddt->ddt_log_buf[ddt->ddt_log_buf_count++];
+	dlr->dlr_key = dle->dle_key;
+	bcopy(dle->dle_phys, dlr->dlr_phys, sizeof (dlr->dlr_phys));
+	ddt->ddt_log_appended++;
+
+	if (ddt->ddt_log_buf_count == DDT_LOG_BUF_RECORDS)
+		ddt_log_write(ddt, tx);
+}
+
+/*
+ * Record the new state of an entry in the in-core DDT log, and on disk if
+ * append is set.  otype and oclass are where the entry was found in the
+ * ZAPs, which only matters if it was not already in the log.
+ */
+static void
+ddt_log_update(ddt_t *ddt, ddt_entry_t *dde, enum ddt_type otype,
+    enum ddt_class oclass, boolean_t append, dmu_tx_t *tx)
+{
+	ddt_log_entry_t *dle, dle_search;
+	avl_index_t where;
+
+	dle_search.dle_key = dde->dde_key;
+
+	ddt_enter(ddt);
+	dle = avl_find(&ddt->ddt_log_tree, &dle_search, &where);
+	if (dle == NULL) {
+		if (otype == DDT_TYPES &&
+		    ddt_phys_class(dde->dde_phys) == DDT_CLASSES) {
+			ddt_exit(ddt);
+			return;
+		}
+		dle = kmem_zalloc(sizeof (*dle), KM_SLEEP);
+		dle->dle_key = dde->dde_key;
+		dle->dle_type = otype;
+		dle->dle_class = oclass;
+		avl_insert(&ddt->ddt_log_tree, dle, where);
+	}
+	bcopy(dde->dde_phys, dle->dle_phys, sizeof (dle->dle_phys));
+	ddt_exit(ddt);
+
+	if (append)
+		ddt_log_append(ddt, dle, tx);
+}
+
+/*
+ * Write a log entry back to the ZAPs and drop it from the log.  The ZAP is
+ * updated before the entry leaves the log tree so that concurrent lookups
+ * always find the latest state in one or the other.
+ */
+static void
+ddt_log_flush_entry(ddt_t *ddt, ddt_log_entry_t *dle, ddt_entry_t *dde,
+    dmu_tx_t *tx)
+{
+	enum ddt_type otype = dle->dle_type;
+	enum ddt_type ntype = DDT_TYPE_CURRENT;
+	enum ddt_class oclass = dle->dle_class;
+	enum ddt_class nclass = ddt_phys_class(dle->dle_phys);
+
+	dde->dde_key = dle->dle_key;
+	bcopy(dle->dle_phys, dde->dde_phys, sizeof (dde->dde_phys));
+
+	if (otype != DDT_TYPES &&
+	    (otype != ntype || oclass != nclass || nclass == DDT_CLASSES)) {
+		VERIFY(ddt_object_remove(ddt, otype, oclass, dde, tx) == 0);
+		ASSERT(ddt_object_lookup(ddt, otype, oclass, dde) == ENOENT);
+	}
+
+	if (nclass != DDT_CLASSES) {
+		ASSERT(ddt_object_exists(ddt, ntype, nclass));
+		VERIFY(ddt_object_update(ddt, ntype, nclass, dde, tx) == 0);
+	}
+
+	ddt_enter(ddt);
+	avl_remove(&ddt->ddt_log_tree, dle);
+	ddt_exit(ddt);
+	kmem_free(dle, sizeof (*dle));
+	ddt->ddt_log_flushed++;
+}
+
+/*
+ * Flush up to budget log entries to the ZAPs, continuing in key order from
+ * where the previous txg stopped so that ZAP leaves are visited
+ * sequentially.  If the log is over its memory cap, unique entries are
+ * pruned first, and whatever remains over the cap is added to the budget.
+ * Only the syncing thread changes the log tree, so it is walked unlocked.
+ */
+static void
+ddt_log_flush(ddt_t *ddt, uint64_t budget, dmu_tx_t *tx)
+{
+	avl_tree_t *t = &ddt->ddt_log_tree;
+	uint64_t max = zfs_ddt_log_mem_max / sizeof (ddt_log_entry_t);
+	ddt_log_entry_t *dle, *dle_next, dle_search;
+	ddt_entry_t *dde;
+	avl_index_t where;
+
+	if (avl_numnodes(t) == 0)
+		return;
+
+	dde = ddt_alloc(&ddt->ddt_log_cursor);
+
+	if (avl_numnodes(t) > max) {
+		uint64_t excess = avl_numnodes(t) - max;
+
+		for (dle = avl_first(t); dle != NULL && excess > 0;
+		    dle = dle_next) {
+			dle_next = AVL_NEXT(t, dle);
+			if (ddt_phys_class(dle->dle_phys) < DDT_CLASS_UNIQUE)
+				continue;
+			ddt_log_flush_entry(ddt, dle, dde, tx);
+			ddt->ddt_log_pruned++;
+			excess--;
+		}
+		budget = MAX(budget, excess);
+	}
+
+	dle_search.dle_key = ddt->ddt_log_cursor;
+	dle = avl_find(t, &dle_search, &where);
+	if (dle == NULL)
+		dle = avl_nearest(t, where, AVL_AFTER);
+
+	for (; budget > 0 && avl_numnodes(t) != 0; budget--) {
+		if (dle == NULL)
+			dle = avl_first(t);
+		dle_next = AVL_NEXT(t, dle);
+		ddt_log_flush_entry(ddt, dle, dde, tx);
+		dle = dle_next;
+	}
+
+	if (dle != NULL)
+		ddt->ddt_log_cursor = dle->dle_key;
+	else
+		bzero(&ddt->ddt_log_cursor, sizeof (ddt_key_t));
+
+	ddt_free(dde);
+}
+
+/*
+ * Bring the on-disk log in line with the in-core one at the end of a pass:
+ * drop it once every entry has been flushed, rewrite it from the log tree
+ * once it is mostly superseded records, and record its length.
+ */
+static void
+ddt_log_sync(ddt_t *ddt, dmu_tx_t *tx)
+{
+	char name[DDT_NAMELEN];
+	uint64_t entries = avl_numnodes(&ddt->ddt_log_tree);
+	uint64_t val[2];
+
+	if (entries == 0) {
+		ddt->ddt_log_buf_count = 0;
+		if (ddt->ddt_log_object != 0)
+			ddt_log_destroy(ddt, tx);
+		return;
+	}
+
+	ddt_log_write(ddt, tx);
+
+	if (ddt->ddt_log_length > zfs_ddt_log_compact_min &&
+	    ddt->ddt_log_length / sizeof (ddt_log_record_t) >
+	    entries * zfs_ddt_log_compact_ratio) {
+		dmu_free_range(ddt->ddt_os, ddt->ddt_log_object, 0,
+		    DMU_OBJECT_END, tx);
+		ddt->ddt_log_length = 0;
+		for (ddt_log_entry_t *dle = avl_first(&ddt->ddt_log_tree);
+		    dle != NULL; dle = AVL_NEXT(&ddt->ddt_log_tree, dle))
+			ddt_log_append(ddt, dle, tx);
+		ddt_log_write(ddt, tx);
+		ddt->ddt_log_compactions++;
+	}
+
+	if (ddt->ddt_log_object == 0)
+		return;
+
+	ddt_log_name(ddt, name);
+	val[0] = ddt->ddt_log_object;
+	val[1] = ddt->ddt_log_length;
+	VERIFY0(zap_update(ddt->ddt_os, DMU_POOL_DIRECTORY_OBJECT, name,
+	    sizeof (uint64_t), 2, val, tx));
+}
+
+static void
+ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg,
+    boolean_t append)
 {
 	dsl_pool_t *dp = ddt->ddt_spa->spa_dsl_pool;
 	ddt_phys_t *ddp = dde->dde_phys;
@@ -1049,19 +1587,12 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 	else
 		nclass = DDT_CLASS_UNIQUE;
 
-	if (otype != DDT_TYPES &&
-	    (otype != ntype || oclass != nclass || total_refcnt == 0)) {
-		VERIFY(ddt_object_remove(ddt, otype, oclass, dde, tx) == 0);
-		ASSERT(ddt_object_lookup(ddt, otype, oclass, dde) == ENOENT);
-	}
-
 	if (total_refcnt != 0) {
 		dde->dde_type = ntype;
 		dde->dde_class = nclass;
 		ddt_stat_update(ddt, dde, 0);
 		if (!ddt_object_exists(ddt, ntype, nclass))
 			ddt_object_create(ddt, ntype, nclass, tx);
-		VERIFY(ddt_object_update(ddt, ntype, nclass, dde, tx) == 0);
 
 		/*
 		 * If the class changes, the order that we scan this bp
@@ -1075,6 +1606,11 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 			    ddt->ddt_checksum, dde, tx);
 		}
 	}
+
+	/*
+	 * The ZAPs are updated when the entry is flushed from the log.
+	 */
+	ddt_log_update(ddt, dde, otype, oclass, append, tx);
 }
 
 static void
@@ -1083,8 +1619,11 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 	spa_t *spa = ddt->ddt_spa;
 	ddt_entry_t *dde;
 	void *cookie = NULL;
+	uint64_t budget;
+	boolean_t append;
 
-	if (avl_numnodes(&ddt->ddt_tree) == 0)
+	if (avl_numnodes(&ddt->ddt_tree) == 0 &&
+	    (avl_numnodes(&ddt->ddt_log_tree) == 0 || spa_sync_pass(spa) > 1))
 		return;
 
 	ASSERT(spa->spa_uberblock.ub_version >= SPA_VERSION_DEDUP);
@@ -1095,11 +1634,27 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 		    DMU_POOL_DDT_STATS, tx);
 	}
 
+	/*
+	 * Changes only go through the on-disk log when they would not all
+	 * be flushed in this txg anyway.  Later passes add to the log but
+	 * leave flushing to the next txg.
+	 */
+	budget = spa_sync_pass(spa) == 1 ? zfs_ddt_log_flush_entries : 0;
+	append = zfs_ddt_log_enabled &&
+	    spa_feature_is_enabled(spa, SPA_FEATURE_DDT_LOG) &&
+	    (avl_numnodes(&ddt->ddt_log_tree) != 0 ||
+	    avl_numnodes(&ddt->ddt_tree) > budget);
+	if (!append)
+		budget = UINT64_MAX;
+
 	while ((dde = avl_destroy_nodes(&ddt->ddt_tree, &cookie)) != NULL) {
-		ddt_sync_entry(ddt, dde, tx, txg);
+		ddt_sync_entry(ddt, dde, tx, txg, append);
 		ddt_free(dde);
 	}
 
+	ddt_log_flush(ddt, budget, tx);
+	ddt_log_sync(ddt, tx);
+
 	for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
 		uint64_t count = 0;
 		for (enum ddt_class class = 0; class < DDT_CLASSES; class++) {
@@ -1109,7 +1664,9 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 			}
 		}
 		for (enum ddt_class class = 0; class < DDT_CLASSES; class++) {
-			if (count == 0 && ddt_object_exists(ddt, type, class))
+			if (count == 0 &&
+			    avl_numnodes(&ddt->ddt_log_tree) == 0 &&
+			    ddt_object_exists(ddt, type, class))
 				ddt_object_destroy(ddt, type, class, tx);
 		}
 	}
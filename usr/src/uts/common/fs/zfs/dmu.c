@@ -1412,19 +1412,141 @@ xuio_stat_wbuf_nocopy(void)
 }
 
 #ifdef _KERNEL
-int
-dmu_read_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size)
+/*
+ * Ask for a dbuf to be destroyed, rather than placed in the dbuf cache,
+ * when its last hold is released.  Used for streaming reads (see
+ * DMU_READ_NO_CACHE) which are not expected to touch the data again: the
+ * block stays cached in the ARC, where it may be held compressed, and we
+ * avoid keeping a second, uncompressed copy of it in the dbuf cache.
+ */
+static void
+dmu_buf_set_pending_evict(dmu_buf_t *db)
+{
+	dmu_buf_impl_t *dbi = (dmu_buf_impl_t *)db;
+
+	mutex_enter(&dbi->db_mtx);
+	if (dbi->db_dirtycnt == 0)
+		dbi->db_pending_evict = TRUE;
+	mutex_exit(&dbi->db_mtx);
+}
+
+static void
+dmu_buf_set_uncached(dmu_buf_t *db)
+{
+	dmu_buf_impl_t *dbi = (dmu_buf_impl_t *)db;
+
+	mutex_enter(&dbi->db_mtx);
+	dbi->db_uncached = TRUE;
+	mutex_exit(&dbi->db_mtx);
+}
+
+/*
+ * Direct I/O read (DMU_DIRECTIO).  Blocks which are neither cached nor
+ * dirty are read with zio_read() straight into a private buffer, so they
+ * never enter the ARC.  Blocks the DMU already knows about (cached, being
+ * read, dirty, holes, embedded or encrypted) are read through their dbufs
+ * as usual, to stay coherent with any in-flight writes, but are marked
+ * uncached so they leave the ARC again once released.
+ *
+ * The caller holds a range lock covering the read, so the block pointers
+ * we sample cannot be rewritten underneath us.
+ */
+static int
+dmu_read_uio_direct(dnode_t *dn, uio_t *uio, uint64_t size)
+{
+	spa_t *spa = dn->dn_objset->os_spa;
+	dmu_buf_t **dbp;
+	abd_t **abds;
+	int numbufs, i, err;
+	zio_t *rio;
+
+	err = dmu_buf_hold_array_by_dnode(dn, uio->uio_loffset, size,
+	    FALSE, FTAG, &numbufs, &dbp, DMU_READ_NO_PREFETCH);
+	if (err)
+		return (err);
+
+	abds = kmem_zalloc(numbufs * sizeof (abd_t *), KM_SLEEP);
+	rio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	for (i = 0; i < numbufs; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		zbookmark_phys_t zb;
+		blkptr_t bp;
+
+		mutex_enter(&db->db_mtx);
+		if (db->db_state != DB_UNCACHED || db->db_dirtycnt != 0 ||
+		    db->db_blkptr == NULL || BP_IS_HOLE(db->db_blkptr) ||
+		    BP_IS_EMBEDDED(db->db_blkptr) ||
+		    BP_USES_CRYPT(db->db_blkptr)) {
+			db->db_uncached = TRUE;
+			mutex_exit(&db->db_mtx);
+			(void) dbuf_read(db, rio, DB_RF_CANFAIL |
+			    DB_RF_NEVERWAIT | DB_RF_NOPREFETCH);
+			continue;
+		}
+		bp = *db->db_blkptr;
+		mutex_exit(&db->db_mtx);
+
+		SET_BOOKMARK(&zb, dmu_objset_id(dn->dn_objset),
+		    dn->dn_object, 0, db->db_blkid);
+		abds[i] = abd_alloc_linear(db->db.db_size, B_FALSE);
+		zio_nowait(zio_read(rio, spa, &bp, abds[i], db->db.db_size,
+		    NULL, NULL, ZIO_PRIORITY_SYNC_READ, ZIO_FLAG_CANFAIL, &zb));
+	}
+	err = zio_wait(rio);
+
+	for (i = 0; i < numbufs && err == 0; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		int bufoff, tocpy;
+		void *data;
+
+		if (abds[i] != NULL) {
+			data = abd_to_buf(abds[i]);
+		} else {
+			mutex_enter(&db->db_mtx);
+			while (db->db_state == DB_READ ||
+			    db->db_state == DB_FILL)
+				cv_wait(&db->db_changed, &db->db_mtx);
+			if (db->db_state == DB_UNCACHED)
+				err = SET_ERROR(EIO);
+			mutex_exit(&db->db_mtx);
+			if (err)
+				break;
+			data = db->db.db_data;
+		}
+
+		bufoff = uio->uio_loffset - db->db.db_offset;
+		tocpy = (int)MIN(db->db.db_size - bufoff, size);
+		err = uiomove((char *)data + bufoff, tocpy, UIO_READ, uio);
+		size -= tocpy;
+	}
+
+	for (i = 0; i < numbufs; i++) {
+		if (abds[i] != NULL)
+			abd_free(abds[i]);
+	}
+	kmem_free(abds, numbufs * sizeof (abd_t *));
+	dmu_buf_rele_array(dbp, numbufs, FTAG);
+
+	return (err);
+}
+
+static int
+dmu_read_uio_dnode_impl(dnode_t *dn, uio_t *uio, uint64_t size,
+    uint32_t flags)
 {
 	dmu_buf_t **dbp;
 	int numbufs, i, err;
 	xuio_t *xuio = NULL;
 
+	if ((flags & DMU_DIRECTIO) && uio->uio_extflg != UIO_XUIO)
+		return (dmu_read_uio_direct(dn, uio, size));
+
 	/*
 	 * NB: we could do this block-at-a-time, but it's nice
 	 * to be reading in parallel.
 	 */
 	err = dmu_buf_hold_array_by_dnode(dn, uio->uio_loffset, size,
-	    TRUE, FTAG, &numbufs, &dbp, 0);
+	    TRUE, FTAG, &numbufs, &dbp, flags);
 	if (err)
 		return (err);
 
@@ -1462,6 +1584,9 @@ dmu_read_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size)
 		if (err)
 			break;
 
+		if ((flags & DMU_READ_NO_CACHE) && xuio == NULL)
+			dmu_buf_set_pending_evict(db);
+
 		size -= tocpy;
 	}
 	dmu_buf_rele_array(dbp, numbufs, FTAG);
@@ -1469,6 +1594,12 @@ dmu_read_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size)
 	return (err);
 }
 
+int
+dmu_read_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size)
+{
+	return (dmu_read_uio_dnode_impl(dn, uio, size, DMU_READ_PREFETCH));
+}
+
 /*
  * Read 'size' bytes into the uio buffer.
  * From object zdb->db_object.
@@ -1479,7 +1610,8 @@ dmu_read_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size)
  * because we don't have to find the dnode_t for the object.
  */
 int
-dmu_read_uio_dbuf(dmu_buf_t *zdb, uio_t *uio, uint64_t size)
+dmu_read_uio_dbuf_flags(dmu_buf_t *zdb, uio_t *uio, uint64_t size,
+    uint32_t flags)
 {
 	dmu_buf_impl_t *db = (dmu_buf_impl_t *)zdb;
 	dnode_t *dn;
@@ -1490,12 +1622,18 @@ dmu_read_uio_dbuf(dmu_buf_t *zdb, uio_t *uio, uint64_t size)
 
 	DB_DNODE_ENTER(db);
 	dn = DB_DNODE(db);
-	err = dmu_read_uio_dnode(dn, uio, size);
+	err = dmu_read_uio_dnode_impl(dn, uio, size, flags);
 	DB_DNODE_EXIT(db);
 
 	return (err);
 }
 
+int
+dmu_read_uio_dbuf(dmu_buf_t *zdb, uio_t *uio, uint64_t size)
+{
+	return (dmu_read_uio_dbuf_flags(zdb, uio, size, DMU_READ_PREFETCH));
+}
+
 /*
  * Read 'size' bytes into the uio buffer.
  * From the specified object
@@ -1521,8 +1659,9 @@ dmu_read_uio(objset_t *os, uint64_t object, uio_t *uio, uint64_t size)
 	return (err);
 }
 
-int
-dmu_write_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size, dmu_tx_t *tx)
+static int
+dmu_write_uio_dnode_impl(dnode_t *dn, uio_t *uio, uint64_t size,
+    dmu_tx_t *tx, uint32_t flags)
 {
 	dmu_buf_t **dbp;
 	int numbufs;
@@ -1563,6 +1702,9 @@ dmu_write_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size, dmu_tx_t *tx)
 		if (tocpy == db->db_size)
 			dmu_buf_fill_done(db, tx);
 
+		if (flags & DMU_DIRECTIO)
+			dmu_buf_set_uncached(db);
+
 		if (err)
 			break;
 
@@ -1573,6 +1715,12 @@ dmu_write_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size, dmu_tx_t *tx)
 	return (err);
 }
 
+int
+dmu_write_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size, dmu_tx_t *tx)
+{
+	return (dmu_write_uio_dnode_impl(dn, uio, size, tx, 0));
+}
+
 /*
  * Write 'size' bytes from the uio buffer.
  * To object zdb->db_object.
@@ -1585,6 +1733,20 @@ dmu_write_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size, dmu_tx_t *tx)
 int
 dmu_write_uio_dbuf(dmu_buf_t *zdb, uio_t *uio, uint64_t size,
     dmu_tx_t *tx)
+{
+	return (dmu_write_uio_dbuf_flags(zdb, uio, size, tx, 0));
+}
+
+/*
+ * As dmu_write_uio_dbuf(), but with DMU_DIRECTIO the written dbufs are
+ * marked uncached: the data still moves through the dirty dbufs (it must
+ * be checksummed, compressed and written in syncing context like any
+ * other), but once the txg has synced and the last hold is dropped both
+ * the dbuf and its ARC buffer are evicted.
+ */
+int
+dmu_write_uio_dbuf_flags(dmu_buf_t *zdb, uio_t *uio, uint64_t size,
+    dmu_tx_t *tx, uint32_t flags)
 {
 	dmu_buf_impl_t *db = (dmu_buf_impl_t *)zdb;
 	dnode_t *dn;
@@ -1595,7 +1757,7 @@ dmu_write_uio_dbuf(dmu_buf_t *zdb, uio_t *uio, uint64_t size,
 
 	DB_DNODE_ENTER(db);
 	dn = DB_DNODE(db);
-	err = dmu_write_uio_dnode(dn, uio, size, tx);
+	err = dmu_write_uio_dnode_impl(dn, uio, size, tx, flags);
 	DB_DNODE_EXIT(db);
 
 	return (err);
@@ -22,6 +22,7 @@
  * Copyright (c) 2005, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright (c) 2013, 2017 by Delphix. All rights reserved.
  * Copyright 2014 HybridCluster. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/dbuf.h>
@@ -88,10 +89,9 @@ dmu_object_alloc_impl(objset_t *os, dmu_object_type_t ot, int blocksize,
 		    (P2PHASE(object + dn_slots - 1, dnodes_per_chunk) <
 		    dn_slots)) {
 			DNODE_STAT_BUMP(dnode_alloc_next_chunk);
-			mutex_enter(&os->os_obj_lock);
-			ASSERT0(P2PHASE(os->os_obj_next_chunk,
-			    dnodes_per_chunk));
-			object = os->os_obj_next_chunk;
+			object = atomic_add_64_nv(&os->os_obj_next_chunk,
+			    dnodes_per_chunk) - dnodes_per_chunk;
+			ASSERT0(P2PHASE(object, dnodes_per_chunk));
 
 			/*
 			 * Each time we polish off a L1 bp worth of dnodes
@@ -119,8 +119,17 @@ dmu_object_alloc_impl(objset_t *os, dmu_object_type_t ot, int blocksize,
 			 * to this algorithm should preserve that property
 			 * or find another solution to the issues described
 			 * in traverse_visitbp.
+			 *
+			 * The search can read indirect blocks of the
+			 * metadnode, so it is done by only one thread at a
+			 * time, under os_obj_lock, while every other thread
+			 * goes on taking fresh chunks past the end of the
+			 * L1 block without waiting.  A thread which finds
+			 * the search already under way simply uses the
+			 * chunk it was given.
 			 */
-			if (P2PHASE(object, L1_dnode_count) == 0) {
+			if (P2PHASE(object, L1_dnode_count) == 0 &&
+			    mutex_tryenter(&os->os_obj_lock)) {
 				uint64_t offset;
 				uint64_t blkfill;
 				int minlvl;
@@ -139,16 +148,19 @@ dmu_object_alloc_impl(objset_t *os, dmu_object_type_t ot, int blocksize,
 				if (error == 0) {
 					object = offset >> DNODE_SHIFT;
 				}
+				/*
+				 * Note: if "restarted", we may find a L0
+				 * that is not suitably aligned.  Chunks
+				 * handed out while we searched may end up
+				 * overlapping later ones; the allocation
+				 * below tolerates that as an ordinary race.
+				 */
+				(void) atomic_swap_64(&os->os_obj_next_chunk,
+				    P2ALIGN(object, dnodes_per_chunk) +
+				    dnodes_per_chunk);
+				mutex_exit(&os->os_obj_lock);
 			}
-			/*
-			 * Note: if "restarted", we may find a L0 that
-			 * is not suitably aligned.
-			 */
-			os->os_obj_next_chunk =
-			    P2ALIGN(object, dnodes_per_chunk) +
-			    dnodes_per_chunk;
 			(void) atomic_swap_64(cpuobj, object);
-			mutex_exit(&os->os_obj_lock);
 		}
 
 		/*
@@ -23,7 +23,7 @@
  * Copyright (c) 2005, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright (c) 2012, 2017 by Delphix. All rights reserved.
  * Copyright (c) 2013 by Saso Kiselkov. All rights reserved.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2014 Spectra Logic Corporation, All rights reserved.
  * Copyright (c) 2015, STRATO AG, Inc. All rights reserved.
  * Copyright (c) 2014 Integros [integros.com]
@@ -252,6 +252,20 @@ secondary_cache_changed_cb(void *arg, uint64_t newval)
 	os->os_secondary_cache = newval;
 }
 
+static void
+direct_changed_cb(void *arg, uint64_t newval)
+{
+	objset_t *os = arg;
+
+	/*
+	 * Inheritance and range checking should have been done by now.
+	 */
+	ASSERT(newval == ZFS_DIRECT_STANDARD ||
+	    newval == ZFS_DIRECT_ALWAYS || newval == ZFS_DIRECT_DISABLED);
+
+	os->os_direct = newval;
+}
+
 static void
 sync_changed_cb(void *arg, uint64_t newval)
 {
@@ -544,6 +558,11 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 				    zfs_prop_to_name(ZFS_PROP_SYNC),
 				    sync_changed_cb, os);
 			}
+			if (err == 0) {
+				err = dsl_prop_register(ds,
+				    zfs_prop_to_name(ZFS_PROP_DIRECT),
+				    direct_changed_cb, os);
+			}
 			if (err == 0) {
 				err = dsl_prop_register(ds,
 				    zfs_prop_to_name(
@@ -584,6 +603,7 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 		os->os_dedup_verify = B_FALSE;
 		os->os_logbias = ZFS_LOGBIAS_LATENCY;
 		os->os_sync = ZFS_SYNC_STANDARD;
+		os->os_direct = ZFS_DIRECT_STANDARD;
 		os->os_primary_cache = ZFS_CACHE_ALL;
 		os->os_secondary_cache = ZFS_CACHE_ALL;
 		os->os_dnodesize = DNODE_MIN_SIZE;
@@ -634,6 +654,8 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 
 	mutex_init(&os->os_upgrade_lock, NULL, MUTEX_DEFAULT, NULL);
 
+	zfetch_os_init(os);
+
 	*osp = os;
 	return (0);
 }
@@ -961,6 +983,7 @@ dmu_objset_evict_done(objset_t *os)
 		dnode_special_close(&os->os_groupused_dnode);
 	}
 	zil_free(os->os_zil);
+	zfetch_os_fini(os);
 
 	arc_buf_destroy(os->os_phys_buf, &os->os_phys_buf);
 
@@ -1611,17 +1634,67 @@ dmu_objset_write_done(zio_t *zio, arc_buf_t *abuf, void *arg)
 	kmem_free(bp, sizeof (*bp));
 }
 
+/*
+ * State shared by the tasks syncing the dirty dnodes of one objset.  The
+ * last task to finish issues the objset's root block write.
+ */
+typedef struct sync_objset_arg {
+	objset_t *soa_os;
+	dmu_tx_t *soa_tx;
+	zio_t *soa_zio;
+	uint_t soa_count;
+} sync_objset_arg_t;
+
 typedef struct sync_dnodes_arg {
 	multilist_t *sda_list;
 	int sda_sublist_idx;
 	multilist_t *sda_newlist;
 	dmu_tx_t *sda_tx;
+	sync_objset_arg_t *sda_soa;
 } sync_dnodes_arg_t;
 
+/*
+ * Finish syncing an objset once all of its dirty dnodes have been synced:
+ * issue the writes of the meta-dnode's blocks, free intent log blocks up to
+ * this txg, and issue the write of the root block itself.
+ */
+static void
+sync_objset_done(sync_objset_arg_t *soa)
+{
+	objset_t *os = soa->soa_os;
+	dmu_tx_t *tx = soa->soa_tx;
+	list_t *list;
+	dbuf_dirty_record_t *dr;
+
+	list = &DMU_META_DNODE(os)->dn_dirty_records[tx->tx_txg & TXG_MASK];
+	while ((dr = list_head(list)) != NULL) {
+		ASSERT0(dr->dr_dbuf->db_level);
+		list_remove(list, dr);
+		if (dr->dr_zio)
+			zio_nowait(dr->dr_zio);
+	}
+
+	/* Enable dnode backfill if enough objects have been freed. */
+	if (os->os_freed_dnodes >= dmu_rescan_dnode_threshold) {
+		os->os_rescan_dnodes = B_TRUE;
+		os->os_freed_dnodes = 0;
+	}
+
+	/*
+	 * Free intent log blocks up to this tx.
+	 */
+	zil_sync(os->os_zil, tx);
+	os->os_phys->os_zil_header = os->os_zil_header;
+	zio_nowait(soa->soa_zio);
+
+	kmem_free(soa, sizeof (*soa));
+}
+
 static void
 sync_dnodes_task(void *arg)
 {
 	sync_dnodes_arg_t *sda = arg;
+	sync_objset_arg_t *soa = sda->sda_soa;
 
 	multilist_sublist_t *ms =
 	    multilist_sublist_lock(sda->sda_list, sda->sda_sublist_idx);
@@ -1631,10 +1704,19 @@ sync_dnodes_task(void *arg)
 	multilist_sublist_unlock(ms);
 
 	kmem_free(sda, sizeof (*sda));
+
+	if (atomic_dec_uint_nv(&soa->soa_count) == 0)
+		sync_objset_done(soa);
 }
 
 
-/* called from dsl */
+/*
+ * Called from dsl.  The dirty dnodes are synced in tasks on dp_sync_taskq,
+ * and the last of them issues the root block write, so this returns without
+ * waiting for them; the datasets of a txg are thereby synced concurrently.
+ * The root block write is a child of pio, so zio_wait(pio) still waits for
+ * all of the work.
+ */
 void
 dmu_objset_sync(objset_t *os, zio_t *pio, dmu_tx_t *tx)
 {
@@ -1642,8 +1724,8 @@ dmu_objset_sync(objset_t *os, zio_t *pio, dmu_tx_t *tx)
 	zbookmark_phys_t zb;
 	zio_prop_t zp;
 	zio_t *zio;
-	list_t *list;
-	dbuf_dirty_record_t *dr;
+	sync_objset_arg_t *soa;
+	int nsublists;
 	blkptr_t *blkptr_copy = kmem_alloc(sizeof (*os->os_rootbp), KM_SLEEP);
 	*blkptr_copy = *os->os_rootbp;
 
@@ -1732,38 +1814,23 @@ dmu_objset_sync(objset_t *os, zio_t *pio, dmu_tx_t *tx)
 		}
 	}
 
-	for (int i = 0;
-	    i < multilist_get_num_sublists(os->os_dirty_dnodes[txgoff]); i++) {
+	nsublists = multilist_get_num_sublists(os->os_dirty_dnodes[txgoff]);
+	soa = kmem_alloc(sizeof (*soa), KM_SLEEP);
+	soa->soa_os = os;
+	soa->soa_tx = tx;
+	soa->soa_zio = zio;
+	soa->soa_count = nsublists;
+
+	for (int i = 0; i < nsublists; i++) {
 		sync_dnodes_arg_t *sda = kmem_alloc(sizeof (*sda), KM_SLEEP);
 		sda->sda_list = os->os_dirty_dnodes[txgoff];
 		sda->sda_sublist_idx = i;
 		sda->sda_tx = tx;
+		sda->sda_soa = soa;
 		(void) taskq_dispatch(dmu_objset_pool(os)->dp_sync_taskq,
 		    sync_dnodes_task, sda, 0);
-		/* callback frees sda */
+		/* callback frees sda, and the last one frees soa */
 	}
-	taskq_wait(dmu_objset_pool(os)->dp_sync_taskq);
-
-	list = &DMU_META_DNODE(os)->dn_dirty_records[txgoff];
-	while ((dr = list_head(list)) != NULL) {
-		ASSERT0(dr->dr_dbuf->db_level);
-		list_remove(list, dr);
-		if (dr->dr_zio)
-			zio_nowait(dr->dr_zio);
-	}
-
-	/* Enable dnode backfill if enough objects have been freed. */
-	if (os->os_freed_dnodes >= dmu_rescan_dnode_threshold) {
-		os->os_rescan_dnodes = B_TRUE;
-		os->os_freed_dnodes = 0;
-	}
-
-	/*
-	 * Free intent log blocks up to this tx.
-	 */
-	zil_sync(os->os_zil, tx);
-	os->os_phys->os_zil_header = os->os_zil_header;
-	zio_nowait(zio);
 }
 
 boolean_t
@@ -59,6 +59,12 @@
 /* Set this tunable to TRUE to replace corrupt data with 0x2f5baddb10c */
 int zfs_send_corrupt_data = B_FALSE;
 int zfs_send_queue_length = SPA_MAXBLOCKSIZE;
+/*
+ * Bytes of block data the send prefetch thread may have read ahead of the
+ * record being written to the stream.  Set this tunable to 0 to read each
+ * block only when its record is written.
+ */
+int zfs_send_prefetch_queue_length = 16 * 1024 * 1024;
 /* Set this tunable to FALSE to disable setting of DRR_FLAG_FREERECORDS */
 int zfs_send_set_freerecords_bit = B_TRUE;
 /* Set this tunable to FALSE is disable sending unmodified spill blocks. */
@@ -83,6 +89,13 @@ struct send_thread_arg {
 	zbookmark_phys_t resume;
 };
 
+struct send_prefetch_arg {
+	bqueue_t		q;
+	bqueue_t		*from_q;	/* Records from the traversal */
+	dmu_sendarg_t		*dsa;
+	boolean_t		cancel;
+};
+
 struct send_block_record {
 	boolean_t		eos_marker; /* Marks the end of the stream */
 	blkptr_t		bp;
@@ -90,6 +103,16 @@ struct send_block_record {
 	uint8_t			indblkshift;
 	uint16_t		datablkszsec;
 	bqueue_node_t		ln;
+
+	/*
+	 * The block's data, once send_read_block() has been called.  The
+	 * lock and cv are only initialized if io_issued is set.
+	 */
+	kmutex_t		lock;
+	kcondvar_t		cv;
+	boolean_t		io_issued;
+	boolean_t		io_outstanding;
+	arc_buf_t		*abuf;
 };
 
 static int do_dump(dmu_sendarg_t *dsa, struct send_block_record *data);
@@ -639,6 +662,9 @@ backup_do_embed(dmu_sendarg_t *dsp, const blkptr_t *bp)
 	if ((BP_GET_COMPRESS(bp) >= ZIO_COMPRESS_LEGACY_FUNCTIONS &&
 	    !(dsp->dsa_featureflags & DMU_BACKUP_FEATURE_LZ4)))
 		return (B_FALSE);
+	if (BP_GET_COMPRESS(bp) >= ZIO_COMPRESS_ZSTD_1 &&
+	    !(dsp->dsa_featureflags & DMU_BACKUP_FEATURE_ZSTD))
+		return (B_FALSE);
 
 	/*
 	 * Embed type must be explicitly enabled.
@@ -654,6 +680,136 @@ backup_do_embed(dmu_sendarg_t *dsp, const blkptr_t *bp)
 	return (B_FALSE);
 }
 
+/*
+ * Returns the zio flags with which do_dump() reads the given block.
+ */
+static enum zio_flag
+send_block_zioflags(dmu_sendarg_t *dsa, const struct send_block_record *data)
+{
+	const blkptr_t *bp = &data->bp;
+	dmu_object_type_t type = BP_GET_TYPE(bp);
+	int blksz = data->datablkszsec << SPA_MINBLOCKSHIFT;
+	enum zio_flag zioflags = ZIO_FLAG_CANFAIL;
+
+	if (dsa->dsa_featureflags & DMU_BACKUP_FEATURE_RAW) {
+		zioflags |= ZIO_FLAG_RAW;
+	} else if (type != DMU_OT_DNODE && type != DMU_OT_SA) {
+		/*
+		 * We should only request compressed data from the ARC if all
+		 * the following are true:
+		 *  - stream compression was requested
+		 *  - we aren't splitting large blocks into smaller chunks
+		 *  - the data won't need to be byteswapped before sending
+		 *  - this isn't an embedded block
+		 *  - this isn't metadata (if receiving on a different endian
+		 *    system it can be byteswapped more easily)
+		 */
+		boolean_t split_large_blocks = blksz > SPA_OLD_MAXBLOCKSIZE &&
+		    !(dsa->dsa_featureflags & DMU_BACKUP_FEATURE_LARGE_BLOCKS);
+
+		if ((dsa->dsa_featureflags & DMU_BACKUP_FEATURE_COMPRESSED) &&
+		    !split_large_blocks && !BP_SHOULD_BYTESWAP(bp) &&
+		    !BP_IS_EMBEDDED(bp) && !DMU_OT_IS_METADATA(type))
+			zioflags |= ZIO_FLAG_RAW_COMPRESS;
+	}
+
+	return (zioflags);
+}
+
+/*
+ * Returns B_TRUE if do_dump() will need the contents of the given block.
+ */
+static boolean_t
+send_block_needs_read(dmu_sendarg_t *dsa, const struct send_block_record *data)
+{
+	const blkptr_t *bp = &data->bp;
+	const zbookmark_phys_t *zb = &data->zb;
+
+	if (zb->zb_object != DMU_META_DNODE_OBJECT &&
+	    DMU_OBJECT_IS_SPECIAL(zb->zb_object))
+		return (B_FALSE);
+	if (BP_IS_HOLE(bp) || zb->zb_level > 0 ||
+	    BP_GET_TYPE(bp) == DMU_OT_OBJSET)
+		return (B_FALSE);
+	if (BP_GET_TYPE(bp) != DMU_OT_DNODE && BP_GET_TYPE(bp) != DMU_OT_SA &&
+	    backup_do_embed(dsa, bp))
+		return (B_FALSE);
+	return (B_TRUE);
+}
+
+/*ARGSUSED*/
+static void
+send_read_done(zio_t *zio, const zbookmark_phys_t *zb, const blkptr_t *bp,
+    arc_buf_t *abuf, void *arg)
+{
+	struct send_block_record *data = arg;
+
+	mutex_enter(&data->lock);
+	ASSERT(data->io_outstanding);
+	data->abuf = abuf;
+	data->io_outstanding = B_FALSE;
+	cv_broadcast(&data->cv);
+	mutex_exit(&data->lock);
+}
+
+/*
+ * Start reading the contents of a block.  The buffer is held on behalf of
+ * the record until send_release_block() is called.
+ */
+static void
+send_issue_read(dmu_sendarg_t *dsa, struct send_block_record *data,
+    arc_flags_t aflags)
+{
+	spa_t *spa = dmu_objset_spa(dsa->dsa_os);
+
+	ASSERT(!data->io_issued);
+	mutex_init(&data->lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&data->cv, NULL, CV_DEFAULT, NULL);
+	data->io_issued = B_TRUE;
+	data->io_outstanding = B_TRUE;
+
+	(void) arc_read(NULL, spa, &data->bp, send_read_done, data,
+	    ZIO_PRIORITY_ASYNC_READ, send_block_zioflags(dsa, data), &aflags,
+	    &data->zb);
+}
+
+/*
+ * Return the contents of the block, reading it now if the prefetch thread
+ * has not already done so, or NULL if the read failed.
+ */
+static arc_buf_t *
+send_read_block(dmu_sendarg_t *dsa, struct send_block_record *data)
+{
+	if (!data->io_issued)
+		send_issue_read(dsa, data, ARC_FLAG_WAIT);
+
+	mutex_enter(&data->lock);
+	while (data->io_outstanding)
+		cv_wait(&data->cv, &data->lock);
+	mutex_exit(&data->lock);
+
+	return (data->abuf);
+}
+
+static void
+send_release_block(struct send_block_record *data)
+{
+	if (!data->io_issued)
+		return;
+
+	mutex_enter(&data->lock);
+	while (data->io_outstanding)
+		cv_wait(&data->cv, &data->lock);
+	mutex_exit(&data->lock);
+
+	if (data->abuf != NULL)
+		arc_buf_destroy(data->abuf, data);
+	data->abuf = NULL;
+	mutex_destroy(&data->lock);
+	cv_destroy(&data->cv);
+	data->io_issued = B_FALSE;
+}
+
 /*
  * This is the callback function to traverse_dataset that acts as the worker
  * thread for dmu_send_impl.
@@ -721,6 +877,34 @@ send_traverse_thread(void *arg)
 	thread_exit();
 }
 
+/*
+ * This thread sits between the traversal and dmu_send_impl().  It issues
+ * asynchronous reads for the blocks the stream will need, so that up to
+ * zfs_send_prefetch_queue_length bytes of reads are in flight at once rather
+ * than one at a time, and so that checksum verification, decompression and
+ * decryption of the blocks happen in parallel in the zio pipeline.  Records
+ * are passed on in traversal order.
+ */
+static void
+send_prefetch_thread(void *arg)
+{
+	struct send_prefetch_arg *spta = arg;
+	struct send_block_record *data;
+
+	data = bqueue_dequeue(spta->from_q);
+	while (!data->eos_marker) {
+		if (!spta->cancel && send_block_needs_read(spta->dsa, data)) {
+			send_issue_read(spta->dsa, data,
+			    ARC_FLAG_NOWAIT | ARC_FLAG_PREFETCH);
+		}
+		bqueue_enqueue(&spta->q, data,
+		    data->datablkszsec << SPA_MINBLOCKSHIFT);
+		data = bqueue_dequeue(spta->from_q);
+	}
+	bqueue_enqueue(&spta->q, data, 1);
+	thread_exit();
+}
+
 /*
  * This function actually handles figuring out what kind of record needs to be
  * dumped, reading the data (which has hopefully been prefetched), and calling
@@ -773,20 +957,16 @@ do_dump(dmu_sendarg_t *dsa, struct send_block_record *data)
 		return (0);
 	} else if (type == DMU_OT_DNODE) {
 		int epb = BP_GET_LSIZE(bp) >> DNODE_SHIFT;
-		arc_flags_t aflags = ARC_FLAG_WAIT;
 		arc_buf_t *abuf;
-		enum zio_flag zioflags = ZIO_FLAG_CANFAIL;
 
 		if (dsa->dsa_featureflags & DMU_BACKUP_FEATURE_RAW) {
 			ASSERT(BP_IS_ENCRYPTED(bp));
 			ASSERT3U(BP_GET_COMPRESS(bp), ==, ZIO_COMPRESS_OFF);
-			zioflags |= ZIO_FLAG_RAW;
 		}
 
 		ASSERT0(zb->zb_level);
 
-		if (arc_read(NULL, spa, bp, arc_getbuf_func, &abuf,
-		    ZIO_PRIORITY_ASYNC_READ, zioflags, &aflags, zb) != 0)
+		if ((abuf = send_read_block(dsa, data)) == NULL)
 			return (SET_ERROR(EIO));
 
 		dnode_phys_t *blk = abuf->b_data;
@@ -810,23 +990,18 @@ do_dump(dmu_sendarg_t *dsa, struct send_block_record *data)
 					break;
 			}
 		}
-		arc_buf_destroy(abuf, &abuf);
+		send_release_block(data);
 	} else if (type == DMU_OT_SA) {
-		arc_flags_t aflags = ARC_FLAG_WAIT;
 		arc_buf_t *abuf;
-		enum zio_flag zioflags = ZIO_FLAG_CANFAIL;
 
-		if (dsa->dsa_featureflags & DMU_BACKUP_FEATURE_RAW) {
+		if (dsa->dsa_featureflags & DMU_BACKUP_FEATURE_RAW)
 			ASSERT(BP_IS_PROTECTED(bp));
-			zioflags |= ZIO_FLAG_RAW;
-		}
 
-		if (arc_read(NULL, spa, bp, arc_getbuf_func, &abuf,
-		    ZIO_PRIORITY_ASYNC_READ, zioflags, &aflags, zb) != 0)
+		if ((abuf = send_read_block(dsa, data)) == NULL)
 			return (SET_ERROR(EIO));
 
 		err = dump_spill(dsa, bp, zb->zb_object, abuf->b_data);
-		arc_buf_destroy(abuf, &abuf);
+		send_release_block(data);
 	} else if (backup_do_embed(dsa, bp)) {
 		/* it's an embedded level-0 block of a regular object */
 		int blksz = dblkszsec << SPA_MINBLOCKSHIFT;
@@ -835,7 +1010,6 @@ do_dump(dmu_sendarg_t *dsa, struct send_block_record *data)
 		    zb->zb_blkid * blksz, blksz, bp);
 	} else {
 		/* it's a level-0 block of a regular object */
-		arc_flags_t aflags = ARC_FLAG_WAIT;
 		arc_buf_t *abuf;
 		int blksz = dblkszsec << SPA_MINBLOCKSHIFT;
 		uint64_t offset;
@@ -855,21 +1029,6 @@ do_dump(dmu_sendarg_t *dsa, struct send_block_record *data)
 		boolean_t request_raw =
 		    (dsa->dsa_featureflags & DMU_BACKUP_FEATURE_RAW) != 0;
 
-		/*
-		 * We should only request compressed data from the ARC if all
-		 * the following are true:
-		 *  - stream compression was requested
-		 *  - we aren't splitting large blocks into smaller chunks
-		 *  - the data won't need to be byteswapped before sending
-		 *  - this isn't an embedded block
-		 *  - this isn't metadata (if receiving on a different endian
-		 *    system it can be byteswapped more easily)
-		 */
-		boolean_t request_compressed =
-		    (dsa->dsa_featureflags & DMU_BACKUP_FEATURE_COMPRESSED) &&
-		    !split_large_blocks && !BP_SHOULD_BYTESWAP(bp) &&
-		    !BP_IS_EMBEDDED(bp) && !DMU_OT_IS_METADATA(BP_GET_TYPE(bp));
-
 		IMPLY(request_raw, !split_large_blocks);
 		IMPLY(request_raw, BP_IS_PROTECTED(bp));
 		ASSERT0(zb->zb_level);
@@ -884,18 +1043,12 @@ do_dump(dmu_sendarg_t *dsa, struct send_block_record *data)
 
 		ASSERT3U(blksz, ==, BP_GET_LSIZE(bp));
 
-		enum zio_flag zioflags = ZIO_FLAG_CANFAIL;
-		if (request_raw)
-			zioflags |= ZIO_FLAG_RAW;
-		else if (request_compressed)
-			zioflags |= ZIO_FLAG_RAW_COMPRESS;
-
-		if (arc_read(NULL, spa, bp, arc_getbuf_func, &abuf,
-		    ZIO_PRIORITY_ASYNC_READ, zioflags, &aflags, zb) != 0) {
+		if ((abuf = send_read_block(dsa, data)) == NULL) {
 			if (zfs_send_corrupt_data) {
 				/* Send a block filled with 0x"zfs badd bloc" */
-				abuf = arc_alloc_buf(spa, &abuf, ARC_BUFC_DATA,
+				abuf = arc_alloc_buf(spa, data, ARC_BUFC_DATA,
 				    blksz);
+				data->abuf = abuf;
 				uint64_t *ptr;
 				for (ptr = abuf->b_data;
 				    (char *)ptr < (char *)abuf->b_data + blksz;
@@ -925,7 +1078,7 @@ do_dump(dmu_sendarg_t *dsa, struct send_block_record *data)
 			err = dump_write(dsa, type, zb->zb_object, offset,
 			    blksz, arc_buf_size(abuf), bp, abuf->b_data);
 		}
-		arc_buf_destroy(abuf, &abuf);
+		send_release_block(data);
 	}
 
 	ASSERT(err == 0 || err == EINTR);
@@ -939,6 +1092,7 @@ static struct send_block_record *
 get_next_record(bqueue_t *bq, struct send_block_record *data)
 {
 	struct send_block_record *tmp = bqueue_dequeue(bq);
+	send_release_block(data);
 	kmem_free(data, sizeof (*data));
 	return (tmp);
 }
@@ -1037,6 +1191,13 @@ dmu_send_impl(void *tag, dsl_pool_t *dp, dsl_dataset_t *to_ds,
 		featureflags |= DMU_BACKUP_FEATURE_LZ4;
 	}
 
+	if ((featureflags &
+	    (DMU_BACKUP_FEATURE_EMBED_DATA | DMU_BACKUP_FEATURE_COMPRESSED |
+	    DMU_BACKUP_FEATURE_RAW)) != 0 &&
+	    spa_feature_is_active(dp->dp_spa, SPA_FEATURE_ZSTD_COMPRESS)) {
+		featureflags |= DMU_BACKUP_FEATURE_ZSTD;
+	}
+
 	if (resumeobj != 0 || resumeoff != 0) {
 		featureflags |= DMU_BACKUP_FEATURE_RESUMING;
 	}
@@ -1153,27 +1314,55 @@ dmu_send_impl(void *tag, dsl_pool_t *dp, dsl_dataset_t *to_ds,
 	to_arg.flags = TRAVERSE_PRE | TRAVERSE_PREFETCH;
 	if (rawok)
 		to_arg.flags |= TRAVERSE_NO_DECRYPT;
+
+	/*
+	 * With the prefetch thread, the records the stream is built from come
+	 * from its queue; it reads the data blocks itself, so the traversal
+	 * only needs to prefetch metadata.
+	 */
+	struct send_prefetch_arg pf_arg = { 0 };
+	bqueue_t *data_q = &to_arg.q;
+	boolean_t prefetch = (zfs_send_prefetch_queue_length > 0);
+
+	if (prefetch) {
+		(void) bqueue_init(&pf_arg.q,
+		    MAX(zfs_send_prefetch_queue_length, 2 * zfs_max_recordsize),
+		    offsetof(struct send_block_record, ln));
+		pf_arg.from_q = &to_arg.q;
+		pf_arg.dsa = dsp;
+		pf_arg.cancel = B_FALSE;
+		to_arg.flags &= ~TRAVERSE_PREFETCH_DATA;
+		data_q = &pf_arg.q;
+	}
+
 	(void) thread_create(NULL, 0, send_traverse_thread, &to_arg, 0, curproc,
 	    TS_RUN, minclsyspri);
+	if (prefetch) {
+		(void) thread_create(NULL, 0, send_prefetch_thread, &pf_arg, 0,
+		    curproc, TS_RUN, minclsyspri);
+	}
 
 	struct send_block_record *to_data;
-	to_data = bqueue_dequeue(&to_arg.q);
+	to_data = bqueue_dequeue(data_q);
 
 	while (!to_data->eos_marker && err == 0) {
 		err = do_dump(dsp, to_data);
-		to_data = get_next_record(&to_arg.q, to_data);
+		to_data = get_next_record(data_q, to_data);
 		if (issig(JUSTLOOKING) && issig(FORREAL))
 			err = EINTR;
 	}
 
 	if (err != 0) {
 		to_arg.cancel = B_TRUE;
+		pf_arg.cancel = B_TRUE;
 		while (!to_data->eos_marker) {
-			to_data = get_next_record(&to_arg.q, to_data);
+			to_data = get_next_record(data_q, to_data);
 		}
 	}
 	kmem_free(to_data, sizeof (*to_data));
 
+	if (prefetch)
+		bqueue_destroy(&pf_arg.q);
 	bqueue_destroy(&to_arg.q);
 
 	if (err == 0 && to_arg.error_code != 0)
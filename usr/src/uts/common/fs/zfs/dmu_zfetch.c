@@ -33,6 +33,7 @@
 #include <sys/dmu_zfetch.h>
 #include <sys/dmu.h>
 #include <sys/dbuf.h>
+#include <sys/dsl_dataset.h>
 #include <sys/kstat.h>
 
 /*
@@ -53,22 +54,52 @@ uint32_t	zfetch_max_distance = 8 * 1024 * 1024;
 uint32_t	zfetch_max_idistance = 64 * 1024 * 1024;
 /* max number of bytes in an array_read in which we allow prefetching (1MB) */
 uint64_t	zfetch_array_rd_sz = 1024 * 1024;
+/* max distance in blocks between accesses of a strided or reverse stream */
+uint32_t	zfetch_max_stride = 128;
+/* min bytes to prefetch per stream when the distance is adapted (1MB) */
+uint32_t	zfetch_min_distance = 1024 * 1024;
+/* # of prefetched blocks over which the wasted fraction is measured */
+uint32_t	zfetch_adapt_blocks = 4096;
+/* shrink the distance when more than this % of prefetched blocks is unused */
+uint32_t	zfetch_waste_high_pct = 50;
+/* grow the distance again when less than this % is unused */
+uint32_t	zfetch_waste_low_pct = 10;
 
 typedef struct zfetch_stats {
 	kstat_named_t zfetchstat_hits;
 	kstat_named_t zfetchstat_misses;
 	kstat_named_t zfetchstat_max_streams;
+	kstat_named_t zfetchstat_stride_hits;
+	kstat_named_t zfetchstat_reverse_hits;
 } zfetch_stats_t;
 
 static zfetch_stats_t zfetch_stats = {
 	{ "hits",			KSTAT_DATA_UINT64 },
 	{ "misses",			KSTAT_DATA_UINT64 },
 	{ "max_streams",		KSTAT_DATA_UINT64 },
+	{ "stride_hits",		KSTAT_DATA_UINT64 },
+	{ "reverse_hits",		KSTAT_DATA_UINT64 },
+};
+
+static const zfetch_os_stats_t zfetch_os_stats_template = {
+	{ "hits",			KSTAT_DATA_UINT64 },
+	{ "misses",			KSTAT_DATA_UINT64 },
+	{ "stride_hits",		KSTAT_DATA_UINT64 },
+	{ "reverse_hits",		KSTAT_DATA_UINT64 },
+	{ "prefetched",			KSTAT_DATA_UINT64 },
+	{ "wasted",			KSTAT_DATA_UINT64 },
+	{ "distance",			KSTAT_DATA_UINT64 },
 };
 
 #define	ZFETCHSTAT_BUMP(stat) \
 	atomic_inc_64(&zfetch_stats.stat.value.ui64);
 
+#define	ZFETCHSTAT_OS_BUMP(zf, stat) {					\
+	zfetch_os_t *zfo = (zf)->zf_dnode->dn_objset->os_zfetch;	\
+	if (zfo != NULL)						\
+		atomic_inc_64(&zfo->zfo_stats.stat.value.ui64);		\
+}
+
 kstat_t		*zfetch_ksp;
 
 void
@@ -93,6 +124,109 @@ zfetch_fini(void)
 	}
 }
 
+/*
+ * Set up the per-objset prefetch state.  Each dataset (but not snapshots,
+ * of which there may be very many, or the MOS) gets a "zfetch-<objset id>"
+ * kstat in a module named after the pool.
+ */
+void
+zfetch_os_init(objset_t *os)
+{
+	dsl_dataset_t *ds = os->os_dsl_dataset;
+	zfetch_os_t *zfo;
+	char name[KSTAT_STRLEN];
+
+	zfo = kmem_zalloc(sizeof (zfetch_os_t), KM_SLEEP);
+	zfo->zfo_stats = zfetch_os_stats_template;
+	zfo->zfo_distance = zfetch_max_distance;
+	zfo->zfo_stats.zfos_distance.value.ui64 = zfo->zfo_distance;
+	os->os_zfetch = zfo;
+
+	if (ds == NULL || ds->ds_is_snapshot)
+		return;
+
+	(void) snprintf(name, sizeof (name), "zfetch-0x%llx",
+	    (u_longlong_t)ds->ds_object);
+	zfo->zfo_ksp = kstat_create(spa_name(os->os_spa), 0, name, "misc",
+	    KSTAT_TYPE_NAMED,
+	    sizeof (zfetch_os_stats_t) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (zfo->zfo_ksp != NULL) {
+		zfo->zfo_ksp->ks_data = &zfo->zfo_stats;
+		kstat_install(zfo->zfo_ksp);
+	}
+}
+
+void
+zfetch_os_fini(objset_t *os)
+{
+	zfetch_os_t *zfo = os->os_zfetch;
+
+	if (zfo == NULL)
+		return;
+
+	if (zfo->zfo_ksp != NULL)
+		kstat_delete(zfo->zfo_ksp);
+	kmem_free(zfo, sizeof (zfetch_os_t));
+	os->os_zfetch = NULL;
+}
+
+/*
+ * Account for blocks prefetched on behalf of a stream, and for blocks that
+ * were prefetched but never read by the time the stream went away.  Every
+ * zfetch_adapt_blocks prefetched blocks, look at how many of them were
+ * wasted and halve or double the objset's data prefetch distance
+ * accordingly, within [zfetch_min_distance, zfetch_max_distance].
+ *
+ * The window counters are updated without a lock; a lost update only
+ * delays the next adjustment.
+ */
+static void
+zfetch_os_account(zfetch_t *zf, uint64_t prefetched, uint64_t wasted)
+{
+	zfetch_os_t *zfo = zf->zf_dnode->dn_objset->os_zfetch;
+	uint64_t win_pf, win_wasted;
+	uint32_t dist;
+
+	if (zfo == NULL || (prefetched == 0 && wasted == 0))
+		return;
+
+	if (prefetched != 0) {
+		atomic_add_64(&zfo->zfo_stats.zfos_prefetched.value.ui64,
+		    prefetched);
+		atomic_add_64(&zfo->zfo_win_prefetched, prefetched);
+	}
+	if (wasted != 0) {
+		atomic_add_64(&zfo->zfo_stats.zfos_wasted.value.ui64, wasted);
+		atomic_add_64(&zfo->zfo_win_wasted, wasted);
+	}
+
+	win_pf = zfo->zfo_win_prefetched;
+	if (win_pf < zfetch_adapt_blocks ||
+	    atomic_cas_64(&zfo->zfo_win_prefetched, win_pf, 0) != win_pf)
+		return;
+	win_wasted = atomic_swap_64(&zfo->zfo_win_wasted, 0);
+
+	dist = MIN(zfo->zfo_distance, zfetch_max_distance);
+	if (win_wasted * 100 > win_pf * zfetch_waste_high_pct)
+		dist = MAX(dist / 2, MIN(zfetch_min_distance,
+		    zfetch_max_distance));
+	else if (win_wasted * 100 < win_pf * zfetch_waste_low_pct)
+		dist = MIN((uint64_t)dist * 2, zfetch_max_distance);
+	zfo->zfo_distance = dist;
+	zfo->zfo_stats.zfos_distance.value.ui64 = dist;
+}
+
+static uint32_t
+dmu_zfetch_max_distance(zfetch_t *zf)
+{
+	zfetch_os_t *zfo = zf->zf_dnode->dn_objset->os_zfetch;
+
+	if (zfo == NULL)
+		return (zfetch_max_distance);
+	return (MIN(zfo->zfo_distance, zfetch_max_distance));
+}
+
 /*
  * This takes a pointer to a zfetch structure and a dnode.  It performs the
  * necessary setup for the zfetch structure, grokking data from the
@@ -105,6 +239,8 @@ dmu_zfetch_init(zfetch_t *zf, dnode_t *dno)
 		return;
 
 	zf->zf_dnode = dno;
+	zf->zf_last_blkid = 0;
+	zf->zf_last_nblks = 0;
 
 	list_create(&zf->zf_stream, sizeof (zstream_t),
 	    offsetof(zstream_t, zs_node));
@@ -115,7 +251,19 @@ dmu_zfetch_init(zfetch_t *zf, dnode_t *dno)
 static void
 dmu_zfetch_stream_remove(zfetch_t *zf, zstream_t *zs)
 {
+	uint64_t wasted;
+
 	ASSERT(RW_WRITE_HELD(&zf->zf_rwlock));
+
+	/* Anything prefetched beyond the last access was never read. */
+	if (zs->zs_stride != 0)
+		wasted = zs->zs_pf_ahead * zs->zs_nblks;
+	else if (zs->zs_pf_blkid > zs->zs_blkid)
+		wasted = zs->zs_pf_blkid - zs->zs_blkid;
+	else
+		wasted = 0;
+	zfetch_os_account(zf, 0, wasted);
+
 	list_remove(&zf->zf_stream, zs);
 	mutex_destroy(&zs->zs_lock);
 	kmem_free(zs, sizeof (*zs));
@@ -145,11 +293,14 @@ dmu_zfetch_fini(zfetch_t *zf)
 /*
  * If there aren't too many streams already, create a new stream.
  * The "blkid" argument is the next block that we expect this stream to access.
+ * For a strided or reverse stream, "stride" is the distance between
+ * accesses of "nblks" blocks; it is zero for a forward sequential stream.
  * While we're here, clean up old streams (which haven't been
  * accessed for at least zfetch_min_sec_reap seconds).
  */
 static void
-dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid)
+dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid, int64_t stride,
+    uint64_t nblks)
 {
 	zstream_t *zs_next;
 	int numstreams = 0;
@@ -189,12 +340,87 @@ dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid)
 	zs->zs_blkid = blkid;
 	zs->zs_pf_blkid = blkid;
 	zs->zs_ipf_blkid = blkid;
+	zs->zs_stride = stride;
+	zs->zs_nblks = nblks;
 	zs->zs_atime = gethrtime();
 	mutex_init(&zs->zs_lock, NULL, MUTEX_DEFAULT, NULL);
 
 	list_insert_head(&zf->zf_stream, zs);
 }
 
+/*
+ * Called with zf_rwlock held as writer when an access matched no stream.
+ * If this access and the previous unmatched one were the same size and at
+ * most zfetch_max_stride blocks apart, but not adjacent in the forward
+ * direction, start a strided (or, for a negative stride, reverse) stream
+ * expecting the next access one stride further on.  Otherwise start an
+ * ordinary forward stream.
+ */
+static void
+dmu_zfetch_stream_detect(zfetch_t *zf, uint64_t blkid, uint64_t nblks)
+{
+	int64_t stride = (int64_t)(blkid - zf->zf_last_blkid);
+	uint64_t last_nblks = zf->zf_last_nblks;
+
+	ASSERT(RW_WRITE_HELD(&zf->zf_rwlock));
+
+	zf->zf_last_blkid = blkid;
+	zf->zf_last_nblks = nblks;
+
+	if (last_nblks == nblks && stride != 0 && stride != (int64_t)nblks &&
+	    stride <= (int64_t)zfetch_max_stride &&
+	    stride >= -(int64_t)zfetch_max_stride &&
+	    (int64_t)blkid + stride > 0) {
+		dmu_zfetch_stream_create(zf, blkid + stride, stride, nblks);
+		return;
+	}
+
+	dmu_zfetch_stream_create(zf, blkid + nblks, 0, 0);
+}
+
+/*
+ * Issue prefetches for a strided or reverse stream which has just seen the
+ * access it expected at blkid.  Like the sequential case, the number of
+ * accesses we prefetch ahead doubles on each hit, up to the objset's
+ * prefetch distance.  Called with zs_lock held; returns the range to
+ * prefetch, which the caller issues after dropping its locks.
+ */
+static void
+dmu_zfetch_stride(zfetch_t *zf, zstream_t *zs, uint64_t blkid,
+    uint64_t nblks, boolean_t fetch_data, uint64_t *first, uint64_t *last)
+{
+	dnode_t *dn = zf->zf_dnode;
+	uint64_t ahead, target, max_ahead;
+
+	ASSERT(MUTEX_HELD(&zs->zs_lock));
+	ASSERT3S(zs->zs_stride, !=, 0);
+
+	zs->zs_nblks = nblks;
+	ahead = (zs->zs_pf_ahead > 0) ? zs->zs_pf_ahead - 1 : 0;
+	max_ahead = MAX(1, (dmu_zfetch_max_distance(zf) >>
+	    dn->dn_datablkshift) / nblks);
+	target = fetch_data ? MIN(2 * ahead + 2, max_ahead) : ahead;
+
+	/* Don't run off either end of the object. */
+	while (target > ahead) {
+		int64_t end = (int64_t)blkid + (int64_t)target * zs->zs_stride;
+
+		if (end >= 0 && end <= (int64_t)dn->dn_maxblkid)
+			break;
+		target--;
+	}
+
+	*first = ahead + 1;
+	*last = target;
+	zs->zs_pf_ahead = MAX(ahead, target);
+
+	if ((int64_t)blkid + zs->zs_stride < 0)
+		zs->zs_blkid = UINT64_MAX;
+	else
+		zs->zs_blkid = blkid + zs->zs_stride;
+	zs->zs_atime = gethrtime();
+}
+
 /*
  * This is the predictive prefetch entry point.  It associates dnode access
  * specified with blkid and nblks arguments with prefetch stream, predicts
@@ -242,7 +468,14 @@ dmu_zfetch(zfetch_t *zf, uint64_t blkid, uint64_t nblks, boolean_t fetch_data)
 	 */
 	for (zs = list_head(&zf->zf_stream); zs != NULL;
 	    zs = list_next(&zf->zf_stream, zs)) {
-		if (blkid == zs->zs_blkid || blkid + 1 == zs->zs_blkid) {
+		if (zs->zs_stride != 0) {
+			if (blkid != zs->zs_blkid)
+				continue;
+			mutex_enter(&zs->zs_lock);
+			if (blkid == zs->zs_blkid)
+				break;
+			mutex_exit(&zs->zs_lock);
+		} else if (blkid == zs->zs_blkid || blkid + 1 == zs->zs_blkid) {
 			mutex_enter(&zs->zs_lock);
 			/*
 			 * zs_blkid could have changed before we
@@ -271,12 +504,46 @@ dmu_zfetch(zfetch_t *zf, uint64_t blkid, uint64_t nblks, boolean_t fetch_data)
 		 * a new stream for it.
 		 */
 		ZFETCHSTAT_BUMP(zfetchstat_misses);
+		ZFETCHSTAT_OS_BUMP(zf, zfos_misses);
 		if (rw_tryupgrade(&zf->zf_rwlock))
-			dmu_zfetch_stream_create(zf, end_of_access_blkid);
+			dmu_zfetch_stream_detect(zf, blkid, nblks);
 		rw_exit(&zf->zf_rwlock);
 		return;
 	}
 
+	if (zs->zs_stride != 0) {
+		int64_t stride = zs->zs_stride;
+		uint64_t first, last, pf_nblks = 0;
+
+		dmu_zfetch_stride(zf, zs, blkid, nblks, fetch_data,
+		    &first, &last);
+		mutex_exit(&zs->zs_lock);
+		rw_exit(&zf->zf_rwlock);
+
+		for (uint64_t i = first; i <= last; i++) {
+			uint64_t start = blkid + i * stride;
+
+			for (uint64_t b = 0; b < nblks; b++) {
+				dbuf_prefetch(zf->zf_dnode, 0, start + b,
+				    ZIO_PRIORITY_ASYNC_READ,
+				    ARC_FLAG_PREDICTIVE_PREFETCH);
+				pf_nblks++;
+			}
+		}
+		zfetch_os_account(zf, pf_nblks, 0);
+
+		ZFETCHSTAT_BUMP(zfetchstat_hits);
+		ZFETCHSTAT_OS_BUMP(zf, zfos_hits);
+		if (stride > 0) {
+			ZFETCHSTAT_BUMP(zfetchstat_stride_hits);
+			ZFETCHSTAT_OS_BUMP(zf, zfos_stride_hits);
+		} else {
+			ZFETCHSTAT_BUMP(zfetchstat_reverse_hits);
+			ZFETCHSTAT_OS_BUMP(zf, zfos_reverse_hits);
+		}
+		return;
+	}
+
 	/*
 	 * This access was to a block that we issued a prefetch for on
 	 * behalf of this stream. Issue further prefetches for this stream.
@@ -294,8 +561,8 @@ dmu_zfetch(zfetch_t *zf, uint64_t blkid, uint64_t nblks, boolean_t fetch_data)
 	 * prefetch get further ahead than zfetch_max_distance.
 	 */
 	if (fetch_data) {
-		max_dist_blks =
-		    zfetch_max_distance >> zf->zf_dnode->dn_datablkshift;
+		max_dist_blks = dmu_zfetch_max_distance(zf) >>
+		    zf->zf_dnode->dn_datablkshift;
 		/*
 		 * Previously, we were (zs_pf_blkid - blkid) ahead.  We
 		 * want to now be double that, so read that amount again,
@@ -353,5 +620,7 @@ dmu_zfetch(zfetch_t *zf, uint64_t blkid, uint64_t nblks, boolean_t fetch_data)
 		dbuf_prefetch(zf->zf_dnode, 1, iblk,
 		    ZIO_PRIORITY_ASYNC_READ, ARC_FLAG_PREDICTIVE_PREFETCH);
 	}
+	zfetch_os_account(zf, MAX(pf_nblks, 0), 0);
 	ZFETCHSTAT_BUMP(zfetchstat_hits);
+	ZFETCHSTAT_OS_BUMP(zf, zfos_hits);
 }
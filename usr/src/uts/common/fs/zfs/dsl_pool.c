@@ -25,6 +25,7 @@
  * Copyright (c) 2014 Spectra Logic Corporation, All rights reserved.
  * Copyright (c) 2014 Integros [integros.com]
  * Copyright 2016 Nexenta Systems, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/dsl_pool.h>
@@ -86,14 +87,22 @@
  *
  * The zfs_dirty_data_sync tunable dictates the threshold at which we
  * ensure that there is a txg syncing (see the comment in txg.c for a full
- * description of transaction group stages).
+ * description of transaction group stages).  Each pool also measures the
+ * rate at which it syncs dirty data (dp_sync_bw), and pushes out a txg
+ * sooner if what is dirty would take more than zfs_txg_sync_target_ms to
+ * write at that rate; this keeps txgs on slow pools from growing so large
+ * that syncing one stalls every writer.
  *
  * The IO scheduler uses both the dirty space limit and current amount of
  * dirty data as inputs. Those values affect the number of concurrent IOs ZFS
  * issues. See the comment in vdev_queue.c for details of the IO scheduler.
  *
  * The delay is also calculated based on the amount of dirty data.  See the
- * comment above dmu_tx_delay() for details.
+ * comment above dmu_tx_delay() for details.  Short of zfs_dirty_data_max,
+ * the delay is not applied to a zone when some other zone is dirtying much
+ * more than its share of data and this zone is not (see
+ * zfs_zone_dirty_exempt()); the bulk writer is slowed down alone, rather
+ * than every zone's small writes queueing behind it.
  */
 
 /*
@@ -118,6 +127,15 @@ uint64_t zfs_dirty_data_sync_pct = 20;
  */
 int zfs_delay_min_dirty_percent = 60;
 
+/*
+ * Push out a txg once its dirty data would take this long to sync at the
+ * pool's measured sync rate (0 disables this).  Txgs with less dirty data
+ * than zfs_txg_sync_min_bytes are neither pushed out early nor used to
+ * measure the rate, as their fixed costs dominate.
+ */
+int zfs_txg_sync_target_ms = 1000;
+uint64_t zfs_txg_sync_min_bytes = 64 * 1024 * 1024;
+
 /*
  * This controls how quickly the delay approaches infinity.
  * Larger values cause it to delay more for a given amount of dirty data.
@@ -610,6 +628,9 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 
 	tx = dmu_tx_create_assigned(dp, txg);
 
+	if (spa_sync_pass(dp->dp_spa) == 1)
+		dp->dp_sync_dirty = dp->dp_dirty_pertxg[txg & TXG_MASK];
+
 	/*
 	 * Run all early sync tasks before writing out any dirty blocks.
 	 * For more info on early sync tasks see block comment in
@@ -789,6 +810,24 @@ dsl_pool_sync_done(dsl_pool_t *dp, uint64_t txg)
 		dmu_buf_rele(ds->ds_dbuf, zilog);
 	}
 	ASSERT(!dmu_objset_is_dirty(dp->dp_meta_objset, txg));
+
+	/*
+	 * Fold the rate at which this txg was written into the pool's
+	 * measured sync rate, for dsl_pool_need_dirty_delay().
+	 */
+	hrtime_t elapsed = NSEC2USEC(gethrtime() -
+	    dp->dp_spa->spa_sync_starttime);
+	if (dp->dp_sync_dirty >= zfs_txg_sync_min_bytes && elapsed > 0) {
+		uint64_t bw = dp->dp_sync_dirty * MICROSEC / elapsed;
+
+		mutex_enter(&dp->dp_lock);
+		if (dp->dp_sync_bw == 0)
+			dp->dp_sync_bw = bw;
+		else
+			dp->dp_sync_bw = (dp->dp_sync_bw * 3 + bw) / 4;
+		mutex_exit(&dp->dp_lock);
+	}
+	dp->dp_sync_dirty = 0;
 }
 
 /*
@@ -875,10 +914,20 @@ dsl_pool_need_dirty_delay(dsl_pool_t *dp)
 	boolean_t rv;
 
 	mutex_enter(&dp->dp_lock);
+	if (zfs_txg_sync_target_ms != 0 && dp->dp_sync_bw != 0) {
+		uint64_t target = dp->dp_sync_bw * zfs_txg_sync_target_ms /
+		    MILLISEC;
+		dirty_min_bytes = MIN(dirty_min_bytes,
+		    MAX(target, zfs_txg_sync_min_bytes));
+	}
 	if (dp->dp_dirty_total > dirty_min_bytes)
 		txg_kick(dp);
 	rv = (dp->dp_dirty_total > delay_min_bytes);
+	boolean_t below_max = (dp->dp_dirty_total < zfs_dirty_data_max);
 	mutex_exit(&dp->dp_lock);
+
+	if (rv && below_max && zfs_zone_dirty_exempt())
+		rv = B_FALSE;
 	return (rv);
 }
 
@@ -886,6 +935,7 @@ void
 dsl_pool_dirty_space(dsl_pool_t *dp, int64_t space, dmu_tx_t *tx)
 {
 	if (space > 0) {
+		zfs_zone_dirty_space(space);
 		mutex_enter(&dp->dp_lock);
 		dp->dp_dirty_pertxg[tx->tx_txg & TXG_MASK] += space;
 		dsl_pool_dirty_delta(dp, space);
@@ -127,6 +127,8 @@ static void scan_ds_queue_remove(dsl_scan_t *scn, uint64_t dsobj);
 static void scan_ds_queue_sync(dsl_scan_t *scn, dmu_tx_t *tx);
 
 extern int zfs_vdev_async_write_active_min_dirty_percent;
+extern int zfs_vdev_aggregation_limit;
+extern int zfs_vdev_resilver_aggregation_limit;
 
 /*
  * By default zfs will check to ensure it is not over the hard memory
@@ -438,6 +440,93 @@ bp2sio(const blkptr_t *bp, scan_io_t *sio, int dva_i)
 	}
 }
 
+typedef struct dsl_scan_kstat {
+	kstat_named_t dsk_func;
+	kstat_named_t dsk_state;
+	kstat_named_t dsk_to_examine;
+	kstat_named_t dsk_examined;
+	kstat_named_t dsk_issued;
+	kstat_named_t dsk_pass_start;
+	kstat_named_t dsk_pass_issued;
+	kstat_named_t dsk_issue_rate;
+	kstat_named_t dsk_remaining_secs;
+	kstat_named_t dsk_finish_time;
+} dsl_scan_kstat_t;
+
+static const dsl_scan_kstat_t dsl_scan_kstat_template = {
+	{ "function",			KSTAT_DATA_UINT64 },
+	{ "state",			KSTAT_DATA_UINT64 },
+	{ "to_examine",			KSTAT_DATA_UINT64 },
+	{ "examined",			KSTAT_DATA_UINT64 },
+	{ "issued",			KSTAT_DATA_UINT64 },
+	{ "pass_start",			KSTAT_DATA_UINT64 },
+	{ "pass_issued",		KSTAT_DATA_UINT64 },
+	/* bytes per second issued during this pass */
+	{ "issue_rate",			KSTAT_DATA_UINT64 },
+	/* projected seconds left, 0 if unknown */
+	{ "remaining_secs",		KSTAT_DATA_UINT64 },
+	/* projected wall clock time of completion, 0 if unknown */
+	{ "finish_time",		KSTAT_DATA_UINT64 },
+};
+
+/*
+ * Report the progress of the current scan and project its finish time
+ * from the issue rate of the current pass, the same way zpool status does.
+ */
+static int
+dsl_scan_kstat_update(kstat_t *ksp, int rw)
+{
+	dsl_scan_t *scn = ksp->ks_private;
+	dsl_scan_kstat_t *dsk = ksp->ks_data;
+	dsl_scan_phys_t *scnp = &scn->scn_phys;
+	spa_t *spa = scn->scn_dp->dp_spa;
+	uint64_t now, elapsed, issued, rate = 0, remaining = 0;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	issued = scn->scn_issued_before_pass + spa->spa_scan_pass_issued;
+	now = spa->spa_scan_pass_scrub_pause != 0 ?
+	    spa->spa_scan_pass_scrub_pause : gethrestime_sec();
+	elapsed = now - spa->spa_scan_pass_start -
+	    spa->spa_scan_pass_scrub_spent_paused;
+	if (scnp->scn_state == DSS_SCANNING && elapsed > 0 &&
+	    spa->spa_scan_pass_start != 0) {
+		rate = spa->spa_scan_pass_issued / elapsed;
+		if (rate != 0 && scnp->scn_to_examine > issued)
+			remaining = (scnp->scn_to_examine - issued) / rate;
+	}
+
+	dsk->dsk_func.value.ui64 = scnp->scn_func;
+	dsk->dsk_state.value.ui64 = scnp->scn_state;
+	dsk->dsk_to_examine.value.ui64 = scnp->scn_to_examine;
+	dsk->dsk_examined.value.ui64 = scnp->scn_examined;
+	dsk->dsk_issued.value.ui64 = issued;
+	dsk->dsk_pass_start.value.ui64 = spa->spa_scan_pass_start;
+	dsk->dsk_pass_issued.value.ui64 = spa->spa_scan_pass_issued;
+	dsk->dsk_issue_rate.value.ui64 = rate;
+	dsk->dsk_remaining_secs.value.ui64 = remaining;
+	dsk->dsk_finish_time.value.ui64 = remaining != 0 ?
+	    gethrestime_sec() + remaining : 0;
+
+	return (0);
+}
+
+static void
+dsl_scan_kstat_init(dsl_scan_t *scn)
+{
+	scn->scn_kstat = kstat_create(spa_name(scn->scn_dp->dp_spa), 0,
+	    "scan", "misc", KSTAT_TYPE_NAMED,
+	    sizeof (dsl_scan_kstat_t) / sizeof (kstat_named_t), 0);
+	if (scn->scn_kstat != NULL) {
+		bcopy(&dsl_scan_kstat_template, scn->scn_kstat->ks_data,
+		    sizeof (dsl_scan_kstat_t));
+		scn->scn_kstat->ks_private = scn;
+		scn->scn_kstat->ks_update = dsl_scan_kstat_update;
+		kstat_install(scn->scn_kstat);
+	}
+}
+
 int
 dsl_scan_init(dsl_pool_t *dp, uint64_t txg)
 {
@@ -587,6 +676,7 @@ dsl_scan_init(dsl_pool_t *dp, uint64_t txg)
 	}
 
 	spa_scan_stat_init(spa);
+	dsl_scan_kstat_init(scn);
 	return (0);
 }
 
@@ -596,6 +686,8 @@ dsl_scan_fini(dsl_pool_t *dp)
 	if (dp->dp_scan != NULL) {
 		dsl_scan_t *scn = dp->dp_scan;
 
+		if (scn->scn_kstat != NULL)
+			kstat_delete(scn->scn_kstat);
 		if (scn->scn_taskq != NULL)
 			taskq_destroy(scn->scn_taskq);
 		scan_ds_queue_clear(scn);
@@ -2644,6 +2736,18 @@ dsl_scan_visit(dsl_scan_t *scn, dmu_tx_t *tx)
 	ASSERT0(scn->scn_suspending);
 }
 
+/*
+ * Resilvers issue their sorted queues in large physically sequential runs
+ * which the vdev queue merges into multi-megabyte reads, unless
+ * zfs_vdev_resilver_aggregation_limit has been tuned down.
+ */
+static boolean_t
+dsl_scan_sequential_resilver(dsl_scan_t *scn)
+{
+	return (scn->scn_phys.scn_func == POOL_SCAN_RESILVER &&
+	    zfs_vdev_resilver_aggregation_limit > zfs_vdev_aggregation_limit);
+}
+
 static uint64_t
 dsl_scan_count_leaves(vdev_t *vd)
 {
@@ -2757,6 +2861,14 @@ scan_io_queue_gather(dsl_scan_io_queue_t *queue, range_seg_t *rs, list_t *list)
 	avl_index_t idx;
 	uint_t num_sios = 0;
 	int64_t bytes_issued = 0;
+	int64_t bytes_limit = 0;
+
+	/*
+	 * A sequential resilver gathers a whole aggregation's worth of the
+	 * extent at once so that it reaches the vdev queue back to back.
+	 */
+	if (dsl_scan_sequential_resilver(queue->q_scn))
+		bytes_limit = zfs_vdev_resilver_aggregation_limit;
 
 	ASSERT(rs != NULL);
 	ASSERT(MUTEX_HELD(&queue->q_vd->vdev_scan_io_queue_lock));
@@ -2776,7 +2888,8 @@ scan_io_queue_gather(dsl_scan_io_queue_t *queue, range_seg_t *rs, list_t *list)
 		sio = avl_nearest(&queue->q_sios_by_addr, idx, AVL_AFTER);
 
 	while (sio != NULL && SIO_GET_OFFSET(sio) < rs_get_end(rs,
-	    queue->q_exts_by_addr) && num_sios <= 32) {
+	    queue->q_exts_by_addr) &&
+	    (num_sios <= 32 || bytes_issued < bytes_limit)) {
 		ASSERT3U(SIO_GET_OFFSET(sio), >=, rs_get_start(rs,
 		    queue->q_exts_by_addr));
 		ASSERT3U(SIO_GET_END_OFFSET(sio), <=, rs_get_end(rs,
@@ -2793,7 +2906,8 @@ scan_io_queue_gather(dsl_scan_io_queue_t *queue, range_seg_t *rs, list_t *list)
 	}
 
 	/*
-	 * We limit the number of sios we process at once to 32 to avoid
+	 * We limit the number of sios we process at once to 32 (or, for
+	 * sequential resilver, one aggregation's worth) to avoid
 	 * biting off more than we can chew. If we didn't take everything
 	 * in the segment we update it to reflect the work we were able to
 	 * complete. Otherwise, we remove it from the range tree entirely.
@@ -2909,6 +3023,12 @@ scan_io_queues_run_one(void *arg)
 
 	ASSERT(queue->q_scn->scn_is_sorted);
 
+	/* keep two full aggregations in flight per leaf */
+	if (dsl_scan_sequential_resilver(queue->q_scn)) {
+		bytes_per_leaf = MAX(bytes_per_leaf,
+		    2ULL * zfs_vdev_resilver_aggregation_limit);
+	}
+
 	list_create(&sio_list, sizeof (scan_io_t),
 	    offsetof(scan_io_t, sio_nodes.sio_list_node));
 	mutex_enter(q_lock);
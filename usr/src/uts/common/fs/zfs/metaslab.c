@@ -227,6 +227,15 @@ int metaslab_preload_limit = 10;
  */
 boolean_t metaslab_preload_enabled = B_TRUE;
 
+/*
+ * Allocations of up to metaslab_slab_max_asize bytes are satisfied from
+ * per-CPU reservation slabs of metaslab_slab_size bytes, carved from the
+ * group's metaslabs, without taking ms_lock (see metaslab_slab_alloc()).
+ */
+boolean_t metaslab_slab_enabled = B_TRUE;
+uint64_t metaslab_slab_size = 1ULL << 20;
+uint64_t metaslab_slab_max_asize = 1ULL << 16;
+
 /*
  * Enable/disable fragmentation weighting on metaslabs.
  */
@@ -828,6 +837,14 @@ metaslab_group_create(metaslab_class_t *mc, vdev_t *vd, int allocators)
 	mg->mg_taskq = taskq_create("metaslab_group_taskq", metaslab_load_pct,
 	    minclsyspri, 10, INT_MAX, TASKQ_THREADS_CPU_PCT);
 
+	mg->mg_slab_cpus = MAX(1, boot_ncpus);
+	mg->mg_slabs = kmem_zalloc(mg->mg_slab_cpus * TXG_SIZE *
+	    sizeof (metaslab_slab_t), KM_SLEEP);
+	for (int i = 0; i < mg->mg_slab_cpus * TXG_SIZE; i++) {
+		mutex_init(&mg->mg_slabs[i].mss_lock, NULL, MUTEX_DEFAULT,
+		    NULL);
+	}
+
 	return (mg);
 }
 
@@ -861,9 +878,42 @@ metaslab_group_destroy(metaslab_group_t *mg)
 	kmem_free(mg->mg_cur_max_alloc_queue_depth, mg->mg_allocators *
 	    sizeof (uint64_t));
 
+	for (int i = 0; i < mg->mg_slab_cpus * TXG_SIZE; i++) {
+		ASSERT3U(mg->mg_slabs[i].mss_cursor, ==,
+		    mg->mg_slabs[i].mss_end);
+		mutex_destroy(&mg->mg_slabs[i].mss_lock);
+	}
+	kmem_free(mg->mg_slabs, mg->mg_slab_cpus * TXG_SIZE *
+	    sizeof (metaslab_slab_t));
+
 	kmem_free(mg, sizeof (metaslab_group_t));
 }
 
+static int
+metaslab_group_kstat_update(kstat_t *ksp, int rw)
+{
+	metaslab_group_t *mg = ksp->ks_private;
+	metaslab_group_kstat_t *mgk = ksp->ks_data;
+	uint64_t allocs = 0, contended = 0;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	for (int i = 0; i < mg->mg_slab_cpus * TXG_SIZE; i++) {
+		allocs += mg->mg_slabs[i].mss_allocs;
+		contended += mg->mg_slabs[i].mss_contended;
+	}
+	mgk->mg_slab_allocs.value.ui64 = allocs;
+	mgk->mg_slab_contended.value.ui64 = contended;
+	mgk->mg_slab_refills.value.ui64 = mg->mg_slab_refills;
+	mgk->mg_slab_refill_failures.value.ui64 =
+	    mg->mg_slab_refill_failures;
+	mgk->mg_slab_returned.value.ui64 = mg->mg_slab_returned;
+	mgk->mg_ms_lock_contended.value.ui64 = mg->mg_ms_lock_contended;
+
+	return (0);
+}
+
 void
 metaslab_group_activate(metaslab_group_t *mg)
 {
@@ -915,9 +965,23 @@ metaslab_group_activate(metaslab_group_t *mg)
 		    KSTAT_DATA_STRING);
 		kstat_named_setstr(&mg_kstat->mg_spa_name,
 		    mg->mg_vd->vdev_spa->spa_name);
+		kstat_named_init(&mg_kstat->mg_slab_allocs, "slab_allocs",
+		    KSTAT_DATA_UINT64);
+		kstat_named_init(&mg_kstat->mg_slab_contended,
+		    "slab_contended", KSTAT_DATA_UINT64);
+		kstat_named_init(&mg_kstat->mg_slab_refills, "slab_refills",
+		    KSTAT_DATA_UINT64);
+		kstat_named_init(&mg_kstat->mg_slab_refill_failures,
+		    "slab_refill_failures", KSTAT_DATA_UINT64);
+		kstat_named_init(&mg_kstat->mg_slab_returned,
+		    "slab_returned_bytes", KSTAT_DATA_UINT64);
+		kstat_named_init(&mg_kstat->mg_ms_lock_contended,
+		    "ms_lock_contended", KSTAT_DATA_UINT64);
 
 		mg->mg_kstat->ks_data = mg_kstat;
 		mg->mg_kstat->ks_lock = &mg->mg_kstat_lock;
+		mg->mg_kstat->ks_private = mg;
+		mg->mg_kstat->ks_update = metaslab_group_kstat_update;
 		kstat_install(mg->mg_kstat);
 	}
 
@@ -1003,6 +1067,7 @@ metaslab_group_passivate(metaslab_group_t *mg)
 
 		kstat_delete(mg->mg_kstat);
 		kmem_free(data, sizeof (metaslab_group_kstat_t));
+		mg->mg_kstat = NULL;
 	}
 	mutex_destroy(&mg->mg_kstat_lock);
 }
@@ -3468,6 +3533,28 @@ metaslab_group_preload(metaslab_group_t *mg)
 	mutex_exit(&mg->mg_lock);
 }
 
+/*
+ * Start preloading every active metaslab group in the class.  Groups are
+ * otherwise only preloaded by metaslab_sync_reassess() once they have been
+ * dirtied, so right after a pool is opened the first allocations from each
+ * vdev would have to load metaslabs on demand.
+ */
+void
+metaslab_class_preload(metaslab_class_t *mc)
+{
+	spa_t *spa = mc->mc_spa;
+	metaslab_group_t *mg;
+
+	spa_config_enter(spa, SCL_ALLOC, FTAG, RW_READER);
+	if ((mg = mc->mc_rotor) != NULL) {
+		do {
+			if (mg->mg_activation_count > 0)
+				metaslab_group_preload(mg);
+		} while ((mg = mg->mg_next) != mc->mc_rotor);
+	}
+	spa_config_exit(spa, SCL_ALLOC, FTAG);
+}
+
 /*
  * Determine if the space map's on-disk footprint is past our tolerance for
  * inefficiency. We would like to use the following criteria to make our
@@ -3859,6 +3946,50 @@ metaslab_flush(metaslab_t *msp, dmu_tx_t *tx)
 	return (B_TRUE);
 }
 
+/*
+ * Give the unused tail [start, start + size) of a reservation slab back to
+ * the metaslab it was carved from.  It was accounted as allocated in txg.
+ */
+static void
+metaslab_slab_return(metaslab_t *msp, uint64_t txg, uint64_t start,
+    uint64_t size)
+{
+	ASSERT(MUTEX_HELD(&msp->ms_lock));
+	ASSERT(msp->ms_loaded);
+
+	range_tree_remove(msp->ms_allocating[txg & TXG_MASK], start, size);
+	range_tree_add(msp->ms_allocatable, start, size);
+	msp->ms_allocating_total -= size;
+	msp->ms_max_size = metaslab_largest_allocatable(msp);
+	atomic_add_64(&msp->ms_group->mg_slab_returned, size);
+}
+
+/*
+ * Return what is left of the slabs carved from msp in txg before the
+ * metaslab is written out.  No allocations for txg can be in flight once
+ * a metaslab_sync() for it has started.
+ */
+static void
+metaslab_slab_reclaim(metaslab_t *msp, uint64_t txg)
+{
+	metaslab_group_t *mg = msp->ms_group;
+
+	mutex_enter(&msp->ms_lock);
+	for (int c = 0; c < mg->mg_slab_cpus; c++) {
+		metaslab_slab_t *mss = METASLAB_SLAB(mg, c, txg);
+
+		mutex_enter(&mss->mss_lock);
+		if (mss->mss_msp == msp && mss->mss_txg == txg &&
+		    mss->mss_cursor < mss->mss_end) {
+			metaslab_slab_return(msp, txg, mss->mss_cursor,
+			    mss->mss_end - mss->mss_cursor);
+			mss->mss_end = mss->mss_cursor;
+		}
+		mutex_exit(&mss->mss_lock);
+	}
+	mutex_exit(&msp->ms_lock);
+}
+
 /*
  * Write a metaslab to disk in the context of the specified transaction group.
  */
@@ -3888,6 +4019,9 @@ metaslab_sync(metaslab_t *msp, uint64_t txg)
 	ASSERT3P(msp->ms_checkpointing, !=, NULL);
 	ASSERT3P(msp->ms_trim, !=, NULL);
 
+	if (!range_tree_is_empty(alloctree))
+		metaslab_slab_reclaim(msp, txg);
+
 	/*
 	 * Normally, we don't want to process a metaslab if there are no
 	 * allocations or frees to perform. However, if the metaslab is being
@@ -4788,7 +4922,10 @@ metaslab_group_alloc_normal(metaslab_group_t *mg, zio_alloc_list_t *zal,
 			kmem_free(search, sizeof (*search));
 			return (-1ULL);
 		}
-		mutex_enter(&msp->ms_lock);
+		if (!mutex_tryenter(&msp->ms_lock)) {
+			atomic_inc_64(&mg->mg_ms_lock_contended);
+			mutex_enter(&msp->ms_lock);
+		}
 
 		metaslab_active_mask_verify(msp);
 
@@ -5006,6 +5143,85 @@ next:
 	return (offset);
 }
 
+/*
+ * Try to satisfy an allocation from this CPU's reservation slab for txg.
+ * The only lock taken is the slab's own, which is in practice uncontended.
+ */
+static uint64_t
+metaslab_slab_alloc(metaslab_group_t *mg, uint64_t asize, uint64_t txg)
+{
+	metaslab_slab_t *mss = METASLAB_SLAB(mg,
+	    CPU_SEQID % mg->mg_slab_cpus, txg);
+	uint64_t offset = -1ULL;
+
+	if (!mutex_tryenter(&mss->mss_lock)) {
+		mutex_enter(&mss->mss_lock);
+		mss->mss_contended++;
+	}
+	if (mss->mss_txg == txg && mss->mss_end - mss->mss_cursor >= asize) {
+		offset = mss->mss_cursor;
+		mss->mss_cursor += asize;
+		mss->mss_allocs++;
+	}
+	mutex_exit(&mss->mss_lock);
+
+	return (offset);
+}
+
+/*
+ * The slab was empty: carve a new one out of the group through the normal
+ * allocation path, satisfy this allocation from its head and install the
+ * rest.  If the new slab cannot be allocated (the group is too fragmented
+ * or nearly full) we don't try again on this CPU for the rest of the txg.
+ */
+static uint64_t
+metaslab_slab_refill(metaslab_group_t *mg, zio_alloc_list_t *zal,
+    uint64_t asize, uint64_t txg, int allocator)
+{
+	vdev_t *vd = mg->mg_vd;
+	metaslab_slab_t *mss;
+	metaslab_t *omsp = NULL;
+	uint64_t offset, ostart = 0, osize = 0;
+
+	mss = METASLAB_SLAB(mg, CPU_SEQID % mg->mg_slab_cpus, txg);
+	if (mss->mss_nofill_txg == txg)
+		return (-1ULL);
+
+	offset = metaslab_group_alloc_normal(mg, zal, metaslab_slab_size, txg,
+	    B_FALSE, NULL, 0, allocator, B_FALSE);
+
+	mutex_enter(&mss->mss_lock);
+	if (offset == -1ULL) {
+		mss->mss_nofill_txg = txg;
+		mutex_exit(&mss->mss_lock);
+		atomic_inc_64(&mg->mg_slab_refill_failures);
+		return (-1ULL);
+	}
+	if (mss->mss_txg == txg && mss->mss_cursor < mss->mss_end) {
+		omsp = mss->mss_msp;
+		ostart = mss->mss_cursor;
+		osize = mss->mss_end - mss->mss_cursor;
+	}
+	mss->mss_msp = vd->vdev_ms[offset >> vd->vdev_ms_shift];
+	mss->mss_txg = txg;
+	mss->mss_cursor = offset + asize;
+	mss->mss_end = offset + metaslab_slab_size;
+	mutex_exit(&mss->mss_lock);
+	atomic_inc_64(&mg->mg_slab_refills);
+
+	/*
+	 * Another thread on this CPU may have refilled the slab while we
+	 * were allocating; return what was left of the one we replaced.
+	 */
+	if (omsp != NULL) {
+		mutex_enter(&omsp->ms_lock);
+		metaslab_slab_return(omsp, txg, ostart, osize);
+		mutex_exit(&omsp->ms_lock);
+	}
+
+	return (offset);
+}
+
 static uint64_t
 metaslab_group_alloc(metaslab_group_t *mg, zio_alloc_list_t *zal,
     uint64_t asize, uint64_t txg, boolean_t want_unique, dva_t *dva, int d,
@@ -5014,6 +5230,22 @@ metaslab_group_alloc(metaslab_group_t *mg, zio_alloc_list_t *zal,
 	uint64_t offset;
 	ASSERT(mg->mg_initialized);
 
+	/*
+	 * Small allocations of the first copy of a block are served from
+	 * a reservation slab.  Ditto copies need the metaslab selection
+	 * in metaslab_group_alloc_normal() to keep their DVAs apart.
+	 */
+	if (metaslab_slab_enabled && d == 0 && !try_hard &&
+	    asize <= metaslab_slab_max_asize &&
+	    asize < metaslab_slab_size) {
+		offset = metaslab_slab_alloc(mg, asize, txg);
+		if (offset != -1ULL)
+			return (offset);
+		offset = metaslab_slab_refill(mg, zal, asize, txg, allocator);
+		if (offset != -1ULL)
+			return (offset);
+	}
+
 	offset = metaslab_group_alloc_normal(mg, zal, asize, txg, want_unique,
 	    dva, d, allocator, try_hard);
 
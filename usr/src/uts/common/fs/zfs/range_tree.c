@@ -24,6 +24,7 @@
  */
 /*
  * Copyright (c) 2013, 2019 by Delphix. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/zfs_context.h>
@@ -660,6 +661,9 @@ range_tree_swap(range_tree_t **rtsrc, range_tree_t **rtdst)
 
 	ASSERT0(range_tree_space(*rtdst));
 	ASSERT0(zfs_btree_numnodes(&(*rtdst)->rt_root));
+	ASSERT3U((*rtsrc)->rt_type, ==, (*rtdst)->rt_type);
+	ASSERT3U((*rtsrc)->rt_start, ==, (*rtdst)->rt_start);
+	ASSERT3U((*rtsrc)->rt_shift, ==, (*rtdst)->rt_shift);
 
 	rt = *rtsrc;
 	*rtsrc = *rtdst;
@@ -28,7 +28,7 @@
  * Copyright (c) 2014 Integros [integros.com]
  * Copyright 2016 Toomas Soome <tsoome@me.com>
  * Copyright (c) 2017, 2019, Datto Inc. All rights reserved.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2017, Intel Corporation.
  * Copyright 2018 OmniOS Community Edition (OmniOSce) Association.
  * Copyright 2020 Joshua M. Clulow <josh@sysmgr.org>
@@ -58,6 +58,7 @@
 #include <sys/vdev_indirect_births.h>
 #include <sys/vdev_initialize.h>
 #include <sys/vdev_trim.h>
+#include <sys/vdev_rebuild.h>
 #include <sys/metaslab.h>
 #include <sys/metaslab_impl.h>
 #include <sys/mmp.h>
@@ -1040,9 +1041,14 @@ spa_taskqs_fini(spa_t *spa, zio_type_t t, zio_taskq_type_t q)
 /*
  * Dispatch a task to the appropriate taskq for the ZFS I/O type and priority.
  * Note that a type may have multiple discrete taskqs to avoid lock contention
- * on the taskq itself. In that case we choose which taskq at random by using
- * the low bits of gethrtime().
+ * on the taskq itself. In that case we choose which taskq by the dispatching
+ * CPU, so that the I/Os issued (or completed) on a CPU keep going to the same
+ * taskq and its lock and threads stay warm in that CPU's cache, rather than
+ * every CPU contending on every taskq.  Setting spa_taskq_cpu_affine to zero
+ * restores the old choice at random by the low bits of gethrtime().
  */
+boolean_t spa_taskq_cpu_affine = B_TRUE;
+
 void
 spa_taskq_dispatch_ent(spa_t *spa, zio_type_t t, zio_taskq_type_t q,
     task_func_t *func, void *arg, uint_t flags, taskq_ent_t *ent)
@@ -1055,6 +1061,8 @@ spa_taskq_dispatch_ent(spa_t *spa, zio_type_t t, zio_taskq_type_t q,
 
 	if (tqs->stqs_count == 1) {
 		tq = tqs->stqs_taskq[0];
+	} else if (spa_taskq_cpu_affine) {
+		tq = tqs->stqs_taskq[CPU_SEQID % tqs->stqs_count];
 	} else {
 		tq = tqs->stqs_taskq[gethrtime() % tqs->stqs_count];
 	}
@@ -1142,6 +1150,50 @@ spa_thread(void *arg)
 }
 #endif
 
+/*
+ * Per-pool kstat reporting how long each phase of the most recently synced
+ * txg took, to make it clear which part of spa_sync() a slow txg spent its
+ * time in.
+ */
+typedef struct spa_sync_kstat {
+	kstat_named_t	ssk_txg;
+	kstat_named_t	ssk_passes;
+	kstat_named_t	ssk_total;
+	kstat_named_t	ssk_phase[SPA_SYNC_NPHASES];
+} spa_sync_kstat_t;
+
+static const spa_sync_kstat_t spa_sync_kstat_template = {
+	{ "txg",			KSTAT_DATA_UINT64 },
+	{ "passes",			KSTAT_DATA_UINT64 },
+	{ "total_ns",			KSTAT_DATA_UINT64 },
+	{
+		{ "dsl_pool_sync_ns",	KSTAT_DATA_UINT64 },
+		{ "frees_ns",		KSTAT_DATA_UINT64 },
+		{ "ddt_scan_ns",	KSTAT_DATA_UINT64 },
+		{ "flush_metaslabs_ns",	KSTAT_DATA_UINT64 },
+		{ "vdev_sync_ns",	KSTAT_DATA_UINT64 },
+		{ "config_sync_ns",	KSTAT_DATA_UINT64 },
+	}
+};
+
+static int
+spa_sync_kstat_update(kstat_t *ksp, int rw)
+{
+	spa_t *spa = ksp->ks_private;
+	spa_sync_kstat_t *ssk = ksp->ks_data;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	ssk->ssk_txg.value.ui64 = spa->spa_sync_stat_txg;
+	ssk->ssk_passes.value.ui64 = spa->spa_sync_stat_passes;
+	ssk->ssk_total.value.ui64 = spa->spa_sync_stat_total;
+	for (int p = 0; p < SPA_SYNC_NPHASES; p++)
+		ssk->ssk_phase[p].value.ui64 = spa->spa_sync_stat_phase[p];
+
+	return (0);
+}
+
 /*
  * Activate an uninitialized pool.
  */
@@ -1221,6 +1273,17 @@ spa_activate(spa_t *spa, int mode)
 	 */
 	spa->spa_upgrade_taskq = taskq_create("z_upgrade", boot_ncpus,
 	    minclsyspri, 1, INT_MAX, TASKQ_DYNAMIC);
+
+	spa->spa_sync_kstat = kstat_create(spa_name(spa), 0, "sync",
+	    "misc", KSTAT_TYPE_NAMED,
+	    sizeof (spa_sync_kstat_t) / sizeof (kstat_named_t), 0);
+	if (spa->spa_sync_kstat != NULL) {
+		bcopy(&spa_sync_kstat_template, spa->spa_sync_kstat->ks_data,
+		    sizeof (spa_sync_kstat_t));
+		spa->spa_sync_kstat->ks_private = spa;
+		spa->spa_sync_kstat->ks_update = spa_sync_kstat_update;
+		kstat_install(spa->spa_sync_kstat);
+	}
 }
 
 /*
@@ -1237,6 +1300,11 @@ spa_deactivate(spa_t *spa)
 
 	spa_evicting_os_wait(spa);
 
+	if (spa->spa_sync_kstat != NULL) {
+		kstat_delete(spa->spa_sync_kstat);
+		spa->spa_sync_kstat = NULL;
+	}
+
 	if (spa->spa_upgrade_taskq) {
 		taskq_destroy(spa->spa_upgrade_taskq);
 		spa->spa_upgrade_taskq = NULL;
@@ -1451,6 +1519,7 @@ spa_unload(spa_t *spa)
 		vdev_initialize_stop_all(root_vdev, VDEV_INITIALIZE_ACTIVE);
 		vdev_trim_stop_all(root_vdev, VDEV_TRIM_ACTIVE);
 		vdev_autotrim_stop_all(spa);
+		vdev_rebuild_stop_all(spa);
 	}
 
 	/*
@@ -4355,6 +4424,15 @@ spa_load_impl(spa_t *spa, spa_import_type_t type, char **ereport)
 		spa_restart_removal(spa);
 		spa_spawn_aux_threads(spa);
 
+		/*
+		 * Load the metaslabs we are likely to allocate from in the
+		 * background, rather than on demand in the first allocations.
+		 */
+		metaslab_class_preload(spa_normal_class(spa));
+		metaslab_class_preload(spa_special_class(spa));
+		metaslab_class_preload(spa_dedup_class(spa));
+		metaslab_class_preload(spa_log_class(spa));
+
 		/*
 		 * Delete any inconsistent datasets.
 		 *
@@ -5997,6 +6075,7 @@ spa_export_common(char *pool, int new_state, nvlist_t **oldconfig,
 			vdev_initialize_stop_all(rvd, VDEV_INITIALIZE_ACTIVE);
 			vdev_trim_stop_all(rvd, VDEV_TRIM_ACTIVE);
 			vdev_autotrim_stop_all(spa);
+			vdev_rebuild_stop_all(spa);
 		}
 
 		/*
@@ -6209,9 +6288,14 @@ spa_vdev_add(spa_t *spa, nvlist_t *nvroot)
  * extra rules: you can't attach to it after it's been created, and upon
  * completion of resilvering, the first disk (the one being replaced)
  * is automatically detached.
+ *
+ * If 'rebuild' is specified, the new device is rebuilt by copying the
+ * allocated space of the top-level vdev (see vdev_rebuild.c) instead of
+ * being resilvered.  This is only possible within mirrors.
  */
 int
-spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
+spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing,
+    boolean_t rebuild)
 {
 	uint64_t txg, dtl_max_txg;
 	vdev_t *rvd = spa->spa_root_vdev;
@@ -6243,6 +6327,10 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 	if (!oldvd->vdev_ops->vdev_op_leaf)
 		return (spa_vdev_exit(spa, NULL, txg, ENOTSUP));
 
+	if (rebuild && oldvd->vdev_top != oldvd &&
+	    !vdev_rebuild_supported(oldvd->vdev_top))
+		return (spa_vdev_exit(spa, NULL, txg, ENOTSUP));
+
 	pvd = oldvd->vdev_parent;
 
 	if ((error = spa_config_parse(spa, &newrootvd, nvroot, NULL, 0,
@@ -6393,9 +6481,17 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 	 * Schedule the resilver to restart in the future. We do this to
 	 * ensure that dmu_sync-ed blocks have been stitched into the
 	 * respective datasets. We do not do this if resilvers have been
-	 * deferred.
-	 */
-	if (dsl_scan_resilvering(spa_get_dsl(spa)) &&
+	 * deferred.  A rebuild is (re)started from the beginning when
+	 * spa_vdev_exit() restarts the rebuild threads; it too waits for
+	 * dtl_max_txg to sync first.
+	 */
+	if (rebuild) {
+		ASSERT(vdev_rebuild_supported(tvd));
+		tvd->vdev_rebuild_max_txg = dtl_max_txg;
+		tvd->vdev_rebuild_next_ms = 0;
+		tvd->vdev_rebuild_bytes_done = 0;
+		tvd->vdev_rebuild_errors = 0;
+	} else if (dsl_scan_resilvering(spa_get_dsl(spa)) &&
 	    spa_feature_is_enabled(spa, SPA_FEATURE_RESILVER_DEFER))
 		vdev_defer_resilver(newvd);
 	else
@@ -7631,6 +7727,12 @@ spa_async_thread(void *arg)
 	if (tasks & SPA_ASYNC_RESILVER_DONE)
 		spa_vdev_resilver_done(spa);
 
+	/*
+	 * Verify the data copied by a sequential rebuild.
+	 */
+	if ((tasks & SPA_ASYNC_REBUILD_DONE) && zfs_rebuild_scrub_enabled)
+		(void) dsl_scan(dp, POOL_SCAN_SCRUB);
+
 	/*
 	 * Kick off a resilver.
 	 */
@@ -8391,12 +8493,13 @@ spa_sync_condense_indirect(spa_t *spa, dmu_tx_t *tx)
 }
 
 static void
-spa_sync_iterate_to_convergence(spa_t *spa, dmu_tx_t *tx)
+spa_sync_iterate_to_convergence(spa_t *spa, dmu_tx_t *tx, hrtime_t *phase)
 {
 	objset_t *mos = spa->spa_meta_objset;
 	dsl_pool_t *dp = spa->spa_dsl_pool;
 	uint64_t txg = tx->tx_txg;
 	bplist_t *free_bpl = &spa->spa_free_bplist[txg & TXG_MASK];
+	hrtime_t start, now;
 
 	do {
 		int pass = ++spa->spa_sync_pass;
@@ -8407,7 +8510,12 @@ spa_sync_iterate_to_convergence(spa_t *spa, dmu_tx_t *tx)
 		spa_sync_aux_dev(spa, &spa->spa_l2cache, tx,
 		    ZPOOL_CONFIG_L2CACHE, DMU_POOL_L2CACHE);
 		spa_errlog_sync(spa, txg);
+
+		start = gethrtime();
 		dsl_pool_sync(dp, txg);
+		now = gethrtime();
+		phase[SPA_SYNC_PHASE_DSL_POOL] += now - start;
+		start = now;
 
 		if (pass < zfs_sync_pass_deferred_free ||
 		    spa_feature_is_active(spa, SPA_FEATURE_LOG_SPACEMAP)) {
@@ -8427,18 +8535,28 @@ spa_sync_iterate_to_convergence(spa_t *spa, dmu_tx_t *tx)
 			bplist_iterate(free_bpl, bpobj_enqueue_cb,
 			    &spa->spa_deferred_bpobj, tx);
 		}
+		now = gethrtime();
+		phase[SPA_SYNC_PHASE_FREES] += now - start;
+		start = now;
 
 		ddt_sync(spa, txg);
 		dsl_scan_sync(dp, tx);
 		svr_sync(spa, tx);
 		spa_sync_upgrades(spa, tx);
+		now = gethrtime();
+		phase[SPA_SYNC_PHASE_DDT_SCAN] += now - start;
+		start = now;
 
 		spa_flush_metaslabs(spa, tx);
+		now = gethrtime();
+		phase[SPA_SYNC_PHASE_FLUSH] += now - start;
+		start = now;
 
 		vdev_t *vd = NULL;
 		while ((vd = txg_list_remove(&spa->spa_vdev_txg_list, txg))
 		    != NULL)
 			vdev_sync(vd, txg);
+		phase[SPA_SYNC_PHASE_VDEVS] += gethrtime() - start;
 
 		/*
 		 * Note: We need to check if the MOS is dirty because we could
@@ -8541,6 +8659,8 @@ void
 spa_sync(spa_t *spa, uint64_t txg)
 {
 	vdev_t *vd = NULL;
+	hrtime_t phase[SPA_SYNC_NPHASES] = { 0 };
+	hrtime_t start;
 
 	VERIFY(spa_writeable(spa));
 
@@ -8623,7 +8743,7 @@ spa_sync(spa_t *spa, uint64_t txg)
 
 	spa_sync_condense_indirect(spa, tx);
 
-	spa_sync_iterate_to_convergence(spa, tx);
+	spa_sync_iterate_to_convergence(spa, tx, phase);
 
 #ifdef ZFS_DEBUG
 	if (!list_is_empty(&spa->spa_config_dirty_list)) {
@@ -8646,7 +8766,9 @@ spa_sync(spa_t *spa, uint64_t txg)
 		ASSERT0(spa->spa_vdev_removal->svr_bytes_done[txg & TXG_MASK]);
 	}
 
+	start = gethrtime();
 	spa_sync_rewrite_vdev_config(spa, tx);
+	phase[SPA_SYNC_PHASE_CONFIG] = gethrtime() - start;
 	dmu_tx_commit(tx);
 
 	VERIFY(cyclic_reprogram(spa->spa_deadman_cycid, CY_INFINITY));
@@ -8700,6 +8822,11 @@ spa_sync(spa_t *spa, uint64_t txg)
 	while (zfs_pause_spa_sync)
 		delay(1);
 
+	spa->spa_sync_stat_txg = txg;
+	spa->spa_sync_stat_passes = spa->spa_sync_pass;
+	spa->spa_sync_stat_total = gethrtime() - spa->spa_sync_starttime;
+	bcopy(phase, spa->spa_sync_stat_phase, sizeof (phase));
+
 	spa->spa_sync_pass = 0;
 
 	/*
@@ -44,6 +44,7 @@
 #include <sys/vdev_impl.h>
 #include <sys/vdev_initialize.h>
 #include <sys/vdev_trim.h>
+#include <sys/vdev_rebuild.h>
 #include <sys/vdev_raidz.h>
 #include <sys/metaslab.h>
 #include <sys/uberblock_impl.h>
@@ -59,6 +60,7 @@
 #include <sys/arc.h>
 #include <sys/ddt.h>
 #include "zfs_prop.h"
+#include "zfs_fletcher.h"
 #include <sys/btree.h>
 #include <sys/zfeature.h>
 
@@ -607,6 +609,9 @@ spa_log_sm_sort_by_txg(const void *va, const void *vb)
 	return (TREE_CMP(a->sls_txg, b->sls_txg));
 }
 
+static void spa_iostats_init(spa_t *);
+static void spa_iostats_destroy(spa_t *);
+
 /*
  * Create an uninitialized spa_t with the given name.  Requires
  * spa_namespace_lock.  The caller must ensure that the spa_t doesn't already
@@ -741,6 +746,7 @@ spa_add(const char *name, nvlist_t *config, const char *altroot)
 		spa->spa_iokstat->ks_lock = &spa->spa_iokstat_lock;
 		kstat_install(spa->spa_iokstat);
 	}
+	spa_iostats_init(spa);
 
 	spa->spa_min_ashift = INT_MAX;
 	spa->spa_max_ashift = 0;
@@ -822,6 +828,7 @@ spa_remove(spa_t *spa)
 
 	kstat_delete(spa->spa_iokstat);
 	spa->spa_iokstat = NULL;
+	spa_iostats_destroy(spa);
 
 	for (int t = 0; t < TXG_SIZE; t++)
 		bplist_destroy(&spa->spa_free_bplist[t]);
@@ -1203,6 +1210,7 @@ spa_vdev_enter(spa_t *spa)
 	mutex_enter(&spa_namespace_lock);
 
 	vdev_autotrim_stop_all(spa);
+	vdev_rebuild_stop_all(spa);
 
 	return (spa_vdev_config_enter(spa));
 }
@@ -1313,6 +1321,7 @@ int
 spa_vdev_exit(spa_t *spa, vdev_t *vd, uint64_t txg, int error)
 {
 	vdev_autotrim_restart(spa);
+	vdev_rebuild_restart(spa);
 
 	spa_vdev_config_exit(spa, vd, txg, error, FTAG);
 	mutex_exit(&spa_namespace_lock);
@@ -2182,6 +2191,91 @@ spa_import_progress_remove(spa_t *spa)
 	}
 }
 
+/*
+ * ==========================================================================
+ * SPA I/O Statistics
+ * Exported as the named kstat zfs:0:<pool>_iostats.  Only TRIM is accounted
+ * here; the counters are updated atomically without a lock.
+ * ==========================================================================
+ */
+
+static const spa_iostats_t spa_iostats_template = {
+	{ "trim_extents_written",		KSTAT_DATA_UINT64 },
+	{ "trim_bytes_written",			KSTAT_DATA_UINT64 },
+	{ "trim_extents_skipped",		KSTAT_DATA_UINT64 },
+	{ "trim_bytes_skipped",			KSTAT_DATA_UINT64 },
+	{ "trim_extents_failed",		KSTAT_DATA_UINT64 },
+	{ "trim_bytes_failed",			KSTAT_DATA_UINT64 },
+	{ "autotrim_extents_written",		KSTAT_DATA_UINT64 },
+	{ "autotrim_bytes_written",		KSTAT_DATA_UINT64 },
+	{ "autotrim_extents_skipped",		KSTAT_DATA_UINT64 },
+	{ "autotrim_bytes_skipped",		KSTAT_DATA_UINT64 },
+	{ "autotrim_extents_failed",		KSTAT_DATA_UINT64 },
+	{ "autotrim_bytes_failed",		KSTAT_DATA_UINT64 },
+};
+
+static void
+spa_iostats_init(spa_t *spa)
+{
+	char name[KSTAT_STRLEN];
+
+	(void) snprintf(name, sizeof (name), "%s_iostats", spa_name(spa));
+	spa->spa_iostats_kstat = kstat_create("zfs", 0, name, "misc",
+	    KSTAT_TYPE_NAMED, sizeof (spa_iostats_t) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (spa->spa_iostats_kstat != NULL) {
+		spa_iostats_t *sis = kmem_alloc(sizeof (spa_iostats_t),
+		    KM_SLEEP);
+
+		bcopy(&spa_iostats_template, sis, sizeof (spa_iostats_t));
+		spa->spa_iostats_kstat->ks_data = sis;
+		kstat_install(spa->spa_iostats_kstat);
+	}
+}
+
+static void
+spa_iostats_destroy(spa_t *spa)
+{
+	if (spa->spa_iostats_kstat != NULL) {
+		void *data = spa->spa_iostats_kstat->ks_data;
+
+		kstat_delete(spa->spa_iostats_kstat);
+		spa->spa_iostats_kstat = NULL;
+		kmem_free(data, sizeof (spa_iostats_t));
+	}
+}
+
+void
+spa_iostats_trim_add(spa_t *spa, trim_type_t type,
+    uint64_t extents_written, uint64_t bytes_written,
+    uint64_t extents_skipped, uint64_t bytes_skipped,
+    uint64_t extents_failed, uint64_t bytes_failed)
+{
+	spa_iostats_t *sis;
+	kstat_named_t *ksn;
+
+	if (spa->spa_iostats_kstat == NULL)
+		return;
+
+	sis = spa->spa_iostats_kstat->ks_data;
+	ksn = (type == TRIM_TYPE_MANUAL) ?
+	    &sis->trim_extents_written : &sis->autotrim_extents_written;
+
+	/* The six counters for each type are laid out in this order. */
+	if (extents_written != 0)
+		atomic_add_64(&ksn[0].value.ui64, extents_written);
+	if (bytes_written != 0)
+		atomic_add_64(&ksn[1].value.ui64, bytes_written);
+	if (extents_skipped != 0)
+		atomic_add_64(&ksn[2].value.ui64, extents_skipped);
+	if (bytes_skipped != 0)
+		atomic_add_64(&ksn[3].value.ui64, bytes_skipped);
+	if (extents_failed != 0)
+		atomic_add_64(&ksn[4].value.ui64, extents_failed);
+	if (bytes_failed != 0)
+		atomic_add_64(&ksn[5].value.ui64, bytes_failed);
+}
+
 /*
  * ==========================================================================
  * Initialization and Termination
@@ -2255,6 +2349,7 @@ spa_init(int mode)
 	vdev_cache_stat_init();
 	vdev_mirror_stat_init();
 	vdev_raidz_math_init();
+	fletcher_4_init();
 	zfs_prop_init();
 	zpool_prop_init();
 	zpool_feature_init();
@@ -2274,6 +2369,7 @@ spa_fini(void)
 	vdev_cache_stat_fini();
 	vdev_mirror_stat_fini();
 	vdev_raidz_math_fini();
+	fletcher_4_fini();
 	zil_fini();
 	dmu_fini();
 	zio_fini();
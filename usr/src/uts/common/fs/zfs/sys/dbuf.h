@@ -23,6 +23,7 @@
  * Copyright (c) 2012, 2018 by Delphix. All rights reserved.
  * Copyright (c) 2013 by Saso Kiselkov. All rights reserved.
  * Copyright (c) 2014 Spectra Logic Corporation, All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_SYS_DBUF_H
@@ -156,6 +157,13 @@ typedef struct dbuf_dirty_record {
 			boolean_t dr_nopwrite;
 			boolean_t dr_has_raw_params;
 
+			/*
+			 * Set if the block being overwritten was being read
+			 * frequently, so the new copy should be placed in
+			 * the special class (see dbuf_write()).
+			 */
+			boolean_t dr_hot;
+
 			/*
 			 * If dr_has_raw_params is set, the following crypt
 			 * params will be set on the BP that's written.
@@ -273,20 +281,49 @@ typedef struct dmu_buf_impl {
 	/*
 	 * dnode_evict_dbufs() or dnode_evict_bonus() tried to
 	 * evict this dbuf, but couldn't due to outstanding
-	 * references.  Evict once the refcount drops to 0.
+	 * references.  Evict once the refcount drops to 0.  Also set
+	 * by DMU_READ_NO_CACHE reads, which don't want the dbuf cached.
 	 */
 	uint8_t db_pending_evict;
 
+	/*
+	 * Direct I/O (DMU_DIRECTIO) touched this dbuf: when the last
+	 * hold is released, treat it as if primarycache=none and
+	 * evict both the dbuf and its ARC buffer.
+	 */
+	uint8_t db_uncached;
+
 	uint8_t db_dirtycnt;
 } dmu_buf_impl_t;
 
-/* Note: the dbuf hash table is exposed only for the mdb module */
-#define	DBUF_MUTEXES 256
-#define	DBUF_HASH_MUTEX(h, idx) (&(h)->hash_mutexes[(idx) & (DBUF_MUTEXES-1)])
+/*
+ * Note: the dbuf hash table is exposed only for the mdb module
+ *
+ * The table is never smaller than DBUF_MUTEXES buckets, so the mutex
+ * covering a bucket depends only on the low bits of the hash value.  When
+ * the table is grown, each old bucket and the two new buckets it splits into
+ * are therefore covered by the same mutex, which lets the buckets be moved
+ * to hash_new_table one at a time; those below hash_rehash_idx have already
+ * been moved.
+ */
+#define	DBUF_MUTEXES 2048
+#define	DBUF_HASH_LOCK_PAD 64
+#define	DBUF_HASH_MUTEX(h, hv) \
+	(&(h)->hash_mutexes[(hv) & (DBUF_MUTEXES-1)].dhl_lock)
+typedef struct dbuf_hash_lock {
+	kmutex_t dhl_lock;
+#ifdef _KERNEL
+	unsigned char dhl_pad[DBUF_HASH_LOCK_PAD - sizeof (kmutex_t)];
+#endif
+} dbuf_hash_lock_t;
+
 typedef struct dbuf_hash_table {
 	uint64_t hash_table_mask;
 	dmu_buf_impl_t **hash_table;
-	kmutex_t hash_mutexes[DBUF_MUTEXES];
+	uint64_t hash_new_mask;
+	dmu_buf_impl_t **hash_new_table;
+	uint64_t hash_rehash_idx;
+	dbuf_hash_lock_t hash_mutexes[DBUF_MUTEXES];
 } dbuf_hash_table_t;
 
 uint64_t dbuf_whichblock(struct dnode *di, int64_t level, uint64_t offset);
@@ -359,9 +396,10 @@ boolean_t dbuf_is_metadata(dmu_buf_impl_t *db);
 	(dbuf_is_metadata(_db) ? ARC_BUFC_METADATA : ARC_BUFC_DATA)
 
 #define	DBUF_IS_CACHEABLE(_db)						\
+	(!(_db)->db_uncached &&						\
 	((_db)->db_objset->os_primary_cache == ZFS_CACHE_ALL ||		\
 	(dbuf_is_metadata(_db) &&					\
-	((_db)->db_objset->os_primary_cache == ZFS_CACHE_METADATA)))
+	((_db)->db_objset->os_primary_cache == ZFS_CACHE_METADATA))))
 
 #define	DBUF_IS_L2CACHEABLE(_db)					\
 	((_db)->db_objset->os_secondary_cache == ZFS_CACHE_ALL ||	\
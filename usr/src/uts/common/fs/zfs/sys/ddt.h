@@ -127,6 +127,28 @@ struct ddt_entry {
 	avl_node_t	dde_node;
 };
 
+/*
+ * On-disk DDT log record.  The log is an append-only object holding the
+ * latest state of every entry that has changed since it was last flushed
+ * into its ZAP; a record with no referenced phys is a removal.
+ */
+typedef struct ddt_log_record {
+	ddt_key_t	dlr_key;
+	ddt_phys_t	dlr_phys[DDT_PHYS_TYPES];
+} ddt_log_record_t;
+
+/*
+ * In-core DDT log entry.  dle_type and dle_class record where the entry
+ * currently lives in the on-disk ZAPs (DDT_TYPES if it is not there yet).
+ */
+typedef struct ddt_log_entry {
+	ddt_key_t	dle_key;
+	ddt_phys_t	dle_phys[DDT_PHYS_TYPES];
+	enum ddt_type	dle_type;
+	enum ddt_class	dle_class;
+	avl_node_t	dle_node;
+} ddt_log_entry_t;
+
 /*
  * In-core ddt
  */
@@ -143,6 +165,16 @@ struct ddt {
 	ddt_histogram_t	ddt_histogram_cache[DDT_TYPES][DDT_CLASSES];
 	ddt_object_t	ddt_object_stats[DDT_TYPES][DDT_CLASSES];
 	avl_node_t	ddt_node;
+	avl_tree_t	ddt_log_tree;	/* unflushed log entries */
+	uint64_t	ddt_log_object;	/* on-disk log object */
+	uint64_t	ddt_log_length;	/* bytes of records in the log */
+	ddt_key_t	ddt_log_cursor;	/* next key to flush */
+	ddt_log_record_t *ddt_log_buf;	/* records not yet written */
+	uint64_t	ddt_log_buf_count;
+	uint64_t	ddt_log_appended;
+	uint64_t	ddt_log_flushed;
+	uint64_t	ddt_log_pruned;
+	uint64_t	ddt_log_compactions;
 };
 
 /*
@@ -237,6 +269,7 @@ extern ddt_entry_t *ddt_repair_start(ddt_t *ddt, const blkptr_t *bp);
 extern void ddt_repair_done(ddt_t *ddt, ddt_entry_t *dde);
 
 extern int ddt_entry_compare(const void *x1, const void *x2);
+extern int ddt_log_entry_compare(const void *x1, const void *x2);
 
 extern void ddt_create(spa_t *spa);
 extern int ddt_load(spa_t *spa);
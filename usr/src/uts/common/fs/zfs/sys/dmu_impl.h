@@ -23,7 +23,7 @@
  * Use is subject to license terms.
  */
 /*
- * Copyright (c) 2012, Joyent, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2013, 2015 by Delphix. All rights reserved.
  * Copyright (c) 2018 DilOS
  */
@@ -71,7 +71,7 @@ extern "C" {
  * os_obj_lock
  *   must be held before:
  *   	everything except dp_config_rwlock
- *   protects os_obj_next
+ *   serializes dmu_object_alloc's search for a sparse part of the metadnode
  *   held from:
  *   	dmu_object_alloc: dn_dbufs_mtx, db_mtx, hash_mutexes, dn_struct_rwlock
  *
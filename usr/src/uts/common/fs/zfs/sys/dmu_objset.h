@@ -120,6 +120,7 @@ struct objset {
 	zfs_cache_type_t os_primary_cache;
 	zfs_cache_type_t os_secondary_cache;
 	zfs_sync_type_t os_sync;
+	zfs_direct_type_t os_direct;
 	zfs_redundant_metadata_type_t os_redundant_metadata;
 	int os_recordsize;
 	/*
@@ -156,7 +157,11 @@ struct objset {
 	/* os_phys_buf should be written raw next txg */
 	boolean_t os_next_write_raw[TXG_SIZE];
 
-	/* Protected by os_obj_lock */
+	/*
+	 * os_obj_next_chunk is advanced with atomic ops; os_obj_lock is
+	 * only held by the one thread at a time which is searching the
+	 * meta-dnode for a sparse region to move it to.
+	 */
 	kmutex_t os_obj_lock;
 	uint64_t os_obj_next_chunk;
 
@@ -173,6 +178,9 @@ struct objset {
 	/* Protects changes to DMU_{USER,GROUP,PROJECT}USED_OBJECT */
 	kmutex_t os_userused_lock;
 
+	/* predictive prefetch statistics and tuning */
+	zfetch_os_t *os_zfetch;
+
 	/* stuff we store for the user */
 	kmutex_t os_user_ptr_lock;
 	void *os_user_ptr;
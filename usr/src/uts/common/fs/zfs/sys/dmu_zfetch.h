@@ -39,11 +39,24 @@ extern "C" {
 extern uint64_t	zfetch_array_rd_sz;
 
 struct dnode;				/* so we can reference dnode */
+struct objset;
 
 typedef struct zstream {
 	uint64_t	zs_blkid;	/* expect next access at this blkid */
 	uint64_t	zs_pf_blkid;	/* next block to prefetch */
 
+	/*
+	 * Strided and reverse streams.  zs_stride is the distance in blocks
+	 * between the starts of consecutive accesses of zs_nblks blocks each;
+	 * it is negative for a stream that is read backwards, and zero for an
+	 * ordinary forward sequential stream, which uses zs_pf_blkid and
+	 * zs_ipf_blkid instead.  zs_pf_ahead is the number of accesses we
+	 * have prefetched beyond zs_blkid.
+	 */
+	int64_t		zs_stride;
+	uint64_t	zs_nblks;
+	uint64_t	zs_pf_ahead;
+
 	/*
 	 * We will next prefetch the L1 indirect block of this level-0
 	 * block id.
@@ -59,11 +72,38 @@ typedef struct zfetch {
 	krwlock_t	zf_rwlock;	/* protects zfetch structure */
 	list_t		zf_stream;	/* list of zstream_t's */
 	struct dnode	*zf_dnode;	/* dnode that owns this zfetch */
+	uint64_t	zf_last_blkid;	/* last access matching no stream */
+	uint64_t	zf_last_nblks;	/* and its length, 0 if none */
 } zfetch_t;
 
+typedef struct zfetch_os_stats {
+	kstat_named_t zfos_hits;
+	kstat_named_t zfos_misses;
+	kstat_named_t zfos_stride_hits;
+	kstat_named_t zfos_reverse_hits;
+	kstat_named_t zfos_prefetched;
+	kstat_named_t zfos_wasted;
+	kstat_named_t zfos_distance;
+} zfetch_os_stats_t;
+
+/*
+ * Per-objset prefetch state: statistics, and the data prefetch distance,
+ * which adapts to how many of the prefetched blocks are actually read.
+ */
+typedef struct zfetch_os {
+	kstat_t		*zfo_ksp;
+	zfetch_os_stats_t zfo_stats;
+	uint32_t	zfo_distance;	/* current max data distance */
+	uint64_t	zfo_win_prefetched; /* blocks prefetched in window */
+	uint64_t	zfo_win_wasted;	/* never read, in window */
+} zfetch_os_t;
+
 void		zfetch_init(void);
 void		zfetch_fini(void);
 
+void		zfetch_os_init(struct objset *);
+void		zfetch_os_fini(struct objset *);
+
 void		dmu_zfetch_init(zfetch_t *, struct dnode *);
 void		dmu_zfetch_fini(zfetch_t *);
 void		dmu_zfetch(zfetch_t *, uint64_t, uint64_t, boolean_t);
@@ -22,6 +22,7 @@
  * Copyright (c) 2005, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright (c) 2013, 2017 by Delphix. All rights reserved.
  * Copyright 2016 Nexenta Systems, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_SYS_DSL_POOL_H
@@ -102,6 +103,7 @@ typedef struct dsl_pool {
 	uint64_t dp_bptree_obj;
 	uint64_t dp_empty_bpobj;
 	bpobj_t dp_obsolete_bpobj;
+	uint64_t dp_sync_dirty;		/* dirty data in the syncing txg */
 
 	struct dsl_scan *dp_scan;
 
@@ -114,6 +116,7 @@ typedef struct dsl_pool {
 	uint64_t dp_mos_used_delta;
 	uint64_t dp_mos_compressed_delta;
 	uint64_t dp_mos_uncompressed_delta;
+	uint64_t dp_sync_bw;		/* measured sync rate, bytes/sec */
 
 	/*
 	 * Time of most recently scheduled (furthest in the future)
@@ -37,6 +37,7 @@
 #include <sys/txg.h>
 #include <sys/avl.h>
 #include <sys/multilist.h>
+#include <sys/aggsum.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -203,6 +204,29 @@ struct metaslab_class {
 	multilist_t		*mc_metaslab_txg_list;
 };
 
+/*
+ * A reservation slab is a run of space carved out of a metaslab from which
+ * small allocations are then handed out without taking ms_lock; see
+ * metaslab_slab_alloc().  Each metaslab group keeps one slab per CPU and
+ * open txg.  The space reserved for a slab is accounted as allocated in
+ * that txg, and whatever is left of it is returned to the metaslab by
+ * metaslab_sync() before the txg is written out, so a slab never outlives
+ * its txg.
+ */
+typedef struct metaslab_slab {
+	kmutex_t	mss_lock;
+	metaslab_t	*mss_msp;	/* metaslab the slab was carved from */
+	uint64_t	mss_txg;	/* txg the slab belongs to */
+	uint64_t	mss_cursor;	/* next free offset */
+	uint64_t	mss_end;	/* end of the slab */
+	uint64_t	mss_nofill_txg;	/* last txg a refill failed */
+	uint64_t	mss_allocs;	/* allocations satisfied */
+	uint64_t	mss_contended;	/* mss_lock was busy */
+} metaslab_slab_t __aligned(CACHE_LINE_SIZE);
+
+#define	METASLAB_SLAB(mg, cpu, txg)	\
+	(&(mg)->mg_slabs[(cpu) * TXG_SIZE + ((txg) & TXG_MASK)])
+
 /*
  * Metaslab groups encapsulate all the allocatable regions (i.e. metaslabs)
  * of a top-level vdev. They are linked togther to form a circular linked
@@ -284,6 +308,14 @@ struct metaslab_group {
 	kmutex_t		mg_ms_disabled_lock;
 	kcondvar_t		mg_ms_disabled_cv;
 
+	/* reservation slabs, METASLAB_SLAB(mg, cpu, txg) */
+	metaslab_slab_t		*mg_slabs;
+	int			mg_slab_cpus;
+	uint64_t		mg_slab_refills;
+	uint64_t		mg_slab_refill_failures;
+	uint64_t		mg_slab_returned;
+	uint64_t		mg_ms_lock_contended;
+
 	kstat_t			*mg_kstat;
 	kmutex_t		mg_kstat_lock;
 };
@@ -292,6 +324,12 @@ typedef struct metaslab_group_kstat {
 	kstat_named_t	mg_loads;
 	kstat_named_t	mg_unloads;
 	kstat_named_t	mg_spa_name;
+	kstat_named_t	mg_slab_allocs;
+	kstat_named_t	mg_slab_contended;
+	kstat_named_t	mg_slab_refills;
+	kstat_named_t	mg_slab_refill_failures;
+	kstat_named_t	mg_slab_returned;
+	kstat_named_t	mg_ms_lock_contended;
 } metaslab_group_kstat_t;
 
 /*
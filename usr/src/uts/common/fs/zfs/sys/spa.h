@@ -25,7 +25,7 @@
  * Copyright (c) 2014 Spectra Logic Corporation, All rights reserved.
  * Copyright 2013 Saso Kiselkov. All rights reserved.
  * Copyright (c) 2014 Integros [integros.com]
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2017, 2019, Datto Inc. All rights reserved.
  * Copyright (c) 2017, Intel Corporation.
  * Copyright 2020 Joshua M. Clulow <josh@sysmgr.org>
@@ -792,6 +792,7 @@ extern int spa_scan_get_stats(spa_t *spa, pool_scan_stat_t *ps);
 #define	SPA_ASYNC_INITIALIZE_RESTART		0x100
 #define	SPA_ASYNC_TRIM_RESTART			0x200
 #define	SPA_ASYNC_AUTOTRIM_RESTART		0x400
+#define	SPA_ASYNC_REBUILD_DONE			0x800
 
 /*
  * Controls the behavior of spa_vdev_remove().
@@ -802,7 +803,7 @@ extern int spa_scan_get_stats(spa_t *spa, pool_scan_stat_t *ps);
 /* device manipulation */
 extern int spa_vdev_add(spa_t *spa, nvlist_t *nvroot);
 extern int spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot,
-    int replacing);
+    int replacing, boolean_t rebuild);
 extern int spa_vdev_detach(spa_t *spa, uint64_t guid, uint64_t pguid,
     int replace_done);
 extern int spa_vdev_remove(spa_t *spa, uint64_t guid, boolean_t unspare);
@@ -908,6 +909,8 @@ extern int spa_import_progress_set_max_txg(spa_t *, uint64_t);
 extern int spa_import_progress_set_mmp_check(spa_t *, uint64_t);
 extern void spa_import_progress_add(spa_t *);
 extern void spa_import_progress_remove(spa_t *);
+extern void spa_iostats_trim_add(spa_t *, trim_type_t, uint64_t, uint64_t,
+    uint64_t, uint64_t, uint64_t, uint64_t);
 
 /* Pool configuration locks */
 extern int spa_config_tryenter(spa_t *spa, int locks, void *tag, krw_t rw);
@@ -27,7 +27,7 @@
  * Copyright (c) 2017 Datto Inc.
  * Copyright 2019 Joyent, Inc.
  * Copyright (c) 2017, Intel Corporation.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef _SYS_SPA_IMPL_H
@@ -197,6 +197,20 @@ typedef enum spa_config_source {
 	SPA_CONFIG_SRC_MOS		/* MOS, but not always from right txg */
 } spa_config_source_t;
 
+/*
+ * The phases of spa_sync() whose duration is reported by the per-pool
+ * "sync" kstat.
+ */
+typedef enum spa_sync_phase {
+	SPA_SYNC_PHASE_DSL_POOL,	/* dsl_pool_sync() */
+	SPA_SYNC_PHASE_FREES,		/* freeing or deferring frees */
+	SPA_SYNC_PHASE_DDT_SCAN,	/* ddt, scan, removal and upgrades */
+	SPA_SYNC_PHASE_FLUSH,		/* flushing the log spacemaps */
+	SPA_SYNC_PHASE_VDEVS,		/* vdev_sync() of dirty vdevs */
+	SPA_SYNC_PHASE_CONFIG,		/* writing labels and uberblocks */
+	SPA_SYNC_NPHASES
+} spa_sync_phase_t;
+
 struct spa {
 	/*
 	 * Fields protected by spa_namespace_lock.
@@ -360,6 +374,7 @@ struct spa {
 	uint64_t	spa_bootsize;		/* efi system partition size */
 	ddt_t		*spa_ddt[ZIO_CHECKSUM_FUNCTIONS]; /* in-core DDTs */
 	uint64_t	spa_ddt_stat_object;	/* DDT statistics */
+	struct kstat	*spa_ddt_log_kstat;	/* DDT log statistics */
 	uint64_t	spa_dedup_ditto;	/* dedup ditto threshold */
 	uint64_t	spa_dedup_checksum;	/* default dedup checksum */
 	uint64_t	spa_dspace;		/* dspace in normal class */
@@ -382,6 +397,11 @@ struct spa {
 	cyclic_id_t	spa_deadman_cycid;	/* cyclic id */
 	uint64_t	spa_deadman_calls;	/* number of deadman calls */
 	hrtime_t	spa_sync_starttime;	/* starting time fo spa_sync */
+	struct kstat	*spa_sync_kstat;	/* sync phase timings */
+	uint64_t	spa_sync_stat_txg;	/* last txg timed */
+	uint64_t	spa_sync_stat_passes;	/* passes in that txg */
+	hrtime_t	spa_sync_stat_total;	/* duration of that txg */
+	hrtime_t	spa_sync_stat_phase[SPA_SYNC_NPHASES];
 	uint64_t	spa_deadman_synctime;	/* deadman expiration timer */
 	uint64_t	spa_all_vdev_zaps;	/* ZAP of per-vd ZAP obj #s */
 	spa_avz_action_t	spa_avz_action;	/* destroy/rebuild AVZ? */
@@ -407,6 +427,7 @@ struct spa {
 	 */
 	kmutex_t	spa_imp_kstat_lock;
 	struct kstat	*spa_imp_kstat;		/* kstat for import status */
+	struct kstat	*spa_iostats_kstat;	/* assorted pool I/O stats */
 
 	/* arc_memory_throttle() parameters during low memory condition */
 	uint64_t	spa_lowmem_page_load;	/* memory load during txg */
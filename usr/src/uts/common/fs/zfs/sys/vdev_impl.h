@@ -23,13 +23,14 @@
  * Copyright (c) 2011, 2018 by Delphix. All rights reserved.
  * Copyright (c) 2011, 2019 by Delphix. All rights reserved.
  * Copyright (c) 2017, Intel Corporation.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright 2020 Joshua M. Clulow <josh@sysmgr.org>
  */
 
 #ifndef _SYS_VDEV_IMPL_H
 #define	_SYS_VDEV_IMPL_H
 
+#include <sys/aggsum.h>
 #include <sys/avl.h>
 #include <sys/bpobj.h>
 #include <sys/dmu.h>
@@ -63,6 +64,7 @@ typedef struct vdev_cache_entry vdev_cache_entry_t;
 struct abd;
 
 extern int zfs_vdev_queue_depth_pct;
+extern boolean_t zfs_vdev_queue_mq;
 extern int zfs_vdev_def_queue_depth;
 extern uint32_t zfs_vdev_async_write_max_active;
 
@@ -136,6 +138,7 @@ struct vdev_cache {
 
 typedef struct vdev_queue_class {
 	uint32_t	vqc_active;
+	uint32_t	vqc_mq_queued;	/* queued i/os in multi-queue mode */
 
 	/*
 	 * Sorted by offset or timestamp, depending on if the queue is
@@ -144,6 +147,17 @@ typedef struct vdev_queue_class {
 	avl_tree_t	vqc_queued_tree;
 } vdev_queue_class_t;
 
+/*
+ * Per-CPU submission state for the multi-queue vdev_queue mode.  The queued
+ * trees are FIFO ordered; the active tree holds the i/os issued from this
+ * CPU's queues.
+ */
+typedef struct vdev_queue_cpu {
+	kmutex_t	vqcpu_lock;
+	avl_tree_t	vqcpu_queued_tree[ZIO_PRIORITY_NUM_QUEUEABLE];
+	avl_tree_t	vqcpu_active_tree;
+} vdev_queue_cpu_t __aligned(CACHE_LINE_SIZE);
+
 struct vdev_queue {
 	vdev_t		*vq_vdev;
 	vdev_queue_class_t vq_class[ZIO_PRIORITY_NUM_QUEUEABLE];
@@ -154,7 +168,13 @@ struct vdev_queue {
 	uint64_t	vq_last_offset;
 	zoneid_t	vq_last_zone_id;
 	hrtime_t	vq_io_complete_ts; /* time last i/o completed */
+	hrtime_t	vq_read_lat;	/* moving average read latency */
 	kmutex_t	vq_lock;
+	boolean_t	vq_mq;		/* per-CPU multi-queue dispatch */
+	uint32_t	vq_mq_active;	/* i/os issued in multi-queue mode */
+	uint32_t	vq_mq_rotor;	/* next CPU queue to issue from */
+	uint_t		vq_ncpus;
+	vdev_queue_cpu_t *vq_cpu;
 };
 
 typedef enum vdev_alloc_bias {
@@ -237,6 +257,7 @@ struct vdev {
 	boolean_t	vdev_nonrot;	/* true if solid state		*/
 	int		vdev_open_error; /* error on last open		*/
 	kthread_t	*vdev_open_thread; /* thread opening children	*/
+	nvlist_t	*vdev_validate_label; /* label read ahead	*/
 	uint64_t	vdev_crtxg;	/* txg when top-level was added */
 
 	/*
@@ -303,6 +324,20 @@ struct vdev {
 	/* The following is not in ZoL, but used for auto-trim test progress */
 	uint64_t	vdev_autotrim_bytes_done;
 
+	/* Sequential rebuild related, top-level only; see vdev_rebuild.c */
+	boolean_t	vdev_rebuild_exit_wanted;
+	/* Protects vdev_rebuild_thread. */
+	kmutex_t	vdev_rebuild_lock;
+	kcondvar_t	vdev_rebuild_cv;
+	kthread_t	*vdev_rebuild_thread;
+	uint64_t	vdev_rebuild_max_txg;	/* rebuilding txgs below this */
+	uint64_t	vdev_rebuild_next_ms;	/* first metaslab not rebuilt */
+	uint64_t	vdev_rebuild_bytes_done;
+	uint64_t	vdev_rebuild_errors;
+	kmutex_t	vdev_rebuild_io_lock;
+	kcondvar_t	vdev_rebuild_io_cv;
+	uint64_t	vdev_rebuild_inflight;
+
 	/* for limiting outstanding I/Os (initialize and TRIM) */
 	kmutex_t	vdev_initialize_io_lock;
 	kcondvar_t	vdev_initialize_io_cv;
@@ -23,6 +23,7 @@
  * Copyright (c) 2005, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright (c) 2012, 2018 by Delphix. All rights reserved.
  * Copyright 2017 Nexenta Systems, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_SYS_ZAP_H
@@ -348,6 +349,7 @@ typedef struct zap_cursor {
 	uint64_t zc_hash;
 	uint32_t zc_cd;
 	boolean_t zc_prefetch;
+	uint64_t zc_prefetch_hash;	/* leaves prefetched up to here */
 } zap_cursor_t;
 
 typedef struct {
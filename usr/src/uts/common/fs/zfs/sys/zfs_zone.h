@@ -19,7 +19,7 @@
  * CDDL HEADER END
  */
 /*
- * Copyright 2015, Joyent, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_SYS_FS_ZFS_ZONE_H
@@ -51,6 +51,8 @@ extern void zfs_zone_zio_dequeue(zio_t *);
 extern void zfs_zone_zio_enqueue(zio_t *);
 extern void zfs_zone_report_txg_sync(void *);
 extern hrtime_t zfs_zone_txg_delay();
+extern void zfs_zone_dirty_space(uint64_t);
+extern boolean_t zfs_zone_dirty_exempt(void);
 #ifdef _KERNEL
 extern zio_t *zfs_zone_schedule(vdev_queue_t *, zio_priority_t, avl_index_t,
     avl_tree_t *);
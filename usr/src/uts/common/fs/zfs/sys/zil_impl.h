@@ -45,8 +45,11 @@ extern "C" {
  * must be held.
  *
  * After the lwb is "opened", it can transition into the "issued" state
- * via zil_lwb_write_issue(). Again, the zilog's "zl_issuer_lock" must
- * be held when making this transition.
+ * via zil_lwb_write_close(). Again, the zilog's "zl_issuer_lock" must
+ * be held when making this transition. The "issued" lwb's zios are then
+ * handed to the zio layer by zil_lwb_write_issue(), which does not
+ * require the "zl_issuer_lock"; a writer collects the lwbs it closes and
+ * only issues them once it has dropped the lock.
  *
  * After the lwb's write zio completes, it transitions into the "write
  * done" state via zil_lwb_write_done(); and then into the "flush done"
@@ -83,7 +86,7 @@ typedef enum {
 /*
  * Log write block (lwb)
  *
- * Prior to an lwb being issued to disk via zil_lwb_write_issue(), it
+ * Prior to an lwb being closed for writing via zil_lwb_write_close(), it
  * will be protected by the zilog's "zl_issuer_lock". Basically, prior
  * to it being issued, it will only be accessed by the thread that's
  * holding the "zl_issuer_lock". After the lwb is issued, the zilog's
@@ -106,6 +109,8 @@ typedef struct lwb {
 	avl_tree_t	lwb_vdev_tree;	/* vdevs to flush after lwb write */
 	kmutex_t	lwb_vdev_lock;	/* protects lwb_vdev_tree */
 	hrtime_t	lwb_issued_timestamp; /* when was the lwb issued? */
+	hrtime_t	lwb_write_done_timestamp; /* when did the write end? */
+	list_node_t	lwb_issue_node;	/* list of lwbs to be issued */
 } lwb_t;
 
 /*
@@ -477,6 +477,7 @@ struct zio {
 					/* file). */
 	avl_node_t	io_queue_node;
 	avl_node_t	io_offset_node;
+	uint_t		io_queue_cpu;	/* multi-queue vdev_queue index */
 	avl_node_t	io_alloc_node;
 	zio_alloc_list_t	io_alloc_list;
 
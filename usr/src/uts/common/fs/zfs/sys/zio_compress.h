@@ -54,6 +54,46 @@ enum zio_compress {
 	ZIO_COMPRESS_GZIP_9,
 	ZIO_COMPRESS_ZLE,
 	ZIO_COMPRESS_LZ4,
+	ZIO_COMPRESS_ZSTD_1,
+	ZIO_COMPRESS_ZSTD_2,
+	ZIO_COMPRESS_ZSTD_3,
+	ZIO_COMPRESS_ZSTD_4,
+	ZIO_COMPRESS_ZSTD_5,
+	ZIO_COMPRESS_ZSTD_6,
+	ZIO_COMPRESS_ZSTD_7,
+	ZIO_COMPRESS_ZSTD_8,
+	ZIO_COMPRESS_ZSTD_9,
+	ZIO_COMPRESS_ZSTD_10,
+	ZIO_COMPRESS_ZSTD_11,
+	ZIO_COMPRESS_ZSTD_12,
+	ZIO_COMPRESS_ZSTD_13,
+	ZIO_COMPRESS_ZSTD_14,
+	ZIO_COMPRESS_ZSTD_15,
+	ZIO_COMPRESS_ZSTD_16,
+	ZIO_COMPRESS_ZSTD_17,
+	ZIO_COMPRESS_ZSTD_18,
+	ZIO_COMPRESS_ZSTD_19,
+	ZIO_COMPRESS_ZSTD_FAST_1,
+	ZIO_COMPRESS_ZSTD_FAST_2,
+	ZIO_COMPRESS_ZSTD_FAST_3,
+	ZIO_COMPRESS_ZSTD_FAST_4,
+	ZIO_COMPRESS_ZSTD_FAST_5,
+	ZIO_COMPRESS_ZSTD_FAST_6,
+	ZIO_COMPRESS_ZSTD_FAST_7,
+	ZIO_COMPRESS_ZSTD_FAST_8,
+	ZIO_COMPRESS_ZSTD_FAST_9,
+	ZIO_COMPRESS_ZSTD_FAST_10,
+	ZIO_COMPRESS_ZSTD_FAST_20,
+	ZIO_COMPRESS_ZSTD_FAST_30,
+	ZIO_COMPRESS_ZSTD_FAST_40,
+	ZIO_COMPRESS_ZSTD_FAST_50,
+	ZIO_COMPRESS_ZSTD_FAST_60,
+	ZIO_COMPRESS_ZSTD_FAST_70,
+	ZIO_COMPRESS_ZSTD_FAST_80,
+	ZIO_COMPRESS_ZSTD_FAST_90,
+	ZIO_COMPRESS_ZSTD_FAST_100,
+	ZIO_COMPRESS_ZSTD_FAST_500,
+	ZIO_COMPRESS_ZSTD_FAST_1000,
 	ZIO_COMPRESS_FUNCTIONS
 };
 
@@ -102,6 +142,12 @@ extern size_t lz4_compress(void *src, void *dst, size_t s_len, size_t d_len,
     int level);
 extern int lz4_decompress(void *src, void *dst, size_t s_len, size_t d_len,
     int level);
+extern size_t zstd_compress(void *src, void *dst, size_t s_len, size_t d_len,
+    int level);
+extern int zstd_decompress(void *src, void *dst, size_t s_len, size_t d_len,
+    int level);
+extern void zstd_init(void);
+extern void zstd_fini(void);
 
 /*
  * Compress and decompress data if necessary.
@@ -15,6 +15,7 @@
 
 /*
  * Copyright (c) 2017, Datto, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_SYS_ZIO_CRYPT_H
@@ -65,6 +66,35 @@ typedef struct zio_crypt_info {
 
 extern zio_crypt_info_t zio_crypt_table[ZIO_CRYPT_FUNCTIONS];
 
+/*
+ * Blocks written under an earlier salt (before the key was last loaded, or
+ * before the last salt rotation) need their encryption key derived again from
+ * the master key.  The most recently used of these derived keys are kept,
+ * along with their crypto templates, in a small direct-mapped cache in each
+ * loaded key.
+ */
+#define	ZIO_CRYPT_SALT_CACHE	8
+
+typedef struct zio_crypt_salt_ent {
+	/* protects the entry; held as reader while the key is in use */
+	krwlock_t zcse_lock;
+
+	/* entry holds a valid key */
+	boolean_t zcse_valid;
+
+	/* salt the key was derived from */
+	uint8_t zcse_salt[ZIO_DATA_SALT_LEN];
+
+	/* buffer for the derived encryption key */
+	uint8_t zcse_keydata[MASTER_KEY_MAX_LEN];
+
+	/* illumos crypto api derived encryption key */
+	crypto_key_t zcse_key;
+
+	/* template of derived encryption key for illumos crypto api */
+	crypto_ctx_template_t zcse_tmpl;
+} zio_crypt_salt_ent_t;
+
 /* in memory representation of an unwrapped key that is loaded into memory */
 typedef struct zio_crypt_key {
 	/* encryption algorithm */
@@ -105,6 +135,9 @@ typedef struct zio_crypt_key {
 
 	/* lock for changing the salt and dependant values */
 	krwlock_t zk_salt_lock;
+
+	/* keys derived from recently used older salts */
+	zio_crypt_salt_ent_t zk_salt_cache[ZIO_CRYPT_SALT_CACHE];
 } zio_crypt_key_t;
 
 void zio_crypt_key_destroy(zio_crypt_key_t *key);
@@ -21,12 +21,14 @@
 
 /*
  * Copyright (c) 2006, 2010, Oracle and/or its affiliates. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_SYS_ZVOL_H
 #define	_SYS_ZVOL_H
 
 #include <sys/zfs_context.h>
+#include <sys/zfs_rlock.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -36,6 +38,16 @@ extern "C" {
 #define	ZVOL_ZAP_OBJ		2ULL
 
 #ifdef _KERNEL
+/*
+ * A lock on a range of a volume holds the range in each of the volume's
+ * range lock shards which the range touches.
+ */
+#define	ZVOL_RANGELOCKS		8
+
+typedef struct zvol_locked_range {
+	locked_range_t	*zlr_lr[ZVOL_RANGELOCKS];
+} zvol_locked_range_t;
+
 extern int zvol_check_volsize(uint64_t volsize, uint64_t blocksize);
 extern int zvol_check_volblocksize(uint64_t volblocksize);
 extern int zvol_get_stats(objset_t *os, nvlist_t *nv);
@@ -66,6 +78,9 @@ extern uint64_t zvol_get_volume_size(void *minor_hdl);
 extern int zvol_get_volume_wce(void *minor_hdl);
 extern void zvol_log_write_minor(void *minor_hdl, dmu_tx_t *tx, offset_t off,
     ssize_t resid, boolean_t sync);
+extern void zvol_rangelock_enter(void *rl_hdl, zvol_locked_range_t *zlr,
+    uint64_t off, uint64_t len, rangelock_type_t type);
+extern void zvol_rangelock_exit(zvol_locked_range_t *zlr);
 
 #endif
 
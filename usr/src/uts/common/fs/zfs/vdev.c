@@ -92,6 +92,12 @@ int zfs_vdev_max_ms_shift = 34;
 
 boolean_t vdev_validate_skip = B_FALSE;
 
+/*
+ * Maximum number of threads used to read leaf vdev labels in parallel
+ * ahead of vdev_validate().
+ */
+int vdev_validate_threads = 64;
+
 /*
  * Since the DTL space map of a vdev is not expected to have a lot of
  * entries, we default its block size to 4K.
@@ -523,6 +529,10 @@ vdev_alloc_common(spa_t *spa, uint_t id, uint64_t guid, vdev_ops_t *ops)
 	cv_init(&vd->vdev_trim_cv, NULL, CV_DEFAULT, NULL);
 	cv_init(&vd->vdev_autotrim_cv, NULL, CV_DEFAULT, NULL);
 	cv_init(&vd->vdev_trim_io_cv, NULL, CV_DEFAULT, NULL);
+	mutex_init(&vd->vdev_rebuild_lock, NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&vd->vdev_rebuild_io_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&vd->vdev_rebuild_cv, NULL, CV_DEFAULT, NULL);
+	cv_init(&vd->vdev_rebuild_io_cv, NULL, CV_DEFAULT, NULL);
 
 	for (int t = 0; t < DTL_TYPES; t++) {
 		vd->vdev_dtl[t] = range_tree_create(NULL, RANGE_SEG64, NULL, 0,
@@ -940,6 +950,10 @@ vdev_free(vdev_t *vd)
 	cv_destroy(&vd->vdev_trim_cv);
 	cv_destroy(&vd->vdev_autotrim_cv);
 	cv_destroy(&vd->vdev_trim_io_cv);
+	mutex_destroy(&vd->vdev_rebuild_lock);
+	mutex_destroy(&vd->vdev_rebuild_io_lock);
+	cv_destroy(&vd->vdev_rebuild_cv);
+	cv_destroy(&vd->vdev_rebuild_io_cv);
 
 	if (vd == spa->spa_root_vdev)
 		spa->spa_root_vdev = NULL;
@@ -1744,6 +1758,12 @@ vdev_open(vdev_t *vd)
 
 	vdev_set_min_asize(vd);
 
+	/*
+	 * Leaf vdevs on non-rotational media may use per-CPU dispatch queues.
+	 */
+	if (vd->vdev_ops->vdev_op_leaf)
+		vdev_queue_set_mq(vd, zfs_vdev_queue_mq && vd->vdev_nonrot);
+
 	/*
 	 * Ensure we can issue some IO before declaring the
 	 * vdev open for business.
@@ -1782,17 +1802,103 @@ vdev_open(vdev_t *vd)
 }
 
 /*
- * Called once the vdevs are all opened, this routine validates the label
- * contents. This needs to be done before vdev_load() so that we don't
- * inadvertently do repair I/Os to the wrong device.
- *
- * This function will only return failure if one of the vdevs indicates that it
- * has since been destroyed or exported.  This is only possible if
- * /etc/zfs/zpool.cache was readonly at the time.  Otherwise, the vdev state
- * will be updated but the function will return 0.
+ * The txg to validate leaf labels against.  If we are performing an extreme
+ * rewind, we allow for a label that was modified at a point after the
+ * current txg.  If config lock is not held do not check for the txg.
+ * spa_sync could be updating the vdev's label before updating
+ * spa_last_synced_txg.
  */
-int
-vdev_validate(vdev_t *vd)
+static uint64_t
+vdev_validate_txg(spa_t *spa)
+{
+	if (spa->spa_extreme_rewind || spa_last_synced_txg(spa) == 0 ||
+	    spa_config_held(spa, SCL_CONFIG, RW_WRITER) != SCL_CONFIG)
+		return (UINT64_MAX);
+	else
+		return (spa_last_synced_txg(spa));
+}
+
+typedef struct vdev_label_prefetch {
+	vdev_t		*vlp_vd;
+	uint64_t	vlp_txg;
+} vdev_label_prefetch_t;
+
+static void
+vdev_validate_prefetch_leaf(void *arg)
+{
+	vdev_label_prefetch_t *vlp = arg;
+	vdev_t *vd = vlp->vlp_vd;
+
+	vd->vdev_open_thread = curthread;
+	vd->vdev_validate_label = vdev_label_read_config(vd, vlp->vlp_txg);
+	vd->vdev_open_thread = NULL;
+}
+
+static int
+vdev_validate_prefetch_collect(vdev_t *vd, vdev_label_prefetch_t *vlp,
+    int n, uint64_t txg)
+{
+	for (uint64_t c = 0; c < vd->vdev_children; c++)
+		n = vdev_validate_prefetch_collect(vd->vdev_child[c], vlp, n,
+		    txg);
+
+	if (vd->vdev_ops->vdev_op_leaf && vdev_readable(vd)) {
+		if (vlp != NULL) {
+			vlp[n].vlp_vd = vd;
+			vlp[n].vlp_txg = txg;
+		}
+		n++;
+	}
+	return (n);
+}
+
+/*
+ * Reading a leaf's label takes one synchronous read per label copy, which
+ * adds up on pools with hundreds of disks.  Read the labels of all leaves
+ * below vd in parallel, in the same way vdev_open_children() opens them;
+ * vdev_validate() then picks up the result from vdev_validate_label.
+ */
+static void
+vdev_validate_prefetch(vdev_t *vd)
+{
+	vdev_label_prefetch_t *vlp;
+	uint64_t txg = vdev_validate_txg(vd->vdev_spa);
+	taskq_t *tq;
+	int n;
+
+	if (vdev_uses_zvols(vd) ||
+	    (n = vdev_validate_prefetch_collect(vd, NULL, 0, txg)) < 2)
+		return;
+
+	tq = taskq_create("vdev_validate", MIN(n, vdev_validate_threads),
+	    minclsyspri, n, n, TASKQ_PREPOPULATE);
+	if (tq == NULL)
+		return;
+
+	vlp = kmem_alloc(n * sizeof (vdev_label_prefetch_t), KM_SLEEP);
+	VERIFY3S(vdev_validate_prefetch_collect(vd, vlp, 0, txg), ==, n);
+	for (int i = 0; i < n; i++) {
+		VERIFY(taskq_dispatch(tq, vdev_validate_prefetch_leaf,
+		    &vlp[i], TQ_SLEEP) != TASKQID_INVALID);
+	}
+	taskq_destroy(tq);
+	kmem_free(vlp, n * sizeof (vdev_label_prefetch_t));
+}
+
+static void
+vdev_validate_discard(vdev_t *vd)
+{
+	for (uint64_t c = 0; c < vd->vdev_children; c++)
+		vdev_validate_discard(vd->vdev_child[c]);
+
+	if (vd->vdev_validate_label != NULL) {
+		nvlist_free(vd->vdev_validate_label);
+		vd->vdev_validate_label = NULL;
+	}
+}
+
+static int
+vdev_validate_impl(vdev_t *vd)
 {
 	spa_t *spa = vd->vdev_spa;
 	nvlist_t *label;
@@ -1801,11 +1907,8 @@ vdev_validate(vdev_t *vd)
 	nvlist_t *nvl;
 	uint64_t txg;
 
-	if (vdev_validate_skip)
-		return (0);
-
 	for (uint64_t c = 0; c < vd->vdev_children; c++)
-		if (vdev_validate(vd->vdev_child[c]) != 0)
+		if (vdev_validate_impl(vd->vdev_child[c]) != 0)
 			return (SET_ERROR(EBADF));
 
 	/*
@@ -1816,19 +1919,13 @@ vdev_validate(vdev_t *vd)
 	if (!vd->vdev_ops->vdev_op_leaf || !vdev_readable(vd))
 		return (0);
 
-	/*
-	 * If we are performing an extreme rewind, we allow for a label that
-	 * was modified at a point after the current txg.
-	 * If config lock is not held do not check for the txg. spa_sync could
-	 * be updating the vdev's label before updating spa_last_synced_txg.
-	 */
-	if (spa->spa_extreme_rewind || spa_last_synced_txg(spa) == 0 ||
-	    spa_config_held(spa, SCL_CONFIG, RW_WRITER) != SCL_CONFIG)
-		txg = UINT64_MAX;
+	txg = vdev_validate_txg(spa);
+	if ((label = vd->vdev_validate_label) != NULL)
+		vd->vdev_validate_label = NULL;
 	else
-		txg = spa_last_synced_txg(spa);
+		label = vdev_label_read_config(vd, txg);
 
-	if ((label = vdev_label_read_config(vd, txg)) == NULL) {
+	if (label == NULL) {
 		vdev_set_state(vd, B_TRUE, VDEV_STATE_CANT_OPEN,
 		    VDEV_AUX_BAD_LABEL);
 		vdev_dbgmsg(vd, "vdev_validate: failed reading config for "
@@ -1976,6 +2073,33 @@ vdev_validate(vdev_t *vd)
 	return (0);
 }
 
+/*
+ * Called once the vdevs are all opened, this routine validates the label
+ * contents. This needs to be done before vdev_load() so that we don't
+ * inadvertently do repair I/Os to the wrong device.
+ *
+ * This function will only return failure if one of the vdevs indicates that it
+ * has since been destroyed or exported.  This is only possible if
+ * /etc/zfs/zpool.cache was readonly at the time.  Otherwise, the vdev state
+ * will be updated but the function will return 0.
+ */
+int
+vdev_validate(vdev_t *vd)
+{
+	int error;
+
+	if (vdev_validate_skip)
+		return (0);
+
+	if (vd == vd->vdev_spa->spa_root_vdev)
+		vdev_validate_prefetch(vd);
+
+	error = vdev_validate_impl(vd);
+	vdev_validate_discard(vd);
+
+	return (error);
+}
+
 static void
 vdev_copy_path_impl(vdev_t *svd, vdev_t *dvd)
 {
@@ -2914,10 +3038,73 @@ vdev_checkpoint_sm_object(vdev_t *vd)
 	return (sm_obj);
 }
 
+/*
+ * vdev_load() reads the dnode of every metaslab and DTL space map in the
+ * pool, one at a time.  Before any of that, issue prefetches for all of
+ * them so the reads for the whole pool are in flight together:
+ *
+ *   - first the dnodes of the leaves' DTL objects and of each top-level
+ *     vdev's metaslab array,
+ *   - then, reading each metaslab array, the dnodes of the space maps it
+ *     lists.
+ */
+static void
+vdev_load_prefetch_impl(vdev_t *vd, boolean_t arrays)
+{
+	objset_t *mos = spa_meta_objset(vd->vdev_spa);
+
+	for (int c = 0; c < vd->vdev_children; c++)
+		vdev_load_prefetch_impl(vd->vdev_child[c], arrays);
+
+	if (!arrays) {
+		if (vd->vdev_ops->vdev_op_leaf && vd->vdev_dtl_object != 0) {
+			dmu_prefetch(mos, vd->vdev_dtl_object, 0, 0, 0,
+			    ZIO_PRIORITY_SYNC_READ);
+		}
+		if (vd == vd->vdev_top && vd->vdev_ms_array != 0) {
+			dmu_prefetch(mos, vd->vdev_ms_array, 0, 0, 0,
+			    ZIO_PRIORITY_SYNC_READ);
+		}
+		return;
+	}
+
+	if (vd != vd->vdev_top || !vdev_is_concrete(vd) ||
+	    vd->vdev_ms_array == 0 || vd->vdev_ms_shift == 0)
+		return;
+
+	uint64_t count = vd->vdev_asize >> vd->vdev_ms_shift;
+	size_t size = count * sizeof (uint64_t);
+	if (count == 0 || count > zfs_vdev_ms_count_limit)
+		return;
+
+	uint64_t *objects = kmem_alloc(size, KM_SLEEP);
+	if (dmu_read(mos, vd->vdev_ms_array, 0, size, objects,
+	    DMU_READ_PREFETCH) == 0) {
+		for (uint64_t m = 0; m < count; m++) {
+			if (objects[m] != 0) {
+				dmu_prefetch(mos, objects[m], 0, 0, 0,
+				    ZIO_PRIORITY_SYNC_READ);
+			}
+		}
+	}
+	kmem_free(objects, size);
+}
+
+static void
+vdev_load_prefetch(vdev_t *vd)
+{
+	vdev_load_prefetch_impl(vd, B_FALSE);
+	vdev_load_prefetch_impl(vd, B_TRUE);
+}
+
 int
 vdev_load(vdev_t *vd)
 {
 	int error = 0;
+
+	if (vd == vd->vdev_spa->spa_root_vdev)
+		vdev_load_prefetch(vd);
+
 	/*
 	 * Recursively load all children.
 	 */
@@ -4538,11 +4725,17 @@ vdev_deadman(vdev_t *vd)
 
 	if (vd->vdev_ops->vdev_op_leaf) {
 		vdev_queue_t *vq = &vd->vdev_queue;
+		hrtime_t timestamp = 0;
+		zio_t *fio;
 
 		mutex_enter(&vq->vq_lock);
-		if (avl_numnodes(&vq->vq_active_tree) > 0) {
+		if (vq->vq_mq)
+			timestamp = vdev_queue_mq_oldest(vd);
+		else if ((fio = avl_first(&vq->vq_active_tree)) != NULL)
+			timestamp = fio->io_timestamp;
+
+		if (timestamp != 0) {
 			spa_t *spa = vd->vdev_spa;
-			zio_t *fio;
 			uint64_t delta;
 
 			/*
@@ -4550,12 +4743,11 @@ vdev_deadman(vdev_t *vd)
 			 * if any I/O has been outstanding for longer than
 			 * the spa_deadman_synctime we panic the system.
 			 */
-			fio = avl_first(&vq->vq_active_tree);
-			delta = gethrtime() - fio->io_timestamp;
+			delta = gethrtime() - timestamp;
 			if (delta > spa_deadman_synctime(spa)) {
 				vdev_dbgmsg(vd, "SLOW IO: zio timestamp "
 				    "%lluns, delta %lluns, last io %lluns",
-				    fio->io_timestamp, (u_longlong_t)delta,
+				    timestamp, (u_longlong_t)delta,
 				    vq->vq_io_complete_ts);
 				fm_panic("I/O to pool '%s' appears to be "
 				    "hung.", spa_name(spa));
@@ -122,6 +122,14 @@ typedef struct mirror_map {
 
 int vdev_mirror_shift = 21;
 
+/*
+ * Resilver reads ignore the child load and are spread round-robin across
+ * the readable children in runs of 1 << vdev_mirror_resilver_shift bytes,
+ * so that each child sees long sequential reads which the vdev queue can
+ * aggregate.
+ */
+int vdev_mirror_resilver_shift = 24;
+
 /*
  * The load configuration settings below are tuned by default for
  * the case where all devices are of the same rotational type.
@@ -470,6 +478,12 @@ vdev_mirror_preferred_child_randomize(zio_t *zio)
 		return (vdev_mirror_dva_select(zio, p));
 	}
 
+	if (zio->io_flags & ZIO_FLAG_RESILVER) {
+		p = (zio->io_offset >> vdev_mirror_resilver_shift) %
+		    mm->mm_preferred_cnt;
+		return (mm->mm_preferred[p]);
+	}
+
 	/*
 	 * To ensure we don't always favour the first matching vdev,
 	 * which could lead to wear leveling issues on SSD's, we
@@ -519,7 +533,11 @@ vdev_mirror_child_select(zio_t *zio)
 			continue;
 		}
 
-		mc->mc_load = vdev_mirror_load(mm, mc->mc_vd, mc->mc_offset);
+		if (zio->io_flags & ZIO_FLAG_RESILVER)
+			mc->mc_load = 0;
+		else
+			mc->mc_load = vdev_mirror_load(mm, mc->mc_vd,
+			    mc->mc_offset);
 		if (mc->mc_load > lowest_load)
 			continue;
 
@@ -27,7 +27,7 @@
 /*
  * Copyright (c) 2012, 2018 by Delphix. All rights reserved.
  * Copyright (c) 2014 Integros [integros.com]
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/zfs_context.h>
@@ -178,6 +178,15 @@ int zfs_vdev_aggregation_limit = 1 << 20;
 int zfs_vdev_read_gap_limit = 32 << 10;
 int zfs_vdev_write_gap_limit = 4 << 10;
 
+/*
+ * Resilver reads are issued in sorted, physically sequential runs (see
+ * scan_io_queue_gather()), so we allow them to be merged into much larger
+ * reads, spanning larger gaps, than normal I/O.  Setting the limit to
+ * zfs_vdev_aggregation_limit or less disables sequential resilver.
+ */
+int zfs_vdev_resilver_aggregation_limit = 8 << 20;
+int zfs_vdev_resilver_read_gap_limit = 128 << 10;
+
 /*
  * Define the queue depth percentage for each top-level. This percentage is
  * used in conjunction with zfs_vdev_async_max_active to determine how many
@@ -210,6 +219,29 @@ int zfs_vdev_def_queue_depth = 32;
  */
 int zfs_vdev_aggregate_trim = 0;
 
+/*
+ * Multi-queue dispatch for non-rotational leaf vdevs.
+ *
+ * In the normal mode every enqueue and dequeue on a vdev is serialized by
+ * vq_lock, and the queued i/os are kept in offset-sorted trees to support
+ * seek-aware scheduling and aggregation.  Neither is useful to a device such
+ * as NVMe that can sustain very high IOPS, and at those rates vq_lock
+ * becomes heavily contended.
+ *
+ * When zfs_vdev_queue_mq is set, leaf vdevs which report themselves as
+ * non-rotational are switched (the next time they are opened while idle)
+ * to a mode where each CPU has its own set of FIFO submission queues,
+ * protected by a per-CPU lock.  The per-class and per-vdev active counts
+ * are maintained atomically, so the zfs_vdev_max_active and per-class
+ * min/max_active limits are still honoured, but no lock is shared by all
+ * submitters.  I/Os are issued from the per-CPU queues in round-robin
+ * order, so ordering is FIFO within a CPU's queue only, and no
+ * aggregation is attempted; optional (ZIO_FLAG_NODATA) i/os are discarded
+ * as soon as they are queued.  The zone I/O scheduler is not consulted in
+ * this mode.
+ */
+boolean_t zfs_vdev_queue_mq = B_FALSE;
+
 int
 vdev_queue_offset_compare(const void *x1, const void *x2)
 {
@@ -301,11 +333,86 @@ vdev_queue_init(vdev_t *vd)
 	vq->vq_last_offset = 0;
 }
 
+static void
+vdev_queue_mq_alloc(vdev_queue_t *vq)
+{
+	vq->vq_ncpus = max_ncpus;
+	vq->vq_cpu = kmem_zalloc(vq->vq_ncpus * sizeof (vdev_queue_cpu_t),
+	    KM_SLEEP);
+	for (uint_t c = 0; c < vq->vq_ncpus; c++) {
+		vdev_queue_cpu_t *vqcpu = &vq->vq_cpu[c];
+
+		mutex_init(&vqcpu->vqcpu_lock, NULL, MUTEX_DEFAULT, NULL);
+		for (zio_priority_t p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE;
+		    p++) {
+			avl_create(&vqcpu->vqcpu_queued_tree[p],
+			    vdev_queue_timestamp_compare, sizeof (zio_t),
+			    offsetof(struct zio, io_queue_node));
+		}
+		avl_create(&vqcpu->vqcpu_active_tree,
+		    vdev_queue_timestamp_compare, sizeof (zio_t),
+		    offsetof(struct zio, io_queue_node));
+	}
+}
+
+static void
+vdev_queue_mq_free(vdev_queue_t *vq)
+{
+	if (vq->vq_cpu == NULL)
+		return;
+
+	for (uint_t c = 0; c < vq->vq_ncpus; c++) {
+		vdev_queue_cpu_t *vqcpu = &vq->vq_cpu[c];
+
+		for (zio_priority_t p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++)
+			avl_destroy(&vqcpu->vqcpu_queued_tree[p]);
+		avl_destroy(&vqcpu->vqcpu_active_tree);
+		mutex_destroy(&vqcpu->vqcpu_lock);
+	}
+	kmem_free(vq->vq_cpu, vq->vq_ncpus * sizeof (vdev_queue_cpu_t));
+	vq->vq_cpu = NULL;
+	vq->vq_ncpus = 0;
+}
+
+/*
+ * Select the dispatch mode for a leaf vdev.  The mode is only changed while
+ * the queue is completely idle, which is always the case the first time the
+ * vdev is opened; otherwise the current mode is kept.
+ */
+void
+vdev_queue_set_mq(vdev_t *vd, boolean_t mq)
+{
+	vdev_queue_t *vq = &vd->vdev_queue;
+
+	mutex_enter(&vq->vq_lock);
+	if (vq->vq_mq == mq || avl_numnodes(&vq->vq_active_tree) != 0 ||
+	    vq->vq_mq_active != 0) {
+		mutex_exit(&vq->vq_lock);
+		return;
+	}
+	for (zio_priority_t p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++) {
+		if (avl_numnodes(vdev_queue_class_tree(vq, p)) != 0 ||
+		    vq->vq_class[p].vqc_mq_queued != 0) {
+			mutex_exit(&vq->vq_lock);
+			return;
+		}
+	}
+
+	if (mq && vq->vq_cpu == NULL)
+		vdev_queue_mq_alloc(vq);
+	vq->vq_mq = mq;
+	vdev_dbgmsg(vd, "vdev_queue: %s multi-queue dispatch",
+	    mq ? "enabled" : "disabled");
+	mutex_exit(&vq->vq_lock);
+}
+
 void
 vdev_queue_fini(vdev_t *vd)
 {
 	vdev_queue_t *vq = &vd->vdev_queue;
 
+	vdev_queue_mq_free(vq);
+
 	for (zio_priority_t p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++)
 		avl_destroy(vdev_queue_class_tree(vq, p));
 	avl_destroy(&vq->vq_active_tree);
@@ -549,6 +656,7 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 	zio_t *first, *last, *aio, *dio, *mandatory, *nio;
 	zio_link_t *zl = NULL;
 	uint64_t maxgap = 0;
+	uint64_t limit = zfs_vdev_aggregation_limit;
 	uint64_t size;
 	boolean_t stretch = B_FALSE;
 	avl_tree_t *t = vdev_queue_type_tree(vq, zio->io_type);
@@ -569,6 +677,15 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 	if (zio->io_type == ZIO_TYPE_READ)
 		maxgap = zfs_vdev_read_gap_limit;
 
+	if (zio->io_type == ZIO_TYPE_READ &&
+	    zio->io_priority == ZIO_PRIORITY_SCRUB &&
+	    (zio->io_flags & ZIO_FLAG_RESILVER) &&
+	    zfs_vdev_resilver_aggregation_limit > limit) {
+		limit = MIN(zfs_vdev_resilver_aggregation_limit,
+		    SPA_MAXBLOCKSIZE);
+		maxgap = MAX(maxgap, zfs_vdev_resilver_read_gap_limit);
+	}
+
 	/*
 	 * We can aggregate I/Os that are sufficiently adjacent and of
 	 * the same flavor, as expressed by the AGG_INHERIT flags.
@@ -590,7 +707,7 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 	 */
 	while ((dio = AVL_PREV(t, first)) != NULL &&
 	    (dio->io_flags & ZIO_FLAG_AGG_INHERIT) == flags &&
-	    IO_SPAN(dio, last) <= zfs_vdev_aggregation_limit &&
+	    IO_SPAN(dio, last) <= limit &&
 	    IO_GAP(dio, first) <= maxgap &&
 	    dio->io_type == zio->io_type) {
 		first = dio;
@@ -614,7 +731,7 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 	 */
 	while ((dio = AVL_NEXT(t, last)) != NULL &&
 	    (dio->io_flags & ZIO_FLAG_AGG_INHERIT) == flags &&
-	    (IO_SPAN(first, dio) <= zfs_vdev_aggregation_limit ||
+	    (IO_SPAN(first, dio) <= limit ||
 	    (dio->io_flags & ZIO_FLAG_OPTIONAL)) &&
 	    IO_GAP(last, dio) <= maxgap &&
 	    dio->io_type == zio->io_type) {
@@ -773,6 +890,298 @@ again:
 	return (zio);
 }
 
+/*
+ * Atomically increment *cp if it is below limit.
+ */
+static boolean_t
+vdev_queue_mq_inc_below(uint32_t *cp, uint32_t limit)
+{
+	uint32_t c;
+
+	do {
+		c = *cp;
+		if (c >= limit)
+			return (B_FALSE);
+	} while (atomic_cas_32(cp, c, c + 1) != c);
+
+	return (B_TRUE);
+}
+
+/*
+ * Atomically decrement *cp if it is non-zero.
+ */
+static boolean_t
+vdev_queue_mq_dec_nonzero(uint32_t *cp)
+{
+	uint32_t c;
+
+	do {
+		c = *cp;
+		if (c == 0)
+			return (B_FALSE);
+	} while (atomic_cas_32(cp, c, c - 1) != c);
+
+	return (B_TRUE);
+}
+
+/*
+ * The multi-queue equivalent of vdev_queue_class_to_issue().  The counts are
+ * read without a lock, so the class returned is only a candidate which the
+ * caller must then reserve with vdev_queue_mq_reserve().
+ */
+static zio_priority_t
+vdev_queue_mq_class_to_issue(vdev_queue_t *vq)
+{
+	spa_t *spa = vq->vq_vdev->vdev_spa;
+	zio_priority_t p;
+
+	if (vq->vq_mq_active >= zfs_vdev_max_active)
+		return (ZIO_PRIORITY_NUM_QUEUEABLE);
+
+	for (p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++) {
+		if (vq->vq_class[p].vqc_mq_queued > 0 &&
+		    vq->vq_class[p].vqc_active <
+		    vdev_queue_class_min_active(p))
+			return (p);
+	}
+
+	for (p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++) {
+		if (vq->vq_class[p].vqc_mq_queued > 0 &&
+		    vq->vq_class[p].vqc_active <
+		    vdev_queue_class_max_active(spa, p))
+			return (p);
+	}
+
+	return (ZIO_PRIORITY_NUM_QUEUEABLE);
+}
+
+/*
+ * Reserve an active slot on the vdev and in class p, and claim one of the
+ * class's queued i/os.  A claimed i/o is guaranteed to be present on one of
+ * the per-CPU queues, since i/os are counted only after they are queued.
+ */
+static boolean_t
+vdev_queue_mq_reserve(vdev_queue_t *vq, zio_priority_t p)
+{
+	spa_t *spa = vq->vq_vdev->vdev_spa;
+	vdev_queue_class_t *vqc = &vq->vq_class[p];
+
+	if (!vdev_queue_mq_inc_below(&vq->vq_mq_active, zfs_vdev_max_active))
+		return (B_FALSE);
+
+	if (!vdev_queue_mq_inc_below(&vqc->vqc_active,
+	    MAX(vdev_queue_class_min_active(p),
+	    vdev_queue_class_max_active(spa, p)))) {
+		atomic_dec_32(&vq->vq_mq_active);
+		return (B_FALSE);
+	}
+
+	if (!vdev_queue_mq_dec_nonzero(&vqc->vqc_mq_queued)) {
+		atomic_dec_32(&vqc->vqc_active);
+		atomic_dec_32(&vq->vq_mq_active);
+		return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
+static void
+vdev_queue_mq_io_add(vdev_queue_t *vq, zio_t *zio)
+{
+	spa_t *spa = zio->io_spa;
+	vdev_queue_cpu_t *vqcpu;
+
+	ASSERT3U(zio->io_priority, <, ZIO_PRIORITY_NUM_QUEUEABLE);
+	zio->io_queue_cpu = CPU_SEQID % vq->vq_ncpus;
+	vqcpu = &vq->vq_cpu[zio->io_queue_cpu];
+
+	mutex_enter(&vqcpu->vqcpu_lock);
+	zio->io_timestamp = gethrtime();
+	avl_add(&vqcpu->vqcpu_queued_tree[zio->io_priority], zio);
+	mutex_exit(&vqcpu->vqcpu_lock);
+
+	zfs_zone_zio_enqueue(zio);
+
+	mutex_enter(&spa->spa_iokstat_lock);
+	spa->spa_queue_stats[zio->io_priority].spa_queued++;
+	if (spa->spa_iokstat != NULL)
+		kstat_waitq_enter(spa->spa_iokstat->ks_data);
+	mutex_exit(&spa->spa_iokstat_lock);
+
+	atomic_inc_32(&vq->vq_class[zio->io_priority].vqc_mq_queued);
+}
+
+/*
+ * Take a claimed i/o of class p off one of the per-CPU queues and move it to
+ * that CPU's active tree.
+ */
+static zio_t *
+vdev_queue_mq_io_remove(vdev_queue_t *vq, zio_priority_t p)
+{
+	uint32_t c = atomic_inc_32_nv(&vq->vq_mq_rotor);
+	vdev_queue_cpu_t *vqcpu;
+	spa_t *spa;
+	zio_t *zio;
+
+	for (;; c++) {
+		vqcpu = &vq->vq_cpu[c % vq->vq_ncpus];
+		if (avl_numnodes(&vqcpu->vqcpu_queued_tree[p]) == 0)
+			continue;
+
+		mutex_enter(&vqcpu->vqcpu_lock);
+		zio = avl_first(&vqcpu->vqcpu_queued_tree[p]);
+		if (zio != NULL) {
+			avl_remove(&vqcpu->vqcpu_queued_tree[p], zio);
+			avl_add(&vqcpu->vqcpu_active_tree, zio);
+			mutex_exit(&vqcpu->vqcpu_lock);
+			break;
+		}
+		mutex_exit(&vqcpu->vqcpu_lock);
+	}
+
+	ASSERT3U(zio->io_priority, ==, p);
+	zfs_zone_zio_dequeue(zio);
+
+	spa = zio->io_spa;
+	mutex_enter(&spa->spa_iokstat_lock);
+	ASSERT3U(spa->spa_queue_stats[p].spa_queued, >, 0);
+	spa->spa_queue_stats[p].spa_queued--;
+	spa->spa_queue_stats[p].spa_active++;
+	if (spa->spa_iokstat != NULL)
+		kstat_waitq_to_runq(spa->spa_iokstat->ks_data);
+	mutex_exit(&spa->spa_iokstat_lock);
+
+	return (zio);
+}
+
+static void
+vdev_queue_mq_pending_remove(vdev_queue_t *vq, zio_t *zio)
+{
+	spa_t *spa = zio->io_spa;
+	vdev_queue_cpu_t *vqcpu = &vq->vq_cpu[zio->io_queue_cpu];
+
+	ASSERT3U(zio->io_priority, <, ZIO_PRIORITY_NUM_QUEUEABLE);
+	mutex_enter(&vqcpu->vqcpu_lock);
+	avl_remove(&vqcpu->vqcpu_active_tree, zio);
+	mutex_exit(&vqcpu->vqcpu_lock);
+
+	mutex_enter(&spa->spa_iokstat_lock);
+	ASSERT3U(spa->spa_queue_stats[zio->io_priority].spa_active, >, 0);
+	spa->spa_queue_stats[zio->io_priority].spa_active--;
+	if (spa->spa_iokstat != NULL) {
+		kstat_io_t *ksio = spa->spa_iokstat->ks_data;
+
+		kstat_runq_exit(spa->spa_iokstat->ks_data);
+		if (zio->io_type == ZIO_TYPE_READ) {
+			ksio->reads++;
+			ksio->nread += zio->io_size;
+		} else if (zio->io_type == ZIO_TYPE_WRITE) {
+			ksio->writes++;
+			ksio->nwritten += zio->io_size;
+		}
+	}
+	mutex_exit(&spa->spa_iokstat_lock);
+
+	atomic_dec_32(&vq->vq_class[zio->io_priority].vqc_active);
+	atomic_dec_32(&vq->vq_mq_active);
+}
+
+/*
+ * Find the next i/o to issue in multi-queue mode.  A failed reservation is
+ * always followed by another look at the queues: a concurrent submitter may
+ * have found the vdev full only because of our transient reservation, and
+ * it relies on us to issue its i/o in that case.
+ */
+static zio_t *
+vdev_queue_mq_io_to_issue(vdev_queue_t *vq)
+{
+	zio_priority_t p;
+
+	while ((p = vdev_queue_mq_class_to_issue(vq)) !=
+	    ZIO_PRIORITY_NUM_QUEUEABLE) {
+		if (vdev_queue_mq_reserve(vq, p))
+			return (vdev_queue_mq_io_remove(vq, p));
+	}
+
+	return (NULL);
+}
+
+static zio_t *
+vdev_queue_mq_io(vdev_queue_t *vq, zio_t *zio)
+{
+	/* There is no aggregation in this mode; drop optional i/os now. */
+	if (zio->io_flags & ZIO_FLAG_NODATA) {
+		zio->io_timestamp = gethrtime();
+		zio_vdev_io_bypass(zio);
+		zio_execute(zio);
+		return (NULL);
+	}
+
+	vdev_queue_mq_io_add(vq, zio);
+	return (vdev_queue_mq_io_to_issue(vq));
+}
+
+/*
+ * Fold a completed read's latency into the vdev's moving average, which
+ * background work such as automatic TRIM uses to back off while the device
+ * is struggling to serve reads.  Each read has a weight of
+ * 1 / 2^vdev_queue_read_lat_shift.  The update is racy in multi-queue mode,
+ * which only costs the odd sample.
+ */
+int vdev_queue_read_lat_shift = 3;
+
+static void
+vdev_queue_read_lat_update(vdev_queue_t *vq, zio_t *zio)
+{
+	if (zio->io_type != ZIO_TYPE_READ)
+		return;
+
+	vq->vq_read_lat += (zio->io_delta - vq->vq_read_lat) >>
+	    vdev_queue_read_lat_shift;
+}
+
+static void
+vdev_queue_mq_io_done(vdev_queue_t *vq, zio_t *zio)
+{
+	zio_t *nio;
+
+	vdev_queue_mq_pending_remove(vq, zio);
+
+	zio->io_delta = gethrtime() - zio->io_timestamp;
+	vq->vq_io_complete_ts = gethrtime();
+	vdev_queue_read_lat_update(vq, zio);
+
+	while ((nio = vdev_queue_mq_io_to_issue(vq)) != NULL) {
+		zio_vdev_io_reissue(nio);
+		zio_execute(nio);
+	}
+}
+
+/*
+ * Return the timestamp of the oldest active i/o on a multi-queue vdev, or
+ * zero if there is none.  Used by the deadman.
+ */
+hrtime_t
+vdev_queue_mq_oldest(vdev_t *vd)
+{
+	vdev_queue_t *vq = &vd->vdev_queue;
+	hrtime_t oldest = 0;
+
+	for (uint_t c = 0; c < vq->vq_ncpus; c++) {
+		vdev_queue_cpu_t *vqcpu = &vq->vq_cpu[c];
+		zio_t *fio;
+
+		mutex_enter(&vqcpu->vqcpu_lock);
+		fio = avl_first(&vqcpu->vqcpu_active_tree);
+		if (fio != NULL &&
+		    (oldest == 0 || fio->io_timestamp < oldest))
+			oldest = fio->io_timestamp;
+		mutex_exit(&vqcpu->vqcpu_lock);
+	}
+
+	return (oldest);
+}
+
 zio_t *
 vdev_queue_io(zio_t *zio)
 {
@@ -812,6 +1221,9 @@ vdev_queue_io(zio_t *zio)
 
 	zio->io_flags |= ZIO_FLAG_DONT_CACHE | ZIO_FLAG_DONT_QUEUE;
 
+	if (vq->vq_mq)
+		return (vdev_queue_mq_io(vq, zio));
+
 	mutex_enter(&vq->vq_lock);
 	zio->io_timestamp = gethrtime();
 	vdev_queue_io_add(vq, zio);
@@ -835,12 +1247,18 @@ vdev_queue_io_done(zio_t *zio)
 	vdev_queue_t *vq = &zio->io_vd->vdev_queue;
 	zio_t *nio;
 
+	if (vq->vq_mq) {
+		vdev_queue_mq_io_done(vq, zio);
+		return;
+	}
+
 	mutex_enter(&vq->vq_lock);
 
 	vdev_queue_pending_remove(vq, zio);
 
 	zio->io_delta = gethrtime() - zio->io_timestamp;
 	vq->vq_io_complete_ts = gethrtime();
+	vdev_queue_read_lat_update(vq, zio);
 
 	while ((nio = vdev_queue_io_to_issue(vq)) != NULL) {
 		mutex_exit(&vq->vq_lock);
@@ -886,6 +1304,45 @@ vdev_queue_change_io_priority(zio_t *zio, zio_priority_t priority)
 			priority = ZIO_PRIORITY_ASYNC_WRITE;
 	}
 
+	if (vq->vq_mq) {
+		vdev_queue_cpu_t *vqcpu = &vq->vq_cpu[zio->io_queue_cpu];
+		zio_priority_t oldpri = zio->io_priority;
+
+		/*
+		 * As below, but the zio can only be moved if it has not
+		 * already been claimed by an issuing thread.
+		 */
+		mutex_enter(&vqcpu->vqcpu_lock);
+		if (avl_find(&vqcpu->vqcpu_queued_tree[oldpri], zio, NULL) ==
+		    zio) {
+			spa_t *spa = zio->io_spa;
+
+			if (vdev_queue_mq_dec_nonzero(
+			    &vq->vq_class[oldpri].vqc_mq_queued)) {
+				zfs_zone_zio_dequeue(zio);
+				avl_remove(&vqcpu->vqcpu_queued_tree[oldpri],
+				    zio);
+				zio->io_priority = priority;
+				avl_add(&vqcpu->vqcpu_queued_tree[priority],
+				    zio);
+				zfs_zone_zio_enqueue(zio);
+
+				mutex_enter(&spa->spa_iokstat_lock);
+				spa->spa_queue_stats[oldpri].spa_queued--;
+				spa->spa_queue_stats[priority].spa_queued++;
+				mutex_exit(&spa->spa_iokstat_lock);
+
+				atomic_inc_32(
+				    &vq->vq_class[priority].vqc_mq_queued);
+			}
+		} else if (avl_find(&vqcpu->vqcpu_active_tree, zio, NULL) !=
+		    zio) {
+			zio->io_priority = priority;
+		}
+		mutex_exit(&vqcpu->vqcpu_lock);
+		return;
+	}
+
 	mutex_enter(&vq->vq_lock);
 
 	/*
@@ -927,6 +1384,8 @@ vdev_queue_change_io_priority(zio_t *zio, zio_priority_t priority)
 int
 vdev_queue_length(vdev_t *vd)
 {
+	if (vd->vdev_queue.vq_mq)
+		return (vd->vdev_queue.vq_mq_active);
 	return (avl_numnodes(&vd->vdev_queue.vq_active_tree));
 }
 
@@ -935,3 +1394,17 @@ vdev_queue_last_offset(vdev_t *vd)
 {
 	return (vd->vdev_queue.vq_last_offset);
 }
+
+/*
+ * Return the moving average read latency of a leaf vdev, or zero if it has
+ * completed no I/O in the last second, in which case the average is stale.
+ */
+hrtime_t
+vdev_queue_read_latency(vdev_t *vd)
+{
+	vdev_queue_t *vq = &vd->vdev_queue;
+
+	if (gethrtime() - vq->vq_io_complete_ts > NANOSEC)
+		return (0);
+	return (vq->vq_read_lat);
+}
@@ -62,6 +62,12 @@ const raidz_impl_ops_t *raidz_all_maths[] = {
 #if defined(__amd64)
 	&vdev_raidz_avx2_impl,
 #endif
+#if defined(__amd64)
+	&vdev_raidz_avx512f_impl,
+#endif
+#if defined(__amd64)
+	&vdev_raidz_avx512bw_impl,
+#endif
 };
 
 /* Indicate that benchmark has been completed */
@@ -0,0 +1,442 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2020 Joyent, Inc.
+ */
+
+/*
+ * AVX-512F RAID-Z parity implementation, for processors (such as Knights
+ * Landing) which lack AVX-512BW.  Only quadword operations are available on
+ * 512-bit registers, so multiplication is done bit-serially rather than with
+ * the nibble lookup tables used by the SSSE3, AVX2 and AVX-512BW versions.
+ *
+ * Data vectors use zmm0-zmm9; the multiplication constants and temporaries
+ * live in zmm16-zmm31, which only EVEX-encoded instructions can reach.
+ */
+#include <sys/isa_defs.h>
+
+#if defined(__amd64)
+
+#include <sys/types.h>
+#include <sys/simd.h>
+
+#define	__asm __asm__ __volatile__
+
+#define	_REG_CNT(_0, _1, _2, _3, _4, _5, _6, _7, N, ...) N
+#define	REG_CNT(r...) _REG_CNT(r, 8, 7, 6, 5, 4, 3, 2, 1)
+
+#define	VR0_(REG, ...) "zmm"#REG
+#define	VR1_(_1, REG, ...) "zmm"#REG
+#define	VR2_(_1, _2, REG, ...) "zmm"#REG
+#define	VR3_(_1, _2, _3, REG, ...) "zmm"#REG
+#define	VR4_(_1, _2, _3, _4, REG, ...) "zmm"#REG
+#define	VR5_(_1, _2, _3, _4, _5, REG, ...) "zmm"#REG
+#define	VR6_(_1, _2, _3, _4, _5, _6, REG, ...) "zmm"#REG
+#define	VR7_(_1, _2, _3, _4, _5, _6, _7, REG, ...) "zmm"#REG
+
+#define	VR0(r...) VR0_(r)
+#define	VR1(r...) VR1_(r)
+#define	VR2(r...) VR2_(r, 1)
+#define	VR3(r...) VR3_(r, 1, 2)
+#define	VR4(r...) VR4_(r, 1, 2)
+#define	VR5(r...) VR5_(r, 1, 2, 3)
+#define	VR6(r...) VR6_(r, 1, 2, 3, 4)
+#define	VR7(r...) VR7_(r, 1, 2, 3, 4, 5)
+
+#define	R_01(REG1, REG2, ...) REG1, REG2
+#define	_R_23(_0, _1, REG2, REG3, ...) REG2, REG3
+#define	R_23(REG...) _R_23(REG, 1, 2, 3)
+
+#define	ZFS_ASM_BUG()	ASSERT(0)
+
+#define	ELEM_SIZE 64
+
+typedef struct v {
+	uint8_t b[ELEM_SIZE] __attribute__((aligned(ELEM_SIZE)));
+} v_t;
+
+
+#define	XOR_ACC(src, r...)						\
+{									\
+	switch (REG_CNT(r)) {						\
+	case 4:								\
+		__asm(							\
+		    "vpxorq 0x00(%[SRC]), %%" VR0(r)", %%" VR0(r) "\n"	\
+		    "vpxorq 0x40(%[SRC]), %%" VR1(r)", %%" VR1(r) "\n"	\
+		    "vpxorq 0x80(%[SRC]), %%" VR2(r)", %%" VR2(r) "\n"	\
+		    "vpxorq 0xc0(%[SRC]), %%" VR3(r)", %%" VR3(r) "\n"	\
+		    : : [SRC] "r" (src));				\
+		break;							\
+	case 2:								\
+		__asm(							\
+		    "vpxorq 0x00(%[SRC]), %%" VR0(r)", %%" VR0(r) "\n"	\
+		    "vpxorq 0x40(%[SRC]), %%" VR1(r)", %%" VR1(r) "\n"	\
+		    : : [SRC] "r" (src));				\
+		break;							\
+	default:							\
+		ZFS_ASM_BUG();						\
+	}								\
+}
+
+#define	XOR(r...)							\
+{									\
+	switch (REG_CNT(r)) {						\
+	case 8:								\
+		__asm(							\
+		    "vpxorq %" VR0(r) ", %" VR4(r)", %" VR4(r) "\n"	\
+		    "vpxorq %" VR1(r) ", %" VR5(r)", %" VR5(r) "\n"	\
+		    "vpxorq %" VR2(r) ", %" VR6(r)", %" VR6(r) "\n"	\
+		    "vpxorq %" VR3(r) ", %" VR7(r)", %" VR7(r));	\
+		break;							\
+	case 4:								\
+		__asm(							\
+		    "vpxorq %" VR0(r) ", %" VR2(r)", %" VR2(r) "\n"	\
+		    "vpxorq %" VR1(r) ", %" VR3(r)", %" VR3(r));	\
+		break;							\
+	default:							\
+		ZFS_ASM_BUG();						\
+	}								\
+}
+
+#define	ZERO(r...)	XOR(r, r)
+
+#define	COPY(r...) 							\
+{									\
+	switch (REG_CNT(r)) {						\
+	case 8:								\
+		__asm(							\
+		    "vmovdqa64 %" VR0(r) ", %" VR4(r) "\n"		\
+		    "vmovdqa64 %" VR1(r) ", %" VR5(r) "\n"		\
+		    "vmovdqa64 %" VR2(r) ", %" VR6(r) "\n"		\
+		    "vmovdqa64 %" VR3(r) ", %" VR7(r));			\
+		break;							\
+	case 4:								\
+		__asm(							\
+		    "vmovdqa64 %" VR0(r) ", %" VR2(r) "\n"		\
+		    "vmovdqa64 %" VR1(r) ", %" VR3(r));			\
+		break;							\
+	default:							\
+		ZFS_ASM_BUG();						\
+	}								\
+}
+
+/*
+ * Column buffers are only guaranteed to be aligned to the sector size of the
+ * smaller vector implementations, so use unaligned moves; they carry no
+ * penalty when the address happens to be aligned.
+ */
+#define	LOAD(src, r...) 						\
+{									\
+	switch (REG_CNT(r)) {						\
+	case 4:								\
+		__asm(							\
+		    "vmovdqu64 0x00(%[SRC]), %%" VR0(r) "\n"		\
+		    "vmovdqu64 0x40(%[SRC]), %%" VR1(r) "\n"		\
+		    "vmovdqu64 0x80(%[SRC]), %%" VR2(r) "\n"		\
+		    "vmovdqu64 0xc0(%[SRC]), %%" VR3(r) "\n"		\
+		    : : [SRC] "r" (src));				\
+		break;							\
+	case 2:								\
+		__asm(							\
+		    "vmovdqu64 0x00(%[SRC]), %%" VR0(r) "\n"		\
+		    "vmovdqu64 0x40(%[SRC]), %%" VR1(r) "\n"		\
+		    : : [SRC] "r" (src));				\
+		break;							\
+	default:							\
+		ZFS_ASM_BUG();						\
+	}								\
+}
+
+#define	STORE(dst, r...)   						\
+{									\
+	switch (REG_CNT(r)) {						\
+	case 4:								\
+		__asm(							\
+		    "vmovdqu64 %%" VR0(r) ", 0x00(%[DST])\n"		\
+		    "vmovdqu64 %%" VR1(r) ", 0x40(%[DST])\n"		\
+		    "vmovdqu64 %%" VR2(r) ", 0x80(%[DST])\n"		\
+		    "vmovdqu64 %%" VR3(r) ", 0xc0(%[DST])\n"		\
+		    : : [DST] "r" (dst));				\
+		break;							\
+	case 2:								\
+		__asm(							\
+		    "vmovdqu64 %%" VR0(r) ", 0x00(%[DST])\n"		\
+		    "vmovdqu64 %%" VR1(r) ", 0x40(%[DST])\n"		\
+		    : : [DST] "r" (dst));				\
+		break;							\
+	default:							\
+		ZFS_ASM_BUG();						\
+	}								\
+}
+
+#define	FLUSH()								\
+{									\
+	__asm("vzeroupper");						\
+}
+
+#define	MUL2_SETUP() 							\
+{   									\
+	__asm("vmovq %0,   %%xmm16" :: "r"(0x0101010101010101));	\
+	__asm("vpbroadcastq %xmm16, %zmm16");				\
+	__asm("vpternlogq $0x55, %zmm16, %zmm16, %zmm17");		\
+}
+
+/*
+ * Without AVX-512BW there are no byte-granular 512-bit adds or shuffles, so
+ * multiply by 2 with quadword shifts: zmm16 holds 0x01 in every byte and
+ * zmm17 holds 0xfe.  The top bit of each byte is moved to the bottom (t),
+ * every byte is doubled with the carries between bytes masked off, and the
+ * reduction by the field polynomial 0x1d (t ^ t<<2 ^ t<<3 ^ t<<4) is folded
+ * in with two three-way XORs.
+ */
+#define	_MUL2(r...) 							\
+{									\
+	switch	(REG_CNT(r)) {						\
+	case 2:								\
+		__asm(							\
+		    "vpsrlq $7, %" VR0(r)", %zmm18\n"			\
+		    "vpsrlq $7, %" VR1(r)", %zmm19\n"			\
+		    "vpsllq $1, %" VR0(r)", %" VR0(r) "\n"		\
+		    "vpsllq $1, %" VR1(r)", %" VR1(r) "\n"		\
+		    "vpandq %zmm16, %zmm18, %zmm18\n"			\
+		    "vpandq %zmm16, %zmm19, %zmm19\n"			\
+		    "vpandq %zmm17, %" VR0(r)", %" VR0(r) "\n"		\
+		    "vpandq %zmm17, %" VR1(r)", %" VR1(r) "\n"		\
+		    "vpsllq $2, %zmm18, %zmm20\n"			\
+		    "vpsllq $2, %zmm19, %zmm21\n"			\
+		    "vpternlogq $0x96, %zmm20, %zmm18, %" VR0(r) "\n"	\
+		    "vpternlogq $0x96, %zmm21, %zmm19, %" VR1(r) "\n"	\
+		    "vpsllq $3, %zmm18, %zmm20\n"			\
+		    "vpsllq $3, %zmm19, %zmm21\n"			\
+		    "vpsllq $4, %zmm18, %zmm18\n"			\
+		    "vpsllq $4, %zmm19, %zmm19\n"			\
+		    "vpternlogq $0x96, %zmm20, %zmm18, %" VR0(r) "\n"	\
+		    "vpternlogq $0x96, %zmm21, %zmm19, %" VR1(r));	\
+		break;							\
+	default:							\
+		ZFS_ASM_BUG();						\
+	}								\
+}
+
+#define	MUL2(r...)							\
+{									\
+	switch (REG_CNT(r)) {						\
+	case 4:								\
+	    _MUL2(R_01(r));						\
+	    _MUL2(R_23(r));						\
+	    break;							\
+	case 2:								\
+	    _MUL2(r);							\
+	    break;							\
+	default:							\
+		ZFS_ASM_BUG();						\
+	}								\
+}
+
+#define	MUL4(r...)							\
+{									\
+	MUL2(r);							\
+	MUL2(r);							\
+}
+
+/*
+ * General multiplication by shift-and-add: for each set bit of the constant
+ * the current multiple of the data is accumulated in zmm24-zmm27, and the
+ * data is doubled after every bit.  The shifts in _MUL2 leave the constant
+ * registers intact, so MUL2_SETUP() only needs to be done once per call.
+ */
+#define	_MUL_ACC(r...)							\
+{									\
+	switch (REG_CNT(r)) {						\
+	case 4:								\
+		__asm(							\
+		    "vpxorq %" VR0(r) ", %zmm24, %zmm24\n"		\
+		    "vpxorq %" VR1(r) ", %zmm25, %zmm25\n"		\
+		    "vpxorq %" VR2(r) ", %zmm26, %zmm26\n"		\
+		    "vpxorq %" VR3(r) ", %zmm27, %zmm27");		\
+		break;							\
+	case 2:								\
+		__asm(							\
+		    "vpxorq %" VR0(r) ", %zmm24, %zmm24\n"		\
+		    "vpxorq %" VR1(r) ", %zmm25, %zmm25");		\
+		break;							\
+	default:							\
+		ZFS_ASM_BUG();						\
+	}								\
+}
+
+#define	_MUL_RES(r...)							\
+{									\
+	switch (REG_CNT(r)) {						\
+	case 4:								\
+		__asm(							\
+		    "vmovdqa64 %zmm24, %" VR0(r) "\n"			\
+		    "vmovdqa64 %zmm25, %" VR1(r) "\n"			\
+		    "vmovdqa64 %zmm26, %" VR2(r) "\n"			\
+		    "vmovdqa64 %zmm27, %" VR3(r));			\
+		break;							\
+	case 2:								\
+		__asm(							\
+		    "vmovdqa64 %zmm24, %" VR0(r) "\n"			\
+		    "vmovdqa64 %zmm25, %" VR1(r));			\
+		break;							\
+	default:							\
+		ZFS_ASM_BUG();						\
+	}								\
+}
+
+#define	MUL(c, r...)							\
+{									\
+	unsigned _c = (c);						\
+									\
+	MUL2_SETUP();							\
+	__asm("vpxorq %zmm24, %zmm24, %zmm24\n"				\
+	    "vpxorq %zmm25, %zmm25, %zmm25\n"				\
+	    "vpxorq %zmm26, %zmm26, %zmm26\n"				\
+	    "vpxorq %zmm27, %zmm27, %zmm27");				\
+	while (_c != 0) {						\
+		if (_c & 1)						\
+			_MUL_ACC(r);					\
+		_c >>= 1;						\
+		if (_c != 0)						\
+			MUL2(r);					\
+	}								\
+	_MUL_RES(r);							\
+}
+
+#define	raidz_math_begin()	kfpu_begin()
+#define	raidz_math_end()						\
+{									\
+	FLUSH();							\
+	kfpu_end();							\
+}
+
+
+#define	SYN_STRIDE		4
+
+#define	ZERO_STRIDE		4
+#define	ZERO_DEFINE()		{}
+#define	ZERO_D			0, 1, 2, 3
+
+#define	COPY_STRIDE		4
+#define	COPY_DEFINE()		{}
+#define	COPY_D			0, 1, 2, 3
+
+#define	ADD_STRIDE		4
+#define	ADD_DEFINE()		{}
+#define	ADD_D 			0, 1, 2, 3
+
+#define	MUL_STRIDE		4
+#define	MUL_DEFINE() 		{}
+#define	MUL_D			0, 1, 2, 3
+
+#define	GEN_P_STRIDE		4
+#define	GEN_P_DEFINE()		{}
+#define	GEN_P_P			0, 1, 2, 3
+
+#define	GEN_PQ_STRIDE		4
+#define	GEN_PQ_DEFINE() 	{}
+#define	GEN_PQ_D		0, 1, 2, 3
+#define	GEN_PQ_C		4, 5, 6, 7
+
+#define	GEN_PQR_STRIDE		4
+#define	GEN_PQR_DEFINE() 	{}
+#define	GEN_PQR_D		0, 1, 2, 3
+#define	GEN_PQR_C		4, 5, 6, 7
+
+#define	SYN_Q_DEFINE()		{}
+#define	SYN_Q_D			0, 1, 2, 3
+#define	SYN_Q_X			4, 5, 6, 7
+
+#define	SYN_R_DEFINE()		{}
+#define	SYN_R_D			0, 1, 2, 3
+#define	SYN_R_X			4, 5, 6, 7
+
+#define	SYN_PQ_DEFINE() 	{}
+#define	SYN_PQ_D		0, 1, 2, 3
+#define	SYN_PQ_X		4, 5, 6, 7
+
+#define	REC_PQ_STRIDE		2
+#define	REC_PQ_DEFINE() 	{}
+#define	REC_PQ_X		0, 1
+#define	REC_PQ_Y		2, 3
+#define	REC_PQ_T		4, 5
+
+#define	SYN_PR_DEFINE() 	{}
+#define	SYN_PR_D		0, 1, 2, 3
+#define	SYN_PR_X		4, 5, 6, 7
+
+#define	REC_PR_STRIDE		2
+#define	REC_PR_DEFINE() 	{}
+#define	REC_PR_X		0, 1
+#define	REC_PR_Y		2, 3
+#define	REC_PR_T		4, 5
+
+#define	SYN_QR_DEFINE() 	{}
+#define	SYN_QR_D		0, 1, 2, 3
+#define	SYN_QR_X		4, 5, 6, 7
+
+#define	REC_QR_STRIDE		2
+#define	REC_QR_DEFINE() 	{}
+#define	REC_QR_X		0, 1
+#define	REC_QR_Y		2, 3
+#define	REC_QR_T		4, 5
+
+#define	SYN_PQR_DEFINE() 	{}
+#define	SYN_PQR_D		0, 1, 2, 3
+#define	SYN_PQR_X		4, 5, 6, 7
+
+#define	REC_PQR_STRIDE		2
+#define	REC_PQR_DEFINE() 	{}
+#define	REC_PQR_X		0, 1
+#define	REC_PQR_Y		2, 3
+#define	REC_PQR_Z		4, 5
+#define	REC_PQR_XS		6, 7
+#define	REC_PQR_YS		8, 9
+
+
+#include <sys/vdev_raidz_impl.h>
+#include "vdev_raidz_math_impl.h"
+
+DEFINE_GEN_METHODS(avx512f);
+DEFINE_REC_METHODS(avx512f);
+
+static boolean_t
+raidz_will_avx512f_work(void)
+{
+	return (kfpu_allowed() && zfs_avx_available() &&
+	    zfs_avx512f_available() && zfs_avx512f_available());
+}
+
+const raidz_impl_ops_t vdev_raidz_avx512f_impl = {
+	.init = NULL,
+	.fini = NULL,
+	.gen = RAIDZ_GEN_METHODS(avx512f),
+	.rec = RAIDZ_REC_METHODS(avx512f),
+	.is_supported = &raidz_will_avx512f_work,
+	.name = "avx512f"
+};
+
+#elif defined(__i386)
+
+/* 32-bit stub for user-level fakekernel dependencies */
+#include <sys/vdev_raidz_impl.h>
+const raidz_impl_ops_t vdev_raidz_avx512f_impl = {
+	.init = NULL,
+	.fini = NULL,
+	.gen = NULL,
+	.rec = NULL,
+	.is_supported = NULL,
+	.name = "avx512f"
+};
+
+#endif /* defined(__amd64) */
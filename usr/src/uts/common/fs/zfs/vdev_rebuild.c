@@ -0,0 +1,410 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/txg.h>
+#include <sys/vdev_impl.h>
+#include <sys/vdev_rebuild.h>
+#include <sys/metaslab_impl.h>
+#include <sys/dsl_synctask.h>
+#include <sys/dmu_tx.h>
+#include <sys/zio.h>
+#include <sys/abd.h>
+
+/*
+ * Sequential rebuild
+ *
+ * A resilver (see dsl_scan.c) walks every block pointer in the pool and is
+ * therefore bound by metadata reads on pools with many small blocks.  For
+ * top-level vdevs whose children all hold the same data (mirrors, and
+ * replacing and spare vdevs), a newly attached device can instead be
+ * rebuilt by copying every allocated range of the top-level vdev, in
+ * offset order, from a healthy child.  The allocated ranges come straight
+ * from the metaslab space maps, so the rebuild runs at device bandwidth
+ * regardless of the block size.
+ *
+ * Each range is read through the top-level vdev using a block pointer
+ * born in TXG_INITIAL with no checksum, issued with ZIO_FLAG_RESILVER.
+ * The mirror reads it from a child whose DTL does not cover TXG_INITIAL
+ * and writes it to every child whose DTL does.  Since no checksums are
+ * verified, a scrub is started once the rebuild completes.
+ *
+ * The rebuild of a top-level vdev covers the txgs below
+ * vdev_rebuild_max_txg, which the attach sets just like the DTL of the new
+ * device.  When every metaslab has been copied without errors, that part
+ * of the DTLs is excised.  Rebuild state is not persistent: if the pool is
+ * exported before the rebuild completes, the next import finds the DTLs
+ * still dirty and starts a normal resilver.
+ */
+
+/* maximum size of a single rebuild read; see zfs_remove_max_segment */
+uint64_t zfs_rebuild_max_segment = 1024 * 1024;
+
+/* maximum number of rebuild reads outstanding per top-level vdev */
+int zfs_rebuild_queue_limit = 20;
+
+/* scrub the pool once a rebuild completes, to verify the copied data */
+int zfs_rebuild_scrub_enabled = 1;
+
+/*
+ * Only vdevs which maintain full copies of their data on every child can
+ * be rebuilt by copying ranges.
+ */
+boolean_t
+vdev_rebuild_supported(vdev_t *tvd)
+{
+	return (tvd->vdev_ops == &vdev_mirror_ops ||
+	    tvd->vdev_ops == &vdev_replacing_ops ||
+	    tvd->vdev_ops == &vdev_spare_ops);
+}
+
+static boolean_t
+vdev_rebuild_should_stop(vdev_t *tvd)
+{
+	return (tvd->vdev_rebuild_exit_wanted || !vdev_writeable(tvd) ||
+	    tvd->vdev_removing || spa_shutting_down(tvd->vdev_spa));
+}
+
+static uint64_t
+vdev_rebuild_write_errors(vdev_t *vd)
+{
+	uint64_t errors = 0;
+
+	if (vd->vdev_ops->vdev_op_leaf)
+		return (vd->vdev_stat.vs_write_errors);
+
+	for (uint64_t i = 0; i < vd->vdev_children; i++)
+		errors += vdev_rebuild_write_errors(vd->vdev_child[i]);
+
+	return (errors);
+}
+
+static void
+vdev_rebuild_cb(zio_t *zio)
+{
+	vdev_t *tvd = zio->io_private;
+
+	mutex_enter(&tvd->vdev_rebuild_io_lock);
+	if (zio->io_error != 0)
+		tvd->vdev_rebuild_errors++;
+	else
+		tvd->vdev_rebuild_bytes_done += zio->io_size;
+	ASSERT3U(tvd->vdev_rebuild_inflight, >, 0);
+	tvd->vdev_rebuild_inflight--;
+	cv_broadcast(&tvd->vdev_rebuild_io_cv);
+	mutex_exit(&tvd->vdev_rebuild_io_lock);
+
+	abd_free(zio->io_abd);
+	spa_config_exit(tvd->vdev_spa, SCL_STATE_ALL, tvd);
+}
+
+/* Issues the read of one range and limits the number of concurrent ZIOs. */
+static int
+vdev_rebuild_range(vdev_t *tvd, uint64_t start, uint64_t size)
+{
+	spa_t *spa = tvd->vdev_spa;
+	blkptr_t blk, *bp = &blk;
+
+	mutex_enter(&tvd->vdev_rebuild_io_lock);
+	while (tvd->vdev_rebuild_inflight >= zfs_rebuild_queue_limit) {
+		cv_wait(&tvd->vdev_rebuild_io_cv,
+		    &tvd->vdev_rebuild_io_lock);
+	}
+	tvd->vdev_rebuild_inflight++;
+	mutex_exit(&tvd->vdev_rebuild_io_lock);
+
+	spa_config_enter(spa, SCL_STATE_ALL, tvd, RW_READER);
+
+	/*
+	 * We know the vdev struct will still be around since all
+	 * consumers of vdev_free must stop the rebuild first.
+	 */
+	if (vdev_rebuild_should_stop(tvd)) {
+		mutex_enter(&tvd->vdev_rebuild_io_lock);
+		ASSERT3U(tvd->vdev_rebuild_inflight, >, 0);
+		tvd->vdev_rebuild_inflight--;
+		mutex_exit(&tvd->vdev_rebuild_io_lock);
+		spa_config_exit(spa, SCL_STATE_ALL, tvd);
+		return (SET_ERROR(EINTR));
+	}
+
+	BP_ZERO(bp);
+	DVA_SET_VDEV(&bp->blk_dva[0], tvd->vdev_id);
+	DVA_SET_OFFSET(&bp->blk_dva[0], start);
+	DVA_SET_ASIZE(&bp->blk_dva[0], size);
+	BP_SET_BIRTH(bp, TXG_INITIAL, TXG_INITIAL);
+	BP_SET_LSIZE(bp, size);
+	BP_SET_PSIZE(bp, size);
+	BP_SET_COMPRESS(bp, ZIO_COMPRESS_OFF);
+	BP_SET_CHECKSUM(bp, ZIO_CHECKSUM_OFF);
+	BP_SET_TYPE(bp, DMU_OT_NONE);
+	BP_SET_LEVEL(bp, 0);
+	BP_SET_DEDUP(bp, 0);
+	BP_SET_BYTEORDER(bp, ZFS_HOST_BYTEORDER);
+
+	zio_nowait(zio_read(NULL, spa, bp, abd_alloc(size, B_FALSE), size,
+	    vdev_rebuild_cb, tvd, ZIO_PRIORITY_SCRUB,
+	    ZIO_FLAG_RAW | ZIO_FLAG_CANFAIL | ZIO_FLAG_RESILVER, NULL));
+	/* vdev_rebuild_cb releases SCL_STATE_ALL */
+
+	return (0);
+}
+
+static int
+vdev_rebuild_ranges(vdev_t *tvd, range_tree_t *rt)
+{
+	zfs_btree_t *bt = &rt->rt_root;
+	zfs_btree_index_t where;
+	uint64_t align = 1ULL << tvd->vdev_ashift;
+	uint64_t max_segment = MAX(P2ALIGN(MIN(zfs_rebuild_max_segment,
+	    SPA_MAXBLOCKSIZE), align), align);
+
+	for (range_seg_t *rs = zfs_btree_first(bt, &where); rs != NULL;
+	    rs = zfs_btree_next(bt, &where, &where)) {
+		uint64_t start = rs_get_start(rs, rt);
+		uint64_t end = rs_get_end(rs, rt);
+
+		/* Split range into legally-sized logical chunks */
+		while (start < end) {
+			uint64_t size = MIN(end - start, max_segment);
+			int error = vdev_rebuild_range(tvd, start, size);
+
+			if (error != 0)
+				return (error);
+			start += size;
+		}
+	}
+
+	return (0);
+}
+
+static void
+vdev_rebuild_clear(void *arg, uint64_t start, uint64_t size)
+{
+	range_tree_clear(arg, start, size);
+}
+
+/*
+ * Add the allocated ranges of the metaslab to rt: those in its space map
+ * plus those not yet flushed from the log space maps.  Holding ms_sync_lock
+ * keeps metaslab_sync() from changing either while we look.
+ */
+static void
+vdev_rebuild_ms_allocated(metaslab_t *msp, range_tree_t *rt)
+{
+	mutex_enter(&msp->ms_sync_lock);
+	if (msp->ms_sm != NULL) {
+		VERIFY0(space_map_load(msp->ms_sm, rt, SM_ALLOC));
+
+		mutex_enter(&msp->ms_lock);
+		range_tree_walk(msp->ms_unflushed_allocs, range_tree_add, rt);
+		range_tree_walk(msp->ms_unflushed_frees, vdev_rebuild_clear,
+		    rt);
+		mutex_exit(&msp->ms_lock);
+	}
+	mutex_exit(&msp->ms_sync_lock);
+}
+
+static void
+vdev_rebuild_excise(vdev_t *vd, uint64_t max_txg)
+{
+	for (uint64_t i = 0; i < vd->vdev_children; i++)
+		vdev_rebuild_excise(vd->vdev_child[i], max_txg);
+
+	if (!vd->vdev_ops->vdev_op_leaf || vd->vdev_state < VDEV_STATE_DEGRADED)
+		return;
+
+	mutex_enter(&vd->vdev_dtl_lock);
+	range_tree_clear(vd->vdev_dtl[DTL_MISSING], 0, max_txg);
+	mutex_exit(&vd->vdev_dtl_lock);
+}
+
+static void
+vdev_rebuild_complete_sync(void *arg, dmu_tx_t *tx)
+{
+	vdev_t *tvd = arg;
+	spa_t *spa = tvd->vdev_spa;
+
+	vdev_rebuild_excise(tvd, tvd->vdev_rebuild_max_txg);
+	vdev_dtl_reassess(tvd, tx->tx_txg, 0, B_FALSE);
+
+	spa_history_log_internal(spa, "rebuild", tx,
+	    "complete vdev=%llu max_txg=%llu bytes=%llu",
+	    (u_longlong_t)tvd->vdev_id,
+	    (u_longlong_t)tvd->vdev_rebuild_max_txg,
+	    (u_longlong_t)tvd->vdev_rebuild_bytes_done);
+}
+
+static void
+vdev_rebuild_thread(void *arg)
+{
+	vdev_t *tvd = arg;
+	spa_t *spa = tvd->vdev_spa;
+	dsl_pool_t *dp = spa_get_dsl(spa);
+	boolean_t done = B_FALSE;
+	uint64_t write_errors;
+	range_tree_t *rt;
+	int error = 0;
+
+	ASSERT3P(tvd->vdev_top, ==, tvd);
+
+	/*
+	 * Every block born before vdev_rebuild_max_txg must have made it
+	 * into the space maps before we read them.
+	 */
+	txg_wait_synced(dp, tvd->vdev_rebuild_max_txg);
+
+	rt = range_tree_create(NULL, RANGE_SEG64, NULL, 0, 0);
+
+	spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+	write_errors = vdev_rebuild_write_errors(tvd);
+
+	for (uint64_t i = tvd->vdev_rebuild_next_ms; ; i++) {
+		if (i >= tvd->vdev_ms_count) {
+			done = B_TRUE;
+			break;
+		}
+		if (vdev_rebuild_should_stop(tvd))
+			break;
+
+		metaslab_t *msp = tvd->vdev_ms[i];
+
+		spa_config_exit(spa, SCL_CONFIG, FTAG);
+		metaslab_disable(msp);
+		vdev_rebuild_ms_allocated(msp, rt);
+		error = vdev_rebuild_ranges(tvd, rt);
+		metaslab_enable(msp, B_FALSE, B_FALSE);
+		spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+
+		range_tree_vacate(rt, NULL, NULL);
+		if (error != 0)
+			break;
+		tvd->vdev_rebuild_next_ms = i + 1;
+	}
+	spa_config_exit(spa, SCL_CONFIG, FTAG);
+
+	mutex_enter(&tvd->vdev_rebuild_io_lock);
+	while (tvd->vdev_rebuild_inflight > 0) {
+		cv_wait(&tvd->vdev_rebuild_io_cv,
+		    &tvd->vdev_rebuild_io_lock);
+	}
+	mutex_exit(&tvd->vdev_rebuild_io_lock);
+
+	range_tree_destroy(rt);
+
+	if (done && !vdev_rebuild_should_stop(tvd)) {
+		spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+		boolean_t clean = (tvd->vdev_rebuild_errors == 0 &&
+		    vdev_rebuild_write_errors(tvd) == write_errors);
+		spa_config_exit(spa, SCL_CONFIG, FTAG);
+
+		if (clean) {
+			dmu_tx_t *tx = dmu_tx_create_dd(dp->dp_mos_dir);
+			VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+			uint64_t txg = dmu_tx_get_txg(tx);
+			dsl_sync_task_nowait(dp, vdev_rebuild_complete_sync,
+			    tvd, 0, ZFS_SPACE_CHECK_NONE, tx);
+			dmu_tx_commit(tx);
+			txg_wait_synced(dp, txg);
+
+			spa_async_request(spa, SPA_ASYNC_RESILVER_DONE |
+			    SPA_ASYNC_REBUILD_DONE);
+		} else {
+			/*
+			 * Something went wrong along the way; leave the
+			 * DTLs alone and let a resilver sort it out.
+			 */
+			zfs_dbgmsg("rebuild of vdev %llu failed, %llu read "
+			    "errors; falling back to resilver",
+			    (u_longlong_t)tvd->vdev_id,
+			    (u_longlong_t)tvd->vdev_rebuild_errors);
+			spa_async_request(spa, SPA_ASYNC_RESILVER);
+		}
+		tvd->vdev_rebuild_max_txg = 0;
+	}
+
+	mutex_enter(&tvd->vdev_rebuild_lock);
+	tvd->vdev_rebuild_thread = NULL;
+	cv_broadcast(&tvd->vdev_rebuild_cv);
+	mutex_exit(&tvd->vdev_rebuild_lock);
+}
+
+/*
+ * Wait for the rebuild thread of the top-level vdev to stop.  Its progress
+ * is kept so that vdev_rebuild_restart() can resume it.
+ */
+void
+vdev_rebuild_stop_wait(vdev_t *tvd)
+{
+	mutex_enter(&tvd->vdev_rebuild_lock);
+	if (tvd->vdev_rebuild_thread != NULL) {
+		tvd->vdev_rebuild_exit_wanted = B_TRUE;
+
+		while (tvd->vdev_rebuild_thread != NULL) {
+			cv_wait(&tvd->vdev_rebuild_cv,
+			    &tvd->vdev_rebuild_lock);
+		}
+
+		ASSERT3P(tvd->vdev_rebuild_thread, ==, NULL);
+		tvd->vdev_rebuild_exit_wanted = B_FALSE;
+	}
+	mutex_exit(&tvd->vdev_rebuild_lock);
+}
+
+/*
+ * Stop the rebuild threads of all top-level vdevs, e.g. while the vdev
+ * tree is being changed.
+ */
+void
+vdev_rebuild_stop_all(spa_t *spa)
+{
+	vdev_t *root_vd = spa->spa_root_vdev;
+
+	for (uint64_t i = 0; i < root_vd->vdev_children; i++)
+		vdev_rebuild_stop_wait(root_vd->vdev_child[i]);
+}
+
+/*
+ * Start (or resume) a rebuild thread for each top-level vdev which has a
+ * rebuild pending and can still be rebuilt.
+ */
+void
+vdev_rebuild_restart(spa_t *spa)
+{
+	vdev_t *root_vd = spa->spa_root_vdev;
+
+	ASSERT(MUTEX_HELD(&spa_namespace_lock));
+
+	for (uint64_t i = 0; i < root_vd->vdev_children; i++) {
+		vdev_t *tvd = root_vd->vdev_child[i];
+
+		mutex_enter(&tvd->vdev_rebuild_lock);
+		if (tvd->vdev_rebuild_max_txg != 0 && vdev_writeable(tvd) &&
+		    !tvd->vdev_removing && tvd->vdev_rebuild_thread == NULL) {
+			tvd->vdev_rebuild_thread = thread_create(NULL, 0,
+			    vdev_rebuild_thread, tvd, 0, &p0, TS_RUN,
+			    maxclsyspri);
+			ASSERT(tvd->vdev_rebuild_thread != NULL);
+		}
+		mutex_exit(&tvd->vdev_rebuild_lock);
+	}
+}
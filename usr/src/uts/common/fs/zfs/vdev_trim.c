@@ -22,7 +22,7 @@
 /*
  * Copyright (c) 2016 by Delphix. All rights reserved.
  * Copyright (c) 2019 by Lawrence Livermore National Security, LLC.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/spa.h>
@@ -82,8 +82,11 @@
  * While the automatic TRIM process is highly effective it is more likely
  * than a manual TRIM to encounter tiny ranges.  Ranges less than or equal to
  * 'zfs_trim_extent_bytes_min' (32k) are considered too small to efficiently
- * TRIM and are skipped.  This means small amounts of freed space may not
- * be automatically trimmed.
+ * TRIM and are skipped.  They are kept for a later pass, when neighbouring
+ * frees may have grown them into a range worth trimming, but this means small
+ * amounts of freed space may not be automatically trimmed.  The rate of
+ * automatic TRIM can be capped, and it backs off while a device's reads are
+ * slow; see zfs_autotrim_rate.
  *
  * Furthermore, devices with attached hot spares and devices being actively
  * replaced are skipped.  This is done to avoid adding additional stress to
@@ -136,6 +139,30 @@ unsigned int zfs_trim_queue_limit = 10;
  */
 unsigned int zfs_trim_txg_batch = 32;
 
+/*
+ * Automatic TRIM has no per-vdev rate like a manual TRIM does, so on a pool
+ * with heavy churn it can flood a device with discards which hurt its read
+ * latency.  zfs_autotrim_rate, when non-zero, caps the rate in bytes/sec at
+ * which each leaf vdev is trimmed automatically.  Independently, while a
+ * leaf's moving average read latency (see vdev_queue_read_latency()) is above
+ * zfs_autotrim_read_latency_us, no more than one automatic TRIM I/O is kept
+ * in flight to it; each TRIM waits at most zfs_autotrim_backoff_ms for the
+ * latency to recover so that the TRIM still makes progress.
+ */
+uint64_t zfs_autotrim_rate = 0;
+unsigned int zfs_autotrim_read_latency_us = 2000;
+unsigned int zfs_autotrim_backoff_ms = 100;
+
+/*
+ * Freed extents smaller than zfs_trim_extent_bytes_min are not worth a TRIM
+ * on their own, but they often become part of a larger free extent once
+ * their neighbours are freed too.  Rather than forgetting them, automatic
+ * TRIM returns them to the metaslab's ms_trim tree (while it holds fewer
+ * than zfs_autotrim_defer_max_segs segments), so that they are coalesced with
+ * later frees and trimmed once the combined extent is large enough.
+ */
+unsigned int zfs_autotrim_defer_max_segs = 4096;
+
 /*
  * The trim_args are a control structure which describe how a leaf vdev
  * should be trimmed.  The core elements are the vdev, the metaslab being
@@ -372,15 +399,11 @@ vdev_trim_cb(zio_t *zio)
 	} else {
 		if (zio->io_error != 0) {
 			vd->vdev_stat.vs_trim_errors++;
-			/*
-			 * spa_iostats_trim_add(vd->vdev_spa, TRIM_TYPE_MANUAL,
-			 *  0, 0, 0, 0, 1, zio->io_orig_size);
-			 */
+			spa_iostats_trim_add(vd->vdev_spa, TRIM_TYPE_MANUAL,
+			    0, 0, 0, 0, 1, zio->io_orig_size);
 		} else {
-			/*
-			 * spa_iostats_trim_add(vd->vdev_spa, TRIM_TYPE_MANUAL,
-			 *  1, zio->io_orig_size, 0, 0, 0, 0);
-			 */
+			spa_iostats_trim_add(vd->vdev_spa, TRIM_TYPE_MANUAL,
+			    1, zio->io_orig_size, 0, 0, 0, 0);
 		}
 
 		vd->vdev_trim_bytes_done += zio->io_orig_size;
@@ -409,15 +432,11 @@ vdev_autotrim_cb(zio_t *zio)
 
 	if (zio->io_error != 0) {
 		vd->vdev_stat.vs_trim_errors++;
-		/*
-		 * spa_iostats_trim_add(vd->vdev_spa, TRIM_TYPE_AUTO,
-		 *  0, 0, 0, 0, 1, zio->io_orig_size);
-		 */
+		spa_iostats_trim_add(vd->vdev_spa, TRIM_TYPE_AUTO,
+		    0, 0, 0, 0, 1, zio->io_orig_size);
 	} else {
-		/*
-		 * spa_iostats_trim_add(vd->vdev_spa, TRIM_TYPE_AUTO,
-		 *  1, zio->io_orig_size, 0, 0, 0, 0);
-		 */
+		spa_iostats_trim_add(vd->vdev_spa, TRIM_TYPE_AUTO,
+		    1, zio->io_orig_size, 0, 0, 0, 0);
 
 		vd->vdev_autotrim_bytes_done += zio->io_orig_size;
 	}
@@ -453,8 +472,9 @@ vdev_trim_range(trim_args_t *ta, uint64_t start, uint64_t size)
 	mutex_enter(&vd->vdev_trim_io_lock);
 
 	/*
-	 * Limit manual TRIM I/Os to the requested rate.  This does not
-	 * apply to automatic TRIM since no per vdev rate can be specified.
+	 * Limit manual TRIM I/Os to the requested rate.  Automatic TRIM
+	 * I/Os are limited to zfs_autotrim_rate and back off while the
+	 * device's reads are slow.
 	 */
 	if (ta->trim_type == TRIM_TYPE_MANUAL) {
 		while (vd->vdev_trim_rate != 0 && !vdev_trim_should_stop(vd) &&
@@ -463,6 +483,27 @@ vdev_trim_range(trim_args_t *ta, uint64_t start, uint64_t size)
 			    &vd->vdev_trim_io_lock, ddi_get_lbolt() +
 			    MSEC_TO_TICK(10));
 		}
+	} else {
+		hrtime_t backoff_end = gethrtime() +
+		    MSEC2NSEC(zfs_autotrim_backoff_ms);
+
+		while (zfs_autotrim_rate != 0 &&
+		    !vdev_autotrim_should_stop(vd->vdev_top) &&
+		    vdev_trim_calculate_rate(ta) > zfs_autotrim_rate) {
+			(void) cv_timedwait(&vd->vdev_trim_io_cv,
+			    &vd->vdev_trim_io_lock, ddi_get_lbolt() +
+			    MSEC_TO_TICK(10));
+		}
+		while (zfs_autotrim_read_latency_us != 0 &&
+		    vd->vdev_trim_inflight[TRIM_TYPE_AUTO] != 0 &&
+		    vdev_queue_read_latency(vd) >
+		    USEC2NSEC(zfs_autotrim_read_latency_us) &&
+		    gethrtime() < backoff_end &&
+		    !vdev_autotrim_should_stop(vd->vdev_top)) {
+			(void) cv_timedwait(&vd->vdev_trim_io_cv,
+			    &vd->vdev_trim_io_lock, ddi_get_lbolt() +
+			    MSEC_TO_TICK(10));
+		}
 	}
 	ta->trim_bytes_done += size;
 
@@ -549,10 +590,8 @@ vdev_trim_ranges(trim_args_t *ta)
 		    ta->trim_tree);
 
 		if (extent_bytes_min && size < extent_bytes_min) {
-			/*
-			 * spa_iostats_trim_add(spa, ta->trim_type,
-			 *  0, 0, 1, size, 0, 0);
-			 */
+			spa_iostats_trim_add(spa, ta->trim_type,
+			    0, 0, 1, size, 0, 0);
 			continue;
 		}
 
@@ -1101,6 +1140,28 @@ vdev_trim_range_verify(void *arg, uint64_t start, uint64_t size)
 	VERIFY(range_tree_contains(msp->ms_allocatable, start, size));
 }
 
+/*
+ * Used by the automatic TRIM to return an extent which was too small to be
+ * trimmed to ms_trim (see zfs_autotrim_defer_max_segs).  The metaslab is
+ * still disabled, so the extent is still free and cannot overlap anything
+ * freed since ms_trim was swapped out.
+ */
+static void
+vdev_autotrim_defer(void *arg, uint64_t start, uint64_t size)
+{
+	trim_args_t *ta = arg;
+	metaslab_t *msp = ta->trim_msp;
+
+	ASSERT(MUTEX_HELD(&msp->ms_lock));
+	ASSERT3U(msp->ms_disabled, >, 0);
+
+	if (size >= ta->trim_extent_bytes_min ||
+	    range_tree_numsegs(msp->ms_trim) >= zfs_autotrim_defer_max_segs)
+		return;
+
+	range_tree_add(msp->ms_trim, start, size);
+}
+
 /*
  * Each automatic TRIM thread is responsible for managing the trimming of a
  * top-level vdev in the pool.  No automatic TRIM state is maintained on-disk.
@@ -1195,9 +1256,14 @@ vdev_autotrim_thread(void *arg)
 			/*
 			 * Allocate an empty range tree which is swapped in
 			 * for the existing ms_trim tree while it is processed.
+			 * It must use the same compact segment encoding as
+			 * the tree it replaces, or the metaslab would be left
+			 * with a 64-bit ms_trim (twice the memory per segment)
+			 * after its first automatic TRIM.
 			 */
-			trim_tree = range_tree_create(NULL, RANGE_SEG64, NULL,
-			    0, 0);
+			trim_tree = range_tree_create(NULL,
+			    msp->ms_trim->rt_type, NULL,
+			    msp->ms_trim->rt_start, msp->ms_trim->rt_shift);
 			range_tree_swap(&msp->ms_trim, &trim_tree);
 			ASSERT(range_tree_is_empty(msp->ms_trim));
 
@@ -1305,6 +1371,20 @@ vdev_autotrim_thread(void *arg)
 				mutex_exit(&msp->ms_lock);
 			}
 
+			/*
+			 * Keep the extents which were too small to TRIM, so
+			 * that they can coalesce with later frees.
+			 */
+			if (zfs_autotrim_defer_max_segs != 0 &&
+			    extent_bytes_min != 0) {
+				mutex_enter(&msp->ms_lock);
+				if (spa_get_autotrim(spa) == SPA_AUTOTRIM_ON) {
+					range_tree_walk(trim_tree,
+					    vdev_autotrim_defer, &tap[0]);
+				}
+				mutex_exit(&msp->ms_lock);
+			}
+
 			range_tree_vacate(trim_tree, NULL, NULL);
 			range_tree_destroy(trim_tree);
 
@@ -22,6 +22,7 @@
  * Copyright (c) 2005, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright (c) 2012, 2018 by Delphix. All rights reserved.
  * Copyright (c) 2014 Spectra Logic Corporation, All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -79,6 +80,15 @@
  */
 boolean_t zap_iterate_prefetch = B_TRUE;
 
+/*
+ * The prefetch above reads leaf blocks in offset order, and is capped at
+ * dmu_prefetch_max, while a cursor visits leaves in hash order.  For a ZAP
+ * too large to prefetch whole, or a cursor resumed part way through (e.g.
+ * readdir), the cursor also prefetches this many leaves ahead of itself,
+ * in the order it will visit them.
+ */
+int zap_iterate_prefetch_leaves = 32;
+
 int fzap_default_block_shift = 14; /* 16k blocksize */
 
 extern inline zap_phys_t *zap_f_phys(zap_t *zap);
@@ -1189,6 +1199,60 @@ zap_increment_int(objset_t *os, uint64_t obj, uint64_t key, int64_t delta,
  * Routines for iterating over the attributes.
  */
 
+/*
+ * Prefetch the leaf blocks which follow the cursor's current leaf in hash
+ * order, by walking forward through the pointer table.  zc_prefetch_hash
+ * records how far ahead prefetches have been issued, and more are issued
+ * only once the cursor is within half a window of that point.  The size of
+ * the window in pointer table entries is estimated from the number of
+ * leaves, since a leaf occupies 2^(zt_shift - lh_prefix_len) entries.
+ */
+static void
+zap_cursor_prefetch_leaves(zap_t *zap, zap_cursor_t *zc)
+{
+	zap_leaf_phys_t *lp = zap_leaf_phys(zc->zc_leaf);
+	int shift = zap_f_phys(zap)->zap_ptrtbl.zt_shift;
+	int bs = FZAP_BLOCK_SHIFT(zap);
+	uint64_t nleafs = MAX(zap_f_phys(zap)->zap_num_leafs, 1);
+	uint64_t nidx, window, start, end, idx, blk, lastblk;
+	int n;
+
+	if (zap_iterate_prefetch_leaves <= 0 || shift == 0 ||
+	    zc->zc_prefetch_hash == -1ULL ||
+	    lp->l_hdr.lh_prefix_len > shift)
+		return;
+
+	nidx = 1ULL << shift;
+	window = MAX(zap_iterate_prefetch_leaves * (nidx / nleafs),
+	    zap_iterate_prefetch_leaves);
+
+	start = (lp->l_hdr.lh_prefix + 1) <<
+	    (shift - lp->l_hdr.lh_prefix_len);
+	idx = ZAP_HASH_IDX(zc->zc_prefetch_hash, shift);
+	if (idx > start) {
+		if (idx - start > window / 2)
+			return;
+		start = idx;
+	}
+
+	end = MIN(nidx, start + 4 * window);
+	lastblk = 0;
+	n = 0;
+	for (idx = start; idx < end && n < zap_iterate_prefetch_leaves;
+	    idx++) {
+		if (zap_idx_to_blk(zap, idx, &blk) != 0)
+			break;
+		if (blk == lastblk)
+			continue;
+		dmu_prefetch(zap->zap_objset, zap->zap_object, 0, blk << bs,
+		    1 << bs, ZIO_PRIORITY_ASYNC_READ);
+		lastblk = blk;
+		n++;
+	}
+
+	zc->zc_prefetch_hash = (idx >= nidx) ? -1ULL : idx << (64 - shift);
+}
+
 int
 fzap_cursor_retrieve(zap_t *zap, zap_cursor_t *zc, zap_attribute_t *za)
 {
@@ -1228,6 +1292,9 @@ again:
 		    &zc->zc_leaf);
 		if (err != 0)
 			return (err);
+		if (zap_iterate_prefetch && zc->zc_prefetch &&
+		    zap_f_phys(zap)->zap_freeblk > 2)
+			zap_cursor_prefetch_leaves(zap, zc);
 	} else {
 		rw_enter(&zc->zc_leaf->l_rwlock, RW_READER);
 	}
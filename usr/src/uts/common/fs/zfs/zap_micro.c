@@ -25,6 +25,7 @@
  * Copyright (c) 2014 Spectra Logic Corporation, All rights reserved.
  * Copyright (c) 2014 Integros [integros.com]
  * Copyright 2017 Nexenta Systems, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/zio.h>
@@ -1394,6 +1395,7 @@ zap_cursor_init_impl(zap_cursor_t *zc, objset_t *os, uint64_t zapobj,
 	zc->zc_hash = 0;
 	zc->zc_cd = 0;
 	zc->zc_prefetch = prefetch;
+	zc->zc_prefetch_hash = 0;
 }
 void
 zap_cursor_init_serialized(zap_cursor_t *zc, objset_t *os, uint64_t zapobj,
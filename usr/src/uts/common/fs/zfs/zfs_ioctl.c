@@ -28,7 +28,7 @@
  * Portions Copyright 2011 Martin Matuska
  * Copyright 2015, OmniTI Computer Consulting, Inc. All rights reserved.
  * Copyright 2018 Nexenta Systems, Inc.  All rights reserved.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2011, 2017 by Delphix. All rights reserved.
  * Copyright (c) 2013 by Saso Kiselkov. All rights reserved.
  * Copyright (c) 2013 Steven Hartland. All rights reserved.
@@ -2064,6 +2064,7 @@ zfs_ioc_vdev_attach(zfs_cmd_t *zc)
 {
 	spa_t *spa;
 	int replacing = zc->zc_cookie;
+	boolean_t rebuild = zc->zc_simple;
 	nvlist_t *config;
 	int error;
 
@@ -2072,7 +2073,8 @@ zfs_ioc_vdev_attach(zfs_cmd_t *zc)
 
 	if ((error = get_nvlist(zc->zc_nvlist_conf, zc->zc_nvlist_conf_size,
 	    zc->zc_iflags, &config)) == 0) {
-		error = spa_vdev_attach(spa, zc->zc_guid, config, replacing);
+		error = spa_vdev_attach(spa, zc->zc_guid, config, replacing,
+		    rebuild);
 		nvlist_free(config);
 	}
 
@@ -2164,6 +2166,43 @@ zfs_ioc_vdev_setfru(zfs_cmd_t *zc)
 	return (error);
 }
 
+/*
+ * Gather the property nvlist for an objset whose stats have already been
+ * filled in by dmu_objset_fast_stat().
+ */
+static int
+zfs_objset_props(objset_t *os, dmu_objset_stats_t *stat,
+    boolean_t cachedpropsonly, nvlist_t **nvp)
+{
+	int error;
+	nvlist_t *nv;
+
+	if ((error = dsl_prop_get_all(os, &nv)) != 0)
+		return (error);
+
+	dmu_objset_stats(os, nv);
+	/*
+	 * NB: zvol_get_stats() will read the objset contents,
+	 * which we aren't supposed to do with a
+	 * DS_MODE_USER hold, because it could be
+	 * inconsistent.  So this is a bit of a workaround...
+	 * XXX reading with out owning
+	 */
+	if (!stat->dds_inconsistent &&
+	    dmu_objset_type(os) == DMU_OST_ZVOL &&
+	    !cachedpropsonly) {
+		error = zvol_get_stats(os, nv);
+		if (error == EIO) {
+			nvlist_free(nv);
+			return (error);
+		}
+		VERIFY0(error);
+	}
+
+	*nvp = nv;
+	return (0);
+}
+
 static int
 zfs_ioc_objset_stats_impl(zfs_cmd_t *zc, objset_t *os,
     boolean_t cachedpropsonly)
@@ -2174,23 +2213,8 @@ zfs_ioc_objset_stats_impl(zfs_cmd_t *zc, objset_t *os,
 	dmu_objset_fast_stat(os, &zc->zc_objset_stats);
 
 	if (zc->zc_nvlist_dst != 0 &&
-	    (error = dsl_prop_get_all(os, &nv)) == 0) {
-		dmu_objset_stats(os, nv);
-		/*
-		 * NB: zvol_get_stats() will read the objset contents,
-		 * which we aren't supposed to do with a
-		 * DS_MODE_USER hold, because it could be
-		 * inconsistent.  So this is a bit of a workaround...
-		 * XXX reading with out owning
-		 */
-		if (!zc->zc_objset_stats.dds_inconsistent &&
-		    dmu_objset_type(os) == DMU_OST_ZVOL &&
-		    !cachedpropsonly) {
-			error = zvol_get_stats(os, nv);
-			if (error == EIO)
-				return (error);
-			VERIFY0(error);
-		}
+	    (error = zfs_objset_props(os, &zc->zc_objset_stats,
+	    cachedpropsonly, &nv)) == 0) {
 		error = put_nvlist(zc, nv);
 		nvlist_free(nv);
 	}
@@ -2407,17 +2431,129 @@ top:
 	return (error);
 }
 
+/*
+ * The most snapshots returned by a single batched ZFS_IOC_SNAPSHOT_LIST_NEXT.
+ */
+uint64_t zfs_snapshot_list_batch_max = 1024;
+
+/*
+ * Return the stats and properties of up to 'batch' snapshots of 'os' in a
+ * single nvlist:
+ *
+ *	"snapshots" -> {
+ *		<snapshot name> -> {
+ *			"stats" -> uint8 array (dmu_objset_stats_t)
+ *			"props" -> property nvlist
+ *		}
+ *		...
+ *	}
+ *
+ * We stop early rather than overflow the caller's buffer, and leave zc_cookie
+ * positioned at the first snapshot not returned.  zc_name holds the dataset
+ * name followed by '@' on entry.
+ */
+static int
+zfs_ioc_snapshot_list_batch(zfs_cmd_t *zc, objset_t *os, uint64_t batch,
+    boolean_t cachedpropsonly)
+{
+	dsl_pool_t *dp = os->os_dsl_dataset->ds_dir->dd_pool;
+	size_t baselen = strlen(zc->zc_name);
+	nvlist_t *snaps, *outnvl;
+	uint64_t cookie;
+	uint64_t n = 0;
+	size_t size = 0;
+	int error = 0;
+
+	batch = MIN(batch, zfs_snapshot_list_batch_max);
+	snaps = fnvlist_alloc();
+
+	while (n < batch) {
+		dmu_objset_stats_t stat;
+		dsl_dataset_t *ds;
+		objset_t *ossnap;
+		nvlist_t *props, *entry;
+
+		cookie = zc->zc_cookie;
+		zc->zc_name[baselen] = '\0';
+		error = dmu_snapshot_list_next(os,
+		    sizeof (zc->zc_name) - baselen, zc->zc_name + baselen,
+		    &zc->zc_obj, &zc->zc_cookie, NULL);
+		if (error != 0)
+			break;
+
+		if ((error = dsl_dataset_hold_obj(dp, zc->zc_obj, FTAG,
+		    &ds)) != 0) {
+			zc->zc_cookie = cookie;
+			break;
+		}
+		if ((error = dmu_objset_from_ds(ds, &ossnap)) == 0) {
+			dmu_objset_fast_stat(ossnap, &stat);
+			error = zfs_objset_props(ossnap, &stat,
+			    cachedpropsonly, &props);
+		}
+		dsl_dataset_rele(ds, FTAG);
+		if (error != 0) {
+			zc->zc_cookie = cookie;
+			break;
+		}
+
+		entry = fnvlist_alloc();
+		fnvlist_add_uint8_array(entry, "stats", (uint8_t *)&stat,
+		    sizeof (stat));
+		fnvlist_add_nvlist(entry, "props", props);
+		nvlist_free(props);
+
+		/*
+		 * Keep a running estimate of the packed size, so that we don't
+		 * have to repack the whole list for every snapshot.  If the
+		 * estimate is low, put_nvlist() fails with ENOMEM and the
+		 * caller retries with a larger buffer from the same cookie.
+		 */
+		size += fnvlist_size(entry) + strlen(zc->zc_name) + 64;
+		if (n != 0 && size > zc->zc_nvlist_dst_size) {
+			/* leave this one for the next call */
+			nvlist_free(entry);
+			zc->zc_cookie = cookie;
+			break;
+		}
+
+		fnvlist_add_nvlist(snaps, zc->zc_name, entry);
+		nvlist_free(entry);
+		n++;
+	}
+
+	/*
+	 * Errors after the first snapshot are reported by the next call,
+	 * which starts from the snapshot that failed.
+	 */
+	if (n != 0) {
+		outnvl = fnvlist_alloc();
+		fnvlist_add_nvlist(outnvl, "snapshots", snaps);
+		error = put_nvlist(zc, outnvl);
+		nvlist_free(outnvl);
+	} else if (error == ENOENT) {
+		error = SET_ERROR(ESRCH);
+	}
+	nvlist_free(snaps);
+
+	return (error);
+}
+
 /*
  * inputs:
  * zc_name		name of filesystem
  * zc_cookie		zap cursor
+ * zc_nvlist_src	optional options nvlist:
+ *			"cachedpropsonly": don't read zvol contents
+ *			"batch": return up to this many snapshots (uint64)
  * zc_nvlist_dst_size	size of buffer for property nvlist
  * zc_simple		when set, only name is requested
  *
  * outputs:
  * zc_name		name of next snapshot
  * zc_objset_stats	stats
- * zc_nvlist_dst	property nvlist
+ * zc_nvlist_dst	property nvlist, or when batching, the nvlist
+ *			described in zfs_ioc_snapshot_list_batch()
  * zc_nvlist_dst_size	size of property nvlist
  */
 static int
@@ -2426,6 +2562,7 @@ zfs_ioc_snapshot_list_next(zfs_cmd_t *zc)
 	objset_t *os;
 	nvlist_t *nvl = NULL;
 	boolean_t cachedpropsonly = B_FALSE;
+	uint64_t batch = 0;
 	int error;
 
 	if (zc->zc_nvlist_src != (uintptr_t)NULL &&
@@ -2436,6 +2573,7 @@ zfs_ioc_snapshot_list_next(zfs_cmd_t *zc)
 	if (nvl != NULL) {
 		(void) nvlist_lookup_boolean_value(nvl, "cachedpropsonly",
 		    &cachedpropsonly);
+		(void) nvlist_lookup_uint64(nvl, "batch", &batch);
 		nvlist_free(nvl);
 	}
 
@@ -2454,6 +2592,15 @@ zfs_ioc_snapshot_list_next(zfs_cmd_t *zc)
 		return (SET_ERROR(ESRCH));
 	}
 
+	if (batch != 0 && !zc->zc_simple && zc->zc_nvlist_dst != 0) {
+		error = zfs_ioc_snapshot_list_batch(zc, os, batch,
+		    cachedpropsonly);
+		dmu_objset_rele(os, FTAG);
+		if (error != 0)
+			*strchr(zc->zc_name, '@') = '\0';
+		return (error);
+	}
+
 	error = dmu_snapshot_list_next(os,
 	    sizeof (zc->zc_name) - strlen(zc->zc_name),
 	    zc->zc_name + strlen(zc->zc_name), &zc->zc_obj, &zc->zc_cookie,
@@ -4359,6 +4506,21 @@ zfs_check_settable(const char *dsname, nvpair_t *pair, cred_t *cr)
 				spa_close(spa, FTAG);
 			}
 
+			if (intval >= ZIO_COMPRESS_ZSTD_1 &&
+			    intval < ZIO_COMPRESS_FUNCTIONS) {
+				spa_t *spa;
+
+				if ((err = spa_open(dsname, &spa, FTAG)) != 0)
+					return (err);
+
+				if (!spa_feature_is_enabled(spa,
+				    SPA_FEATURE_ZSTD_COMPRESS)) {
+					spa_close(spa, FTAG);
+					return (SET_ERROR(ENOTSUP));
+				}
+				spa_close(spa, FTAG);
+			}
+
 			/*
 			 * If this is a bootable dataset then
 			 * verify that the compression algorithm
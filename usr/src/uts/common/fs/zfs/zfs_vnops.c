@@ -40,6 +40,7 @@
 #include <sys/vfs_opreg.h>
 #include <sys/vnode.h>
 #include <sys/file.h>
+#include <sys/fcntl.h>
 #include <sys/stat.h>
 #include <sys/kmem.h>
 #include <sys/taskq.h>
@@ -349,6 +350,11 @@ zfs_ioctl_setxattr(vnode_t *vp, intptr_t data, int flags, cred_t *cr,
 	return (zfs_setattr(vp, (vattr_t *)&xva, flags, cr, ct));
 }
 
+/*
+ * The most a single POSIX_FADV_WILLNEED will prefetch.
+ */
+offset_t zfs_fadvise_prefetch_max = 64 * 1024 * 1024; /* Tunable */
+
 /* ARGSUSED */
 static int
 zfs_ioctl(vnode_t *vp, int com, intptr_t data, int flag, cred_t *cred,
@@ -380,15 +386,18 @@ zfs_ioctl(vnode_t *vp, int com, intptr_t data, int flag, cred_t *cred,
 	case _FIODIRECTIO:
 	{
 		/*
-		 * ZFS inherently provides the basic semantics for directio.
-		 * This is the summary from the ZFS on Linux support for
-		 * O_DIRECT, which is the common form of directio, and required
-		 * no changes to ZFS.
+		 * This is the summary of the directio semantics, following
+		 * the ZFS on Linux support for O_DIRECT, which is the common
+		 * form of directio.
 		 *
 		 * 1. Minimize cache effects of the I/O.
 		 *
-		 *    By design the ARC is already scan-resistant, which helps
-		 *    mitigate the need for special O_DIRECT handling.
+		 *    While directio is enabled on a file (and the dataset's
+		 *    "direct" property is "standard"), I/O to it bypasses the
+		 *    ARC; see zfs_direct_io().  Block-aligned reads of blocks
+		 *    the DMU does not already hold are issued straight to the
+		 *    vdevs; other reads and all writes go through the dbufs,
+		 *    which are then evicted rather than cached.
 		 *
 		 * 2. O_DIRECT _MAY_ impose restrictions on IO alignment and
 		 *    length.
@@ -402,7 +411,8 @@ zfs_ioctl(vnode_t *vp, int com, intptr_t data, int flag, cred_t *cred,
 		 *    No unbuffered IO operations are currently supported. In
 		 *    order to support features such as compression, encryption,
 		 *    and checksumming a copy must be made to transform the
-		 *    data.
+		 *    data, though direct reads copy from a private buffer
+		 *    rather than from the ARC.
 		 *
 		 * 4. O_DIRECT _MAY_ imply O_DSYNC (XFS).
 		 *
@@ -414,6 +424,15 @@ zfs_ioctl(vnode_t *vp, int com, intptr_t data, int flag, cred_t *cred,
 		 *    All I/O in ZFS is locked for correctness and this locking
 		 *    is not disabled by O_DIRECT.
 		 */
+		if (data != DIRECTIO_ON && data != DIRECTIO_OFF)
+			return (SET_ERROR(EINVAL));
+
+		zp = VTOZ(vp);
+		zfsvfs = zp->z_zfsvfs;
+		ZFS_ENTER(zfsvfs);
+		ZFS_VERIFY_ZP(zp);
+		zp->z_directio = (data == DIRECTIO_ON);
+		ZFS_EXIT(zfsvfs);
 		return (0);
 	}
 
@@ -437,6 +456,50 @@ zfs_ioctl(vnode_t *vp, int com, intptr_t data, int flag, cred_t *cred,
 			return (SET_ERROR(EFAULT));
 		return (0);
 	}
+	case _FIO_ADVISE:
+	{
+		fio_advise_t fa;
+
+		if (ddi_copyin((void *)data, &fa, sizeof (fa), flag))
+			return (SET_ERROR(EFAULT));
+		if (fa.fa_offset < 0 || fa.fa_len < 0)
+			return (SET_ERROR(EINVAL));
+
+		zp = VTOZ(vp);
+		zfsvfs = zp->z_zfsvfs;
+		ZFS_ENTER(zfsvfs);
+		ZFS_VERIFY_ZP(zp);
+
+		switch (fa.fa_advice) {
+		case POSIX_FADV_NORMAL:
+		case POSIX_FADV_SEQUENTIAL:
+		case POSIX_FADV_RANDOM:
+			/*
+			 * The prefetcher already detects sequential streams;
+			 * a random access hint just keeps it from trying.
+			 */
+			zp->z_fadvise = (uint8_t)fa.fa_advice;
+			break;
+		case POSIX_FADV_WILLNEED:
+			/*
+			 * Start reading the range into the ARC without waiting
+			 * for it, bounded by zfs_fadvise_prefetch_max.
+			 */
+			if (fa.fa_offset >= zp->z_size)
+				break;
+			if (fa.fa_len == 0 ||
+			    fa.fa_len > zp->z_size - fa.fa_offset)
+				fa.fa_len = zp->z_size - fa.fa_offset;
+			dmu_prefetch(zfsvfs->z_os, zp->z_id, 0, fa.fa_offset,
+			    MIN(fa.fa_len, zfs_fadvise_prefetch_max),
+			    ZIO_PRIORITY_ASYNC_READ);
+			break;
+		default:
+			break;
+		}
+		ZFS_EXIT(zfsvfs);
+		return (0);
+	}
 	case _FIO_COUNT_FILLED:
 	{
 		/*
@@ -585,6 +648,47 @@ mappedread(vnode_t *vp, int nbytes, uio_t *uio)
 
 offset_t zfs_read_chunk_size = 1024 * 1024; /* Tunable */
 
+/*
+ * Should I/O to this file bypass the ARC?  The dataset's "direct" property
+ * can force this on or off; by default we follow the file's directio(3C)
+ * advice.
+ */
+static boolean_t
+zfs_direct_io(znode_t *zp)
+{
+	switch (zp->z_zfsvfs->z_os->os_direct) {
+	case ZFS_DIRECT_ALWAYS:
+		return (B_TRUE);
+	case ZFS_DIRECT_DISABLED:
+		return (B_FALSE);
+	default:
+		return (zp->z_directio != 0);
+	}
+}
+
+/*
+ * DMU flags for reading nbytes at the uio's offset.  Direct reads must
+ * cover whole blocks; an unaligned read under directio still keeps its
+ * dbufs out of the dbuf cache, but the blocks are left in the ARC since
+ * the rest of them is likely to be read next.
+ */
+static uint32_t
+zfs_read_flags(znode_t *zp, uio_t *uio, ssize_t nbytes)
+{
+	uint64_t blksz = zp->z_blksz;
+
+	if (!zfs_direct_io(zp)) {
+		return (zp->z_fadvise == POSIX_FADV_RANDOM ?
+		    DMU_READ_NO_PREFETCH : DMU_READ_PREFETCH);
+	}
+
+	if (uio->uio_loffset % blksz == 0 && (nbytes % blksz == 0 ||
+	    uio->uio_loffset + nbytes == zp->z_size))
+		return (DMU_DIRECTIO);
+
+	return (DMU_READ_NO_CACHE);
+}
+
 /*
  * Read bytes from specified file into supplied buffer.
  *
@@ -718,8 +822,8 @@ zfs_read(vnode_t *vp, uio_t *uio, int ioflag, cred_t *cr, caller_context_t *ct)
 		if (vn_has_cached_data(vp)) {
 			error = mappedread(vp, nbytes, uio);
 		} else {
-			error = dmu_read_uio_dbuf(sa_get_db(zp->z_sa_hdl),
-			    uio, nbytes);
+			error = dmu_read_uio_dbuf_flags(sa_get_db(zp->z_sa_hdl),
+			    uio, nbytes, zfs_read_flags(zp, uio, nbytes));
 		}
 		if (error) {
 			/* convert checksum errors into IO errors */
@@ -782,6 +886,7 @@ zfs_write(vnode_t *vp, uio_t *uio, int ioflag, cred_t *cr, caller_context_t *ct)
 	iovec_t		*iovp = uio->uio_iov;
 	int		write_eof;
 	int		count = 0;
+	boolean_t	direct;
 	sa_bulk_attr_t	bulk[4];
 	uint64_t	mtime[2], ctime[2];
 
@@ -839,6 +944,7 @@ zfs_write(vnode_t *vp, uio_t *uio, int ioflag, cred_t *cr, caller_context_t *ct)
 	}
 
 	zilog = zfsvfs->z_log;
+	direct = zfs_direct_io(zp);
 
 	/*
 	 * Validate file offset
@@ -933,7 +1039,7 @@ zfs_write(vnode_t *vp, uio_t *uio, int ioflag, cred_t *cr, caller_context_t *ct)
 			    ((char *)aiov->iov_base - (char *)abuf->b_data +
 			    aiov->iov_len == arc_buf_size(abuf)));
 			i_iov++;
-		} else if (n >= max_blksz && woff >= zp->z_size &&
+		} else if (!direct && n >= max_blksz && woff >= zp->z_size &&
 		    P2PHASE(woff, max_blksz) == 0 &&
 		    zp->z_blksz == max_blksz) {
 			/*
@@ -1005,8 +1111,9 @@ zfs_write(vnode_t *vp, uio_t *uio, int ioflag, cred_t *cr, caller_context_t *ct)
 
 		if (abuf == NULL) {
 			tx_bytes = uio->uio_resid;
-			error = dmu_write_uio_dbuf(sa_get_db(zp->z_sa_hdl),
-			    uio, nbytes, tx);
+			error = dmu_write_uio_dbuf_flags(
+			    sa_get_db(zp->z_sa_hdl), uio, nbytes, tx,
+			    direct ? DMU_DIRECTIO : 0);
 			tx_bytes -= uio->uio_resid;
 		} else {
 			tx_bytes = nbytes;
@@ -2339,6 +2446,7 @@ zfs_readdir(vnode_t *vp, uio_t *uio, cred_t *cr, int *eofp,
 	int		error;
 	uint8_t		prefetch;
 	boolean_t	check_sysattrs;
+	boolean_t	edirent;
 
 	ZFS_ENTER(zfsvfs);
 	ZFS_VERIFY_ZP(zp);
@@ -2418,6 +2526,13 @@ zfs_readdir(vnode_t *vp, uio_t *uio, cred_t *cr, int *eofp,
 	    (vp->v_flag & V_XATTRDIR) && zfsvfs->z_norm &&
 	    (flags & V_RDDIR_ENTFLAGS);
 
+	/*
+	 * Extended entries are returned for either entry flags or entry
+	 * types.  The type comes for free from the directory entry itself and
+	 * saves consumers such as the lx brand's getdents a lookup per entry.
+	 */
+	edirent = (flags & (V_RDDIR_ENTFLAGS | V_RDDIR_DTYPE)) != 0;
+
 	/*
 	 * Transform to file-system independent format
 	 */
@@ -2426,6 +2541,7 @@ zfs_readdir(vnode_t *vp, uio_t *uio, cred_t *cr, int *eofp,
 		ino64_t objnum;
 		ushort_t reclen;
 		off64_t *next = NULL;
+		uint8_t dtype = IFTODT(S_IFDIR);
 
 		/*
 		 * Special case `.', `..', and `.zfs'.
@@ -2464,10 +2580,7 @@ zfs_readdir(vnode_t *vp, uio_t *uio, cred_t *cr, int *eofp,
 			}
 
 			objnum = ZFS_DIRENT_OBJ(zap.za_first_integer);
-			/*
-			 * MacOS X can extract the object type here such as:
-			 * uint8_t type = ZFS_DIRENT_TYPE(zap.za_first_integer);
-			 */
+			dtype = ZFS_DIRENT_TYPE(zap.za_first_integer);
 
 			if (check_sysattrs && !zap.za_normalization_conflict) {
 				zap.za_normalization_conflict =
@@ -2490,7 +2603,7 @@ zfs_readdir(vnode_t *vp, uio_t *uio, cred_t *cr, int *eofp,
 			VN_RELE(ZTOV(ezp));
 		}
 
-		if (flags & V_RDDIR_ENTFLAGS)
+		if (edirent)
 			reclen = EDIRENT_RECLEN(strlen(zap.za_name));
 		else
 			reclen = DIRENT64_RECLEN(strlen(zap.za_name));
@@ -2508,7 +2621,7 @@ zfs_readdir(vnode_t *vp, uio_t *uio, cred_t *cr, int *eofp,
 			}
 			break;
 		}
-		if (flags & V_RDDIR_ENTFLAGS) {
+		if (edirent) {
 			/*
 			 * Add extended flag entry:
 			 */
@@ -2516,8 +2629,12 @@ zfs_readdir(vnode_t *vp, uio_t *uio, cred_t *cr, int *eofp,
 			eodp->ed_reclen = reclen;
 			/* NOTE: ed_off is the offset for the *next* entry */
 			next = &(eodp->ed_off);
-			eodp->ed_eflags = zap.za_normalization_conflict ?
-			    ED_CASE_CONFLICT : 0;
+			eodp->ed_eflags = 0;
+			if ((flags & V_RDDIR_ENTFLAGS) &&
+			    zap.za_normalization_conflict)
+				eodp->ed_eflags |= ED_CASE_CONFLICT;
+			if (flags & V_RDDIR_DTYPE)
+				eodp->ed_eflags |= (dtype & ED_DTYPE_MASK);
 			(void) strncpy(eodp->ed_name, zap.za_name,
 			    EDIRENT_NAMELEN(reclen));
 			eodp = (edirent_t *)((intptr_t)eodp + reclen);
@@ -5144,6 +5261,14 @@ zfs_addmap(vnode_t *vp, offset_t off, struct as *as, caddr_t addr,
 	uint64_t pages = btopr(len);
 
 	atomic_add_64(&VTOZ(vp)->z_mapcnt, pages);
+
+	/*
+	 * Our vnodes are VNOPGSCAN: pages only become modified through shared
+	 * writable mappings, so tell fsflush about them.
+	 */
+	if ((flags & MAP_PRIVATE) == 0 && (maxprot & PROT_WRITE) != 0)
+		fsflush_vnode_add(vp);
+
 	return (0);
 }
 
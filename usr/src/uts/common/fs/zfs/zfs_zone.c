@@ -10,7 +10,7 @@
  */
 
 /*
- * Copyright 2018, Joyent, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -140,6 +140,18 @@ zfs_zone_txg_delay()
 	return (MSEC2NSEC(10));
 }
 
+/*ARGSUSED*/
+void
+zfs_zone_dirty_space(uint64_t space)
+{
+}
+
+boolean_t
+zfs_zone_dirty_exempt(void)
+{
+	return (B_FALSE);
+}
+
 #else
 
 /*
@@ -253,6 +265,9 @@ typedef struct {
 	uint_t zi_diskutil;
 	boolean_t zi_underutil;
 	boolean_t zi_overutil;
+	uint64_t zi_totdirty;
+	int zi_ndirty;
+	int zi_ndirty_above;
 } zoneio_stats_t;
 
 static sys_lat_cycle_t	rd_lat;
@@ -316,6 +331,50 @@ uint32_t	zfs_zone_schedule_thresh = 10;
 int		zfs_zone_txg_throttle_scale = 2;
 hrtime_t	zfs_zone_txg_delay_nsec = MSEC2NSEC(20);
 
+/*
+ * Write throttle fairness.
+ *
+ * Each zone's dirty data is counted as it is charged to a pool (see
+ * dsl_pool_dirty_space()), and on each zfs_zone_adjust_time interval a
+ * non-global zone which dirtied more than zfs_zone_dirty_hog_pct percent of
+ * the average for zones which dirtied anything is marked as exceeding its
+ * share.  While any zone is so marked, the other zones are exempt from the
+ * dirty data delay in dmu_tx_delay() (though not from the hard limit at
+ * zfs_dirty_data_max), so that one zone's bulk writes do not hold up every
+ * other zone's small ones.
+ */
+boolean_t	zfs_zone_dirty_fair_enable = B_TRUE;
+uint_t		zfs_zone_dirty_hog_pct = 200;
+static int	zfs_zone_dirty_hogs;	/* zones over their share */
+
+/*
+ * Latency-target QoS.
+ *
+ * When zfs_zone_qos_enable is set, the synchronous queues are no longer
+ * scheduled by the priority/weight heuristic in get_next_zio.  Instead each
+ * zone with queued I/O is served by deficit round robin (DRR): in each round
+ * a zone is credited a quantum of zfs_zone_qos_quantum bytes scaled by its
+ * zone.zfs-io-priority, and may issue I/O until the credit is used up.  A
+ * zone which is missing its zone.zfs-io-latency-target (measured as the
+ * decayed average time its sync I/Os wait in the vdev queue), or which is
+ * below its zone.zfs-io-iops-floor or zone.zfs-io-bandwidth-floor over the
+ * last zfs_zone_qos_window, has its quantum multiplied by zfs_zone_qos_boost
+ * until it catches up.  Zones with a target or floor configured are also
+ * exempt from the averaged delay throttle in zfs_zone_io_throttle.
+ *
+ * Per-zone queue time histograms are kept in all modes and are exported in
+ * the zone_zfs kstat.
+ */
+boolean_t	zfs_zone_qos_enable = B_FALSE;
+uint_t		zfs_zone_qos_quantum = 128 * 1024;	/* bytes */
+uint_t		zfs_zone_qos_boost = 4;
+uint_t		zfs_zone_qos_window = 1000000;		/* 1 s */
+
+#define	ZFS_ZONE_QOS_RESERVED(iop)	\
+	((iop)->zpers_qos_lat_target != 0 || \
+	(iop)->zpers_qos_iops_floor != 0 || \
+	(iop)->zpers_qos_bw_floor != 0)
+
 typedef struct {
 	int		zq_qdepth;
 	zio_priority_t	zq_queue;
@@ -324,6 +383,18 @@ typedef struct {
 	zoneid_t	zq_zoneid;
 } zone_q_bump_t;
 
+typedef struct {
+	zio_priority_t	zd_queue;
+	hrtime_t	zd_unow;
+	boolean_t	zd_refill;	/* start a new DRR round */
+	boolean_t	zd_stay;	/* last zone still has credit */
+	zoneid_t	zd_last;	/* zone last served from this queue */
+	zoneid_t	zd_next;	/* next zone after zd_last */
+	zoneid_t	zd_first;	/* lowest zone ID with credit */
+	zoneid_t	zd_best;	/* zone with the most credit */
+	int64_t		zd_best_deficit;
+} zone_q_drr_t;
+
 /*
  * This uses gethrtime() but returns a value in usecs.
  */
@@ -672,6 +743,11 @@ zfs_zone_wait_adjust_calculate_cb(zone_t *zonep, void *arg)
 		sp->zi_totpri += iop->zpers_zfs_io_pri;
 	}
 
+	if (iop->zpers_dirty_bytes > 0) {
+		sp->zi_totdirty += iop->zpers_dirty_bytes;
+		sp->zi_ndirty++;
+	}
+
 	/*
 	 * sdt:::zfs-zone-utilization
 	 *
@@ -728,6 +804,19 @@ zfs_zone_wait_adjust_delay_cb(zone_t *zonep, void *arg)
 	delay = iop->zpers_io_delay;
 	iop->zpers_io_util_above_avg = 0;
 
+	/*
+	 * Compare the data this zone dirtied over the period with the average
+	 * for all zones dirtying data, and start a new period.
+	 */
+	iop->zpers_dirty_above_fair = 0;
+	if (zonep->zone_id != GLOBAL_ZONEID && sp->zi_ndirty > 1 &&
+	    iop->zpers_dirty_bytes * 100 >
+	    (sp->zi_totdirty / sp->zi_ndirty) * zfs_zone_dirty_hog_pct) {
+		iop->zpers_dirty_above_fair = 1;
+		sp->zi_ndirty_above++;
+	}
+	iop->zpers_dirty_bytes = 0;
+
 	/*
 	 * Given the calculated total utilitzation for all zones, calculate the
 	 * fair share of I/O for this zone.
@@ -841,6 +930,7 @@ zfs_zone_wait_adjust(hrtime_t unow, hrtime_t last_checked)
 	    uintptr_t, stats.zi_diskutil);
 
 	(void) zone_walk(zfs_zone_wait_adjust_delay_cb, &stats);
+	zfs_zone_dirty_hogs = stats.zi_ndirty_above;
 }
 
 /*
@@ -982,6 +1072,214 @@ get_next_zio(vdev_queue_class_t *vqc, int qdepth, zio_priority_t p,
 	return (zp);
 }
 
+/*
+ * Is this zone missing its QoS latency target or below one of its floors?
+ * Called with the zone's zpers_zfs_lock held.
+ */
+static boolean_t
+zfs_zone_qos_behind(zone_zfs_io_t *iop, hrtime_t unow)
+{
+	hrtime_t elapsed;
+
+	if (iop->zpers_qos_lat_target != 0 &&
+	    iop->zpers_qos_qtime_avg > iop->zpers_qos_lat_target)
+		return (B_TRUE);
+
+	elapsed = MIN(unow - iop->zpers_qos_win_start, zfs_zone_qos_window);
+	if (elapsed <= 0)
+		return (B_FALSE);
+
+	if (iop->zpers_qos_iops_floor != 0 &&
+	    iop->zpers_qos_win_ops * MICROSEC / elapsed <
+	    iop->zpers_qos_iops_floor)
+		return (B_TRUE);
+
+	if (iop->zpers_qos_bw_floor != 0 &&
+	    iop->zpers_qos_win_bytes * MICROSEC / elapsed <
+	    iop->zpers_qos_bw_floor)
+		return (B_TRUE);
+
+	return (B_FALSE);
+}
+
+/*
+ * Callback used to pick the zone to serve next under deficit round robin.
+ *
+ * Zones with a positive deficit on this queue have credit left in the
+ * current round.  We keep serving the zone we last served while it has
+ * credit, otherwise we move on to the next zone (in zone ID order) which
+ * has credit.  When no zone has credit left, the caller starts a new round
+ * by walking the zones again with zd_refill set.
+ */
+static int
+get_drr_zone_cb(zone_t *zonep, void *arg)
+{
+	zone_q_drr_t *qdp = arg;
+	zio_priority_t p = qdp->zd_queue;
+	zoneid_t zid = zonep->zone_id;
+	zone_persist_t *zpd = &zone_pdata[zid];
+	zone_zfs_io_t *iop;
+	int64_t deficit;
+
+	mutex_enter(&zpd->zpers_zfs_lock);
+	iop = zpd->zpers_zfsp;
+	if (iop == NULL) {
+		mutex_exit(&zpd->zpers_zfs_lock);
+		return (0);
+	}
+
+	/* An idle zone forfeits any credit left over, but not its debt. */
+	if (iop->zpers_zfs_queued[p] == 0) {
+		if (iop->zpers_qos_deficit[p] > 0)
+			iop->zpers_qos_deficit[p] = 0;
+		mutex_exit(&zpd->zpers_zfs_lock);
+		return (0);
+	}
+
+	if (qdp->zd_refill) {
+		int64_t quantum = (int64_t)zfs_zone_qos_quantum *
+		    MAX(iop->zpers_zfs_io_pri, 1);
+
+		if (zfs_zone_qos_behind(iop, qdp->zd_unow))
+			quantum *= zfs_zone_qos_boost;
+		iop->zpers_qos_deficit[p] += quantum;
+	}
+	deficit = iop->zpers_qos_deficit[p];
+	mutex_exit(&zpd->zpers_zfs_lock);
+
+	if (qdp->zd_best == ALL_ZONES || deficit > qdp->zd_best_deficit) {
+		qdp->zd_best = zid;
+		qdp->zd_best_deficit = deficit;
+	}
+
+	if (deficit <= 0)
+		return (0);
+
+	if (zid == qdp->zd_last)
+		qdp->zd_stay = B_TRUE;
+	if (qdp->zd_first == ALL_ZONES || zid < qdp->zd_first)
+		qdp->zd_first = zid;
+	if (zid > qdp->zd_last &&
+	    (qdp->zd_next == ALL_ZONES || zid < qdp->zd_next))
+		qdp->zd_next = zid;
+
+	return (0);
+}
+
+static zoneid_t
+get_drr_zone(zone_q_drr_t *qdp)
+{
+	qdp->zd_stay = B_FALSE;
+	qdp->zd_next = ALL_ZONES;
+	qdp->zd_first = ALL_ZONES;
+	qdp->zd_best = ALL_ZONES;
+	qdp->zd_best_deficit = 0;
+	(void) zone_walk(get_drr_zone_cb, qdp);
+
+	if (qdp->zd_stay)
+		return (qdp->zd_last);
+	if (qdp->zd_next != ALL_ZONES)
+		return (qdp->zd_next);
+	return (qdp->zd_first);
+}
+
+/*
+ * Pick the next zio from one of the sync queues using deficit round robin
+ * across zones (see the comment above zfs_zone_qos_enable).  The zone whose
+ * zio is issued is charged its size.
+ */
+static zio_t *
+get_next_zio_drr(vdev_queue_t *vq, zio_priority_t p, avl_tree_t *tree)
+{
+	zone_q_drr_t qdrr;
+	zone_persist_t *zpd;
+	zone_zfs_io_t *iop;
+	zio_t *zp = NULL, *zphead;
+	zoneid_t zid;
+	int cnt = 0;
+
+	qdrr.zd_queue = p;
+	qdrr.zd_unow = GET_USEC_TIME;
+	qdrr.zd_last = vq->vq_last_zone_id;
+	qdrr.zd_refill = B_FALSE;
+	if ((zid = get_drr_zone(&qdrr)) == ALL_ZONES) {
+		/* Every backlogged zone is out of credit; start a new round */
+		qdrr.zd_refill = B_TRUE;
+		if ((zid = get_drr_zone(&qdrr)) == ALL_ZONES)
+			zid = qdrr.zd_best;
+	}
+
+	zphead = avl_first(tree);
+
+	if (zid != ALL_ZONES) {
+		for (zp = zphead; zp != NULL;
+		    zp = avl_walk(tree, zp, AVL_AFTER)) {
+			if (zp->io_zoneid == zid)
+				break;
+			cnt++;
+		}
+	}
+
+	/*
+	 * The queued counts are kept per zone, not per vdev, so the zone we
+	 * picked may have nothing queued on this vdev.
+	 */
+	if (zp == NULL)
+		zp = zphead;
+
+	zpd = &zone_pdata[zp->io_zoneid];
+	mutex_enter(&zpd->zpers_zfs_lock);
+	iop = zpd->zpers_zfsp;
+	if (iop != NULL)
+		iop->zpers_qos_deficit[p] -= zp->io_size;
+	mutex_exit(&zpd->zpers_zfs_lock);
+
+	if (zp != zphead) {
+		DTRACE_PROBE3(zfs__zone__sched__drr, uint_t, zp->io_zoneid,
+		    uint_t, cnt, boolean_t, qdrr.zd_refill);
+	}
+
+	return (zp);
+}
+
+/*
+ * Record the time a zio waited in the vdev queue.  Called with the zone's
+ * zpers_zfs_lock held.
+ */
+static void
+zfs_zone_qos_record(zone_zfs_io_t *iop, zio_t *zp, hrtime_t now)
+{
+	hrtime_t unow = NANO_TO_MICRO(now);
+	uint64_t qtime;
+	int b;
+
+	if (unow - iop->zpers_qos_win_start >= zfs_zone_qos_window) {
+		iop->zpers_qos_win_start = unow;
+		iop->zpers_qos_win_ops = 0;
+		iop->zpers_qos_win_bytes = 0;
+	}
+	iop->zpers_qos_win_ops++;
+	iop->zpers_qos_win_bytes += zp->io_size;
+
+	if (zp->io_timestamp == 0 || now < zp->io_timestamp)
+		return;
+
+	qtime = NANO_TO_MICRO(now - zp->io_timestamp);
+	b = MIN(qtime == 0 ? 0 : highbit64(qtime) - 1,
+	    ZONE_ZFS_QTIME_BUCKETS - 1);
+	iop->zpers_qos_qtime_hist[zp->io_type == ZIO_TYPE_READ ? 0 : 1][b]++;
+
+	if (zp->io_priority != ZIO_PRIORITY_SYNC_READ &&
+	    zp->io_priority != ZIO_PRIORITY_SYNC_WRITE)
+		return;
+
+	/* Decay the average by 1/8 per sample */
+	iop->zpers_qos_qtime_avg = (iop->zpers_qos_qtime_avg * 7 + qtime) / 8;
+	if (iop->zpers_qos_lat_target != 0 &&
+	    qtime > iop->zpers_qos_lat_target)
+		iop->zpers_qos_slo_miss++;
+}
+
 /*
  * Add our zone ID to the zio so we can keep track of which zones are doing
  * what, even when the current thread processing the zio is not associated
@@ -1075,6 +1373,15 @@ zfs_zone_io_throttle(zfs_zone_iop_type_t type)
 		return;
 	}
 
+	/*
+	 * Under latency-target QoS, zones with a reservation are protected by
+	 * the scheduler rather than delayed here.
+	 */
+	if (zfs_zone_qos_enable && ZFS_ZONE_QOS_RESERVED(iop)) {
+		mutex_exit(&zpd->zpers_zfs_lock);
+		return;
+	}
+
 	/* Handle periodically updating the per-zone I/O parameters */
 	if ((unow - zfs_zone_last_checked) > zfs_zone_adjust_time) {
 		hrtime_t last_checked;
@@ -1193,6 +1500,44 @@ zfs_zone_txg_delay()
 	return (MSEC2NSEC(10));
 }
 
+/*
+ * Charge dirty data to the current zone; see dsl_pool_dirty_space().
+ */
+void
+zfs_zone_dirty_space(uint64_t space)
+{
+	zone_persist_t *zpd = &zone_pdata[curzone->zone_id];
+
+	mutex_enter(&zpd->zpers_zfs_lock);
+	if (zpd->zpers_zfsp != NULL)
+		zpd->zpers_zfsp->zpers_dirty_bytes += space;
+	mutex_exit(&zpd->zpers_zfs_lock);
+}
+
+/*
+ * Called from dsl_pool_need_dirty_delay() once a pool's dirty data has
+ * reached the point at which transactions are delayed.  Return B_TRUE if
+ * the current zone should not be delayed, because some other zone is
+ * dirtying more than its share of data and this one is not.
+ */
+boolean_t
+zfs_zone_dirty_exempt(void)
+{
+	zone_persist_t *zpd = &zone_pdata[curzone->zone_id];
+	boolean_t exempt = B_FALSE;
+
+	if (!zfs_zone_delay_enable || !zfs_zone_dirty_fair_enable ||
+	    zfs_zone_dirty_hogs == 0 || curzone->zone_id == GLOBAL_ZONEID)
+		return (B_FALSE);
+
+	mutex_enter(&zpd->zpers_zfs_lock);
+	if (zpd->zpers_zfsp != NULL)
+		exempt = (zpd->zpers_zfsp->zpers_dirty_above_fair == 0);
+	mutex_exit(&zpd->zpers_zfs_lock);
+
+	return (exempt);
+}
+
 /*
  * Called from vdev_disk_io_start when an IO hits the end of the zio pipeline
  * and is issued.
@@ -1203,6 +1548,7 @@ zfs_zone_zio_start(zio_t *zp)
 {
 	zone_persist_t *zpd = &zone_pdata[zp->io_zoneid];
 	zone_zfs_io_t *iop;
+	hrtime_t now;
 
 	/*
 	 * I/Os of type ZIO_TYPE_IOCTL are used to flush the disk cache, not for
@@ -1212,17 +1558,20 @@ zfs_zone_zio_start(zio_t *zp)
 	if (zp->io_type == ZIO_TYPE_IOCTL)
 		return;
 
+	now = gethrtime();
+
 	mutex_enter(&zpd->zpers_zfs_lock);
 	iop = zpd->zpers_zfsp;
 	if (iop != NULL) {
 		if (zp->io_type == ZIO_TYPE_READ)
 			kstat_runq_enter(&iop->zpers_zfs_rwstats);
 		iop->zpers_zfs_weight = 0;
+		zfs_zone_qos_record(iop, zp, now);
 	}
 	mutex_exit(&zpd->zpers_zfs_lock);
 
 	mutex_enter(&zfs_disk_lock);
-	zp->io_dispatched = gethrtime();
+	zp->io_dispatched = now;
 
 	if (zfs_disk_rcnt++ != 0)
 		zfs_disk_rtime += (zp->io_dispatched - zfs_disk_rlastupdate);
@@ -1230,6 +1579,33 @@ zfs_zone_zio_start(zio_t *zp)
 	mutex_exit(&zfs_disk_lock);
 }
 
+/*
+ * Classify an I/O for the zone_lat histograms by the allocation class of the
+ * top-level vdev it was issued to.
+ */
+static zone_lat_zio_t
+zfs_zone_zio_class(zio_t *zp)
+{
+	vdev_t *tvd;
+
+	if (zp->io_vd == NULL || (tvd = zp->io_vd->vdev_top) == NULL)
+		return (ZONE_LAT_ZIO_NORMAL);
+
+	if (tvd->vdev_islog)
+		return (ZONE_LAT_ZIO_LOG);
+
+	switch (tvd->vdev_alloc_bias) {
+	case VDEV_BIAS_LOG:
+		return (ZONE_LAT_ZIO_LOG);
+	case VDEV_BIAS_SPECIAL:
+		return (ZONE_LAT_ZIO_SPECIAL);
+	case VDEV_BIAS_DEDUP:
+		return (ZONE_LAT_ZIO_DEDUP);
+	default:
+		return (ZONE_LAT_ZIO_NORMAL);
+	}
+}
+
 /*
  * Called from vdev_disk_io_done when an IO completes.
  * Increment our counter for zone ops.
@@ -1273,6 +1649,9 @@ zfs_zone_zio_done(zio_t *zp)
 			iop->zpers_zfs_rwstats.writes++;
 			iop->zpers_zfs_rwstats.nwritten += zp->io_size;
 		}
+
+		iop->zpers_zio_lat[zfs_zone_zio_class(zp)]
+		    [zone_lat_bucket(now - zp->io_dispatched)]++;
 	}
 	mutex_exit(&zpd->zpers_zfs_lock);
 
@@ -1398,7 +1777,9 @@ zfs_zone_schedule(vdev_queue_t *vq, zio_priority_t p, avl_index_t idx,
 	 * If there are more than a few zios already queued up, then use
 	 * scheduling to get the next zio.
 	 */
-	if (!zfs_zone_schedule_enable || cnt < zfs_zone_schedule_thresh)
+	if (zfs_zone_qos_enable && cnt > 1)
+		zio = get_next_zio_drr(vq, p, tree);
+	else if (!zfs_zone_schedule_enable || cnt < zfs_zone_schedule_thresh)
 		zio = avl_nearest(tree, idx, AVL_AFTER);
 	else
 		zio = get_next_zio(vqc, cnt, p, tree);
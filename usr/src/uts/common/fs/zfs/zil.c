@@ -128,6 +128,68 @@ uint64_t zil_slog_bulk = 0x100000000ULL;
 static kmem_cache_t *zil_lwb_cache;
 static kmem_cache_t *zil_zcw_cache;
 
+/*
+ * ZIL statistics, exported as the "zfs:0:zil" kstat.
+ *
+ * The "*_time" counters accumulate the time, in nanoseconds, spent in
+ * each stage of zil_commit(); dividing them by the matching count gives
+ * the average latency of the stage:
+ *
+ *	- commit_assign_time: assigning the commit itx (zil_commit_count)
+ *	- commit_issuer_wait_time: waiting for the zl_issuer_lock
+ *	  (zil_commit_writer_count)
+ *	- commit_writer_time: building and closing lwbs while holding the
+ *	  zl_issuer_lock (zil_commit_writer_count)
+ *	- commit_waiter_time: waiting for the lwb to be written and flushed
+ *	  (zil_commit_count)
+ *	- lwb_write_time: lwb write zio issue to completion (zil_lwb_count)
+ *	- lwb_flush_time: lwb write completion to the end of the cache
+ *	  flushes (zil_lwb_count)
+ *
+ * zil_lwb_waiters / zil_lwb_count is the average number of commit
+ * waiters woken up per lwb, i.e. the size of the commit batches.
+ */
+typedef struct zil_stats {
+	kstat_named_t zil_commit_count;
+	kstat_named_t zil_commit_writer_count;
+	kstat_named_t zil_commit_assign_time;
+	kstat_named_t zil_commit_issuer_wait_time;
+	kstat_named_t zil_commit_writer_time;
+	kstat_named_t zil_commit_waiter_time;
+	kstat_named_t zil_lwb_count;
+	kstat_named_t zil_lwb_waiters;
+	kstat_named_t zil_lwb_write_time;
+	kstat_named_t zil_lwb_flush_time;
+	kstat_named_t zil_lwb_slog_count;
+	kstat_named_t zil_lwb_slog_bytes;
+	kstat_named_t zil_lwb_normal_count;
+	kstat_named_t zil_lwb_normal_bytes;
+} zil_stats_t;
+
+static zil_stats_t zil_stats = {
+	{ "zil_commit_count",			KSTAT_DATA_UINT64 },
+	{ "zil_commit_writer_count",		KSTAT_DATA_UINT64 },
+	{ "zil_commit_assign_time",		KSTAT_DATA_UINT64 },
+	{ "zil_commit_issuer_wait_time",	KSTAT_DATA_UINT64 },
+	{ "zil_commit_writer_time",		KSTAT_DATA_UINT64 },
+	{ "zil_commit_waiter_time",		KSTAT_DATA_UINT64 },
+	{ "zil_lwb_count",			KSTAT_DATA_UINT64 },
+	{ "zil_lwb_waiters",			KSTAT_DATA_UINT64 },
+	{ "zil_lwb_write_time",			KSTAT_DATA_UINT64 },
+	{ "zil_lwb_flush_time",			KSTAT_DATA_UINT64 },
+	{ "zil_lwb_slog_count",			KSTAT_DATA_UINT64 },
+	{ "zil_lwb_slog_bytes",			KSTAT_DATA_UINT64 },
+	{ "zil_lwb_normal_count",		KSTAT_DATA_UINT64 },
+	{ "zil_lwb_normal_bytes",		KSTAT_DATA_UINT64 },
+};
+
+#define	ZIL_STAT_INCR(stat, val) \
+	atomic_add_64(&zil_stats.stat.value.ui64, (val));
+#define	ZIL_STAT_BUMP(stat) \
+	ZIL_STAT_INCR(stat, 1);
+
+static kstat_t *zil_ksp;
+
 static void zil_async_to_sync(zilog_t *zilog, uint64_t foid);
 
 #define	LWB_EMPTY(lwb) ((BP_GET_LSIZE(&lwb->lwb_blk) - \
@@ -1101,6 +1163,8 @@ zil_lwb_flush_vdevs_done(zio_t *zio)
 	zilog_t *zilog = lwb->lwb_zilog;
 	dmu_tx_t *tx = lwb->lwb_tx;
 	zil_commit_waiter_t *zcw;
+	uint64_t nwaiters = 0;
+	hrtime_t now;
 
 	spa_config_exit(zilog->zl_spa, SCL_STATE, lwb);
 
@@ -1120,7 +1184,10 @@ zil_lwb_flush_vdevs_done(zio_t *zio)
 	lwb->lwb_tx = NULL;
 
 	ASSERT3U(lwb->lwb_issued_timestamp, >, 0);
-	zilog->zl_last_lwb_latency = gethrtime() - lwb->lwb_issued_timestamp;
+	now = gethrtime();
+	zilog->zl_last_lwb_latency = now - lwb->lwb_issued_timestamp;
+	ZIL_STAT_BUMP(zil_lwb_count);
+	ZIL_STAT_INCR(zil_lwb_flush_time, now - lwb->lwb_write_done_timestamp);
 
 	lwb->lwb_root_zio = NULL;
 
@@ -1153,10 +1220,13 @@ zil_lwb_flush_vdevs_done(zio_t *zio)
 		cv_broadcast(&zcw->zcw_cv);
 
 		mutex_exit(&zcw->zcw_lock);
+		nwaiters++;
 	}
 
 	mutex_exit(&zilog->zl_lock);
 
+	ZIL_STAT_INCR(zil_lwb_waiters, nwaiters);
+
 	/*
 	 * Now that we've written this log block, we have a stable pointer
 	 * to the next block in the chain, so it's OK to let the txg in
@@ -1201,6 +1271,10 @@ zil_lwb_write_done(zio_t *zio)
 
 	abd_put(zio->io_abd);
 
+	lwb->lwb_write_done_timestamp = gethrtime();
+	ZIL_STAT_INCR(zil_lwb_write_time,
+	    lwb->lwb_write_done_timestamp - lwb->lwb_issued_timestamp);
+
 	mutex_enter(&zilog->zl_lock);
 	ASSERT3S(lwb->lwb_state, ==, LWB_STATE_ISSUED);
 	lwb->lwb_state = LWB_STATE_WRITE_DONE;
@@ -1389,11 +1463,15 @@ uint64_t zil_block_buckets[] = {
 };
 
 /*
- * Start a log block write and advance to the next log block.
- * Calls are serialized.
+ * Close a log block for writing and advance to the next log block: the
+ * next block is allocated and linked into this one, and this one is
+ * transitioned to the "issued" state. Calls are serialized by the
+ * zl_issuer_lock. The lwb's zios must then be handed to the zio layer
+ * via zil_lwb_write_issue(); the caller may defer that until after it
+ * has dropped the zl_issuer_lock.
  */
 static lwb_t *
-zil_lwb_write_issue(zilog_t *zilog, lwb_t *lwb)
+zil_lwb_write_close(zilog_t *zilog, lwb_t *lwb)
 {
 	lwb_t *nlwb = NULL;
 	zil_chain_t *zilc;
@@ -1508,15 +1586,16 @@ zil_lwb_write_issue(zilog_t *zilog, lwb_t *lwb)
 	 */
 	bzero(lwb->lwb_buf + lwb->lwb_nused, wsz - lwb->lwb_nused);
 
-	spa_config_enter(zilog->zl_spa, SCL_STATE, lwb, RW_READER);
+	if (lwb->lwb_slog) {
+		ZIL_STAT_BUMP(zil_lwb_slog_count);
+		ZIL_STAT_INCR(zil_lwb_slog_bytes, wsz);
+	} else {
+		ZIL_STAT_BUMP(zil_lwb_normal_count);
+		ZIL_STAT_INCR(zil_lwb_normal_bytes, wsz);
+	}
 
-	zil_lwb_add_block(lwb, &lwb->lwb_blk);
-	lwb->lwb_issued_timestamp = gethrtime();
 	lwb->lwb_state = LWB_STATE_ISSUED;
 
-	zio_nowait(lwb->lwb_root_zio);
-	zio_nowait(lwb->lwb_write_zio);
-
 	/*
 	 * If there was an allocation failure then nlwb will be null which
 	 * forces a txg_wait_synced().
@@ -1524,8 +1603,44 @@ zil_lwb_write_issue(zilog_t *zilog, lwb_t *lwb)
 	return (nlwb);
 }
 
+/*
+ * Hand a closed lwb's zios to the zio layer. This does not require the
+ * zl_issuer_lock: the lwb is in the "issued" state and no other thread
+ * will modify its buffer, and the completion order of the lwbs is
+ * enforced by the zio dependencies set up in zil_lwb_set_zio_dependency(),
+ * not by the order in which they are issued. Issuing outside the lock lets
+ * the next writer build its lwbs while the checksums of ours are computed
+ * and their writes are queued, so consecutive lwbs (which are allocated on
+ * alternating log devices, see zio_alloc_zil()) are in flight in parallel.
+ */
+static void
+zil_lwb_write_issue(zilog_t *zilog, lwb_t *lwb)
+{
+	ASSERT3S(lwb->lwb_state, ==, LWB_STATE_ISSUED);
+
+	spa_config_enter(zilog->zl_spa, SCL_STATE, lwb, RW_READER);
+
+	zil_lwb_add_block(lwb, &lwb->lwb_blk);
+	lwb->lwb_issued_timestamp = gethrtime();
+
+	zio_nowait(lwb->lwb_root_zio);
+	zio_nowait(lwb->lwb_write_zio);
+}
+
+/*
+ * Issue all lwbs on the given list of closed lwbs, in order.
+ */
+static void
+zil_lwb_write_issue_list(zilog_t *zilog, list_t *ilwbs)
+{
+	lwb_t *lwb;
+
+	while ((lwb = list_remove_head(ilwbs)) != NULL)
+		zil_lwb_write_issue(zilog, lwb);
+}
+
 static lwb_t *
-zil_lwb_commit(zilog_t *zilog, itx_t *itx, lwb_t *lwb)
+zil_lwb_commit(zilog_t *zilog, itx_t *itx, lwb_t *lwb, list_t *ilwbs)
 {
 	lr_t *lrcb, *lrc;
 	lr_write_t *lrwb, *lrw;
@@ -1582,7 +1697,10 @@ cont:
 	if (reclen > lwb_sp || (reclen + dlen > lwb_sp &&
 	    lwb_sp < ZIL_MAX_WASTE_SPACE && (dlen % ZIL_MAX_LOG_DATA == 0 ||
 	    lwb_sp < reclen + dlen % ZIL_MAX_LOG_DATA))) {
-		lwb = zil_lwb_write_issue(zilog, lwb);
+		lwb_t *nlwb = zil_lwb_write_close(zilog, lwb);
+
+		list_insert_tail(ilwbs, lwb);
+		lwb = nlwb;
 		if (lwb == NULL)
 			return (NULL);
 		zil_lwb_write_open(zilog, lwb);
@@ -2109,10 +2227,12 @@ zil_commit_writer_stall(zilog_t *zilog)
  * This function will traverse the commit list, creating new lwbs as
  * needed, and committing the itxs from the commit list to these newly
  * created lwbs. Additionally, as a new lwb is created, the previous
- * lwb will be issued to the zio layer to be written to disk.
+ * lwb is closed and appended to "ilwbs"; the caller must issue these
+ * lwbs to the zio layer with zil_lwb_write_issue_list(), which it
+ * usually does after dropping the zl_issuer_lock.
  */
 static void
-zil_process_commit_list(zilog_t *zilog)
+zil_process_commit_list(zilog_t *zilog, list_t *ilwbs)
 {
 	spa_t *spa = zilog->zl_spa;
 	list_t nolwb_waiters;
@@ -2203,7 +2323,7 @@ zil_process_commit_list(zilog_t *zilog)
 		 */
 		if (frozen || !synced || lrc->lrc_txtype == TX_COMMIT) {
 			if (lwb != NULL) {
-				lwb = zil_lwb_commit(zilog, itx, lwb);
+				lwb = zil_lwb_commit(zilog, itx, lwb, ilwbs);
 			} else if (lrc->lrc_txtype == TX_COMMIT) {
 				ASSERT3P(lwb, ==, NULL);
 				zil_commit_waiter_link_nolwb(
@@ -2221,7 +2341,11 @@ zil_process_commit_list(zilog_t *zilog)
 		 * "next" lwb on-disk. When this happens, we must stall
 		 * the ZIL write pipeline; see the comment within
 		 * zil_commit_writer_stall() for more details.
+		 *
+		 * The lwbs closed so far must be issued first, as the
+		 * txg can't sync until they complete.
 		 */
+		zil_lwb_write_issue_list(zilog, ilwbs);
 		zil_commit_writer_stall(zilog);
 
 		/*
@@ -2309,10 +2433,19 @@ zil_process_commit_list(zilog_t *zilog)
 static void
 zil_commit_writer(zilog_t *zilog, zil_commit_waiter_t *zcw)
 {
+	list_t ilwbs;
+	hrtime_t start, locked;
+
 	ASSERT(!MUTEX_HELD(&zilog->zl_lock));
 	ASSERT(spa_writeable(zilog->zl_spa));
 
+	list_create(&ilwbs, sizeof (lwb_t), offsetof(lwb_t, lwb_issue_node));
+
+	start = gethrtime();
 	mutex_enter(&zilog->zl_issuer_lock);
+	locked = gethrtime();
+	ZIL_STAT_BUMP(zil_commit_writer_count);
+	ZIL_STAT_INCR(zil_commit_issuer_wait_time, locked - start);
 
 	if (zcw->zcw_lwb != NULL || zcw->zcw_done) {
 		/*
@@ -2336,10 +2469,19 @@ zil_commit_writer(zilog_t *zilog, zil_commit_waiter_t *zcw)
 
 	zil_get_commit_list(zilog);
 	zil_prune_commit_list(zilog);
-	zil_process_commit_list(zilog);
+	zil_process_commit_list(zilog, &ilwbs);
 
 out:
+	ZIL_STAT_INCR(zil_commit_writer_time, gethrtime() - locked);
 	mutex_exit(&zilog->zl_issuer_lock);
+
+	/*
+	 * Issue the lwbs we closed only after dropping the lock, so that
+	 * the threads whose commit itxs didn't make it into those lwbs can
+	 * start building the next batch in the meantime.
+	 */
+	zil_lwb_write_issue_list(zilog, &ilwbs);
+	list_destroy(&ilwbs);
 }
 
 static void
@@ -2366,7 +2508,7 @@ zil_commit_waiter_timeout(zilog_t *zilog, zil_commit_waiter_t *zcw)
 		return;
 
 	/*
-	 * In order to call zil_lwb_write_issue() we must hold the
+	 * In order to call zil_lwb_write_close() we must hold the
 	 * zilog's "zl_issuer_lock". We can't simply acquire that lock,
 	 * since we're already holding the commit waiter's "zcw_lock",
 	 * and those two locks are aquired in the opposite order
@@ -2404,7 +2546,7 @@ zil_commit_waiter_timeout(zilog_t *zilog, zil_commit_waiter_t *zcw)
 	 * if it's ISSUED or OPENED, and block any other threads that might
 	 * attempt to issue this lwb. For that reason we hold the
 	 * zl_issuer_lock when checking the lwb_state; we must not call
-	 * zil_lwb_write_issue() if the lwb had already been issued.
+	 * zil_lwb_write_close() if the lwb had already been issued.
 	 *
 	 * See the comment above the lwb_state_t structure definition for
 	 * more details on the lwb states, and locking requirements.
@@ -2422,7 +2564,8 @@ zil_commit_waiter_timeout(zilog_t *zilog, zil_commit_waiter_t *zcw)
 	 * since we've reached the commit waiter's timeout and it still
 	 * hasn't been issued.
 	 */
-	lwb_t *nlwb = zil_lwb_write_issue(zilog, lwb);
+	lwb_t *nlwb = zil_lwb_write_close(zilog, lwb);
+	zil_lwb_write_issue(zilog, lwb);
 
 	IMPLY(nlwb != NULL, lwb->lwb_state != LWB_STATE_OPENED);
 
@@ -2442,7 +2585,7 @@ zil_commit_waiter_timeout(zilog_t *zilog, zil_commit_waiter_t *zcw)
 
 	if (nlwb == NULL) {
 		/*
-		 * When zil_lwb_write_issue() returns NULL, this
+		 * When zil_lwb_write_close() returns NULL, this
 		 * indicates zio_alloc_zil() failed to allocate the
 		 * "next" lwb on-disk. When this occurs, the ZIL write
 		 * pipeline must be stalled; see the comment within the
@@ -2835,11 +2978,20 @@ zil_commit_impl(zilog_t *zilog, uint64_t foid)
 	 * is not guaranteed to be committed to an lwb prior to calling
 	 * zil_commit_waiter().
 	 */
+	hrtime_t start = gethrtime(), now;
+
 	zil_commit_waiter_t *zcw = zil_alloc_commit_waiter();
 	zil_commit_itx_assign(zilog, zcw);
 
+	now = gethrtime();
+	ZIL_STAT_BUMP(zil_commit_count);
+	ZIL_STAT_INCR(zil_commit_assign_time, now - start);
+
 	zil_commit_writer(zilog, zcw);
+
+	start = gethrtime();
 	zil_commit_waiter(zilog, zcw);
+	ZIL_STAT_INCR(zil_commit_waiter_time, gethrtime() - start);
 
 	if (zcw->zcw_zio_error != 0) {
 		/*
@@ -2960,11 +3112,25 @@ zil_init(void)
 
 	zil_zcw_cache = kmem_cache_create("zil_zcw_cache",
 	    sizeof (zil_commit_waiter_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+
+	zil_ksp = kstat_create("zfs", 0, "zil", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (zil_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+
+	if (zil_ksp != NULL) {
+		zil_ksp->ks_data = &zil_stats;
+		kstat_install(zil_ksp);
+	}
 }
 
 void
 zil_fini(void)
 {
+	if (zil_ksp != NULL) {
+		kstat_delete(zil_ksp);
+		zil_ksp = NULL;
+	}
+
 	kmem_cache_destroy(zil_zcw_cache);
 	kmem_cache_destroy(zil_lwb_cache);
 }
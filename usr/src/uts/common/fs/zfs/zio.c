@@ -24,7 +24,7 @@
  * Copyright (c) 2011 Nexenta Systems, Inc. All rights reserved.
  * Copyright (c) 2013 by Saso Kiselkov. All rights reserved.
  * Copyright (c) 2014 Integros [integros.com]
- * Copyright (c) 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2017, Intel Corporation.
  */
 
@@ -111,6 +111,19 @@ int zfs_sync_pass_rewrite = 2; /* rewrite new bps starting in this pass */
 
 boolean_t	zio_requeue_io_start_cut_in_line = B_TRUE;
 
+/*
+ * Writes normally hand off to an issue taskq at ZIO_STAGE_ISSUE_ASYNC, so that
+ * compression, encryption, checksumming and allocation don't run in (and
+ * serialize) the thread that issued them.  For a small write which needs
+ * none of the expensive work, such as a ZIL block, the handoff costs more
+ * than the stages it moves: two context switches and a trip through the
+ * taskq's lock.  Such writes are instead executed inline by the issuing
+ * thread when zio_issue_inline is set and they are no larger than
+ * zio_issue_inline_max.
+ */
+boolean_t	zio_issue_inline = B_TRUE;
+uint64_t	zio_issue_inline_max = 32 << 10;
+
 #ifdef ZFS_DEBUG
 int zio_buf_debug_limit = 16384;
 #else
@@ -191,6 +204,7 @@ zio_init(void)
 			zio_data_buf_cache[c - 1] = zio_data_buf_cache[c];
 	}
 
+	zstd_init();
 	zio_inject_init();
 }
 
@@ -218,6 +232,7 @@ zio_fini(void)
 	kmem_cache_destroy(zio_link_cache);
 	kmem_cache_destroy(zio_cache);
 
+	zstd_fini();
 	zio_inject_fini();
 }
 
@@ -1735,9 +1750,42 @@ zio_taskq_member(zio_t *zio, zio_taskq_type_t q)
 	return (B_FALSE);
 }
 
+/*
+ * Decide whether a write at ZIO_STAGE_ISSUE_ASYNC is cheap enough to carry on
+ * in the current thread (see zio_issue_inline above).  Allocating writes
+ * must not compress, encrypt or dedup; rewrites of already-allocated blocks
+ * never do.  Syncing context is excluded so that spa_sync() still spreads
+ * its checksums and allocations across the issue taskqs, and interrupt
+ * threads are excluded so that they get back to completing I/O.
+ */
+static boolean_t
+zio_issue_is_inline(zio_t *zio)
+{
+	dsl_pool_t *dp = spa_get_dsl(zio->io_spa);
+	zio_prop_t *zp = &zio->io_prop;
+
+	if (!zio_issue_inline || zio->io_type != ZIO_TYPE_WRITE ||
+	    zio->io_size > zio_issue_inline_max)
+		return (B_FALSE);
+
+	if (IO_IS_ALLOCATING(zio) && (zp->zp_dedup || zp->zp_encrypt ||
+	    (zp->zp_compress != ZIO_COMPRESS_OFF &&
+	    !(zio->io_flags & ZIO_FLAG_RAW_COMPRESS))))
+		return (B_FALSE);
+
+	if (dp == NULL || dsl_pool_sync_context(dp) ||
+	    zio_taskq_member(zio, ZIO_TASKQ_INTERRUPT))
+		return (B_FALSE);
+
+	return (B_TRUE);
+}
+
 static int
 zio_issue_async(zio_t *zio)
 {
+	if (zio_issue_is_inline(zio))
+		return (ZIO_PIPELINE_CONTINUE);
+
 	zio_taskq_dispatch(zio, ZIO_TASKQ_ISSUE, B_FALSE);
 
 	return (ZIO_PIPELINE_STOP);
@@ -15,6 +15,7 @@
 
 /*
  * Copyright (c) 2017, Datto, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/zio_crypt.h>
@@ -211,10 +212,94 @@ zio_crypt_info_t zio_crypt_table[ZIO_CRYPT_FUNCTIONS] = {
 	{SUN_CKM_AES_GCM,	ZC_TYPE_GCM,	32,	"aes-256-gcm"}
 };
 
+static void
+zio_crypt_salt_cache_init(zio_crypt_key_t *key)
+{
+	for (int i = 0; i < ZIO_CRYPT_SALT_CACHE; i++) {
+		zio_crypt_salt_ent_t *zcse = &key->zk_salt_cache[i];
+
+		rw_init(&zcse->zcse_lock, NULL, RW_DEFAULT, NULL);
+		zcse->zcse_valid = B_FALSE;
+		zcse->zcse_tmpl = NULL;
+	}
+}
+
+static void
+zio_crypt_salt_cache_fini(zio_crypt_key_t *key)
+{
+	for (int i = 0; i < ZIO_CRYPT_SALT_CACHE; i++) {
+		zio_crypt_salt_ent_t *zcse = &key->zk_salt_cache[i];
+
+		crypto_destroy_ctx_template(zcse->zcse_tmpl);
+		rw_destroy(&zcse->zcse_lock);
+	}
+}
+
+/*
+ * Find the encryption key for an older salt in the key's salt cache, deriving
+ * it (and its crypto template) into the cache if it isn't there.  On success
+ * the entry is returned held as reader, and must be released with rw_exit()
+ * once the key is no longer in use.  If the entry is busy with another salt,
+ * NULL is returned and the caller derives a temporary key itself.
+ */
+static zio_crypt_salt_ent_t *
+zio_crypt_salt_cache_hold(zio_crypt_key_t *key, uint8_t *salt)
+{
+	uint_t keydata_len = zio_crypt_table[key->zk_crypt].ci_keylen;
+	crypto_mechanism_t mech;
+	zio_crypt_salt_ent_t *zcse;
+	uint64_t hash;
+
+	CTASSERT(sizeof (hash) == ZIO_DATA_SALT_LEN);
+	bcopy(salt, &hash, sizeof (hash));
+	zcse = &key->zk_salt_cache[hash % ZIO_CRYPT_SALT_CACHE];
+
+	rw_enter(&zcse->zcse_lock, RW_READER);
+	if (zcse->zcse_valid &&
+	    bcmp(salt, zcse->zcse_salt, ZIO_DATA_SALT_LEN) == 0)
+		return (zcse);
+	rw_exit(&zcse->zcse_lock);
+
+	if (!rw_tryenter(&zcse->zcse_lock, RW_WRITER))
+		return (NULL);
+
+	if (!zcse->zcse_valid ||
+	    bcmp(salt, zcse->zcse_salt, ZIO_DATA_SALT_LEN) != 0) {
+		zcse->zcse_valid = B_FALSE;
+		crypto_destroy_ctx_template(zcse->zcse_tmpl);
+		zcse->zcse_tmpl = NULL;
+
+		if (hkdf_sha512(key->zk_master_keydata, keydata_len, NULL, 0,
+		    salt, ZIO_DATA_SALT_LEN, zcse->zcse_keydata,
+		    keydata_len) != 0) {
+			rw_exit(&zcse->zcse_lock);
+			return (NULL);
+		}
+
+		bcopy(salt, zcse->zcse_salt, ZIO_DATA_SALT_LEN);
+		zcse->zcse_key.ck_format = CRYPTO_KEY_RAW;
+		zcse->zcse_key.ck_data = zcse->zcse_keydata;
+		zcse->zcse_key.ck_length = CRYPTO_BYTES2BITS(keydata_len);
+
+		/* as elsewhere, the template is just an optimization */
+		mech.cm_type = crypto_mech2id(
+		    zio_crypt_table[key->zk_crypt].ci_mechname);
+		if (crypto_create_ctx_template(&mech, &zcse->zcse_key,
+		    &zcse->zcse_tmpl, KM_SLEEP) != CRYPTO_SUCCESS)
+			zcse->zcse_tmpl = NULL;
+
+		zcse->zcse_valid = B_TRUE;
+	}
+
+	rw_downgrade(&zcse->zcse_lock);
+	return (zcse);
+}
+
 void
 zio_crypt_key_destroy(zio_crypt_key_t *key)
 {
 	rw_destroy(&key->zk_salt_lock);
+	zio_crypt_salt_cache_fini(key);
 
 	/* free crypto templates */
 	crypto_destroy_ctx_template(key->zk_current_tmpl);
@@ -236,6 +321,7 @@ zio_crypt_key_init(uint64_t crypt, zio_crypt_key_t *key)
 
 	keydata_len = zio_crypt_table[crypt].ci_keylen;
 	bzero(key, sizeof (zio_crypt_key_t));
+	zio_crypt_salt_cache_init(key);
 
 	/* fill keydata buffers and salt with random data */
 	ret = random_get_bytes((uint8_t *)&key->zk_guid, sizeof (uint64_t));
@@ -329,6 +415,8 @@ zio_crypt_key_change_salt(zio_crypt_key_t *key)
 
 	/* destroy the old context template and create the new one */
 	crypto_destroy_ctx_template(key->zk_current_tmpl);
+	mech.cm_type =
+	    crypto_mech2id(zio_crypt_table[key->zk_crypt].ci_mechname);
 	ret = crypto_create_ctx_template(&mech, &key->zk_current_key,
 	    &key->zk_current_tmpl, KM_SLEEP);
 	if (ret != CRYPTO_SUCCESS)
@@ -574,6 +662,7 @@ zio_crypt_key_unwrap(crypto_key_t *cwkey, uint64_t crypt, uint64_t version,
 	ASSERT3U(cwkey->ck_format, ==, CRYPTO_KEY_RAW);
 
 	rw_init(&key->zk_salt_lock, NULL, RW_DEFAULT, NULL);
+	zio_crypt_salt_cache_init(key);
 	keydata_len = zio_crypt_table[crypt].ci_keylen;
 
 	/* initialize uio_ts */
@@ -1885,6 +1974,7 @@ zio_do_crypt_data(boolean_t encrypt, zio_crypt_key_t *key,
 	uint8_t enc_keydata[MASTER_KEY_MAX_LEN];
 	crypto_key_t tmp_ckey, *ckey = NULL;
 	crypto_ctx_template_t tmpl;
+	zio_crypt_salt_ent_t *zcse = NULL;
 	uint8_t *authbuf = NULL;
 
 	bzero(&puio, sizeof (uio_t));
@@ -1899,7 +1989,8 @@ zio_do_crypt_data(boolean_t encrypt, zio_crypt_key_t *key,
 
 	/*
 	 * If the needed key is the current one, just use it. Otherwise we
-	 * need to generate a temporary one from the given salt + master key.
+	 * need to find or derive one from the given salt + master key in the
+	 * salt cache, or failing that generate a temporary one.
 	 * If we are encrypting, we must return a copy of the current salt
 	 * so that it can be stored in the blkptr_t.
 	 */
@@ -1913,17 +2004,24 @@ zio_do_crypt_data(boolean_t encrypt, zio_crypt_key_t *key,
 		rw_exit(&key->zk_salt_lock);
 		locked = B_FALSE;
 
-		ret = hkdf_sha512(key->zk_master_keydata, keydata_len, NULL, 0,
-		    salt, ZIO_DATA_SALT_LEN, enc_keydata, keydata_len);
-		if (ret != 0)
-			goto error;
-
-		tmp_ckey.ck_format = CRYPTO_KEY_RAW;
-		tmp_ckey.ck_data = enc_keydata;
-		tmp_ckey.ck_length = CRYPTO_BYTES2BITS(keydata_len);
-
-		ckey = &tmp_ckey;
-		tmpl = NULL;
+		zcse = zio_crypt_salt_cache_hold(key, salt);
+		if (zcse != NULL) {
+			ckey = &zcse->zcse_key;
+			tmpl = zcse->zcse_tmpl;
+		} else {
+			ret = hkdf_sha512(key->zk_master_keydata, keydata_len,
+			    NULL, 0, salt, ZIO_DATA_SALT_LEN, enc_keydata,
+			    keydata_len);
+			if (ret != 0)
+				goto error;
+
+			tmp_ckey.ck_format = CRYPTO_KEY_RAW;
+			tmp_ckey.ck_data = enc_keydata;
+			tmp_ckey.ck_length = CRYPTO_BYTES2BITS(keydata_len);
+
+			ckey = &tmp_ckey;
+			tmpl = NULL;
+		}
 	}
 
 	/* perform the encryption / decryption */
@@ -1936,6 +2034,8 @@ zio_do_crypt_data(boolean_t encrypt, zio_crypt_key_t *key,
 		rw_exit(&key->zk_salt_lock);
 		locked = B_FALSE;
 	}
+	if (zcse != NULL)
+		rw_exit(&zcse->zcse_lock);
 
 	if (authbuf != NULL)
 		zio_buf_free(authbuf, datalen);
@@ -1956,6 +2056,8 @@ error:
 	}
 	if (locked)
 		rw_exit(&key->zk_salt_lock);
+	if (zcse != NULL)
+		rw_exit(&zcse->zcse_lock);
 	if (authbuf != NULL)
 		zio_buf_free(authbuf, datalen);
 	if (ckey == &tmp_ckey)
@@ -0,0 +1,249 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Copyright 2020 Joyent, Inc.
+ */
+
+/*
+ * Zstandard compression glue.
+ *
+ * Each supported zstd level is a separate zio_compress value (in the same
+ * way as gzip-1 through gzip-9), so the level used to write a block is
+ * recorded in the block pointer and the ARC and L2ARC can reproduce the
+ * exact on-disk encoding when they need to recompress.  Negative levels are
+ * zstd's "fast" levels.
+ *
+ * A compressed block is laid out as a 4-byte big-endian length of the zstd
+ * frame followed by the frame itself.  The block may be zero-padded out to
+ * the allocation size, so the length is needed to hand zstd the exact frame.
+ *
+ * zstd needs a sizeable workspace for both compression and decompression.
+ * We never let the library allocate on its own:
+ *
+ *   - Compression contexts are taken from per-level kmem caches, sized for
+ *     either "small" (<= SPA_OLD_MAXBLOCKSIZE) or "large" blocks.  The
+ *     allocation is KM_NOSLEEP; if it fails we store the block uncompressed
+ *     rather than stall the write pipeline.
+ *
+ *   - Decompression contexts are allocated once at zstd_init() time, one per
+ *     CPU.  A read picks the context belonging to the CPU it runs on, so the
+ *     zio read pipeline never allocates (and never fails to allocate) a
+ *     workspace.  Each context is protected by its own lock in case the
+ *     thread migrates or is preempted by another reader on that CPU.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/aggsum.h>
+#include <sys/zio.h>
+#include <sys/zio_compress.h>
+
+#define	ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+
+#define	ZSTD_HDR_SIZE		sizeof (uint32_t)
+
+/*
+ * Range of levels accepted by zstd_compress().  Fast levels are negative.
+ */
+#define	ZSTD_LEVEL_MIN		(-1000)
+#define	ZSTD_LEVEL_MAX		19
+
+typedef enum zstd_cctx_class {
+	ZSTD_CCTX_SMALL,
+	ZSTD_CCTX_LARGE,
+	ZSTD_CCTX_CLASSES
+} zstd_cctx_class_t;
+
+typedef struct zstd_cctx_cache {
+	kmem_cache_t	*zcc_cache[ZSTD_CCTX_CLASSES];
+	size_t		zcc_size[ZSTD_CCTX_CLASSES];
+} zstd_cctx_cache_t;
+
+typedef struct zstd_dctx {
+	kmutex_t	zd_lock;
+	void		*zd_ws;
+	ZSTD_DCtx	*zd_dctx;
+} zstd_dctx_t __aligned(CACHE_LINE_SIZE);
+
+/*
+ * One compression context cache per entry in zio_compress_table that uses
+ * zstd, indexed by (enum zio_compress - ZIO_COMPRESS_ZSTD_1).
+ */
+#define	ZSTD_NLEVELS (ZIO_COMPRESS_FUNCTIONS - ZIO_COMPRESS_ZSTD_1)
+
+static zstd_cctx_cache_t zstd_cctx_caches[ZSTD_NLEVELS];
+static zstd_dctx_t *zstd_dctx;
+static uint_t zstd_ndctx;
+static size_t zstd_dctx_size;
+
+/*
+ * Number of blocks that were stored uncompressed because no compression
+ * workspace could be allocated.
+ */
+uint64_t zstd_cctx_alloc_fail;
+
+static zstd_cctx_cache_t *
+zstd_cctx_cache_lookup(int level)
+{
+	for (int c = ZIO_COMPRESS_ZSTD_1; c < ZIO_COMPRESS_FUNCTIONS; c++) {
+		if (zio_compress_table[c].ci_level == level)
+			return (&zstd_cctx_caches[c - ZIO_COMPRESS_ZSTD_1]);
+	}
+	return (NULL);
+}
+
+size_t
+zstd_compress(void *s_start, void *d_start, size_t s_len, size_t d_len, int n)
+{
+	zstd_cctx_cache_t *zcc;
+	zstd_cctx_class_t class;
+	ZSTD_CCtx *cctx;
+	void *ws;
+	size_t c_len;
+
+	ASSERT(d_len <= s_len);
+	ASSERT3S(n, >=, ZSTD_LEVEL_MIN);
+	ASSERT3S(n, <=, ZSTD_LEVEL_MAX);
+
+	if (d_len <= ZSTD_HDR_SIZE ||
+	    (zcc = zstd_cctx_cache_lookup(n)) == NULL)
+		return (s_len);
+
+	class = (s_len <= SPA_OLD_MAXBLOCKSIZE) ?
+	    ZSTD_CCTX_SMALL : ZSTD_CCTX_LARGE;
+	if ((ws = kmem_cache_alloc(zcc->zcc_cache[class], KM_NOSLEEP)) ==
+	    NULL) {
+		atomic_inc_64(&zstd_cctx_alloc_fail);
+		return (s_len);
+	}
+
+	cctx = ZSTD_initStaticCCtx(ws, zcc->zcc_size[class]);
+	VERIFY(cctx != NULL);
+	c_len = ZSTD_compressCCtx(cctx, (char *)d_start + ZSTD_HDR_SIZE,
+	    d_len - ZSTD_HDR_SIZE, s_start, s_len, n);
+	kmem_cache_free(zcc->zcc_cache[class], ws);
+
+	/*
+	 * Either the data was incompressible (the frame did not fit in
+	 * d_len) or zstd failed; signal that the block should be stored
+	 * uncompressed.
+	 */
+	if (ZSTD_isError(c_len))
+		return (s_len);
+
+	*(uint32_t *)d_start = BE_32((uint32_t)c_len);
+	return (c_len + ZSTD_HDR_SIZE);
+}
+
+/*ARGSUSED*/
+int
+zstd_decompress(void *s_start, void *d_start, size_t s_len, size_t d_len,
+    int n)
+{
+	uint32_t bufsiz = BE_IN32(s_start);
+	zstd_dctx_t *zd;
+	size_t ret;
+
+	/* invalid compressed buffer size encoded at start */
+	if (bufsiz + ZSTD_HDR_SIZE > s_len)
+		return (1);
+
+	zd = &zstd_dctx[CPU_SEQID % zstd_ndctx];
+	mutex_enter(&zd->zd_lock);
+	ret = ZSTD_decompressDCtx(zd->zd_dctx, d_start, d_len,
+	    (char *)s_start + ZSTD_HDR_SIZE, bufsiz);
+	mutex_exit(&zd->zd_lock);
+
+	return (ZSTD_isError(ret) ? 1 : 0);
+}
+
+static size_t
+zstd_cctx_size(int level, size_t blksz)
+{
+	ZSTD_compressionParameters cp = ZSTD_getCParams(level, blksz, 0);
+
+	return (ZSTD_estimateCCtxSize_usingCParams(cp));
+}
+
+void
+zstd_init(void)
+{
+	char name[KSTAT_STRLEN];
+
+	for (int c = ZIO_COMPRESS_ZSTD_1; c < ZIO_COMPRESS_FUNCTIONS; c++) {
+		zstd_cctx_cache_t *zcc =
+		    &zstd_cctx_caches[c - ZIO_COMPRESS_ZSTD_1];
+		int level = zio_compress_table[c].ci_level;
+
+		zcc->zcc_size[ZSTD_CCTX_SMALL] =
+		    zstd_cctx_size(level, SPA_OLD_MAXBLOCKSIZE);
+		zcc->zcc_size[ZSTD_CCTX_LARGE] =
+		    zstd_cctx_size(level, SPA_MAXBLOCKSIZE);
+
+		(void) snprintf(name, sizeof (name), "zstd_cctx_%s",
+		    zio_compress_table[c].ci_name + strlen("zstd-"));
+		zcc->zcc_cache[ZSTD_CCTX_SMALL] = kmem_cache_create(name,
+		    zcc->zcc_size[ZSTD_CCTX_SMALL], 0, NULL, NULL, NULL, NULL,
+		    NULL, 0);
+
+		(void) snprintf(name, sizeof (name), "zstd_cctx_%s_large",
+		    zio_compress_table[c].ci_name + strlen("zstd-"));
+		zcc->zcc_cache[ZSTD_CCTX_LARGE] = kmem_cache_create(name,
+		    zcc->zcc_size[ZSTD_CCTX_LARGE], 0, NULL, NULL, NULL, NULL,
+		    NULL, 0);
+	}
+
+	zstd_ndctx = MAX(boot_ncpus, 1);
+	zstd_dctx_size = ZSTD_estimateDCtxSize();
+	zstd_dctx = kmem_zalloc(zstd_ndctx * sizeof (zstd_dctx_t), KM_SLEEP);
+	for (uint_t i = 0; i < zstd_ndctx; i++) {
+		zstd_dctx_t *zd = &zstd_dctx[i];
+
+		mutex_init(&zd->zd_lock, NULL, MUTEX_DEFAULT, NULL);
+		zd->zd_ws = kmem_alloc(zstd_dctx_size, KM_SLEEP);
+		zd->zd_dctx = ZSTD_initStaticDCtx(zd->zd_ws, zstd_dctx_size);
+		VERIFY(zd->zd_dctx != NULL);
+	}
+}
+
+void
+zstd_fini(void)
+{
+	for (uint_t i = 0; i < zstd_ndctx; i++) {
+		zstd_dctx_t *zd = &zstd_dctx[i];
+
+		kmem_free(zd->zd_ws, zstd_dctx_size);
+		mutex_destroy(&zd->zd_lock);
+	}
+	kmem_free(zstd_dctx, zstd_ndctx * sizeof (zstd_dctx_t));
+	zstd_dctx = NULL;
+	zstd_ndctx = 0;
+
+	for (int i = 0; i < ZSTD_NLEVELS; i++) {
+		zstd_cctx_cache_t *zcc = &zstd_cctx_caches[i];
+
+		for (int class = 0; class < ZSTD_CCTX_CLASSES; class++) {
+			kmem_cache_destroy(zcc->zcc_cache[class]);
+			zcc->zcc_cache[class] = NULL;
+		}
+	}
+}
@@ -26,7 +26,7 @@
  * Copyright 2017 Nexenta Systems, Inc.  All rights reserved.
  * Copyright (c) 2012, 2020 by Delphix. All rights reserved.
  * Copyright (c) 2014 Integros [integros.com]
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -129,7 +129,8 @@ typedef struct zvol_state {
 	uint32_t	zv_total_opens;	/* total open count */
 	zilog_t		*zv_zilog;	/* ZIL handle */
 	list_t		zv_extents;	/* List of extents for dump */
-	rangelock_t	zv_rangelock;
+	rangelock_t	zv_rangelocks[ZVOL_RANGELOCKS]; /* range lock shards */
+	uint8_t		zv_rl_shift;	/* log2 of range lock stripe size */
 	dnode_t		*zv_dn;		/* dnode hold */
 } zvol_state_t;
 
@@ -162,6 +163,19 @@ boolean_t zvol_unmap_enabled = B_TRUE;
  */
 boolean_t zvol_unmap_sync_enabled = B_FALSE;
 
+/*
+ * Each zvol's range lock is split into ZVOL_RANGELOCKS shards, each of which
+ * covers every ZVOL_RANGELOCKS'th stripe of the volume, so that concurrent
+ * I/O to different parts of one volume does not serialize on a single AVL
+ * tree and mutex.  A stripe is at least this many bytes, and never less than
+ * one volume block, so that a block always falls within a single shard.
+ * The stripe size of a volume is fixed when its minor node is created.
+ */
+uint64_t zvol_rangelock_stripe = 1ULL << 20;
+
+#define	ZVOL_RL_SHARD(zv, off)	\
+	(((off) >> (zv)->zv_rl_shift) % ZVOL_RANGELOCKS)
+
 extern int zfs_set_prop_nvlist(const char *, zprop_source_t,
     nvlist_t *, nvlist_t *);
 static int zvol_remove_zv(zvol_state_t *);
@@ -560,13 +574,16 @@ zvol_create_minor(const char *name)
 	zv->zv_objset = os;
 	if (dmu_objset_is_snapshot(os) || !spa_writeable(dmu_objset_spa(os)))
 		zv->zv_flags |= ZVOL_RDONLY;
-	rangelock_init(&zv->zv_rangelock, NULL, NULL);
+	for (int i = 0; i < ZVOL_RANGELOCKS; i++)
+		rangelock_init(&zv->zv_rangelocks[i], NULL, NULL);
 	list_create(&zv->zv_extents, sizeof (zvol_extent_t),
 	    offsetof(zvol_extent_t, ze_node));
 	/* get and cache the blocksize */
 	error = dmu_object_info(os, ZVOL_OBJ, &doi);
 	ASSERT(error == 0);
 	zv->zv_volblocksize = doi.doi_data_block_size;
+	zv->zv_rl_shift = highbit64(MAX(zvol_rangelock_stripe,
+	    zv->zv_volblocksize)) - 1;
 
 	if (spa_writeable(dmu_objset_spa(os))) {
 		if (zil_replay_disable)
@@ -603,7 +620,8 @@ zvol_remove_zv(zvol_state_t *zv)
 	(void) snprintf(nmbuf, sizeof (nmbuf), "%u", minor);
 	ddi_remove_minor_node(zfs_dip, nmbuf);
 
-	rangelock_fini(&zv->zv_rangelock);
+	for (int i = 0; i < ZVOL_RANGELOCKS; i++)
+		rangelock_fini(&zv->zv_rangelocks[i]);
 
 	kmem_free(zv, sizeof (zvol_state_t));
 
@@ -989,7 +1007,8 @@ zvol_get_done(zgd_t *zgd, int error)
 	if (zgd->zgd_db)
 		dmu_buf_rele(zgd->zgd_db, zgd);
 
-	rangelock_exit(zgd->zgd_lr);
+	if (zgd->zgd_lr != NULL)
+		rangelock_exit(zgd->zgd_lr);
 
 	kmem_free(zgd, sizeof (zgd_t));
 }
@@ -1022,20 +1041,24 @@ zvol_get_data(void *arg, lr_write_t *lr, char *buf, struct lwb *lwb, zio_t *zio)
 	 * we don't have to write the data twice.
 	 */
 	if (buf != NULL) { /* immediate write */
-		zgd->zgd_lr = rangelock_enter(&zv->zv_rangelock, offset, size,
-		    RL_READER);
+		zvol_locked_range_t zlr;
+
+		zvol_rangelock_enter(zv, &zlr, offset, size, RL_READER);
 		error = dmu_read_by_dnode(zv->zv_dn, offset, size, buf,
 		    DMU_READ_NO_PREFETCH);
+		zvol_rangelock_exit(&zlr);
 	} else { /* indirect write */
 		/*
 		 * Have to lock the whole block to ensure when it's written out
 		 * and its checksum is being calculated that no one can change
 		 * the data. Contrarily to zfs_get_data we need not re-check
 		 * blocksize after we get the lock because it cannot be changed.
+		 * The block lies within a single range lock shard.
 		 */
 		size = zv->zv_volblocksize;
 		offset = P2ALIGN(offset, size);
-		zgd->zgd_lr = rangelock_enter(&zv->zv_rangelock, offset, size,
+		zgd->zgd_lr = rangelock_enter(
+		    &zv->zv_rangelocks[ZVOL_RL_SHARD(zv, offset)], offset, size,
 		    RL_READER);
 		error = dmu_buf_hold_by_dnode(zv->zv_dn, offset, zgd, &db,
 		    DMU_READ_NO_PREFETCH);
@@ -1250,7 +1273,8 @@ zvol_strategy(buf_t *bp)
 	 * There must be no buffer changes when doing a dmu_sync() because
 	 * we can't change the data whilst calculating the checksum.
 	 */
-	locked_range_t *lr = rangelock_enter(&zv->zv_rangelock, off, resid,
+	zvol_locked_range_t zlr;
+	zvol_rangelock_enter(zv, &zlr, off, resid,
 	    doread ? RL_READER : RL_WRITER);
 
 	while (resid != 0 && off < volsize) {
@@ -1284,7 +1308,7 @@ zvol_strategy(buf_t *bp)
 		addr += size;
 		resid -= size;
 	}
-	rangelock_exit(lr);
+	zvol_rangelock_exit(&zlr);
 
 	if ((bp->b_resid = resid) == bp->b_bcount)
 		bioerror(bp, off > volsize ? EINVAL : error);
@@ -1385,8 +1409,9 @@ zvol_read(dev_t dev, uio_t *uio, cred_t *cr)
 	start = gethrtime();
 	tot_bytes = 0;
 
-	locked_range_t *lr = rangelock_enter(&zv->zv_rangelock,
-	    uio->uio_loffset, uio->uio_resid, RL_READER);
+	zvol_locked_range_t zlr;
+	zvol_rangelock_enter(zv, &zlr, uio->uio_loffset, uio->uio_resid,
+	    RL_READER);
 	while (uio->uio_resid > 0 && uio->uio_loffset < volsize) {
 		uint64_t bytes = MIN(uio->uio_resid, DMU_MAX_ACCESS >> 1);
 
@@ -1403,7 +1428,7 @@ zvol_read(dev_t dev, uio_t *uio, cred_t *cr)
 			break;
 		}
 	}
-	rangelock_exit(lr);
+	zvol_rangelock_exit(&zlr);
 
 	mutex_enter(&zonep->zone_vfs_lock);
 	zonep->zone_vfs_rwstats.reads++;
@@ -1488,8 +1513,9 @@ zvol_write(dev_t dev, uio_t *uio, cred_t *cr)
 	sync = !(zv->zv_flags & ZVOL_WCE) ||
 	    (zv->zv_objset->os_sync == ZFS_SYNC_ALWAYS);
 
-	locked_range_t *lr = rangelock_enter(&zv->zv_rangelock,
-	    uio->uio_loffset, uio->uio_resid, RL_WRITER);
+	zvol_locked_range_t zlr;
+	zvol_rangelock_enter(zv, &zlr, uio->uio_loffset, uio->uio_resid,
+	    RL_WRITER);
 	while (uio->uio_resid > 0 && uio->uio_loffset < volsize) {
 		uint64_t bytes = MIN(uio->uio_resid, DMU_MAX_ACCESS >> 1);
 		uint64_t off = uio->uio_loffset;
@@ -1513,7 +1539,7 @@ zvol_write(dev_t dev, uio_t *uio, cred_t *cr)
 		if (error)
 			break;
 	}
-	rangelock_exit(lr);
+	zvol_rangelock_exit(&zlr);
 
 	if (sync)
 		zil_commit(zv->zv_zilog, ZVOL_OBJ);
@@ -1640,7 +1666,7 @@ zvol_get_volume_params(minor_t minor, uint64_t *blksize,
 	*minor_hdl = zv;
 	*objset_hdl = zv->zv_objset;
 	*zil_hdl = zv->zv_zilog;
-	*rl_hdl = &zv->zv_rangelock;
+	*rl_hdl = zv;
 	*dnode_hdl = zv->zv_dn;
 	return (0);
 }
@@ -1680,6 +1706,47 @@ zvol_log_write_minor(void *minor_hdl, dmu_tx_t *tx, offset_t off, ssize_t resid,
 
 	zvol_log_write(zv, tx, off, resid, sync);
 }
+
+/*
+ * Lock [off, off + len) of the volume, for internal and external callers
+ * alike.  The range is entered in every shard whose stripes it touches, and
+ * shards are always entered in ascending order so that ranges spanning more
+ * than one shard cannot deadlock against each other.
+ */
+void
+zvol_rangelock_enter(void *rl_hdl, zvol_locked_range_t *zlr, uint64_t off,
+    uint64_t len, rangelock_type_t type)
+{
+	zvol_state_t *zv = rl_hdl;
+	uint64_t first = off >> zv->zv_rl_shift;
+	uint64_t last = (len == 0) ? first : (off + len - 1) >> zv->zv_rl_shift;
+	uint_t shards = 0;
+
+	if (last - first >= ZVOL_RANGELOCKS - 1) {
+		shards = (1U << ZVOL_RANGELOCKS) - 1;
+	} else {
+		for (uint64_t s = first; s <= last; s++)
+			shards |= 1U << (s % ZVOL_RANGELOCKS);
+	}
+
+	for (int i = 0; i < ZVOL_RANGELOCKS; i++) {
+		if (shards & (1U << i)) {
+			zlr->zlr_lr[i] = rangelock_enter(&zv->zv_rangelocks[i],
+			    off, len, type);
+		} else {
+			zlr->zlr_lr[i] = NULL;
+		}
+	}
+}
+
+void
+zvol_rangelock_exit(zvol_locked_range_t *zlr)
+{
+	for (int i = ZVOL_RANGELOCKS - 1; i >= 0; i--) {
+		if (zlr->zlr_lr[i] != NULL)
+			rangelock_exit(zlr->zlr_lr[i]);
+	}
+}
 /*
  * END entry points to allow external callers access to the volume.
  */
@@ -1719,7 +1786,7 @@ zvol_ioctl(dev_t dev, int cmd, intptr_t arg, int flag, cred_t *cr, int *rvalp)
 	zvol_state_t *zv;
 	struct dk_callback *dkc;
 	int i, error = 0;
-	locked_range_t *lr;
+	zvol_locked_range_t zlr;
 
 	mutex_enter(&zfsdev_state_lock);
 
@@ -1844,19 +1911,17 @@ zvol_ioctl(dev_t dev, int cmd, intptr_t arg, int flag, cred_t *cr, int *rvalp)
 		break;
 
 	case DKIOCDUMPINIT:
-		lr = rangelock_enter(&zv->zv_rangelock, 0, zv->zv_volsize,
-		    RL_WRITER);
+		zvol_rangelock_enter(zv, &zlr, 0, zv->zv_volsize, RL_WRITER);
 		error = zvol_dumpify(zv);
-		rangelock_exit(lr);
+		zvol_rangelock_exit(&zlr);
 		break;
 
 	case DKIOCDUMPFINI:
 		if (!(zv->zv_flags & ZVOL_DUMPIFIED))
 			break;
-		lr = rangelock_enter(&zv->zv_rangelock, 0, zv->zv_volsize,
-		    RL_WRITER);
+		zvol_rangelock_enter(zv, &zlr, 0, zv->zv_volsize, RL_WRITER);
 		error = zvol_dump_fini(zv);
-		rangelock_exit(lr);
+		zvol_rangelock_exit(&zlr);
 		break;
 
 	case DKIOCFREE:
@@ -1901,7 +1966,7 @@ zvol_ioctl(dev_t dev, int cmd, intptr_t arg, int flag, cred_t *cr, int *rvalp)
 				length = end - start;
 			}
 
-			lr = rangelock_enter(&zv->zv_rangelock, start, length,
+			zvol_rangelock_enter(zv, &zlr, start, length,
 			    RL_WRITER);
 			tx = dmu_tx_create(zv->zv_objset);
 			error = dmu_tx_assign(tx, TXG_WAIT);
@@ -1915,7 +1980,7 @@ zvol_ioctl(dev_t dev, int cmd, intptr_t arg, int flag, cred_t *cr, int *rvalp)
 				    ZVOL_OBJ, start, length);
 			}
 
-			rangelock_exit(lr);
+			zvol_rangelock_exit(&zlr);
 
 			if (error != 0)
 				break;
@@ -10,7 +10,7 @@
  */
 
 /*
- * Copyright 2016 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_INET_BPF_H
@@ -39,6 +39,16 @@ typedef struct ip_bpf_insn {
 extern uint32_t ip_bpf_filter(ip_bpf_insn_t *, uchar_t *, uint_t, uint_t);
 extern boolean_t ip_bpf_validate(ip_bpf_insn_t *, uint_t);
 
+/*
+ * A validated program compiled to native code, where that's supported.
+ */
+typedef struct ip_bpf_jit ip_bpf_jit_t;
+
+extern ip_bpf_jit_t *ip_bpf_jit(ip_bpf_insn_t *, uint_t);
+extern void ip_bpf_jit_free(ip_bpf_jit_t *);
+extern uint32_t ip_bpf_jit_filter(ip_bpf_jit_t *, ip_bpf_insn_t *, uchar_t *,
+    uint_t, uint_t);
+
 
 #endif	/* _KERNEL */
 
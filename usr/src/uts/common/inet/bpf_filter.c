@@ -38,7 +38,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
- * Copyright 2016 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/param.h>
@@ -46,6 +46,10 @@
 #include <sys/stream.h>
 #include <sys/byteorder.h>
 #include <sys/sdt.h>
+#ifdef _KERNEL
+#include <sys/kmem.h>
+#include <sys/strsun.h>
+#endif
 #include <inet/bpf.h>
 #include <net/bpf.h>
 
@@ -570,3 +574,483 @@ ip_bpf_validate(ip_bpf_insn_t *f, uint_t len)
 
 	return (BPF_CLASS(f[len - 1].code) == BPF_RET);
 }
+
+#ifdef _KERNEL
+
+/*
+ * Compilation of filter programs to native code.
+ *
+ * Capturing on a busy link runs every packet through the interpreter
+ * above, whose per-instruction dispatch dominates the cost of all but the
+ * most trivial filters.  For validated programs, we can instead produce a
+ * function which does the same thing directly.  The compiled code has the
+ * same semantics as ip_bpf_filter() with a contiguous packet (buflen
+ * non-zero): any load outside of the buffer, or division by zero, rejects
+ * the packet.  Packets which are in more than one mblk_t are left to the
+ * interpreter, so the compiled code never has to call out to anything.
+ *
+ * On amd64, A lives in %eax, X in %r9d, the packet pointer in %rdi, the
+ * wire length in %esi and the buffer length in %r8d; the scratch memory
+ * words are on the stack.  Every branch has a 32-bit displacement, so the
+ * size of each instruction's code doesn't depend on where its targets are,
+ * and a first pass with no buffer sizes the code and finds the offset of
+ * each instruction for the second.
+ */
+boolean_t ip_bpf_jit_enable = B_TRUE;
+
+typedef uint32_t (*ip_bpf_jit_fn_t)(uchar_t *, uint_t, uint_t);
+
+struct ip_bpf_jit {
+	ip_bpf_jit_fn_t	ipbj_func;
+	size_t		ipbj_size;	/* of this allocation, code included */
+};
+
+#if defined(__amd64)
+
+typedef struct ip_bpf_jit_ctx {
+	uint8_t		*bjc_buf;	/* NULL while sizing */
+	size_t		bjc_off;	/* current offset */
+	size_t		*bjc_addrs;	/* offset of each instruction */
+	size_t		bjc_fail;	/* offset of the code returning 0 */
+} ip_bpf_jit_ctx_t;
+
+static void
+bj_emit(ip_bpf_jit_ctx_t *c, const uint8_t *b, size_t n)
+{
+	if (c->bjc_buf != NULL)
+		bcopy(b, c->bjc_buf + c->bjc_off, n);
+	c->bjc_off += n;
+}
+
+#define	BJ(c, ...)	bj_emit((c), (const uint8_t []){ __VA_ARGS__ },	\
+	sizeof ((const uint8_t []){ __VA_ARGS__ }))
+
+static void
+bj_imm32(ip_bpf_jit_ctx_t *c, uint32_t v)
+{
+	BJ(c, v & 0xff, (v >> 8) & 0xff, (v >> 16) & 0xff, v >> 24);
+}
+
+/*
+ * Emit a jump (with the given opcode bytes) to the code at offset target.
+ */
+static void
+bj_jump(ip_bpf_jit_ctx_t *c, const uint8_t *op, size_t oplen, size_t target)
+{
+	bj_emit(c, op, oplen);
+	bj_imm32(c, (uint32_t)(target - (c->bjc_off + 4)));
+}
+
+#define	BJ_JMP(c, target)	bj_jump((c), (const uint8_t []){ 0xe9 }, 1, \
+	(target))
+#define	BJ_JCC(c, cc, target)	bj_jump((c), (const uint8_t []){ 0x0f, \
+	(cc) }, 2, (target))
+
+#define	BJ_JA		0x87
+#define	BJ_JAE		0x83
+#define	BJ_JB		0x82
+#define	BJ_JBE		0x86
+#define	BJ_JE		0x84
+#define	BJ_JNE		0x85
+
+/* The offset from %rsp of scratch memory word k */
+#define	BJ_MEM(k)	((uint8_t)((k) * sizeof (uint32_t)))
+#define	BJ_FRAME	(BPF_MEMWORDS * sizeof (uint32_t))
+
+static void
+bj_return(ip_bpf_jit_ctx_t *c)
+{
+	BJ(c, 0x48, 0x83, 0xc4, BJ_FRAME);	/* add $BJ_FRAME, %rsp */
+	BJ(c, 0xc3);				/* ret */
+}
+
+/*
+ * Fail unless %r8d (buflen) is greater than 'min', for a load of the byte
+ * at offset min (jbe), or at least 'min', for a load ending there (jb).
+ */
+static void
+bj_check_abs(ip_bpf_jit_ctx_t *c, uint64_t min, uint8_t cc)
+{
+	if (min > UINT32_MAX) {
+		BJ_JMP(c, c->bjc_fail);
+		return;
+	}
+	BJ(c, 0x41, 0x81, 0xf8);		/* cmp $min, %r8d */
+	bj_imm32(c, (uint32_t)min);
+	BJ_JCC(c, cc, c->bjc_fail);
+}
+
+/*
+ * Load the X-relative offset into %ecx, and fail unless 'size' bytes from
+ * there are within the buffer.
+ */
+static void
+bj_check_ind(ip_bpf_jit_ctx_t *c, uint32_t k, uint8_t size)
+{
+	BJ(c, 0x44, 0x89, 0xc9);		/* mov %r9d, %ecx */
+	BJ(c, 0x81, 0xc1);			/* add $k, %ecx */
+	bj_imm32(c, k);
+	if (size == 1) {
+		BJ(c, 0x4c, 0x39, 0xc1);	/* cmp %r8, %rcx */
+		BJ_JCC(c, BJ_JAE, c->bjc_fail);
+	} else {
+		BJ(c, 0x48, 0x8d, 0x51, size);	/* lea size(%rcx), %rdx */
+		BJ(c, 0x4c, 0x39, 0xc2);	/* cmp %r8, %rdx */
+		BJ_JCC(c, BJ_JA, c->bjc_fail);
+	}
+}
+
+static void
+bj_cond(ip_bpf_jit_ctx_t *c, const ip_bpf_insn_t *pc, uint_t from,
+    uint8_t cc, uint8_t ncc)
+{
+	size_t t = c->bjc_addrs[from + pc->jt];
+	size_t f = c->bjc_addrs[from + pc->jf];
+
+	if (pc->jt == pc->jf) {
+		if (pc->jt != 0)
+			BJ_JMP(c, t);
+	} else if (pc->jf == 0) {
+		BJ_JCC(c, cc, t);
+	} else if (pc->jt == 0) {
+		BJ_JCC(c, ncc, f);
+	} else {
+		BJ_JCC(c, cc, t);
+		BJ_JMP(c, f);
+	}
+}
+
+static void
+bj_insn(ip_bpf_jit_ctx_t *c, const ip_bpf_insn_t *pc, uint_t i)
+{
+	uint32_t k = pc->k;
+
+	switch (pc->code) {
+	default:
+		BJ_JMP(c, c->bjc_fail);
+		break;
+
+	case BPF_RET|BPF_K:
+		BJ(c, 0xb8);				/* mov $k, %eax */
+		bj_imm32(c, k);
+		bj_return(c);
+		break;
+
+	case BPF_RET|BPF_A:
+		bj_return(c);
+		break;
+
+	case BPF_LD|BPF_W|BPF_ABS:
+		bj_check_abs(c, (uint64_t)k + sizeof (int32_t), BJ_JB);
+		BJ(c, 0xb9);				/* mov $k, %ecx */
+		bj_imm32(c, k);
+		BJ(c, 0x8b, 0x04, 0x0f);	/* mov (%rdi,%rcx), %eax */
+		BJ(c, 0x0f, 0xc8);			/* bswap %eax */
+		break;
+
+	case BPF_LD|BPF_H|BPF_ABS:
+		bj_check_abs(c, (uint64_t)k + sizeof (int16_t), BJ_JB);
+		BJ(c, 0xb9);				/* mov $k, %ecx */
+		bj_imm32(c, k);
+		BJ(c, 0x0f, 0xb7, 0x04, 0x0f);	/* movzwl (%rdi,%rcx), %eax */
+		BJ(c, 0x66, 0xc1, 0xc0, 0x08);	/* rol $8, %ax */
+		break;
+
+	case BPF_LD|BPF_B|BPF_ABS:
+		bj_check_abs(c, k, BJ_JBE);
+		BJ(c, 0xb9);				/* mov $k, %ecx */
+		bj_imm32(c, k);
+		BJ(c, 0x0f, 0xb6, 0x04, 0x0f);	/* movzbl (%rdi,%rcx), %eax */
+		break;
+
+	case BPF_LD|BPF_W|BPF_LEN:
+		BJ(c, 0x89, 0xf0);			/* mov %esi, %eax */
+		break;
+
+	case BPF_LDX|BPF_W|BPF_LEN:
+		BJ(c, 0x41, 0x89, 0xf1);		/* mov %esi, %r9d */
+		break;
+
+	case BPF_LD|BPF_W|BPF_IND:
+		bj_check_ind(c, k, sizeof (int32_t));
+		BJ(c, 0x8b, 0x04, 0x0f);	/* mov (%rdi,%rcx), %eax */
+		BJ(c, 0x0f, 0xc8);			/* bswap %eax */
+		break;
+
+	case BPF_LD|BPF_H|BPF_IND:
+		bj_check_ind(c, k, sizeof (int16_t));
+		BJ(c, 0x0f, 0xb7, 0x04, 0x0f);	/* movzwl (%rdi,%rcx), %eax */
+		BJ(c, 0x66, 0xc1, 0xc0, 0x08);	/* rol $8, %ax */
+		break;
+
+	case BPF_LD|BPF_B|BPF_IND:
+		bj_check_ind(c, k, 1);
+		BJ(c, 0x0f, 0xb6, 0x04, 0x0f);	/* movzbl (%rdi,%rcx), %eax */
+		break;
+
+	case BPF_LDX|BPF_MSH|BPF_B:
+		bj_check_abs(c, k, BJ_JBE);
+		BJ(c, 0xb9);				/* mov $k, %ecx */
+		bj_imm32(c, k);
+		/* movzbl (%rdi,%rcx), %r9d */
+		BJ(c, 0x44, 0x0f, 0xb6, 0x0c, 0x0f);
+		BJ(c, 0x41, 0x83, 0xe1, 0x0f);	/* and $0xf, %r9d */
+		BJ(c, 0x41, 0xc1, 0xe1, 0x02);	/* shl $2, %r9d */
+		break;
+
+	case BPF_LD|BPF_IMM:
+		BJ(c, 0xb8);				/* mov $k, %eax */
+		bj_imm32(c, k);
+		break;
+
+	case BPF_LDX|BPF_IMM:
+		BJ(c, 0x41, 0xb9);			/* mov $k, %r9d */
+		bj_imm32(c, k);
+		break;
+
+	case BPF_LD|BPF_MEM:
+		BJ(c, 0x8b, 0x44, 0x24, BJ_MEM(k));	/* mov k(%rsp), %eax */
+		break;
+
+	case BPF_LDX|BPF_MEM:
+		/* mov k(%rsp), %r9d */
+		BJ(c, 0x44, 0x8b, 0x4c, 0x24, BJ_MEM(k));
+		break;
+
+	case BPF_ST:
+		BJ(c, 0x89, 0x44, 0x24, BJ_MEM(k));	/* mov %eax, k(%rsp) */
+		break;
+
+	case BPF_STX:
+		/* mov %r9d, k(%rsp) */
+		BJ(c, 0x44, 0x89, 0x4c, 0x24, BJ_MEM(k));
+		break;
+
+	case BPF_JMP|BPF_JA:
+		BJ_JMP(c, c->bjc_addrs[i + 1 + k]);
+		break;
+
+	case BPF_JMP|BPF_JGT|BPF_K:
+	case BPF_JMP|BPF_JGE|BPF_K:
+	case BPF_JMP|BPF_JEQ|BPF_K:
+		BJ(c, 0x3d);				/* cmp $k, %eax */
+		bj_imm32(c, k);
+		goto jcc;
+
+	case BPF_JMP|BPF_JSET|BPF_K:
+		BJ(c, 0xa9);				/* test $k, %eax */
+		bj_imm32(c, k);
+		goto jcc;
+
+	case BPF_JMP|BPF_JGT|BPF_X:
+	case BPF_JMP|BPF_JGE|BPF_X:
+	case BPF_JMP|BPF_JEQ|BPF_X:
+		BJ(c, 0x44, 0x39, 0xc8);		/* cmp %r9d, %eax */
+		goto jcc;
+
+	case BPF_JMP|BPF_JSET|BPF_X:
+		BJ(c, 0x44, 0x85, 0xc8);		/* test %r9d, %eax */
+	jcc:
+		switch (BPF_OP(pc->code)) {
+		case BPF_JGT:
+			bj_cond(c, pc, i + 1, BJ_JA, BJ_JBE);
+			break;
+		case BPF_JGE:
+			bj_cond(c, pc, i + 1, BJ_JAE, BJ_JB);
+			break;
+		case BPF_JEQ:
+			bj_cond(c, pc, i + 1, BJ_JE, BJ_JNE);
+			break;
+		case BPF_JSET:
+			bj_cond(c, pc, i + 1, BJ_JNE, BJ_JE);
+			break;
+		}
+		break;
+
+	case BPF_ALU|BPF_ADD|BPF_X:
+		BJ(c, 0x44, 0x01, 0xc8);		/* add %r9d, %eax */
+		break;
+
+	case BPF_ALU|BPF_SUB|BPF_X:
+		BJ(c, 0x44, 0x29, 0xc8);		/* sub %r9d, %eax */
+		break;
+
+	case BPF_ALU|BPF_MUL|BPF_X:
+		BJ(c, 0x41, 0x0f, 0xaf, 0xc1);	/* imul %r9d, %eax */
+		break;
+
+	case BPF_ALU|BPF_DIV|BPF_X:
+		BJ(c, 0x45, 0x85, 0xc9);		/* test %r9d, %r9d */
+		BJ_JCC(c, BJ_JE, c->bjc_fail);
+		BJ(c, 0x31, 0xd2);			/* xor %edx, %edx */
+		BJ(c, 0x41, 0xf7, 0xf1);		/* div %r9d */
+		break;
+
+	case BPF_ALU|BPF_AND|BPF_X:
+		BJ(c, 0x44, 0x21, 0xc8);		/* and %r9d, %eax */
+		break;
+
+	case BPF_ALU|BPF_OR|BPF_X:
+		BJ(c, 0x44, 0x09, 0xc8);		/* or %r9d, %eax */
+		break;
+
+	case BPF_ALU|BPF_LSH|BPF_X:
+		BJ(c, 0x44, 0x89, 0xc9);		/* mov %r9d, %ecx */
+		BJ(c, 0xd3, 0xe0);			/* shl %cl, %eax */
+		break;
+
+	case BPF_ALU|BPF_RSH|BPF_X:
+		BJ(c, 0x44, 0x89, 0xc9);		/* mov %r9d, %ecx */
+		BJ(c, 0xd3, 0xe8);			/* shr %cl, %eax */
+		break;
+
+	case BPF_ALU|BPF_ADD|BPF_K:
+		BJ(c, 0x05);				/* add $k, %eax */
+		bj_imm32(c, k);
+		break;
+
+	case BPF_ALU|BPF_SUB|BPF_K:
+		BJ(c, 0x2d);				/* sub $k, %eax */
+		bj_imm32(c, k);
+		break;
+
+	case BPF_ALU|BPF_MUL|BPF_K:
+		BJ(c, 0x69, 0xc0);			/* imul $k, %eax */
+		bj_imm32(c, k);
+		break;
+
+	case BPF_ALU|BPF_DIV|BPF_K:
+		if (k == 0) {
+			/* ip_bpf_validate() doesn't allow this */
+			BJ_JMP(c, c->bjc_fail);
+			break;
+		}
+		BJ(c, 0x31, 0xd2);			/* xor %edx, %edx */
+		BJ(c, 0xb9);				/* mov $k, %ecx */
+		bj_imm32(c, k);
+		BJ(c, 0xf7, 0xf1);			/* div %ecx */
+		break;
+
+	case BPF_ALU|BPF_AND|BPF_K:
+		BJ(c, 0x25);				/* and $k, %eax */
+		bj_imm32(c, k);
+		break;
+
+	case BPF_ALU|BPF_OR|BPF_K:
+		BJ(c, 0x0d);				/* or $k, %eax */
+		bj_imm32(c, k);
+		break;
+
+	/*
+	 * The processor masks the shift count just as it does for the
+	 * interpreter's shifts by X.
+	 */
+	case BPF_ALU|BPF_LSH|BPF_K:
+		BJ(c, 0xc1, 0xe0, k & 0x1f);		/* shl $k, %eax */
+		break;
+
+	case BPF_ALU|BPF_RSH|BPF_K:
+		BJ(c, 0xc1, 0xe8, k & 0x1f);		/* shr $k, %eax */
+		break;
+
+	case BPF_ALU|BPF_NEG:
+		BJ(c, 0xf7, 0xd8);			/* neg %eax */
+		break;
+
+	case BPF_MISC|BPF_TAX:
+		BJ(c, 0x41, 0x89, 0xc1);		/* mov %eax, %r9d */
+		break;
+
+	case BPF_MISC|BPF_TXA:
+		BJ(c, 0x44, 0x89, 0xc8);		/* mov %r9d, %eax */
+		break;
+	}
+}
+
+static void
+bj_program(ip_bpf_jit_ctx_t *c, const ip_bpf_insn_t *f, uint_t len)
+{
+	uint_t i;
+
+	c->bjc_off = 0;
+	BJ(c, 0x48, 0x83, 0xec, BJ_FRAME);	/* sub $BJ_FRAME, %rsp */
+	BJ(c, 0x41, 0x89, 0xd0);		/* mov %edx, %r8d */
+	BJ(c, 0x31, 0xc0);			/* xor %eax, %eax */
+	BJ(c, 0x45, 0x31, 0xc9);		/* xor %r9d, %r9d */
+	for (i = 0; i < len; i++) {
+		c->bjc_addrs[i] = c->bjc_off;
+		bj_insn(c, &f[i], i);
+	}
+	c->bjc_fail = c->bjc_off;
+	BJ(c, 0x31, 0xc0);			/* xor %eax, %eax */
+	bj_return(c);
+}
+
+#endif	/* __amd64 */
+
+/*
+ * Compile the validated program f, of len instructions.  Returns NULL if
+ * it can't be, in which case callers use the interpreter.
+ */
+ip_bpf_jit_t *
+ip_bpf_jit(ip_bpf_insn_t *f, uint_t len)
+{
+#if defined(__amd64)
+	ip_bpf_jit_ctx_t c;
+	ip_bpf_jit_t *jit;
+	size_t size;
+
+	if (!ip_bpf_jit_enable || len == 0 || len > BPF_MAXINSNS)
+		return (NULL);
+
+	bzero(&c, sizeof (c));
+	c.bjc_addrs = kmem_alloc(len * sizeof (size_t), KM_SLEEP);
+	bj_program(&c, f, len);		/* size it */
+
+	size = sizeof (ip_bpf_jit_t) + c.bjc_off;
+	jit = kmem_alloc(size, KM_SLEEP);
+	jit->ipbj_size = size;
+	c.bjc_buf = (uint8_t *)(jit + 1);
+	bj_program(&c, f, len);
+	ASSERT3U(sizeof (ip_bpf_jit_t) + c.bjc_off, ==, size);
+	jit->ipbj_func = (ip_bpf_jit_fn_t)(uintptr_t)c.bjc_buf;
+
+	kmem_free(c.bjc_addrs, len * sizeof (size_t));
+	return (jit);
+#else
+	return (NULL);
+#endif
+}
+
+void
+ip_bpf_jit_free(ip_bpf_jit_t *jit)
+{
+	if (jit != NULL)
+		kmem_free(jit, jit->ipbj_size);
+}
+
+/*
+ * Run the filter: compiled, if jit is non-NULL and the packet is
+ * contiguous, and otherwise by interpreting pc.  The arguments are as for
+ * ip_bpf_filter().
+ */
+uint32_t
+ip_bpf_jit_filter(ip_bpf_jit_t *jit, ip_bpf_insn_t *pc, uchar_t *p,
+    uint_t wirelen, uint_t buflen)
+{
+	mblk_t *mp;
+
+	if (jit == NULL)
+		return (ip_bpf_filter(pc, p, wirelen, buflen));
+
+	if (buflen == 0) {
+		mp = (mblk_t *)p;
+		if (mp->b_cont != NULL)
+			return (ip_bpf_filter(pc, p, wirelen, buflen));
+		p = mp->b_rptr;
+		buflen = MBLKL(mp);
+	}
+	return (jit->ipbj_func(p, wirelen, buflen));
+}
+
+#endif	/* _KERNEL */
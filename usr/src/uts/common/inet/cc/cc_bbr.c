@@ -0,0 +1,558 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2020 Joyent, Inc.
+ */
+
+/*
+ * BBR congestion control, after "BBR: Congestion-Based Congestion Control"
+ * by Cardwell, Cheng, Gunn, Yeganeh and Jacobson (ACM Queue, 2016) and
+ * draft-cardwell-iccrg-bbr-congestion-control.
+ *
+ * Rather than treating loss as the signal of congestion, BBR builds a model
+ * of the path from two estimates: the bottleneck bandwidth (BtlBw), the
+ * windowed maximum of the delivery rate, and the round-trip propagation time
+ * (RTprop), the windowed minimum of the RTT.  It paces transmissions at
+ * pacing_gain * BtlBw and bounds the data in flight to cwnd_gain * BDP,
+ * where BDP = BtlBw * RTprop.  The gains depend on the state BBR is in:
+ *
+ *  STARTUP	Grow the sending rate exponentially, like slow start, until
+ *		the bandwidth estimate stops growing for a few rounds.
+ *  DRAIN	Drain the queue created during STARTUP.
+ *  PROBE_BW	Cycle the pacing gain around 1 to probe for more bandwidth
+ *		and then drain any queue that probing built up.
+ *  PROBE_RTT	If RTprop has not been refreshed for a while, briefly cut
+ *		the data in flight to a few segments to measure it again.
+ *
+ * The delivery rate is sampled once per round trip, as the data acknowledged
+ * during the round divided by the duration of the round.  That is coarser
+ * than the per-packet rate sampling of the reference implementation, but it
+ * needs no per-segment state in TCP.  RTprop is taken from TCP's own RTT
+ * samples.
+ *
+ * BBR sets tcp_pacing_rate, and TCP paces its transmissions accordingly; see
+ * tcp_wput_data().
+ */
+
+#include <sys/errno.h>
+#include <sys/types.h>
+#include <sys/kmem.h>
+#include <sys/ddi.h>
+#include <sys/sunddi.h>
+#include <sys/modctl.h>
+#include <sys/time.h>
+
+#include <inet/tcp_impl.h>
+#include <inet/cc.h>
+#include <inet/cc/cc_module.h>
+
+static struct modlmisc cc_bbr_modlmisc = {
+	&mod_miscops,
+	"BBR Congestion Control"
+};
+
+static struct modlinkage cc_bbr_modlinkage = {
+	MODREV_1,
+	&cc_bbr_modlmisc,
+	NULL
+};
+
+static void	bbr_ack_received(struct cc_var *ccv, uint16_t type);
+static void	bbr_after_idle(struct cc_var *ccv);
+static void	bbr_cb_destroy(struct cc_var *ccv);
+static int	bbr_cb_init(struct cc_var *ccv);
+static void	bbr_cong_signal(struct cc_var *ccv, uint32_t type);
+static void	bbr_conn_init(struct cc_var *ccv);
+static void	bbr_post_recovery(struct cc_var *ccv);
+
+/* Gains are fixed point with BBR_SCALE bits of fraction. */
+#define	BBR_SCALE		8
+#define	BBR_UNIT		(1 << BBR_SCALE)
+
+/* 2/ln(2), the smallest gain that doubles the rate every round. */
+#define	BBR_HIGH_GAIN		(BBR_UNIT * 2885 / 1000 + 1)
+#define	BBR_DRAIN_GAIN		(BBR_UNIT * 1000 / 2885)
+#define	BBR_CWND_GAIN		(BBR_UNIT * 2)
+
+/* Number of phases in the PROBE_BW pacing gain cycle. */
+#define	BBR_CYCLE_LEN		8
+
+/* Rounds over which the maximum delivery rate is tracked. */
+#define	BBR_BW_ROUNDS		10
+
+/* STARTUP ends once BtlBw grows by less than 25% for three rounds. */
+#define	BBR_FULL_BW_THRESH	(BBR_UNIT * 5 / 4)
+#define	BBR_FULL_BW_ROUNDS	3
+
+/* RTprop lifetime, and how long PROBE_RTT holds the window down. */
+#define	BBR_MIN_RTT_WIN		(10 * NANOSEC)
+#define	BBR_PROBE_RTT_TIME	(200 * (NANOSEC / MILLISEC))
+
+/* Smallest congestion window, in segments. */
+#define	BBR_MIN_CWND_SEGS	4
+
+/* Pace slightly below the estimated bandwidth to avoid building queues. */
+#define	BBR_PACING_MARGIN_PCT	1
+
+typedef enum bbr_mode {
+	BBR_STARTUP,
+	BBR_DRAIN,
+	BBR_PROBE_BW,
+	BBR_PROBE_RTT
+} bbr_mode_t;
+
+static const uint32_t bbr_pacing_gain[BBR_CYCLE_LEN] = {
+	BBR_UNIT * 5 / 4,	/* probe for more bandwidth */
+	BBR_UNIT * 3 / 4,	/* drain the queue probing created */
+	BBR_UNIT, BBR_UNIT, BBR_UNIT,	/* cruise at the estimated rate */
+	BBR_UNIT, BBR_UNIT, BBR_UNIT
+};
+
+struct bbr {
+	bbr_mode_t	mode;
+	uint32_t	pacing_gain;
+	uint32_t	cwnd_gain;
+	/* Delivery rate samples (bytes/sec) of the last BBR_BW_ROUNDS. */
+	uint64_t	bw_samples[BBR_BW_ROUNDS];
+	/* Windowed maximum of bw_samples: the BtlBw estimate. */
+	uint64_t	btl_bw;
+	/* Windowed minimum RTT: the RTprop estimate, and when it was set. */
+	hrtime_t	min_rtt;
+	hrtime_t	min_rtt_stamp;
+	/* The tcp_rtt_update count of the last RTT sample looked at. */
+	uint32_t	rtt_update;
+	/* Round trip accounting. */
+	uint32_t	round_count;
+	uint32_t	round_end_seq;
+	hrtime_t	round_start;
+	uint64_t	round_delivered;
+	boolean_t	round_active;
+	boolean_t	round_app_limited;
+	/* STARTUP exit detection. */
+	uint64_t	full_bw;
+	uint32_t	full_bw_count;
+	boolean_t	filled_pipe;
+	/* PROBE_BW gain cycling. */
+	uint32_t	cycle_idx;
+	hrtime_t	cycle_stamp;
+	/* PROBE_RTT. */
+	hrtime_t	probe_rtt_done;
+	uint32_t	probe_rtt_round;
+	/* cwnd before loss recovery or PROBE_RTT cut it back. */
+	uint32_t	prior_cwnd;
+};
+
+struct cc_algo bbr_cc_algo = {
+	.name = "bbr",
+	.ack_received = bbr_ack_received,
+	.after_idle = bbr_after_idle,
+	.cb_destroy = bbr_cb_destroy,
+	.cb_init = bbr_cb_init,
+	.cong_signal = bbr_cong_signal,
+	.conn_init = bbr_conn_init,
+	.post_recovery = bbr_post_recovery,
+};
+
+int
+_init(void)
+{
+	int err;
+
+	if ((err = cc_register_algo(&bbr_cc_algo)) == 0) {
+		if ((err = mod_install(&cc_bbr_modlinkage)) != 0)
+			(void) cc_deregister_algo(&bbr_cc_algo);
+	}
+	return (err);
+}
+
+int
+_fini(void)
+{
+	/* XXX Not unloadable for now */
+	return (EBUSY);
+}
+
+int
+_info(struct modinfo *modinfop)
+{
+	return (mod_info(&cc_bbr_modlinkage, modinfop));
+}
+
+static uint32_t
+bbr_inflight(struct cc_var *ccv)
+{
+	return (CCV(ccv, tcp_snxt) - CCV(ccv, tcp_suna));
+}
+
+/*
+ * The window needed to keep the path full at gain times the BtlBw, or zero
+ * until there are estimates of both BtlBw and RTprop.
+ */
+static uint32_t
+bbr_target_cwnd(struct cc_var *ccv, uint32_t gain)
+{
+	struct bbr *bbr = ccv->cc_data;
+	uint64_t bdp;
+	uint32_t mss = CCV(ccv, tcp_mss);
+
+	if (bbr->btl_bw == 0 || bbr->min_rtt == 0)
+		return (0);
+
+	bdp = bbr->btl_bw * bbr->min_rtt / NANOSEC;
+	bdp = (bdp * gain) >> BBR_SCALE;
+	/* Leave room for the segments the receiver's delayed ACKs hold. */
+	bdp += 3 * mss;
+	bdp = MAX(bdp, BBR_MIN_CWND_SEGS * mss);
+	return ((uint32_t)MIN(bdp, CCV(ccv, tcp_cwnd_max)));
+}
+
+static void
+bbr_set_pacing_rate(struct cc_var *ccv)
+{
+	struct bbr *bbr = ccv->cc_data;
+	uint64_t rate;
+
+	if (bbr->btl_bw != 0) {
+		rate = (bbr->btl_bw * bbr->pacing_gain) >> BBR_SCALE;
+	} else if (CCV(ccv, tcp_rtt_last) != 0) {
+		/* No bandwidth sample yet: spread cwnd over the RTT. */
+		rate = (uint64_t)CCV(ccv, tcp_cwnd) * NANOSEC /
+		    CCV(ccv, tcp_rtt_last);
+		rate = (rate * bbr->pacing_gain) >> BBR_SCALE;
+	} else {
+		return;
+	}
+	rate = rate * (100 - BBR_PACING_MARGIN_PCT) / 100;
+
+	/* Never stop the connection outright. */
+	CCV(ccv, tcp_pacing_rate) = MAX(rate, 1);
+}
+
+static void
+bbr_enter_probe_bw(struct bbr *bbr, hrtime_t now)
+{
+	bbr->mode = BBR_PROBE_BW;
+	bbr->cwnd_gain = BBR_CWND_GAIN;
+	/*
+	 * Start at a random phase other than the 3/4 one, so that flows
+	 * sharing a bottleneck do not probe in lockstep.
+	 */
+	bbr->cycle_idx = (uint32_t)((now >> 10) % (BBR_CYCLE_LEN - 1));
+	if (bbr->cycle_idx >= 1)
+		bbr->cycle_idx++;
+	bbr->cycle_stamp = now;
+	bbr->pacing_gain = bbr_pacing_gain[bbr->cycle_idx];
+}
+
+/*
+ * Account for newly acknowledged data and, at the end of each round trip,
+ * take a delivery rate sample.  Returns B_TRUE when a round has just ended.
+ */
+static boolean_t
+bbr_update_round(struct cc_var *ccv, hrtime_t now)
+{
+	struct bbr *bbr = ccv->cc_data;
+	uint64_t bw;
+	hrtime_t elapsed;
+	int i;
+
+	bbr->round_delivered += ccv->bytes_this_ack;
+
+	if (!bbr->round_active) {
+		bbr->round_active = B_TRUE;
+		bbr->round_end_seq = CCV(ccv, tcp_snxt);
+		bbr->round_start = now;
+		bbr->round_delivered = 0;
+		bbr->round_app_limited = (CCV(ccv, tcp_unsent) == 0);
+		return (B_FALSE);
+	}
+	if (SEQ_LT(ccv->curack, bbr->round_end_seq))
+		return (B_FALSE);
+
+	elapsed = now - bbr->round_start;
+	if (elapsed > 0 && bbr->round_delivered > 0) {
+		bw = bbr->round_delivered * NANOSEC / elapsed;
+
+		/*
+		 * A round in which the application did not keep the pipe
+		 * full says little about the path unless it beat the
+		 * current estimate.
+		 */
+		if (!bbr->round_app_limited || bw > bbr->btl_bw) {
+			bbr->bw_samples[bbr->round_count % BBR_BW_ROUNDS] = bw;
+			bbr->btl_bw = 0;
+			for (i = 0; i < BBR_BW_ROUNDS; i++) {
+				bbr->btl_bw = MAX(bbr->btl_bw,
+				    bbr->bw_samples[i]);
+			}
+		}
+	}
+	bbr->round_count++;
+	/* Age out the sample of the round we are about to overwrite. */
+	bbr->bw_samples[bbr->round_count % BBR_BW_ROUNDS] = 0;
+
+	bbr->round_end_seq = CCV(ccv, tcp_snxt);
+	bbr->round_start = now;
+	bbr->round_delivered = 0;
+	bbr->round_app_limited = (CCV(ccv, tcp_unsent) == 0);
+	bbr->round_active = (bbr->round_end_seq != CCV(ccv, tcp_suna));
+	return (B_TRUE);
+}
+
+static void
+bbr_update_min_rtt(struct cc_var *ccv, hrtime_t now)
+{
+	struct bbr *bbr = ccv->cc_data;
+	hrtime_t rtt = CCV(ccv, tcp_rtt_last);
+	boolean_t expired;
+
+	expired = (now - bbr->min_rtt_stamp > BBR_MIN_RTT_WIN);
+	if (CCV(ccv, tcp_rtt_update) != bbr->rtt_update && rtt > 0) {
+		bbr->rtt_update = CCV(ccv, tcp_rtt_update);
+		if (bbr->min_rtt == 0 || rtt <= bbr->min_rtt ||
+		    (expired && bbr->mode != BBR_PROBE_RTT)) {
+			bbr->min_rtt = rtt;
+			bbr->min_rtt_stamp = now;
+			expired = B_FALSE;
+		}
+	}
+
+	if (expired && bbr->mode != BBR_PROBE_RTT && bbr->min_rtt != 0) {
+		bbr->mode = BBR_PROBE_RTT;
+		bbr->pacing_gain = BBR_UNIT;
+		bbr->cwnd_gain = BBR_UNIT;
+		bbr->prior_cwnd = MAX(bbr->prior_cwnd, CCV(ccv, tcp_cwnd));
+		bbr->probe_rtt_done = 0;
+	}
+}
+
+static void
+bbr_update_mode(struct cc_var *ccv, boolean_t round_end, hrtime_t now)
+{
+	struct bbr *bbr = ccv->cc_data;
+	uint32_t mss = CCV(ccv, tcp_mss);
+	uint32_t inflight = bbr_inflight(ccv);
+	uint32_t bdp = bbr_target_cwnd(ccv, BBR_UNIT);
+
+	/* Has the bandwidth estimate stopped growing? */
+	if (!bbr->filled_pipe && round_end && !bbr->round_app_limited) {
+		if (bbr->btl_bw >= (bbr->full_bw * BBR_FULL_BW_THRESH) >>
+		    BBR_SCALE) {
+			bbr->full_bw = bbr->btl_bw;
+			bbr->full_bw_count = 0;
+		} else if (++bbr->full_bw_count >= BBR_FULL_BW_ROUNDS) {
+			bbr->filled_pipe = B_TRUE;
+		}
+	}
+
+	switch (bbr->mode) {
+	case BBR_STARTUP:
+		if (bbr->filled_pipe) {
+			bbr->mode = BBR_DRAIN;
+			bbr->pacing_gain = BBR_DRAIN_GAIN;
+			bbr->cwnd_gain = BBR_HIGH_GAIN;
+		}
+		break;
+
+	case BBR_DRAIN:
+		if (inflight <= bdp)
+			bbr_enter_probe_bw(bbr, now);
+		break;
+
+	case BBR_PROBE_BW:
+		/*
+		 * Move to the next phase after one RTprop; leave the
+		 * draining phase early once the queue is gone.
+		 */
+		if (now - bbr->cycle_stamp > bbr->min_rtt ||
+		    (bbr->pacing_gain < BBR_UNIT && inflight <= bdp)) {
+			bbr->cycle_idx = (bbr->cycle_idx + 1) % BBR_CYCLE_LEN;
+			bbr->cycle_stamp = now;
+			bbr->pacing_gain = bbr_pacing_gain[bbr->cycle_idx];
+		}
+		break;
+
+	case BBR_PROBE_RTT:
+		/*
+		 * Hold the window at the minimum for BBR_PROBE_RTT_TIME and
+		 * at least one round once the data in flight has drained
+		 * down to it.
+		 */
+		if (bbr->probe_rtt_done == 0) {
+			if (inflight <= BBR_MIN_CWND_SEGS * mss) {
+				bbr->probe_rtt_done = now + BBR_PROBE_RTT_TIME;
+				bbr->probe_rtt_round = bbr->round_count;
+			}
+		} else if (now >= bbr->probe_rtt_done &&
+		    bbr->round_count != bbr->probe_rtt_round) {
+			bbr->min_rtt_stamp = now;
+			CCV(ccv, tcp_cwnd) = MAX(CCV(ccv, tcp_cwnd),
+			    bbr->prior_cwnd);
+			bbr->prior_cwnd = 0;
+			if (bbr->filled_pipe) {
+				bbr_enter_probe_bw(bbr, now);
+			} else {
+				bbr->mode = BBR_STARTUP;
+				bbr->pacing_gain = BBR_HIGH_GAIN;
+				bbr->cwnd_gain = BBR_HIGH_GAIN;
+			}
+		}
+		break;
+	}
+}
+
+static void
+bbr_set_cwnd(struct cc_var *ccv)
+{
+	struct bbr *bbr = ccv->cc_data;
+	uint32_t mss = CCV(ccv, tcp_mss);
+	uint32_t cwnd = CCV(ccv, tcp_cwnd);
+	uint32_t target;
+
+	if (bbr->mode == BBR_PROBE_RTT) {
+		CCV(ccv, tcp_cwnd) = MIN(cwnd, BBR_MIN_CWND_SEGS * mss);
+		return;
+	}
+
+	/*
+	 * Grow towards the target by the amount just delivered.  Before the
+	 * pipe is known to be full that is just slow start.
+	 */
+	target = bbr_target_cwnd(ccv, bbr->cwnd_gain);
+	if (bbr->filled_pipe && target != 0)
+		cwnd = MIN(cwnd + ccv->bytes_this_ack, target);
+	else if (target == 0 || cwnd < target)
+		cwnd += ccv->bytes_this_ack;
+
+	cwnd = MAX(cwnd, BBR_MIN_CWND_SEGS * mss);
+	CCV(ccv, tcp_cwnd) = MIN(cwnd, CCV(ccv, tcp_cwnd_max));
+}
+
+static void
+bbr_ack_received(struct cc_var *ccv, uint16_t type)
+{
+	struct bbr *bbr = ccv->cc_data;
+	hrtime_t now;
+	boolean_t round_end;
+
+	if (type != CC_ACK)
+		return;
+
+	now = gethrtime();
+	round_end = bbr_update_round(ccv, now);
+	bbr_update_min_rtt(ccv, now);
+	bbr_update_mode(ccv, round_end, now);
+
+	/* Packet conservation while TCP is recovering from a loss. */
+	if (!IN_RECOVERY(ccv->flags))
+		bbr_set_cwnd(ccv);
+	bbr_set_pacing_rate(ccv);
+}
+
+/*
+ * BBR does not slow down on loss or ECN, as its model already bounds the
+ * data in flight; it only holds off growing the window while TCP repairs
+ * the loss, and restarts from one segment after a retransmission timeout.
+ */
+static void
+bbr_cong_signal(struct cc_var *ccv, uint32_t type)
+{
+	struct bbr *bbr = ccv->cc_data;
+	uint32_t mss = CCV(ccv, tcp_mss);
+	uint32_t cwnd = CCV(ccv, tcp_cwnd);
+
+	switch (type) {
+	case CC_NDUPACK:
+		if (!IN_FASTRECOVERY(ccv->flags)) {
+			bbr->prior_cwnd = MAX(bbr->prior_cwnd, cwnd);
+			CCV(ccv, tcp_cwnd_ssthresh) = MAX(cwnd, 2 * mss);
+			CCV(ccv, tcp_cwnd) = MAX(bbr_inflight(ccv),
+			    BBR_MIN_CWND_SEGS * mss);
+			ENTER_RECOVERY(ccv->flags);
+		}
+		break;
+
+	case CC_ECN:
+		break;
+
+	case CC_RTO:
+		bbr->prior_cwnd = MAX(bbr->prior_cwnd, cwnd);
+		CCV(ccv, tcp_cwnd_ssthresh) = MAX(cwnd, 2 * mss);
+		CCV(ccv, tcp_cwnd) = mss;
+		/* The round in progress no longer measures anything. */
+		bbr->round_active = B_FALSE;
+		break;
+	}
+}
+
+static void
+bbr_post_recovery(struct cc_var *ccv)
+{
+	struct bbr *bbr = ccv->cc_data;
+
+	if (bbr->mode != BBR_PROBE_RTT && bbr->prior_cwnd != 0) {
+		CCV(ccv, tcp_cwnd) = MAX(CCV(ccv, tcp_cwnd), bbr->prior_cwnd);
+		bbr->prior_cwnd = 0;
+	}
+}
+
+/*
+ * Restarting after idle: keep the window, since the model still describes
+ * the path, but pace at the estimated bandwidth rather than probing so that
+ * the restart does not arrive as a burst.
+ */
+static void
+bbr_after_idle(struct cc_var *ccv)
+{
+	struct bbr *bbr = ccv->cc_data;
+
+	bbr->round_active = B_FALSE;
+	if (bbr->mode == BBR_PROBE_BW) {
+		bbr->pacing_gain = BBR_UNIT;
+		bbr_set_pacing_rate(ccv);
+	}
+}
+
+static int
+bbr_cb_init(struct cc_var *ccv)
+{
+	struct bbr *bbr;
+
+	bbr = kmem_zalloc(sizeof (struct bbr), KM_NOSLEEP);
+	if (bbr == NULL)
+		return (ENOMEM);
+
+	bbr->mode = BBR_STARTUP;
+	bbr->pacing_gain = BBR_HIGH_GAIN;
+	bbr->cwnd_gain = BBR_HIGH_GAIN;
+	bbr->min_rtt_stamp = gethrtime();
+
+	ccv->cc_data = bbr;
+	return (0);
+}
+
+static void
+bbr_cb_destroy(struct cc_var *ccv)
+{
+	if (ccv->cc_data != NULL)
+		kmem_free(ccv->cc_data, sizeof (struct bbr));
+
+	/* Stop pacing; the next algorithm may not want it. */
+	CCV(ccv, tcp_pacing_rate) = 0;
+}
+
+static void
+bbr_conn_init(struct cc_var *ccv)
+{
+	/* STARTUP grows the window itself; don't let slow start end it. */
+	CCV(ccv, tcp_cwnd_ssthresh) = CCV(ccv, tcp_cwnd_max);
+}
@@ -22,6 +22,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 #ifndef _INET_ILB_H
 #define	_INET_ILB_H
@@ -61,7 +62,8 @@ typedef enum {
 	ILB_ALG_IMPL_ROUNDROBIN = 1,
 	ILB_ALG_IMPL_HASH_IP,
 	ILB_ALG_IMPL_HASH_IP_SPORT,
-	ILB_ALG_IMPL_HASH_IP_VIP
+	ILB_ALG_IMPL_HASH_IP_VIP,
+	ILB_ALG_IMPL_MAGLEV
 } ilb_algo_impl_t;
 
 /* Supported load balancing method */
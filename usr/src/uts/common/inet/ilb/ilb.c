@@ -22,6 +22,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/sysmacros.h>
@@ -726,6 +727,13 @@ ilb_rule_add(ilb_stack_t *ilbs, zoneid_t zoneid, const ilb_rule_cmd_t *cmd)
 		}
 		rule->ir_alg_type = cmd->algo;
 		break;
+	case ILB_ALG_IMPL_MAGLEV:
+		if ((rule->ir_alg = ilb_alg_maglev_init(rule, NULL)) == NULL) {
+			ret = ENOMEM;
+			goto error;
+		}
+		rule->ir_alg_type = ILB_ALG_IMPL_MAGLEV;
+		break;
 	default:
 		ret = EINVAL;
 		goto error;
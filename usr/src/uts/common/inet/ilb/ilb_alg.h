@@ -22,6 +22,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef _INET_ILB_ALG_H
@@ -35,6 +36,7 @@ extern "C" {
 /* Load balance algorithms initialization routines. */
 ilb_alg_data_t *ilb_alg_rr_init(ilb_rule_t *, void *);
 ilb_alg_data_t *ilb_alg_hash_init(ilb_rule_t *, const void *);
+ilb_alg_data_t *ilb_alg_maglev_init(ilb_rule_t *, const void *);
 
 
 #ifdef __cplusplus
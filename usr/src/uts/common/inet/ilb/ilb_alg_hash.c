@@ -22,10 +22,12 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/types.h>
 #include <sys/cmn_err.h>
+#include <sys/cpuvar.h>
 #include <netinet/in.h>
 #include <inet/ip.h>
 #include <inet/ip6.h>
@@ -429,3 +431,444 @@ hash_fini(ilb_alg_data_t **alg)
 	kmem_free(*alg, sizeof (ilb_alg_data_t));
 	*alg = NULL;
 }
+
+/*
+ * Maglev consistent hashing.  Each server is given a permutation of the slots
+ * of a lookup table whose size is prime, determined by an offset and a skip
+ * derived from the server's address and port.  The enabled servers take turns
+ * claiming the next unclaimed slot in their permutation until the table is
+ * full, and a flow is mapped to a server by hashing its 4-tuple into the
+ * table.  Since each server's permutation depends only on the server itself,
+ * adding, removing, enabling or disabling a server only moves the flows of
+ * the slots which change hands, roughly 1/N of them.  This matters most for
+ * DSR rules, which keep no connection state and so rely on the hash alone to
+ * keep a flow on the same server.
+ *
+ * The lookup table is rebuilt off to the side whenever the set of enabled
+ * servers changes, and is then published with a pointer swap.  A lookup only
+ * holds the lock of the CPU it is running on (mg_cpulock) while it reads the
+ * current table, and publishing a table acquires all of these locks, so the
+ * old table can be freed as soon as the swap is done and the lookups of
+ * different CPUs never contend with each other.
+ */
+uint32_t ilb_maglev_tbl_size = 65537;
+
+#define	MAGLEV_DEF_TBL_SIZE	65537
+#define	MAGLEV_MIN_TBL_SIZE	251
+#define	MAGLEV_MAX_TBL_SIZE	(1 << 24)
+
+#define	MAGLEV_SKIP_SEED	0x9e3779b97f4a7c15ULL
+
+typedef struct maglev_server_s {
+	ilb_server_t	*ms_server;
+	boolean_t	ms_enabled;
+	uint32_t	ms_offset;		/* first slot in permutation */
+	uint32_t	ms_skip;		/* distance between slots */
+} maglev_server_t;
+
+typedef struct maglev_tbl_s {
+	uint32_t	mt_size;		/* number of slots */
+	ilb_server_t	*mt_slot[1];
+} maglev_tbl_t;
+
+#define	MAGLEV_TBL_MEMSIZE(size)	\
+	(sizeof (maglev_tbl_t) + ((size) - 1) * sizeof (ilb_server_t *))
+
+typedef union maglev_cpulock_u {
+	kmutex_t	mcl_lock;
+	char		mcl_pad[64];		/* one cache line per CPU */
+} maglev_cpulock_t;
+
+typedef struct maglev_s {
+	kmutex_t	mg_lock;		/* serializes updates */
+	uint32_t	mg_tbl_size;		/* slots in lookup tables */
+	size_t		mg_servers;		/* # of servers */
+	size_t		mg_srv_tbl_size;	/* size of mg_srv_tbl */
+	maglev_server_t	*mg_srv_tbl;		/* all servers */
+	maglev_tbl_t	*mg_tbl;		/* current lookup table */
+	uint_t		mg_ncpulocks;
+	maglev_cpulock_t *mg_cpulock;		/* protects mg_tbl */
+} maglev_t;
+
+static void maglev_fini(ilb_alg_data_t **);
+
+static uint64_t
+maglev_mix(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return (x);
+}
+
+static uint64_t
+maglev_hash(const in6_addr_t *addr, uint64_t seed)
+{
+	const uint32_t *w = addr->s6_addr32;
+	uint64_t h;
+
+	h = maglev_mix(seed ^ (((uint64_t)w[0] << 32) | w[1]));
+	h = maglev_mix(h ^ (((uint64_t)w[2] << 32) | w[3]));
+	return (h);
+}
+
+static boolean_t
+maglev_is_prime(uint32_t n)
+{
+	uint32_t d;
+
+	if (n < 2 || (n % 2) == 0)
+		return (n == 2);
+	for (d = 3; d <= n / d; d += 2) {
+		if ((n % d) == 0)
+			return (B_FALSE);
+	}
+	return (B_TRUE);
+}
+
+static boolean_t
+maglev_lb(in6_addr_t *saddr, in_port_t sport, in6_addr_t *daddr,
+    in_port_t dport, void *alg_data, ilb_server_t **ret_server)
+{
+	maglev_t *mg = (maglev_t *)alg_data;
+	maglev_tbl_t *tbl;
+	kmutex_t *lock;
+	uint64_t h;
+
+	ASSERT(ret_server != NULL);
+	*ret_server = NULL;
+
+	h = maglev_hash(saddr, ((uint32_t)sport << 16) | dport);
+	h = maglev_hash(daddr, h);
+
+	/*
+	 * It does not matter if we migrate to another CPU after picking the
+	 * lock; publishing a table holds all of them.
+	 */
+	lock = &mg->mg_cpulock[CPU->cpu_seqid % mg->mg_ncpulocks].mcl_lock;
+	mutex_enter(lock);
+	if ((tbl = mg->mg_tbl) != NULL)
+		*ret_server = tbl->mt_slot[h % tbl->mt_size];
+	mutex_exit(lock);
+
+	return (*ret_server != NULL);
+}
+
+/*
+ * Build a lookup table from the currently enabled servers.  If no server is
+ * enabled, the new table is NULL.
+ */
+static int
+maglev_build(maglev_t *mg, maglev_tbl_t **ret_tbl)
+{
+	maglev_tbl_t *tbl;
+	maglev_server_t *ms;
+	uint32_t size = mg->mg_tbl_size;
+	uint32_t *pos, filled, c;
+	size_t i, enabled;
+
+	ASSERT(MUTEX_HELD(&mg->mg_lock));
+	*ret_tbl = NULL;
+
+	for (i = 0, enabled = 0; i < mg->mg_servers; i++) {
+		if (mg->mg_srv_tbl[i].ms_enabled)
+			enabled++;
+	}
+	if (enabled == 0)
+		return (0);
+
+	if ((tbl = kmem_zalloc(MAGLEV_TBL_MEMSIZE(size), KM_NOSLEEP)) == NULL)
+		return (ENOMEM);
+	if ((pos = kmem_alloc(sizeof (uint32_t) * mg->mg_servers,
+	    KM_NOSLEEP)) == NULL) {
+		kmem_free(tbl, MAGLEV_TBL_MEMSIZE(size));
+		return (ENOMEM);
+	}
+	tbl->mt_size = size;
+	for (i = 0; i < mg->mg_servers; i++)
+		pos[i] = mg->mg_srv_tbl[i].ms_offset;
+
+	/*
+	 * Since size is prime and each skip is less than size, every server's
+	 * permutation visits every slot, so the inner loop always finds a
+	 * free slot while the table is not full.
+	 */
+	filled = 0;
+	for (;;) {
+		for (i = 0; i < mg->mg_servers; i++) {
+			ms = &mg->mg_srv_tbl[i];
+			if (!ms->ms_enabled)
+				continue;
+			do {
+				c = pos[i];
+				pos[i] = (pos[i] + ms->ms_skip) % size;
+			} while (tbl->mt_slot[c] != NULL);
+			tbl->mt_slot[c] = ms->ms_server;
+			if (++filled == size)
+				goto done;
+		}
+	}
+done:
+	kmem_free(pos, sizeof (uint32_t) * mg->mg_servers);
+	*ret_tbl = tbl;
+	return (0);
+}
+
+static void
+maglev_publish(maglev_t *mg, maglev_tbl_t *tbl)
+{
+	maglev_tbl_t *old;
+	uint_t i;
+
+	ASSERT(MUTEX_HELD(&mg->mg_lock));
+
+	for (i = 0; i < mg->mg_ncpulocks; i++)
+		mutex_enter(&mg->mg_cpulock[i].mcl_lock);
+	old = mg->mg_tbl;
+	mg->mg_tbl = tbl;
+	for (i = 0; i < mg->mg_ncpulocks; i++)
+		mutex_exit(&mg->mg_cpulock[i].mcl_lock);
+
+	if (old != NULL)
+		kmem_free(old, MAGLEV_TBL_MEMSIZE(old->mt_size));
+}
+
+/*
+ * Rebuild and publish the lookup table after a change to the set of enabled
+ * servers.  If this fails, the current table is left in place and the caller
+ * must undo its change.
+ */
+static int
+maglev_update(maglev_t *mg)
+{
+	maglev_tbl_t *tbl;
+	int ret;
+
+	if ((ret = maglev_build(mg, &tbl)) != 0)
+		return (ret);
+	maglev_publish(mg, tbl);
+	return (0);
+}
+
+static maglev_server_t *
+maglev_find(maglev_t *mg, ilb_server_t *host, size_t *idx)
+{
+	size_t i;
+
+	for (i = 0; i < mg->mg_servers; i++) {
+		if (mg->mg_srv_tbl[i].ms_server == host) {
+			if (idx != NULL)
+				*idx = i;
+			return (&mg->mg_srv_tbl[i]);
+		}
+	}
+	return (NULL);
+}
+
+static int
+maglev_server_del(ilb_server_t *host, void *alg_data)
+{
+	maglev_t *mg = (maglev_t *)alg_data;
+	maglev_server_t *ms;
+	boolean_t enabled;
+	size_t i;
+	int ret;
+
+	mutex_enter(&mg->mg_lock);
+
+	if ((ms = maglev_find(mg, host, &i)) == NULL) {
+		mutex_exit(&mg->mg_lock);
+		return (EINVAL);
+	}
+	enabled = ms->ms_enabled;
+	if (enabled) {
+		ms->ms_enabled = B_FALSE;
+		if ((ret = maglev_update(mg)) != 0) {
+			ms->ms_enabled = B_TRUE;
+			mutex_exit(&mg->mg_lock);
+			return (ret);
+		}
+	}
+
+	/* The new table no longer refers to the server; drop it. */
+	for (; i < mg->mg_servers - 1; i++)
+		mg->mg_srv_tbl[i] = mg->mg_srv_tbl[i + 1];
+	mg->mg_servers--;
+	bzero(&mg->mg_srv_tbl[mg->mg_servers], sizeof (maglev_server_t));
+
+	mutex_exit(&mg->mg_lock);
+	ILB_SERVER_REFRELE(host);
+	return (0);
+}
+
+static int
+maglev_server_add(ilb_server_t *host, void *alg_data)
+{
+	maglev_t *mg = (maglev_t *)alg_data;
+	maglev_server_t *ms, *new_tbl;
+	uint32_t size = mg->mg_tbl_size;
+	uint64_t seed;
+	int ret;
+
+	mutex_enter(&mg->mg_lock);
+
+	if (mg->mg_servers == mg->mg_srv_tbl_size) {
+		if ((new_tbl = kmem_zalloc(sizeof (maglev_server_t) *
+		    (mg->mg_srv_tbl_size + INIT_HASH_TBL_SIZE),
+		    KM_NOSLEEP)) == NULL) {
+			mutex_exit(&mg->mg_lock);
+			return (ENOMEM);
+		}
+		bcopy(mg->mg_srv_tbl, new_tbl,
+		    sizeof (maglev_server_t) * mg->mg_servers);
+		kmem_free(mg->mg_srv_tbl,
+		    sizeof (maglev_server_t) * mg->mg_srv_tbl_size);
+		mg->mg_srv_tbl = new_tbl;
+		mg->mg_srv_tbl_size += INIT_HASH_TBL_SIZE;
+	}
+
+	seed = host->iser_min_port;
+	ms = &mg->mg_srv_tbl[mg->mg_servers];
+	ms->ms_server = host;
+	ms->ms_enabled = host->iser_enabled;
+	ms->ms_offset = maglev_hash(&host->iser_addr_v6, seed) % size;
+	ms->ms_skip = maglev_hash(&host->iser_addr_v6,
+	    seed ^ MAGLEV_SKIP_SEED) % (size - 1) + 1;
+	mg->mg_servers++;
+
+	if (host->iser_enabled && (ret = maglev_update(mg)) != 0) {
+		mg->mg_servers--;
+		bzero(ms, sizeof (maglev_server_t));
+		mutex_exit(&mg->mg_lock);
+		return (ret);
+	}
+
+	mutex_exit(&mg->mg_lock);
+	ILB_SERVER_REFHOLD(host);
+	return (0);
+}
+
+static int
+maglev_server_set(ilb_server_t *host, void *alg_data, boolean_t enable)
+{
+	maglev_t *mg = (maglev_t *)alg_data;
+	maglev_server_t *ms;
+	int ret;
+
+	mutex_enter(&mg->mg_lock);
+
+	if ((ms = maglev_find(mg, host, NULL)) == NULL) {
+		mutex_exit(&mg->mg_lock);
+		return (EINVAL);
+	}
+	if (ms->ms_enabled == enable) {
+		mutex_exit(&mg->mg_lock);
+		return (0);
+	}
+
+	ms->ms_enabled = enable;
+	if ((ret = maglev_update(mg)) != 0)
+		ms->ms_enabled = !enable;
+
+	mutex_exit(&mg->mg_lock);
+	return (ret);
+}
+
+static int
+maglev_server_enable(ilb_server_t *host, void *alg_data)
+{
+	return (maglev_server_set(host, alg_data, B_TRUE));
+}
+
+static int
+maglev_server_disable(ilb_server_t *host, void *alg_data)
+{
+	return (maglev_server_set(host, alg_data, B_FALSE));
+}
+
+/* ARGSUSED */
+ilb_alg_data_t *
+ilb_alg_maglev_init(ilb_rule_t *rule, const void *arg)
+{
+	ilb_alg_data_t	*alg;
+	maglev_t	*mg;
+	uint32_t	size = ilb_maglev_tbl_size;
+	uint_t		i;
+
+	if (size < MAGLEV_MIN_TBL_SIZE || size > MAGLEV_MAX_TBL_SIZE ||
+	    !maglev_is_prime(size)) {
+		cmn_err(CE_WARN, "ilb: ilb_maglev_tbl_size %u is not a prime "
+		    "between %u and %u, using %u", size, MAGLEV_MIN_TBL_SIZE,
+		    MAGLEV_MAX_TBL_SIZE, MAGLEV_DEF_TBL_SIZE);
+		size = MAGLEV_DEF_TBL_SIZE;
+	}
+
+	if ((alg = kmem_alloc(sizeof (ilb_alg_data_t), KM_NOSLEEP)) == NULL)
+		return (NULL);
+	if ((mg = kmem_zalloc(sizeof (maglev_t), KM_NOSLEEP)) == NULL) {
+		kmem_free(alg, sizeof (ilb_alg_data_t));
+		return (NULL);
+	}
+	mg->mg_srv_tbl = kmem_zalloc(sizeof (maglev_server_t) *
+	    INIT_HASH_TBL_SIZE, KM_NOSLEEP);
+	mg->mg_ncpulocks = max_ncpus;
+	mg->mg_cpulock = kmem_zalloc(sizeof (maglev_cpulock_t) *
+	    mg->mg_ncpulocks, KM_NOSLEEP);
+	if (mg->mg_srv_tbl == NULL || mg->mg_cpulock == NULL) {
+		if (mg->mg_srv_tbl != NULL) {
+			kmem_free(mg->mg_srv_tbl, sizeof (maglev_server_t) *
+			    INIT_HASH_TBL_SIZE);
+		}
+		if (mg->mg_cpulock != NULL) {
+			kmem_free(mg->mg_cpulock, sizeof (maglev_cpulock_t) *
+			    mg->mg_ncpulocks);
+		}
+		kmem_free(mg, sizeof (maglev_t));
+		kmem_free(alg, sizeof (ilb_alg_data_t));
+		return (NULL);
+	}
+
+	alg->ilb_alg_lb = maglev_lb;
+	alg->ilb_alg_server_del = maglev_server_del;
+	alg->ilb_alg_server_add = maglev_server_add;
+	alg->ilb_alg_server_enable = maglev_server_enable;
+	alg->ilb_alg_server_disable = maglev_server_disable;
+	alg->ilb_alg_fini = maglev_fini;
+	alg->ilb_alg_data = mg;
+
+	mutex_init(&mg->mg_lock, NULL, MUTEX_DEFAULT, NULL);
+	for (i = 0; i < mg->mg_ncpulocks; i++) {
+		mutex_init(&mg->mg_cpulock[i].mcl_lock, NULL, MUTEX_DEFAULT,
+		    NULL);
+	}
+	mg->mg_tbl_size = size;
+	mg->mg_srv_tbl_size = INIT_HASH_TBL_SIZE;
+
+	return (alg);
+}
+
+static void
+maglev_fini(ilb_alg_data_t **alg)
+{
+	maglev_t	*mg;
+	size_t		i;
+
+	mg = (*alg)->ilb_alg_data;
+	for (i = 0; i < mg->mg_servers; i++)
+		ILB_SERVER_REFRELE(mg->mg_srv_tbl[i].ms_server);
+
+	if (mg->mg_tbl != NULL)
+		kmem_free(mg->mg_tbl, MAGLEV_TBL_MEMSIZE(mg->mg_tbl->mt_size));
+	for (i = 0; i < mg->mg_ncpulocks; i++)
+		mutex_destroy(&mg->mg_cpulock[i].mcl_lock);
+	kmem_free(mg->mg_cpulock, sizeof (maglev_cpulock_t) *
+	    mg->mg_ncpulocks);
+	kmem_free(mg->mg_srv_tbl, sizeof (maglev_server_t) *
+	    mg->mg_srv_tbl_size);
+	mutex_destroy(&mg->mg_lock);
+	kmem_free(mg, sizeof (maglev_t));
+	kmem_free(*alg, sizeof (ilb_alg_data_t));
+	*alg = NULL;
+}
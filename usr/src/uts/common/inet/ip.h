@@ -552,6 +552,7 @@ extern	void ip_mcast_mapping(struct ill_s *, uchar_t *, uchar_t *);
 #define	DCEF_PMTU		0x0002	/* Different than interface MTU */
 #define	DCEF_UINFO		0x0004	/* dce_uinfo set */
 #define	DCEF_TOO_SMALL_PMTU	0x0008	/* Smaller than IPv4 MIN */
+#define	DCEF_FASTOPEN		0x0010	/* dce_fastopen_cookie set */
 
 #ifdef _KERNEL
 /*
@@ -2440,6 +2441,11 @@ struct ip_recv_attr_s {
 #define	IRA_FREE_CRED		0x00000001	/* ira_cred needs to be rele */
 #define	IRA_FREE_TSL		0x00000002	/* ira_tsl needs to be rele */
 
+/*
+ * The largest TCP Fast Open cookie (RFC 7413) we remember for a destination.
+ */
+#define	DCE_FASTOPEN_COOKIE_MAX	16
+
 /*
  * Optional destination cache entry for path MTU information,
  * and ULP metrics.
@@ -2451,6 +2457,8 @@ struct dce_s {
 	uint32_t	dce_pmtu;	/* Path MTU if DCEF_PMTU */
 	uint32_t	dce_ident;	/* Per destination IP ident. */
 	iulp_t		dce_uinfo;	/* Metrics if DCEF_UINFO */
+	uint8_t		dce_fastopen_len; /* TCP Fast Open cookie length */
+	uint8_t		dce_fastopen_cookie[DCE_FASTOPEN_COOKIE_MAX];
 
 	struct dce_s	*dce_next;
 	struct dce_s	**dce_ptpn;
@@ -3707,6 +3715,8 @@ extern int	dce_update_uinfo_v6(const in6_addr_t *, uint_t, iulp_t *,
     ip_stack_t *);
 extern int	dce_update_uinfo(const in6_addr_t *, uint_t, iulp_t *,
     ip_stack_t *);
+extern void	dce_set_fastopen_cookie(dce_t *, const uint8_t *, uint_t);
+extern uint_t	dce_get_fastopen_cookie(dce_t *, uint8_t *, uint_t);
 extern void	dce_increment_generation(dce_t *);
 extern void	dce_increment_all_generations(boolean_t, ip_stack_t *);
 extern void	dce_refrele(dce_t *);
@@ -3793,6 +3803,7 @@ extern int	inet_pton(int, char *, void *);
 #define	SQTAG_TCP_SHUTDOWN_OUTPUT	43
 #define	SQTAG_TCP_IXA_CLEANUP		44
 #define	SQTAG_TCP_SEND_SYNACK		45
+#define	SQTAG_TCP_FASTOPEN		46
 
 extern sin_t	sin_null;	/* Zero address for quick clears */
 extern sin6_t	sin6_null;	/* Zero address for quick clears */
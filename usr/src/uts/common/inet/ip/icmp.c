@@ -22,7 +22,7 @@
  * Copyright (c) 1991, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright (c) 2013 by Delphix. All rights reserved.
  * Copyright 2014, OmniTI Computer Consulting, Inc. All rights reserved.
- * Copyright (c) 2018, Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 /* Copyright (c) 1990 Mentat Inc. */
 
@@ -1023,6 +1023,8 @@ icmp_close_free(conn_t *connp)
 		kmem_free(icmp->icmp_bpf_prog, icmp->icmp_bpf_len);
 		icmp->icmp_bpf_len = 0;
 		icmp->icmp_bpf_prog = NULL;
+		ip_bpf_jit_free(icmp->icmp_bpf_jit);
+		icmp->icmp_bpf_jit = NULL;
 	}
 
 	/*
@@ -1983,6 +1985,7 @@ icmp_attach_filter(icmp_t *icmp, uint_t inlen, const uchar_t *invalp)
 {
 	struct bpf_program prog;
 	ip_bpf_insn_t *insns = NULL;
+	ip_bpf_jit_t *jit;
 	unsigned int size;
 
 #ifdef _LP64
@@ -2016,15 +2019,18 @@ icmp_attach_filter(icmp_t *icmp, uint_t inlen, const uchar_t *invalp)
 		kmem_free(insns, size);
 		return (EINVAL);
 	}
+	jit = ip_bpf_jit(insns, prog.bf_len);
 
 	rw_enter(&icmp->icmp_bpf_lock, RW_WRITER);
 	if (icmp->icmp_bpf_len != 0) {
 		ASSERT(icmp->icmp_bpf_prog != NULL);
 
 		kmem_free(icmp->icmp_bpf_prog, icmp->icmp_bpf_len);
+		ip_bpf_jit_free(icmp->icmp_bpf_jit);
 	}
 	icmp->icmp_bpf_len = size;
 	icmp->icmp_bpf_prog = insns;
+	icmp->icmp_bpf_jit = jit;
 	rw_exit(&icmp->icmp_bpf_lock);
 	return (0);
 }
@@ -2043,6 +2049,8 @@ icmp_detach_filter(icmp_t *icmp)
 		    icmp->icmp_bpf_len);
 		icmp->icmp_bpf_len = 0;
 		icmp->icmp_bpf_prog = NULL;
+		ip_bpf_jit_free(icmp->icmp_bpf_jit);
+		icmp->icmp_bpf_jit = NULL;
 		error = 0;
 	}
 	rw_exit(&icmp->icmp_bpf_lock);
@@ -2070,7 +2078,8 @@ icmp_eval_filter(icmp_t *icmp, mblk_t *mp, ip_recv_attr_t *ira)
 
 		wirelen = ntohs(ip6h->ip6_plen) + IPV6_HDR_LEN;
 	}
-	res = !ip_bpf_filter(icmp->icmp_bpf_prog, buf, wirelen, len);
+	res = !ip_bpf_jit_filter(icmp->icmp_bpf_jit, icmp->icmp_bpf_prog, buf,
+	    wirelen, len);
 	rw_exit(&icmp->icmp_bpf_lock);
 
 	return (res);
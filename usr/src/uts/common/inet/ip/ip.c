@@ -13931,6 +13931,8 @@ ip_kstat2_init(netstackid_t stackid, ip_stat_t *ip_statisticsp)
 		{ "conn_in_recvpktinfo",	KSTAT_DATA_UINT64 },
 		{ "conn_in_recvtclass",		KSTAT_DATA_UINT64 },
 		{ "conn_in_timestamp",		KSTAT_DATA_UINT64 },
+		{ "ipcl_conn_cache_hit",	KSTAT_DATA_UINT64 },
+		{ "ipcl_conn_cache_miss",	KSTAT_DATA_UINT64 },
 	};
 
 	ksp = kstat_create_netstack("ip", 0, "ipstat", "net",
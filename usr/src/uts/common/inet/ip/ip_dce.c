@@ -21,7 +21,7 @@
 
 /*
  * Copyright (c) 2009, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright (c) 2012, Joyent, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  * Copyright 2017, OmniTI Computer Consulting, Inc. All rights reserved.
  */
 
@@ -129,7 +129,8 @@ uint_t ip_dce_reclaim_threshold_hard = 2;
 
 /*
  * Reclaim a fraction of dce's in the dcb.
- * For now we have a higher probability to delete DCEs without DCE_PMTU.
+ * For now we have a higher probability to delete DCEs without DCE_PMTU
+ * or a TCP Fast Open cookie.
  */
 static void
 dcb_reclaim(dcb_t *dcb, ip_stack_t *ipst, uint_t fraction)
@@ -161,7 +162,7 @@ dcb_reclaim(dcb_t *dcb, ip_stack_t *ipst, uint_t fraction)
 		if (max == 0 || retained < max) {
 			hash = RANDOM_HASH((uint64_t)((uintptr_t)dce | seed));
 
-			if (dce->dce_flags & DCEF_PMTU) {
+			if (dce->dce_flags & (DCEF_PMTU | DCEF_FASTOPEN)) {
 				if (hash % fraction_pmtu != 0) {
 					retained++;
 					continue;
@@ -508,11 +509,61 @@ dce_lookup_v6(const in6_addr_t *dst, uint_t ifindex, ip_stack_t *ipst,
 	return (dce);
 }
 
+/*
+ * Return a held, non-condemned DCE for dst from the bucket, or NULL.
+ * The caller holds dcb_lock as either reader or writer.
+ */
+static dce_t *
+dce_find_v4(dcb_t *dcb, ipaddr_t dst)
+{
+	dce_t		*dce;
+
+	ASSERT(RW_LOCK_HELD(&dcb->dcb_lock));
+	for (dce = dcb->dcb_dce; dce != NULL; dce = dce->dce_next) {
+		if (dce->dce_v4addr == dst) {
+			mutex_enter(&dce->dce_lock);
+			if (!DCE_IS_CONDEMNED(dce)) {
+				dce_refhold(dce);
+				mutex_exit(&dce->dce_lock);
+				return (dce);
+			}
+			mutex_exit(&dce->dce_lock);
+		}
+	}
+	return (NULL);
+}
+
+static dce_t *
+dce_find_v6(dcb_t *dcb, const in6_addr_t *dst, uint_t ifindex)
+{
+	dce_t		*dce;
+
+	ASSERT(RW_LOCK_HELD(&dcb->dcb_lock));
+	for (dce = dcb->dcb_dce; dce != NULL; dce = dce->dce_next) {
+		if (IN6_ARE_ADDR_EQUAL(&dce->dce_v6addr, dst) &&
+		    dce->dce_ifindex == ifindex) {
+			mutex_enter(&dce->dce_lock);
+			if (!DCE_IS_CONDEMNED(dce)) {
+				dce_refhold(dce);
+				mutex_exit(&dce->dce_lock);
+				return (dce);
+			}
+			mutex_exit(&dce->dce_lock);
+		}
+	}
+	return (NULL);
+}
+
 /*
  * Atomically looks for a non-default DCE, and if not found tries to create one.
  * If there is no memory it returns NULL.
  * When an entry is created we increase the generation number on
  * the default DCE so that conn_ip_output will detect there is a new DCE.
+ *
+ * Every TCP connect ends up here, and on a busy host the entry nearly always
+ * exists already, so the bucket is first searched as a reader.  Only a miss
+ * takes the writer lock, and then the bucket has to be searched again since
+ * another thread may have added the entry in between.
  */
 dce_t *
 dce_lookup_and_add_v4(ipaddr_t dst, ip_stack_t *ipst)
@@ -529,18 +580,16 @@ dce_lookup_and_add_v4(ipaddr_t dst, ip_stack_t *ipst)
 	 */
 	if (dcb->dcb_cnt > ipst->ips_ip_dce_reclaim_threshold)
 		atomic_or_uint(&ipst->ips_dce_reclaim_needed, 1);
+	rw_enter(&dcb->dcb_lock, RW_READER);
+	dce = dce_find_v4(dcb, dst);
+	rw_exit(&dcb->dcb_lock);
+	if (dce != NULL)
+		return (dce);
+
 	rw_enter(&dcb->dcb_lock, RW_WRITER);
-	for (dce = dcb->dcb_dce; dce != NULL; dce = dce->dce_next) {
-		if (dce->dce_v4addr == dst) {
-			mutex_enter(&dce->dce_lock);
-			if (!DCE_IS_CONDEMNED(dce)) {
-				dce_refhold(dce);
-				mutex_exit(&dce->dce_lock);
-				rw_exit(&dcb->dcb_lock);
-				return (dce);
-			}
-			mutex_exit(&dce->dce_lock);
-		}
+	if ((dce = dce_find_v4(dcb, dst)) != NULL) {
+		rw_exit(&dcb->dcb_lock);
+		return (dce);
 	}
 	dce = kmem_cache_alloc(dce_cache, KM_NOSLEEP);
 	if (dce == NULL) {
@@ -579,6 +628,7 @@ dce_lookup_and_add_v4(ipaddr_t dst, ip_stack_t *ipst)
  * When an entry is created we increase the generation number on
  * the default DCE so that conn_ip_output will detect there is a new DCE.
  * ifindex should only be used with link-local addresses.
+ * As with dce_lookup_and_add_v4(), an existing entry is found as a reader.
  */
 dce_t *
 dce_lookup_and_add_v6(const in6_addr_t *dst, uint_t ifindex, ip_stack_t *ipst)
@@ -598,19 +648,16 @@ dce_lookup_and_add_v6(const in6_addr_t *dst, uint_t ifindex, ip_stack_t *ipst)
 	 */
 	if (dcb->dcb_cnt > ipst->ips_ip_dce_reclaim_threshold)
 		atomic_or_uint(&ipst->ips_dce_reclaim_needed, 1);
+	rw_enter(&dcb->dcb_lock, RW_READER);
+	dce = dce_find_v6(dcb, dst, ifindex);
+	rw_exit(&dcb->dcb_lock);
+	if (dce != NULL)
+		return (dce);
+
 	rw_enter(&dcb->dcb_lock, RW_WRITER);
-	for (dce = dcb->dcb_dce; dce != NULL; dce = dce->dce_next) {
-		if (IN6_ARE_ADDR_EQUAL(&dce->dce_v6addr, dst) &&
-		    dce->dce_ifindex == ifindex) {
-			mutex_enter(&dce->dce_lock);
-			if (!DCE_IS_CONDEMNED(dce)) {
-				dce_refhold(dce);
-				mutex_exit(&dce->dce_lock);
-				rw_exit(&dcb->dcb_lock);
-				return (dce);
-			}
-			mutex_exit(&dce->dce_lock);
-		}
+	if ((dce = dce_find_v6(dcb, dst, ifindex)) != NULL) {
+		rw_exit(&dcb->dcb_lock);
+		return (dce);
 	}
 
 	dce = kmem_cache_alloc(dce_cache, KM_NOSLEEP);
@@ -751,6 +798,46 @@ dce_update_uinfo(const in6_addr_t *dst, uint_t ifindex, iulp_t *uinfo,
 	}
 }
 
+/*
+ * Remember the TCP Fast Open cookie a server handed us.  A zero length
+ * forgets any cookie we had.  The shared default DCE is never updated;
+ * TCP always connects with a per-destination DCE (IPDF_UNIQUE_DCE).
+ */
+void
+dce_set_fastopen_cookie(dce_t *dce, const uint8_t *cookie, uint_t len)
+{
+	if (dce->dce_flags & DCEF_DEFAULT)
+		return;
+
+	ASSERT(len <= DCE_FASTOPEN_COOKIE_MAX);
+	mutex_enter(&dce->dce_lock);
+	if (len == 0) {
+		dce->dce_flags &= ~DCEF_FASTOPEN;
+	} else {
+		bcopy(cookie, dce->dce_fastopen_cookie, len);
+		dce->dce_flags |= DCEF_FASTOPEN;
+	}
+	dce->dce_fastopen_len = (uint8_t)len;
+	mutex_exit(&dce->dce_lock);
+}
+
+/*
+ * Copy out the cached TCP Fast Open cookie, if any, and return its length.
+ */
+uint_t
+dce_get_fastopen_cookie(dce_t *dce, uint8_t *cookie, uint_t len)
+{
+	uint_t	clen = 0;
+
+	mutex_enter(&dce->dce_lock);
+	if ((dce->dce_flags & DCEF_FASTOPEN) && dce->dce_fastopen_len <= len) {
+		clen = dce->dce_fastopen_len;
+		bcopy(dce->dce_fastopen_cookie, cookie, clen);
+	}
+	mutex_exit(&dce->dce_lock);
+	return (clen);
+}
+
 static void
 dce_make_condemned(dce_t *dce)
 {
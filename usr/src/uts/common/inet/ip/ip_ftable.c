@@ -20,6 +20,7 @@
  */
 /*
  * Copyright (c) 2006, 2010, Oracle and/or its affiliates. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -41,6 +42,9 @@
 #include <sys/param.h>
 #include <sys/socket.h>
 #include <sys/strsubr.h>
+#include <sys/bitmap.h>
+#include <sys/taskq.h>
+#include <util/qsort.h>
 #include <net/if.h>
 #include <net/route.h>
 #include <netinet/in.h>
@@ -83,6 +87,7 @@
 static ire_t	*route_to_dst(const struct sockaddr *, zoneid_t, ip_stack_t *);
 static void	ire_del_host_redir(ire_t *, char *);
 static boolean_t ire_find_best_route(struct radix_node *, void *);
+static boolean_t ip_lpm_lookup(const struct ip_lpm *, ipaddr_t, rt_t **);
 
 /*
  * Lookup a route in forwarding table. A specific lookup is indicated by
@@ -236,8 +241,16 @@ ire_ftable_lookup_simple_v4(ipaddr_t addr, uint32_t xmit_hint, ip_stack_t *ipst,
 	 */
 	RADIX_NODE_HEAD_RLOCK(ipst->ips_ip_ftable);
 
-	rt = (struct rt_entry *)ipst->ips_ip_ftable->rnh_matchaddr_args(&rdst,
-	    ipst->ips_ip_ftable, NULL, NULL);
+	/*
+	 * The compiled table, when present, gives the same answer as the
+	 * radix tree for any address which isn't under a route changed
+	 * since the table was built.
+	 */
+	if (ipst->ips_ip_ftable_lpm == NULL ||
+	    !ip_lpm_lookup(ipst->ips_ip_ftable_lpm, addr, &rt)) {
+		rt = (struct rt_entry *)ipst->ips_ip_ftable->rnh_matchaddr_args(
+		    &rdst, ipst->ips_ip_ftable, NULL, NULL);
+	}
 
 	if (rt == NULL)
 		goto bad;
@@ -454,6 +467,8 @@ ire_get_bucket(ire_t *ire)
 			/* found a non-root match */
 			rt = (struct rt_entry *)rn;
 		}
+	} else {
+		ip_ftable_lpm_changed(ipst, rt, B_TRUE);
 	}
 	if (rt != NULL) {
 		irb = &rt->rt_irb;
@@ -1781,3 +1796,565 @@ ire_clone_verify(ire_t *ire)
 	mutex_exit(&ire->ire_lock);
 	return (B_TRUE);
 }
+
+/*
+ * Compiled IPv4 forwarding table.
+ *
+ * With a full Internet routing table (getting on for a million prefixes)
+ * each walk down the radix tree is some two dozen dependent cache misses.
+ * So, once the table is large enough for that to matter, we also compile
+ * it into a poptrie (Asai and Ohara, SIGCOMM 2015), which answers the same
+ * longest-prefix-match question that ire_ftable_lookup_simple_v4() asks
+ * of the radix tree, typically in two or three cache lines.
+ *
+ * The top sixteen bits of the address index a direct-pointing array
+ * (ipl_dir), each entry of which is either the leaf for the whole /16, or
+ * the index of a node covering the next six bits.  A node has 64 slots,
+ * and each slot is either a child node or a leaf; rather than store 64 of
+ * each, a node keeps a bitmap of the slots which are children
+ * (ipln_vector) -- their nodes are consecutive from ipln_base1 -- and a
+ * bitmap of the leaf slots which differ from the leaf slot before them
+ * (ipln_leafvec) -- their leaves are consecutive from ipln_base0 -- so
+ * that the child or leaf for a slot is found by counting the bits below
+ * it.  A leaf is an index into ipl_rts, whose entry 0 means no route.
+ *
+ * The table is rebuilt from scratch by a task which runs a little while
+ * after the radix tree changes, so that a burst of changes (a BGP session
+ * coming up, say) costs a single rebuild.  In the meantime the table stays
+ * in use: every change marks the /16 slots the changed route covers as
+ * dirty (ipl_dirty), and a lookup in a dirty slot goes to the radix tree.
+ * Since only a route covering an address can change the result for it,
+ * or be freed while the table refers to it, what's left is still correct.
+ * The table under construction (ips_ip_ftable_lpm_next) is marked in the
+ * same way, from before its walk of the tree begins, so that changes
+ * racing with the walk are accounted for.  Tables are installed, marked
+ * and freed with the radix head write-locked, and read with it
+ * read-locked, which is how the lookups hold it anyway.
+ *
+ * The direct-pointing array and dirty bitmap alone come to some 264K,
+ * which is too much to spend on every small routing table in every zone,
+ * and the radix tree is shallow enough for those anyway; tables of fewer
+ * than ip_ftable_lpm_min_routes routes are not compiled.
+ */
+uint_t	ip_ftable_lpm_min_routes = 4096;
+uint_t	ip_ftable_lpm_delay_ms = 2000;
+
+#define	IP_LPM_DIRBITS		16
+#define	IP_LPM_DIRSIZE		(1 << IP_LPM_DIRBITS)
+#define	IP_LPM_STRIDE		6
+#define	IP_LPM_FANOUT		(1 << IP_LPM_STRIDE)
+#define	IP_LPM_LEAF		0x80000000U	/* ipl_dir entry is a leaf */
+
+/* The IP_LPM_STRIDE bits of a host-order address starting at bit 'off' */
+#define	IP_LPM_INDEX(key, off)	\
+	((uint_t)((((uint64_t)(key) << 32) >> (64 - IP_LPM_STRIDE - (off))) & \
+	(IP_LPM_FANOUT - 1)))
+
+/* Bits 0 through 'idx' inclusive */
+#define	IP_LPM_UPTO(idx)	((2ULL << (idx)) - 1)
+
+#define	IP_LPM_CONTIGUOUS(mask)	((~(mask) & (~(mask) + 1)) == 0)
+
+typedef struct ip_lpm_node {
+	uint64_t	ipln_vector;	/* slots which are child nodes */
+	uint64_t	ipln_leafvec;	/* slots which start a run of a leaf */
+	uint32_t	ipln_base0;	/* ipl_leaves index of first leaf */
+	uint32_t	ipln_base1;	/* ipl_nodes index of first child */
+} ip_lpm_node_t;
+
+typedef struct ip_lpm {
+	uint32_t	ipl_dir[IP_LPM_DIRSIZE];
+	ulong_t		ipl_dirty[BT_BITOUL(IP_LPM_DIRSIZE)];
+	ip_lpm_node_t	*ipl_nodes;
+	uint32_t	*ipl_leaves;
+	rt_t		**ipl_rts;
+	uint_t		ipl_nnodes;
+	uint_t		ipl_nleaves;
+	uint_t		ipl_nrts;
+	uint_t		ipl_maxnodes;
+	uint_t		ipl_maxleaves;
+	uint_t		ipl_maxrts;
+} ip_lpm_t;
+
+typedef struct ip_lpm_route {
+	uint32_t	iplr_key;	/* host byte order, masked */
+	uint32_t	iplr_leaf;	/* ipl_rts index */
+	uint_t		iplr_plen;
+} ip_lpm_route_t;
+
+typedef struct ip_lpm_build {
+	ip_lpm_t	*iplb_lpm;
+	ip_lpm_route_t	*iplb_routes;
+	uint_t		iplb_nroutes;
+	uint_t		iplb_maxroutes;
+	int		iplb_error;
+} ip_lpm_build_t;
+
+static void ip_ftable_lpm_timer(void *);
+
+static uint_t
+ip_lpm_popc(uint64_t x)
+{
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return ((uint_t)((x * 0x0101010101010101ULL) >> 56));
+}
+
+/*
+ * Look up addr (in network byte order) in the compiled table.  Returns
+ * B_FALSE if the table can't answer for it, in which case the radix tree
+ * must be asked.
+ */
+static boolean_t
+ip_lpm_lookup(const ip_lpm_t *lpm, ipaddr_t addr, rt_t **rtp)
+{
+	uint32_t key = ntohl(addr);
+	uint32_t ent = lpm->ipl_dir[key >> (32 - IP_LPM_DIRBITS)];
+	const ip_lpm_node_t *n;
+	uint_t off, idx;
+
+	if (BT_TEST(lpm->ipl_dirty, key >> (32 - IP_LPM_DIRBITS)))
+		return (B_FALSE);
+
+	if (ent & IP_LPM_LEAF) {
+		*rtp = lpm->ipl_rts[ent & ~IP_LPM_LEAF];
+		return (B_TRUE);
+	}
+
+	n = &lpm->ipl_nodes[ent];
+	for (off = IP_LPM_DIRBITS; ; off += IP_LPM_STRIDE) {
+		idx = IP_LPM_INDEX(key, off);
+		if ((n->ipln_vector & (1ULL << idx)) == 0)
+			break;
+		n = &lpm->ipl_nodes[n->ipln_base1 +
+		    ip_lpm_popc(n->ipln_vector & IP_LPM_UPTO(idx)) - 1];
+	}
+	*rtp = lpm->ipl_rts[lpm->ipl_leaves[n->ipln_base0 +
+	    ip_lpm_popc(n->ipln_leafvec & IP_LPM_UPTO(idx)) - 1]];
+	return (B_TRUE);
+}
+
+static ipaddr_t
+ip_lpm_rt_mask(const rt_t *rt)
+{
+	const struct rt_sockaddr *mask;
+
+	mask = (const struct rt_sockaddr *)rt->rt_nodes->rn_mask;
+	return (mask == NULL ? IP_HOST_MASK : mask->rt_sin_addr.s_addr);
+}
+
+/*
+ * Mark the /16 slots covered by rt as dirty.
+ */
+static void
+ip_lpm_dirty(ip_lpm_t *lpm, const rt_t *rt)
+{
+	uint32_t mask = ntohl(ip_lpm_rt_mask(rt));
+	uint32_t key = ntohl(rt->rt_dst.rt_sin_addr.s_addr) & mask;
+	uint_t slot, last;
+
+	if (IP_LPM_CONTIGUOUS(mask)) {
+		slot = key >> (32 - IP_LPM_DIRBITS);
+		last = (key | ~mask) >> (32 - IP_LPM_DIRBITS);
+	} else {
+		slot = 0;
+		last = IP_LPM_DIRSIZE - 1;
+	}
+	for (; slot <= last; slot++)
+		BT_SET(lpm->ipl_dirty, slot);
+}
+
+static void
+ip_lpm_free(ip_lpm_t *lpm)
+{
+	if (lpm->ipl_nodes != NULL) {
+		kmem_free(lpm->ipl_nodes,
+		    lpm->ipl_maxnodes * sizeof (ip_lpm_node_t));
+	}
+	if (lpm->ipl_leaves != NULL) {
+		kmem_free(lpm->ipl_leaves,
+		    lpm->ipl_maxleaves * sizeof (uint32_t));
+	}
+	if (lpm->ipl_rts != NULL)
+		kmem_free(lpm->ipl_rts, lpm->ipl_maxrts * sizeof (rt_t *));
+	kmem_free(lpm, sizeof (ip_lpm_t));
+}
+
+/*
+ * Make room for at least 'need' elements of 'size' bytes in the array buf,
+ * which has room for *maxp.  Returns the (possibly new) array, or NULL, in
+ * which case buf is left as it was.
+ */
+static void *
+ip_lpm_grow(void *buf, uint_t *maxp, uint_t need, size_t size)
+{
+	uint_t max = *maxp;
+	void *nbuf;
+
+	if (need <= max)
+		return (buf);
+	max = MAX(MAX(need, max * 2), 64);
+	if ((nbuf = kmem_alloc(max * size, KM_NOSLEEP)) == NULL)
+		return (NULL);
+	if (buf != NULL) {
+		bcopy(buf, nbuf, *maxp * size);
+		kmem_free(buf, *maxp * size);
+	}
+	*maxp = max;
+	return (nbuf);
+}
+
+static int
+ip_lpm_route_cmp(const void *a, const void *b)
+{
+	const ip_lpm_route_t *ra = a, *rb = b;
+
+	if (ra->iplr_key != rb->iplr_key)
+		return (ra->iplr_key < rb->iplr_key ? -1 : 1);
+	if (ra->iplr_plen != rb->iplr_plen)
+		return (ra->iplr_plen < rb->iplr_plen ? -1 : 1);
+	return (0);
+}
+
+/*
+ * rnh_walktree_mt() callback: note the route, and its rt_t, for the table
+ * being built.  The walk holds a reference on the bucket.
+ */
+static int
+ip_lpm_collect(struct radix_node *rn, void *arg)
+{
+	ip_lpm_build_t *b = arg;
+	ip_lpm_t *lpm = b->iplb_lpm;
+	rt_t *rt = (rt_t *)rn;
+	ip_lpm_route_t *r;
+	uint32_t mask = ntohl(ip_lpm_rt_mask(rt));
+	void *p;
+
+	if (!IP_LPM_CONTIGUOUS(mask)) {
+		b->iplb_error = EINVAL;
+		return (1);
+	}
+
+	if ((p = ip_lpm_grow(b->iplb_routes, &b->iplb_maxroutes,
+	    b->iplb_nroutes + 1, sizeof (ip_lpm_route_t))) == NULL) {
+		b->iplb_error = ENOMEM;
+		return (1);
+	}
+	b->iplb_routes = p;
+	if ((p = ip_lpm_grow(lpm->ipl_rts, &lpm->ipl_maxrts,
+	    lpm->ipl_nrts + 1, sizeof (rt_t *))) == NULL) {
+		b->iplb_error = ENOMEM;
+		return (1);
+	}
+	lpm->ipl_rts = p;
+
+	r = &b->iplb_routes[b->iplb_nroutes++];
+	r->iplr_key = ntohl(rt->rt_dst.rt_sin_addr.s_addr) & mask;
+	r->iplr_plen = ip_lpm_popc(mask);
+	r->iplr_leaf = lpm->ipl_nrts;
+	lpm->ipl_rts[lpm->ipl_nrts++] = rt;
+	return (0);
+}
+
+/*
+ * Fill in node nidx, which covers the IP_LPM_STRIDE bits from bit 'off',
+ * from the nr routes at r, all of which lie within it and are longer than
+ * 'off' bits.  Addresses which none of them covers get leaf 'def'.
+ */
+static int
+ip_lpm_build_node(ip_lpm_t *lpm, const ip_lpm_route_t *r, uint_t nr,
+    uint_t nidx, uint_t off, uint32_t def)
+{
+	uint32_t slot[IP_LPM_FANOUT];
+	uint64_t vector = 0, leafvec = 0;
+	uint_t end = off + IP_LPM_STRIDE;
+	uint_t i, s, n, start, child;
+	uint32_t base0, base1, prev;
+	ip_lpm_node_t *node;
+	void *p;
+	int err;
+
+	/*
+	 * The routes are sorted by address and then by length, so a route
+	 * comes after any shorter one which covers it.
+	 */
+	for (s = 0; s < IP_LPM_FANOUT; s++)
+		slot[s] = def;
+	for (i = 0; i < nr; i++) {
+		s = IP_LPM_INDEX(r[i].iplr_key, off);
+		if (r[i].iplr_plen > end) {
+			vector |= 1ULL << s;
+			continue;
+		}
+		for (n = 1U << (end - r[i].iplr_plen); n > 0; n--)
+			slot[s++] = r[i].iplr_leaf;
+	}
+
+	base0 = lpm->ipl_nleaves;
+	prev = UINT32_MAX;
+	for (s = 0; s < IP_LPM_FANOUT; s++) {
+		if ((vector & (1ULL << s)) != 0 || slot[s] == prev)
+			continue;
+		if ((p = ip_lpm_grow(lpm->ipl_leaves, &lpm->ipl_maxleaves,
+		    lpm->ipl_nleaves + 1, sizeof (uint32_t))) == NULL)
+			return (ENOMEM);
+		lpm->ipl_leaves = p;
+		lpm->ipl_leaves[lpm->ipl_nleaves++] = slot[s];
+		leafvec |= 1ULL << s;
+		prev = slot[s];
+	}
+
+	base1 = lpm->ipl_nnodes;
+	if ((p = ip_lpm_grow(lpm->ipl_nodes, &lpm->ipl_maxnodes,
+	    base1 + ip_lpm_popc(vector), sizeof (ip_lpm_node_t))) == NULL)
+		return (ENOMEM);
+	lpm->ipl_nodes = p;
+	lpm->ipl_nnodes += ip_lpm_popc(vector);
+
+	node = &lpm->ipl_nodes[nidx];
+	node->ipln_vector = vector;
+	node->ipln_leafvec = leafvec;
+	node->ipln_base0 = base0;
+	node->ipln_base1 = base1;
+
+	/*
+	 * Each child gets the routes longer than this node within its
+	 * slot.  Any route ending in this node which covers the slot sorts
+	 * ahead of them, and has already been folded into slot[].
+	 */
+	i = 0;
+	child = base1;
+	for (s = 0; s < IP_LPM_FANOUT; s++) {
+		if ((vector & (1ULL << s)) == 0)
+			continue;
+		while (i < nr && (IP_LPM_INDEX(r[i].iplr_key, off) < s ||
+		    r[i].iplr_plen <= end))
+			i++;
+		start = i;
+		while (i < nr && IP_LPM_INDEX(r[i].iplr_key, off) == s)
+			i++;
+		ASSERT3U(i, >, start);
+		if ((err = ip_lpm_build_node(lpm, &r[start], i - start,
+		    child++, end, slot[s])) != 0)
+			return (err);
+	}
+	return (0);
+}
+
+/*
+ * Compile the nr routes at r, sorted by ip_lpm_route_cmp(), into lpm.
+ */
+static int
+ip_lpm_compile(ip_lpm_t *lpm, const ip_lpm_route_t *r, uint_t nr)
+{
+	uint_t dirshift = 32 - IP_LPM_DIRBITS;
+	uint_t i, s, n, start, nidx;
+	uint32_t def;
+	void *p;
+	int err;
+
+	for (s = 0; s < IP_LPM_DIRSIZE; s++)
+		lpm->ipl_dir[s] = IP_LPM_LEAF | 0;
+	for (i = 0; i < nr; i++) {
+		if (r[i].iplr_plen > IP_LPM_DIRBITS)
+			continue;
+		s = r[i].iplr_key >> dirshift;
+		for (n = 1U << (IP_LPM_DIRBITS - r[i].iplr_plen); n > 0; n--)
+			lpm->ipl_dir[s++] = IP_LPM_LEAF | r[i].iplr_leaf;
+	}
+
+	for (i = 0; i < nr; ) {
+		if (r[i].iplr_plen <= IP_LPM_DIRBITS) {
+			i++;
+			continue;
+		}
+		s = r[i].iplr_key >> dirshift;
+		start = i;
+		while (i < nr && (r[i].iplr_key >> dirshift) == s)
+			i++;
+
+		nidx = lpm->ipl_nnodes;
+		if ((p = ip_lpm_grow(lpm->ipl_nodes, &lpm->ipl_maxnodes,
+		    nidx + 1, sizeof (ip_lpm_node_t))) == NULL)
+			return (ENOMEM);
+		lpm->ipl_nodes = p;
+		lpm->ipl_nnodes++;
+
+		def = lpm->ipl_dir[s] & ~IP_LPM_LEAF;
+		lpm->ipl_dir[s] = nidx;
+		if ((err = ip_lpm_build_node(lpm, &r[start], i - start, nidx,
+		    IP_LPM_DIRBITS, def)) != 0)
+			return (err);
+	}
+	return (0);
+}
+
+/*
+ * Build a new compiled table from the radix tree and install it in place
+ * of the old one.
+ */
+static void
+ip_ftable_lpm_rebuild(ip_stack_t *ipst)
+{
+	struct radix_node_head *rnh = ipst->ips_ip_ftable;
+	ip_lpm_build_t b;
+	ip_lpm_t *lpm, *old;
+	int err;
+
+	if ((lpm = kmem_zalloc(sizeof (ip_lpm_t), KM_NOSLEEP)) == NULL)
+		return;
+	if ((lpm->ipl_rts = ip_lpm_grow(NULL, &lpm->ipl_maxrts, 1,
+	    sizeof (rt_t *))) == NULL) {
+		ip_lpm_free(lpm);
+		return;
+	}
+	lpm->ipl_rts[lpm->ipl_nrts++] = NULL;
+
+	RADIX_NODE_HEAD_WLOCK(rnh);
+	if (ipst->ips_ip_ftable_nrt < ip_ftable_lpm_min_routes) {
+		old = ipst->ips_ip_ftable_lpm;
+		ipst->ips_ip_ftable_lpm = NULL;
+		RADIX_NODE_HEAD_UNLOCK(rnh);
+		if (old != NULL)
+			ip_lpm_free(old);
+		ip_lpm_free(lpm);
+		return;
+	}
+	ASSERT(ipst->ips_ip_ftable_lpm_next == NULL);
+	ipst->ips_ip_ftable_lpm_next = lpm;
+	RADIX_NODE_HEAD_UNLOCK(rnh);
+
+	bzero(&b, sizeof (b));
+	b.iplb_lpm = lpm;
+	(void) rnh->rnh_walktree_mt(rnh, ip_lpm_collect, &b, irb_refhold_rn,
+	    irb_refrele_rn);
+	if ((err = b.iplb_error) == 0) {
+		qsort(b.iplb_routes, b.iplb_nroutes, sizeof (ip_lpm_route_t),
+		    ip_lpm_route_cmp);
+		err = ip_lpm_compile(lpm, b.iplb_routes, b.iplb_nroutes);
+	}
+	if (b.iplb_routes != NULL) {
+		kmem_free(b.iplb_routes,
+		    b.iplb_maxroutes * sizeof (ip_lpm_route_t));
+	}
+
+	RADIX_NODE_HEAD_WLOCK(rnh);
+	ipst->ips_ip_ftable_lpm_next = NULL;
+	if (err == 0) {
+		old = ipst->ips_ip_ftable_lpm;
+		ipst->ips_ip_ftable_lpm = lpm;
+		lpm = old;
+	}
+	RADIX_NODE_HEAD_UNLOCK(rnh);
+
+	DTRACE_PROBE2(ip__ftable__lpm__rebuild, ip_stack_t *, ipst, int, err);
+	if (lpm != NULL)
+		ip_lpm_free(lpm);
+}
+
+static void
+ip_ftable_lpm_task(void *arg)
+{
+	ip_stack_t *ipst = arg;
+
+	ip_ftable_lpm_rebuild(ipst);
+
+	mutex_enter(&ipst->ips_ip_ftable_lpm_lock);
+	ipst->ips_ip_ftable_lpm_busy = B_FALSE;
+	cv_broadcast(&ipst->ips_ip_ftable_lpm_cv);
+	mutex_exit(&ipst->ips_ip_ftable_lpm_lock);
+}
+
+static void
+ip_ftable_lpm_timer(void *arg)
+{
+	ip_stack_t *ipst = arg;
+
+	mutex_enter(&ipst->ips_ip_ftable_lpm_lock);
+	ipst->ips_ip_ftable_lpm_tid = 0;
+	if (ipst->ips_ip_ftable_lpm_quiesce) {
+		mutex_exit(&ipst->ips_ip_ftable_lpm_lock);
+		return;
+	}
+	/*
+	 * If a rebuild is still running it may have missed the change which
+	 * got us here, so try again later; likewise if we can't dispatch.
+	 */
+	if (ipst->ips_ip_ftable_lpm_busy ||
+	    taskq_dispatch(system_taskq, ip_ftable_lpm_task, ipst,
+	    TQ_NOSLEEP) == TASKQID_INVALID) {
+		ipst->ips_ip_ftable_lpm_tid = timeout(ip_ftable_lpm_timer,
+		    ipst, MSEC_TO_TICK(ip_ftable_lpm_delay_ms));
+	} else {
+		ipst->ips_ip_ftable_lpm_busy = B_TRUE;
+	}
+	mutex_exit(&ipst->ips_ip_ftable_lpm_lock);
+}
+
+/*
+ * Called, with the radix head write-locked, when rt has just been added
+ * to or is about to be removed from the radix tree.
+ */
+void
+ip_ftable_lpm_changed(ip_stack_t *ipst, rt_t *rt, boolean_t added)
+{
+	ASSERT(RW_WRITE_HELD(&ipst->ips_ip_ftable->rnh_lock));
+
+	if (added)
+		ipst->ips_ip_ftable_nrt++;
+	else
+		ipst->ips_ip_ftable_nrt--;
+
+	if (ipst->ips_ip_ftable_lpm != NULL)
+		ip_lpm_dirty(ipst->ips_ip_ftable_lpm, rt);
+	if (ipst->ips_ip_ftable_lpm_next != NULL)
+		ip_lpm_dirty(ipst->ips_ip_ftable_lpm_next, rt);
+
+	if (ipst->ips_ip_ftable_lpm == NULL &&
+	    ipst->ips_ip_ftable_nrt < ip_ftable_lpm_min_routes)
+		return;
+
+	mutex_enter(&ipst->ips_ip_ftable_lpm_lock);
+	if (ipst->ips_ip_ftable_lpm_tid == 0 &&
+	    !ipst->ips_ip_ftable_lpm_quiesce) {
+		ipst->ips_ip_ftable_lpm_tid = timeout(ip_ftable_lpm_timer,
+		    ipst, MSEC_TO_TICK(ip_ftable_lpm_delay_ms));
+	}
+	mutex_exit(&ipst->ips_ip_ftable_lpm_lock);
+}
+
+void
+ip_ftable_lpm_init(ip_stack_t *ipst)
+{
+	mutex_init(&ipst->ips_ip_ftable_lpm_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&ipst->ips_ip_ftable_lpm_cv, NULL, CV_DEFAULT, NULL);
+}
+
+void
+ip_ftable_lpm_fini(ip_stack_t *ipst)
+{
+	timeout_id_t tid;
+
+	mutex_enter(&ipst->ips_ip_ftable_lpm_lock);
+	ipst->ips_ip_ftable_lpm_quiesce = B_TRUE;
+	while ((tid = ipst->ips_ip_ftable_lpm_tid) != 0) {
+		ipst->ips_ip_ftable_lpm_tid = 0;
+		mutex_exit(&ipst->ips_ip_ftable_lpm_lock);
+		(void) untimeout(tid);
+		mutex_enter(&ipst->ips_ip_ftable_lpm_lock);
+	}
+	while (ipst->ips_ip_ftable_lpm_busy)
+		cv_wait(&ipst->ips_ip_ftable_lpm_cv,
+		    &ipst->ips_ip_ftable_lpm_lock);
+	mutex_exit(&ipst->ips_ip_ftable_lpm_lock);
+
+	if (ipst->ips_ip_ftable_lpm != NULL) {
+		ip_lpm_free(ipst->ips_ip_ftable_lpm);
+		ipst->ips_ip_ftable_lpm = NULL;
+	}
+	ASSERT(ipst->ips_ip_ftable_lpm_next == NULL);
+
+	cv_destroy(&ipst->ips_ip_ftable_lpm_cv);
+	mutex_destroy(&ipst->ips_ip_ftable_lpm_lock);
+}
@@ -831,6 +831,42 @@ after_ilb:
 }
 #undef rptr
 
+/*
+ * Forward each of the segments that MAC coalesced into mp (see the HW_LSO
+ * comment in <sys/pattr.h>) as it was received, since the coalesced packet
+ * may not fit the outgoing MTU and the hosts on either side expect their
+ * segments to pass through unchanged.
+ */
+static void
+ip_forward_lro_v4(ire_t *ire, mblk_t *mp, ip_recv_attr_t *ira)
+{
+	ipha_t		*ipha = (ipha_t *)mp->b_rptr;
+	iaflags_t	iraflags = ira->ira_flags;
+	uint_t		hlen;
+	mblk_t		*seg, *next;
+
+	hlen = IP_SIMPLE_HDR_LENGTH +
+	    TCP_HDR_LENGTH((tcpha_t *)&mp->b_rptr[IP_SIMPLE_HDR_LENGTH]);
+
+	/* The later segments' headers are untouched, only the first's */
+	ipha->ipha_length = htons(MBLKL(mp));
+	ipha->ipha_hdr_checksum = 0;
+	ipha->ipha_hdr_checksum = ip_csum_hdr(ipha);
+	DB_CKSUMFLAGS(mp) &= ~HW_LSO;
+
+	for (seg = mp; seg != NULL; seg = next) {
+		next = seg->b_cont;
+		seg->b_cont = NULL;
+		if (seg != mp)
+			seg->b_rptr -= hlen;
+		ASSERT(OK_32PTR(seg->b_rptr) && seg->b_rptr >= DB_BASE(seg));
+
+		ira->ira_flags = iraflags;
+		ira->ira_pktlen = MBLKL(seg);
+		ire_recv_forward_v4(ire, seg, seg->b_rptr, ira);
+	}
+}
+
 /*
  * ire_recvfn for IREs that need forwarding
  */
@@ -860,6 +896,11 @@ ire_recv_forward_v4(ire_t *ire, mblk_t *mp, void *iph_arg, ip_recv_attr_t *ira)
 		return;
 	}
 
+	if (DB_CKSUMFLAGS(mp) & HW_LSO) {
+		ip_forward_lro_v4(ire, mp, ira);
+		return;
+	}
+
 	/*
 	 * Either ire_nce_capable or ire_dep_parent would be set for the IRE
 	 * when it is found by ire_route_recursive, but that some other thread
@@ -21,6 +21,7 @@
 /*
  * Copyright (c) 1991, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright (c) 1990 Mentat Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -1468,6 +1469,7 @@ irb_inactive(irb_t *irb)
 		    ipst->ips_ip_ftable);
 		DTRACE_PROBE1(irb__free, rt_t *,  rt);
 		ASSERT((void *)rn == (void *)rt);
+		ip_ftable_lpm_changed(ipst, rt, B_FALSE);
 		Free(rt, rt_entry_cache);
 		/* irb_lock is freed */
 		RADIX_NODE_HEAD_UNLOCK(ipst->ips_ip_ftable);
@@ -2297,6 +2299,7 @@ ip_ire_init(ip_stack_t *ipst)
 	mutex_init(&ipst->ips_ire_ft_init_lock, NULL, MUTEX_DEFAULT, 0);
 
 	(void) rn_inithead((void **)&ipst->ips_ip_ftable, 32);
+	ip_ftable_lpm_init(ipst);
 
 	/*
 	 * Make sure that the forwarding table size is a power of 2.
@@ -2382,6 +2385,7 @@ ip_ire_fini(ip_stack_t *ipst)
 	 */
 	ire_walk(ire_delete, NULL, ipst);
 
+	ip_ftable_lpm_fini(ipst);
 	rn_freehead(ipst->ips_ip_ftable);
 	ipst->ips_ip_ftable = NULL;
 
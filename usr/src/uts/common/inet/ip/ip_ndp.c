@@ -23,7 +23,7 @@
  */
 
 /*
- * Copyright (c) 2019, Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/types.h>
@@ -775,18 +775,22 @@ ncec_lookup_illgrp(ill_t *ill, const in6_addr_t *addr, ncec_t *ncec)
  * Find an nce_t on ill with nce_addr == addr. Lookup the nce_t
  * entries for ill only, i.e., when ill is part of an ipmp group,
  * nce_lookup_v4 will never try to match across the group.
+ *
+ * The ill_nce list is protected by ill_lock alone.  Callers that go on to
+ * add an nce if none is found need the ndp_g_lock across both steps and use
+ * nce_lookup_addr(); a plain lookup does not, and taking the per-stack
+ * ndp_g_lock here would serialize all lookups on the host.
  */
 nce_t *
 nce_lookup_v4(ill_t *ill, const in_addr_t *addr)
 {
 	nce_t *nce;
 	in6_addr_t addr6;
-	ip_stack_t *ipst = ill->ill_ipst;
 
-	mutex_enter(&ipst->ips_ndp4->ndp_g_lock);
 	IN6_IPADDR_TO_V4MAPPED(*addr, &addr6);
-	nce = nce_lookup_addr(ill, &addr6);
-	mutex_exit(&ipst->ips_ndp4->ndp_g_lock);
+	mutex_enter(&ill->ill_lock);
+	nce = nce_lookup(ill, &addr6);
+	mutex_exit(&ill->ill_lock);
 	return (nce);
 }
 
@@ -799,11 +803,10 @@ nce_t *
 nce_lookup_v6(ill_t *ill, const in6_addr_t *addr6)
 {
 	nce_t *nce;
-	ip_stack_t *ipst = ill->ill_ipst;
 
-	mutex_enter(&ipst->ips_ndp6->ndp_g_lock);
-	nce = nce_lookup_addr(ill, addr6);
-	mutex_exit(&ipst->ips_ndp6->ndp_g_lock);
+	mutex_enter(&ill->ill_lock);
+	nce = nce_lookup(ill, addr6);
+	mutex_exit(&ill->ill_lock);
 	return (nce);
 }
 
@@ -155,6 +155,7 @@ ip_squeue_create(pri_t pri)
 
 	sqp = squeue_create(pri, B_TRUE);
 	ASSERT(sqp != NULL);
+	ipcl_conn_cache_init(sqp);
 	if (ip_squeue_create_callback != NULL)
 		ip_squeue_create_callback(sqp);
 	return (sqp);
@@ -289,6 +289,9 @@ uint_t ipcl_udp_fanout_size = 16384;
 /* Raw socket fanout size.  Must be a power of 2. */
 uint_t ipcl_raw_fanout_size = 256;
 
+/* Consult the per-squeue cache of connected TCP conn_ts.  Setable anytime. */
+boolean_t ipcl_conn_cache_enable = B_TRUE;
+
 /*
  * The IPCL_IPTUN_HASH() function works best with a prime table size.  We
  * expect that most large deployments would have hundreds of tunnels, and
@@ -639,6 +642,7 @@ ipcl_conn_destroy(conn_t *connp)
 	ASSERT(!MUTEX_HELD(&connp->conn_lock));
 	ASSERT(connp->conn_ref == 0);
 	ASSERT(connp->conn_ioctlref == 0);
+	ASSERT(connp->conn_sqcache == NULL);
 
 	DTRACE_PROBE1(conn__destroy, conn_t *, connp);
 
@@ -800,6 +804,8 @@ ipcl_conn_unlisten(conn_t *connp)
 		(connp)->conn_flags |= IPCL_REMOVED;			\
 		if (((connp)->conn_flags & IPCL_CL_LISTENER) != 0)	\
 			ipcl_conn_unlisten((connp));			\
+		if ((connp)->conn_sqcache != NULL)			\
+			ipcl_conn_cache_purge((connp));			\
 		CONN_DEC_REF((connp));					\
 		mutex_exit(&connfp->connf_lock);			\
 	}								\
@@ -832,6 +838,7 @@ ipcl_hash_remove_locked(conn_t *connp, connf_t	*connfp)
 	ASSERT(MUTEX_HELD(&connfp->connf_lock));
 	ASSERT(MUTEX_HELD(&connp->conn_lock));
 	ASSERT((connp->conn_flags & IPCL_CL_LISTENER) == 0);
+	ASSERT(connp->conn_sqcache == NULL);
 
 	if ((connp)->conn_next != NULL) {
 		(connp)->conn_next->conn_prev = (connp)->conn_prev;
@@ -1541,6 +1548,108 @@ ipcl_conn_insert_v6(conn_t *connp)
 	return (ret);
 }
 
+/*
+ * Per-squeue connected TCP cache; see ipcl_conn_cache_t.  Every IP squeue
+ * gets one when it is created, and keeps it for its lifetime.
+ */
+void
+ipcl_conn_cache_init(squeue_t *sqp)
+{
+	ipcl_conn_cache_t *icc;
+
+	icc = kmem_zalloc(sizeof (*icc), KM_SLEEP);
+	mutex_init(&icc->icc_lock, NULL, MUTEX_DEFAULT, NULL);
+	*squeue_getprivate(sqp, SQPRIVATE_IPCL) = (uintptr_t)icc;
+}
+
+/* Whether a connected TCP conn_t may receive the packet in zoneid. */
+#define	IPCL_TCP_ZONE_MATCH(connp, zoneid, ira)				\
+	((connp)->conn_zoneid == (zoneid) || (connp)->conn_allzones ||	\
+	((connp)->conn_mac_mode != CONN_MAC_DEFAULT &&			\
+	((ira)->ira_flags & IRAF_TX_MAC_EXEMPTABLE) &&			\
+	((ira)->ira_flags & IRAF_TX_SHARED_ADDR)))
+
+static ipcl_conn_cache_t *
+ipcl_conn_cache(ip_recv_attr_t *ira)
+{
+	if (!ipcl_conn_cache_enable || ira->ira_sqp == NULL)
+		return (NULL);
+	return ((ipcl_conn_cache_t *)*squeue_getprivate(ira->ira_sqp,
+	    SQPRIVATE_IPCL));
+}
+
+/*
+ * Return the conn_t cached for fanout bucket idx of ipst with a reference
+ * held; the caller still has to match it against the packet.
+ */
+static conn_t *
+ipcl_conn_cache_get(ipcl_conn_cache_t *icc, uint_t idx, ip_stack_t *ipst)
+{
+	conn_t *connp;
+
+	mutex_enter(&icc->icc_lock);
+	connp = icc->icc_conn[idx & (IPCL_CONN_CACHE_SIZE - 1)];
+	if (connp != NULL && connp->conn_netstack == ipst->ips_netstack)
+		CONN_INC_REF(connp);
+	else
+		connp = NULL;
+	mutex_exit(&icc->icc_lock);
+	return (connp);
+}
+
+/*
+ * Cache connp, just found in its fanout bucket idx, unless some squeue
+ * already has it.  Whatever was in the slot is evicted; it is still in its
+ * own bucket, which holds a reference, so ours is never the last one.
+ */
+static void
+ipcl_conn_cache_put(ipcl_conn_cache_t *icc, uint_t idx, conn_t *connp)
+{
+	uint_t slot = idx & (IPCL_CONN_CACHE_SIZE - 1);
+	conn_t *old;
+
+	ASSERT(MUTEX_HELD(&connp->conn_fanout->connf_lock));
+	if (connp->conn_sqcache != NULL)
+		return;
+
+	CONN_INC_REF(connp);
+	mutex_enter(&icc->icc_lock);
+	if ((old = icc->icc_conn[slot]) != NULL) {
+		ASSERT(old->conn_sqcache == icc);
+		old->conn_sqcache = NULL;
+	}
+	icc->icc_conn[slot] = connp;
+	connp->conn_sqcache = icc;
+	connp->conn_sqcache_slot = slot;
+	if (old != NULL)
+		CONN_DEC_REF(old);
+	mutex_exit(&icc->icc_lock);
+}
+
+/*
+ * Drop connp from the squeue cache holding it.  Called with the conn's
+ * connf_lock held as it leaves the fanout, so it cannot be cached again.
+ */
+void
+ipcl_conn_cache_purge(conn_t *connp)
+{
+	ipcl_conn_cache_t *icc = connp->conn_sqcache;
+
+	ASSERT(connp->conn_fanout == NULL ||
+	    MUTEX_HELD(&connp->conn_fanout->connf_lock));
+	if (icc == NULL)
+		return;
+
+	mutex_enter(&icc->icc_lock);
+	if (connp->conn_sqcache == icc &&
+	    icc->icc_conn[connp->conn_sqcache_slot] == connp) {
+		icc->icc_conn[connp->conn_sqcache_slot] = NULL;
+		connp->conn_sqcache = NULL;
+		CONN_DEC_REF(connp);
+	}
+	mutex_exit(&icc->icc_lock);
+}
+
 /*
  * v4 packet classifying function. looks up the fanout table to
  * find the conn, the packet belongs to. returns the conn with
@@ -1563,6 +1672,8 @@ ipcl_classify_v4(mblk_t *mp, uint8_t protocol, uint_t hdr_len,
 	conn_t	*connp;
 	uint16_t  *up;
 	zoneid_t	zoneid = ira->ira_zoneid;
+	ipcl_conn_cache_t *icc;
+	uint_t	idx;
 
 	ipha = (ipha_t *)mp->b_rptr;
 	up = (uint16_t *)((uchar_t *)ipha + hdr_len + TCP_PORTS_OFFSET);
@@ -1570,19 +1681,28 @@ ipcl_classify_v4(mblk_t *mp, uint8_t protocol, uint_t hdr_len,
 	switch (protocol) {
 	case IPPROTO_TCP:
 		ports = *(uint32_t *)up;
-		connfp =
-		    &ipst->ips_ipcl_conn_fanout[IPCL_CONN_HASH(ipha->ipha_src,
-		    ports, ipst)];
+		idx = IPCL_CONN_HASH(ipha->ipha_src, ports, ipst);
+		if ((icc = ipcl_conn_cache(ira)) != NULL) {
+			connp = ipcl_conn_cache_get(icc, idx, ipst);
+			if (connp != NULL) {
+				if (IPCL_CONN_MATCH(connp, protocol,
+				    ipha->ipha_src, ipha->ipha_dst, ports) &&
+				    IPCL_TCP_ZONE_MATCH(connp, zoneid, ira)) {
+					IP_STAT(ipst, ipcl_conn_cache_hit);
+					return (connp);
+				}
+				CONN_DEC_REF(connp);
+			}
+			IP_STAT(ipst, ipcl_conn_cache_miss);
+		}
+
+		connfp = &ipst->ips_ipcl_conn_fanout[idx];
 		mutex_enter(&connfp->connf_lock);
 		for (connp = connfp->connf_head; connp != NULL;
 		    connp = connp->conn_next) {
 			if (IPCL_CONN_MATCH(connp, protocol,
 			    ipha->ipha_src, ipha->ipha_dst, ports) &&
-			    (connp->conn_zoneid == zoneid ||
-			    connp->conn_allzones ||
-			    ((connp->conn_mac_mode != CONN_MAC_DEFAULT) &&
-			    (ira->ira_flags & IRAF_TX_MAC_EXEMPTABLE) &&
-			    (ira->ira_flags & IRAF_TX_SHARED_ADDR))))
+			    IPCL_TCP_ZONE_MATCH(connp, zoneid, ira))
 				break;
 		}
 
@@ -1595,6 +1715,8 @@ ipcl_classify_v4(mblk_t *mp, uint8_t protocol, uint_t hdr_len,
 			 * before allowing the connection to become bound.
 			 */
 			CONN_INC_REF(connp);
+			if (icc != NULL)
+				ipcl_conn_cache_put(icc, idx, connp);
 			mutex_exit(&connfp->connf_lock);
 			return (connp);
 		}
@@ -1704,6 +1826,8 @@ ipcl_classify_v6(mblk_t *mp, uint8_t protocol, uint_t hdr_len,
 	conn_t		*connp;
 	uint16_t	*up;
 	zoneid_t	zoneid = ira->ira_zoneid;
+	ipcl_conn_cache_t *icc;
+	uint_t		idx;
 
 	ip6h = (ip6_t *)mp->b_rptr;
 
@@ -1713,19 +1837,28 @@ ipcl_classify_v6(mblk_t *mp, uint8_t protocol, uint_t hdr_len,
 		up = &tcpha->tha_lport;
 		ports = *(uint32_t *)up;
 
-		connfp =
-		    &ipst->ips_ipcl_conn_fanout[IPCL_CONN_HASH_V6(ip6h->ip6_src,
-		    ports, ipst)];
+		idx = IPCL_CONN_HASH_V6(ip6h->ip6_src, ports, ipst);
+		if ((icc = ipcl_conn_cache(ira)) != NULL) {
+			connp = ipcl_conn_cache_get(icc, idx, ipst);
+			if (connp != NULL) {
+				if (IPCL_CONN_MATCH_V6(connp, protocol,
+				    ip6h->ip6_src, ip6h->ip6_dst, ports) &&
+				    IPCL_TCP_ZONE_MATCH(connp, zoneid, ira)) {
+					IP_STAT(ipst, ipcl_conn_cache_hit);
+					return (connp);
+				}
+				CONN_DEC_REF(connp);
+			}
+			IP_STAT(ipst, ipcl_conn_cache_miss);
+		}
+
+		connfp = &ipst->ips_ipcl_conn_fanout[idx];
 		mutex_enter(&connfp->connf_lock);
 		for (connp = connfp->connf_head; connp != NULL;
 		    connp = connp->conn_next) {
 			if (IPCL_CONN_MATCH_V6(connp, protocol,
 			    ip6h->ip6_src, ip6h->ip6_dst, ports) &&
-			    (connp->conn_zoneid == zoneid ||
-			    connp->conn_allzones ||
-			    ((connp->conn_mac_mode != CONN_MAC_DEFAULT) &&
-			    (ira->ira_flags & IRAF_TX_MAC_EXEMPTABLE) &&
-			    (ira->ira_flags & IRAF_TX_SHARED_ADDR))))
+			    IPCL_TCP_ZONE_MATCH(connp, zoneid, ira))
 				break;
 		}
 
@@ -1738,6 +1871,8 @@ ipcl_classify_v6(mblk_t *mp, uint8_t protocol, uint_t hdr_len,
 			 * before allowing the connection to become bound.
 			 */
 			CONN_INC_REF(connp);
+			if (icc != NULL)
+				ipcl_conn_cache_put(icc, idx, connp);
 			mutex_exit(&connfp->connf_lock);
 			return (connp);
 		}
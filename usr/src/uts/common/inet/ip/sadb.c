@@ -22,7 +22,7 @@
  * Copyright 2010 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
  * Copyright (c) 2012 Nexenta Systems, Inc. All rights reserved.
- * Copyright (c) 2018 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/types.h>
@@ -3910,8 +3910,19 @@ sadb_age_bytes(queue_t *pfkey_q, ipsa_t *assoc, uint64_t bytes,
 	boolean_t rc = B_TRUE;
 	uint64_t newtotal;
 
+	/*
+	 * This is called for every packet, so only take the SA lock when a
+	 * lifetime is about to be crossed.  Otherwise just add up the bytes.
+	 */
+	newtotal = atomic_add_64_nv(&assoc->ipsa_bytes, bytes);
+	if ((assoc->ipsa_hardbyteslt == 0 ||
+	    newtotal < assoc->ipsa_hardbyteslt) &&
+	    (assoc->ipsa_softbyteslt == 0 ||
+	    newtotal < assoc->ipsa_softbyteslt ||
+	    assoc->ipsa_state >= IPSA_STATE_DYING))
+		return (B_TRUE);
+
 	mutex_enter(&assoc->ipsa_lock);
-	newtotal = assoc->ipsa_bytes + bytes;
 	if (assoc->ipsa_hardbyteslt != 0 &&
 	    newtotal >= assoc->ipsa_hardbyteslt) {
 		if (assoc->ipsa_state != IPSA_STATE_DEAD) {
@@ -3939,13 +3950,10 @@ sadb_age_bytes(queue_t *pfkey_q, ipsa_t *assoc, uint64_t bytes,
 			 * this off on another non-interrupt thread.
 			 */
 			assoc->ipsa_state = IPSA_STATE_DYING;
-			assoc->ipsa_bytes = newtotal;
 			if (sendmsg)
 				sadb_expire_assoc(pfkey_q, assoc);
 		} /* Else someone beat me to it! */
 	}
-	if (rc == B_TRUE)
-		assoc->ipsa_bytes = newtotal;
 	mutex_exit(&assoc->ipsa_lock);
 	return (rc);
 }
@@ -4682,6 +4690,8 @@ sadb_update_sa(mblk_t *mp, keysock_in_t *ksi, mblk_t **ipkt_lst,
 				mutex_enter(&ipsapp.ipsap_sa_ptr->ipsa_lock);
 				ipsapp.ipsap_sa_ptr->ipsa_replay =
 				    replext->sadb_x_rc_replay32;
+				bzero(ipsapp.ipsap_sa_ptr->ipsa_replay_arr,
+				    SADB_REPLAY_WORDS * sizeof (uint64_t));
 				ipsapp.ipsap_sa_ptr->ipsa_idleexpiretime =
 				    current +
 				    ipsapp.ipsap_sa_ptr->ipsa_idletime;
@@ -6281,40 +6291,46 @@ sadb_in_acquire(sadb_msg_t *samsg, sadbp_t *sp, queue_t *pfkey_q,
 
 /*
  * The following functions work with the replay windows of an SA.  They assume
- * the ipsa->ipsa_replay_arr is an array of uint64_t, and that the bit vector
- * represents the highest sequence number packet received, and back
- * (ipsa->ipsa_replay_wsize) packets.
+ * the ipsa->ipsa_replay_arr is an array of SADB_REPLAY_WORDS uint64_t, used
+ * as a ring of bits indexed by sequence number (as in RFC 6479): bit
+ * (seq & 63) of word ((seq >> 6) % SADB_REPLAY_WORDS) records whether seq has
+ * been received.  The window covers the highest sequence number packet
+ * received, ipsa->ipsa_replay, and back (ipsa->ipsa_replay_wsize) packets.
+ * Because the ring has a word to spare, moving the window forward just
+ * clears the words it moves into, rather than shifting the whole vector.
  */
+#define	IPSA_REPLAY_WORD(ipsa, seq)	\
+	((ipsa)->ipsa_replay_arr[((seq) >> 6) % SADB_REPLAY_WORDS])
+#define	IPSA_REPLAY_BIT(seq)	((uint64_t)1 << (uint64_t)((seq) & 63))
 
 /*
  * Is the replay bit set?
  */
 static boolean_t
-ipsa_is_replay_set(ipsa_t *ipsa, uint32_t offset)
+ipsa_is_replay_set(ipsa_t *ipsa, uint32_t seq)
 {
-	uint64_t bit = (uint64_t)1 << (uint64_t)(offset & 63);
-
-	return ((bit & ipsa->ipsa_replay_arr[offset >> 6]) ? B_TRUE : B_FALSE);
+	return ((IPSA_REPLAY_WORD(ipsa, seq) & IPSA_REPLAY_BIT(seq)) ?
+	    B_TRUE : B_FALSE);
 }
 
 /*
- * Shift the bits of the replay window over.
+ * Move the top of the replay window up to seq, clearing the words of the
+ * ring which it moves into.
  */
 static void
-ipsa_shift_replay(ipsa_t *ipsa, uint32_t shift)
+ipsa_advance_replay(ipsa_t *ipsa, uint32_t seq)
 {
-	int i;
-	int jump = ((shift - 1) >> 6) + 1;
+	uint32_t blk = ipsa->ipsa_replay >> 6;
+	uint32_t nblks = (seq >> 6) - blk;
 
-	if (shift == 0)
-		return;
+	ASSERT(MUTEX_HELD(&ipsa->ipsa_lock));
 
-	for (i = (ipsa->ipsa_replay_wsize - 1) >> 6; i >= 0; i--) {
-		if (i + jump <= (ipsa->ipsa_replay_wsize - 1) >> 6) {
-			ipsa->ipsa_replay_arr[i + jump] |=
-			    ipsa->ipsa_replay_arr[i] >> (64 - (shift & 63));
-		}
-		ipsa->ipsa_replay_arr[i] <<= shift;
+	if (nblks > SADB_REPLAY_WORDS)
+		nblks = SADB_REPLAY_WORDS;
+
+	while (nblks-- > 0) {
+		blk++;
+		ipsa->ipsa_replay_arr[blk % SADB_REPLAY_WORDS] = 0;
 	}
 }
 
@@ -6322,11 +6338,9 @@ ipsa_shift_replay(ipsa_t *ipsa, uint32_t shift)
  * Set a bit in the bit vector.
  */
 static void
-ipsa_set_replay(ipsa_t *ipsa, uint32_t offset)
+ipsa_set_replay(ipsa_t *ipsa, uint32_t seq)
 {
-	uint64_t bit = (uint64_t)1 << (uint64_t)(offset & 63);
-
-	ipsa->ipsa_replay_arr[offset >> 6] |= bit;
+	IPSA_REPLAY_WORD(ipsa, seq) |= IPSA_REPLAY_BIT(seq);
 }
 
 #define	SADB_MAX_REPLAY_VALUE 0xffffffff
@@ -6359,30 +6373,22 @@ sadb_replay_check(ipsa_t *ipsa, uint32_t seq)
 
 	if (seq > ipsa->ipsa_replay) {
 		/*
-		 * I have received a new "highest value received".  Shift
-		 * the replay window over.
+		 * I have received a new "highest value received".  Move
+		 * the replay window up.
 		 */
-		diff = seq - ipsa->ipsa_replay;
-		if (diff < ipsa->ipsa_replay_wsize) {
-			/* In replay window, shift bits over. */
-			ipsa_shift_replay(ipsa, diff);
-		} else {
-			/* WAY FAR AHEAD, clear bits and start again. */
-			bzero(ipsa->ipsa_replay_arr,
-			    sizeof (ipsa->ipsa_replay_arr));
-		}
-		ipsa_set_replay(ipsa, 0);
+		ipsa_advance_replay(ipsa, seq);
+		ipsa_set_replay(ipsa, seq);
 		ipsa->ipsa_replay = seq;
 		rc = B_TRUE;
 		goto done;
 	}
 	diff = ipsa->ipsa_replay - seq;
-	if (diff >= ipsa->ipsa_replay_wsize || ipsa_is_replay_set(ipsa, diff)) {
+	if (diff >= ipsa->ipsa_replay_wsize || ipsa_is_replay_set(ipsa, seq)) {
 		rc = B_FALSE;
 		goto done;
 	}
 	/* Set this packet as seen. */
-	ipsa_set_replay(ipsa, diff);
+	ipsa_set_replay(ipsa, seq);
 
 	rc = B_TRUE;
 done:
@@ -6397,12 +6403,17 @@ done:
  * and collisions with already replayed packets.  Return B_TRUE if it
  * is okay to proceed, B_FALSE if this packet should be dropped immediately.
  * Assume same byte-ordering as sadb_replay_check.
+ *
+ * This is done without the SA lock, so that inbound packets for one SA
+ * contend for it only once, in sadb_replay_check().  A racing update of the
+ * window can only make us see a bit set for a sequence number which has
+ * already fallen out of the window, so we never drop a packet that
+ * sadb_replay_check() would have accepted.
  */
 boolean_t
 sadb_replay_peek(ipsa_t *ipsa, uint32_t seq)
 {
-	boolean_t rc = B_FALSE;
-	uint32_t diff;
+	uint32_t replay;
 
 	if (ipsa->ipsa_replay_wsize == 0)
 		return (B_TRUE);
@@ -6418,40 +6429,30 @@ sadb_replay_peek(ipsa_t *ipsa, uint32_t seq)
 		return (B_FALSE);
 
 	seq = ntohl(seq);
-	mutex_enter(&ipsa->ipsa_lock);
-	if (seq < ipsa->ipsa_replay - ipsa->ipsa_replay_wsize &&
-	    ipsa->ipsa_replay >= ipsa->ipsa_replay_wsize)
-		goto done;
+	replay = *(volatile uint32_t *)&ipsa->ipsa_replay;
+	if (seq < replay - ipsa->ipsa_replay_wsize &&
+	    replay >= ipsa->ipsa_replay_wsize)
+		return (B_FALSE);
 
 	/*
 	 * If I've hit 0xffffffff, then quite honestly, I don't need to
 	 * bother with formalities.  I'm not accepting any more packets
 	 * on this SA.
 	 */
-	if (ipsa->ipsa_replay == SADB_MAX_REPLAY_VALUE) {
-		/*
-		 * Since we're already holding the lock, update the
-		 * expire time ala. sadb_replay_delete() and return.
-		 */
-		ipsa->ipsa_hardexpiretime = (time_t)1;
-		goto done;
+	if (replay == SADB_MAX_REPLAY_VALUE) {
+		sadb_replay_delete(ipsa);
+		return (B_FALSE);
 	}
 
-	if (seq <= ipsa->ipsa_replay) {
-		/*
-		 * This seq is in the replay window.  I'm not below it,
-		 * because I already checked for that above!
-		 */
-		diff = ipsa->ipsa_replay - seq;
-		if (ipsa_is_replay_set(ipsa, diff))
-			goto done;
-	}
-	/* Else return B_TRUE, I'm going to advance the window. */
+	/*
+	 * If this seq is in the replay window (I'm not below it, because I
+	 * already checked for that above!) then check whether I've seen it.
+	 * Else return B_TRUE, I'm going to advance the window.
+	 */
+	if (seq <= replay && ipsa_is_replay_set(ipsa, seq))
+		return (B_FALSE);
 
-	rc = B_TRUE;
-done:
-	mutex_exit(&ipsa->ipsa_lock);
-	return (rc);
+	return (B_TRUE);
 }
 
 /*
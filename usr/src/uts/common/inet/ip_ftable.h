@@ -22,6 +22,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef _INET_IP_FTABLE_H
@@ -83,6 +84,10 @@ extern int ipfil_sendpkt(const struct sockaddr *, mblk_t *, uint_t, zoneid_t);
 extern void  irb_refhold_rn(struct radix_node *);
 extern void  irb_refrele_rn(struct radix_node *);
 
+extern void	ip_ftable_lpm_init(ip_stack_t *);
+extern void	ip_ftable_lpm_fini(ip_stack_t *);
+extern void	ip_ftable_lpm_changed(ip_stack_t *, rt_t *, boolean_t);
+
 #endif /* _KERNEL */
 
 #ifdef	__cplusplus
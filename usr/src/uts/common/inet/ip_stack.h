@@ -25,7 +25,7 @@
  */
 
 /*
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_INET_IP_STACK_H
@@ -93,6 +93,8 @@ typedef struct ip_stat {
 	kstat_named_t	conn_in_recvpktinfo;
 	kstat_named_t	conn_in_recvtclass;
 	kstat_named_t	conn_in_timestamp;
+	kstat_named_t	ipcl_conn_cache_hit;
+	kstat_named_t	ipcl_conn_cache_miss;
 } ip_stat_t;
 
 
@@ -235,6 +237,20 @@ struct ip_stack {
 	/* IPv4 forwarding table */
 	struct radix_node_head *ips_ip_ftable;
 
+	/*
+	 * Compiled lookup table for ips_ip_ftable; see ip_ftable.c.  The
+	 * first three are protected by the ips_ip_ftable rnh_lock, the
+	 * rest by ips_ip_ftable_lpm_lock.
+	 */
+	struct ip_lpm	*ips_ip_ftable_lpm;
+	struct ip_lpm	*ips_ip_ftable_lpm_next;
+	uint_t		ips_ip_ftable_nrt;
+	kmutex_t	ips_ip_ftable_lpm_lock;
+	kcondvar_t	ips_ip_ftable_lpm_cv;
+	timeout_id_t	ips_ip_ftable_lpm_tid;
+	boolean_t	ips_ip_ftable_lpm_busy;
+	boolean_t	ips_ip_ftable_lpm_quiesce;
+
 #define	IPV6_ABITS		128
 #define	IP6_MASK_TABLE_SIZE	(IPV6_ABITS + 1)	/* 129 ptrs */
 	struct irb	*ips_ip_forwarding_table_v6[IP6_MASK_TABLE_SIZE];
@@ -129,6 +129,7 @@ typedef boolean_t (*edesc_vpf)(conn_t *, void *, struct icmph_s *,
 #define	IPCL_IS_NONSTR(connp)	((connp)->conn_flags & IPCL_NONSTR)
 
 typedef struct connf_s connf_t;
+typedef struct ipcl_conn_cache_s ipcl_conn_cache_t;
 
 typedef struct
 {
@@ -329,6 +330,8 @@ struct conn_s {
 	connf_t		*conn_fanout;		/* Hash bucket we're part of */
 	struct conn_s	*conn_next;		/* Hash chain next */
 	struct conn_s	*conn_prev;		/* Hash chain prev */
+	ipcl_conn_cache_t *conn_sqcache;	/* Squeue cache holding us */
+	uint_t		conn_sqcache_slot;	/* Our slot in conn_sqcache */
 
 	struct {
 		in6_addr_t connua_laddr;	/* Local address - match */
@@ -469,6 +472,23 @@ struct connf_s {
 	kmutex_t	connf_lock;
 };
 
+/*
+ * ipcl_conn_cache_t - per-squeue cache of connected TCP conn_ts.
+ *
+ * Direct-mapped by conn fanout bucket, it lets ipcl_classify_v4/v6 find an
+ * established connection without taking the (shared) connf_lock.  Each
+ * entry holds a reference on its conn_t and conn_sqcache points back at the
+ * one cache holding it; entries are only added, and are always purged,
+ * under the connf_lock of the conn's bucket.  Lock order is connf_lock,
+ * icc_lock, conn_lock.
+ */
+#define	IPCL_CONN_CACHE_SIZE	256	/* must be a power of 2 */
+
+struct ipcl_conn_cache_s {
+	kmutex_t	icc_lock;
+	struct conn_s	*icc_conn[IPCL_CONN_CACHE_SIZE];
+};
+
 #define	CONN_INC_REF(connp)	{				\
 	mutex_enter(&(connp)->conn_lock);			\
 	DTRACE_PROBE1(conn__inc__ref, conn_t *, connp);		\
@@ -700,6 +720,8 @@ extern int	ipcl_conn_insert(conn_t *);
 extern int	ipcl_conn_insert_v4(conn_t *);
 extern int	ipcl_conn_insert_v6(conn_t *);
 extern conn_t	*ipcl_get_next_conn(connf_t *, conn_t *, uint32_t);
+extern void	ipcl_conn_cache_init(squeue_t *);
+extern void	ipcl_conn_cache_purge(conn_t *);
 
 conn_t *ipcl_classify_v4(mblk_t *, uint8_t, uint_t, ip_recv_attr_t *,
 	    ip_stack_t *);
@@ -10,7 +10,7 @@
  */
 
 /*
- * Copyright 2019, Joyent, Inc.
+ * Copyright 2020, Joyent, Inc.
  */
 
 /* IPF oddness for compilation in userland for IPF tests. */
@@ -58,6 +58,7 @@
 #endif
 #if defined(_KERNEL)
 #include <sys/sunddi.h>
+#include <sys/cpuvar.h>
 #endif
 
 #include "netinet/ipf_cfw.h"
@@ -84,13 +85,22 @@ boolean_t ipf_cfwlog_enabled;
 #ifdef _KERNEL
 
 /*
- * CFW event ring buffer.  Remember, this is for ALL ZONES because only a
+ * CFW event ring buffers.  Remember, these are for ALL ZONES because only a
  * global-zone event-reader will be consuming these.  In other words, it's
  * not something to instantiate per-netstack.
  *
- * We may want to get more sophisticated and performant (e.g. per-processor),
- * but for now keep the ring buffer simple and stupid.
- * Must be a power of 2, to be bitmaskable, and must be countable by a uint_t
+ * Events are reported from packet-processing context on every CPU, and a
+ * single ring behind a single lock made that lock an ipf hot spot under
+ * connection storms.  Instead, each CPU has its own ring, locked only by the
+ * CPUs reporting into it and, briefly, by the reader copying events out.
+ * The reader drains the rings into a private batch and only then copies the
+ * batch out to userland, so no ring lock is held across uiomove().  Events
+ * from different CPUs are therefore not delivered in time order.
+ *
+ * Each ring has cfw_ringsize entries, which must be a power of 2, to be
+ * bitmaskable, and must be countable by a uint_t.  The start and end indices
+ * run freely and are masked on use, so a ring is full when they differ by
+ * cfw_ringsize.
  *
  * Resizeable, see ipf_cfw_ring_resize() below.
  */
@@ -98,23 +108,43 @@ boolean_t ipf_cfwlog_enabled;
 #define	IPF_CFW_MIN_RING_BUFS		8
 #define	IPF_CFW_MAX_RING_BUFS		(1U << 31U)
 
-/* Assume C's init-to-zero is sufficient for these types... */
+typedef struct cfw_cpuring {
+	kmutex_t	ccr_lock;
+	uint_t		ccr_start;	/* next event for the reader */
+	uint_t		ccr_end;	/* next slot to fill */
+	cfwev_t		*ccr_ring;
+	uint64_t	ccr_reports;
+	uint64_t	ccr_drops;
+	uint64_t	ccr_pad[3];	/* keep rings on separate cache lines */
+} cfw_cpuring_t;
+
+/*
+ * cfw_ringlock serializes readers against each other and against resizing,
+ * and is what a waiting reader sleeps with.  Reporters only ever take it to
+ * wake a reader which has said, via cfw_reader_waiting, that it is asleep.
+ *
+ * Assume C's init-to-zero is sufficient for these types...
+ */
 static kmutex_t cfw_ringlock;
 static kcondvar_t cfw_ringcv;
+static volatile uint_t cfw_reader_waiting;
 
-static cfwev_t *cfw_ring;	/* NULL by default. */
+static cfw_cpuring_t *cfw_cpurings;	/* NULL by default. */
+static uint_t cfw_ncpurings;	/* 0 by default. */
+static uint_t cfw_nextring;	/* where the reader starts draining */
 static uint32_t cfw_ringsize;	/* 0 by default, number of array elements. */
 static uint32_t cfw_ringmask;	/* 0 by default. */
 
-/* If these are equal, we're either empty or full. */
-static uint_t cfw_ringstart, cfw_ringend;
-static boolean_t cfw_ringfull;	/* Tell the difference here! */
-/* Bean-counters. */
-static uint64_t cfw_evreports;
+/* Events lost by the reader or to resizing, rather than to overflow. */
 static uint64_t cfw_evdrops;
 
 /*
- * Place an event in the CFW event ring buffer.
+ * The most events the reader gathers from the rings in one go.
+ */
+uint_t cfw_batch = 256;
+
+/*
+ * Place an event in this CPU's event ring buffer.
  *
  * For now, be simple and drop the oldest event if we overflow. We may wish to
  * selectively drop older events based on type in the future.
@@ -122,40 +152,130 @@ static uint64_t cfw_evdrops;
 static void
 ipf_cfwev_report(cfwev_t *event)
 {
-	mutex_enter(&cfw_ringlock);
-	cfw_ring[cfw_ringend] = *event;
-	cfw_ringend++;
-	cfw_ringend &= cfw_ringmask;
-	if (cfw_ringfull) {
-		cfw_ringstart++;
-		cfw_ringstart &= cfw_ringmask;
-		ASSERT3U(cfw_ringstart, ==, cfw_ringend);
+	cfw_cpuring_t *ccr = &cfw_cpurings[CPU->cpu_seqid % cfw_ncpurings];
+
+	mutex_enter(&ccr->ccr_lock);
+	if (ccr->ccr_end - ccr->ccr_start == cfw_ringsize) {
+		ccr->ccr_start++;
 		DTRACE_PROBE(ipf__cfw__evdrop);
-		cfw_evdrops++;
+		ccr->ccr_drops++;
+	}
+	ccr->ccr_ring[ccr->ccr_end & cfw_ringmask] = *event;
+	ccr->ccr_end++;
+	ccr->ccr_reports++;
+	mutex_exit(&ccr->ccr_lock);
+
+	/*
+	 * Wake the reader only if it is asleep, and only once per sleep, so
+	 * that a burst of events costs a single wakeup.  The barrier orders
+	 * the event's publication against our check of cfw_reader_waiting;
+	 * ipf_cfwev_wait() does the converse.
+	 */
+	membar_enter();
+	if (cfw_reader_waiting != 0 &&
+	    atomic_swap_uint((uint_t *)&cfw_reader_waiting, 0) != 0) {
+		mutex_enter(&cfw_ringlock);
+		cv_broadcast(&cfw_ringcv);
+		mutex_exit(&cfw_ringlock);
+	}
+}
+
+/*
+ * Is any event waiting in any ring?  This is only a hint, as the rings are
+ * not locked.
+ */
+static boolean_t
+ipf_cfwev_pending(void)
+{
+	uint_t i;
+
+	for (i = 0; i < cfw_ncpurings; i++) {
+		if (cfw_cpurings[i].ccr_start != cfw_cpurings[i].ccr_end)
+			return (B_TRUE);
+	}
+	return (B_FALSE);
+}
+
+/*
+ * Move up to "max" events out of the rings and into "batch", starting with a
+ * different ring each time so that no CPU's events are starved.  Requires
+ * cfw_ringlock.
+ */
+static uint_t
+ipf_cfwev_gather(cfwev_t *batch, uint_t max)
+{
+	cfw_cpuring_t *ccr;
+	uint_t n = 0, i, idx, contig;
+
+	ASSERT(MUTEX_HELD(&cfw_ringlock));
+
+	for (i = 0; i < cfw_ncpurings && n < max; i++) {
+		ccr = &cfw_cpurings[(cfw_nextring + i) % cfw_ncpurings];
+		if (ccr->ccr_start == ccr->ccr_end)
+			continue;
+
+		mutex_enter(&ccr->ccr_lock);
+		while (n < max && ccr->ccr_start != ccr->ccr_end) {
+			idx = ccr->ccr_start & cfw_ringmask;
+			contig = MIN(ccr->ccr_end - ccr->ccr_start,
+			    cfw_ringsize - idx);
+			contig = MIN(contig, max - n);
+			bcopy(&ccr->ccr_ring[idx], &batch[n],
+			    contig * sizeof (cfwev_t));
+			ccr->ccr_start += contig;
+			n += contig;
+		}
+		mutex_exit(&ccr->ccr_lock);
+	}
+	cfw_nextring = (cfw_nextring + 1) % cfw_ncpurings;
+
+	return (n);
+}
+
+/*
+ * Sleep until an event is reported, for at most "delta" ticks if that is not
+ * -1.  Requires cfw_ringlock, and returns as cv_reltimedwait_sig() does.
+ */
+static clock_t
+ipf_cfwev_wait(clock_t delta)
+{
+	clock_t rv;
+
+	ASSERT(MUTEX_HELD(&cfw_ringlock));
+
+	cfw_reader_waiting = 1;
+	membar_enter();
+	if (ipf_cfwev_pending()) {
+		cfw_reader_waiting = 0;
+		return (1);
+	}
+
+	if (delta == -1) {
+		rv = cv_wait_sig(&cfw_ringcv, &cfw_ringlock);
 	} else {
-		cfw_ringfull = (cfw_ringend == cfw_ringstart);
+		rv = cv_reltimedwait_sig(&cfw_ringcv, &cfw_ringlock, delta,
+		    TR_CLOCK_TICK);
 	}
-	cfw_evreports++;
-	cv_broadcast(&cfw_ringcv);
-	mutex_exit(&cfw_ringlock);
+	cfw_reader_waiting = 0;
+
+	return (rv);
 }
 
 /*
- * Provide access to multiple CFW events that can allow copying straight from
- * the ring buffer up to userland.  Requires a callback (which could call
- * uiomove() directly, OR to a local still-in-kernel buffer) that must do the
- * data copying-out.
+ * Provide access to multiple CFW events that can allow copying up to
+ * userland.  Requires a callback (which could call uiomove() directly, OR to
+ * a local still-in-kernel buffer) that must do the data copying-out.
  *
  * Callback function is of the form:
  *
  *	uint_t cfw_many_cb(cfwev_t *evptr, int num_avail, void *cbarg);
  *
  * The function must return how many events got consumed, which MUST be <= the
- * number available.  The function must ALSO UNDERSTAND that cfw_ringlock is
- * held and must not be released during this time.  The function may be called
- * more than once, if the available buffers wrap-around OR "block" is set and
- * we don't have enough buffers.  If any callback returns 0, exit the function
- * with however many were consumed.
+ * number available.  The events it is handed have already been taken out of
+ * the rings, so any it does not consume are lost, and counted as drops.  The
+ * function may be called more than once, as each batch is gathered or if
+ * "block" is set and we don't have enough events.  If any callback returns
+ * less than it was given, exit the function with however many were consumed.
  *
  * This function, like the callback, returns the number of events *CONSUMED*.
  *
@@ -182,70 +302,43 @@ static uint_t
 ipf_cfwev_consume_many(uint_t num_requested, boolean_t block,
     cfwmanycb_t cfw_many_cb, void *cbarg)
 {
-	uint_t consumed = 0, cb_consumed, contig_size;
+	uint_t consumed = 0, cb_consumed, n, batchsize;
 	uint_t timeout_tries = cfw_timeout_tries;
 	boolean_t eintr = B_FALSE;
+	cfwev_t *batch;
+
+	batchsize = MIN(num_requested, MAX(cfw_batch, 1));
+	batch = kmem_alloc(batchsize * sizeof (cfwev_t), KM_SLEEP);
 
 	mutex_enter(&cfw_ringlock);
 
 	while (num_requested > 0) {
-		clock_t delta;
-
-		/* Silly reality checks */
-		ASSERT3U(cfw_ringstart, <, cfw_ringsize);
-		ASSERT3U(cfw_ringend, <, cfw_ringsize);
-
-		if (cfw_ringstart > cfw_ringend || cfw_ringfull) {
-			/* We have from ringstart to the buffer's end. */
-			contig_size = cfw_ringsize - cfw_ringstart;
-		} else if (cfw_ringstart < cfw_ringend) {
-			/* We have no potential wrapping at this time. */
-			contig_size = cfw_ringend - cfw_ringstart;
-		} else if (block && cv_wait_sig(&cfw_ringcv, &cfw_ringlock)) {
-			/* Maybe something to consume now, try again. */
+		n = ipf_cfwev_gather(batch, MIN(num_requested, batchsize));
+		if (n != 0) {
+			cb_consumed = cfw_many_cb(batch, n, cbarg);
+			ASSERT3U(cb_consumed, <=, n);
+			consumed += cb_consumed;
+			if (cb_consumed < n) {
+				/*
+				 * Callback returned less than given.
+				 * This is likely a uio error, and what it
+				 * didn't take is gone.  Get out of here.
+				 */
+				cfw_evdrops += n - cb_consumed;
+				break;
+			}
+			num_requested -= n;
 			continue;
-		} else {
-			/* Nothing (more) to consume, return! */
-			eintr = (block && consumed == 0);
-			break;
 		}
 
-		/* Less asked-for than what we needed. */
-		if (num_requested < contig_size)
-			contig_size = num_requested;
-
-		cb_consumed =
-		    cfw_many_cb(&(cfw_ring[cfw_ringstart]), contig_size, cbarg);
-		ASSERT3U(cb_consumed, <=, contig_size);
-
-		cfw_ringstart += cb_consumed;
-		ASSERT3U(cfw_ringstart, <=, cfw_ringmask + 1);
-		cfw_ringstart &= cfw_ringmask;	/* In case of wraparound. */
-		consumed += cb_consumed;
-		cfw_ringfull = (cfw_ringfull && cb_consumed == 0);
-		if (cb_consumed < contig_size) {
-			/*
-			 * Callback returned less than given.
-			 * This is likely a uio error, but we have
-			 * something.  Get out of here.
-			 */
-			break;
-		}
-		ASSERT3U(cb_consumed, ==, contig_size);
-		num_requested -= contig_size;
-
-		if (num_requested == 0) {
-			/* All done! */
-			break;
-		}
-
-		if (cfw_ringstart != cfw_ringend) {
-			/*
-			 * We wrapped around the end of the buffer, and
-			 * we have more available to fill our request.
-			 */
-			ASSERT0(cfw_ringstart);
-			ASSERT(!cfw_ringfull);
+		if (consumed == 0) {
+			if (!block)
+				break;
+			if (ipf_cfwev_wait(-1) == 0) {
+				/* Received signal with nothing to return. */
+				eintr = B_TRUE;
+				break;
+			}
 			continue;
 		}
 
@@ -255,18 +348,12 @@ ipf_cfwev_consume_many(uint_t num_requested, boolean_t block,
 		 */
 		if (timeout_tries == 0)
 			break;	/* Don't bother... */
-		delta = drv_usectohz(cfw_timeout_wait);
 		timeout_tries--;
 
-		switch (cv_reltimedwait_sig(&cfw_ringcv, &cfw_ringlock, delta,
-		    TR_CLOCK_TICK)) {
+		switch (ipf_cfwev_wait(drv_usectohz(cfw_timeout_wait))) {
 		case 0:
-			/*
-			 * Received signal!  Return what we have OR if we have
-			 * nothing, EINTR.
-			 */
+			/* Received signal!  Return what we have. */
 			DTRACE_PROBE1(ipf__cfw__timedsignal, int, consumed);
-			eintr = (consumed == 0);
 			num_requested = 0;
 			break;
 		case -1:
@@ -282,6 +369,7 @@ ipf_cfwev_consume_many(uint_t num_requested, boolean_t block,
 	}
 
 	mutex_exit(&cfw_ringlock);
+	kmem_free(batch, batchsize * sizeof (cfwev_t));
 	if (eintr)
 		((uio_error_t *)cbarg)->ue_error = EINTR;
 	return (consumed);
@@ -482,59 +570,97 @@ cfwlog_read_manycb(cfwev_t *evptr, uint_t num_avail, void *cbarg)
 }
 
 /*
- * Resize the CFW event ring buffer.
+ * Resize the CFW event ring buffers.
  *
  * The caller must ensure the new size is a power of 2 between
  * IPF_CFW_{MIN,MAX}_RING_BUFS (inclusive) or the special values
  * IPF_CFW_RING_ALLOCATE (first-time creation) or IPF_CFW_RING_DESTROY
- * (netstack-unload destruction).
+ * (netstack-unload destruction).  The size applies to each CPU's ring.
  *
- * Everything in the current ring will be destroyed (and reported as a drop)
+ * Everything in the current rings will be destroyed (and reported as a drop)
  * upon resize.
  */
 int
 ipf_cfw_ring_resize(uint32_t newsize)
 {
+	cfw_cpuring_t *ccr;
+	cfwev_t **rings;
+	uint32_t oldsize;
+	uint_t i;
+
 	ASSERT(MUTEX_HELD(&cfw_ringlock) || newsize == IPF_CFW_RING_ALLOCATE ||
 	    newsize == IPF_CFW_RING_DESTROY);
 
 	if (newsize == IPF_CFW_RING_ALLOCATE) {
-		if (cfw_ring != NULL)
+		if (cfw_cpurings != NULL)
 			return (EBUSY);
 		newsize = IPF_CFW_DEFAULT_RING_BUFS;
-		/* Fall through to allocating a new ring buffer. */
-	} else {
-		/* We may be called during error cleanup, so be liberal here. */
-		if ((cfw_ring == NULL && newsize == IPF_CFW_RING_DESTROY) ||
-		    newsize == cfw_ringsize) {
-			return (0);
+		cfw_ncpurings = MAX(ncpus, 1);
+		cfw_cpurings = kmem_zalloc(cfw_ncpurings *
+		    sizeof (cfw_cpuring_t), KM_SLEEP);
+		for (i = 0; i < cfw_ncpurings; i++) {
+			ccr = &cfw_cpurings[i];
+			mutex_init(&ccr->ccr_lock, NULL, MUTEX_DEFAULT, NULL);
+			ccr->ccr_ring = kmem_alloc(newsize * sizeof (cfwev_t),
+			    KM_SLEEP);
 		}
-		kmem_free(cfw_ring, cfw_ringsize * sizeof (cfwev_t));
-		cfw_ring = NULL;
-		if (cfw_ringfull) {
-			cfw_evdrops += cfw_ringsize;
-		} else if (cfw_ringstart > cfw_ringend) {
-			cfw_evdrops += cfw_ringend +
-			    (cfw_ringsize - cfw_ringstart);
-		} else {
-			cfw_evdrops += cfw_ringend - cfw_ringstart;
-		}
-		cfw_ringsize = cfw_ringmask = cfw_ringstart = cfw_ringend = 0;
-		cfw_ringfull = B_FALSE;
+		/* KM_SLEEP means we always succeed. */
+		cfw_ringsize = newsize;
+		cfw_ringmask = cfw_ringsize - 1;
+		return (0);
+	}
 
-		if (newsize == IPF_CFW_RING_DESTROY)
-			return (0);
-		/*
-		 * Keep the reports & drops around because if we're just
-		 * resizing, we need to know what we lost.
-		 */
+	/* We may be called during error cleanup, so be liberal here. */
+	if (cfw_cpurings == NULL ||
+	    (newsize != IPF_CFW_RING_DESTROY && newsize == cfw_ringsize))
+		return (0);
+
+	if (newsize == IPF_CFW_RING_DESTROY) {
+		/* No more reporters or readers, by now. */
+		for (i = 0; i < cfw_ncpurings; i++) {
+			ccr = &cfw_cpurings[i];
+			kmem_free(ccr->ccr_ring,
+			    cfw_ringsize * sizeof (cfwev_t));
+			mutex_destroy(&ccr->ccr_lock);
+		}
+		kmem_free(cfw_cpurings, cfw_ncpurings * sizeof (cfw_cpuring_t));
+		cfw_cpurings = NULL;
+		cfw_ncpurings = 0;
+		cfw_ringsize = cfw_ringmask = 0;
+		return (0);
 	}
 
+	/*
+	 * Allocate the new rings before stopping the reporters, then swap
+	 * them in with every ring locked.  Keep the reports & drops around
+	 * because if we're just resizing, we need to know what we lost.
+	 */
 	ASSERT(ISP2(newsize));
-	cfw_ring = kmem_alloc(newsize * sizeof (cfwev_t), KM_SLEEP);
-	/* KM_SLEEP means we always succeed. */
+	rings = kmem_alloc(cfw_ncpurings * sizeof (cfwev_t *), KM_SLEEP);
+	for (i = 0; i < cfw_ncpurings; i++)
+		rings[i] = kmem_alloc(newsize * sizeof (cfwev_t), KM_SLEEP);
+
+	for (i = 0; i < cfw_ncpurings; i++)
+		mutex_enter(&cfw_cpurings[i].ccr_lock);
+	for (i = 0; i < cfw_ncpurings; i++) {
+		cfwev_t *old;
+
+		ccr = &cfw_cpurings[i];
+		ccr->ccr_drops += ccr->ccr_end - ccr->ccr_start;
+		ccr->ccr_start = ccr->ccr_end = 0;
+		old = ccr->ccr_ring;
+		ccr->ccr_ring = rings[i];
+		rings[i] = old;
+	}
+	oldsize = cfw_ringsize;
 	cfw_ringsize = newsize;
 	cfw_ringmask = cfw_ringsize - 1;
+	for (i = 0; i < cfw_ncpurings; i++)
+		mutex_exit(&cfw_cpurings[i].ccr_lock);
+
+	for (i = 0; i < cfw_ncpurings; i++)
+		kmem_free(rings[i], oldsize * sizeof (cfwev_t));
+	kmem_free(rings, cfw_ncpurings * sizeof (cfwev_t *));
 
 	return (0);
 }
@@ -551,6 +677,7 @@ ipf_cfwlog_ioctl(dev_t dev, int cmd, intptr_t data, int mode, cred_t *cp,
 {
 	ipfcfwcfg_t cfginfo;
 	int error;
+	uint_t i;
 
 	if (cmd != SIOCIPFCFWCFG && cmd != SIOCIPFCFWNEWSZ)
 		return (EIO);
@@ -564,7 +691,9 @@ ipf_cfwlog_ioctl(dev_t dev, int cmd, intptr_t data, int mode, cred_t *cp,
 
 	cfginfo.ipfcfwc_maxevsize = sizeof (cfwev_t);
 	mutex_enter(&cfw_ringlock);
-	cfginfo.ipfcfwc_evreports = cfw_evreports;
+	cfginfo.ipfcfwc_evreports = 0;
+	for (i = 0; i < cfw_ncpurings; i++)
+		cfginfo.ipfcfwc_evreports += cfw_cpurings[i].ccr_reports;
 	if (cmd == SIOCIPFCFWNEWSZ) {
 		uint32_t newsize = cfginfo.ipfcfwc_evringsize;
 
@@ -578,8 +707,10 @@ ipf_cfwlog_ioctl(dev_t dev, int cmd, intptr_t data, int mode, cred_t *cp,
 	} else {
 		error = 0;
 	}
-	/* Both cfw_evdrops and cfw_ringsize are affected by resize. */
+	/* Both the drops and cfw_ringsize are affected by resize. */
 	cfginfo.ipfcfwc_evdrops = cfw_evdrops;
+	for (i = 0; i < cfw_ncpurings; i++)
+		cfginfo.ipfcfwc_evdrops += cfw_cpurings[i].ccr_drops;
 	cfginfo.ipfcfwc_evringsize = cfw_ringsize;
 	mutex_exit(&cfw_ringlock);
 
@@ -5,7 +5,7 @@
  *
  * Copyright (c) 2003, 2010, Oracle and/or its affiliates. All rights reserved.
  *
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #if defined(KERNEL) || defined(_KERNEL)
@@ -7213,9 +7213,9 @@ ipf_stack_t *ifs;
 			(void)fr_derefrule((frentry_t **)datap, ifs);
 			break;
 		case IPFGENITER_IPNAT :
-			WRITE_ENTER(&ifs->ifs_ipf_nat);
+			BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 			fr_ipnatderef((ipnat_t **)datap, ifs);
-			RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+			BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 			break;
 		case IPFGENITER_NAT :
 			fr_natderef((nat_t **)datap, ifs);
@@ -7231,9 +7231,9 @@ ipf_stack_t *ifs;
 				     &ifs->ifs_ipf_natfrag, ifs);
 			break;
 		case IPFGENITER_HOSTMAP :
-			WRITE_ENTER(&ifs->ifs_ipf_nat);
+			BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 			fr_hostmapdel((hostmap_t **)datap);
-			RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+			BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 			break;
 		default :
 			(void) ip_lookup_iterderef(token->ipt_type, data, ifs);
@@ -5,7 +5,7 @@
  *
  * Copyright (c) 2003, 2010, Oracle and/or its affiliates. All rights reserved.
  *
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #if !defined(lint)
@@ -1969,6 +1969,120 @@ fr_info_t *fin;
 }
 
 
+/*
+ * The most shards that a big reader lock is split into; see ip_compat.h.
+ */
+u_int ipf_brlock_maxshards = 64;
+
+/* ------------------------------------------------------------------------ */
+/* Function:    ipf_brlock_init                                             */
+/* Returns:     Nil                                                         */
+/* Parameters:  brl(I)  - pointer to lock to initialise                     */
+/*              name(I) - name of the lock                                  */
+/*                                                                          */
+/* Sets up a big reader lock with a shard per CPU, up to a limit of         */
+/* ipf_brlock_maxshards.  The number of shards is a power of two so that a  */
+/* thread ID can be reduced to a shard with a mask.                         */
+/* ------------------------------------------------------------------------ */
+void ipf_brlock_init(brl, name)
+ipfbrlock_t *brl;
+char *name;
+{
+	u_int n, i;
+
+	n = MIN((u_int)ncpus, ipf_brlock_maxshards);
+	n = (n <= 1) ? 1 : 1U << highbit(n - 1);
+
+	brl->ipfbr_shards = kmem_zalloc(n * sizeof (ipfbrshard_t), KM_SLEEP);
+	brl->ipfbr_mask = n - 1;
+	for (i = 0; i < n; i++)
+		RWLOCK_INIT(&brl->ipfbr_shards[i].ipfbs_lock, name);
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Function:    ipf_brlock_destroy                                          */
+/* Returns:     Nil                                                         */
+/* Parameters:  brl(I) - pointer to lock to destroy                         */
+/* ------------------------------------------------------------------------ */
+void ipf_brlock_destroy(brl)
+ipfbrlock_t *brl;
+{
+	u_int i;
+
+	for (i = 0; i <= brl->ipfbr_mask; i++)
+		RW_DESTROY(&brl->ipfbr_shards[i].ipfbs_lock);
+	kmem_free(brl->ipfbr_shards,
+	    (brl->ipfbr_mask + 1) * sizeof (ipfbrshard_t));
+	brl->ipfbr_shards = NULL;
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Function:    ipf_br_write_enter                                          */
+/* Returns:     Nil                                                         */
+/* Parameters:  brl(I) - pointer to lock                                    */
+/*                                                                          */
+/* Take every shard of a big reader lock as writer, always in the same      */
+/* order so that two writers cannot deadlock against each other.            */
+/* ------------------------------------------------------------------------ */
+void ipf_br_write_enter(brl)
+ipfbrlock_t *brl;
+{
+	u_int i;
+
+	for (i = 0; i <= brl->ipfbr_mask; i++)
+		WRITE_ENTER(&brl->ipfbr_shards[i].ipfbs_lock);
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Function:    ipf_br_downgrade                                            */
+/* Returns:     Nil                                                         */
+/* Parameters:  brl(I) - pointer to lock                                    */
+/*                                                                          */
+/* Turn a write hold into a read hold: keep the shard that BR_READ_ENTER    */
+/* would have chosen for this thread, as reader, and drop all of the rest.  */
+/* ------------------------------------------------------------------------ */
+void ipf_br_downgrade(brl)
+ipfbrlock_t *brl;
+{
+	ipfrwlock_t *mine = BRLOCK_SHARD(brl);
+	u_int i;
+
+	ASSERT(rw_write_held(&BRLOCK_LK(brl)));
+
+	MUTEX_DOWNGRADE(mine);
+	for (i = 0; i <= brl->ipfbr_mask; i++) {
+		if (&brl->ipfbr_shards[i].ipfbs_lock != mine)
+			RWLOCK_EXIT(&brl->ipfbr_shards[i].ipfbs_lock);
+	}
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Function:    ipf_br_exit                                                 */
+/* Returns:     Nil                                                         */
+/* Parameters:  brl(I) - pointer to lock                                    */
+/*                                                                          */
+/* Release a big reader lock that is held either as reader or as writer.    */
+/* Only a writer can hold the first shard as writer, so that is enough to   */
+/* tell which shards are held.                                              */
+/* ------------------------------------------------------------------------ */
+void ipf_br_exit(brl)
+ipfbrlock_t *brl;
+{
+	u_int i;
+
+	if (rw_write_held(&BRLOCK_LK(brl))) {
+		for (i = brl->ipfbr_mask + 1; i-- > 0; )
+			RWLOCK_EXIT(&brl->ipfbr_shards[i].ipfbs_lock);
+	} else {
+		RWLOCK_EXIT(BRLOCK_SHARD(brl));
+	}
+}
+
+
 #ifndef IPFILTER_CKSUM
 /* ARGSUSED */
 #endif
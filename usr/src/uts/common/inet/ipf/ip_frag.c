@@ -796,7 +796,7 @@ ipf_stack_t *ifs;
 	ifs->ifs_ipfr_tail = &ifs->ifs_ipfr_list;
 	RWLOCK_EXIT(&ifs->ifs_ipf_frag);
 
-	WRITE_ENTER(&ifs->ifs_ipf_nat);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 	WRITE_ENTER(&ifs->ifs_ipf_natfrag);
 	while ((fra = ifs->ifs_ipfr_natlist) != NULL) {
 		nat = fra->ipfr_data;
@@ -809,7 +809,7 @@ ipf_stack_t *ifs;
 	}
 	ifs->ifs_ipfr_nattail = &ifs->ifs_ipfr_natlist;
 	RWLOCK_EXIT(&ifs->ifs_ipf_natfrag);
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 }
 
 
@@ -865,7 +865,7 @@ ipf_stack_t *ifs;
 	 * NOTE: We need to grab both mutex's early, and in this order so as
 	 * to prevent a deadlock if both try to expire at the same time.
 	 */
-	WRITE_ENTER(&ifs->ifs_ipf_nat);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 	WRITE_ENTER(&ifs->ifs_ipf_natfrag);
 	for (fp = &ifs->ifs_ipfr_natlist; ((fra = *fp) != NULL); ) {
 		if (fra->ipfr_ttl > ifs->ifs_fr_ticks)
@@ -881,7 +881,7 @@ ipf_stack_t *ifs;
 		ifs->ifs_ipfr_inuse--;
 	}
 	RWLOCK_EXIT(&ifs->ifs_ipf_natfrag);
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 	SPL_X(s);
 }
 
@@ -5,6 +5,8 @@
  *
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ *
+ * Copyright 2020 Joyent, Inc.
  */
 
 #if defined(KERNEL) || defined(_KERNEL)
@@ -286,7 +288,7 @@ ipf_stack_t *ifs;
 	ifs->ifs_nat_tqb[IPF_TCPS_CLOSED].ifq_ttl =
 	    ifs->ifs_nat_tqb[IPF_TCPS_LAST_ACK].ifq_ttl;
 
-	RWLOCK_INIT(&ifs->ifs_ipf_nat, "ipf IP NAT rwlock");
+	BRLOCK_INIT(&ifs->ifs_ipf_nat, "ipf IP NAT rwlock");
 	RWLOCK_INIT(&ifs->ifs_ipf_natfrag, "ipf IP NAT-Frag rwlock");
 	MUTEX_INIT(&ifs->ifs_ipf_nat_new, "ipf nat new mutex");
 	MUTEX_INIT(&ifs->ifs_ipf_natio, "ipf nat io mutex");
@@ -779,7 +781,7 @@ ipf_stack_t *ifs;
 		natlookup_t nl;
 
 		if (getlock) {
-			READ_ENTER(&ifs->ifs_ipf_nat);
+			BR_READ_ENTER(&ifs->ifs_ipf_nat);
 		}
 		error = fr_inobj(data, &nl, IPFOBJ_NATLOOKUP);
 		if (nl.nl_v != 6)
@@ -809,7 +811,7 @@ ipf_stack_t *ifs;
 			}
 		}
 		if (getlock) {
-			RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+			BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 		}
 		break;
 	    }
@@ -819,7 +821,7 @@ ipf_stack_t *ifs;
 			break;
 		}
 		if (getlock) {
-			WRITE_ENTER(&ifs->ifs_ipf_nat);
+			BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 		}
 		error = BCOPYIN(data, &arg, sizeof(arg));
 		if (error != 0) {
@@ -833,7 +835,7 @@ ipf_stack_t *ifs;
 				error = EINVAL;
 		}
 		if (getlock) {
-			RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+			BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 		}
 		if (error == 0) {
 			error = BCOPYOUT(&ret, data, sizeof(ret));
@@ -861,11 +863,11 @@ ipf_stack_t *ifs;
 	case SIOCSTGSZ :
 		if (ifs->ifs_fr_nat_lock) {
 			if (getlock) {
-				READ_ENTER(&ifs->ifs_ipf_nat);
+				BR_READ_ENTER(&ifs->ifs_ipf_nat);
 			}
 			error = fr_natgetsz(data, ifs);
 			if (getlock) {
-				RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+				BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 			}
 		} else
 			error = EACCES;
@@ -873,11 +875,11 @@ ipf_stack_t *ifs;
 	case SIOCSTGET :
 		if (ifs->ifs_fr_nat_lock) {
 			if (getlock) {
-				READ_ENTER(&ifs->ifs_ipf_nat);
+				BR_READ_ENTER(&ifs->ifs_ipf_nat);
 			}
 			error = fr_natgetent(data, ifs);
 			if (getlock) {
-				RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+				BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 			}
 		} else
 			error = EACCES;
@@ -1021,7 +1023,7 @@ ipf_stack_t *ifs;
 	/* Otherwise, these fields are preset */
 
 	if (getlock) {
-		WRITE_ENTER(&ifs->ifs_ipf_nat);
+		BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 	}
 	n->in_next = NULL;
 	*np = n;
@@ -1069,7 +1071,7 @@ ipf_stack_t *ifs;
 	n = NULL;
 	ifs->ifs_nat_stats.ns_rules++;
 	if (getlock) {
-		RWLOCK_EXIT(&ifs->ifs_ipf_nat);			/* WRITE */
+		BRLOCK_EXIT(&ifs->ifs_ipf_nat);			/* WRITE */
 	}
 
 	return error;
@@ -1131,7 +1133,7 @@ ipf_stack_t *ifs;
 	int i;
 
 	if (getlock) {
-		WRITE_ENTER(&ifs->ifs_ipf_nat);
+		BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 	}
 	if (n->in_redir & NAT_REDIRECT)
 		nat_delrdr(n);
@@ -1170,7 +1172,7 @@ ipf_stack_t *ifs;
 		n->in_next = NULL;
 	}
 	if (getlock) {
-		RWLOCK_EXIT(&ifs->ifs_ipf_nat);			/* READ/WRITE */
+		BRLOCK_EXIT(&ifs->ifs_ipf_nat);			/* READ/WRITE */
 	}
 }
 
@@ -1677,7 +1679,7 @@ ipf_stack_t *ifs;
 		fin.fin_data[1] = ntohs(nat->nat_outport);
 		fin.fin_ifp = nat->nat_ifps[0];
 		if (getlock) {
-			READ_ENTER(&ifs->ifs_ipf_nat);
+			BR_READ_ENTER(&ifs->ifs_ipf_nat);
 		}
 
 		switch (nat->nat_v)
@@ -1699,7 +1701,7 @@ ipf_stack_t *ifs;
 		}
 
 		if (getlock) {
-			RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+			BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 		}
 		if (n != NULL) {
 			error = EEXIST;
@@ -1710,7 +1712,7 @@ ipf_stack_t *ifs;
 		fin.fin_data[1] = ntohs(nat->nat_oport);
 		fin.fin_ifp = nat->nat_ifps[1];
 		if (getlock) {
-			READ_ENTER(&ifs->ifs_ipf_nat);
+			BR_READ_ENTER(&ifs->ifs_ipf_nat);
 		}
 
 		switch (nat->nat_v)
@@ -1731,7 +1733,7 @@ ipf_stack_t *ifs;
 		}
 
 		if (getlock) {
-			RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+			BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 		}
 		if (n != NULL) {
 			error = EEXIST;
@@ -1803,7 +1805,7 @@ ipf_stack_t *ifs;
 			MUTEX_INIT(&fr->fr_lock, "nat-filter rule lock");
 		} else {
 			if (getlock) {
-				READ_ENTER(&ifs->ifs_ipf_nat);
+				BR_READ_ENTER(&ifs->ifs_ipf_nat);
 			}
 			for (n = ifs->ifs_nat_instances; n; n = n->nat_next)
 				if (n->nat_fr == fr)
@@ -1815,7 +1817,7 @@ ipf_stack_t *ifs;
 				MUTEX_EXIT(&fr->fr_lock);
 			}
 			if (getlock) {
-				RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+				BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 			}
 			if (!n) {
 				error = ESRCH;
@@ -1832,7 +1834,7 @@ ipf_stack_t *ifs;
 	nat_calc_chksum_diffs(nat);
 
 	if (getlock) {
-		WRITE_ENTER(&ifs->ifs_ipf_nat);
+		BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 	}
 
 	nat_calc_chksum_diffs(nat);
@@ -1856,7 +1858,7 @@ ipf_stack_t *ifs;
 		ifs->ifs_ap_sess_list = aps;
 	}
 	if (getlock) {
-		RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+		BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 	}
 
 	if (error == 0)
@@ -3375,12 +3377,12 @@ find_in_wild_ports:
 	if (ifs->ifs_nat_stats.ns_wilds == 0)
 		return NULL;
 
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 
 	hv = NAT_HASH_FN(dst, 0, 0xffffffff);
 	hv = NAT_HASH_FN(src.s_addr, hv, ifs->ifs_ipf_nattable_sz);
 
-	WRITE_ENTER(&ifs->ifs_ipf_nat);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 
 	nat = ifs->ifs_nat_table[1][hv];
 	for (; nat; nat = nat->nat_hnext[1]) {
@@ -3424,7 +3426,7 @@ find_in_wild_ports:
 		}
 	}
 
-	MUTEX_DOWNGRADE(&ifs->ifs_ipf_nat);
+	BR_DOWNGRADE(&ifs->ifs_ipf_nat);
 
 	return nat;
 }
@@ -3616,12 +3618,12 @@ find_out_wild_ports:
 	if (ifs->ifs_nat_stats.ns_wilds == 0)
 		return NULL;
 
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 
 	hv = NAT_HASH_FN(srcip, 0, 0xffffffff);
 	hv = NAT_HASH_FN(dst.s_addr, hv, ifs->ifs_ipf_nattable_sz);
 
-	WRITE_ENTER(&ifs->ifs_ipf_nat);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 
 	nat = ifs->ifs_nat_table[0][hv];
 	for (; nat; nat = nat->nat_hnext[0]) {
@@ -3667,7 +3669,7 @@ find_out_wild_ports:
 		}
 	}
 
-	MUTEX_DOWNGRADE(&ifs->ifs_ipf_nat);
+	BR_DOWNGRADE(&ifs->ifs_ipf_nat);
 
 	return nat;
 }
@@ -3924,7 +3926,7 @@ u_32_t *passp;
 
 	ipa = fin->fin_saddr;
 
-	READ_ENTER(&ifs->ifs_ipf_nat);
+	BR_READ_ENTER(&ifs->ifs_ipf_nat);
 
 	if ((fin->fin_p == IPPROTO_ICMP) && !(nflags & IPN_ICMPQUERY) &&
 	    (nat = nat_icmperror(fin, &nflags, NAT_OUTBOUND)))
@@ -3981,19 +3983,19 @@ maskloop:
 			}
 
 			ATOMIC_INC32(np->in_use);
-			RWLOCK_EXIT(&ifs->ifs_ipf_nat);
-			WRITE_ENTER(&ifs->ifs_ipf_nat);
+			BRLOCK_EXIT(&ifs->ifs_ipf_nat);
+			BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 			nat = nat_new(fin, np, NULL, nflags, NAT_OUTBOUND);
 			if (nat != NULL) {
 				np->in_use--;
 				np->in_hits++;
-				MUTEX_DOWNGRADE(&ifs->ifs_ipf_nat);
+				BR_DOWNGRADE(&ifs->ifs_ipf_nat);
 				break;
 			}
 			natfailed = -1;
 			npnext = np->in_mnext;
 			fr_ipnatderef(&np, ifs);
-			MUTEX_DOWNGRADE(&ifs->ifs_ipf_nat);
+			BR_DOWNGRADE(&ifs->ifs_ipf_nat);
 		}
 		if ((np == NULL) && (nmsk != 0)) {
 			while (nmsk) {
@@ -4022,7 +4024,7 @@ nonatfrag:
 		}
 	} else
 		rval = natfailed;
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 
 	if (rval == -1) {
 		if (passp != NULL)
@@ -4250,7 +4252,7 @@ u_32_t *passp;
 
 	in = fin->fin_dst;
 
-	READ_ENTER(&ifs->ifs_ipf_nat);
+	BR_READ_ENTER(&ifs->ifs_ipf_nat);
 
 	if ((fin->fin_p == IPPROTO_ICMP) && !(nflags & IPN_ICMPQUERY) &&
 	    (nat = nat_icmperror(fin, &nflags, NAT_INBOUND)))
@@ -4307,19 +4309,19 @@ maskloop:
 			}
 
 			ATOMIC_INC32(np->in_use);
-			RWLOCK_EXIT(&ifs->ifs_ipf_nat);
-			WRITE_ENTER(&ifs->ifs_ipf_nat);
+			BRLOCK_EXIT(&ifs->ifs_ipf_nat);
+			BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 			nat = nat_new(fin, np, NULL, nflags, NAT_INBOUND);
 			if (nat != NULL) {
 				np->in_use--;
 				np->in_hits++;
-				MUTEX_DOWNGRADE(&ifs->ifs_ipf_nat);
+				BR_DOWNGRADE(&ifs->ifs_ipf_nat);
 				break;
 			}	
 			natfailed = -1;
 			npnext = np->in_rnext;
 			fr_ipnatderef(&np, ifs);
-			MUTEX_DOWNGRADE(&ifs->ifs_ipf_nat);
+			BR_DOWNGRADE(&ifs->ifs_ipf_nat);
 		}
 
 		if ((np == NULL) && (rmsk != 0)) {
@@ -4349,7 +4351,7 @@ nonatfrag:
 		}
 	} else
 		rval = natfailed;
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 
 	if (rval == -1) {
 		if (passp != NULL)
@@ -4656,7 +4658,7 @@ ipf_stack_t *ifs;
 		fr_sttab_destroy(ifs->ifs_nat_tqb);
 
 		RW_DESTROY(&ifs->ifs_ipf_natfrag);
-		RW_DESTROY(&ifs->ifs_ipf_nat);
+		BR_DESTROY(&ifs->ifs_ipf_nat);
 
 		MUTEX_DESTROY(&ifs->ifs_ipf_nat_new);
 		MUTEX_DESTROY(&ifs->ifs_ipf_natio);
@@ -4685,7 +4687,7 @@ ipf_stack_t *ifs;
 	SPL_INT(s);
 
 	SPL_NET(s);
-	WRITE_ENTER(&ifs->ifs_ipf_nat);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 	for (ifq = ifs->ifs_nat_tqb, i = 0; ifq != NULL; ifq = ifq->ifq_next) {
 		for (tqn = ifq->ifq_head; ((tqe = tqn) != NULL); i++) {
 			if (tqe->tqe_die > ifs->ifs_fr_ticks)
@@ -4720,7 +4722,7 @@ ipf_stack_t *ifs;
 		ifs->ifs_nat_doflush = 0;
 	}
 
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 	SPL_X(s);
 }
 
@@ -4753,10 +4755,10 @@ ipf_stack_t *ifs;
 		return;
 
 	SPL_NET(s);
-	WRITE_ENTER(&ifs->ifs_ipf_nat);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 
 	if (ifs->ifs_fr_running <= 0) {
-		RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+		BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 		return;
 	}
 
@@ -4843,7 +4845,7 @@ ipf_stack_t *ifs;
 		nat->nat_sumd[1] = nat->nat_sumd[0];
 	}
 
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 	SPL_X(s);
 }
 
@@ -4879,10 +4881,10 @@ ipf_stack_t *ifs;
 		return;
 
 	SPL_NET(s);
-	WRITE_ENTER(&ifs->ifs_ipf_nat);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 
 	if (ifs->ifs_fr_running <= 0) {
-		RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+		BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 		return;
 	}
 
@@ -4963,7 +4965,7 @@ ipf_stack_t *ifs;
 		}
 		break;
 	}
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 	SPL_X(s);
 }
 
@@ -4988,7 +4990,7 @@ ipf_stack_t *ifs;
 	nat_t *nat;
 	ipnat_t *n;
 
-	WRITE_ENTER(&ifs->ifs_ipf_nat);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 
 	for (nat = ifs->ifs_nat_instances; nat != NULL; nat = nat->nat_next) {
 		if (ifp == nat->nat_ifps[0])
@@ -5006,7 +5008,7 @@ ipf_stack_t *ifs;
 			n->in_ifps[1] = newifp;
 	}
 
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 }
 #endif
 
@@ -5192,9 +5194,9 @@ ipf_stack_t *ifs;
 	}
 	MUTEX_EXIT(&nat->nat_lock);
 
-	WRITE_ENTER(&ifs->ifs_ipf_nat);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 	(void) nat_delete(nat, NL_EXPIRE, ifs);
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 }
 
 
@@ -5498,7 +5500,7 @@ ipf_stack_t *ifs;
 	if (itp->igi_nitems == 0)
 		return EINVAL;
 
-	READ_ENTER(&ifs->ifs_ipf_nat);
+	BR_READ_ENTER(&ifs->ifs_ipf_nat);
 
 	/*
 	 * Get "previous" entry from the token and find the next entry.
@@ -5532,7 +5534,7 @@ ipf_stack_t *ifs;
 		}
 		break;
 	default :
-		RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+		BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 		return EINVAL;
 	}
 
@@ -5592,7 +5594,7 @@ ipf_stack_t *ifs;
 		/*
 		 * Now that we have ref, it's save to give up lock.
 		 */
-		RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+		BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 
 		/*
 		 * Copy out data and clean up references and token as needed.
@@ -5609,9 +5611,9 @@ ipf_stack_t *ifs;
 				break;
 			} else {
 				if (hm != NULL) {
-					WRITE_ENTER(&ifs->ifs_ipf_nat);
+					BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 					fr_hostmapdel(&hm);
-					RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+					BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 				}
 				if (nexthm->hm_next == NULL) {
 					ipf_freetoken(t, ifs);
@@ -5634,9 +5636,9 @@ ipf_stack_t *ifs;
 				break;
 			} else {
 				if (ipn != NULL) {
-					WRITE_ENTER(&ifs->ifs_ipf_nat);
+					BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 					fr_ipnatderef(&ipn, ifs);
-					RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+					BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 				}
 				if (nextipnat->in_next == NULL) {
 					ipf_freetoken(t, ifs);
@@ -5677,7 +5679,7 @@ ipf_stack_t *ifs;
 		if ((count == 1) || (error != 0))
 			break;
  
-		READ_ENTER(&ifs->ifs_ipf_nat);
+		BR_READ_ENTER(&ifs->ifs_ipf_nat);
 	}
 
 	return error;
@@ -5840,7 +5842,7 @@ fr_info_t *fin;
 		break;
 	}
 
-	WRITE_ENTER(&ifs->ifs_ipf_nat);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 
 	if (fin->fin_out == 0) {
 		nat = nat_outlookup(fin, nflags, (u_int)fin->fin_p,
@@ -5857,5 +5859,5 @@ fr_info_t *fin;
 		ifs->ifs_nat_stats.ns_uncreate[fin->fin_out][1]++;
 	}
 
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 }
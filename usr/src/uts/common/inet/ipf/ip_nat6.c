@@ -1588,12 +1588,12 @@ find_in_wild_ports:
 	if (ifs->ifs_nat_stats.ns_wilds == 0)
 		return NULL;
 
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 
 	hv = NAT_HASH_FN6(&dst, 0, 0xffffffff);
 	hv = NAT_HASH_FN6(src, hv, ifs->ifs_ipf_nattable_sz);
 
-	WRITE_ENTER(&ifs->ifs_ipf_nat);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 
 	nat = ifs->ifs_nat_table[1][hv];
 	for (; nat; nat = nat->nat_hnext[1]) {
@@ -1637,7 +1637,7 @@ find_in_wild_ports:
 		}
 	}
 
-	MUTEX_DOWNGRADE(&ifs->ifs_ipf_nat);
+	BR_DOWNGRADE(&ifs->ifs_ipf_nat);
 
 	return nat;
 }
@@ -1828,12 +1828,12 @@ find_out_wild_ports:
 	if (ifs->ifs_nat_stats.ns_wilds == 0)
 		return NULL;
 
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 
 	hv = NAT_HASH_FN6(src, 0, 0xffffffff);
 	hv = NAT_HASH_FN6(dst, hv, ifs->ifs_ipf_nattable_sz);
 
-	WRITE_ENTER(&ifs->ifs_ipf_nat);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 
 	nat = ifs->ifs_nat_table[0][hv];
 	for (; nat; nat = nat->nat_hnext[0]) {
@@ -1879,7 +1879,7 @@ find_out_wild_ports:
 		}
 	}
 
-	MUTEX_DOWNGRADE(&ifs->ifs_ipf_nat);
+	BR_DOWNGRADE(&ifs->ifs_ipf_nat);
 
 	return nat;
 }
@@ -2081,7 +2081,7 @@ u_32_t *passp;
 
 	ipa = fin->fin_src6;
 
-	READ_ENTER(&ifs->ifs_ipf_nat);
+	BR_READ_ENTER(&ifs->ifs_ipf_nat);
 
 	if ((fin->fin_p == IPPROTO_ICMPV6) && !(nflags & IPN_ICMPQUERY) &&
 	    (nat = nat6_icmperror(fin, &nflags, NAT_OUTBOUND)))
@@ -2101,14 +2101,14 @@ u_32_t *passp;
 		 * If there is no current entry in the nat table for this IP#,
 		 * create one for it (if there is a matching rule).
 		 */
-		RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+		BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 		i = 3;
 		msk.i6[0] = 0xffffffff;
 		msk.i6[1] = 0xffffffff;
 		msk.i6[2] = 0xffffffff;
 		msk.i6[3] = 0xffffffff;
 		nmsk = ifs->ifs_nat6_masks[3];
-		WRITE_ENTER(&ifs->ifs_ipf_nat);
+		BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 maskloop:
 		IP6_AND(&ipa, &msk, &iph);
 		hv = NAT_HASH_FN6(&iph, 0, ifs->ifs_ipf_natrules_sz);
@@ -2168,7 +2168,7 @@ maskloop:
 				}
 			}
 		}
-		MUTEX_DOWNGRADE(&ifs->ifs_ipf_nat);
+		BR_DOWNGRADE(&ifs->ifs_ipf_nat);
 	}
 
 	if (nat != NULL) {
@@ -2176,7 +2176,7 @@ maskloop:
 	} else {
 		rval = natfailed;
 	}
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 
 	if (rval == -1) {
 		if (passp != NULL)
@@ -2365,7 +2365,7 @@ u_32_t *passp;
 
 	ipa = fin->fin_dst6;
 
-	READ_ENTER(&ifs->ifs_ipf_nat);
+	BR_READ_ENTER(&ifs->ifs_ipf_nat);
 
 	if ((fin->fin_p == IPPROTO_ICMPV6) && !(nflags & IPN_ICMPQUERY) &&
 	    (nat = nat6_icmperror(fin, &nflags, NAT_INBOUND)))
@@ -2380,14 +2380,14 @@ u_32_t *passp;
 		i6addr_t msk;
 		int i;
 
-		RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+		BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 		i = 3;
 		msk.i6[0] = 0xffffffff;
 		msk.i6[1] = 0xffffffff;
 		msk.i6[2] = 0xffffffff;
 		msk.i6[3] = 0xffffffff;
 		rmsk = ifs->ifs_rdr6_masks[3];
-		WRITE_ENTER(&ifs->ifs_ipf_nat);
+		BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 		/*
 		 * If there is no current entry in the nat table for this IP#,
 		 * create one for it (if there is a matching rule).
@@ -2451,14 +2451,14 @@ maskloop:
 				}
 			}
 		}
-		MUTEX_DOWNGRADE(&ifs->ifs_ipf_nat);
+		BR_DOWNGRADE(&ifs->ifs_ipf_nat);
 	}
 	if (nat != NULL) {
 		rval = fr_nat6in(fin, nat, natadd, nflags);
 	} else {
 		rval = natfailed;
 	}
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 
 	if (rval == -1) {
 		if (passp != NULL)
@@ -5,7 +5,7 @@
  *
  * Copyright (c) 2003, 2010, Oracle and/or its affiliates. All rights reserved.
  *
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #if defined(KERNEL) || defined(_KERNEL)
@@ -262,7 +262,7 @@ ipf_stack_t *ifs;
 	MUTEX_INIT(&ifs->ifs_ips_deletetq.ifq_lock, "state delete queue");
 	ifs->ifs_ips_deletetq.ifq_next = NULL;
 
-	RWLOCK_INIT(&ifs->ifs_ipf_state, "ipf IP state rwlock");
+	BRLOCK_INIT(&ifs->ifs_ipf_state, "ipf IP state rwlock");
 	MUTEX_INIT(&ifs->ifs_ipf_stinsert, "ipf state insert mutex");
 	ifs->ifs_fr_state_init = 1;
 
@@ -338,7 +338,7 @@ ipf_stack_t *ifs;
 
 	if (ifs->ifs_fr_state_init == 1) {
 		ifs->ifs_fr_state_init = 0;
-		RW_DESTROY(&ifs->ifs_ipf_state);
+		BR_DESTROY(&ifs->ifs_ipf_state);
 		MUTEX_DESTROY(&ifs->ifs_ipf_stinsert);
 	}
 }
@@ -385,7 +385,7 @@ ipf_stack_t *ifs;
 	if (error)
 		return EFAULT;
 
-	WRITE_ENTER(&ifs->ifs_ipf_state);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_state);
 	for (sp = ifs->ifs_ips_list; sp; sp = sp->is_next)
 		if ((sp->is_p == st.is_p) && (sp->is_v == st.is_v) &&
 		    !bcmp((caddr_t)&sp->is_src, (caddr_t)&st.is_src,
@@ -395,10 +395,10 @@ ipf_stack_t *ifs;
 		    !bcmp((caddr_t)&sp->is_ps, (caddr_t)&st.is_ps,
 			  sizeof(st.is_ps))) {
 			(void) fr_delstate(sp, ISL_REMOVE, ifs);
-			RWLOCK_EXIT(&ifs->ifs_ipf_state);
+			BRLOCK_EXIT(&ifs->ifs_ipf_state);
 			return 0;
 		}
-	RWLOCK_EXIT(&ifs->ifs_ipf_state);
+	BRLOCK_EXIT(&ifs->ifs_ipf_state);
 	return ESRCH;
 }
 
@@ -441,9 +441,9 @@ ipf_stack_t *ifs;
 			error = EFAULT;
 		} else {
 			if (VALID_TABLE_FLUSH_OPT(arg)) {
-				WRITE_ENTER(&ifs->ifs_ipf_state);
+				BR_WRITE_ENTER(&ifs->ifs_ipf_state);
 				ret = fr_state_flush(arg, 4, ifs);
-				RWLOCK_EXIT(&ifs->ifs_ipf_state);
+				BRLOCK_EXIT(&ifs->ifs_ipf_state);
 				error = BCOPYOUT((char *)&ret, data,
 						sizeof(ret));
 				if (error != 0)
@@ -461,9 +461,9 @@ ipf_stack_t *ifs;
 			error = EFAULT;
 		} else {
 			if (VALID_TABLE_FLUSH_OPT(arg)) {
-				WRITE_ENTER(&ifs->ifs_ipf_state);
+				BR_WRITE_ENTER(&ifs->ifs_ipf_state);
 				ret = fr_state_flush(arg, 6, ifs);
-				RWLOCK_EXIT(&ifs->ifs_ipf_state);
+				BRLOCK_EXIT(&ifs->ifs_ipf_state);
 				error = BCOPYOUT((char *)&ret, data,
 						sizeof(ret));
 				if (error != 0)
@@ -712,10 +712,10 @@ ipf_stack_t *ifs;
 	fr = ips.ips_rule;
 
 	if (fr == NULL) {
-		READ_ENTER(&ifs->ifs_ipf_state);
+		BR_READ_ENTER(&ifs->ifs_ipf_state);
 		fr_stinsert(isn, 0, ifs);
 		MUTEX_EXIT(&isn->is_lock);
-		RWLOCK_EXIT(&ifs->ifs_ipf_state);
+		BRLOCK_EXIT(&ifs->ifs_ipf_state);
 		return 0;
 	}
 
@@ -761,13 +761,13 @@ ipf_stack_t *ifs;
 			KFREE(fr);
 			return EFAULT;
 		}
-		READ_ENTER(&ifs->ifs_ipf_state);
+		BR_READ_ENTER(&ifs->ifs_ipf_state);
 		fr_stinsert(isn, 0, ifs);
 		MUTEX_EXIT(&isn->is_lock);
-		RWLOCK_EXIT(&ifs->ifs_ipf_state);
+		BRLOCK_EXIT(&ifs->ifs_ipf_state);
 
 	} else {
-		READ_ENTER(&ifs->ifs_ipf_state);
+		BR_READ_ENTER(&ifs->ifs_ipf_state);
 		for (is = ifs->ifs_ips_list; is; is = is->is_next)
 			if (is->is_rule == fr) {
 				fr_stinsert(isn, 0, ifs);
@@ -779,7 +779,7 @@ ipf_stack_t *ifs;
 			KFREE(isn);
 			isn = NULL;
 		}
-		RWLOCK_EXIT(&ifs->ifs_ipf_state);
+		BRLOCK_EXIT(&ifs->ifs_ipf_state);
 
 		return (isn == NULL) ? ESRCH : 0;
 	}
@@ -1498,7 +1498,7 @@ u_int flags;
 	if (pass & FR_LOGFIRST)
 		is->is_pass &= ~(FR_LOGFIRST|FR_LOG);
 
-	READ_ENTER(&ifs->ifs_ipf_state);
+	BR_READ_ENTER(&ifs->ifs_ipf_state);
 	is->is_me = stsave;
 
 	fr_stinsert(is, fin->fin_rev, ifs);
@@ -1529,7 +1529,7 @@ u_int flags;
 	if (IFS_CFWLOG(ifs, is->is_rule))
 		ipf_log_cfwlog(is, ISL_NEW, ifs);
 
-	RWLOCK_EXIT(&ifs->ifs_ipf_state);
+	BRLOCK_EXIT(&ifs->ifs_ipf_state);
 	fin->fin_rev = IP6_NEQ(&is->is_dst, &fin->fin_daddr);
 	fin->fin_flx |= FI_STATE;
 	if (fin->fin_flx & FI_FRAG)
@@ -2509,7 +2509,7 @@ fr_info_t *fin;
 		hv += icmp->icmp_id;
 		hv = DOUBLE_HASH(hv, ifs);
 
-		READ_ENTER(&ifs->ifs_ipf_state);
+		BR_READ_ENTER(&ifs->ifs_ipf_state);
 		for (isp = &ifs->ifs_ips_table[hv]; ((is = *isp) != NULL); ) {
 			isp = &is->is_hnext;
 			if ((is->is_p != pr) || (is->is_v != 4))
@@ -2520,7 +2520,7 @@ fr_info_t *fin;
 					    NULL, FI_ICMPCMP);
 			if (is != NULL) {
 				if ((is->is_pass & FR_NOICMPERR) != 0) {
-					RWLOCK_EXIT(&ifs->ifs_ipf_state);
+					BRLOCK_EXIT(&ifs->ifs_ipf_state);
 					return NULL;
 				}
 				/*
@@ -2543,7 +2543,7 @@ fr_info_t *fin;
 				return is;
 			}
 		}
-		RWLOCK_EXIT(&ifs->ifs_ipf_state);
+		BRLOCK_EXIT(&ifs->ifs_ipf_state);
 		return NULL;
 	case IPPROTO_TCP :
 	case IPPROTO_UDP :
@@ -2565,7 +2565,7 @@ fr_info_t *fin;
 	hv += sport;
 	hv = DOUBLE_HASH(hv, ifs);
 
-	READ_ENTER(&ifs->ifs_ipf_state);
+	BR_READ_ENTER(&ifs->ifs_ipf_state);
 	for (isp = &ifs->ifs_ips_table[hv]; ((is = *isp) != NULL); ) {
 		isp = &is->is_hnext;
 		/*
@@ -2605,7 +2605,7 @@ fr_info_t *fin;
 			return is;
 		}
 	}
-	RWLOCK_EXIT(&ifs->ifs_ipf_state);
+	BRLOCK_EXIT(&ifs->ifs_ipf_state);
 	return NULL;
 }
 
@@ -2627,7 +2627,7 @@ ipf_stack_t *ifs;
 	ipstate_t **isp;
 	u_int hvm;
 
-	ASSERT(rw_read_locked(&ifs->ifs_ipf_state.ipf_lk) == 0);
+	ASSERT(rw_read_locked(&BRLOCK_LK(&ifs->ifs_ipf_state)) == 0);
 
 	hvm = is->is_hv;
 	/*
@@ -2735,7 +2735,7 @@ ipftq_t **ifqp;
 				hv += ic->icmp_id;
 			}
 		}
-		READ_ENTER(&ifs->ifs_ipf_state);
+		BR_READ_ENTER(&ifs->ifs_ipf_state);
 icmp6again:
 		hvm = DOUBLE_HASH(hv, ifs);
 		for (isp = &ifs->ifs_ips_table[hvm]; ((is = *isp) != NULL); ) {
@@ -2761,11 +2761,11 @@ icmp6again:
 				hv += fin->fin_fi.fi_src.i6[2];
 				hv += fin->fin_fi.fi_src.i6[3];
 				fr_ipsmove(is, hv, ifs);
-				MUTEX_DOWNGRADE(&ifs->ifs_ipf_state);
+				BR_DOWNGRADE(&ifs->ifs_ipf_state);
 			}
 			break;
 		}
-		RWLOCK_EXIT(&ifs->ifs_ipf_state);
+		BRLOCK_EXIT(&ifs->ifs_ipf_state);
 
 		/*
 		 * No matching icmp state entry. Perhaps this is a
@@ -2784,7 +2784,7 @@ icmp6again:
 			hv -= fin->fin_fi.fi_src.i6[2];
 			hv -= fin->fin_fi.fi_src.i6[3];
 			tryagain = 1;
-			WRITE_ENTER(&ifs->ifs_ipf_state);
+			BR_WRITE_ENTER(&ifs->ifs_ipf_state);
 			goto icmp6again;
 		}
 
@@ -2799,7 +2799,7 @@ icmp6again:
 			hv += ic->icmp_id;
 		}
 		hv = DOUBLE_HASH(hv, ifs);
-		READ_ENTER(&ifs->ifs_ipf_state);
+		BR_READ_ENTER(&ifs->ifs_ipf_state);
 		for (isp = &ifs->ifs_ips_table[hv]; ((is = *isp) != NULL); ) {
 			isp = &is->is_hnext;
 			if ((is->is_p != pr) || (is->is_v != v))
@@ -2816,7 +2816,7 @@ icmp6again:
 			}
 		}
 		if (is == NULL) {
-			RWLOCK_EXIT(&ifs->ifs_ipf_state);
+			BRLOCK_EXIT(&ifs->ifs_ipf_state);
 		}
 		break;
 
@@ -2829,7 +2829,7 @@ icmp6again:
 		hv += dport;
 		oow = 0;
 		tryagain = 0;
-		READ_ENTER(&ifs->ifs_ipf_state);
+		BR_READ_ENTER(&ifs->ifs_ipf_state);
 retry_tcpudp:
 		hvm = DOUBLE_HASH(hv, ifs);
 		for (isp = &ifs->ifs_ips_table[hvm]; ((is = *isp) != NULL); ) {
@@ -2854,11 +2854,11 @@ retry_tcpudp:
 				hv += dport;
 				hv += sport;
 				fr_ipsmove(is, hv, ifs);
-				MUTEX_DOWNGRADE(&ifs->ifs_ipf_state);
+				BR_DOWNGRADE(&ifs->ifs_ipf_state);
 			}
 			break;
 		}
-		RWLOCK_EXIT(&ifs->ifs_ipf_state);
+		BRLOCK_EXIT(&ifs->ifs_ipf_state);
 
 		if (ifs->ifs_ips_stats.iss_wild) {
 			if (tryagain == 0) {
@@ -2882,7 +2882,7 @@ retry_tcpudp:
 			}
 			tryagain++;
 			if (tryagain <= 2) {
-				WRITE_ENTER(&ifs->ifs_ipf_state);
+				BR_WRITE_ENTER(&ifs->ifs_ipf_state);
 				goto retry_tcpudp;
 			}
 		}
@@ -2900,7 +2900,7 @@ retry_tcpudp:
 	default :
 		ifqp = NULL;
 		hvm = DOUBLE_HASH(hv, ifs);
-		READ_ENTER(&ifs->ifs_ipf_state);
+		BR_READ_ENTER(&ifs->ifs_ipf_state);
 		for (isp = &ifs->ifs_ips_table[hvm]; ((is = *isp) != NULL); ) {
 			isp = &is->is_hnext;
 			if ((is->is_p != pr) || (is->is_v != v))
@@ -2912,7 +2912,7 @@ retry_tcpudp:
 			}
 		}
 		if (is == NULL) {
-			RWLOCK_EXIT(&ifs->ifs_ipf_state);
+			BRLOCK_EXIT(&ifs->ifs_ipf_state);
 		}
 		break;
 	}
@@ -3075,11 +3075,11 @@ matched:
 	if (fr != NULL) {
 		if ((fin->fin_out == 0) && (fr->fr_nattag.ipt_num[0] != 0)) {
 			if (fin->fin_nattag == NULL) {
-				RWLOCK_EXIT(&ifs->ifs_ipf_state);
+				BRLOCK_EXIT(&ifs->ifs_ipf_state);
 				return NULL;
 			}
 			if (fr_matchtag(&fr->fr_nattag, fin->fin_nattag) != 0) {
-				RWLOCK_EXIT(&ifs->ifs_ipf_state);
+				BRLOCK_EXIT(&ifs->ifs_ipf_state);
 				return NULL;
 			}
 		}
@@ -3091,7 +3091,7 @@ matched:
 	pass = is->is_pass;
 	fr_updatestate(fin, is, ifq);
 
-	RWLOCK_EXIT(&ifs->ifs_ipf_state);
+	BRLOCK_EXIT(&ifs->ifs_ipf_state);
 	fin->fin_flx |= FI_STATE;
 	if ((pass & FR_LOGFIRST) != 0)
 		pass &= ~(FR_LOGFIRST|FR_LOG);
@@ -3203,10 +3203,10 @@ ipf_stack_t *ifs;
 	if (ifs->ifs_fr_running <= 0)
 		return;
 
-	WRITE_ENTER(&ifs->ifs_ipf_state);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_state);
 
 	if (ifs->ifs_fr_running <= 0) {
-		RWLOCK_EXIT(&ifs->ifs_ipf_state);
+		BRLOCK_EXIT(&ifs->ifs_ipf_state);
 		return;
 	}
 
@@ -3253,7 +3253,7 @@ ipf_stack_t *ifs;
 		}
 		break;
 	}
-	RWLOCK_EXIT(&ifs->ifs_ipf_state);
+	BRLOCK_EXIT(&ifs->ifs_ipf_state);
 }
 
 
@@ -3278,7 +3278,7 @@ ipf_stack_t *ifs;
 	ipstate_t *is;
 	int i;
 
-	WRITE_ENTER(&ifs->ifs_ipf_state);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_state);
 
 	for (is = ifs->ifs_ips_list; is != NULL; is = is->is_next) {
 
@@ -3288,7 +3288,7 @@ ipf_stack_t *ifs;
 		}
 	}
 
-	RWLOCK_EXIT(&ifs->ifs_ipf_state);
+	BRLOCK_EXIT(&ifs->ifs_ipf_state);
 }
 #endif
 
@@ -3312,7 +3312,7 @@ ipf_stack_t *ifs;
 	int removed = 0;
 
 	ASSERT(rw_write_held(&ifs->ifs_ipf_global.ipf_lk) == 0 ||
-		rw_write_held(&ifs->ifs_ipf_state.ipf_lk) == 0);
+		rw_write_held(&BRLOCK_LK(&ifs->ifs_ipf_state)) == 0);
 
 	/*
 	 * Start by removing the entry from the hash table of state entries
@@ -3446,7 +3446,7 @@ ipf_stack_t *ifs;
 	SPL_INT(s);
 
 	SPL_NET(s);
-	WRITE_ENTER(&ifs->ifs_ipf_state);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_state);
 	for (ifq = ifs->ifs_ips_tqtqb; ifq != NULL; ifq = ifq->ifq_next)
 		for (tqn = ifq->ifq_head; ((tqe = tqn) != NULL); ) {
 			if (tqe->tqe_die > ifs->ifs_fr_ticks)
@@ -3479,7 +3479,7 @@ ipf_stack_t *ifs;
 		(void) fr_state_flush(FLUSH_TABLE_EXTRA, 0, ifs);
 		ifs->ifs_fr_state_doflush = 0;
 	}
-	RWLOCK_EXIT(&ifs->ifs_ipf_state);
+	BRLOCK_EXIT(&ifs->ifs_ipf_state);
 	SPL_X(s);
 }
 
@@ -4113,7 +4113,7 @@ fr_info_t *fin;
 		hv += oic->icmp6_seq;
 		hv = DOUBLE_HASH(hv, ifs);
 
-		READ_ENTER(&ifs->ifs_ipf_state);
+		BR_READ_ENTER(&ifs->ifs_ipf_state);
 		for (isp = &ifs->ifs_ips_table[hv]; ((is = *isp) != NULL); ) {
 			ic = &is->is_icmp;
 			isp = &is->is_hnext;
@@ -4140,7 +4140,7 @@ fr_info_t *fin;
 				}
 			}
 		}
-		RWLOCK_EXIT(&ifs->ifs_ipf_state);
+		BRLOCK_EXIT(&ifs->ifs_ipf_state);
 		return NULL;
 	}
 
@@ -4166,7 +4166,7 @@ fr_info_t *fin;
 		tcp = NULL;
 	hv = DOUBLE_HASH(hv, ifs);
 
-	READ_ENTER(&ifs->ifs_ipf_state);
+	BR_READ_ENTER(&ifs->ifs_ipf_state);
 	for (isp = &ifs->ifs_ips_table[hv]; ((is = *isp) != NULL); ) {
 		isp = &is->is_hnext;
 		/*
@@ -4194,7 +4194,7 @@ fr_info_t *fin;
 			return is;
 		}
 	}
-	RWLOCK_EXIT(&ifs->ifs_ipf_state);
+	BRLOCK_EXIT(&ifs->ifs_ipf_state);
 	return NULL;
 }
 #endif
@@ -4291,9 +4291,9 @@ ipf_stack_t *ifs;
 	}
 	MUTEX_EXIT(&is->is_lock);
 
-	WRITE_ENTER(&ifs->ifs_ipf_state);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_state);
 	(void) fr_delstate(is, ISL_EXPIRE, ifs);
-	RWLOCK_EXIT(&ifs->ifs_ipf_state);
+	BRLOCK_EXIT(&ifs->ifs_ipf_state);
 }
 
 
@@ -4396,7 +4396,7 @@ ipf_stack_t *ifs;
 
 	error = 0;
 
-	READ_ENTER(&ifs->ifs_ipf_state);
+	BR_READ_ENTER(&ifs->ifs_ipf_state);
 
 	/*
 	 * Get "previous" entry from the token and find the next entry.
@@ -4428,7 +4428,7 @@ ipf_stack_t *ifs;
 		/*
 		 * Safe to release lock now the we have a reference.
 		 */
-		RWLOCK_EXIT(&ifs->ifs_ipf_state);
+		BRLOCK_EXIT(&ifs->ifs_ipf_state);
 
 		/*
 		 * Copy out data and clean up references and tokens.
@@ -4451,7 +4451,7 @@ ipf_stack_t *ifs;
 		if ((count == 1) || (error != 0))
 			break;
 
-		READ_ENTER(&ifs->ifs_ipf_state);
+		BR_READ_ENTER(&ifs->ifs_ipf_state);
 		dst += sizeof(*next);
 		is = next;
 		next = is->is_next;
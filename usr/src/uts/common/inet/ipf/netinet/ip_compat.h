@@ -8,6 +8,8 @@
  *
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ *
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	__IP_COMPAT_H__
@@ -1433,6 +1435,55 @@ typedef union {
 #define	ipf_isw		ipf_lkun_s.ipf_sw
 #define	ipf_magic	ipf_lkun_s.ipf_magic
 
+/*
+ * The state and NAT table locks are taken as reader for every packet that
+ * is looked up in those tables, and as writer only when entries are added or
+ * removed.  In the Solaris kernel they are "big reader" locks, split into
+ * shards that each sit on their own cache line.  A reader takes only the
+ * shard picked by its thread ID, so packets being handled on different CPUs
+ * no longer bounce one lock word between them; a writer takes every shard,
+ * in order.  BRLOCK_EXIT tells the two apart by whether the first shard is
+ * write-held by the current thread.  BRLOCK_LK names the first shard, for
+ * assertions about write ownership.
+ */
+#if SOLARIS && defined(_KERNEL)
+typedef union {
+	ipfrwlock_t	ipfbs_lock;
+	char		ipfbs_pad[64];
+} ipfbrshard_t;
+
+typedef struct ipfbrlock {
+	ipfbrshard_t	*ipfbr_shards;
+	u_int		ipfbr_mask;
+} ipfbrlock_t;
+
+extern	void	ipf_brlock_init __P((ipfbrlock_t *, char *));
+extern	void	ipf_brlock_destroy __P((ipfbrlock_t *));
+extern	void	ipf_br_write_enter __P((ipfbrlock_t *));
+extern	void	ipf_br_downgrade __P((ipfbrlock_t *));
+extern	void	ipf_br_exit __P((ipfbrlock_t *));
+
+# define	BRLOCK_SHARD(x)		(&(x)->ipfbr_shards[curthread->t_did & \
+					    (x)->ipfbr_mask].ipfbs_lock)
+# define	BRLOCK_LK(x)		((x)->ipfbr_shards[0].ipfbs_lock.ipf_lk)
+# define	BRLOCK_INIT(x, y)	ipf_brlock_init((x), (y))
+# define	BR_DESTROY(x)		ipf_brlock_destroy(x)
+# define	BR_READ_ENTER(x)	READ_ENTER(BRLOCK_SHARD(x))
+# define	BR_WRITE_ENTER(x)	ipf_br_write_enter(x)
+# define	BR_DOWNGRADE(x)		ipf_br_downgrade(x)
+# define	BRLOCK_EXIT(x)		ipf_br_exit(x)
+#else
+typedef	ipfrwlock_t	ipfbrlock_t;
+
+# define	BRLOCK_LK(x)		((x)->ipf_lk)
+# define	BRLOCK_INIT(x, y)	RWLOCK_INIT((x), (y))
+# define	BR_DESTROY(x)		RW_DESTROY(x)
+# define	BR_READ_ENTER(x)	READ_ENTER(x)
+# define	BR_WRITE_ENTER(x)	WRITE_ENTER(x)
+# define	BR_DOWNGRADE(x)		MUTEX_DOWNGRADE(x)
+# define	BRLOCK_EXIT(x)		RWLOCK_EXIT(x)
+#endif
+
 #if !defined(__GNUC__) || \
     (defined(__FreeBSD_version) && (__FreeBSD_version >= 503000))
 # ifndef	INLINE
@@ -8,7 +8,7 @@
  *
  * Copyright (c) 2003, 2010, Oracle and/or its affiliates. All rights reserved.
  *
- * Copyright 2019, Joyent, Inc.
+ * Copyright 2020, Joyent, Inc.
  */
 
 #ifndef	__IP_FIL_H__
@@ -1193,7 +1193,7 @@ typedef struct ipfcfwcfg {
 	/* CFG => Max event size, NEWSZ => ignored in, like CFG out. */
 	uint32_t ipfcfwc_maxevsize;
 	/*
-	 * CFG => Current ring size,
+	 * CFG => Current ring size (of each CPU's ring),
 	 * NEWSZ => New ring size, must be 2^N for 3 <= N <= 31.
 	 */
 	uint32_t ipfcfwc_evringsize;
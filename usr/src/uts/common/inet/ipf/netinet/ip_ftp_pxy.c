@@ -408,7 +408,7 @@ ifs_ftppxy_t *ifsftp;
 		ipstate_t *is;
 
 		nat_update(&fi, nat2, nat->nat_ptr);
-		READ_ENTER(&ifs->ifs_ipf_state);
+		BR_READ_ENTER(&ifs->ifs_ipf_state);
 		is = nat2->nat_state;
 		if (is != NULL) {
 			MUTEX_ENTER(&is->is_lock);
@@ -416,7 +416,7 @@ ifs_ftppxy_t *ifsftp;
 				         is->is_flags);
 			MUTEX_EXIT(&is->is_lock);
 		}
-		RWLOCK_EXIT(&ifs->ifs_ipf_state);
+		BRLOCK_EXIT(&ifs->ifs_ipf_state);
 	}
 	return APR_INC(inc);
 }
@@ -771,7 +771,7 @@ ifs_ftppxy_t *ifsftp;
 		ipstate_t *is;
 
 		nat_update(&fi, nat2, nat->nat_ptr);
-		READ_ENTER(&ifs->ifs_ipf_state);
+		BR_READ_ENTER(&ifs->ifs_ipf_state);
 		is = nat2->nat_state;
 		if (is != NULL) {
 			MUTEX_ENTER(&is->is_lock);
@@ -779,7 +779,7 @@ ifs_ftppxy_t *ifsftp;
 					  is->is_flags);
 			MUTEX_EXIT(&is->is_lock);
 		}
-		RWLOCK_EXIT(&ifs->ifs_ipf_state);
+		BRLOCK_EXIT(&ifs->ifs_ipf_state);
 	}
 	return inc;
 }
@@ -227,13 +227,13 @@ void *private;
 		 * A (maybe better) solution is do a UPGRADE(), and instead
 		 * of calling fr_nat_ioctl(), we add the nat rule ourself.
 		 */
-		RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+		BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 		if (fr_nat_ioctl((caddr_t)ipn, SIOCADNAT,
 				 NAT_SYSSPACE|FWRITE, 0, NULL, ifs) == -1) {
-			READ_ENTER(&ifs->ifs_ipf_nat);
+			BR_READ_ENTER(&ifs->ifs_ipf_nat);
 			return -1;
 		}
-		READ_ENTER(&ifs->ifs_ipf_nat);
+		BR_READ_ENTER(&ifs->ifs_ipf_nat);
 		if (aps->aps_data != NULL && aps->aps_psiz > 0) {
 			bcopy(aps->aps_data, newarray, aps->aps_psiz);
 			KFREES(aps->aps_data, aps->aps_psiz);
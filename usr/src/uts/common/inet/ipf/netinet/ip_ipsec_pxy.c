@@ -271,13 +271,13 @@ void *private;
 		/*
 		 * Update state timeout/create state if missing.
 		 */
-		READ_ENTER(&ifs->ifs_ipf_state);
+		BR_READ_ENTER(&ifs->ifs_ipf_state);
 		if (ipsec->ipsc_state != NULL) {
 			fr_queueback(&ipsec->ipsc_state->is_sti, ifs);
 			ipsec->ipsc_state->is_die = nat->nat_age;
-			RWLOCK_EXIT(&ifs->ifs_ipf_state);
+			BRLOCK_EXIT(&ifs->ifs_ipf_state);
 		} else {
-			RWLOCK_EXIT(&ifs->ifs_ipf_state);
+			BRLOCK_EXIT(&ifs->ifs_ipf_state);
 			fi.fin_data[0] = 0;
 			fi.fin_data[1] = 0;
 			ipsec->ipsc_state = fr_addstate(&fi,
@@ -358,13 +358,13 @@ ipf_stack_t *ifs;
 		 * *_del() is on a callback from aps_free(), from nat_delete()
 		 */
 
-		READ_ENTER(&ifs->ifs_ipf_state);
+		BR_READ_ENTER(&ifs->ifs_ipf_state);
 		if (ipsec->ipsc_state != NULL) {
 			ipsec->ipsc_state->is_die = ifs->ifs_fr_ticks + 1;
 			ipsec->ipsc_state->is_me = NULL;
 			fr_queuefront(&ipsec->ipsc_state->is_sti);
 		}
-		RWLOCK_EXIT(&ifs->ifs_ipf_state);
+		BRLOCK_EXIT(&ifs->ifs_ipf_state);
 
 		ipsec->ipsc_state = NULL;
 		ipsec->ipsc_nat = NULL;
@@ -227,12 +227,12 @@ ifs_pptppxy_t *ifspptp;
 		}
 	}
 
-	READ_ENTER(&ifs->ifs_ipf_state);
+	BR_READ_ENTER(&ifs->ifs_ipf_state);
 	if (pptp->pptp_state != NULL) {
 		fr_queueback(&pptp->pptp_state->is_sti, ifs);
-		RWLOCK_EXIT(&ifs->ifs_ipf_state);
+		BRLOCK_EXIT(&ifs->ifs_ipf_state);
 	} else {
-		RWLOCK_EXIT(&ifs->ifs_ipf_state);
+		BRLOCK_EXIT(&ifs->ifs_ipf_state);
 		if (nat->nat_dir == NAT_INBOUND)
 			fi.fin_fi.fi_daddr = nat2->nat_inip.s_addr;
 		else
@@ -539,13 +539,13 @@ ipf_stack_t *ifs;
 		 * *_del() is on a callback from aps_free(), from nat_delete()
 		 */
 
-		READ_ENTER(&ifs->ifs_ipf_state);
+		BR_READ_ENTER(&ifs->ifs_ipf_state);
 		if (pptp->pptp_state != NULL) {
 			pptp->pptp_state->is_die = ifs->ifs_fr_ticks + 1;
 			pptp->pptp_state->is_me = NULL;
 			fr_queuefront(&pptp->pptp_state->is_sti);
 		}
-		RWLOCK_EXIT(&ifs->ifs_ipf_state);
+		BRLOCK_EXIT(&ifs->ifs_ipf_state);
 
 		pptp->pptp_state = NULL;
 		pptp->pptp_nat = NULL;
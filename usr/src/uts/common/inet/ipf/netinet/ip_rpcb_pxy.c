@@ -1224,15 +1224,15 @@ ippr_rpcb_getnat(fin, nat, proto, port, ifsrpcb)
 	 */
 	is = fr_stlookup(&fi, &tcp, NULL);
 	if (is != NULL)
-		RWLOCK_EXIT(&ifs->ifs_ipf_state);
+		BRLOCK_EXIT(&ifs->ifs_ipf_state);
 
-	RWLOCK_EXIT(&ifs->ifs_ipf_nat);
+	BRLOCK_EXIT(&ifs->ifs_ipf_nat);
 
-	WRITE_ENTER(&ifs->ifs_ipf_nat);
+	BR_WRITE_ENTER(&ifs->ifs_ipf_nat);
 	natl = nat_inlookup(&fi, nflags, proto, fi.fin_src, fi.fin_dst);
 
 	if ((natl != NULL) && (is != NULL)) {
-		MUTEX_DOWNGRADE(&ifs->ifs_ipf_nat);
+		BR_DOWNGRADE(&ifs->ifs_ipf_nat);
 		return(0);
 	}
 
@@ -1273,7 +1273,7 @@ ippr_rpcb_getnat(fin, nat, proto, port, ifsrpcb)
 		bcopy((char *)&ipnat, (char *)ipn, sizeof(ipnat));
 
 		if (natl == NULL) {
-			MUTEX_DOWNGRADE(&ifs->ifs_ipf_nat);
+			BR_DOWNGRADE(&ifs->ifs_ipf_nat);
 			return(-1);
 		}
 
@@ -1281,7 +1281,7 @@ ippr_rpcb_getnat(fin, nat, proto, port, ifsrpcb)
 		(void) nat_proto(&fi, natl, nflags);
 		nat_update(&fi, natl, natl->nat_ptr);
 	}
-	MUTEX_DOWNGRADE(&ifs->ifs_ipf_nat);
+	BR_DOWNGRADE(&ifs->ifs_ipf_nat);
 
 	if (is == NULL) {
 		/* Create state entry.  Return NULL if this fails. */
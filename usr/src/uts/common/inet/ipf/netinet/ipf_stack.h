@@ -6,7 +6,7 @@
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
  *
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	__IPF_STACK_H__
@@ -100,8 +100,8 @@ struct ipf_stack {
 	ipfrwlock_t	ifs_ipf_frcache;
 	ipfrwlock_t	ifs_ip_poolrw;
 	ipfrwlock_t	ifs_ipf_frag;
-	ipfrwlock_t	ifs_ipf_state;
-	ipfrwlock_t	ifs_ipf_nat;
+	ipfbrlock_t	ifs_ipf_state;
+	ipfbrlock_t	ifs_ipf_nat;
 	ipfrwlock_t	ifs_ipf_natfrag;
 	ipfmutex_t	ifs_ipf_nat_new;
 	ipfmutex_t	ifs_ipf_natio;
@@ -20,7 +20,7 @@
  */
 /*
  * Copyright (c) 2000, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright 2016 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 /* Copyright (c) 1990 Mentat Inc. */
 
@@ -90,6 +90,7 @@ typedef	struct icmp_s {
 	krwlock_t	icmp_bpf_lock;	/* protects icmp_bpf */
 	ip_bpf_insn_t	*icmp_bpf_prog; /* SO_ATTACH_FILTER bpf */
 	uint_t		icmp_bpf_len;
+	ip_bpf_jit_t	*icmp_bpf_jit;	/* compiled icmp_bpf_prog */
 } icmp_t;
 
 /*
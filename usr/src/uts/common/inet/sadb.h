@@ -22,7 +22,7 @@
  * Copyright 2010 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
  * Copyright (c) 2012 Nexenta Systems, Inc. All rights reserved.
- * Copyright 2017 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_INET_SADB_H
@@ -161,10 +161,13 @@ typedef struct ipsa_s {
 	 * Use an array of uint64_t for best performance on 64-bit
 	 * processors.  (And hope that 32-bit compilers can handle things
 	 * okay.)  The " >> 6 " is to get the appropriate number of 64-bit
-	 * ints.
+	 * ints.  The vector is used as a ring indexed by sequence number
+	 * (see sadb_replay_check()), which needs one word more than the
+	 * window so that advancing the window only ever clears whole words.
 	 */
 #define	SADB_MAX_REPLAY 256	/* Must be 0 mod 64. */
-	uint64_t ipsa_replay_arr[SADB_MAX_REPLAY >> 6];
+#define	SADB_REPLAY_WORDS ((SADB_MAX_REPLAY >> 6) + 1)
+	uint64_t ipsa_replay_arr[SADB_REPLAY_WORDS];
 
 	uint64_t ipsa_unique_id;	/* Non-zero for unique SAs */
 	uint64_t ipsa_unique_mask;	/* mask value for unique_id */
@@ -21,7 +21,7 @@
 
 /*
  * Copyright (c) 2009, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright 2015 Joyent, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef _PACKET_H
@@ -172,6 +172,7 @@ struct sock_fprog {
  */
 typedef struct pfpsock {
 	struct bpf_program		ps_bpf;
+	struct ip_bpf_jit		*ps_bpf_jit;	/* compiled ps_bpf */
 	krwlock_t			ps_bpflock;
 	sock_upper_handle_t		ps_upper;
 	sock_upcalls_t			*ps_upcalls;
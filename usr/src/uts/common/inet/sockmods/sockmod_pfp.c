@@ -21,7 +21,7 @@
 
 /*
  * Copyright (c) 2009, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright 2016 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/types.h>
@@ -449,7 +449,8 @@ pfp_packet(void *arg, mac_resource_handle_t mrh, mblk_t *mp, boolean_t flag)
 			buffer = (uchar_t *)mp;
 		}
 		rw_enter(&ps->ps_bpflock, RW_READER);
-		if (ip_bpf_filter((ip_bpf_insn_t *)ps->ps_bpf.bf_insns, buffer,
+		if (ip_bpf_jit_filter(ps->ps_bpf_jit,
+		    (ip_bpf_insn_t *)ps->ps_bpf.bf_insns, buffer,
 		    hdr.mhi_pktsize, buflen) == 0) {
 			rw_exit(&ps->ps_bpflock);
 			ps->ps_stats.tp_drops++;
@@ -1338,6 +1339,7 @@ pfp_setsocket_sockopt(sock_lower_handle_t handle, int option_name,
 {
 	struct bpf_program prog;
 	ip_bpf_insn_t *fcode;
+	ip_bpf_jit_t *jit;
 	struct pfpsock *ps;
 	struct sock_proto_props sopp;
 	int error = 0;
@@ -1372,10 +1374,12 @@ pfp_setsocket_sockopt(sock_lower_handle_t handle, int option_name,
 		}
 
 		if (ip_bpf_validate(fcode, prog.bf_len)) {
+			jit = ip_bpf_jit(fcode, prog.bf_len);
 			rw_enter(&ps->ps_bpflock, RW_WRITER);
 			pfp_release_bpf(ps);
 			ps->ps_bpf.bf_insns = (struct bpf_insn *)fcode;
 			ps->ps_bpf.bf_len = size;
+			ps->ps_bpf_jit = jit;
 			rw_exit(&ps->ps_bpflock);
 
 			return (0);
@@ -1483,6 +1487,8 @@ pfp_release_bpf(struct pfpsock *ps)
 		kmem_free(ps->ps_bpf.bf_insns, ps->ps_bpf.bf_len);
 		ps->ps_bpf.bf_len = 0;
 		ps->ps_bpf.bf_insns = NULL;
+		ip_bpf_jit_free(ps->ps_bpf_jit);
+		ps->ps_bpf_jit = NULL;
 	}
 }
 
@@ -115,6 +115,19 @@
  * system gets more packets, it gets more efficient by switching to
  * polling more often and dealing with larger packet chains.
  *
+ * Timers:
+ * -------
+ *
+ * A thread processing the squeue can schedule a function to be called
+ * from within the same squeue at a later time with squeue_timer_schedule().
+ * The timers are kept in a hierarchical timing wheel hung off the squeue
+ * rather than in the callout subsystem, so scheduling, rescheduling and
+ * cancelling one is a few pointer operations and needs no locks. A single
+ * callout per squeue, armed for the earliest event in the wheel, tells
+ * the squeue when it has timers due; they are then run by whichever
+ * thread drains the squeue next. This is what allows TCP to pace the
+ * transmissions of a great many connections at a fine granularity.
+ *
  */
 
 #include <sys/types.h>
@@ -130,6 +143,8 @@
 #include <sys/sunddi.h>
 #include <sys/stack.h>
 #include <sys/archsystm.h>
+#include <sys/bitmap.h>
+#include <sys/callo.h>
 
 #include <inet/ipclassifier.h>
 #include <inet/udp_impl.h>
@@ -141,6 +156,7 @@ static void squeue_worker(squeue_t *sqp);
 static void squeue_polling_thread(squeue_t *sqp);
 static void squeue_worker_wakeup(squeue_t *sqp);
 static void squeue_try_drain_one(squeue_t *, conn_t *);
+static void squeue_timer_run(squeue_t *);
 
 kmem_cache_t *squeue_cache;
 
@@ -156,6 +172,15 @@ uint_t squeue_drain_stack_toodeep;
 
 #define	MAX_BYTES_TO_PICKUP	150000
 
+/*
+ * A tick of the timer wheel is 2^SQ_TW_SHIFT nanoseconds, about 131
+ * microseconds. With the SQ_TW_LEVELS levels of SQ_TW_SLOTS buckets the
+ * wheel spans about 36 minutes; later timers are parked at its far end.
+ */
+#define	SQ_TW_SHIFT		17
+#define	SQ_TW_TICK		(1LL << SQ_TW_SHIFT)
+#define	SQ_TW_SPAN		(1ULL << (SQ_TW_LEVELS * SQ_TW_BITS))
+
 #define	ENQUEUE_CHAIN(sqp, mp, tail, cnt) {			\
 	/*							\
 	 * Enqueue our mblk chain.				\
@@ -286,6 +311,9 @@ squeue_destroy(squeue_t *sqp)
 
 	thread_join(poll);
 	thread_join(worker);
+	VERIFY0(sqp->sq_tw_count);
+	if (sqp->sq_tw_tid != 0)
+		(void) untimeout_generic(sqp->sq_tw_tid, 0);
 	kmem_cache_free(squeue_cache, sqp);
 }
 
@@ -444,11 +472,12 @@ squeue_enter(squeue_t *sqp, mblk_t *mp, mblk_t *tail, uint32_t cnt,
 				}
 
 				/*
-				 * If work or control actions are pending, wake
-				 * up the worker thread.
+				 * If work, timers or control actions are
+				 * pending, wake up the worker thread.
 				 */
 				if (sqp->sq_first != NULL ||
-				    sqp->sq_state & SQS_WORKER_THR_CONTROL) {
+				    sqp->sq_state & (SQS_TIMER |
+				    SQS_WORKER_THR_CONTROL)) {
 					squeue_worker_wakeup(sqp);
 				}
 				mutex_exit(&sqp->sq_lock);
@@ -645,6 +674,7 @@ squeue_drain(squeue_t *sqp, uint_t proc_type, hrtime_t expire)
 	hrtime_t 	now;
 	boolean_t	sq_poll_capable;
 	ip_recv_attr_t	*ira, iras;
+	boolean_t	timers;
 
 	/*
 	 * Before doing any work, check our stack depth; if we're not a
@@ -670,6 +700,9 @@ again:
 	sqp->sq_last = NULL;
 	sqp->sq_count = 0;
 
+	timers = (sqp->sq_state & SQS_TIMER) != 0;
+	sqp->sq_state &= ~SQS_TIMER;
+
 	sqp->sq_state |= SQS_PROC | proc_type;
 
 	/*
@@ -686,6 +719,9 @@ again:
 	SQS_POLLING_ON(sqp, sq_poll_capable, sq_rx_ring);
 	mutex_exit(&sqp->sq_lock);
 
+	if (timers)
+		squeue_timer_run(sqp);
+
 	while ((mp = head) != NULL) {
 
 		head = mp->b_next;
@@ -762,7 +798,7 @@ again:
 	 * signal the worker thread to take up the work if processing time
 	 * has expired.
 	 */
-	if (sqp->sq_first != NULL) {
+	if (sqp->sq_first != NULL || (sqp->sq_state & SQS_TIMER)) {
 		/*
 		 * Still more to process. If time quanta not expired, we
 		 * should let the drain go on. The worker thread is allowed
@@ -1094,11 +1130,12 @@ poll_again:
 			SQS_POLLING_OFF(sqp, B_TRUE, sq_rx_ring);
 
 			/*
-			 * If there is a pending control operation
-			 * wake up the worker, since it is currently
-			 * not running.
+			 * If there is a pending control operation or
+			 * timers are due, wake up the worker, since it is
+			 * currently not running.
 			 */
-			if (sqp->sq_state & SQS_WORKER_THR_CONTROL) {
+			if (sqp->sq_state & (SQS_TIMER |
+			    SQS_WORKER_THR_CONTROL)) {
 				squeue_worker_wakeup(sqp);
 			}
 		} else {
@@ -1257,11 +1294,13 @@ squeue_worker(squeue_t *sqp)
 
 			/*
 			 * If the squeue is not being processed and we either
-			 * have messages to drain or some thread has signaled
-			 * some control activity we need to break
+			 * have messages to drain or timers to run, or some
+			 * thread has signaled some control activity we need
+			 * to break
 			 */
 			if (!(sqp->sq_state & SQS_PROC) &&
-			    ((sqp->sq_state & SQS_WORKER_THR_CONTROL) ||
+			    ((sqp->sq_state & (SQS_TIMER |
+			    SQS_WORKER_THR_CONTROL)) ||
 			    (sqp->sq_first != NULL)))
 				break;
 
@@ -1371,6 +1410,8 @@ again:
 			mutex_enter(&sqp->sq_lock);
 			sqp->sq_state &= ~SQS_PROC;
 			sqp->sq_run = NULL;
+			if (sqp->sq_state & SQS_TIMER)
+				squeue_worker_wakeup(sqp);
 			mutex_exit(&sqp->sq_lock);
 			goto again;
 		}
@@ -1544,9 +1585,249 @@ squeue_synch_exit(conn_t *connp, int flag)
 		squeue_try_drain_one(sqp, connp);
 	}
 
-	/* Wake up the worker if further requests are pending. */
-	if (sqp->sq_first != NULL) {
+	/* Wake up the worker if further requests or timers are pending. */
+	if (sqp->sq_first != NULL || (sqp->sq_state & SQS_TIMER)) {
 		squeue_worker_wakeup(sqp);
 	}
 	mutex_exit(&sqp->sq_lock);
 }
+
+/*
+ * The squeue timer wheel.
+ *
+ * Time is counted in ticks of SQ_TW_TICK nanoseconds. A level 0 bucket
+ * holds the timers due in one tick and each bucket of level n holds those
+ * due in SQ_TW_SLOTS^n ticks; a timer is kept at the lowest level whose
+ * span reaches its expiration. As the wheel turns past the start of the
+ * span of an upper level bucket, the timers in it are cascaded down to
+ * the level below. The sq_tw_map bitmaps of non-empty buckets let the
+ * wheel skip straight to the next tick at which anything happens, which
+ * is also the time the squeue's callout is armed for.
+ *
+ * Timers are rounded up to a tick and never fire early. All of the wheel
+ * is only ever touched by the thread processing the squeue; the squeue
+ * lock is only needed to hand the news that timers are due (SQS_TIMER)
+ * from the callout to the squeue.
+ */
+static void
+squeue_timer_link(squeue_t *sqp, sqtimer_t *st, uint64_t first)
+{
+	uint64_t tick, delta;
+	uint_t level, b;
+
+	tick = (uint64_t)(st->st_expire + SQ_TW_TICK - 1) >> SQ_TW_SHIFT;
+	tick = MAX(tick, first);
+	delta = tick - sqp->sq_tw_tick;
+	if (delta >= SQ_TW_SPAN) {
+		tick = sqp->sq_tw_tick + SQ_TW_SPAN - 1;
+		delta = SQ_TW_SPAN - 1;
+	}
+	for (level = 0; level < SQ_TW_LEVELS - 1; level++) {
+		if (delta < (1ULL << ((level + 1) * SQ_TW_BITS)))
+			break;
+	}
+	b = (tick >> (level * SQ_TW_BITS)) & SQ_TW_MASK;
+	sqp->sq_tw_map[level] |= 1ULL << b;
+	b += level * SQ_TW_SLOTS;
+
+	st->st_bucket = b;
+	if ((st->st_next = sqp->sq_tw_bucket[b]) != NULL)
+		st->st_next->st_prevp = &st->st_next;
+	st->st_prevp = &sqp->sq_tw_bucket[b];
+	sqp->sq_tw_bucket[b] = st;
+	sqp->sq_tw_count++;
+}
+
+static void
+squeue_timer_unlink(squeue_t *sqp, sqtimer_t *st)
+{
+	uint_t b = st->st_bucket;
+
+	ASSERT(SQTIMER_PENDING(st));
+	ASSERT(sqp->sq_tw_count > 0);
+
+	if ((*st->st_prevp = st->st_next) != NULL)
+		st->st_next->st_prevp = st->st_prevp;
+	if (sqp->sq_tw_bucket[b] == NULL) {
+		sqp->sq_tw_map[b / SQ_TW_SLOTS] &=
+		    ~(1ULL << (b & SQ_TW_MASK));
+	}
+	st->st_next = NULL;
+	st->st_prevp = NULL;
+	sqp->sq_tw_count--;
+}
+
+/*
+ * Distance from bucket 'cur' to the next non-empty bucket after it on the
+ * same level, between 1 and SQ_TW_SLOTS, or 0 if the level is empty.
+ */
+static uint_t
+squeue_timer_dist(uint64_t map, uint_t cur)
+{
+	cur = (cur + 1) & SQ_TW_MASK;
+	if (cur != 0)
+		map = (map >> cur) | (map << (SQ_TW_SLOTS - cur));
+	return (lowbit((ulong_t)map));
+}
+
+/*
+ * The next tick at which a timer may be due or a bucket needs cascading.
+ */
+static uint64_t
+squeue_timer_next(squeue_t *sqp)
+{
+	uint64_t tick = sqp->sq_tw_tick;
+	uint64_t next = UINT64_MAX;
+	uint_t level, shift, d;
+
+	for (level = 0; level < SQ_TW_LEVELS; level++) {
+		shift = level * SQ_TW_BITS;
+		d = squeue_timer_dist(sqp->sq_tw_map[level],
+		    (tick >> shift) & SQ_TW_MASK);
+		if (d != 0)
+			next = MIN(next, ((tick >> shift) + d) << shift);
+	}
+	return (next);
+}
+
+static void
+squeue_timer_fire(void *arg)
+{
+	squeue_t *sqp = arg;
+
+	mutex_enter(&sqp->sq_lock);
+	sqp->sq_state |= SQS_TIMER;
+	if (!(sqp->sq_state & SQS_PROC))
+		squeue_worker_wakeup(sqp);
+	mutex_exit(&sqp->sq_lock);
+}
+
+/*
+ * Make sure the squeue's callout fires by the time the earliest timer in
+ * the wheel is due.
+ */
+static void
+squeue_timer_arm(squeue_t *sqp)
+{
+	hrtime_t when;
+
+	if (sqp->sq_tw_count == 0)
+		return;
+
+	when = (hrtime_t)(squeue_timer_next(sqp) << SQ_TW_SHIFT);
+	if (sqp->sq_tw_tid != 0) {
+		if (sqp->sq_tw_armed <= when)
+			return;
+		/*
+		 * If the callout fired before we could cancel it, forget
+		 * what it told us; the new one covers everything it did.
+		 */
+		(void) untimeout_generic(sqp->sq_tw_tid, 0);
+		mutex_enter(&sqp->sq_lock);
+		sqp->sq_state &= ~SQS_TIMER;
+		mutex_exit(&sqp->sq_lock);
+	}
+	sqp->sq_tw_armed = when;
+	sqp->sq_tw_tid = timeout_generic(CALLOUT_NORMAL, squeue_timer_fire,
+	    sqp, when, SQ_TW_TICK,
+	    CALLOUT_FLAG_ABSOLUTE | CALLOUT_FLAG_ROUNDUP);
+}
+
+/*
+ * Run the timers that are due. Called from squeue_drain() once the
+ * squeue's callout has fired.
+ */
+static void
+squeue_timer_run(squeue_t *sqp)
+{
+	uint64_t now = (uint64_t)gethrtime() >> SQ_TW_SHIFT;
+	uint64_t tick;
+	sqtimer_t *st, *next;
+	uint_t level, shift, b;
+
+	ASSERT(sqp->sq_run == curthread);
+
+	/* The callout has fired, so there is none outstanding. */
+	sqp->sq_tw_tid = 0;
+	sqp->sq_tw_running = B_TRUE;
+
+	while (sqp->sq_tw_count != 0 &&
+	    (tick = squeue_timer_next(sqp)) <= now) {
+		sqp->sq_tw_tick = tick;
+
+		for (level = 1; level < SQ_TW_LEVELS; level++) {
+			shift = level * SQ_TW_BITS;
+			if ((tick & ((1ULL << shift) - 1)) != 0)
+				break;
+			b = (tick >> shift) & SQ_TW_MASK;
+			sqp->sq_tw_map[level] &= ~(1ULL << b);
+			b += level * SQ_TW_SLOTS;
+			st = sqp->sq_tw_bucket[b];
+			sqp->sq_tw_bucket[b] = NULL;
+			for (; st != NULL; st = next) {
+				next = st->st_next;
+				sqp->sq_tw_count--;
+				squeue_timer_link(sqp, st, tick);
+			}
+		}
+
+		/*
+		 * Timers scheduled by the functions we call go in later
+		 * buckets, so this terminates.
+		 */
+		b = tick & SQ_TW_MASK;
+		while ((st = sqp->sq_tw_bucket[b]) != NULL) {
+			squeue_timer_unlink(sqp, st);
+			st->st_func(sqp, st->st_arg);
+		}
+	}
+	sqp->sq_tw_tick = MAX(sqp->sq_tw_tick, now);
+
+	sqp->sq_tw_running = B_FALSE;
+	squeue_timer_arm(sqp);
+}
+
+/*
+ * Arrange for func(sqp, arg) to be called from within the squeue at or
+ * shortly after the absolute time 'when'. If the timer is already pending
+ * it is rescheduled. May only be called by the thread processing the
+ * squeue, and only for a timer that belongs to this squeue; a consumer
+ * whose object may move to another squeue must cancel its timers first.
+ */
+void
+squeue_timer_schedule(squeue_t *sqp, sqtimer_t *st, hrtime_t when,
+    sqtimer_func_t func, void *arg)
+{
+	ASSERT(sqp->sq_run == curthread);
+
+	if (SQTIMER_PENDING(st))
+		squeue_timer_unlink(sqp, st);
+
+	/* An empty wheel may have stood still; catch up with the clock. */
+	if (sqp->sq_tw_count == 0 && !sqp->sq_tw_running) {
+		sqp->sq_tw_tick = MAX(sqp->sq_tw_tick,
+		    (uint64_t)gethrtime() >> SQ_TW_SHIFT);
+	}
+
+	st->st_expire = when;
+	st->st_func = func;
+	st->st_arg = arg;
+	squeue_timer_link(sqp, st, sqp->sq_tw_tick + 1);
+
+	if (!sqp->sq_tw_running)
+		squeue_timer_arm(sqp);
+}
+
+/*
+ * Cancel a timer if it is pending. Like squeue_timer_schedule(), this may
+ * only be called by the thread processing the squeue. Once it returns, the
+ * timer's function will not be called.
+ */
+void
+squeue_timer_cancel(squeue_t *sqp, sqtimer_t *st)
+{
+	ASSERT(sqp->sq_run == curthread);
+
+	if (SQTIMER_PENDING(st))
+		squeue_timer_unlink(sqp, st);
+}
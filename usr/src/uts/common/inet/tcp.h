@@ -116,6 +116,14 @@ typedef	struct tcphdr_s {
 #define	TCP_MAX_LARGEWIN		(TCP_MAXWIN << TCP_MAX_WINSHIFT)
 #define	TCP_MAX_LSO_LENGTH	(IP_MAXPACKET - TCP_MAX_COMBINED_HEADER_LENGTH)
 
+/*
+ * TCP Fast Open (RFC 7413) cookies are between 4 and 16 bytes long; the
+ * ones we hand out are 8 bytes.
+ */
+#define	TCP_FASTOPEN_COOKIE_MIN	4
+#define	TCP_FASTOPEN_COOKIE_MAX	16
+#define	TCP_FASTOPEN_COOKIE_LEN	8
+
 #define	TCPIP_HDR_LENGTH(mp, n)					\
 	(n) = IPH_HDR_LENGTH((mp)->b_rptr),			\
 	(n) += TCP_HDR_LENGTH((tcpha_t *)&(mp)->b_rptr[(n)])
@@ -136,6 +144,7 @@ typedef	struct tcphdra_s {
 struct conn_s;
 struct tcp_listen_cnt_s;
 struct tcp_rg_s;
+struct tcp_tls_tx_s;
 
 /*
  * Control structure for each open TCP stream,
@@ -250,8 +259,13 @@ typedef struct tcp_s {
 
 		tcp_lso :1,		/* Lower layer is capable of LSO */
 		tcp_is_wnd_shrnk : 1,	/* Window has shrunk */
+		tcp_fastopen_req : 1,	/* Send Fast Open option in SYN */
+		tcp_fastopen_syn_data : 1, /* Our SYN carried data */
 
-		tcp_pad_to_bit_31 : 18;
+		tcp_fastopen_cookie_req : 1, /* Send our cookie in SYN-ACK */
+		tcp_fastopen_eager : 1,	/* Eager accepted with SYN data */
+
+		tcp_pad_to_bit_31 : 14;
 
 	uint32_t	tcp_initial_pmtu; /* Initial outgoing Path MTU. */
 
@@ -285,6 +299,7 @@ typedef struct tcp_s {
 	hrtime_t tcp_rtt_sa;		/* Round trip smoothed average */
 	hrtime_t tcp_rtt_sd;		/* Round trip smoothed deviation */
 	uint32_t tcp_rtt_update;	/* Round trip update(s) */
+	hrtime_t tcp_rtt_last;		/* Most recent round trip sample */
 	clock_t tcp_ms_we_have_waited;	/* Total retrans time */
 
 	uint32_t tcp_swl1;		/* These help us avoid using stale */
@@ -297,6 +312,16 @@ typedef struct tcp_s {
 	timeout_id_t	tcp_ack_tid;	/* Delayed ACK timer ID */
 	timeout_id_t	tcp_push_tid;	/* Push timer ID */
 
+	/*
+	 * Transmit pacing, requested by the congestion control algorithm
+	 * through tcp_pacing_rate or capped by the application with
+	 * SO_MAX_PACING_RATE; see tcp_wput_data().
+	 */
+	uint64_t	tcp_pacing_rate;	/* Bytes per second, 0 if off */
+	uint64_t	tcp_max_pacing_rate;	/* Bytes/sec, 0 if no cap */
+	hrtime_t	tcp_pace_next;		/* Earliest time of next send */
+	sqtimer_t	tcp_pace_sqt;		/* Pacing timer, on conn_sqp */
+
 	uint32_t tcp_max_swnd;		/* Maximum swnd we have seen */
 
 	struct tcp_s *tcp_listener;	/* Our listener */
@@ -335,6 +360,19 @@ typedef struct tcp_s {
 	} tcp_conn;
 	uint32_t tcp_syn_rcvd_timeout;	/* How many SYN_RCVD timeout in q0 */
 
+	/*
+	 * TCP Fast Open.  The listener allows tcp_fastopen_qlen eagers to
+	 * be accepted on their SYN's data; tcp_fastopen_pending is the number
+	 * still linked to it and is protected by its tcp_eager_lock.  An
+	 * active open keeps the peer's cookie in tcp_fastopen_cookie.
+	 */
+	int	tcp_fastopen_qlen;
+	int	tcp_fastopen_pending;
+	uint_t	tcp_fastopen_cookie_len;
+	uint8_t	tcp_fastopen_cookie[TCP_FASTOPEN_COOKIE_MAX];
+
+	struct tcp_tls_tx_s *tcp_tls_tx;	/* TCP_TLS_TX record state */
+
 	/*
 	 * TCP Keepalive Timer members.
 	 * All keepalive timer intervals are in milliseconds.
@@ -1351,6 +1351,7 @@ tcp_free(tcp_t *tcp)
 
 	tcp_close_mpp(&tcp->tcp_xmit_head);
 	tcp_close_mpp(&tcp->tcp_reass_head);
+	tcp_tls_tx_free(tcp);
 	if (tcp->tcp_rcv_list != NULL) {
 		/* Free b_next chain */
 		tcp_close_mpp(&tcp->tcp_rcv_list);
@@ -1636,6 +1637,10 @@ tcp_connect_ipv4(tcp_t *tcp, ipaddr_t *dstaddrp, in_port_t dstport,
 	    connp->conn_fport == connp->conn_lport)
 		return (-TBADADDR);
 
+	/* The four-tuple may still be in (compact) TIME_WAIT state. */
+	if (!tcp_time_wait_reuse(connp))
+		return (EADDRINUSE);
+
 	tcp->tcp_state = TCPS_SYN_SENT;
 
 	return (ipcl_conn_insert_v4(connp));
@@ -1732,6 +1737,10 @@ tcp_connect_ipv6(tcp_t *tcp, in6_addr_t *dstaddrp, in_port_t dstport,
 	    connp->conn_fport == connp->conn_lport)
 		return (-TBADADDR);
 
+	/* The four-tuple may still be in (compact) TIME_WAIT state. */
+	if (!tcp_time_wait_reuse(connp))
+		return (EADDRINUSE);
+
 	tcp->tcp_state = TCPS_SYN_SENT;
 
 	return (ipcl_conn_insert_v6(connp));
@@ -2087,7 +2096,7 @@ tcp_reinit_values(tcp_t *tcp)
 	tcp->tcp_snxt = 0;			/* Displayed in mib */
 	tcp->tcp_suna = 0;			/* Displayed in mib */
 	tcp->tcp_swnd = 0;
-	DONTCARE(tcp->tcp_cwnd);	/* Init in tcp_process_options */
+	tcp->tcp_cwnd = 0;		/* Init in tcp_process_options */
 
 	if (connp->conn_ht_iphc != NULL) {
 		kmem_free(connp->conn_ht_iphc, connp->conn_ht_iphc_allocated);
@@ -2180,9 +2189,15 @@ tcp_reinit_values(tcp_t *tcp)
 	DONTCARE(tcp->tcp_rtt_sa);		/* Init in tcp_init_values */
 	DONTCARE(tcp->tcp_rtt_sd);		/* Init in tcp_init_values */
 	tcp->tcp_rtt_update = 0;
+	tcp->tcp_rtt_last = 0;
 	tcp->tcp_rtt_sum = 0;
 	tcp->tcp_rtt_cnt = 0;
 
+	tcp->tcp_pacing_rate = 0;
+	tcp->tcp_max_pacing_rate = 0;
+	tcp->tcp_pace_next = 0;
+	ASSERT(!SQTIMER_PENDING(&tcp->tcp_pace_sqt));
+
 	DONTCARE(tcp->tcp_swl1); /* Init in case TCPS_LISTEN/TCPS_SYN_SENT */
 	DONTCARE(tcp->tcp_swl2); /* Init in case TCPS_LISTEN/TCPS_SYN_SENT */
 
@@ -2301,6 +2316,15 @@ tcp_reinit_values(tcp_t *tcp)
 	tcp->tcp_cork = B_FALSE;
 	tcp->tcp_tconnind_started = B_FALSE;
 
+	tcp->tcp_fastopen_req = B_FALSE;
+	tcp->tcp_fastopen_syn_data = B_FALSE;
+	tcp->tcp_fastopen_cookie_req = B_FALSE;
+	tcp->tcp_fastopen_eager = B_FALSE;
+	tcp->tcp_fastopen_qlen = 0;
+	ASSERT(tcp->tcp_fastopen_pending == 0);
+	tcp->tcp_fastopen_cookie_len = 0;
+	tcp_tls_tx_free(tcp);
+
 	PRESERVE(tcp->tcp_squeue_bytes);
 
 	tcp->tcp_closemp_used = B_FALSE;
@@ -2401,6 +2425,8 @@ tcp_init_values(tcp_t *tcp, tcp_t *parent)
 		tcp->tcp_ka_rinterval = parent->tcp_ka_rinterval;
 
 		tcp->tcp_init_cwnd = parent->tcp_init_cwnd;
+
+		tcp->tcp_max_pacing_rate = parent->tcp_max_pacing_rate;
 	}
 
 	if (tcp->tcp_cc_algo->cb_init != NULL)
@@ -3713,6 +3739,8 @@ tcp_ddi_g_init(void)
 	tcp_notsack_blk_cache = kmem_cache_create("tcp_notsack_blk_cache",
 	    sizeof (notsack_blk_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
 
+	tcp_time_wait_g_init();
+
 	mutex_init(&tcp_random_lock, NULL, MUTEX_DEFAULT, NULL);
 
 	/* Initialize the random number generator */
@@ -3774,6 +3802,8 @@ tcp_stack_init(netstackid_t stackid, netstack_t *ns)
 		    MUTEX_DEFAULT, NULL);
 	}
 
+	tcp_time_wait_stack_init(tcps);
+
 	/* TCP's IPsec code calls the packet dropper. */
 	ip_drop_register(&tcps->tcps_dropper, "TCP IPsec policy enforcement");
 
@@ -3803,6 +3833,15 @@ tcp_stack_init(netstackid_t stackid, netstack_t *ns)
 	tcp_iss_key_init((uint8_t *)&tcp_g_t_info_ack,
 	    sizeof (tcp_g_t_info_ack), tcps);
 
+	/* The TCP Fast Open cookie secret is purely random. */
+	{
+		uint8_t	secret[PASSWD_SIZE];
+
+		(void) random_get_pseudo_bytes(secret, sizeof (secret));
+		MD5Init(&tcps->tcps_fastopen_key);
+		MD5Update(&tcps->tcps_fastopen_key, secret, sizeof (secret));
+	}
+
 	tcps->tcps_kstat = tcp_kstat2_init(stackid);
 	tcps->tcps_mibkp = tcp_kstat_init(stackid);
 
@@ -3864,6 +3903,7 @@ tcp_ddi_g_destroy(void)
 
 	kmem_cache_destroy(tcp_timercache);
 	kmem_cache_destroy(tcp_notsack_blk_cache);
+	tcp_time_wait_g_destroy();
 
 	netstack_unregister(NS_TCP);
 }
@@ -3921,6 +3961,8 @@ tcp_stack_fini(netstackid_t stackid, void *arg)
 	    TCP_ACCEPTOR_FANOUT_SIZE);
 	tcps->tcps_acceptor_fanout = NULL;
 
+	tcp_time_wait_stack_fini(tcps);
+
 	mutex_destroy(&tcps->tcps_iss_key_lock);
 	mutex_destroy(&tcps->tcps_epriv_port_lock);
 
@@ -3985,6 +4027,28 @@ tcp_iss_init(tcp_t *tcp)
 	tcp->tcp_csuna = tcp->tcp_snxt;
 }
 
+/*
+ * Generate the TCP Fast Open cookie for the peer of this connection.  The
+ * cookie is a MAC of the peer's address keyed by a per-stack secret, so a
+ * server can validate a cookie without keeping any per-client state.
+ */
+void
+tcp_fastopen_cookie(tcp_t *tcp, uint8_t *cookie)
+{
+	MD5_CTX context;
+	uint32_t answer[4];
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	conn_t		*connp = tcp->tcp_connp;
+
+	mutex_enter(&tcps->tcps_iss_key_lock);
+	context = tcps->tcps_fastopen_key;
+	mutex_exit(&tcps->tcps_iss_key_lock);
+	MD5Update(&context, (uchar_t *)&connp->conn_faddr_v6,
+	    sizeof (connp->conn_faddr_v6));
+	MD5Final((uchar_t *)answer, &context);
+	bcopy(answer, cookie, TCP_FASTOPEN_COOKIE_LEN);
+}
+
 /*
  * tcp_{set,clr}qfull() functions are used to either set or clear QFULL
  * on the specified backing STREAMS q. Note, the caller may make the
@@ -4088,10 +4152,14 @@ tcp_do_bind(conn_t *connp, struct sockaddr *sa, socklen_t len, cred_t *cr,
  * If the return value from this function is positive, it's a UNIX error.
  * Otherwise, if it's negative, then the absolute value is a TLI error.
  * the TPI routine tcp_tpi_connect() is a wrapper function for this.
+ *
+ * If data is not NULL, it is sent with the SYN using TCP Fast Open when
+ * possible, and is otherwise queued for transmission once the connection
+ * is established.  It is consumed only on success.
  */
 int
 tcp_do_connect(conn_t *connp, const struct sockaddr *sa, socklen_t len,
-    cred_t *cr, pid_t pid)
+    cred_t *cr, pid_t pid, mblk_t *data)
 {
 	tcp_t		*tcp = connp->conn_tcp;
 	sin_t		*sin = (sin_t *)sa;
@@ -4286,9 +4354,28 @@ tcp_do_connect(conn_t *connp, const struct sockaddr *sa, socklen_t len,
 	    connp->conn_ixa, void, NULL, tcp_t *, tcp, void, NULL,
 	    int32_t, TCPS_BOUND);
 
+	/*
+	 * Ask for, or present, a Fast Open cookie if the caller has data to
+	 * send with the SYN.  Loopback connections gain nothing from it.
+	 */
+	if (data != NULL && (tcps->tcps_fastopen & TCP_FASTOPEN_CLIENT) &&
+	    !tcp->tcp_loopback) {
+		tcp->tcp_fastopen_req = B_TRUE;
+		if (ixa->ixa_dce != NULL) {
+			tcp->tcp_fastopen_cookie_len = dce_get_fastopen_cookie(
+			    ixa->ixa_dce, tcp->tcp_fastopen_cookie,
+			    sizeof (tcp->tcp_fastopen_cookie));
+		}
+	}
+
 	TCP_TIMER_RESTART(tcp, tcp->tcp_rto);
-	syn_mp = tcp_xmit_mp(tcp, NULL, 0, NULL, NULL,
-	    tcp->tcp_iss, B_FALSE, NULL, B_FALSE);
+	if (data != NULL) {
+		syn_mp = tcp_fastopen_syn(tcp, data,
+		    (int32_t)(mss - TCP_MAX_TCP_OPTIONS_LENGTH));
+	} else {
+		syn_mp = tcp_xmit_mp(tcp, NULL, 0, NULL, NULL,
+		    tcp->tcp_iss, B_FALSE, NULL, B_FALSE);
+	}
 	if (syn_mp != NULL) {
 		/*
 		 * We must bump the generation before sending the syn
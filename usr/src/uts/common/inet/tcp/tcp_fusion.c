@@ -21,6 +21,7 @@
 /*
  * Copyright (c) 2005, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright (c) 2015 by Delphix. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/types.h>
@@ -766,16 +767,21 @@ tcp_fuse_rcv_drain(queue_t *q, tcp_t *tcp, mblk_t **sigurg_mpp)
 			return (B_FALSE);
 	}
 
-	/* Drain the data */
-	while ((mp = tcp->tcp_rcv_list) != NULL) {
-		tcp->tcp_rcv_list = mp->b_next;
-		mp->b_next = NULL;
+	/* Drain the data, passing the whole list upstream at once */
+	if ((mp = tcp->tcp_rcv_list) != NULL) {
+		mblk_t *mp1;
+		uint_t nmsg = 0;
+
+		ASSERT(!IPCL_IS_NONSTR(connp));
+		for (mp1 = mp; mp1 != NULL; mp1 = mp1->b_next) {
 #ifdef DEBUG
-		cnt += msgdsize(mp);
+			cnt += msgdsize(mp1);
 #endif
-		ASSERT(!IPCL_IS_NONSTR(connp));
-		putnext(q, mp);
-		TCP_STAT(tcps, tcp_fusion_putnext);
+			nmsg++;
+		}
+		tcp->tcp_rcv_list = NULL;
+		putnext_chain(q, mp);
+		TCP_STAT_UPDATE(tcps, tcp_fusion_putnext, nmsg);
 	}
 
 #ifdef DEBUG
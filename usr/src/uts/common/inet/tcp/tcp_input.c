@@ -22,7 +22,7 @@
 /*
  * Copyright (c) 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright 2011 Nexenta Systems, Inc. All rights reserved.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2014, 2016 by Delphix. All rights reserved.
  */
 
@@ -62,11 +62,6 @@
 	(TCPOPT_NOP << 8) | TCPOPT_NOP)
 #endif
 
-/*
- *  PAWS needs a timer for 24 days.  This is the number of ticks in 24 days
- */
-#define	PAWS_TIMEOUT	((clock_t)(24*24*60*60*hz))
-
 /*
  * Since tcp_listener is not cleared atomically with tcp_detached
  * being cleared we need this extra bit to tell a detached connection
@@ -158,11 +153,13 @@ static mblk_t	*tcp_conn_create_v4(conn_t *, conn_t *, mblk_t *,
 static mblk_t	*tcp_conn_create_v6(conn_t *, conn_t *, mblk_t *,
 		    ip_recv_attr_t *);
 static boolean_t	tcp_drop_q0(tcp_t *);
+static void	tcp_fastopen_deliver(void *, mblk_t *, void *,
+		    ip_recv_attr_t *);
 static void	tcp_icmp_error_ipv6(tcp_t *, mblk_t *, ip_recv_attr_t *);
 static mblk_t	*tcp_input_add_ancillary(tcp_t *, mblk_t *, ip_pkt_t *,
 		    ip_recv_attr_t *);
 static void	tcp_input_listener(void *, mblk_t *, void *, ip_recv_attr_t *);
-static void	tcp_process_options(tcp_t *, tcpha_t *);
+static boolean_t	tcp_process_options(tcp_t *, tcpha_t *, boolean_t);
 static mblk_t	*tcp_reass(tcp_t *, mblk_t *, uint32_t);
 static void	tcp_reass_elim_overlap(tcp_t *, mblk_t *);
 static void	tcp_rsrv_input(void *, mblk_t *, void *, ip_recv_attr_t *);
@@ -365,6 +362,7 @@ tcp_parse_options(tcpha_t *tcpha, tcp_opt_t *tcpopt)
 	int32_t		sack_len;
 	tcp_seq		sack_begin, sack_end;
 	tcp_t		*tcp;
+	uint_t		cookie_len;
 
 	endp = up + TCP_HDR_LENGTH(tcpha);
 	up += TCP_MIN_HEADER_LENGTH;
@@ -505,6 +503,28 @@ tcp_parse_options(tcpha_t *tcpha, tcp_opt_t *tcpopt)
 			up += TCPOPT_TSTAMP_LEN;
 			continue;
 
+		case TCPOPT_FASTOPEN:
+			if (len < TCPOPT_HEADER_LEN ||
+			    up[1] < TCPOPT_HEADER_LEN || len < up[1])
+				break;
+
+			/*
+			 * An option without a cookie is a cookie request.
+			 * Cookies of an unexpected size are ignored.
+			 */
+			cookie_len = up[1] - TCPOPT_HEADER_LEN;
+			if (cookie_len == 0 ||
+			    (cookie_len >= TCP_FASTOPEN_COOKIE_MIN &&
+			    cookie_len <= TCP_FASTOPEN_COOKIE_MAX)) {
+				bcopy(up + TCPOPT_HEADER_LEN,
+				    tcpopt->tcp_opt_fo_cookie, cookie_len);
+				tcpopt->tcp_opt_fo_cookie_len = cookie_len;
+				found |= TCP_OPT_FASTOPEN_PRESENT;
+			}
+
+			up += up[1];
+			continue;
+
 		default:
 			if (len <= 1 || len < (int)up[1] || up[1] == 0)
 				break;
@@ -526,9 +546,15 @@ tcp_parse_options(tcpha_t *tcpha, tcp_opt_t *tcpopt)
  * and timestamp values, and initialize SACK info blocks.  But it does not
  * change receive window size after setting the tcp_mss value.  The caller
  * should do the appropriate change.
+ *
+ * If `fastopen' is set on a passive open, returns B_TRUE when the SYN
+ * carried a valid TCP Fast Open cookie; an invalid cookie or a cookie
+ * request instead marks the eager to send a fresh cookie in its SYN-ACK.
+ * On an active open, a cookie in the SYN-ACK is remembered for the next
+ * connection to the same destination.
  */
-static void
-tcp_process_options(tcp_t *tcp, tcpha_t *tcpha)
+static boolean_t
+tcp_process_options(tcp_t *tcp, tcpha_t *tcpha, boolean_t fastopen)
 {
 	int options;
 	tcp_opt_t tcpopt;
@@ -678,6 +704,33 @@ tcp_process_options(tcp_t *tcp, tcpha_t *tcpha)
 
 	if (tcp->tcp_cc_algo->conn_init != NULL)
 		tcp->tcp_cc_algo->conn_init(&tcp->tcp_ccv);
+
+	/* Process TCP Fast Open option. */
+	if (!(options & TCP_OPT_FASTOPEN_PRESENT))
+		return (B_FALSE);
+
+	if (!TCP_IS_DETACHED(tcp)) {
+		if (tcp->tcp_fastopen_req &&
+		    tcpopt.tcp_opt_fo_cookie_len != 0 &&
+		    connp->conn_ixa->ixa_dce != NULL) {
+			dce_set_fastopen_cookie(connp->conn_ixa->ixa_dce,
+			    tcpopt.tcp_opt_fo_cookie,
+			    tcpopt.tcp_opt_fo_cookie_len);
+		}
+	} else if (fastopen) {
+		uint8_t	cookie[TCP_FASTOPEN_COOKIE_LEN];
+
+		if (tcpopt.tcp_opt_fo_cookie_len == TCP_FASTOPEN_COOKIE_LEN) {
+			tcp_fastopen_cookie(tcp, cookie);
+			if (bcmp(cookie, tcpopt.tcp_opt_fo_cookie,
+			    TCP_FASTOPEN_COOKIE_LEN) == 0)
+				return (B_TRUE);
+		}
+		if (tcpopt.tcp_opt_fo_cookie_len != 0)
+			TCP_STAT(tcps, tcp_fastopen_rejected);
+		tcp->tcp_fastopen_cookie_req = B_TRUE;
+	}
+	return (B_FALSE);
 }
 
 /*
@@ -1266,6 +1319,10 @@ tcp_eager_unlink(tcp_t *tcp)
 			prev = tcpp[0];
 		}
 	}
+	if (tcp->tcp_fastopen_eager) {
+		ASSERT(listener->tcp_fastopen_pending > 0);
+		listener->tcp_fastopen_pending--;
+	}
 	tcp->tcp_listener = NULL;
 }
 
@@ -1407,6 +1464,8 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	mblk_t		*tpi_mp;
 	uint_t		ifindex = ira->ira_ruifindex;
 	boolean_t	tlc_set = B_FALSE;
+	boolean_t	fastopen;
+	int		seg_len;
 
 	ip_hdr_len = ira->ira_ip_hdr_length;
 	tcpha = (tcpha_t *)&mp->b_rptr[ip_hdr_len];
@@ -1416,6 +1475,14 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	    __dtrace_tcp_void_ip_t *, mp->b_rptr, tcp_t *, listener,
 	    __dtrace_tcp_tcph_t *, tcpha);
 
+	/*
+	 * A segment for a connection in compact TIME_WAIT state is answered
+	 * from its record; only a SYN starting a new incarnation gets past
+	 * (see tcp_time_wait_input()).
+	 */
+	if (tcp_time_wait_input(mp, ira, ipst))
+		return;
+
 	if (!(flags & TH_SYN)) {
 		if ((flags & TH_RST) || (flags & TH_URG)) {
 			freemsg(mp);
@@ -1741,8 +1808,13 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 		goto error3;
 	}
 
-	/* Process all TCP options. */
-	tcp_process_options(eager, tcpha);
+	/*
+	 * Process all TCP options.  Fast Open is only offered by non-STREAMS
+	 * listeners that have asked for it with the TCP_FASTOPEN option.
+	 */
+	fastopen = (tcps->tcps_fastopen & TCP_FASTOPEN_SERVER) &&
+	    listener->tcp_fastopen_qlen > 0 && IPCL_IS_NONSTR(lconnp);
+	fastopen = tcp_process_options(eager, tcpha, fastopen);
 
 	/* Is the other end ECN capable? */
 	if (tcps->tcps_ecn_permitted >= 1 &&
@@ -1810,6 +1882,25 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 		 */
 		++listener->tcp_conn_req_seqnum;
 	}
+
+	/*
+	 * A valid Fast Open cookie lets us accept the data in the SYN, as
+	 * long as it fits in the window and the listener's Fast Open queue
+	 * has room.  Otherwise the data is dropped and the peer sends it
+	 * again once the handshake is done.
+	 */
+	seg_len = msgdsize(mp) - (ip_hdr_len + TCP_HDR_LENGTH(tcpha));
+	if (fastopen && seg_len > 0 && seg_len <= eager->tcp_rwnd &&
+	    !(flags & (TH_FIN | TH_URG))) {
+		if (listener->tcp_fastopen_pending <
+		    listener->tcp_fastopen_qlen) {
+			listener->tcp_fastopen_pending++;
+			eager->tcp_fastopen_eager = B_TRUE;
+			TCP_STAT(tcps, tcp_fastopen_accepted);
+		} else {
+			TCP_STAT(tcps, tcp_fastopen_overflow);
+		}
+	}
 	mutex_exit(&listener->tcp_eager_lock);
 
 	if (listener->tcp_syn_defense) {
@@ -1835,6 +1926,8 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	eager->tcp_irs = seg_seq;
 	eager->tcp_rack = seg_seq;
 	eager->tcp_rnxt = seg_seq + 1;
+	if (eager->tcp_fastopen_eager)
+		eager->tcp_rnxt += seg_len;
 	eager->tcp_tcpha->tha_ack = htonl(eager->tcp_rnxt);
 	TCPS_BUMP_MIB(tcps, tcpPassiveOpens);
 	eager->tcp_state = TCPS_SYN_RCVD;
@@ -1891,7 +1984,18 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 		goto error;
 
 	ASSERT(econnp->conn_ixa->ixa_notify_cookie == econnp->conn_tcp);
-	freemsg(mp);
+	if (eager->tcp_fastopen_eager) {
+		/*
+		 * Pass the SYN's data to the eager's perimeter, ahead of
+		 * anything else the peer sends it.
+		 */
+		mp->b_rptr += ip_hdr_len + TCP_HDR_LENGTH(tcpha);
+		CONN_INC_REF(econnp);
+		SQUEUE_ENTER_ONE(econnp->conn_sqp, mp, tcp_fastopen_deliver,
+		    econnp, ira, SQ_FILL, SQTAG_TCP_FASTOPEN);
+	} else {
+		freemsg(mp);
+	}
 	/*
 	 * Send the SYN-ACK. Use the right squeue so that conn_ixa is
 	 * only used by one thread at a time.
@@ -1953,6 +2057,48 @@ error2:
 		atomic_dec_32(&listener->tcp_listen_cnt->tlc_cnt);
 }
 
+/*
+ * Deliver the data carried by a TCP Fast Open SYN, running in the eager's
+ * perimeter.  The eager is handed to the listening socket now rather than
+ * when the final ACK of the handshake arrives, so that the application can
+ * accept it and read the data a round trip earlier.
+ */
+/* ARGSUSED */
+static void
+tcp_fastopen_deliver(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
+{
+	conn_t		*connp = (conn_t *)arg;
+	tcp_t		*tcp = connp->conn_tcp;
+	boolean_t	push = B_TRUE;
+	uint_t		len;
+	int		error;
+
+	/* The eager may have been reset or dropped in the meantime. */
+	if (tcp->tcp_state != TCPS_SYN_RCVD || tcp->tcp_listener == NULL ||
+	    !tcp->tcp_fastopen_eager) {
+		freemsg(mp);
+		return;
+	}
+
+	/* As in tcp_input_data(), hold the eager until accept completes. */
+	CONN_INC_REF(connp);
+	if (!tcp_newconn_notify(tcp, ira)) {
+		freemsg(mp);
+		CONN_DEC_REF(connp);
+		ASSERT(TCP_IS_DETACHED(tcp));
+		(void) tcp_close_detached(tcp);
+		return;
+	}
+
+	len = msgdsize(mp);
+	if ((*connp->conn_upcalls->su_recv)(connp->conn_upper_handle, mp,
+	    len, 0, &error, &push) <= 0) {
+		ASSERT(error != EOPNOTSUPP);
+		if (error == ENOSPC)
+			tcp->tcp_rwnd -= len;
+	}
+}
+
 /*
  * In an ideal case of vertical partition in NUMA architecture, its
  * beneficial to have the listener and all the incoming connections
@@ -2092,13 +2238,15 @@ tcp_rcv_drain(tcp_t *tcp)
 			return (ret);
 	}
 
-	while ((mp = tcp->tcp_rcv_list) != NULL) {
-		tcp->tcp_rcv_list = mp->b_next;
-		mp->b_next = NULL;
+	if ((mp = tcp->tcp_rcv_list) != NULL) {
 #ifdef DEBUG
-		cnt += msgdsize(mp);
+		mblk_t *mp1;
+
+		for (mp1 = mp; mp1 != NULL; mp1 = mp1->b_next)
+			cnt += msgdsize(mp1);
 #endif
-		putnext(q, mp);
+		tcp->tcp_rcv_list = NULL;
+		putnext_chain(q, mp);
 	}
 #ifdef DEBUG
 	ASSERT(cnt == tcp->tcp_rcv_cnt);
@@ -2611,10 +2759,9 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 		}
 		if (flags & TH_ACK) {
 			/*
-			 * Note that our stack cannot send data before a
-			 * connection is established, therefore the
-			 * following check is valid.  Otherwise, it has
-			 * to be changed.
+			 * Note that our stack only sends data before a
+			 * connection is established in a Fast Open SYN, so
+			 * the SYN-ACK may also acknowledge some of that.
 			 */
 			if (SEQ_LEQ(seg_ack, tcp->tcp_iss) ||
 			    SEQ_GT(seg_ack, tcp->tcp_snxt)) {
@@ -2625,7 +2772,8 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 				    tcp, seg_ack, 0, TH_RST);
 				return;
 			}
-			ASSERT(tcp->tcp_suna + 1 == seg_ack);
+			ASSERT(tcp->tcp_suna + 1 == seg_ack ||
+			    tcp->tcp_fastopen_syn_data);
 		}
 		if (flags & TH_RST) {
 			if (flags & TH_ACK) {
@@ -2644,7 +2792,7 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 		}
 
 		/* Process all TCP options. */
-		tcp_process_options(tcp, tcpha);
+		(void) tcp_process_options(tcp, tcpha, B_FALSE);
 		/*
 		 * The following changes our rwnd to be a multiple of the
 		 * MIN(peer MSS, our MSS) for performance reason.
@@ -2736,6 +2884,15 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 				tcp->tcp_cwnd = tcp->tcp_mss;
 			}
 
+			/*
+			 * If the peer ignored the data in our Fast Open SYN,
+			 * send it again right away as ordinary data.
+			 */
+			if (tcp->tcp_fastopen_syn_data &&
+			    seg_ack == tcp->tcp_suna)
+				tcp_fastopen_rewind(tcp);
+			tcp->tcp_fastopen_syn_data = B_FALSE;
+
 			tcp->tcp_swl1 = seg_seq;
 			tcp->tcp_swl2 = seg_ack;
 
@@ -2843,12 +3000,15 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 			 * yes, set the transmit flag.  Then check to see
 			 * if received data processing needs to be done.
 			 * If not, go straight to xmit_check.  This short
-			 * cut is OK as we don't support T/TCP.
+			 * cut is OK as we don't support T/TCP, unless the
+			 * SYN-ACK also acknowledged Fast Open data which
+			 * still has to be taken off the transmit list.
 			 */
 			if (tcp->tcp_unsent)
 				flags |= TH_XMIT_NEEDED;
 
-			if (seg_len == 0 && !(flags & TH_URG)) {
+			if (seg_len == 0 && !(flags & TH_URG) &&
+			    seg_ack == tcp->tcp_suna) {
 				freemsg(mp);
 				goto xmit_check;
 			}
@@ -3832,6 +3992,14 @@ process_ack:
 			DTRACE_TCP5(connect__established, mblk_t *, NULL,
 			    ip_xmit_attr_t *, connp->conn_ixa, void_ip_t *,
 			    iphdr, tcp_t *, tcp, tcph_t *, tcpha);
+		} else if (tcp->tcp_fastopen_eager) {
+			/*
+			 * A Fast Open eager was already handed to the
+			 * socket by tcp_fastopen_deliver().
+			 */
+			DTRACE_TCP5(accept__established, mlbk_t *, NULL,
+			    ip_xmit_attr_t *, connp->conn_ixa, void_ip_t *,
+			    iphdr, tcp_t *, tcp, tcph_t *, tcpha);
 		} else if (IPCL_IS_NONSTR(connp)) {
 			/*
 			 * 3-way handshake has completed, so notify socket
@@ -5345,6 +5513,7 @@ tcp_set_rto(tcp_t *tcp, hrtime_t rtt)
 
 	TCPS_BUMP_MIB(tcps, tcpRttUpdate);
 	tcp->tcp_rtt_update++;
+	tcp->tcp_rtt_last = rtt;
 	tcp->tcp_rtt_sum += m;
 	tcp->tcp_rtt_cnt++;
 
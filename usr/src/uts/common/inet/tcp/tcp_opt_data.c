@@ -92,6 +92,8 @@ opdes_t	tcp_opt_arr[] = {
 
 { SO_PROTOTYPE,	SOL_SOCKET, OA_R, OA_R, OP_NP, 0, sizeof (int), 0 },
 
+{ SO_MAX_PACING_RATE, SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
+
 { TCP_NODELAY,	IPPROTO_TCP, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0
 	},
 { TCP_MAXSEG,	IPPROTO_TCP, OA_R, OA_R, OP_NP, 0, sizeof (uint_t),
@@ -135,6 +137,10 @@ opdes_t	tcp_opt_arr[] = {
 
 { TCP_CORK, IPPROTO_TCP, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
 
+{ TCP_FASTOPEN, IPPROTO_TCP, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
+{ TCP_TLS_TX, IPPROTO_TCP, OA_R, OA_RW, OP_NP, 0,
+	sizeof (struct tcp_tls_crypto_info), 0 },
+
 { TCP_RTO_INITIAL, IPPROTO_TCP, OA_RW, OA_RW, OP_NP, 0, sizeof (uint32_t), 0 },
 
 { TCP_RTO_MIN, IPPROTO_TCP, OA_RW, OA_RW, OP_NP, 0, sizeof (uint32_t), 0 },
@@ -388,6 +394,10 @@ tcp_opt_get(conn_t *connp, int level, int name, uchar_t *ptr)
 		case SO_ACCEPTCONN:
 			*i1 = (tcp->tcp_state == TCPS_LISTEN);
 			return (sizeof (int));
+		case SO_MAX_PACING_RATE:
+			*(uint_t *)i1 = (tcp->tcp_max_pacing_rate == 0) ?
+			    UINT_MAX : (uint_t)tcp->tcp_max_pacing_rate;
+			return (sizeof (int));
 		}
 		break;
 	case IPPROTO_TCP:
@@ -448,6 +458,13 @@ tcp_opt_get(conn_t *connp, int level, int name, uchar_t *ptr)
 		case TCP_CORK:
 			*i1 = tcp->tcp_cork;
 			return (sizeof (int));
+		case TCP_FASTOPEN:
+			*i1 = tcp->tcp_fastopen_qlen;
+			return (sizeof (int));
+		case TCP_TLS_TX:
+			/* Whether keys are installed; never the keys. */
+			*i1 = (tcp->tcp_tls_tx != NULL);
+			return (sizeof (int));
 		case TCP_RTO_INITIAL:
 			*i1 = tcp->tcp_rto_initial;
 			return (sizeof (uint32_t));
@@ -770,6 +787,14 @@ tcp_opt_set(conn_t *connp, uint_t optset_context, int level, int name,
 				return (tcp_set_reuseport(connp, *i1 != 0));
 			}
 			return (0);
+		case SO_MAX_PACING_RATE:
+			/* Both zero and UINT_MAX lift the limit. */
+			if (!checkonly) {
+				tcp->tcp_max_pacing_rate =
+				    ((uint_t)*i1 == UINT_MAX) ? 0 : (uint_t)*i1;
+			}
+			*outlenp = inlen;
+			return (0);
 		}
 		break;
 	case IPPROTO_TCP:
@@ -1021,6 +1046,29 @@ tcp_opt_set(conn_t *connp, uint_t optset_context, int level, int name,
 				tcp->tcp_cork = onoff;
 			}
 			break;
+		case TCP_FASTOPEN:
+			/*
+			 * The maximum number of Fast Open eagers that may be
+			 * pending on this listener; zero disables Fast Open.
+			 */
+			if (*i1 < 0)
+				return (EINVAL);
+			if (!checkonly)
+				tcp->tcp_fastopen_qlen = *i1;
+			break;
+		case TCP_TLS_TX:
+			if (inlen != sizeof (struct tcp_tls_crypto_info)) {
+				*outlenp = 0;
+				return (EINVAL);
+			}
+			if (checkonly)
+				break;
+			if ((reterr = tcp_tls_tx_set(tcp,
+			    (struct tcp_tls_crypto_info *)invalp)) != 0) {
+				*outlenp = 0;
+				return (reterr);
+			}
+			break;
 		case TCP_RTO_INITIAL:
 			if (checkonly || val == 0)
 				break;
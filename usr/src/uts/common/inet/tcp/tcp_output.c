@@ -81,6 +81,86 @@ static void	tcp_wput_proto(void *, mblk_t *, void *, ip_recv_attr_t *);
  */
 static int tcp_tx_pull_len = 16;
 
+/*
+ * The amount of data sent at once by a paced connection is the larger of two
+ * segments and tcp_pace_quantum_usec worth of data at the pacing rate, but
+ * no more than tcp_pace_quantum_max bytes.  Larger quanta mean fewer pacing
+ * timers at the cost of burstier transmissions.
+ */
+uint_t tcp_pace_quantum_usec = 1000;
+uint_t tcp_pace_quantum_max = 64 * 1024;
+
+/*
+ * The rate a paced connection is sent at: the one its congestion control
+ * algorithm asked for, but no more than SO_MAX_PACING_RATE.
+ */
+static uint64_t
+tcp_pace_rate(tcp_t *tcp)
+{
+	if (tcp->tcp_pacing_rate == 0)
+		return (tcp->tcp_max_pacing_rate);
+	if (tcp->tcp_max_pacing_rate == 0)
+		return (tcp->tcp_pacing_rate);
+	return (MIN(tcp->tcp_pacing_rate, tcp->tcp_max_pacing_rate));
+}
+
+/*
+ * Arrange for tcp_pace_timer() to resume transmission at tcp_pace_next.  The
+ * timer lives on the squeue's timer wheel rather than in the callout
+ * subsystem, which keeps it cheap to run for many paced connections; it
+ * holds a reference on the conn_t while pending.
+ */
+static void
+tcp_pace_schedule(tcp_t *tcp)
+{
+	conn_t	*connp = tcp->tcp_connp;
+
+	if (SQTIMER_PENDING(&tcp->tcp_pace_sqt))
+		return;
+
+	CONN_INC_REF(connp);
+	squeue_timer_schedule(connp->conn_sqp, &tcp->tcp_pace_sqt,
+	    tcp->tcp_pace_next, tcp_pace_timer, connp);
+}
+
+/*
+ * Return how much of usable a paced connection may send now.  If it may not
+ * send anything yet, make sure the pacing timer is running.
+ */
+static int
+tcp_pace_usable(tcp_t *tcp, int usable, int32_t mss)
+{
+	uint64_t	quantum;
+
+	if (gethrtime() < tcp->tcp_pace_next) {
+		tcp_pace_schedule(tcp);
+		return (0);
+	}
+
+	quantum = tcp_pace_rate(tcp) * tcp_pace_quantum_usec / MICROSEC;
+	quantum = MAX(quantum, 2 * (uint64_t)mss);
+	quantum = MIN(quantum, tcp_pace_quantum_max);
+	return (MIN(usable, (int)quantum));
+}
+
+/*
+ * A paced connection just sent len bytes; work out when it may send again.
+ * Time spent idle does not earn the connection credit for a later burst.
+ */
+static void
+tcp_pace_sent(tcp_t *tcp, uint32_t len)
+{
+	hrtime_t	now = gethrtime();
+
+	if (tcp->tcp_pace_next < now)
+		tcp->tcp_pace_next = now;
+	tcp->tcp_pace_next += (hrtime_t)((uint64_t)len * NANOSEC /
+	    tcp_pace_rate(tcp));
+
+	if (tcp->tcp_unsent > 0)
+		tcp_pace_schedule(tcp);
+}
+
 static void
 cc_after_idle(tcp_t *tcp)
 {
@@ -466,6 +546,15 @@ data_null:
 		}
 	}
 
+	/*
+	 * If the connection is paced, send no more than a pacing quantum
+	 * now; tcp_pace_sent() arranges for the rest to go out when the
+	 * pacing rate allows it.
+	 */
+	if (TCP_IS_PACED(tcp) && !urgent &&
+	    (usable = tcp_pace_usable(tcp, usable, mss)) == 0)
+		goto done;
+
 	local_time = (mblk_t *)(intptr_t)gethrtime();
 
 	/*
@@ -564,6 +653,8 @@ done:;
 	}
 	/* Note that len is the amount we just sent but with a negative sign */
 	tcp->tcp_unsent += len;
+	if (TCP_IS_PACED(tcp) && len != 0)
+		tcp_pace_sent(tcp, -len);
 	mutex_enter(&tcp->tcp_non_sq_lock);
 	if (tcp->tcp_flow_stopped) {
 		if (TCP_UNSENT_BYTES(tcp) <= connp->conn_sndlowat) {
@@ -1158,9 +1249,11 @@ tcp_output(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *dummy)
 	 *   4. data in mblk
 	 *   5. len <= mss
 	 *   6. no tcp_valid bits
+	 *   7. transmissions are not paced
 	 */
 	if ((tcp->tcp_unsent != 0) ||
 	    (tcp->tcp_cork) ||
+	    TCP_IS_PACED(tcp) ||
 	    (mp->b_cont != NULL) ||
 	    (tcp->tcp_state != TCPS_ESTABLISHED) ||
 	    (len == 0) ||
@@ -2454,15 +2547,30 @@ tcp_xmit_ctl(char *str, tcp_t *tcp, uint32_t seq, uint32_t ack, int ctl)
  * Generate a reset based on an inbound packet, connp is set by caller
  * when RST is in response to an unexpected inbound packet for which
  * there is active tcp state in the system.
+ */
+static void
+tcp_xmit_early_reset(char *str, mblk_t *mp, uint32_t seq, uint32_t ack, int ctl,
+    ip_recv_attr_t *ira, ip_stack_t *ipst, conn_t *connp)
+{
+	tcp_xmit_reply(str, mp, seq, ack, ctl, 0, NULL, ira, ipst, connp);
+}
+
+/*
+ * Turn an inbound packet around into a bare control segment, for replies
+ * sent with no tcp_t: resets, and the ACKs of connections in compact
+ * TIME_WAIT state.  win is the (scaled) window to advertise; if tsecrp is
+ * not NULL a timestamp option echoing *tsecrp is added.  Resets are
+ * subject to the tcp_rst_sent_rate limit.
  *
  * IPSEC NOTE : Try to send the reply with the same protection as it came
  * in.  We have the ip_recv_attr_t which is reversed to form the ip_xmit_attr_t.
  * That way the packet will go out at the same level of protection as it
  * came in with.
  */
-static void
-tcp_xmit_early_reset(char *str, mblk_t *mp, uint32_t seq, uint32_t ack, int ctl,
-    ip_recv_attr_t *ira, ip_stack_t *ipst, conn_t *connp)
+void
+tcp_xmit_reply(char *str, mblk_t *mp, uint32_t seq, uint32_t ack, int ctl,
+    uint16_t win, uint32_t *tsecrp, ip_recv_attr_t *ira, ip_stack_t *ipst,
+    conn_t *connp)
 {
 	ipha_t		*ipha = NULL;
 	ip6_t		*ip6h = NULL;
@@ -2477,8 +2585,9 @@ tcp_xmit_early_reset(char *str, mblk_t *mp, uint32_t seq, uint32_t ack, int ctl,
 	uint_t		ip_hdr_len = ira->ira_ip_hdr_length;
 	boolean_t	need_refrele = B_FALSE;		/* ixa_refrele(ixa) */
 	ushort_t	port;
+	uint_t		optlen = (tsecrp != NULL) ? TCPOPT_REAL_TS_LEN : 0;
 
-	if (!tcp_send_rst_chk(tcps)) {
+	if ((ctl & TH_RST) && !tcp_send_rst_chk(tcps)) {
 		TCP_STAT(tcps, tcp_rst_unsent);
 		freemsg(mp);
 		return;
@@ -2520,7 +2629,7 @@ tcp_xmit_early_reset(char *str, mblk_t *mp, uint32_t seq, uint32_t ack, int ctl,
 
 	if (str && tcps->tcps_dbg) {
 		(void) strlog(TCP_MOD_ID, 0, 1, SL_TRACE,
-		    "tcp_xmit_early_reset: '%s', seq 0x%x, ack 0x%x, "
+		    "tcp_xmit_reply: '%s', seq 0x%x, ack 0x%x, "
 		    "flags 0x%x",
 		    str, seq, ack, ctl);
 	}
@@ -2586,8 +2695,36 @@ tcp_xmit_early_reset(char *str, mblk_t *mp, uint32_t seq, uint32_t ack, int ctl,
 		freemsg(mp);
 		goto done;
 	}
-	tcpha->tha_offset_and_reserved = (5 << 4);
 	len = ip_hdr_len + sizeof (tcpha_t);
+	if (mp->b_datap->db_lim - mp->b_rptr < len + optlen) {
+		mblk_t *mp1;
+
+		/* No room for the options in the segment we were sent. */
+		if ((mp1 = allocb(len + optlen, BPRI_MED)) == NULL) {
+			freemsg(mp);
+			goto done;
+		}
+		bcopy(mp->b_rptr, mp1->b_rptr, len);
+		freemsg(mp);
+		mp = mp1;
+		if (ipha != NULL)
+			ipha = (ipha_t *)mp->b_rptr;
+		else
+			ip6h = (ip6_t *)mp->b_rptr;
+		tcpha = (tcpha_t *)&mp->b_rptr[ip_hdr_len];
+	}
+	tcpha->tha_offset_and_reserved = (5 + optlen / 4) << 4;
+	if (optlen != 0) {
+		uint8_t *wptr = (uint8_t *)&tcpha[1];
+
+		wptr[0] = TCPOPT_NOP;
+		wptr[1] = TCPOPT_NOP;
+		wptr[2] = TCPOPT_TSTAMP;
+		wptr[3] = TCPOPT_TSTAMP_LEN;
+		U32_TO_BE32((uint32_t)LBOLT_FASTPATH, wptr + 4);
+		U32_TO_BE32(*tsecrp, wptr + 8);
+		len += optlen;
+	}
 	mp->b_wptr = &mp->b_rptr[len];
 	if (IPH_HDR_VERSION(mp->b_rptr) == IPV4_VERSION) {
 		ipha->ipha_length = htons(len);
@@ -2623,8 +2760,8 @@ tcp_xmit_early_reset(char *str, mblk_t *mp, uint32_t seq, uint32_t ack, int ctl,
 
 	tcpha->tha_ack = htonl(ack);
 	tcpha->tha_seq = htonl(seq);
-	tcpha->tha_win = 0;
-	tcpha->tha_sum = htons(sizeof (tcpha_t));
+	tcpha->tha_win = htons(win);
+	tcpha->tha_sum = htons(sizeof (tcpha_t) + optlen);
 	tcpha->tha_flags = (uint8_t)ctl;
 	if (ctl & TH_RST) {
 		if (ctl & TH_ACK) {
@@ -2644,6 +2781,8 @@ tcp_xmit_early_reset(char *str, mblk_t *mp, uint32_t seq, uint32_t ack, int ctl,
 		}
 		TCPS_BUMP_MIB(tcps, tcpOutRsts);
 		TCPS_BUMP_MIB(tcps, tcpOutControl);
+	} else if (ctl & TH_ACK) {
+		TCPS_BUMP_MIB(tcps, tcpOutAck);
 	}
 
 	/* Discard any old label */
@@ -2756,6 +2895,10 @@ tcp_xmit_listeners_reset(mblk_t *mp, ip_recv_attr_t *ira, ip_stack_t *ipst,
 		return;
 	}
 
+	/* A connection in compact TIME_WAIT state answers for itself. */
+	if (tcp_time_wait_input(mp, ira, ipst))
+		return;
+
 	rptr = mp->b_rptr;
 
 	tcpha = (tcpha_t *)&rptr[ip_hdr_len];
@@ -2968,6 +3111,38 @@ tcp_xmit_mp_aux_iss(tcp_t *tcp, conn_t *connp, tcpha_t *tcpha, mblk_t *mp,
 		tcpha->tha_offset_and_reserved += (1 << 4);
 	}
 
+	/*
+	 * TCP Fast Open: an active open asks for a cookie (or presents the
+	 * one cached for this destination), and a passive open hands out a
+	 * cookie when the peer asked for one.  The option is padded out to
+	 * a word boundary with leading NOPs.
+	 */
+	if ((tcp->tcp_state == TCPS_SYN_SENT && tcp->tcp_fastopen_req) ||
+	    (tcp->tcp_state == TCPS_SYN_RCVD && tcp->tcp_fastopen_cookie_req)) {
+		uint_t len, words, pad;
+		uint8_t *cookie;
+		uint8_t scookie[TCP_FASTOPEN_COOKIE_LEN];
+
+		if (tcp->tcp_state == TCPS_SYN_SENT) {
+			len = tcp->tcp_fastopen_cookie_len;
+			cookie = tcp->tcp_fastopen_cookie;
+		} else {
+			tcp_fastopen_cookie(tcp, scookie);
+			len = TCP_FASTOPEN_COOKIE_LEN;
+			cookie = scookie;
+			TCP_STAT(tcps, tcp_fastopen_cookie_sent);
+		}
+		words = (TCPOPT_HEADER_LEN + len + 3) >> 2;
+		for (pad = (words << 2) - (TCPOPT_HEADER_LEN + len); pad > 0;
+		    pad--)
+			*wptr++ = TCPOPT_NOP;
+		wptr[0] = TCPOPT_FASTOPEN;
+		wptr[1] = TCPOPT_HEADER_LEN + len;
+		bcopy(cookie, wptr + TCPOPT_HEADER_LEN, len);
+		wptr += TCPOPT_HEADER_LEN + len;
+		tcpha->tha_offset_and_reserved += (words << 4);
+	}
+
 	mp->b_wptr = wptr;
 	u1 = (int)(mp->b_wptr - mp->b_rptr);
 	/*
@@ -3738,3 +3913,390 @@ tcp_fill_header(tcp_t *tcp, uchar_t *rptr, int num_sack_blk)
 		    ((num_sack_blk * 2 + 1) << 4);
 	}
 }
+
+/*
+ * Build the SYN for an active open that has data to go with it (TCP Fast
+ * Open).  The data is queued on the transmit list as if tcp_wput_data()
+ * had been called; if we hold a cookie for the peer, up to max_data bytes
+ * of it are carried in the SYN, otherwise a plain SYN requesting a cookie
+ * is built and the data goes out once the connection is established.
+ */
+mblk_t *
+tcp_fastopen_syn(tcp_t *tcp, mblk_t *mp, int32_t max_data)
+{
+	mblk_t		*syn_mp;
+	mblk_t		*end_mp;
+	int32_t		off = 0;
+	uint32_t	seg_len = 0;
+	int		len;
+
+	ASSERT(tcp->tcp_state == TCPS_SYN_SENT);
+	ASSERT(tcp->tcp_xmit_head == NULL);
+	ASSERT(tcp->tcp_unsent == 0);
+
+	len = msgdsize(mp);
+	if (len == 0) {
+		freemsg(mp);
+	} else {
+		tcp->tcp_xmit_head = mp;
+		tcp->tcp_xmit_tail = mp;
+		while (mp->b_cont != NULL)
+			mp = mp->b_cont;
+		tcp->tcp_xmit_last = mp;
+		tcp->tcp_unsent = len;
+		tcp->tcp_xmit_tail_unsent = (int)MBLKL(tcp->tcp_xmit_head);
+	}
+
+	if (len == 0 || tcp->tcp_fastopen_cookie_len == 0 || max_data <= 0) {
+		return (tcp_xmit_mp(tcp, NULL, 0, NULL, NULL, tcp->tcp_iss,
+		    B_FALSE, NULL, B_FALSE));
+	}
+
+	syn_mp = tcp_xmit_mp(tcp, tcp->tcp_xmit_head, max_data, &off, &end_mp,
+	    tcp->tcp_iss, B_TRUE, &seg_len, B_FALSE);
+	if (syn_mp == NULL)
+		return (NULL);
+
+	tcp->tcp_snxt += seg_len;
+	tcp->tcp_unsent -= seg_len;
+	if (end_mp == NULL) {
+		tcp->tcp_xmit_tail = tcp->tcp_xmit_last;
+		tcp->tcp_xmit_tail_unsent = 0;
+	} else {
+		tcp->tcp_xmit_tail = end_mp;
+		tcp->tcp_xmit_tail_unsent = (int)MBLKL(end_mp) - off;
+	}
+	tcp->tcp_fastopen_syn_data = B_TRUE;
+	TCP_STAT(tcp->tcp_tcps, tcp_fastopen_syn_data);
+	return (syn_mp);
+}
+
+/*
+ * The data sent in our SYN was not acknowledged, either because the peer
+ * rejected the cookie or because the SYN has to be retransmitted.  Put the
+ * data back on the unsent part of the transmit list so that it is sent
+ * once the connection is established.
+ */
+void
+tcp_fastopen_rewind(tcp_t *tcp)
+{
+	ASSERT(tcp->tcp_fastopen_syn_data);
+	ASSERT(tcp->tcp_xmit_head != NULL);
+
+	tcp->tcp_unsent += tcp->tcp_snxt - (tcp->tcp_iss + 1);
+	tcp->tcp_snxt = tcp->tcp_iss + 1;
+	tcp->tcp_xmit_tail = tcp->tcp_xmit_head;
+	tcp->tcp_xmit_tail_unsent = (int)MBLKL(tcp->tcp_xmit_head);
+	tcp->tcp_fastopen_syn_data = B_FALSE;
+}
+
+/*
+ * Kernel TLS transmit (TCP_TLS_TX)
+ *
+ * After the TLS handshake an application can give the socket its transmit
+ * keys. Every later write then goes through tcp_tls_encrypt() in
+ * tcp_sendmsg(), before it is queued on the squeue. That function cuts the
+ * data into records of at most tcp_tls_max_record bytes, encrypts each one
+ * with AES-GCM through KCF, and hands the records on in place of the
+ * plaintext. sendfile() therefore produces HTTPS records without the file
+ * data passing through userland. Its zero-copy segmap pages serve as the
+ * encryption input and are released once their record has been built.
+ *
+ * ttx_lock serializes record production. Sequence numbers then match the
+ * order in which records reach the squeue.
+ */
+uint_t tcp_tls_max_record = TLS_MAX_PLAINTEXT;
+
+static uint64_t
+tcp_tls_be64(const uint8_t *p)
+{
+	uint64_t v = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		v = (v << 8) | p[i];
+	return (v);
+}
+
+static void
+tcp_tls_put_be64(uint8_t *p, uint64_t v)
+{
+	int i;
+
+	for (i = 7; i >= 0; i--) {
+		p[i] = v & 0xff;
+		v >>= 8;
+	}
+}
+
+/*
+ * Install the transmit keys given with TCP_TLS_TX. Called on the squeue;
+ * the keys can be set once per connection.
+ */
+int
+tcp_tls_tx_set(tcp_t *tcp, const struct tcp_tls_crypto_info *tti)
+{
+	tcp_tls_tx_t *ttx;
+	uint_t keylen;
+	int rv;
+
+	if (!IPCL_IS_NONSTR(tcp->tcp_connp))
+		return (EOPNOTSUPP);
+	if (tcp->tcp_tls_tx != NULL)
+		return (EEXIST);
+	if (tcp->tcp_state != TCPS_ESTABLISHED)
+		return (ENOTCONN);
+	if (tti->tti_version != TCP_TLS_VERSION_1_2 &&
+	    tti->tti_version != TCP_TLS_VERSION_1_3)
+		return (EINVAL);
+
+	switch (tti->tti_cipher) {
+	case TCP_TLS_CIPHER_AES_GCM_128:
+		keylen = 16;
+		break;
+	case TCP_TLS_CIPHER_AES_GCM_256:
+		keylen = 32;
+		break;
+	default:
+		return (EINVAL);
+	}
+
+	if ((ttx = kmem_zalloc(sizeof (*ttx), KM_NOSLEEP)) == NULL)
+		return (ENOMEM);
+	ttx->ttx_mech.cm_type = crypto_mech2id(SUN_CKM_AES_GCM);
+	if (ttx->ttx_mech.cm_type == CRYPTO_MECH_INVALID) {
+		kmem_free(ttx, sizeof (*ttx));
+		return (EPROTONOSUPPORT);
+	}
+	bcopy(tti->tti_key, ttx->ttx_keybuf, keylen);
+	ttx->ttx_key.ck_format = CRYPTO_KEY_RAW;
+	ttx->ttx_key.ck_data = ttx->ttx_keybuf;
+	ttx->ttx_key.ck_length = CRYPTO_BYTES2BITS(keylen);
+	rv = crypto_create_ctx_template(&ttx->ttx_mech, &ttx->ttx_key,
+	    &ttx->ttx_tmpl, KM_NOSLEEP);
+	if (rv != CRYPTO_SUCCESS && rv != CRYPTO_NOT_SUPPORTED) {
+		bzero(ttx->ttx_keybuf, sizeof (ttx->ttx_keybuf));
+		kmem_free(ttx, sizeof (*ttx));
+		return (ENOMEM);
+	}
+	if (rv != CRYPTO_SUCCESS)
+		ttx->ttx_tmpl = NULL;
+
+	ttx->ttx_version = tti->tti_version;
+	bcopy(tti->tti_salt, ttx->ttx_salt, TLS_AEAD_SALT_LEN);
+	bcopy(tti->tti_iv, ttx->ttx_iv, TLS_AEAD_IV_LEN);
+	ttx->ttx_seq = tcp_tls_be64(tti->tti_rec_seq);
+	mutex_init(&ttx->ttx_lock, NULL, MUTEX_DEFAULT, NULL);
+
+	/* tcp_sendmsg() looks at tcp_tls_tx without entering the squeue */
+	membar_producer();
+	tcp->tcp_tls_tx = ttx;
+	return (0);
+}
+
+void
+tcp_tls_tx_free(tcp_t *tcp)
+{
+	tcp_tls_tx_t *ttx = tcp->tcp_tls_tx;
+
+	if (ttx == NULL)
+		return;
+	tcp->tcp_tls_tx = NULL;
+	if (ttx->ttx_tmpl != NULL)
+		crypto_destroy_ctx_template(ttx->ttx_tmpl);
+	bzero(ttx->ttx_keybuf, sizeof (ttx->ttx_keybuf));
+	mutex_destroy(&ttx->ttx_lock);
+	kmem_free(ttx, sizeof (*ttx));
+}
+
+/*
+ * Split the first len bytes off *mpp and return them. The rest is left in
+ * *mpp.
+ */
+static mblk_t *
+tcp_tls_split(mblk_t **mpp, size_t len)
+{
+	mblk_t *head = *mpp, *mp = head, *rest;
+
+	while (len > MBLKL(mp)) {
+		len -= MBLKL(mp);
+		mp = mp->b_cont;
+	}
+	if (len == MBLKL(mp)) {
+		rest = mp->b_cont;
+	} else {
+		if ((rest = dupb(mp)) == NULL)
+			return (NULL);
+		rest->b_rptr += len;
+		mp->b_wptr = mp->b_rptr + len;
+		rest->b_cont = mp->b_cont;
+	}
+	mp->b_cont = NULL;
+	*mpp = rest;
+	return (head);
+}
+
+/*
+ * Seal one record of the given content type around the plaintext in pt.
+ * pt is always consumed.
+ */
+static mblk_t *
+tcp_tls_seal(tcp_tls_tx_t *ttx, mblk_t *pt, size_t len, uint8_t type,
+    int *errorp)
+{
+	boolean_t tls13 = (ttx->ttx_version == TCP_TLS_VERSION_1_3);
+	uint8_t nonce[TLS_AEAD_NONCE_LEN];
+	uint8_t aad[TLS_1_2_AAD_LEN];
+	uint8_t seq[8];
+	CK_AES_GCM_PARAMS gcm;
+	crypto_mechanism_t mech;
+	crypto_data_t in, out;
+	size_t ctlen, hdrlen, reclen;
+	mblk_t *rec, *tmp;
+	uint8_t *p;
+	int i, rv;
+
+	ctlen = len + (tls13 ? 1 : 0) + TLS_AEAD_TAG_LEN;
+	hdrlen = TLS_HDR_LEN + (tls13 ? 0 : TLS_AEAD_IV_LEN);
+	reclen = hdrlen - TLS_HDR_LEN + ctlen;
+
+	if ((rec = allocb(hdrlen + ctlen, BPRI_MED)) == NULL) {
+		freemsg(pt);
+		*errorp = ENOMEM;
+		return (NULL);
+	}
+	p = rec->b_wptr;
+	p[0] = tls13 ? TLS_RT_APPLICATION_DATA : type;
+	p[1] = 0x03;
+	p[2] = 0x03;
+	p[3] = (reclen >> 8) & 0xff;
+	p[4] = reclen & 0xff;
+
+	tcp_tls_put_be64(seq, ttx->ttx_seq);
+	bcopy(ttx->ttx_salt, nonce, TLS_AEAD_SALT_LEN);
+	bcopy(ttx->ttx_iv, nonce + TLS_AEAD_SALT_LEN, TLS_AEAD_IV_LEN);
+	if (tls13) {
+		/* The true content type trails the plaintext. */
+		if ((tmp = allocb(1, BPRI_MED)) == NULL) {
+			freemsg(pt);
+			freeb(rec);
+			*errorp = ENOMEM;
+			return (NULL);
+		}
+		*tmp->b_wptr++ = type;
+		linkb(pt, tmp);
+		for (i = 0; i < 8; i++)
+			nonce[TLS_AEAD_SALT_LEN + i] ^= seq[i];
+		gcm.pAAD = p;
+		gcm.ulAADLen = TLS_HDR_LEN;
+	} else {
+		bcopy(ttx->ttx_iv, p + TLS_HDR_LEN, TLS_AEAD_IV_LEN);
+		bcopy(seq, aad, 8);
+		aad[8] = type;
+		aad[9] = 0x03;
+		aad[10] = 0x03;
+		aad[11] = (len >> 8) & 0xff;
+		aad[12] = len & 0xff;
+		gcm.pAAD = aad;
+		gcm.ulAADLen = TLS_1_2_AAD_LEN;
+	}
+	gcm.pIv = nonce;
+	gcm.ulIvLen = TLS_AEAD_NONCE_LEN;
+	gcm.ulIvBits = CRYPTO_BYTES2BITS(TLS_AEAD_NONCE_LEN);
+	gcm.ulTagBits = CRYPTO_BYTES2BITS(TLS_AEAD_TAG_LEN);
+
+	mech.cm_type = ttx->ttx_mech.cm_type;
+	mech.cm_param = (char *)&gcm;
+	mech.cm_param_len = sizeof (gcm);
+
+	bzero(&in, sizeof (in));
+	in.cd_format = CRYPTO_DATA_MBLK;
+	in.cd_length = ctlen - TLS_AEAD_TAG_LEN;
+	in.cd_mp = pt;
+
+	bzero(&out, sizeof (out));
+	out.cd_format = CRYPTO_DATA_RAW;
+	out.cd_length = ctlen;
+	out.cd_raw.iov_base = (char *)p + hdrlen;
+	out.cd_raw.iov_len = ctlen;
+
+	rv = crypto_encrypt(&mech, &in, &ttx->ttx_key, ttx->ttx_tmpl, &out,
+	    NULL);
+	bzero(nonce, sizeof (nonce));
+	freemsg(pt);
+	if (rv != CRYPTO_SUCCESS) {
+		freeb(rec);
+		*errorp = EIO;
+		return (NULL);
+	}
+	rec->b_wptr += hdrlen + ctlen;
+
+	ttx->ttx_seq++;
+	if (!tls13) {
+		/* Advance the explicit nonce for the next record. */
+		for (i = TLS_AEAD_IV_LEN - 1; i >= 0; i--) {
+			if (++ttx->ttx_iv[i] != 0)
+				break;
+		}
+	}
+	return (rec);
+}
+
+/*
+ * Replace the plaintext chain mp with a chain of TLS records of the given
+ * content type. Called from tcp_sendmsg() with ttx_lock held; mp is always
+ * consumed. The zero-copy notifications of the plaintext are delivered
+ * here, since the data that TCP later transmits is the ciphertext.
+ */
+mblk_t *
+tcp_tls_encrypt(tcp_t *tcp, mblk_t *mp, uint8_t type, int *errorp)
+{
+	tcp_tls_tx_t *ttx = tcp->tcp_tls_tx;
+	tcp_stack_t *tcps = tcp->tcp_tcps;
+	mblk_t *head = NULL, **tailp = &head;
+	mblk_t *pt, *rec, *bp;
+	boolean_t notify = B_FALSE;
+	size_t len, resid;
+	uint64_t seq = ttx->ttx_seq;
+	uint8_t iv[TLS_AEAD_IV_LEN];
+
+	ASSERT(MUTEX_HELD(&ttx->ttx_lock));
+	bcopy(ttx->ttx_iv, iv, TLS_AEAD_IV_LEN);
+
+	for (bp = mp; bp != NULL; bp = bp->b_cont) {
+		if (bp->b_datap->db_struioflag & STRUIO_ZCNOTIFY) {
+			bp->b_datap->db_struioflag &= ~STRUIO_ZCNOTIFY;
+			notify = B_TRUE;
+		}
+	}
+
+	resid = msgdsize(mp);
+	while (resid > 0) {
+		len = MIN(resid, MIN(tcp_tls_max_record, TLS_MAX_PLAINTEXT));
+		if ((pt = tcp_tls_split(&mp, len)) == NULL) {
+			*errorp = ENOMEM;
+			goto fail;
+		}
+		if ((rec = tcp_tls_seal(ttx, pt, len, type, errorp)) == NULL)
+			goto fail;
+		*tailp = rec;
+		tailp = &rec->b_cont;
+		resid -= len;
+		TCP_STAT(tcps, tcp_tls_tx_records);
+	}
+	ASSERT(mp == NULL);
+	if (notify)
+		tcp_zcopy_notify(tcp);
+	return (head);
+
+fail:
+	/* Nothing was sent; the records sealed so far never existed. */
+	ttx->ttx_seq = seq;
+	bcopy(iv, ttx->ttx_iv, TLS_AEAD_IV_LEN);
+	TCP_STAT(tcps, tcp_tls_tx_fail);
+	freemsg(mp);
+	freemsg(head);
+	if (notify)
+		tcp_zcopy_notify(tcp);
+	return (NULL);
+}
@@ -192,7 +192,9 @@ tcp_accept(sock_lower_handle_t lproto_handle,
 	mutex_exit(&listener->tcp_eager_lock);
 	CONN_DEC_REF(listener->tcp_connp);
 
-	return ((eager->tcp_state < TCPS_ESTABLISHED) ? ECONNABORTED : 0);
+	/* A Fast Open eager may be accepted before the handshake completes. */
+	return ((eager->tcp_state < (eager->tcp_fastopen_eager ?
+	    TCPS_SYN_RCVD : TCPS_ESTABLISHED)) ? ECONNABORTED : 0);
 }
 
 static int
@@ -299,7 +301,7 @@ tcp_connect(sock_lower_handle_t proto_handle, const struct sockaddr *sa,
 	/*
 	 * TCP supports quick connect, so no need to do an implicit bind
 	 */
-	error = tcp_do_connect(connp, sa, len, cr, curproc->p_pid);
+	error = tcp_do_connect(connp, sa, len, cr, curproc->p_pid, NULL);
 	if (error == 0) {
 		*id = connp->conn_tcp->tcp_connid;
 	} else if (error < 0) {
@@ -483,6 +485,82 @@ tcp_setsockopt(sock_lower_handle_t proto_handle, int level, int option_name,
 	return (error);
 }
 
+/*
+ * Implicit connect for sendto(2)/sendmsg(2) with MSG_FASTOPEN: initiate the
+ * connection to msg_name, carrying mp in the SYN if a Fast Open cookie for
+ * the peer is cached (see tcp_do_connect()).
+ */
+static int
+tcp_fastopen_connect(conn_t *connp, mblk_t *mp, struct nmsghdr *msg,
+    cred_t *cr)
+{
+	tcp_t	*tcp = connp->conn_tcp;
+	int	error;
+
+	if (!(tcp->tcp_tcps->tcps_fastopen & TCP_FASTOPEN_CLIENT)) {
+		freemsg(mp);
+		return (EOPNOTSUPP);
+	}
+	if (msg->msg_name == NULL || msg->msg_namelen == 0) {
+		freemsg(mp);
+		return (EDESTADDRREQ);
+	}
+	error = proto_verify_ip_addr(connp->conn_family,
+	    (struct sockaddr *)msg->msg_name, msg->msg_namelen);
+	if (error != 0) {
+		freemsg(mp);
+		return (error);
+	}
+
+	error = squeue_synch_enter(connp, NULL);
+	if (error != 0) {
+		freemsg(mp);
+		return (ENOSR);
+	}
+
+	error = tcp_do_connect(connp, (struct sockaddr *)msg->msg_name,
+	    msg->msg_namelen, cr, curproc->p_pid, mp);
+	if (error != 0) {
+		freemsg(mp);
+		if (error < 0) {
+			error = (error == -TOUTSTATE) ? EISCONN :
+			    proto_tlitosyserr(-error);
+		}
+	} else if (tcp->tcp_loopback) {
+		struct sock_proto_props sopp;
+
+		sopp.sopp_flags = SOCKOPT_LOOPBACK;
+		sopp.sopp_loopback = B_TRUE;
+
+		(*connp->conn_upcalls->su_set_proto_props)(
+		    connp->conn_upper_handle, &sopp);
+	}
+	squeue_synch_exit(connp, SQ_PROCESS);
+
+	return (error);
+}
+
+/*
+ * Pick the record content type out of a TCP_TLS_RECTYPE control message;
+ * no other control message is accepted on a TCP socket.
+ */
+static int
+tcp_tls_rectype(struct nmsghdr *msg, uint8_t *typep)
+{
+	struct cmsghdr *cmsg = (struct cmsghdr *)msg->msg_control;
+
+	if (!(msg->msg_flags & MSG_XPG4_2) ||
+	    msg->msg_controllen < CMSG_LEN(sizeof (uint8_t)) ||
+	    !ISALIGNED_cmsghdr(cmsg) ||
+	    cmsg->cmsg_level != IPPROTO_TCP ||
+	    cmsg->cmsg_type != TCP_TLS_RECTYPE ||
+	    cmsg->cmsg_len != CMSG_LEN(sizeof (uint8_t)) ||
+	    CMSG_SPACE(sizeof (uint8_t)) < msg->msg_controllen)
+		return (EINVAL);
+	*typep = *(uint8_t *)CMSG_DATA(cmsg);
+	return (0);
+}
+
 /* ARGSUSED */
 static int
 tcp_sendmsg(sock_lower_handle_t proto_handle, mblk_t *mp, struct nmsghdr *msg,
@@ -492,6 +570,9 @@ tcp_sendmsg(sock_lower_handle_t proto_handle, mblk_t *mp, struct nmsghdr *msg,
 	uint32_t	msize;
 	conn_t *connp = (conn_t *)proto_handle;
 	int32_t		tcpstate;
+	tcp_tls_tx_t	*ttx;
+	uint8_t		rectype = TLS_RT_APPLICATION_DATA;
+	int		error;
 
 	/* All Solaris components should pass a cred for this operation. */
 	ASSERT(cr != NULL);
@@ -499,18 +580,33 @@ tcp_sendmsg(sock_lower_handle_t proto_handle, mblk_t *mp, struct nmsghdr *msg,
 	ASSERT(connp->conn_ref >= 2);
 	ASSERT(connp->conn_upper_handle != NULL);
 
-	if (msg->msg_controllen != 0) {
+	tcp = connp->conn_tcp;
+	ASSERT(tcp != NULL);
+
+	if (msg->msg_controllen != 0 &&
+	    (tcp->tcp_tls_tx == NULL ||
+	    tcp_tls_rectype(msg, &rectype) != 0)) {
 		freemsg(mp);
 		return (EOPNOTSUPP);
 	}
 
 	switch (DB_TYPE(mp)) {
 	case M_DATA:
-		tcp = connp->conn_tcp;
-		ASSERT(tcp != NULL);
 
 		tcpstate = tcp->tcp_state;
-		if (tcpstate < TCPS_ESTABLISHED) {
+		if ((msg->msg_flags & MSG_FASTOPEN) &&
+		    (tcpstate == TCPS_IDLE || tcpstate == TCPS_BOUND))
+			return (tcp_fastopen_connect(connp, mp, msg, cr));
+
+		/*
+		 * Data sent before the handshake completes is queued: by an
+		 * active open that used MSG_FASTOPEN, or by a Fast Open
+		 * eager that has already been accepted.
+		 */
+		if (tcpstate < TCPS_ESTABLISHED &&
+		    !(tcpstate == TCPS_SYN_SENT &&
+		    (msg->msg_flags & MSG_FASTOPEN)) &&
+		    !(tcpstate == TCPS_SYN_RCVD && tcp->tcp_fastopen_eager)) {
 			freemsg(mp);
 			/*
 			 * We return ENOTCONN if the endpoint is trying to
@@ -525,6 +621,24 @@ tcp_sendmsg(sock_lower_handle_t proto_handle, mblk_t *mp, struct nmsghdr *msg,
 			return (EPIPE);
 		}
 
+		/*
+		 * With TCP_TLS_TX the plaintext is sealed into records here.
+		 * ttx_lock is held until the records are on the squeue so
+		 * that they are transmitted in sequence number order.
+		 */
+		if ((ttx = tcp->tcp_tls_tx) != NULL) {
+			if (msg->msg_flags & MSG_OOB) {
+				freemsg(mp);
+				return (EOPNOTSUPP);
+			}
+			mutex_enter(&ttx->ttx_lock);
+			if ((mp = tcp_tls_encrypt(tcp, mp, rectype,
+			    &error)) == NULL) {
+				mutex_exit(&ttx->ttx_lock);
+				return (error);
+			}
+		}
+
 		msize = msgdsize(mp);
 
 		mutex_enter(&tcp->tcp_non_sq_lock);
@@ -555,6 +669,8 @@ tcp_sendmsg(sock_lower_handle_t proto_handle, mblk_t *mp, struct nmsghdr *msg,
 			SQUEUE_ENTER_ONE(connp->conn_sqp, mp, tcp_output,
 			    connp, NULL, tcp_squeue_flag, SQTAG_TCP_OUTPUT);
 		}
+		if (ttx != NULL)
+			mutex_exit(&ttx->ttx_lock);
 
 		return (0);
 
@@ -1029,9 +1145,10 @@ tcp_fallback(sock_lower_handle_t proto_handle, queue_t *q,
 	}
 
 	/*
-	 * Do not allow fallback on connections making use of SO_REUSEPORT.
+	 * Do not allow fallback on connections making use of SO_REUSEPORT,
+	 * or on those whose transmit side is framed by TCP_TLS_TX.
 	 */
-	if (tcp->tcp_rg_bind != NULL) {
+	if (tcp->tcp_rg_bind != NULL || tcp->tcp_tls_tx != NULL) {
 		freeb(stropt_mp);
 		freeb(ordrel_mp);
 		squeue_synch_exit(connp, SQ_NODRAIN);
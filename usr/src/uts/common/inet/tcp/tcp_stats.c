@@ -794,6 +794,15 @@ tcp_kstat2_init(netstackid_t stackid)
 		{ "tcp_rst_unsent",		KSTAT_DATA_UINT64, 0 },
 		{ "tcp_reclaim_cnt",		KSTAT_DATA_UINT64, 0 },
 		{ "tcp_reass_timeout",		KSTAT_DATA_UINT64, 0 },
+		{ "tcp_fastopen_cookie_sent",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_fastopen_accepted",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_fastopen_rejected",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_fastopen_overflow",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_fastopen_syn_data",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_tls_tx_records",		KSTAT_DATA_UINT64, 0 },
+		{ "tcp_tls_tx_fail",		KSTAT_DATA_UINT64, 0 },
+		{ "tcp_time_wait_compact",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_time_wait_compact_reuse", KSTAT_DATA_UINT64, 0 },
 #ifdef TCP_DEBUG_COUNTER
 		{ "tcp_time_wait",		KSTAT_DATA_UINT64, 0 },
 		{ "tcp_rput_time_wait",		KSTAT_DATA_UINT64, 0 },
@@ -1001,6 +1010,15 @@ tcp_clr_stats(tcp_stat_t *stats)
 	stats->tcp_rst_unsent.value.ui64 = 0;
 	stats->tcp_reclaim_cnt.value.ui64 = 0;
 	stats->tcp_reass_timeout.value.ui64 = 0;
+	stats->tcp_fastopen_cookie_sent.value.ui64 = 0;
+	stats->tcp_fastopen_accepted.value.ui64 = 0;
+	stats->tcp_fastopen_rejected.value.ui64 = 0;
+	stats->tcp_fastopen_overflow.value.ui64 = 0;
+	stats->tcp_fastopen_syn_data.value.ui64 = 0;
+	stats->tcp_tls_tx_records.value.ui64 = 0;
+	stats->tcp_tls_tx_fail.value.ui64 = 0;
+	stats->tcp_time_wait_compact.value.ui64 = 0;
+	stats->tcp_time_wait_compact_reuse.value.ui64 = 0;
 
 #ifdef TCP_DEBUG_COUNTER
 	stats->tcp_time_wait.value.ui64 = 0;
@@ -1097,6 +1115,24 @@ tcp_add_stats(tcp_stat_counter_t *from, tcp_stat_t *to)
 	    from->tcp_reclaim_cnt;
 	to->tcp_reass_timeout.value.ui64 +=
 	    from->tcp_reass_timeout;
+	to->tcp_fastopen_cookie_sent.value.ui64 +=
+	    from->tcp_fastopen_cookie_sent;
+	to->tcp_fastopen_accepted.value.ui64 +=
+	    from->tcp_fastopen_accepted;
+	to->tcp_fastopen_rejected.value.ui64 +=
+	    from->tcp_fastopen_rejected;
+	to->tcp_fastopen_overflow.value.ui64 +=
+	    from->tcp_fastopen_overflow;
+	to->tcp_fastopen_syn_data.value.ui64 +=
+	    from->tcp_fastopen_syn_data;
+	to->tcp_tls_tx_records.value.ui64 +=
+	    from->tcp_tls_tx_records;
+	to->tcp_tls_tx_fail.value.ui64 +=
+	    from->tcp_tls_tx_fail;
+	to->tcp_time_wait_compact.value.ui64 +=
+	    from->tcp_time_wait_compact;
+	to->tcp_time_wait_compact_reuse.value.ui64 +=
+	    from->tcp_time_wait_compact_reuse;
 
 #ifdef TCP_DEBUG_COUNTER
 	to->tcp_time_wait.value.ui64 +=
@@ -35,6 +35,7 @@
 #include <sys/squeue_impl.h>
 #include <sys/squeue.h>
 #include <sys/callo.h>
+#include <sys/tsol/tnet.h>
 
 #include <inet/common.h>
 #include <inet/ip.h>
@@ -49,6 +50,20 @@ static void tcp_time_wait_purge(tcp_t *, tcp_squeue_priv_t *);
 
 #define	TW_BUCKET_NEXT(b)	(((b) + 1) % TCP_TIME_WAIT_BUCKETS)
 
+/*
+ * Detached TIME_WAIT connections are kept as compact tcp_tw_t records (see
+ * tcp_impl.h) unless tcp_time_wait_compact_enable is cleared.  The records
+ * of each stack are hashed in tcp_tw_fanout_size buckets, a power of 2.
+ */
+boolean_t	tcp_time_wait_compact_enable = B_TRUE;
+uint_t		tcp_tw_fanout_size = 8192;
+
+static kmem_cache_t *tcp_tw_cache;
+
+/* Same mixing as IPCL_CONN_HASH() */
+#define	TW_HASH(faddr, ports, size)					\
+	((unsigned)(ntohl(V4_PART_OF_V6((faddr))) ^ ((ports) >> 24) ^	\
+	((ports) >> 16) ^ ((ports) >> 8) ^ (ports)) & ((size) - 1))
 
 /*
  * Remove a connection from the list of detached TIME_WAIT connections.
@@ -121,6 +136,177 @@ tcp_time_wait_remove(tcp_t *tcp, tcp_squeue_priv_t *tsp)
 	((x)->tcp_connp->conn_ipversion == IPV6_VERSION && \
 	IN6_IS_ADDR_LOOPBACK(&(x)->tcp_connp->conn_laddr_v6)))
 
+void
+tcp_time_wait_g_init(void)
+{
+	tcp_tw_cache = kmem_cache_create("tcp_tw_cache", sizeof (tcp_tw_t),
+	    0, NULL, NULL, NULL, NULL, NULL, 0);
+}
+
+void
+tcp_time_wait_g_destroy(void)
+{
+	kmem_cache_destroy(tcp_tw_cache);
+}
+
+void
+tcp_time_wait_stack_init(tcp_stack_t *tcps)
+{
+	uint_t	size = tcp_tw_fanout_size;
+	uint_t	i;
+
+	/* Round a bad setting down to a power of 2. */
+	if (size == 0)
+		size = 1;
+	while (!ISP2(size))
+		size &= size - 1;
+
+	tcps->tcps_tw_fanout_size = size;
+	tcps->tcps_tw_fanout = kmem_zalloc(size * sizeof (tcp_tw_fanout_t),
+	    KM_SLEEP);
+	for (i = 0; i < size; i++) {
+		mutex_init(&tcps->tcps_tw_fanout[i].twf_lock, NULL,
+		    MUTEX_DEFAULT, NULL);
+	}
+}
+
+void
+tcp_time_wait_stack_fini(tcp_stack_t *tcps)
+{
+	uint_t	i;
+
+	/* Every record holds the netstack, so they are all gone. */
+	ASSERT(tcps->tcps_tw_count == 0);
+	for (i = 0; i < tcps->tcps_tw_fanout_size; i++) {
+		ASSERT(tcps->tcps_tw_fanout[i].twf_head == NULL);
+		mutex_destroy(&tcps->tcps_tw_fanout[i].twf_lock);
+	}
+	kmem_free(tcps->tcps_tw_fanout,
+	    tcps->tcps_tw_fanout_size * sizeof (tcp_tw_fanout_t));
+	tcps->tcps_tw_fanout = NULL;
+}
+
+/*
+ * Take a compact record off its hash chain.  It stays on the timing wheel
+ * until the collector frees it.
+ */
+static void
+tcp_tw_unhash(tcp_tw_t *tw)
+{
+	tcp_tw_fanout_t	*twf = tw->tw_fanout;
+	tcp_tw_t	**twpp;
+
+	ASSERT(MUTEX_HELD(&twf->twf_lock));
+	ASSERT(tw->tw_flags & TW_HASHED);
+
+	for (twpp = &twf->twf_head; *twpp != tw;
+	    twpp = &(*twpp)->tw_hash_next) {
+		ASSERT(*twpp != NULL);
+	}
+	*twpp = tw->tw_hash_next;
+	tw->tw_hash_next = NULL;
+	tw->tw_flags &= ~TW_HASHED;
+	atomic_dec_uint(&tw->tw_tcps->tcps_tw_count);
+}
+
+/*
+ * Find the compact record for a four-tuple.  If one is found it is returned
+ * with the twf_lock of its bucket held.
+ */
+static tcp_tw_t *
+tcp_tw_lookup(tcp_stack_t *tcps, uint8_t ipversion, const in6_addr_t *laddr,
+    const in6_addr_t *faddr, uint32_t ports)
+{
+	tcp_tw_fanout_t	*twf;
+	tcp_tw_t	*tw;
+
+	twf = &tcps->tcps_tw_fanout[TW_HASH(*faddr, ports,
+	    tcps->tcps_tw_fanout_size)];
+	mutex_enter(&twf->twf_lock);
+	for (tw = twf->twf_head; tw != NULL; tw = tw->tw_hash_next) {
+		if (tw->tw_ports == ports && tw->tw_ipversion == ipversion &&
+		    IN6_ARE_ADDR_EQUAL(&tw->tw_faddr, faddr) &&
+		    IN6_ARE_ADDR_EQUAL(&tw->tw_laddr, laddr))
+			return (tw);
+	}
+	mutex_exit(&twf->twf_lock);
+	return (NULL);
+}
+
+/*
+ * Make and hash a compact record of a TIME_WAIT connection, or return NULL
+ * if it has to stay a tcp_t: whenever the reply to the peer depends on more
+ * than the four-tuple (IPsec, labels, zones, a bound interface or link-local
+ * scope), or clustering wants to hear of the disconnect.
+ */
+static tcp_tw_t *
+tcp_time_wait_compact(tcp_t *tcp)
+{
+	conn_t		*connp = tcp->tcp_connp;
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	tcp_tw_fanout_t	*twf;
+	tcp_tw_t	*tw;
+
+	if (!tcp_time_wait_compact_enable || cl_inet_disconnect != NULL ||
+	    connp->conn_latch != NULL || connp->conn_policy != NULL ||
+	    connp->conn_allzones || connp->conn_mac_mode != CONN_MAC_DEFAULT ||
+	    connp->conn_incoming_ifindex != 0 ||
+	    IN6_IS_ADDR_LINKSCOPE(&connp->conn_faddr_v6) ||
+	    is_system_labeled())
+		return (NULL);
+
+	if ((tw = kmem_cache_alloc(tcp_tw_cache, KM_NOSLEEP)) == NULL)
+		return (NULL);
+
+	tw->tw_next = NULL;
+	tw->tw_tcps = tcps;
+	tw->tw_laddr = connp->conn_laddr_v6;
+	tw->tw_faddr = connp->conn_faddr_v6;
+	tw->tw_ports = connp->conn_ports;
+	tw->tw_snxt = tcp->tcp_snxt;
+	tw->tw_rnxt = tcp->tcp_rnxt;
+	tw->tw_rwnd = tcp->tcp_rwnd;
+	tw->tw_ts_recent = tcp->tcp_ts_recent;
+	tw->tw_last_rcv = tcp->tcp_last_rcv_lbolt;
+	tw->tw_ipversion = connp->conn_ipversion;
+	tw->tw_rcv_ws = tcp->tcp_rcv_ws;
+	tw->tw_flags = TW_HASHED;
+	if (tcp->tcp_snd_ts_ok)
+		tw->tw_flags |= TW_TS_OK;
+	tw->tw_expire = 0;
+	tw->tw_deadline = 0;
+	netstack_hold(tcps->tcps_netstack);
+
+	twf = &tcps->tcps_tw_fanout[TW_HASH(tw->tw_faddr, tw->tw_ports,
+	    tcps->tcps_tw_fanout_size)];
+	tw->tw_fanout = twf;
+	mutex_enter(&twf->twf_lock);
+	tw->tw_hash_next = twf->twf_head;
+	twf->twf_head = tw;
+	mutex_exit(&twf->twf_lock);
+	atomic_inc_uint(&tcps->tcps_tw_count);
+
+	TCP_STAT(tcps, tcp_time_wait_compact);
+	return (tw);
+}
+
+/*
+ * Put a compact record on the squeue's timing wheel to expire at (offset)
+ * time expire.
+ */
+static void
+tcp_time_wait_link_tw(tcp_squeue_priv_t *tsp, tcp_tw_t *tw, int64_t expire)
+{
+	unsigned int	bucket = TW_BUCKET(expire);
+
+	ASSERT(MUTEX_HELD(&tsp->tcp_time_wait_lock));
+
+	tw->tw_expire = expire;
+	tw->tw_next = tsp->tcp_tw_bucket[bucket];
+	tsp->tcp_tw_bucket[bucket] = tw;
+	tsp->tcp_time_wait_cnt++;
+}
+
 
 /*
  * Add a connection to the list of detached TIME_WAIT connections
@@ -135,6 +321,7 @@ tcp_time_wait_append(tcp_t *tcp)
 	    *((tcp_squeue_priv_t **)squeue_getprivate(sqp, SQPRIVATE_TCP));
 	int64_t		now, schedule;
 	unsigned int	bucket;
+	tcp_tw_t	*tw = NULL;
 
 	tcp_timers_stop(tcp);
 
@@ -153,6 +340,8 @@ tcp_time_wait_append(tcp_t *tcp)
 	ASSERT(tcp->tcp_listener == NULL);
 
 	TCP_DBGSTAT(tcps, tcp_time_wait);
+	if (!tcp->tcp_loopback)
+		tw = tcp_time_wait_compact(tcp);
 	mutex_enter(&tsp->tcp_time_wait_lock);
 
 	/*
@@ -198,19 +387,34 @@ tcp_time_wait_append(tcp_t *tcp)
 	 * time_wait_collector interval.
 	 */
 	schedule = now + MSEC_TO_TICK(tcps->tcps_time_wait_interval);
-	tcp->tcp_time_wait_expire = schedule;
 
-	/*
-	 * Append the connection into the appropriate bucket.
-	 */
-	bucket = TW_BUCKET(tcp->tcp_time_wait_expire);
-	tcp->tcp_time_wait_next = tsp->tcp_time_wait_bucket[bucket];
-	tsp->tcp_time_wait_bucket[bucket] = tcp;
-	if (tcp->tcp_time_wait_next != NULL) {
-		ASSERT(tcp->tcp_time_wait_next->tcp_time_wait_prev == NULL);
-		tcp->tcp_time_wait_next->tcp_time_wait_prev = tcp;
+	if (tw != NULL) {
+		/*
+		 * The record answers for the connection from now on, so the
+		 * tcp_t can go at once, much as a loopback one does above.
+		 * While tcp_time_wait_purge() may drop tcp_time_wait_lock,
+		 * the count taken by the record keeps the timer state below
+		 * from being reset underneath us.
+		 */
+		tw->tw_deadline = schedule + tsp->tcp_time_wait_offset;
+		tcp_time_wait_link_tw(tsp, tw, schedule);
+		tcp_time_wait_purge(tcp, tsp);
+	} else {
+		tcp->tcp_time_wait_expire = schedule;
+
+		/*
+		 * Append the connection into the appropriate bucket.
+		 */
+		bucket = TW_BUCKET(tcp->tcp_time_wait_expire);
+		tcp->tcp_time_wait_next = tsp->tcp_time_wait_bucket[bucket];
+		tsp->tcp_time_wait_bucket[bucket] = tcp;
+		if (tcp->tcp_time_wait_next != NULL) {
+			ASSERT(tcp->tcp_time_wait_next->tcp_time_wait_prev ==
+			    NULL);
+			tcp->tcp_time_wait_next->tcp_time_wait_prev = tcp;
+		}
+		tsp->tcp_time_wait_cnt++;
 	}
-	tsp->tcp_time_wait_cnt++;
 
 	/*
 	 * Round delay up to the nearest bucket boundary.
@@ -318,9 +522,11 @@ tcp_time_wait_purge(tcp_t *tcp, tcp_squeue_priv_t *tsp)
 	 * and after dropping all locks
 	 *
 	 * See the comments in tcp_closei_local for additional information
-	 * regarding the refcnt logic.
+	 * regarding the refcnt logic.  A reference held by a squeue's
+	 * connection cache is dropped first; it does not count against this.
 	 */
 	if (mutex_tryenter(lock)) {
+		ipcl_conn_cache_purge(connp);
 		mutex_enter(&connp->conn_lock);
 		if (connp->conn_ref == 2 && cl_inet_disconnect == NULL) {
 			ipcl_hash_remove_locked(connp, connp->conn_fanout);
@@ -401,6 +607,8 @@ void
 tcp_time_wait_collector(void *arg)
 {
 	tcp_t *tcp;
+	tcp_tw_t *tw, **twp;
+	tcp_tw_fanout_t *twf;
 	int64_t now, sched_active, sched_cur, sched_new;
 	unsigned int idx;
 
@@ -512,6 +720,37 @@ retry:
 		tcp = tsp->tcp_time_wait_bucket[idx];
 	}
 
+	/*
+	 * Then the compact records.  These do not drop tcp_time_wait_lock,
+	 * but a duplicate FIN may have pushed their deadline out, and so they
+	 * are not kept in expiry order; walk the whole bucket.
+	 */
+	twp = &tsp->tcp_tw_bucket[idx];
+	while ((tw = *twp) != NULL) {
+		if (now < tw->tw_expire) {
+			twp = &tw->tw_next;
+			continue;
+		}
+		*twp = tw->tw_next;
+		tsp->tcp_time_wait_cnt--;
+
+		twf = tw->tw_fanout;
+		mutex_enter(&twf->twf_lock);
+		if ((tw->tw_flags & TW_HASHED) &&
+		    ddi_get_lbolt64() < tw->tw_deadline) {
+			mutex_exit(&twf->twf_lock);
+			tcp_time_wait_link_tw(tsp, tw,
+			    tw->tw_deadline - tsp->tcp_time_wait_offset);
+			continue;
+		}
+		if (tw->tw_flags & TW_HASHED)
+			tcp_tw_unhash(tw);
+		mutex_exit(&twf->twf_lock);
+
+		netstack_rele(tw->tw_tcps->tcps_netstack);
+		kmem_cache_free(tcp_tw_cache, tw);
+	}
+
 	if (tsp->tcp_time_wait_cnt == 0) {
 		/*
 		 * There is not a need for the collector to schedule a new
@@ -535,14 +774,16 @@ retry:
 		 */
 		sched_new = sched_cur + MSEC_TO_TICK(TCP_TIME_WAIT_DELAY);
 		nidx = TW_BUCKET_NEXT(idx);
-		while (tsp->tcp_time_wait_bucket[nidx] == NULL) {
+		while (tsp->tcp_time_wait_bucket[nidx] == NULL &&
+		    tsp->tcp_tw_bucket[nidx] == NULL) {
 			if (nidx == idx) {
 				break;
 			}
 			nidx = TW_BUCKET_NEXT(nidx);
 			sched_new += MSEC_TO_TICK(TCP_TIME_WAIT_DELAY);
 		}
-		ASSERT(tsp->tcp_time_wait_bucket[nidx] != NULL);
+		ASSERT(tsp->tcp_time_wait_bucket[nidx] != NULL ||
+		    tsp->tcp_tw_bucket[nidx] != NULL);
 	}
 
 	/*
@@ -587,6 +828,67 @@ retry:
 	mutex_exit(&tsp->tcp_time_wait_lock);
 }
 
+/*
+ * Make sure that when we accept a new incarnation of a connection in
+ * TIME_WAIT state, we pick an ISS greater than (snxt + tcp_iss_incr/2) for
+ * the old one.
+ *
+ * The next ISS generated is equal to tcp_iss_incr_extra + tcp_iss_incr/2 +
+ * other components depending on the value of tcp_strong_iss.  We
+ * pre-calculate the new ISS here and compare with snxt to determine if we
+ * need to make adjustment to tcp_iss_incr_extra.
+ *
+ * The above calculation is ugly and is a waste of CPU cycles...
+ */
+static void
+tcp_time_wait_iss(tcp_stack_t *tcps, uint32_t ports, const in6_addr_t *laddr,
+    const in6_addr_t *faddr, uint32_t snxt)
+{
+	uint32_t new_iss = tcps->tcps_iss_incr_extra;
+	int32_t adj;
+
+	switch (tcps->tcps_strong_iss) {
+	case 2: {
+		/* Add time and MD5 components. */
+		uint32_t answer[4];
+		struct {
+			uint32_t ports;
+			in6_addr_t src;
+			in6_addr_t dst;
+		} arg;
+		MD5_CTX context;
+
+		mutex_enter(&tcps->tcps_iss_key_lock);
+		context = tcps->tcps_iss_key;
+		mutex_exit(&tcps->tcps_iss_key_lock);
+		arg.ports = ports;
+		/* We use MAPPED addresses in tcp_iss_init */
+		arg.src = *laddr;
+		arg.dst = *faddr;
+		MD5Update(&context, (uchar_t *)&arg, sizeof (arg));
+		MD5Final((uchar_t *)answer, &context);
+		answer[0] ^= answer[1] ^ answer[2] ^ answer[3];
+		new_iss += (gethrtime() >> ISS_NSEC_SHT) + answer[0];
+		break;
+	}
+	case 1:
+		/* Add time component and min random (i.e. 1). */
+		new_iss += (gethrtime() >> ISS_NSEC_SHT) + 1;
+		break;
+	default:
+		/* Add only time component. */
+		new_iss += (uint32_t)gethrestime_sec() * tcps->tcps_iss_incr;
+		break;
+	}
+	if ((adj = (int32_t)(snxt - new_iss)) > 0) {
+		/*
+		 * New ISS not guaranteed to be tcp_iss_incr/2 ahead of the
+		 * current snxt, so add the difference to tcp_iss_incr_extra.
+		 */
+		tcps->tcps_iss_incr_extra += adj;
+	}
+}
+
 /*
  * tcp_time_wait_processing() handles processing of incoming packets when
  * the tcp_t is in the TIME_WAIT state.
@@ -678,67 +980,11 @@ tcp_time_wait_processing(tcp_t *tcp, mblk_t *mp, uint32_t seg_seq,
 	}
 
 	if ((flags & TH_SYN) && gap > 0 && rgap < 0) {
-		/*
-		 * Make sure that when we accept the connection, pick
-		 * an ISS greater than (tcp_snxt + tcp_iss_incr/2) for the
-		 * old connection.
-		 *
-		 * The next ISS generated is equal to tcp_iss_incr_extra
-		 * + tcp_iss_incr/2 + other components depending on the
-		 * value of tcp_strong_iss.  We pre-calculate the new
-		 * ISS here and compare with tcp_snxt to determine if
-		 * we need to make adjustment to tcp_iss_incr_extra.
-		 *
-		 * The above calculation is ugly and is a
-		 * waste of CPU cycles...
-		 */
-		uint32_t new_iss = tcps->tcps_iss_incr_extra;
-		int32_t adj;
 		ip_stack_t *ipst = tcps->tcps_netstack->netstack_ip;
 
-		switch (tcps->tcps_strong_iss) {
-		case 2: {
-			/* Add time and MD5 components. */
-			uint32_t answer[4];
-			struct {
-				uint32_t ports;
-				in6_addr_t src;
-				in6_addr_t dst;
-			} arg;
-			MD5_CTX context;
-
-			mutex_enter(&tcps->tcps_iss_key_lock);
-			context = tcps->tcps_iss_key;
-			mutex_exit(&tcps->tcps_iss_key_lock);
-			arg.ports = connp->conn_ports;
-			/* We use MAPPED addresses in tcp_iss_init */
-			arg.src = connp->conn_laddr_v6;
-			arg.dst = connp->conn_faddr_v6;
-			MD5Update(&context, (uchar_t *)&arg,
-			    sizeof (arg));
-			MD5Final((uchar_t *)answer, &context);
-			answer[0] ^= answer[1] ^ answer[2] ^ answer[3];
-			new_iss += (gethrtime() >> ISS_NSEC_SHT) + answer[0];
-			break;
-		}
-		case 1:
-			/* Add time component and min random (i.e. 1). */
-			new_iss += (gethrtime() >> ISS_NSEC_SHT) + 1;
-			break;
-		default:
-			/* Add only time component. */
-			new_iss += (uint32_t)gethrestime_sec() *
-			    tcps->tcps_iss_incr;
-			break;
-		}
-		if ((adj = (int32_t)(tcp->tcp_snxt - new_iss)) > 0) {
-			/*
-			 * New ISS not guaranteed to be tcp_iss_incr/2
-			 * ahead of the current tcp_snxt, so add the
-			 * difference to tcp_iss_incr_extra.
-			 */
-			tcps->tcps_iss_incr_extra += adj;
-		}
+		tcp_time_wait_iss(tcps, connp->conn_ports,
+		    &connp->conn_laddr_v6, &connp->conn_faddr_v6,
+		    tcp->tcp_snxt);
 		/*
 		 * If tcp_clean_death() can not perform the task now,
 		 * drop the SYN packet and let the other side re-xmit.
@@ -832,3 +1078,229 @@ process_ack:
 done:
 	freemsg(mp);
 }
+
+/*
+ * tcp_time_wait_input() is tcp_time_wait_processing() for connections in
+ * compact TIME_WAIT state.  It is called for segments that matched no
+ * conn_t, before they are given to a listener or reset.  Nothing is ever
+ * delivered, and replies are sent with no tcp_t.  Returns B_TRUE if mp was
+ * consumed, or B_FALSE if the caller should go on with it as before: there
+ * was no record, or it is a SYN starting a new incarnation and the old
+ * record has been retired.
+ */
+boolean_t
+tcp_time_wait_input(mblk_t *mp, ip_recv_attr_t *ira, ip_stack_t *ipst)
+{
+	tcp_stack_t	*tcps = ipst->ips_netstack->netstack_tcp;
+	uint_t		ip_hdr_len = ira->ira_ip_hdr_length;
+	uint8_t		ipversion = IPH_HDR_VERSION(mp->b_rptr);
+	tcpha_t		*tcpha = (tcpha_t *)&mp->b_rptr[ip_hdr_len];
+	tcp_tw_fanout_t	*twf;
+	tcp_tw_t	*tw;
+	tcp_opt_t	tcpopt;
+	in6_addr_t	laddr, faddr;
+	uint32_t	seg_seq, seg_ack, seq, ack, tsecr;
+	int32_t		gap, rgap;
+	int		seg_len;
+	uint_t		flags;
+	int		ctl;
+	uint16_t	win;
+	boolean_t	ts_ok, keepalive;
+	int64_t		now;
+
+	if (tcps->tcps_tw_count == 0)
+		return (B_FALSE);
+
+	if (ipversion == IPV4_VERSION) {
+		ipha_t *ipha = (ipha_t *)mp->b_rptr;
+
+		IN6_IPADDR_TO_V4MAPPED(ipha->ipha_dst, &laddr);
+		IN6_IPADDR_TO_V4MAPPED(ipha->ipha_src, &faddr);
+	} else {
+		ip6_t *ip6h = (ip6_t *)mp->b_rptr;
+
+		laddr = ip6h->ip6_dst;
+		faddr = ip6h->ip6_src;
+	}
+	tw = tcp_tw_lookup(tcps, ipversion, &laddr, &faddr,
+	    *(uint32_t *)&tcpha->tha_lport);
+	if (tw == NULL)
+		return (B_FALSE);
+	twf = tw->tw_fanout;
+
+	TCPS_BUMP_MIB(tcps, tcpHCInSegs);
+	DTRACE_PROBE2(tcp__trace__recv, mblk_t *, mp, tcp_tw_t *, tw);
+
+	now = ddi_get_lbolt64();
+	flags = (unsigned int)tcpha->tha_flags & 0xFF;
+	seg_seq = ntohl(tcpha->tha_seq);
+	seg_ack = ntohl(tcpha->tha_ack);
+	seg_len = msgdsize(mp) - ip_hdr_len - TCP_HDR_LENGTH(tcpha);
+
+	keepalive = (seg_len == 0 || seg_len == 1) &&
+	    (seg_seq + 1 == tw->tw_rnxt);
+	if ((tw->tw_flags & TW_TS_OK) && !(flags & TH_RST) && !keepalive) {
+		tcpopt.tcp = NULL;
+		if (!(tcp_parse_options(tcpha, &tcpopt) &
+		    TCP_OPT_TSTAMP_PRESENT)) {
+			goto drop;
+		}
+		if (TSTMP_LT(tcpopt.tcp_opt_ts_val, tw->tw_ts_recent)) {
+			/* As tcp_paws_check() */
+			if (now < tw->tw_last_rcv + PAWS_TIMEOUT)
+				goto ack;
+			tw->tw_ts_recent = tcpopt.tcp_opt_ts_val;
+		}
+	}
+	gap = seg_seq - tw->tw_rnxt;
+	rgap = tw->tw_rwnd - (gap + seg_len);
+	if (gap < 0) {
+		TCPS_BUMP_MIB(tcps, tcpInDataDupSegs);
+		TCPS_UPDATE_MIB(tcps, tcpInDataDupBytes,
+		    (seg_len > -gap ? -gap : seg_len));
+		seg_len += gap;
+		if (seg_len < 0 || (seg_len == 0 && !(flags & TH_FIN))) {
+			if (flags & TH_RST)
+				goto drop;
+			if ((flags & TH_FIN) && seg_len == -1) {
+				/*
+				 * A duplicate FIN restarts the 2 MSL timer.
+				 * The collector requeues the record when it
+				 * comes across it.
+				 */
+				tw->tw_deadline = now +
+				    MSEC_TO_TICK(tcps->tcps_time_wait_interval);
+				TCP_DBGSTAT(tcps, tcp_rput_time_wait);
+			}
+			goto ack;
+		}
+		/* Fix seg_seq, and chew the gap off the front. */
+		seg_seq = tw->tw_rnxt;
+	}
+
+	if ((flags & TH_SYN) && gap > 0 && rgap < 0) {
+		/*
+		 * A new incarnation: retire the record and let the caller
+		 * give the SYN to the listener.
+		 */
+		tcp_time_wait_iss(tcps, tw->tw_ports, &tw->tw_laddr,
+		    &tw->tw_faddr, tw->tw_snxt);
+		tcp_tw_unhash(tw);
+		mutex_exit(&twf->twf_lock);
+		TCP_STAT(tcps, tcp_time_wait_syn_success);
+		TCP_STAT(tcps, tcp_time_wait_compact_reuse);
+		return (B_FALSE);
+	}
+
+	if (rgap < 0) {
+		TCPS_BUMP_MIB(tcps, tcpInDataPastWinSegs);
+		TCPS_UPDATE_MIB(tcps, tcpInDataPastWinBytes, -rgap);
+		/* Fix seg_len and make sure there is something left. */
+		seg_len += rgap;
+		if (seg_len <= 0) {
+			if (flags & TH_RST)
+				goto drop;
+			goto ack;
+		}
+	}
+	/* As tcp_time_wait_processing(); tcp_rack is tcp_rnxt here. */
+	if ((tw->tw_flags & TW_TS_OK) && !(flags & TH_RST) &&
+	    TSTMP_GEQ(tcpopt.tcp_opt_ts_val, tw->tw_ts_recent) &&
+	    SEQ_LEQ(seg_seq, tw->tw_rnxt)) {
+		tw->tw_ts_recent = tcpopt.tcp_opt_ts_val;
+		tw->tw_last_rcv = now;
+	}
+
+	if (seg_seq != tw->tw_rnxt && seg_len > 0) {
+		/* Always ack out of order packets */
+		goto ack;
+	} else if (seg_len > 0) {
+		TCPS_BUMP_MIB(tcps, tcpInClosed);
+		TCPS_BUMP_MIB(tcps, tcpInDataInorderSegs);
+		TCPS_UPDATE_MIB(tcps, tcpInDataInorderBytes, seg_len);
+	}
+	if (flags & TH_RST) {
+		tcp_tw_unhash(tw);
+		goto drop;
+	}
+	if (flags & TH_SYN) {
+		/* Refer to RFC 1122, 4.2.2.13. */
+		seq = seg_ack;
+		ack = seg_seq + 1;
+		ctl = TH_RST | TH_ACK;
+		goto reply;
+	}
+	/* Acks something not sent */
+	if ((flags & TH_ACK) && SEQ_GT(seg_ack, tw->tw_snxt))
+		goto ack;
+drop:
+	mutex_exit(&twf->twf_lock);
+	freemsg(mp);
+	return (B_TRUE);
+
+ack:
+	seq = tw->tw_snxt;
+	ack = tw->tw_rnxt;
+	ctl = TH_ACK;
+reply:
+	win = (uint16_t)MIN(tw->tw_rwnd >> tw->tw_rcv_ws, TCP_MAXWIN);
+	ts_ok = (tw->tw_flags & TW_TS_OK) != 0;
+	tsecr = tw->tw_ts_recent;
+	mutex_exit(&twf->twf_lock);
+
+	tcp_xmit_reply(NULL, mp, seq, ack, ctl, win, ts_ok ? &tsecr : NULL,
+	    ira, ipst, NULL);
+	return (B_TRUE);
+}
+
+/*
+ * The port of a connection in compact TIME_WAIT state is not in the bind
+ * hash, so an active open can pick the four-tuple of such a connection.
+ * This is called once the four-tuple is known.  As for a SYN arriving for
+ * the connection, the record can be taken over only when the new sequence
+ * space cannot be confused with the old: here that takes timestamps, so
+ * that PAWS will reject old duplicates, and a peer quiet for a second.
+ * Returns B_FALSE if the connection must not be made.
+ */
+boolean_t
+tcp_time_wait_reuse(conn_t *connp)
+{
+	tcp_t		*tcp = connp->conn_tcp;
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	tcp_tw_t	*tw;
+	int32_t		adj;
+
+	if (tcps->tcps_tw_count == 0)
+		return (B_TRUE);
+
+	tw = tcp_tw_lookup(tcps, connp->conn_ipversion, &connp->conn_laddr_v6,
+	    &connp->conn_faddr_v6, connp->conn_ports);
+	if (tw == NULL)
+		return (B_TRUE);
+
+	if (!(tw->tw_flags & TW_TS_OK) ||
+	    ddi_get_lbolt64() - tw->tw_last_rcv < SEC_TO_TICK(1)) {
+		mutex_exit(&tw->tw_fanout->twf_lock);
+		return (B_FALSE);
+	}
+
+	/*
+	 * The ISS was set by tcp_set_destination(); move it clear of the
+	 * old sequence space, as tcp_time_wait_iss() would have.
+	 */
+	adj = (int32_t)(tw->tw_snxt + (tcps->tcps_iss_incr >> 1) -
+	    tcp->tcp_iss);
+	if (adj > 0) {
+		tcp->tcp_iss += adj;
+		tcp->tcp_fss = tcp->tcp_iss - 1;
+		tcp->tcp_suna = tcp->tcp_iss;
+		tcp->tcp_snxt = tcp->tcp_iss + 1;
+		tcp->tcp_rexmit_nxt = tcp->tcp_snxt;
+		tcp->tcp_csuna = tcp->tcp_snxt;
+	}
+	tcp_tw_unhash(tw);
+	mutex_exit(&tw->tw_fanout->twf_lock);
+
+	TCP_STAT(tcps, tcp_time_wait_compact_reuse);
+	return (B_TRUE);
+}
@@ -395,6 +395,11 @@ tcp_timers_stop(tcp_t *tcp)
 		(void) TCP_TIMER_CANCEL(tcp, tcp->tcp_reass_tid);
 		tcp->tcp_reass_tid = 0;
 	}
+	if (SQTIMER_PENDING(&tcp->tcp_pace_sqt)) {
+		squeue_timer_cancel(tcp->tcp_connp->conn_sqp,
+		    &tcp->tcp_pace_sqt);
+		CONN_DEC_REF(tcp->tcp_connp);
+	}
 }
 
 /*
@@ -531,6 +536,26 @@ tcp_reass_timer(void *arg)
 	TCP_STAT(tcp->tcp_tcps, tcp_reass_timeout);
 }
 
+/*
+ * This function handles the pacing timeout: the pacing rate now allows more
+ * of the unsent data to go out.  Unlike the other TCP timers it is an squeue
+ * timer set by tcp_pace_schedule(), and it drops the reference that took.
+ */
+void
+tcp_pace_timer(squeue_t *sqp, void *arg)
+{
+	conn_t	*connp = (conn_t *)arg;
+	tcp_t	*tcp = connp->conn_tcp;
+
+	ASSERT(sqp == connp->conn_sqp);
+
+	connp->conn_on_sqp = B_TRUE;
+	if (tcp->tcp_unsent > 0 && tcp->tcp_state >= TCPS_ESTABLISHED)
+		tcp_wput_data(tcp, NULL, B_FALSE);
+	connp->conn_on_sqp = B_FALSE;
+	CONN_DEC_REF(connp);
+}
+
 /* This function handles the push timeout. */
 void
 tcp_push_timer(void *arg)
@@ -666,6 +691,13 @@ tcp_timer(void *arg)
 	case TCPS_SYN_RCVD: {
 		tcp_t	*listener = tcp->tcp_listener;
 
+		/*
+		 * A Fast Open eager is already on the listener's accept
+		 * queue and must not be made droppable.
+		 */
+		if (tcp->tcp_fastopen_eager)
+			listener = NULL;
+
 		if (tcp->tcp_syn_rcvd_timeout == 0 && (listener != NULL)) {
 			/* it's our first timeout */
 			tcp->tcp_syn_rcvd_timeout = 1;
@@ -1020,6 +1052,17 @@ timer_rexmit:
 	if (mss > tcp->tcp_swnd && tcp->tcp_swnd != 0)
 		mss = tcp->tcp_swnd;
 
+	/*
+	 * A SYN or SYN-ACK is retransmitted without data.  The data of a
+	 * Fast Open SYN goes back on the unsent list, to be sent once the
+	 * connection is established.
+	 */
+	if (tcp->tcp_state < TCPS_ESTABLISHED) {
+		if (tcp->tcp_fastopen_syn_data)
+			tcp_fastopen_rewind(tcp);
+		mss = 0;
+	}
+
 	if ((mp = tcp->tcp_xmit_head) != NULL) {
 		mp->b_prev = (mblk_t *)(intptr_t)gethrtime();
 	}
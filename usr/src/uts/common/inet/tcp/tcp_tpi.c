@@ -721,7 +721,7 @@ tcp_tpi_connect(tcp_t *tcp, mblk_t *mp)
 	}
 
 	/* call the non-TPI version */
-	error = tcp_do_connect(tcp->tcp_connp, sa, len, cr, cpid);
+	error = tcp_do_connect(tcp->tcp_connp, sa, len, cr, cpid, NULL);
 	if (error < 0) {
 		mp = mi_tpi_err_ack_alloc(mp, -error, 0);
 	} else if (error > 0) {
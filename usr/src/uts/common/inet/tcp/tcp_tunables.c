@@ -604,6 +604,10 @@ mod_prop_info_t tcp_propinfo_tbl[] = {
 	{ "_abc_l_var", MOD_PROTO_TCP,
 	    mod_set_uint32, mod_get_uint32, {1, UINT32_MAX, 2}, {2} },
 
+	/* RFC 7413 - TCP Fast Open; 1 enables the client, 2 the server */
+	{ "_fastopen", MOD_PROTO_TCP,
+	    mod_set_uint32, mod_get_uint32, {0, 3, 1}, {1} },
+
 	{ "?", MOD_PROTO_TCP, NULL, mod_get_allprop, {0}, {0} },
 
 	{ NULL, 0, NULL, NULL, {0}, {0} }
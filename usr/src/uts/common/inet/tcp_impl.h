@@ -43,6 +43,7 @@ extern "C" {
 
 #include <sys/cpuvar.h>
 #include <sys/clock_impl.h>	/* For LBOLT_FASTPATH{,64} */
+#include <sys/crypto/api.h>
 #include <inet/optcom.h>
 #include <inet/tcp.h>
 #include <inet/tunables.h>
@@ -92,6 +93,10 @@ extern sock_downcalls_t sock_tcp_downcalls;
 #define	TCPOPT_MAX_SACK_LEN	36
 #define	TCPOPT_HEADER_LEN	2
 
+/* Values for the _fastopen tunable, a bitmask. */
+#define	TCP_FASTOPEN_CLIENT	0x1
+#define	TCP_FASTOPEN_SERVER	0x2
+
 /* Round up the value to the nearest mss. */
 #define	MSS_ROUNDUP(value, mss)		((((value) - 1) / (mss) + 1) * (mss))
 
@@ -105,6 +110,12 @@ extern sock_downcalls_t sock_tcp_downcalls;
  */
 #define	TCP_IS_DETACHED(tcp)	((tcp)->tcp_detached)
 
+/*
+ * Are this tcp's transmissions paced?
+ */
+#define	TCP_IS_PACED(tcp)	\
+	((tcp)->tcp_pacing_rate != 0 || (tcp)->tcp_max_pacing_rate != 0)
+
 /* TCP timers related data structures.  Refer to tcp_timers.c. */
 typedef struct tcp_timer_s {
 	conn_t	*connp;
@@ -194,7 +205,46 @@ extern kmem_cache_t *tcp_timercache;
  * with the tcp_stack_t and conn_netstack.  Any tcp_t connections stored in the
  * tcp_free_list are disassociated and have NULL tcp_tcps and conn_netstack
  * pointers.
- */
+ *
+ * Most detached connections do not stay on the wheel as a tcp_t at all.
+ * tcp_time_wait_append() replaces them with a compact tcp_tw_t, which keeps
+ * only what is needed to answer the peer, and releases the tcp_t and its
+ * conn_t.  A tcp_tw_t is on two lists: a per-stack hash (tcps_tw_fanout,
+ * under twf_lock) so that tcp_time_wait_input() can find it, and its
+ * squeue's tcp_tw_bucket wheel (under tcp_time_wait_lock) so that it
+ * expires.  Retiring one early (for a RST, or a new incarnation) just takes
+ * it off the hash; only the collector takes it off the wheel and frees it.
+ * Each holds a reference on its netstack.  Lock order is
+ * tcp_time_wait_lock, then twf_lock.
+ */
+typedef struct tcp_tw_s {
+	struct tcp_tw_s	*tw_hash_next;	/* on tw_fanout's chain */
+	struct tcp_tw_s	*tw_next;	/* on the timing wheel */
+	struct tcp_tw_fanout_s *tw_fanout; /* our hash bucket */
+	tcp_stack_t	*tw_tcps;
+	in6_addr_t	tw_laddr;
+	in6_addr_t	tw_faddr;
+	uint32_t	tw_ports;	/* as conn_ports */
+	uint32_t	tw_snxt;
+	uint32_t	tw_rnxt;
+	uint32_t	tw_rwnd;
+	uint32_t	tw_ts_recent;
+	uint8_t		tw_ipversion;
+	uint8_t		tw_rcv_ws;
+	uint8_t		tw_flags;
+	int64_t		tw_expire;	/* as tcp_time_wait_expire */
+	int64_t		tw_deadline;	/* lbolt64 before which it must stay */
+	int64_t		tw_last_rcv;	/* lbolt64 tw_ts_recent was updated */
+} tcp_tw_t;
+
+#define	TW_HASHED	0x01		/* on tw_fanout */
+#define	TW_TS_OK	0x02		/* timestamps were negotiated */
+
+typedef struct tcp_tw_fanout_s {
+	tcp_tw_t	*twf_head;
+	kmutex_t	twf_lock;
+} tcp_tw_fanout_t;
+
 typedef struct tcp_squeue_priv_s {
 	kmutex_t	tcp_time_wait_lock;
 	boolean_t	tcp_time_wait_collector_active;
@@ -203,10 +253,36 @@ typedef struct tcp_squeue_priv_s {
 	int64_t		tcp_time_wait_schedule;
 	int64_t		tcp_time_wait_offset;
 	tcp_t		*tcp_time_wait_bucket[TCP_TIME_WAIT_BUCKETS];
+	tcp_tw_t	*tcp_tw_bucket[TCP_TIME_WAIT_BUCKETS];
 	tcp_t		*tcp_free_list;
 	uint_t		tcp_free_list_cnt;
 } tcp_squeue_priv_t;
 
+/*
+ * TCP_TLS_TX record layer state; see tcp_tls_encrypt().  ttx_lock orders
+ * record production against entry into the squeue.
+ */
+#define	TLS_HDR_LEN		5	/* type, version, length */
+#define	TLS_AEAD_TAG_LEN	16
+#define	TLS_AEAD_SALT_LEN	4
+#define	TLS_AEAD_IV_LEN		8
+#define	TLS_AEAD_NONCE_LEN	(TLS_AEAD_SALT_LEN + TLS_AEAD_IV_LEN)
+#define	TLS_1_2_AAD_LEN		13
+#define	TLS_MAX_PLAINTEXT	16384
+#define	TLS_RT_APPLICATION_DATA	23
+
+typedef struct tcp_tls_tx_s {
+	kmutex_t		ttx_lock;
+	uint16_t		ttx_version;
+	crypto_mechanism_t	ttx_mech;
+	crypto_key_t		ttx_key;
+	crypto_ctx_template_t	ttx_tmpl;
+	uint8_t			ttx_keybuf[32];
+	uint8_t			ttx_salt[TLS_AEAD_SALT_LEN];
+	uint8_t			ttx_iv[TLS_AEAD_IV_LEN];
+	uint64_t		ttx_seq;
+} tcp_tls_tx_t;
+
 /*
  * Parameters for TCP Initial Send Sequence number (ISS) generation.  When
  * tcp_strong_iss is set to 1, which is the default, the ISS is calculated
@@ -235,6 +311,11 @@ typedef struct tcp_squeue_priv_s {
 #define	TSTMP_GEQ(a, b)	((int32_t)((a)-(b)) >= 0)
 #define	TSTMP_LT(a, b)	((int32_t)((a)-(b)) < 0)
 
+/*
+ *  PAWS needs a timer for 24 days.  This is the number of ticks in 24 days
+ */
+#define	PAWS_TIMEOUT	((clock_t)(24*24*60*60*hz))
+
 /*
  * Initialize cwnd according to RFC 3390.  def_max_init_cwnd is
  * either tcp_slow_start_initial or tcp_slow_start_after idle
@@ -307,6 +388,8 @@ typedef struct tcp_opt_s {
 	uint32_t	tcp_opt_wscale;
 	uint32_t	tcp_opt_ts_val;
 	uint32_t	tcp_opt_ts_ecr;
+	uint32_t	tcp_opt_fo_cookie_len;
+	uint8_t		tcp_opt_fo_cookie[TCP_FASTOPEN_COOKIE_MAX];
 	tcp_t		*tcp;
 } tcp_opt_t;
 
@@ -318,6 +401,7 @@ typedef struct tcp_opt_s {
 #define	TCP_OPT_TSTAMP_PRESENT	4
 #define	TCP_OPT_SACK_OK_PRESENT	8
 #define	TCP_OPT_SACK_PRESENT	16
+#define	TCP_OPT_FASTOPEN_PRESENT 32
 
 /*
  * Write-side flow-control is implemented via the per instance STREAMS
@@ -580,6 +664,7 @@ extern uint32_t tcp_early_abort;
 #define	tcps_iss_incr			tcps_propinfo_tbl[65].prop_cur_uval
 #define	tcps_abc			tcps_propinfo_tbl[67].prop_cur_bval
 #define	tcps_abc_l_var			tcps_propinfo_tbl[68].prop_cur_uval
+#define	tcps_fastopen			tcps_propinfo_tbl[69].prop_cur_uval
 
 
 /*
@@ -675,7 +760,7 @@ extern char	*tcp_display(tcp_t *, char *, char);
 extern int	tcp_do_bind(conn_t *, struct sockaddr *, socklen_t, cred_t *,
 		    boolean_t);
 extern int	tcp_do_connect(conn_t *, const struct sockaddr *, socklen_t,
-		    cred_t *, pid_t);
+		    cred_t *, pid_t, mblk_t *);
 extern int	tcp_do_listen(conn_t *, struct sockaddr *, socklen_t, int,
 		    cred_t *, boolean_t);
 extern int	tcp_do_unbind(conn_t *);
@@ -683,6 +768,7 @@ extern boolean_t	tcp_eager_blowoff(tcp_t *, t_scalar_t);
 extern void	tcp_eager_cleanup(tcp_t *, boolean_t);
 extern void	tcp_eager_kill(void *, mblk_t *, void *, ip_recv_attr_t *);
 extern void	tcp_eager_unlink(tcp_t *);
+extern void	tcp_fastopen_cookie(tcp_t *, uint8_t *);
 extern void	tcp_init_values(tcp_t *, tcp_t *);
 extern void	tcp_ipsec_cleanup(tcp_t *);
 extern int	tcp_maxpsz_set(tcp_t *, boolean_t);
@@ -733,9 +819,14 @@ extern void	tcp_iss_key_init(uint8_t *, int, tcp_stack_t *);
  * Output related functions in tcp_output.c.
  */
 extern void	tcp_close_output(void *, mblk_t *, void *, ip_recv_attr_t *);
+extern void	tcp_fastopen_rewind(tcp_t *);
+extern mblk_t	*tcp_fastopen_syn(tcp_t *, mblk_t *, int32_t);
 extern void	tcp_output(void *, mblk_t *, void *, ip_recv_attr_t *);
 extern void	tcp_output_urgent(void *, mblk_t *, void *, ip_recv_attr_t *);
 extern void	tcp_rexmit_after_error(tcp_t *);
+extern mblk_t	*tcp_tls_encrypt(tcp_t *, mblk_t *, uint8_t, int *);
+extern void	tcp_tls_tx_free(tcp_t *);
+extern int	tcp_tls_tx_set(tcp_t *, const struct tcp_tls_crypto_info *);
 extern void	tcp_sack_rexmit(tcp_t *, uint_t *);
 extern void	tcp_send_data(tcp_t *, mblk_t *);
 extern void	tcp_send_synack(void *, mblk_t *, void *, ip_recv_attr_t *);
@@ -749,6 +840,9 @@ extern int	tcp_wput_fallback(queue_t *, mblk_t *);
 extern void	tcp_xmit_ctl(char *, tcp_t *, uint32_t, uint32_t, int);
 extern void	tcp_xmit_listeners_reset(mblk_t *, ip_recv_attr_t *,
 		    ip_stack_t *i, conn_t *);
+extern void	tcp_xmit_reply(char *, mblk_t *, uint32_t, uint32_t, int,
+		    uint16_t, uint32_t *, ip_recv_attr_t *, ip_stack_t *,
+		    conn_t *);
 extern mblk_t	*tcp_xmit_mp(tcp_t *, mblk_t *, int32_t, int32_t *,
 		    mblk_t **, uint32_t, boolean_t, uint32_t *, boolean_t);
 
@@ -780,6 +874,7 @@ extern boolean_t tcp_newconn_notify(tcp_t *, ip_recv_attr_t *);
 extern void	tcp_ack_timer(void *);
 extern void	tcp_close_linger_timeout(void *);
 extern void	tcp_keepalive_timer(void *);
+extern void	tcp_pace_timer(squeue_t *, void *);
 extern void	tcp_push_timer(void *);
 extern void	tcp_reass_timer(void *);
 extern mblk_t	*tcp_timermp_alloc(int);
@@ -827,9 +922,16 @@ extern int	tcp_opt_set(conn_t *, uint_t, int, int, uint_t, uchar_t *,
  */
 extern void		tcp_time_wait_append(tcp_t *);
 extern void		tcp_time_wait_collector(void *);
+extern void		tcp_time_wait_g_destroy(void);
+extern void		tcp_time_wait_g_init(void);
+extern boolean_t	tcp_time_wait_input(mblk_t *, ip_recv_attr_t *,
+			    ip_stack_t *);
 extern boolean_t	tcp_time_wait_remove(tcp_t *, tcp_squeue_priv_t *);
+extern boolean_t	tcp_time_wait_reuse(conn_t *);
 extern void		tcp_time_wait_processing(tcp_t *, mblk_t *, uint32_t,
 			    uint32_t, int, tcpha_t *, ip_recv_attr_t *);
+extern void		tcp_time_wait_stack_fini(tcp_stack_t *);
+extern void		tcp_time_wait_stack_init(tcp_stack_t *);
 
 /*
  * Misc functions in tcp_misc.c.
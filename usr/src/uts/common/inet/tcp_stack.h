@@ -73,6 +73,11 @@ struct tcp_stack {
 	/* TCP queue hash list - all tcp_t in case they will be an acceptor. */
 	struct tf_s	*tcps_acceptor_fanout;
 
+	/* Compact TIME_WAIT records, by four-tuple; see tcp_tw_t. */
+	struct tcp_tw_fanout_s *tcps_tw_fanout;
+	uint_t		tcps_tw_fanout_size;
+	uint_t		tcps_tw_count;	/* # hashed, updated atomically */
+
 	/*
 	 * MIB-2 stuff for SNMP
 	 * Note: tcpInErrs {tcp 15} is accumulated in ip.c
@@ -84,6 +89,7 @@ struct tcp_stack {
 				/* Incremented for each connection */
 	kmutex_t	tcps_iss_key_lock;
 	MD5_CTX		tcps_iss_key;
+	MD5_CTX		tcps_fastopen_key;	/* Fast Open cookie secret */
 
 	/* Packet dropper for TCP IPsec policy drops. */
 	ipdropper_t	tcps_dropper;
@@ -122,6 +122,15 @@ typedef struct tcp_stat {
 	kstat_named_t	tcp_rst_unsent;
 	kstat_named_t	tcp_reclaim_cnt;
 	kstat_named_t	tcp_reass_timeout;
+	kstat_named_t	tcp_fastopen_cookie_sent;
+	kstat_named_t	tcp_fastopen_accepted;
+	kstat_named_t	tcp_fastopen_rejected;
+	kstat_named_t	tcp_fastopen_overflow;
+	kstat_named_t	tcp_fastopen_syn_data;
+	kstat_named_t	tcp_tls_tx_records;
+	kstat_named_t	tcp_tls_tx_fail;
+	kstat_named_t	tcp_time_wait_compact;
+	kstat_named_t	tcp_time_wait_compact_reuse;
 #ifdef TCP_DEBUG_COUNTER
 	kstat_named_t	tcp_time_wait;
 	kstat_named_t	tcp_rput_time_wait;
@@ -178,6 +187,15 @@ typedef struct tcp_stat_counter_s {
 	uint64_t	tcp_rst_unsent;
 	uint64_t	tcp_reclaim_cnt;
 	uint64_t	tcp_reass_timeout;
+	uint64_t	tcp_fastopen_cookie_sent;
+	uint64_t	tcp_fastopen_accepted;
+	uint64_t	tcp_fastopen_rejected;
+	uint64_t	tcp_fastopen_overflow;
+	uint64_t	tcp_fastopen_syn_data;
+	uint64_t	tcp_tls_tx_records;
+	uint64_t	tcp_tls_tx_fail;
+	uint64_t	tcp_time_wait_compact;
+	uint64_t	tcp_time_wait_compact_reuse;
 #ifdef TCP_DEBUG_COUNTER
 	uint64_t	tcp_time_wait;
 	uint64_t	tcp_rput_time_wait;
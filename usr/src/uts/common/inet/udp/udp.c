@@ -1675,6 +1675,11 @@ udp_opt_get(conn_t *connp, t_scalar_t level, t_scalar_t name,
 			*i1 = udp->udp_snd_to_conn ? 1 : 0;
 			mutex_exit(&connp->conn_lock);
 			return (sizeof (int));
+		case UDP_SEGMENT:
+			mutex_enter(&connp->conn_lock);
+			*i1 = udp->udp_gso_size;
+			mutex_exit(&connp->conn_lock);
+			return (sizeof (int));
 		}
 	}
 	mutex_enter(&connp->conn_lock);
@@ -1835,6 +1840,19 @@ udp_do_opt_set(conn_opt_arg_t *coa, int level, int name,
 			udp->udp_snd_to_conn = onoff;
 			mutex_exit(&connp->conn_lock);
 			return (0);
+		case UDP_SEGMENT:
+			/*
+			 * Zero disables segmentation; otherwise the size is
+			 * the payload of each datagram sent.
+			 */
+			if (*i1 < 0 || *i1 > UDP_MAXPACKET_IPV4)
+				return (EINVAL);
+			if (!checkonly) {
+				mutex_enter(&connp->conn_lock);
+				udp->udp_gso_size = *i1;
+				mutex_exit(&connp->conn_lock);
+			}
+			return (0);
 		}
 		break;
 	}
@@ -6054,9 +6072,9 @@ done:
 	return (error);
 }
 
-int
-udp_send(sock_lower_handle_t proto_handle, mblk_t *mp, struct nmsghdr *msg,
-    cred_t *cr)
+static int
+udp_send_one(sock_lower_handle_t proto_handle, mblk_t *mp,
+    struct nmsghdr *msg, cred_t *cr)
 {
 	sin6_t		*sin6;
 	sin_t		*sin = NULL;
@@ -6295,6 +6313,93 @@ udp_send(sock_lower_handle_t proto_handle, mblk_t *mp, struct nmsghdr *msg,
 	}
 }
 
+/*
+ * Detach the first len bytes of *mpp and return them as their own message,
+ * leaving the remainder in *mpp. Data is shared rather than copied; an mblk
+ * straddling the boundary is duplicated. The caller guarantees that *mpp
+ * holds more than len bytes.
+ */
+static mblk_t *
+udp_split_segment(mblk_t **mpp, size_t len)
+{
+	mblk_t	*head = *mpp;
+	mblk_t	*mp = head;
+	mblk_t	*prev = NULL;
+	mblk_t	*dup;
+
+	while (len >= MBLKL(mp)) {
+		len -= MBLKL(mp);
+		prev = mp;
+		mp = mp->b_cont;
+		ASSERT(mp != NULL);
+	}
+
+	if (len != 0) {
+		if ((dup = dupb(mp)) == NULL)
+			return (NULL);
+		dup->b_wptr = dup->b_rptr + len;
+		mp->b_rptr += len;
+		if (prev != NULL)
+			prev->b_cont = dup;
+		else
+			head = dup;
+	} else {
+		ASSERT(prev != NULL);
+		prev->b_cont = NULL;
+	}
+
+	*mpp = mp;
+	return (head);
+}
+
+/*
+ * When UDP_SEGMENT is set, a send larger than the segment size is split into
+ * datagrams of that size (the last may be shorter), all to the same
+ * destination and carrying the same ancillary data. This lets an application
+ * hand down a whole burst with one system call and one copy.
+ */
+int
+udp_send(sock_lower_handle_t proto_handle, mblk_t *mp, struct nmsghdr *msg,
+    cred_t *cr)
+{
+	conn_t		*connp = (conn_t *)proto_handle;
+	udp_t		*udp = connp->conn_udp;
+	uint_t		gso_size = udp->udp_gso_size;
+	size_t		size;
+	mblk_t		*seg;
+	int		error = 0;
+
+	if (gso_size == 0 || (size = msgdsize(mp)) <= gso_size)
+		return (udp_send_one(proto_handle, mp, msg, cr));
+
+	if (howmany(size, gso_size) > UDP_MAX_SEGMENTS) {
+		UDPS_BUMP_MIB(udp->udp_us, udpOutErrors);
+		freemsg(mp);
+		return (EINVAL);
+	}
+
+	UDP_STAT(udp->udp_us, udp_out_segmented);
+	while (mp != NULL) {
+		if (size > gso_size) {
+			if ((seg = udp_split_segment(&mp, gso_size)) == NULL) {
+				UDPS_BUMP_MIB(udp->udp_us, udpOutErrors);
+				freemsg(mp);
+				return (ENOMEM);
+			}
+			size -= gso_size;
+		} else {
+			seg = mp;
+			mp = NULL;
+		}
+
+		if ((error = udp_send_one(proto_handle, seg, msg, cr)) != 0) {
+			freemsg(mp);
+			break;
+		}
+	}
+	return (error);
+}
+
 int
 udp_fallback(sock_lower_handle_t proto_handle, queue_t *q,
     boolean_t issocket, so_proto_quiesced_cb_t quiesced_cb,
@@ -295,7 +295,8 @@ opdes_t	udp_opt_arr[] = {
 	0 },
 { UDP_SRCPORT_HASH, IPPROTO_UDP, OA_R, OA_RW, OP_CONFIG, 0, sizeof (int), 0 },
 { UDP_SND_TO_CONNECTED, IPPROTO_UDP, OA_R, OA_RW, OP_CONFIG, 0, sizeof (int),
-	0 }
+	0 },
+{ UDP_SEGMENT, IPPROTO_UDP, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 }
 };
 
 /*
@@ -78,6 +78,7 @@ typedef struct udp_stat {			/* Class "net" kstats */
 	kstat_named_t	udp_out_err_notconn;
 	kstat_named_t	udp_out_err_output;
 	kstat_named_t	udp_out_err_tudr;
+	kstat_named_t	udp_out_segmented;
 #ifdef DEBUG
 	kstat_named_t	udp_data_conn;
 	kstat_named_t	udp_data_notconn;
@@ -99,6 +100,7 @@ typedef struct {
 	uint64_t	udp_out_err_notconn;
 	uint64_t	udp_out_err_output;
 	uint64_t	udp_out_err_tudr;
+	uint64_t	udp_out_segmented;
 #ifdef DEBUG
 	uint64_t	udp_data_conn;
 	uint64_t	udp_data_notconn;
@@ -124,6 +126,9 @@ typedef struct {
 #define	UDP_XMIT_HIWATER	(56 * 1024)
 #define	UDP_XMIT_LOWATER	1024
 
+/* Most datagrams a single UDP_SEGMENT send may be split into. */
+#define	UDP_MAX_SEGMENTS	64
+
 /*
  * UDP stack instances
  */
@@ -186,6 +191,8 @@ typedef	struct udp_s {
 
 		udp_pad_to_bit_31 : 27;
 
+	uint_t		udp_gso_size;	/* UDP_SEGMENT option */
+
 	/* Following 2 fields protected by the uf_lock */
 	struct udp_s	*udp_bind_hash; /* Bind hash chain */
 	struct udp_s	**udp_ptpbhn; /* Pointer to previous bind hash next. */
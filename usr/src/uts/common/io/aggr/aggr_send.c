@@ -21,6 +21,7 @@
 /*
  * Copyright 2010 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -74,7 +75,9 @@ aggr_send_update_policy(aggr_grp_t *grp, uint32_t policy)
 
 /*
  * Function invoked by mac layer to find a specific TX ring on a port
- * to send data.
+ * to send data.  The mac layer hands us a whole chain, which all goes to
+ * the ring selected for its first packet; the headers are only parsed
+ * when the result can make a difference.
  */
 mblk_t *
 aggr_find_tx_ring(void *arg, mblk_t *mp, uintptr_t hint, mac_ring_handle_t *rh)
@@ -93,8 +96,25 @@ aggr_find_tx_ring(void *arg, mblk_t *mp, uintptr_t hint, mac_ring_handle_t *rh)
 		freemsgchain(mp);
 		return (NULL);
 	}
-	hash = mac_pkt_hash(DL_ETHER, mp, grp->lg_mac_tx_policy, B_TRUE);
-	port = grp->lg_tx_ports[hash % grp->lg_ntx_ports];
+
+	if (grp->lg_ntx_ports == 1) {
+		/*
+		 * Only one port is distributing, such as while LACP is
+		 * bringing up the others, so the policy hash can only pick
+		 * that port.  It is still needed to pick one of the port's
+		 * rings if the client gave us no hint.
+		 */
+		port = grp->lg_tx_ports[0];
+		hash = 0;
+		if (hint == 0 && port->lp_tx_ring_cnt > 1) {
+			hash = mac_pkt_hash(DL_ETHER, mp,
+			    grp->lg_mac_tx_policy, B_TRUE);
+		}
+	} else {
+		hash = mac_pkt_hash(DL_ETHER, mp, grp->lg_mac_tx_policy,
+		    B_TRUE);
+		port = grp->lg_tx_ports[hash % grp->lg_ntx_ports];
+	}
 
 	/*
 	 * Use hash as the hint so to direct traffic to
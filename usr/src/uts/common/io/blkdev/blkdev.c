@@ -44,6 +44,7 @@
 #include <sys/devops.h>
 #include <sys/list.h>
 #include <sys/sysmacros.h>
+#include <sys/cpuvar.h>
 #include <sys/dkio.h>
 #include <sys/dkioc_free_util.h>
 #include <sys/vtoc.h>
@@ -107,10 +108,26 @@
  * parent driver supports multiple hardware queues it can then select
  * where to submit the I/O request.
  *
- * Currently blkdev uses a simplistic round-robin queue selection method.
- * It has the advantage that it is lockless. In the future it will be
- * worthwhile reviewing this strategy for something which prioritizes queues
- * depending on how busy they are.
+ * By default blkdev selects the queue from the sequence id of the CPU the
+ * request is issued on, so that a given CPU always uses the same queue.
+ * For drivers which create one hardware queue per CPU (e.g. nvme) this keeps
+ * the submission path free of contention on the queue locks and keeps the
+ * queue's cache lines local to that CPU. Setting bd_queue_cpu_affinity to 0
+ * falls back to the simplistic round-robin method, which spreads I/O issued
+ * from few threads over all queues. Both methods are lockless. The queue is
+ * selected when the transfer is allocated.
+ *
+ * Each queue keeps a small free list of pre-allocated transfers (up to
+ * bd_queue_prealloc, bounded by the queue size), so the submission path of
+ * a CPU normally neither touches the kmem cache nor any state shared with
+ * other queues. Once the free list is exhausted transfers are allocated from
+ * the kmem cache as before.
+ *
+ * Each queue also has its own I/O kstat, named <driver><instance>,q<queue>
+ * in the class "queue", which is protected by q_iomutex and updated along
+ * with the waitq/runq. The per-device "disk" kstat is computed from the
+ * per-queue kstats when it is read: the counters and queue length integrals
+ * are summed up, while the busy times are those of the busiest queue.
  *
  * Each waitq/runq pair is protected by its mutex (q_iomutex). Incoming
  * I/O requests are initially added to the waitq. They are taken off the
@@ -123,12 +140,14 @@
  * Locks
  * -----
  * There are 4 instance global locks d_ocmutex, d_ksmutex, d_errmutex and
- * d_statemutex. As well a q_iomutex per waitq/runq pair.
+ * d_statemutex. As well a q_iomutex per waitq/runq pair and a q_freemutex
+ * per free list of pre-allocated transfers.
  *
  * Lock Hierarchy
  * --------------
- * The only two locks which may be held simultaneously are q_iomutex and
- * d_ksmutex. In all cases q_iomutex must be acquired before d_ksmutex.
+ * The only two locks which may be held simultaneously are d_ksmutex and
+ * q_iomutex, when the device kstat is updated from the queue kstats. In all
+ * cases d_ksmutex must be acquired before q_iomutex.
  */
 
 #define	BD_MAXPART	64
@@ -170,7 +189,6 @@ struct bd {
 	kmem_cache_t	*d_cache;
 	bd_queue_t	*d_queues;
 	kstat_t		*d_ksp;
-	kstat_io_t	*d_kiop;
 	kstat_t		*d_errstats;
 	struct bd_errstats *d_kerr;
 
@@ -209,6 +227,7 @@ struct bd_xfer_impl {
 	uint32_t	i_blkshift;
 	size_t		i_len;
 	size_t		i_resid;
+	boolean_t	i_prealloc;
 };
 
 struct bd_queue {
@@ -217,6 +236,12 @@ struct bd_queue {
 	uint32_t	q_qactive;
 	list_t		q_runq;
 	list_t		q_waitq;
+	kstat_t		*q_ksp;
+	kstat_io_t	*q_kiop;
+
+	kmutex_t	q_freemutex;
+	list_t		q_freelist;
+	uint32_t	q_nprealloc;
 };
 
 #define	i_dmah		i_public.x_dmah
@@ -232,6 +257,17 @@ struct bd_queue {
 #define	CAN_FREESPACE(bd) \
 	(((bd)->d_ops.o_free_space == NULL) ? B_FALSE : B_TRUE)
 
+/*
+ * Select the queue for an I/O request by the CPU it is issued on rather
+ * than round-robin. See "Queues" above.
+ */
+int bd_queue_cpu_affinity = 1;
+
+/*
+ * Maximum number of transfers pre-allocated for each queue.
+ */
+uint32_t bd_queue_prealloc = 64;
+
 /*
  * Private prototypes.
  */
@@ -243,6 +279,9 @@ static void bd_destroy_errstats(bd_t *);
 static void bd_errstats_setstr(kstat_named_t *, char *, size_t, char *);
 static void bd_init_errstats(bd_t *, bd_drive_t *);
 static void bd_fini_errstats(bd_t *);
+static void bd_queues_init(bd_t *, int, uint32_t);
+static int bd_kstat_update(kstat_t *, int);
+static bd_queue_t *bd_queue_select(bd_t *);
 
 static int bd_getinfo(dev_info_t *, ddi_info_cmd_t, void *, void **);
 static int bd_attach(dev_info_t *, ddi_attach_cmd_t);
@@ -595,14 +634,82 @@ bd_fini_errstats(bd_t *bd)
 	mutex_exit(&bd->d_errmutex);
 }
 
+static void
+bd_queues_init(bd_t *bd, int inst, uint32_t qsize)
+{
+	char		name[KSTAT_STRLEN];
+	uint32_t	i, j;
+
+	bd->d_queues = kmem_alloc(sizeof (*bd->d_queues) * bd->d_qcount,
+	    KM_SLEEP);
+	for (i = 0; i < bd->d_qcount; i++) {
+		bd_queue_t *bq = &bd->d_queues[i];
+
+		bq->q_qsize = qsize;
+		bq->q_qactive = 0;
+		mutex_init(&bq->q_iomutex, NULL, MUTEX_DRIVER, NULL);
+
+		list_create(&bq->q_waitq, sizeof (bd_xfer_impl_t),
+		    offsetof(struct bd_xfer_impl, i_linkage));
+		list_create(&bq->q_runq, sizeof (bd_xfer_impl_t),
+		    offsetof(struct bd_xfer_impl, i_linkage));
+
+		(void) snprintf(name, sizeof (name), "%s%d,q%u",
+		    ddi_driver_name(bd->d_dip), inst, i);
+		bq->q_ksp = kstat_create(ddi_driver_name(bd->d_dip), inst,
+		    name, "queue", KSTAT_TYPE_IO, 1, 0);
+		if (bq->q_ksp != NULL) {
+			bq->q_ksp->ks_lock = &bq->q_iomutex;
+			kstat_install(bq->q_ksp);
+			bq->q_kiop = bq->q_ksp->ks_data;
+		} else {
+			/*
+			 * As for the device kstat, use a scratch kstat so
+			 * we can always update it without an extra branch.
+			 */
+			bq->q_kiop = kmem_zalloc(sizeof (kstat_io_t),
+			    KM_SLEEP);
+		}
+
+		mutex_init(&bq->q_freemutex, NULL, MUTEX_DRIVER, NULL);
+		list_create(&bq->q_freelist, sizeof (bd_xfer_impl_t),
+		    offsetof(struct bd_xfer_impl, i_linkage));
+		bq->q_nprealloc = MIN(qsize, bd_queue_prealloc);
+		for (j = 0; j < bq->q_nprealloc; j++) {
+			bd_xfer_impl_t *xi;
+
+			xi = kmem_cache_alloc(bd->d_cache, KM_SLEEP);
+			xi->i_prealloc = B_TRUE;
+			xi->i_bq = bq;
+			list_insert_tail(&bq->q_freelist, xi);
+		}
+	}
+}
+
 static void
 bd_queues_free(bd_t *bd)
 {
+	bd_xfer_impl_t *xi;
 	uint32_t i;
 
 	for (i = 0; i < bd->d_qcount; i++) {
 		bd_queue_t *bq = &bd->d_queues[i];
 
+		while ((xi = list_remove_head(&bq->q_freelist)) != NULL) {
+			bq->q_nprealloc--;
+			kmem_cache_free(bd->d_cache, xi);
+		}
+		ASSERT0(bq->q_nprealloc);
+		list_destroy(&bq->q_freelist);
+		mutex_destroy(&bq->q_freemutex);
+
+		if (bq->q_ksp != NULL) {
+			kstat_delete(bq->q_ksp);
+			bq->q_ksp = NULL;
+		} else {
+			kmem_free(bq->q_kiop, sizeof (kstat_io_t));
+		}
+
 		mutex_destroy(&bq->q_iomutex);
 		list_destroy(&bq->q_waitq);
 		list_destroy(&bq->q_runq);
@@ -611,6 +718,44 @@ bd_queues_free(bd_t *bd)
 	kmem_free(bd->d_queues, sizeof (*bd->d_queues) * bd->d_qcount);
 }
 
+/*
+ * Compute the device kstat from the per-queue kstats, see "Queues" above.
+ * Called with d_ksmutex held.
+ */
+static int
+bd_kstat_update(kstat_t *ksp, int rw)
+{
+	bd_t		*bd = ksp->ks_private;
+	kstat_io_t	*kiop = KSTAT_IO_PTR(ksp);
+	uint32_t	i;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	bzero(kiop, sizeof (*kiop));
+	for (i = 0; i < bd->d_qcount; i++) {
+		bd_queue_t *bq = &bd->d_queues[i];
+		kstat_io_t *qkiop = bq->q_kiop;
+
+		mutex_enter(&bq->q_iomutex);
+		kiop->nread += qkiop->nread;
+		kiop->nwritten += qkiop->nwritten;
+		kiop->reads += qkiop->reads;
+		kiop->writes += qkiop->writes;
+		kiop->wlentime += qkiop->wlentime;
+		kiop->rlentime += qkiop->rlentime;
+		kiop->wcnt += qkiop->wcnt;
+		kiop->rcnt += qkiop->rcnt;
+		kiop->wtime = MAX(kiop->wtime, qkiop->wtime);
+		kiop->rtime = MAX(kiop->rtime, qkiop->rtime);
+		kiop->wlastupdate = MAX(kiop->wlastupdate, qkiop->wlastupdate);
+		kiop->rlastupdate = MAX(kiop->rlastupdate, qkiop->rlastupdate);
+		mutex_exit(&bq->q_iomutex);
+	}
+
+	return (0);
+}
+
 static int
 bd_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
 {
@@ -618,7 +763,6 @@ bd_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
 	bd_handle_t	hdl;
 	bd_t		*bd;
 	bd_drive_t	drive;
-	uint32_t	i;
 	int		rv;
 	char		name[16];
 	char		kcache[32];
@@ -700,20 +844,16 @@ bd_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
 	bd->d_cache = kmem_cache_create(kcache, sizeof (bd_xfer_impl_t), 8,
 	    bd_xfer_ctor, bd_xfer_dtor, NULL, bd, NULL, 0);
 
+	/*
+	 * The device kstat is installed once the queues it is computed from
+	 * have been set up.
+	 */
 	bd->d_ksp = kstat_create(ddi_driver_name(dip), inst, NULL, "disk",
 	    KSTAT_TYPE_IO, 1, KSTAT_FLAG_PERSISTENT);
 	if (bd->d_ksp != NULL) {
 		bd->d_ksp->ks_lock = &bd->d_ksmutex;
-		kstat_install(bd->d_ksp);
-		bd->d_kiop = bd->d_ksp->ks_data;
-	} else {
-		/*
-		 * Even if we cannot create the kstat, we create a
-		 * scratch kstat.  The reason for this is to ensure
-		 * that we can update the kstat all of the time,
-		 * without adding an extra branch instruction.
-		 */
-		bd->d_kiop = kmem_zalloc(sizeof (kstat_io_t), KM_SLEEP);
+		bd->d_ksp->ks_update = bd_kstat_update;
+		bd->d_ksp->ks_private = bd;
 	}
 
 	cmlb_alloc_handle(&bd->d_cmlbh);
@@ -778,20 +918,9 @@ bd_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
 	bd_create_errstats(bd, inst, &drive);
 	bd_update_state(bd);
 
-	bd->d_queues = kmem_alloc(sizeof (*bd->d_queues) * bd->d_qcount,
-	    KM_SLEEP);
-	for (i = 0; i < bd->d_qcount; i++) {
-		bd_queue_t *bq = &bd->d_queues[i];
-
-		bq->q_qsize = drive.d_qsize;
-		bq->q_qactive = 0;
-		mutex_init(&bq->q_iomutex, NULL, MUTEX_DRIVER, NULL);
-
-		list_create(&bq->q_waitq, sizeof (bd_xfer_impl_t),
-		    offsetof(struct bd_xfer_impl, i_linkage));
-		list_create(&bq->q_runq, sizeof (bd_xfer_impl_t),
-		    offsetof(struct bd_xfer_impl, i_linkage));
-	}
+	bd_queues_init(bd, inst, drive.d_qsize);
+	if (bd->d_ksp != NULL)
+		kstat_install(bd->d_ksp);
 
 	rv = cmlb_attach(dip, &bd_tg_ops, DTYPE_DIRECT,
 	    bd->d_removable, bd->d_hotpluggable,
@@ -835,6 +964,10 @@ bd_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
 	return (DDI_SUCCESS);
 
 fail_cmlb_attach:
+	if (bd->d_ksp != NULL) {
+		kstat_delete(bd->d_ksp);
+		bd->d_ksp = NULL;
+	}
 	bd_queues_free(bd);
 	bd_destroy_errstats(bd);
 
@@ -844,8 +977,6 @@ fail_drive_info:
 	if (bd->d_ksp != NULL) {
 		kstat_delete(bd->d_ksp);
 		bd->d_ksp = NULL;
-	} else {
-		kmem_free(bd->d_kiop, sizeof (kstat_io_t));
 	}
 
 	kmem_cache_destroy(bd->d_cache);
@@ -877,8 +1008,6 @@ bd_detach(dev_info_t *dip, ddi_detach_cmd_t cmd)
 	if (bd->d_ksp != NULL) {
 		kstat_delete(bd->d_ksp);
 		bd->d_ksp = NULL;
-	} else {
-		kmem_free(bd->d_kiop, sizeof (kstat_io_t));
 	}
 
 	bd_destroy_errstats(bd);
@@ -886,12 +1015,12 @@ bd_detach(dev_info_t *dip, ddi_detach_cmd_t cmd)
 	cmlb_free_handle(&bd->d_cmlbh);
 	if (bd->d_devid)
 		ddi_devid_free(bd->d_devid);
+	bd_queues_free(bd);
 	kmem_cache_destroy(bd->d_cache);
 	mutex_destroy(&bd->d_ksmutex);
 	mutex_destroy(&bd->d_ocmutex);
 	mutex_destroy(&bd->d_statemutex);
 	cv_destroy(&bd->d_statecv);
-	bd_queues_free(bd);
 	ddi_soft_state_free(bd_state, ddi_get_instance(dip));
 	return (DDI_SUCCESS);
 }
@@ -935,6 +1064,60 @@ bd_xfer_dtor(void *buf, void *arg)
 	xi->i_dmah = NULL;
 }
 
+static bd_queue_t *
+bd_queue_select(bd_t *bd)
+{
+	unsigned	q;
+
+	if (bd->d_qcount == 1)
+		q = 0;
+	else if (bd_queue_cpu_affinity != 0)
+		q = CPU->cpu_seqid % bd->d_qcount;
+	else
+		q = atomic_inc_64_nv(&bd->d_io_counter) % bd->d_qcount;
+
+	return (&bd->d_queues[q]);
+}
+
+/*
+ * Take a transfer from the free list of the queue, falling back to the kmem
+ * cache if it is empty.
+ */
+static bd_xfer_impl_t *
+bd_xfer_get(bd_t *bd, bd_queue_t *bq, int kmflag)
+{
+	bd_xfer_impl_t	*xi;
+
+	mutex_enter(&bq->q_freemutex);
+	xi = list_remove_head(&bq->q_freelist);
+	mutex_exit(&bq->q_freemutex);
+
+	if (xi == NULL) {
+		xi = kmem_cache_alloc(bd->d_cache, kmflag);
+		if (xi == NULL)
+			return (NULL);
+		xi->i_prealloc = B_FALSE;
+	}
+
+	xi->i_bq = bq;
+	xi->i_qnum = bq - bd->d_queues;
+	return (xi);
+}
+
+static void
+bd_xfer_put(bd_xfer_impl_t *xi)
+{
+	bd_queue_t	*bq = xi->i_bq;
+
+	if (xi->i_prealloc) {
+		mutex_enter(&bq->q_freemutex);
+		list_insert_head(&bq->q_freelist, xi);
+		mutex_exit(&bq->q_freemutex);
+	} else {
+		kmem_cache_free(xi->i_bd->d_cache, xi);
+	}
+}
+
 static bd_xfer_impl_t *
 bd_xfer_alloc(bd_t *bd, struct buf *bp, int (*func)(void *, bd_xfer_t *),
     int kmflag)
@@ -953,7 +1136,7 @@ bd_xfer_alloc(bd_t *bd, struct buf *bp, int (*func)(void *, bd_xfer_t *),
 		cb = DDI_DMA_DONTWAIT;
 	}
 
-	xi = kmem_cache_alloc(bd->d_cache, kmflag);
+	xi = bd_xfer_get(bd, bd_queue_select(bd), kmflag);
 	if (xi == NULL) {
 		bioerror(bp, ENOMEM);
 		return (NULL);
@@ -963,6 +1146,7 @@ bd_xfer_alloc(bd_t *bd, struct buf *bp, int (*func)(void *, bd_xfer_t *),
 
 	xi->i_bp = bp;
 	xi->i_func = func;
+	xi->i_flags = 0;
 	xi->i_blkno = bp->b_lblkno >> (bd->d_blkshift - DEV_BSHIFT);
 
 	if (bp->b_bcount == 0) {
@@ -1054,7 +1238,7 @@ bd_xfer_alloc(bd_t *bd, struct buf *bp, int (*func)(void *, bd_xfer_t *),
 
 done:
 	if (rv != 0) {
-		kmem_cache_free(bd->d_cache, xi);
+		bd_xfer_put(xi);
 		bioerror(bp, rv);
 		return (NULL);
 	}
@@ -1072,7 +1256,7 @@ bd_xfer_free(bd_xfer_impl_t *xi)
 		dfl_free((dkioc_free_list_t *)xi->i_dfl);
 		xi->i_dfl = NULL;
 	}
-	kmem_cache_free(xi->i_bd->d_cache, xi);
+	bd_xfer_put(xi);
 }
 
 static int
@@ -1784,9 +1968,7 @@ bd_sched(bd_t *bd, bd_queue_t *bq)
 
 	while ((bq->q_qactive < bq->q_qsize) &&
 	    ((xi = list_remove_head(&bq->q_waitq)) != NULL)) {
-		mutex_enter(&bd->d_ksmutex);
-		kstat_waitq_to_runq(bd->d_kiop);
-		mutex_exit(&bd->d_ksmutex);
+		kstat_waitq_to_runq(bq->q_kiop);
 
 		bq->q_qactive++;
 		list_insert_tail(&bq->q_runq, xi);
@@ -1809,9 +1991,7 @@ bd_sched(bd_t *bd, bd_queue_t *bq)
 
 			mutex_enter(&bq->q_iomutex);
 
-			mutex_enter(&bd->d_ksmutex);
-			kstat_runq_exit(bd->d_kiop);
-			mutex_exit(&bd->d_ksmutex);
+			kstat_runq_exit(bq->q_kiop);
 
 			bq->q_qactive--;
 			list_remove(&bq->q_runq, xi);
@@ -1827,20 +2007,12 @@ bd_sched(bd_t *bd, bd_queue_t *bq)
 static void
 bd_submit(bd_t *bd, bd_xfer_impl_t *xi)
 {
-	uint64_t	nv = atomic_inc_64_nv(&bd->d_io_counter);
-	unsigned	q = nv % bd->d_qcount;
-	bd_queue_t	*bq = &bd->d_queues[q];
-
-	xi->i_bq = bq;
-	xi->i_qnum = q;
+	bd_queue_t	*bq = xi->i_bq;
 
 	mutex_enter(&bq->q_iomutex);
 
 	list_insert_tail(&bq->q_waitq, xi);
-
-	mutex_enter(&bd->d_ksmutex);
-	kstat_waitq_enter(bd->d_kiop);
-	mutex_exit(&bd->d_ksmutex);
+	kstat_waitq_enter(bq->q_kiop);
 
 	mutex_exit(&bq->q_iomutex);
 
@@ -1857,24 +2029,21 @@ bd_runq_exit(bd_xfer_impl_t *xi, int err)
 	mutex_enter(&bq->q_iomutex);
 	bq->q_qactive--;
 
-	mutex_enter(&bd->d_ksmutex);
-	kstat_runq_exit(bd->d_kiop);
-	mutex_exit(&bd->d_ksmutex);
+	kstat_runq_exit(bq->q_kiop);
 
 	list_remove(&bq->q_runq, xi);
-	mutex_exit(&bq->q_iomutex);
 
 	if (err == 0) {
 		if (bp->b_flags & B_READ) {
-			atomic_inc_uint(&bd->d_kiop->reads);
-			atomic_add_64((uint64_t *)&bd->d_kiop->nread,
-			    bp->b_bcount - xi->i_resid);
+			bq->q_kiop->reads++;
+			bq->q_kiop->nread += bp->b_bcount - xi->i_resid;
 		} else {
-			atomic_inc_uint(&bd->d_kiop->writes);
-			atomic_add_64((uint64_t *)&bd->d_kiop->nwritten,
-			    bp->b_bcount - xi->i_resid);
+			bq->q_kiop->writes++;
+			bq->q_kiop->nwritten += bp->b_bcount - xi->i_resid;
 		}
 	}
+	mutex_exit(&bq->q_iomutex);
+
 	bd_sched(bd, bq);
 }
 
@@ -40,7 +40,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
- * Copyright 2017 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -88,6 +88,7 @@
 #include <net/bpf.h>
 #include <net/bpfdesc.h>
 #include <net/dlt.h>
+#include <inet/bpf.h>
 
 #include <netinet/in.h>
 #include <sys/mac.h>
@@ -96,6 +97,8 @@
 #include <sys/time_std_impl.h>
 #include <sys/hook.h>
 #include <sys/hook_event.h>
+#include <sys/sunddi.h>
+#include <sys/ddidevmap.h>
 
 
 #define	mtod(_v, _t)	(_t)((_v)->b_rptr)
@@ -114,7 +117,12 @@ typedef void *(*cp_fn_t)(void *, const void *, size_t);
  */
 int bpf_bufsize = BPF_BUFSIZE;
 int bpf_maxbufsize = (16 * 1024 * 1024);
+/*
+ * The limit on the size of a BIOCSRING capture ring.
+ */
+size_t bpf_maxringsize = BPF_MAXRINGSIZE;
 static mod_hash_t *bpf_hash = NULL;
+extern dev_info_t *bpf_dev_info;
 
 /*
  * Use a mutex to avoid a race condition between gathering the stats/peers
@@ -154,6 +162,11 @@ static inline void
 static void	catchpacket(struct bpf_d *, uchar_t *, uint_t, uint_t,
 		    cp_fn_t, struct timeval *);
 static void	reset_d(struct bpf_d *);
+static int	bpf_ring_setup(struct bpf_d *, struct bpf_ring_req *);
+static void	bpf_ring_catch(struct bpf_d *, uchar_t *, uint_t, uint_t,
+		    cp_fn_t, struct timeval *);
+static boolean_t bpf_ring_ready(struct bpf_d *);
+static void	bpf_ring_timeout(void *);
 static int	bpf_getdltlist(struct bpf_d *, struct bpf_dltlist *);
 static int	bpf_setdlt(struct bpf_d *, void *);
 static void	bpf_dev_add(struct bpf_d *);
@@ -532,6 +545,7 @@ int
 bpfclose(dev_t dev, int flag, int otyp, cred_t *cred_p)
 {
 	struct bpf_d *d = bpf_dev_get(getminor(dev));
+	timeout_id_t tid;
 
 	mutex_enter(&d->bd_lock);
 
@@ -551,8 +565,18 @@ bpfclose(dev_t dev, int flag, int otyp, cred_t *cred_p)
 	d->bd_state = BPF_IDLE;
 	if (d->bd_bif)
 		bpf_detachd(d);
+	tid = d->bd_ring_tid;
+	d->bd_ring_tid = 0;
 	mutex_exit(&d->bd_lock);
 
+	/*
+	 * With bd_ring_tid cleared, a bpf_ring_timeout() that is already
+	 * running will not reschedule itself.
+	 */
+	if (tid != 0)
+		(void) untimeout(tid);
+	pollhead_clean(&d->bd_poll);
+
 	mutex_enter(&bpf_mtx);
 	LIST_REMOVE(d, bd_list);
 	bpf_dev_remove(d);
@@ -602,6 +626,13 @@ bpfread(dev_t dev, struct uio *uio, cred_t *cred)
 		return (EINVAL);
 
 	mutex_enter(&d->bd_lock);
+	/*
+	 * Once there is a capture ring, packets are only delivered there.
+	 */
+	if (d->bd_ring != NULL) {
+		mutex_exit(&d->bd_lock);
+		return (EBUSY);
+	}
 	if (d->bd_state == BPF_WAITING)
 		bpf_clear_timeout(d);
 	timed_out = (d->bd_state == BPF_TIMED_OUT);
@@ -807,6 +838,8 @@ reset_d(struct bpf_d *d)
 	}
 	d->bd_slen = 0;
 	d->bd_hlen = 0;
+	d->bd_ring_len = 0;
+	d->bd_ring_npkts = 0;
 	d->bd_rcount = 0;
 	d->bd_dcount = 0;
 	d->bd_ccount = 0;
@@ -828,6 +861,7 @@ reset_d(struct bpf_d *d)
  *  BIOCVERSION		Get filter language version.
  *  BIOCGHDRCMPLT	Get "header already complete" flag.
  *  BIOCSHDRCMPLT	Set "header already complete" flag.
+ *  BIOCSRING		Set up a memory-mapped capture ring.
  */
 /* ARGSUSED */
 int
@@ -1239,6 +1273,21 @@ bpfioctl(dev_t dev, int cmd, intptr_t addr, int mode, cred_t *cred, int *rval)
 			error = EFAULT;
 		break;
 
+	/*
+	 * Set up a memory-mapped capture ring.
+	 */
+	case BIOCSRING:
+		{
+			struct bpf_ring_req req;
+
+			if (copyin((void *)addr, &req, sizeof (req)) != 0) {
+				error = EFAULT;
+				break;
+			}
+			error = bpf_ring_setup(d, &req);
+			break;
+		}
+
 	case FIONBIO:		/* Non-blocking I/O */
 		if (copyin((void *)addr, &d->bd_nonblock,
 		    sizeof (d->bd_nonblock)) != 0)
@@ -1258,6 +1307,7 @@ int
 bpf_setf(struct bpf_d *d, struct bpf_program *fp)
 {
 	struct bpf_insn *fcode, *old;
+	ip_bpf_jit_t *jit, *oldjit;
 	uint_t flen, size;
 	size_t oldsize;
 
@@ -1267,12 +1317,15 @@ bpf_setf(struct bpf_d *d, struct bpf_program *fp)
 		mutex_enter(&d->bd_lock);
 		old = d->bd_filter;
 		oldsize = d->bd_filter_size;
+		oldjit = d->bd_jit;
 		d->bd_filter = 0;
 		d->bd_filter_size = 0;
+		d->bd_jit = NULL;
 		reset_d(d);
 		mutex_exit(&d->bd_lock);
 		if (old != 0)
 			kmem_free(old, oldsize);
+		ip_bpf_jit_free(oldjit);
 		return (0);
 	}
 	flen = fp->bf_len;
@@ -1285,15 +1338,19 @@ bpf_setf(struct bpf_d *d, struct bpf_program *fp)
 		return (EFAULT);
 
 	if (bpf_validate(fcode, (int)flen)) {
+		jit = ip_bpf_jit((ip_bpf_insn_t *)fcode, flen);
 		mutex_enter(&d->bd_lock);
 		old = d->bd_filter;
 		oldsize = d->bd_filter_size;
+		oldjit = d->bd_jit;
 		d->bd_filter = fcode;
 		d->bd_filter_size = size;
+		d->bd_jit = jit;
 		reset_d(d);
 		mutex_exit(&d->bd_lock);
 		if (old != 0)
 			kmem_free(old, oldsize);
+		ip_bpf_jit_free(oldjit);
 
 		return (0);
 	}
@@ -1418,7 +1475,21 @@ bpfchpoll(dev_t dev, short events, int anyyet, short *reventsp,
 		return (EPERM);
 	}
 
-	if (events & (POLLIN | POLLRDNORM)) {
+	if ((events & (POLLIN | POLLRDNORM)) && d->bd_ring != NULL) {
+		/*
+		 * Retiring a ring block always issues a pollwakeup(), so
+		 * unlike the read(2) buffers the pollhead can be handed out.
+		 */
+		mutex_enter(&d->bd_lock);
+		if (bpf_ring_ready(d)) {
+			*reventsp |= events & (POLLIN | POLLRDNORM);
+		} else {
+			*reventsp = 0;
+			if (!anyyet)
+				*phpp = &d->bd_poll;
+		}
+		mutex_exit(&d->bd_lock);
+	} else if (events & (POLLIN | POLLRDNORM)) {
 		/*
 		 * An imitation of the FIONREAD ioctl code.
 		 */
@@ -1493,6 +1564,7 @@ bpf_deliver(struct bpf_d *d, cp_fn_t cpfn, void *marg, uint_t pktlen,
     uint_t buflen, boolean_t issent)
 {
 	struct timeval tv;
+	boolean_t wakeup;
 	uint_t slen;
 
 	if (!d->bd_seesent && issent)
@@ -1503,7 +1575,8 @@ bpf_deliver(struct bpf_d *d, cp_fn_t cpfn, void *marg, uint_t pktlen,
 	 * is important to protect even the outer ones.
 	 */
 	mutex_enter(&d->bd_lock);
-	slen = bpf_filter(d->bd_filter, marg, pktlen, buflen);
+	slen = ip_bpf_jit_filter(d->bd_jit, (ip_bpf_insn_t *)d->bd_filter,
+	    marg, pktlen, buflen);
 	DTRACE_PROBE5(bpf__packet, struct bpf_if *, d->bd_bif,
 	    struct bpf_d *, d, void *, marg, uint_t, pktlen, uint_t, slen);
 	d->bd_rcount++;
@@ -1512,7 +1585,12 @@ bpf_deliver(struct bpf_d *d, cp_fn_t cpfn, void *marg, uint_t pktlen,
 		uniqtime(&tv);
 		catchpacket(d, marg, pktlen, slen, cpfn, &tv);
 	}
+	wakeup = d->bd_ring_wakeup;
+	d->bd_ring_wakeup = B_FALSE;
 	mutex_exit(&d->bd_lock);
+
+	if (wakeup)
+		pollwakeup(&d->bd_poll, POLLIN | POLLRDNORM);
 }
 
 /*
@@ -1582,6 +1660,10 @@ catchpacket(struct bpf_d *d, uchar_t *pkt, uint_t pktlen, uint_t snaplen,
 
 	++d->bd_ccount;
 	ks_stats.kp_capture.value.ui64++;
+	if (d->bd_ring != NULL) {
+		bpf_ring_catch(d, pkt, pktlen, snaplen, cpfn, tv);
+		return;
+	}
 	/*
 	 * Figure out how many bytes to move.  If the packet is
 	 * greater or equal to the snapshot length, transfer that
@@ -1646,6 +1728,211 @@ catchpacket(struct bpf_d *d, uchar_t *pkt, uint_t pktlen, uint_t snaplen,
 		bpf_wakeup(d);
 }
 
+/*
+ * The capture ring set up by BIOCSRING; see <net/bpf.h> for the layout that
+ * is shared with the consumer.  The kernel's view of the ring, in the bd_ring_*
+ * fields, is protected by bd_lock.
+ */
+#define	BPF_RING_BLOCK(d, i)	((struct bpf_block_hdr *)((d)->bd_ring + \
+	(size_t)(i) * (d)->bd_ring_bsize))
+
+static int
+bpf_ring_setup(struct bpf_d *d, struct bpf_ring_req *req)
+{
+	ddi_umem_cookie_t cookie;
+	struct bpf_block_hdr *bh;
+	caddr_t ring;
+	size_t size;
+	uint32_t i;
+
+	if (req->brq_blocksize < sizeof (*bh) + BPF_MINBUFSIZE ||
+	    !IS_P2ALIGNED(req->brq_blocksize, sizeof (uint64_t)) ||
+	    req->brq_nblocks == 0 ||
+	    (uint64_t)req->brq_blocksize * req->brq_nblocks > bpf_maxringsize)
+		return (EINVAL);
+
+	size = ptob(btopr((size_t)req->brq_blocksize * req->brq_nblocks));
+	ring = ddi_umem_alloc(size, DDI_UMEM_SLEEP, &cookie);
+	bzero(ring, size);
+	for (i = 0; i < req->brq_nblocks; i++) {
+		bh = (struct bpf_block_hdr *)(ring +
+		    (size_t)i * req->brq_blocksize);
+		bh->bbh_offset = sizeof (*bh);
+	}
+
+	mutex_enter(&d->bd_lock);
+	if (d->bd_ring != NULL) {
+		mutex_exit(&d->bd_lock);
+		ddi_umem_free(cookie);
+		return (EBUSY);
+	}
+	d->bd_ring = ring;
+	d->bd_ring_cookie = cookie;
+	d->bd_ring_size = size;
+	d->bd_ring_bsize = req->brq_blocksize;
+	d->bd_ring_nblocks = req->brq_nblocks;
+	d->bd_ring_cur = 0;
+	d->bd_ring_len = 0;
+	d->bd_ring_npkts = 0;
+	d->bd_ring_tail = 0;
+	d->bd_ring_nuser = 0;
+	if (req->brq_timeout != 0) {
+		d->bd_ring_tout = MAX(1,
+		    drv_usectohz((clock_t)req->brq_timeout * 1000));
+		d->bd_ring_tid = timeout(bpf_ring_timeout, d,
+		    d->bd_ring_tout);
+	}
+	mutex_exit(&d->bd_lock);
+
+	return (0);
+}
+
+/*
+ * Hand the block being filled over to the consumer, if there is anything in
+ * it.  The pollwakeup() is left to our caller, once it has dropped bd_lock.
+ */
+static void
+bpf_ring_retire(struct bpf_d *d)
+{
+	struct bpf_block_hdr *bh;
+
+	if (d->bd_ring_npkts == 0)
+		return;
+
+	bh = BPF_RING_BLOCK(d, d->bd_ring_cur);
+	bh->bbh_npkts = d->bd_ring_npkts;
+	bh->bbh_offset = sizeof (*bh);
+	bh->bbh_len = sizeof (*bh) + d->bd_ring_len;
+	bh->bbh_seq = d->bd_ring_seq++;
+	membar_producer();
+	bh->bbh_status = BPF_BLOCK_USER;
+
+	d->bd_ring_cur = (d->bd_ring_cur + 1) % d->bd_ring_nblocks;
+	d->bd_ring_len = 0;
+	d->bd_ring_npkts = 0;
+	d->bd_ring_nuser++;
+	d->bd_ring_wakeup = B_TRUE;
+}
+
+/*
+ * The ring counterpart of the tail of catchpacket(): append a packet to the
+ * current block, retiring it first if the packet would not fit.
+ */
+static void
+bpf_ring_catch(struct bpf_d *d, uchar_t *pkt, uint_t pktlen, uint_t snaplen,
+    cp_fn_t cpfn, struct timeval *tv)
+{
+	uint_t room = d->bd_ring_bsize - sizeof (struct bpf_block_hdr);
+	int hdrlen = d->bd_hdrlen;
+	struct bpf_block_hdr *bh;
+	struct bpf_hdr *hp;
+	uint_t totlen, curlen;
+
+	totlen = hdrlen + min(snaplen, pktlen);
+	if (totlen > room)
+		totlen = room;
+
+	curlen = BPF_WORDALIGN(d->bd_ring_len);
+	if (curlen + totlen > room) {
+		bpf_ring_retire(d);
+		curlen = 0;
+	}
+
+	bh = BPF_RING_BLOCK(d, d->bd_ring_cur);
+	if (d->bd_ring_npkts == 0) {
+		/*
+		 * Starting a new block: it must have been handed back.
+		 */
+		if (bh->bbh_status != BPF_BLOCK_KERNEL) {
+			++d->bd_dcount;
+			ks_stats.kp_dropped.value.ui64++;
+			return;
+		}
+		membar_consumer();
+		curlen = 0;
+	}
+
+	hp = (struct bpf_hdr *)((caddr_t)(bh + 1) + curlen);
+	hp->bh_tstamp.tv_sec = tv->tv_sec;
+	hp->bh_tstamp.tv_usec = tv->tv_usec;
+	hp->bh_datalen = pktlen;
+	hp->bh_hdrlen = (uint16_t)hdrlen;
+	(*cpfn)((uchar_t *)hp + hdrlen, pkt,
+	    (hp->bh_caplen = totlen - hdrlen));
+	d->bd_ring_len = curlen + totlen;
+	d->bd_ring_npkts++;
+
+	if (d->bd_immediate)
+		bpf_ring_retire(d);
+}
+
+/*
+ * Is there a retired block which the consumer has not yet handed back?
+ */
+static boolean_t
+bpf_ring_ready(struct bpf_d *d)
+{
+	while (d->bd_ring_nuser != 0 &&
+	    BPF_RING_BLOCK(d, d->bd_ring_tail)->bbh_status ==
+	    BPF_BLOCK_KERNEL) {
+		d->bd_ring_tail = (d->bd_ring_tail + 1) % d->bd_ring_nblocks;
+		d->bd_ring_nuser--;
+	}
+
+	return (d->bd_ring_nuser != 0);
+}
+
+/*
+ * Retire a partly filled block, so that no packet waits in the ring for much
+ * longer than the timeout given to BIOCSRING.
+ */
+static void
+bpf_ring_timeout(void *arg)
+{
+	struct bpf_d *d = arg;
+	boolean_t wakeup;
+
+	mutex_enter(&d->bd_lock);
+	if (d->bd_ring_tid == 0) {
+		mutex_exit(&d->bd_lock);
+		return;
+	}
+	bpf_ring_retire(d);
+	wakeup = d->bd_ring_wakeup;
+	d->bd_ring_wakeup = B_FALSE;
+	d->bd_ring_tid = timeout(bpf_ring_timeout, d, d->bd_ring_tout);
+	mutex_exit(&d->bd_lock);
+
+	if (wakeup)
+		pollwakeup(&d->bd_poll, POLLIN | POLLRDNORM);
+}
+
+/*
+ * Map the capture ring set up by BIOCSRING.
+ */
+/* ARGSUSED */
+int
+bpfdevmap(dev_t dev, devmap_cookie_t dhp, offset_t off, size_t len,
+    size_t *maplen, uint_t model)
+{
+	struct bpf_d *d = bpf_dev_get(getminor(dev));
+	int error;
+
+	mutex_enter(&d->bd_lock);
+	if (d->bd_ring == NULL || off < 0 || len == 0 ||
+	    off + len > d->bd_ring_size) {
+		error = ENXIO;
+	} else {
+		error = devmap_umem_setup(dhp, bpf_dev_info, NULL,
+		    d->bd_ring_cookie, off, len,
+		    PROT_READ | PROT_WRITE | PROT_USER, DEVMAP_DEFAULTS, NULL);
+		*maplen = len;
+	}
+	mutex_exit(&d->bd_lock);
+
+	return (error);
+}
+
 /*
  * Initialize all nonzero fields of a descriptor.
  */
@@ -1686,6 +1973,12 @@ bpf_freed(struct bpf_d *d)
 	}
 	if (d->bd_filter)
 		kmem_free(d->bd_filter, d->bd_filter_size);
+	ip_bpf_jit_free(d->bd_jit);
+	d->bd_jit = NULL;
+	if (d->bd_ring != NULL) {
+		ddi_umem_free(d->bd_ring_cookie);
+		d->bd_ring = NULL;
+	}
 }
 
 /*
@@ -22,6 +22,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/types.h>
@@ -37,6 +38,7 @@
 #include <sys/cmn_err.h>
 #include <sys/cred.h>
 #include <sys/sunddi.h>
+#include <sys/ddidevmap.h>
 #include <sys/mac_provider.h>
 #include <sys/dls_impl.h>
 #include <inet/ipnet.h>
@@ -47,6 +49,8 @@ extern	int	bpfread(dev_t dev, struct uio *uio_p, cred_t *cred_p);
 extern	int	bpfwrite(dev_t dev, struct uio *uio, cred_t *cred);
 extern	int	bpfchpoll(dev_t, short, int, short *, struct pollhead **);
 extern	int	bpfioctl(dev_t, int, intptr_t, int, cred_t *, int *);
+extern	int	bpfdevmap(dev_t, devmap_cookie_t, offset_t, size_t, size_t *,
+		    uint_t);
 extern	int	bpfilterattach(void);
 extern	int	bpfilterdetach(void);
 
@@ -77,13 +81,13 @@ static struct cb_ops bpf_cb_ops = {
 	bpfread,
 	bpfwrite,	/* write */
 	bpfioctl,	/* ioctl */
-	nodev,		/* devmap */
+	bpfdevmap,	/* devmap */
 	nodev,		/* mmap */
-	nodev,		/* segmap */
+	ddi_devmap_segmap,	/* segmap */
 	bpfchpoll,	/* poll */
 	ddi_prop_op,
 	NULL,
-	D_MTSAFE,
+	D_MTSAFE | D_DEVMAP,
 	CB_REV,
 	nodev,		/* aread */
 	nodev,		/* awrite */
@@ -108,7 +112,7 @@ static struct modldrv bpfmod = {
 };
 static struct modlinkage modlink1 = { MODREV_1, &bpfmod, NULL };
 
-static dev_info_t *bpf_dev_info = NULL;
+dev_info_t *bpf_dev_info = NULL;
 static net_instance_t *bpf_inst = NULL;
 
 int
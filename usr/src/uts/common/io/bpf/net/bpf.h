@@ -39,6 +39,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef _NET_BPF_H_
@@ -66,6 +67,7 @@ typedef	uint_t bpf_u_int32;
 #define	BPF_DFLTBUFSIZE (1024*1024)	/* default static upper limit */
 #define	BPF_MAXBUFSIZE (1024*1024*16)	/* hard limit on sysctl'able value */
 #define	BPF_MINBUFSIZE 32
+#define	BPF_MAXRINGSIZE (1024*1024*256)	/* default limit for BIOCSRING */
 
 /*
  *  Structure for BIOCSETF.
@@ -147,6 +149,7 @@ struct bpf_version {
 #define	BIOCSSEESENT	 _IOW('B', 121, uint_t)
 #define	BIOCSRTIMEOUT	 _IOW('B', 122, struct timeval)
 #define	BIOCGRTIMEOUT	 _IOR('B', 123, struct timeval)
+#define	BIOCSRING	 _IOW('B', 124, struct bpf_ring_req)
 /*
  */
 #define	BIOCSETF32	 _IOW('B', 103, struct bpf_program32)
@@ -154,6 +157,39 @@ struct bpf_version {
 #define	BIOCSRTIMEOUT32	 _IOW('B', 122, struct timeval32)
 #define	BIOCGRTIMEOUT32	 _IOR('B', 123, struct timeval32)
 
+/*
+ * Memory-mapped capture ring.  BIOCSRING allocates brq_nblocks blocks of
+ * brq_blocksize bytes each, which the consumer then maps with mmap(2) at
+ * offset 0.  From then on captured packets are written directly into the
+ * ring instead of being copied out by read(2), which fails with EBUSY.
+ *
+ * Each block starts with a bpf_block_hdr, followed from bbh_offset by
+ * packets in the same bpf_hdr format that read(2) returns.  A block belongs
+ * to the kernel while bbh_status is BPF_BLOCK_KERNEL.  The kernel retires a
+ * block to the consumer, by setting BPF_BLOCK_USER and waking up poll(2),
+ * when the next packet will not fit in it, when brq_timeout milliseconds
+ * have passed with packets in it, or after every packet in immediate mode.
+ * The consumer processes blocks in ring order and hands each back by storing
+ * BPF_BLOCK_KERNEL to bbh_status.  Packets that arrive while the next block
+ * still belongs to the consumer are dropped, and counted in bs_drop.
+ */
+struct bpf_ring_req {
+	uint32_t	brq_blocksize;	/* bytes per block, a multiple of 8 */
+	uint32_t	brq_nblocks;	/* number of blocks */
+	uint32_t	brq_timeout;	/* retire timeout in ms, or 0 */
+};
+
+struct bpf_block_hdr {
+	volatile uint32_t bbh_status;	/* BPF_BLOCK_KERNEL or _USER */
+	uint32_t	bbh_npkts;	/* number of packets in the block */
+	uint32_t	bbh_offset;	/* offset of the first packet */
+	uint32_t	bbh_len;	/* bytes used, including this header */
+	uint64_t	bbh_seq;	/* sequence number of the block */
+};
+
+#define	BPF_BLOCK_KERNEL	0
+#define	BPF_BLOCK_USER		1
+
 /*
  * Structure prepended to each packet. This is "wire" format, so we
  * cannot change it unfortunately to 64 bit times on 32 bit systems [yet].
@@ -40,6 +40,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef _NET_BPFDESC_H_
@@ -49,6 +50,8 @@
 #include <sys/mutex.h>
 #include <sys/condvar.h>
 #include <sys/queue.h>
+#include <sys/poll.h>
+#include <sys/ddidevmap.h>
 
 /*
  * Access to "layer 2" networking is provided through each such provider
@@ -135,6 +138,7 @@ struct bpf_d {
 	ulong_t		bd_rtout;	/* Read timeout in 'ticks' */
 	struct bpf_insn *bd_filter; 	/* filter code */
 	size_t		bd_filter_size;
+	struct ip_bpf_jit *bd_jit;	/* compiled bd_filter */
 	ulong_t		bd_rcount;	/* number of packets received */
 	ulong_t		bd_dcount;	/* number of packets dropped */
 	ulong_t		bd_ccount;	/* number of packets captured */
@@ -176,6 +180,26 @@ struct bpf_d {
 	 * be kept across changing DLT or network interface.
 	 */
 	int		bd_promisc_flags;
+	/*
+	 * The capture ring set up by BIOCSRING, if any.  The block headers
+	 * in the ring are writable by the consumer, so the kernel keeps its
+	 * own record of how far it has filled the current block.
+	 */
+	caddr_t		bd_ring;
+	ddi_umem_cookie_t bd_ring_cookie;
+	size_t		bd_ring_size;	/* bytes, rounded up to pages */
+	uint32_t	bd_ring_bsize;	/* bytes per block */
+	uint32_t	bd_ring_nblocks;
+	uint32_t	bd_ring_cur;	/* block being filled */
+	uint32_t	bd_ring_len;	/* bytes of packets in bd_ring_cur */
+	uint32_t	bd_ring_npkts;	/* packets in bd_ring_cur */
+	uint32_t	bd_ring_tail;	/* oldest block retired */
+	uint32_t	bd_ring_nuser;	/* blocks retired and not returned */
+	uint64_t	bd_ring_seq;	/* blocks retired, ever */
+	clock_t		bd_ring_tout;	/* retire timeout, in ticks */
+	timeout_id_t	bd_ring_tid;
+	boolean_t	bd_ring_wakeup;	/* pollwakeup() once bd_lock drops */
+	struct pollhead	bd_poll;
 };
 
 
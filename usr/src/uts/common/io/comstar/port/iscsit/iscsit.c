@@ -22,7 +22,7 @@
  * Copyright (c) 2008, 2010, Oracle and/or its affiliates. All rights reserved.
  *
  * Copyright 2017 Nexenta Systems, Inc.
- * Copyright (c) 2017, Joyent, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/cpuvar.h>
@@ -119,6 +119,16 @@ kmem_cache_t	*iscsit_status_pdu_cache;
 
 boolean_t	iscsit_sm_logging = B_FALSE;
 
+/*
+ * Read data from LUs that can lend us their own buffers (zvols, through
+ * sbd) is sent straight from those buffers on TCP connections, rather
+ * than being copied into an IDM buffer first.  Set iscsit_zcopy_read to
+ * B_FALSE to always copy.  Reads smaller than iscsit_zcopy_threshold are
+ * copied anyway, since then the copy is cheaper than lending the buffers.
+ */
+boolean_t	iscsit_zcopy_read = B_TRUE;
+uint32_t	iscsit_zcopy_threshold = PAGESIZE;
+
 kmutex_t	login_sm_session_mutex;
 
 static idm_status_t iscsit_init(dev_info_t *dip);
@@ -200,6 +210,12 @@ iscsit_dbuf_alloc(scsi_task_t *task, uint32_t size, uint32_t *pminsize,
 static void
 iscsit_dbuf_free(stmf_dbuf_store_t *ds, stmf_data_buf_t *dbuf);
 
+static stmf_status_t
+iscsit_dbuf_setup(scsi_task_t *task, stmf_data_buf_t *dbuf, uint32_t flags);
+
+static void
+iscsit_dbuf_teardown(stmf_dbuf_store_t *ds, stmf_data_buf_t *dbuf);
+
 static void
 iscsit_buf_xfer_cb(idm_buf_t *idb, idm_status_t status);
 
@@ -707,6 +723,8 @@ iscsit_enable_svc(iscsit_hostinfo_t *hostinfo)
 	}
 	dbuf_store->ds_alloc_data_buf = iscsit_dbuf_alloc;
 	dbuf_store->ds_free_data_buf = iscsit_dbuf_free;
+	dbuf_store->ds_setup_dbuf = iscsit_dbuf_setup;
+	dbuf_store->ds_teardown_dbuf = iscsit_dbuf_teardown;
 	dbuf_store->ds_port_private = NULL;
 	iscsit_global.global_dbuf_store = dbuf_store;
 
@@ -1525,6 +1543,65 @@ iscsit_dbuf_free(stmf_dbuf_store_t *ds, stmf_data_buf_t *dbuf)
 	}
 }
 
+/*
+ * Prepare a buffer lent to us by the LU (DB_LU_DATA_BUF) for transfer by
+ * wrapping its scatter/gather list in a segmented IDM buffer, so that
+ * the data goes from the LU's buffers straight into the socket.  We only
+ * accept such buffers for reads; see TASK_AF_ACCEPT_LU_DBUF in
+ * iscsit_post_scsi_cmd().
+ */
+/*ARGSUSED*/
+static stmf_status_t
+iscsit_dbuf_setup(scsi_task_t *task, stmf_data_buf_t *dbuf, uint32_t flags)
+{
+	iscsit_task_t	*itask = task->task_port_private;
+	iscsit_buf_t	*ibuf;
+	struct iovec	*iov;
+	size_t		size;
+	int		i;
+
+	if ((dbuf->db_flags & DB_DIRECTION_TO_RPORT) == 0 ||
+	    dbuf->db_data_size > itask->it_ict->ict_op.op_max_burst_length)
+		return (STMF_FAILURE);
+
+	/* The iovec array follows the iscsit_buf_t */
+	size = sizeof (iscsit_buf_t) +
+	    dbuf->db_sglist_length * sizeof (struct iovec);
+	ibuf = kmem_zalloc(size, KM_NOSLEEP);
+	if (ibuf == NULL)
+		return (STMF_FAILURE);
+
+	iov = (struct iovec *)(ibuf + 1);
+	for (i = 0; i < dbuf->db_sglist_length; i++) {
+		iov[i].iov_base = (caddr_t)dbuf->db_sglist[i].seg_addr;
+		iov[i].iov_len = dbuf->db_sglist[i].seg_length;
+	}
+
+	ibuf->ibuf_idm_buf = idm_buf_alloc_iov(itask->it_ict->ict_ic, iov,
+	    dbuf->db_sglist_length, dbuf->db_data_size);
+	if (ibuf->ibuf_idm_buf == NULL) {
+		kmem_free(ibuf, size);
+		return (STMF_FAILURE);
+	}
+	ibuf->ibuf_stmf_buf = dbuf;
+	ibuf->ibuf_is_immed = B_FALSE;
+	dbuf->db_port_private = ibuf;
+
+	return (STMF_SUCCESS);
+}
+
+/*ARGSUSED*/
+static void
+iscsit_dbuf_teardown(stmf_dbuf_store_t *ds, stmf_data_buf_t *dbuf)
+{
+	iscsit_buf_t *ibuf = dbuf->db_port_private;
+
+	idm_buf_free(ibuf->ibuf_idm_buf);
+	kmem_free(ibuf, sizeof (iscsit_buf_t) +
+	    dbuf->db_sglist_length * sizeof (struct iovec));
+	dbuf->db_port_private = NULL;
+}
+
 /*ARGSUSED*/
 stmf_status_t
 iscsit_xfer_scsi_data(scsi_task_t *task, stmf_data_buf_t *dbuf,
@@ -2121,6 +2198,19 @@ iscsit_post_scsi_cmd(idm_conn_t *ic, idm_pdu_t *rx_pdu)
 	task->task_priority = 0;
 	task->task_mgmt_function = TM_NONE;
 
+	/*
+	 * Let the LU lend us its buffers for reads (iscsit_dbuf_setup).
+	 * Write data is received straight off the socket into contiguous
+	 * IDM buffers, so writes always use our own.
+	 */
+	if (iscsit_zcopy_read && idm_buf_iov_capable(ic) &&
+	    (task->task_flags & (TF_READ_DATA | TF_WRITE_DATA)) ==
+	    TF_READ_DATA) {
+		task->task_additional_flags |= TASK_AF_ACCEPT_LU_DBUF;
+		task->task_copy_threshold = iscsit_zcopy_threshold;
+		task->task_max_xfer_len = ict->ict_op.op_max_burst_length;
+	}
+
 	/*
 	 * This "task_max_nbufs" doesn't map well to BIDI.  We probably need
 	 * parameter for each direction.  "MaxOutstandingR2T" may very well
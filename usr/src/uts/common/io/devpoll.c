@@ -232,6 +232,48 @@ dpinfo(dev_info_t *dip, ddi_info_cmd_t infocmd, void *arg, void **result)
 	return (error);
 }
 
+/*
+ * Called by dp_pcache_poll for each polldat it took off the ready list, once
+ * it is done with it.  If the fd is still marked in the bitmap (it is
+ * level-triggered and still ready, or another event arrived meanwhile), hold
+ * it for the ready list again; it is put back at the end of the pass so that
+ * one pass does not visit it twice.
+ */
+static void
+dp_ready_done(pollcache_t *pcp, polldat_t *pdp, polldat_t **headp,
+    polldat_t **tailp)
+{
+	ASSERT(pdp->pd_flags & PDF_READY);
+	if (!BT_TEST(pcp->pc_bitmap, pdp->pd_fd)) {
+		pdp->pd_flags &= ~PDF_READY;
+		return;
+	}
+	pdp->pd_rnext = NULL;
+	if (*tailp == NULL) {
+		*headp = pdp;
+	} else {
+		(*tailp)->pd_rnext = pdp;
+	}
+	*tailp = pdp;
+}
+
+/*
+ * Return polldats held by dp_ready_done to the end of the ready list.
+ */
+static void
+dp_ready_requeue(pollcache_t *pcp, polldat_t **headp, polldat_t **tailp)
+{
+	if (*headp == NULL)
+		return;
+	if (pcp->pc_ready_tail == NULL) {
+		pcp->pc_ready = *headp;
+	} else {
+		pcp->pc_ready_tail->pd_rnext = *headp;
+	}
+	pcp->pc_ready_tail = *tailp;
+	*headp = *tailp = NULL;
+}
+
 /*
  * dp_pcache_poll has similar logic to pcache_poll() in poll.c. The major
  * differences are: (1) /dev/poll requires scanning the bitmap starting at
@@ -240,6 +282,11 @@ dpinfo(dev_info_t *dip, ddi_info_cmd_t infocmd, void *arg, void **result)
  * closed, some polldats in cache may refer to closed or reused fds. We
  * need to check for those cases.
  *
+ * Epoll-enabled pollcaches don't scan the bitmap at all, but take the fds
+ * to examine off the pollcache ready list (see pcache_ready_insert()), so
+ * the cost of a DP_POLL is proportional to the number of ready fds rather
+ * than the number of cached ones.
+ *
  * NOTE: Upon closing an fd, automatic poll cache cleanup is done for
  *	 poll(2) caches but NOT for /dev/poll caches. So expect some
  *	 stale entries!
@@ -254,6 +301,8 @@ dp_pcache_poll(dp_entry_t *dpep, void *dpbuf, pollcache_t *pcp, nfds_t nfds,
 	epoll_event_t	*epoll;
 	const short	mask = POLLRDHUP | POLLWRBAND;
 	const boolean_t	is_epoll = (dpep->dpe_flag & DP_ISEPOLLCOMPAT) != 0;
+	const boolean_t	use_ready = (pcp->pc_flag & PC_EPOLL) != 0;
+	polldat_t	*rdp = NULL, *rhead = NULL, *rtail = NULL;
 
 	ASSERT(MUTEX_HELD(&pcp->pc_lock));
 	if (pcp->pc_bitmap == NULL) {
@@ -269,6 +318,13 @@ dp_pcache_poll(dp_entry_t *dpep, void *dpbuf, pollcache_t *pcp, nfds_t nfds,
 		epoll = NULL;
 	}
 retry:
+	if (use_ready) {
+		if (rdp != NULL) {
+			dp_ready_done(pcp, rdp, &rhead, &rtail);
+			rdp = NULL;
+		}
+		dp_ready_requeue(pcp, &rhead, &rtail);
+	}
 	start = ostart = pcp->pc_mapstart;
 	end = pcp->pc_mapend;
 
@@ -292,26 +348,42 @@ retry:
 		 * Examine the bit map in a circular fashion
 		 * to avoid starvation. Always resume from
 		 * last stop. Scan till end of the map. Then
-		 * wrap around.
+		 * wrap around.  With a ready list, just take the next fd
+		 * off it instead.
 		 */
-		fd = bt_getlowbit(pcp->pc_bitmap, start, end);
-		ASSERT(fd <= end);
+		if (use_ready) {
+			if (rdp != NULL)
+				dp_ready_done(pcp, rdp, &rhead, &rtail);
+			rdp = pcache_ready_remove(pcp);
+			fd = (rdp != NULL) ? rdp->pd_fd : -1;
+		} else {
+			fd = bt_getlowbit(pcp->pc_bitmap, start, end);
+			ASSERT(fd <= end);
+		}
 		if (fd >= 0) {
 			file_t *fp;
 			polldat_t *pdp;
 
-			if (fd == end) {
-				if (no_wrap) {
-					done = B_TRUE;
-				} else {
-					start = 0;
-					end = ostart - 1;
-					no_wrap = B_TRUE;
+			if (use_ready) {
+				pdp = rdp;
+				if (!BT_TEST(pcp->pc_bitmap, fd)) {
+					/* Cleared since it was queued */
+					continue;
 				}
 			} else {
-				start = fd + 1;
+				if (fd == end) {
+					if (no_wrap) {
+						done = B_TRUE;
+					} else {
+						start = 0;
+						end = ostart - 1;
+						no_wrap = B_TRUE;
+					}
+				} else {
+					start = fd + 1;
+				}
+				pdp = pcache_lookup_fd(pcp, fd);
 			}
-			pdp = pcache_lookup_fd(pcp, fd);
 repoll:
 			ASSERT(pdp != NULL);
 			ASSERT(pdp->pd_fd == fd);
@@ -628,7 +700,7 @@ repoll:
 			/*
 			 * No bit set in the range. Check for wrap around.
 			 */
-			if (!no_wrap) {
+			if (!no_wrap && !use_ready) {
 				start = 0;
 				end = ostart - 1;
 				no_wrap = B_TRUE;
@@ -638,7 +710,11 @@ repoll:
 		}
 	}
 
-	if (!done) {
+	if (use_ready) {
+		if (rdp != NULL)
+			dp_ready_done(pcp, rdp, &rhead, &rtail);
+		dp_ready_requeue(pcp, &rhead, &rtail);
+	} else if (!done) {
 		pcp->pc_mapstart = start;
 	}
 	ASSERT(*fdcntp == 0);
@@ -953,6 +1029,12 @@ dpwrite(dev_t dev, struct uio *uiop, cred_t *credp)
 
 				epfdp = (dvpoll_epollfd_t *)pfdp;
 				pdp->pd_epolldata = epfdp->dpep_data;
+				if (epfdp->dpep_pollfd.revents &
+				    DP_EPOLL_EXCLUSIVE) {
+					pdp->pd_flags |= PDF_EXCLUSIVE;
+				} else {
+					pdp->pd_flags &= ~PDF_EXCLUSIVE;
+				}
 			}
 
 			ASSERT(pdp->pd_fd == fd);
@@ -1046,7 +1128,7 @@ dpwrite(dev_t dev, struct uio *uiop, cred_t *credp)
 			 * DP_POLL.  We also attempt a pollhead_insert();
 			 * if it's not possible, we'll do it in dpioctl().
 			 */
-			BT_SET(pcp->pc_bitmap, fd);
+			pcache_ready_insert(pcp, pdp);
 			if (error != 0) {
 				releasef(fd);
 				break;
@@ -1086,6 +1168,7 @@ dpwrite(dev_t dev, struct uio *uiop, cred_t *credp)
 			ASSERT(pdp->pd_fd == fd);
 			pdp->pd_fp = NULL;
 			pdp->pd_events = 0;
+			pdp->pd_flags &= ~PDF_EXCLUSIVE;
 			ASSERT(pdp->pd_thread == NULL);
 			if (pdp->pd_php != NULL) {
 				pollhead_delete(pdp->pd_php, pdp);
@@ -1179,9 +1262,25 @@ dpioctl(dev_t dev, int cmd, intptr_t arg, int mode, cred_t *credp, int *rvalp)
 		 */
 		dpep->dpe_flag |= DP_ISEPOLLCOMPAT;
 
-		/* Record the epoll-enabled nature in the pollcache too */
+		/*
+		 * Record the epoll-enabled nature in the pollcache too, and
+		 * queue any fds already marked in the bitmap on the ready
+		 * list which DP_POLL will use from now on.
+		 */
 		mutex_enter(&pcp->pc_lock);
 		pcp->pc_flag |= PC_EPOLL;
+		if (pcp->pc_bitmap != NULL) {
+			int fd = 0;
+			polldat_t *pdp;
+
+			while (fd <= pcp->pc_mapend &&
+			    (fd = bt_getlowbit(pcp->pc_bitmap, fd,
+			    pcp->pc_mapend)) >= 0) {
+				if ((pdp = pcache_lookup_fd(pcp, fd)) != NULL)
+					pcache_ready_insert(pcp, pdp);
+				fd++;
+			}
+		}
 		mutex_exit(&pcp->pc_lock);
 
 		mutex_exit(&dpep->dpe_lock);
@@ -1409,8 +1508,10 @@ dpioctl(dev_t dev, int cmd, intptr_t arg, int mode, cred_t *credp, int *rvalp)
 				break;
 			}
 
+			pcp->pc_waiters++;
 			error = cv_timedwait_sig_hrtime(&pcp->pc_cv,
 			    &pcp->pc_lock, deadline);
+			pcp->pc_waiters--;
 
 			/*
 			 * If we were awakened by a signal or timeout then
@@ -1423,6 +1524,15 @@ dpioctl(dev_t dev, int cmd, intptr_t arg, int mode, cred_t *credp, int *rvalp)
 				error = 0;
 			}
 		}
+
+		/*
+		 * pollnotify() wakes only one thread sleeping on an epoll
+		 * handle; if we're leaving ready fds behind, pass the
+		 * wake-up on.
+		 */
+		if ((pcp->pc_flag & PC_EPOLL) && pcp->pc_ready != NULL &&
+		    pcp->pc_waiters > 0)
+			cv_signal(&pcp->pc_cv);
 		pollstate_exit(pcp);
 
 		DP_SIGMASK_RESTORE(ksetp);
@@ -28,6 +28,9 @@
 #define	I40E_PROP_RX_ITR	"_rx_intr_throttle"
 #define	I40E_PROP_TX_ITR	"_tx_intr_throttle"
 #define	I40E_PROP_OTHER_ITR	"_other_intr_throttle"
+#define	I40E_PROP_RSS_KEY	"_rss_key"
+#define	I40E_PROP_RSS_HASH	"_rss_hash"
+#define	I40E_PROP_RSS_TABLE	"_rss_table"
 
 char *i40e_priv_props[] = {
 	I40E_PROP_RX_DMA_THRESH,
@@ -35,6 +38,9 @@ char *i40e_priv_props[] = {
 	I40E_PROP_RX_ITR,
 	I40E_PROP_TX_ITR,
 	I40E_PROP_OTHER_ITR,
+	I40E_PROP_RSS_KEY,
+	I40E_PROP_RSS_HASH,
+	I40E_PROP_RSS_TABLE,
 	NULL
 };
 
@@ -762,6 +768,31 @@ i40e_m_getcapab(void *arg, mac_capab_t cap, void *cap_data)
 		break;
 	}
 
+	case MAC_CAPAB_TUNNEL: {
+		mac_capab_tunnel_t *cap_tunnel = cap_data;
+
+		/*
+		 * The controller can offload the inner checksums and TSO of
+		 * VXLAN encapsulated frames given the tunneling parameters in
+		 * the transmit context descriptor.
+		 */
+		if (i40e->i40e_tx_hcksum_enable != B_TRUE)
+			return (B_FALSE);
+
+		bzero(cap_tunnel, sizeof (*cap_tunnel));
+		cap_tunnel->mct_types = MAC_TUNNEL_VXLAN;
+		cap_tunnel->mct_flags = MCT_F_INNER_HCKSUM;
+		cap_tunnel->mct_hcksum_flags = HCKSUM_INET_PARTIAL |
+		    HCKSUM_IPHDRCKSUM;
+		if (i40e->i40e_tx_lso_enable == B_TRUE) {
+			cap_tunnel->mct_flags |= MCT_F_LSO;
+			cap_tunnel->mct_lso_flags = LSO_TX_BASIC_TCP_IPV4 |
+			    LSO_TX_BASIC_TCP_IPV6;
+			cap_tunnel->mct_lso_max = I40E_LSO_MAXLEN;
+		}
+		break;
+	}
+
 	case MAC_CAPAB_RINGS:
 		cap_rings = cap_data;
 		cap_rings->mr_group_type = MAC_GROUP_TYPE_STATIC;
@@ -834,6 +865,16 @@ i40e_m_setprop_private(i40e_t *i40e, const char *pr_name, uint_t pr_valsize,
 
 	ASSERT(MUTEX_HELD(&i40e->i40e_general_lock));
 
+	/*
+	 * The RSS properties are strings rather than numbers.
+	 */
+	if (strcmp(pr_name, I40E_PROP_RSS_KEY) == 0)
+		return (i40e_rss_set_key(i40e, pr_val));
+	if (strcmp(pr_name, I40E_PROP_RSS_HASH) == 0)
+		return (i40e_rss_set_hash(i40e, pr_val));
+	if (strcmp(pr_name, I40E_PROP_RSS_TABLE) == 0)
+		return (i40e_rss_set_table(i40e, pr_val));
+
 	if ((ret = ddi_strtol(pr_val, &eptr, 10, &val)) != 0 ||
 	    *eptr != '\0') {
 		return (ret);
@@ -899,6 +940,13 @@ i40e_m_getprop_private(i40e_t *i40e, const char *pr_name, uint_t pr_valsize,
 
 	ASSERT(MUTEX_HELD(&i40e->i40e_general_lock));
 
+	if (strcmp(pr_name, I40E_PROP_RSS_KEY) == 0)
+		return (i40e_rss_get_key(i40e, pr_val, pr_valsize));
+	if (strcmp(pr_name, I40E_PROP_RSS_HASH) == 0)
+		return (i40e_rss_get_hash(i40e, pr_val, pr_valsize));
+	if (strcmp(pr_name, I40E_PROP_RSS_TABLE) == 0)
+		return (i40e_rss_get_table(i40e, pr_val, pr_valsize));
+
 	if (strcmp(pr_name, I40E_PROP_RX_DMA_THRESH) == 0) {
 		val = i40e->i40e_rx_dma_min;
 	} else if (strcmp(pr_name, I40E_PROP_TX_DMA_THRESH) == 0) {
@@ -932,6 +980,22 @@ i40e_m_propinfo_private(i40e_t *i40e, const char *pr_name,
 	char buf[64];
 	uint32_t def;
 
+	/*
+	 * The RSS key is random, and the default LUT depends on the number
+	 * of queues, so only the hash types have a fixed default.
+	 */
+	if (strcmp(pr_name, I40E_PROP_RSS_KEY) == 0 ||
+	    strcmp(pr_name, I40E_PROP_RSS_TABLE) == 0) {
+		mac_prop_info_set_perm(prh, MAC_PROP_PERM_RW);
+		return;
+	}
+	if (strcmp(pr_name, I40E_PROP_RSS_HASH) == 0) {
+		mac_prop_info_set_perm(prh, MAC_PROP_PERM_RW);
+		mac_prop_info_set_default_str(prh,
+		    "ipv4,tcp4,udp4,sctp4,ipv6,tcp6,udp6,sctp6,l2");
+		return;
+	}
+
 	if (strcmp(pr_name, I40E_PROP_RX_DMA_THRESH) == 0) {
 		mac_prop_info_set_perm(prh, MAC_PROP_PERM_RW);
 		def = I40E_DEF_RX_DMA_THRESH;
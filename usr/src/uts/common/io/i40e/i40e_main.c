@@ -1583,6 +1583,39 @@ i40e_get_prop(i40e_t *i40e, char *prop, int min, int max, int def)
 	return (val);
 }
 
+/*
+ * The packet types which may be chosen for hashing with the _rss_hash
+ * property, and the PCTYPEs each one enables. The X722 splits some of these
+ * up further, which we enable alongside.
+ */
+typedef struct i40e_rss_hash_type {
+	const char	*irh_name;
+	uint64_t	irh_pctypes;
+	uint64_t	irh_pctypes_x722;
+} i40e_rss_hash_type_t;
+
+static const i40e_rss_hash_type_t i40e_rss_hash_types[] = {
+	{ "ipv4", (1ULL << I40E_FILTER_PCTYPE_NONF_IPV4_OTHER) |
+	    (1ULL << I40E_FILTER_PCTYPE_FRAG_IPV4), 0 },
+	{ "tcp4", (1ULL << I40E_FILTER_PCTYPE_NONF_IPV4_TCP),
+	    (1ULL << I40E_FILTER_PCTYPE_NONF_IPV4_TCP_SYN_NO_ACK) },
+	{ "udp4", (1ULL << I40E_FILTER_PCTYPE_NONF_IPV4_UDP),
+	    (1ULL << I40E_FILTER_PCTYPE_NONF_UNICAST_IPV4_UDP) |
+	    (1ULL << I40E_FILTER_PCTYPE_NONF_MULTICAST_IPV4_UDP) },
+	{ "sctp4", (1ULL << I40E_FILTER_PCTYPE_NONF_IPV4_SCTP), 0 },
+	{ "ipv6", (1ULL << I40E_FILTER_PCTYPE_NONF_IPV6_OTHER) |
+	    (1ULL << I40E_FILTER_PCTYPE_FRAG_IPV6), 0 },
+	{ "tcp6", (1ULL << I40E_FILTER_PCTYPE_NONF_IPV6_TCP),
+	    (1ULL << I40E_FILTER_PCTYPE_NONF_IPV6_TCP_SYN_NO_ACK) },
+	{ "udp6", (1ULL << I40E_FILTER_PCTYPE_NONF_IPV6_UDP),
+	    (1ULL << I40E_FILTER_PCTYPE_NONF_UNICAST_IPV6_UDP) |
+	    (1ULL << I40E_FILTER_PCTYPE_NONF_MULTICAST_IPV6_UDP) },
+	{ "sctp6", (1ULL << I40E_FILTER_PCTYPE_NONF_IPV6_SCTP), 0 },
+	{ "l2", (1ULL << I40E_FILTER_PCTYPE_L2_PAYLOAD), 0 },
+};
+
+#define	I40E_RSS_HASH_ALL	((1U << ARRAY_SIZE(i40e_rss_hash_types)) - 1)
+
 static void
 i40e_init_properties(i40e_t *i40e)
 {
@@ -1650,6 +1683,15 @@ i40e_init_properties(i40e_t *i40e)
 	i40e->i40e_other_itr = i40e_get_prop(i40e, "other_intr_throttle",
 	    I40E_MIN_ITR, I40E_MAX_ITR, I40E_DEF_OTHER_ITR);
 
+	/*
+	 * The RSS key is chosen once for the life of the instance so that
+	 * flows keep hashing the same way across a restart.
+	 */
+	(void) random_get_pseudo_bytes((uint8_t *)i40e->i40e_rss_key,
+	    sizeof (i40e->i40e_rss_key));
+	i40e->i40e_rss_hash = I40E_RSS_HASH_ALL;
+	i40e->i40e_rss_table_len = 0;
+
 	if (!i40e->i40e_mr_enable) {
 		i40e->i40e_num_trqpairs = I40E_TRQPAIR_NOMSIX;
 		i40e->i40e_num_rx_groups = I40E_GROUP_NOMSIX;
@@ -2315,14 +2357,12 @@ static boolean_t
 i40e_config_rss_key_x722(i40e_t *i40e, i40e_hw_t *hw)
 {
 	for (uint_t i = 0; i < i40e->i40e_num_rx_groups; i++) {
-		uint32_t seed[I40E_PFQF_HKEY_MAX_INDEX + 1];
 		struct i40e_aqc_get_set_rss_key_data key;
 		const char *u8seed;
 		enum i40e_status_code status;
 		uint16_t vsi_number = i40e->i40e_vsis[i].iv_number;
 
-		(void) random_get_pseudo_bytes((uint8_t *)seed, sizeof (seed));
-		u8seed = (char *)seed;
+		u8seed = (char *)i40e->i40e_rss_key;
 
 		CTASSERT(sizeof (key) >= (sizeof (key.standard_rss_key) +
 		    sizeof (key.extended_hash_key)));
@@ -2348,7 +2388,8 @@ i40e_config_rss_key_x722(i40e_t *i40e, i40e_hw_t *hw)
 /*
  * Configure the RSS key. For the X710 controller family, this is set on a
  * per-PF basis via registers. For the X722, this is done on a per-VSI basis
- * through the admin queue.
+ * through the admin queue. The key itself is chosen at random at attach
+ * time, or set through the _rss_key property.
  */
 static boolean_t
 i40e_config_rss_key(i40e_t *i40e, i40e_hw_t *hw)
@@ -2357,9 +2398,8 @@ i40e_config_rss_key(i40e_t *i40e, i40e_hw_t *hw)
 		if (!i40e_config_rss_key_x722(i40e, hw))
 			return (B_FALSE);
 	} else {
-		uint32_t seed[I40E_PFQF_HKEY_MAX_INDEX + 1];
+		uint32_t *seed = i40e->i40e_rss_key;
 
-		(void) random_get_pseudo_bytes((uint8_t *)seed, sizeof (seed));
 		for (uint_t i = 0; i <= I40E_PFQF_HKEY_MAX_INDEX; i++)
 			i40e_write_rx_ctl(hw, I40E_PFQF_HKEY(i), seed[i]);
 	}
@@ -2377,7 +2417,8 @@ i40e_config_rss_key(i40e_t *i40e, i40e_hw_t *hw)
  * i40e_add_vsi() function to set the RSS LUT bits in the queueing section.
  *
  * We populate the LUT in a round robin fashion with the rx queue indices from 0
- * to i40e_num_trqpairs_per_vsi - 1.
+ * to i40e_num_trqpairs_per_vsi - 1, unless the _rss_table property has given
+ * us a pattern of queue indices to repeat across the table instead.
  */
 static boolean_t
 i40e_config_rss_hlut(i40e_t *i40e, i40e_hw_t *hw)
@@ -2408,8 +2449,14 @@ i40e_config_rss_hlut(i40e_t *i40e, i40e_hw_t *hw)
 	}
 
 	for (i = 0; i < I40E_HLUT_TABLE_SIZE; i++) {
-		((uint8_t *)hlut)[i] =
-		    (i % i40e->i40e_num_trqpairs_per_vsi) & lut_mask;
+		uint_t q;
+
+		if (i40e->i40e_rss_table_len != 0) {
+			q = i40e->i40e_rss_table[i % i40e->i40e_rss_table_len];
+		} else {
+			q = i % i40e->i40e_num_trqpairs_per_vsi;
+		}
+		((uint8_t *)hlut)[i] = q & lut_mask;
 	}
 
 	if (i40e_is_x722(i40e)) {
@@ -2434,6 +2481,28 @@ out:
 	return (ret);
 }
 
+static void
+i40e_config_rss_hena(i40e_t *i40e, i40e_hw_t *hw)
+{
+	uint64_t hena = 0;
+
+	for (uint_t i = 0; i < ARRAY_SIZE(i40e_rss_hash_types); i++) {
+		const i40e_rss_hash_type_t *t = &i40e_rss_hash_types[i];
+
+		if ((i40e->i40e_rss_hash & (1U << i)) == 0)
+			continue;
+		hena |= t->irh_pctypes;
+		/*
+		 * Add additional types supported by the X722 controller.
+		 */
+		if (i40e_is_x722(i40e))
+			hena |= t->irh_pctypes_x722;
+	}
+
+	i40e_write_rx_ctl(hw, I40E_PFQF_HENA(0), (uint32_t)hena);
+	i40e_write_rx_ctl(hw, I40E_PFQF_HENA(1), (uint32_t)(hena >> 32));
+}
+
 /*
  * Set up RSS.
  *	1. Seed the hash key.
@@ -2443,8 +2512,6 @@ out:
 static boolean_t
 i40e_config_rss(i40e_t *i40e, i40e_hw_t *hw)
 {
-	uint64_t hena;
-
 	/*
 	 * 1. Seed the hash key
 	 */
@@ -2454,37 +2521,214 @@ i40e_config_rss(i40e_t *i40e, i40e_hw_t *hw)
 	/*
 	 * 2. Configure PCTYPES
 	 */
-	hena = (1ULL << I40E_FILTER_PCTYPE_NONF_IPV4_OTHER) |
-	    (1ULL << I40E_FILTER_PCTYPE_NONF_IPV4_TCP) |
-	    (1ULL << I40E_FILTER_PCTYPE_NONF_IPV4_SCTP) |
-	    (1ULL << I40E_FILTER_PCTYPE_NONF_IPV4_UDP) |
-	    (1ULL << I40E_FILTER_PCTYPE_FRAG_IPV4) |
-	    (1ULL << I40E_FILTER_PCTYPE_NONF_IPV6_OTHER) |
-	    (1ULL << I40E_FILTER_PCTYPE_NONF_IPV6_TCP) |
-	    (1ULL << I40E_FILTER_PCTYPE_NONF_IPV6_SCTP) |
-	    (1ULL << I40E_FILTER_PCTYPE_NONF_IPV6_UDP) |
-	    (1ULL << I40E_FILTER_PCTYPE_FRAG_IPV6) |
-	    (1ULL << I40E_FILTER_PCTYPE_L2_PAYLOAD);
+	i40e_config_rss_hena(i40e, hw);
 
 	/*
-	 * Add additional types supported by the X722 controller.
+	 * 3. Populate LUT
 	 */
-	if (i40e_is_x722(i40e)) {
-		hena |= (1ULL << I40E_FILTER_PCTYPE_NONF_UNICAST_IPV4_UDP) |
-		    (1ULL << I40E_FILTER_PCTYPE_NONF_MULTICAST_IPV4_UDP) |
-		    (1ULL << I40E_FILTER_PCTYPE_NONF_IPV4_TCP_SYN_NO_ACK) |
-		    (1ULL << I40E_FILTER_PCTYPE_NONF_UNICAST_IPV6_UDP) |
-		    (1ULL << I40E_FILTER_PCTYPE_NONF_MULTICAST_IPV6_UDP) |
-		    (1ULL << I40E_FILTER_PCTYPE_NONF_IPV6_TCP_SYN_NO_ACK);
+	return (i40e_config_rss_hlut(i40e, hw));
+}
+
+/*
+ * The RSS key, hash types and LUT may all be changed at runtime through
+ * private link properties. The new settings are kept in the i40e_t so that
+ * they survive a restart of the chip, and are pushed to the hardware now if
+ * it's running. The caller holds the general lock.
+ */
+static int
+i40e_rss_update(i40e_t *i40e)
+{
+	i40e_hw_t *hw = &i40e->i40e_hw_space;
+
+	ASSERT(MUTEX_HELD(&i40e->i40e_general_lock));
+
+	if (!(i40e->i40e_state & I40E_STARTED))
+		return (0);
+
+	if (!i40e_config_rss(i40e, hw))
+		return (EIO);
+
+	if (i40e_check_acc_handle(i40e->i40e_osdep_space.ios_reg_handle) !=
+	    DDI_FM_OK) {
+		ddi_fm_service_impact(i40e->i40e_dip, DDI_SERVICE_DEGRADED);
+		return (EIO);
 	}
 
-	i40e_write_rx_ctl(hw, I40E_PFQF_HENA(0), (uint32_t)hena);
-	i40e_write_rx_ctl(hw, I40E_PFQF_HENA(1), (uint32_t)(hena >> 32));
+	return (0);
+}
+
+static int
+i40e_rss_hexval(char c)
+{
+	if (c >= '0' && c <= '9')
+		return (c - '0');
+	if (c >= 'a' && c <= 'f')
+		return (c - 'a' + 10);
+	if (c >= 'A' && c <= 'F')
+		return (c - 'A' + 10);
+	return (-1);
+}
+
+/*
+ * The key is given as a string of hex digits, two per byte, covering the
+ * whole of the key.
+ */
+int
+i40e_rss_set_key(i40e_t *i40e, const char *val)
+{
+	uint8_t key[sizeof (i40e->i40e_rss_key)];
+
+	if (strlen(val) != sizeof (key) * 2)
+		return (EINVAL);
+
+	for (uint_t i = 0; i < sizeof (key); i++) {
+		int hi = i40e_rss_hexval(val[i * 2]);
+		int lo = i40e_rss_hexval(val[i * 2 + 1]);
+
+		if (hi < 0 || lo < 0)
+			return (EINVAL);
+		key[i] = (hi << 4) | lo;
+	}
+
+	bcopy(key, i40e->i40e_rss_key, sizeof (key));
+	return (i40e_rss_update(i40e));
+}
+
+int
+i40e_rss_get_key(i40e_t *i40e, char *buf, uint_t len)
+{
+	const uint8_t *key = (const uint8_t *)i40e->i40e_rss_key;
+
+	if (len < sizeof (i40e->i40e_rss_key) * 2 + 1)
+		return (ERANGE);
+
+	for (uint_t i = 0; i < sizeof (i40e->i40e_rss_key); i++) {
+		(void) snprintf(&buf[i * 2], 3, "%02x", key[i]);
+	}
+	return (0);
+}
+
+/*
+ * Hash types are given as a comma-separated list of names from
+ * i40e_rss_hash_types.
+ */
+int
+i40e_rss_set_hash(i40e_t *i40e, const char *val)
+{
+	uint_t hash = 0;
+	const char *p = val;
+
+	while (*p != '\0') {
+		const char *end = strchr(p, ',');
+		size_t len = (end != NULL) ? end - p : strlen(p);
+		uint_t i;
+
+		for (i = 0; i < ARRAY_SIZE(i40e_rss_hash_types); i++) {
+			const char *name = i40e_rss_hash_types[i].irh_name;
+
+			if (strlen(name) == len && strncmp(name, p, len) == 0)
+				break;
+		}
+		if (i == ARRAY_SIZE(i40e_rss_hash_types))
+			return (EINVAL);
+		hash |= 1U << i;
+
+		p += len;
+		if (*p == ',')
+			p++;
+	}
+
+	if (hash == 0)
+		return (EINVAL);
+
+	i40e->i40e_rss_hash = hash;
+	return (i40e_rss_update(i40e));
+}
+
+int
+i40e_rss_get_hash(i40e_t *i40e, char *buf, uint_t len)
+{
+	size_t off = 0;
+
+	if (len == 0)
+		return (ERANGE);
+	buf[0] = '\0';
+
+	for (uint_t i = 0; i < ARRAY_SIZE(i40e_rss_hash_types); i++) {
+		if ((i40e->i40e_rss_hash & (1U << i)) == 0)
+			continue;
+		off += snprintf(&buf[off], len - off, "%s%s",
+		    off == 0 ? "" : ",", i40e_rss_hash_types[i].irh_name);
+		if (off >= len)
+			return (ERANGE);
+	}
+	return (0);
+}
+
+/*
+ * The LUT is given as a comma-separated list of queue indices within each
+ * VSI, which is repeated to fill the table. Listing a queue more often gives
+ * it a larger share of flows; leaving one out keeps hashed traffic off it.
+ */
+int
+i40e_rss_set_table(i40e_t *i40e, const char *val)
+{
+	uint8_t table[I40E_RSS_TABLE_PATTERN_MAX];
+	uint_t n = 0;
+	const char *p = val;
+
+	while (*p != '\0') {
+		unsigned long q;
+		char *end;
+
+		if (n == ARRAY_SIZE(table) ||
+		    ddi_strtoul(p, &end, 10, &q) != 0 || end == p ||
+		    (*end != ',' && *end != '\0') ||
+		    q >= i40e->i40e_num_trqpairs_per_vsi) {
+			return (EINVAL);
+		}
+		table[n++] = (uint8_t)q;
+
+		p = end;
+		if (*p == ',')
+			p++;
+	}
+
+	if (n == 0)
+		return (EINVAL);
+
+	bcopy(table, i40e->i40e_rss_table, n);
+	i40e->i40e_rss_table_len = n;
+	return (i40e_rss_update(i40e));
+}
+
+int
+i40e_rss_get_table(i40e_t *i40e, char *buf, uint_t len)
+{
+	uint_t n = i40e->i40e_rss_table_len;
+	size_t off = 0;
+
+	if (len == 0)
+		return (ERANGE);
+	buf[0] = '\0';
 
 	/*
-	 * 3. Populate LUT
+	 * The default round robin LUT is the same as the pattern of every
+	 * queue in order.
 	 */
-	return (i40e_config_rss_hlut(i40e, hw));
+	if (n == 0)
+		n = i40e->i40e_num_trqpairs_per_vsi;
+
+	for (uint_t i = 0; i < n; i++) {
+		uint_t q = (i40e->i40e_rss_table_len != 0) ?
+		    i40e->i40e_rss_table[i] : i;
+
+		off += snprintf(&buf[off], len - off, "%s%u",
+		    i == 0 ? "" : ",", q);
+		if (off >= len)
+			return (ERANGE);
+	}
+	return (0);
 }
 
 /*
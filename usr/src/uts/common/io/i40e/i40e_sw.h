@@ -62,6 +62,7 @@ extern "C" {
 #include <inet/nd.h>
 #include <netinet/udp.h>
 #include <netinet/sctp.h>
+#include <sys/vxlan.h>
 #include <sys/bitmap.h>
 #include <sys/cpuvar.h>
 #include <sys/ddifm.h>
@@ -331,6 +332,12 @@ typedef enum i40e_itr_index {
  */
 #define	I40E_HLUT_TABLE_SIZE	512
 
+/*
+ * The longest pattern of queues that the _rss_table property may specify. It
+ * is repeated to fill the HLUT.
+ */
+#define	I40E_RSS_TABLE_PATTERN_MAX	128
+
 /*
  * Bit flags for attach_progress
  */
@@ -898,6 +905,16 @@ typedef struct i40e {
 	uint32_t	i40e_tx_dma_min;
 	uint_t		i40e_tx_itr;
 
+	/*
+	 * RSS configuration, see i40e_config_rss(). i40e_rss_hash is a bitmask
+	 * of entries in i40e_rss_hash_types; a zero i40e_rss_table_len means
+	 * the default round robin HLUT.
+	 */
+	uint32_t	i40e_rss_key[I40E_PFQF_HKEY_MAX_INDEX + 1];
+	uint_t		i40e_rss_hash;
+	uint8_t		i40e_rss_table[I40E_RSS_TABLE_PATTERN_MAX];
+	uint_t		i40e_rss_table_len;
+
 	/*
 	 * Interrupt state
 	 */
@@ -998,6 +1015,16 @@ extern void i40e_log(i40e_t *, const char *, ...) __KPRINTFLIKE(2);
 extern void i40e_link_check(i40e_t *);
 extern void i40e_update_mtu(i40e_t *);
 
+/*
+ * RSS configuration through link properties.
+ */
+extern int i40e_rss_set_key(i40e_t *, const char *);
+extern int i40e_rss_get_key(i40e_t *, char *, uint_t);
+extern int i40e_rss_set_hash(i40e_t *, const char *);
+extern int i40e_rss_get_hash(i40e_t *, char *, uint_t);
+extern int i40e_rss_set_table(i40e_t *, const char *);
+extern int i40e_rss_get_table(i40e_t *, char *, uint_t);
+
 /*
  * FMA functions.
  */
@@ -407,6 +407,8 @@ typedef struct i40e_tx_context {
 	enum i40e_tx_ctx_desc_cmd_bits	itc_ctx_cmdflags;
 	uint32_t			itc_ctx_tsolen;
 	uint32_t			itc_ctx_mss;
+	uint32_t			itc_ctx_hdrlen;
+	uint32_t			itc_ctx_tunneling;
 } i40e_tx_context_t;
 
 /*
@@ -1664,12 +1666,20 @@ i40e_ring_rx_poll(void *arg, int poll_bytes)
  *
  * If the mblk requires LSO then we'll also gather the information that will be
  * used to construct the Transmit Context Descriptor.
+ *
+ * If the mblk is VXLAN encapsulated then the checksum and LSO flags describe
+ * the inner frame. In that case the data descriptor's MACLEN still covers the
+ * outer L2 header, but its IPLEN and L4LEN describe the inner headers, while
+ * the outer IP header and the UDP, VXLAN and inner L2 headers (the NATLEN) go
+ * in the context descriptor's tunneling parameters.
  */
 static int
 i40e_tx_context(i40e_t *i40e, i40e_trqpair_t *itrq, mblk_t *mp,
     mac_ether_offload_info_t *meo, i40e_tx_context_t *tctx)
 {
 	uint32_t chkflags, start, mss, lsoflags;
+	uint32_t maclen, hdroff;
+	mac_ether_offload_info_t omeo, imeo;
 	i40e_txq_stat_t *txs = &itrq->itrq_txstat;
 
 	bzero(tctx, sizeof (i40e_tx_context_t));
@@ -1683,6 +1693,36 @@ i40e_tx_context(i40e_t *i40e, i40e_trqpair_t *itrq, mblk_t *mp,
 	if (chkflags == 0 && lsoflags == 0)
 		return (0);
 
+	maclen = hdroff = meo->meoi_l2hlen;
+	if (mac_tunnel_get(mp) != 0) {
+		uint32_t natlen;
+
+		if (mac_ether_tunnel_offload_info(mp, &omeo, &imeo) != 0 ||
+		    (omeo.meoi_flags & MEOI_L4INFO_SET) == 0) {
+			txs->itxs_hck_meoifail.value.ui64++;
+			return (-1);
+		}
+
+		if (omeo.meoi_l3proto == ETHERTYPE_IP) {
+			tctx->itc_ctx_tunneling |= I40E_TX_CTX_EXT_IP_IPV4;
+		} else if (omeo.meoi_l3proto == ETHERTYPE_IPV6) {
+			tctx->itc_ctx_tunneling |= I40E_TX_CTX_EXT_IP_IPV6;
+		} else {
+			txs->itxs_hck_badl3.value.ui64++;
+			return (-1);
+		}
+		natlen = omeo.meoi_l4hlen + VXLAN_HDR_LEN + imeo.meoi_l2hlen;
+		tctx->itc_ctx_tunneling |= (omeo.meoi_l3hlen >> 2) <<
+		    I40E_TXD_CTX_QW0_EXT_IPLEN_SHIFT;
+		tctx->itc_ctx_tunneling |= I40E_TXD_CTX_UDP_TUNNELING;
+		tctx->itc_ctx_tunneling |= (natlen >> 1) <<
+		    I40E_TXD_CTX_QW0_NATLEN_SHIFT;
+
+		maclen = omeo.meoi_l2hlen;
+		hdroff = omeo.meoi_l2hlen + omeo.meoi_l3hlen + natlen;
+		meo = &imeo;
+	}
+
 	/*
 	 * Have we been asked to checksum an IPv4 header. If so, verify that we
 	 * have sufficient information and then set the proper fields in the
@@ -1702,7 +1742,7 @@ i40e_tx_context(i40e_t *i40e, i40e_trqpair_t *itrq, mblk_t *mp,
 			return (-1);
 		}
 		tctx->itc_data_cmdflags |= I40E_TX_DESC_CMD_IIPT_IPV4_CSUM;
-		tctx->itc_data_offsets |= (meo->meoi_l2hlen >> 1) <<
+		tctx->itc_data_offsets |= (maclen >> 1) <<
 		    I40E_TX_DESC_LENGTH_MACLEN_SHIFT;
 		tctx->itc_data_offsets |= (meo->meoi_l3hlen >> 2) <<
 		    I40E_TX_DESC_LENGTH_IPLEN_SHIFT;
@@ -1740,7 +1780,7 @@ i40e_tx_context(i40e_t *i40e, i40e_trqpair_t *itrq, mblk_t *mp,
 				txs->itxs_hck_badl3.value.ui64++;
 				return (-1);
 			}
-			tctx->itc_data_offsets |= (meo->meoi_l2hlen >> 1) <<
+			tctx->itc_data_offsets |= (maclen >> 1) <<
 			    I40E_TX_DESC_LENGTH_MACLEN_SHIFT;
 			tctx->itc_data_offsets |= (meo->meoi_l3hlen >> 2) <<
 			    I40E_TX_DESC_LENGTH_IPLEN_SHIFT;
@@ -1782,8 +1822,9 @@ i40e_tx_context(i40e_t *i40e, i40e_trqpair_t *itrq, mblk_t *mp,
 
 		tctx->itc_ctx_cmdflags |= I40E_TX_CTX_DESC_TSO;
 		tctx->itc_ctx_mss = mss;
-		tctx->itc_ctx_tsolen = msgsize(mp) -
-		    (meo->meoi_l2hlen + meo->meoi_l3hlen + meo->meoi_l4hlen);
+		tctx->itc_ctx_hdrlen = hdroff + meo->meoi_l3hlen +
+		    meo->meoi_l4hlen;
+		tctx->itc_ctx_tsolen = msgsize(mp) - tctx->itc_ctx_hdrlen;
 	}
 
 	return (0);
@@ -2357,8 +2398,7 @@ uint_t i40e_lso_num_descs = 7;
  */
 static i40e_tx_control_block_t *
 i40e_lso_chain(i40e_trqpair_t *itrq, const mblk_t *mp,
-    const mac_ether_offload_info_t *meo, const i40e_tx_context_t *tctx,
-    uint_t *ndesc)
+    const i40e_tx_context_t *tctx, uint_t *ndesc)
 {
 	size_t mp_len = MBLKL(mp);
 	/*
@@ -2378,8 +2418,7 @@ i40e_lso_chain(i40e_trqpair_t *itrq, const mblk_t *mp,
 	uint_t segdesc = 0;
 	uint_t needed_desc = 0;
 	size_t hdrcopied = 0;
-	const size_t hdrlen =
-	    meo->meoi_l2hlen + meo->meoi_l3hlen + meo->meoi_l4hlen;
+	const size_t hdrlen = tctx->itc_ctx_hdrlen;
 	const size_t mss = tctx->itc_ctx_mss;
 	boolean_t force_copy = B_FALSE;
 	i40e_tx_control_block_t *tcb = NULL, *tcbhead = NULL, *tcbtail = NULL;
@@ -2757,6 +2796,8 @@ i40e_ring_tx(void *arg, mblk_t *mp)
 		use_lso = B_TRUE;
 		do_ctx_desc = B_TRUE;
 	}
+	if (tctx.itc_ctx_tunneling != 0)
+		do_ctx_desc = B_TRUE;
 
 	/*
 	 * For the primordial driver we can punt on doing any recycling right
@@ -2785,7 +2826,7 @@ i40e_ring_tx(void *arg, mblk_t *mp)
 	if (!use_lso) {
 		tcbhead = i40e_non_lso_chain(itrq, mp, &needed_desc);
 	} else {
-		tcbhead = i40e_lso_chain(itrq, mp, &meo, &tctx, &needed_desc);
+		tcbhead = i40e_lso_chain(itrq, mp, &tctx, &needed_desc);
 	}
 
 	if (tcbhead == NULL)
@@ -2825,7 +2866,8 @@ i40e_ring_tx(void *arg, mblk_t *mp)
 
 		/* QW0 */
 		type = I40E_TX_DESC_DTYPE_CONTEXT;
-		ctxdesc->tunneling_params = 0;
+		ctxdesc->tunneling_params =
+		    CPU_TO_LE32(tctx.itc_ctx_tunneling);
 		ctxdesc->l2tag2 = 0;
 
 		/* QW1 */
@@ -21,6 +21,7 @@
 /*
  * Copyright (c) 2008, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright 2017 Nexenta Systems, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/cpuvar.h>
@@ -778,6 +779,9 @@ idm_buf_rx_from_ini(idm_task_t *idt, idm_buf_t *idb,
 {
 	idm_status_t rc;
 
+	/* Segmented buffers can only be transmitted */
+	ASSERT(idb->idb_iov == NULL);
+
 	idb->idb_bufoffset = offset;
 	idb->idb_xfer_len = xfer_len;
 	idb->idb_buf_cb = idb_buf_cb;
@@ -1001,6 +1005,8 @@ idm_buf_alloc(idm_conn_t *ic, void *bufptr, uint64_t buflen)
 	buf->idb_magic		= IDM_BUF_MAGIC;
 	buf->idb_in_transport	= B_FALSE;
 	buf->idb_bufbcopy	= B_FALSE;
+	buf->idb_iov		= NULL;
+	buf->idb_iovcnt		= 0;
 
 	/*
 	 * If bufptr is NULL, we have an implicit request to allocate
@@ -1054,6 +1060,59 @@ idm_buf_alloc(idm_conn_t *ic, void *bufptr, uint64_t buflen)
 	return (buf);
 }
 
+/*
+ * idm_buf_iov_capable
+ *
+ * Returns B_TRUE if the transport for this connection can send Data-In
+ * PDUs from a buffer allocated with idm_buf_alloc_iov().  The sockets
+ * transport copies PDU data into the socket only as it is sent, so it
+ * can gather the data from any number of segments; iSER would have to
+ * register each of them.
+ */
+boolean_t
+idm_buf_iov_capable(idm_conn_t *ic)
+{
+	return (ic->ic_transport_type == IDM_TRANSPORT_TYPE_SOCKETS);
+}
+
+/*
+ * idm_buf_alloc_iov
+ *
+ * Like idm_buf_alloc() with a caller-supplied buffer, except that the
+ * buffer is a list of iovcnt segments totalling buflen bytes.  This lets
+ * a target transmit data from wherever it already is (for example, DMU
+ * buffers loaned by a zvol) instead of copying it into one contiguous
+ * buffer first.  The buffer may only be used with idm_buf_tx_to_ini(),
+ * and the iovec array must stay valid until idm_buf_free().
+ *
+ * Returns NULL if the transport can't do this; see idm_buf_iov_capable().
+ */
+idm_buf_t *
+idm_buf_alloc_iov(idm_conn_t *ic, struct iovec *iov, int iovcnt,
+    uint64_t buflen)
+{
+	idm_buf_t	*buf;
+
+	ASSERT(iovcnt > 0);
+
+	if (!idm_buf_iov_capable(ic))
+		return (NULL);
+
+	/*
+	 * Setting up a caller-supplied buffer registers nothing with the
+	 * sockets transport, so the first segment stands in for the whole.
+	 */
+	buf = idm_buf_alloc(ic, iov[0].iov_base, buflen);
+	if (buf != NULL) {
+		ASSERT(!buf->idb_bufalloc);
+		buf->idb_buf = NULL;
+		buf->idb_iov = iov;
+		buf->idb_iovcnt = iovcnt;
+	}
+
+	return (buf);
+}
+
 /*
  * idm_buf_free
  *
@@ -25,7 +25,7 @@
 /*
  * Copyright (c) 2013 by Delphix. All rights reserved.
  * Copyright 2015 Nexenta Systems, Inc.  All rights reserved.
- * Copyright (c) 2017, Joyent, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/conf.h>
@@ -2295,7 +2295,8 @@ idm_i_so_tx(idm_pdu_t *pdu)
 	uint32_t	data_digest_crc = 0;
 	int		total_len = 0;
 	int		iovlen = 0;
-	struct iovec	iov[6];
+	int		i;
+	struct iovec	iov[4 + PDU_MAX_IOVLEN];
 	idm_so_conn_t	*so_conn;
 
 	so_conn = ic->ic_transport_private;
@@ -2349,10 +2350,15 @@ idm_i_so_tx(idm_pdu_t *pdu)
 			}
 		}
 
-		iov[iovlen].iov_base = (caddr_t)pdu->isp_data;
-		iov[iovlen].iov_len  = pdu->isp_datalen;
-		total_len += iov[iovlen].iov_len;
-		iovlen++;
+		if (pdu->isp_flags & IDM_PDU_DATA_IOV) {
+			for (i = 0; i < pdu->isp_iovlen; i++)
+				iov[iovlen++] = pdu->isp_iov[i];
+		} else {
+			iov[iovlen].iov_base = (caddr_t)pdu->isp_data;
+			iov[iovlen].iov_len  = pdu->isp_datalen;
+			iovlen++;
+		}
+		total_len += pdu->isp_datalen;
 	}
 
 	/* Setup the data pad if necessary */
@@ -2379,7 +2385,15 @@ idm_i_so_tx(idm_pdu_t *pdu)
 		 * RFC3720/10.2.3: A zero-length Data Segment also
 		 * implies a zero-length data digest.
 		 */
-		if (pdu->isp_datalen) {
+		if (pdu->isp_flags & IDM_PDU_DATA_IOV) {
+			data_digest_crc = idm_crc32c(pdu->isp_iov[0].iov_base,
+			    pdu->isp_iov[0].iov_len);
+			for (i = 1; i < pdu->isp_iovlen; i++) {
+				data_digest_crc = idm_crc32c_continued(
+				    pdu->isp_iov[i].iov_base,
+				    pdu->isp_iov[i].iov_len, data_digest_crc);
+			}
+		} else if (pdu->isp_datalen) {
 			data_digest_crc = idm_crc32c(pdu->isp_data,
 			    pdu->isp_datalen);
 		}
@@ -2685,6 +2699,42 @@ idm_so_send_rtt_data_done(idm_task_t *idt, idm_buf_t *idb)
 	idm_buf_free(idb);
 }
 
+/*
+ * Point the data of a Data-In PDU at up to len bytes of a segmented buffer
+ * (see idm_buf_alloc_iov()), starting at buffer offset ro.  Returns the
+ * number of bytes covered, which is less than len if the PDU ran out of
+ * iovecs first.
+ */
+static size_t
+idm_so_fill_tx_iov(idm_pdu_t *pdu, idm_buf_t *idb, uint32_t ro, size_t len)
+{
+	struct iovec	*iov = idb->idb_iov;
+	struct iovec	*end = iov + idb->idb_iovcnt;
+	size_t		n, xfer = 0;
+
+	while (iov < end && ro >= iov->iov_len) {
+		ro -= iov->iov_len;
+		iov++;
+	}
+
+	pdu->isp_iovlen = 0;
+	while (iov < end && xfer < len && pdu->isp_iovlen < PDU_MAX_IOVLEN) {
+		n = MIN(iov->iov_len - ro, len - xfer);
+		pdu->isp_iov[pdu->isp_iovlen].iov_base = iov->iov_base + ro;
+		pdu->isp_iov[pdu->isp_iovlen].iov_len = n;
+		pdu->isp_iovlen++;
+		xfer += n;
+		ro = 0;
+		iov++;
+	}
+	ASSERT(xfer > 0);
+
+	pdu->isp_data = NULL;
+	pdu->isp_flags |= IDM_PDU_DATA_IOV;
+
+	return (xfer);
+}
+
 static idm_status_t
 idm_so_send_buf_region(idm_task_t *idt, idm_buf_t *idb,
     uint32_t buf_region_offset, uint32_t buf_region_length)
@@ -2740,13 +2790,21 @@ idm_so_send_buf_region(idm_task_t *idt, idm_buf_t *idb,
 
 		bhs->datasn		= htonl(idt->idt_exp_datasn++);
 
+		/*
+		 * Setup data.  A segmented buffer may need more iovecs than
+		 * a PDU has, in which case this PDU carries less data.
+		 */
+		if (idb->idb_iov != NULL) {
+			chunk = idm_so_fill_tx_iov(pdu, idb, data_offset,
+			    chunk);
+		} else {
+			pdu->isp_data = (uint8_t *)idb->idb_buf + data_offset;
+		}
+		pdu->isp_datalen = (uint_t)chunk;
+
 		hton24(bhs->dlength, chunk);
 		bhs->offset = htonl(idb->idb_bufoffset + data_offset);
 
-		/* setup data */
-		pdu->isp_data	=  (uint8_t *)idb->idb_buf + data_offset;
-		pdu->isp_datalen = (uint_t)chunk;
-
 		if (chunk == remainder) {
 			bhs->flags = ISCSI_FLAG_FINAL; /* F bit set to 1 */
 			/* Piggyback the status with the last data PDU */
@@ -2821,6 +2879,7 @@ idm_sotx_cache_pdu_cb(idm_pdu_t *pdu, idm_status_t status)
 {
 	/* reset values between use */
 	pdu->isp_datalen = 0;
+	pdu->isp_iovlen = 0;
 
 	kmem_cache_free(idm.idm_sotx_pdu_cache, pdu);
 }
@@ -93,6 +93,7 @@ struct inotify_state {
 	vmem_t *ins_wds;			/* watch identifier arena */
 	int ins_maxwatches;			/* maximum number of watches */
 	int ins_maxevents;			/* maximum number of events */
+	int32_t ins_maxsize;			/* maximum size of events */
 	int ins_nevents;			/* current # of events */
 	int32_t ins_size;			/* total size of events */
 	inotify_kevent_t *ins_head;		/* head of event queue */
@@ -112,6 +113,7 @@ struct inotify_state {
 int	inotify_maxwatches = 8192;		/* max watches per instance */
 int	inotify_maxevents = 16384;		/* max events */
 int	inotify_maxinstances = 128;		/* max instances per user */
+int	inotify_maxsize = 4 * 1024 * 1024;	/* max bytes of queued events */
 
 /*
  * Internal global variables.
@@ -466,42 +468,46 @@ inotify_watch_event(inotify_watch_t *watch, uint64_t mask, char *name)
 	if (mask & (IN_MOVED_FROM | IN_MOVED_TO))
 		cookie = (uint32_t)curthread->t_did;
 
-	if (state->ins_nevents >= state->ins_maxevents) {
+	if (name != NULL) {
+		/*
+		 * We are in the context of a file event monitoring operation,
+		 * so the name length is bounded by the kernel.
+		 */
+		len = strlen(name) + 1;
+		len = roundup(len, sizeof (struct inotify_event));
+	} else {
+		len = 0;
+	}
+
+	if (state->ins_nevents >= state->ins_maxevents ||
+	    state->ins_size + sizeof (struct inotify_event) + len >
+	    state->ins_maxsize) {
 		/*
-		 * We're at our maximum number of events -- turn our event
-		 * into an IN_Q_OVERFLOW event, which will be coalesced if
-		 * it's already the tail event.
+		 * We're at our maximum number or size of events -- turn our
+		 * event into an IN_Q_OVERFLOW event, which will be coalesced
+		 * if it's already the tail event.
 		 */
 		mask = IN_Q_OVERFLOW;
 		wd = (uint32_t)-1;
 		cookie = 0;
+		name = NULL;
 		len = 0;
 	}
 
 	if ((tail = state->ins_tail) != NULL && tail->ine_event.wd == wd &&
 	    tail->ine_event.mask == mask && tail->ine_event.cookie == cookie &&
-	    ((tail->ine_event.len == 0 && len == 0) ||
-	    (name != NULL && tail->ine_event.len != 0 &&
-	    strcmp(tail->ine_event.name, name) == 0))) {
+	    tail->ine_event.len == len &&
+	    (len == 0 || strcmp(tail->ine_event.name, name) == 0)) {
 		/*
-		 * This is an implicitly coalesced event; we're done.
+		 * This is an implicitly coalesced event; we're done.  A
+		 * scanner that touches the same file repeatedly generates
+		 * a run of these, so they cost no allocation.
 		 */
 		if (!removal)
 			mutex_exit(&state->ins_lock);
 		return;
 	}
 
-	if (name != NULL) {
-		/*
-		 * We are in the context of a file event monitoring operation,
-		 * so the name length is bounded by the kernel.
-		 */
-		len = strlen(name) + 1;
-		len = roundup(len, sizeof (struct inotify_event));
-	} else {
-		len = 0;
-	}
-
 	event = kmem_zalloc(sizeof (inotify_kevent_t) + len, KM_SLEEP);
 	event->ine_event.wd = wd;
 	event->ine_event.mask = (uint32_t)mask;
@@ -1155,6 +1161,7 @@ inotify_open(dev_t *devp, int flag, int otyp, cred_t *cred_p)
 
 	state->ins_maxwatches = inotify_maxwatches;
 	state->ins_maxevents = inotify_maxevents;
+	state->ins_maxsize = inotify_maxsize;
 
 	mutex_exit(&inotify_lock);
 
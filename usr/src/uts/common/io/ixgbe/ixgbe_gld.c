@@ -811,6 +811,20 @@ ixgbe_m_propinfo(void *arg, const char *pr_name, mac_prop_id_t pr_num,
 			return;
 		}
 
+		/*
+		 * The RSS key is random and the default redirection table
+		 * depends on the number of rings.
+		 */
+		if (strcmp(pr_name, "_rss_key") == 0 ||
+		    strcmp(pr_name, "_rss_table") == 0) {
+			return;
+		}
+		if (strcmp(pr_name, "_rss_hash") == 0) {
+			mac_prop_info_set_default_str(prh,
+			    "ipv4,tcp4,udp4,ipv6,tcp6,udp6");
+			return;
+		}
+
 		if (strcmp(pr_name, "_tx_copy_thresh") == 0) {
 			value = DEFAULT_TX_COPY_THRESHOLD;
 		} else if (strcmp(pr_name, "_tx_recycle_thresh") == 0) {
@@ -864,6 +878,18 @@ ixgbe_set_priv_prop(ixgbe_t *ixgbe, const char *pr_name,
 	struct ixgbe_hw *hw = &ixgbe->hw;
 	int i;
 
+	if (strcmp(pr_name, "_rss_key") == 0 ||
+	    strcmp(pr_name, "_rss_hash") == 0 ||
+	    strcmp(pr_name, "_rss_table") == 0) {
+		if (pr_val == NULL)
+			return (EINVAL);
+		if (strcmp(pr_name, "_rss_key") == 0)
+			return (ixgbe_rss_set_key(ixgbe, pr_val));
+		if (strcmp(pr_name, "_rss_hash") == 0)
+			return (ixgbe_rss_set_hash(ixgbe, pr_val));
+		return (ixgbe_rss_set_table(ixgbe, pr_val));
+	}
+
 	if (strcmp(pr_name, "_tx_copy_thresh") == 0) {
 		if (pr_val == NULL) {
 			err = EINVAL;
@@ -995,6 +1021,13 @@ ixgbe_get_priv_prop(ixgbe_t *ixgbe, const char *pr_name,
 	int err = ENOTSUP;
 	int value;
 
+	if (strcmp(pr_name, "_rss_key") == 0)
+		return (ixgbe_rss_get_key(ixgbe, pr_val, pr_valsize));
+	if (strcmp(pr_name, "_rss_hash") == 0)
+		return (ixgbe_rss_get_hash(ixgbe, pr_val, pr_valsize));
+	if (strcmp(pr_name, "_rss_table") == 0)
+		return (ixgbe_rss_get_table(ixgbe, pr_val, pr_valsize));
+
 	if (strcmp(pr_name, "_adv_pause_cap") == 0) {
 		value = ixgbe->param_adv_pause_cap;
 		err = 0;
@@ -67,6 +67,8 @@ static void ixgbe_setup_rss(ixgbe_t *);
 static void ixgbe_setup_vmdq(ixgbe_t *);
 static void ixgbe_setup_vmdq_rss(ixgbe_t *);
 static void ixgbe_setup_rss_table(ixgbe_t *);
+static void ixgbe_write_rss_table(ixgbe_t *);
+static uint32_t ixgbe_rss_mrqc_fields(ixgbe_t *);
 static void ixgbe_init_unicst(ixgbe_t *);
 static int ixgbe_init_vlan(ixgbe_t *);
 static int ixgbe_unicst_find(ixgbe_t *, const uint8_t *);
@@ -152,12 +154,37 @@ char *ixgbe_priv_props[] = {
 	"_intr_throttling",
 	"_adv_pause_cap",
 	"_adv_asym_pause_cap",
+	"_rss_key",
+	"_rss_hash",
+	"_rss_table",
 	NULL
 };
 
 #define	IXGBE_MAX_PRIV_PROPS \
 	(sizeof (ixgbe_priv_props) / sizeof (mac_priv_prop_t))
 
+/*
+ * The packet types which may be chosen for RSS hashing with the _rss_hash
+ * property, and the MRQC hash field bits each enables.
+ */
+typedef struct ixgbe_rss_hash_type {
+	const char	*irh_name;
+	uint32_t	irh_mrqc;
+} ixgbe_rss_hash_type_t;
+
+static const ixgbe_rss_hash_type_t ixgbe_rss_hash_types[] = {
+	{ "ipv4", IXGBE_MRQC_RSS_FIELD_IPV4 },
+	{ "tcp4", IXGBE_MRQC_RSS_FIELD_IPV4_TCP },
+	{ "udp4", IXGBE_MRQC_RSS_FIELD_IPV4_UDP },
+	{ "ipv6", IXGBE_MRQC_RSS_FIELD_IPV6 | IXGBE_MRQC_RSS_FIELD_IPV6_EX },
+	{ "tcp6", IXGBE_MRQC_RSS_FIELD_IPV6_TCP |
+	    IXGBE_MRQC_RSS_FIELD_IPV6_EX_TCP },
+	{ "udp6", IXGBE_MRQC_RSS_FIELD_IPV6_UDP |
+	    IXGBE_MRQC_RSS_FIELD_IPV6_EX_UDP },
+};
+
+#define	IXGBE_RSS_HASH_ALL	((1U << ARRAY_SIZE(ixgbe_rss_hash_types)) - 1)
+
 static struct cb_ops ixgbe_cb_ops = {
 	nulldev,		/* cb_open */
 	nulldev,		/* cb_close */
@@ -2864,16 +2891,7 @@ ixgbe_setup_rss(ixgbe_t *ixgbe)
 	/*
 	 * Enable RSS & perform hash on these packet types
 	 */
-	mrqc = IXGBE_MRQC_RSSEN |
-	    IXGBE_MRQC_RSS_FIELD_IPV4 |
-	    IXGBE_MRQC_RSS_FIELD_IPV4_TCP |
-	    IXGBE_MRQC_RSS_FIELD_IPV4_UDP |
-	    IXGBE_MRQC_RSS_FIELD_IPV6_EX_TCP |
-	    IXGBE_MRQC_RSS_FIELD_IPV6_EX |
-	    IXGBE_MRQC_RSS_FIELD_IPV6 |
-	    IXGBE_MRQC_RSS_FIELD_IPV6_TCP |
-	    IXGBE_MRQC_RSS_FIELD_IPV6_UDP |
-	    IXGBE_MRQC_RSS_FIELD_IPV6_EX_UDP;
+	mrqc = IXGBE_MRQC_RSSEN | ixgbe_rss_mrqc_fields(ixgbe);
 	IXGBE_WRITE_REG(hw, IXGBE_MRQC, mrqc);
 }
 
@@ -2968,16 +2986,7 @@ ixgbe_setup_vmdq_rss(ixgbe_t *ixgbe)
 		/*
 		 * Enable RSS & Setup RSS Hash functions
 		 */
-		mrqc = IXGBE_MRQC_RSSEN |
-		    IXGBE_MRQC_RSS_FIELD_IPV4 |
-		    IXGBE_MRQC_RSS_FIELD_IPV4_TCP |
-		    IXGBE_MRQC_RSS_FIELD_IPV4_UDP |
-		    IXGBE_MRQC_RSS_FIELD_IPV6_EX_TCP |
-		    IXGBE_MRQC_RSS_FIELD_IPV6_EX |
-		    IXGBE_MRQC_RSS_FIELD_IPV6 |
-		    IXGBE_MRQC_RSS_FIELD_IPV6_TCP |
-		    IXGBE_MRQC_RSS_FIELD_IPV6_UDP |
-		    IXGBE_MRQC_RSS_FIELD_IPV6_EX_UDP;
+		mrqc = IXGBE_MRQC_RSSEN | ixgbe_rss_mrqc_fields(ixgbe);
 		IXGBE_WRITE_REG(hw, IXGBE_MRQC, mrqc);
 
 		/*
@@ -2997,15 +3006,7 @@ ixgbe_setup_vmdq_rss(ixgbe_t *ixgbe)
 		/*
 		 * Enable RSS & Setup RSS Hash functions
 		 */
-		mrqc = IXGBE_MRQC_RSS_FIELD_IPV4 |
-		    IXGBE_MRQC_RSS_FIELD_IPV4_TCP |
-		    IXGBE_MRQC_RSS_FIELD_IPV4_UDP |
-		    IXGBE_MRQC_RSS_FIELD_IPV6_EX_TCP |
-		    IXGBE_MRQC_RSS_FIELD_IPV6_EX |
-		    IXGBE_MRQC_RSS_FIELD_IPV6 |
-		    IXGBE_MRQC_RSS_FIELD_IPV6_TCP |
-		    IXGBE_MRQC_RSS_FIELD_IPV6_UDP |
-		    IXGBE_MRQC_RSS_FIELD_IPV6_EX_UDP;
+		mrqc = ixgbe_rss_mrqc_fields(ixgbe);
 
 		/*
 		 * Enable VMDq+RSS.
@@ -3064,16 +3065,39 @@ ixgbe_setup_vmdq_rss(ixgbe_t *ixgbe)
  */
 static void
 ixgbe_setup_rss_table(ixgbe_t *ixgbe)
+{
+	struct ixgbe_hw *hw = &ixgbe->hw;
+	uint32_t rxcsum;
+
+	ixgbe_write_rss_table(ixgbe);
+
+	/*
+	 * Disable Packet Checksum to enable RSS for multiple receive queues.
+	 * It is an adapter hardware limitation that Packet Checksum is
+	 * mutually exclusive with RSS.
+	 */
+	rxcsum = IXGBE_READ_REG(hw, IXGBE_RXCSUM);
+	rxcsum |= IXGBE_RXCSUM_PCSD;
+	rxcsum &= ~IXGBE_RXCSUM_IPPCSE;
+	IXGBE_WRITE_REG(hw, IXGBE_RXCSUM, rxcsum);
+}
+
+/*
+ * ixgbe_write_rss_table - Program the RETA/ERETA table and the hash key.
+ *
+ * The table is filled round robin with the rings of each group unless the
+ * _rss_table property has given a pattern of rings to repeat instead.
+ */
+static void
+ixgbe_write_rss_table(ixgbe_t *ixgbe)
 {
 	struct ixgbe_hw *hw = &ixgbe->hw;
 	uint32_t i, j;
-	uint32_t random;
 	uint32_t reta;
 	uint32_t ring_per_group;
 	uint32_t ring;
 	uint32_t table_size;
 	uint32_t index_mult;
-	uint32_t rxcsum;
 
 	/*
 	 * Set multiplier for RETA setup and table size based on MAC type.
@@ -3115,7 +3139,11 @@ ixgbe_setup_rss_table(ixgbe_t *ixgbe)
 		 * The low 8 bits are for hash value (n+0);
 		 * The next 8 bits are for hash value (n+1), etc.
 		 */
-		ring = (j * index_mult);
+		if (ixgbe->rss_table_len != 0)
+			ring = ixgbe->rss_table[i % ixgbe->rss_table_len];
+		else
+			ring = j;
+		ring *= index_mult;
 		reta = reta >> 8;
 		reta = reta | (((uint32_t)ring) << 24);
 
@@ -3135,23 +3163,237 @@ ixgbe_setup_rss_table(ixgbe_t *ixgbe)
 	}
 
 	/*
-	 * Fill out hash function seeds with a random constant
+	 * Fill out hash function seeds with the key, which is a random
+	 * constant chosen at attach unless set with the _rss_key property.
 	 */
-	for (i = 0; i < 10; i++) {
-		(void) random_get_pseudo_bytes((uint8_t *)&random,
-		    sizeof (uint32_t));
-		IXGBE_WRITE_REG(hw, IXGBE_RSSRK(i), random);
+	for (i = 0; i < IXGBE_RSS_KEY_WORDS; i++) {
+		IXGBE_WRITE_REG(hw, IXGBE_RSSRK(i), ixgbe->rss_key[i]);
 	}
+}
+
+/*
+ * ixgbe_rss_mrqc_fields - The MRQC hash field bits for the chosen hash types.
+ */
+static uint32_t
+ixgbe_rss_mrqc_fields(ixgbe_t *ixgbe)
+{
+	uint32_t mrqc = 0;
+
+	for (uint_t i = 0; i < ARRAY_SIZE(ixgbe_rss_hash_types); i++) {
+		if ((ixgbe->rss_hash & (1U << i)) != 0)
+			mrqc |= ixgbe_rss_hash_types[i].irh_mrqc;
+	}
+	return (mrqc);
+}
+
+/*
+ * The RSS key, hash types and redirection table may all be changed at runtime
+ * through private link properties. The settings are kept in the ixgbe_t so
+ * that they survive a restart of the chip, and are pushed to the hardware now
+ * if it's running with RSS. The caller holds gen_lock.
+ */
+static int
+ixgbe_rss_update(ixgbe_t *ixgbe)
+{
+	struct ixgbe_hw *hw = &ixgbe->hw;
+	uint32_t mrqc;
+
+	ASSERT(mutex_owned(&ixgbe->gen_lock));
+
+	if (!(ixgbe->ixgbe_state & IXGBE_STARTED))
+		return (0);
+	if (ixgbe->classify_mode != IXGBE_CLASSIFY_RSS &&
+	    ixgbe->classify_mode != IXGBE_CLASSIFY_VMDQ_RSS)
+		return (0);
+
+	ixgbe_write_rss_table(ixgbe);
+
+	mrqc = IXGBE_READ_REG(hw, IXGBE_MRQC);
+	mrqc &= ~IXGBE_MRQC_RSS_FIELD_MASK;
+	mrqc |= ixgbe_rss_mrqc_fields(ixgbe);
+	IXGBE_WRITE_REG(hw, IXGBE_MRQC, mrqc);
+
+	if (ixgbe_check_acc_handle(ixgbe->osdep.reg_handle) != DDI_FM_OK) {
+		ddi_fm_service_impact(ixgbe->dip, DDI_SERVICE_DEGRADED);
+		return (EIO);
+	}
+
+	return (0);
+}
+
+static int
+ixgbe_rss_hexval(char c)
+{
+	if (c >= '0' && c <= '9')
+		return (c - '0');
+	if (c >= 'a' && c <= 'f')
+		return (c - 'a' + 10);
+	if (c >= 'A' && c <= 'F')
+		return (c - 'A' + 10);
+	return (-1);
+}
+
+/*
+ * The key is given as a string of hex digits, two per byte, covering the
+ * whole of the key. Bytes are in the order the hardware uses them.
+ */
+int
+ixgbe_rss_set_key(ixgbe_t *ixgbe, const char *val)
+{
+	uint8_t key[sizeof (ixgbe->rss_key)];
+
+	if (strlen(val) != sizeof (key) * 2)
+		return (EINVAL);
+
+	for (uint_t i = 0; i < sizeof (key); i++) {
+		int hi = ixgbe_rss_hexval(val[i * 2]);
+		int lo = ixgbe_rss_hexval(val[i * 2 + 1]);
+
+		if (hi < 0 || lo < 0)
+			return (EINVAL);
+		key[i] = (hi << 4) | lo;
+	}
+
+	bcopy(key, ixgbe->rss_key, sizeof (key));
+	return (ixgbe_rss_update(ixgbe));
+}
+
+int
+ixgbe_rss_get_key(ixgbe_t *ixgbe, char *buf, uint_t len)
+{
+	const uint8_t *key = (const uint8_t *)ixgbe->rss_key;
+
+	if (len < sizeof (ixgbe->rss_key) * 2 + 1)
+		return (ERANGE);
+
+	for (uint_t i = 0; i < sizeof (ixgbe->rss_key); i++) {
+		(void) snprintf(&buf[i * 2], 3, "%02x", key[i]);
+	}
+	return (0);
+}
+
+/*
+ * Hash types are given as a comma-separated list of names from
+ * ixgbe_rss_hash_types.
+ */
+int
+ixgbe_rss_set_hash(ixgbe_t *ixgbe, const char *val)
+{
+	uint_t hash = 0;
+	const char *p = val;
+
+	while (*p != '\0') {
+		const char *end = strchr(p, ',');
+		size_t len = (end != NULL) ? end - p : strlen(p);
+		uint_t i;
+
+		for (i = 0; i < ARRAY_SIZE(ixgbe_rss_hash_types); i++) {
+			const char *name = ixgbe_rss_hash_types[i].irh_name;
+
+			if (strlen(name) == len && strncmp(name, p, len) == 0)
+				break;
+		}
+		if (i == ARRAY_SIZE(ixgbe_rss_hash_types))
+			return (EINVAL);
+		hash |= 1U << i;
+
+		p += len;
+		if (*p == ',')
+			p++;
+	}
+
+	if (hash == 0)
+		return (EINVAL);
+
+	ixgbe->rss_hash = hash;
+	return (ixgbe_rss_update(ixgbe));
+}
+
+int
+ixgbe_rss_get_hash(ixgbe_t *ixgbe, char *buf, uint_t len)
+{
+	size_t off = 0;
+
+	if (len == 0)
+		return (ERANGE);
+	buf[0] = '\0';
+
+	for (uint_t i = 0; i < ARRAY_SIZE(ixgbe_rss_hash_types); i++) {
+		if ((ixgbe->rss_hash & (1U << i)) == 0)
+			continue;
+		off += snprintf(&buf[off], len - off, "%s%s",
+		    off == 0 ? "" : ",", ixgbe_rss_hash_types[i].irh_name);
+		if (off >= len)
+			return (ERANGE);
+	}
+	return (0);
+}
+
+/*
+ * The redirection table is given as a comma-separated list of ring indices
+ * within each group, which is repeated to fill the table. Listing a ring
+ * more often gives it a larger share of flows; leaving one out keeps hashed
+ * traffic off it.
+ */
+int
+ixgbe_rss_set_table(ixgbe_t *ixgbe, const char *val)
+{
+	uint8_t table[IXGBE_RSS_TABLE_PATTERN_MAX];
+	uint32_t ring_per_group = ixgbe->num_rx_rings / ixgbe->num_rx_groups;
+	uint_t n = 0;
+	const char *p = val;
+
+	while (*p != '\0') {
+		unsigned long q;
+		char *end;
+
+		if (n == ARRAY_SIZE(table) ||
+		    ddi_strtoul(p, &end, 10, &q) != 0 || end == p ||
+		    (*end != ',' && *end != '\0') || q >= ring_per_group) {
+			return (EINVAL);
+		}
+		table[n++] = (uint8_t)q;
+
+		p = end;
+		if (*p == ',')
+			p++;
+	}
+
+	if (n == 0)
+		return (EINVAL);
+
+	bcopy(table, ixgbe->rss_table, n);
+	ixgbe->rss_table_len = n;
+	return (ixgbe_rss_update(ixgbe));
+}
+
+int
+ixgbe_rss_get_table(ixgbe_t *ixgbe, char *buf, uint_t len)
+{
+	uint_t n = ixgbe->rss_table_len;
+	size_t off = 0;
+
+	if (len == 0)
+		return (ERANGE);
+	buf[0] = '\0';
 
 	/*
-	 * Disable Packet Checksum to enable RSS for multiple receive queues.
-	 * It is an adapter hardware limitation that Packet Checksum is
-	 * mutually exclusive with RSS.
+	 * The default round robin table is the same as the pattern of every
+	 * ring in the group in order.
 	 */
-	rxcsum = IXGBE_READ_REG(hw, IXGBE_RXCSUM);
-	rxcsum |= IXGBE_RXCSUM_PCSD;
-	rxcsum &= ~IXGBE_RXCSUM_IPPCSE;
-	IXGBE_WRITE_REG(hw, IXGBE_RXCSUM, rxcsum);
+	if (n == 0)
+		n = ixgbe->num_rx_rings / ixgbe->num_rx_groups;
+
+	for (uint_t i = 0; i < n; i++) {
+		uint_t q = (ixgbe->rss_table_len != 0) ?
+		    ixgbe->rss_table[i] : i;
+
+		off += snprintf(&buf[off], len - off, "%s%u",
+		    i == 0 ? "" : ",", q);
+		if (off >= len)
+			return (ERANGE);
+	}
+	return (0);
 }
 
 /*
@@ -3625,6 +3867,16 @@ ixgbe_get_conf(ixgbe_t *ixgbe)
 	    MIN_RX_LIMIT_PER_INTR, MAX_RX_LIMIT_PER_INTR,
 	    DEFAULT_RX_LIMIT_PER_INTR);
 
+	/*
+	 * The RSS key is chosen once for the life of the instance so that
+	 * flows keep hashing the same way across a restart. The hash types
+	 * and redirection table may be changed later with link properties.
+	 */
+	(void) random_get_pseudo_bytes((uint8_t *)ixgbe->rss_key,
+	    sizeof (ixgbe->rss_key));
+	ixgbe->rss_hash = IXGBE_RSS_HASH_ALL;
+	ixgbe->rss_table_len = 0;
+
 	ixgbe->intr_throttling[0] = ixgbe_get_prop(ixgbe, PROP_INTR_THROTTLING,
 	    ixgbe->capab->min_intr_throttle,
 	    ixgbe->capab->max_intr_throttle,
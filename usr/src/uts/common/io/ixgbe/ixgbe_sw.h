@@ -121,6 +121,13 @@ extern "C" {
 #define	MAX_RX_QUEUE_NUM		128
 #define	MAX_INTR_VECTOR			64
 
+/*
+ * RSS hash key size (in RSSRK registers), and the longest pattern of rings
+ * which the _rss_table property may give to be repeated across the RETA.
+ */
+#define	IXGBE_RSS_KEY_WORDS		10
+#define	IXGBE_RSS_TABLE_PATTERN_MAX	128
+
 /*
  * Maximum values for user configurable parameters
  */
@@ -704,6 +711,10 @@ typedef struct ixgbe {
 	boolean_t		rx_hcksum_enable; /* Rx h/w cksum offload */
 	uint32_t		rx_copy_thresh; /* Rx copy threshold */
 	uint32_t		rx_limit_per_intr; /* Rx pkts per interrupt */
+	uint32_t		rss_key[IXGBE_RSS_KEY_WORDS]; /* RSS hash key */
+	uint_t			rss_hash;	/* RSS hash types */
+	uint8_t			rss_table[IXGBE_RSS_TABLE_PATTERN_MAX];
+	uint_t			rss_table_len;	/* 0: round robin */
 	uint32_t		intr_throttling[MAX_INTR_VECTOR];
 	uint32_t		intr_force;
 	int			fm_capabilities; /* FMA capabilities */
@@ -882,6 +893,12 @@ void ixgbe_disable_watchdog_timer(ixgbe_t *);
 int ixgbe_atomic_reserve(uint32_t *, uint32_t);
 
 int ixgbe_check_acc_handle(ddi_acc_handle_t handle);
+int ixgbe_rss_set_key(ixgbe_t *, const char *);
+int ixgbe_rss_get_key(ixgbe_t *, char *, uint_t);
+int ixgbe_rss_set_hash(ixgbe_t *, const char *);
+int ixgbe_rss_get_hash(ixgbe_t *, char *, uint_t);
+int ixgbe_rss_set_table(ixgbe_t *, const char *);
+int ixgbe_rss_get_table(ixgbe_t *, char *, uint_t);
 int ixgbe_check_dma_handle(ddi_dma_handle_t handle);
 void ixgbe_fm_ereport(ixgbe_t *, char *);
 
@@ -22,6 +22,7 @@
  * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
  * Copyright 2015 Nexenta Systems, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 
@@ -659,6 +660,255 @@ write_kstat_data(int *rvalp, void *user_ksp, int flag, cred_t *cred)
 	return (error);
 }
 
+/*
+ * Prepare a snapshot of a named kstat for a bulk read: fix up the types of
+ * 'long' statistics for the caller's data model, and gather any long strings
+ * into the buffer, replacing their pointers with offsets from its start.
+ * The result depends only on the kstat's data, so it can be checksummed to
+ * detect changes.
+ */
+static void
+kstat_bulk_named(void *kbuf, size_t kbufsize, uint_t ndata, uint_t model)
+{
+	kstat_named_t *kn = kbuf;
+	char *strbuf = (char *)(kn + ndata);
+	uintptr_t off;
+	uint_t i;
+
+	for (i = 0; i < ndata; kn++, i++) {
+		switch (kn->data_type) {
+#ifdef _LP64
+		case KSTAT_DATA_LONG:
+			if (model == DDI_MODEL_ILP32) {
+				kn->value.i32 = (int32_t)kn->value.l;
+				kn->data_type = KSTAT_DATA_INT32;
+			} else {
+				kn->data_type = KSTAT_DATA_INT64;
+			}
+			break;
+		case KSTAT_DATA_ULONG:
+			if (model == DDI_MODEL_ILP32) {
+				kn->value.ui32 = (uint32_t)kn->value.ul;
+				kn->data_type = KSTAT_DATA_UINT32;
+			} else {
+				kn->data_type = KSTAT_DATA_UINT64;
+			}
+			break;
+#endif	/* _LP64 */
+		case KSTAT_DATA_STRING:
+			if (KSTAT_NAMED_STR_PTR(kn) == NULL)
+				break;
+			if (KSTAT_NAMED_STR_PTR(kn) < (char *)kbuf ||
+			    KSTAT_NAMED_STR_PTR(kn) +
+			    KSTAT_NAMED_STR_BUFLEN(kn) >
+			    (char *)kbuf + kbufsize + 1) {
+				bcopy(KSTAT_NAMED_STR_PTR(kn), strbuf,
+				    KSTAT_NAMED_STR_BUFLEN(kn));
+				KSTAT_NAMED_STR_PTR(kn) = strbuf;
+				strbuf += KSTAT_NAMED_STR_BUFLEN(kn);
+				ASSERT(strbuf <= (char *)kbuf + kbufsize + 1);
+			}
+			off = KSTAT_NAMED_STR_PTR(kn) - (char *)kbuf;
+			bzero(&kn->value.str.addr, sizeof (kn->value.str.addr));
+#ifdef _MULTI_DATAMODEL
+			if (model == DDI_MODEL_ILP32) {
+				kn->value.str.addr.ptr32 = (caddr32_t)off;
+				break;
+			}
+#endif
+			KSTAT_NAMED_STR_PTR(kn) = (char *)off;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/*
+ * A 64-bit FNV-1a hash of a snapshot, used to detect kstats whose data has
+ * changed between bulk reads.
+ */
+static uint64_t
+kstat_bulk_sum(const void *buf, size_t size)
+{
+	const uchar_t *p = buf;
+	uint64_t sum = 0xcbf29ce484222325ULL;
+
+	while (size-- != 0) {
+		sum ^= *p++;
+		sum *= 0x100000001b3ULL;
+	}
+	return (sum);
+}
+
+static int
+kstat_bulk_grow(void **kbufp, size_t *kbufsizep, size_t size)
+{
+	void *kbuf;
+
+	if (size <= *kbufsizep)
+		return (0);
+
+	/*
+	 * As with read_kstat_data(), we can't sleep for memory while holding
+	 * a kstat.
+	 */
+	size = MAX(P2ROUNDUP(size, PAGESIZE), *kbufsizep * 2);
+	if ((kbuf = kmem_alloc(size, KM_NOSLEEP)) == NULL)
+		return (EAGAIN);
+	if (*kbufp != NULL)
+		kmem_free(*kbufp, *kbufsizep);
+	*kbufp = kbuf;
+	*kbufsizep = size;
+	return (0);
+}
+
+static int
+read_kstat_bulk(int *rvalp, void *user_kb, int flag)
+{
+	kstat_bulk_t kb;
+	kstat_bulk_rec_t kbr;
+	kstat_t *ksp;
+	char *module, *class;
+	caddr_t ubuf;
+	void *kbuf = NULL;
+	size_t kbufsize = 0, size, reclen;
+	uint64_t since, gen, used = 0;
+	uint32_t nrecs = 0;
+	kid_t kid, last;
+	boolean_t more = B_FALSE;
+	uint_t model = ddi_model_convert_from(flag & FMODELS);
+	int error = 0;
+
+	if (copyin(user_kb, &kb, sizeof (kb)) != 0)
+		return (EFAULT);
+	if ((kb.kb_flags & ~KSTAT_BULK_CHANGED) != 0)
+		return (EINVAL);
+
+	kb.kb_module[KSTAT_STRLEN - 1] = '\0';
+	kb.kb_class[KSTAT_STRLEN - 1] = '\0';
+	module = kb.kb_module[0] != '\0' ? kb.kb_module : NULL;
+	class = kb.kb_class[0] != '\0' ? kb.kb_class : NULL;
+	ubuf = (caddr_t)(uintptr_t)kb.kb_buf;
+
+	/*
+	 * Any change we (or anyone else) notice from here on is stamped with
+	 * a later generation than this one.
+	 */
+	membar_consumer();
+	gen = kstat_bulk_gen;
+	since = (kb.kb_flags & KSTAT_BULK_CHANGED) ? kb.kb_gen : 0;
+	bzero(&kbr, sizeof (kbr));
+
+	kid = last = kb.kb_kid;
+	while ((ksp = kstat_hold_next(kid, getzoneid(), module,
+	    class)) != NULL) {
+		kid = ksp->ks_kid;
+		if (ksp->ks_flags & KSTAT_FLAG_INVALID) {
+			kstat_rele(ksp);
+			continue;
+		}
+
+		/*
+		 * Size the buffer for a fixed-size kstat before taking its
+		 * data lock, as read_kstat_data() does.
+		 */
+		if (!(ksp->ks_flags &
+		    (KSTAT_FLAG_VAR_SIZE | KSTAT_FLAG_LONGSTRINGS)) &&
+		    (error = kstat_bulk_grow(&kbuf, &kbufsize,
+		    ksp->ks_data_size + sizeof (uint64_t))) != 0) {
+			kstat_rele(ksp);
+			more = B_TRUE;
+			break;
+		}
+
+		KSTAT_ENTER(ksp);
+		if (KSTAT_UPDATE(ksp, KSTAT_READ) != 0) {
+			KSTAT_EXIT(ksp);
+			kstat_rele(ksp);
+			continue;
+		}
+		size = ksp->ks_data_size;
+		if ((error = kstat_bulk_grow(&kbuf, &kbufsize,
+		    size + sizeof (uint64_t))) != 0) {
+			KSTAT_EXIT(ksp);
+			kstat_rele(ksp);
+			more = B_TRUE;
+			break;
+		}
+		bzero(kbuf, size + 1);
+		if (KSTAT_SNAPSHOT(ksp, kbuf, KSTAT_READ) != 0) {
+			KSTAT_EXIT(ksp);
+			kstat_rele(ksp);
+			continue;
+		}
+
+		kbr.kbr_kid = kid;
+		kbr.kbr_snaptime = ksp->ks_snaptime;
+		kbr.kbr_data_size = size;
+		kbr.kbr_ndata = ksp->ks_ndata;
+		kbr.kbr_instance = ksp->ks_instance;
+		kbr.kbr_type = ksp->ks_type;
+		kbr.kbr_flags = ksp->ks_flags;
+		bcopy(ksp->ks_module, kbr.kbr_module, KSTAT_STRLEN);
+		bcopy(ksp->ks_name, kbr.kbr_name, KSTAT_STRLEN);
+		bcopy(ksp->ks_class, kbr.kbr_class, KSTAT_STRLEN);
+		KSTAT_EXIT(ksp);
+
+		if (kbr.kbr_type == KSTAT_TYPE_NAMED)
+			kstat_bulk_named(kbuf, size, kbr.kbr_ndata, model);
+		kbr.kbr_gen = kstat_bulk_changed(ksp,
+		    kstat_bulk_sum(kbuf, size));
+		kstat_rele(ksp);
+
+		if (kbr.kbr_gen <= since)
+			continue;
+
+		reclen = P2ROUNDUP(sizeof (kbr) + size, sizeof (uint64_t));
+		if (reclen > kb.kb_bufsize - used) {
+			if (nrecs == 0) {
+				used = reclen;
+				error = ENOMEM;
+			}
+			more = B_TRUE;
+			break;
+		}
+		kbr.kbr_reclen = (uint32_t)reclen;
+		bzero((char *)kbuf + size, reclen - sizeof (kbr) - size);
+		if (copyout(&kbr, ubuf + used, sizeof (kbr)) != 0 ||
+		    copyout(kbuf, ubuf + used + sizeof (kbr),
+		    reclen - sizeof (kbr)) != 0) {
+			error = EFAULT;
+			break;
+		}
+		used += reclen;
+		nrecs++;
+		last = kid;
+	}
+
+	if (kbuf != NULL)
+		kmem_free(kbuf, kbufsize);
+
+	/*
+	 * Running out of memory part way through still leaves the caller
+	 * with something to show for it, and a place to continue from.
+	 */
+	if (error == EAGAIN && nrecs != 0)
+		error = 0;
+	if (error == EFAULT)
+		return (error);
+
+	kb.kb_gen = gen;
+	kb.kb_used = used;
+	kb.kb_nrecs = nrecs;
+	kb.kb_next = more ? last : 0;
+	*rvalp = kstat_chain_id;
+
+	if (copyout(&kb, user_kb, sizeof (kb)) != 0 && error == 0)
+		error = EFAULT;
+	return (error);
+}
+
 /*ARGSUSED*/
 static int
 kstat_ioctl(dev_t dev, int cmd, intptr_t data, int flag, cred_t *cr, int *rvalp)
@@ -679,6 +929,10 @@ kstat_ioctl(dev_t dev, int cmd, intptr_t data, int flag, cred_t *cr, int *rvalp)
 		rc = write_kstat_data(rvalp, (void *)data, flag, cr);
 		break;
 
+	case KSTAT_IOC_BULK:
+		rc = read_kstat_bulk(rvalp, (void *)data, flag);
+		break;
+
 	default:
 		/* invalid request */
 		rc = EINVAL;
@@ -3670,7 +3670,8 @@ mac_tx(mac_client_handle_t mch, mblk_t *mp_chain, uintptr_t hint,
 
 			mp->b_next = NULL;
 
-			if ((needed & (HCK_TX_FLAGS | HW_LSO_FLAGS)) != 0) {
+			if ((needed & (HCK_TX_FLAGS | HW_LSO_FLAGS |
+			    HW_TUNNEL_FLAGS)) != 0) {
 				mac_emul_t emul = 0;
 
 				if (needed & HCK_IPV4_HDRCKSUM)
@@ -3680,6 +3681,14 @@ mac_tx(mac_client_handle_t mch, mblk_t *mp_chain, uintptr_t hint,
 				if (needed & HW_LSO)
 					emul = MAC_LSO_EMUL;
 
+				/*
+				 * A provider without tunnel offloads cannot
+				 * apply any of the other offloads to the inner
+				 * frame, whatever it supports natively.
+				 */
+				if (needed & HW_TUNNEL_FLAGS)
+					emul = MAC_ALL_EMULS;
+
 				mac_hw_emul(&mp, &tail, NULL, emul);
 
 				if (mp == NULL) {
@@ -20,7 +20,7 @@
  */
 /*
  * Copyright (c) 2008, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright 2018 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/types.h>
@@ -149,11 +149,15 @@ static krwlock_t mac_srs_g_lock;
 boolean_t mac_srs_thread_bind = B_TRUE;
 
 /*
- * Whether Rx/Tx interrupts should be re-targeted. Disabled by default.
- * dladm command would override this.
+ * Whether Rx/Tx interrupts should be re-targeted to the CPU of the SRS
+ * thread which processes them (the Rx poll thread, or the Tx SRS worker), so
+ * that a ring's interrupt, its SRS and the data it touches share a cache.
+ * This is done whenever the SRS CPUs are chosen, including when the binding
+ * is changed with dladm.  Set these to B_FALSE to leave interrupt placement
+ * entirely to intrd(1M).
  */
-boolean_t mac_tx_intr_retarget = B_FALSE;
-boolean_t mac_rx_intr_retarget = B_FALSE;
+boolean_t mac_tx_intr_retarget = B_TRUE;
+boolean_t mac_rx_intr_retarget = B_TRUE;
 
 /*
  * If cpu bindings are specified by user, then Tx SRS and its soft
@@ -22,7 +22,7 @@
 /*
  * Copyright 2010 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
- * Copyright 2018 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/strsun.h>
@@ -61,6 +61,11 @@ static krwlock_t	flow_tab_lock;
 
 static kmem_cache_t	*flow_cache;
 static kmem_cache_t	*flow_tab_cache;
+
+/*
+ * Offer flows to providers with the MAC_CAPAB_FLOW capability.
+ */
+boolean_t		mac_flow_hw_enable = B_TRUE;
 static flow_ops_t	flow_l2_ops;
 
 typedef struct {
@@ -1179,6 +1184,130 @@ mac_rename_flow(flow_entry_t *fep, const char *new_name)
 	}
 }
 
+/*
+ * Validate and cache a provider's flow classification capability.
+ */
+void
+mac_flow_hw_init(mac_impl_t *mip)
+{
+	mac_capab_flow_t *cap = &mip->mi_flow;
+
+	mip->mi_flow_nfilters = 0;
+
+	if (!mac_capab_get((mac_handle_t)mip, MAC_CAPAB_FLOW, cap)) {
+		bzero(cap, sizeof (mac_capab_flow_t));
+		return;
+	}
+
+	if (cap->mcf_add == NULL || cap->mcf_remove == NULL ||
+	    cap->mcf_nfilters == 0 ||
+	    (cap->mcf_flags & ~MCF_F_EXCLUSIVE) != 0) {
+		dev_err(mip->mi_dip, CE_WARN, "driver set invalid flow "
+		    "capability, ignoring capability");
+		bzero(cap, sizeof (mac_capab_flow_t));
+	}
+}
+
+/*
+ * Ask the provider to steer a subflow's traffic to one of its mac client's
+ * rings, if the client has a group of its own with more than one ring and
+ * the provider can match all of the flow's fields.  The first ring of the
+ * group is left for the client's other traffic.  If the provider's filters
+ * are exclusive, each flow gets a ring to itself, and that ring's SRS hands
+ * its traffic straight to the flow rather than classifying it; otherwise
+ * the flows are spread over the rings and classified as usual, which at
+ * least keeps them off the rings carrying the rest of the traffic.
+ *
+ * This is best effort: whatever the hardware does not steer is classified
+ * in software.
+ */
+static void
+mac_flow_hw_add(mac_client_impl_t *mcip, flow_entry_t *flent)
+{
+	mac_impl_t		*mip = mcip->mci_mip;
+	mac_capab_flow_t	*cap = &mip->mi_flow;
+	boolean_t		excl = (cap->mcf_flags & MCF_F_EXCLUSIVE) != 0;
+	mac_group_t		*grp = mcip->mci_flent->fe_rx_ring_group;
+	flow_tab_t		*ft = flent->fe_flow_tab;
+	mac_ring_t		*ring, *target = NULL;
+	uint_t			i, n;
+	int			err;
+
+	ASSERT(MAC_PERIM_HELD((mac_handle_t)mip));
+	ASSERT(flent->fe_hw_ring == NULL);
+
+	if (!mac_flow_hw_enable || cap->mcf_add == NULL ||
+	    mip->mi_flow_nfilters >= cap->mcf_nfilters ||
+	    (flent->fe_flow_desc.fd_mask & ~cap->mcf_mask) != 0 ||
+	    grp == NULL || grp->mrg_cur_count < 2 ||
+	    grp->mrg_state != MAC_GROUP_STATE_RESERVED)
+		return;
+
+	n = 1 + mip->mi_flow_nfilters % (grp->mrg_cur_count - 1);
+	for (ring = grp->mrg_rings->mr_next, i = 1; ring != NULL;
+	    ring = ring->mr_next, i++) {
+		if (ring->mr_srs == NULL || ring->mr_srs->srs_mcip != mcip)
+			return;
+		if (excl ? ring->mr_srs->srs_hw_flent == NULL : i == n) {
+			target = ring;
+			break;
+		}
+	}
+	if (target == NULL)
+		return;
+
+	err = cap->mcf_add(mip->mi_driver, target->mr_driver,
+	    &flent->fe_flow_desc, &flent->fe_hw_filter);
+	if (err != 0) {
+		DTRACE_PROBE3(flow__hw__add__failed, mac_impl_t *, mip,
+		    flow_entry_t *, flent, int, err);
+		return;
+	}
+
+	flent->fe_hw_ring = target;
+	mip->mi_flow_nfilters++;
+
+	if (excl) {
+		rw_enter(&ft->ft_lock, RW_WRITER);
+		target->mr_srs->srs_hw_flent = flent;
+		rw_exit(&ft->ft_lock);
+	}
+}
+
+/*
+ * Undo mac_flow_hw_add().  The subflow table lock makes sure that no SRS
+ * is still picking up the flow from srs_hw_flent once we return.
+ */
+static void
+mac_flow_hw_remove(mac_client_impl_t *mcip, flow_entry_t *flent)
+{
+	mac_impl_t		*mip = mcip->mci_mip;
+	mac_ring_t		*ring = flent->fe_hw_ring;
+	flow_tab_t		*ft = flent->fe_flow_tab;
+	int			err;
+
+	ASSERT(MAC_PERIM_HELD((mac_handle_t)mip));
+
+	if (ring == NULL)
+		return;
+
+	if (ring->mr_srs != NULL && ring->mr_srs->srs_hw_flent == flent) {
+		rw_enter(&ft->ft_lock, RW_WRITER);
+		ring->mr_srs->srs_hw_flent = NULL;
+		rw_exit(&ft->ft_lock);
+	}
+
+	if ((err = mip->mi_flow.mcf_remove(mip->mi_driver,
+	    flent->fe_hw_filter)) != 0) {
+		DTRACE_PROBE3(flow__hw__remove__failed, mac_impl_t *, mip,
+		    flow_entry_t *, flent, int, err);
+	}
+
+	flent->fe_hw_ring = NULL;
+	ASSERT(mip->mi_flow_nfilters > 0);
+	mip->mi_flow_nfilters--;
+}
+
 /*
  * mac_link_flow_init()
  * Internal flow interface used for allocating SRSs and related
@@ -1198,6 +1327,7 @@ mac_link_flow_init(mac_client_handle_t mch, flow_entry_t *sub_flow)
 		return (err);
 
 	sub_flow->fe_mcip = mcip;
+	mac_flow_hw_add(mcip, sub_flow);
 
 	return (0);
 }
@@ -1335,6 +1465,8 @@ mac_link_flow_clean(mac_client_handle_t mch, flow_entry_t *sub_flow)
 	if (sub_flow->fe_mcip == NULL)
 		return;
 
+	mac_flow_hw_remove(mcip, sub_flow);
+
 	last_subflow = FLOW_TAB_EMPTY(mcip->mci_subflow_tab);
 	/*
 	 * Tear down the data path
@@ -21,7 +21,7 @@
 
 /*
  * Copyright (c) 2008, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright 2017 OmniTI Computer Consulting, Inc. All rights reserved.
  * Copyright 2020 RackTop Systems, Inc.
  */
@@ -63,6 +63,7 @@
 #include <inet/tcp.h>
 #include <netinet/udp.h>
 #include <netinet/sctp.h>
+#include <sys/vxlan.h>
 
 /*
  * MAC Provider Interface.
@@ -126,6 +127,7 @@ mac_features_to_flags(mac_handle_t mh)
 	uint16_t flags = 0;
 	uint32_t cap_sum = 0;
 	mac_capab_lso_t cap_lso;
+	mac_capab_tunnel_t cap_tunnel;
 
 	if (mac_capab_get(mh, MAC_CAPAB_HCKSUM, &cap_sum)) {
 		if (cap_sum & HCKSUM_IPHDRCKSUM)
@@ -144,6 +146,10 @@ mac_features_to_flags(mac_handle_t mh)
 	if (mac_capab_get(mh, MAC_CAPAB_LSO, &cap_lso))
 		flags |= HW_LSO;
 
+	if (mac_capab_get(mh, MAC_CAPAB_TUNNEL, &cap_tunnel) &&
+	    (cap_tunnel.mct_types & MAC_TUNNEL_VXLAN) != 0)
+		flags |= HW_TUNNEL_VXLAN;
+
 	return (flags);
 }
 
@@ -402,6 +408,8 @@ mac_register(mac_register_t *mregp, mac_handle_t *mhp)
 
 	mac_led_init(mip);
 
+	mac_flow_hw_init(mip);
+
 	/*
 	 * Enforce the virtrualization level registered.
 	 */
@@ -1745,8 +1753,13 @@ mac_meoi_get_uint16(mblk_t *mp, off_t off, uint16_t *out)
 }
 
 
-int
-mac_ether_offload_info(mblk_t *mp, mac_ether_offload_info_t *meoi)
+/*
+ * Fill in the offload information for the Ethernet frame which begins base
+ * bytes into mp.
+ */
+static int
+mac_ether_offload_info_off(mblk_t *mp, size_t base,
+    mac_ether_offload_info_t *meoi)
 {
 	size_t off;
 	uint16_t ether;
@@ -1754,13 +1767,13 @@ mac_ether_offload_info(mblk_t *mp, mac_ether_offload_info_t *meoi)
 
 	bzero(meoi, sizeof (mac_ether_offload_info_t));
 
-	meoi->meoi_len = msgsize(mp);
-	off = offsetof(struct ether_header, ether_type);
+	meoi->meoi_len = msgsize(mp) - base;
+	off = offsetof(struct ether_header, ether_type) + base;
 	if (mac_meoi_get_uint16(mp, off, &ether) != 0)
 		return (-1);
 
 	if (ether == ETHERTYPE_VLAN) {
-		off = offsetof(struct ether_vlan_header, ether_type);
+		off = offsetof(struct ether_vlan_header, ether_type) + base;
 		if (mac_meoi_get_uint16(mp, off, &ether) != 0)
 			return (-1);
 		meoi->meoi_flags |= MEOI_VLAN_TAGGED;
@@ -1771,6 +1784,7 @@ mac_ether_offload_info(mblk_t *mp, mac_ether_offload_info_t *meoi)
 	meoi->meoi_flags |= MEOI_L2INFO_SET;
 	meoi->meoi_l2hlen = maclen;
 	meoi->meoi_l3proto = ether;
+	base += maclen;
 
 	switch (ether) {
 	case ETHERTYPE_IP:
@@ -1778,20 +1792,20 @@ mac_ether_offload_info(mblk_t *mp, mac_ether_offload_info_t *meoi)
 		 * For IPv4 we need to get the length of the header, as it can
 		 * be variable.
 		 */
-		off = offsetof(ipha_t, ipha_version_and_hdr_length) + maclen;
+		off = offsetof(ipha_t, ipha_version_and_hdr_length) + base;
 		if (mac_meoi_get_uint8(mp, off, &iplen) != 0)
 			return (-1);
 		iplen &= 0x0f;
 		if (iplen < 5 || iplen > 0x0f)
 			return (-1);
 		iplen *= 4;
-		off = offsetof(ipha_t, ipha_protocol) + maclen;
+		off = offsetof(ipha_t, ipha_protocol) + base;
 		if (mac_meoi_get_uint8(mp, off, &ipproto) == -1)
 			return (-1);
 		break;
 	case ETHERTYPE_IPV6:
 		iplen = 40;
-		off = offsetof(ip6_t, ip6_nxt) + maclen;
+		off = offsetof(ip6_t, ip6_nxt) + base;
 		if (mac_meoi_get_uint8(mp, off, &ipproto) == -1)
 			return (-1);
 		break;
@@ -1804,7 +1818,7 @@ mac_ether_offload_info(mblk_t *mp, mac_ether_offload_info_t *meoi)
 
 	switch (ipproto) {
 	case IPPROTO_TCP:
-		off = offsetof(tcph_t, th_offset_and_rsrvd) + maclen + iplen;
+		off = offsetof(tcph_t, th_offset_and_rsrvd) + base + iplen;
 		if (mac_meoi_get_uint8(mp, off, &l4len) == -1)
 			return (-1);
 		l4len = (l4len & 0xf0) >> 4;
@@ -1826,3 +1840,56 @@ mac_ether_offload_info(mblk_t *mp, mac_ether_offload_info_t *meoi)
 	meoi->meoi_flags |= MEOI_L4INFO_SET;
 	return (0);
 }
+
+int
+mac_ether_offload_info(mblk_t *mp, mac_ether_offload_info_t *meoi)
+{
+	return (mac_ether_offload_info_off(mp, 0, meoi));
+}
+
+/*
+ * Fill in the offload information for both the outer and the inner frame of
+ * a tunneled message, as indicated by its HW_TUNNEL flags. The inner frame
+ * must at least have a valid L2 header.
+ */
+int
+mac_ether_tunnel_offload_info(mblk_t *mp, mac_ether_offload_info_t *outer,
+    mac_ether_offload_info_t *inner)
+{
+	size_t off;
+
+	if (mac_ether_offload_info_off(mp, 0, outer) != 0)
+		return (-1);
+
+	switch (mac_tunnel_get(mp)) {
+	case MAC_TUNNEL_VXLAN:
+		if ((outer->meoi_flags & MEOI_L4INFO_SET) == 0 ||
+		    outer->meoi_l4proto != IPPROTO_UDP)
+			return (-1);
+		off = outer->meoi_l2hlen + outer->meoi_l3hlen +
+		    outer->meoi_l4hlen + VXLAN_HDR_LEN;
+		break;
+	default:
+		return (-1);
+	}
+
+	if (mac_ether_offload_info_off(mp, off, inner) != 0 ||
+	    (inner->meoi_flags & MEOI_L2INFO_SET) == 0)
+		return (-1);
+
+	return (0);
+}
+
+/*
+ * Return the MAC_TUNNEL_* encapsulation that a transmitted message has asked
+ * the provider to offload, or zero if it is not tunneled.
+ */
+uint32_t
+mac_tunnel_get(const mblk_t *mp)
+{
+	ASSERT(DB_TYPE(mp) == M_DATA);
+
+	if (DB_CKSUMFLAGS(mp) & HW_TUNNEL_VXLAN)
+		return (MAC_TUNNEL_VXLAN);
+	return (0);
+}
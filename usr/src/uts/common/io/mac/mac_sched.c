@@ -21,7 +21,7 @@
 /*
  * Copyright 2010 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
- * Copyright 2018 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright 2013 Nexenta Systems, Inc. All rights reserved.
  */
 
@@ -3218,6 +3218,28 @@ mac_rx_srs_subflow_process(void *arg, mac_resource_handle_t srs,
 	mcip = mac_srs->srs_mcip;
 	ASSERT(mcip != NULL);
 
+	/*
+	 * If the hardware steers one flow, and nothing else, to this ring
+	 * then the whole chain belongs to that flow; see mac_flow_hw_add().
+	 */
+	if (mac_srs->srs_hw_flent != NULL) {
+		flow_tab_t	*ft = mcip->mci_subflow_tab;
+		int		err = -1;
+
+		rw_enter(&ft->ft_lock, RW_READER);
+		if ((flent = mac_srs->srs_hw_flent) != NULL)
+			FLOW_TRY_REFHOLD(flent, err);
+		rw_exit(&ft->ft_lock);
+
+		if (err == 0) {
+			(flent->fe_cb_fn)(flent->fe_cb_arg1,
+			    flent->fe_cb_arg2, mp_chain, loopback);
+			FLOW_REFRELE(flent);
+			return;
+		}
+		flent = NULL;
+	}
+
 	/*
 	 * We need to determine the SRS for every packet
 	 * by walking the flow table, if we don't get any,
@@ -4284,6 +4306,57 @@ mac_tx_classify(mac_impl_t *mip, mblk_t *mp)
 	return (flent);
 }
 
+/*
+ * Return B_TRUE if the Ethernet frame mp has the same destination address,
+ * VLAN and type as prev, and so belongs to the same local flow.
+ */
+static boolean_t
+mac_tx_same_dst(const mblk_t *mp, const mblk_t *prev)
+{
+	const struct ether_vlan_header *evh, *pevh;
+
+	if (MBLKL(mp) < sizeof (struct ether_vlan_header) ||
+	    MBLKL(prev) < sizeof (struct ether_vlan_header))
+		return (B_FALSE);
+
+	evh = (const struct ether_vlan_header *)mp->b_rptr;
+	pevh = (const struct ether_vlan_header *)prev->b_rptr;
+
+	if (bcmp(&evh->ether_dhost, &pevh->ether_dhost, ETHERADDRL) != 0 ||
+	    evh->ether_tpid != pevh->ether_tpid)
+		return (B_FALSE);
+
+	if (evh->ether_tpid == htons(ETHERTYPE_VLAN) &&
+	    VLAN_ID(ntohs(evh->ether_tci)) != VLAN_ID(ntohs(pevh->ether_tci)))
+		return (B_FALSE);
+
+	return (B_TRUE);
+}
+
+/*
+ * Deliver a chain of packets from one local MAC client to another, dropping
+ * the reference on the destination flow that mac_tx_classify() took.  We
+ * force a context switch if both source and destination MAC clients are
+ * used by IP, i.e. bypass is set.
+ */
+static void
+mac_tx_loopback(mac_client_impl_t *src_mcip, flow_entry_t *dst_flow_ent,
+    mblk_t *mp_chain)
+{
+	mac_client_impl_t *dst_mcip = dst_flow_ent->fe_mcip;
+	boolean_t do_switch;
+
+	do_switch = ((src_mcip->mci_state_flags &
+	    dst_mcip->mci_state_flags & MCIS_CLIENT_POLL_CAPABLE) != 0);
+
+	mac_hw_emul(&mp_chain, NULL, NULL, MAC_ALL_EMULS);
+	if (mp_chain != NULL) {
+		(dst_flow_ent->fe_cb_fn)(dst_flow_ent->fe_cb_arg1,
+		    dst_flow_ent->fe_cb_arg2, mp_chain, do_switch);
+	}
+	FLOW_REFRELE(dst_flow_ent);
+}
+
 /*
  * This macro is only meant to be used by mac_tx_send().
  */
@@ -4317,7 +4390,9 @@ mac_tx_send(mac_client_handle_t mch, mac_ring_handle_t ring, mblk_t *mp_chain,
 	mac_impl_t *mip = src_mcip->mci_mip;
 	uint_t obytes = 0, opackets = 0, oerrors = 0;
 	mblk_t *mp = NULL, *next;
-	boolean_t vid_check, add_tag;
+	flow_entry_t *lb_flent = NULL;
+	mblk_t *lb_head = NULL, *lb_tail = NULL;
+	boolean_t vid_check, add_tag, batch;
 	uint16_t vid = 0;
 
 	if (mip->mi_nclients > 1) {
@@ -4373,6 +4448,7 @@ mac_tx_send(mac_client_handle_t mch, mac_ring_handle_t ring, mblk_t *mp_chain,
 	DTRACE_PROBE3(slowpath, mac_client_impl_t *,
 	    src_mcip, int, mip->mi_nclients, mblk_t *, mp_chain);
 
+	batch = (mip->mi_info.mi_nativemedia == DL_ETHER);
 	mp = mp_chain;
 	while (mp != NULL) {
 		flow_entry_t *dst_flow_ent;
@@ -4386,6 +4462,26 @@ mac_tx_send(mac_client_handle_t mch, mac_ring_handle_t ring, mblk_t *mp_chain,
 		obytes += pkt_size;
 		CHECK_VID_AND_ADD_TAG(mp);
 
+		/*
+		 * A run of packets for the same local client, such as a TCP
+		 * window's worth between two zones, is delivered as one
+		 * chain, and only its first packet is classified.
+		 */
+		if (lb_flent != NULL) {
+			if (batch && mac_tx_same_dst(mp, lb_head)) {
+				if (mip->mi_promisc_list != NULL) {
+					mac_promisc_dispatch(mip, mp, src_mcip,
+					    B_TRUE);
+				}
+				lb_tail->b_next = mp;
+				lb_tail = mp;
+				mp = next;
+				continue;
+			}
+			mac_tx_loopback(src_mcip, lb_flent, lb_head);
+			lb_flent = NULL;
+		}
+
 		/*
 		 * Find the destination.
 		 */
@@ -4406,20 +4502,14 @@ mac_tx_send(mac_client_handle_t mch, mac_ring_handle_t ring, mblk_t *mp_chain,
 				 */
 				mac_bcast_send(flow_cookie, src_mcip, mp,
 				    B_TRUE);
+				FLOW_REFRELE(dst_flow_ent);
 			} else {
 				/*
 				 * loopback the packet to a local MAC
-				 * client. We force a context switch
-				 * if both source and destination MAC
-				 * clients are used by IP, i.e.
-				 * bypass is set.
-				 */
-				boolean_t do_switch;
-
-				mac_client_impl_t *dst_mcip =
-				    dst_flow_ent->fe_mcip;
-
-				/*
+				 * client, starting a new run; the run
+				 * keeps the flow's reference until it is
+				 * delivered.
+				 *
 				 * Check if there are promiscuous mode
 				 * callbacks defined. This check is
 				 * done here in the 'else' case and
@@ -4435,21 +4525,9 @@ mac_tx_send(mac_client_handle_t mch, mac_ring_handle_t ring, mblk_t *mp_chain,
 					mac_promisc_dispatch(mip, mp, src_mcip,
 					    B_TRUE);
 				}
-
-				do_switch = ((src_mcip->mci_state_flags &
-				    dst_mcip->mci_state_flags &
-				    MCIS_CLIENT_POLL_CAPABLE) != 0);
-
-				mac_hw_emul(&mp, NULL, NULL, MAC_ALL_EMULS);
-				if (mp != NULL) {
-					(dst_flow_ent->fe_cb_fn)(
-					    dst_flow_ent->fe_cb_arg1,
-					    dst_flow_ent->fe_cb_arg2,
-					    mp, do_switch);
-				}
-
+				lb_flent = dst_flow_ent;
+				lb_head = lb_tail = mp;
 			}
-			FLOW_REFRELE(dst_flow_ent);
 		} else {
 			/*
 			 * Unknown destination, send via the underlying
@@ -4470,6 +4548,9 @@ mac_tx_send(mac_client_handle_t mch, mac_ring_handle_t ring, mblk_t *mp_chain,
 		mp = next;
 	}
 
+	if (lb_flent != NULL)
+		mac_tx_loopback(src_mcip, lb_flent, lb_head);
+
 done:
 	stats->mts_obytes = obytes;
 	stats->mts_opackets = opackets;
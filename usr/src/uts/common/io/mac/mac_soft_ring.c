@@ -79,8 +79,10 @@
 #include <sys/strsubr.h>
 #include <sys/strsun.h>
 #include <sys/vlan.h>
+#include <sys/pattr.h>
 #include <inet/ipsec_impl.h>
 #include <inet/ip_impl.h>
+#include <inet/tcp.h>
 #include <inet/sadb.h>
 #include <inet/ipsecesp.h>
 #include <inet/ipsecah.h>
@@ -99,6 +101,14 @@ static void mac_tx_soft_ring_drain(mac_soft_ring_t *);
 uint32_t mac_tx_soft_ring_max_q_cnt = 100000;
 uint32_t mac_tx_soft_ring_hiwat = 1000;
 
+/*
+ * Software receive offload for the IPv4 TCP soft rings; see
+ * mac_rx_soft_ring_lro().  mac_rx_lro_max_len bounds the IP length of a
+ * coalesced packet.
+ */
+boolean_t mac_rx_lro_enable = B_TRUE;
+uint32_t mac_rx_lro_max_len = IP_MAXPACKET;
+
 extern kmem_cache_t *mac_soft_ring_cache;
 
 #define	ADD_SOFTRING_TO_SET(mac_srs, softring) {			\
@@ -338,6 +348,214 @@ mac_soft_ring_fire(void *arg)
 	mutex_exit(&ringp->s_ring_lock);
 }
 
+/*
+ * Software LRO.
+ *
+ * The IPv4 TCP soft rings of a DLS bypass client hold packets which start
+ * at an aligned IP header.  Before a chain taken off one of them goes up
+ * to IP, runs of in-order segments of the same connection are coalesced
+ * into one packet so that IP and TCP pay their per-packet costs once per
+ * run rather than once per segment.  This does in software what a NIC
+ * with hardware LRO does, and so places the same conditions on a segment:
+ * a single, unshared mblk holding exactly one unfragmented IPv4 packet
+ * with no IP options, whose IP and TCP checksums the hardware verified, and
+ * which carries data and no TCP flags other than ACK and PSH.  A segment
+ * joins the packet before it in the same connection if it is the next in
+ * sequence, if its ACK, window, TOS, TTL and TCP options all match, and if
+ * it is no larger than the first.  A shorter segment, or one with PSH,
+ * closes the run.
+ *
+ * A coalesced packet is the first segment's mblk with each later segment's
+ * mblk added on its b_cont chain, its b_rptr moved past that segment's
+ * (unchanged) headers.  The IP length and header checksum are rewritten;
+ * the TCP header is not.  It is flagged HW_LSO with the first segment's
+ * payload size in DB_LSOMSS, which lets IP undo the coalescing exactly
+ * should it have to forward the packet (see <sys/pattr.h>).
+ *
+ * Only a few connections are tracked at a time, which is enough since the
+ * chains are themselves fanned out by connection.
+ */
+#define	MAC_RX_LRO_FLOWS	8
+
+typedef struct mac_rx_lro_s {
+	mblk_t		*lro_mp;	/* first segment */
+	mblk_t		*lro_tail;	/* last mblk on lro_mp's b_cont */
+	uint32_t	lro_seq;	/* next sequence number expected */
+	uint32_t	lro_len;	/* IP length so far */
+	uint32_t	lro_mss;	/* first segment's payload */
+	uint32_t	lro_segs;
+	boolean_t	lro_closed;
+} mac_rx_lro_t;
+
+/*
+ * Return the TCP header of mp if it is a segment that may be coalesced,
+ * else NULL.
+ */
+static tcpha_t *
+mac_rx_lro_tcpha(mblk_t *mp)
+{
+	ipha_t		*ipha = (ipha_t *)mp->b_rptr;
+	tcpha_t		*tcpha;
+	size_t		len = MBLKL(mp);
+	uint_t		hlen;
+
+	if (mp->b_cont != NULL || DB_REF(mp) != 1 || !OK_32PTR(ipha) ||
+	    (DB_CKSUMFLAGS(mp) & (HCK_IPV4_HDRCKSUM_OK | HCK_FULLCKSUM_OK)) !=
+	    (HCK_IPV4_HDRCKSUM_OK | HCK_FULLCKSUM_OK) ||
+	    len < IP_SIMPLE_HDR_LENGTH + TCP_MIN_HEADER_LENGTH)
+		return (NULL);
+
+	if (ipha->ipha_version_and_hdr_length != IP_SIMPLE_HDR_VERSION ||
+	    ipha->ipha_protocol != IPPROTO_TCP ||
+	    ntohs(ipha->ipha_length) != len ||
+	    (ipha->ipha_fragment_offset_and_flags & ~IPH_DF_HTONS) != 0)
+		return (NULL);
+
+	tcpha = (tcpha_t *)&mp->b_rptr[IP_SIMPLE_HDR_LENGTH];
+	hlen = IP_SIMPLE_HDR_LENGTH + TCP_HDR_LENGTH(tcpha);
+	if (hlen >= len || (tcpha->tha_flags & ~(TH_ACK | TH_PUSH)) != 0 ||
+	    !(tcpha->tha_flags & TH_ACK))
+		return (NULL);
+
+	return (tcpha);
+}
+
+/*
+ * Finish off a coalesced packet, if that is what lro holds.
+ */
+static void
+mac_rx_lro_flush(mac_rx_lro_t *lro, uint64_t *pktsp, uint64_t *segsp)
+{
+	mblk_t	*mp = lro->lro_mp;
+	ipha_t	*ipha = (ipha_t *)mp->b_rptr;
+
+	if (lro->lro_segs > 1) {
+		ipha->ipha_length = htons(lro->lro_len);
+		ipha->ipha_hdr_checksum = 0;
+		ipha->ipha_hdr_checksum = (uint16_t)ip_csum_hdr(ipha);
+		DB_CKSUMFLAGS(mp) |= HW_LSO;
+		DB_LSOMSS(mp) = lro->lro_mss;
+		(*pktsp)++;
+		*segsp += lro->lro_segs;
+	}
+	lro->lro_mp = NULL;
+}
+
+/*
+ * Coalesce the segments of chain as described above, returning the new
+ * chain.  The number of coalesced packets made, and of segments that went
+ * into them, are added to *pktsp and *segsp.
+ */
+static mblk_t *
+mac_rx_soft_ring_lro(mblk_t *chain, uint64_t *pktsp, uint64_t *segsp)
+{
+	mac_rx_lro_t	flows[MAC_RX_LRO_FLOWS];
+	mac_rx_lro_t	*lro;
+	mblk_t		*head = NULL, *tail = NULL;
+	mblk_t		*mp, *next;
+	uint_t		victim = 0;
+	int		i;
+
+	bzero(flows, sizeof (flows));
+
+	for (mp = chain; mp != NULL; mp = next) {
+		ipha_t		*ipha = (ipha_t *)mp->b_rptr;
+		tcpha_t		*tcpha;
+		uint32_t	seq, plen;
+		uint_t		thlen;
+
+		next = mp->b_next;
+		mp->b_next = NULL;
+
+		if ((tcpha = mac_rx_lro_tcpha(mp)) == NULL)
+			goto deliver;
+
+		thlen = TCP_HDR_LENGTH(tcpha);
+		plen = ntohs(ipha->ipha_length) - IP_SIMPLE_HDR_LENGTH - thlen;
+		seq = ntohl(tcpha->tha_seq);
+
+		lro = NULL;
+		for (i = 0; i < MAC_RX_LRO_FLOWS; i++) {
+			ipha_t	*oipha;
+			tcpha_t	*otcpha;
+
+			if (flows[i].lro_mp == NULL)
+				continue;
+			oipha = (ipha_t *)flows[i].lro_mp->b_rptr;
+			otcpha = (tcpha_t *)&flows[i].lro_mp->b_rptr[
+			    IP_SIMPLE_HDR_LENGTH];
+			if (oipha->ipha_src == ipha->ipha_src &&
+			    oipha->ipha_dst == ipha->ipha_dst &&
+			    *(uint32_t *)otcpha == *(uint32_t *)tcpha) {
+				lro = &flows[i];
+				break;
+			}
+		}
+
+		if (lro != NULL) {
+			ipha_t	*oipha = (ipha_t *)lro->lro_mp->b_rptr;
+			tcpha_t	*otcpha = (tcpha_t *)&lro->lro_mp->b_rptr[
+			    IP_SIMPLE_HDR_LENGTH];
+
+			if (!lro->lro_closed && seq == lro->lro_seq &&
+			    plen <= lro->lro_mss &&
+			    lro->lro_len + plen <= mac_rx_lro_max_len &&
+			    tcpha->tha_ack == otcpha->tha_ack &&
+			    tcpha->tha_win == otcpha->tha_win &&
+			    ipha->ipha_type_of_service ==
+			    oipha->ipha_type_of_service &&
+			    ipha->ipha_ttl == oipha->ipha_ttl &&
+			    TCP_HDR_LENGTH(otcpha) == thlen &&
+			    bcmp(&otcpha[1], &tcpha[1],
+			    thlen - TCP_MIN_HEADER_LENGTH) == 0) {
+				mp->b_rptr += IP_SIMPLE_HDR_LENGTH + thlen;
+				lro->lro_tail->b_cont = mp;
+				lro->lro_tail = mp;
+				lro->lro_seq += plen;
+				lro->lro_len += plen;
+				lro->lro_segs++;
+				if (plen < lro->lro_mss ||
+				    (tcpha->tha_flags & TH_PUSH))
+					lro->lro_closed = B_TRUE;
+				continue;
+			}
+			mac_rx_lro_flush(lro, pktsp, segsp);
+		} else {
+			for (i = 0; i < MAC_RX_LRO_FLOWS; i++) {
+				if (flows[i].lro_mp == NULL) {
+					lro = &flows[i];
+					break;
+				}
+			}
+			if (lro == NULL) {
+				lro = &flows[victim];
+				victim = (victim + 1) % MAC_RX_LRO_FLOWS;
+				mac_rx_lro_flush(lro, pktsp, segsp);
+			}
+		}
+
+		lro->lro_mp = mp;
+		lro->lro_tail = mp;
+		lro->lro_seq = seq + plen;
+		lro->lro_len = ntohs(ipha->ipha_length);
+		lro->lro_mss = plen;
+		lro->lro_segs = 1;
+		lro->lro_closed = (tcpha->tha_flags & TH_PUSH) != 0;
+deliver:
+		if (head == NULL)
+			head = mp;
+		else
+			tail->b_next = mp;
+		tail = mp;
+	}
+
+	for (i = 0; i < MAC_RX_LRO_FLOWS; i++) {
+		if (flows[i].lro_mp != NULL)
+			mac_rx_lro_flush(&flows[i], pktsp, segsp);
+	}
+	return (head);
+}
+
 /*
  * Drain the soft ring pointed to by ringp.
  *
@@ -357,6 +575,8 @@ mac_rx_soft_ring_drain(mac_soft_ring_t *ringp)
 	mac_direct_rx_t	proc;
 	size_t		sz;
 	int		cnt;
+	uint64_t	lropkts, lrosegs;
+	boolean_t	lro;
 	mac_soft_ring_set_t	*mac_srs = ringp->s_ring_set;
 
 	ringp->s_ring_run = curthread;
@@ -371,6 +591,13 @@ mac_rx_soft_ring_drain(mac_soft_ring_t *ringp)
 	proc = ringp->s_ring_rx_func;
 	arg1 = ringp->s_ring_rx_arg1;
 	arg2 = ringp->s_ring_rx_arg2;
+	/*
+	 * Only packets fanned out for DLS bypass are known to start at the
+	 * IP header; clients without bypass (e.g. viona) see whole frames.
+	 */
+	lro = mac_rx_lro_enable && (ringp->s_ring_type & ST_RING_TCP) &&
+	    (mac_srs->srs_type & SRST_DLS_BYPASS) &&
+	    !(ringp->s_ring_mcip->mci_state_flags & MCIS_RX_BYPASS_DISABLE);
 
 	while ((ringp->s_ring_first != NULL) &&
 	    !(ringp->s_ring_state & S_RING_PAUSE)) {
@@ -388,6 +615,10 @@ mac_rx_soft_ring_drain(mac_soft_ring_t *ringp)
 			tid = NULL;
 		}
 
+		lropkts = lrosegs = 0;
+		if (lro && cnt > 1)
+			mp = mac_rx_soft_ring_lro(mp, &lropkts, &lrosegs);
+
 		(*proc)(arg1, arg2, mp, NULL);
 
 		/*
@@ -401,6 +632,8 @@ mac_rx_soft_ring_drain(mac_soft_ring_t *ringp)
 		mutex_enter(&mac_srs->srs_lock);
 		MAC_UPDATE_SRS_COUNT_LOCKED(mac_srs, cnt);
 		MAC_UPDATE_SRS_SIZE_LOCKED(mac_srs, sz);
+		mac_srs->srs_rx.sr_stat.mrs_lropkts += lropkts;
+		mac_srs->srs_rx.sr_stat.mrs_lrosegs += lrosegs;
 		mutex_exit(&mac_srs->srs_lock);
 
 		mutex_enter(&ringp->s_ring_lock);
@@ -539,6 +772,7 @@ mac_soft_ring_poll(mac_soft_ring_t *ringp, size_t bytes_to_pickup)
 	mblk_t	*mp;
 	size_t	sz = 0;
 	int	cnt = 0;
+	uint64_t lropkts = 0, lrosegs = 0;
 	mac_soft_ring_set_t	*mac_srs = ringp->s_ring_set;
 
 	ASSERT(mac_srs != NULL);
@@ -578,6 +812,11 @@ mac_soft_ring_poll(mac_soft_ring_t *ringp, size_t bytes_to_pickup)
 	}
 
 	mutex_exit(&ringp->s_ring_lock);
+
+	if (mac_rx_lro_enable && (ringp->s_ring_type & ST_RING_TCP) &&
+	    cnt > 1)
+		head = mac_rx_soft_ring_lro(head, &lropkts, &lrosegs);
+
 	/*
 	 * Update the shared count and size counters so
 	 * that SRS has a accurate idea of queued packets.
@@ -585,6 +824,8 @@ mac_soft_ring_poll(mac_soft_ring_t *ringp, size_t bytes_to_pickup)
 	mutex_enter(&mac_srs->srs_lock);
 	MAC_UPDATE_SRS_COUNT_LOCKED(mac_srs, cnt);
 	MAC_UPDATE_SRS_SIZE_LOCKED(mac_srs, sz);
+	mac_srs->srs_rx.sr_stat.mrs_lropkts += lropkts;
+	mac_srs->srs_rx.sr_stat.mrs_lrosegs += lrosegs;
 	mutex_exit(&mac_srs->srs_lock);
 	return (head);
 }
@@ -65,7 +65,9 @@ enum mac_stat {
 	MAC_STAT_MULTIRCVBYTES,
 	MAC_STAT_BRDCSTRCVBYTES,
 	MAC_STAT_MULTIXMTBYTES,
-	MAC_STAT_BRDCSTXMTBYTES
+	MAC_STAT_BRDCSTXMTBYTES,
+	MAC_STAT_LROPKTS,
+	MAC_STAT_LROSEGS
 };
 
 static mac_stat_info_t	i_mac_si[] = {
@@ -153,7 +155,9 @@ static mac_stat_info_t  i_mac_rx_swlane_si[] = {
 	{ MAC_STAT_LCLBYTES,	"localbytes",	KSTAT_DATA_UINT64,	0},
 	{ MAC_STAT_INTRS,	"intrs",	KSTAT_DATA_UINT64,	0},
 	{ MAC_STAT_INTRBYTES,	"intrbytes",	KSTAT_DATA_UINT64,	0},
-	{ MAC_STAT_RXSDROPS,	"rxsdrops",	KSTAT_DATA_UINT64,	0}
+	{ MAC_STAT_RXSDROPS,	"rxsdrops",	KSTAT_DATA_UINT64,	0},
+	{ MAC_STAT_LROPKTS,	"lropkts",	KSTAT_DATA_UINT64,	0},
+	{ MAC_STAT_LROSEGS,	"lrosegs",	KSTAT_DATA_UINT64,	0}
 };
 #define	MAC_RX_SWLANE_NKSTAT \
 	(sizeof (i_mac_rx_swlane_si) / sizeof (mac_stat_info_t))
@@ -171,7 +175,9 @@ static mac_stat_info_t  i_mac_rx_hwlane_si[] = {
 	{ MAC_STAT_RXSDROPS,	"rxsdrops",	KSTAT_DATA_UINT64,	0},
 	{ MAC_STAT_CHU10,	"chainunder10",	KSTAT_DATA_UINT64,	0},
 	{ MAC_STAT_CH10T50,	"chain10to50",	KSTAT_DATA_UINT64,	0},
-	{ MAC_STAT_CHO50,	"chainover50",	KSTAT_DATA_UINT64,	0}
+	{ MAC_STAT_CHO50,	"chainover50",	KSTAT_DATA_UINT64,	0},
+	{ MAC_STAT_LROPKTS,	"lropkts",	KSTAT_DATA_UINT64,	0},
+	{ MAC_STAT_LROSEGS,	"lrosegs",	KSTAT_DATA_UINT64,	0}
 };
 #define	MAC_RX_HWLANE_NKSTAT \
 	(sizeof (i_mac_rx_hwlane_si) / sizeof (mac_stat_info_t))
@@ -260,7 +266,9 @@ static stat_info_t rx_srs_stats_list[] = {
 	{RX_SRS_STAT_OFF(mrs_chaincntundr10)},
 	{RX_SRS_STAT_OFF(mrs_chaincnt10to50)},
 	{RX_SRS_STAT_OFF(mrs_chaincntover50)},
-	{RX_SRS_STAT_OFF(mrs_ierrors)}
+	{RX_SRS_STAT_OFF(mrs_ierrors)},
+	{RX_SRS_STAT_OFF(mrs_lropkts)},
+	{RX_SRS_STAT_OFF(mrs_lrosegs)}
 };
 #define	RX_SRS_STAT_SIZE		\
 	(sizeof (rx_srs_stats_list) / sizeof (stat_info_t))
@@ -575,6 +583,12 @@ i_mac_rx_swlane_stat_get(void *handle, uint_t stat)
 	case MAC_STAT_RXSDROPS:
 		return (mac_rx_stat->mrs_sdrops);
 
+	case MAC_STAT_LROPKTS:
+		return (mac_rx_stat->mrs_lropkts);
+
+	case MAC_STAT_LROSEGS:
+		return (mac_rx_stat->mrs_lrosegs);
+
 	default:
 		return (0);
 	}
@@ -643,6 +657,12 @@ i_mac_rx_hwlane_stat_get(void *handle, uint_t stat)
 	case MAC_STAT_CHO50:
 		return (mac_rx_stat->mrs_chaincntover50);
 
+	case MAC_STAT_LROPKTS:
+		return (mac_rx_stat->mrs_lropkts);
+
+	case MAC_STAT_LROSEGS:
+		return (mac_rx_stat->mrs_lrosegs);
+
 	default:
 		return (0);
 	}
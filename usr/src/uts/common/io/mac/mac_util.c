@@ -51,6 +51,7 @@
 #include <inet/tcp.h>
 #include <inet/udp_impl.h>
 #include <inet/sctp_ip.h>
+#include <sys/vxlan.h>
 
 /*
  * The next two functions are used for dropping packets or chains of
@@ -1285,6 +1286,62 @@ fail:
 
 #define	HCK_NEEDED	(HCK_IPV4_HDRCKSUM | HCK_PARTIALCKSUM | HCK_FULLCKSUM)
 
+/*
+ * Emulate the inner checksum offloads of a tunneled message. The message is
+ * pulled up into a single private mblk, whose read pointer is temporarily
+ * advanced to the inner frame so that mac_sw_cksum() can do the real work.
+ * The outer headers are left alone: the outer IPv4 header checksum has
+ * already been filled in by the stack and VXLAN leaves the UDP checksum
+ * zero. Tunnel LSO is not emulated; such messages are dropped.
+ */
+static mblk_t *
+mac_sw_tunnel(mblk_t *mp, mac_emul_t emul)
+{
+	mac_ether_offload_info_t outer, inner;
+	mblk_t *nmp, *tmp;
+	uint32_t flags = DB_CKSUMFLAGS(mp);
+	size_t off;
+
+	if ((flags & HW_LSO) != 0) {
+		if ((emul & MAC_LSO_EMUL) == 0)
+			return (mp);
+		mac_drop_pkt(mp, "tunnel LSO emulation not supported");
+		return (NULL);
+	}
+
+	if ((flags & HCK_NEEDED) == 0 || (emul & MAC_HWCKSUM_EMULS) == 0) {
+		DB_CKSUMFLAGS(mp) &= ~HW_TUNNEL_FLAGS;
+		return (mp);
+	}
+
+	if (mac_ether_tunnel_offload_info(mp, &outer, &inner) != 0 ||
+	    (inner.meoi_flags & MEOI_L3INFO_SET) == 0) {
+		mac_drop_pkt(mp, "failed to parse tunneled frame");
+		return (NULL);
+	}
+	off = outer.meoi_l2hlen + outer.meoi_l3hlen + outer.meoi_l4hlen +
+	    VXLAN_HDR_LEN;
+
+	if ((nmp = msgpullup(mp, -1)) == NULL) {
+		mac_drop_pkt(mp, "tunnel pullup failed");
+		return (NULL);
+	}
+	mac_hcksum_clone(mp, nmp);
+	freemsg(mp);
+
+	DB_CKSUMFLAGS(nmp) = flags & ~HW_TUNNEL_FLAGS;
+	nmp->b_rptr += off;
+	tmp = mac_sw_cksum(nmp, emul);
+	if (tmp == NULL) {
+		/* mac_sw_cksum() freed nmp. */
+		return (NULL);
+	}
+	ASSERT3P(tmp, ==, nmp);
+	nmp->b_rptr -= off;
+
+	return (nmp);
+}
+
 /*
  * Emulate various hardware offload features in software. Take a chain
  * of packets as input and emulate the hardware features specified in
@@ -1368,7 +1425,21 @@ mac_hw_emul(mblk_t **mp_chain, mblk_t **otail, uint_t *ocount, mac_emul_t emul)
 		 */
 		flags = DB_CKSUMFLAGS(mp);
 
-		if ((flags & HW_LSO) && (emul & MAC_LSO_EMUL)) {
+		if (flags & HW_TUNNEL_FLAGS) {
+			/*
+			 * The offload flags of a tunneled message describe
+			 * its inner frame, which needs its own handling.
+			 */
+			tmp = mac_sw_tunnel(mp, emul);
+			if (tmp == NULL) {
+				/* mac_sw_tunnel() freed the mp. */
+				mp = next;
+				continue;
+			}
+			tmphead = tmp;
+			tmptail = tmp;
+			count++;
+		} else if ((flags & HW_LSO) && (emul & MAC_LSO_EMUL)) {
 			uint_t tmpcount = 0;
 
 			/*
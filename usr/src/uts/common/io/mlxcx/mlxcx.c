@@ -318,6 +318,16 @@
  *                 | on loan to MAC |----------->O
  *                 +----------------+  freemsg()
  *
+ * Striding RQs (see the "rx_striding" property) change this a little. Each
+ * buffer_t covers every stride of one multi-packet WQE and is shared by all
+ * the packets the hardware places into it. Rather than loaning the buffer_t
+ * itself, mlxcx_rx_completion_striding() makes a new mblk for each packet
+ * pointing into the buffer and takes a reference (mlb_refcnt) for it. The
+ * buffer holds one more reference on behalf of the hardware, which is
+ * dropped by mlxcx_buf_return() once every stride has been consumed; at that
+ * point the buffer moves to the "loaned" list. Whichever of these drops the
+ * last reference sends the buffer on to the free list (or to be destroyed,
+ * if draining) as above.
  */
 
 /*
@@ -593,6 +603,51 @@ mlxcx_load_props(mlxcx_t *mlxp)
 		    MLXCX_RX_PER_CQ_MIN, MLXCX_RX_PER_CQ_MAX);
 		p->mldp_rx_per_cq = MLXCX_RX_PER_CQ_DEFAULT;
 	}
+
+	p->mldp_rx_striding = ddi_getprop(DDI_DEV_T_ANY, mlxp->mlx_dip,
+	    DDI_PROP_CANSLEEP | DDI_PROP_DONTPASS, "rx_striding", 1) != 0;
+	p->mldp_rx_stride_shift = ddi_getprop(DDI_DEV_T_ANY, mlxp->mlx_dip,
+	    DDI_PROP_CANSLEEP | DDI_PROP_DONTPASS, "rx_stride_shift",
+	    MLXCX_RX_STRIDE_SHIFT_DFLT);
+	if (p->mldp_rx_stride_shift < MLXCX_WORKQ_LOG_STRIDE_SZ_BASE ||
+	    p->mldp_rx_stride_shift > MLXCX_WORKQ_LOG_STRIDE_SZ_MAX) {
+		mlxcx_warn(mlxp, "!rx_stride_shift = %u is "
+		    "out of range. Defaulting to: %d. Valid values are from "
+		    "%d to %d", p->mldp_rx_stride_shift,
+		    MLXCX_RX_STRIDE_SHIFT_DFLT, MLXCX_WORKQ_LOG_STRIDE_SZ_BASE,
+		    MLXCX_WORKQ_LOG_STRIDE_SZ_MAX);
+		p->mldp_rx_stride_shift = MLXCX_RX_STRIDE_SHIFT_DFLT;
+	}
+	p->mldp_rx_strides_shift = ddi_getprop(DDI_DEV_T_ANY, mlxp->mlx_dip,
+	    DDI_PROP_CANSLEEP | DDI_PROP_DONTPASS, "rx_strides_per_wqe_shift",
+	    MLXCX_RX_STRIDES_PER_WQE_SHIFT_DFLT);
+	if (p->mldp_rx_strides_shift < MLXCX_WORKQ_LOG_NUM_STRIDES_BASE ||
+	    p->mldp_rx_strides_shift > MLXCX_WORKQ_LOG_NUM_STRIDES_MAX) {
+		mlxcx_warn(mlxp, "!rx_strides_per_wqe_shift = %u is "
+		    "out of range. Defaulting to: %d. Valid values are from "
+		    "%d to %d", p->mldp_rx_strides_shift,
+		    MLXCX_RX_STRIDES_PER_WQE_SHIFT_DFLT,
+		    MLXCX_WORKQ_LOG_NUM_STRIDES_BASE,
+		    MLXCX_WORKQ_LOG_NUM_STRIDES_MAX);
+		p->mldp_rx_strides_shift = MLXCX_RX_STRIDES_PER_WQE_SHIFT_DFLT;
+	}
+	p->mldp_rq_striding_size_shift = ddi_getprop(DDI_DEV_T_ANY,
+	    mlxp->mlx_dip, DDI_PROP_CANSLEEP | DDI_PROP_DONTPASS,
+	    "rq_striding_size_shift", MLXCX_RQ_STRIDING_SIZE_SHIFT_DFLT);
+	/*
+	 * Each WQE can generate one CQE per stride, so the CQ behind a
+	 * striding RQ must hold (WQEs * strides) entries. Keep that within
+	 * what a CQ can be created with.
+	 */
+	if (p->mldp_rq_striding_size_shift < 2 ||
+	    p->mldp_rq_striding_size_shift + p->mldp_rx_strides_shift >
+	    MLXCX_CQ_SIZE_SHIFT_MAX) {
+		mlxcx_warn(mlxp, "!rq_striding_size_shift = %u is "
+		    "out of range for %u strides per WQE; striding RQs "
+		    "disabled", p->mldp_rq_striding_size_shift,
+		    1U << p->mldp_rx_strides_shift);
+		p->mldp_rx_striding = B_FALSE;
+	}
 }
 
 void
@@ -2515,6 +2570,17 @@ mlxcx_init_caps(mlxcx_t *mlxp)
 
 	c->mlc_max_tir = (1 << gen->mlcap_general_log_max_tir);
 
+	/*
+	 * The RQ stride size caps are zero on hardware which cannot do
+	 * striding (multi-packet WQE) receive queues.
+	 */
+	c->mlc_max_rx_stride_shift =
+	    gen->mlcap_general_log_max_stride_sz_rq.bit_val &
+	    MLXCX_CAP_GENERAL_LOG_STRIDE_SZ_MASK;
+	c->mlc_min_rx_stride_shift = gen->mlcap_general_log_min_stride_sz_rq &
+	    MLXCX_CAP_GENERAL_LOG_STRIDE_SZ_MASK;
+	c->mlc_rx_striding = (c->mlc_max_rx_stride_shift != 0);
+
 	c->mlc_checksum = get_bit32(c->mlc_ether_cur.mhc_eth.mlcap_eth_flags,
 	    MLXCX_ETH_CAP_CSUM_CAP);
 	c->mlc_vxlan = get_bit32(c->mlc_ether_cur.mhc_eth.mlcap_eth_flags,
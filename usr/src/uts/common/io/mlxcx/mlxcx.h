@@ -104,6 +104,8 @@ extern "C" {
  */
 #define	MLXCX_CQ_SIZE_SHIFT_DFLT	10
 #define	MLXCX_CQ_SIZE_SHIFT_25G		12
+/* Largest CQ which fits in MLXCX_CREATE_QUEUE_MAX_PAGES of 64-byte CQEs */
+#define	MLXCX_CQ_SIZE_SHIFT_MAX		13
 
 /*
  * Default to making SQs bigger than RQs for 9k MTU, since most packets will
@@ -121,7 +123,24 @@ extern "C" {
 #define	MLXCX_WQ_HWM_GAP		MLXCX_CQ_HWM_GAP
 #define	MLXCX_WQ_LWM_GAP		MLXCX_CQ_LWM_GAP
 
-#define	MLXCX_RQ_REFILL_STEP		64
+/*
+ * RQs are refilled in batches of up to this many buffers, or a quarter of
+ * the queue for the short queues used by striding RQs.
+ */
+#define	MLXCX_RQ_REFILL_STEP_MAX	64
+#define	MLXCX_RQ_REFILL_STEP(wq)	\
+	MIN(MLXCX_RQ_REFILL_STEP_MAX, (wq)->mlwq_nents / 4)
+
+/*
+ * Striding (multi-packet) receive queues. Each RQ WQE points at one large
+ * buffer which the hardware carves up into fixed-size strides, placing
+ * each packet into as many consecutive strides as it needs. With the
+ * defaults below every WQE is 512 strides of 256 bytes (128KiB), and the
+ * RQ is much shorter than a regular one since each WQE holds many packets.
+ */
+#define	MLXCX_RX_STRIDE_SHIFT_DFLT		8
+#define	MLXCX_RX_STRIDES_PER_WQE_SHIFT_DFLT	9
+#define	MLXCX_RQ_STRIDING_SIZE_SHIFT_DFLT	4
 
 /*
  * CQ event moderation
@@ -540,6 +559,17 @@ typedef struct mlxcx_buffer {
 	mlxcx_dma_buffer_t	mlb_dma;
 	mblk_t			*mlb_mp;
 	frtn_t			mlb_frtn;
+
+	/*
+	 * Striding RQ buffers are shared between every packet the hardware
+	 * places into their strides. mlb_refcnt counts the hardware's hold
+	 * (while on the WQ) plus each mblk loaned up the stack; the buffer
+	 * goes back to the free list when it drops to zero.
+	 */
+	boolean_t		mlb_striding;
+	uint_t			mlb_strides_used;
+	volatile uint_t		mlb_refcnt;
+	frtn_t			mlb_stride_frtn;
 } mlxcx_buffer_t;
 
 typedef enum {
@@ -651,6 +681,11 @@ struct mlxcx_work_queue {
 	mlxcx_eth_inline_mode_t		mlwq_inline_mode;
 	size_t				mlwq_entshift;
 	size_t				mlwq_nents;
+
+	/* Striding (multi-packet WQE) RQ parameters */
+	boolean_t			mlwq_striding;
+	uint_t				mlwq_stride_shift;
+	uint_t				mlwq_nstrides_shift;
 	/* Discriminate based on mwq_type */
 	union {
 		mlxcx_sendq_ent_t	*mlwq_send_ent;
@@ -974,6 +1009,10 @@ typedef struct {
 
 	size_t			mlc_max_tir;
 
+	boolean_t		mlc_rx_striding;
+	uint_t			mlc_min_rx_stride_shift;
+	uint_t			mlc_max_rx_stride_shift;
+
 	/* Raw caps data */
 	mlxcx_hca_cap_t		mlc_hca_cur;
 	mlxcx_hca_cap_t		mlc_hca_max;
@@ -1007,6 +1046,10 @@ typedef struct {
 	uint64_t		mldp_eq_check_interval_sec;
 	uint64_t		mldp_cq_check_interval_sec;
 	uint64_t		mldp_wq_check_interval_sec;
+	boolean_t		mldp_rx_striding;
+	uint_t			mldp_rx_stride_shift;
+	uint_t			mldp_rx_strides_shift;
+	uint_t			mldp_rq_striding_size_shift;
 } mlxcx_drv_props_t;
 
 typedef enum {
@@ -1262,6 +1305,8 @@ extern boolean_t mlxcx_buf_create(mlxcx_t *, mlxcx_buf_shard_t *,
     mlxcx_buffer_t **);
 extern boolean_t mlxcx_buf_create_foreign(mlxcx_t *, mlxcx_buf_shard_t *,
     mlxcx_buffer_t **);
+extern boolean_t mlxcx_buf_create_striding(mlxcx_t *, mlxcx_work_queue_t *,
+    mlxcx_buffer_t **);
 extern mlxcx_buffer_t *mlxcx_buf_take(mlxcx_t *, mlxcx_work_queue_t *);
 extern size_t mlxcx_buf_take_n(mlxcx_t *, mlxcx_work_queue_t *,
     mlxcx_buffer_t **, size_t);
@@ -1303,6 +1348,9 @@ extern void mlxcx_tx_completion(mlxcx_t *, mlxcx_completion_queue_t *,
     mlxcx_completionq_ent_t *, mlxcx_buffer_t *);
 extern mblk_t *mlxcx_rx_completion(mlxcx_t *, mlxcx_completion_queue_t *,
     mlxcx_completionq_ent_t *, mlxcx_buffer_t *);
+extern mblk_t *mlxcx_rx_completion_striding(mlxcx_t *,
+    mlxcx_completion_queue_t *, mlxcx_completionq_ent_t *, mlxcx_buffer_t *,
+    boolean_t *);
 
 extern mlxcx_buf_shard_t *mlxcx_mlbs_create(mlxcx_t *);
 
@@ -2452,12 +2452,32 @@ mlxcx_cmd_create_rq(mlxcx_t *mlxp, mlxcx_work_queue_t *mlwq)
 	set_bit32(&ctx->mlrqc_flags, MLXCX_RQ_FLAGS_VLAN_STRIP_DISABLE);
 	ctx->mlrqc_cqn = to_be24(mlwq->mlwq_cq->mlcq_num);
 
-	set_bits32(&ctx->mlrqc_wq.mlwqc_flags, MLXCX_WORKQ_CTX_TYPE,
-	    MLXCX_WORKQ_TYPE_CYCLIC);
 	ctx->mlrqc_wq.mlwqc_pd = to_be24(mlwq->mlwq_pd->mlpd_num);
 	ctx->mlrqc_wq.mlwqc_log_wq_sz = mlwq->mlwq_entshift;
 	ctx->mlrqc_wq.mlwqc_log_wq_stride = MLXCX_RECVQ_STRIDE_SHIFT;
 
+	if (mlwq->mlwq_striding) {
+		set_bits32(&ctx->mlrqc_wq.mlwqc_flags, MLXCX_WORKQ_CTX_TYPE,
+		    MLXCX_WORKQ_TYPE_CYCLIC_STRIDING);
+		set_bits16(&ctx->mlrqc_wq.mlwqc_strides,
+		    MLXCX_WORKQ_CTX_LOG_WQE_NUM_STRIDES,
+		    mlwq->mlwq_nstrides_shift -
+		    MLXCX_WORKQ_LOG_NUM_STRIDES_BASE);
+		set_bits16(&ctx->mlrqc_wq.mlwqc_strides,
+		    MLXCX_WORKQ_CTX_LOG_WQE_STRIDE_SZ,
+		    mlwq->mlwq_stride_shift - MLXCX_WORKQ_LOG_STRIDE_SZ_BASE);
+		/*
+		 * Have the hardware start each packet two bytes into its
+		 * stride so the IP header ends up 4-byte aligned, as we do
+		 * for regular RQ buffers with mlxcx_dma_alloc_offset().
+		 */
+		set_bit16(&ctx->mlrqc_wq.mlwqc_strides,
+		    MLXCX_WORKQ_CTX_TWO_BYTE_SHIFT);
+	} else {
+		set_bits32(&ctx->mlrqc_wq.mlwqc_flags, MLXCX_WORKQ_CTX_TYPE,
+		    MLXCX_WORKQ_TYPE_CYCLIC);
+	}
+
 	c = mlxcx_dma_cookie_one(&mlwq->mlwq_doorbell_dma);
 	ctx->mlrqc_wq.mlwqc_dbr_addr = to_be64(c->dmac_laddress);
 	ASSERT3U(c->dmac_size, >=, sizeof (mlxcx_workq_doorbell_t));
@@ -847,11 +847,12 @@ mlxcx_process_cq(mlxcx_t *mlxp, mlxcx_completion_queue_t *mlcq, mblk_t **mpp,
 	mlxcx_completionq_ent_t *cent;
 	mblk_t *mp, *cmp, *nmp;
 	mlxcx_buffer_t *buf;
-	boolean_t found, added;
+	boolean_t found, added, done;
 	size_t bytes = 0;
 	uint_t rx_frames = 0;
 	uint_t comp_cnt = 0;
 	int64_t wqebbs, bufcnt;
+	uint16_t wqe_ctr;
 
 	*mpp = NULL;
 
@@ -883,6 +884,15 @@ mlxcx_process_cq(mlxcx_t *mlxp, mlxcx_completion_queue_t *mlcq, mblk_t **mpp,
 			goto nextcq;
 		}
 
+		/*
+		 * On a striding RQ the WQE counter holds the stride index
+		 * and the WQE is identified by the wqe_id field instead.
+		 */
+		if (wq->mlwq_striding)
+			wqe_ctr = from_be16(cent->mlcqe_wqe_id);
+		else
+			wqe_ctr = from_be16(cent->mlcqe_wqe_counter);
+
 lookagain:
 		/*
 		 * Generally the buffer we're looking for will be
@@ -892,8 +902,7 @@ lookagain:
 		buf = list_head(&mlcq->mlcq_buffers);
 		found = B_FALSE;
 		while (buf != NULL) {
-			if ((buf->mlb_wqe_index & UINT16_MAX) ==
-			    from_be16(cent->mlcqe_wqe_counter)) {
+			if ((buf->mlb_wqe_index & UINT16_MAX) == wqe_ctr) {
 				found = B_TRUE;
 				break;
 			}
@@ -926,13 +935,46 @@ lookagain:
 			mlxcx_warn(mlxp, "got completion on CQ %x but "
 			    "no buffer matching wqe found: %x (first "
 			    "buffer counter = %x)", mlcq->mlcq_num,
-			    from_be16(cent->mlcqe_wqe_counter),
-			    buf == NULL ? UINT32_MAX :
+			    wqe_ctr, buf == NULL ? UINT32_MAX :
 			    buf->mlb_wqe_index);
 			mlxcx_fm_ereport(mlxp, DDI_FM_DEVICE_INVAL_STATE);
 			goto nextcq;
 		}
 
+		if (wq->mlwq_striding) {
+			/*
+			 * Striding RQ buffers take many completions, and
+			 * only leave the CQ once the hardware has finished
+			 * with every stride.
+			 */
+			nmp = mlxcx_rx_completion_striding(mlxp, mlcq, cent,
+			    buf, &done);
+			if (nmp != NULL) {
+				bytes += MBLKL(nmp);
+				if (cmp != NULL) {
+					cmp->b_next = nmp;
+					cmp = nmp;
+				} else {
+					mp = cmp = nmp;
+				}
+
+				rx_frames++;
+			}
+			if (!done)
+				goto updateci;
+
+			wqebbs += buf->mlb_wqebbs;
+			list_remove(&mlcq->mlcq_buffers, buf);
+			bufcnt++;
+			mlxcx_buf_return(mlxp, buf);
+
+			mutex_enter(&wq->mlwq_mtx);
+			if (!(wq->mlwq_state & MLXCX_WQ_TEARDOWN))
+				mlxcx_rq_refill(mlxp, wq);
+			mutex_exit(&wq->mlwq_mtx);
+			goto updateci;
+		}
+
 		/*
 		 * The buf is likely to be freed below, count this now.
 		 */
@@ -961,15 +1003,19 @@ lookagain:
 			break;
 		}
 
+updateci:
 		/*
 		 * Update the consumer index with what has been processed,
 		 * followed by driver counters. It is important to tell the
 		 * hardware first, otherwise when we throw more packets at
 		 * it, it may get an overflow error.
 		 * We do this whenever we've processed enough to bridge the
-		 * high->low water mark.
+		 * high->low water mark. Striding RQs can go many completions
+		 * without finishing a buffer, so count those instead.
 		 */
-		if (bufcnt > (MLXCX_CQ_LWM_GAP - MLXCX_CQ_HWM_GAP)) {
+		if (bufcnt > (MLXCX_CQ_LWM_GAP - MLXCX_CQ_HWM_GAP) ||
+		    (wq->mlwq_striding &&
+		    comp_cnt > (MLXCX_CQ_LWM_GAP - MLXCX_CQ_HWM_GAP))) {
 			mlxcx_update_cqci(mlxp, mlcq);
 			/*
 			 * Both these variables are incremented using
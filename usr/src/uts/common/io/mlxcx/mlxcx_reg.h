@@ -260,6 +260,16 @@ typedef enum {
 	MLXCX_CQE_OWNER_INIT		= 1
 } mlxcx_cqe_owner_t;
 
+/*
+ * On a striding RQ, the byte count of a CQE is split up into the size of the
+ * packet and the number of strides it consumed. A filler CQE carries no data
+ * and indicates that the remaining strides of a WQE have been skipped.
+ */
+#define	MLXCX_CQE_MPWQE_BYTE_CNT_MASK	0x0000ffff
+#define	MLXCX_CQE_MPWQE_STRIDES_MASK	0x3fff0000
+#define	MLXCX_CQE_MPWQE_STRIDES_SHIFT	16
+#define	MLXCX_CQE_MPWQE_FILLER		(1UL << 31)
+
 typedef enum {
 	MLXCX_VLAN_TYPE_NONE,
 	MLXCX_VLAN_TYPE_CVLAN,
@@ -308,7 +318,8 @@ typedef struct {
 
 typedef struct {
 	uint8_t		mlcqe_tunnel_flags;
-	uint8_t		mlcqe_rsvd[3];
+	uint8_t		mlcqe_rsvd;
+	uint16be_t	mlcqe_wqe_id;		/* WQE index on MPWQE */
 	uint8_t		mlcqe_lro_flags;
 	uint8_t		mlcqe_lro_min_ttl;
 	uint16be_t	mlcqe_lro_tcp_win;
@@ -639,6 +650,25 @@ typedef enum {
 						.bit_shift = 25, \
 						.bit_mask = 0x06000000 }
 
+/*
+ * These live in mlwqc_strides and only apply to striding work queues. The
+ * number of strides is 1 << (9 + value) and the stride size is
+ * 1 << (6 + value).
+ */
+/* CSTYLED */
+#define	MLXCX_WORKQ_CTX_LOG_WQE_NUM_STRIDES	(bitdef_t){ \
+						.bit_shift = 8, \
+						.bit_mask = 0x0f00 }
+#define	MLXCX_WORKQ_CTX_TWO_BYTE_SHIFT		(1 << 7)
+/* CSTYLED */
+#define	MLXCX_WORKQ_CTX_LOG_WQE_STRIDE_SZ	(bitdef_t){ \
+						.bit_shift = 0, \
+						.bit_mask = 0x0007 }
+#define	MLXCX_WORKQ_LOG_NUM_STRIDES_BASE	9
+#define	MLXCX_WORKQ_LOG_NUM_STRIDES_MAX		16
+#define	MLXCX_WORKQ_LOG_STRIDE_SZ_BASE		6
+#define	MLXCX_WORKQ_LOG_STRIDE_SZ_MAX		13
+
 #define	MLXCX_WORKQ_CTX_MAX_ADDRESSES		128
 
 typedef struct mlxcx_workq_ctx {
@@ -1450,8 +1480,18 @@ typedef struct {
 	uint8_t		mlcap_general_log_max_sq;
 	uint8_t		mlcap_general_log_max_tir;
 	uint8_t		mlcap_general_log_max_tis;
+	bits8_t		mlcap_general_log_max_rmp_flags;
+	uint8_t		mlcap_general_log_max_rqt;
+	uint8_t		mlcap_general_log_max_rqt_size;
+	uint8_t		mlcap_general_log_max_tis_per_sq;
+	bits8_t		mlcap_general_log_max_stride_sz_rq;
+	uint8_t		mlcap_general_log_min_stride_sz_rq;
+	uint8_t		mlcap_general_log_max_stride_sz_sq;
+	uint8_t		mlcap_general_log_min_stride_sz_sq;
 } mlxcx_hca_cap_general_caps_t;
 
+#define	MLXCX_CAP_GENERAL_LOG_STRIDE_SZ_MASK	0x1f
+
 typedef enum {
 	MLXCX_ETH_CAP_TUNNEL_STATELESS_VXLAN		= 1 << 0,
 	MLXCX_ETH_CAP_TUNNEL_STATELESS_GRE		= 1 << 1,
@@ -54,9 +54,21 @@ mlxcx_wq_alloc_dma(mlxcx_t *mlxp, mlxcx_work_queue_t *mlwq)
 		sz = mlwq->mlwq_nents * sizeof (mlxcx_sendq_ent_t);
 		break;
 	case MLXCX_WQ_TYPE_RECVQ:
-		mlwq->mlwq_entshift = mlxp->mlx_props.mldp_rq_size_shift;
+		/*
+		 * Each striding RQ entry holds many packets, so far fewer
+		 * of them are needed. The queue can end up smaller than a
+		 * page, which is all the hardware will take.
+		 */
+		if (mlwq->mlwq_striding) {
+			mlwq->mlwq_entshift =
+			    mlxp->mlx_props.mldp_rq_striding_size_shift;
+		} else {
+			mlwq->mlwq_entshift =
+			    mlxp->mlx_props.mldp_rq_size_shift;
+		}
 		mlwq->mlwq_nents = (1 << mlwq->mlwq_entshift);
 		sz = mlwq->mlwq_nents * sizeof (mlxcx_recvq_ent_t);
+		sz = P2ROUNDUP(sz, MLXCX_HW_PAGE_SIZE);
 		break;
 	default:
 		VERIFY(0);
@@ -390,6 +402,35 @@ mlxcx_cq_setup(mlxcx_t *mlxp, mlxcx_event_queue_t *eq,
 	return (B_TRUE);
 }
 
+/*
+ * Decide whether new RQs should be striding (multi-packet WQE) ones. This
+ * needs both the driver property and hardware which can do the configured
+ * stride size.
+ */
+static boolean_t
+mlxcx_rq_use_striding(mlxcx_t *mlxp)
+{
+	const mlxcx_caps_t *c = mlxp->mlx_caps;
+	const mlxcx_drv_props_t *p = &mlxp->mlx_props;
+
+	if (!p->mldp_rx_striding || !c->mlc_rx_striding)
+		return (B_FALSE);
+
+	if (p->mldp_rx_stride_shift < c->mlc_min_rx_stride_shift ||
+	    p->mldp_rx_stride_shift > c->mlc_max_rx_stride_shift)
+		return (B_FALSE);
+
+	/*
+	 * A packet has to fit within a single WQE, since the two-byte
+	 * shift eats into the first stride.
+	 */
+	if ((1U << (p->mldp_rx_stride_shift + p->mldp_rx_strides_shift)) <
+	    mlxp->mlx_ports[0].mlp_mtu + 2)
+		return (B_FALSE);
+
+	return (B_TRUE);
+}
+
 static boolean_t
 mlxcx_rq_setup(mlxcx_t *mlxp, mlxcx_completion_queue_t *cq,
     mlxcx_work_queue_t *wq)
@@ -409,6 +450,13 @@ mlxcx_rq_setup(mlxcx_t *mlxp, mlxcx_completion_queue_t *cq,
 
 	wq->mlwq_bufs = mlxcx_mlbs_create(mlxp);
 
+	if (mlxcx_rq_use_striding(mlxp)) {
+		wq->mlwq_striding = B_TRUE;
+		wq->mlwq_stride_shift = mlxp->mlx_props.mldp_rx_stride_shift;
+		wq->mlwq_nstrides_shift =
+		    mlxp->mlx_props.mldp_rx_strides_shift;
+	}
+
 	if (!mlxcx_wq_alloc_dma(mlxp, wq)) {
 		mutex_exit(&wq->mlwq_mtx);
 		return (B_FALSE);
@@ -419,8 +467,14 @@ mlxcx_rq_setup(mlxcx_t *mlxp, mlxcx_completion_queue_t *cq,
 		return (B_FALSE);
 	}
 
-	wq->mlwq_bufhwm = wq->mlwq_nents - MLXCX_WQ_HWM_GAP;
-	wq->mlwq_buflwm = wq->mlwq_nents - MLXCX_WQ_LWM_GAP;
+	if (wq->mlwq_nents > MLXCX_WQ_LWM_GAP) {
+		wq->mlwq_bufhwm = wq->mlwq_nents - MLXCX_WQ_HWM_GAP;
+		wq->mlwq_buflwm = wq->mlwq_nents - MLXCX_WQ_LWM_GAP;
+	} else {
+		/* Short striding RQs */
+		wq->mlwq_bufhwm = wq->mlwq_nents;
+		wq->mlwq_buflwm = wq->mlwq_nents / 2;
+	}
 
 	mutex_exit(&wq->mlwq_mtx);
 
@@ -792,9 +846,18 @@ mlxcx_rx_group_setup(mlxcx_t *mlxp, mlxcx_ring_group_t *g)
 		 * A single completion is indicated for each rq entry as
 		 * it is used. So, the number of cq entries never needs
 		 * to be larger than the rq.
+		 *
+		 * Striding RQ entries can complete once per stride though,
+		 * so their CQ has to cover every stride in the RQ.
 		 */
-		ent_shift = MIN(mlxp->mlx_props.mldp_cq_size_shift,
-		    mlxp->mlx_props.mldp_rq_size_shift);
+		if (mlxcx_rq_use_striding(mlxp)) {
+			ent_shift = MIN(MLXCX_CQ_SIZE_SHIFT_MAX,
+			    mlxp->mlx_props.mldp_rq_striding_size_shift +
+			    mlxp->mlx_props.mldp_rx_strides_shift);
+		} else {
+			ent_shift = MIN(mlxp->mlx_props.mldp_cq_size_shift,
+			    mlxp->mlx_props.mldp_rq_size_shift);
+		}
 		if (!mlxcx_cq_setup(mlxp, eq, &cq, ent_shift)) {
 			g->mlg_nwqs = i;
 			break;
@@ -1224,14 +1287,14 @@ mlxcx_rx_ring_start(mlxcx_t *mlxp, mlxcx_ring_group_t *g,
 
 	mlxcx_shard_ready(rq->mlwq_bufs);
 
-	for (j = 0; j < rq->mlwq_nents; ++j) {
-		if (!mlxcx_buf_create(mlxp, rq->mlwq_bufs, &b))
-			break;
-		mlxcx_buf_return(mlxp, b);
-	}
-	for (j = 0; j < rq->mlwq_nents / 2; ++j) {
-		if (!mlxcx_buf_create(mlxp, rq->mlwq_bufs, &b))
-			break;
+	for (j = 0; j < rq->mlwq_nents + rq->mlwq_nents / 2; ++j) {
+		if (rq->mlwq_striding) {
+			if (!mlxcx_buf_create_striding(mlxp, rq, &b))
+				break;
+		} else {
+			if (!mlxcx_buf_create(mlxp, rq->mlwq_bufs, &b))
+				break;
+		}
 		mlxcx_buf_return(mlxp, b);
 	}
 
@@ -1814,6 +1877,7 @@ mlxcx_rq_refill_task(void *arg)
 	mlxcx_t *mlxp = wq->mlwq_mlx;
 	mlxcx_buf_shard_t *s = wq->mlwq_bufs;
 	boolean_t refill, draining;
+	size_t step = MLXCX_RQ_REFILL_STEP(wq);
 
 	do {
 		/*
@@ -1841,7 +1905,7 @@ mlxcx_rq_refill_task(void *arg)
 		} else {
 			mlxcx_rq_refill(mlxp, wq);
 
-			if (cq->mlcq_bufcnt < MLXCX_RQ_REFILL_STEP) {
+			if (cq->mlcq_bufcnt < step) {
 				refill = B_TRUE;
 			} else {
 				refill = B_FALSE;
@@ -1860,7 +1924,8 @@ mlxcx_rq_refill(mlxcx_t *mlxp, mlxcx_work_queue_t *mlwq)
 	size_t target, current, want, done, n;
 	mlxcx_completion_queue_t *cq;
 	mlxcx_ring_group_t *g;
-	mlxcx_buffer_t *b[MLXCX_RQ_REFILL_STEP];
+	mlxcx_buffer_t *b[MLXCX_RQ_REFILL_STEP_MAX];
+	size_t step = MLXCX_RQ_REFILL_STEP(mlwq);
 	uint_t i;
 
 	ASSERT(mutex_owned(&mlwq->mlwq_mtx));
@@ -1869,7 +1934,7 @@ mlxcx_rq_refill(mlxcx_t *mlxp, mlxcx_work_queue_t *mlwq)
 
 	ASSERT(mlwq->mlwq_state & MLXCX_WQ_BUFFERS);
 
-	target = mlwq->mlwq_nents - MLXCX_RQ_REFILL_STEP;
+	target = mlwq->mlwq_nents - step;
 	cq = mlwq->mlwq_cq;
 
 	if ((mlwq->mlwq_state & MLXCX_WQ_STARTED) == 0)
@@ -1880,14 +1945,14 @@ mlxcx_rq_refill(mlxcx_t *mlxp, mlxcx_work_queue_t *mlwq)
 
 	current = cq->mlcq_bufcnt;
 
-	if (current >= target - MLXCX_RQ_REFILL_STEP)
+	if (current >= target - step)
 		return;
 
 	want = target - current;
 	done = 0;
 
 	while (!(mlwq->mlwq_state & MLXCX_WQ_TEARDOWN) && done < want) {
-		n = mlxcx_buf_take_n(mlxp, mlwq, b, MLXCX_RQ_REFILL_STEP);
+		n = mlxcx_buf_take_n(mlxp, mlwq, b, step);
 		if (n == 0) {
 			/*
 			 * We didn't get any buffers from the free queue.
@@ -1895,7 +1960,7 @@ mlxcx_rq_refill(mlxcx_t *mlxp, mlxcx_work_queue_t *mlwq)
 			 * to wait for free buffers if the completion
 			 * queue is low.
 			 */
-			if (current < MLXCX_RQ_REFILL_STEP &&
+			if (current < step &&
 			    (mlwq->mlwq_state & MLXCX_WQ_REFILLING) == 0) {
 				mlwq->mlwq_state |= MLXCX_WQ_REFILLING;
 				g = mlwq->mlwq_group;
@@ -2118,6 +2183,127 @@ mlxcx_rx_completion(mlxcx_t *mlxp, mlxcx_completion_queue_t *mlcq,
 	return (buf->mlb_mp);
 }
 
+/*
+ * Handle a completion on a striding RQ. Each one describes a single packet
+ * placed into one or more strides of the WQE's buffer, which we loan
+ * upstream as an mblk pointing into the buffer. The buffer itself stays on
+ * the WQ until *donep is set, at which point the caller drops the hardware
+ * reference with mlxcx_buf_return().
+ */
+mblk_t *
+mlxcx_rx_completion_striding(mlxcx_t *mlxp, mlxcx_completion_queue_t *mlcq,
+    mlxcx_completionq_ent_t *ent, mlxcx_buffer_t *buf, boolean_t *donep)
+{
+	mlxcx_work_queue_t *wq = mlcq->mlcq_wq;
+	uint32_t chkflags = 0;
+	uint32_t bcnt;
+	uint_t sidx, nstrides;
+	size_t off, len;
+	ddi_fm_error_t err;
+	mblk_t *mp;
+
+	ASSERT(mutex_owned(&mlcq->mlcq_mtx));
+	ASSERT(buf->mlb_striding);
+
+	*donep = B_FALSE;
+
+	if (ent->mlcqe_opcode == MLXCX_CQE_OP_RESP_ERR) {
+		mlxcx_completionq_error_ent_t *eent =
+		    (mlxcx_completionq_error_ent_t *)ent;
+		mlxcx_fm_cqe_ereport(mlxp, mlcq, eent);
+		*donep = B_TRUE;
+		mutex_enter(&wq->mlwq_mtx);
+		mlxcx_check_rq(mlxp, wq);
+		mutex_exit(&wq->mlwq_mtx);
+		return (NULL);
+	}
+
+	if (ent->mlcqe_opcode != MLXCX_CQE_OP_RESP) {
+		mlxcx_warn(mlxp, "!got weird cq opcode: %x", ent->mlcqe_opcode);
+		*donep = B_TRUE;
+		return (NULL);
+	}
+
+	if (ent->mlcqe_format != MLXCX_CQE_FORMAT_BASIC) {
+		mlxcx_warn(mlxp, "!got weird cq format: %x", ent->mlcqe_format);
+		*donep = B_TRUE;
+		return (NULL);
+	}
+
+	if (ent->mlcqe_rx_drop_counter > 0) {
+		atomic_add_64(&mlcq->mlcq_stats->mlps_rx_drops,
+		    ent->mlcqe_rx_drop_counter);
+	}
+
+	bcnt = from_be32(ent->mlcqe_byte_cnt);
+	nstrides = (bcnt & MLXCX_CQE_MPWQE_STRIDES_MASK) >>
+	    MLXCX_CQE_MPWQE_STRIDES_SHIFT;
+	sidx = from_be16(ent->mlcqe_wqe_counter);
+	len = bcnt & MLXCX_CQE_MPWQE_BYTE_CNT_MASK;
+
+	buf->mlb_strides_used += nstrides;
+	if (buf->mlb_strides_used >= (1U << wq->mlwq_nstrides_shift))
+		*donep = B_TRUE;
+
+	if (bcnt & MLXCX_CQE_MPWQE_FILLER)
+		return (NULL);
+
+	off = (size_t)sidx << wq->mlwq_stride_shift;
+	if (nstrides == 0 || off + len + 2 > buf->mlb_dma.mxdb_len) {
+		mlxcx_warn(mlxp, "!striding rq completion out of range: "
+		    "stride %u, %u bytes", sidx, (uint_t)len);
+		*donep = B_TRUE;
+		return (NULL);
+	}
+
+	VERIFY0(ddi_dma_sync(buf->mlb_dma.mxdb_dma_handle, off, len + 2,
+	    DDI_DMA_SYNC_FORCPU));
+	ddi_fm_dma_err_get(buf->mlb_dma.mxdb_dma_handle, &err,
+	    DDI_FME_VERSION);
+	if (err.fme_status != DDI_FM_OK) {
+		ddi_fm_dma_err_clear(buf->mlb_dma.mxdb_dma_handle,
+		    DDI_FME_VERSION);
+		return (NULL);
+	}
+
+	/*
+	 * The two-byte shift means the packet starts 2 bytes into its
+	 * first stride.
+	 */
+	mp = desballoc((unsigned char *)buf->mlb_dma.mxdb_va + off + 2,
+	    len, 0, &buf->mlb_stride_frtn);
+	if (mp == NULL)
+		return (NULL);
+	atomic_inc_uint(&buf->mlb_refcnt);
+	mp->b_wptr = mp->b_rptr + len;
+
+	if (get_bit8(ent->mlcqe_csflags, MLXCX_CQE_CSFLAGS_L4_OK)) {
+		chkflags |= HCK_FULLCKSUM_OK;
+	}
+	if (get_bit8(ent->mlcqe_csflags, MLXCX_CQE_CSFLAGS_L3_OK)) {
+		chkflags |= HCK_IPV4_HDRCKSUM_OK;
+	}
+	if (chkflags != 0) {
+		mac_hcksum_set(mp, 0, 0, 0,
+		    from_be16(ent->mlcqe_checksum), chkflags);
+	}
+
+	return (mp);
+}
+
+static void
+mlxcx_buf_stride_return(caddr_t arg)
+{
+	mlxcx_buffer_t *b = (mlxcx_buffer_t *)arg;
+
+	/*
+	 * The last mblk loaned out of a buffer the hardware has finished
+	 * with puts it back on the free list.
+	 */
+	if (atomic_dec_uint_nv(&b->mlb_refcnt) == 0)
+		mlxcx_buf_return(b->mlb_mlx, b);
+}
+
 static void
 mlxcx_buf_mp_return(caddr_t arg)
 {
@@ -2163,6 +2349,52 @@ mlxcx_buf_create(mlxcx_t *mlxp, mlxcx_buf_shard_t *shard, mlxcx_buffer_t **bp)
 	return (B_TRUE);
 }
 
+/*
+ * Striding RQ buffers cover every stride of a WQE, and must be physically
+ * contiguous as the WQE only has a single data segment pointing at them.
+ * They carry no mblk of their own; one is made per packet as it arrives.
+ */
+boolean_t
+mlxcx_buf_create_striding(mlxcx_t *mlxp, mlxcx_work_queue_t *wq,
+    mlxcx_buffer_t **bp)
+{
+	mlxcx_buffer_t *b;
+	ddi_device_acc_attr_t acc;
+	ddi_dma_attr_t attr;
+	boolean_t ret;
+
+	ASSERT(wq->mlwq_striding);
+
+	b = kmem_cache_alloc(mlxp->mlx_bufs_cache, KM_SLEEP);
+	b->mlb_shard = wq->mlwq_bufs;
+	b->mlb_foreign = B_FALSE;
+	b->mlb_striding = B_TRUE;
+	b->mlb_strides_used = 0;
+	/* Held for the hardware until every stride is consumed */
+	b->mlb_refcnt = 1;
+
+	mlxcx_dma_acc_attr(mlxp, &acc);
+	mlxcx_dma_buf_attr(mlxp, &attr);
+	attr.dma_attr_sgllen = 1;
+	attr.dma_attr_align = MLXCX_HW_PAGE_SIZE;
+
+	ret = mlxcx_dma_alloc(mlxp, &b->mlb_dma, &attr, &acc, B_FALSE,
+	    1UL << (wq->mlwq_stride_shift + wq->mlwq_nstrides_shift), B_TRUE);
+	if (!ret) {
+		b->mlb_striding = B_FALSE;
+		b->mlb_refcnt = 0;
+		kmem_cache_free(mlxp->mlx_bufs_cache, b);
+		return (B_FALSE);
+	}
+
+	b->mlb_stride_frtn.free_func = mlxcx_buf_stride_return;
+	b->mlb_stride_frtn.free_arg = (caddr_t)b;
+
+	*bp = b;
+
+	return (B_TRUE);
+}
+
 boolean_t
 mlxcx_buf_create_foreign(mlxcx_t *mlxp, mlxcx_buf_shard_t *shard,
     mlxcx_buffer_t **bp)
@@ -2466,6 +2698,23 @@ mlxcx_buf_return(mlxcx_t *mlxp, mlxcx_buffer_t *b)
 	VERIFY3U(oldstate, !=, MLXCX_BUFFER_FREE);
 	ASSERT3P(b->mlb_mlx, ==, mlxp);
 
+	/*
+	 * A striding buffer coming off the WQ may still have packets loaned
+	 * out of it. Park it on the loaned list and drop the hardware's
+	 * reference; whoever drops the last one puts the buffer back.
+	 */
+	if (b->mlb_striding && oldstate == MLXCX_BUFFER_ON_WQ) {
+		mutex_enter(&s->mlbs_mtx);
+		list_remove(&s->mlbs_busy, b);
+		list_insert_tail(&s->mlbs_loaned, b);
+		b->mlb_state = MLXCX_BUFFER_ON_LOAN;
+		mutex_exit(&s->mlbs_mtx);
+
+		if (atomic_dec_uint_nv(&b->mlb_refcnt) != 0)
+			return;
+		oldstate = MLXCX_BUFFER_ON_LOAN;
+	}
+
 	/*
 	 * The mlbs_mtx held below is a heavily contended lock, so it is
 	 * imperative we do as much of the buffer clean up outside the lock
@@ -2479,6 +2728,11 @@ mlxcx_buf_return(mlxcx_t *mlxp, mlxcx_buffer_t *b)
 	b->mlb_wqebbs = 0;
 	ASSERT(list_is_empty(&b->mlb_tx_chain));
 
+	if (b->mlb_striding) {
+		b->mlb_strides_used = 0;
+		b->mlb_refcnt = 1;
+	}
+
 	if (b->mlb_foreign) {
 		if (b->mlb_dma.mxdb_flags & MLXCX_DMABUF_BOUND) {
 			mlxcx_dma_unbind(mlxp, &b->mlb_dma);
@@ -2556,6 +2810,9 @@ mlxcx_buf_destroy(mlxcx_t *mlxp, mlxcx_buffer_t *b)
 	 */
 	b->mlb_state = MLXCX_BUFFER_INIT;
 	b->mlb_shard = NULL;
+	b->mlb_striding = B_FALSE;
+	b->mlb_strides_used = 0;
+	b->mlb_refcnt = 0;
 	if (b->mlb_mp != NULL) {
 		freeb(b->mlb_mp);
 		ASSERT(b->mlb_mp == NULL);
@@ -47,10 +47,13 @@
  * Command Processing:
  *
  * NVMe devices can have up to 65535 I/O queue pairs, with each queue holding up
- * to 65536 I/O commands. The driver will configure one I/O queue pair per
- * available interrupt vector, with the queue length usually much smaller than
- * the maximum of 65536. If the hardware doesn't provide enough queues, fewer
- * interrupt vectors will be used.
+ * to 65536 I/O commands. The driver will configure one I/O submission queue per
+ * CPU and one completion queue per available interrupt vector, with the queue
+ * length usually much smaller than the maximum of 65536. If there are fewer
+ * interrupt vectors than CPUs the submission queues share the completion
+ * queues. If the hardware doesn't provide enough queues, fewer queues and
+ * interrupt vectors will be used. blkdev selects the queue by the CPU an I/O is
+ * issued on, so each CPU normally submits to a queue of its own.
  *
  * Additionally the hardware provides a single special admin queue pair that can
  * hold up to 4096 admin commands.
@@ -80,6 +83,21 @@
  * command back.
  *
  *
+ * Hybrid Polling:
+ *
+ * Namespaces listed in the "hybrid-poll-namespaces" property complete their
+ * I/O by polling where possible. After submitting a command the issuing thread
+ * waits for half of the average polled completion latency of the namespace
+ * without touching the completion queue, and then polls the completion queue
+ * until its command is returned or the poll budget runs out. The budget is
+ * twice the average latency, but never more than "hybrid-poll-max-usec". Any
+ * command retrieved while polling is completed inline. The completion queue
+ * interrupt stays enabled, so a command that isn't retrieved in time (or one
+ * which is retrieved by the interrupt handler first) is completed through the
+ * regular interrupt path. This trades CPU time for latency and is meant for
+ * namespaces with latency-critical workloads on fast devices.
+ *
+ *
  * Namespace Support:
  *
  * NVMe devices can have multiple namespaces, each being a independent data
@@ -248,6 +266,10 @@
  * - max-completion-queues: the maximum number of I/O completion queues,
  *   can be less than max-submission-queues, in which case the completion
  *   queues are shared.
+ * - hybrid-poll-namespaces: list of namespace IDs which should use hybrid
+ *   polling for I/O completion
+ * - hybrid-poll-max-usec: the maximum time in microseconds to poll for the
+ *   completion of a single command (1-10000)
  *
  *
  * TODO:
@@ -2339,10 +2361,13 @@ nvme_set_nqueues(nvme_t *nvme)
 	    nvme->n_intr_cnt);
 
 	/*
-	 * The default is to use one submission queue per completion queue.
+	 * The default is to use one submission queue per CPU, sharing the
+	 * completion queues if there are fewer of them.
 	 */
-	if (nvme->n_submission_queues == -1)
-		nvme->n_submission_queues = nvme->n_completion_queues;
+	if (nvme->n_submission_queues == -1) {
+		nvme->n_submission_queues = MAX(nvme->n_completion_queues,
+		    MIN(UINT16_MAX, ncpus));
+	}
 
 	/*
 	 * There is no point in having more compeletion queues than
@@ -2535,6 +2560,29 @@ nvme_prepare_devid(nvme_t *nvme, uint32_t nsid)
 	    nvme->n_idctl->id_vid, model, serial, nsid);
 }
 
+static boolean_t
+nvme_hybrid_poll_ns(nvme_t *nvme, int nsid)
+{
+	boolean_t poll = B_FALSE;
+	int *nsids;
+	uint_t n;
+
+	if (ddi_prop_lookup_int_array(DDI_DEV_T_ANY, nvme->n_dip,
+	    DDI_PROP_DONTPASS, "hybrid-poll-namespaces", &nsids, &n) !=
+	    DDI_PROP_SUCCESS)
+		return (B_FALSE);
+
+	for (uint_t i = 0; i < n; i++) {
+		if (nsids[i] == nsid) {
+			poll = B_TRUE;
+			break;
+		}
+	}
+
+	ddi_prop_free(nsids);
+	return (poll);
+}
+
 static int
 nvme_init_ns(nvme_t *nvme, int nsid)
 {
@@ -2599,6 +2647,9 @@ nvme_init_ns(nvme_t *nvme, int nsid)
 	if (ns->ns_best_block_size < nvme->n_min_block_size)
 		ns->ns_best_block_size = nvme->n_min_block_size;
 
+	ns->ns_hybrid_poll = nvme_hybrid_poll_ns(nvme, nsid);
+	ns->ns_poll_avg = 0;
+
 	was_ignored = ns->ns_ignore;
 
 	/*
@@ -3392,6 +3443,9 @@ nvme_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
 	    DDI_PROP_DONTPASS, "max-submission-queues", -1);
 	nvme->n_completion_queues = ddi_prop_get_int(DDI_DEV_T_ANY, dip,
 	    DDI_PROP_DONTPASS, "max-completion-queues", -1);
+	nvme->n_hybrid_poll_usec = ddi_prop_get_int(DDI_DEV_T_ANY, dip,
+	    DDI_PROP_DONTPASS, "hybrid-poll-max-usec",
+	    NVME_DEFAULT_HYBRID_POLL_USEC);
 
 	if (!ISP2(nvme->n_min_block_size) ||
 	    (nvme->n_min_block_size < NVME_DEFAULT_MIN_BLOCK_SIZE)) {
@@ -3420,6 +3474,14 @@ nvme_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
 		nvme->n_completion_queues = -1;
 	}
 
+	if (nvme->n_hybrid_poll_usec < 1 ||
+	    nvme->n_hybrid_poll_usec > NVME_MAX_HYBRID_POLL_USEC) {
+		dev_err(dip, CE_WARN, "!\"hybrid-poll-max-usec\"=%u is not "
+		    "valid. Must be [1..%d]", nvme->n_hybrid_poll_usec,
+		    NVME_MAX_HYBRID_POLL_USEC);
+		nvme->n_hybrid_poll_usec = NVME_DEFAULT_HYBRID_POLL_USEC;
+	}
+
 	if (nvme->n_admin_queue_len < NVME_MIN_ADMIN_QUEUE_LEN)
 		nvme->n_admin_queue_len = NVME_MIN_ADMIN_QUEUE_LEN;
 	else if (nvme->n_admin_queue_len > NVME_MAX_ADMIN_QUEUE_LEN)
@@ -3985,6 +4047,67 @@ nvme_bd_mediainfo(void *arg, bd_media_t *media)
 	return (0);
 }
 
+/*
+ * Poll the completion queue of ioq until the command submitted at the time
+ * start is returned, see "Hybrid Polling" above. The command may already
+ * have been completed and freed by the interrupt path, so it is only used
+ * for comparison and never dereferenced.
+ */
+static void
+nvme_bd_hybrid_poll(nvme_namespace_t *ns, nvme_qpair_t *ioq,
+    nvme_cmd_t *submitted, hrtime_t start)
+{
+	nvme_t *nvme = ns->ns_nvme;
+	hrtime_t avg = ns->ns_poll_avg;
+	hrtime_t budget = USEC2NSEC(nvme->n_hybrid_poll_usec);
+	hrtime_t now;
+	nvme_cmd_t *cmd;
+
+	/*
+	 * The command is unlikely to have completed before half of the
+	 * average latency has passed, don't contend for the completion
+	 * queue before that.
+	 */
+	if (avg != 0) {
+		budget = MIN(budget, 2 * avg);
+		drv_usecwait(NSEC2USEC(avg / 2));
+	}
+
+	for (;;) {
+		if ((cmd = nvme_retrieve_cmd(nvme, ioq)) != NULL) {
+			boolean_t mine = (cmd == submitted);
+
+			cmd->nc_callback(cmd);
+			if (!mine)
+				continue;
+
+			/*
+			 * Keep an exponentially weighted moving average
+			 * of the polled completion latency.
+			 */
+			now = gethrtime() - start;
+			ns->ns_poll_avg = (avg == 0) ? now :
+			    (avg * 7 + now) / 8;
+			ns->ns_poll_hits++;
+			return;
+		}
+
+		/*
+		 * Give up if the command was completed by the interrupt
+		 * handler or once the budget is exhausted.
+		 */
+		if (ioq->nq_active_cmds == 0)
+			return;
+
+		if (gethrtime() - start >= budget) {
+			ns->ns_poll_misses++;
+			return;
+		}
+
+		drv_usecwait(1);
+	}
+}
+
 static int
 nvme_bd_cmd(nvme_namespace_t *ns, bd_xfer_t *xfer, uint8_t opc)
 {
@@ -3992,6 +4115,7 @@ nvme_bd_cmd(nvme_namespace_t *ns, bd_xfer_t *xfer, uint8_t opc)
 	nvme_cmd_t *cmd;
 	nvme_qpair_t *ioq;
 	boolean_t poll;
+	hrtime_t start;
 	int ret;
 
 	if (nvme->n_dead) {
@@ -4012,14 +4136,18 @@ nvme_bd_cmd(nvme_namespace_t *ns, bd_xfer_t *xfer, uint8_t opc)
 	 * treat both cmd and xfer as if they have been freed already.
 	 */
 	poll = (xfer->x_flags & BD_XFER_POLL) != 0;
+	start = gethrtime();
 
 	ret = nvme_submit_io_cmd(ioq, cmd);
 
 	if (ret != 0)
 		return (ret);
 
-	if (!poll)
+	if (!poll) {
+		if (ns->ns_hybrid_poll && !servicing_interrupt())
+			nvme_bd_hybrid_poll(ns, ioq, cmd, start);
 		return (0);
+	}
 
 	do {
 		cmd = nvme_retrieve_cmd(nvme, ioq);
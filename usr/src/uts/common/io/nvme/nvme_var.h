@@ -47,6 +47,8 @@ extern "C" {
 #define	NVME_DEFAULT_ASYNC_EVENT_LIMIT	10
 #define	NVME_MIN_ASYNC_EVENT_LIMIT	1
 #define	NVME_DEFAULT_MIN_BLOCK_SIZE	512
+#define	NVME_DEFAULT_HYBRID_POLL_USEC	100
+#define	NVME_MAX_HYBRID_POLL_USEC	10000
 
 
 typedef struct nvme nvme_t;
@@ -174,6 +176,7 @@ struct nvme {
 	boolean_t n_progress_supported;
 	int n_submission_queues;
 	int n_completion_queues;
+	uint32_t n_hybrid_poll_usec;
 
 	int n_nssr_supported;
 	int n_doorbell_stride;
@@ -278,6 +281,15 @@ struct nvme_namespace {
 
 	boolean_t ns_ignore;
 
+	/*
+	 * Hybrid polling state, see nvme_bd_hybrid_poll(). ns_poll_avg is a
+	 * moving average of the latency of commands completed by polling.
+	 */
+	boolean_t ns_hybrid_poll;
+	hrtime_t ns_poll_avg;
+	uint64_t ns_poll_hits;
+	uint64_t ns_poll_misses;
+
 	nvme_identify_nsid_t *ns_idns;
 
 	/* state for attachment point minor node */
@@ -486,6 +486,15 @@
  * any outstanding data to that place. For the full story on how we look that up
  * will be discussed in the section on the Target Cache Lifecycle.
  *
+ * Taking the target's lock and hashing the mac address for every packet is
+ * expensive on busy links, so dynamic targets also have a small per-CPU cache
+ * of valid translations (overlay_target_pcpu_t) that is consulted first. It is
+ * only ever written by the CPU that owns it and is never locked. Instead, the
+ * target keeps a generation number which is bumped every time an entry changes
+ * state or destination; a per-CPU slot is only believed when its generation
+ * matches. Separately, overlay_m_tx() only looks up a destination once for a
+ * run of consecutive frames to the same mac address.
+ *
  * ------------------------
  * FMA and Degraded Devices
  * ------------------------
@@ -575,6 +584,14 @@
  * stay in the same state, repeating this until the number of requests is
  * drained.
  *
+ * That is the behavior when negative caching is disabled by setting
+ * overlay_target_negative_ttl to zero. By default, a failed lookup instead
+ * drops everything queued on the entry and marks it with
+ * OVERLAY_ENTRY_F_NEGATIVE. Until overlay_target_negative_ttl has elapsed,
+ * traffic to a negative entry is dropped without asking varpd again. After
+ * that, the next packet clears the flag and starts a new lookup. A reply, a
+ * cache set or an invalidation also clears the flag.
+ *
  * The following images describes the flow of a given lookup and where the
  * overlay_target_entry_t is at any given time.
  *
@@ -1052,6 +1069,10 @@ overlay_m_tx(void *arg, mblk_t *mp_chain)
 	int ret;
 	ovep_encap_info_t einfo;
 	struct msghdr hdr;
+	struct sockaddr_storage storage;
+	socklen_t slen;
+	uint8_t lastaddr[ETHERADDRL];
+	boolean_t havedest = B_FALSE;
 
 	mutex_enter(&odd->odd_lock);
 	if ((odd->odd_flags & OVERLAY_F_MDDROP) ||
@@ -1069,24 +1090,35 @@ overlay_m_tx(void *arg, mblk_t *mp_chain)
 	einfo.ovdi_id = odd->odd_vid;
 	mp = mp_chain;
 	while (mp != NULL) {
-		socklen_t slen;
-		struct sockaddr_storage storage;
-
 		mp_chain = mp->b_next;
 		mp->b_next = NULL;
 		ep = NULL;
 
-		ret = overlay_target_lookup(odd, mp,
-		    (struct sockaddr *)&storage, &slen);
-		if (ret != OVERLAY_TARGET_OK) {
-			if (ret == OVERLAY_TARGET_DROP)
-				freemsg(mp);
-			mp = mp_chain;
-			continue;
-		}
+		/*
+		 * Chains from MAC frequently carry long runs of frames for the
+		 * same destination. While the destination MAC matches the
+		 * previous frame's, reuse the translation and socket address
+		 * rather than going back to the target for every frame.
+		 */
+		if (havedest == B_FALSE || MBLKL(mp) < ETHERADDRL ||
+		    bcmp(mp->b_rptr, lastaddr, ETHERADDRL) != 0) {
+			havedest = B_FALSE;
+			ret = overlay_target_lookup(odd, mp,
+			    (struct sockaddr *)&storage, &slen);
+			if (ret != OVERLAY_TARGET_OK) {
+				if (ret == OVERLAY_TARGET_DROP)
+					freemsg(mp);
+				mp = mp_chain;
+				continue;
+			}
 
-		hdr.msg_name = &storage;
-		hdr.msg_namelen = slen;
+			hdr.msg_name = &storage;
+			hdr.msg_namelen = slen;
+			if (MBLKL(mp) >= ETHERADDRL) {
+				bcopy(mp->b_rptr, lastaddr, ETHERADDRL);
+				havedest = B_TRUE;
+			}
+		}
 
 		ret = odd->odd_plugin->ovp_ops->ovpo_encap(odd->odd_mh, mp,
 		    &einfo, &ep);
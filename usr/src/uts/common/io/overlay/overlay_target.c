@@ -38,6 +38,9 @@
 #include <sys/errno.h>
 #include <sys/ddi.h>
 #include <sys/sunddi.h>
+#include <sys/atomic.h>
+#include <sys/cpuvar.h>
+#include <sys/disp.h>
 
 #include <sys/overlay_impl.h>
 #include <sys/sdt.h>
@@ -100,6 +103,20 @@ static boolean_t overlay_target_excl;
  */
 static int overlay_ent_size = 128 * 1024;
 
+/*
+ * Whether dynamic targets should consult the per-CPU translation cache before
+ * falling back to the refhash.  This is read when a target is associated.
+ */
+int overlay_target_pcpu_enable = 1;
+
+/*
+ * When varpd tells us that it couldn't find a destination, we remember that for
+ * this many nanoseconds and drop traffic to it without asking again. Otherwise
+ * a host sending to a stale or bogus address would have every packet go up to
+ * varpd and out to the remote. A value of zero disables negative caching.
+ */
+hrtime_t overlay_target_negative_ttl = NANOSEC;
+
 /* ARGSUSED */
 static int
 overlay_target_cache_constructor(void *buf, void *arg, int kmflgs)
@@ -255,9 +272,83 @@ overlay_target_free(overlay_dev_t *odd)
 	}
 
 	ASSERT(odd->odd_target->ott_ocount == 0);
+	if (odd->odd_target->ott_pcpu != NULL) {
+		kmem_free(odd->odd_target->ott_pcpu,
+		    sizeof (overlay_target_pcpu_t) * max_ncpus);
+		odd->odd_target->ott_pcpu = NULL;
+	}
 	kmem_cache_free(overlay_target_cache, odd->odd_target);
 }
 
+/*
+ * Invalidate every per-CPU translation for this target. This must be called
+ * after an entry's state or destination has been changed.
+ */
+static void
+overlay_target_invalidate(overlay_target_t *ott)
+{
+	atomic_inc_64(&ott->ott_gen);
+}
+
+static uint_t
+overlay_target_pcpu_slot(const uint8_t *addr)
+{
+	return ((addr[ETHERADDRL - 1] ^ addr[ETHERADDRL - 2]) %
+	    OVERLAY_PCPU_NENTS);
+}
+
+static boolean_t
+overlay_target_pcpu_lookup(overlay_target_t *ott, const uint8_t *addr,
+    struct sockaddr_in6 *v6)
+{
+	overlay_target_pcpu_ent_t *ent;
+	uint32_t seq;
+	boolean_t hit = B_FALSE;
+
+	kpreempt_disable();
+	ent = &ott->ott_pcpu[CPU->cpu_seqid].otpc_ents[
+	    overlay_target_pcpu_slot(addr)];
+	seq = ent->otpe_seq;
+	membar_consumer();
+	if ((seq & 1) == 0 && ent->otpe_gen == ott->ott_gen &&
+	    bcmp(ent->otpe_addr, addr, ETHERADDRL) == 0) {
+		bcopy(&ent->otpe_ip, &v6->sin6_addr, sizeof (struct in6_addr));
+		v6->sin6_port = htons(ent->otpe_port);
+		membar_consumer();
+		hit = (ent->otpe_seq == seq);
+	}
+	kpreempt_enable();
+
+	return (hit);
+}
+
+/*
+ * Record a valid translation in this CPU's cache. The generation must have
+ * been sampled before the entry's state was read so that a racing
+ * invalidation always leaves the slot stale.
+ */
+static void
+overlay_target_pcpu_fill(overlay_target_t *ott, const uint8_t *addr,
+    const overlay_target_point_t *otp, uint64_t gen)
+{
+	overlay_target_pcpu_ent_t *ent;
+
+	kpreempt_disable();
+	ent = &ott->ott_pcpu[CPU->cpu_seqid].otpc_ents[
+	    overlay_target_pcpu_slot(addr)];
+	if ((ent->otpe_seq & 1) == 0) {
+		ent->otpe_seq++;
+		membar_producer();
+		bcopy(addr, ent->otpe_addr, ETHERADDRL);
+		ent->otpe_gen = gen;
+		bcopy(&otp->otp_ip, &ent->otpe_ip, sizeof (struct in6_addr));
+		ent->otpe_port = otp->otp_port;
+		membar_producer();
+		ent->otpe_seq++;
+	}
+	kpreempt_enable();
+}
+
 int
 overlay_target_busy()
 {
@@ -309,6 +400,7 @@ overlay_target_lookup(overlay_dev_t *odd, mblk_t *mp, struct sockaddr *sock,
     socklen_t *slenp)
 {
 	int ret;
+	uint64_t gen;
 	struct sockaddr_in6 *v6;
 	overlay_target_t *ott;
 	mac_header_info_t mhi;
@@ -350,6 +442,15 @@ overlay_target_lookup(overlay_dev_t *odd, mblk_t *mp, struct sockaddr *sock,
 	 */
 	if (mac_header_info(odd->odd_mh, mp, &mhi) != 0)
 		return (OVERLAY_TARGET_DROP);
+
+	gen = ott->ott_gen;
+	membar_consumer();
+	if (ott->ott_pcpu != NULL &&
+	    overlay_target_pcpu_lookup(ott, mhi.mhi_daddr, v6)) {
+		*slenp = sizeof (struct sockaddr_in6);
+		return (OVERLAY_TARGET_OK);
+	}
+
 	mutex_enter(&ott->ott_lock);
 	entry = refhash_lookup(ott->ott_u.ott_dyn.ott_dhash,
 	    mhi.mhi_daddr);
@@ -383,10 +484,19 @@ overlay_target_lookup(overlay_dev_t *odd, mblk_t *mp, struct sockaddr *sock,
 		    sizeof (struct in6_addr));
 		v6->sin6_port = htons(entry->ote_dest.otp_port);
 		*slenp = sizeof (struct sockaddr_in6);
+		if (ott->ott_pcpu != NULL) {
+			overlay_target_pcpu_fill(ott, mhi.mhi_daddr,
+			    &entry->ote_dest, gen);
+		}
 		ret = OVERLAY_TARGET_OK;
+	} else if ((entry->ote_flags & OVERLAY_ENTRY_F_NEGATIVE) &&
+	    gethrtime() - entry->ote_vtime < overlay_target_negative_ttl) {
+		ret = OVERLAY_TARGET_DROP;
 	} else {
 		size_t mlen = msgsize(mp);
 
+		entry->ote_flags &= ~OVERLAY_ENTRY_F_NEGATIVE;
+
 		if (mlen + entry->ote_mbsize > overlay_ent_size) {
 			ret = OVERLAY_TARGET_DROP;
 		} else {
@@ -491,6 +601,8 @@ overlay_target_associate(overlay_target_hdl_t *thdl, void *arg)
 	ott = kmem_cache_alloc(overlay_target_cache, KM_SLEEP);
 	ott->ott_flags = 0;
 	ott->ott_ocount = 0;
+	ott->ott_gen = 0;
+	ott->ott_pcpu = NULL;
 	ott->ott_mode = ota->ota_mode;
 	ott->ott_dest = ota->ota_provides;
 	ott->ott_id = ota->ota_id;
@@ -507,10 +619,19 @@ overlay_target_associate(overlay_target_hdl_t *thdl, void *arg)
 		avl_create(&ott->ott_u.ott_dyn.ott_tree, overlay_mac_avl,
 		    sizeof (overlay_target_entry_t),
 		    offsetof(overlay_target_entry_t, ote_avllink));
+		if (overlay_target_pcpu_enable != 0) {
+			ott->ott_pcpu = kmem_zalloc(
+			    sizeof (overlay_target_pcpu_t) * max_ncpus,
+			    KM_SLEEP);
+		}
 	}
 	mutex_enter(&odd->odd_lock);
 	if (odd->odd_flags & OVERLAY_F_VARPD) {
 		mutex_exit(&odd->odd_lock);
+		if (ott->ott_pcpu != NULL) {
+			kmem_free(ott->ott_pcpu,
+			    sizeof (overlay_target_pcpu_t) * max_ncpus);
+		}
 		kmem_cache_free(overlay_target_cache, ott);
 		overlay_hold_rele(odd);
 		return (EEXIST);
@@ -675,13 +796,15 @@ overlay_target_lookup_respond(overlay_target_hdl_t *thdl, void *arg)
 	mutex_enter(&entry->ote_lock);
 	bcopy(&otr->otr_answer, &entry->ote_dest,
 	    sizeof (overlay_target_point_t));
-	entry->ote_flags &= ~OVERLAY_ENTRY_F_PENDING;
+	entry->ote_flags &= ~(OVERLAY_ENTRY_F_PENDING |
+	    OVERLAY_ENTRY_F_NEGATIVE);
 	entry->ote_flags |= OVERLAY_ENTRY_F_VALID;
 	mp = entry->ote_chead;
 	entry->ote_chead = NULL;
 	entry->ote_ctail = NULL;
 	entry->ote_mbsize = 0;
 	entry->ote_vtime = gethrtime();
+	overlay_target_invalidate(entry->ote_ott);
 	mutex_exit(&entry->ote_lock);
 
 	/*
@@ -731,6 +854,24 @@ overlay_target_lookup_drop(overlay_target_hdl_t *thdl, void *arg)
 		goto done;
 	}
 
+	/*
+	 * With negative caching, we fail everything that's queued along with
+	 * this request, as the answer for it would be the same, and remember
+	 * the failure so we don't go straight back to varpd.
+	 */
+	if (overlay_target_negative_ttl != 0) {
+		mp = entry->ote_chead;
+		entry->ote_chead = NULL;
+		entry->ote_ctail = NULL;
+		entry->ote_mbsize = 0;
+		entry->ote_flags &= ~OVERLAY_ENTRY_F_PENDING;
+		entry->ote_flags |= OVERLAY_ENTRY_F_NEGATIVE;
+		entry->ote_vtime = gethrtime();
+		mutex_exit(&entry->ote_lock);
+		freemsgchain(mp);
+		goto done;
+	}
+
 	mp = entry->ote_chead;
 	if (mp != NULL) {
 		entry->ote_chead = mp->b_next;
@@ -1162,6 +1303,7 @@ overlay_target_cache_set(overlay_target_hdl_t *thdl, void *arg)
 		mutex_enter(&ote->ote_lock);
 	}
 
+	ote->ote_flags &= ~OVERLAY_ENTRY_F_NEGATIVE;
 	if (otc->otc_entry.otce_flags & OVERLAY_TARGET_CACHE_DROP) {
 		ote->ote_flags |= OVERLAY_ENTRY_F_DROP;
 	} else {
@@ -1174,6 +1316,7 @@ overlay_target_cache_set(overlay_target_hdl_t *thdl, void *arg)
 		ote->ote_mbsize = 0;
 		ote->ote_vtime = gethrtime();
 	}
+	overlay_target_invalidate(ott);
 
 	mutex_exit(&ote->ote_lock);
 	mutex_exit(&ott->ott_lock);
@@ -1221,7 +1364,9 @@ overlay_target_cache_remove(overlay_target_hdl_t *thdl, void *arg)
 	    otc->otc_entry.otce_mac);
 	if (ote != NULL) {
 		mutex_enter(&ote->ote_lock);
-		ote->ote_flags &= ~OVERLAY_ENTRY_F_VALID_MASK;
+		ote->ote_flags &= ~(OVERLAY_ENTRY_F_VALID_MASK |
+		    OVERLAY_ENTRY_F_NEGATIVE);
+		overlay_target_invalidate(ott);
 		mutex_exit(&ote->ote_lock);
 		ret = 0;
 	} else {
@@ -1266,9 +1411,11 @@ overlay_target_cache_flush(overlay_target_hdl_t *thdl, void *arg)
 
 	for (ote = avl_first(avl); ote != NULL; ote = AVL_NEXT(avl, ote)) {
 		mutex_enter(&ote->ote_lock);
-		ote->ote_flags &= ~OVERLAY_ENTRY_F_VALID_MASK;
+		ote->ote_flags &= ~(OVERLAY_ENTRY_F_VALID_MASK |
+		    OVERLAY_ENTRY_F_NEGATIVE);
 		mutex_exit(&ote->ote_lock);
 	}
+	overlay_target_invalidate(ott);
 	ote = refhash_lookup(ott->ott_u.ott_dyn.ott_dhash,
 	    otc->otc_entry.otce_mac);
 
@@ -26,7 +26,7 @@
  * Copyright (c) 2011 Bayard G. Bell.  All rights reserved.
  * Copyright (c) 2012, 2016 by Delphix. All rights reserved.
  * Copyright 2012 DEY Storage Systems, Inc.  All rights reserved.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright 2017 Nexenta Systems, Inc.
  * Copyright 2019 Racktop Systems
  */
@@ -179,6 +179,8 @@ static	char *sd_config_list		= "sd-config-list";
 #define	sd_reset_throttle_timeout	ssd_reset_throttle_timeout
 #define	sd_qfull_throttle_timeout	ssd_qfull_throttle_timeout
 #define	sd_qfull_throttle_enable	ssd_qfull_throttle_enable
+#define	sd_lat_throttle_enable		ssd_lat_throttle_enable
+#define	sd_lat_throttle_ratio		ssd_lat_throttle_ratio
 #define	sd_check_media_time		ssd_check_media_time
 #define	sd_wait_cmds_complete		ssd_wait_cmds_complete
 #define	sd_label_mutex			ssd_label_mutex
@@ -243,6 +245,14 @@ int sd_min_throttle			= SD_MIN_THROTTLE;
 int sd_rot_delay			= 4; /* Default 4ms Rotation delay */
 int sd_qfull_throttle_enable		= TRUE;
 
+/*
+ * Latency-based throttling for solid state devices (see
+ * sd_lat_throttle_update()).  The limit is cut back whenever the average
+ * command latency rises above sd_lat_throttle_ratio times its recent low.
+ */
+int sd_lat_throttle_enable		= TRUE;
+int sd_lat_throttle_ratio		= 2;
+
 int sd_retry_on_reservation_conflict	= 1;
 int sd_reinstate_resv_delay		= SD_REINSTATE_RESV_DELAY;
 _NOTE(SCHEME_PROTECTS_DATA("safe sharing", sd_reinstate_resv_delay))
@@ -976,6 +986,7 @@ static int sd_pm_idletime = 1;
 #define	sd_mark_rqs_idle		ssd_mark_rqs_idle
 #define	sd_reduce_throttle		ssd_reduce_throttle
 #define	sd_restore_throttle		ssd_restore_throttle
+#define	sd_lat_throttle_update		ssd_lat_throttle_update
 #define	sd_print_incomplete_msg		ssd_print_incomplete_msg
 #define	sd_init_cdb_limits		ssd_init_cdb_limits
 #define	sd_pkt_status_good		ssd_pkt_status_good
@@ -1424,6 +1435,7 @@ static struct buf *sd_mark_rqs_idle(struct sd_lun *un, struct sd_xbuf *xp);
 
 static void sd_reduce_throttle(struct sd_lun *un, int throttle_type);
 static void sd_restore_throttle(void *arg);
+static void sd_lat_throttle_update(struct sd_lun *un, struct sd_xbuf *xp);
 
 static void sd_init_cdb_limits(struct sd_lun *un);
 
@@ -15047,7 +15059,9 @@ sd_start_cmds(struct sd_lun *un, struct buf *immed_bp)
 			 * For all of these conditions, IO processing will
 			 * restart after the condition is cleared.
 			 */
-			if (un->un_ncmds_in_transport >= un->un_throttle) {
+			if (un->un_ncmds_in_transport >= un->un_throttle ||
+			    (un->un_lat_throttle != 0 &&
+			    un->un_ncmds_in_transport >= un->un_lat_throttle)) {
 				SD_TRACE(SD_LOG_IO_CORE | SD_LOG_ERROR, un,
 				    "sd_start_cmds: exiting, "
 				    "throttle limit reached!\n");
@@ -15335,6 +15349,7 @@ got_pkt:
 
 		un->un_ncmds_in_transport++;
 		SD_UPDATE_KSTATS(un, statp, bp);
+		xp->xb_start = gethrtime();
 
 		/*
 		 * Call scsi_transport() to send the command to the target.
@@ -16837,6 +16852,87 @@ sd_reduce_throttle(struct sd_lun *un, int throttle_type)
 
 
 
+/*
+ *    Function: sd_lat_throttle_update
+ *
+ * Description: Adjusts un_lat_throttle, the latency-based limit on the
+ *		number of commands in transport, from the completion time
+ *		of a successful command.  Used only for solid state devices,
+ *		which keep accepting commands long after queueing more of
+ *		them stops adding throughput and only adds latency.
+ *
+ *		A moving average of command latency is kept, along with
+ *		its lowest value, which drifts slowly upward so that it can
+ *		follow changes in the workload.  Once per window of
+ *		un_lat_throttle completions, the limit is cut by an eighth
+ *		if the average is above sd_lat_throttle_ratio times the low,
+ *		or raised by one if the average is near the low and commands
+ *		are waiting.  The limit stays between un_min_throttle and
+ *		un_saved_throttle; un_throttle still applies on top of it.
+ *
+ *   Arguments: un - ptr to the sd_lun softstate struct
+ *		xp - ptr to the sd_xbuf of the completed command
+ *
+ *     Context: May be called from interrupt context
+ */
+
+static void
+sd_lat_throttle_update(struct sd_lun *un, struct sd_xbuf *xp)
+{
+	hrtime_t	lat, avg, base;
+	short		limit;
+
+	ASSERT(un != NULL);
+	ASSERT(mutex_owned(SD_MUTEX(un)));
+
+	if (!sd_lat_throttle_enable || !un->un_f_is_solid_state ||
+	    xp->xb_start == 0) {
+		un->un_lat_throttle = 0;
+		return;
+	}
+
+	lat = gethrtime() - xp->xb_start;
+	xp->xb_start = 0;
+
+	if ((avg = un->un_lat_avg) == 0)
+		avg = lat;
+	else
+		avg += (lat - avg) / 8;
+	un->un_lat_avg = avg;
+
+	if ((limit = un->un_lat_throttle) == 0)
+		limit = un->un_saved_throttle;
+	if (++un->un_lat_ncmds < MAX(limit, 8)) {
+		un->un_lat_throttle = limit;
+		return;
+	}
+	un->un_lat_ncmds = 0;
+
+	base = un->un_lat_base;
+	if (base == 0 || avg < base)
+		base = avg;
+	else
+		base += (avg - base) / 64;
+	un->un_lat_base = base;
+
+	if (avg > base * sd_lat_throttle_ratio) {
+		limit -= MAX(limit / 8, 1);
+	} else if (avg < base + base / 4 && un->un_waitq_headp != NULL) {
+		limit++;
+	}
+	limit = MAX(limit, un->un_min_throttle);
+	limit = MIN(limit, un->un_saved_throttle);
+
+	if (limit != un->un_lat_throttle) {
+		SD_TRACE(SD_LOG_IO_CORE, un, "sd_lat_throttle_update: "
+		    "un:0x%p avg:%lld base:%lld limit:%d\n", un, avg, base,
+		    limit);
+	}
+	un->un_lat_throttle = limit;
+}
+
+
+
 /*
  *    Function: sd_restore_throttle
  *
@@ -17206,6 +17302,7 @@ sdintr(struct scsi_pkt *pktp)
 		} else {
 			goto not_successful;
 		}
+		sd_lat_throttle_update(un, xp);
 		sd_return_command(un, bp);
 
 		/*
@@ -0,0 +1,696 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2020 Joyent, Inc.
+ */
+
+/*
+ * Continuous stack-sampling profiler
+ *
+ * The profile provider can be used to sample stacks (for example, with
+ * "@[stack(), ustack()] = count()"), but doing so continuously is expensive:
+ * every sample runs DIF, records both stacks into the principal buffer, and
+ * the consumer must then process and aggregate every record.  stkprof is a
+ * much narrower facility designed to run all the time under a profiling
+ * daemon.
+ *
+ * When started, an omnipresent cyclic fires at the requested rate on every
+ * CPU.  Each firing captures the kernel stack (if the CPU was interrupted in
+ * the kernel) and the user stack of the current thread, and counts the
+ * resulting (pid, kernel stack, user stack) tuple in a per-CPU hash table.
+ * The tables are deduplicated in place, so a daemon reading every few
+ * seconds sees one record per distinct stack rather than one per sample.
+ *
+ * Each CPU has two tables: the cyclic handler records into the active one.
+ * A read switches the tables with a cross-call to that CPU -- which, like
+ * the DTrace buffer switch, cannot interleave with the handler since the
+ * handler runs with interrupts disabled -- and then copies out and clears
+ * the now-inactive table.  The handler never blocks and never takes a lock;
+ * when its table is full (or a probe sequence is exhausted), the sample is
+ * counted as a drop.
+ *
+ * Stacks are captured with the same fault-protected routines DTrace uses for
+ * stack() and ustack(), so this driver depends on drv/dtrace.  As with
+ * ustack(), user stacks are walked by frame pointer and are only as good as
+ * the frame pointers in the sampled program.  Only one consumer may have the
+ * device open at a time; sampling stops when it is closed.
+ */
+
+#include <sys/types.h>
+#include <sys/errno.h>
+#include <sys/stat.h>
+#include <sys/modctl.h>
+#include <sys/conf.h>
+#include <sys/systm.h>
+#include <sys/ddi.h>
+#include <sys/sunddi.h>
+#include <sys/cpuvar.h>
+#include <sys/kmem.h>
+#include <sys/proc.h>
+#include <sys/zone.h>
+#include <sys/policy.h>
+#include <sys/cyclic.h>
+#include <sys/x_call.h>
+#include <sys/dtrace_impl.h>
+#include <sys/stkprof.h>
+
+/*
+ * The number of frames between the call to dtrace_getpcstack() in
+ * stkprof_fire() and the interrupted PC.  This is PROF_ARTIFICIAL_FRAMES
+ * from the profile provider, less one for the dtrace_probe() frame that we
+ * don't have; stkprof_aframes may be set to override it.
+ */
+#ifdef __x86
+#define	STKPROF_AFRAMES		9
+#else
+#define	STKPROF_AFRAMES		3
+#endif
+
+typedef struct stkprof_ent {
+	uint32_t	spe_hash;
+	stkprof_rec_t	spe_rec;
+} stkprof_ent_t;
+
+typedef struct stkprof_cpu {
+	stkprof_ent_t	*spc_tab[2];		/* sample tables */
+	uint64_t	spc_drops[2];		/* drops, per table */
+	uint_t		spc_active;		/* table being recorded to */
+	uint32_t	spc_flags;		/* STKPROF_F_* flags */
+	processorid_t	spc_cpuid;		/* CPU ID */
+	pc_t		spc_kpcs[STKPROF_MAXDEPTH];	/* kernel scratch */
+	uint64_t	spc_upcs[STKPROF_MAXDEPTH + 1];	/* user scratch */
+} stkprof_cpu_t;
+
+/*
+ * Tunables.  stkprof_nentries is the number of distinct stacks each CPU can
+ * record between reads; stkprof_nprobes bounds the open-addressing probe
+ * sequence in the handler.
+ */
+uint_t	stkprof_nentries = 512;
+uint_t	stkprof_nprobes = 8;
+int	stkprof_aframes = 0;
+
+static dev_info_t *stkprof_devi;
+
+/*
+ * stkprof_lock protects the session state.  The per-CPU state is created and
+ * destroyed by the omni cyclic's online and offline handlers, which are
+ * called with cpu_lock held; stkprof_cpus is therefore only examined with
+ * cpu_lock held.
+ */
+static kmutex_t stkprof_lock;
+static boolean_t stkprof_open_busy;
+static cyclic_id_t stkprof_cyclic = CYCLIC_NONE;
+static stkprof_conf_t stkprof_conf;
+static stkprof_cpu_t **stkprof_cpus;
+static uint_t stkprof_tabents;
+
+static uint_t
+stkprof_nframes(const uint64_t *pcs, uint_t max)
+{
+	uint_t n;
+
+	for (n = 0; n < max && pcs[n] != 0; n++)
+		continue;
+
+	return (n);
+}
+
+static uint32_t
+stkprof_hash(const stkprof_rec_t *rec)
+{
+	const uint8_t *p, *end;
+	uint32_t hashval = 0;
+	uint_t i;
+
+	/*
+	 * Bob Jenkins' "One-at-a-time" hash, as used for DTrace aggregations,
+	 * over the pid and the valid portions of the two stacks.
+	 */
+	for (i = 0; i < 3; i++) {
+		switch (i) {
+		case 0:
+			p = (const uint8_t *)&rec->spr_pid;
+			end = p + sizeof (rec->spr_pid);
+			break;
+		case 1:
+			p = (const uint8_t *)rec->spr_kstack;
+			end = p + rec->spr_nkframes * sizeof (uint64_t);
+			break;
+		default:
+			p = (const uint8_t *)rec->spr_ustack;
+			end = p + rec->spr_nuframes * sizeof (uint64_t);
+			break;
+		}
+
+		for (; p < end; p++) {
+			hashval += *p;
+			hashval += (hashval << 10);
+			hashval ^= (hashval >> 6);
+		}
+	}
+
+	hashval += (hashval << 3);
+	hashval ^= (hashval >> 11);
+	hashval += (hashval << 15);
+
+	return (hashval);
+}
+
+static boolean_t
+stkprof_match(const stkprof_rec_t *a, const stkprof_rec_t *b)
+{
+	uint_t i;
+
+	if (a->spr_pid != b->spr_pid || a->spr_zoneid != b->spr_zoneid ||
+	    a->spr_nkframes != b->spr_nkframes ||
+	    a->spr_nuframes != b->spr_nuframes)
+		return (B_FALSE);
+
+	for (i = 0; i < a->spr_nkframes; i++) {
+		if (a->spr_kstack[i] != b->spr_kstack[i])
+			return (B_FALSE);
+	}
+
+	for (i = 0; i < a->spr_nuframes; i++) {
+		if (a->spr_ustack[i] != b->spr_ustack[i])
+			return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
+static void
+stkprof_fire(void *arg)
+{
+	stkprof_cpu_t *spc = arg;
+	stkprof_ent_t *tab, *ent;
+	stkprof_rec_t *rec;
+	dtrace_icookie_t cookie;
+	uint16_t flags;
+	uint32_t hashval;
+	uint_t i, ndx, nkframes = 0, nuframes = 0;
+	uintptr_t kpc = CPU->cpu_profile_pc;
+	proc_t *p = curproc;
+
+	if (!(spc->spc_flags & STKPROF_F_IDLE) &&
+	    curthread == CPU->cpu_idle_thread)
+		return;
+
+	/*
+	 * The cross-call that switches tables runs at a higher level than we
+	 * do; we disable interrupts so that it cannot land while we are
+	 * updating the active table.
+	 */
+	cookie = dtrace_interrupt_disable();
+
+	if ((spc->spc_flags & STKPROF_F_KERNEL) && kpc != 0) {
+		dtrace_getpcstack(spc->spc_kpcs, STKPROF_MAXDEPTH,
+		    stkprof_aframes != 0 ? stkprof_aframes : STKPROF_AFRAMES,
+		    (uint32_t *)kpc);
+		for (nkframes = 0; nkframes < STKPROF_MAXDEPTH &&
+		    spc->spc_kpcs[nkframes] != 0; nkframes++)
+			continue;
+	}
+
+	if ((spc->spc_flags & STKPROF_F_USER) && ttolwp(curthread) != NULL &&
+	    !(p->p_flag & SSYS)) {
+		/*
+		 * dtrace_getupcstack() relies on the DTrace no-fault
+		 * protocol to survive walking an unmapped frame.  Nothing
+		 * else on this CPU can be in DTrace probe context (it, too,
+		 * runs with interrupts disabled), but we preserve the flags
+		 * regardless.
+		 */
+		flags = cpu_core[CPU->cpu_id].cpuc_dtrace_flags;
+		cpu_core[CPU->cpu_id].cpuc_dtrace_flags =
+		    CPU_DTRACE_NOFAULT;
+		dtrace_getupcstack(spc->spc_upcs, STKPROF_MAXDEPTH + 1);
+		cpu_core[CPU->cpu_id].cpuc_dtrace_flags = flags;
+
+		/* The first slot is the pid. */
+		nuframes = stkprof_nframes(&spc->spc_upcs[1], STKPROF_MAXDEPTH);
+	}
+
+	if (nkframes == 0 && nuframes == 0)
+		goto out;
+
+	tab = spc->spc_tab[spc->spc_active];
+
+	/*
+	 * We build the candidate record in the slot we would claim if the
+	 * stack is new; the hash need not be stable until it is.
+	 */
+	rec = &tab[stkprof_tabents].spe_rec;
+	rec->spr_pid = p->p_pid;
+	rec->spr_zoneid = p->p_zone->zone_id;
+	rec->spr_nkframes = nkframes;
+	rec->spr_nuframes = nuframes;
+	for (i = 0; i < nkframes; i++)
+		rec->spr_kstack[i] = spc->spc_kpcs[i];
+	for (i = 0; i < nuframes; i++)
+		rec->spr_ustack[i] = spc->spc_upcs[i + 1];
+
+	hashval = stkprof_hash(rec);
+	ndx = hashval % stkprof_tabents;
+
+	for (i = 0; i < stkprof_nprobes; i++) {
+		ent = &tab[(ndx + i) % stkprof_tabents];
+
+		if (ent->spe_rec.spr_count == 0) {
+			ent->spe_hash = hashval;
+			bcopy(rec, &ent->spe_rec, sizeof (*rec));
+			ent->spe_rec.spr_cpu = spc->spc_cpuid;
+			ent->spe_rec.spr_count = 1;
+			goto out;
+		}
+
+		if (ent->spe_hash == hashval &&
+		    stkprof_match(&ent->spe_rec, rec)) {
+			ent->spe_rec.spr_count++;
+			goto out;
+		}
+	}
+
+	spc->spc_drops[spc->spc_active]++;
+out:
+	dtrace_interrupt_enable(cookie);
+}
+
+/*ARGSUSED*/
+static void
+stkprof_online(void *arg, cpu_t *cpu, cyc_handler_t *hdlr, cyc_time_t *when)
+{
+	stkprof_conf_t *conf = arg;
+	stkprof_cpu_t *spc;
+	size_t tabsz;
+
+	ASSERT(MUTEX_HELD(&cpu_lock));
+
+	/*
+	 * Each table has one entry beyond stkprof_tabents that is used by
+	 * stkprof_fire() as scratch space for the record being looked up.
+	 */
+	tabsz = (stkprof_tabents + 1) * sizeof (stkprof_ent_t);
+
+	spc = kmem_zalloc(sizeof (stkprof_cpu_t), KM_SLEEP);
+	spc->spc_tab[0] = kmem_zalloc(tabsz, KM_SLEEP);
+	spc->spc_tab[1] = kmem_zalloc(tabsz, KM_SLEEP);
+	spc->spc_flags = conf->spcf_flags;
+	spc->spc_cpuid = cpu->cpu_id;
+	stkprof_cpus[cpu->cpu_id] = spc;
+
+	hdlr->cyh_func = stkprof_fire;
+	hdlr->cyh_arg = spc;
+	hdlr->cyh_level = CY_HIGH_LEVEL;
+
+	when->cyt_interval = NANOSEC / conf->spcf_hz;
+	when->cyt_when = gethrtime() + when->cyt_interval;
+}
+
+/*ARGSUSED*/
+static void
+stkprof_offline(void *arg, cpu_t *cpu, void *oarg)
+{
+	stkprof_cpu_t *spc = oarg;
+	size_t tabsz = (stkprof_tabents + 1) * sizeof (stkprof_ent_t);
+
+	ASSERT(MUTEX_HELD(&cpu_lock));
+	ASSERT(stkprof_cpus[cpu->cpu_id] == spc);
+
+	stkprof_cpus[cpu->cpu_id] = NULL;
+	kmem_free(spc->spc_tab[0], tabsz);
+	kmem_free(spc->spc_tab[1], tabsz);
+	kmem_free(spc, sizeof (stkprof_cpu_t));
+}
+
+/*ARGSUSED*/
+static int
+stkprof_switch(xc_arg_t arg1, xc_arg_t arg2, xc_arg_t arg3)
+{
+	stkprof_cpu_t *spc = (stkprof_cpu_t *)arg1;
+
+	spc->spc_active ^= 1;
+	return (0);
+}
+
+static int
+stkprof_start(stkprof_conf_t *conf)
+{
+	cyc_omni_handler_t omni;
+
+	ASSERT(MUTEX_HELD(&stkprof_lock));
+
+	if (conf->spcf_hz == 0 || conf->spcf_hz > STKPROF_MAXHZ ||
+	    conf->spcf_flags == 0 || (conf->spcf_flags & ~STKPROF_F_ALL) ||
+	    !(conf->spcf_flags & (STKPROF_F_KERNEL | STKPROF_F_USER)))
+		return (EINVAL);
+
+	if (stkprof_cyclic != CYCLIC_NONE)
+		return (EBUSY);
+
+	stkprof_conf = *conf;
+	stkprof_tabents = MAX(stkprof_nentries, 1);
+	stkprof_cpus = kmem_zalloc(max_ncpus * sizeof (stkprof_cpu_t *),
+	    KM_SLEEP);
+
+	omni.cyo_online = stkprof_online;
+	omni.cyo_offline = stkprof_offline;
+	omni.cyo_arg = &stkprof_conf;
+
+	mutex_enter(&cpu_lock);
+	stkprof_cyclic = cyclic_add_omni(&omni);
+	mutex_exit(&cpu_lock);
+
+	return (0);
+}
+
+static void
+stkprof_stop(void)
+{
+	ASSERT(MUTEX_HELD(&stkprof_lock));
+
+	if (stkprof_cyclic == CYCLIC_NONE)
+		return;
+
+	mutex_enter(&cpu_lock);
+	cyclic_remove(stkprof_cyclic);
+	stkprof_cyclic = CYCLIC_NONE;
+	mutex_exit(&cpu_lock);
+
+	kmem_free(stkprof_cpus, max_ncpus * sizeof (stkprof_cpu_t *));
+	stkprof_cpus = NULL;
+}
+
+static int
+stkprof_read(stkprof_read_t *rd)
+{
+	stkprof_rec_t *staging;
+	uint64_t left = rd->sprd_bufsize / sizeof (stkprof_rec_t);
+	uintptr_t ubuf = (uintptr_t)rd->sprd_buf;
+	size_t stagesz;
+	int i, error = 0;
+
+	ASSERT(MUTEX_HELD(&stkprof_lock));
+
+	if (stkprof_cyclic == CYCLIC_NONE)
+		return (ENXIO);
+
+	rd->sprd_nrecs = 0;
+	rd->sprd_drops = 0;
+
+	stagesz = stkprof_tabents * sizeof (stkprof_rec_t);
+	staging = kmem_alloc(stagesz, KM_SLEEP);
+
+	for (i = 0; i < max_ncpus; i++) {
+		stkprof_cpu_t *spc;
+		stkprof_ent_t *tab;
+		cpuset_t set;
+		uint_t j, n = 0, inactive;
+
+		/*
+		 * Holding cpu_lock keeps the CPU's state from being freed
+		 * beneath us by the offline handler.
+		 */
+		mutex_enter(&cpu_lock);
+
+		if ((spc = stkprof_cpus[i]) == NULL) {
+			mutex_exit(&cpu_lock);
+			continue;
+		}
+
+		CPUSET_ONLY(set, i);
+		kpreempt_disable();
+		xc_call((xc_arg_t)spc, 0, 0, CPUSET2BV(set), stkprof_switch);
+		kpreempt_enable();
+
+		inactive = spc->spc_active ^ 1;
+		tab = spc->spc_tab[inactive];
+
+		for (j = 0; j < stkprof_tabents; j++) {
+			if (tab[j].spe_rec.spr_count == 0)
+				continue;
+
+			if (n < left) {
+				bcopy(&tab[j].spe_rec, &staging[n],
+				    sizeof (stkprof_rec_t));
+				n++;
+			} else {
+				rd->sprd_drops += tab[j].spe_rec.spr_count;
+			}
+
+			tab[j].spe_rec.spr_count = 0;
+		}
+
+		rd->sprd_drops += spc->spc_drops[inactive];
+		spc->spc_drops[inactive] = 0;
+
+		mutex_exit(&cpu_lock);
+
+		if (n == 0)
+			continue;
+
+		if (copyout(staging, (void *)ubuf,
+		    n * sizeof (stkprof_rec_t)) != 0) {
+			error = EFAULT;
+			break;
+		}
+
+		ubuf += n * sizeof (stkprof_rec_t);
+		rd->sprd_nrecs += n;
+		left -= n;
+	}
+
+	kmem_free(staging, stagesz);
+	return (error);
+}
+
+/*ARGSUSED*/
+static int
+stkprof_ioctl(dev_t dev, int cmd, intptr_t arg, int md, cred_t *cr, int *rv)
+{
+	stkprof_conf_t conf;
+	stkprof_read_t rd;
+	int error;
+
+	switch (cmd) {
+	case STKPROFIOC_START:
+		if (ddi_copyin((void *)arg, &conf, sizeof (conf), md) != 0)
+			return (EFAULT);
+
+		mutex_enter(&stkprof_lock);
+		error = stkprof_start(&conf);
+		mutex_exit(&stkprof_lock);
+		return (error);
+
+	case STKPROFIOC_STOP:
+		mutex_enter(&stkprof_lock);
+		stkprof_stop();
+		mutex_exit(&stkprof_lock);
+		return (0);
+
+	case STKPROFIOC_READ:
+		if (ddi_copyin((void *)arg, &rd, sizeof (rd), md) != 0)
+			return (EFAULT);
+
+		mutex_enter(&stkprof_lock);
+		error = stkprof_read(&rd);
+		mutex_exit(&stkprof_lock);
+
+		if (error != 0)
+			return (error);
+
+		if (ddi_copyout(&rd, (void *)arg, sizeof (rd), md) != 0)
+			return (EFAULT);
+
+		return (0);
+
+	default:
+		return (ENOTTY);
+	}
+}
+
+/*ARGSUSED*/
+static int
+stkprof_open(dev_t *devp, int flag, int otyp, cred_t *cr)
+{
+	if (crgetzoneid(cr) != GLOBAL_ZONEID)
+		return (EPERM);
+
+	if (secpolicy_sys_config(cr, B_FALSE) != 0)
+		return (EPERM);
+
+	mutex_enter(&stkprof_lock);
+	if (stkprof_open_busy) {
+		mutex_exit(&stkprof_lock);
+		return (EBUSY);
+	}
+	stkprof_open_busy = B_TRUE;
+	mutex_exit(&stkprof_lock);
+
+	return (0);
+}
+
+/*ARGSUSED*/
+static int
+stkprof_close(dev_t dev, int flag, int otyp, cred_t *cr)
+{
+	mutex_enter(&stkprof_lock);
+	stkprof_stop();
+	stkprof_open_busy = B_FALSE;
+	mutex_exit(&stkprof_lock);
+
+	return (0);
+}
+
+static int
+stkprof_attach(dev_info_t *devi, ddi_attach_cmd_t cmd)
+{
+	switch (cmd) {
+	case DDI_ATTACH:
+		break;
+	case DDI_RESUME:
+		return (DDI_SUCCESS);
+	default:
+		return (DDI_FAILURE);
+	}
+
+	if (ddi_create_minor_node(devi, "stkprof", S_IFCHR, 0,
+	    DDI_PSEUDO, 0) == DDI_FAILURE) {
+		ddi_remove_minor_node(devi, NULL);
+		return (DDI_FAILURE);
+	}
+
+	ddi_report_dev(devi);
+	stkprof_devi = devi;
+	return (DDI_SUCCESS);
+}
+
+static int
+stkprof_detach(dev_info_t *devi, ddi_detach_cmd_t cmd)
+{
+	switch (cmd) {
+	case DDI_DETACH:
+		break;
+	case DDI_SUSPEND:
+		return (DDI_SUCCESS);
+	default:
+		return (DDI_FAILURE);
+	}
+
+	mutex_enter(&stkprof_lock);
+	if (stkprof_open_busy) {
+		mutex_exit(&stkprof_lock);
+		return (DDI_FAILURE);
+	}
+	mutex_exit(&stkprof_lock);
+
+	ddi_remove_minor_node(devi, NULL);
+	stkprof_devi = NULL;
+	return (DDI_SUCCESS);
+}
+
+/*ARGSUSED*/
+static int
+stkprof_info(dev_info_t *dip, ddi_info_cmd_t infocmd, void *arg, void **result)
+{
+	int error;
+
+	switch (infocmd) {
+	case DDI_INFO_DEVT2DEVINFO:
+		*result = (void *)stkprof_devi;
+		error = DDI_SUCCESS;
+		break;
+	case DDI_INFO_DEVT2INSTANCE:
+		*result = (void *)0;
+		error = DDI_SUCCESS;
+		break;
+	default:
+		error = DDI_FAILURE;
+	}
+	return (error);
+}
+
+static struct cb_ops stkprof_cb_ops = {
+	stkprof_open,		/* open */
+	stkprof_close,		/* close */
+	nulldev,		/* strategy */
+	nulldev,		/* print */
+	nodev,			/* dump */
+	nodev,			/* read */
+	nodev,			/* write */
+	stkprof_ioctl,		/* ioctl */
+	nodev,			/* devmap */
+	nodev,			/* mmap */
+	nodev,			/* segmap */
+	nochpoll,		/* poll */
+	ddi_prop_op,		/* cb_prop_op */
+	0,			/* streamtab  */
+	D_NEW | D_MP		/* Driver compatibility flag */
+};
+
+static struct dev_ops stkprof_ops = {
+	DEVO_REV,		/* devo_rev, */
+	0,			/* refcnt  */
+	stkprof_info,		/* get_dev_info */
+	nulldev,		/* identify */
+	nulldev,		/* probe */
+	stkprof_attach,		/* attach */
+	stkprof_detach,		/* detach */
+	nodev,			/* reset */
+	&stkprof_cb_ops,	/* driver operations */
+	NULL,			/* bus operations */
+	nodev,			/* dev power */
+	ddi_quiesce_not_needed,	/* quiesce */
+};
+
+static struct modldrv modldrv = {
+	&mod_driverops,		/* module type (this is a pseudo driver) */
+	"stack sampling profiler",	/* name of module */
+	&stkprof_ops,		/* driver ops */
+};
+
+static struct modlinkage modlinkage = {
+	MODREV_1,
+	(void *)&modldrv,
+	NULL
+};
+
+int
+_init(void)
+{
+	int error;
+
+	mutex_init(&stkprof_lock, NULL, MUTEX_DEFAULT, NULL);
+
+	if ((error = mod_install(&modlinkage)) != 0)
+		mutex_destroy(&stkprof_lock);
+
+	return (error);
+}
+
+int
+_info(struct modinfo *modinfop)
+{
+	return (mod_info(&modlinkage, modinfop));
+}
+
+int
+_fini(void)
+{
+	int error;
+
+	if ((error = mod_remove(&modlinkage)) == 0)
+		mutex_destroy(&stkprof_lock);
+
+	return (error);
+}
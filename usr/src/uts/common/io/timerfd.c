@@ -10,7 +10,7 @@
  */
 
 /*
- * Copyright (c) 2015 Joyent, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -51,6 +51,16 @@ static vmem_t		*timerfd_minor;		/* minor number arena */
 static void		*timerfd_softstate;	/* softstate pointer */
 static timerfd_state_t	*timerfd_state;		/* global list of state */
 
+/*
+ * Event loops tend to arm many CLOCK_MONOTONIC timerfds with expirations
+ * that are close together, and each is a separate cyclic firing.  If
+ * timerfd_slack_nsec is set, the initial expiration of such a timer is
+ * rounded up to a multiple of it, so that timers that would have expired
+ * within the same slack interval fire from the same cyclic interrupt.  The
+ * timer interval itself is never changed.
+ */
+hrtime_t		timerfd_slack_nsec = 0;
+
 static itimer_t *
 timerfd_itimer_lock(timerfd_state_t *state)
 {
@@ -245,6 +255,27 @@ timerfd_copyout(itimerspec_t *src, uintptr_t addr)
 	return (0);
 }
 
+/*
+ * Apply timerfd_slack_nsec to the initial expiration of a CLOCK_HIGHRES
+ * timer.  A relative expiration stays relative, so that the backend still
+ * applies its minimum interval to unprivileged callers.
+ */
+static void
+timerfd_slack(itimer_t *it, int flags, itimerspec_t *when)
+{
+	hrtime_t slack = timerfd_slack_nsec;
+	hrtime_t now, exp;
+
+	if (slack <= 0 || !timerspecisset(&when->it_value) ||
+	    when->it_value.tv_sec >= INT32_MAX ||
+	    it->it_backend != clock_get_backend(CLOCK_HIGHRES))
+		return;
+
+	now = (flags & TIMER_ABSTIME) ? 0 : gethrtime();
+	exp = roundup(ts2hrt(&when->it_value) + now, slack);
+	hrt2ts(exp - now, &when->it_value);
+}
+
 /*ARGSUSED*/
 static int
 timerfd_ioctl(dev_t dev, int cmd, intptr_t arg, int md, cred_t *cr, int *rv)
@@ -317,6 +348,7 @@ timerfd_ioctl(dev_t dev, int cmd, intptr_t arg, int md, cred_t *cr, int *rv)
 
 	case TIMERFDIOC_SETTIME: {
 		timerfd_settime_t st;
+		int flags;
 
 		if (copyin((void *)arg, &st, sizeof (st)) != 0)
 			return (EFAULT);
@@ -368,9 +400,10 @@ timerfd_ioctl(dev_t dev, int cmd, intptr_t arg, int md, cred_t *cr, int *rv)
 		state->tfd_fired = 0;
 		mutex_exit(&state->tfd_lock);
 
-		err = it->it_backend->clk_timer_settime(it,
-		    st.tfd_settime_flags & TFD_TIMER_ABSTIME ?
-		    TIMER_ABSTIME : TIMER_RELTIME, &when);
+		flags = st.tfd_settime_flags & TFD_TIMER_ABSTIME ?
+		    TIMER_ABSTIME : TIMER_RELTIME;
+		timerfd_slack(it, flags, &when);
+		err = it->it_backend->clk_timer_settime(it, flags, &when);
 		timerfd_itimer_unlock(state, it);
 
 		if (err != 0 || st.tfd_settime_ovalue == 0)
@@ -597,6 +597,45 @@
  * block comes out of the gsqueue, then we know nothing else in the gsqueue that
  * could refer to the vnd_str_t, being destroyed, exists.
  *
+ * -------------------
+ * Shared memory rings
+ * -------------------
+ *
+ * Both of the consumer ends above cost a system call, and a copy between the
+ * data queues and the consumer's buffers, for every batch of frames. For
+ * consumers that process packets at high rates, vnd can instead exchange
+ * frames through a pair of rings in memory that is shared with the consumer.
+ * The rings are created with the VND_IOC_RING_SETUP ioctl and then mapped with
+ * mmap(2); <sys/vnd.h> describes their layout. The memory is allocated with
+ * ddi_umem_alloc(9F) and exported through our devmap(9E) entry point. It's
+ * represented in the kernel by a vnd_ring_t hanging off of the vnd_dev_t.
+ *
+ * On the rx path, vnd_mac_input() copies each frame that makes it through the
+ * hooks straight into the next slot of the receive ring, instead of pushing
+ * it onto vns_dq_read, and publishes it by advancing the ring's producer
+ * index. If the consumer has not freed a slot, the frame is dropped, just as
+ * it would be if the data queue were full. That's the one copy on the rx
+ * path: MAC's own buffers belong to the driver and can't be handed to
+ * userland.
+ *
+ * The tx path needs no copy at all. When the consumer kicks the transmit
+ * ring, each frame that it posted is wrapped in an mblk_t with desballoc(9F)
+ * pointing at its slot, and enters the gsqueue exactly as a write(9E) would,
+ * after taking a reservation in vns_dq_write. The slot stays busy until that
+ * mblk_t is freed, whether by the driver once the frame has been sent or by a
+ * drop somewhere along the way. The ring's consumer index, which tells the
+ * consumer which slots it may reuse, only advances over slots that are no
+ * longer busy. Because the consumer could rewrite a busy slot at any time,
+ * frames are copied rather than loaned whenever the hooks are in use, so that
+ * what the firewall inspected is what is sent.
+ *
+ * The consumer learns about new frames and free slots through the same
+ * pollwakeup(9F) calls as the data queues, which fire once per batch and which
+ * event ports pick up without any further system calls. The rings last until
+ * the device is closed, which cannot happen while they are still mapped. The
+ * vnd_ring_t itself may outlive that if there are loaned tx mblk_t's
+ * outstanding; the last of them to be freed frees the ring.
+ *
  * ---------------------
  * vnd, zones, netstacks
  * ---------------------
@@ -737,8 +776,10 @@
  * 1) vnd`vnd_dev_lock
  * 2) vnd_pnsd_t`vpnd_lock
  * 3) vnd_dev_t`vnd_lock
- * 4) vnd_str_t`vns_lock
- * 5) vnd_data_queue_t`vdq_lock
+ * 4) vnd_ring_t`vr_txlock
+ * 5) vnd_str_t`vns_lock
+ * 6) vnd_data_queue_t`vdq_lock
+ * 7) vnd_ring_t`vr_lock
  *
  * One must adhere to the following rules:
  *
@@ -786,6 +827,12 @@
  * thread. Otherwise, it is always fair game to refer to their addresses. Their
  * contents are ignored by vnd, but some members are manipulated by the gsqueue
  * subsystem.
+ *
+ * vnd_dev_t: The vdd_ring is only set and cleared while holding both the
+ * vdd_lock and the vns_dq_read`vdq_lock of the attached stream, so either is
+ * enough to read it. The rx path uses the latter, as it already holds it. The
+ * vnd_ring_t`vr_rxprod is likewise protected by that vdq_lock, while its
+ * vr_txnext is only changed while holding both the vr_txlock and the vr_lock.
  */
 
 #include <sys/conf.h>
@@ -831,6 +878,8 @@
 #include <sys/random.h>
 #include <sys/gsqueue.h>
 #include <sys/smt.h>
+#include <sys/ddidevmap.h>
+#include <sys/mman.h>
 
 #include <inet/ip.h>
 #include <inet/ip6.h>
@@ -943,6 +992,13 @@ size_t vnd_vdq_hard_max = 1024 * 1024 * 4;	/* 4 MB */
 size_t vnd_flush_burst_size = 1520 * 10;	/* 10 1500 MTU packets */
 size_t vnd_flush_nburst = 10;			/* 10 frames */
 
+/*
+ * Limits on the shared memory rings that a consumer may create.
+ */
+uint32_t vnd_ring_max_slots = 4096;
+uint32_t vnd_ring_max_slotsize = 1024 * 64;	/* 64 KB */
+size_t vnd_ring_hard_max = 1024 * 1024 * 64;	/* 64 MB */
+
 /*
  * Constants related to our sdev plugins
  */
@@ -1140,6 +1196,41 @@ typedef struct vnd_str {
 	struct vnd_pnsd	*vns_nsd;		/* E + X */
 } vnd_str_t;
 
+/*
+ * The kernel's view of a device's shared memory rings. Everything that vnd
+ * depends on is kept here; of the shared vnd_ring_map_t, only the values that
+ * the consumer owns are ever read, and they are read once and checked.
+ *
+ * See synchronization section of the big theory statement for member
+ * annotations.
+ */
+typedef struct vnd_ring_slot {
+	frtn_t		vrs_frtn;		/* E */
+	struct vnd_ring	*vrs_ring;		/* E */
+	boolean_t	vrs_busy;		/* L */
+} vnd_ring_slot_t;
+
+typedef struct vnd_ring {
+	kmutex_t	vr_lock;
+	kmutex_t	vr_txlock;		/* Serializes tx kicks */
+	ddi_umem_cookie_t vr_cookie;		/* E */
+	size_t		vr_size;		/* E */
+	uint32_t	vr_nslots;		/* E */
+	uint32_t	vr_slotsize;		/* E */
+	vnd_ring_map_t	*vr_map;		/* E */
+	vnd_ring_desc_t	*vr_rxdesc;		/* E */
+	vnd_ring_desc_t	*vr_txdesc;		/* E */
+	caddr_t		vr_rxdata;		/* E */
+	caddr_t		vr_txdata;		/* E */
+	vnd_ring_slot_t	*vr_txslots;		/* E */
+	uint32_t	vr_rxprod;		/* X */
+	uint32_t	vr_txnext;		/* L + X */
+	uint32_t	vr_txcons;		/* L */
+	uint_t		vr_ref;			/* L */
+	boolean_t	vr_closed;		/* L */
+	struct vnd_dev	*vr_dev;		/* L */
+} vnd_ring_t;
+
 typedef enum vnd_dev_flags {
 	VND_D_ATTACH_INFLIGHT =	0x001,
 	VND_D_ATTACHED =	0x002,
@@ -1168,6 +1259,7 @@ typedef struct vnd_dev {
 	ldi_handle_t	vdd_ldih;			/* X */
 	cred_t		*vdd_cr;			/* X */
 	vnd_str_t	*vdd_str;			/* L */
+	vnd_ring_t	*vdd_ring;			/* L + X */
 	struct pollhead	vdd_ph;				/* E */
 	struct vnd_pnsd *vdd_nsd;			/* E + X */
 	char		vdd_datalink[VND_NAMELEN];	/* L */
@@ -1608,6 +1700,185 @@ vnd_dq_is_empty(vnd_data_queue_t *vqp)
 	return (ret);
 }
 
+static void vnd_ring_tx_done(caddr_t);
+
+static vnd_ring_t *
+vnd_ring_alloc(uint32_t nslots, uint32_t slotsize, size_t dataoff, size_t size)
+{
+	vnd_ring_t *vrp;
+	vnd_ring_map_t *map;
+	ddi_umem_cookie_t cookie;
+	uint32_t i;
+
+	map = ddi_umem_alloc(size, DDI_UMEM_NOSLEEP, &cookie);
+	if (map == NULL)
+		return (NULL);
+	bzero(map, size);
+
+	vrp = kmem_zalloc(sizeof (vnd_ring_t), KM_SLEEP);
+	mutex_init(&vrp->vr_lock, NULL, MUTEX_DRIVER, NULL);
+	mutex_init(&vrp->vr_txlock, NULL, MUTEX_DRIVER, NULL);
+	vrp->vr_cookie = cookie;
+	vrp->vr_size = size;
+	vrp->vr_nslots = nslots;
+	vrp->vr_slotsize = slotsize;
+	vrp->vr_map = map;
+	vrp->vr_rxdesc = (vnd_ring_desc_t *)(map + 1);
+	vrp->vr_txdesc = vrp->vr_rxdesc + nslots;
+	vrp->vr_rxdata = (caddr_t)map + dataoff;
+	vrp->vr_txdata = vrp->vr_rxdata + (size_t)nslots * slotsize;
+
+	vrp->vr_txslots = kmem_zalloc(sizeof (vnd_ring_slot_t) * nslots,
+	    KM_SLEEP);
+	for (i = 0; i < nslots; i++) {
+		vrp->vr_txslots[i].vrs_frtn.free_func = vnd_ring_tx_done;
+		vrp->vr_txslots[i].vrs_frtn.free_arg =
+		    (caddr_t)&vrp->vr_txslots[i];
+		vrp->vr_txslots[i].vrs_ring = vrp;
+	}
+
+	map->vrm_rx.vrc_nslots = nslots;
+	map->vrm_rx.vrc_slotsize = slotsize;
+	map->vrm_rx.vrc_descoff = (caddr_t)vrp->vr_rxdesc - (caddr_t)map;
+	map->vrm_rx.vrc_dataoff = vrp->vr_rxdata - (caddr_t)map;
+	map->vrm_tx.vrc_nslots = nslots;
+	map->vrm_tx.vrc_slotsize = slotsize;
+	map->vrm_tx.vrc_descoff = (caddr_t)vrp->vr_txdesc - (caddr_t)map;
+	map->vrm_tx.vrc_dataoff = vrp->vr_txdata - (caddr_t)map;
+
+	return (vrp);
+}
+
+static void
+vnd_ring_free(vnd_ring_t *vrp)
+{
+	ASSERT(vrp->vr_ref == 0);
+	ddi_umem_free(vrp->vr_cookie);
+	kmem_free(vrp->vr_txslots, sizeof (vnd_ring_slot_t) * vrp->vr_nslots);
+	mutex_destroy(&vrp->vr_txlock);
+	mutex_destroy(&vrp->vr_lock);
+	kmem_free(vrp, sizeof (vnd_ring_t));
+}
+
+static void
+vnd_ring_hold(vnd_ring_t *vrp)
+{
+	mutex_enter(&vrp->vr_lock);
+	vrp->vr_ref++;
+	mutex_exit(&vrp->vr_lock);
+}
+
+static void
+vnd_ring_rele(vnd_ring_t *vrp)
+{
+	boolean_t last;
+
+	mutex_enter(&vrp->vr_lock);
+	VERIFY(vrp->vr_ref > 0);
+	vrp->vr_ref--;
+	last = (vrp->vr_ref == 0 && vrp->vr_closed);
+	mutex_exit(&vrp->vr_lock);
+
+	if (last)
+		vnd_ring_free(vrp);
+}
+
+/*
+ * The device has been closed and so its rings are no longer mapped. Tear them
+ * down once nothing in the kernel refers to them any longer.
+ */
+static void
+vnd_ring_close(vnd_ring_t *vrp)
+{
+	boolean_t last;
+
+	mutex_enter(&vrp->vr_lock);
+	vrp->vr_closed = B_TRUE;
+	vrp->vr_dev = NULL;
+	last = (vrp->vr_ref == 0);
+	mutex_exit(&vrp->vr_lock);
+
+	if (last)
+		vnd_ring_free(vrp);
+}
+
+/*
+ * Place a received frame in the next slot of the receive ring. Like
+ * vnd_dq_push(), return one if it was placed there and so the consumer should
+ * be woken.
+ */
+static int
+vnd_ring_rx(vnd_str_t *vsp, vnd_ring_t *vrp, mblk_t *mp)
+{
+	uint32_t idx;
+	size_t len;
+
+	ASSERT(MUTEX_HELD(&vsp->vns_dq_read.vdq_lock));
+
+	if (vrp->vr_rxprod - vrp->vr_map->vrm_rx.vrc_cons >= vrp->vr_nslots) {
+		vnd_drop_in(vsp, mp, "rx ring full");
+		return (0);
+	}
+
+	len = msgsize(mp);
+	if (len > vrp->vr_slotsize) {
+		vnd_drop_in(vsp, mp, "frame larger than rx ring slot");
+		return (0);
+	}
+
+	idx = vrp->vr_rxprod & (vrp->vr_nslots - 1);
+	mcopymsg(mp, vrp->vr_rxdata + (size_t)idx * vrp->vr_slotsize);
+	vrp->vr_rxdesc[idx].vrd_len = (uint32_t)len;
+	vrp->vr_rxdesc[idx].vrd_flags = 0;
+	membar_producer();
+	vrp->vr_rxprod++;
+	vrp->vr_map->vrm_rx.vrc_prod = vrp->vr_rxprod;
+
+	return (1);
+}
+
+/*
+ * Advance the transmit ring's consumer index past every slot that has been
+ * taken and is no longer in use, and let the consumer know.
+ */
+static void
+vnd_ring_tx_reclaim(vnd_ring_t *vrp)
+{
+	uint32_t mask = vrp->vr_nslots - 1;
+	uint32_t cons = vrp->vr_txcons;
+
+	ASSERT(MUTEX_HELD(&vrp->vr_lock));
+
+	while (vrp->vr_txcons != vrp->vr_txnext &&
+	    !vrp->vr_txslots[vrp->vr_txcons & mask].vrs_busy)
+		vrp->vr_txcons++;
+
+	if (vrp->vr_txcons == cons)
+		return;
+
+	vrp->vr_map->vrm_tx.vrc_cons = vrp->vr_txcons;
+	if (vrp->vr_dev != NULL)
+		pollwakeup(&vrp->vr_dev->vdd_ph, POLLOUT);
+}
+
+/*
+ * The free routine of a loaned transmit mblk_t.
+ */
+static void
+vnd_ring_tx_done(caddr_t arg)
+{
+	vnd_ring_slot_t *vrsp = (vnd_ring_slot_t *)arg;
+	vnd_ring_t *vrp = vrsp->vrs_ring;
+
+	mutex_enter(&vrp->vr_lock);
+	VERIFY(vrsp->vrs_busy == B_TRUE);
+	vrsp->vrs_busy = B_FALSE;
+	vnd_ring_tx_reclaim(vrp);
+	mutex_exit(&vrp->vr_lock);
+
+	vnd_ring_rele(vrp);
+}
+
 /*
  * Get a network uint16_t from the message and translate it into something the
  * host understands.
@@ -2189,8 +2460,11 @@ vnd_mac_input(vnd_str_t *vsp, mac_resource_t *unused, mblk_t *mp_chain,
 		DTRACE_VND5(recv, mblk_t *, mp, void *, NULL, void *, NULL,
 		    vnd_str_t *, vsp, mblk_t *, mp);
 		mutex_enter(&vsp->vns_dq_read.vdq_lock);
-		signal |= vnd_dq_push(&vsp->vns_dq_read, mp, B_FALSE,
-		    vnd_drop_in);
+		if (vsp->vns_dev->vdd_ring != NULL)
+			signal |= vnd_ring_rx(vsp, vsp->vns_dev->vdd_ring, mp);
+		else
+			signal |= vnd_dq_push(&vsp->vns_dq_read, mp, B_FALSE,
+			    vnd_drop_in);
 		mutex_exit(&vsp->vns_dq_read.vdq_lock);
 	}
 
@@ -4618,6 +4892,211 @@ vnd_frameio_write(vnd_dev_t *vdp, intptr_t addr, int mode)
 	return (ret);
 }
 
+static int
+vnd_ioctl_ring_setup(vnd_dev_t *vdp, intptr_t arg, int cpflag)
+{
+	int ret;
+	vnd_ioc_ring_t vir;
+	vnd_ring_t *vrp;
+	uint32_t nslots, slotsize;
+	size_t maxwrite, dataoff, size;
+
+	if (ddi_copyin((void *)arg, &vir, sizeof (vir), cpflag) != 0)
+		return (EFAULT);
+
+	mutex_enter(&vdp->vdd_lock);
+	if (!(vdp->vdd_flags & VND_D_ATTACHED)) {
+		mutex_exit(&vdp->vdd_lock);
+		vir.vir_errno = VND_E_NOTATTACHED;
+		ret = EIO;
+		goto err;
+	}
+	mutex_enter(&vdp->vdd_str->vns_lock);
+	maxwrite = vdp->vdd_str->vns_maxwrite;
+	mutex_exit(&vdp->vdd_str->vns_lock);
+	mutex_exit(&vdp->vdd_lock);
+
+	nslots = vir.vir_nslots;
+	if (nslots == 0 || !ISP2(nslots) || nslots > vnd_ring_max_slots) {
+		vir.vir_errno = VND_E_BADRING;
+		ret = EIO;
+		goto err;
+	}
+
+	if (vir.vir_slotsize < maxwrite) {
+		vir.vir_errno = VND_E_BUFTOOSMALL;
+		ret = EIO;
+		goto err;
+	}
+
+	/*
+	 * Slots are kept cache line aligned and the slot buffers page aligned,
+	 * after the vnd_ring_map_t and the two rings of descriptors.
+	 */
+	slotsize = P2ROUNDUP(vir.vir_slotsize, 64);
+	dataoff = ptob(btopr(sizeof (vnd_ring_map_t) +
+	    2 * nslots * sizeof (vnd_ring_desc_t)));
+	size = ptob(btopr(dataoff + 2 * (size_t)nslots * slotsize));
+	if (vir.vir_slotsize > vnd_ring_max_slotsize ||
+	    size > vnd_ring_hard_max) {
+		vir.vir_errno = VND_E_BUFTOOBIG;
+		ret = EIO;
+		goto err;
+	}
+
+	vrp = vnd_ring_alloc(nslots, slotsize, dataoff, size);
+	if (vrp == NULL) {
+		vir.vir_errno = VND_E_NOMEM;
+		ret = EIO;
+		goto err;
+	}
+
+	mutex_enter(&vdp->vdd_lock);
+	if (vdp->vdd_ring != NULL) {
+		mutex_exit(&vdp->vdd_lock);
+		vnd_ring_free(vrp);
+		vir.vir_errno = VND_E_RINGEXISTS;
+		ret = EIO;
+		goto err;
+	}
+	vrp->vr_dev = vdp;
+	mutex_enter(&vdp->vdd_str->vns_dq_read.vdq_lock);
+	vdp->vdd_ring = vrp;
+	mutex_exit(&vdp->vdd_str->vns_dq_read.vdq_lock);
+	mutex_exit(&vdp->vdd_lock);
+
+	vir.vir_slotsize = slotsize;
+	vir.vir_mapsize = size;
+	ret = 0;
+
+err:
+	if (ddi_copyout(&vir, (void *)arg, sizeof (vir), cpflag) != 0)
+		return (EFAULT);
+
+	return (ret);
+}
+
+/*
+ * Send the frames that the consumer has posted to the transmit ring, for as
+ * long as there's room for them in the write data queue. Frames are loaned to
+ * the stack unless the hooks are in use, in which case they're copied so that
+ * the consumer can't change them after the fact.
+ */
+static int
+vnd_ioctl_ring_txkick(vnd_dev_t *vdp, intptr_t arg, int cpflag)
+{
+	int ret;
+	vnd_ioc_ring_t vir;
+	vnd_ring_t *vrp;
+	vnd_str_t *vsp;
+	vnd_data_queue_t *vqp;
+	size_t minwrite, maxwrite;
+	uint32_t prod, idx, len, ntx;
+	boolean_t hooked;
+
+	if (ddi_copyin((void *)arg, &vir, sizeof (vir), cpflag) != 0)
+		return (EFAULT);
+
+	mutex_enter(&vdp->vdd_lock);
+	if (!(vdp->vdd_flags & VND_D_ATTACHED)) {
+		mutex_exit(&vdp->vdd_lock);
+		vir.vir_errno = VND_E_NOTATTACHED;
+		ret = EIO;
+		goto err;
+	}
+	if ((vrp = vdp->vdd_ring) == NULL) {
+		mutex_exit(&vdp->vdd_lock);
+		vir.vir_errno = VND_E_NORING;
+		ret = EIO;
+		goto err;
+	}
+	vnd_ring_hold(vrp);
+	vsp = vdp->vdd_str;
+	mutex_exit(&vdp->vdd_lock);
+
+	mutex_enter(&vsp->vns_lock);
+	minwrite = vsp->vns_minwrite;
+	maxwrite = vsp->vns_maxwrite;
+	mutex_exit(&vsp->vns_lock);
+	hooked = vsp->vns_nsd->vpnd_hooked;
+
+	ret = 0;
+	ntx = 0;
+	vqp = &vsp->vns_dq_write;
+	mutex_enter(&vrp->vr_txlock);
+	for (;;) {
+		vnd_ring_slot_t *vrsp;
+		caddr_t buf;
+		mblk_t *mp;
+
+		prod = vrp->vr_map->vrm_tx.vrc_prod;
+		if (prod == vrp->vr_txnext)
+			break;
+		if (prod - vrp->vr_txnext > vrp->vr_nslots) {
+			vir.vir_errno = VND_E_BADRING;
+			ret = EIO;
+			break;
+		}
+		membar_consumer();
+
+		idx = vrp->vr_txnext & (vrp->vr_nslots - 1);
+		len = vrp->vr_txdesc[idx].vrd_len;
+		if (len < minwrite || len > maxwrite ||
+		    len > vrp->vr_slotsize) {
+			ret = ERANGE;
+			break;
+		}
+
+		mutex_enter(&vqp->vdq_lock);
+		if (vnd_dq_reserve(vqp, len) == 0) {
+			mutex_exit(&vqp->vdq_lock);
+			break;
+		}
+		mutex_exit(&vqp->vdq_lock);
+
+		vrsp = &vrp->vr_txslots[idx];
+		buf = vrp->vr_txdata + (size_t)idx * vrp->vr_slotsize;
+		if (hooked) {
+			if ((mp = allocb(len, 0)) != NULL)
+				bcopy(buf, mp->b_wptr, len);
+		} else {
+			mp = desballoc((uchar_t *)buf, len, 0, &vrsp->vrs_frtn);
+		}
+		if (mp == NULL) {
+			mutex_enter(&vqp->vdq_lock);
+			vnd_dq_unreserve(vqp, len);
+			mutex_exit(&vqp->vdq_lock);
+			ret = ENOSR;
+			break;
+		}
+		mp->b_wptr += len;
+
+		mutex_enter(&vrp->vr_lock);
+		vrp->vr_txnext++;
+		if (hooked) {
+			vnd_ring_tx_reclaim(vrp);
+		} else {
+			vrsp->vrs_busy = B_TRUE;
+			vrp->vr_ref++;
+		}
+		mutex_exit(&vrp->vr_lock);
+
+		gsqueue_enter_one(vsp->vns_squeue, mp, vnd_squeue_tx_append,
+		    vsp, GSQUEUE_PROCESS, VND_SQUEUE_TAG_VND_WRITE);
+		ntx++;
+	}
+	mutex_exit(&vrp->vr_txlock);
+	vnd_ring_rele(vrp);
+
+	vir.vir_ntx = ntx;
+
+err:
+	if (ddi_copyout(&vir, (void *)arg, sizeof (vir), cpflag) != 0)
+		return (EFAULT);
+
+	return (ret);
+}
+
 static int
 vnd_ioctl_list_copy_info(vnd_dev_t *vdp, vnd_ioc_info_t *arg, int mode)
 {
@@ -4823,6 +5302,20 @@ vnd_ioctl(dev_t dev, int cmd, intptr_t arg, int mode, cred_t *credp,
 		}
 		ret = vnd_frameio_write(vdp, arg, mode);
 		break;
+	case VND_IOC_RING_SETUP:
+		if ((mode & (FREAD | FWRITE)) != (FREAD | FWRITE)) {
+			ret = EBADF;
+			break;
+		}
+		ret = vnd_ioctl_ring_setup(vdp, arg, mode);
+		break;
+	case VND_IOC_RING_TXKICK:
+		if (!(mode & FWRITE)) {
+			ret = EBADF;
+			break;
+		}
+		ret = vnd_ioctl_ring_txkick(vdp, arg, mode);
+		break;
 	case VND_IOC_LIST:
 		if (!(mode & FREAD)) {
 			ret = EBADF;
@@ -4951,6 +5444,7 @@ vnd_close(dev_t dev, int flag, int otyp, cred_t *credp)
 {
 	minor_t m;
 	vnd_dev_t *vdp;
+	vnd_ring_t *vrp;
 
 	m = getminor(dev);
 	if (m == 0)
@@ -4963,8 +5457,16 @@ vnd_close(dev_t dev, int flag, int otyp, cred_t *credp)
 	mutex_enter(&vdp->vdd_lock);
 	VERIFY(vdp->vdd_flags & VND_D_OPENED);
 	vdp->vdd_flags &= ~VND_D_OPENED;
+	if ((vrp = vdp->vdd_ring) != NULL) {
+		mutex_enter(&vdp->vdd_str->vns_dq_read.vdq_lock);
+		vdp->vdd_ring = NULL;
+		mutex_exit(&vdp->vdd_str->vns_dq_read.vdq_lock);
+	}
 	mutex_exit(&vdp->vdd_lock);
 
+	if (vrp != NULL)
+		vnd_ring_close(vrp);
+
 	/* Remove the hold from the previous open. */
 	vnd_dev_rele(vdp);
 
@@ -5143,6 +5645,7 @@ vnd_chpoll(dev_t dev, short events, int anyyet, short *reventsp,
 	short ready = 0;
 	vnd_dev_t *vdp;
 	vnd_data_queue_t *vqp;
+	vnd_ring_t *vrp;
 
 	vdp = vnd_dev_lookup(getminor(dev));
 	if (vdp == NULL)
@@ -5154,12 +5657,15 @@ vnd_chpoll(dev_t dev, short events, int anyyet, short *reventsp,
 		vnd_dev_rele(vdp);
 		return (ENXIO);
 	}
+	if ((vrp = vdp->vdd_ring) != NULL)
+		vnd_ring_hold(vrp);
 	mutex_exit(&vdp->vdd_lock);
 
 	if ((events & POLLIN) || (events & POLLRDNORM)) {
 		vqp = &vdp->vdd_str->vns_dq_read;
 		mutex_enter(&vqp->vdq_lock);
-		if (vqp->vdq_head != NULL)
+		if (vqp->vdq_head != NULL || (vrp != NULL &&
+		    vrp->vr_rxprod != vrp->vr_map->vrm_rx.vrc_cons))
 			ready |= events & (POLLIN | POLLRDNORM);
 		mutex_exit(&vqp->vdq_lock);
 	}
@@ -5170,8 +5676,19 @@ vnd_chpoll(dev_t dev, short events, int anyyet, short *reventsp,
 		if (vqp->vdq_cur != vqp->vdq_max)
 			ready |= POLLOUT;
 		mutex_exit(&vqp->vdq_lock);
+
+		if (vrp != NULL) {
+			mutex_enter(&vrp->vr_lock);
+			if (vrp->vr_map->vrm_tx.vrc_prod - vrp->vr_txcons >=
+			    vrp->vr_nslots)
+				ready &= ~POLLOUT;
+			mutex_exit(&vrp->vr_lock);
+		}
 	}
 
+	if (vrp != NULL)
+		vnd_ring_rele(vrp);
+
 	if ((ready == 0 && !anyyet) || (events & POLLET)) {
 		*phpp = &vdp->vdd_ph;
 	}
@@ -5180,6 +5697,38 @@ vnd_chpoll(dev_t dev, short events, int anyyet, short *reventsp,
 	return (0);
 }
 
+/*
+ * Map a device's shared memory rings; see VND_IOC_RING_SETUP.
+ */
+/* ARGSUSED */
+static int
+vnd_devmap(dev_t dev, devmap_cookie_t dhp, offset_t off, size_t len,
+    size_t *maplen, uint_t model)
+{
+	int ret;
+	vnd_dev_t *vdp;
+	vnd_ring_t *vrp;
+
+	vdp = vnd_dev_lookup(getminor(dev));
+	if (vdp == NULL)
+		return (ENXIO);
+
+	mutex_enter(&vdp->vdd_lock);
+	vrp = vdp->vdd_ring;
+	if (vrp == NULL || off < 0 || len == 0 || off + len > vrp->vr_size) {
+		ret = ENXIO;
+	} else {
+		ret = devmap_umem_setup(dhp, vnd_dip, NULL, vrp->vr_cookie,
+		    off, len, PROT_READ | PROT_WRITE | PROT_USER,
+		    DEVMAP_DEFAULTS, NULL);
+		*maplen = len;
+	}
+	mutex_exit(&vdp->vdd_lock);
+
+	vnd_dev_rele(vdp);
+	return (ret);
+}
+
 /* ARGSUSED */
 static void *
 vnd_stack_init(netstackid_t stackid, netstack_t *ns)
@@ -5770,13 +6319,13 @@ static struct cb_ops vnd_cb_ops = {
 	vnd_read,		/* read */
 	vnd_write,		/* write */
 	vnd_ioctl,		/* ioctl */
-	nodev,			/* devmap */
+	vnd_devmap,		/* devmap */
 	nodev,			/* mmap */
-	nodev,			/* segmap */
+	ddi_devmap_segmap,	/* segmap */
 	vnd_chpoll,		/* poll */
 	ddi_prop_op,		/* cb_prop_op */
 	NULL,			/* streamtab  */
-	D_MP			/* Driver compatibility flag */
+	D_MP | D_DEVMAP		/* Driver compatibility flag */
 };
 
 static struct dev_ops vnd_dev_ops = {
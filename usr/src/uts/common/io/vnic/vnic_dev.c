@@ -471,6 +471,17 @@ vnic_dev_create(datalink_id_t vnic_id, datalink_id_t linkid,
 		} else {
 			vnic->vn_cap_lso.lso_flags = 0;
 		}
+
+		/*
+		 * Tunnel offloads are likewise only meaningful on top of
+		 * the checksum offloads.
+		 */
+		if (vnic->vn_hcksum_txflags == 0 ||
+		    !mac_capab_get(vnic->vn_lower_mh, MAC_CAPAB_TUNNEL,
+		    &vnic->vn_cap_tunnel)) {
+			bzero(&vnic->vn_cap_tunnel,
+			    sizeof (vnic->vn_cap_tunnel));
+		}
 	}
 
 	/* register with the MAC module */
@@ -850,6 +861,14 @@ vnic_m_capab_get(void *arg, mac_capab_t cap, void *cap_data)
 		*cap_lso = vnic->vn_cap_lso;
 		break;
 	}
+	case MAC_CAPAB_TUNNEL: {
+		mac_capab_tunnel_t *cap_tunnel = cap_data;
+
+		if (vnic->vn_cap_tunnel.mct_types == 0)
+			return (B_FALSE);
+		*cap_tunnel = vnic->vn_cap_tunnel;
+		break;
+	}
 	case MAC_CAPAB_VNIC: {
 		mac_capab_vnic_t *vnic_capab = cap_data;
 
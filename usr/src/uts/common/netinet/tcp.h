@@ -81,6 +81,7 @@ struct tcphdr {
 #define	TCPOPT_SACK_PERMITTED	4
 #define	TCPOPT_SACK	5
 #define	TCPOPT_TSTAMP	8
+#define	TCPOPT_FASTOPEN	34
 
 /*
  * Default maximum segment size for TCP.
@@ -130,6 +131,34 @@ struct tcphdr {
 #define	TCP_KEEPCNT			0x23
 #define	TCP_KEEPINTVL			0x24
 #define	TCP_CONGESTION			0x25
+#define	TCP_FASTOPEN			0x26
+#define	TCP_TLS_TX			0x27
+#define	TCP_TLS_RECTYPE			0x28	/* sendmsg cmsg type */
+
+/*
+ * TCP_TLS_TX takes the transmit keys of an established TLS session. From
+ * then on the kernel frames everything written to the socket as TLS
+ * records of type application_data, or of the type given in a
+ * TCP_TLS_RECTYPE control message (a single byte) passed to sendmsg().
+ * The nonce is tti_salt followed by tti_iv. For TLS 1.2, tti_iv is the
+ * explicit nonce of the first record and is incremented for each record.
+ * For TLS 1.3 the record sequence number is XOR'ed into it. tti_rec_seq
+ * is the big-endian sequence number of the first record.
+ */
+#define	TCP_TLS_VERSION_1_2		0x0303
+#define	TCP_TLS_VERSION_1_3		0x0304
+
+#define	TCP_TLS_CIPHER_AES_GCM_128	1
+#define	TCP_TLS_CIPHER_AES_GCM_256	2
+
+struct tcp_tls_crypto_info {
+	uint16_t	tti_version;	/* TCP_TLS_VERSION_* */
+	uint16_t	tti_cipher;	/* TCP_TLS_CIPHER_* */
+	uint8_t		tti_key[32];	/* AES-128 uses the first 16 bytes */
+	uint8_t		tti_salt[4];
+	uint8_t		tti_iv[8];
+	uint8_t		tti_rec_seq[8];
+};
 
 #ifdef	__cplusplus
 }
@@ -36,6 +36,7 @@ struct udphdr {
 #define	UDP_NAT_T_ENDPOINT	0x0103		/* for internal use only */
 #define	UDP_SRCPORT_HASH	0x0104		/* for internal use only */
 #define	UDP_SND_TO_CONNECTED	0x0105		/* for internal use only */
+#define	UDP_SEGMENT		0x0106		/* segment size for sends */
 
 /*
  * Hash definitions for UDP_SRCPORT_HASH that effectively tell UDP how to go
@@ -26,6 +26,7 @@
 
 /*
  * Copyright 2018 Nexenta Systems, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef _NFS4_DRC_H
@@ -37,14 +38,24 @@ extern "C" {
 
 /*
  * NFSv4 Duplicate Request cache.
+ *
+ * The cache is split by XID into dr_nshards independent shards, each with
+ * its own lock, LRU list and hash buckets, so that non-idempotent requests
+ * on different XIDs do not serialize on a single lock.
  */
-typedef struct rfs4_drc {
+typedef struct rfs4_drc_shard {
 	kmutex_t	lock;
-	uint32_t	dr_hash;
 	uint32_t	max_size;
 	uint32_t	in_use;
 	list_t		dr_cache;
 	list_t		*dr_buckets;
+	uint64_t	dr_pad[2];	/* pad to a cache line */
+} rfs4_drc_shard_t;
+
+typedef struct rfs4_drc {
+	uint32_t	dr_hash;	/* buckets per shard */
+	uint32_t	dr_nshards;
+	rfs4_drc_shard_t *dr_shards;
 } rfs4_drc_t;
 
 /*
@@ -54,7 +65,7 @@ typedef struct rfs4_dupreq {
 	list_node_t	dr_bkt_next;
 	list_node_t	dr_next;
 	list_t		*dr_bkt;
-	rfs4_drc_t	*drc;
+	rfs4_drc_shard_t *drc;
 	int		dr_state;
 	uint32_t	dr_xid;
 	struct netbuf	dr_addr;
@@ -75,11 +86,12 @@ typedef struct rfs4_dupreq {
 
 extern uint32_t nfs4_drc_max;
 extern uint32_t nfs4_drc_hash;
+extern uint32_t nfs4_drc_shards;
 
 rfs4_drc_t *rfs4_init_drc(uint32_t, uint32_t);
 void rfs4_fini_drc(void);
 void rfs4_dr_chstate(rfs4_dupreq_t *, int);
-rfs4_dupreq_t *rfs4_alloc_dr(rfs4_drc_t *);
+rfs4_dupreq_t *rfs4_alloc_dr(rfs4_drc_shard_t *);
 int rfs4_find_dr(struct svc_req *, rfs4_drc_t *, rfs4_dupreq_t **);
 
 #ifdef	__cplusplus
@@ -35,6 +35,7 @@
 #include <sys/debug.h>
 #include <sys/vtrace.h>
 #include <sys/sysmacros.h>
+#include <sys/bitmap.h>
 #include <sys/sdt.h>
 
 int callout_init_done;				/* useful during boot */
@@ -47,6 +48,8 @@ static hrtime_t callout_debug_hrtime;		/* debugger entry time */
 static int callout_chunk;			/* callout heap chunk size */
 static int callout_min_reap;			/* callout minimum reap count */
 static int callout_tolerance;			/* callout hires tolerance */
+static int callout_slack_pct = CALLOUT_SLACK_PCT; /* coalescing slack */
+static hrtime_t callout_slack_max;		/* max coalescing slack */
 static callout_table_t *callout_boot_ct;	/* Boot CPU's callout tables */
 static clock_t callout_max_ticks;		/* max interval */
 static hrtime_t callout_longterm;		/* longterm nanoseconds */
@@ -75,6 +78,7 @@ static char *callout_kstat_names[] = {
 	"callout_expirations",
 	"callout_allocations",
 	"callout_cleanups",
+	"callout_coalesced",
 };
 
 static hrtime_t	callout_heap_process(callout_table_t *, hrtime_t, int);
@@ -985,8 +989,9 @@ timeout_generic(int type, void (*func)(void *), void *arg,
 	callout_t *cp;
 	callout_id_t id;
 	callout_list_t *cl;
-	hrtime_t now, interval;
+	hrtime_t now, interval, slack;
 	int hash, clflags;
+	boolean_t deferred = B_FALSE;
 
 	ASSERT(resolution > 0);
 	ASSERT(func != NULL);
@@ -1060,6 +1065,28 @@ timeout_generic(int type, void (*func)(void *), void *arg,
 		expiration = (expiration / resolution) * resolution;
 	}
 
+	/*
+	 * Relative callouts that are not high resolution can tolerate firing
+	 * a little late. Defer the expiration to a boundary within
+	 * callout_slack_pct percent of the interval. The boundary is a power
+	 * of two multiple of nanoseconds, so callouts with different
+	 * intervals land on common expirations and share a callout list and
+	 * a single cyclic fire instead of waking the CPU separately. The
+	 * result is realigned to the resolution afterwards.
+	 */
+	if (callout_slack_pct > 0 && resolution > 1 &&
+	    !(flags & (CALLOUT_FLAG_ABSOLUTE | CALLOUT_FLAG_HRESTIME))) {
+		slack = MIN((interval / 100) * callout_slack_pct,
+		    callout_slack_max);
+		if (slack > resolution) {
+			slack = 1LL << (highbit64(slack) - 1);
+			expiration = P2ROUNDUP(expiration, slack);
+			expiration = ((expiration + resolution - 1) /
+			    resolution) * resolution;
+			deferred = B_TRUE;
+		}
+	}
+
 	if (expiration <= 0) {
 		/*
 		 * expiration hrtime overflow has occurred. Just set the
@@ -1172,6 +1199,8 @@ again:
 		 */
 		if (cl->cl_callouts.ch_head == NULL)
 			ct->ct_nreap--;
+		if (deferred)
+			ct->ct_coalesced++;
 	}
 out:
 	cp->c_list = cl;
@@ -2109,6 +2138,8 @@ callout_init(void)
 
 	if (callout_tolerance <= 0)
 		callout_tolerance = CALLOUT_TOLERANCE;
+	if (callout_slack_max <= 0)
+		callout_slack_max = CALLOUT_SLACK_MAX;
 	if (callout_threads <= 0)
 		callout_threads = CALLOUT_THREADS;
 	if (callout_chunk <= 0)
@@ -131,6 +131,17 @@
  * clock_tick_scan
  *	Where to begin the scan for single-threaded mode. In multi-threaded,
  *	the clock_tick_set itself contains a field for this.
+ *
+ * clock_tick_idle_skip
+ *	If set, a set whose CPUs are all idle is not scheduled at all, and a
+ *	set that has busy CPUs is scheduled on one of them rather than
+ *	waking an idle CPU to do the accounting. Idle CPUs are not charged
+ *	ticks anyway, so on a lightly loaded system this stops the periodic
+ *	cross-calls to them.
+ *
+ * clock_tick_idle_skipped
+ *	Number of times a set was not scheduled because all its CPUs were
+ *	idle.
  */
 int			clock_tick_threshold;
 int			clock_tick_ncpus;
@@ -148,12 +159,17 @@ clock_tick_set_t	*clock_tick_set;
 int			clock_tick_nsets;
 int			clock_tick_scan;
 ulong_t			clock_tick_intr;
+int			clock_tick_idle_skip = 1;
+ulong_t			clock_tick_idle_skipped;
 
 static uint_t	clock_tick_execute(caddr_t, caddr_t);
 static void	clock_tick_execute_common(int, int, int, clock_t, int);
 
 #define	CLOCK_TICK_ALIGN	64	/* cache alignment */
 
+#define	CLOCK_TICK_CPU_IDLE(cp)	\
+	((cp)->cpu_dispthread == (cp)->cpu_idle_thread)
+
 /*
  * Clock tick initialization is done in two phases:
  *
@@ -421,13 +437,36 @@ clock_tick_process(cpu_t *cp, clock_t mylbolt, int pending)
 	mutex_exit(plockp);
 }
 
+/*
+ * Return a busy CPU in the set that can take the tick accounting cross-call,
+ * or NULL if there is nothing in the set to account for. The clock CPU is
+ * accounted for by clock_tick_schedule() itself. Races with CPUs going busy
+ * or idle are benign; at worst a single tick is not charged.
+ */
+static cpu_t *
+clock_tick_set_busy(clock_tick_set_t *csp)
+{
+	cpu_t	*cp;
+	int	i;
+
+	for (i = csp->ct_start; i < csp->ct_end; i++) {
+		cp = clock_tick_cpus[i];
+		if ((cp == NULL) || (cp == CPU) || (cp->cpu_id == clock_cpu_id))
+			continue;
+		if (!CLOCK_TICK_CPU_IDLE(cp) && CLOCK_TICK_XCALL_SAFE(cp))
+			return (cp);
+	}
+
+	return (NULL);
+}
+
 void
 clock_tick_schedule(int one_sec)
 {
 	ulong_t			active;
 	int			i, end;
 	clock_tick_set_t	*csp;
-	cpu_t			*cp;
+	cpu_t			*cp, *tcp;
 
 	if (clock_cpu_id != CPU->cpu_id)
 		clock_cpu_id = CPU->cpu_id;
@@ -504,7 +543,23 @@ clock_tick_schedule(int one_sec)
 		if (csp->ct_scan >= csp->ct_end)
 			csp->ct_scan = csp->ct_start;
 
-		clock_tick_schedule_one(csp, clock_tick_pending, cp->cpu_id);
+		tcp = cp;
+		if (clock_tick_idle_skip) {
+			/*
+			 * Leave idle CPUs alone. Skip the set if there is
+			 * nothing to account, otherwise prefer a busy CPU
+			 * of the set over an idle one.
+			 */
+			if ((tcp = clock_tick_set_busy(csp)) == NULL) {
+				clock_tick_idle_skipped++;
+				cp = cp->cpu_next_onln;
+				continue;
+			}
+			if (!CLOCK_TICK_CPU_IDLE(cp))
+				tcp = cp;
+		}
+
+		clock_tick_schedule_one(csp, clock_tick_pending, tcp->cpu_id);
 
 		cp = cp->cpu_next_onln;
 	}
@@ -21,7 +21,7 @@
 
 /*
  * Copyright (c) 1998, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright 2018 Nexenta Systems, Inc. All rights reserved.
  */
 
@@ -790,6 +790,27 @@ dump_pfn_to_bitnum(pfn_t pfn)
 	return ((pgcnt_t)-1);
 }
 
+/*
+ * Return the first bit set in the dump bitmap in [bitnum, end), or end if
+ * there is none. A kernel-only dump of a large-memory system leaves most of
+ * the bitmap clear, so skip over zero words rather than testing every bit.
+ */
+static pgcnt_t
+dump_bitmap_next(pgcnt_t bitnum, pgcnt_t end)
+{
+	while (bitnum < end) {
+		if ((bitnum & BT_ULMASK) == 0 &&
+		    dumpcfg.bitmap[bitnum >> BT_ULSHIFT] == 0) {
+			bitnum += BT_NBIPUL;
+			continue;
+		}
+		if (BT_TEST(dumpcfg.bitmap, bitnum))
+			return (bitnum);
+		bitnum++;
+	}
+	return (end);
+}
+
 /*
  * Set/test bitmap for a CBUF_MAPSIZE range which includes pfn. The
  * mapping of pfn to range index is imperfect because pfn and bitnum
@@ -2491,9 +2512,7 @@ dumpsys_main_task(void *arg)
 			}
 
 			HRSTART(ds->perpage, bitmap);
-			for (; bitnum < dumpcfg.bitmapsize; bitnum++)
-				if (BT_TEST(dumpcfg.bitmap, bitnum))
-					break;
+			bitnum = dump_bitmap_next(bitnum, dumpcfg.bitmapsize);
 			HRSTOP(ds->perpage, bitmap);
 			dump_timeleft = dump_timeout;
 
@@ -2536,9 +2555,11 @@ dumpsys_main_task(void *arg)
 			cp->pagenum = pagenum++;
 			cp->off = ptob(pfnoff);
 
-			for (; bitnum < hibitnum; bitnum++)
-				if (BT_TEST(dumpcfg.bitmap, bitnum))
-					pagenum++;
+			while ((bitnum = dump_bitmap_next(bitnum, hibitnum)) <
+			    hibitnum) {
+				pagenum++;
+				bitnum++;
+			}
 
 			dump_timeleft = dump_timeout;
 			cp->used = ptob(pagenum - cp->pagenum);
@@ -2944,10 +2965,10 @@ dumpsys(void)
 	 */
 	dumphdr->dump_pfn = dumpvp_flush();
 	dump_init_memlist_walker(&mlw);
-	for (bitnum = 0; bitnum < dumpcfg.bitmapsize; bitnum++) {
+	for (bitnum = dump_bitmap_next(0, dumpcfg.bitmapsize);
+	    bitnum < dumpcfg.bitmapsize;
+	    bitnum = dump_bitmap_next(bitnum + 1, dumpcfg.bitmapsize)) {
 		dump_timeleft = dump_timeout;
-		if (!BT_TEST(dumpcfg.bitmap, bitnum))
-			continue;
 		pfn = dump_bitnum_to_pfn(bitnum, &mlw);
 		ASSERT(pfn != PFN_INVALID);
 		dumpvp_write(&pfn, sizeof (pfn_t));
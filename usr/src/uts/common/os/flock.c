@@ -1118,7 +1118,7 @@ flk_process_request(lock_descriptor_t *request)
 			    (request->l_type == F_RDLCK))
 				return (flk_execute_request(request));
 			lock = lock->l_next;
-		} while (lock->l_vnode == vp);
+		} while (lock->l_vnode == vp && !PAST_REQUEST(lock, request));
 	}
 
 	if (!request_blocked_by_active) {
@@ -1265,7 +1265,7 @@ block:
 					return (error);
 			}
 			lock = lock->l_next;
-		} while (lock->l_vnode == vp);
+		} while (lock->l_vnode == vp && !PAST_REQUEST(lock, request));
 	}
 
 	if (NOT_BLOCKED(request)) {
@@ -1334,7 +1334,8 @@ flk_execute_request(lock_descriptor_t *request)
 			done_searching = flk_relation(lock, request);
 		}
 		lock = lock1;
-	} while (lock->l_vnode == vp && !done_searching);
+	} while (lock->l_vnode == vp && !done_searching &&
+	    !PAST_REQUEST(lock, request));
 
 	/*
 	 * insert in active queue
@@ -2400,7 +2401,7 @@ flk_get_first_blocking_lock(lock_descriptor_t *request)
 				break;
 			}
 			lock = lock->l_next;
-		} while (lock->l_vnode == vp);
+		} while (lock->l_vnode == vp && !PAST_REQUEST(lock, request));
 	}
 
 	if (blocker == NULL && request->l_flock.l_type == F_RDLCK) {
@@ -21,6 +21,7 @@
 
 /*
  * Copyright (c) 2004, 2010, Oracle and/or its affiliates. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/param.h>
@@ -421,11 +422,10 @@ kcpc_free_configs(kcpc_set_t *set)
 }
 
 /*
- * buf points to a user address and the data should be copied out to that
- * address in the current process.
+ * Bring the set's data store up to date with the hardware.
  */
-int
-kcpc_sample(kcpc_set_t *set, uint64_t *buf, hrtime_t *hrtime, uint64_t *tick)
+static int
+kcpc_sample_common(kcpc_set_t *set)
 {
 	kcpc_ctx_t	*ctx = set->ks_ctx;
 	int		save_spl;
@@ -484,6 +484,22 @@ kcpc_sample(kcpc_set_t *set, uint64_t *buf, hrtime_t *hrtime, uint64_t *tick)
 	splx(save_spl);
 	kpreempt_enable();
 
+	return (0);
+}
+
+/*
+ * buf points to a user address and the data should be copied out to that
+ * address in the current process.
+ */
+int
+kcpc_sample(kcpc_set_t *set, uint64_t *buf, hrtime_t *hrtime, uint64_t *tick)
+{
+	kcpc_ctx_t	*ctx = set->ks_ctx;
+	int		error;
+
+	if ((error = kcpc_sample_common(set)) != 0)
+		return (error);
+
 	if (copyout(set->ks_data, buf,
 	    set->ks_nreqs * sizeof (uint64_t)) == -1)
 		return (EFAULT);
@@ -495,6 +511,22 @@ kcpc_sample(kcpc_set_t *set, uint64_t *buf, hrtime_t *hrtime, uint64_t *tick)
 	return (0);
 }
 
+/*
+ * As kcpc_sample(), but buf is a kernel address and only the counter values
+ * are returned.
+ */
+int
+kcpc_sample_kernel(kcpc_set_t *set, uint64_t *buf)
+{
+	int error;
+
+	if ((error = kcpc_sample_common(set)) != 0)
+		return (error);
+
+	bcopy(set->ks_data, buf, set->ks_nreqs * sizeof (uint64_t));
+	return (0);
+}
+
 /*
  * Stop the counters on the CPU this context is bound to.
  */
@@ -841,6 +841,7 @@
 #include <sys/id32.h>
 #include <sys/zone.h>
 #include <sys/netstack.h>
+#include <sys/lgrp.h>
 #ifdef	DEBUG
 #include <sys/random.h>
 #endif
@@ -861,6 +862,7 @@ struct kmem_cache_kstat {
 	kstat_named_t	kmc_depot_alloc;
 	kstat_named_t	kmc_depot_free;
 	kstat_named_t	kmc_depot_contention;
+	kstat_named_t	kmc_depot_remote;
 	kstat_named_t	kmc_slab_alloc;
 	kstat_named_t	kmc_slab_free;
 	kstat_named_t	kmc_buf_constructed;
@@ -877,6 +879,8 @@ struct kmem_cache_kstat {
 	kstat_named_t	kmc_full_magazines;
 	kstat_named_t	kmc_empty_magazines;
 	kstat_named_t	kmc_magazine_size;
+	kstat_named_t	kmc_magazine_grow;
+	kstat_named_t	kmc_magazine_shrink;
 	kstat_named_t	kmc_reap; /* number of kmem_cache_reap() calls */
 	kstat_named_t	kmc_defrag; /* attempts to defrag all partial slabs */
 	kstat_named_t	kmc_scan; /* attempts to defrag one partial slab */
@@ -900,6 +904,7 @@ struct kmem_cache_kstat {
 	{ "depot_alloc",	KSTAT_DATA_UINT64 },
 	{ "depot_free",		KSTAT_DATA_UINT64 },
 	{ "depot_contention",	KSTAT_DATA_UINT64 },
+	{ "depot_remote",	KSTAT_DATA_UINT64 },
 	{ "slab_alloc",		KSTAT_DATA_UINT64 },
 	{ "slab_free",		KSTAT_DATA_UINT64 },
 	{ "buf_constructed",	KSTAT_DATA_UINT64 },
@@ -916,6 +921,8 @@ struct kmem_cache_kstat {
 	{ "full_magazines",	KSTAT_DATA_UINT64 },
 	{ "empty_magazines",	KSTAT_DATA_UINT64 },
 	{ "magazine_size",	KSTAT_DATA_UINT64 },
+	{ "magazine_grow",	KSTAT_DATA_UINT64 },
+	{ "magazine_shrink",	KSTAT_DATA_UINT64 },
 	{ "reap",		KSTAT_DATA_UINT64 },
 	{ "defrag",		KSTAT_DATA_UINT64 },
 	{ "scan",		KSTAT_DATA_UINT64 },
@@ -1004,6 +1011,10 @@ static uint32_t kmem_reaping_idspace;
  */
 clock_t kmem_reap_interval;	/* cache reaping rate [15 * HZ ticks] */
 int kmem_depot_contention = 3;	/* max failed tryenters per real interval */
+int kmem_magazine_autosize = 1;	/* adapt magazine size to depot traffic */
+int kmem_depot_xfer_hiwat = 1000; /* per-CPU exchanges/interval to grow */
+int kmem_depot_xfer_lowat = 8;	/* per-CPU exchanges/interval to shrink */
+int kmem_lgrp_depot_enable = 1;	/* per-lgroup full magazine depots */
 pgcnt_t kmem_reapahead = 0;	/* start reaping N pages before pageout */
 int kmem_panic = 1;		/* whether to panic on error */
 int kmem_logging = 1;		/* kmem_log_enter() override */
@@ -1040,6 +1051,7 @@ int kmem_flags = KMF_AUDIT | KMF_DEADBEEF | KMF_REDZONE | KMF_CONTENTS;
 int kmem_flags = 0;
 #endif
 int kmem_ready;
+static int kmem_lgrp_depot_ready; /* lgroup topology known, see mp_init */
 
 static kmem_cache_t	*kmem_slab_cache;
 static kmem_cache_t	*kmem_bufctl_cache;
@@ -2074,10 +2086,10 @@ kmem_magazine_destroy(kmem_cache_t *cp, kmem_magazine_t *mp, int nrounds)
 }
 
 /*
- * Allocate a magazine from the depot.
+ * Allocate a magazine from a magazine list protected by lp.
  */
 static kmem_magazine_t *
-kmem_depot_alloc(kmem_cache_t *cp, kmem_maglist_t *mlp)
+kmem_maglist_alloc(kmem_cache_t *cp, kmutex_t *lp, kmem_maglist_t *mlp)
 {
 	kmem_magazine_t *mp;
 
@@ -2087,9 +2099,9 @@ kmem_depot_alloc(kmem_cache_t *cp, kmem_maglist_t *mlp)
 	 * contention rate to determine whether we need to
 	 * increase the magazine size for better scalability.
 	 */
-	if (!mutex_tryenter(&cp->cache_depot_lock)) {
-		mutex_enter(&cp->cache_depot_lock);
-		cp->cache_depot_contention++;
+	if (!mutex_tryenter(lp)) {
+		mutex_enter(lp);
+		atomic_inc_64(&cp->cache_depot_contention);
 	}
 
 	if ((mp = mlp->ml_list) != NULL) {
@@ -2100,23 +2112,152 @@ kmem_depot_alloc(kmem_cache_t *cp, kmem_maglist_t *mlp)
 		mlp->ml_alloc++;
 	}
 
-	mutex_exit(&cp->cache_depot_lock);
+	mutex_exit(lp);
 
 	return (mp);
 }
 
 /*
- * Free a magazine to the depot.
+ * Free a magazine to a magazine list protected by lp.
  */
 static void
-kmem_depot_free(kmem_cache_t *cp, kmem_maglist_t *mlp, kmem_magazine_t *mp)
+kmem_maglist_free(kmem_cache_t *cp, kmutex_t *lp, kmem_maglist_t *mlp,
+    kmem_magazine_t *mp)
 {
-	mutex_enter(&cp->cache_depot_lock);
+	mutex_enter(lp);
 	ASSERT(KMEM_MAGAZINE_VALID(cp, mp));
 	mp->mag_next = mlp->ml_list;
 	mlp->ml_list = mp;
 	mlp->ml_total++;
-	mutex_exit(&cp->cache_depot_lock);
+	mutex_exit(lp);
+}
+
+/*
+ * Allocate a magazine from the depot.
+ */
+static kmem_magazine_t *
+kmem_depot_alloc(kmem_cache_t *cp, kmem_maglist_t *mlp)
+{
+	return (kmem_maglist_alloc(cp, &cp->cache_depot_lock, mlp));
+}
+
+/*
+ * Free a magazine to the depot.
+ */
+static void
+kmem_depot_free(kmem_cache_t *cp, kmem_maglist_t *mlp, kmem_magazine_t *mp)
+{
+	kmem_maglist_free(cp, &cp->cache_depot_lock, mlp, mp);
+}
+
+/*
+ * Return the number of per-lgroup depots cp has.  The depots are attached to
+ * caches that already exist when kmem_mp_init() runs, so pair the load of
+ * the count with the barrier in kmem_lgrp_depot_init().
+ */
+static uint_t
+kmem_lgrp_ndepot(kmem_cache_t *cp)
+{
+	uint_t ndepot = cp->cache_lgrp_ndepot;
+
+	membar_consumer();
+	return (ndepot);
+}
+
+/*
+ * Return the depot of the current CPU's lgroup, or NULL if cp doesn't have
+ * per-lgroup depots.
+ */
+static kmem_lgrp_depot_t *
+kmem_lgrp_depot(kmem_cache_t *cp)
+{
+	uint_t ndepot = kmem_lgrp_ndepot(cp);
+	lgrp_id_t lgrpid;
+
+	if (ndepot == 0)
+		return (NULL);
+
+	lgrpid = CPU->cpu_lpl->lpl_lgrpid;
+	if (lgrpid < 0 || lgrpid >= ndepot)
+		return (NULL);
+
+	return (&cp->cache_lgrp_depot[lgrpid]);
+}
+
+/*
+ * Allocate a full magazine, preferring the depot of the current lgroup.  If
+ * neither that nor the cache-wide depot has one, take a magazine freed in
+ * another lgroup rather than going to the slab layer; kld_remote counts the
+ * buffers that cross lgroups this way.
+ */
+static kmem_magazine_t *
+kmem_depot_alloc_full(kmem_cache_t *cp)
+{
+	kmem_lgrp_depot_t *kld, *rkld;
+	kmem_magazine_t *mp;
+	uint_t i, ndepot;
+
+	if ((kld = kmem_lgrp_depot(cp)) != NULL &&
+	    (mp = kmem_maglist_alloc(cp, &kld->kld_lock,
+	    &kld->kld_full)) != NULL)
+		return (mp);
+
+	if ((mp = kmem_depot_alloc(cp, &cp->cache_full)) != NULL ||
+	    kld == NULL)
+		return (mp);
+
+	ndepot = kmem_lgrp_ndepot(cp);
+	for (i = 0; i < ndepot; i++) {
+		rkld = &cp->cache_lgrp_depot[i];
+		if (rkld == kld || rkld->kld_full.ml_total == 0)
+			continue;
+		mp = kmem_maglist_alloc(cp, &rkld->kld_lock, &rkld->kld_full);
+		if (mp != NULL) {
+			atomic_add_64(&rkld->kld_remote,
+			    cp->cache_magtype->mt_magsize);
+			return (mp);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ * Free a full magazine to the depot of the current lgroup.
+ */
+static void
+kmem_depot_free_full(kmem_cache_t *cp, kmem_magazine_t *mp)
+{
+	kmem_lgrp_depot_t *kld;
+
+	if ((kld = kmem_lgrp_depot(cp)) != NULL)
+		kmem_maglist_free(cp, &kld->kld_lock, &kld->kld_full, mp);
+	else
+		kmem_depot_free(cp, &cp->cache_full, mp);
+}
+
+/*
+ * Attach per-lgroup depots to cp.  This is done for caches that exist when
+ * kmem_mp_init() runs, by which point the lgroup topology is known, and for
+ * every cache created after that.
+ */
+static void
+kmem_lgrp_depot_init(kmem_cache_t *cp)
+{
+	kmem_lgrp_depot_t *kld;
+	uint_t i, ndepot = nlgrpsmax;
+
+	if (!kmem_lgrp_depot_enable || nlgrps <= 1 || ndepot <= 1 ||
+	    (cp->cache_flags & KMF_NOMAGAZINE) || cp->cache_lgrp_ndepot != 0)
+		return;
+
+	kld = kmem_zalloc(ndepot * sizeof (kmem_lgrp_depot_t), KM_SLEEP);
+	for (i = 0; i < ndepot; i++)
+		mutex_init(&kld[i].kld_lock, NULL, MUTEX_DEFAULT, NULL);
+
+	cp->cache_lgrp_depot = kld;
+	membar_producer();
+	cp->cache_lgrp_ndepot = ndepot;
 }
 
 /*
@@ -2125,12 +2266,23 @@ kmem_depot_free(kmem_cache_t *cp, kmem_maglist_t *mlp, kmem_magazine_t *mp)
 static void
 kmem_depot_ws_update(kmem_cache_t *cp)
 {
+	kmem_lgrp_depot_t *kld;
+	uint_t i, ndepot = kmem_lgrp_ndepot(cp);
+
 	mutex_enter(&cp->cache_depot_lock);
 	cp->cache_full.ml_reaplimit = cp->cache_full.ml_min;
 	cp->cache_full.ml_min = cp->cache_full.ml_total;
 	cp->cache_empty.ml_reaplimit = cp->cache_empty.ml_min;
 	cp->cache_empty.ml_min = cp->cache_empty.ml_total;
 	mutex_exit(&cp->cache_depot_lock);
+
+	for (i = 0; i < ndepot; i++) {
+		kld = &cp->cache_lgrp_depot[i];
+		mutex_enter(&kld->kld_lock);
+		kld->kld_full.ml_reaplimit = kld->kld_full.ml_min;
+		kld->kld_full.ml_min = kld->kld_full.ml_total;
+		mutex_exit(&kld->kld_lock);
+	}
 }
 
 /*
@@ -2140,12 +2292,23 @@ kmem_depot_ws_update(kmem_cache_t *cp)
 static void
 kmem_depot_ws_zero(kmem_cache_t *cp)
 {
+	kmem_lgrp_depot_t *kld;
+	uint_t i, ndepot = kmem_lgrp_ndepot(cp);
+
 	mutex_enter(&cp->cache_depot_lock);
 	cp->cache_full.ml_reaplimit = cp->cache_full.ml_total;
 	cp->cache_full.ml_min = cp->cache_full.ml_total;
 	cp->cache_empty.ml_reaplimit = cp->cache_empty.ml_total;
 	cp->cache_empty.ml_min = cp->cache_empty.ml_total;
 	mutex_exit(&cp->cache_depot_lock);
+
+	for (i = 0; i < ndepot; i++) {
+		kld = &cp->cache_lgrp_depot[i];
+		mutex_enter(&kld->kld_lock);
+		kld->kld_full.ml_reaplimit = kld->kld_full.ml_total;
+		kld->kld_full.ml_min = kld->kld_full.ml_total;
+		mutex_exit(&kld->kld_lock);
+	}
 }
 
 /*
@@ -2164,10 +2327,28 @@ kmem_depot_ws_reap(kmem_cache_t *cp)
 	size_t bytes = 0;
 	long reap;
 	kmem_magazine_t *mp;
+	kmem_lgrp_depot_t *kld;
+	uint_t i, ndepot = kmem_lgrp_ndepot(cp);
 
 	ASSERT(!list_link_active(&cp->cache_link) ||
 	    taskq_member(kmem_taskq, curthread));
 
+	for (i = 0; i < ndepot; i++) {
+		kld = &cp->cache_lgrp_depot[i];
+		reap = MIN(kld->kld_full.ml_reaplimit, kld->kld_full.ml_min);
+		while (reap-- && (mp = kmem_maglist_alloc(cp, &kld->kld_lock,
+		    &kld->kld_full)) != NULL) {
+			kmem_magazine_destroy(cp, mp,
+			    cp->cache_magtype->mt_magsize);
+			bytes += cp->cache_magtype->mt_magsize *
+			    cp->cache_bufsize;
+			if (bytes > kmem_reap_preempt_bytes) {
+				kpreempt(KPREEMPT_SYNC);
+				bytes = 0;
+			}
+		}
+	}
+
 	reap = MIN(cp->cache_full.ml_reaplimit, cp->cache_full.ml_min);
 	while (reap-- &&
 	    (mp = kmem_depot_alloc(cp, &cp->cache_full)) != NULL) {
@@ -2496,7 +2677,7 @@ kmem_cache_alloc(kmem_cache_t *cp, int kmflag)
 		/*
 		 * Try to get a full magazine from the depot.
 		 */
-		fmp = kmem_depot_alloc(cp, &cp->cache_full);
+		fmp = kmem_depot_alloc_full(cp);
 		if (fmp != NULL) {
 			if (ccp->cc_ploaded != NULL)
 				kmem_depot_free(cp, &cp->cache_empty,
@@ -2606,8 +2787,7 @@ kmem_cpucache_magazine_alloc(kmem_cpu_cache_t *ccp, kmem_cache_t *cp)
 	emp = kmem_depot_alloc(cp, &cp->cache_empty);
 	if (emp != NULL) {
 		if (ccp->cc_ploaded != NULL)
-			kmem_depot_free(cp, &cp->cache_full,
-			    ccp->cc_ploaded);
+			kmem_depot_free_full(cp, ccp->cc_ploaded);
 		kmem_cpu_reload(ccp, emp, 0);
 		return (1);
 	}
@@ -3056,6 +3236,8 @@ kmem_cache_reap(kmem_cache_t *cp)
 	 * callback is just an advisory plea for help.
 	 */
 	if (cp->cache_reclaim != NULL) {
+		kmem_lgrp_depot_t *kld;
+		uint_t i, ndepot = kmem_lgrp_ndepot(cp);
 		long delta;
 
 		/*
@@ -3063,6 +3245,10 @@ kmem_cache_reap(kmem_cache_t *cp)
 		 * depot's working set).
 		 */
 		delta = cp->cache_full.ml_total;
+		for (i = 0; i < ndepot; i++) {
+			kld = &cp->cache_lgrp_depot[i];
+			kld->kld_reclaim = kld->kld_full.ml_total;
+		}
 		cp->cache_reclaim(cp->cache_private);
 		delta = cp->cache_full.ml_total - delta;
 		if (delta > 0) {
@@ -3071,6 +3257,16 @@ kmem_cache_reap(kmem_cache_t *cp)
 			cp->cache_full.ml_min += delta;
 			mutex_exit(&cp->cache_depot_lock);
 		}
+		for (i = 0; i < ndepot; i++) {
+			kld = &cp->cache_lgrp_depot[i];
+			delta = kld->kld_full.ml_total - kld->kld_reclaim;
+			if (delta > 0) {
+				mutex_enter(&kld->kld_lock);
+				kld->kld_full.ml_reaplimit += delta;
+				kld->kld_full.ml_min += delta;
+				mutex_exit(&kld->kld_lock);
+			}
+		}
 	}
 
 	kmem_depot_ws_reap(cp);
@@ -3261,6 +3457,58 @@ kmem_cache_reap_soon(kmem_cache_t *cp)
 	    (task_func_t *)kmem_depot_ws_reap, cp, TQ_SLEEP);
 }
 
+/*
+ * Return the initial (smallest) magazine type for a given chunk size.
+ */
+static kmem_magtype_t *
+kmem_magtype_base(size_t chunksize)
+{
+	kmem_magtype_t *mtp;
+
+	for (mtp = kmem_magtype; chunksize <= mtp->mt_minbuf; mtp++)
+		continue;
+
+	return (mtp);
+}
+
+/*
+ * Return the total number of magazine exchanges cp's depot has performed,
+ * including the per-lgroup full lists.
+ */
+static uint64_t
+kmem_depot_xfers(kmem_cache_t *cp)
+{
+	uint64_t xfers;
+	uint_t i, ndepot = kmem_lgrp_ndepot(cp);
+
+	ASSERT(MUTEX_HELD(&cp->cache_depot_lock));
+
+	xfers = cp->cache_full.ml_alloc + cp->cache_empty.ml_alloc;
+	for (i = 0; i < ndepot; i++)
+		xfers += cp->cache_lgrp_depot[i].kld_full.ml_alloc;
+
+	return (xfers);
+}
+
+/*
+ * Switch cp to magazine type mtp.  All magazines of the old type are
+ * purged first.
+ */
+static void
+kmem_cache_magazine_set(kmem_cache_t *cp, kmem_magtype_t *mtp)
+{
+	ASSERT(taskq_member(kmem_taskq, curthread));
+
+	kmem_cache_magazine_purge(cp);
+	mutex_enter(&cp->cache_depot_lock);
+	cp->cache_magtype = mtp;
+	cp->cache_depot_contention_prev =
+	    cp->cache_depot_contention + INT_MAX;
+	cp->cache_depot_xfer_prev = kmem_depot_xfers(cp);
+	mutex_exit(&cp->cache_depot_lock);
+	kmem_cache_magazine_enable(cp);
+}
+
 /*
  * Recompute a cache's magazine size.  The trade-off is that larger magazines
  * provide a higher transfer rate with the depot, while smaller magazines
@@ -3268,9 +3516,6 @@ kmem_cache_reap_soon(kmem_cache_t *cp)
  * it should not be done frequently.
  *
  * Changes to the magazine size are serialized by the kmem_taskq lock.
- *
- * Note: at present this only grows the magazine size.  It might be useful
- * to allow shrinkage too.
  */
 static void
 kmem_cache_magazine_resize(kmem_cache_t *cp)
@@ -3280,13 +3525,27 @@ kmem_cache_magazine_resize(kmem_cache_t *cp)
 	ASSERT(taskq_member(kmem_taskq, curthread));
 
 	if (cp->cache_chunksize < mtp->mt_maxbuf) {
-		kmem_cache_magazine_purge(cp);
-		mutex_enter(&cp->cache_depot_lock);
-		cp->cache_magtype = ++mtp;
-		cp->cache_depot_contention_prev =
-		    cp->cache_depot_contention + INT_MAX;
-		mutex_exit(&cp->cache_depot_lock);
-		kmem_cache_magazine_enable(cp);
+		kmem_cache_magazine_set(cp, mtp + 1);
+		atomic_inc_64(&cp->cache_magazine_grow);
+	}
+}
+
+/*
+ * Step a cache's magazine size back down towards its initial size.  This
+ * is done when the cache's depot has been idle during an interval in which
+ * the system was reaping, so that the memory cached in oversized magazines
+ * goes back to the slab layer and stays there.
+ */
+static void
+kmem_cache_magazine_shrink(kmem_cache_t *cp)
+{
+	kmem_magtype_t *mtp = cp->cache_magtype;
+
+	ASSERT(taskq_member(kmem_taskq, curthread));
+
+	if (mtp > kmem_magtype_base(cp->cache_chunksize)) {
+		kmem_cache_magazine_set(cp, mtp - 1);
+		atomic_inc_64(&cp->cache_magazine_shrink);
 	}
 }
 
@@ -3350,6 +3609,8 @@ kmem_cache_update(kmem_cache_t *cp)
 {
 	int need_hash_rescale = 0;
 	int need_magazine_resize = 0;
+	int need_magazine_shrink = 0;
+	uint64_t xfers, rate;
 
 	ASSERT(MUTEX_HELD(&kmem_cache_lock));
 
@@ -3373,17 +3634,35 @@ kmem_cache_update(kmem_cache_t *cp)
 	kmem_depot_ws_update(cp);
 
 	/*
-	 * If there's a lot of contention in the depot,
-	 * increase the magazine size.
+	 * If there's a lot of contention in the depot, or the CPUs are
+	 * exchanging magazines with it at a high rate, increase the magazine
+	 * size.  If the depot has been nearly idle while the system is short
+	 * of memory, step the magazine size back down so that fewer buffers
+	 * sit unused in the magazine layer.
 	 */
 	mutex_enter(&cp->cache_depot_lock);
 
-	if (cp->cache_chunksize < cp->cache_magtype->mt_maxbuf &&
+	xfers = kmem_depot_xfers(cp);
+	rate = (xfers - cp->cache_depot_xfer_prev) / MAX(ncpus_online, 1);
+
+	if (cp->cache_flags & KMF_NOMAGAZINE) {
+		/* nothing to resize */
+	} else if (cp->cache_chunksize < cp->cache_magtype->mt_maxbuf &&
 	    (int)(cp->cache_depot_contention -
-	    cp->cache_depot_contention_prev) > kmem_depot_contention)
+	    cp->cache_depot_contention_prev) > kmem_depot_contention) {
 		need_magazine_resize = 1;
+	} else if (kmem_magazine_autosize && kmem_reaping == 0 &&
+	    cp->cache_chunksize < cp->cache_magtype->mt_maxbuf &&
+	    rate > kmem_depot_xfer_hiwat) {
+		need_magazine_resize = 1;
+	} else if (kmem_magazine_autosize && kmem_reaping != 0 &&
+	    rate < kmem_depot_xfer_lowat &&
+	    cp->cache_magtype > kmem_magtype_base(cp->cache_chunksize)) {
+		need_magazine_shrink = 1;
+	}
 
 	cp->cache_depot_contention_prev = cp->cache_depot_contention;
+	cp->cache_depot_xfer_prev = xfers;
 
 	mutex_exit(&cp->cache_depot_lock);
 
@@ -3395,6 +3674,10 @@ kmem_cache_update(kmem_cache_t *cp)
 		(void) taskq_dispatch(kmem_taskq,
 		    (task_func_t *)kmem_cache_magazine_resize, cp, TQ_NOSLEEP);
 
+	if (need_magazine_shrink)
+		(void) taskq_dispatch(kmem_taskq,
+		    (task_func_t *)kmem_cache_magazine_shrink, cp, TQ_NOSLEEP);
+
 	if (cp->cache_defrag != NULL)
 		(void) taskq_dispatch(kmem_taskq,
 		    (task_func_t *)kmem_cache_scan, cp, TQ_NOSLEEP);
@@ -3431,6 +3714,7 @@ kmem_cache_kstat_update(kstat_t *ksp, int rw)
 	uint64_t cpu_buf_avail;
 	uint64_t buf_avail = 0;
 	int cpu_seqid;
+	uint_t i, ndepot;
 	long reap;
 
 	ASSERT(MUTEX_HELD(&kmem_cache_kstat_lock));
@@ -3474,6 +3758,8 @@ kmem_cache_kstat_update(kstat_t *ksp, int rw)
 	kmcp->kmc_magazine_size.value.ui64	=
 	    (cp->cache_flags & KMF_NOMAGAZINE) ?
 	    0 : cp->cache_magtype->mt_magsize;
+	kmcp->kmc_magazine_grow.value.ui64	= cp->cache_magazine_grow;
+	kmcp->kmc_magazine_shrink.value.ui64	= cp->cache_magazine_shrink;
 
 	kmcp->kmc_alloc.value.ui64		+= cp->cache_full.ml_alloc;
 	kmcp->kmc_free.value.ui64		+= cp->cache_empty.ml_alloc;
@@ -3484,6 +3770,23 @@ kmem_cache_kstat_update(kstat_t *ksp, int rw)
 
 	mutex_exit(&cp->cache_depot_lock);
 
+	kmcp->kmc_depot_remote.value.ui64 = 0;
+	ndepot = kmem_lgrp_ndepot(cp);
+	for (i = 0; i < ndepot; i++) {
+		kmem_lgrp_depot_t *kld = &cp->cache_lgrp_depot[i];
+
+		mutex_enter(&kld->kld_lock);
+		kmcp->kmc_depot_alloc.value.ui64 += kld->kld_full.ml_alloc;
+		kmcp->kmc_depot_remote.value.ui64 += kld->kld_remote;
+		kmcp->kmc_full_magazines.value.ui64 += kld->kld_full.ml_total;
+		kmcp->kmc_alloc.value.ui64 += kld->kld_full.ml_alloc;
+		buf_avail += kld->kld_full.ml_total *
+		    cp->cache_magtype->mt_magsize;
+		reap += MIN(MIN(kld->kld_full.ml_reaplimit,
+		    kld->kld_full.ml_min), kld->kld_full.ml_total);
+		mutex_exit(&kld->kld_lock);
+	}
+
 	kmcp->kmc_buf_size.value.ui64	= cp->cache_bufsize;
 	kmcp->kmc_align.value.ui64	= cp->cache_align;
 	kmcp->kmc_chunk_size.value.ui64	= cp->cache_chunksize;
@@ -3695,7 +3998,6 @@ kmem_cache_create(
 	int cpu_seqid;
 	size_t chunksize;
 	kmem_cache_t *cp;
-	kmem_magtype_t *mtp;
 	size_t csize = KMEM_CACHE_SIZE(max_ncpus);
 
 #ifdef	DEBUG
@@ -3945,10 +4247,10 @@ kmem_cache_create(
 	 */
 	mutex_init(&cp->cache_depot_lock, NULL, MUTEX_DEFAULT, NULL);
 
-	for (mtp = kmem_magtype; chunksize <= mtp->mt_minbuf; mtp++)
-		continue;
+	cp->cache_magtype = kmem_magtype_base(chunksize);
 
-	cp->cache_magtype = mtp;
+	if (kmem_lgrp_depot_ready)
+		kmem_lgrp_depot_init(cp);
 
 	/*
 	 * Initialize the CPU layer.
@@ -4134,6 +4436,17 @@ kmem_cache_destroy(kmem_cache_t *cp)
 	for (cpu_seqid = 0; cpu_seqid < max_ncpus; cpu_seqid++)
 		mutex_destroy(&cp->cache_cpu[cpu_seqid].cc_lock);
 
+	if (cp->cache_lgrp_ndepot != 0) {
+		uint_t i;
+
+		for (i = 0; i < cp->cache_lgrp_ndepot; i++) {
+			ASSERT(cp->cache_lgrp_depot[i].kld_full.ml_total == 0);
+			mutex_destroy(&cp->cache_lgrp_depot[i].kld_lock);
+		}
+		kmem_free(cp->cache_lgrp_depot,
+		    cp->cache_lgrp_ndepot * sizeof (kmem_lgrp_depot_t));
+	}
+
 	mutex_destroy(&cp->cache_depot_lock);
 	mutex_destroy(&cp->cache_lock);
 
@@ -4537,10 +4850,19 @@ kmem_thread_init(void)
 void
 kmem_mp_init(void)
 {
+	kmem_cache_t *cp;
+
 	mutex_enter(&cpu_lock);
 	register_cpu_setup_func(kmem_cpu_setup, NULL);
 	mutex_exit(&cpu_lock);
 
+	mutex_enter(&kmem_cache_lock);
+	kmem_lgrp_depot_ready = 1;
+	for (cp = list_head(&kmem_caches); cp != NULL;
+	    cp = list_next(&kmem_caches, cp))
+		kmem_lgrp_depot_init(cp);
+	mutex_exit(&kmem_cache_lock);
+
 	kmem_update_timeout(NULL);
 
 	taskq_mp_init();
@@ -5315,6 +5637,8 @@ kmem_cache_is_fragmented(kmem_cache_t *cp, boolean_t *doreap)
 	 * have fallen out of the working set.
 	 */
 	if (!fragmented) {
+		kmem_lgrp_depot_t *kld;
+		uint_t i, ndepot = kmem_lgrp_ndepot(cp);
 		long reap;
 
 		mutex_enter(&cp->cache_depot_lock);
@@ -5322,6 +5646,14 @@ kmem_cache_is_fragmented(kmem_cache_t *cp, boolean_t *doreap)
 		reap = MIN(reap, cp->cache_full.ml_total);
 		mutex_exit(&cp->cache_depot_lock);
 
+		for (i = 0; i < ndepot; i++) {
+			kld = &cp->cache_lgrp_depot[i];
+			mutex_enter(&kld->kld_lock);
+			reap += MIN(MIN(kld->kld_full.ml_reaplimit,
+			    kld->kld_full.ml_min), kld->kld_full.ml_total);
+			mutex_exit(&kld->kld_lock);
+		}
+
 		nfree += ((uint64_t)reap * cp->cache_magtype->mt_magsize);
 		if (kmem_cache_frag_threshold(cp, nfree)) {
 			*doreap = B_TRUE;
@@ -20,7 +20,7 @@
  */
 /*
  * Copyright (c) 1992, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright 2017, Joyent, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  * Copyright 2015 Nexenta Systems, Inc. All rights reserved.
  */
 
@@ -54,6 +54,7 @@
 #include <sys/cpupart.h>
 #include <sys/zone.h>
 #include <sys/loadavg.h>
+#include <sys/atomic.h>
 #include <vm/page.h>
 #include <vm/anon.h>
 #include <vm/seg_kmem.h>
@@ -81,6 +82,16 @@ static kmutex_t kstat_chain_lock;
 
 kid_t kstat_chain_id = 2;
 
+/*
+ * Bulk readers of /dev/kstat (KSTAT_IOC_BULK) may ask for only those kstats
+ * whose data has changed since an earlier read.  To support this, each kstat
+ * remembers a checksum of its data as last seen by a bulk reader, along with
+ * the value of kstat_bulk_gen at which that checksum last changed.  The
+ * generation only moves forward, so a reader which notes its value before
+ * starting a walk will see any change stamped after that point.
+ */
+uint64_t kstat_bulk_gen;
+
 /*
  * As far as zones are concerned, there are 3 types of kstat:
  *
@@ -122,6 +133,8 @@ typedef struct ekstat {
 	avl_node_t	e_avl_bykid;	/* AVL tree to sort by KID */
 	avl_node_t	e_avl_byname;	/* AVL tree to sort by name */
 	kstat_zone_t	e_zone;		/* zone to export stats to */
+	uint64_t	e_bulk_sum;	/* data checksum seen by bulk read */
+	uint64_t	e_bulk_gen;	/* kstat_bulk_gen of last change */
 } ekstat_t;
 
 static uint64_t kstat_initial[8192];
@@ -435,6 +448,79 @@ kstat_hold_byname(const char *ks_module, int ks_instance, const char *ks_name,
 	return (kstat_hold(&kstat_avl_byname, &e));
 }
 
+/*
+ * Hold the kstat with the lowest KID greater than kid which is visible to
+ * the given zone and whose module and class match ks_module and ks_class (a
+ * NULL filter matches anything).  Non-matching kstats are skipped without
+ * being held, and kstat_chain_lock is dropped before returning, so a caller
+ * can walk the entire chain one kstat at a time without holding up kstat
+ * creation and deletion for the duration of the walk.
+ */
+kstat_t *
+kstat_hold_next(kid_t kid, zoneid_t zoneid, const char *ks_module,
+    const char *ks_class)
+{
+	ekstat_t template, *e;
+	avl_index_t where;
+	kstat_t *ksp;
+
+	template.e_ks.ks_kid = kid;
+	template.e_zone.zoneid = ALL_ZONES;
+	template.e_zone.next = NULL;
+
+	mutex_enter(&kstat_chain_lock);
+again:
+	/*
+	 * KIDs are unique, so a template with ALL_ZONES finds the kstat with
+	 * this KID, if there is one, regardless of its visibility.
+	 */
+	if ((e = avl_find(&kstat_avl_bykid, &template, &where)) != NULL)
+		e = AVL_NEXT(&kstat_avl_bykid, e);
+	else
+		e = avl_nearest(&kstat_avl_bykid, where, AVL_AFTER);
+
+	for (; e != NULL; e = AVL_NEXT(&kstat_avl_bykid, e)) {
+		ksp = &e->e_ks;
+		if (!kstat_zone_find(ksp, zoneid))
+			continue;
+		if (ks_module != NULL && strcmp(ksp->ks_module, ks_module) != 0)
+			continue;
+		if (ks_class != NULL && strcmp(ksp->ks_class, ks_class) != 0)
+			continue;
+		if (e->e_owner != NULL) {
+			/*
+			 * The kstat may be deleted while we wait, so look
+			 * it up again from the last KID we were given.
+			 */
+			cv_wait(&e->e_cv, &kstat_chain_lock);
+			goto again;
+		}
+		e->e_owner = curthread;
+		break;
+	}
+	mutex_exit(&kstat_chain_lock);
+
+	return (e != NULL ? &e->e_ks : NULL);
+}
+
+/*
+ * Note the checksum of a held kstat's data as seen by a bulk reader, and
+ * return the bulk generation at which it last changed.  A kstat which has
+ * never been seen by a bulk reader is always considered to have changed.
+ */
+uint64_t
+kstat_bulk_changed(kstat_t *ksp, uint64_t sum)
+{
+	ekstat_t *e = (ekstat_t *)ksp;
+
+	ASSERT(e->e_owner == curthread);
+	if (e->e_bulk_gen == 0 || e->e_bulk_sum != sum) {
+		e->e_bulk_sum = sum;
+		e->e_bulk_gen = atomic_inc_64_nv(&kstat_bulk_gen);
+	}
+	return (e->e_bulk_gen);
+}
+
 static ekstat_t *
 kstat_alloc(size_t size)
 {
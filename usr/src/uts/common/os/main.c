@@ -622,6 +622,8 @@ main(void)
 	 */
 	kmem_mp_init();
 
+	page_pcp_init();
+
 	clock_tick_init_post();
 
 	for (initptr = &mp_init_tbl[0]; *initptr; initptr++)
@@ -680,6 +682,9 @@ main(void)
 	(void) thread_create(NULL, 0, seg_pasync_thread,
 	    NULL, 0, &p0, TS_RUN, minclsyspri);
 
+	(void) thread_create(NULL, 0, page_compact_thread,
+	    NULL, 0, &p0, TS_RUN, minclsyspri);
+
 	pid_setmin();
 
 	/* system is now ready */
@@ -1803,6 +1803,13 @@ delete_memory_thread(caddr_t amhp)
 
 		MDSTAT_INCR(mhp, nloop);
 		collected = 0;
+		/*
+		 * Free pages in the per-CPU page caches are locked; put
+		 * them back on the freelists so they can be collected.
+		 */
+		mutex_exit(&mhp->mh_mutex);
+		page_pcp_drain_all();
+		mutex_enter(&mhp->mh_mutex);
 		for (mdsp = mhp->mh_transit.trl_spans; (mdsp != NULL) &&
 		    (mhp->mh_cancel == 0); mdsp = mdsp->mds_next) {
 			pfn_t pfn, p_end;
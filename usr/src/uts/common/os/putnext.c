@@ -21,6 +21,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*	Copyright (c) 1984, 1986, 1987, 1988, 1989 AT&T	*/
@@ -96,10 +97,20 @@ int put_stack_needed = PUT_STACK_NEEDED;
 
 boolean_t	UseFastlocks = B_FALSE;
 
+/*
+ * The most messages putnext_chain() passes through a perimeter under one
+ * claim.  This bounds both the extra claims a chain headed for a full syncq
+ * needs and how long a chain keeps an exclusive perimeter to itself.
+ */
+int	putnext_chain_max = 32;
+
 /*
  * function: putnext()
  * purpose:  call the put routine of the queue linked to qp
  *
+ * putnext_common() is putnext() for a b_next chain of messages; see
+ * putnext_chain() below.
+ *
  * Note: this function is written to perform well on modern computer
  * architectures by e.g. preloading values into registers and "smearing" out
  * code.
@@ -140,10 +151,11 @@ boolean_t	UseFastlocks = B_FALSE;
  * has changed in that cycle, or wakeups are needed, it will occur
  * there.
  */
-void
-putnext(queue_t *qp, mblk_t *mp)
+static inline void
+putnext_common(queue_t *qp, mblk_t *mp)
 {
 	queue_t		*fqp = qp; /* For strft tracing */
+	mblk_t		*nmp;
 	syncq_t		*sq;
 	uint16_t	flags;
 	uint16_t	drain_mask;
@@ -160,7 +172,7 @@ putnext(queue_t *qp, mblk_t *mp)
 	    "putnext_start:(%p, %p)", qp, mp);
 
 	ASSERT(mp->b_datap->db_ref != 0);
-	ASSERT(mp->b_next == NULL && mp->b_prev == NULL);
+	ASSERT(mp->b_prev == NULL);
 	stp = STREAM(qp);
 	ASSERT(stp != NULL);
 	if (stp->sd_ciputctrl != NULL) {
@@ -222,6 +234,15 @@ putnext(queue_t *qp, mblk_t *mp)
 			    "putnext_end:(%p, %p, %p) SQ_EXCL fill",
 			    qp, mp, sq);
 
+			/*
+			 * qfill_syncq() consumes a claim for each message it
+			 * is given, so make one for the rest of any chain.
+			 */
+			for (nmp = mp->b_next; nmp != NULL; nmp = nmp->b_next) {
+				sq->sq_count++;
+				ASSERT(sq->sq_count != 0);	/* Wraparound */
+			}
+
 			/*
 			 * NOTE: qfill_syncq will need QLOCK. It is safe to drop
 			 * SQLOCK because positive sq_count keeps the syncq from
@@ -229,7 +250,11 @@ putnext(queue_t *qp, mblk_t *mp)
 			 */
 			mutex_exit(SQLOCK(sq));
 
-			qfill_syncq(sq, qp, mp);
+			do {
+				nmp = mp->b_next;
+				mp->b_next = NULL;
+				qfill_syncq(sq, qp, mp);
+			} while ((mp = nmp) != NULL);
 			/*
 			 * NOTE: after the call to qfill_syncq() qp may be
 			 * closed, both qp and sq should not be referenced at
@@ -265,54 +290,62 @@ putnext(queue_t *qp, mblk_t *mp)
 	/*
 	 * We now have a claim on the syncq, we are either going to
 	 * put the message on the syncq and then drain it, or we are
-	 * going to call the putproc().
+	 * going to call the putproc().  The messages of a chain are
+	 * handed over one at a time under the same claim.  Other threads
+	 * may fill the syncq while we are in the putproc, so every
+	 * message after the first takes the "queued" path below.
 	 */
 	putproc = qi->qi_putp;
-	if (!queued) {
-		STR_FTEVENT_MSG(mp, fqp, FTEV_PUTNEXT, mp->b_rptr -
-		    mp->b_datap->db_base);
-		(*putproc)(qp, mp);
-		ASSERT(MUTEX_NOT_HELD(SQLOCK(sq)));
-		ASSERT(MUTEX_NOT_HELD(QLOCK(qp)));
-	} else {
-		mutex_enter(QLOCK(qp));
-		/*
-		 * If there are no messages in front of us, just call putproc(),
-		 * otherwise enqueue the message and drain the queue.
-		 */
-		if (qp->q_syncqmsgs == 0) {
-			mutex_exit(QLOCK(qp));
+	for (; mp != NULL; mp = nmp, queued = B_TRUE) {
+		nmp = mp->b_next;
+		mp->b_next = NULL;
+		if (!queued) {
 			STR_FTEVENT_MSG(mp, fqp, FTEV_PUTNEXT, mp->b_rptr -
 			    mp->b_datap->db_base);
 			(*putproc)(qp, mp);
 			ASSERT(MUTEX_NOT_HELD(SQLOCK(sq)));
+			ASSERT(MUTEX_NOT_HELD(QLOCK(qp)));
 		} else {
+			mutex_enter(QLOCK(qp));
 			/*
-			 * We are doing a fill with the intent to
-			 * drain (meaning we are filling because
-			 * there are messages in front of us ane we
-			 * need to preserve message ordering)
-			 * Therefore, put the message on the queue
-			 * and call qdrain_syncq (must be done with
-			 * the QLOCK held).
+			 * If there are no messages in front of us, just call
+			 * putproc(), otherwise enqueue the message and drain
+			 * the queue.
 			 */
-			STR_FTEVENT_MSG(mp, fqp, FTEV_PUTNEXT,
-			    mp->b_rptr - mp->b_datap->db_base);
+			if (qp->q_syncqmsgs == 0) {
+				mutex_exit(QLOCK(qp));
+				STR_FTEVENT_MSG(mp, fqp, FTEV_PUTNEXT,
+				    mp->b_rptr - mp->b_datap->db_base);
+				(*putproc)(qp, mp);
+				ASSERT(MUTEX_NOT_HELD(SQLOCK(sq)));
+			} else {
+				/*
+				 * We are doing a fill with the intent to
+				 * drain (meaning we are filling because
+				 * there are messages in front of us ane we
+				 * need to preserve message ordering)
+				 * Therefore, put the message on the queue
+				 * and call qdrain_syncq (must be done with
+				 * the QLOCK held).
+				 */
+				STR_FTEVENT_MSG(mp, fqp, FTEV_PUTNEXT,
+				    mp->b_rptr - mp->b_datap->db_base);
 
 #ifdef DEBUG
-			/*
-			 * These two values were in the original code for
-			 * all syncq messages.  This is unnecessary in
-			 * the current implementation, but was retained
-			 * in debug mode as it is usefull to know where
-			 * problems occur.
-			 */
-			mp->b_queue = qp;
-			mp->b_prev = (mblk_t *)putproc;
+				/*
+				 * These two values were in the original code
+				 * for all syncq messages.  This is unnecessary
+				 * in the current implementation, but was
+				 * retained in debug mode as it is usefull to
+				 * know where problems occur.
+				 */
+				mp->b_queue = qp;
+				mp->b_prev = (mblk_t *)putproc;
 #endif
-			SQPUT_MP(qp, mp);
-			qdrain_syncq(sq, qp);
-			ASSERT(MUTEX_NOT_HELD(QLOCK(qp)));
+				SQPUT_MP(qp, mp);
+				qdrain_syncq(sq, qp);
+				ASSERT(MUTEX_NOT_HELD(QLOCK(qp)));
+			}
 		}
 	}
 	/*
@@ -411,6 +444,41 @@ putnext(queue_t *qp, mblk_t *mp)
 	    "putnext_end:(%p, %p, %p) done", qp, mp, sq);
 }
 
+void
+putnext(queue_t *qp, mblk_t *mp)
+{
+	ASSERT(mp->b_next == NULL);
+	putnext_common(qp, mp);
+}
+
+/*
+ * function: putnext_chain()
+ * purpose:  putnext() each message of a b_next chain, in order
+ *
+ * This is for callers which have built up a list of messages, such as a
+ * protocol draining its receive list upstream.  Rather than taking sd_lock
+ * and making a claim on the next syncq for every message, as a loop around
+ * putnext() would, the chain is passed through the perimeter in batches of
+ * up to putnext_chain_max messages.  Each batch goes to the queue that was
+ * next when the batch started, exactly as if the messages had been sent in
+ * one putnext() call each without anything changing in between.
+ */
+void
+putnext_chain(queue_t *qp, mblk_t *mp)
+{
+	mblk_t	*last, *nmp;
+	int	n;
+
+	while (mp != NULL) {
+		for (last = mp, n = 1; last->b_next != NULL &&
+		    n < putnext_chain_max; last = last->b_next, n++)
+			;
+		nmp = last->b_next;
+		last->b_next = NULL;
+		putnext_common(qp, mp);
+		mp = nmp;
+	}
+}
 
 /*
  * wrapper for qi_putp entry in module ops vec.
@@ -21,9 +21,13 @@
 /*
  * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/types.h>
+#if defined(__amd64) && defined(_KERNEL)
+#include <sys/x86_archext.h>
+#endif
 
 /*
  * Fast CRC32 calculation algorithm suggested by Ferenc Rakoczi
@@ -70,11 +74,45 @@ flip32(uint32_t w)
 
 #endif
 
+#if defined(__amd64) && defined(_KERNEL)
+
+/*
+ * The SSE4.2 crc32 instruction computes the same reflected CRC32c, and
+ * works on the general purpose registers, so it needs no FPU state.  It
+ * is used instead of the tables when the processor has it.
+ */
+static boolean_t sctp_crc32_sse42 = B_FALSE;
+
+static uint32_t
+sctp_crc32_hw(uint32_t crc32, const uint8_t *buf, int len)
+{
+	uint64_t crc = crc32;
+
+	for (; len > 0 && ((uintptr_t)buf & 7) != 0; len--, buf++)
+		__asm__("crc32b %1, %k0" : "+r" (crc) : "rm" (*buf));
+
+	for (; len >= 8; len -= 8, buf += 8) {
+		__asm__("crc32q %1, %0" : "+r" (crc) :
+		    "rm" (*(const uint64_t *)buf));
+	}
+
+	for (; len > 0; len--, buf++)
+		__asm__("crc32b %1, %k0" : "+r" (crc) : "rm" (*buf));
+
+	return ((uint32_t)crc);
+}
+
+#endif
+
 void
 sctp_crc32_init(void)
 {
 	uint32_t i, j, k, crc;
 
+#if defined(__amd64) && defined(_KERNEL)
+	sctp_crc32_sse42 = is_x86_feature(x86_featureset, X86FSET_SSE4_2);
+#endif
+
 	for (i = 0; i < 256; i++) {
 		crc = reflect_32(i);
 		for (k = 0; k < 4; k++) {
@@ -128,6 +166,11 @@ sctp_crc32(uint32_t crc32, const uint8_t *buf, int len)
 {
 	int rem;
 
+#if defined(__amd64) && defined(_KERNEL)
+	if (sctp_crc32_sse42)
+		return (sctp_crc32_hw(crc32, buf, len));
+#endif
+
 	rem = 4 - ((uintptr_t)buf) & 3;
 	if (rem != 0) {
 		if (len < rem) {
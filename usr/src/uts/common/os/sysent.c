@@ -323,6 +323,8 @@ ssize_t	recvmsg(int, struct nmsghdr *, int);
 ssize_t	send(int, void *, size_t, int);
 ssize_t	sendmsg(int, struct nmsghdr *, int);
 ssize_t	sendto(int, void *, size_t, int, struct sockaddr *, socklen_t);
+int	recvmmsg(int, struct mmsghdr *, uint_t, int, timespec_t *);
+int	sendmmsg(int, struct mmsghdr *, uint_t, int);
 int	getpeername(int, struct sockaddr *, socklen_t *, int);
 int	getsockname(int, struct sockaddr *, socklen_t *, int);
 int	getsockopt(int, int, int, void *, socklen_t *, int);
@@ -470,7 +472,7 @@ struct sysent sysent[NSYSCALL] =
 	/* 27 */ SYSENT_CI("alarm",		alarm,		1),
 	/* 28 */ SYSENT_CI("fstat",		fstat,		2),
 	/* 29 */ SYSENT_CI("pause",		pause,		0),
-	/* 30 */ SYSENT_LOADABLE(),			/* (was utime) */
+	/* 30 */ SYSENT_CI("recvmmsg",		recvmmsg,	5),
 	/* 31 */ SYSENT_CI("stty",		stty,		2),
 	/* 32 */ SYSENT_CI("gtty",		gtty,		2),
 	/* 33 */ SYSENT_CI("access",		access,		2),
@@ -528,7 +530,7 @@ struct sysent sysent[NSYSCALL] =
 	/* 73 */ SYSENT_CI("getpagesizes",	getpagesizes,	3),
 	/* 74 */ SYSENT_CI("rctlsys",		rctlsys,	6),
 	/* 75 */ SYSENT_2CI("sidsys",		sidsys,		4),
-	/* 76 */ SYSENT_LOADABLE(),			/* (was fsat) */
+	/* 76 */ SYSENT_CI("sendmmsg",		sendmmsg,	4),
 	/* 77 */ SYSENT_CI("lwp_park",		syslwp_park,	3),
 	/* 78 */ SYSENT_CL("sendfilev",		sendfilev,	5),
 	/* 79 */ SYSENT_CI("rmdir",		rmdir,		1),
@@ -849,7 +851,7 @@ struct sysent sysent32[NSYSCALL] =
 	/* 27 */ SYSENT_CI("alarm",		alarm,		1),
 	/* 28 */ SYSENT_CI("fstat",		fstat32,	2),
 	/* 29 */ SYSENT_CI("pause",		pause,		0),
-	/* 30 */ SYSENT_LOADABLE32(),			/* (was utime) */
+	/* 30 */ SYSENT_CI("recvmmsg",		recvmmsg,	5),
 	/* 31 */ SYSENT_CI("stty",		stty,		2),
 	/* 32 */ SYSENT_CI("gtty",		gtty,		2),
 	/* 33 */ SYSENT_CI("access",		access,		2),
@@ -897,7 +899,7 @@ struct sysent sysent32[NSYSCALL] =
 	/* 73 */ SYSENT_CI("getpagesizes",	getpagesizes32,	3),
 	/* 74 */ SYSENT_CI("rctlsys",		rctlsys,	6),
 	/* 75 */ SYSENT_2CI("sidsys",		sidsys,		4),
-	/* 76 */ SYSENT_LOADABLE32(),			/* (was fsat) */
+	/* 76 */ SYSENT_CI("sendmmsg",		sendmmsg,	4),
 	/* 77 */ SYSENT_CI("lwp_park",		syslwp_park,	3),
 	/* 78 */ SYSENT_CI("sendfilev",		sendfilev,	5),
 	/* 79 */ SYSENT_CI("rmdir",		rmdir,		1),
@@ -126,6 +126,20 @@
  *		supported for DYNAMIC task queues.  This flag is not compatible
  *		with TASKQ_THREADS_CPU_PCT.
  *
+ *	  TASKQ_PERCPU: Instead of the single tq_task list, keep one queue per
+ *		worker thread (up to one per CPU), each with its own lock.
+ *		taskq_dispatch() and taskq_dispatch_ent() place the task on
+ *		the queue selected by the dispatching CPU, so concurrent
+ *		dispatchers on different CPUs do not contend on tq_lock.  A
+ *		worker drains its own queue first and then steals from the
+ *		tail of the other queues.  Task entries come straight from
+ *		the taskq_ent_cache, so 'minalloc' and 'maxalloc' are ignored
+ *		and TQ_NOALLOC dispatches always fail.  Tasks are executed in
+ *		dispatch order only if nthreads == 1.  The number of steals
+ *		and contended queue lock acquisitions are exported as the
+ *		"steals" and "lockwait" kstats.  This flag is not supported
+ *		for DYNAMIC task queues.
+ *
  *	The 'pri' field specifies the default priority for the threads that
  *	service all scheduled tasks.
  *
@@ -503,6 +517,7 @@
 #include <sys/cpupart.h>
 #include <sys/sdt.h>
 #include <sys/sysdc.h>
+#include <sys/atomic.h>
 #include <sys/note.h>
 
 static kmem_cache_t *taskq_ent_cache, *taskq_cache;
@@ -588,6 +603,8 @@ static void taskq_ent_free(taskq_t *, taskq_ent_t *);
 static int taskq_ent_exists(taskq_t *, task_func_t, void *);
 static taskq_ent_t *taskq_bucket_dispatch(taskq_bucket_t *, task_func_t,
     void *);
+static taskqid_t taskq_pcq_dispatch(taskq_t *, task_func_t, void *, uint_t,
+    taskq_ent_t *);
 
 /*
  * Task queues kstats.
@@ -603,6 +620,8 @@ struct taskq_kstat {
 	kstat_named_t	tq_pri;
 	kstat_named_t	tq_nthreads;
 	kstat_named_t	tq_nomem;
+	kstat_named_t	tq_steals;
+	kstat_named_t	tq_lockwait;
 } taskq_kstat = {
 	{ "pid",		KSTAT_DATA_UINT64 },
 	{ "tasks",		KSTAT_DATA_UINT64 },
@@ -614,6 +633,8 @@ struct taskq_kstat {
 	{ "priority",		KSTAT_DATA_UINT64 },
 	{ "threads",		KSTAT_DATA_UINT64 },
 	{ "nomem",		KSTAT_DATA_UINT64 },
+	{ "steals",		KSTAT_DATA_UINT64 },
+	{ "lockwait",		KSTAT_DATA_UINT64 },
 };
 
 struct taskq_d_kstat {
@@ -1152,6 +1173,11 @@ taskq_dispatch(taskq_t *tq, task_func_t func, void *arg, uint_t flags)
 	ASSERT(tq != NULL);
 	ASSERT(func != NULL);
 
+	if (tq->tq_flags & TASKQ_PERCPU) {
+		ASSERT(!(flags & TQ_NOQUEUE));
+		return (taskq_pcq_dispatch(tq, func, arg, flags, NULL));
+	}
+
 	if (!(tq->tq_flags & TASKQ_DYNAMIC)) {
 		/*
 		 * TQ_NOQUEUE flag can't be used with non-dynamic task queues.
@@ -1311,6 +1337,12 @@ taskq_dispatch_ent(taskq_t *tq, task_func_t func, void *arg, uint_t flags,
 	 * to ensure that we don't free it later.
 	 */
 	tqe->tqent_un.tqent_flags |= TQENT_FLAG_PREALLOC;
+
+	if (tq->tq_flags & TASKQ_PERCPU) {
+		(void) taskq_pcq_dispatch(tq, func, arg, flags, tqe);
+		return;
+	}
+
 	/*
 	 * Enqueue the task to the underlying queue.
 	 */
@@ -1324,6 +1356,168 @@ taskq_dispatch_ent(taskq_t *tq, task_func_t func, void *arg, uint_t flags,
 	mutex_exit(&tq->tq_lock);
 }
 
+/*
+ * Enter a per-CPU queue lock, counting the times we had to wait for it.
+ */
+#define	TQ_PCQ_ENTER(pq) {					\
+	if (!mutex_tryenter(&(pq)->tqp_lock)) {			\
+		mutex_enter(&(pq)->tqp_lock);			\
+		(pq)->tqp_lockwait++;				\
+	}							\
+}
+
+/*
+ * Dispatch to a TASKQ_PERCPU taskq.  If tqe is NULL an entry is allocated
+ * from the taskq_ent_cache, otherwise it is a preallocated entry from
+ * taskq_dispatch_ent().
+ *
+ * tq_pcq_pending is raised before the task is queued and lowered after it
+ * is dequeued, so it never undercounts.  Idle workers raise tq_pcq_idle
+ * under tq_lock before checking tq_pcq_pending and going to sleep; here we
+ * check tq_pcq_idle after raising tq_pcq_pending, so either the worker sees
+ * the new task or we see the worker and wake it.  tq_lock is therefore only
+ * taken when some worker is actually asleep.
+ */
+static taskqid_t
+taskq_pcq_dispatch(taskq_t *tq, task_func_t func, void *arg, uint_t flags,
+    taskq_ent_t *tqe)
+{
+	taskq_pcq_t *pq;
+	uint_t pending;
+
+	if (tqe == NULL) {
+		if (!(flags & TQ_NOALLOC)) {
+			tqe = kmem_cache_alloc(taskq_ent_cache,
+			    (flags & TQ_NOSLEEP) ? KM_NOSLEEP : KM_SLEEP);
+		}
+		if (tqe == NULL) {
+			atomic_inc_64(&tq->tq_nomem);
+			return (TASKQID_INVALID);
+		}
+		/* Make sure we start without any flags */
+		tqe->tqent_un.tqent_flags = 0;
+	}
+
+	pending = atomic_inc_uint_nv(&tq->tq_pcq_pending);
+	if (pending > tq->tq_maxtasks)
+		tq->tq_maxtasks = pending;
+
+	pq = &tq->tq_pcq[CPU->cpu_seqid % tq->tq_npcq];
+	TQ_PCQ_ENTER(pq);
+	if (flags & TQ_FRONT) {
+		TQ_PREPEND(pq->tqp_task, tqe);
+	} else {
+		TQ_APPEND(pq->tqp_task, tqe);
+	}
+	tqe->tqent_func = func;
+	tqe->tqent_arg = arg;
+	pq->tqp_tasks++;
+	DTRACE_PROBE2(taskq__enqueue, taskq_t *, tq, taskq_ent_t *, tqe);
+	mutex_exit(&pq->tqp_lock);
+
+	membar_enter();
+	if (tq->tq_pcq_idle != 0) {
+		mutex_enter(&tq->tq_lock);
+		cv_signal(&tq->tq_dispatch_cv);
+		mutex_exit(&tq->tq_lock);
+	}
+
+	return ((taskqid_t)tqe);
+}
+
+/*
+ * Take the next task for the worker whose own queue is 'home'.  The own
+ * queue is served from the head; other queues are only tried with
+ * mutex_tryenter() and are served from the tail, which keeps thieves away
+ * from the entries their owner is about to take.
+ */
+static taskq_ent_t *
+taskq_pcq_get(taskq_t *tq, uint_t home)
+{
+	taskq_pcq_t *pq;
+	taskq_ent_t *tqe;
+	uint_t i, n = tq->tq_npcq;
+
+	for (i = 0; i < n && tq->tq_pcq_pending != 0; i++) {
+		pq = &tq->tq_pcq[(home + i) % n];
+		if (IS_EMPTY(pq->tqp_task))
+			continue;
+
+		if (i == 0) {
+			TQ_PCQ_ENTER(pq);
+			tqe = pq->tqp_task.tqent_next;
+		} else if (mutex_tryenter(&pq->tqp_lock)) {
+			tqe = pq->tqp_task.tqent_prev;
+		} else {
+			continue;
+		}
+
+		if (tqe == &pq->tqp_task) {
+			mutex_exit(&pq->tqp_lock);
+			continue;
+		}
+
+		tqe->tqent_prev->tqent_next = tqe->tqent_next;
+		tqe->tqent_next->tqent_prev = tqe->tqent_prev;
+		if (i != 0)
+			pq->tqp_steals++;
+		mutex_exit(&pq->tqp_lock);
+
+		atomic_dec_uint(&tq->tq_pcq_pending);
+		return (tqe);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Run tasks from a TASKQ_PERCPU taskq until none can be found, or until this
+ * thread (whose thread_id is home + 1) is no longer wanted.  Called and
+ * returns with tq_lock held, but drops it while running tasks.
+ */
+static void
+taskq_pcq_run(taskq_t *tq, uint_t home)
+{
+	taskq_ent_t *tqe;
+	hrtime_t start, end, total = 0;
+	uint64_t executed = 0;
+	boolean_t freeit;
+
+	ASSERT(MUTEX_HELD(&tq->tq_lock));
+	mutex_exit(&tq->tq_lock);
+
+	while ((int)home < tq->tq_nthreads_target &&
+	    (tqe = taskq_pcq_get(tq, home)) != NULL) {
+		/* See the comment in taskq_thread() */
+		if (tqe->tqent_un.tqent_flags & TQENT_FLAG_PREALLOC) {
+			tqe->tqent_next = tqe->tqent_prev = NULL;
+			freeit = B_FALSE;
+		} else {
+			freeit = B_TRUE;
+		}
+
+		rw_enter(&tq->tq_threadlock, RW_READER);
+		start = gethrtime();
+		DTRACE_PROBE2(taskq__exec__start, taskq_t *, tq,
+		    taskq_ent_t *, tqe);
+		tqe->tqent_func(tqe->tqent_arg);
+		DTRACE_PROBE2(taskq__exec__end, taskq_t *, tq,
+		    taskq_ent_t *, tqe);
+		end = gethrtime();
+		rw_exit(&tq->tq_threadlock);
+
+		total += end - start;
+		executed++;
+
+		if (freeit)
+			kmem_cache_free(taskq_ent_cache, tqe);
+	}
+
+	mutex_enter(&tq->tq_lock);
+	tq->tq_totaltime += total;
+	tq->tq_executed += executed;
+}
+
 /*
  * Allow our caller to ask if there are tasks pending on the queue.
  */
@@ -1334,7 +1528,8 @@ taskq_empty(taskq_t *tq)
 
 	ASSERT3P(tq, !=, curthread->t_taskq);
 	mutex_enter(&tq->tq_lock);
-	rv = (tq->tq_task.tqent_next == &tq->tq_task) && (tq->tq_active == 0);
+	rv = (tq->tq_task.tqent_next == &tq->tq_task) && (tq->tq_active == 0) &&
+	    (tq->tq_pcq_pending == 0);
 	mutex_exit(&tq->tq_lock);
 
 	return (rv);
@@ -1350,7 +1545,8 @@ taskq_wait(taskq_t *tq)
 	ASSERT(tq != curthread->t_taskq);
 
 	mutex_enter(&tq->tq_lock);
-	while (tq->tq_task.tqent_next != &tq->tq_task || tq->tq_active != 0)
+	while (tq->tq_task.tqent_next != &tq->tq_task || tq->tq_active != 0 ||
+	    tq->tq_pcq_pending != 0)
 		cv_wait(&tq->tq_wait_cv, &tq->tq_lock);
 	mutex_exit(&tq->tq_lock);
 
@@ -1614,6 +1810,24 @@ taskq_thread(void *arg)
 				}
 			}
 		}
+		if (tq->tq_flags & TASKQ_PERCPU) {
+			if (tq->tq_pcq_pending != 0) {
+				taskq_pcq_run(tq, thread_id - 1);
+				continue; /* tq_lock was dropped */
+			}
+			/* See taskq_pcq_dispatch() for the wakeup protocol */
+			tq->tq_pcq_idle++;
+			membar_enter();
+			if (tq->tq_pcq_pending == 0) {
+				if (--tq->tq_active == 0)
+					cv_broadcast(&tq->tq_wait_cv);
+				(void) taskq_thread_wait(tq, &tq->tq_lock,
+				    &tq->tq_dispatch_cv, &cprinfo, -1);
+				tq->tq_active++;
+			}
+			tq->tq_pcq_idle--;
+			continue;
+		}
 		if ((tqe = tq->tq_task.tqent_next) == &tq->tq_task) {
 			if (--tq->tq_active == 0)
 				cv_broadcast(&tq->tq_wait_cv);
@@ -1903,6 +2117,7 @@ taskq_create_common(const char *name, int instance, int nthreads, pri_t pri,
 	 */
 	IMPLY((flags & TASKQ_DYNAMIC), !(flags & TASKQ_CPR_SAFE));
 	IMPLY((flags & TASKQ_DYNAMIC), !(flags & TASKQ_THREADS_CPU_PCT));
+	IMPLY((flags & TASKQ_DYNAMIC), !(flags & TASKQ_PERCPU));
 	IMPLY((flags & TASKQ_CPR_SAFE), !(flags & TASKQ_THREADS_CPU_PCT));
 
 	/* Cannot have DYNAMIC with DUTY_CYCLE */
@@ -1979,8 +2194,23 @@ taskq_create_common(const char *name, int instance, int nthreads, pri_t pri,
 		tq->tq_threadlist = kmem_alloc(
 		    sizeof (kthread_t *) * max_nthreads, KM_SLEEP);
 
+	if (flags & TASKQ_PERCPU) {
+		taskq_pcq_t *pq;
+		int i;
+
+		tq->tq_npcq = MIN(max_nthreads, max_ncpus);
+		tq->tq_pcq = kmem_zalloc(sizeof (taskq_pcq_t) * tq->tq_npcq,
+		    KM_SLEEP);
+		for (i = 0; i < tq->tq_npcq; i++) {
+			pq = &tq->tq_pcq[i];
+			mutex_init(&pq->tqp_lock, NULL, MUTEX_DEFAULT, NULL);
+			pq->tqp_task.tqent_next = &pq->tqp_task;
+			pq->tqp_task.tqent_prev = &pq->tqp_task;
+		}
+	}
+
 	mutex_enter(&tq->tq_lock);
-	if (flags & TASKQ_PREPOPULATE) {
+	if ((flags & (TASKQ_PREPOPULATE | TASKQ_PERCPU)) == TASKQ_PREPOPULATE) {
 		while (minalloc-- > 0)
 			taskq_ent_free(tq, taskq_ent_alloc(tq, TQ_SLEEP));
 	}
@@ -2129,6 +2359,20 @@ taskq_destroy(taskq_t *tq)
 
 	mutex_exit(&tq->tq_lock);
 
+	if (tq->tq_pcq != NULL) {
+		int i;
+
+		ASSERT(tq->tq_flags & TASKQ_PERCPU);
+		ASSERT0(tq->tq_pcq_pending);
+		for (i = 0; i < tq->tq_npcq; i++) {
+			ASSERT(IS_EMPTY(tq->tq_pcq[i].tqp_task));
+			mutex_destroy(&tq->tq_pcq[i].tqp_lock);
+		}
+		kmem_free(tq->tq_pcq, sizeof (taskq_pcq_t) * tq->tq_npcq);
+		tq->tq_pcq = NULL;
+		tq->tq_npcq = 0;
+	}
+
 	/*
 	 * Mark each bucket as closing and wakeup all sleeping threads.
 	 */
@@ -2273,12 +2517,22 @@ taskq_kstat_update(kstat_t *ksp, int rw)
 {
 	struct taskq_kstat *tqsp = &taskq_kstat;
 	taskq_t *tq = ksp->ks_private;
+	uint64_t tasks, steals, lockwait;
+	int i;
 
 	if (rw == KSTAT_WRITE)
 		return (EACCES);
 
+	tasks = tq->tq_tasks;
+	steals = lockwait = 0;
+	for (i = 0; i < tq->tq_npcq; i++) {
+		tasks += tq->tq_pcq[i].tqp_tasks;
+		steals += tq->tq_pcq[i].tqp_steals;
+		lockwait += tq->tq_pcq[i].tqp_lockwait;
+	}
+
 	tqsp->tq_pid.value.ui64 = tq->tq_proc->p_pid;
-	tqsp->tq_tasks.value.ui64 = tq->tq_tasks;
+	tqsp->tq_tasks.value.ui64 = tasks;
 	tqsp->tq_executed.value.ui64 = tq->tq_executed;
 	tqsp->tq_maxtasks.value.ui64 = tq->tq_maxtasks;
 	tqsp->tq_totaltime.value.ui64 = tq->tq_totaltime;
@@ -2287,6 +2541,8 @@ taskq_kstat_update(kstat_t *ksp, int rw)
 	tqsp->tq_pri.value.ui64 = tq->tq_pri;
 	tqsp->tq_nthreads.value.ui64 = tq->tq_nthreads;
 	tqsp->tq_nomem.value.ui64 = tq->tq_nomem;
+	tqsp->tq_steals.value.ui64 = steals;
+	tqsp->tq_lockwait.value.ui64 = lockwait;
 	return (0);
 }
 
@@ -21,7 +21,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
- * Copyright 2018 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*	Copyright (c) 1984, 1986, 1987, 1988, 1989 AT&T	*/
@@ -58,6 +58,7 @@
 #include <sys/callb.h>
 #include <sys/tnf_probe.h>
 #include <sys/mem_cage.h>
+#include <sys/kstat.h>
 #include <sys/time.h>
 #include <sys/zone.h>
 
@@ -212,6 +213,25 @@ static hrtime_t	pageout_sample_etime = 0;
  */
 uint64_t pageout_timeouts = 0;
 
+/*
+ * Per-scanner statistics, exported as the unix:<inst>:pageout_scanner kstat.
+ * Each instance is only updated by its own scanner thread, once per wakeup
+ * cycle.  The kstat is created when the scanner thread first starts and
+ * survives the thread being stopped when the number of scanners is reduced.
+ */
+typedef struct pscan_kstat {
+	kstat_named_t	pk_runs;	/* wakeup cycles */
+	kstat_named_t	pk_visited;	/* pages visited by the hands */
+	kstat_named_t	pk_scanned;	/* eligible pages scanned */
+	kstat_named_t	pk_freed;	/* pages freed */
+	kstat_named_t	pk_timeouts;	/* cycles ended on the CPU budget */
+	kstat_named_t	pk_wraps;	/* front hand wraparounds */
+	kstat_named_t	pk_time;	/* nsec spent scanning */
+} pscan_kstat_t;
+
+static pscan_kstat_t pscan_kstats[MAX_PSCAN_THREADS];
+static kstat_t *pscan_ksp[MAX_PSCAN_THREADS];
+
 #ifdef VM_STATS
 static struct pageoutvmstats_str {
 	ulong_t	checkpage[3];
@@ -921,6 +941,33 @@ pageout()
 	}
 }
 
+static void
+pscan_kstat_create(uint_t inst)
+{
+	pscan_kstat_t *pk = &pscan_kstats[inst];
+	kstat_t *ksp;
+
+	if (pscan_ksp[inst] != NULL)
+		return;
+
+	kstat_named_init(&pk->pk_runs, "runs", KSTAT_DATA_UINT64);
+	kstat_named_init(&pk->pk_visited, "visited", KSTAT_DATA_UINT64);
+	kstat_named_init(&pk->pk_scanned, "scanned", KSTAT_DATA_UINT64);
+	kstat_named_init(&pk->pk_freed, "freed", KSTAT_DATA_UINT64);
+	kstat_named_init(&pk->pk_timeouts, "timeouts", KSTAT_DATA_UINT64);
+	kstat_named_init(&pk->pk_wraps, "wraps", KSTAT_DATA_UINT64);
+	kstat_named_init(&pk->pk_time, "scan_time", KSTAT_DATA_UINT64);
+
+	ksp = kstat_create("unix", inst, "pageout_scanner", "vm",
+	    KSTAT_TYPE_NAMED, sizeof (pscan_kstat_t) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (ksp != NULL) {
+		ksp->ks_data = pk;
+		kstat_install(ksp);
+	}
+	pscan_ksp[inst] = ksp;
+}
+
 /*
  * Kernel thread that scans pages looking for ones to free
  */
@@ -931,14 +978,20 @@ pageout_scanner(void *a)
 	uint_t count, iter = 0;
 	callb_cpr_t cprinfo;
 	pgcnt_t	nscan_cnt, nscan_limit;
-	pgcnt_t	pcount;
+	pgcnt_t	pcount, nfreed;
 	uint_t inst = (uint_t)(uintptr_t)a;
+	uint_t nwraps;
+	boolean_t timedout;
+	pscan_kstat_t *pk;
 	hrtime_t sample_start, sample_end;
 	clock_t pageout_lbolt;
 	kmutex_t pscan_mutex;
 
 	VERIFY3U(inst, <, MAX_PSCAN_THREADS);
 
+	pscan_kstat_create(inst);
+	pk = &pscan_kstats[inst];
+
 	mutex_init(&pscan_mutex, NULL, MUTEX_DEFAULT, NULL);
 
 	CALLB_CPR_INIT(&cprinfo, &pscan_mutex, callb_generic_cpr, "poscan");
@@ -1011,6 +1064,9 @@ loop:
 
 	pcount = 0;
 	nscan_cnt = 0;
+	nfreed = 0;
+	nwraps = 0;
+	timedout = B_FALSE;
 	if (PAGE_SCAN_STARTUP) {
 		nscan_limit = total_pages;
 	} else {
@@ -1055,6 +1111,7 @@ loop:
 				if (!zones_over) {
 					atomic_inc_64(&pageout_timeouts);
 				}
+				timedout = B_TRUE;
 				DTRACE_PROBE1(pageout__timeout, uint_t, inst);
 				break;
 			}
@@ -1064,10 +1121,14 @@ loop:
 		 * If checkpage manages to add a page to the free list,
 		 * we give ourselves another couple of trips around memory.
 		 */
-		if ((rvfront = checkpage(fronthand, FRONT)) == 1)
+		if ((rvfront = checkpage(fronthand, FRONT)) == 1) {
 			count = 0;
-		if ((rvback = checkpage(backhand, BACK)) == 1)
+			nfreed++;
+		}
+		if ((rvback = checkpage(backhand, BACK)) == 1) {
 			count = 0;
+			nfreed++;
+		}
 
 		++pcount;
 
@@ -1092,6 +1153,7 @@ loop:
 
 		if ((fronthand = page_next(fronthand)) == page_first())	{
 			DTRACE_PROBE1(pageout__wrap__front, uint_t, inst);
+			nwraps++;
 
 			/*
 			 * Every 64 wraps we reposition our hands within our
@@ -1144,6 +1206,15 @@ loop:
 
 	sample_end = gethrtime();
 
+	pk->pk_runs.value.ui64++;
+	pk->pk_visited.value.ui64 += pcount;
+	pk->pk_scanned.value.ui64 += nscan_cnt;
+	pk->pk_freed.value.ui64 += nfreed;
+	pk->pk_wraps.value.ui64 += nwraps;
+	pk->pk_time.value.ui64 += sample_end - sample_start;
+	if (timedout)
+		pk->pk_timeouts.value.ui64++;
+
 	DTRACE_PROBE3(pageout__loop__end, pgcnt_t, nscan_cnt, pgcnt_t, pcount,
 	    uint_t, inst);
 
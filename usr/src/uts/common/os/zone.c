@@ -21,7 +21,7 @@
 
 /*
  * Copyright (c) 2003, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2016 by Delphix. All rights reserved.
  * Copyright 2018 OmniOS Community Edition (OmniOSce) Association.
  */
@@ -252,6 +252,7 @@
 #include <sys/zone.h>
 #include <net/if.h>
 #include <sys/cpucaps.h>
+#include <sys/dnlc.h>
 #include <vm/seg.h>
 #include <sys/mac.h>
 #include <sys/rt.h>
@@ -383,7 +384,11 @@ rctl_hndl_t rc_zone_max_lofi;
 rctl_hndl_t rc_zone_cpu_cap;
 rctl_hndl_t rc_zone_cpu_baseline;
 rctl_hndl_t rc_zone_cpu_burst_time;
+rctl_hndl_t rc_zone_cpu_burst_credit;
 rctl_hndl_t rc_zone_zfs_io_pri;
+rctl_hndl_t rc_zone_zfs_io_lat_target;
+rctl_hndl_t rc_zone_zfs_io_iops_floor;
+rctl_hndl_t rc_zone_zfs_io_bw_floor;
 rctl_hndl_t rc_zone_nlwps;
 rctl_hndl_t rc_zone_nprocs;
 rctl_hndl_t rc_zone_shmmax;
@@ -1522,6 +1527,42 @@ static rctl_ops_t zone_cpu_burst_time_ops = {
 	rcop_no_test
 };
 
+/*ARGSUSED*/
+static rctl_qty_t
+zone_cpu_burst_credit_get(rctl_t *rctl, struct proc *p)
+{
+	ASSERT(MUTEX_HELD(&p->p_lock));
+	return (cpucaps_zone_get_burst_credit(p->p_zone));
+}
+
+/*
+ * The zone cpu burst credit is the amount of unused capped CPU time, in
+ * seconds at the cap rate, that the zone can bank and later spend running
+ * above its cap while there is idle CPU.
+ */
+/*ARGSUSED*/
+static int
+zone_cpu_burst_credit_set(rctl_t *rctl, struct proc *p, rctl_entity_p_t *e,
+    rctl_qty_t nv)
+{
+	zone_t *zone = e->rcep_p.zone;
+
+	ASSERT(MUTEX_HELD(&p->p_lock));
+	ASSERT(e->rcep_t == RCENTITY_ZONE);
+
+	if (zone == NULL)
+		return (0);
+
+	return (cpucaps_zone_set_burst_credit(zone, nv));
+}
+
+static rctl_ops_t zone_cpu_burst_credit_ops = {
+	rcop_no_action,
+	zone_cpu_burst_credit_get,
+	zone_cpu_burst_credit_set,
+	rcop_no_test
+};
+
 /*
  * zone.zfs-io-pri resource control support (IO priority).
  */
@@ -1573,6 +1614,147 @@ static rctl_ops_t zone_zfs_io_pri_ops = {
 	rcop_no_test
 };
 
+/*
+ * zone.zfs-io-latency-target, zone.zfs-io-iops-floor and
+ * zone.zfs-io-bandwidth-floor resource control support.  These are only
+ * consulted by the ZFS I/O scheduler when zfs_zone_qos_enable is set; a value
+ * of zero means the zone has no target or floor.
+ */
+/*ARGSUSED*/
+static rctl_qty_t
+zone_zfs_io_lat_target_get(rctl_t *rctl, struct proc *p)
+{
+	zone_persist_t *zp = &zone_pdata[p->p_zone->zone_id];
+	rctl_qty_t r = 0;
+
+	ASSERT(MUTEX_HELD(&p->p_lock));
+	mutex_enter(&zp->zpers_zfs_lock);
+	if (zp->zpers_zfsp != NULL)
+		r = (rctl_qty_t)zp->zpers_zfsp->zpers_qos_lat_target;
+	mutex_exit(&zp->zpers_zfs_lock);
+
+	return (r);
+}
+
+/*ARGSUSED*/
+static int
+zone_zfs_io_lat_target_set(rctl_t *rctl, struct proc *p, rctl_entity_p_t *e,
+    rctl_qty_t nv)
+{
+	zone_t *zone = e->rcep_p.zone;
+	zone_persist_t *zp;
+
+	ASSERT(MUTEX_HELD(&p->p_lock));
+	ASSERT(e->rcep_t == RCENTITY_ZONE);
+
+	if (zone == NULL)
+		return (0);
+
+	zp = &zone_pdata[zone->zone_id];
+	mutex_enter(&zp->zpers_zfs_lock);
+	if (zp->zpers_zfsp != NULL)
+		zp->zpers_zfsp->zpers_qos_lat_target = (uint32_t)nv;
+	mutex_exit(&zp->zpers_zfs_lock);
+	return (0);
+}
+
+static rctl_ops_t zone_zfs_io_lat_target_ops = {
+	rcop_no_action,
+	zone_zfs_io_lat_target_get,
+	zone_zfs_io_lat_target_set,
+	rcop_no_test
+};
+
+/*ARGSUSED*/
+static rctl_qty_t
+zone_zfs_io_iops_floor_get(rctl_t *rctl, struct proc *p)
+{
+	zone_persist_t *zp = &zone_pdata[p->p_zone->zone_id];
+	rctl_qty_t r = 0;
+
+	ASSERT(MUTEX_HELD(&p->p_lock));
+	mutex_enter(&zp->zpers_zfs_lock);
+	if (zp->zpers_zfsp != NULL)
+		r = (rctl_qty_t)zp->zpers_zfsp->zpers_qos_iops_floor;
+	mutex_exit(&zp->zpers_zfs_lock);
+
+	return (r);
+}
+
+/*ARGSUSED*/
+static int
+zone_zfs_io_iops_floor_set(rctl_t *rctl, struct proc *p, rctl_entity_p_t *e,
+    rctl_qty_t nv)
+{
+	zone_t *zone = e->rcep_p.zone;
+	zone_persist_t *zp;
+
+	ASSERT(MUTEX_HELD(&p->p_lock));
+	ASSERT(e->rcep_t == RCENTITY_ZONE);
+
+	if (zone == NULL)
+		return (0);
+
+	zp = &zone_pdata[zone->zone_id];
+	mutex_enter(&zp->zpers_zfs_lock);
+	if (zp->zpers_zfsp != NULL)
+		zp->zpers_zfsp->zpers_qos_iops_floor = (uint32_t)nv;
+	mutex_exit(&zp->zpers_zfs_lock);
+	return (0);
+}
+
+static rctl_ops_t zone_zfs_io_iops_floor_ops = {
+	rcop_no_action,
+	zone_zfs_io_iops_floor_get,
+	zone_zfs_io_iops_floor_set,
+	rcop_no_test
+};
+
+/*ARGSUSED*/
+static rctl_qty_t
+zone_zfs_io_bw_floor_get(rctl_t *rctl, struct proc *p)
+{
+	zone_persist_t *zp = &zone_pdata[p->p_zone->zone_id];
+	rctl_qty_t r = 0;
+
+	ASSERT(MUTEX_HELD(&p->p_lock));
+	mutex_enter(&zp->zpers_zfs_lock);
+	if (zp->zpers_zfsp != NULL)
+		r = (rctl_qty_t)zp->zpers_zfsp->zpers_qos_bw_floor;
+	mutex_exit(&zp->zpers_zfs_lock);
+
+	return (r);
+}
+
+/*ARGSUSED*/
+static int
+zone_zfs_io_bw_floor_set(rctl_t *rctl, struct proc *p, rctl_entity_p_t *e,
+    rctl_qty_t nv)
+{
+	zone_t *zone = e->rcep_p.zone;
+	zone_persist_t *zp;
+
+	ASSERT(MUTEX_HELD(&p->p_lock));
+	ASSERT(e->rcep_t == RCENTITY_ZONE);
+
+	if (zone == NULL)
+		return (0);
+
+	zp = &zone_pdata[zone->zone_id];
+	mutex_enter(&zp->zpers_zfs_lock);
+	if (zp->zpers_zfsp != NULL)
+		zp->zpers_zfsp->zpers_qos_bw_floor = (uint64_t)nv;
+	mutex_exit(&zp->zpers_zfs_lock);
+	return (0);
+}
+
+static rctl_ops_t zone_zfs_io_bw_floor_ops = {
+	rcop_no_action,
+	zone_zfs_io_bw_floor_get,
+	zone_zfs_io_bw_floor_set,
+	rcop_no_test
+};
+
 /*ARGSUSED*/
 static rctl_qty_t
 zone_lwps_usage(rctl_t *r, proc_t *p)
@@ -2204,6 +2386,7 @@ zone_zfs_kstat_update(kstat_t *ksp, int rw)
 	zone_t *zone = ksp->ks_private;
 	zone_zfs_kstat_t *zzp = ksp->ks_data;
 	zone_persist_t *zp = &zone_pdata[zone->zone_id];
+	uint_t i;
 
 	if (rw == KSTAT_WRITE)
 		return (EACCES);
@@ -2217,7 +2400,14 @@ zone_zfs_kstat_update(kstat_t *ksp, int rw)
 		zzp->zz_nwritten.value.ui64 = 0;
 		zzp->zz_writes.value.ui64 = 0;
 		zzp->zz_waittime.value.ui64 = 0;
+		zzp->zz_qos_slo_miss.value.ui64 = 0;
+		zzp->zz_qos_qtime_avg.value.ui64 = 0;
+		for (i = 0; i < ZONE_ZFS_QTIME_BUCKETS; i++) {
+			zzp->zz_rd_qtime[i].value.ui64 = 0;
+			zzp->zz_wr_qtime[i].value.ui64 = 0;
+		}
 	} else {
+		zone_zfs_io_t *iop = zp->zpers_zfsp;
 		kstat_io_t *kiop = &zp->zpers_zfsp->zpers_zfs_rwstats;
 
 		/*
@@ -2237,6 +2427,14 @@ zone_zfs_kstat_update(kstat_t *ksp, int rw)
 		zzp->zz_writes.value.ui64 = kiop->writes;
 		zzp->zz_waittime.value.ui64 =
 		    zp->zpers_zfsp->zpers_zfs_rd_waittime;
+		zzp->zz_qos_slo_miss.value.ui64 = iop->zpers_qos_slo_miss;
+		zzp->zz_qos_qtime_avg.value.ui64 = iop->zpers_qos_qtime_avg;
+		for (i = 0; i < ZONE_ZFS_QTIME_BUCKETS; i++) {
+			zzp->zz_rd_qtime[i].value.ui64 =
+			    iop->zpers_qos_qtime_hist[0][i];
+			zzp->zz_wr_qtime[i].value.ui64 =
+			    iop->zpers_qos_qtime_hist[1][i];
+		}
 	}
 	mutex_exit(&zp->zpers_zfs_lock);
 
@@ -2251,6 +2449,7 @@ zone_zfs_kstat_create(zone_t *zone)
 {
 	kstat_t *ksp;
 	zone_zfs_kstat_t *zzp;
+	uint_t i;
 
 	if ((ksp = kstat_create_zone("zone_zfs", zone->zone_id,
 	    zone->zone_name, "zone_zfs", KSTAT_TYPE_NAMED,
@@ -2276,6 +2475,20 @@ zone_zfs_kstat_create(zone_t *zone)
 	kstat_named_init(&zzp->zz_nwritten, "nwritten", KSTAT_DATA_UINT64);
 	kstat_named_init(&zzp->zz_writes, "writes", KSTAT_DATA_UINT64);
 	kstat_named_init(&zzp->zz_waittime, "waittime", KSTAT_DATA_UINT64);
+	kstat_named_init(&zzp->zz_qos_slo_miss, "qos_slo_miss",
+	    KSTAT_DATA_UINT64);
+	kstat_named_init(&zzp->zz_qos_qtime_avg, "qos_qtime_avg",
+	    KSTAT_DATA_UINT64);
+	for (i = 0; i < ZONE_ZFS_QTIME_BUCKETS; i++) {
+		char name[KSTAT_STRLEN];
+
+		(void) snprintf(name, sizeof (name), "rd_qtime_%lluus",
+		    1ULL << i);
+		kstat_named_init(&zzp->zz_rd_qtime[i], name, KSTAT_DATA_UINT64);
+		(void) snprintf(name, sizeof (name), "wr_qtime_%lluus",
+		    1ULL << i);
+		kstat_named_init(&zzp->zz_wr_qtime[i], name, KSTAT_DATA_UINT64);
+	}
 
 	ksp->ks_update = zone_zfs_kstat_update;
 	ksp->ks_private = zone;
@@ -2284,12 +2497,121 @@ zone_zfs_kstat_create(zone_t *zone)
 	return (ksp);
 }
 
+/*
+ * Map a latency, in nanoseconds, to its zone_lat histogram bucket.
+ */
+uint_t
+zone_lat_bucket(hrtime_t lat)
+{
+	uint64_t usec;
+
+	if (lat <= 0)
+		return (0);
+
+	usec = NSEC2USEC(lat);
+	return (MIN(usec == 0 ? 0 : highbit64(usec) - 1, ZONE_LAT_BUCKETS - 1));
+}
+
+void
+zone_lat_vfs_record(zone_t *zone, zone_lat_vfs_t op, hrtime_t lat)
+{
+	ASSERT3U(op, <, ZONE_LAT_VFS_NOPS);
+	atomic_inc_64(&zone->zone_vfs_lat[op][zone_lat_bucket(lat)]);
+}
+
+static int
+zone_lat_kstat_update(kstat_t *ksp, int rw)
+{
+	zone_t *zone = ksp->ks_private;
+	zone_lat_kstat_t *zlp = ksp->ks_data;
+	zone_persist_t *zp = &zone_pdata[zone->zone_id];
+	uint_t i, j;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	for (i = 0; i < ZONE_LAT_VFS_NOPS; i++) {
+		for (j = 0; j < ZONE_LAT_BUCKETS; j++) {
+			zlp->zl_vfs[i][j].value.ui64 =
+			    zone->zone_vfs_lat[i][j];
+		}
+	}
+
+	mutex_enter(&zp->zpers_zfs_lock);
+	for (i = 0; i < ZONE_LAT_ZIO_NCLASS; i++) {
+		for (j = 0; j < ZONE_LAT_BUCKETS; j++) {
+			zlp->zl_zio[i][j].value.ui64 = zp->zpers_zfsp == NULL ?
+			    0 : zp->zpers_zfsp->zpers_zio_lat[i][j];
+		}
+	}
+	mutex_exit(&zp->zpers_zfs_lock);
+
+	return (0);
+}
+
+static kstat_t *
+zone_lat_kstat_create(zone_t *zone)
+{
+	static const char *vfs_ops[ZONE_LAT_VFS_NOPS] = {
+		"read", "write", "fsync"
+	};
+	static const char *zio_classes[ZONE_LAT_ZIO_NCLASS] = {
+		"normal", "log", "special", "dedup"
+	};
+	char name[KSTAT_STRLEN];
+	zone_lat_kstat_t *zlp;
+	kstat_t *ksp;
+	uint_t i, j;
+
+	if ((ksp = kstat_create_zone("zone_lat", zone->zone_id,
+	    zone->zone_name, "zone_lat", KSTAT_TYPE_NAMED,
+	    sizeof (zone_lat_kstat_t) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL, zone->zone_id)) == NULL)
+		return (NULL);
+
+	if (zone->zone_id != GLOBAL_ZONEID)
+		kstat_zone_add(ksp, GLOBAL_ZONEID);
+
+	zlp = ksp->ks_data = kmem_zalloc(sizeof (zone_lat_kstat_t), KM_SLEEP);
+	ksp->ks_data_size += strlen(zone->zone_name) + 1;
+	ksp->ks_lock = &zone->zone_lat_lock;
+
+	/* The kstat "name" field is not large enough for a full zonename */
+	kstat_named_init(&zlp->zl_zonename, "zonename", KSTAT_DATA_STRING);
+	kstat_named_setstr(&zlp->zl_zonename, zone->zone_name);
+
+	for (i = 0; i < ZONE_LAT_VFS_NOPS; i++) {
+		for (j = 0; j < ZONE_LAT_BUCKETS; j++) {
+			(void) snprintf(name, sizeof (name), "vfs_%s_%lluus",
+			    vfs_ops[i], 1ULL << j);
+			kstat_named_init(&zlp->zl_vfs[i][j], name,
+			    KSTAT_DATA_UINT64);
+		}
+	}
+
+	for (i = 0; i < ZONE_LAT_ZIO_NCLASS; i++) {
+		for (j = 0; j < ZONE_LAT_BUCKETS; j++) {
+			(void) snprintf(name, sizeof (name), "zio_%s_%lluus",
+			    zio_classes[i], 1ULL << j);
+			kstat_named_init(&zlp->zl_zio[i][j], name,
+			    KSTAT_DATA_UINT64);
+		}
+	}
+
+	ksp->ks_update = zone_lat_kstat_update;
+	ksp->ks_private = zone;
+
+	kstat_install(ksp);
+	return (ksp);
+}
+
 static int
 zone_mcap_kstat_update(kstat_t *ksp, int rw)
 {
 	zone_t *zone = ksp->ks_private;
 	zone_mcap_kstat_t *zmp = ksp->ks_data;
 	zone_persist_t *zp;
+	uint64_t over, over_max;
 
 	if (rw == KSTAT_WRITE)
 		return (EACCES);
@@ -2301,6 +2623,24 @@ zone_mcap_kstat_update(kstat_t *ksp, int rw)
 	zmp->zm_swap.value.ui64 = zone->zone_max_swap;
 	zmp->zm_swap_cap.value.ui64 = zone->zone_max_swap_ctl;
 	zmp->zm_nover.value.ui64 = zp->zpers_nover;
+
+	/*
+	 * The time taken to reclaim enough pages to bring the zone back
+	 * under its cap, in total and for the longest episode.  Include the
+	 * episode in progress, if any.
+	 */
+	mutex_enter(&zone_physcap_lock);
+	over = zp->zpers_over_time;
+	over_max = zp->zpers_over_max;
+	if (zp->zpers_over == 1) {
+		hrtime_t cur = gethrtime() - zp->zpers_over_start;
+
+		over += cur;
+		over_max = MAX(over_max, cur);
+	}
+	mutex_exit(&zone_physcap_lock);
+	zmp->zm_reclaim_usec.value.ui64 = NSEC2USEC(over);
+	zmp->zm_reclaim_max_usec.value.ui64 = NSEC2USEC(over_max);
 #ifndef DEBUG
 	zmp->zm_pagedout.value.ui64 = ptob(zp->zpers_pg_out);
 #else
@@ -2344,6 +2684,10 @@ zone_mcap_kstat_create(zone_t *zone)
 	kstat_named_init(&zmp->zm_swap, "swap", KSTAT_DATA_UINT64);
 	kstat_named_init(&zmp->zm_swap_cap, "swapcap", KSTAT_DATA_UINT64);
 	kstat_named_init(&zmp->zm_nover, "nover", KSTAT_DATA_UINT64);
+	kstat_named_init(&zmp->zm_reclaim_usec, "reclaim_usec",
+	    KSTAT_DATA_UINT64);
+	kstat_named_init(&zmp->zm_reclaim_max_usec, "reclaim_max_usec",
+	    KSTAT_DATA_UINT64);
 	kstat_named_init(&zmp->zm_pagedout, "pagedout", KSTAT_DATA_UINT64);
 	kstat_named_init(&zmp->zm_pgpgin, "pgpgin", KSTAT_DATA_UINT64);
 	kstat_named_init(&zmp->zm_anonpgin, "anonpgin", KSTAT_DATA_UINT64);
@@ -2402,6 +2746,9 @@ zone_misc_kstat_update(kstat_t *ksp, int rw)
 	zmp->zm_init_restarts.value.ui32 = zone->zone_proc_init_restarts;
 	zmp->zm_boot_time.value.ui64 = (uint64_t)zone->zone_boot_time;
 
+	zmp->zm_lpg_promote.value.ui32 = zone->zone_lpg_promote_ok;
+	zmp->zm_lpg_promote_fail.value.ui32 = zone->zone_lpg_promote_fail;
+
 	return (0);
 }
 
@@ -2448,6 +2795,10 @@ zone_misc_kstat_create(zone_t *zone)
 	kstat_named_init(&zmp->zm_init_restarts, "init_restarts",
 	    KSTAT_DATA_UINT32);
 	kstat_named_init(&zmp->zm_boot_time, "boot_time", KSTAT_DATA_UINT64);
+	kstat_named_init(&zmp->zm_lpg_promote, "lpg_promote",
+	    KSTAT_DATA_UINT32);
+	kstat_named_init(&zmp->zm_lpg_promote_fail, "lpg_promote_fail",
+	    KSTAT_DATA_UINT32);
 
 	ksp->ks_update = zone_misc_kstat_update;
 	ksp->ks_private = zone;
@@ -2478,6 +2829,8 @@ zone_kstat_create(zone_t *zone)
 		    sizeof (zone_zfs_kstat_t), KM_SLEEP);
 	}
 
+	zone->zone_lat_ksp = zone_lat_kstat_create(zone);
+
 	if ((zone->zone_mcap_ksp = zone_mcap_kstat_create(zone)) == NULL) {
 		zone->zone_mcap_stats = kmem_zalloc(
 		    sizeof (zone_mcap_kstat_t), KM_SLEEP);
@@ -2518,6 +2871,8 @@ zone_kstat_delete(zone_t *zone)
 	    sizeof (zone_vfs_kstat_t));
 	zone_kstat_delete_common(&zone->zone_zfs_ksp,
 	    sizeof (zone_zfs_kstat_t));
+	zone_kstat_delete_common(&zone->zone_lat_ksp,
+	    sizeof (zone_lat_kstat_t));
 	zone_kstat_delete_common(&zone->zone_mcap_ksp,
 	    sizeof (zone_mcap_kstat_t));
 	zone_kstat_delete_common(&zone->zone_misc_ksp,
@@ -2662,11 +3017,17 @@ hash_labelkey_cmp(mod_hash_key_t key1, mod_hash_key_t key2)
 void
 zone_init(void)
 {
+	static const char *zfs_qos_rctls[] = {
+		"zone.zfs-io-latency-target",
+		"zone.zfs-io-iops-floor",
+		"zone.zfs-io-bandwidth-floor"
+	};
 	rctl_dict_entry_t *rde;
 	rctl_val_t *dval;
 	rctl_set_t *set;
 	rctl_alloc_gp_t *gp;
 	rctl_entity_p_t e;
+	uint_t i;
 	int res;
 
 	ASSERT(curproc == &p0);
@@ -2701,11 +3062,31 @@ zone_init(void)
 	    RCTL_GLOBAL_NOBASIC | RCTL_GLOBAL_COUNT | RCTL_GLOBAL_SYSLOG_NEVER,
 	    INT_MAX, INT_MAX, &zone_cpu_burst_time_ops);
 
+	rc_zone_cpu_burst_credit = rctl_register("zone.cpu-burst-credit",
+	    RCENTITY_ZONE, RCTL_GLOBAL_SIGNAL_NEVER | RCTL_GLOBAL_DENY_NEVER |
+	    RCTL_GLOBAL_NOBASIC | RCTL_GLOBAL_COUNT | RCTL_GLOBAL_SYSLOG_NEVER,
+	    INT_MAX, INT_MAX, &zone_cpu_burst_credit_ops);
+
 	rc_zone_zfs_io_pri = rctl_register("zone.zfs-io-priority",
 	    RCENTITY_ZONE, RCTL_GLOBAL_SIGNAL_NEVER | RCTL_GLOBAL_DENY_NEVER |
 	    RCTL_GLOBAL_NOBASIC | RCTL_GLOBAL_COUNT | RCTL_GLOBAL_SYSLOG_NEVER,
 	    16384, 16384, &zone_zfs_io_pri_ops);
 
+	rc_zone_zfs_io_lat_target = rctl_register("zone.zfs-io-latency-target",
+	    RCENTITY_ZONE, RCTL_GLOBAL_SIGNAL_NEVER | RCTL_GLOBAL_DENY_NEVER |
+	    RCTL_GLOBAL_NOBASIC | RCTL_GLOBAL_COUNT | RCTL_GLOBAL_SYSLOG_NEVER,
+	    UINT32_MAX, UINT32_MAX, &zone_zfs_io_lat_target_ops);
+
+	rc_zone_zfs_io_iops_floor = rctl_register("zone.zfs-io-iops-floor",
+	    RCENTITY_ZONE, RCTL_GLOBAL_SIGNAL_NEVER | RCTL_GLOBAL_DENY_NEVER |
+	    RCTL_GLOBAL_NOBASIC | RCTL_GLOBAL_COUNT | RCTL_GLOBAL_SYSLOG_NEVER,
+	    UINT32_MAX, UINT32_MAX, &zone_zfs_io_iops_floor_ops);
+
+	rc_zone_zfs_io_bw_floor = rctl_register("zone.zfs-io-bandwidth-floor",
+	    RCENTITY_ZONE, RCTL_GLOBAL_SIGNAL_NEVER | RCTL_GLOBAL_DENY_NEVER |
+	    RCTL_GLOBAL_NOBASIC | RCTL_GLOBAL_BYTES | RCTL_GLOBAL_SYSLOG_NEVER,
+	    UINT64_MAX, UINT64_MAX, &zone_zfs_io_bw_floor_ops);
+
 	rc_zone_nlwps = rctl_register("zone.max-lwps", RCENTITY_ZONE,
 	    RCTL_GLOBAL_NOACTION | RCTL_GLOBAL_NOBASIC | RCTL_GLOBAL_COUNT,
 	    INT_MAX, INT_MAX, &zone_lwps_ops);
@@ -2761,6 +3142,23 @@ zone_init(void)
 	rde = rctl_dict_lookup("zone.zfs-io-priority");
 	(void) rctl_val_list_insert(&rde->rcd_default_value, dval);
 
+	/*
+	 * The ZFS QoS targets and floors default to zero (none), rather than
+	 * the maximum value, so that a zone does not claim a reservation
+	 * unless one has been configured.
+	 */
+	for (i = 0; i < ARRAY_SIZE(zfs_qos_rctls); i++) {
+		dval = kmem_cache_alloc(rctl_val_cache, KM_SLEEP);
+		bzero(dval, sizeof (rctl_val_t));
+		dval->rcv_value = 0;
+		dval->rcv_privilege = RCPRIV_PRIVILEGED;
+		dval->rcv_flagaction = RCTL_LOCAL_NOACTION;
+		dval->rcv_action_recip_pid = -1;
+
+		rde = rctl_dict_lookup(zfs_qos_rctls[i]);
+		(void) rctl_val_list_insert(&rde->rcd_default_value, dval);
+	}
+
 	rc_zone_locked_mem = rctl_register("zone.max-locked-memory",
 	    RCENTITY_ZONE, RCTL_GLOBAL_NOBASIC | RCTL_GLOBAL_BYTES |
 	    RCTL_GLOBAL_DENY_ALWAYS, UINT64_MAX, UINT64_MAX,
@@ -6043,6 +6441,9 @@ zone_destroy(zoneid_t zoneid)
 		    (mod_hash_key_t)zone->zone_slabel);
 	mutex_exit(&zonehash_lock);
 
+	/* Drop whatever the zone still has in the name cache. */
+	dnlc_zone_fini(zone);
+
 	/*
 	 * Release the root vnode; we're not using it anymore.  Nor should any
 	 * other thread that might access it exist.
@@ -6365,6 +6766,15 @@ zone_getattr(zoneid_t zoneid, int attr, void *buf, size_t bufsize)
 		    bufsize) != 0)
 			error = EFAULT;
 		break;
+	case ZONE_ATTR_LPG_PROMOTE:
+		size = sizeof (boolean_t);
+		if (bufsize > size)
+			bufsize = size;
+
+		if (buf != NULL && copyout(&zone->zone_lpg_promote, buf,
+		    bufsize) != 0)
+			error = EFAULT;
+		break;
 	default:
 		if ((attr >= ZONE_ATTR_BRAND_ATTRS) && ZONE_IS_BRANDED(zone)) {
 			size = bufsize;
@@ -6491,6 +6901,14 @@ zone_setattr(zoneid_t zoneid, int attr, void *buf, size_t bufsize)
 			err = 0;
 		}
 		break;
+	case ZONE_ATTR_LPG_PROMOTE:
+		if (bufsize != sizeof (boolean_t)) {
+			err = EINVAL;
+		} else {
+			zone->zone_lpg_promote = (boolean_t)buf;
+			err = 0;
+		}
+		break;
 	default:
 		if ((attr >= ZONE_ATTR_BRAND_ATTRS) && ZONE_IS_BRANDED(zone))
 			err = ZBROP(zone)->b_setattr(zone, attr, buf, bufsize);
@@ -8214,6 +8632,7 @@ zone_incr_capped(zoneid_t zid)
 	if (zp->zpers_pg_cnt > zp->zpers_pg_limit && zp->zpers_over == 0) {
 		zp->zpers_over = 1;
 		zp->zpers_nover++;
+		zp->zpers_over_start = gethrtime();
 		zone_num_over_cap++;
 		DTRACE_PROBE1(zone__over__pcap, zoneid_t, zid);
 	}
@@ -8263,7 +8682,11 @@ zone_decr_capped(zoneid_t zid)
 	mutex_enter(&zone_physcap_lock);
 	/* Recheck under mutex. */
 	if (zp->zpers_pg_cnt < adjusted_limit && zp->zpers_over == 1) {
+		hrtime_t over = gethrtime() - zp->zpers_over_start;
+
 		zp->zpers_over = 0;
+		zp->zpers_over_time += over;
+		zp->zpers_over_max = MAX(zp->zpers_over_max, over);
 		ASSERT(zone_num_over_cap > 0);
 		zone_num_over_cap--;
 		DTRACE_PROBE1(zone__under__pcap, zoneid_t, zid);
@@ -8426,3 +8849,24 @@ zone_get_physmem_data(int zid, pgcnt_t *memcap, pgcnt_t *free)
 		}
 	}
 }
+
+/*
+ * Return a snapshot of the zone's ZFS read/write counters.  The counters are
+ * zeroed if the zone has no ZFS I/O data.
+ */
+void
+zone_get_zfs_iostats(int zid, kstat_io_t *kiop)
+{
+	zone_persist_t *zp;
+
+	ASSERT(zid >= 0 && zid <= MAX_ZONEID);
+	zp = &zone_pdata[zid];
+
+	mutex_enter(&zp->zpers_zfs_lock);
+	if (zp->zpers_zfsp == NULL) {
+		bzero(kiop, sizeof (*kiop));
+	} else {
+		*kiop = zp->zpers_zfsp->zpers_zfs_rwstats;
+	}
+	mutex_exit(&zp->zpers_zfs_lock);
+}
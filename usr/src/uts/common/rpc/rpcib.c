@@ -21,6 +21,7 @@
 /*
  * Copyright (c) 2007, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright 2013 Nexenta Systems, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -5035,6 +5036,25 @@ rib_force_cleanup(void *hca)
 		    (void *)hca, DDI_NOSLEEP);
 }
 
+/*
+ * Long buffers are cached, still registered, by exact size.  The size of a
+ * READ reply's buffer is that of the write chunks offered by the client,
+ * which varies from request to request, so caching exact sizes gets few
+ * hits and most replies pay for a registration and deregistration.  Round
+ * sizes up to one of four classes per power of two instead, wasting at most
+ * a quarter of a buffer, so that buffers and their registrations are reused.
+ */
+static uint32_t
+rib_cache_buf_len(uint32_t len)
+{
+	uint32_t gran;
+
+	if (len <= PAGESIZE)
+		return (PAGESIZE);
+	gran = MAX(PAGESIZE, 1U << (highbit(len - 1) - 3));
+	return (P2ROUNDUP(len, gran));
+}
+
 static rib_lrc_entry_t *
 rib_get_cache_buf(CONN *conn, uint32_t len)
 {
@@ -5044,6 +5064,8 @@ rib_get_cache_buf(CONN *conn, uint32_t len)
 	avl_index_t where = (uintptr_t)NULL;
 	uint64_t c_alloc = 0;
 
+	len = rib_cache_buf_len(len);
+
 	if (!hca->avl_init)
 		goto  error_alloc;
 
@@ -23,6 +23,7 @@
  * Copyright 2012 Marcel Telka <marcel@telka.sk>
  * Copyright 2015 Nexenta Systems, Inc.  All rights reserved.
  * Copyright 2018 OmniOS Community Edition (OmniOSce) Association.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -206,6 +207,9 @@
 #include <sys/callb.h>
 #include <sys/vtrace.h>
 #include <sys/zone.h>
+#include <sys/cpuvar.h>
+#include <sys/kstat.h>
+#include <sys/atomic.h>
 #include <nfs/nfs.h>
 #include <sys/tsol/label_macro.h>
 
@@ -232,12 +236,20 @@ int    svc_default_stksize = DEFAULT_SVC_RUN_STKSIZE;
 clock_t svc_default_timeout = DEFAULT_SVC_POLL_TIMEOUT;
 
 /*
- * Size of the `xprt-ready' queue.
+ * Size of each shard of the `xprt-ready' queue.
  */
 #define	DEFAULT_SVC_QSIZE		(256)	/* qnodes */
 
 size_t svc_default_qsize = DEFAULT_SVC_QSIZE;
 
+/*
+ * Maximum number of `xprt-ready' queue shards per pool.  A pool gets one
+ * shard per CPU, up to this limit; setting it to 1 restores a single queue.
+ */
+#define	DEFAULT_SVC_MAX_QSHARDS		(64)
+
+uint_t svc_max_qshards = DEFAULT_SVC_MAX_QSHARDS;
+
 /*
  * Default limit for the number of service threads.
  */
@@ -269,8 +281,55 @@ int    svc_default_redline = DEFAULT_SVC_REDLINE;
 struct __svcxprt_qnode {
 	__SVCXPRT_QNODE	*q_next;
 	SVCMASTERXPRT	*q_xprt;
+	hrtime_t	q_time;		/* When the hint was queued */
+};
+
+/*
+ * A shard of the `xprt-ready' queue.  Both ends of the FIFO and the
+ * statistics are protected by qs_lock.  Shards are padded to keep the
+ * locks of different CPUs on different cache lines.
+ */
+struct __svcxprt_qshard {
+	kmutex_t	qs_lock;
+	__SVCXPRT_QNODE	*qs_body;	/* Queue body (array) */
+	__SVCXPRT_QNODE	*qs_top;	/* Writer's end of FIFO */
+	__SVCXPRT_QNODE	*qs_end;	/* Reader's end of FIFO */
+	uint64_t	qs_puts;	/* Hints queued */
+	uint64_t	qs_local;	/* Hints taken on the same CPU */
+	uint64_t	qs_remote;	/* Hints taken from another CPU */
+	uint64_t	qs_overflows;	/* Hints dropped, shard full */
+	hrtime_t	qs_wait;	/* Total time hints were queued */
+	hrtime_t	qs_maxwait;	/* Longest time a hint was queued */
+	uint64_t	qs_pad[6];
+};
+
+/*
+ * Per-pool `xprt-ready' queue statistics, summed over the shards.
+ */
+typedef struct svc_pool_kstat {
+	kstat_named_t	spk_id;
+	kstat_named_t	spk_shards;
+	kstat_named_t	spk_puts;
+	kstat_named_t	spk_local;
+	kstat_named_t	spk_remote;
+	kstat_named_t	spk_overflows;
+	kstat_named_t	spk_wait;
+	kstat_named_t	spk_maxwait;
+} svc_pool_kstat_t;
+
+static const svc_pool_kstat_t svc_pool_kstat_template = {
+	{ "pool_id",		KSTAT_DATA_INT32 },
+	{ "queue_shards",	KSTAT_DATA_UINT32 },
+	{ "hints_queued",	KSTAT_DATA_UINT64 },
+	{ "hints_local",	KSTAT_DATA_UINT64 },
+	{ "hints_remote",	KSTAT_DATA_UINT64 },
+	{ "hints_overflowed",	KSTAT_DATA_UINT64 },
+	{ "queue_wait_ns",	KSTAT_DATA_UINT64 },
+	{ "queue_maxwait_ns",	KSTAT_DATA_UINT64 },
 };
 
+static uint32_t svc_pool_kstat_instance;
+
 /*
  * Global SVC variables (private).
  */
@@ -389,7 +448,9 @@ svc_pool_cleanup(SVCPOOL *pool)
 	if (pool->p_shutdown != NULL)
 		(pool->p_shutdown)();
 
-	/* Destroy `xprt-ready' queue */
+	/* Destroy `xprt-ready' queue and its statistics */
+	if (pool->p_kstat != NULL)
+		kstat_delete(pool->p_kstat);
 	svc_xprt_qdestroy(pool);
 
 	/* Destroy transport list */
@@ -642,6 +703,69 @@ svc_pool_init(SVCPOOL *pool, uint_t maxthreads, uint_t redline,
 	return (0);
 }
 
+static int
+svc_pool_kstat_update(kstat_t *ksp, int rw)
+{
+	SVCPOOL *pool = ksp->ks_private;
+	svc_pool_kstat_t *spk = ksp->ks_data;
+	uint64_t puts = 0, local = 0, remote = 0, overflows = 0;
+	hrtime_t wait = 0, maxwait = 0;
+	uint_t i;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	for (i = 0; i < pool->p_nqshards; i++) {
+		__SVCXPRT_QSHARD *qs = &pool->p_qshards[i];
+
+		mutex_enter(&qs->qs_lock);
+		puts += qs->qs_puts;
+		local += qs->qs_local;
+		remote += qs->qs_remote;
+		overflows += qs->qs_overflows;
+		wait += qs->qs_wait;
+		maxwait = MAX(maxwait, qs->qs_maxwait);
+		mutex_exit(&qs->qs_lock);
+	}
+
+	spk->spk_puts.value.ui64 = puts;
+	spk->spk_local.value.ui64 = local;
+	spk->spk_remote.value.ui64 = remote;
+	spk->spk_overflows.value.ui64 = overflows;
+	spk->spk_wait.value.ui64 = wait;
+	spk->spk_maxwait.value.ui64 = maxwait;
+	return (0);
+}
+
+/*
+ * Create the `xprt-ready' queue statistics for a pool.  Pools with the same
+ * id may briefly coexist while an old one is closing, so each pool gets its
+ * own kstat instance and reports its id as a statistic.
+ */
+static void
+svc_pool_kstat_init(SVCPOOL *pool, int id)
+{
+	svc_pool_kstat_t *spk;
+	kstat_t *ksp;
+
+	if ((ksp = kstat_create_zone("unix",
+	    atomic_inc_32_nv(&svc_pool_kstat_instance), "rpc_svc_pool", "rpc",
+	    KSTAT_TYPE_NAMED,
+	    sizeof (svc_pool_kstat_t) / sizeof (kstat_named_t), 0,
+	    curproc->p_zone->zone_id)) == NULL) {
+		return;
+	}
+
+	spk = ksp->ks_data;
+	bcopy(&svc_pool_kstat_template, spk, sizeof (svc_pool_kstat_t));
+	spk->spk_id.value.i32 = id;
+	spk->spk_shards.value.ui32 = pool->p_nqshards;
+	ksp->ks_private = pool;
+	ksp->ks_update = svc_pool_kstat_update;
+	pool->p_kstat = ksp;
+	kstat_install(ksp);
+}
+
 /*
  * PSARC 2003/523 Contract Private Interface
  * svc_pool_create
@@ -682,6 +806,8 @@ svc_pool_create(struct svcpool_args *args)
 		return (error);
 	}
 
+	svc_pool_kstat_init(pool, args->id);
+
 	/* Register the pool with the global pool list */
 	svc_pool_register(svc, pool, args->id);
 
@@ -861,8 +987,17 @@ svc_xprt_unregister(SVCMASTERXPRT *xprt)
 static void
 svc_xprt_qdestroy(SVCPOOL *pool)
 {
-	mutex_destroy(&pool->p_qend_lock);
-	kmem_free(pool->p_qbody, pool->p_qsize * sizeof (__SVCXPRT_QNODE));
+	uint_t i;
+
+	for (i = 0; i < pool->p_nqshards; i++) {
+		__SVCXPRT_QSHARD *qs = &pool->p_qshards[i];
+
+		mutex_destroy(&qs->qs_lock);
+		kmem_free(qs->qs_body,
+		    pool->p_qsize * sizeof (__SVCXPRT_QNODE));
+	}
+	kmem_free(pool->p_qshards,
+	    pool->p_nqshards * sizeof (__SVCXPRT_QSHARD));
 }
 
 /*
@@ -871,54 +1006,70 @@ svc_xprt_qdestroy(SVCPOOL *pool)
 static void
 svc_xprt_qinit(SVCPOOL *pool, size_t qsize)
 {
-	int i;
+	uint_t i;
+	int j;
 
 	pool->p_qsize = qsize;
-	pool->p_qbody = kmem_zalloc(pool->p_qsize * sizeof (__SVCXPRT_QNODE),
-	    KM_SLEEP);
+	pool->p_nqshards = MAX(1, MIN((uint_t)max_ncpus, svc_max_qshards));
+	pool->p_qshards = kmem_zalloc(pool->p_nqshards *
+	    sizeof (__SVCXPRT_QSHARD), KM_SLEEP);
 
-	for (i = 0; i < pool->p_qsize - 1; i++)
-		pool->p_qbody[i].q_next = &(pool->p_qbody[i+1]);
+	for (i = 0; i < pool->p_nqshards; i++) {
+		__SVCXPRT_QSHARD *qs = &pool->p_qshards[i];
 
-	pool->p_qbody[pool->p_qsize-1].q_next = &(pool->p_qbody[0]);
-	pool->p_qtop = &(pool->p_qbody[0]);
-	pool->p_qend = &(pool->p_qbody[0]);
+		qs->qs_body = kmem_zalloc(pool->p_qsize *
+		    sizeof (__SVCXPRT_QNODE), KM_SLEEP);
 
-	mutex_init(&pool->p_qend_lock, NULL, MUTEX_DEFAULT, NULL);
+		for (j = 0; j < pool->p_qsize - 1; j++)
+			qs->qs_body[j].q_next = &(qs->qs_body[j+1]);
+
+		qs->qs_body[pool->p_qsize-1].q_next = &(qs->qs_body[0]);
+		qs->qs_top = &(qs->qs_body[0]);
+		qs->qs_end = &(qs->qs_body[0]);
+
+		mutex_init(&qs->qs_lock, NULL, MUTEX_DEFAULT, NULL);
+	}
 }
 
 /*
  * Called from the svc_queuereq() interrupt routine to queue
  * a hint for svc_poll() which transport has a pending request.
- * - insert a pointer to xprt into the xprt-ready queue (FIFO)
- * - if the xprt-ready queue is full turn the overflow flag on.
+ * - insert a pointer to xprt into the current CPU's shard of the
+ *   xprt-ready queue (FIFO)
+ * - if the shard is full (or the overflow flag is already on)
+ *   return FALSE; the caller must then turn the overflow flag on.
  *
- * NOTICE: pool->p_qtop is protected by the pool's request lock
- * and the caller (svc_queuereq()) must hold the lock.
+ * The overflow flag is only ever set and cleared under the pool's
+ * request lock, together with the `pending-requests' count, so
+ * that a request without a hint can never go unnoticed.
  */
-static void
+static bool_t
 svc_xprt_qput(SVCPOOL *pool, SVCMASTERXPRT *xprt)
 {
-	ASSERT(MUTEX_HELD(&pool->p_req_lock));
+	__SVCXPRT_QSHARD *qs;
 
 	/* If the overflow flag is on there is nothing we can do */
 	if (pool->p_qoverflow)
-		return;
+		return (FALSE);
 
-	/* If the queue is full turn the overflow flag on and exit */
-	if (pool->p_qtop->q_next == pool->p_qend) {
-		mutex_enter(&pool->p_qend_lock);
-		if (pool->p_qtop->q_next == pool->p_qend) {
-			pool->p_qoverflow = TRUE;
-			mutex_exit(&pool->p_qend_lock);
-			return;
-		}
-		mutex_exit(&pool->p_qend_lock);
+	qs = &pool->p_qshards[CPU->cpu_seqid % pool->p_nqshards];
+	mutex_enter(&qs->qs_lock);
+
+	/* If the shard is full tell the caller to turn on the overflow flag */
+	if (qs->qs_top->q_next == qs->qs_end) {
+		qs->qs_overflows++;
+		mutex_exit(&qs->qs_lock);
+		return (FALSE);
 	}
 
-	/* Insert a hint and move pool->p_qtop */
-	pool->p_qtop->q_xprt = xprt;
-	pool->p_qtop = pool->p_qtop->q_next;
+	/* Insert a hint and move qs->qs_top */
+	qs->qs_top->q_xprt = xprt;
+	qs->qs_top->q_time = gethrtime();
+	qs->qs_top = qs->qs_top->q_next;
+	qs->qs_puts++;
+
+	mutex_exit(&qs->qs_lock);
+	return (TRUE);
 }
 
 /*
@@ -926,39 +1077,61 @@ svc_xprt_qput(SVCPOOL *pool, SVCMASTERXPRT *xprt)
  * pending request. Returns a pointer to a transport or NULL if the
  * `xprt-ready' queue is empty.
  *
- * Since we do not acquire the pool's request lock while checking if
- * the queue is empty we may miss a request that is just being delivered.
+ * The shard of the CPU we are running on is tried first, so that a
+ * request tends to be served on the CPU which received it, and then
+ * the other shards in turn.
+ *
+ * Since we do not acquire the shard locks while checking if the
+ * shards are empty we may miss a request that is just being delivered.
  * However this is ok since svc_poll() will retry again until the
  * count indicates that there are pending requests for this pool.
  */
 static SVCMASTERXPRT *
 svc_xprt_qget(SVCPOOL *pool)
 {
+	__SVCXPRT_QSHARD *qs;
+	__SVCXPRT_QNODE *q;
 	SVCMASTERXPRT *xprt;
+	hrtime_t wait;
+	uint_t i, n;
 
-	mutex_enter(&pool->p_qend_lock);
-	do {
-		/*
-		 * If the queue is empty return NULL.
-		 * Since we do not acquire the pool's request lock which
-		 * protects pool->p_qtop this is not exact check. However,
-		 * this is safe - if we miss a request here svc_poll()
-		 * will retry again.
-		 */
-		if (pool->p_qend == pool->p_qtop) {
-			mutex_exit(&pool->p_qend_lock);
-			return (NULL);
-		}
+	n = CPU->cpu_seqid % pool->p_nqshards;
+	for (i = 0; i < pool->p_nqshards; i++, n++) {
+		if (n == pool->p_nqshards)
+			n = 0;
+		qs = &pool->p_qshards[n];
+
+		/* Skip empty shards without taking their lock */
+		if (qs->qs_end == qs->qs_top)
+			continue;
 
-		/* Get a hint and move pool->p_qend */
-		xprt = pool->p_qend->q_xprt;
-		pool->p_qend = pool->p_qend->q_next;
+		mutex_enter(&qs->qs_lock);
+		while (qs->qs_end != qs->qs_top) {
+			/* Get a hint and move qs->qs_end */
+			q = qs->qs_end;
+			xprt = q->q_xprt;
+			qs->qs_end = q->q_next;
 
-		/* Skip fields deleted by svc_xprt_qdelete()	 */
-	} while (xprt == NULL);
-	mutex_exit(&pool->p_qend_lock);
+			/* Skip fields deleted by svc_xprt_qdelete() */
+			if (xprt == NULL)
+				continue;
+
+			wait = gethrtime() - q->q_time;
+			qs->qs_wait += wait;
+			if (wait > qs->qs_maxwait)
+				qs->qs_maxwait = wait;
+			if (i == 0)
+				qs->qs_local++;
+			else
+				qs->qs_remote++;
+			mutex_exit(&qs->qs_lock);
+
+			return (xprt);
+		}
+		mutex_exit(&qs->qs_lock);
+	}
 
-	return (xprt);
+	return (NULL);
 }
 
 /*
@@ -970,13 +1143,18 @@ static void
 svc_xprt_qdelete(SVCPOOL *pool, SVCMASTERXPRT *xprt)
 {
 	__SVCXPRT_QNODE *q;
+	uint_t i;
 
-	mutex_enter(&pool->p_req_lock);
-	for (q = pool->p_qend; q != pool->p_qtop; q = q->q_next) {
-		if (q->q_xprt == xprt)
-			q->q_xprt = NULL;
+	for (i = 0; i < pool->p_nqshards; i++) {
+		__SVCXPRT_QSHARD *qs = &pool->p_qshards[i];
+
+		mutex_enter(&qs->qs_lock);
+		for (q = qs->qs_end; q != qs->qs_top; q = q->q_next) {
+			if (q->q_xprt == xprt)
+				q->q_xprt = NULL;
+		}
+		mutex_exit(&qs->qs_lock);
 	}
-	mutex_exit(&pool->p_req_lock);
 }
 
 /*
@@ -1875,7 +2053,8 @@ svc_poll(SVCPOOL *pool, SVCMASTERXPRT *xprt, SVCXPRT *clone_xprt)
 			SVCMASTERXPRT *hint;
 
 			/*
-			 * Get the next transport from the xprt-ready queue.
+			 * Get the next transport from the xprt-ready queue,
+			 * preferring hints queued on this CPU.
 			 * This is a hint. There is no guarantee that the
 			 * transport still has a pending request since it
 			 * could be picked up by another thread in step 1.
@@ -2499,6 +2678,7 @@ svc_queuereq(queue_t *q, mblk_t *mp, bool_t flowcontrol)
 	SVCMASTERXPRT *xprt = ((void **) q->q_ptr)[0];
 	SVCPOOL *pool = xprt->xp_pool;
 	size_t size;
+	bool_t hinted;
 
 	TRACE_0(TR_FAC_KRPC, TR_SVC_QUEUEREQ_START, "svc_queuereq_start");
 
@@ -2507,12 +2687,11 @@ svc_queuereq(queue_t *q, mblk_t *mp, bool_t flowcontrol)
 
 	/*
 	 * Step 1.
-	 * Grab the transport's request lock and the
-	 * pool's request lock so that when we put
-	 * the request at the tail of the transport's
-	 * request queue, possibly put the request on
-	 * the xprt ready queue and increment the
-	 * pending request count it looks atomic.
+	 * Grab the transport's request lock so that when we put
+	 * the request at the tail of the transport's request queue,
+	 * possibly put the request on the xprt ready queue and
+	 * increment the pending request count it looks atomic to
+	 * service threads, which need that lock to take the request.
 	 */
 	mutex_enter(&xprt->xp_req_lock);
 	if (flowcontrol && xprt->xp_full) {
@@ -2521,7 +2700,6 @@ svc_queuereq(queue_t *q, mblk_t *mp, bool_t flowcontrol)
 		return (FALSE);
 	}
 	ASSERT(xprt->xp_full == FALSE);
-	mutex_enter(&pool->p_req_lock);
 	if (xprt->xp_req_head == NULL)
 		xprt->xp_req_head = mp;
 	else
@@ -2533,10 +2711,15 @@ svc_queuereq(queue_t *q, mblk_t *mp, bool_t flowcontrol)
 	 * Insert a hint into the xprt-ready queue, increment
 	 * counters, handle flow control, and wake up
 	 * a thread sleeping in svc_poll() if necessary.
+	 *
+	 * The hint goes on this CPU's shard of the xprt-ready
+	 * queue, which is not protected by the pool's request lock.
 	 */
+	hinted = svc_xprt_qput(pool, xprt);
 
-	/* Insert pointer to this transport into the xprt-ready queue */
-	svc_xprt_qput(pool, xprt);
+	mutex_enter(&pool->p_req_lock);
+	if (!hinted)
+		pool->p_qoverflow = TRUE;
 
 	/* Increment counters */
 	pool->p_reqs++;
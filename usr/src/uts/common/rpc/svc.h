@@ -23,6 +23,7 @@
  * Copyright 2012 Marcel Telka <marcel@telka.sk>
  * Copyright 2013 Nexenta Systems, Inc.  All rights reserved.
  * Copyright 2018 OmniOS Community Edition (OmniOSce) Association.
+ * Copyright 2020 Joyent, Inc.
  */
 /* Copyright (c) 1983, 1984, 1985, 1986, 1987, 1988, 1989 AT&T */
 /* All Rights Reserved */
@@ -253,6 +254,7 @@ struct xp_ops {
  * Kernel RPC server-side thread pool structure.
  */
 typedef struct __svcxprt_qnode __SVCXPRT_QNODE;	/* Defined in svc.c */
+typedef struct __svcxprt_qshard __SVCXPRT_QSHARD; /* Defined in svc.c */
 
 struct __svcpool {
 	/*
@@ -323,21 +325,22 @@ struct __svcpool {
 	krwlock_t	p_lrwlock;		/* R/W lock		  */
 
 	/*
-	 * Circular linked list for the `xprt-ready' queue (FIFO).
-	 * Must be initialized with svc_xprt_qinit() before it is used.
+	 * The `xprt-ready' queue is split into p_nqshards circular linked
+	 * lists (FIFOs), one per CPU, each protected by its own lock.
+	 * A hint is queued on the shard of the CPU which received the
+	 * request, and service threads look at the shard of the CPU they
+	 * are running on before looking at the others.  Must be initialized
+	 * with svc_xprt_qinit() before it is used.
 	 *
-	 * The writer's end is protected by the pool's request lock
-	 * (pool->p_req_lock). The reader's end is protected by q_end_lock.
-	 *
-	 * When the queue is full the p_qoverflow flag is raised. It stays
-	 * on until all the pending request are drained.
+	 * When a shard is full the p_qoverflow flag is raised. It stays
+	 * on until all the pending request are drained. The flag is
+	 * governed by the pool's request lock (pool->p_req_lock).
 	 */
-	size_t		p_qsize;		/* Number of queue nodes  */
+	size_t		p_qsize;		/* Nodes per queue shard  */
 	int		p_qoverflow : 1;	/* Overflow flag	  */
-	__SVCXPRT_QNODE *p_qbody;		/* Queue body (array)	  */
-	__SVCXPRT_QNODE *p_qtop;		/* Writer's end of FIFO   */
-	__SVCXPRT_QNODE *p_qend;		/* Reader's end of FIFO	  */
-	kmutex_t	p_qend_lock;		/* Reader's end lock	  */
+	uint_t		p_nqshards;		/* Number of queue shards */
+	__SVCXPRT_QSHARD *p_qshards;		/* Queue shards (array)	  */
+	struct kstat	*p_kstat;		/* Queue statistics	  */
 
 	/*
 	 * Userspace thread creator variables.
@@ -23,6 +23,7 @@
  * Copyright (c) 2007, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright 2016 Syneto S.R.L.  All rights reserved.
  * Copyright 2019 Nexenta by DDN, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -93,6 +94,8 @@ extern	kmem_cache_t		*smb_cache_odir;
 extern	kmem_cache_t		*smb_cache_opipe;
 extern	kmem_cache_t		*smb_cache_event;
 extern	kmem_cache_t		*smb_cache_lock;
+extern	kmem_cache_t		*smb_cache_reqbuf;
+extern	size_t			smb_reqbuf_size;
 
 extern	kmem_cache_t		*smb_kshare_cache_vfs;
 
@@ -645,6 +648,8 @@ boolean_t smb_session_levelII_oplocks(smb_session_t *);
 
 smb_request_t *smb_request_alloc(smb_session_t *, int);
 void smb_request_free(smb_request_t *);
+void *smb_reqbuf_alloc(size_t);
+void smb_reqbuf_free(void *, size_t);
 
 /*
  * ofile functions (file smb_ofile.c)
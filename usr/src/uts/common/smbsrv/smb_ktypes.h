@@ -22,6 +22,7 @@
  * Copyright (c) 2008, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright 2019 Nexenta by DDN, Inc. All rights reserved.
  * Copyright 2020 RackTop Systems, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -1788,6 +1789,14 @@ typedef struct smb_arg_olbrk {
 #define	SMB_REQ_MAGIC		0x534D4252	/* 'SMBR' */
 #define	SMB_REQ_VALID(p)	ASSERT((p)->sr_magic == SMB_REQ_MAGIC)
 
+/*
+ * Request buffers larger than SMB_REQBUF_SMALL (the largest kmem_alloc
+ * cache) but no larger than smb_reqbuf_size come from smb_cache_reqbuf.
+ * SMB_REQBUF_SLOP is the room allowed for headers around a maximal write.
+ */
+#define	SMB_REQBUF_SMALL	(128 * 1024)
+#define	SMB_REQBUF_SLOP		(64 * 1024)
+
 typedef enum smb_req_state {
 	SMB_REQ_STATE_FREE = 0,
 	SMB_REQ_STATE_INITIALIZING,
@@ -296,6 +296,9 @@ typedef struct callout_heap {
  *	Number of callout structures allocated.
  * CALLOUT_CLEANUPS
  *	Number of times a callout table is cleaned up.
+ * CALLOUT_COALESCED
+ *	Number of callouts that were deferred within their slack onto an
+ *	existing expiration instead of adding a new one.
  */
 typedef enum callout_stat_type {
 	CALLOUT_TIMEOUTS,
@@ -306,6 +309,7 @@ typedef enum callout_stat_type {
 	CALLOUT_EXPIRATIONS,
 	CALLOUT_ALLOCATIONS,
 	CALLOUT_CLEANUPS,
+	CALLOUT_COALESCED,
 	CALLOUT_NUM_STATS
 } callout_stat_type_t;
 
@@ -404,6 +408,8 @@ typedef struct callout_table {
 		ct_kstat_data[CALLOUT_ALLOCATIONS].value.ui64
 #define	ct_cleanups							\
 		ct_kstat_data[CALLOUT_CLEANUPS].value.ui64
+#define	ct_coalesced							\
+		ct_kstat_data[CALLOUT_COALESCED].value.ui64
 
 /*
  * CALLOUT_CHUNK is the minimum initial size of each heap, and the amount
@@ -438,6 +444,8 @@ typedef struct callout_table {
 #endif
 
 #define	CALLOUT_TOLERANCE	200000		/* nanoseconds */
+#define	CALLOUT_SLACK_PCT	1		/* percent of interval */
+#define	CALLOUT_SLACK_MAX	(NANOSEC / 10)	/* nanoseconds */
 
 extern void		callout_init(void);
 extern void		membar_sync(void);
@@ -64,6 +64,9 @@ typedef struct pg_cmt {
 	struct group	cmt_cpus_actv;
 	struct bitset	cmt_cpus_actv_set;	/* bitset of active CPUs */
 	kstat_t		*cmt_kstat;		/* cmt kstats exported */
+	uint64_t	cmt_llc_affine;		/* LLC-affine placements */
+	uint64_t	cmt_llc_migrate;	/* placements from other LLCs */
+	uint64_t	cmt_llc_deferred;	/* balancing moves not taken */
 } pg_cmt_t;
 
 /*
@@ -112,6 +115,7 @@ int		pg_plat_cmt_rank(pg_cmt_t *, pg_cmt_t *);
  * CMT dispatcher policy
  */
 cpu_t		*cmt_balance(kthread_t *, cpu_t *);
+cpu_t		*cmt_llc_place(kthread_t *, cpu_t *);
 
 /*
  * Power Aware Dispatcher Interfaces
@@ -87,14 +87,18 @@ extern int cpucaps_project_set(kproject_t *, rctl_qty_t);
 extern int cpucaps_zone_set(zone_t *, rctl_qty_t);
 extern int cpucaps_zone_set_base(zone_t *, rctl_qty_t);
 extern int cpucaps_zone_set_burst_time(zone_t *, rctl_qty_t);
+extern int cpucaps_zone_set_burst_credit(zone_t *, rctl_qty_t);
 
 /*
  * Get current CPU usage for a project/zone.
  */
 extern rctl_qty_t cpucaps_project_get(kproject_t *);
 extern rctl_qty_t cpucaps_zone_get(zone_t *);
+extern rctl_qty_t cpucaps_zone_get_value(zone_t *);
+extern void cpucaps_zone_get_ticks(zone_t *, u_longlong_t *, u_longlong_t *);
 extern rctl_qty_t cpucaps_zone_get_base(zone_t *);
 extern rctl_qty_t cpucaps_zone_get_burst_time(zone_t *);
+extern rctl_qty_t cpucaps_zone_get_burst_credit(zone_t *);
 
 /*
  * Scheduling class hooks into CPU caps framework.
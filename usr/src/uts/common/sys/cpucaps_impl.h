@@ -73,7 +73,9 @@ typedef struct cpucap {
 	hrtime_t	cap_base;	/* base CPU for burst		*/
 	u_longlong_t	cap_burst_limit; /* max secs (in tics) for a burst */
 	u_longlong_t	cap_bursting;	/* # of ticks currently bursting */
-	disp_lock_t	cap_usagelock;	/* protects cap_usage above	*/
+	hrtime_t	cap_credit;	/* burst credit balance (CPU nsec) */
+	u_longlong_t	cap_credit_limit; /* max credit (ticks at cap rate) */
+	disp_lock_t	cap_usagelock;	/* protects cap_usage, cap_credit */
 	/*
 	 * Per cap statistics.
 	 */
@@ -81,6 +83,7 @@ typedef struct cpucap {
 	u_longlong_t	cap_below;	/* # of ticks spend below the cap */
 	u_longlong_t	cap_above;	/* # of ticks spend above the cap */
 	u_longlong_t	cap_above_base;	/* # of ticks spent above the base */
+	u_longlong_t	cap_borrowed;	/* # of ticks spent on burst credit */
 } cpucap_t;
 
 /*
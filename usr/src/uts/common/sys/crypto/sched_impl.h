@@ -24,6 +24,7 @@
 
 /*
  * Copyright 2010 Nexenta Systems, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef _SYS_CRYPTO_SCHED_IMPL_H
@@ -159,7 +160,7 @@ typedef struct kcf_sreq_node {
 /*
  * Node structure for asynchronous requests. A node can be on
  * on a chain of requests hanging of the internal context
- * structure and can be in the global software provider queue.
+ * structure and can be in one of the software provider queues.
  */
 typedef struct kcf_areq_node {
 	/* Should always be the first field in this structure */
@@ -191,12 +192,13 @@ typedef struct kcf_areq_node {
 	boolean_t		an_isdual;	/* for internal reuse */
 
 	/*
-	 * Next and previous nodes in the global software
-	 * queue. These fields are NULL for a hardware
-	 * provider since we use a taskq there.
+	 * Next and previous nodes in the software queue, and the
+	 * queue itself, chosen by the submitting CPU. The links are
+	 * NULL for a hardware provider since we use a taskq there.
 	 */
 	struct kcf_areq_node	*an_next;
 	struct kcf_areq_node	*an_prev;
+	struct kcf_global_swq	*an_swq;
 
 	/* Provider handling this request */
 	kcf_provider_desc_t	*an_provider;
@@ -268,9 +270,10 @@ typedef struct kcf_reqid_table {
 } kcf_reqid_table_t;
 
 /*
- * Global software provider queue structure. Requests to be
- * handled by a SW provider and have the ALWAYS_QUEUE flag set
- * get queued here.
+ * Software provider queue structure. Requests to be handled by a
+ * SW provider and have the ALWAYS_QUEUE flag set get queued on the
+ * queue of the CPU submitting them; there are kcf_nswq such queues,
+ * each served by its own threads from the kcfpool.
  */
 typedef struct kcf_global_swq {
 	/*
@@ -283,6 +286,9 @@ typedef struct kcf_global_swq {
 	uint_t			gs_maxjobs;
 	kcf_areq_node_t		*gs_first;
 	kcf_areq_node_t		*gs_last;
+	uint32_t		gs_threads;	/* Threads serving queue */
+	uint32_t		gs_idlethreads;	/* Idle threads */
+	uint32_t		gs_blockedthreads; /* Blocked threads */
 } kcf_global_swq_t;
 
 
@@ -456,6 +462,7 @@ extern int crypto_taskq_threads;
 extern int crypto_taskq_minalloc;
 extern int crypto_taskq_maxalloc;
 extern kcf_global_swq_t *gswq;
+extern uint_t kcf_nswq;
 extern int kcf_maxthreads;
 extern int kcf_minthreads;
 
@@ -498,6 +505,7 @@ extern int kcf_submit_request(kcf_provider_desc_t *, crypto_ctx_t *,
     crypto_call_req_t *, kcf_req_params_t *, boolean_t);
 extern void kcf_sched_init(void);
 extern void kcf_sched_start(void);
+extern uint_t kcf_swq_avail(void);
 extern void kcf_sop_done(kcf_sreq_node_t *, int);
 extern void kcf_aop_done(kcf_areq_node_t *, int);
 extern int common_submit_request(kcf_provider_desc_t *,
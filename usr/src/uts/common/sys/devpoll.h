@@ -70,6 +70,12 @@ typedef struct dvpoll_epollfd {
 	uint64_t	dpep_data;	/* data payload */
 } dvpoll_epollfd_t;
 
+/*
+ * When adding an fd to an epoll-compatible handle, dpep_pollfd.revents
+ * carries flags which have no poll(2) event equivalent.
+ */
+#define	DP_EPOLL_EXCLUSIVE	0x0001	/* EPOLLEXCLUSIVE wake-up */
+
 #ifdef _KERNEL
 
 typedef struct dp_entry {
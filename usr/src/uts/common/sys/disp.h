@@ -116,6 +116,7 @@ extern hrtime_t nosteal_nsec;
  * This is part of the CPU partition structure (cpupart_t).
  */
 extern	pri_t	kpreemptpri;	/* level above which preemption takes place */
+extern	int	disp_dirwake;	/* directed wakeup mode */
 
 extern void		disp_kp_alloc(disp_t *, pri_t);	/* allocate kp queue */
 extern void		disp_kp_free(disp_t *);		/* free kp queue */
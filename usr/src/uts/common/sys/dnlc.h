@@ -80,6 +80,8 @@ typedef struct ncache {
 	struct ncache *hash_prev;
 	struct vnode *vp;		/* vnode the name refers to */
 	struct vnode *dp;		/* vnode of parent of name */
+	struct dnlc_zone *zone;		/* zone charged for the entry */
+	uint32_t gen;			/* generation of dp when entered */
 	int hash;			/* hash signature */
 	uchar_t namlen;			/* length of name */
 	char name[1];			/* segment name - null terminated */
@@ -130,6 +132,11 @@ struct nc_stats {
 	kstat_named_t ncs_pick_free;	/* found a free ncache */
 	kstat_named_t ncs_pick_heur;	/* found ncache w/ NULL vpages */
 	kstat_named_t ncs_pick_last;	/* found last ncache on chain */
+	kstat_named_t ncs_lockless_hits; /* hits without the hash lock */
+	kstat_named_t ncs_zone_limit;	/* enters refused, zone share full */
+	kstat_named_t ncs_neg_limit;	/* enters refused, negative cap hit */
+	kstat_named_t ncs_invalidate;	/* dnlc_invalidate() calls */
+	kstat_named_t ncs_stale;	/* stale entries found by lookups */
 
 	/* directory caching stats */
 
@@ -184,10 +191,12 @@ void	dnlc_update(vnode_t *, const char *, vnode_t *);
 vnode_t	*dnlc_lookup(vnode_t *, const char *);
 void	dnlc_purge(void);
 void	dnlc_purge_vp(vnode_t *);
+void	dnlc_invalidate(vnode_t *);
 int	dnlc_purge_vfsp(vfs_t *, int);
 void	dnlc_remove(vnode_t *, const char *);
 int	dnlc_fs_purge1(struct vnodeops *);
 void	dnlc_reduce_cache(void *);
+void	dnlc_zone_fini(struct zone *);
 
 #endif	/* defined(_KERNEL) */
 
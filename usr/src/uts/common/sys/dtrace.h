@@ -25,7 +25,7 @@
  */
 
 /*
- * Copyright 2018 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2013 by Delphix. All rights reserved.
  */
 
@@ -863,9 +863,26 @@ typedef struct dtrace_difo {
 	uint_t dtdo_krelen;		/* length of krelo table */
 	uint_t dtdo_urelen;		/* length of urelo table */
 	uint_t dtdo_xlmlen;		/* length of translator table */
+#else
+	uint_t dtdo_fastop;		/* trivial-DIFO fast path, if any */
+	uint_t dtdo_fastarg;		/* variable for DTRACE_DIFO_FAST_VAR */
+	uint64_t dtdo_fastval;		/* value for DTRACE_DIFO_FAST_CONST */
 #endif
 } dtrace_difo_t;
 
+#ifdef _KERNEL
+/*
+ * Values for dtdo_fastop.  Many DIFOs -- predicates and the arguments to
+ * trace() and aggregating actions in particular -- consist of nothing more
+ * than a constant or a single built-in variable followed by a ret.  These
+ * are recognized when the DIFO is initialized and evaluated directly by
+ * dtrace_dif_emulate() without entering the interpreter loop.
+ */
+#define	DTRACE_DIFO_FAST_NONE	0	/* no fast path; interpret */
+#define	DTRACE_DIFO_FAST_CONST	1	/* returns dtdo_fastval */
+#define	DTRACE_DIFO_FAST_VAR	2	/* returns built-in dtdo_fastarg */
+#endif
+
 /*
  * DTrace Enabling Description Structures
  *
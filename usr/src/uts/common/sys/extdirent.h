@@ -41,7 +41,9 @@ extern "C" {
  * dirent provides additional informational flag bits for each
  * directory entry.  This dirent will be returned instead of the
  * standard dirent if a VOP_READDIR() requests dirent flags via
- * V_RDDIR_ENTFLAGS, and if the file system supports the flags.
+ * V_RDDIR_ENTFLAGS, and if the file system supports the flags.  It is
+ * also returned for V_RDDIR_DTYPE, on file systems which support
+ * VFSFT_DIRENTTYPE.
  */
 typedef struct edirent {
 	ino64_t		ed_ino;		/* "inode number" of entry */
@@ -62,11 +64,13 @@ typedef struct edirent {
  *	regarding that entry.
  */
 #define	ED_CASE_CONFLICT  0x10  /* Disconsidering case, entry is not unique */
+#define	ED_DTYPE_MASK	0x0f	/* IFTODT() type of entry, 0 if unknown */
 
 /*
  * Extended flags accessor function
  */
 #define	ED_CASE_CONFLICTS(x)	((x)->ed_eflags & ED_CASE_CONFLICT)
+#define	ED_DTYPE(x)		((x)->ed_eflags & ED_DTYPE_MASK)
 
 #endif /* defined(_KERNEL) */
 
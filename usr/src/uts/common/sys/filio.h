@@ -48,6 +48,7 @@
  * General file ioctl definitions.
  */
 
+#include <sys/types.h>
 #include <sys/ioccom.h>
 
 #ifdef	__cplusplus
@@ -140,6 +141,20 @@ extern "C" {
  */
 #define	_FIO_COUNT_FILLED	_IO('f', 100)	/* count holes in a file */
 
+/*
+ * Pass posix_fadvise(3C) advice on a range of a file down to the file
+ * system.  File systems that don't act on advice return ENOTTY, which
+ * callers ignore.
+ */
+#define	_FIO_ADVISE		_IO('f', 101)	/* fadvise hint */
+
+typedef struct fio_advise {
+	offset_t	fa_offset;	/* start of range */
+	offset_t	fa_len;		/* length of range, 0 means to EOF */
+	int		fa_advice;	/* POSIX_FADV_* */
+	int		fa_pad;
+} fio_advise_t;
+
 #ifdef	__cplusplus
 }
 #endif
@@ -303,6 +303,15 @@ extern void cl_flk_state_transition_notify(lock_descriptor_t *lock,
 		(((lock1)->l_start <= (lock2)->l_start) && \
 			((lock1)->l_end >= (lock2)->l_end))
 
+/*
+ * The active locks of a vnode are kept sorted by l_start, so once a walk
+ * reaches a lock that starts more than one byte past the end of 'request'
+ * none of the remaining locks can overlap it or be coalesced with it.
+ */
+#define	PAST_REQUEST(lock, request)	\
+		(((lock)->l_start > (request)->l_end) && \
+			((lock)->l_start - (request)->l_end > 1))
+
 #define	IN_LIST_REMOVE(ep)	\
 	{ \
 	(ep)->edge_in_next->edge_in_prev = (ep)->edge_in_prev; \
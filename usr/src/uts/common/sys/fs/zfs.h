@@ -183,6 +183,7 @@ typedef enum {
 	ZFS_PROP_KEY_GUID,
 	ZFS_PROP_KEYSTATUS,
 	ZFS_PROP_IVSET_GUID,		/* not exposed to the user */
+	ZFS_PROP_DIRECT,
 	ZFS_NUM_PROPS
 } zfs_prop_t;
 
@@ -400,6 +401,12 @@ typedef enum {
 	ZFS_SYNC_DISABLED = 2
 } zfs_sync_type_t;
 
+typedef enum {
+	ZFS_DIRECT_STANDARD = 0,
+	ZFS_DIRECT_ALWAYS = 1,
+	ZFS_DIRECT_DISABLED = 2
+} zfs_direct_type_t;
+
 typedef enum {
 	ZFS_DNSIZE_LEGACY = 0,
 	ZFS_DNSIZE_AUTO = 1,
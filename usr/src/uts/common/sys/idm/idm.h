@@ -22,6 +22,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Copyright 2017 Nexenta Systems, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  * Use is subject to license terms.
  */
 
@@ -397,6 +398,13 @@ idm_declare_key_values(idm_conn_t *ic, nvlist_t *config_nvl,
 idm_buf_t *
 idm_buf_alloc(idm_conn_t *ic, void *bufptr, uint64_t buflen);
 
+boolean_t
+idm_buf_iov_capable(idm_conn_t *ic);
+
+idm_buf_t *
+idm_buf_alloc_iov(idm_conn_t *ic, struct iovec *iov, int iovcnt,
+    uint64_t buflen);
+
 void
 idm_buf_free(idm_buf_t *idb);
 
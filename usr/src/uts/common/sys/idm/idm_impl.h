@@ -23,6 +23,7 @@
  */
 /*
  * Copyright 2014-2015 Nexenta Systems, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_IDM_IMPL_H_
@@ -303,6 +304,12 @@ typedef struct idm_buf_s {
 	void		*idb_reg_private; /* transport-specific reg handle */
 	void		*idb_bufptr; /* transport-specific bcopy pointer */
 	boolean_t	idb_bufbcopy;	/* true if bcopy required */
+	/*
+	 * Buffers from idm_buf_alloc_iov() have no idb_buf; their data is
+	 * in the idb_iovcnt segments of idb_iov (sockets, Data-In only).
+	 */
+	struct iovec	*idb_iov;
+	int		idb_iovcnt;
 
 	idm_buf_cb_t	*idb_buf_cb;	/* Data Completion Notify, tgt only */
 	void		*idb_cb_arg;	/* Client private data */
@@ -367,7 +374,8 @@ typedef struct idm_pdu_s {
 
 	/*
 	 * The following four elements are only used in
-	 * idm_sorecv_scsidata() currently.
+	 * idm_sorecv_scsidata() currently, and for transmitting Data-In
+	 * PDUs from an idm_buf_alloc_iov() buffer (IDM_PDU_DATA_IOV).
 	 */
 	struct iovec	isp_iov[PDU_MAX_IOVLEN];
 	int		isp_iovlen;
@@ -406,6 +414,7 @@ typedef struct {
 #define	IDM_PDU_LOGIN_TX	0x00000008
 #define	IDM_PDU_SET_STATSN	0x00000010
 #define	IDM_PDU_ADVANCE_STATSN	0x00000020
+#define	IDM_PDU_DATA_IOV	0x00000040	/* TX data is in isp_iov */
 
 #define	OSD_EXT_CDB_AHSLEN	(200 - 15)
 #define	BIDI_AHS_LENGTH		5
@@ -21,6 +21,7 @@
 /*
  * Copyright 2009 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef _SYS_KCPC_H
@@ -122,6 +123,11 @@ extern int kcpc_bind_cpu(kcpc_set_t *set, int cpuid, int *subcode);
 extern int kcpc_sample(kcpc_set_t *set, uint64_t *buf, hrtime_t *hrtime,
     uint64_t *tick);
 
+/*
+ * As above, but sample the counter values into a kernel buffer.
+ */
+extern int kcpc_sample_kernel(kcpc_set_t *set, uint64_t *buf);
+
 /*
  * Create CPC context containing specified list of requested counter events
  */
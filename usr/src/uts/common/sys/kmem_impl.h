@@ -49,7 +49,7 @@ extern "C" {
  * Lock order:
  * 1. cache_lock
  * 2. cc_lock in order by CPU ID
- * 3. cache_depot_lock
+ * 3. cache_depot_lock or a per-lgroup kld_lock (never both)
  *
  * Do not call kmem_cache_alloc() or taskq_dispatch() while holding any of the
  * above locks.
@@ -293,6 +293,19 @@ typedef struct kmem_maglist {
 	uint64_t	ml_alloc;	/* allocations from this list */
 } kmem_maglist_t;
 
+/*
+ * On NUMA systems each cache also has a depot of full magazines per lgroup.
+ * Full magazines are returned to the depot of the freeing CPU's lgroup so
+ * that buffers freed on one socket are reused on that socket.  Empty
+ * magazines have no locality and stay in the cache-wide depot.
+ */
+typedef struct kmem_lgrp_depot {
+	kmutex_t	kld_lock;	/* protects kld_full */
+	kmem_maglist_t	kld_full;	/* full magazines freed in lgroup */
+	uint64_t	kld_remote;	/* buffers handed to other lgroups */
+	long		kld_reclaim;	/* kld_full total before reclaim */
+} kmem_lgrp_depot_t;
+
 typedef struct kmem_defrag {
 	/*
 	 * Statistics
@@ -354,6 +367,9 @@ struct kmem_cache {
 	uint64_t	cache_lookup_depth;	/* hash lookup depth */
 	uint64_t	cache_depot_contention;	/* mutex contention count */
 	uint64_t	cache_depot_contention_prev; /* previous snapshot */
+	uint64_t	cache_depot_xfer_prev;	/* depot exchanges snapshot */
+	uint64_t	cache_magazine_grow;	/* magazine size increases */
+	uint64_t	cache_magazine_shrink;	/* magazine size decreases */
 
 	/*
 	 * Cache properties
@@ -405,6 +421,9 @@ struct kmem_cache {
 	kmem_magtype_t	*cache_magtype;		/* magazine type */
 	kmem_maglist_t	cache_full;		/* full magazines */
 	kmem_maglist_t	cache_empty;		/* empty magazines */
+	kmem_lgrp_depot_t *cache_lgrp_depot;	/* per-lgroup depots */
+	uint_t		cache_lgrp_ndepot;	/* # of per-lgroup depots */
+	uint_t		cache_pad2;		/* compiler padding */
 	kmem_dump_t	cache_dump;		/* used during crash dump */
 
 	/*
@@ -23,6 +23,7 @@
  * Use is subject to license terms.
  *
  * Copyright 2015 Nexenta Systems, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_SYS_KSTAT_H
@@ -50,6 +51,7 @@ typedef int	kid_t;		/* unique kstat id */
 #define	KSTAT_IOC_CHAIN_ID	KSTAT_IOC_BASE | 0x01
 #define	KSTAT_IOC_READ		KSTAT_IOC_BASE | 0x02
 #define	KSTAT_IOC_WRITE		KSTAT_IOC_BASE | 0x03
+#define	KSTAT_IOC_BULK		KSTAT_IOC_BASE | 0x04
 
 /*
  * /dev/kstat ioctl usage (kd denotes /dev/kstat descriptor):
@@ -57,6 +59,7 @@ typedef int	kid_t;		/* unique kstat id */
  *	kcid = ioctl(kd, KSTAT_IOC_CHAIN_ID, NULL);
  *	kcid = ioctl(kd, KSTAT_IOC_READ, kstat_t *);
  *	kcid = ioctl(kd, KSTAT_IOC_WRITE, kstat_t *);
+ *	kcid = ioctl(kd, KSTAT_IOC_BULK, kstat_bulk_t *);
  */
 
 #define	KSTAT_STRLEN	31	/* 30 chars + NULL; must be 16 * n - 1 */
@@ -706,11 +709,71 @@ typedef struct kstat_timer {
 
 #define	KSTAT_TIMER_PTR(kptr)	((kstat_timer_t *)(kptr)->ks_data)
 
+/*
+ * Bulk snapshots (KSTAT_IOC_BULK)
+ *
+ * A bulk read snapshots, in KID order, every kstat after kb_kid whose module
+ * and class match kb_module and kb_class (an empty string matches anything),
+ * writing a kstat_bulk_rec_t header followed by the kstat's data for each one
+ * into the buffer at kb_buf.  Each record is padded to a multiple of 8 bytes;
+ * kbr_reclen gives the offset of the next one.  Kstats which are invalid, or
+ * whose update routine fails, are skipped.
+ *
+ * On return, kb_nrecs records totalling kb_used bytes have been written.  If
+ * the buffer filled before the walk completed, kb_next is the KID to pass as
+ * kb_kid to continue it; otherwise kb_next is zero.  If not even the first
+ * record fits, the ioctl fails with ENOMEM and kb_used is set to its size.
+ *
+ * If KSTAT_BULK_CHANGED is set, only kstats whose data has changed since
+ * bulk generation kb_gen are returned; kstats which have not been seen by a
+ * bulk read before are always returned.  On return, kb_gen holds the
+ * generation at which this read started, to be passed to the next one (a
+ * caller continuing a partial walk should keep passing its original kb_gen,
+ * and use the kb_gen returned by the first part of it next time).
+ *
+ * The string of a KSTAT_DATA_STRING named kstat is contained in the record,
+ * and its address is given as an offset from the start of the record's data
+ * rather than as a pointer.  The layout of both structures is the same for
+ * 32-bit and 64-bit consumers.
+ */
+#define	KSTAT_BULK_CHANGED	0x1	/* only kstats changed since kb_gen */
+
+typedef struct kstat_bulk {
+	uint64_t	kb_buf;		/* buffer for records */
+	uint64_t	kb_bufsize;	/* size of buffer, in bytes */
+	uint64_t	kb_gen;		/* in: previous generation; out: this */
+	uint64_t	kb_used;	/* out: bytes of records written */
+	kid_t		kb_kid;		/* in: start after this KID */
+	kid_t		kb_next;	/* out: KID to continue from, or 0 */
+	uint32_t	kb_flags;	/* in: KSTAT_BULK_* flags */
+	uint32_t	kb_nrecs;	/* out: number of records written */
+	char		kb_module[KSTAT_STRLEN]; /* module filter, or "" */
+	char		kb_class[KSTAT_STRLEN];	/* class filter, or "" */
+	char		kb_pad[2];
+} kstat_bulk_t;
+
+typedef struct kstat_bulk_rec {
+	uint32_t	kbr_reclen;	/* header, data and padding */
+	kid_t		kbr_kid;	/* unique kstat ID */
+	hrtime_t	kbr_snaptime;	/* time of this snapshot */
+	uint64_t	kbr_gen;	/* generation of last data change */
+	uint64_t	kbr_data_size;	/* size of data that follows */
+	uint32_t	kbr_ndata;	/* number of data records */
+	int32_t		kbr_instance;	/* provider module instance */
+	uchar_t		kbr_type;	/* kstat data type */
+	uchar_t		kbr_flags;	/* kstat flags */
+	char		kbr_module[KSTAT_STRLEN]; /* provider module name */
+	char		kbr_name[KSTAT_STRLEN];	/* kstat name */
+	char		kbr_class[KSTAT_STRLEN]; /* kstat class */
+	char		kbr_pad[1];
+} kstat_bulk_rec_t;
+
 #if	defined(_KERNEL) || defined(_FAKE_KERNEL)
 
 #include <sys/t_lock.h>
 
 extern kid_t	kstat_chain_id;		/* bumped at each state change */
+extern uint64_t	kstat_bulk_gen;		/* bumped at each bulk data change */
 extern void	kstat_init(void);	/* initialize kstat framework */
 
 /*
@@ -817,7 +880,9 @@ extern int kstat_zone_find(kstat_t *, zoneid_t);
 
 extern kstat_t *kstat_hold_bykid(kid_t kid, zoneid_t);
 extern kstat_t *kstat_hold_byname(const char *, int, const char *, zoneid_t);
+extern kstat_t *kstat_hold_next(kid_t, zoneid_t, const char *, const char *);
 extern void kstat_rele(kstat_t *);
+extern uint64_t kstat_bulk_changed(kstat_t *, uint64_t);
 
 #endif	/* defined(_KERNEL) */
 
@@ -21,6 +21,7 @@
 /*
  * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef _SYS_LOCKSTAT_H
@@ -112,6 +113,71 @@ extern "C" {
 #include <sys/systm.h>
 #include <sys/atomic.h>
 
+/*
+ * Continuous contention profiling
+ *
+ * Rather than firing DTrace probes, the lockstat driver can aggregate lock
+ * contention itself: a sample of lock events is counted, per CPU, against the
+ * PC of the caller of the lock operation.  For each such site, a record
+ * holds the number of spin and block events seen along with their total
+ * duration, and (if LSPROF_F_HOLD is set) a log2 histogram of the time for
+ * which adaptive and reader/writer locks acquired there were held.  A
+ * consumer starts profiling with LSPROFIOC_START on /dev/lockstat and then
+ * streams the profile with periodic LSPROFIOC_READs, each of which returns
+ * and resets the records gathered since the previous one.
+ *
+ * One in every lspc_rate events is sampled on each CPU; the counts are of
+ * sampled events, and should be scaled by lspc_rate.  Profiling can coexist
+ * with lockstat(1M) and DTrace use of the lockstat provider.  It stops when
+ * /dev/lockstat is last closed.
+ */
+#define	LSPROF_NBUCKETS		32		/* log2(ns) hold buckets */
+
+#define	LSPROF_F_HOLD		0x1		/* measure hold times */
+#define	LSPROF_F_ALL		LSPROF_F_HOLD
+
+#define	LSPROF_T_ADAPTIVE	0		/* adaptive mutex */
+#define	LSPROF_T_SPIN		1		/* spin lock */
+#define	LSPROF_T_RW		2		/* reader/writer lock */
+#define	LSPROF_T_THREAD		3		/* thread lock */
+
+#define	LSPROFIOC		(('l' << 24) | ('s' << 16) | ('p' << 8))
+#define	LSPROFIOC_START		(LSPROFIOC | 1)		/* lsprof_conf_t */
+#define	LSPROFIOC_STOP		(LSPROFIOC | 2)		/* no argument */
+#define	LSPROFIOC_READ		(LSPROFIOC | 3)		/* lsprof_read_t */
+
+typedef struct lsprof_conf {
+	uint32_t	lspc_rate;		/* 1 in this many sampled */
+	uint32_t	lspc_flags;		/* LSPROF_F_* flags */
+} lsprof_conf_t;
+
+typedef struct lsprof_rec {
+	uint64_t	lspr_caller;		/* caller of lock primitive */
+	uint32_t	lspr_type;		/* LSPROF_T_* lock type */
+	uint32_t	lspr_cpu;		/* CPU recorded on */
+	uint64_t	lspr_nspin;		/* sampled spin events */
+	uint64_t	lspr_spintime;		/* total spin time (ns) */
+	uint64_t	lspr_nblock;		/* sampled block events */
+	uint64_t	lspr_blocktime;		/* total block time (ns) */
+	uint64_t	lspr_nhold;		/* sampled holds */
+	uint64_t	lspr_holdtime;		/* total hold time (ns) */
+	uint64_t	lspr_holdhist[LSPROF_NBUCKETS];	/* hold times */
+} lsprof_rec_t;
+
+/*
+ * As with stkprof, the buffer is given as a 64-bit quantity so that the
+ * structure is the same for 32-bit and 64-bit consumers.  On return,
+ * lsprd_nrecs records have been written to it; events which could not be
+ * recorded (because a table was full, or because the buffer was too small)
+ * are counted in lsprd_drops.
+ */
+typedef struct lsprof_read {
+	uint64_t	lsprd_buf;		/* lsprof_rec_t array */
+	uint64_t	lsprd_bufsize;		/* size of buffer, in bytes */
+	uint64_t	lsprd_nrecs;		/* records returned */
+	uint64_t	lsprd_drops;		/* events dropped */
+} lsprof_read_t;
+
 #ifdef _KERNEL
 
 /*
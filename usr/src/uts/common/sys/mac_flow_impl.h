@@ -22,6 +22,7 @@
 /*
  * Copyright 2010 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_MAC_FLOW_IMPL_H
@@ -280,6 +281,8 @@ struct flow_entry_s {					/* Protected by */
 	void			*fe_rx_ring_group;	/* SL */
 	void			*fe_rx_srs[MAX_RINGS_PER_GROUP]; /* fe_lock */
 	int			fe_rx_srs_cnt;		/* fe_lock */
+	void			*fe_hw_ring;		/* SL, hw steers here */
+	uint_t			fe_hw_filter;		/* SL, provider's id */
 	void			*fe_tx_ring_group;
 	void			*fe_tx_srs;		/* WO */
 	int			fe_tx_ring_cnt;
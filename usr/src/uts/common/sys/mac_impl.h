@@ -20,7 +20,7 @@
  */
 /*
  * Copyright (c) 2005, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_SYS_MAC_IMPL_H
@@ -438,6 +438,13 @@ struct mac_impl_s {
 	mac_led_mode_t		mi_led_modes;
 	mac_capab_led_t		mi_led;
 
+	/*
+	 * Flow classification capability, and how many of its filters are
+	 * in use. SL protected.
+	 */
+	mac_capab_flow_t	mi_flow;
+	uint_t			mi_flow_nfilters;
+
 	/* Cache of the Tx DB_CKSUMFLAGS that this MAC supports. */
 	uint16_t		mi_tx_cksum_flags; /* SL */
 
@@ -904,6 +911,7 @@ extern int mac_transceiver_read(mac_handle_t, uint_t, uint_t, void *, size_t,
 #define	MAC_LED_ALL	(MAC_LED_DEFAULT | MAC_LED_OFF | MAC_LED_IDENT | \
 			    MAC_LED_ON)
 extern void mac_led_init(mac_impl_t *);
+extern void mac_flow_hw_init(mac_impl_t *);
 extern int mac_led_get(mac_handle_t, mac_led_mode_t *, mac_led_mode_t *);
 extern int mac_led_set(mac_handle_t, mac_led_mode_t);
 
@@ -21,7 +21,7 @@
 
 /*
  * Copyright (c) 2008, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright (c) 2018, Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright 2020 RackTop Systems, Inc.
  */
 
@@ -111,7 +111,9 @@ typedef enum {
 	MAC_CAPAB_VRRP		= 0x00400000, /* data is mac_capab_vrrp_t */
 	MAC_CAPAB_OVERLAY	= 0x00800000, /* boolean only, no data */
 	MAC_CAPAB_TRANSCEIVER	= 0x01000000, /* mac_capab_transciever_t */
-	MAC_CAPAB_LED		= 0x02000000  /* data is mac_capab_led_t */
+	MAC_CAPAB_LED		= 0x02000000, /* data is mac_capab_led_t */
+	MAC_CAPAB_TUNNEL	= 0x04000000, /* data is mac_capab_tunnel_t */
+	MAC_CAPAB_FLOW		= 0x08000000  /* data is mac_capab_flow_t */
 } mac_capab_t;
 
 /*
@@ -146,6 +148,31 @@ typedef	struct mac_capab_lso_s {
 	/* Add future lso capabilities here */
 } mac_capab_lso_t;
 
+/*
+ * Tunnel offload capability
+ *
+ * A provider which can apply checksum and LSO offloads to the inner frame of
+ * an encapsulated packet advertises the encapsulations it understands in
+ * mct_types. A transmitted frame asks for this by setting the matching
+ * HW_TUNNEL flag (see <sys/pattr.h>) alongside the usual HCK_* and HW_LSO
+ * flags, which then describe the inner frame rather than the outer one. The
+ * outer IPv4 header checksum must already be valid, though the provider may
+ * recompute it.
+ */
+#define	MAC_TUNNEL_VXLAN	0x01	/* VXLAN over UDP */
+
+#define	MCT_F_INNER_HCKSUM	0x01	/* inner IPv4 header and L4 checksum */
+#define	MCT_F_LSO		0x02	/* LSO of the inner TCP segment */
+#define	MCT_F_INNER_RSS		0x04	/* Rx hashing on the inner headers */
+
+typedef struct mac_capab_tunnel_s {
+	uint32_t	mct_types;	/* MAC_TUNNEL_* */
+	uint32_t	mct_flags;	/* MCT_F_* */
+	uint32_t	mct_hcksum_flags; /* HCKSUM_* valid on inner frame */
+	uint32_t	mct_lso_flags;	/* LSO_TX_* valid on the inner frame */
+	uint32_t	mct_lso_max;	/* maximum inner payload for LSO */
+} mac_capab_tunnel_t;
+
 /*
  * Multiple Factory MAC Addresses Capability
  */
@@ -394,6 +421,35 @@ typedef struct	mac_capab_rings_s {
 	mac_group_rem_ring_t	mr_gremring;	/* Remove ring from a group */
 } mac_capab_rings_t;
 
+/*
+ * Flow classification capability
+ *
+ * A provider which can match received frames against exact-match filters
+ * and steer the matches to a particular Rx ring advertises the flow_desc_t
+ * fields it can match in mcf_mask and how many filters it has.  When a flow
+ * whose fields are all in mcf_mask is added over one of its groups, the
+ * framework calls mcf_add() with the flow descriptor and the driver handle
+ * of the ring within that group which should receive the matches; the
+ * provider returns an identifier for the filter, to be passed to
+ * mcf_remove().  mcf_add() may fail, in which case the flow is classified
+ * in software as usual.
+ *
+ * With MCF_F_EXCLUSIVE the provider also takes the target ring out of its
+ * RSS spread for as long as a filter points at it, so that the ring only
+ * receives frames which matched; the framework then skips classifying
+ * them.  The framework never targets the first ring of a group.
+ */
+#define	MCF_F_EXCLUSIVE		0x01	/* target ring only gets matches */
+
+typedef struct mac_capab_flow_s {
+	flow_mask_t	mcf_mask;	/* FLOW_* fields that can be matched */
+	uint32_t	mcf_flags;	/* MCF_F_* */
+	uint_t		mcf_nfilters;	/* number of filters available */
+	int		(*mcf_add)(void *, mac_ring_driver_t,
+			    const flow_desc_t *, uint_t *);
+	int		(*mcf_remove)(void *, uint_t);
+} mac_capab_flow_t;
+
 /*
  * Common ring functions and driver interfaces
  */
@@ -679,6 +735,10 @@ typedef struct mac_ether_offload_info {
 
 extern int			mac_ether_offload_info(mblk_t *,
 				    mac_ether_offload_info_t *);
+extern int			mac_ether_tunnel_offload_info(mblk_t *,
+				    mac_ether_offload_info_t *,
+				    mac_ether_offload_info_t *);
+extern uint32_t			mac_tunnel_get(const mblk_t *);
 
 
 #endif	/* _KERNEL */
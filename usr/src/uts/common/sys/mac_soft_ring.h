@@ -22,7 +22,7 @@
 /*
  * Copyright 2010 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
- * Copyright 2017 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_SYS_MAC_SOFT_RING_H
@@ -364,6 +364,13 @@ struct mac_soft_ring_set_s {
 	void			*srs_flent;	/* back ptr to flent */
 	mac_ring_t		*srs_ring;	/*  Ring Descriptor */
 
+	/*
+	 * The flow that the hardware steers to this ring, and only it, if
+	 * any; see mac_flow_hw_add(). Protected by the subflow table's
+	 * ft_lock.
+	 */
+	void			*srs_hw_flent;
+
 	/* Teardown, disable control ops */
 	kcondvar_t	srs_client_cv;	/* Client wait for the control op */
 
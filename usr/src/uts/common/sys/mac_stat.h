@@ -51,6 +51,8 @@ typedef struct mac_rx_stats_s {
 	uint64_t	mrs_chaincnt10to50;
 	uint64_t	mrs_chaincntover50;
 	uint64_t	mrs_ierrors;
+	uint64_t	mrs_lropkts;	/* packets made by soft ring LRO */
+	uint64_t	mrs_lrosegs;	/* segments coalesced into them */
 } mac_rx_stats_t;
 
 typedef struct mac_tx_stats_s {
@@ -26,6 +26,7 @@
 
 /*
  * Copyright (c) 2017 by Delphix. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_NVPAIR_IMPL_H
@@ -61,6 +62,9 @@ struct i_nvp {
 
 			/* next pair in table bucket */
 			i_nvp_t	*_nvi_hashtable_next;
+
+			/* hash of the pair's name */
+			uint32_t _nvi_hash;
 		} _nvi;
 	} _nvi_un;
 
@@ -70,6 +74,7 @@ struct i_nvp {
 #define	nvi_next	_nvi_un._nvi._nvi_next
 #define	nvi_prev	_nvi_un._nvi._nvi_prev
 #define	nvi_hashtable_next	_nvi_un._nvi._nvi_hashtable_next
+#define	nvi_hash	_nvi_un._nvi._nvi_hash
 
 typedef struct {
 	i_nvp_t		*nvp_list;	/* linked list of nvpairs */
@@ -70,6 +70,29 @@ typedef enum overlay_target_flag {
 	OVERLAY_T_TEARDOWN	= 0x1
 } overlay_target_flag_t;
 
+/*
+ * Each CPU keeps a small, direct-mapped cache of recently used VL2 to UL3
+ * translations for a dynamic target so that the transmit path can avoid
+ * ott_lock and the refhash.  A slot is only ever written by its own CPU
+ * with preemption disabled; otpe_seq is odd while a write is in progress so
+ * that an interrupt thread on the same CPU never consumes a torn slot.  A
+ * slot is only valid while otpe_gen matches the target's ott_gen, which is
+ * bumped whenever any entry changes state.
+ */
+#define	OVERLAY_PCPU_NENTS	16
+
+typedef struct overlay_target_pcpu_ent {
+	volatile uint32_t	otpe_seq;
+	uint8_t			otpe_addr[ETHERADDRL];
+	uint64_t		otpe_gen;
+	struct in6_addr		otpe_ip;
+	uint16_t		otpe_port;
+} overlay_target_pcpu_ent_t;
+
+typedef struct overlay_target_pcpu {
+	overlay_target_pcpu_ent_t	otpc_ents[OVERLAY_PCPU_NENTS];
+} overlay_target_pcpu_t;
+
 typedef struct overlay_target {
 	kmutex_t		ott_lock;
 	kcondvar_t		ott_cond;
@@ -78,6 +101,8 @@ typedef struct overlay_target {
 	uint64_t		ott_id;		/* RO */
 	overlay_target_flag_t	ott_flags;	/* ott_lock */
 	uint_t			ott_ocount;	/* ott_lock */
+	volatile uint64_t	ott_gen;	/* atomic: entry generation */
+	overlay_target_pcpu_t	*ott_pcpu;	/* RO: per-CPU cache */
 	union {					/* ott_lock */
 		overlay_target_point_t	ott_point;
 		struct overlay_target_dyn {
@@ -124,7 +149,8 @@ typedef enum overlay_target_entry_flags {
 	OVERLAY_ENTRY_F_PENDING		= 0x01,	/* lookup in progress */
 	OVERLAY_ENTRY_F_VALID		= 0x02,	/* entry is currently valid */
 	OVERLAY_ENTRY_F_DROP		= 0x04,	/* always drop target */
-	OVERLAY_ENTRY_F_VALID_MASK	= 0x06
+	OVERLAY_ENTRY_F_VALID_MASK	= 0x06,
+	OVERLAY_ENTRY_F_NEGATIVE	= 0x08	/* recent lookup failed */
 } overlay_target_entry_flags_t;
 
 typedef struct overlay_target_entry {
@@ -140,7 +166,7 @@ typedef struct overlay_target_entry {
 	mblk_t			*ote_chead;	/* RW: blocked mb chain head */
 	mblk_t			*ote_ctail;	/* RW: blocked mb chain tail */
 	size_t			ote_mbsize;	/* RW: outstanding mblk size */
-	hrtime_t		ote_vtime;	/* RW: valid timestamp */
+	hrtime_t		ote_vtime;	/* RW: valid/negative time */
 } overlay_target_entry_t;
 
 
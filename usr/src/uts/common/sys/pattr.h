@@ -104,10 +104,24 @@ typedef struct pattr_hcksum_s {
  * Extended hardware offloading flags that also use hcksum_flags
  */
 #define	HW_LSO			0x10	/* On Transmit: hardware does LSO */
-					/* On Receive: N/A */
+					/* On Receive: segments coalesced */
+
+/*
+ * On receive, HW_LSO marks a TCP packet built by MAC from several received
+ * segments of DB_LSOMSS bytes each (the last possibly shorter).  The first
+ * mblk holds the first segment; every other segment is one mblk on its
+ * b_cont chain, with that segment's own headers still in place just ahead
+ * of b_rptr.
+ */
 
 #define	HW_LSO_FLAGS		HW_LSO	/* All LSO flags, currently only one */
 
+#define	HW_TUNNEL_VXLAN		0x20	/* On Transmit: frame is VXLAN */
+					/* encapsulated; HCK_* and HW_LSO */
+					/* apply to the inner frame. */
+					/* On Receive: N/A */
+#define	HW_TUNNEL_FLAGS		HW_TUNNEL_VXLAN
+
 /*
  * Structure used for zerocopy attribute.
  */
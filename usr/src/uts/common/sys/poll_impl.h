@@ -228,8 +228,14 @@ struct polldat {
 	port_kevent_t	*pd_portev;	/* associated port event struct */
 	uf_entry_gen_t	pd_gen;		/* fd generation at cache time */
 	uint64_t	pd_epolldata;	/* epoll data, if any */
+	polldat_t	*pd_rnext;	/* next on pollcache ready list */
+	uint_t		pd_flags;	/* see pd_flags define below */
 };
 
+/* pd_flags */
+#define	PDF_READY	0x01	/* on (or being drained from) ready list */
+#define	PDF_EXCLUSIVE	0x02	/* epoll exclusive wake-up */
+
 /*
  * One cache for each thread that polls. Points to a bitmap (used by pollwakeup)
  * and a hash table of polldats.
@@ -254,6 +260,9 @@ struct pollcache {
 	int		pc_mapstart;	/* where search start, devpoll only */
 	pcachelink_t	*pc_parents;	/* linked list of epoll parents */
 	pcachelink_t	*pc_children;	/* linked list of epoll children */
+	polldat_t	*pc_ready;	/* ready list, epoll only */
+	polldat_t	*pc_ready_tail;	/* last entry on ready list */
+	int		pc_waiters;	/* threads sleeping on pc_cv */
 };
 
 /* pc_flag */
@@ -326,6 +335,8 @@ extern void pcache_destroy(pollcache_t *);
  *  pcache_update_xref	update cross ref (from polldat back to cacheset) info
  *  pcache_clean_entry	cleanup an entry in pcache and more...
  *  pcache_wake_parents	wake linked parent pollcaches
+ *  pcache_ready_insert	mark a polldat ready, queueing it if epoll-enabled
+ *  pcache_ready_remove	take the first polldat off the ready list
  */
 extern polldat_t *pcache_lookup_fd(pollcache_t *, int);
 extern polldat_t *pcache_alloc_fd(int);
@@ -336,6 +347,8 @@ extern void pcache_grow_map(pollcache_t *, int);
 extern void pcache_update_xref(pollcache_t *, int, ssize_t, int);
 extern void pcache_clean_entry(pollstate_t *, int);
 extern void pcache_wake_parents(pollcache_t *);
+extern void pcache_ready_insert(pollcache_t *, polldat_t *);
+extern polldat_t *pcache_ready_remove(pollcache_t *);
 
 /*
  * pcacheset interfaces:
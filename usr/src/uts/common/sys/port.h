@@ -59,6 +59,13 @@ typedef	struct	port_notify {
 	void		*portnfy_user;	/* user defined */
 } port_notify_t;
 
+typedef struct port_assoc {
+	int		pa_source;	/* PORT_SOURCE_FD or PORT_SOURCE_FILE */
+	int		pa_events;	/* source specific events */
+	uintptr_t	pa_object;	/* source specific object */
+	void		*pa_user;	/* user cookie */
+} port_assoc_t;
+
 
 typedef struct file_obj {
 	timestruc_t	fo_atime;	/* Access time from stat(2) */
@@ -91,6 +98,13 @@ typedef	struct	port_notify32 {
 	caddr32_t 	portnfy_user;	/* user defined */
 } port_notify32_t;
 
+typedef struct port_assoc32 {
+	int		pa_source;	/* PORT_SOURCE_FD or PORT_SOURCE_FILE */
+	int		pa_events;	/* source specific events */
+	caddr32_t	pa_object;	/* source specific object */
+	caddr32_t	pa_user;	/* user cookie */
+} port_assoc32_t;
+
 #endif /* _SYSCALL32 */
 
 /* port_alert() flags */
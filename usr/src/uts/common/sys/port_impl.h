@@ -61,6 +61,7 @@ extern "C" {
 #define	PORT_GETN	6	/* receive list of objects with events */
 #define	PORT_ALERT	7	/* set port in alert mode */
 #define	PORT_DISPATCH	8	/* dispatch object with events */
+#define	PORT_ASSOCIATEN	9	/* register a list of objects */
 
 #define	PORT_SYS_NOPORT		0x100	/* system call without port-id */
 #define	PORT_SYS_NOSHARE	0x200	/* non shareable event */
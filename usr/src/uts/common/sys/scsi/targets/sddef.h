@@ -361,6 +361,10 @@ struct sd_lun {
 	short	un_saved_throttle;	/* saved value of un_throttle */
 	short	un_busy_throttle;	/* saved un_throttle for BUSY */
 	short	un_min_throttle;	/* min value of un_throttle */
+	short	un_lat_throttle;	/* latency-based limit, 0 if none */
+	uint_t	un_lat_ncmds;		/* completions in latency window */
+	hrtime_t un_lat_avg;		/* moving average cmd latency (ns) */
+	hrtime_t un_lat_base;		/* recent low of un_lat_avg (ns) */
 	timeout_id_t	un_reset_throttle_timeid; /* timeout(9F) handle */
 
 	/*
@@ -1436,6 +1440,7 @@ struct sd_xbuf {
 	short	xb_victim_retry_count;
 	short	xb_ua_retry_count;	/* unit_attention retry counter */
 	short	xb_nr_retry_count;	/* not ready retry counter */
+	hrtime_t xb_start;		/* time sent to the transport */
 
 	/*
 	 * Various status and data used when a RQS command is run on
@@ -203,6 +203,10 @@ struct so_snd_bufinfo {
 #define	SO_EXCLBIND	0x1015		/* exclusive binding */
 #define	SO_MAC_IMPLICIT	0x1016		/* hide mac labels on wire */
 #define	SO_VRRP		0x1017		/* VRRP control socket */
+#define	SO_MAX_PACING_RATE 0x1018	/* limit on pacing rate, bytes/sec */
+#define	SO_ZEROCOPY	0x1019		/* allow MSG_ZEROCOPY sends */
+#define	SCM_ZEROCOPY	SO_ZEROCOPY	/* MSG_ZEROCOPY completion */
+#define	SO_ACCEPTQ_PERCPU 0x101a	/* queue new conns per CPU */
 
 #ifdef	_KERNEL
 #define	SO_SRCADDR	0x2001		/* Internal: AF_UNIX source address */
@@ -256,6 +260,20 @@ struct	linger {
 	int	l_linger;		/* linger time */
 };
 
+/*
+ * Completion of one or more MSG_ZEROCOPY sends, returned as SCM_ZEROCOPY
+ * control data by recvmsg(MSG_ERRQUEUE).  Each zero-copy send is assigned
+ * the next 32-bit sequence number; the notification covers the sends
+ * numbered szc_lo through szc_hi inclusive, whose buffers may now be reused.
+ */
+struct sock_zcopy_info {
+	uint32_t	szc_lo;		/* first completed send */
+	uint32_t	szc_hi;		/* last completed send */
+	uint32_t	szc_flags;	/* SZC_* flags, below */
+};
+
+#define	SZC_COPIED	0x1		/* data was copied, not lent */
+
 /*
  * Levels for (get/set)sockopt() that don't apply to a specific protocol.
  */
@@ -422,6 +440,43 @@ struct msghdr32 {
 #endif	/* _SYSCALL32 */
 #endif	/* _KERNEL */
 
+#if !defined(_XPG4_2) || defined(__EXTENSIONS__)
+/*
+ * Message vector element for recvmmsg and sendmmsg.  msg_len is set to
+ * the number of bytes transferred for the message.
+ */
+struct mmsghdr {
+	struct msghdr	msg_hdr;		/* message header */
+	unsigned int	msg_len;		/* bytes transferred */
+};
+#endif	/* !defined(_XPG4_2) || defined(__EXTENSIONS__) */
+
+#if	defined(_KERNEL) || defined(_FAKE_KERNEL)
+
+/*
+ * Shape of a struct mmsghdr built from an omsghdr, ie. by a non-XPG4.2
+ * caller.
+ */
+struct ommsghdr {
+	struct omsghdr	msg_hdr;
+	uint_t		msg_len;
+};
+
+#if defined(_SYSCALL32)
+
+struct ommsghdr32 {
+	struct omsghdr32 msg_hdr;
+	uint32_t	msg_len;
+};
+
+struct mmsghdr32 {
+	struct msghdr32	msg_hdr;
+	uint32_t	msg_len;
+};
+
+#endif	/* _SYSCALL32 */
+#endif	/* _KERNEL */
+
 #define	MSG_OOB		0x1		/* process out-of-band data */
 #define	MSG_PEEK	0x2		/* peek at incoming message */
 #define	MSG_DONTROUTE	0x4		/* send without using routing tables */
@@ -435,6 +490,10 @@ struct msghdr32 {
 #define	MSG_DUPCTRL	0x800		/* Save control message for use with */
 					/* with left over data */
 #define	MSG_XPG4_2	0x8000		/* Private: XPG4.2 flag */
+#define	MSG_WAITFORONE	0x10000		/* recvmmsg: only block for first */
+#define	MSG_FASTOPEN	0x20000		/* Send data in the SYN (TCP) */
+#define	MSG_ZEROCOPY	0x40000		/* Lend pages instead of copying */
+#define	MSG_ERRQUEUE	0x80000		/* Receive zero-copy completions */
 
 /* Obsolete but kept for compilation compatibility. Use IOV_MAX. */
 #define	MSG_MAXIOVLEN	16
@@ -522,6 +581,8 @@ struct cmsghdr {
 #pragma redefine_extname socket __xnet_socket
 #pragma redefine_extname socketpair __xnet_socketpair
 #pragma redefine_extname getsockopt __xnet_getsockopt
+#pragma redefine_extname recvmmsg __xnet_recvmmsg
+#pragma redefine_extname sendmmsg __xnet_sendmmsg
 #else	/* __PRAGMA_REDEFINE_EXTNAME */
 #define	bind	__xnet_bind
 #define	connect	__xnet_connect
@@ -531,6 +592,8 @@ struct cmsghdr {
 #define	socket	__xnet_socket
 #define	socketpair	__xnet_socketpair
 #define	getsockopt	__xnet_getsockopt
+#define	recvmmsg	__xnet_recvmmsg
+#define	sendmmsg	__xnet_sendmmsg
 #endif	/* __PRAGMA_REDEFINE_EXTNAME */
 
 #endif	/* _XPG4_2 */
@@ -568,6 +631,13 @@ extern int socket(int, int, int);
 #if !defined(_XPG4_2) || defined(_XPG6) || defined(__EXTENSIONS__)
 extern int sockatmark(int);
 #endif /* !defined(_XPG4_2) || defined(_XPG6) || defined(__EXTENSIONS__) */
+
+#if !defined(_XPG4_2) || defined(__EXTENSIONS__)
+struct timespec;
+extern int recvmmsg(int, struct mmsghdr *, unsigned int, int,
+	struct timespec *);
+extern int sendmmsg(int, struct mmsghdr *, unsigned int, int);
+#endif /* !defined(_XPG4_2) || defined(__EXTENSIONS__) */
 #endif	/* !defined(_KERNEL) || defined(_BOOT) */
 
 #ifdef	__cplusplus
@@ -175,6 +175,10 @@ struct sonode {
 	unsigned int	so_backlog;		/* Listen backlog */
 	kcondvar_t	so_acceptq_cv;		/* wait for new conn. */
 	struct sonode	*so_listener;		/* parent socket */
+	struct so_acceptq_cpu *so_acceptq_cpu;	/* per-CPU queues or NULL */
+	boolean_t	so_acceptq_percpu;	/* SO_ACCEPTQ_PERCPU */
+	unsigned int	so_acceptq_cpu_len;	/* # on so_acceptq_cpu */
+	unsigned int	so_acceptq_waiters;	/* # of threads in accept() */
 
 	/* Options */
 	short	so_options;		/* From socket call, see socket.h */
@@ -233,6 +237,11 @@ struct sonode {
 	uint_t			so_copyflag;	/* Copy related flag */
 	kcondvar_t		so_copy_cv;	/* Copy cond variable */
 
+	/* MSG_ZEROCOPY, protected by so_lock */
+	boolean_t		so_zcopy;	/* SO_ZEROCOPY enabled */
+	uint32_t		so_zcopy_next;	/* next send sequence no. */
+	list_t			so_zcopy_list;	/* completions to report */
+
 	/* kernel sockets */
 	ksocket_callbacks_t	so_ksock_callbacks;
 	void			*so_ksock_cb_arg;	/* callback argument */
@@ -83,9 +83,28 @@ typedef struct squeue_s squeue_t;
  */
 typedef enum {
 	SQPRIVATE_TCP,
+	SQPRIVATE_IPCL,
 	SQPRIVATE_MAX
 } sqprivate_t;
 
+/*
+ * Squeue timers.  An sqtimer_t is embedded in the consumer's own structure
+ * and a zeroed one is idle; the function is called from within the squeue.
+ * See the block comment above squeue_timer_schedule() in squeue.c.
+ */
+typedef void (*sqtimer_func_t)(squeue_t *, void *);
+
+typedef struct sqtimer_s {
+	struct sqtimer_s	*st_next;	/* next timer in bucket */
+	struct sqtimer_s	**st_prevp;	/* link to us; NULL if idle */
+	hrtime_t		st_expire;	/* absolute expiration time */
+	sqtimer_func_t		st_func;	/* function to call */
+	void			*st_arg;	/* and its argument */
+	uint_t			st_bucket;	/* wheel bucket we are on */
+} sqtimer_t;
+
+#define	SQTIMER_PENDING(st)	((st)->st_prevp != NULL)
+
 struct ip_recv_attr_s;
 extern void squeue_init(void);
 extern squeue_t *squeue_create(pri_t, boolean_t);
@@ -95,6 +114,9 @@ extern void squeue_enter(squeue_t *, mblk_t *, mblk_t *,
     uint32_t, struct ip_recv_attr_s *, int, uint8_t);
 extern uintptr_t *squeue_getprivate(squeue_t *, sqprivate_t);
 extern void squeue_destroy(squeue_t *);
+extern void squeue_timer_schedule(squeue_t *, sqtimer_t *, hrtime_t,
+    sqtimer_func_t, void *);
+extern void squeue_timer_cancel(squeue_t *, sqtimer_t *);
 
 struct conn_s;
 extern int squeue_synch_enter(struct conn_s *, mblk_t *);
@@ -32,6 +32,7 @@ extern "C" {
 #endif
 
 #include <sys/disp.h>
+#include <sys/systm.h>
 #include <sys/types.h>
 #include <sys/squeue.h>
 #include <inet/ip.h>
@@ -87,6 +88,15 @@ typedef void (*sq_drain_proc_t)(squeue_t *, uint_t, hrtime_t);
 
 extern int ip_squeue_flag;
 
+/*
+ * The squeue timer wheel: SQ_TW_LEVELS levels of SQ_TW_SLOTS buckets each,
+ * every level covering SQ_TW_SLOTS times the span of the one below it.
+ */
+#define	SQ_TW_LEVELS	4
+#define	SQ_TW_BITS	6
+#define	SQ_TW_SLOTS	(1 << SQ_TW_BITS)
+#define	SQ_TW_MASK	(SQ_TW_SLOTS - 1)
+
 struct squeue_s {
 	sq_enter_proc_t	sq_enter;	/* sq_process function */
 	sq_drain_proc_t	sq_drain;	/* sq_drain function */
@@ -116,6 +126,15 @@ struct squeue_s {
 	pri_t		sq_priority;	/* squeue thread priority */
 	boolean_t	sq_isip;	/* use IP-centric features */
 
+	/* Timer wheel; only touched by the thread processing the squeue */
+	sqtimer_t	*sq_tw_bucket[SQ_TW_LEVELS * SQ_TW_SLOTS];
+	uint64_t	sq_tw_map[SQ_TW_LEVELS];	/* non-empty buckets */
+	uint64_t	sq_tw_tick;	/* last tick processed */
+	uint_t		sq_tw_count;	/* # of pending timers */
+	boolean_t	sq_tw_running;	/* expiring timers now */
+	callout_id_t	sq_tw_tid;	/* callout to run the wheel */
+	hrtime_t	sq_tw_armed;	/* when sq_tw_tid fires */
+
 	/* Keep the debug-only fields at the end of the structure */
 #ifdef DEBUG
 	int		sq_isintr;	/* serviced by interrupt */
@@ -163,6 +182,7 @@ struct squeue_s {
 #define	SQS_POLL_THR_QUIESCE	0x02000000
 #define	SQS_PAUSE		0x04000000 /* The squeue has been paused */
 #define	SQS_EXIT		0x08000000 /* squeue is being torn down */
+#define	SQS_TIMER		0x10000000 /* squeue timers are due */
 
 #define	SQS_WORKER_THR_CONTROL          \
 	(SQS_POLL_QUIESCE | SQS_POLL_RESTART | SQS_POLL_CLEANUP)
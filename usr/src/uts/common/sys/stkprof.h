@@ -0,0 +1,80 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2020 Joyent, Inc.
+ */
+
+#ifndef _SYS_STKPROF_H
+#define	_SYS_STKPROF_H
+
+/*
+ * Interface to the stkprof(7D) continuous stack-sampling profiler.  A single
+ * consumer opens /dev/stkprof, starts sampling at a given rate, and then
+ * periodically reads (and thereby resets) the sample tables.  Each record
+ * read is a distinct (pid, kernel stack, user stack) tuple seen on one CPU
+ * since the previous read, along with the number of times it was sampled.
+ */
+
+#include <sys/types.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define	STKPROF_MAXDEPTH	32		/* frames per stack */
+#define	STKPROF_MAXHZ		5000		/* highest sampling rate */
+
+#define	STKPROF_F_KERNEL	0x1		/* sample kernel stacks */
+#define	STKPROF_F_USER		0x2		/* sample user stacks */
+#define	STKPROF_F_IDLE		0x4		/* include idle CPUs */
+#define	STKPROF_F_ALL		(STKPROF_F_KERNEL | STKPROF_F_USER | \
+	STKPROF_F_IDLE)
+
+#define	STKPROFIOC		(('s' << 24) | ('t' << 16) | ('k' << 8))
+#define	STKPROFIOC_START	(STKPROFIOC | 1)	/* stkprof_conf_t */
+#define	STKPROFIOC_STOP		(STKPROFIOC | 2)	/* no argument */
+#define	STKPROFIOC_READ		(STKPROFIOC | 3)	/* stkprof_read_t */
+
+typedef struct stkprof_conf {
+	uint32_t	spcf_hz;		/* per-CPU sampling rate */
+	uint32_t	spcf_flags;		/* STKPROF_F_* flags */
+} stkprof_conf_t;
+
+typedef struct stkprof_rec {
+	uint64_t	spr_count;		/* times sampled */
+	int32_t		spr_pid;		/* process ID */
+	int32_t		spr_zoneid;		/* zone ID */
+	uint32_t	spr_cpu;		/* CPU sampled on */
+	uint16_t	spr_nkframes;		/* valid frames in spr_kstack */
+	uint16_t	spr_nuframes;		/* valid frames in spr_ustack */
+	uint64_t	spr_kstack[STKPROF_MAXDEPTH];	/* kernel PCs */
+	uint64_t	spr_ustack[STKPROF_MAXDEPTH];	/* user PCs */
+} stkprof_rec_t;
+
+/*
+ * The buffer is given as a 64-bit quantity so that the structure is the same
+ * for 32-bit and 64-bit consumers.  On return, sprd_nrecs records have been
+ * written to it; samples which could not be recorded (because a table was
+ * full, or because the buffer was too small) are counted in sprd_drops.
+ */
+typedef struct stkprof_read {
+	uint64_t	sprd_buf;		/* stkprof_rec_t array */
+	uint64_t	sprd_bufsize;		/* size of buffer, in bytes */
+	uint64_t	sprd_nrecs;		/* records returned */
+	uint64_t	sprd_drops;		/* samples dropped */
+} stkprof_read_t;
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_STKPROF_H */
@@ -25,7 +25,7 @@
 /*
  * Copyright 2010 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
- * Copyright 2018 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -1219,6 +1219,7 @@ extern int frozenstr(queue_t *);
 extern size_t xmsgsize(mblk_t *);
 
 extern void putnext_tail(syncq_t *, queue_t *, uint32_t);
+extern void putnext_chain(queue_t *, mblk_t *);
 extern void stream_willservice(stdata_t *);
 extern void stream_runservice(stdata_t *);
 
@@ -78,6 +78,7 @@ extern "C" {
 #define	SYS_alarm	27
 #define	SYS_fstat	28
 #define	SYS_pause	29
+#define	SYS_recvmmsg	30
 #define	SYS_stty	31
 #define	SYS_gtty	32
 #define	SYS_access	33
@@ -201,6 +202,7 @@ extern "C" {
 	 * 	idmap_reg(...)		:: sidsys(1, ...)
 	 * 	idmap_unreg(...)	:: sidsys(2, ...)
 	 */
+#define	SYS_sendmmsg	76
 #define	SYS_lwp_park	77
 	/*
 	 * subcodes:
@@ -90,6 +90,29 @@ struct taskq_bucket {
 /*
  * Bucket flags.
  */
+/*
+ * Per-CPU queue of a TASKQ_PERCPU taskq.  Dispatchers append to the queue
+ * of the CPU they run on; each worker thread drains its own queue from the
+ * head and steals from the tail of the others when it runs dry.  The
+ * structure is padded so that neighbouring queues do not share a cache line.
+ */
+typedef union taskq_pcq {
+	struct {
+		kmutex_t	_tqp_lock;
+		taskq_ent_t	_tqp_task;	/* queued tasks */
+		uint64_t	_tqp_tasks;	/* tasks dispatched here */
+		uint64_t	_tqp_steals;	/* tasks stolen by others */
+		uint64_t	_tqp_lockwait;	/* contended tqp_lock enters */
+	}		tqp_s;
+	char		tqp_pad[128];
+} taskq_pcq_t;
+
+#define	tqp_lock	tqp_s._tqp_lock
+#define	tqp_task	tqp_s._tqp_task
+#define	tqp_tasks	tqp_s._tqp_tasks
+#define	tqp_steals	tqp_s._tqp_steals
+#define	tqp_lockwait	tqp_s._tqp_lockwait
+
 #define	TQBUCKET_CLOSE		0x01
 #define	TQBUCKET_SUSPEND	0x02
 
@@ -129,6 +152,10 @@ struct taskq {
 	taskq_bucket_t	*tq_buckets;	/* Per-cpu array of buckets */
 	int		tq_instance;
 	uint_t		tq_nbuckets;	/* # of buckets	(2^n)	    */
+	taskq_pcq_t	*tq_pcq;	/* TASKQ_PERCPU queues */
+	uint_t		tq_npcq;	/* # of per-CPU queues */
+	volatile uint_t	tq_pcq_pending;	/* tasks queued in tq_pcq */
+	volatile uint_t	tq_pcq_idle;	/* threads waiting for work */
 	union {
 		kthread_t *_tq_thread;
 		kthread_t **_tq_threadlist;
@@ -279,6 +279,7 @@ typedef	uint64_t	vfs_feature_t;
 #define	VFSFT_ACCESS_FILTER	0x100000080	/* dirents filtered by access */
 #define	VFSFT_REPARSE		0x100000100	/* Supports reparse point */
 #define	VFSFT_ZEROCOPY_SUPPORTED	0x100000200
+#define	VFSFT_DIRENTTYPE	0x100000400	/* Supports dirent types */
 				/* Support loaning /returning cache buffer */
 /*
  * Argument structure for mount(2).
@@ -21,7 +21,7 @@
 /*
  * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
- * Copyright 2017 Joyent, Inc.  All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_SYS_VM_USAGE_H
@@ -82,7 +82,17 @@ extern "C" {
 					/* euser */
 #define	VMUSAGE_A_ZONE		0x4000	/* rss/swap for a specified zone */
 
-#define	VMUSAGE_MASK		0x7fff  /* all valid flags for getvmusage() */
+/*
+ * VMUSAGE_FAST may be combined with VMUSAGE_SYSTEM and the zone flags.  The
+ * results are then taken from per-zone counters maintained as pages are
+ * mapped and unmapped, rather than by walking every process's address space.
+ * Only vmu_rss_all and vmu_swap_all are filled in, and a page shared between
+ * zones is counted in none of them.  The flag is ignored if any other
+ * results are requested.
+ */
+#define	VMUSAGE_FAST		0x8000
+
+#define	VMUSAGE_MASK		0xffff  /* all valid flags for getvmusage() */
 
 #define	VMUSAGE_ZONE_FLAGS	(VMUSAGE_ZONE | VMUSAGE_ALL_ZONES | \
 				VMUSAGE_A_ZONE)
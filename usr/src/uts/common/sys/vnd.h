@@ -134,6 +134,64 @@ typedef struct vnd_ioc_list32 {
 #define	VND_IOC_FRAMEIO_READ	(VND_IOC | 0x30)
 #define	VND_IOC_FRAMEIO_WRITE	(VND_IOC | 0x31)
 
+/*
+ * Shared memory ring ioctls
+ *
+ * VND_IOC_RING_SETUP creates a receive and a transmit ring of vir_nslots slots
+ * each, where vir_nslots is a power of two and each slot holds one frame of up
+ * to vir_slotsize bytes. The slot size is rounded up and the actual size
+ * returned along with vir_mapsize, the length the consumer should then mmap(2)
+ * from offset zero of the device. The region starts with a vnd_ring_map_t;
+ * a ring's descriptors and slot buffers are found at the offsets its
+ * vnd_ring_ctl_t gives. Once a device has rings, received frames are placed in
+ * the receive ring rather than being queued for read(2) and frameio. The rings
+ * last until the device is closed.
+ *
+ * The producer and consumer indexes are free running; slot i of a ring is
+ * descriptor (i & (vrc_nslots - 1)) and the slot buffer at that index. On the
+ * receive ring the kernel advances vrc_prod as frames arrive and the consumer
+ * advances vrc_cons as it finishes with them. On the transmit ring the
+ * consumer fills slots and advances vrc_prod, then issues VND_IOC_RING_TXKICK
+ * to have the kernel send them. The kernel advances vrc_cons as slots may be
+ * reused, which may be some time after the kick as frames are sent from the
+ * ring without being copied. A kick returns the number of frames taken in
+ * vir_ntx; it takes fewer than were posted when the transmit buffer is full,
+ * and should be repeated once the device polls writeable.
+ *
+ * Together with poll(2) or event ports, POLLIN indicates a non-empty receive
+ * ring, and POLLOUT one with free transmit slots and transmit buffer space.
+ */
+#define	VND_IOC_RING_SETUP	(VND_IOC | 0x40)
+#define	VND_IOC_RING_TXKICK	(VND_IOC | 0x41)
+
+typedef struct vnd_ioc_ring {
+	uint32_t	vir_nslots;	/* slots per ring */
+	uint32_t	vir_slotsize;	/* bytes per slot */
+	uint64_t	vir_mapsize;	/* bytes to mmap */
+	uint32_t	vir_ntx;	/* frames taken by a kick */
+	uint32_t	vir_errno;
+} vnd_ioc_ring_t;
+
+typedef struct vnd_ring_ctl {
+	volatile uint32_t vrc_prod;	/* producer index */
+	volatile uint32_t vrc_cons;	/* consumer index */
+	uint32_t	vrc_nslots;
+	uint32_t	vrc_slotsize;
+	uint64_t	vrc_descoff;	/* offset of the descriptors */
+	uint64_t	vrc_dataoff;	/* offset of the slot buffers */
+	uint64_t	vrc_pad[5];	/* keep each ring on its own line */
+} vnd_ring_ctl_t;
+
+typedef struct vnd_ring_desc {
+	uint32_t	vrd_len;	/* frame length */
+	uint32_t	vrd_flags;	/* reserved, zero */
+} vnd_ring_desc_t;
+
+typedef struct vnd_ring_map {
+	vnd_ring_ctl_t	vrm_rx;
+	vnd_ring_ctl_t	vrm_tx;
+} vnd_ring_map_t;
+
 #ifdef __cplusplus
 }
 #endif
@@ -62,6 +62,9 @@ typedef enum vnd_errno {
 	VND_E_SYS,			/* unexpected system error */
 	VND_E_CAPABPASS,
 			/* capabilities invalid, pass-through module detected */
+	VND_E_RINGEXISTS,		/* device already has rings */
+	VND_E_NORING,			/* device has no rings */
+	VND_E_BADRING,			/* invalid ring geometry or index */
 	VND_E_UNKNOWN			/* unknown error */
 } vnd_errno_t;
 
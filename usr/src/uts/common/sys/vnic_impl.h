@@ -65,6 +65,7 @@ typedef struct vnic_s {
 
 	uint32_t		vn_hcksum_txflags;
 	mac_capab_lso_t		vn_cap_lso;
+	mac_capab_tunnel_t	vn_cap_tunnel;
 	uint32_t		vn_mtu;
 	link_state_t		vn_ls;
 } vnic_t;
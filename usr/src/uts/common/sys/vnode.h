@@ -418,6 +418,14 @@ typedef struct vn_vfslocks_entry {
  */
 #define	VTRAVERSE	0x80000
 
+/*
+ * The file system only lets this vnode's pages become modified through shared
+ * writable mappings, and reports such mappings with fsflush_vnode_add().
+ * fsflush then flushes the vnode directly rather than finding its modified
+ * pages by scanning memory.  Must be set before the vnode has any pages.
+ */
+#define	VNOPGSCAN	0x100000
+
 /*
  * Vnode attributes.  A bit-mask is supplied as part of the
  * structure to indicate the attributes the caller wants to
@@ -1272,6 +1280,7 @@ extern int	fop_retzcbuf(vnode_t *, xuio_t *, cred_t *, caller_context_t *);
  */
 #define	V_RDDIR_ENTFLAGS	0x01	/* request dirent flags */
 #define	V_RDDIR_ACCFILTER	0x02	/* filter out inaccessible dirents */
+#define	V_RDDIR_DTYPE		0x04	/* request dirent types */
 
 /*
  * Flags for VOP_RWLOCK/VOP_RWUNLOCK
@@ -1301,6 +1310,7 @@ int	vn_is_readonly(vnode_t *);
 int	vn_is_opened(vnode_t *, v_mode_t);
 int	vn_is_mapped(vnode_t *, v_mode_t);
 int	vn_has_other_opens(vnode_t *, v_mode_t);
+void	fsflush_vnode_add(vnode_t *);
 void	vn_open_upgrade(vnode_t *, int);
 void	vn_open_downgrade(vnode_t *, int);
 
@@ -135,6 +135,7 @@ extern "C" {
 #define	ZONE_ATTR_SECFLAGS	21
 #define	ZONE_ATTR_INITRESTART0	22
 #define	ZONE_ATTR_INITREBOOT	23
+#define	ZONE_ATTR_LPG_PROMOTE	24
 
 /* Start of the brand-specific attribute namespace */
 #define	ZONE_ATTR_BRAND_ATTRS	32768
@@ -452,6 +453,14 @@ typedef struct {
 	kstat_named_t	zv_delay_time;
 } zone_vfs_kstat_t;
 
+/*
+ * Number of power-of-two buckets in the per-zone ZFS queue time histograms.
+ * Bucket n counts I/Os which waited in the vdev queue for [2^n, 2^(n+1))
+ * microseconds; the first bucket also counts sub-microsecond waits and the
+ * last bucket is open-ended.
+ */
+#define	ZONE_ZFS_QTIME_BUCKETS	24
+
 typedef struct {
 	kstat_named_t	zz_zonename;
 	kstat_named_t	zz_nread;
@@ -461,8 +470,43 @@ typedef struct {
 	kstat_named_t	zz_nwritten;
 	kstat_named_t	zz_writes;
 	kstat_named_t	zz_waittime;
+	kstat_named_t	zz_qos_slo_miss;
+	kstat_named_t	zz_qos_qtime_avg;
+	kstat_named_t	zz_rd_qtime[ZONE_ZFS_QTIME_BUCKETS];
+	kstat_named_t	zz_wr_qtime[ZONE_ZFS_QTIME_BUCKETS];
 } zone_zfs_kstat_t;
 
+/*
+ * Per-zone latency histograms, exported through the "zone_lat" kstat.  As with
+ * the ZFS queue time histograms above, bucket n counts operations which took
+ * [2^n, 2^(n+1)) microseconds.  VFS operations are timed in the fop_*()
+ * wrappers for filesystems with VFS_STATS set; ZFS I/Os are timed from
+ * dispatch to completion and classified by the allocation class of the
+ * top-level vdev they were issued to.
+ */
+#define	ZONE_LAT_BUCKETS	24
+
+typedef enum zone_lat_vfs {
+	ZONE_LAT_VFS_READ,
+	ZONE_LAT_VFS_WRITE,
+	ZONE_LAT_VFS_FSYNC,
+	ZONE_LAT_VFS_NOPS
+} zone_lat_vfs_t;
+
+typedef enum zone_lat_zio {
+	ZONE_LAT_ZIO_NORMAL,
+	ZONE_LAT_ZIO_LOG,
+	ZONE_LAT_ZIO_SPECIAL,
+	ZONE_LAT_ZIO_DEDUP,
+	ZONE_LAT_ZIO_NCLASS
+} zone_lat_zio_t;
+
+typedef struct {
+	kstat_named_t	zl_zonename;
+	kstat_named_t	zl_vfs[ZONE_LAT_VFS_NOPS][ZONE_LAT_BUCKETS];
+	kstat_named_t	zl_zio[ZONE_LAT_ZIO_NCLASS][ZONE_LAT_BUCKETS];
+} zone_lat_kstat_t;
+
 typedef struct {
 	kstat_named_t	zm_zonename;
 	kstat_named_t	zm_rss;
@@ -470,6 +514,8 @@ typedef struct {
 	kstat_named_t	zm_swap;
 	kstat_named_t	zm_swap_cap;
 	kstat_named_t	zm_nover;
+	kstat_named_t	zm_reclaim_usec;
+	kstat_named_t	zm_reclaim_max_usec;
 	kstat_named_t	zm_pagedout;
 	kstat_named_t	zm_pgpgin;
 	kstat_named_t	zm_anonpgin;
@@ -497,6 +543,8 @@ typedef struct {
 	kstat_named_t	zm_init_pid;
 	kstat_named_t	zm_init_restarts;
 	kstat_named_t	zm_boot_time;
+	kstat_named_t	zm_lpg_promote;
+	kstat_named_t	zm_lpg_promote_fail;
 } zone_misc_kstat_t;
 
 typedef struct zone {
@@ -640,6 +688,7 @@ typedef struct zone {
 	void		*zone_brand_data;	/* store brand specific data */
 	id_t		zone_defaultcid;	/* dflt scheduling class id */
 	boolean_t	zone_fixed_hipri;	/* fixed sched. hi prio */
+	boolean_t	zone_lpg_promote;	/* async large page promotion */
 	kstat_t		*zone_swapresv_kstat;
 	kstat_t		*zone_lockedmem_kstat;
 	/*
@@ -648,6 +697,7 @@ typedef struct zone {
 	list_t		zone_dl_list;
 	netstack_t	*zone_netstack;
 	struct cpucap	*zone_cpucap;	/* CPU caps data */
+	struct dnlc_zone *zone_dnlc;	/* DNLC share accounting */
 
 	/*
 	 * kstats and counters for VFS ops and bytes.
@@ -664,6 +714,15 @@ typedef struct zone {
 	kstat_t		*zone_zfs_ksp;
 	zone_zfs_kstat_t *zone_zfs_stats;
 
+	/*
+	 * Latency histograms; see zone_lat_vfs_record().  The ZFS I/O
+	 * histograms are kept with the rest of the zone's ZFS I/O data in
+	 * zone_pdata.
+	 */
+	kmutex_t	zone_lat_lock;		/* protects zone_lat kstat */
+	kstat_t		*zone_lat_ksp;
+	uint64_t	zone_vfs_lat[ZONE_LAT_VFS_NOPS][ZONE_LAT_BUCKETS];
+
 	/*
 	 * illumos Auditing per-zone audit context
 	 */
@@ -715,6 +774,9 @@ typedef struct zone {
 
 	uint32_t	zone_nested_intp;	/* nested interp. kstat */
 
+	uint32_t	zone_lpg_promote_ok;	/* large page promotions */
+	uint32_t	zone_lpg_promote_fail;	/* failed promotions */
+
 	struct loadavg_s zone_loadavg;		/* loadavg for this zone */
 	uint64_t	zone_hp_avenrun[3];	/* high-precision avenrun */
 	int		zone_avenrun[3];	/* FSCALED avg. run queue len */
@@ -754,6 +816,20 @@ typedef struct zone_zfs_io {
 	uint8_t		zpers_io_delay;		/* IO delay on logical r/w */
 	uint8_t		zpers_zfs_weight;	/* used to prevent starvation */
 	uint8_t		zpers_io_util_above_avg; /* IO util percent > avg. */
+	uint8_t		zpers_dirty_above_fair;	/* dirtying > fair share */
+	uint64_t	zpers_dirty_bytes;	/* data dirtied this period */
+	/* Latency-target QoS (see zfs_zone_qos_enable) */
+	uint32_t	zpers_qos_lat_target;	/* queue time SLO (usec) */
+	uint32_t	zpers_qos_iops_floor;	/* guaranteed ops/sec */
+	uint64_t	zpers_qos_bw_floor;	/* guaranteed bytes/sec */
+	int64_t		zpers_qos_deficit[2];	/* sync queue DRR deficit */
+	hrtime_t	zpers_qos_win_start;	/* floor window start (usec) */
+	uint64_t	zpers_qos_win_ops;	/* ops issued in window */
+	uint64_t	zpers_qos_win_bytes;	/* bytes issued in window */
+	uint64_t	zpers_qos_qtime_avg;	/* decayed sync queue time */
+	uint64_t	zpers_qos_slo_miss;	/* sync I/Os queued past SLO */
+	uint64_t	zpers_qos_qtime_hist[2][ZONE_ZFS_QTIME_BUCKETS];
+	uint64_t	zpers_zio_lat[ZONE_LAT_ZIO_NCLASS][ZONE_LAT_BUCKETS];
 } zone_zfs_io_t;
 
 /*
@@ -766,6 +842,9 @@ typedef struct zone_persist {
 	uint32_t	zpers_pg_cnt;	/* current RSS in pages */
 	uint32_t	zpers_pg_limit;	/* current RRS limit in pages */
 	uint32_t	zpers_nover;	/* # of times over phys. cap */
+	hrtime_t	zpers_over_start; /* when last went over phys. cap */
+	uint64_t	zpers_over_time; /* total nsec spent over phys. cap */
+	uint64_t	zpers_over_max;	/* longest nsec spent over phys. cap */
 #ifndef DEBUG
 	uint64_t	zpers_pg_out;	/* # pages flushed */
 #else
@@ -1034,6 +1113,9 @@ extern void zone_add_page(struct page *);
 extern void zone_rm_page(struct page *);
 extern void zone_pageout_stat(int, zone_pageout_op_t);
 extern void zone_get_physmem_data(int, pgcnt_t *, pgcnt_t *);
+extern void zone_get_zfs_iostats(int, kstat_io_t *);
+extern uint_t zone_lat_bucket(hrtime_t);
+extern void zone_lat_vfs_record(zone_t *, zone_lat_vfs_t, hrtime_t);
 
 /* Interfaces for page scanning */
 extern uint_t zone_num_over_cap;
@@ -62,6 +62,7 @@
 #include <sys/lwp_upimutex_impl.h>
 #include <vm/as.h>
 #include <sys/sdt.h>
+#include <sys/disp.h>
 
 static kthread_t *lwpsobj_owner(caddr_t);
 static void lwp_unsleep(kthread_t *t);
@@ -1891,7 +1892,9 @@ lwp_cond_signal(lwp_cond_t *cv)
 		 * where corruption can occur for such a program. Of course
 		 * if the memory is unmapped, normal fault recovery occurs.
 		 */
+		curthread->t_dirwake = (disp_dirwake != 0);
 		(void) lwp_release(&lwpchan, &waiters, T_WAITCVSEM);
+		curthread->t_dirwake = 0;
 		suword8_noerr(&cv->cond_waiters_kernel, waiters);
 	}
 	lwpchan_unlock(&lwpchan, LWPCHAN_CVPOOL);
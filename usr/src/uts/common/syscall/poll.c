@@ -802,6 +802,12 @@ pollcleanout:
  * Multiple events may be specified.  When POLLHUP or POLLERR are specified,
  * all waiting threads are poked.
  *
+ * Of the polldats marked PDF_EXCLUSIVE (epoll's EPOLLEXCLUSIVE), only
+ * those up to and including the first whose pollcache has a sleeping
+ * thread are notified, so that a listening socket shared by many epoll
+ * handles wakes one of them rather than all.  POLLHUP and POLLERR still
+ * reach every exclusive waiter.
+ *
  * It is important that pollnotify() not drop the lock protecting the list
  * of threads.
  */
@@ -816,6 +822,7 @@ pollwakeup(pollhead_t *php, short events_arg)
 		struct plist *next;
 		};
 	struct plist *plhead = NULL, *pltail = NULL;
+	boolean_t	excl_woken = B_FALSE;
 
 retry:
 	PH_ENTER(php);
@@ -826,6 +833,10 @@ retry:
 
 			pollcache_t 	*pcp;
 
+			if ((pdp->pd_flags & PDF_EXCLUSIVE) && excl_woken &&
+			    (events & (POLLHUP | POLLERR)) == 0)
+				continue;
+
 			if (pdp->pd_portev != NULL) {
 				port_kevent_t	*pkevp = pdp->pd_portev;
 				/*
@@ -886,7 +897,11 @@ retry:
 			 * that the failure rate is very very low.
 			 */
 			if (mutex_tryenter(&pcp->pc_lock)) {
+				pcache_ready_insert(pcp, pdp);
 				pollnotify(pcp, pdp->pd_fd);
+				if ((pdp->pd_flags & PDF_EXCLUSIVE) &&
+				    pcp->pc_waiters > 0)
+					excl_woken = B_TRUE;
 				mutex_exit(&pcp->pc_lock);
 			} else {
 				/*
@@ -964,6 +979,10 @@ retry:
  * This function is called to inform a thread (or threads) that an event being
  * polled on has occurred.  The pollstate lock on the thread should be held
  * on entry.
+ *
+ * Threads sharing an epoll-enabled pollcache all harvest the same ready list,
+ * so only one of them is woken; DP_POLL passes the wake-up along if it
+ * leaves ready entries behind.
  */
 void
 pollnotify(pollcache_t *pcp, int fd)
@@ -972,10 +991,59 @@ pollnotify(pollcache_t *pcp, int fd)
 	ASSERT(MUTEX_HELD(&pcp->pc_lock));
 	BT_SET(pcp->pc_bitmap, fd);
 	pcp->pc_flag |= PC_POLLWAKE;
-	cv_broadcast(&pcp->pc_cv);
+	if (pcp->pc_flag & PC_EPOLL)
+		cv_signal(&pcp->pc_cv);
+	else
+		cv_broadcast(&pcp->pc_cv);
 	pcache_wake_parents(pcp);
 }
 
+/*
+ * Epoll-enabled pollcaches keep the polldats whose bits are set in the
+ * bitmap on a FIFO ready list, so that DP_POLL visits only those fds rather
+ * than scanning the whole map.  PDF_READY is set while a polldat is on the
+ * list, and stays set while dp_pcache_poll() examines it; it puts the
+ * polldat back if the bit is still set when it's done.
+ */
+void
+pcache_ready_insert(pollcache_t *pcp, polldat_t *pdp)
+{
+	ASSERT(MUTEX_HELD(&pcp->pc_lock));
+	ASSERT(pdp->pd_fd < pcp->pc_mapsize);
+
+	BT_SET(pcp->pc_bitmap, pdp->pd_fd);
+	if ((pcp->pc_flag & PC_EPOLL) == 0 || (pdp->pd_flags & PDF_READY))
+		return;
+
+	pdp->pd_flags |= PDF_READY;
+	pdp->pd_rnext = NULL;
+	if (pcp->pc_ready_tail == NULL) {
+		pcp->pc_ready = pdp;
+	} else {
+		pcp->pc_ready_tail->pd_rnext = pdp;
+	}
+	pcp->pc_ready_tail = pdp;
+}
+
+/*
+ * Take the first polldat off the ready list.  It keeps PDF_READY; see
+ * above.
+ */
+polldat_t *
+pcache_ready_remove(pollcache_t *pcp)
+{
+	polldat_t *pdp;
+
+	ASSERT(MUTEX_HELD(&pcp->pc_lock));
+	if ((pdp = pcp->pc_ready) != NULL) {
+		ASSERT(pdp->pd_flags & PDF_READY);
+		if ((pcp->pc_ready = pdp->pd_rnext) == NULL)
+			pcp->pc_ready_tail = NULL;
+		pdp->pd_rnext = NULL;
+	}
+	return (pdp);
+}
+
 /*
  * add a polldat entry to pollhead ph_list. The polldat struct is used
  * by pollwakeup to wake sleeping pollers when polled events has happened.
@@ -275,6 +275,7 @@ faultcode_t as_faulta(struct as *as, caddr_t addr, size_t size);
 int	as_setprot(struct as *as, caddr_t addr, size_t size, uint_t prot);
 int	as_checkprot(struct as *as, caddr_t addr, size_t size, uint_t prot);
 int	as_unmap(struct as *as, caddr_t addr, size_t size);
+int	as_move(struct as *as, caddr_t addr, size_t size, caddr_t naddr);
 int	as_map(struct as *as, caddr_t addr, size_t size, segcreate_func_t crfp,
     void *argsp);
 int as_map_locked(struct as *as, caddr_t addr, size_t size,
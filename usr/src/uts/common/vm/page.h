@@ -20,7 +20,7 @@
  */
 /*
  * Copyright (c) 1986, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright 2017, Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*	Copyright (c) 1984, 1986, 1987, 1988, 1989 AT&T	*/
@@ -678,6 +678,12 @@ extern	pgcnt_t	total_pages;		/* total pages in the system */
 extern	pgcnt_t	pages_pp_maximum;	/* tuning: lock + claim <= max */
 extern	void init_pages_pp_maximum(void);
 
+extern	void page_compact_thread(void);
+
+extern	void page_pcp_init(void);
+extern	int page_pcp_free(page_t *);
+extern	void page_pcp_drain_all(void);
+
 struct lgrp;
 
 /* page_list_{add,sub} flags */
@@ -727,6 +733,7 @@ void	page_rename(page_t *, struct vnode *, u_offset_t);
 int	page_hashin(page_t *, struct vnode *, u_offset_t, kmutex_t *);
 void	page_hashout(page_t *, kmutex_t *);
 int	page_num_hashin(pfn_t, struct vnode *, u_offset_t);
+pgcnt_t	page_scan_count(void);
 void	page_add(page_t **, page_t *);
 void	page_add_common(page_t **, page_t *);
 void	page_sub(page_t **, page_t *);
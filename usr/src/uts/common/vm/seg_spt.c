@@ -20,7 +20,7 @@
  */
 /*
  * Copyright (c) 1993, 2010, Oracle and/or its affiliates. All rights reserved.
- * Copyright 2019 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  * Copyright (c) 2016 by Delphix. All rights reserved.
  */
 
@@ -65,6 +65,17 @@ size_t	spt_used;
 pgcnt_t segspt_minfree = 0;
 size_t segspt_minfree_clamp = (1UL << 30); /* 1GB in bytes */
 
+/*
+ * Interleave the pages of ISM and DISM segments larger than
+ * lgrp_shm_random_thresh round robin across lgroups, rather than placing each
+ * page in a random lgroup.  With large pages a segment is only a handful of
+ * pages, and random placement can leave most of a big shared buffer pool, and
+ * the memory bandwidth to it, on one socket.
+ */
+int segspt_interleave = 1;
+
+extern size_t lgrp_shm_random_thresh;
+
 static int segspt_create(struct seg **segpp, void *argsp);
 static int segspt_unmap(struct seg *seg, caddr_t raddr, size_t ssize);
 static void segspt_free(struct seg *seg);
@@ -521,6 +532,18 @@ segspt_unmap(struct seg *seg, caddr_t raddr, size_t ssize)
 		return (EINVAL);
 }
 
+/*
+ * Initial memory allocation policy for a shared segment of the given size.
+ */
+static lgrp_mem_policy_t
+segspt_policy(size_t size)
+{
+	if (segspt_interleave && size > lgrp_shm_random_thresh)
+		return (LGRP_MEM_POLICY_ROUNDROBIN);
+
+	return (LGRP_MEM_POLICY_DEFAULT);
+}
+
 int
 segspt_create(struct seg **segpp, void *argsp)
 {
@@ -600,8 +623,8 @@ segspt_create(struct seg **segpp, void *argsp)
 	 * Set policy to affect initial allocation of pages in
 	 * anon_map_createpages()
 	 */
-	(void) lgrp_shm_policy_set(LGRP_MEM_POLICY_DEFAULT, amp, anon_index,
-	    NULL, 0, ptob(npages));
+	(void) lgrp_shm_policy_set(segspt_policy(ptob(npages)), amp,
+	    anon_index, NULL, 0, ptob(npages));
 
 	if (sptcargs->flags & SHM_PAGEABLE) {
 		size_t  share_sz;
@@ -1848,7 +1871,7 @@ segspt_shmattach(struct seg **segpp, void *argsp)
 	shmd->shm_amp = shm_amp;
 	shmd->shm_sptseg = shmd_arg->shm_sptseg;
 
-	(void) lgrp_shm_policy_set(LGRP_MEM_POLICY_DEFAULT, shm_amp, 0,
+	(void) lgrp_shm_policy_set(segspt_policy(seg->s_size), shm_amp, 0,
 	    NULL, 0, seg->s_size);
 
 	mutex_init(&shmd->shm_segfree_syncmtx, NULL, MUTEX_DEFAULT, NULL);
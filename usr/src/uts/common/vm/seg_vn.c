@@ -75,6 +75,8 @@
 #include <sys/project.h>
 #include <sys/zone.h>
 #include <sys/shm_impl.h>
+#include <sys/var.h>
+#include <sys/kstat.h>
 
 /*
  * segvn_fault needs a temporary page list array.  To avoid calling kmem all
@@ -403,6 +405,58 @@ static void segvn_trupdate(void);
 static void segvn_trupdate_seg(struct seg *, segvn_data_t *, svntr_t *,
     ulong_t);
 
+/*
+ * Segvn can asynchronously promote private anonymous mappings that are still
+ * backed by base pages to large pages.  When segvn_lpgp_enable is set, the
+ * segvn_lpgp_thread wakes up every segvn_lpgp_interval seconds and walks the
+ * processes of zones that have opted in via ZONE_ATTR_LPG_PROMOTE (the global
+ * zone opts in via segvn_lpgp_global).  Each large page aligned range of a
+ * MAP_PRIVATE anonymous segment that already has at least segvn_lpgp_minfill
+ * percent of its base pages populated has its page size raised with
+ * as_setpagesize().  That unloads the range's translations; the next fault
+ * in segvn_fault_anonpages() relocates the existing base pages into a large
+ * page and maps it with a single translation.  Sparse ranges are left alone
+ * so that promotion doesn't inflate the process rss, and at most
+ * segvn_lpgp_max_per_scan large pages are promoted per pass.
+ */
+int		segvn_lpgp_enable = 0;
+int		segvn_lpgp_global = 0;
+int		segvn_lpgp_interval = 10;
+uint_t		segvn_lpgp_max_per_scan = 256;
+uint_t		segvn_lpgp_minfill = 50;
+size_t		segvn_lpgp_pgsz = 2 * 1024 * 1024;
+
+static uint_t			segvn_lpgp_szc;
+static ksema_t			segvn_lpgp_sem;
+static clock_t			segvn_lpgp_ticks;
+
+typedef struct segvn_lpgp_stats {
+	kstat_named_t	lpgp_scans;
+	kstat_named_t	lpgp_procs;
+	kstat_named_t	lpgp_promoted;
+	kstat_named_t	lpgp_fail_nomem;
+	kstat_named_t	lpgp_fail_busy;
+	kstat_named_t	lpgp_fail_other;
+} segvn_lpgp_stats_t;
+
+static segvn_lpgp_stats_t segvn_lpgp_stats = {
+	{ "scans",		KSTAT_DATA_UINT64 },
+	{ "procs_scanned",	KSTAT_DATA_UINT64 },
+	{ "promoted",		KSTAT_DATA_UINT64 },
+	{ "fail_nomem",		KSTAT_DATA_UINT64 },
+	{ "fail_busy",		KSTAT_DATA_UINT64 },
+	{ "fail_other",		KSTAT_DATA_UINT64 },
+};
+
+#define	SEGVN_LPGP_ADDSTAT(stat, n)					\
+	atomic_add_64(&segvn_lpgp_stats.lpgp_##stat.value.ui64, (n))
+
+static void segvn_lpgp_init(void);
+static void segvn_lpgp_thread(void);
+static void segvn_lpgp_wakeup(void *);
+static void segvn_lpgp_scan(void);
+static uint_t segvn_lpgp_proc(proc_t *, uint_t);
+
 /*
  * Initialize segvn data structures
  */
@@ -500,6 +554,8 @@ segvn_init(void)
 	}
 	segvn_pglock_comb_bshift = highbit(segvn_pglock_comb_balign) - 1;
 	segvn_pglock_comb_palign = btop(segvn_pglock_comb_balign);
+
+	segvn_lpgp_init();
 }
 
 #define	SEGVN_PAGEIO	((void *)0x1)
@@ -6719,6 +6775,79 @@ segvn_split_seg(struct seg *seg, caddr_t addr)
 	return (nseg);
 }
 
+/*
+ * Prepare [addr, addr + len) of a private anonymous segment to be moved to
+ * naddr by as_move().  The range is split off into a segment of its own and
+ * its translations are unloaded.  The anon_map, and the pages it names, are
+ * independent of the segment's address and so move along with it untouched;
+ * they are faulted back in at the new location on demand.  The segment that
+ * exactly covers the range is returned in *segpp.
+ *
+ * Returns ENOTSUP for any segment we can't move this way, in which case the
+ * caller must fall back to copying.
+ */
+int
+segvn_move_prepare(struct seg *seg, caddr_t addr, size_t len, caddr_t naddr,
+    struct seg **segpp)
+{
+	struct segvn_data *svd = (struct segvn_data *)seg->s_data;
+	caddr_t eaddr = addr + len;
+
+	ASSERT(seg->s_as && AS_WRITE_HELD(seg->s_as));
+	ASSERT(seg->s_ops == &segvn_ops);
+	ASSERT(addr >= seg->s_base && eaddr <= seg->s_base + seg->s_size);
+
+	if (svd->vp != NULL || svd->type != MAP_PRIVATE ||
+	    svd->tr_state != SEGVN_TR_OFF ||
+	    HAT_IS_REGION_COOKIE_VALID(svd->rcookie)) {
+		return (ENOTSUP);
+	}
+
+	if (seg->s_szc != 0) {
+		size_t pgsz = page_get_pagesize(seg->s_szc);
+
+		if (!IS_P2ALIGNED(addr, pgsz) || !IS_P2ALIGNED(len, pgsz) ||
+		    !IS_P2ALIGNED(naddr, pgsz)) {
+			return (ENOTSUP);
+		}
+	}
+
+	/*
+	 * As in segvn_unmap(), softlocked pages may just be sitting in the
+	 * pagelock cache; if purging doesn't clear them, I/O is in flight.
+	 */
+	if (svd->softlockcnt > 0) {
+		segvn_purge(seg);
+		if (svd->softlockcnt > 0)
+			return (ENOTSUP);
+	}
+
+	/*
+	 * Locked pages are accounted against the address at which they were
+	 * locked; leave them be.
+	 */
+	if (svd->vpage != NULL) {
+		struct vpage *vp = &svd->vpage[seg_page(seg, addr)];
+		struct vpage *evp = &svd->vpage[seg_page(seg, eaddr - 1)];
+
+		for (; vp <= evp; vp++) {
+			if (VPP_ISPPLOCK(vp))
+				return (ENOTSUP);
+		}
+	}
+
+	if (addr > seg->s_base)
+		seg = segvn_split_seg(seg, addr);
+	if (eaddr < seg->s_base + seg->s_size)
+		(void) segvn_split_seg(seg, eaddr);
+	ASSERT(seg->s_base == addr && seg->s_size == len);
+
+	hat_unload(seg->s_as->a_hat, addr, len, HAT_UNLOAD_UNMAP);
+
+	*segpp = seg;
+	return (0);
+}
+
 /*
  * called on memory operations (unmap, setprot, setpagesize) for a subset
  * of a large page segment to either demote the memory range (SDR_RANGE)
@@ -10341,3 +10470,252 @@ segvn_trupdate_seg(struct seg *seg, segvn_data_t *svd, svntr_t *svntrp,
 
 	SEGVN_TR_ADDSTAT(asyncrepl);
 }
+
+/*
+ * Set up asynchronous large page promotion.  The promotion page size is the
+ * largest one segvn supports that doesn't exceed segvn_lpgp_pgsz.
+ */
+static void
+segvn_lpgp_init(void)
+{
+	kstat_t *ksp;
+	uint_t szc;
+
+	if (!segvn_lpgp_enable || segvn_lpg_disable || segvn_maxpgszc == 0)
+		return;
+
+	for (szc = segvn_maxpgszc; szc > 0; szc--) {
+		if (page_get_pagesize(szc) <= segvn_lpgp_pgsz)
+			break;
+	}
+	if (szc == 0)
+		return;
+	segvn_lpgp_szc = szc;
+
+	if (segvn_lpgp_interval <= 0)
+		segvn_lpgp_interval = 10;
+	segvn_lpgp_ticks = segvn_lpgp_interval * hz;
+	if (segvn_lpgp_minfill > 100)
+		segvn_lpgp_minfill = 100;
+
+	ksp = kstat_create("unix", 0, "segvn_lpgpromote", "vm",
+	    KSTAT_TYPE_NAMED, sizeof (segvn_lpgp_stats) /
+	    sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+	if (ksp != NULL) {
+		ksp->ks_data = &segvn_lpgp_stats;
+		kstat_install(ksp);
+	}
+
+	sema_init(&segvn_lpgp_sem, 0, NULL, SEMA_DEFAULT, NULL);
+	(void) thread_create(NULL, 0, segvn_lpgp_thread,
+	    NULL, 0, &p0, TS_RUN, minclsyspri);
+}
+
+static void
+segvn_lpgp_thread(void)
+{
+	callb_cpr_t cpr_info;
+	kmutex_t cpr_lock;	/* just for CPR stuff */
+
+	mutex_init(&cpr_lock, NULL, MUTEX_DEFAULT, NULL);
+
+	CALLB_CPR_INIT(&cpr_info, &cpr_lock,
+	    callb_generic_cpr, "segvn_lpgp");
+
+	(void) timeout(segvn_lpgp_wakeup, NULL, segvn_lpgp_ticks);
+
+	for (;;) {
+		mutex_enter(&cpr_lock);
+		CALLB_CPR_SAFE_BEGIN(&cpr_info);
+		mutex_exit(&cpr_lock);
+		sema_p(&segvn_lpgp_sem);
+		mutex_enter(&cpr_lock);
+		CALLB_CPR_SAFE_END(&cpr_info, &cpr_lock);
+		mutex_exit(&cpr_lock);
+		if (segvn_lpgp_enable)
+			segvn_lpgp_scan();
+		(void) timeout(segvn_lpgp_wakeup, NULL, segvn_lpgp_ticks);
+	}
+}
+
+/*ARGSUSED*/
+static void
+segvn_lpgp_wakeup(void *dummy)
+{
+	sema_v(&segvn_lpgp_sem);
+}
+
+/*
+ * Walk the process table the same way vm_getusage() does: each candidate is
+ * sprlock'ed so that it can't exit while we drop pidlock and operate on its
+ * address space.
+ */
+static void
+segvn_lpgp_scan(void)
+{
+	proc_t *p;
+	zone_t *zone;
+	int i, ret;
+	uint_t budget = segvn_lpgp_max_per_scan;
+
+	SEGVN_LPGP_ADDSTAT(scans, 1);
+
+	mutex_enter(&pidlock);
+	for (i = 0; i < v.v_proc && budget != 0; i++) {
+again:
+		p = pid_entry(i);
+		if (p == NULL || (p->p_flag & (SSYS | SEXITING)) ||
+		    p->p_as == &kas || p->p_stat == SIDL)
+			continue;
+
+		zone = p->p_zone;
+		if (zone->zone_id == GLOBAL_ZONEID ? !segvn_lpgp_global :
+		    !zone->zone_lpg_promote)
+			continue;
+
+		mutex_enter(&p->p_lock);
+		mutex_exit(&pidlock);
+
+		ret = sprtrylock_proc(p);
+		if (ret == -1) {
+			mutex_exit(&p->p_lock);
+			mutex_enter(&pidlock);
+			continue;
+		} else if (ret == 1) {
+			/* This also drops p_lock. */
+			sprwaitlock_proc(p);
+			mutex_enter(&pidlock);
+			goto again;
+		}
+		mutex_exit(&p->p_lock);
+
+		SEGVN_LPGP_ADDSTAT(procs, 1);
+		budget -= segvn_lpgp_proc(p, budget);
+
+		mutex_enter(&p->p_lock);
+		sprunlock(p);
+		mutex_enter(&pidlock);
+	}
+	mutex_exit(&pidlock);
+}
+
+/*
+ * Return non-zero if the large page at addr in seg can be promoted.  The
+ * caller holds the as lock; we take the segment lock to look at its anon map.
+ */
+static int
+segvn_lpgp_eligible(struct seg *seg, caddr_t addr, size_t pgsz)
+{
+	struct segvn_data *svd = (struct segvn_data *)seg->s_data;
+	struct anon_map *amp;
+	pgcnt_t pgcnt = btop(pgsz);
+	pgcnt_t npages;
+	ulong_t an_idx;
+	int ret = 0;
+
+	SEGVN_LOCK_ENTER(seg->s_as, &svd->lock, RW_READER);
+	amp = svd->amp;
+	if (amp == NULL || svd->softlockcnt != 0 || !sameprot(seg, addr, pgsz))
+		goto out;
+
+	an_idx = svd->anon_index + seg_page(seg, addr);
+	ANON_LOCK_ENTER(&amp->a_rwlock, RW_READER);
+	npages = anon_pages(amp->ahp, an_idx, pgcnt);
+	ANON_LOCK_EXIT(&amp->a_rwlock);
+
+	ret = (npages * 100 >= pgcnt * segvn_lpgp_minfill);
+out:
+	SEGVN_LOCK_EXIT(seg->s_as, &svd->lock);
+	return (ret);
+}
+
+/*
+ * Find the next run of promotable large pages in as at or above *addrp,
+ * limited to budget large pages.  Returns the length of the run (0 if there
+ * is none) and updates *addrp to its start.
+ */
+static size_t
+segvn_lpgp_find(struct as *as, caddr_t *addrp, uint_t budget)
+{
+	size_t pgsz = page_get_pagesize(segvn_lpgp_szc);
+	struct segvn_data *svd;
+	struct seg *seg;
+	caddr_t a, ea, start;
+	size_t len = 0;
+
+	AS_LOCK_ENTER(as, RW_READER);
+	for (seg = as_findseg(as, *addrp, 0); seg != NULL;
+	    seg = AS_SEGNEXT(as, seg)) {
+		svd = (struct segvn_data *)seg->s_data;
+		if (seg->s_ops != &segvn_ops || seg->s_szc != 0 ||
+		    svd->type != MAP_PRIVATE || svd->vp != NULL ||
+		    (svd->flags & MAP_NORESERVE) || svd->amp == NULL)
+			continue;
+
+		a = (caddr_t)P2ROUNDUP((uintptr_t)MAX(seg->s_base, *addrp),
+		    pgsz);
+		ea = (caddr_t)P2ALIGN((uintptr_t)(seg->s_base + seg->s_size),
+		    pgsz);
+		for (start = NULL; a < ea && len < budget * pgsz; a += pgsz) {
+			if (segvn_lpgp_eligible(seg, a, pgsz)) {
+				if (start == NULL)
+					start = a;
+				len += pgsz;
+			} else if (start != NULL) {
+				break;
+			}
+		}
+		if (start != NULL) {
+			*addrp = start;
+			break;
+		}
+	}
+	AS_LOCK_EXIT(as);
+
+	return (len);
+}
+
+/*
+ * Promote up to budget large pages in p's address space and return the
+ * number promoted.
+ */
+static uint_t
+segvn_lpgp_proc(proc_t *p, uint_t budget)
+{
+	struct as *as = p->p_as;
+	zone_t *zone = p->p_zone;
+	size_t pgsz = page_get_pagesize(segvn_lpgp_szc);
+	caddr_t addr = NULL;
+	uint_t done = 0;
+	uint_t npgs;
+	size_t len;
+	int err;
+
+	while (done < budget &&
+	    (len = segvn_lpgp_find(as, &addr, budget - done)) != 0) {
+		npgs = len / pgsz;
+		err = as_setpagesize(as, addr, len, segvn_lpgp_szc, B_FALSE);
+		switch (err) {
+		case 0:
+			SEGVN_LPGP_ADDSTAT(promoted, npgs);
+			atomic_add_32(&zone->zone_lpg_promote_ok, npgs);
+			done += npgs;
+			break;
+		case EAGAIN:
+			SEGVN_LPGP_ADDSTAT(fail_busy, npgs);
+			atomic_add_32(&zone->zone_lpg_promote_fail, npgs);
+			break;
+		case ENOMEM:
+			SEGVN_LPGP_ADDSTAT(fail_nomem, npgs);
+			atomic_add_32(&zone->zone_lpg_promote_fail, npgs);
+			break;
+		default:
+			SEGVN_LPGP_ADDSTAT(fail_other, npgs);
+			atomic_add_32(&zone->zone_lpg_promote_fail, npgs);
+			break;
+		}
+		addr += len;
+	}
+
+	return (done);
+}
@@ -229,6 +229,8 @@ typedef struct svntr_stats {
 
 extern void	segvn_init(void);
 extern int	segvn_create(struct seg **, void *);
+extern int	segvn_move_prepare(struct seg *, caddr_t, size_t, caddr_t,
+		    struct seg **);
 
 extern	struct seg_ops segvn_ops;
 
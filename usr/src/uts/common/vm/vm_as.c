@@ -1432,6 +1432,64 @@ retry:
 	return (0);
 }
 
+/*
+ * Move the private anonymous memory mapped at [addr, addr + size) to naddr
+ * without copying it.  The target range must be unmapped.  Returns ENOTSUP
+ * if the source can't be moved this way (it isn't anonymous memory, is
+ * locked, is being watched, and so forth), leaving the caller to copy it.
+ */
+int
+as_move(struct as *as, caddr_t addr, size_t size, caddr_t naddr)
+{
+	struct seg *seg, *nseg;
+	int error;
+
+	if (size == 0 || (((uintptr_t)addr | (uintptr_t)naddr | size) &
+	    PAGEOFFSET) != 0) {
+		return (EINVAL);
+	}
+	if (valid_usr_range(naddr, size, 0, as, as->a_userlimit) !=
+	    RANGE_OKAY) {
+		return (ENOMEM);
+	}
+
+	AS_LOCK_ENTER(as, RW_WRITER);
+
+	/*
+	 * Unmap callbacks and watched pages are both keyed by address; don't
+	 * try to carry them along.
+	 */
+	if (as->a_callbacks != NULL || avl_numnodes(&as->a_wpage) != 0) {
+		AS_LOCK_EXIT(as);
+		return (ENOTSUP);
+	}
+
+	seg = as_segat(as, addr);
+	if (seg == NULL || seg->s_ops != &segvn_ops ||
+	    addr + size > seg->s_base + seg->s_size) {
+		AS_LOCK_EXIT(as);
+		return (ENOTSUP);
+	}
+
+	nseg = as_findseg(as, naddr, 0);
+	if (nseg != NULL && nseg->s_base < naddr + size) {
+		AS_LOCK_EXIT(as);
+		return (ENOMEM);
+	}
+
+	if ((error = segvn_move_prepare(seg, addr, size, naddr, &seg)) != 0) {
+		AS_LOCK_EXIT(as);
+		return (error);
+	}
+
+	(void) as_removeseg(as, seg);
+	seg->s_base = naddr;
+	VERIFY0(as_addseg(as, seg));
+
+	AS_LOCK_EXIT(as);
+	return (0);
+}
+
 static int
 as_map_segvn_segs(struct as *as, caddr_t addr, size_t size, uint_t szcvec,
     segcreate_func_t crfp, struct segvn_crargs *vn_a, boolean_t *segcreated)
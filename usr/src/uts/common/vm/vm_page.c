@@ -22,7 +22,7 @@
  * Copyright (c) 1986, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright (c) 2015, Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
  * Copyright (c) 2015, 2016 by Delphix. All rights reserved.
- * Copyright 2018 Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*	Copyright (c) 1983, 1984, 1985, 1986, 1987, 1988, 1989  AT&T	*/
@@ -1864,6 +1864,12 @@ page_create_get_something(vnode_t *vp, u_offset_t off, struct seg *seg,
 
 	lgrp = lgrp_mem_choose(seg, vaddr, PAGESIZE);
 
+	/*
+	 * Pages held in other CPUs' page caches are accounted for in
+	 * freemem but invisible to us; put them back on the freelists.
+	 */
+	page_pcp_drain_all();
+
 	for (count = 0; kcage_on || count < MAX_PCGS; count++) {
 		pp = page_get_freelist(vp, off, seg, vaddr, PAGESIZE,
 		    flags, lgrp);
@@ -2690,6 +2696,14 @@ page_free(page_t *pp, int dontneed)
 		 */
 		PP_SETAGED(pp);
 		pp->p_offset = (u_offset_t)-1;
+		if (page_pcp_free(pp)) {
+			/*
+			 * The page went to this CPU's page cache, which
+			 * keeps it locked.
+			 */
+			VM_STAT_ADD(pagecnt.pc_free_free);
+			goto accounting;
+		}
 		page_list_add(pp, PG_FREE_LIST | PG_LIST_TAIL);
 		VM_STAT_ADD(pagecnt.pc_free_free);
 		TRACE_1(TR_FAC_VM, TR_PAGE_FREE_FREE,
@@ -2714,6 +2728,7 @@ page_free(page_t *pp, int dontneed)
 	}
 	page_unlock(pp);
 
+accounting:
 	/*
 	 * Now do the `freemem' accounting.
 	 */
@@ -3394,6 +3409,41 @@ top:
 	opp->p_cowcnt += ocowcnt;
 }
 
+/*
+ * Count of pages which fsflush can only find modified by scanning memory: those
+ * with a file system identity, other than the pages of the kernel's vnodes, of
+ * swapfs, and of VNOPGSCAN vnodes.  The count is striped to keep page_hashin()
+ * and page_hashout() from contending on it; one stripe may go negative when a
+ * page is hashed out on a different CPU from the one it was hashed in on.
+ */
+#define	PAGE_SCANCNT_STRIPES	32
+
+typedef struct page_scancnt {
+	long	psc_cnt;
+	char	psc_pad[64 - sizeof (long)];
+} page_scancnt_t;
+
+static page_scancnt_t page_scancnt[PAGE_SCANCNT_STRIPES];
+
+#define	PAGE_SCANCNT_ADD(vp, n) {					\
+	if (!VN_ISKAS(vp) && !IS_SWAPFSVP(vp) &&			\
+	    ((vp)->v_flag & VNOPGSCAN) == 0)				\
+		atomic_add_long(&page_scancnt[CPU->cpu_seqid &		\
+		    (PAGE_SCANCNT_STRIPES - 1)].psc_cnt, (n));		\
+}
+
+pgcnt_t
+page_scan_count(void)
+{
+	long total = 0;
+	int i;
+
+	for (i = 0; i < PAGE_SCANCNT_STRIPES; i++)
+		total += page_scancnt[i].psc_cnt;
+
+	return (total > 0 ? (pgcnt_t)total : 0);
+}
+
 /*
  * low level routine to add page `pp' to the hash and vp chains for [vp, offset]
  *
@@ -3455,6 +3505,7 @@ page_do_hashin(page_t *pp, vnode_t *vp, u_offset_t offset)
 		listp = &vp->v_pages;
 
 	page_vpadd(listp, pp);
+	PAGE_SCANCNT_ADD(vp, 1);
 
 	return (1);
 }
@@ -3536,6 +3587,7 @@ page_do_hashout(page_t *pp)
 	 */
 	if (vp->v_pages)
 		page_vpsub(&vp->v_pages, pp);
+	PAGE_SCANCNT_ADD(vp, -1);
 
 	pp->p_hash = NULL;
 	page_clr_all_props(pp);
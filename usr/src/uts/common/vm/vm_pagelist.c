@@ -64,6 +64,8 @@
 #include <sys/sdt.h>
 #include <sys/dumphdr.h>
 #include <sys/swap.h>
+#include <sys/kstat.h>
+#include <sys/errno.h>
 
 extern uint_t	vac_colors;
 
@@ -3690,6 +3692,179 @@ page_get_contig_pages(int mnode, uint_t bin, int mtype, uchar_t szc,
 	return (NULL);
 }
 
+/*
+ * Background compaction.  Over time the free lists fragment to the point
+ * where page_freelist_coalesce() can no longer assemble a large page and
+ * page_get_contig_pages() has to relocate in-use pages synchronously on the
+ * allocation path, which it only does with a limited search (pgcpfailcnt[])
+ * and frequently fails.  When page_compact_enable is set, page_compact_thread
+ * wakes up every page_compact_interval seconds and, for each memory node
+ * with fewer than page_compact_target free (or trivially coalescable)
+ * regions of the compaction page size, claims regions with
+ * page_get_contig_pages() and immediately frees them back to the free lists.
+ * The claim relocates the movable pages out of the region via
+ * do_page_relocate() and never touches the kernel cage (see trimkcage()), so
+ * the result is a large free page that later allocations can take directly.
+ *
+ * The compaction page size is the largest page size that doesn't exceed
+ * page_compact_pgsz.  At most page_compact_max large pages are assembled per
+ * memory node per pass, and compaction stops while freemem is below
+ * lotsfree so that the replacement pages it consumes don't compete with the
+ * page scanner.
+ */
+int	page_compact_enable = 0;
+int	page_compact_interval = 30;
+pgcnt_t	page_compact_target = 16;
+pgcnt_t	page_compact_max = 64;
+size_t	page_compact_pgsz = 2 * 1024 * 1024;
+
+static kmutex_t	page_compact_lock;
+static kcondvar_t page_compact_cv;
+
+static struct page_compact_stats {
+	kstat_named_t	pcs_passes;
+	kstat_named_t	pcs_mnodes;
+	kstat_named_t	pcs_compacted;
+	kstat_named_t	pcs_failed;
+	kstat_named_t	pcs_lowmem;
+} page_compact_stats = {
+	{ "passes",		KSTAT_DATA_UINT64 },
+	{ "mnodes_below_target", KSTAT_DATA_UINT64 },
+	{ "compacted",		KSTAT_DATA_UINT64 },
+	{ "failed",		KSTAT_DATA_UINT64 },
+	{ "lowmem",		KSTAT_DATA_UINT64 },
+};
+
+#define	PAGE_COMPACT_STAT(stat)	(page_compact_stats.pcs_##stat.value.ui64++)
+
+/*
+ * Count the regions of size code r in mnode that are entirely free, up to
+ * max.  These are either free large pages already or will be assembled by
+ * page_freelist_coalesce() without relocating anything.
+ */
+static pgcnt_t
+page_compact_count(int mnode, int r, pgcnt_t max)
+{
+	size_t	idx, len;
+	int	full = FULL_REGION_CNT(r);
+	pgcnt_t	cnt = 0;
+
+	rw_enter(&page_ctrs_rwlock[mnode], RW_READER);
+	len = PAGE_COUNTERS_ENTRIES(mnode, r);
+	for (idx = 0; idx < len && cnt < max; idx++) {
+		if (PAGE_COUNTERS(mnode, r, idx) == full)
+			cnt++;
+	}
+	rw_exit(&page_ctrs_rwlock[mnode]);
+
+	return (cnt);
+}
+
+/*
+ * Assemble up to 'need' free large pages of size code szc in mnode.
+ */
+static void
+page_compact_mnode(int mnode, uchar_t szc, pgcnt_t need)
+{
+	pgcnt_t pgcnt = page_get_pagecnt(szc);
+	page_t	*pp;
+	uint_t	flags;
+	int	mtype;
+
+	while (need-- > 0) {
+		if (freemem < lotsfree + pgcnt ||
+		    !page_create_wait(pgcnt, 0)) {
+			PAGE_COMPACT_STAT(lowmem);
+			return;
+		}
+
+		flags = 0;
+		MTYPE_PGR_INIT(mtype, flags, NULL, pgcnt);
+		pp = page_get_contig_pages(mnode, 0, mtype, szc, flags);
+		if (pp == NULL) {
+			page_create_putback(pgcnt);
+			PAGE_COMPACT_STAT(failed);
+			return;
+		}
+
+		ASSERT(pp->p_szc == szc);
+		page_list_add_pages(pp, 0);
+		page_create_putback(pgcnt);
+		PAGE_COMPACT_STAT(compacted);
+	}
+}
+
+static void
+page_compact(uchar_t szc)
+{
+	pgcnt_t	have;
+	int	mnode;
+
+	PAGE_COMPACT_STAT(passes);
+
+	for (mnode = 0; mnode < max_mem_nodes; mnode++) {
+		if (!mem_node_config[mnode].exists)
+			continue;
+
+		/*
+		 * With interleaved mnodes the page counters are shared, so
+		 * the count (and hence the target) is system wide and the
+		 * first mnode short of it does the work.
+		 */
+		have = page_compact_count(mnode, szc, page_compact_target);
+		if (have >= page_compact_target)
+			continue;
+
+		PAGE_COMPACT_STAT(mnodes);
+		page_compact_mnode(mnode, szc,
+		    MIN(page_compact_target - have, page_compact_max));
+	}
+}
+
+void
+page_compact_thread(void)
+{
+	callb_cpr_t cpr_info;
+	kstat_t	*ksp;
+	uchar_t	szc;
+
+	for (szc = mmu_page_sizes - 1; szc > 0; szc--) {
+		if (page_get_pagesize(szc) <= page_compact_pgsz)
+			break;
+	}
+	if (szc == 0 || pg_contig_disable || mpss_coalesce_disable) {
+		thread_exit();
+		/*NOTREACHED*/
+	}
+
+	ksp = kstat_create("unix", 0, "page_compact", "vm", KSTAT_TYPE_NAMED,
+	    sizeof (page_compact_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (ksp != NULL) {
+		ksp->ks_data = &page_compact_stats;
+		kstat_install(ksp);
+	}
+
+	mutex_init(&page_compact_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&page_compact_cv, NULL, CV_DEFAULT, NULL);
+
+	CALLB_CPR_INIT(&cpr_info, &page_compact_lock,
+	    callb_generic_cpr, "page_compact");
+
+	mutex_enter(&page_compact_lock);
+	for (;;) {
+		CALLB_CPR_SAFE_BEGIN(&cpr_info);
+		(void) cv_reltimedwait(&page_compact_cv, &page_compact_lock,
+		    MAX(page_compact_interval, 1) * hz, TR_CLOCK_TICK);
+		CALLB_CPR_SAFE_END(&cpr_info, &page_compact_lock);
+		if (page_compact_enable && page_compact_target != 0) {
+			mutex_exit(&page_compact_lock);
+			page_compact(szc);
+			mutex_enter(&page_compact_lock);
+		}
+	}
+}
+
 #if defined(__i386) || defined(__amd64)
 /*
  * Determine the likelihood of finding/coalescing a szc page.
@@ -3717,6 +3892,323 @@ page_chk_freelist(uint_t szc)
 }
 #endif
 
+/*
+ * Per-CPU page caches.
+ *
+ * When many CPUs fault in anonymous memory at once, for example while a big
+ * JVM heap is first touched or many guests boot, they all queue on the
+ * freelist bin mutexes, because every base page allocated or freed takes
+ * one.  To take that traffic off the bins, each CPU keeps a small cache of
+ * free base pages per memory node in front of the freelists:
+ *
+ *  - page_free() puts a page with no identity in the current CPU's cache.
+ *  - page_get_freelist() takes pages from that cache first.
+ *  - An empty cache is refilled with up to page_pcp_batch pages from the
+ *    requested bin, taking the bin mutex only once.
+ *  - A cache that grows past page_pcp_high gives its page_pcp_batch
+ *    coldest pages back to the freelists.
+ *
+ * Only the cache's own pcp_lock is taken on these paths.  Normally only
+ * threads on the owning CPU use it, so it is not contended.
+ *
+ * A cached page is in the same state as one just returned by
+ * page_get_mnode_freelist(): exclusively locked, still free and aged, on
+ * no list and not in the page counters.  Anything that looks it up by pfn
+ * cannot lock it and treats it as in use.  Cached pages still count in
+ * freemem.  page_pcp_drain_all() returns every cached page to the
+ * freelists.  It runs when page_create_get_something() is struggling to
+ * find pages and when memory is being deleted.
+ *
+ * Setting page_pcp_high to 0 in /etc/system disables the caches.
+ */
+typedef struct page_pcp {
+	kmutex_t	pcp_lock;
+	page_t		*pcp_list;	/* cached pages, hottest first */
+	uint_t		pcp_count;	/* pages on pcp_list */
+	uint64_t	pcp_hits;	/* allocations satisfied */
+	uint64_t	pcp_misses;	/* allocations not satisfied */
+	uint64_t	pcp_refills;	/* pages moved in from the freelists */
+	uint64_t	pcp_drains;	/* pages moved back to the freelists */
+} page_pcp_t;
+
+typedef union page_pcp_pad {
+	page_pcp_t	pcpp_pcp;
+	char		pcpp_pad[64];
+} page_pcp_pad_t;
+
+uint_t	page_pcp_high = 64;
+uint_t	page_pcp_batch = 16;
+
+static page_pcp_pad_t *page_pcp;
+
+#define	PAGE_PCP(seqid, mnode)	\
+	(&page_pcp[(seqid) * max_mem_nodes + (mnode)].pcpp_pcp)
+
+static struct page_pcp_stats {
+	kstat_named_t	pps_hits;
+	kstat_named_t	pps_misses;
+	kstat_named_t	pps_refills;
+	kstat_named_t	pps_drains;
+	kstat_named_t	pps_cached;
+} page_pcp_stats = {
+	{ "hits",		KSTAT_DATA_UINT64 },
+	{ "misses",		KSTAT_DATA_UINT64 },
+	{ "refills",		KSTAT_DATA_UINT64 },
+	{ "drains",		KSTAT_DATA_UINT64 },
+	{ "cached",		KSTAT_DATA_UINT64 },
+};
+
+static int
+page_pcp_kstat_update(kstat_t *ksp, int rw)
+{
+	struct page_pcp_stats *pps = ksp->ks_data;
+	page_pcp_t *pcp;
+	uint64_t hits = 0, misses = 0, refills = 0, drains = 0, cached = 0;
+	int i, n;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	n = max_ncpus * max_mem_nodes;
+	for (i = 0; i < n; i++) {
+		pcp = &page_pcp[i].pcpp_pcp;
+		hits += pcp->pcp_hits;
+		misses += pcp->pcp_misses;
+		refills += pcp->pcp_refills;
+		drains += pcp->pcp_drains;
+		cached += pcp->pcp_count;
+	}
+
+	pps->pps_hits.value.ui64 = hits;
+	pps->pps_misses.value.ui64 = misses;
+	pps->pps_refills.value.ui64 = refills;
+	pps->pps_drains.value.ui64 = drains;
+	pps->pps_cached.value.ui64 = cached;
+
+	return (0);
+}
+
+/*
+ * Called once the number of CPUs is known.
+ */
+void
+page_pcp_init(void)
+{
+	page_pcp_pad_t *pcpp;
+	kstat_t *ksp;
+	int i, n;
+
+	if (page_pcp_high == 0)
+		return;
+	page_pcp_batch = MAX(1, MIN(page_pcp_batch, page_pcp_high));
+
+	n = max_ncpus * max_mem_nodes;
+	pcpp = kmem_zalloc(n * sizeof (page_pcp_pad_t), KM_SLEEP);
+	for (i = 0; i < n; i++) {
+		mutex_init(&pcpp[i].pcpp_pcp.pcp_lock, NULL, MUTEX_DEFAULT,
+		    NULL);
+	}
+
+	ksp = kstat_create("unix", 0, "page_pcp", "vm", KSTAT_TYPE_NAMED,
+	    sizeof (page_pcp_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (ksp != NULL) {
+		ksp->ks_data = &page_pcp_stats;
+		ksp->ks_update = page_pcp_kstat_update;
+		kstat_install(ksp);
+	}
+
+	membar_producer();
+	page_pcp = pcpp;
+}
+
+/*
+ * Give a list of cached pages back to the freelists.  Called without any
+ * pcp_lock held, since page_unlock() may free pages.
+ */
+static void
+page_pcp_return(page_t *list)
+{
+	page_t *pp;
+
+	while ((pp = list) != NULL) {
+		page_sub(&list, pp);
+		ASSERT(PP_ISFREE(pp) && PP_ISAGED(pp));
+		page_list_add(pp, PG_FREE_LIST | PG_LIST_TAIL);
+		page_unlock(pp);
+	}
+}
+
+/*
+ * Detach up to cnt of the coldest pages from the cache.
+ */
+static page_t *
+page_pcp_detach(page_pcp_t *pcp, uint_t cnt)
+{
+	page_t *list = NULL, *pp;
+
+	ASSERT(MUTEX_HELD(&pcp->pcp_lock));
+
+	while (cnt-- != 0 && (pp = pcp->pcp_list) != NULL) {
+		pp = pp->p_prev;
+		page_sub(&pcp->pcp_list, pp);
+		page_add(&list, pp);
+		pcp->pcp_count--;
+		pcp->pcp_drains++;
+	}
+
+	return (list);
+}
+
+void
+page_pcp_drain_all(void)
+{
+	page_pcp_t *pcp;
+	page_t *list;
+	int i, n;
+
+	if (page_pcp == NULL)
+		return;
+
+	n = max_ncpus * max_mem_nodes;
+	for (i = 0; i < n; i++) {
+		pcp = &page_pcp[i].pcpp_pcp;
+		if (pcp->pcp_count == 0)
+			continue;
+		mutex_enter(&pcp->pcp_lock);
+		list = page_pcp_detach(pcp, UINT_MAX);
+		mutex_exit(&pcp->pcp_lock);
+		page_pcp_return(list);
+	}
+}
+
+/*
+ * Put a free page with no identity in the current CPU's cache.  Returns 0
+ * if the page should go to the freelists instead.  On success the page
+ * stays locked; it belongs to the cache.
+ */
+int
+page_pcp_free(page_t *pp)
+{
+	page_pcp_t *pcp;
+	page_t *list = NULL;
+
+	ASSERT(PAGE_EXCL(pp));
+	ASSERT(PP_ISFREE(pp) && PP_ISAGED(pp));
+	ASSERT(pp->p_vnode == NULL && pp->p_szc == 0);
+
+	if (page_pcp == NULL || page_pcp_high == 0 || PP_ISNORELOC(pp) ||
+	    pp->p_toxic != 0 || IS_DUMP_PAGE(pp))
+		return (0);
+
+	pcp = PAGE_PCP(CPU->cpu_seqid, PP_2_MEM_NODE(pp));
+	mutex_enter(&pcp->pcp_lock);
+	page_add(&pcp->pcp_list, pp);
+	if (++pcp->pcp_count > page_pcp_high)
+		list = page_pcp_detach(pcp, page_pcp_batch);
+	mutex_exit(&pcp->pcp_lock);
+
+	page_pcp_return(list);
+
+	return (1);
+}
+
+/*
+ * Return non-zero if pages of mtype pmtype satisfy a request for mtype on
+ * mnode with the given flags.
+ */
+static int
+page_pcp_mtype_ok(int mnode, int mtype, uint_t flags, int pmtype)
+{
+	MTYPE_START(mnode, mtype, flags);
+	while (mtype >= 0) {
+		if (mtype == pmtype)
+			return (1);
+		MTYPE_NEXT(mnode, mtype, flags);
+	}
+	return (0);
+}
+
+/*
+ * Move up to page_pcp_batch pages from the freelist bin into the cache,
+ * holding the bin mutex once for the whole batch.
+ */
+static void
+page_pcp_refill(page_pcp_t *pcp, int mnode, uint_t bin, int mtype,
+    uint_t flags)
+{
+	kmutex_t *pcm;
+	page_t **ppp, *pp;
+	uint_t cnt = 0;
+
+	ASSERT(MUTEX_HELD(&pcp->pcp_lock));
+
+	MTYPE_START(mnode, mtype, flags);
+	if (mtype < 0)
+		return;
+
+	ppp = &PAGE_FREELISTS(mnode, 0, bin, mtype);
+	if (*ppp == NULL)
+		return;
+
+	pcm = PC_BIN_MUTEX(mnode, bin, PG_FREE_LIST);
+	mutex_enter(pcm);
+	while (cnt < page_pcp_batch && (pp = *ppp) != NULL) {
+		/*
+		 * Stop at the first page we can't have; the full
+		 * allocator will walk past it.
+		 */
+		if (IS_DUMP_PAGE(pp) || PP_ISNORELOC(pp) ||
+		    !page_trylock_cons(pp, SE_EXCL))
+			break;
+		ASSERT(PP_ISFREE(pp) && PP_ISAGED(pp));
+		ASSERT(pp->p_szc == 0);
+		page_sub(ppp, pp);
+		page_ctr_sub(mnode, mtype, pp, PG_FREE_LIST);
+		page_add(&pcp->pcp_list, pp);
+		cnt++;
+	}
+	mutex_exit(pcm);
+
+	pcp->pcp_count += cnt;
+	pcp->pcp_refills += cnt;
+}
+
+/*
+ * Take a base page for lgrp from the current CPU's cache, refilling it from
+ * bin if it is empty.
+ */
+static page_t *
+page_pcp_get(struct lgrp *lgrp, uint_t bin, int mtype, uint_t flags)
+{
+	lgrp_mnode_cookie_t lgrp_cookie;
+	page_pcp_t *pcp;
+	page_t *pp;
+	int mnode;
+
+	LGRP_MNODE_COOKIE_INIT(lgrp_cookie, lgrp, LGRP_SRCH_LOCAL);
+	if ((mnode = lgrp_memnode_choose(&lgrp_cookie)) < 0)
+		return (NULL);
+
+	pcp = PAGE_PCP(CPU->cpu_seqid, mnode);
+	mutex_enter(&pcp->pcp_lock);
+	if (pcp->pcp_list == NULL && page_pcp_high != 0)
+		page_pcp_refill(pcp, mnode, bin, mtype, flags);
+	pp = pcp->pcp_list;
+	if (pp != NULL &&
+	    page_pcp_mtype_ok(mnode, mtype, flags, PP_2_MTYPE(pp))) {
+		page_sub(&pcp->pcp_list, pp);
+		pcp->pcp_count--;
+		pcp->pcp_hits++;
+	} else {
+		pp = NULL;
+		pcp->pcp_misses++;
+	}
+	mutex_exit(&pcp->pcp_lock);
+
+	return (pp);
+}
+
 /*
  * Find the `best' page on the freelist for this (vp,off) (as,vaddr) pair.
  *
@@ -3786,6 +4278,19 @@ page_get_freelist(struct vnode *vp, u_offset_t off, struct seg *seg,
 
 	ASSERT(bin < PAGE_GET_PAGECOLORS(szc));
 
+	/*
+	 * Base pages come from this CPU's page cache when they can. It
+	 * ignores color, so a request that insists on it, or on the cage,
+	 * goes straight to the freelists.
+	 */
+	if (szc == 0 && page_pcp != NULL &&
+	    (flags & (PG_MATCH_COLOR | PG_NORELOC)) == 0 &&
+	    (pp = page_pcp_get(lgrp, bin, mtype, flags)) != NULL) {
+		VM_STAT_ADD(vmm_vmstats.pgf_allocok[szc]);
+		DTRACE_PROBE2(page__get__pcp, lgrp_t *, lgrp, page_t *, pp);
+		return (pp);
+	}
+
 	/*
 	 * Try to get a local page first, but try remote if we can't
 	 * get a page of the right color.
@@ -25,7 +25,7 @@
  */
 
 /*
- * Copyright 2018, Joyent, Inc.
+ * Copyright 2020 Joyent, Inc.
  */
 
 /*
@@ -1989,6 +1989,82 @@ vmu_copyout_results(vmu_cache_t *cache, vmusage_t *buf, size_t *nres,
 	return (ret);
 }
 
+/*
+ * With VMUSAGE_FAST, zone and system results do not come from a walk of every
+ * process.  Instead they are taken from the per-zone page counts, which
+ * zone_add_page() and zone_rm_page() maintain as pages are mapped and
+ * unmapped, and from each zone's swap reservation.  This takes time in
+ * proportion to the number of zones.  Only vmu_rss_all and vmu_swap_all are
+ * filled in.  A page mapped into more than one zone is charged to none of
+ * them, so it is counted in neither the zone nor the system results.
+ */
+typedef struct vmu_fast_arg {
+	vmu_cache_t	*vfa_cache;
+	size_t		vfa_next;
+} vmu_fast_arg_t;
+
+/* ARGSUSED */
+static int
+vmu_fast_count_cb(zone_t *zone, void *arg)
+{
+	(*(size_t *)arg)++;
+	return (0);
+}
+
+static int
+vmu_fast_fill_cb(zone_t *zone, void *arg)
+{
+	vmu_fast_arg_t *vfa = arg;
+	vmusage_t *system = &vfa->vfa_cache->vmc_results[0];
+	vmusage_t *result;
+
+	/* Ignore any zones created since they were counted. */
+	if (vfa->vfa_next == vfa->vfa_cache->vmc_nresults)
+		return (1);
+
+	result = &vfa->vfa_cache->vmc_results[vfa->vfa_next++];
+	result->vmu_zoneid = zone->zone_id;
+	result->vmu_type = VMUSAGE_ZONE;
+	result->vmu_id = zone->zone_id;
+	result->vmu_rss_all = ptob(zone_pdata[zone->zone_id].zpers_pg_cnt);
+	result->vmu_swap_all = zone->zone_max_swap;
+
+	system->vmu_rss_all += result->vmu_rss_all;
+	system->vmu_swap_all += result->vmu_swap_all;
+	return (0);
+}
+
+static int
+vmu_getusage_fast(uint_t flags, vmusage_t *buf, size_t *nres,
+    id_t req_zone_id, int cpflg)
+{
+	vmu_fast_arg_t vfa;
+	vmu_cache_t *cache;
+	size_t nzones = 0;
+	int ret;
+
+	(void) zone_walk(vmu_fast_count_cb, &nzones);
+
+	/*
+	 * The first result is the system total.  Any slots left unused
+	 * because zones went away have no type, and are never copied out.
+	 */
+	cache = vmu_cache_alloc(nzones + 1, flags);
+	cache->vmc_results[0].vmu_zoneid = ALL_ZONES;
+	cache->vmc_results[0].vmu_type = VMUSAGE_SYSTEM;
+	vfa.vfa_cache = cache;
+	vfa.vfa_next = 1;
+	(void) zone_walk(vmu_fast_fill_cb, &vfa);
+	cache->vmc_timestamp = gethrtime();
+
+	ret = vmu_copyout_results(cache, buf, nres, flags, req_zone_id, cpflg);
+
+	mutex_enter(&vmu_data.vmu_lock);
+	vmu_cache_rele(cache);
+	mutex_exit(&vmu_data.vmu_lock);
+	return (ret);
+}
+
 /*
  * vm_getusage()
  *
@@ -1998,7 +2074,10 @@ vmu_copyout_results(vmu_cache_t *cache, vmusage_t *buf, size_t *nres,
  * caller is not the global zone.
  *
  * args:
- *	flags:	bitmap consisting of one or more of VMUSAGE_*.
+ *	flags:	bitmap consisting of one or more of VMUSAGE_*.  If the only
+ *		results requested are system and zone results, VMUSAGE_FAST
+ *		asks for them to be answered from counters which are kept up
+ *		to date as pages are mapped (see vmu_getusage_fast()).
  *	age:	maximum allowable age (time since counting was done) in
  *		seconds of the results.  Results from previous callers are
  *		cached in kernel.
@@ -2060,7 +2139,7 @@ vm_getusage(uint_t flags, time_t age, vmusage_t *buf, size_t *nres, int cpflg)
 		return (set_errno(EINVAL));
 
 	/* Check for no flags */
-	if ((flags & VMUSAGE_MASK) == 0)
+	if ((flags & VMUSAGE_MASK & ~VMUSAGE_FAST) == 0)
 		return (set_errno(EINVAL));
 
 	/* If requesting results for a specific zone, get the zone ID */
@@ -2078,6 +2157,16 @@ vm_getusage(uint_t flags, time_t age, vmusage_t *buf, size_t *nres, int cpflg)
 		req_zone_id = zreq.vmu_id;
 	}
 
+	if (flags & VMUSAGE_FAST) {
+		if ((flags & ~(VMUSAGE_FAST | VMUSAGE_SYSTEM |
+		    VMUSAGE_ZONE_FLAGS)) == 0) {
+			return (vmu_getusage_fast(flags_orig, buf, nres,
+			    req_zone_id, cpflg));
+		}
+		flags &= ~VMUSAGE_FAST;
+		flags_orig &= ~VMUSAGE_FAST;
+	}
+
 	mutex_enter(&vmu_data.vmu_lock);
 	now = gethrtime();
 
@@ -85,7 +85,8 @@ typedef struct viona_vring {
 	kcondvar_t	vr_cv;
 	uint16_t	vr_state;
 	uint16_t	vr_state_flags;
-	uint_t		vr_xfer_outstanding;
+	uint_t		vr_xfer_outstanding;	/* atomic */
+	uint_t		vr_tx_ncompl;		/* atomic */
 	kthread_t	*vr_worker_thread;
 	vmm_lease_t	*vr_lease;
 
@@ -145,6 +146,9 @@ typedef struct viona_vring {
 
 		uint64_t	rs_rx_hookdrop;
 		uint64_t	rs_tx_hookdrop;
+
+		uint64_t	rs_rx_coalesced;
+		uint64_t	rs_rx_coalesced_segs;
 	} vr_stats;
 } viona_vring_t;
 
@@ -152,7 +156,8 @@ struct viona_link {
 	vmm_hold_t		*l_vm_hold;
 	boolean_t		l_destroyed;
 
-	viona_vring_t		l_vrings[VIONA_VQ_MAX];
+	viona_vring_t		l_vrings[VIONA_MAX_QUEUES];
+	uint_t			l_nqpairs;
 
 	uint32_t		l_features;
 	uint32_t		l_features_hw;
@@ -283,18 +288,27 @@ struct virtio_net_hdr {
 
 #define	VIRTIO_NET_HDR_GSO_NONE		0
 #define	VIRTIO_NET_HDR_GSO_TCPV4	1
+#define	VIRTIO_NET_HDR_GSO_TCPV6	4
 
 #define	VIRTIO_NET_F_CSUM		(1 << 0)
 #define	VIRTIO_NET_F_GUEST_CSUM		(1 << 1)
 #define	VIRTIO_NET_F_MAC		(1 << 5) /* host supplies MAC */
 #define	VIRTIO_NET_F_GUEST_TSO4		(1 << 7) /* guest can accept TSO */
+#define	VIRTIO_NET_F_GUEST_TSO6		(1 << 8) /* guest can accept TSOv6 */
 #define	VIRTIO_NET_F_HOST_TSO4		(1 << 11) /* host can accept TSO */
 #define	VIRTIO_NET_F_MRG_RXBUF		(1 << 15) /* host can merge RX bufs */
 #define	VIRTIO_NET_F_STATUS		(1 << 16) /* cfg status field present */
+#define	VIRTIO_NET_F_CTRL_VQ		(1 << 17) /* control channel present */
+#define	VIRTIO_NET_F_MQ			(1 << 22) /* multiple queue pairs */
 #define	VIRTIO_F_RING_NOTIFY_ON_EMPTY	(1 << 24)
 #define	VIRTIO_F_RING_INDIRECT_DESC	(1 << 28)
 #define	VIRTIO_F_RING_EVENT_IDX		(1 << 29)
 
+/* Ring index within its link, and whether that index is a TX ring */
+#define	VIONA_RING_IDX(ring)	\
+	((uint_t)((ring) - &(ring)->vr_link->l_vrings[0]))
+#define	VIONA_RING_IS_TX(idx)	(((idx) % VIONA_VQ_MAX) == VIONA_VQ_TX)
+
 
 void viona_ring_alloc(viona_link_t *, viona_vring_t *);
 void viona_ring_free(viona_vring_t *);
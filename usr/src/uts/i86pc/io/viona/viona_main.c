@@ -48,7 +48,8 @@
  * General Architecture
  * --------------------
  *
- * A single viona instance is comprised of a "link" handle and two "rings".
+ * A single viona instance is comprised of a "link" handle and one or more
+ * pairs of "rings".
  * After opening the viona device, it must be associated with a MAC network
  * interface and a bhyve (vmm) instance to form its link resource.  This is
  * done with the VNA_IOC_CREATE ioctl, where the datalink ID and vmm fd are
@@ -75,6 +76,15 @@
  * to processing all requests to transmit data.  Data destined for the guest is
  * delivered directly by MAC to viona_rx() when the ring is active.
  *
+ * When VIRTIO_NET_F_MQ is negotiated, the link carries up to VIONA_MAX_QPAIRS
+ * RX/TX pairs, laid out in virtio queue order (RX of pair N at index 2N, TX at
+ * 2N + 1).  Each ring has its own worker thread, so transmit work from guest
+ * vCPUs using distinct TX queues proceeds in parallel.  Received packets are
+ * spread across the active RX rings (as set by VNA_IOC_SET_QPAIRS) using the
+ * same L4 flow hash MAC uses for soft ring fanout, keeping each flow on a
+ * single RX ring.  The virtio control queue, through which the guest selects
+ * the number of active pairs, is emulated by bhyve in userspace.
+ *
  *
  * -----------
  * Ring States
@@ -166,7 +176,9 @@
  * wrapped in an mblk_t using a preallocated viona_desb_t for the desballoc().
  * Doing so increments vr_xfer_outstanding, preventing the ring from being
  * reset (allowing the link to drop its vmm handle to the guest) until all
- * transmit mblks referencing guest memory have been processed.  Allocation of
+ * transmit mblks referencing guest memory have been processed.  Completions
+ * return descriptors to the guest as each mblk is freed, but interrupt it only
+ * once per batch of them (see viona_tx_intr_batch).  Allocation of
  * the viona_desb_t entries is done during the VRS_INIT stage of the ring
  * worker thread.  The ring size informs that allocation as the number of
  * concurrent transmissions is limited by the number of descriptors in the
@@ -253,8 +265,10 @@
 	VIRTIO_NET_F_GUEST_CSUM |	\
 	VIRTIO_NET_F_MAC |		\
 	VIRTIO_NET_F_GUEST_TSO4 |	\
+	VIRTIO_NET_F_GUEST_TSO6 |	\
 	VIRTIO_NET_F_MRG_RXBUF |	\
 	VIRTIO_NET_F_STATUS |		\
+	VIRTIO_NET_F_MQ |		\
 	VIRTIO_F_RING_NOTIFY_ON_EMPTY |	\
 	VIRTIO_F_RING_INDIRECT_DESC)
 
@@ -290,6 +304,8 @@ static int viona_ioc_ring_kick(viona_link_t *, uint_t);
 static int viona_ioc_ring_set_msi(viona_link_t *, void *, int);
 static int viona_ioc_ring_intr_clear(viona_link_t *, uint_t);
 static int viona_ioc_intr_poll(viona_link_t *, void *, int, int *);
+static int viona_ioc_intr_poll_mq(viona_link_t *, void *, int, int *);
+static int viona_ioc_set_qpairs(viona_link_t *, uint_t);
 
 static struct cb_ops viona_cb_ops = {
 	viona_open,
@@ -558,7 +574,8 @@ viona_ioctl(dev_t dev, int cmd, intptr_t data, int md, cred_t *cr, int *rv)
 			val &= ~VIRTIO_NET_F_HOST_TSO4;
 
 		if ((val & VIRTIO_NET_F_GUEST_CSUM) == 0)
-			val &= ~VIRTIO_NET_F_GUEST_TSO4;
+			val &= ~(VIRTIO_NET_F_GUEST_TSO4 |
+			    VIRTIO_NET_F_GUEST_TSO6);
 
 		link->l_features = val;
 		break;
@@ -583,6 +600,12 @@ viona_ioctl(dev_t dev, int cmd, intptr_t data, int md, cred_t *cr, int *rv)
 	case VNA_IOC_SET_NOTIFY_IOP:
 		err = viona_ioc_set_notify_ioport(link, (uint_t)data);
 		break;
+	case VNA_IOC_SET_QPAIRS:
+		err = viona_ioc_set_qpairs(link, (uint_t)data);
+		break;
+	case VNA_IOC_INTR_POLL_MQ:
+		err = viona_ioc_intr_poll_mq(link, dptr, md, rv);
+		break;
 	default:
 		err = ENOTTY;
 		break;
@@ -612,7 +635,7 @@ viona_chpoll(dev_t dev, short events, int anyyet, short *reventsp,
 
 	*reventsp = 0;
 	if ((events & POLLRDBAND) != 0) {
-		for (uint_t i = 0; i < VIONA_VQ_MAX; i++) {
+		for (uint_t i = 0; i < VIONA_MAX_QUEUES; i++) {
 			if (link->l_vrings[i].vr_intr_enabled != 0) {
 				*reventsp |= POLLRDBAND;
 				break;
@@ -724,12 +747,15 @@ viona_ioc_create(viona_soft_state_t *ss, void *dptr, int md, cred_t *cr)
 		goto bail;
 	}
 
-	viona_ring_alloc(link, &link->l_vrings[VIONA_VQ_RX]);
-	viona_ring_alloc(link, &link->l_vrings[VIONA_VQ_TX]);
+	for (uint_t i = 0; i < VIONA_MAX_QUEUES; i++) {
+		viona_ring_alloc(link, &link->l_vrings[i]);
+	}
+	link->l_nqpairs = 1;
 
 	if ((err = viona_rx_set(link)) != 0) {
-		viona_ring_free(&link->l_vrings[VIONA_VQ_RX]);
-		viona_ring_free(&link->l_vrings[VIONA_VQ_TX]);
+		for (uint_t i = 0; i < VIONA_MAX_QUEUES; i++) {
+			viona_ring_free(&link->l_vrings[i]);
+		}
 		goto bail;
 	}
 
@@ -803,8 +829,9 @@ viona_ioc_delete(viona_soft_state_t *ss, boolean_t on_close)
 	 * Return the rings to their reset state, ignoring any possible
 	 * interruptions from signals.
 	 */
-	VERIFY0(viona_ring_reset(&link->l_vrings[VIONA_VQ_RX], B_FALSE));
-	VERIFY0(viona_ring_reset(&link->l_vrings[VIONA_VQ_TX], B_FALSE));
+	for (uint_t i = 0; i < VIONA_MAX_QUEUES; i++) {
+		VERIFY0(viona_ring_reset(&link->l_vrings[i], B_FALSE));
+	}
 
 	mutex_enter(&ss->ss_lock);
 	if (link->l_mch != NULL) {
@@ -823,8 +850,9 @@ viona_ioc_delete(viona_soft_state_t *ss, boolean_t on_close)
 	nip = link->l_neti;
 	link->l_neti = NULL;
 
-	viona_ring_free(&link->l_vrings[VIONA_VQ_RX]);
-	viona_ring_free(&link->l_vrings[VIONA_VQ_TX]);
+	for (uint_t i = 0; i < VIONA_MAX_QUEUES; i++) {
+		viona_ring_free(&link->l_vrings[i]);
+	}
 	pollhead_clean(&link->l_pollhead);
 	ss->ss_link = NULL;
 	mutex_exit(&ss->ss_lock);
@@ -859,7 +887,7 @@ viona_ioc_ring_reset(viona_link_t *link, uint_t idx)
 {
 	viona_vring_t *ring;
 
-	if (idx >= VIONA_VQ_MAX) {
+	if (idx >= VIONA_MAX_QUEUES) {
 		return (EINVAL);
 	}
 	ring = &link->l_vrings[idx];
@@ -873,7 +901,7 @@ viona_ioc_ring_kick(viona_link_t *link, uint_t idx)
 	viona_vring_t *ring;
 	int err;
 
-	if (idx >= VIONA_VQ_MAX) {
+	if (idx >= VIONA_MAX_QUEUES) {
 		return (EINVAL);
 	}
 	ring = &link->l_vrings[idx];
@@ -912,7 +940,7 @@ viona_ioc_ring_set_msi(viona_link_t *link, void *data, int md)
 	if (ddi_copyin(data, &vrm, sizeof (vrm), md) != 0) {
 		return (EFAULT);
 	}
-	if (vrm.rm_index >= VIONA_VQ_MAX) {
+	if (vrm.rm_index >= VIONA_MAX_QUEUES) {
 		return (EINVAL);
 	}
 
@@ -960,7 +988,7 @@ viona_ioc_set_notify_ioport(viona_link_t *link, uint_t ioport)
 static int
 viona_ioc_ring_intr_clear(viona_link_t *link, uint_t idx)
 {
-	if (idx >= VIONA_VQ_MAX) {
+	if (idx >= VIONA_MAX_QUEUES) {
 		return (EINVAL);
 	}
 
@@ -989,3 +1017,43 @@ viona_ioc_intr_poll(viona_link_t *link, void *udata, int md, int *rv)
 	*rv = (int)cnt;
 	return (0);
 }
+
+static int
+viona_ioc_intr_poll_mq(viona_link_t *link, void *udata, int md, int *rv)
+{
+	uint_t cnt = 0;
+	vioc_intr_poll_mq_t vipm;
+
+	bzero(&vipm, sizeof (vipm));
+	vipm.vipm_nrings = VIONA_MAX_QUEUES;
+	for (uint_t i = 0; i < VIONA_MAX_QUEUES; i++) {
+		uint_t val = link->l_vrings[i].vr_intr_enabled;
+
+		vipm.vipm_status[i] = val;
+		if (val != 0) {
+			cnt++;
+		}
+	}
+
+	if (ddi_copyout(&vipm, udata, sizeof (vipm), md) != 0) {
+		return (EFAULT);
+	}
+	*rv = (int)cnt;
+	return (0);
+}
+
+/*
+ * Set the number of queue pairs across which received traffic is spread.  The
+ * guest selects this (up to the advertised maximum) through the control queue
+ * after VIRTIO_NET_F_MQ has been negotiated.
+ */
+static int
+viona_ioc_set_qpairs(viona_link_t *link, uint_t nqpairs)
+{
+	if (nqpairs == 0 || nqpairs > VIONA_MAX_QPAIRS) {
+		return (EINVAL);
+	}
+
+	link->l_nqpairs = nqpairs;
+	return (0);
+}
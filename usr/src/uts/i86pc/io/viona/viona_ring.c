@@ -156,7 +156,7 @@ viona_ring_init(viona_link_t *link, uint16_t idx, uint16_t qsz, uint64_t pa)
 	kthread_t *t;
 	int err = 0;
 
-	if (idx >= VIONA_VQ_MAX) {
+	if (idx >= VIONA_MAX_QUEUES) {
 		return (EINVAL);
 	}
 	if (qsz == 0 || qsz > VRING_MAX_LEN || (1 << (ffs(qsz) - 1)) != qsz) {
@@ -188,7 +188,7 @@ viona_ring_init(viona_link_t *link, uint16_t idx, uint16_t qsz, uint64_t pa)
 	/* Initialize queue indexes */
 	ring->vr_cur_aidx = 0;
 
-	if (idx == VIONA_VQ_TX) {
+	if (VIONA_RING_IS_TX(idx)) {
 		viona_tx_ring_alloc(ring, qsz);
 	}
 
@@ -381,12 +381,12 @@ viona_worker(void *arg)
 	}
 
 	/* Process actual work */
-	if (ring == &link->l_vrings[VIONA_VQ_RX]) {
-		viona_worker_rx(ring, link);
-	} else if (ring == &link->l_vrings[VIONA_VQ_TX]) {
+	if (VIONA_RING_IDX(ring) >= VIONA_MAX_QUEUES) {
+		panic("unexpected ring: %p", (void *)ring);
+	} else if (VIONA_RING_IS_TX(VIONA_RING_IDX(ring))) {
 		viona_worker_tx(ring, link);
 	} else {
-		panic("unexpected ring: %p", (void *)ring);
+		viona_worker_rx(ring, link);
 	}
 
 	VERIFY3U(ring->vr_state, ==, VRS_STOP);
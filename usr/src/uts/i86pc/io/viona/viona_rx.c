@@ -54,6 +54,17 @@
 #define	MIN_BUF_SIZE		60
 #define	NEED_VLAN_PAD_SIZE	(MIN_BUF_SIZE - VLAN_TAGSZ)
 
+/*
+ * Receive coalescing of TCP segments for guests which accept TSO frames; see
+ * viona_rx_coalesce().  The frame size limit keeps a coalesced frame within
+ * the VTNET_MAXSEGS buffers a guest posting MTU-sized mergeable buffers can
+ * offer for it.
+ */
+boolean_t viona_rx_coalesce_enable = B_TRUE;
+uint32_t viona_rx_coalesce_max = 32768;
+
+#define	VIONA_RX_COALESCE_FLOWS	8
+
 static mblk_t *viona_vlan_pad_mp;
 
 void
@@ -195,6 +206,35 @@ viona_copy_mblk(const mblk_t *mp, size_t seek, caddr_t buf, size_t len,
 	return (copied);
 }
 
+/*
+ * Determine the virtio GSO type with which an HW_LSO frame is handed to the
+ * guest, given the features it negotiated.
+ */
+static uint8_t
+viona_rx_gso_type(const mblk_t *mp, uint32_t features)
+{
+	const struct ether_vlan_header *veth;
+	uint16_t ftype;
+
+	if (MBLKL(mp) < sizeof (struct ether_vlan_header)) {
+		return (VIRTIO_NET_HDR_GSO_NONE);
+	}
+	veth = (const struct ether_vlan_header *)mp->b_rptr;
+	ftype = ntohs(veth->ether_tpid);
+	if (ftype == ETHERTYPE_VLAN) {
+		ftype = ntohs(veth->ether_type);
+	}
+
+	if (ftype == ETHERTYPE_IP &&
+	    (features & VIRTIO_NET_F_GUEST_TSO4) != 0) {
+		return (VIRTIO_NET_HDR_GSO_TCPV4);
+	} else if (ftype == ETHERTYPE_IPV6 &&
+	    (features & VIRTIO_NET_F_GUEST_TSO6) != 0) {
+		return (VIRTIO_NET_HDR_GSO_TCPV6);
+	}
+	return (VIRTIO_NET_HDR_GSO_NONE);
+}
+
 static int
 viona_recv_plain(viona_vring_t *ring, const mblk_t *mp, size_t msz)
 {
@@ -264,10 +304,11 @@ viona_recv_plain(viona_vring_t *ring, const mblk_t *mp, size_t msz)
 	if ((features & VIRTIO_NET_F_GUEST_CSUM) != 0) {
 		uint32_t cksum_flags;
 
-		if (((features & VIRTIO_NET_F_GUEST_TSO4) != 0) &&
-		    ((DB_CKSUMFLAGS(mp) & HW_LSO) != 0)) {
-			hdr->vrh_gso_type |= VIRTIO_NET_HDR_GSO_TCPV4;
-			hdr->vrh_gso_size = DB_LSOMSS(mp);
+		if ((DB_CKSUMFLAGS(mp) & HW_LSO) != 0) {
+			hdr->vrh_gso_type = viona_rx_gso_type(mp, features);
+			if (hdr->vrh_gso_type != VIRTIO_NET_HDR_GSO_NONE) {
+				hdr->vrh_gso_size = DB_LSOMSS(mp);
+			}
 		}
 
 		mac_hcksum_get((mblk_t *)mp, NULL, NULL, NULL, NULL,
@@ -411,10 +452,11 @@ viona_recv_merged(viona_vring_t *ring, const mblk_t *mp, size_t msz)
 	if ((features & VIRTIO_NET_F_GUEST_CSUM) != 0) {
 		uint32_t cksum_flags;
 
-		if (((features & VIRTIO_NET_F_GUEST_TSO4) != 0) &&
-		    ((DB_CKSUMFLAGS(mp) & HW_LSO) != 0)) {
-			hdr->vrh_gso_type |= VIRTIO_NET_HDR_GSO_TCPV4;
-			hdr->vrh_gso_size = DB_LSOMSS(mp);
+		if ((DB_CKSUMFLAGS(mp) & HW_LSO) != 0) {
+			hdr->vrh_gso_type = viona_rx_gso_type(mp, features);
+			if (hdr->vrh_gso_type != VIRTIO_NET_HDR_GSO_NONE) {
+				hdr->vrh_gso_size = DB_LSOMSS(mp);
+			}
 		}
 
 		mac_hcksum_get((mblk_t *)mp, NULL, NULL, NULL, NULL,
@@ -451,6 +493,305 @@ done:
 	return (err);
 }
 
+/*
+ * Receive coalescing.
+ *
+ * For guests which negotiated TSO receive, runs of in-order TCP segments of
+ * the same connection within a chain handed to viona_rx_common() are joined
+ * into one large frame before being copied into guest memory.  The guest then
+ * consumes one set of receive buffers, one used-ring update and (at most) one
+ * interrupt per run rather than per segment, processing the frame through its
+ * GRO/TSO receive path as it would one from a TSO-capable peer on the host.
+ *
+ * The conditions on a segment are those of software LRO in MAC (see
+ * mac_rx_soft_ring_lro()), adapted for whole Ethernet frames: a single,
+ * unshared mblk holding an untagged or 802.1Q-tagged Ethernet frame with
+ * exactly one unfragmented IPv4 packet without options, or IPv6 packet
+ * without extension headers, whose checksums the hardware verified, and
+ * which carries TCP data with no flags other than ACK and PSH.  It joins the
+ * frame before it in the same connection if all of its headers other than
+ * the IP length (and IPv4 ID and checksum) match, if it is next in sequence,
+ * and if it is no larger than the first segment.  A shorter segment, or one
+ * with PSH, closes the run.
+ *
+ * A coalesced frame is the first segment's mblk, with each later segment's
+ * mblk on its b_cont chain, its b_rptr moved past that segment's headers.
+ * The IP length (and IPv4 header checksum) are rewritten and it is flagged
+ * HW_LSO with the payload size of the first segment in DB_LSOMSS, which
+ * becomes the gso_size of the virtio header.
+ */
+typedef struct viona_rx_flow {
+	mblk_t		*vrf_mp;	/* first segment */
+	mblk_t		*vrf_tail;	/* last mblk on vrf_mp's b_cont */
+	uint_t		vrf_hlen;	/* L2 + L3 + L4 header length */
+	uint_t		vrf_l3off;	/* offset of IP header */
+	uint32_t	vrf_seq;	/* next sequence number expected */
+	uint32_t	vrf_len;	/* frame length so far */
+	uint32_t	vrf_mss;	/* first segment's payload */
+	uint32_t	vrf_segs;
+	boolean_t	vrf_v6;
+	boolean_t	vrf_closed;
+} viona_rx_flow_t;
+
+/*
+ * Return the TCP header of mp if it is a segment that may be coalesced, else
+ * NULL.  The offset of the IP header and the length of all headers are
+ * returned through l3offp and hlenp.
+ */
+static tcpha_t *
+viona_rx_coalesce_tcpha(const mblk_t *mp, uint32_t features, uint_t *l3offp,
+    uint_t *hlenp, boolean_t *v6p)
+{
+	const struct ether_vlan_header *veth;
+	const size_t len = MBLKL(mp);
+	uint_t l3off = sizeof (struct ether_header);
+	uint_t l4off;
+	uint32_t need;
+	uint16_t ftype;
+	tcpha_t *tcpha;
+
+	if (mp->b_cont != NULL || DB_REF(mp) != 1 ||
+	    (DB_CKSUMFLAGS(mp) & (HW_LSO | HCK_FULLCKSUM_OK)) !=
+	    HCK_FULLCKSUM_OK || len < sizeof (struct ether_vlan_header) +
+	    IPV6_HDR_LEN + TCP_MIN_HEADER_LENGTH) {
+		return (NULL);
+	}
+
+	veth = (const struct ether_vlan_header *)mp->b_rptr;
+	ftype = ntohs(veth->ether_tpid);
+	if (ftype == ETHERTYPE_VLAN) {
+		l3off = sizeof (struct ether_vlan_header);
+		ftype = ntohs(veth->ether_type);
+	}
+
+	if (ftype == ETHERTYPE_IP) {
+		const ipha_t *ipha = (const ipha_t *)(mp->b_rptr + l3off);
+
+		need = HCK_IPV4_HDRCKSUM_OK;
+		if ((features & VIRTIO_NET_F_GUEST_TSO4) == 0 ||
+		    ipha->ipha_version_and_hdr_length !=
+		    IP_SIMPLE_HDR_VERSION ||
+		    ipha->ipha_protocol != IPPROTO_TCP ||
+		    ntohs(ipha->ipha_length) != len - l3off ||
+		    (ipha->ipha_fragment_offset_and_flags &
+		    ~IPH_DF_HTONS) != 0) {
+			return (NULL);
+		}
+		l4off = l3off + IP_SIMPLE_HDR_LENGTH;
+		*v6p = B_FALSE;
+	} else if (ftype == ETHERTYPE_IPV6) {
+		const ip6_t *ip6h = (const ip6_t *)(mp->b_rptr + l3off);
+
+		need = 0;
+		if ((features & VIRTIO_NET_F_GUEST_TSO6) == 0 ||
+		    IPH_HDR_VERSION(ip6h) != IPV6_VERSION ||
+		    ip6h->ip6_nxt != IPPROTO_TCP ||
+		    ntohs(ip6h->ip6_plen) != len - l3off - IPV6_HDR_LEN) {
+			return (NULL);
+		}
+		l4off = l3off + IPV6_HDR_LEN;
+		*v6p = B_TRUE;
+	} else {
+		return (NULL);
+	}
+	if ((DB_CKSUMFLAGS(mp) & need) != need) {
+		return (NULL);
+	}
+
+	tcpha = (tcpha_t *)(mp->b_rptr + l4off);
+	*l3offp = l3off;
+	*hlenp = l4off + TCP_HDR_LENGTH(tcpha);
+	if (*hlenp >= len || (tcpha->tha_flags & ~(TH_ACK | TH_PUSH)) != 0 ||
+	    (tcpha->tha_flags & TH_ACK) == 0) {
+		return (NULL);
+	}
+
+	return (tcpha);
+}
+
+/*
+ * Do the L2 and IP headers of the segment mp, whose IP header is at l3off,
+ * match those of the flow's frame?
+ */
+static boolean_t
+viona_rx_coalesce_match(const viona_rx_flow_t *vrf, const mblk_t *mp,
+    uint_t l3off, boolean_t v6)
+{
+	const uchar_t *ohdr = vrf->vrf_mp->b_rptr;
+	const uchar_t *hdr = mp->b_rptr;
+
+	if (vrf->vrf_l3off != l3off || vrf->vrf_v6 != v6 ||
+	    bcmp(ohdr, hdr, l3off) != 0) {
+		return (B_FALSE);
+	}
+
+	if (v6) {
+		const ip6_t *oip6h = (const ip6_t *)(ohdr + l3off);
+		const ip6_t *ip6h = (const ip6_t *)(hdr + l3off);
+
+		/* Everything but the payload length must match */
+		if (oip6h->ip6_vcf != ip6h->ip6_vcf ||
+		    oip6h->ip6_hops != ip6h->ip6_hops ||
+		    bcmp(&oip6h->ip6_src, &ip6h->ip6_src,
+		    2 * sizeof (in6_addr_t)) != 0) {
+			return (B_FALSE);
+		}
+	} else {
+		const ipha_t *oipha = (const ipha_t *)(ohdr + l3off);
+		const ipha_t *ipha = (const ipha_t *)(hdr + l3off);
+
+		if (oipha->ipha_src != ipha->ipha_src ||
+		    oipha->ipha_dst != ipha->ipha_dst ||
+		    oipha->ipha_type_of_service != ipha->ipha_type_of_service ||
+		    oipha->ipha_ttl != ipha->ipha_ttl) {
+			return (B_FALSE);
+		}
+	}
+	return (B_TRUE);
+}
+
+/*
+ * Finish off a coalesced frame, if that is what vrf holds.
+ */
+static void
+viona_rx_coalesce_flush(viona_vring_t *ring, viona_rx_flow_t *vrf)
+{
+	mblk_t *mp = vrf->vrf_mp;
+
+	if (vrf->vrf_segs > 1) {
+		if (vrf->vrf_v6) {
+			ip6_t *ip6h = (ip6_t *)(mp->b_rptr + vrf->vrf_l3off);
+
+			ip6h->ip6_plen = htons(vrf->vrf_len - vrf->vrf_l3off -
+			    IPV6_HDR_LEN);
+		} else {
+			ipha_t *ipha = (ipha_t *)(mp->b_rptr + vrf->vrf_l3off);
+
+			ipha->ipha_length = htons(vrf->vrf_len -
+			    vrf->vrf_l3off);
+			ipha->ipha_hdr_checksum = 0;
+			ipha->ipha_hdr_checksum = (uint16_t)ip_csum_hdr(ipha);
+		}
+		DB_CKSUMFLAGS(mp) |= HW_LSO;
+		DB_LSOMSS(mp) = vrf->vrf_mss;
+		VIONA_RING_STAT_INCR(ring, rx_coalesced);
+		ring->vr_stats.rs_rx_coalesced_segs += vrf->vrf_segs;
+	}
+	vrf->vrf_mp = NULL;
+}
+
+/*
+ * Coalesce the segments of chain as described above, returning the new
+ * chain.
+ */
+static mblk_t *
+viona_rx_coalesce(viona_vring_t *ring, mblk_t *chain, uint32_t features)
+{
+	viona_rx_flow_t flows[VIONA_RX_COALESCE_FLOWS];
+	viona_rx_flow_t *vrf;
+	mblk_t *head = NULL, **tailp = &head;
+	mblk_t *mp, *next;
+	uint_t victim = 0;
+
+	bzero(flows, sizeof (flows));
+
+	for (mp = chain; mp != NULL; mp = next) {
+		tcpha_t *tcpha;
+		uint32_t seq, plen;
+		uint_t l3off, hlen, thlen;
+		boolean_t v6;
+
+		next = mp->b_next;
+		mp->b_next = NULL;
+
+		tcpha = viona_rx_coalesce_tcpha(mp, features, &l3off, &hlen,
+		    &v6);
+		if (tcpha == NULL) {
+			goto deliver;
+		}
+		thlen = TCP_HDR_LENGTH(tcpha);
+		plen = MBLKL(mp) - hlen;
+		seq = ntohl(tcpha->tha_seq);
+
+		/* Segments of a flow share header lengths, ports included */
+		vrf = NULL;
+		for (uint_t i = 0; i < VIONA_RX_COALESCE_FLOWS; i++) {
+			const tcpha_t *otcpha;
+
+			if (flows[i].vrf_mp == NULL ||
+			    flows[i].vrf_hlen != hlen) {
+				continue;
+			}
+			otcpha = (const tcpha_t *)(flows[i].vrf_mp->b_rptr +
+			    hlen - thlen);
+			if (*(const uint32_t *)otcpha == *(uint32_t *)tcpha &&
+			    viona_rx_coalesce_match(&flows[i], mp, l3off, v6)) {
+				vrf = &flows[i];
+				break;
+			}
+		}
+
+		if (vrf != NULL) {
+			const tcpha_t *otcpha = (const tcpha_t *)
+			    (vrf->vrf_mp->b_rptr + hlen - thlen);
+
+			if (!vrf->vrf_closed && seq == vrf->vrf_seq &&
+			    plen <= vrf->vrf_mss &&
+			    vrf->vrf_len + plen <= viona_rx_coalesce_max &&
+			    tcpha->tha_ack == otcpha->tha_ack &&
+			    tcpha->tha_win == otcpha->tha_win &&
+			    bcmp(&otcpha[1], &tcpha[1],
+			    thlen - TCP_MIN_HEADER_LENGTH) == 0) {
+				mp->b_rptr += hlen;
+				vrf->vrf_tail->b_cont = mp;
+				vrf->vrf_tail = mp;
+				vrf->vrf_seq += plen;
+				vrf->vrf_len += plen;
+				vrf->vrf_segs++;
+				if (plen < vrf->vrf_mss ||
+				    (tcpha->tha_flags & TH_PUSH) != 0) {
+					vrf->vrf_closed = B_TRUE;
+				}
+				continue;
+			}
+			viona_rx_coalesce_flush(ring, vrf);
+		} else {
+			for (uint_t i = 0; i < VIONA_RX_COALESCE_FLOWS; i++) {
+				if (flows[i].vrf_mp == NULL) {
+					vrf = &flows[i];
+					break;
+				}
+			}
+			if (vrf == NULL) {
+				vrf = &flows[victim];
+				victim = (victim + 1) % VIONA_RX_COALESCE_FLOWS;
+				viona_rx_coalesce_flush(ring, vrf);
+			}
+		}
+
+		vrf->vrf_mp = mp;
+		vrf->vrf_tail = mp;
+		vrf->vrf_hlen = hlen;
+		vrf->vrf_l3off = l3off;
+		vrf->vrf_seq = seq + plen;
+		vrf->vrf_len = MBLKL(mp);
+		vrf->vrf_mss = plen;
+		vrf->vrf_segs = 1;
+		vrf->vrf_v6 = v6;
+		vrf->vrf_closed = (tcpha->tha_flags & TH_PUSH) != 0;
+deliver:
+		*tailp = mp;
+		tailp = &mp->b_next;
+	}
+
+	for (uint_t i = 0; i < VIONA_RX_COALESCE_FLOWS; i++) {
+		if (flows[i].vrf_mp != NULL) {
+			viona_rx_coalesce_flush(ring, &flows[i]);
+		}
+	}
+	return (head);
+}
+
 static void
 viona_rx_common(viona_vring_t *ring, mblk_t *mp, boolean_t is_loopback)
 {
@@ -462,6 +803,19 @@ viona_rx_common(viona_vring_t *ring, mblk_t *mp, boolean_t is_loopback)
 
 	size_t nrx = 0, ndrop = 0;
 
+	/*
+	 * Coalesce TCP segments for guests able to receive TSO frames.  This
+	 * is skipped when nethooks are interested in the traffic, so that
+	 * they continue to see the packets as they arrived.
+	 */
+	if (viona_rx_coalesce_enable && mp != NULL && mp->b_next != NULL &&
+	    (link->l_features & VIRTIO_NET_F_GUEST_CSUM) != 0 &&
+	    (link->l_features &
+	    (VIRTIO_NET_F_GUEST_TSO4 | VIRTIO_NET_F_GUEST_TSO6)) != 0 &&
+	    !VNETHOOK_INTERESTED_IN(link->l_neti)) {
+		mp = viona_rx_coalesce(ring, mp, link->l_features);
+	}
+
 	while (mp != NULL) {
 		mblk_t *next = mp->b_next;
 		mblk_t *pad = NULL;
@@ -610,15 +964,58 @@ viona_rx_classified(void *arg, mac_resource_handle_t mrh, mblk_t *mp,
     boolean_t is_loopback)
 {
 	viona_vring_t *ring = (viona_vring_t *)arg;
+	viona_link_t *link = ring->vr_link;
+	const uint_t nqpairs = link->l_nqpairs;
+	mblk_t *heads[VIONA_MAX_QPAIRS] = { NULL };
+	mblk_t **tails[VIONA_MAX_QPAIRS];
+
+	if (nqpairs <= 1) {
+		/* Drop traffic if ring is inactive or renewing its lease */
+		if (ring->vr_state != VRS_RUN ||
+		    (ring->vr_state_flags & VRSF_RENEW) != 0) {
+			freemsgchain(mp);
+			return;
+		}
 
-	/* Drop traffic if ring is inactive or renewing its lease */
-	if (ring->vr_state != VRS_RUN ||
-	    (ring->vr_state_flags & VRSF_RENEW) != 0) {
-		freemsgchain(mp);
+		viona_rx_common(ring, mp, is_loopback);
 		return;
 	}
 
-	viona_rx_common(ring, mp, is_loopback);
+	/*
+	 * With multiple queue pairs active, spread the chain across the RX
+	 * rings by flow hash so that each flow is delivered, in order, to a
+	 * single guest queue.
+	 */
+	for (uint_t i = 0; i < nqpairs; i++) {
+		tails[i] = &heads[i];
+	}
+	while (mp != NULL) {
+		mblk_t *next = mp->b_next;
+		uint_t q;
+
+		mp->b_next = NULL;
+		q = mac_pkt_hash(DL_ETHER, mp, MAC_PKT_HASH_L4, B_TRUE) %
+		    nqpairs;
+		*tails[q] = mp;
+		tails[q] = &mp->b_next;
+		mp = next;
+	}
+
+	for (uint_t i = 0; i < nqpairs; i++) {
+		if (heads[i] == NULL) {
+			continue;
+		}
+		ring = &link->l_vrings[(i * VIONA_VQ_MAX) + VIONA_VQ_RX];
+
+		/* Drop traffic if ring is inactive or renewing its lease */
+		if (ring->vr_state != VRS_RUN ||
+		    (ring->vr_state_flags & VRSF_RENEW) != 0) {
+			freemsgchain(heads[i]);
+			continue;
+		}
+
+		viona_rx_common(ring, heads[i], is_loopback);
+	}
 }
 
 static void
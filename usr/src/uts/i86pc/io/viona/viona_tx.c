@@ -62,6 +62,15 @@ static enum viona_force_copy {
 	VFC_COPY_REQUIRED	= 2,
 } viona_force_copy_state = VFC_UNINITALIZED;
 
+/*
+ * Zero-copy transmissions complete from the reclaim path of the NIC driver,
+ * typically in bursts.  Rather than interrupting the guest for each, the
+ * interrupt is posted once per viona_tx_intr_batch completions, and always
+ * when the last outstanding transmission completes, so that no completion is
+ * left unsignalled.
+ */
+uint_t viona_tx_intr_batch = 16;
+
 struct viona_desb {
 	frtn_t			d_frtn;
 	viona_vring_t		*d_ring;
@@ -310,13 +319,27 @@ viona_desb_release(viona_desb_t *dp)
 	dp->d_cookie = 0;
 	dp->d_ref = 0;
 
-	viona_tx_done(ring, len, cookie);
+	vq_pushchain(ring, len, cookie);
 
-	mutex_enter(&ring->vr_lock);
-	if ((--ring->vr_xfer_outstanding) == 0) {
+	ref = atomic_dec_uint_nv(&ring->vr_xfer_outstanding);
+	if (ref == 0 ||
+	    atomic_inc_uint_nv(&ring->vr_tx_ncompl) >= viona_tx_intr_batch) {
+		ring->vr_tx_ncompl = 0;
+		membar_enter();
+		if ((*ring->vr_avail_flags & VRING_AVAIL_F_NO_INTERRUPT) == 0) {
+			viona_intr_ring(ring);
+		}
+	}
+
+	/*
+	 * Waiters check vr_xfer_outstanding under vr_lock, so taking it here
+	 * ensures the wake-up cannot be lost.
+	 */
+	if (ref == 0) {
+		mutex_enter(&ring->vr_lock);
 		cv_broadcast(&ring->vr_cv);
+		mutex_exit(&ring->vr_lock);
 	}
-	mutex_exit(&ring->vr_lock);
 }
 
 static boolean_t
@@ -691,9 +714,7 @@ viona_tx(viona_link_t *link, viona_vring_t *ring)
 
 	if (dp != NULL) {
 		dp->d_len = len;
-		mutex_enter(&ring->vr_lock);
-		ring->vr_xfer_outstanding++;
-		mutex_exit(&ring->vr_lock);
+		atomic_inc_uint(&ring->vr_xfer_outstanding);
 	} else {
 		/*
 		 * If the data was cloned out of the ring, the descriptors can
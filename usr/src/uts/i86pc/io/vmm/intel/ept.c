@@ -86,7 +86,7 @@ SYSCTL_DECL(_hw_vmm);
 SYSCTL_NODE(_hw_vmm, OID_AUTO, ept, CTLFLAG_RW | CTLFLAG_MPSAFE, NULL,
     NULL);
 
-static int ept_enable_ad_bits;
+int ept_enable_ad_bits;	/* consulted by vmm_sol_ept dirty tracking */
 
 static int ept_pmap_flags;
 SYSCTL_INT(_hw_vmm_ept, OID_AUTO, pmap_flags, CTLFLAG_RD,
@@ -1123,6 +1123,10 @@ vmx_astpending_trace(struct vmx *vmx, int vcpu, uint64_t rip)
 static VMM_STAT_INTEL(VCPU_INVVPID_SAVED, "Number of vpid invalidations saved");
 static VMM_STAT_INTEL(VCPU_INVVPID_DONE, "Number of vpid invalidations done");
 
+static VMM_STAT_INTEL(VMEXIT_APIC_ACCESS, "vm exits due to APIC page access");
+static VMM_STAT_INTEL(VMEXIT_APIC_WRITE, "vm exits due to APIC register write");
+static VMM_STAT_INTEL(VMEXIT_VIRT_EOI, "vm exits due to APICv EOI broadcast");
+
 /*
  * Invalidate guest mappings identified by its vpid from the TLB.
  */
@@ -2669,12 +2673,14 @@ vmx_exit_process(struct vmx *vmx, int vcpu, struct vm_exit *vmexit)
 			vmx_restore_nmi_blocking(vmx, vcpu);
 		break;
 	case EXIT_REASON_VIRTUALIZED_EOI:
+		vmm_stat_incr(vmx->vm, vcpu, VMEXIT_VIRT_EOI, 1);
 		vmexit->exitcode = VM_EXITCODE_IOAPIC_EOI;
 		vmexit->u.ioapic_eoi.vector = qual & 0xFF;
 		SDT_PROBE3(vmm, vmx, exit, eoi, vmx, vcpu, vmexit);
 		vmexit->inst_length = 0;	/* trap-like */
 		break;
 	case EXIT_REASON_APIC_ACCESS:
+		vmm_stat_incr(vmx->vm, vcpu, VMEXIT_APIC_ACCESS, 1);
 		SDT_PROBE3(vmm, vmx, exit, apicaccess, vmx, vcpu, vmexit);
 		handled = vmx_handle_apic_access(vmx, vcpu, vmexit);
 		break;
@@ -2684,6 +2690,7 @@ vmx_exit_process(struct vmx *vmx, int vcpu, struct vm_exit *vmexit)
 		 * pointing to the next instruction.
 		 */
 		vmexit->inst_length = 0;
+		vmm_stat_incr(vmx->vm, vcpu, VMEXIT_APIC_WRITE, 1);
 		vlapic = vm_lapic(vmx->vm, vcpu);
 		SDT_PROBE4(vmm, vmx, exit, apicwrite,
 		    vmx, vcpu, vmexit, vlapic);
@@ -1602,6 +1602,11 @@ vlapic_deliver_intr(struct vm *vm, bool level, uint32_t dest, bool phys,
 	}
 }
 
+static VMM_STAT(VLAPIC_INTR_POSTED,
+    "interrupts posted to a running vcpu without an exit");
+static VMM_STAT(VLAPIC_INTR_KICKED,
+    "interrupts requiring an exit of a running vcpu");
+
 void
 vlapic_post_intr(struct vlapic *vlapic, int hostcpu, int ipinum)
 {
@@ -1614,10 +1619,15 @@ vlapic_post_intr(struct vlapic *vlapic, int hostcpu, int ipinum)
 	 * If neither of these features are available then fallback to
 	 * sending an IPI to 'hostcpu'.
 	 */
-	if (vlapic->ops.post_intr)
+	if (vlapic->ops.post_intr) {
+		vmm_stat_incr(vlapic->vm, vlapic->vcpuid,
+		    VLAPIC_INTR_POSTED, 1);
 		(*vlapic->ops.post_intr)(vlapic, hostcpu);
-	else
+	} else {
+		vmm_stat_incr(vlapic->vm, vlapic->vcpuid,
+		    VLAPIC_INTR_KICKED, 1);
 		ipi_cpu(hostcpu, ipinum);
+	}
 }
 
 bool
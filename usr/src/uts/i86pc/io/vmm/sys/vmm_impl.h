@@ -19,9 +19,11 @@
 #define	_VMM_IMPL_H_
 
 #include <sys/mutex.h>
+#include <sys/poll.h>
 #include <sys/queue.h>
 #include <sys/varargs.h>
 #include <sys/zone.h>
+#include <sys/vmm_dev.h>
 
 #ifdef	_KERNEL
 
@@ -45,6 +47,7 @@ struct vmm_devmem_entry {
 typedef struct vmm_devmem_entry vmm_devmem_entry_t;
 
 typedef struct vmm_zsd vmm_zsd_t;
+typedef struct vmm_doorbell vmm_doorbell_t;
 
 enum vmm_softc_state {
 	VMM_HELD	= 1,	/* external driver(s) possess hold on the VM */
@@ -72,6 +75,11 @@ struct vmm_softc {
 	kcondvar_t	vmm_lease_cv;
 	krwlock_t	vmm_rwlock;
 
+	/* I/O port doorbells (VM_DOORBELL_BIND), guarded by vmm_rwlock */
+	vmm_doorbell_t	*vmm_doorbells[VM_MAX_DOORBELLS];
+	volatile uint64_t vmm_doorbell_pend;
+	struct pollhead	vmm_pollhead;
+
 	/* For zone specific data */
 	list_node_t	vmm_zsd_linkage;
 	zone_t		*vmm_zone;
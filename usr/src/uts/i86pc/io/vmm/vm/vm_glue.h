@@ -65,6 +65,7 @@ struct vm_object {
 	size_t		vmo_size;
 	vm_pager_fn_t	vmo_pager;
 	void		*vmo_data;
+	boolean_t	vmo_lpage;	/* vmo_data backed by large pages */
 
 	kmutex_t	vmo_lock;	/* protects fields below */
 	vm_memattr_t	vmo_attr;
@@ -82,6 +83,8 @@ int vm_segmap_obj(vm_object_t, off_t, size_t, struct as *, caddr_t *, uint_t,
 int vm_segmap_space(struct vmspace *, off_t, struct as *, caddr_t *, off_t,
     uint_t, uint_t, uint_t);
 void *vmspace_find_kva(struct vmspace *, uintptr_t, size_t);
+int vmspace_track_dirty(struct vmspace *, uint64_t, size_t, uint8_t *);
+void vmm_dirty_bitmap_set(uint8_t *, uint64_t, uint64_t, uint64_t);
 void vmm_arena_init(void);
 void vmm_arena_fini(void);
 
@@ -89,13 +92,17 @@ struct vmm_pt_ops {
 	void * (*vpo_init)(uint64_t *);
 	void (*vpo_free)(void *);
 	uint64_t (*vpo_wired_cnt)(void *);
+	uint64_t (*vpo_lgpg_cnt)(void *);
 	int (*vpo_is_wired)(void *, uint64_t, uint_t *);
 	int (*vpo_map)(void *, uint64_t, pfn_t, uint_t, uint_t, uint8_t);
 	uint64_t (*vpo_unmap)(void *, uint64_t, uint64_t);
+	int (*vpo_harvest_dirty)(void *, uint64_t, uint64_t, uint8_t *);
 };
 
 extern struct vmm_pt_ops ept_ops;
 extern struct vmm_pt_ops rvi_ops;
 
+extern int ept_enable_ad_bits;
+
 
 #endif /* _VM_GLUE_ */
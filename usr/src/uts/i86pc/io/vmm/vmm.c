@@ -68,9 +68,7 @@ __FBSDID("$FreeBSD$");
 #include <vm/vm_extern.h>
 #include <vm/vm_param.h>
 
-#ifdef __FreeBSD__
 #include <machine/cpu.h>
-#endif
 #include <machine/pcb.h>
 #include <machine/smp.h>
 #include <machine/md_var.h>
@@ -137,6 +135,7 @@ struct vcpu {
 	uint64_t	nextrip;	/* (x) next instruction to execute */
 #ifndef __FreeBSD__
 	uint64_t	tsc_offset;	/* (x) offset from host TSC */
+	hrtime_t	halt_poll_ns;	/* (x) adaptive HLT poll window */
 #endif
 };
 
@@ -277,6 +276,20 @@ SYSCTL_INT(_hw_vmm, OID_AUTO, halt_detection, CTLFLAG_RDTUN,
     &halt_detection_enabled, 0,
     "Halt VM if all vcpus execute HLT with interrupts disabled");
 
+#ifndef __FreeBSD__
+/*
+ * Before an idle vcpu (HLT with interrupts enabled) is put to sleep, it spins
+ * for up to its halt_poll_ns waiting for an interrupt, saving the wakeup and
+ * dispatch latency when one arrives quickly.  The window starts at zero and
+ * grows (from vmm_halt_poll_start_ns, doubling) each time a sleep is shorter
+ * than vmm_halt_poll_max_ns, and is halved after a sleep longer than that, so
+ * vcpus which are really idle quickly stop burning host CPU.  A max of zero
+ * disables polling.
+ */
+hrtime_t vmm_halt_poll_max_ns = 200 * NANOSEC / MICROSEC;
+hrtime_t vmm_halt_poll_start_ns = 10 * NANOSEC / MICROSEC;
+#endif
+
 static int vmm_ipinum;
 SYSCTL_INT(_hw_vmm, OID_AUTO, ipinum, CTLFLAG_RD, &vmm_ipinum, 0,
     "IPI vector used for vcpu notifications");
@@ -1303,6 +1316,11 @@ save_guest_fpustate(struct vcpu *vcpu)
 }
 
 static VMM_STAT(VCPU_IDLE_TICKS, "number of ticks vcpu was idle");
+#ifndef __FreeBSD__
+static VMM_STAT(VCPU_HALT_POLL_OK, "idle halts ended by polling");
+static VMM_STAT(VCPU_HALT_POLL_MISS, "idle halts which slept after polling");
+static VMM_STAT(VCPU_HALT_POLL_NS, "nanoseconds spent halt polling");
+#endif
 
 static int
 vcpu_set_state_locked(struct vm *vm, int vcpuid, enum vcpu_state newstate,
@@ -1419,6 +1437,61 @@ vcpu_require_state_locked(struct vm *vm, int vcpuid, enum vcpu_state newstate)
 /*
  * Emulate a guest 'hlt' by sleeping until the vcpu is ready to run.
  */
+#ifndef __FreeBSD__
+/*
+ * Spin, without the vcpu lock, for up to the vcpu's poll window waiting for
+ * something which would end an idle halt.  Those checks are repeated under
+ * the lock by the caller, so racy reads are fine here.
+ */
+static bool
+vcpu_halt_poll(struct vm *vm, int vcpuid)
+{
+	struct vcpu *vcpu = &vm->vcpu[vcpuid];
+	const hrtime_t start = gethrtime();
+	const hrtime_t end = start + vcpu->halt_poll_ns;
+	hrtime_t now;
+	bool woke = false;
+
+	do {
+		if (vm->suspend || vcpu->reqidle ||
+		    vm_nmi_pending(vm, vcpuid) ||
+		    vm_extint_pending(vm, vcpuid) ||
+		    vlapic_pending_intr(vcpu->vlapic, NULL) ||
+		    vcpu_should_yield(vm, vcpuid)) {
+			woke = true;
+			break;
+		}
+		cpu_spinwait();
+		now = gethrtime();
+	} while (now < end);
+
+	vmm_stat_incr(vm, vcpuid, VCPU_HALT_POLL_NS, gethrtime() - start);
+	vmm_stat_incr(vm, vcpuid,
+	    woke ? VCPU_HALT_POLL_OK : VCPU_HALT_POLL_MISS, 1);
+	return (woke);
+}
+
+static void
+vcpu_halt_poll_adjust(struct vcpu *vcpu, hrtime_t slept)
+{
+	const hrtime_t max = vmm_halt_poll_max_ns;
+
+	if (max <= 0) {
+		vcpu->halt_poll_ns = 0;
+	} else if (slept > max) {
+		vcpu->halt_poll_ns /= 2;
+		if (vcpu->halt_poll_ns < vmm_halt_poll_start_ns)
+			vcpu->halt_poll_ns = 0;
+	} else if (vcpu->halt_poll_ns < max) {
+		if (vcpu->halt_poll_ns == 0)
+			vcpu->halt_poll_ns = vmm_halt_poll_start_ns;
+		else
+			vcpu->halt_poll_ns *= 2;
+		vcpu->halt_poll_ns = MIN(vcpu->halt_poll_ns, max);
+	}
+}
+#endif /* __FreeBSD__ */
+
 static int
 vm_handle_hlt(struct vm *vm, int vcpuid, bool intr_disabled, bool *retu)
 {
@@ -1429,6 +1502,10 @@ vm_handle_hlt(struct vm *vm, int vcpuid, bool intr_disabled, bool *retu)
 	const char *wmesg __unused;
 #endif
 	int t, vcpu_halted, vm_halted;
+#ifndef __FreeBSD__
+	bool polled = false;
+	hrtime_t slept;
+#endif
 
 	KASSERT(!CPU_ISSET(vcpuid, &vm->halted_cpus), ("vcpu already halted"));
 
@@ -1484,6 +1561,16 @@ vm_handle_hlt(struct vm *vm, int vcpuid, bool intr_disabled, bool *retu)
 			}
 		} else {
 			wmesg = "vmidle";
+#ifndef __FreeBSD__
+			if (!polled && vcpu->halt_poll_ns != 0) {
+				polled = true;
+				vcpu_unlock(vcpu);
+				(void) vcpu_halt_poll(vm, vcpuid);
+				vcpu_lock(vcpu);
+				/* Re-check the wakeup conditions under lock */
+				continue;
+			}
+#endif
 		}
 
 		t = ticks;
@@ -1499,7 +1586,11 @@ vm_handle_hlt(struct vm *vm, int vcpuid, bool intr_disabled, bool *retu)
 		 * Fortunately, cv_wait_sig can be interrupted by signals, so
 		 * there is no need to periodically wake up.
 		 */
+		slept = gethrtime();
 		(void) cv_wait_sig(&vcpu->vcpu_cv, &vcpu->mtx.m);
+		slept = gethrtime() - slept;
+		if (!intr_disabled)
+			vcpu_halt_poll_adjust(vcpu, slept);
 #endif
 		vcpu_require_state_locked(vm, vcpuid, VCPU_FROZEN);
 		vmm_stat_incr(vm, vcpuid, VCPU_IDLE_TICKS, ticks - t);
@@ -3116,6 +3207,7 @@ vm_copyout(struct vm *vm, int vcpuid, const void *kaddr,
  */
 VMM_STAT_DECLARE(VMM_MEM_RESIDENT);
 VMM_STAT_DECLARE(VMM_MEM_WIRED);
+VMM_STAT_DECLARE(VMM_MEM_LGPG);
 
 static void
 vm_get_rescnt(struct vm *vm, int vcpu, struct vmm_stat_type *stat)
@@ -3138,7 +3230,19 @@ vm_get_wiredcnt(struct vm *vm, int vcpu, struct vmm_stat_type *stat)
 }
 
 VMM_STAT_FUNC(VMM_MEM_RESIDENT, "Resident memory", vm_get_rescnt);
+static void
+vm_get_lgpgcnt(struct vm *vm, int vcpu, struct vmm_stat_type *stat)
+{
+
+	if (vcpu == 0) {
+		vmm_stat_set(vm, vcpu, VMM_MEM_LGPG,
+		    PAGE_SIZE * pmap_lgpg_count(vmspace_pmap(vm->vmspace)));
+	}
+}
+
 VMM_STAT_FUNC(VMM_MEM_WIRED, "Wired memory", vm_get_wiredcnt);
+VMM_STAT_FUNC(VMM_MEM_LGPG, "Memory mapped with large pages",
+    vm_get_lgpgcnt);
 
 #ifndef __FreeBSD__
 int
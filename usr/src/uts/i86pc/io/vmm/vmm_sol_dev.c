@@ -18,6 +18,7 @@
  */
 
 #include <sys/types.h>
+#include <sys/atomic.h>
 #include <sys/conf.h>
 #include <sys/cpuvar.h>
 #include <sys/ioccom.h>
@@ -95,6 +96,13 @@ struct vmm_hold {
 	uint_t		vmh_ioport_hook_cnt;
 };
 
+/* Guest I/O port bound to a bit in vmm_doorbell_pend */
+struct vmm_doorbell {
+	vmm_softc_t	*vdb_sc;
+	uint64_t	vdb_bit;
+	void		*vdb_cookie;
+};
+
 struct vmm_lease {
 	list_node_t		vml_node;
 	struct vm		*vml_vm;
@@ -221,6 +229,123 @@ vmmdev_devmem_purge(vmm_softc_t *sc)
 	}
 }
 
+/*
+ * Doorbell write hook, called in vCPU context on a guest OUT to the bound
+ * port.  The written value is discarded: the bit only says "look at your
+ * rings".  A bit which is already pending has yet to be collected by a
+ * VM_DOORBELL_PENDING that will happen after this write, so there is no
+ * need to wake the poller again.
+ */
+static int
+vmmdev_doorbell_ring(void *arg, uintptr_t port, uint_t bytes, uint64_t val)
+{
+	vmm_doorbell_t *db = arg;
+	vmm_softc_t *sc = db->vdb_sc;
+
+	if ((sc->vmm_doorbell_pend & db->vdb_bit) == 0) {
+		atomic_or_64(&sc->vmm_doorbell_pend, db->vdb_bit);
+		pollwakeup(&sc->vmm_pollhead, POLLIN | POLLRDNORM);
+	}
+	return (0);
+}
+
+static int
+vmmdev_doorbell_bind(vmm_softc_t *sc, const struct vm_doorbell *vdb)
+{
+	vmm_doorbell_t *db;
+	int err;
+
+	ASSERT(RW_WRITE_HELD(&sc->vmm_rwlock));
+
+	if (vdb->id < 0 || vdb->id >= VM_MAX_DOORBELLS) {
+		return (EINVAL);
+	}
+	if (sc->vmm_doorbells[vdb->id] != NULL) {
+		return (EEXIST);
+	}
+
+	db = kmem_alloc(sizeof (*db), KM_SLEEP);
+	db->vdb_sc = sc;
+	db->vdb_bit = 1ULL << vdb->id;
+	/* Reads from the port are still emulated in userspace */
+	err = vm_ioport_hook(sc->vmm_vm, vdb->port, NULL, vmmdev_doorbell_ring,
+	    db, &db->vdb_cookie);
+	if (err != 0) {
+		kmem_free(db, sizeof (*db));
+		return (err);
+	}
+	sc->vmm_doorbells[vdb->id] = db;
+	return (0);
+}
+
+static void
+vmmdev_doorbell_unbind(vmm_softc_t *sc, int id)
+{
+	vmm_doorbell_t *db = sc->vmm_doorbells[id];
+
+	vm_ioport_unhook(sc->vmm_vm, &db->vdb_cookie);
+	atomic_and_64(&sc->vmm_doorbell_pend, ~db->vdb_bit);
+	sc->vmm_doorbells[id] = NULL;
+	kmem_free(db, sizeof (*db));
+}
+
+/*
+ * Remove every doorbell.  The caller must either hold the VM write lock or
+ * be on the last close, with no vCPU able to run.
+ */
+static void
+vmmdev_doorbell_purge(vmm_softc_t *sc)
+{
+	for (int i = 0; i < VM_MAX_DOORBELLS; i++) {
+		if (sc->vmm_doorbells[i] != NULL) {
+			vmmdev_doorbell_unbind(sc, i);
+		}
+	}
+}
+
+/*
+ * The dirty bitmap is harvested and copied out in pieces covering this much
+ * guest-physical space (4K of bitmap apiece).
+ */
+#define	VMM_DIRTY_CHUNK		(PAGESIZE * PAGESIZE * NBBY)
+#define	VMM_DIRTY_CHUNK_BYTES	(VMM_DIRTY_CHUNK / PAGESIZE / NBBY)
+
+static int
+vmmdev_track_dirty(vmm_softc_t *sc, struct vm_dirty_tracker *vdt, int md)
+{
+	struct vmspace *vms = vm_get_vmspace(sc->vmm_vm);
+	const uint64_t gpa = vdt->vdt_start_gpa;
+	const size_t len = vdt->vdt_len;
+	caddr_t out = vdt->vdt_pfns;
+	uint8_t *bitmap;
+	int err = 0;
+
+	if ((gpa & PAGEOFFSET) != 0 || (len & PAGEOFFSET) != 0 || len == 0 ||
+	    gpa + len < gpa) {
+		return (EINVAL);
+	}
+
+	bitmap = kmem_alloc(VMM_DIRTY_CHUNK_BYTES, KM_SLEEP);
+	for (size_t off = 0; off < len; off += VMM_DIRTY_CHUNK) {
+		const size_t clen = MIN(len - off, VMM_DIRTY_CHUNK);
+		const size_t nbytes = howmany(btop(clen), NBBY);
+
+		bzero(bitmap, nbytes);
+		err = vmspace_track_dirty(vms, gpa + off, clen, bitmap);
+		if (err != 0) {
+			break;
+		}
+		if (ddi_copyout(bitmap, out, nbytes, md) != 0) {
+			err = EFAULT;
+			break;
+		}
+		out += nbytes;
+	}
+	kmem_free(bitmap, VMM_DIRTY_CHUNK_BYTES);
+
+	return (err);
+}
+
 static int
 vmmdev_alloc_memseg(vmm_softc_t *sc, struct vm_memseg *mseg)
 {
@@ -465,6 +590,9 @@ vmmdev_do_ioctl(vmm_softc_t *sc, int cmd, intptr_t arg, int md,
 	case VM_MAP_PPTDEV_MMIO:
 	case VM_ALLOC_MEMSEG:
 	case VM_MMAP_MEMSEG:
+	case VM_DOORBELL_BIND:
+	case VM_DOORBELL_UNBIND:
+	case VM_TRACK_DIRTY_PAGES:
 	case VM_WRLOCK_CYCLE:
 		vmm_write_lock(sc);
 		lock_type = LOCK_WRITE_HOLD;
@@ -540,6 +668,8 @@ vmmdev_do_ioctl(vmm_softc_t *sc, int cmd, intptr_t arg, int md,
 			 */
 			break;
 		}
+		/* Doorbells are hooks too; userspace binds them again */
+		vmmdev_doorbell_purge(sc);
 		error = vm_reinit(sc->vmm_vm);
 		(void) vmm_drv_block_hook(sc, B_FALSE);
 		break;
@@ -1174,6 +1304,52 @@ vmmdev_do_ioctl(vmm_softc_t *sc, int cmd, intptr_t arg, int md,
 		}
 		break;
 
+	case VM_DOORBELL_BIND: {
+		struct vm_doorbell vdb;
+
+		if (ddi_copyin(datap, &vdb, sizeof (vdb), md)) {
+			error = EFAULT;
+			break;
+		}
+		error = vmmdev_doorbell_bind(sc, &vdb);
+		break;
+	}
+	case VM_DOORBELL_UNBIND: {
+		struct vm_doorbell vdb;
+
+		if (ddi_copyin(datap, &vdb, sizeof (vdb), md)) {
+			error = EFAULT;
+			break;
+		}
+		if (vdb.id < 0 || vdb.id >= VM_MAX_DOORBELLS ||
+		    sc->vmm_doorbells[vdb.id] == NULL) {
+			error = ENOENT;
+			break;
+		}
+		vmmdev_doorbell_unbind(sc, vdb.id);
+		break;
+	}
+	case VM_TRACK_DIRTY_PAGES: {
+		struct vm_dirty_tracker vdt;
+
+		if (ddi_copyin(datap, &vdt, sizeof (vdt), md)) {
+			error = EFAULT;
+			break;
+		}
+		error = vmmdev_track_dirty(sc, &vdt, md);
+		break;
+	}
+	case VM_DOORBELL_PENDING: {
+		uint64_t pend;
+
+		/* Collect and clear; the poller is re-armed by the next OUT */
+		pend = atomic_swap_64(&sc->vmm_doorbell_pend, 0);
+		if (ddi_copyout(&pend, datap, sizeof (pend), md)) {
+			error = EFAULT;
+		}
+		break;
+	}
+
 	case VM_GET_CPUS: {
 		struct vm_cpuset vm_cpuset;
 		cpuset_t tempset;
@@ -1952,6 +2128,10 @@ vmm_close(dev_t dev, int flag, int otyp, cred_t *credp)
 	VERIFY(sc->vmm_is_open);
 	sc->vmm_is_open = B_FALSE;
 
+	/* Doorbells belong to the open handle, whose last user is now gone */
+	vmmdev_doorbell_purge(sc);
+	pollhead_clean(&sc->vmm_pollhead);
+
 	/*
 	 * If this VM was destroyed while the vmm device was open, then
 	 * clean it up now that it is closed.
@@ -1971,6 +2151,30 @@ vmm_close(dev_t dev, int flag, int otyp, cred_t *credp)
 	return (0);
 }
 
+static int
+vmm_chpoll(dev_t dev, short events, int anyyet, short *reventsp,
+    struct pollhead **phpp)
+{
+	minor_t		minor;
+	vmm_softc_t	*sc;
+
+	minor = getminor(dev);
+	if (minor == VMM_CTL_MINOR)
+		return (ENXIO);
+
+	sc = ddi_get_soft_state(vmm_statep, minor);
+	if (sc == NULL)
+		return (ENXIO);
+
+	*reventsp = 0;
+	if (sc->vmm_doorbell_pend != 0)
+		*reventsp = events & (POLLIN | POLLRDNORM);
+	if ((*reventsp == 0 && !anyyet) || (events & POLLET))
+		*phpp = &sc->vmm_pollhead;
+
+	return (0);
+}
+
 static int
 vmm_is_supported(intptr_t arg)
 {
@@ -2327,7 +2531,7 @@ static struct cb_ops vmm_cb_ops = {
 	nodev,		/* devmap */
 	nodev,		/* mmap */
 	vmm_segmap,
-	nochpoll,	/* poll */
+	vmm_chpoll,	/* poll */
 	ddi_prop_op,
 	NULL,
 	D_NEW | D_MP | D_DEVMAP
@@ -18,6 +18,7 @@
 #include <sys/param.h>
 #include <sys/kmem.h>
 #include <sys/machsystm.h>
+#include <sys/atomic.h>
 
 #include <sys/gipt.h>
 #include <vm/vm_glue.h>
@@ -26,6 +27,7 @@
 struct ept_map {
 	gipt_map_t	em_gipt;
 	uint64_t	em_wired_page_count;
+	uint64_t	em_lgpg_page_count;	/* of wired, in large pages */
 };
 typedef struct ept_map ept_map_t;
 
@@ -40,6 +42,8 @@ CTASSERT(EPT_MAX_LEVELS <= GIPT_MAX_LEVELS);
 #define	EPT_X		(0x1 << 2)
 #define	EPT_RWX		(EPT_R | EPT_W | EPT_X)
 #define	EPT_LGPG	(0x1 << 7)
+#define	EPT_ACCESSED	(0x1 << 8)
+#define	EPT_DIRTY	(0x1 << 9)
 
 #define	EPT_PA_MASK	(0x000ffffffffff000ull)
 
@@ -134,6 +138,19 @@ ept_wired_count(void *arg)
 	return (res);
 }
 
+static uint64_t
+ept_lgpg_count(void *arg)
+{
+	ept_map_t *emap = arg;
+	uint64_t res;
+
+	mutex_enter(EPT_LOCK(emap));
+	res = emap->em_lgpg_page_count;
+	mutex_exit(EPT_LOCK(emap));
+
+	return (res);
+}
+
 static int
 ept_is_wired(void *arg, uint64_t va, uint_t *protp)
 {
@@ -201,6 +218,9 @@ ept_map(void *arg, uint64_t va, pfn_t pfn, uint_t lvl, uint_t prot,
 	*ptep = pte;
 	pt->gipt_valid_cnt++;
 	emap->em_wired_page_count += gipt_level_count[lvl];
+	if (lvl != 0) {
+		emap->em_lgpg_page_count += gipt_level_count[lvl];
+	}
 
 	mutex_exit(EPT_LOCK(emap));
 	return (0);
@@ -213,7 +233,7 @@ ept_unmap(void *arg, uint64_t va, uint64_t end_va)
 	gipt_map_t *map = &emap->em_gipt;
 	gipt_t *pt;
 	uint64_t cur_va = va;
-	uint64_t unmapped = 0;
+	uint64_t unmapped = 0, lgpg_unmapped = 0;
 
 	mutex_enter(EPT_LOCK(emap));
 
@@ -238,6 +258,9 @@ ept_unmap(void *arg, uint64_t va, uint64_t end_va)
 		*ptep = 0;
 		pt->gipt_valid_cnt--;
 		unmapped += gipt_level_count[pt->gipt_level];
+		if (lvl != 0) {
+			lgpg_unmapped += gipt_level_count[lvl];
+		}
 
 		gipt_t *next_pt = pt;
 		uint64_t next_va;
@@ -253,17 +276,75 @@ ept_unmap(void *arg, uint64_t va, uint64_t end_va)
 		cur_va = next_va;
 	}
 	emap->em_wired_page_count -= unmapped;
+	emap->em_lgpg_page_count -= lgpg_unmapped;
 
 	mutex_exit(EPT_LOCK(emap));
 
 	return (unmapped);
 }
 
+static int
+ept_harvest_dirty(void *arg, uint64_t va, uint64_t end_va, uint8_t *bitmap)
+{
+	ept_map_t *emap = arg;
+	gipt_map_t *map = &emap->em_gipt;
+	gipt_t *pt;
+	uint64_t cur_va = va;
+
+	/*
+	 * Without accessed/dirty flag support enabled in the EPTP, the
+	 * processor will not record guest writes in the leaf entries.
+	 */
+	if (ept_enable_ad_bits == 0) {
+		return (ENOTSUP);
+	}
+
+	mutex_enter(EPT_LOCK(emap));
+
+	pt = gipt_map_lookup_deepest(map, cur_va);
+	if (pt == NULL) {
+		mutex_exit(EPT_LOCK(emap));
+		return (0);
+	}
+	if (!EPT_MAPS_PAGE(GIPT_VA2PTE(pt, cur_va), pt->gipt_level)) {
+		cur_va = gipt_map_next_page(map, cur_va, end_va, &pt);
+		if (cur_va == 0) {
+			mutex_exit(EPT_LOCK(emap));
+			return (0);
+		}
+	}
+
+	while (cur_va < end_va) {
+		uint64_t *ptep = GIPT_VA2PTEP(pt, cur_va);
+		const uint_t lvl = pt->gipt_level;
+
+		ASSERT(EPT_MAPS_PAGE(*ptep, lvl));
+		if ((*ptep & EPT_DIRTY) != 0) {
+			const uint64_t pgsz = gipt_level_size[lvl];
+			const uint64_t pg_va = P2ALIGN(cur_va, pgsz);
+
+			atomic_and_64(ptep, ~(uint64_t)EPT_DIRTY);
+			vmm_dirty_bitmap_set(bitmap, va, MAX(pg_va, va),
+			    MIN(pg_va + pgsz, end_va));
+		}
+
+		cur_va = gipt_map_next_page(map, cur_va, end_va, &pt);
+		if (cur_va == 0) {
+			break;
+		}
+	}
+
+	mutex_exit(EPT_LOCK(emap));
+	return (0);
+}
+
 struct vmm_pt_ops ept_ops = {
 	.vpo_init	= ept_create,
 	.vpo_free	= ept_destroy,
 	.vpo_wired_cnt	= ept_wired_count,
+	.vpo_lgpg_cnt	= ept_lgpg_count,
 	.vpo_is_wired	= ept_is_wired,
 	.vpo_map	= ept_map,
 	.vpo_unmap	= ept_unmap,
+	.vpo_harvest_dirty = ept_harvest_dirty,
 };
@@ -18,6 +18,7 @@
 #include <sys/param.h>
 #include <sys/kmem.h>
 #include <sys/machsystm.h>
+#include <sys/atomic.h>
 #include <sys/x86_archext.h>
 
 #include <sys/gipt.h>
@@ -27,6 +28,7 @@
 struct rvi_map {
 	gipt_map_t	rm_gipt;
 	uint64_t	rm_wired_page_count;
+	uint64_t	rm_lgpg_page_count;	/* of wired, in large pages */
 };
 typedef struct rvi_map rvi_map_t;
 
@@ -162,6 +164,19 @@ rvi_wired_count(void *arg)
 	return (res);
 }
 
+static uint64_t
+rvi_lgpg_count(void *arg)
+{
+	rvi_map_t *rmap = arg;
+	uint64_t res;
+
+	mutex_enter(RVI_LOCK(rmap));
+	res = rmap->rm_lgpg_page_count;
+	mutex_exit(RVI_LOCK(rmap));
+
+	return (res);
+}
+
 static int
 rvi_is_wired(void *arg, uint64_t va, uint_t *protp)
 {
@@ -230,6 +245,9 @@ rvi_map(void *arg, uint64_t va, pfn_t pfn, uint_t lvl, uint_t prot,
 	*ptep = pte;
 	pt->gipt_valid_cnt++;
 	rmap->rm_wired_page_count += gipt_level_count[lvl];
+	if (lvl != 0) {
+		rmap->rm_lgpg_page_count += gipt_level_count[lvl];
+	}
 
 	mutex_exit(RVI_LOCK(rmap));
 	return (0);
@@ -242,7 +260,7 @@ rvi_unmap(void *arg, uint64_t va, uint64_t end_va)
 	gipt_map_t *map = &rmap->rm_gipt;
 	gipt_t *pt;
 	uint64_t cur_va = va;
-	uint64_t unmapped = 0;
+	uint64_t unmapped = 0, lgpg_unmapped = 0;
 
 	mutex_enter(RVI_LOCK(rmap));
 
@@ -267,6 +285,9 @@ rvi_unmap(void *arg, uint64_t va, uint64_t end_va)
 		*ptep = 0;
 		pt->gipt_valid_cnt--;
 		unmapped += gipt_level_count[pt->gipt_level];
+		if (lvl != 0) {
+			lgpg_unmapped += gipt_level_count[lvl];
+		}
 
 		gipt_t *next_pt = pt;
 		uint64_t next_va;
@@ -282,17 +303,67 @@ rvi_unmap(void *arg, uint64_t va, uint64_t end_va)
 		cur_va = next_va;
 	}
 	rmap->rm_wired_page_count -= unmapped;
+	rmap->rm_lgpg_page_count -= lgpg_unmapped;
 
 	mutex_exit(RVI_LOCK(rmap));
 
 	return (unmapped);
 }
 
+static int
+rvi_harvest_dirty(void *arg, uint64_t va, uint64_t end_va, uint8_t *bitmap)
+{
+	rvi_map_t *rmap = arg;
+	gipt_map_t *map = &rmap->rm_gipt;
+	gipt_t *pt;
+	uint64_t cur_va = va;
+
+	mutex_enter(RVI_LOCK(rmap));
+
+	pt = gipt_map_lookup_deepest(map, cur_va);
+	if (pt == NULL) {
+		mutex_exit(RVI_LOCK(rmap));
+		return (0);
+	}
+	if (!RVI_MAPS_PAGE(GIPT_VA2PTE(pt, cur_va), pt->gipt_level)) {
+		cur_va = gipt_map_next_page(map, cur_va, end_va, &pt);
+		if (cur_va == 0) {
+			mutex_exit(RVI_LOCK(rmap));
+			return (0);
+		}
+	}
+
+	while (cur_va < end_va) {
+		uint64_t *ptep = GIPT_VA2PTEP(pt, cur_va);
+		const uint_t lvl = pt->gipt_level;
+
+		ASSERT(RVI_MAPS_PAGE(*ptep, lvl));
+		if ((*ptep & RVI_DIRTY) != 0) {
+			const uint64_t pgsz = gipt_level_size[lvl];
+			const uint64_t pg_va = P2ALIGN(cur_va, pgsz);
+
+			atomic_and_64(ptep, ~(uint64_t)RVI_DIRTY);
+			vmm_dirty_bitmap_set(bitmap, va, MAX(pg_va, va),
+			    MIN(pg_va + pgsz, end_va));
+		}
+
+		cur_va = gipt_map_next_page(map, cur_va, end_va, &pt);
+		if (cur_va == 0) {
+			break;
+		}
+	}
+
+	mutex_exit(RVI_LOCK(rmap));
+	return (0);
+}
+
 struct vmm_pt_ops rvi_ops = {
 	.vpo_init	= rvi_create,
 	.vpo_free	= rvi_destroy,
 	.vpo_wired_cnt	= rvi_wired_count,
+	.vpo_lgpg_cnt	= rvi_lgpg_count,
 	.vpo_is_wired	= rvi_is_wired,
 	.vpo_map	= rvi_map,
 	.vpo_unmap	= rvi_unmap,
+	.vpo_harvest_dirty = rvi_harvest_dirty,
 };
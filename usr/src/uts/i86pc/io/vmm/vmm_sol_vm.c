@@ -27,7 +27,11 @@
 #include <sys/vmsystm.h>
 #include <sys/malloc.h>
 #include <sys/x86_archext.h>
+#include <sys/taskq.h>
+#include <sys/disp.h>
 #include <vm/as.h>
+#include <vm/hat.h>
+#include <vm/page.h>
 #include <vm/seg_vn.h>
 #include <vm/seg_kmem.h>
 #include <vm/seg_vmm.h>
@@ -65,6 +69,38 @@ static void vm_mapping_remove(struct vmspace *, vmspace_mapping_t *);
 
 static vmem_t *vmm_alloc_arena = NULL;
 
+/*
+ * Guest memory objects sized in multiples of VMM_LPAGESIZE are backed with
+ * physically contiguous large pages when the system can supply them, allowing
+ * vm_fault() and vm_map_wire() to install large EPT/NPT entries and shorten
+ * the two-dimensional page walk.  Allocation falls back to PAGESIZE backing
+ * from vmm_alloc_arena when large pages are disabled or unavailable.
+ */
+int vmm_lpage_enable = 1;
+
+#define	VMM_LPAGE_LVL	1
+#define	VMM_LPAGESIZE	LEVEL_SIZE(VMM_LPAGE_LVL)
+
+/*
+ * Zeroing guest memory with a single thread dominates the time to create or
+ * reset a large VM.  Objects of at least vmm_clear_par_min bytes are instead
+ * cleared in vmm_clear_chunk sized pieces by the threads of vmm_clear_taskq.
+ * Setting vmm_clear_nthreads to 0 before the driver attaches disables this.
+ */
+size_t vmm_clear_par_min = 1024 * 1024 * 1024;
+size_t vmm_clear_chunk = 128 * 1024 * 1024;
+int vmm_clear_nthreads = 8;
+
+static taskq_t *vmm_clear_taskq = NULL;
+
+typedef struct vmm_clear_task {
+	caddr_t		vct_addr;
+	size_t		vct_len;
+	kmutex_t	*vct_lock;
+	kcondvar_t	*vct_cv;
+	uint_t		*vct_pending;
+} vmm_clear_task_t;
+
 static void *
 vmm_arena_alloc(vmem_t *vmp, size_t size, int vmflag)
 {
@@ -78,6 +114,105 @@ vmm_arena_free(vmem_t *vmp, void *inaddr, size_t size)
 	segkmem_xfree(vmp, inaddr, size, &kvps[KV_VVP], NULL);
 }
 
+/*
+ * Unload and destroy the large pages backing [addr, addr + size).  Page
+ * reservations and the VA are left to the caller.
+ */
+static void
+vmm_lpage_unload(caddr_t addr, size_t size)
+{
+	if (size == 0) {
+		return;
+	}
+
+	hat_unload(kas.a_hat, addr, size, HAT_UNLOAD_UNLOCK);
+	for (size_t pos = 0; pos < size; pos += VMM_LPAGESIZE) {
+		page_t *pp, *rootpp = NULL;
+
+		for (size_t off = 0; off < VMM_LPAGESIZE; off += PAGESIZE) {
+			pp = page_lookup(&kvps[KV_VVP],
+			    (u_offset_t)(uintptr_t)(addr + pos + off), SE_EXCL);
+			VERIFY(pp != NULL);
+			/* Clear p_lckcnt so availrmem is left alone */
+			pp->p_lckcnt = 0;
+			if (rootpp == NULL) {
+				rootpp = pp;
+			}
+		}
+		page_destroy_pages(rootpp);
+	}
+}
+
+static void *
+vmm_lpage_alloc(size_t size)
+{
+	const pgcnt_t npages = btop(size);
+	const pgcnt_t nbpages = btop(VMM_LPAGESIZE);
+	const size_t ppasize = nbpages * sizeof (page_t *);
+	uint_t pgflags = PG_EXCL;
+	page_t **ppa;
+	caddr_t addr;
+
+	ASSERT0(P2PHASE(size, VMM_LPAGESIZE));
+
+	if (segkmem_reloc == 0) {
+		pgflags |= PG_NORELOC;
+	}
+
+	addr = vmem_xalloc(kvmm_arena, size, VMM_LPAGESIZE, 0, 0, NULL, NULL,
+	    VM_NOSLEEP);
+	if (addr == NULL) {
+		return (NULL);
+	}
+	if (page_resv(npages, KM_NOSLEEP) == 0) {
+		vmem_xfree(kvmm_arena, addr, size);
+		return (NULL);
+	}
+
+	ppa = kmem_alloc(ppasize, KM_SLEEP);
+	for (size_t pos = 0; pos < size; pos += VMM_LPAGESIZE) {
+		caddr_t va = addr + pos;
+		page_t *pplist;
+
+		pplist = page_create_va_large(&kvps[KV_VVP],
+		    (u_offset_t)(uintptr_t)va, VMM_LPAGESIZE, pgflags,
+		    &kvmmseg, va, NULL);
+		if (pplist == NULL) {
+			kmem_free(ppa, ppasize);
+			vmm_lpage_unload(addr, pos);
+			page_unresv(npages);
+			vmem_xfree(kvmm_arena, addr, size);
+			return (NULL);
+		}
+
+		for (pgcnt_t i = 0; i < nbpages; i++) {
+			page_t *pp = pplist;
+
+			page_sub(&pplist, pp);
+			ASSERT(page_iolock_assert(pp));
+			page_io_unlock(pp);
+			ppa[i] = pp;
+		}
+		hat_memload_array(kas.a_hat, va, VMM_LPAGESIZE, ppa,
+		    (PROT_ALL & ~PROT_USER) | HAT_NOSYNC, HAT_LOAD_LOCK);
+		for (pgcnt_t i = 0; i < nbpages; i++) {
+			ppa[i]->p_lckcnt = 1;
+			page_unlock(ppa[i]);
+		}
+	}
+	kmem_free(ppa, ppasize);
+
+	return (addr);
+}
+
+static void
+vmm_lpage_free(void *addr, size_t size)
+{
+	vmm_lpage_unload(addr, size);
+	page_unresv(btop(size));
+	vmem_xfree(kvmm_arena, addr, size);
+}
+
 void
 vmm_arena_init(void)
 {
@@ -85,6 +220,12 @@ vmm_arena_init(void)
 	    vmm_arena_alloc, vmm_arena_free, kvmm_arena, 0, VM_SLEEP);
 
 	ASSERT(vmm_alloc_arena != NULL);
+
+	if (vmm_clear_nthreads > 0) {
+		vmm_clear_taskq = taskq_create("vmm_clear", vmm_clear_nthreads,
+		    minclsyspri, vmm_clear_nthreads, INT_MAX,
+		    TASKQ_PREPOPULATE);
+	}
 }
 
 void
@@ -93,6 +234,11 @@ vmm_arena_fini(void)
 	VERIFY(vmem_size(vmm_alloc_arena, VMEM_ALLOC) == 0);
 	vmem_destroy(vmm_alloc_arena);
 	vmm_alloc_arena = NULL;
+
+	if (vmm_clear_taskq != NULL) {
+		taskq_destroy(vmm_clear_taskq);
+		vmm_clear_taskq = NULL;
+	}
 }
 
 struct vmspace *
@@ -173,6 +319,49 @@ vmspace_find_kva(struct vmspace *vms, uintptr_t addr, size_t size)
 	return (result);
 }
 
+/*
+ * Mark the 4K pages of [start, end) in a dirty bitmap whose first bit
+ * corresponds to the page at 'base'.
+ */
+void
+vmm_dirty_bitmap_set(uint8_t *bitmap, uint64_t base, uint64_t start,
+    uint64_t end)
+{
+	ASSERT3U(start, >=, base);
+
+	for (uint64_t gpa = start; gpa < end; gpa += PAGESIZE) {
+		const uint64_t bit = btop(gpa - base);
+
+		bitmap[bit / NBBY] |= (1 << (bit % NBBY));
+	}
+}
+
+/*
+ * Harvest (and clear) the hardware dirty bits for the guest-physical range
+ * [gpa, gpa + len), setting the corresponding bits in 'bitmap'.  The caller
+ * is expected to prevent vCPUs from running while this takes place.  Since
+ * the guest TLB may still hold translations for which the dirty bit is
+ * already set, the EPT generation is bumped so that each vCPU flushes them
+ * on its next entry, ensuring that further writes are recorded.
+ */
+int
+vmspace_track_dirty(struct vmspace *vms, uint64_t gpa, size_t len,
+    uint8_t *bitmap)
+{
+	pmap_t pmap = &vms->vms_pmap;
+	int err;
+
+	mutex_enter(&vms->vms_lock);
+	err = pmap->pm_ops->vpo_harvest_dirty(pmap->pm_impl, gpa, gpa + len,
+	    bitmap);
+	if (err == 0) {
+		atomic_inc_long((ulong_t *)&pmap->pm_eptgen);
+	}
+	mutex_exit(&vms->vms_lock);
+
+	return (err);
+}
+
 static int
 vmspace_pmap_iswired(struct vmspace *vms, uintptr_t addr, uint_t *prot)
 {
@@ -245,6 +434,17 @@ pmap_wired_count(pmap_t pmap)
 	return (val);
 }
 
+long
+pmap_lgpg_count(pmap_t pmap)
+{
+	long val;
+
+	val = pmap->pm_ops->vpo_lgpg_cnt(pmap->pm_impl);
+	VERIFY3S(val, >=, 0);
+
+	return (val);
+}
+
 int
 pmap_emulate_accessed_dirty(pmap_t pmap, vm_offset_t va, int ftype)
 {
@@ -450,13 +650,69 @@ vm_reserve_pages(size_t npages)
 	}
 }
 
+static void
+vm_object_clear_task(void *arg)
+{
+	vmm_clear_task_t *vct = arg;
+
+	bzero(vct->vct_addr, vct->vct_len);
+
+	mutex_enter(vct->vct_lock);
+	if (--(*vct->vct_pending) == 0) {
+		cv_broadcast(vct->vct_cv);
+	}
+	mutex_exit(vct->vct_lock);
+}
+
 void
 vm_object_clear(vm_object_t vmo)
 {
+	const size_t size = vmo->vmo_size;
+	const size_t chunk = MAX(P2ROUNDUP(vmm_clear_chunk, PAGESIZE),
+	    PAGESIZE);
+	vmm_clear_task_t *tasks;
+	uint_t ntasks, pending;
+	kmutex_t lock;
+	kcondvar_t cv;
+
 	ASSERT(vmo->vmo_type == OBJT_DEFAULT);
 
-	/* XXXJOY: Better zeroing approach? */
-	bzero(vmo->vmo_data, vmo->vmo_size);
+	if (vmm_clear_taskq == NULL || size < vmm_clear_par_min ||
+	    size <= chunk) {
+		bzero(vmo->vmo_data, size);
+		return;
+	}
+
+	ntasks = howmany(size, chunk);
+	tasks = kmem_alloc(ntasks * sizeof (*tasks), KM_SLEEP);
+	mutex_init(&lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&cv, NULL, CV_DEFAULT, NULL);
+	pending = ntasks;
+
+	for (uint_t i = 0; i < ntasks; i++) {
+		vmm_clear_task_t *vct = &tasks[i];
+		const size_t off = (size_t)i * chunk;
+
+		vct->vct_addr = (caddr_t)vmo->vmo_data + off;
+		vct->vct_len = MIN(chunk, size - off);
+		vct->vct_lock = &lock;
+		vct->vct_cv = &cv;
+		vct->vct_pending = &pending;
+		if (taskq_dispatch(vmm_clear_taskq, vm_object_clear_task, vct,
+		    TQ_SLEEP) == TASKQID_INVALID) {
+			vm_object_clear_task(vct);
+		}
+	}
+
+	mutex_enter(&lock);
+	while (pending != 0) {
+		cv_wait(&cv, &lock);
+	}
+	mutex_exit(&lock);
+
+	cv_destroy(&cv);
+	mutex_destroy(&lock);
+	kmem_free(tasks, ntasks * sizeof (*tasks));
 }
 
 vm_object_t
@@ -477,8 +733,17 @@ vm_object_allocate(objtype_t type, vm_pindex_t psize)
 	case OBJT_DEFAULT: {
 		vm_reserve_pages(psize);
 
-		/* XXXJOY: opt-in to larger pages? */
-		vmo->vmo_data = vmem_alloc(vmm_alloc_arena, size, KM_NOSLEEP);
+		vmo->vmo_data = NULL;
+		vmo->vmo_lpage = B_FALSE;
+		if (vmm_lpage_enable != 0 && size != 0 &&
+		    P2PHASE(size, VMM_LPAGESIZE) == 0) {
+			vmo->vmo_data = vmm_lpage_alloc(size);
+			vmo->vmo_lpage = (vmo->vmo_data != NULL);
+		}
+		if (vmo->vmo_data == NULL) {
+			vmo->vmo_data = vmem_alloc(vmm_alloc_arena, size,
+			    KM_NOSLEEP);
+		}
 		if (vmo->vmo_data == NULL) {
 			mutex_destroy(&vmo->vmo_lock);
 			kmem_free(vmo, sizeof (*vmo));
@@ -490,6 +755,7 @@ vm_object_allocate(objtype_t type, vm_pindex_t psize)
 		break;
 	case OBJT_SG:
 		vmo->vmo_data = NULL;
+		vmo->vmo_lpage = B_FALSE;
 		vmo->vmo_pager = vm_object_pager_sg;
 		break;
 	default:
@@ -536,7 +802,12 @@ vm_object_deallocate(vm_object_t vmo)
 
 	switch (vmo->vmo_type) {
 	case OBJT_DEFAULT:
-		vmem_free(vmm_alloc_arena, vmo->vmo_data, vmo->vmo_size);
+		if (vmo->vmo_lpage) {
+			vmm_lpage_free(vmo->vmo_data, vmo->vmo_size);
+		} else {
+			vmem_free(vmm_alloc_arena, vmo->vmo_data,
+			    vmo->vmo_size);
+		}
 		break;
 	case OBJT_SG:
 		sglist_free((struct sglist *)vmo->vmo_data);
@@ -652,6 +923,33 @@ vm_mapping_remove(struct vmspace *vms, vmspace_mapping_t *vmsm)
 	kmem_free(vmsm, sizeof (*vmsm));
 }
 
+/*
+ * Choose the level at which guest-physical addr can be mapped, given the
+ * pfn and the level/leading pfn of the host page backing it as reported by
+ * the object pager.  A large EPT/NPT entry is only possible when the guest
+ * and host addresses share the same offset into the large page and the
+ * whole large page lies inside the mapping.
+ */
+static uint_t
+vm_mapping_level(const vmspace_mapping_t *vmsm, uintptr_t addr, pfn_t pfn,
+    pfn_t lpfn, uint_t lvl)
+{
+	uintptr_t sz, base;
+
+	if (lvl == 0 || lvl > VMM_LPAGE_LVL) {
+		return (0);
+	}
+
+	sz = LEVEL_SIZE(lvl);
+	base = P2ALIGN(addr, sz);
+	if (base < vmsm->vmsm_addr ||
+	    base + sz > vmsm->vmsm_addr + vmsm->vmsm_len ||
+	    mmu_ptob(pfn - lpfn) != P2PHASE(P2ALIGN(addr, PAGESIZE), sz)) {
+		return (0);
+	}
+	return (lvl);
+}
+
 int
 vm_fault(vm_map_t map, vm_offset_t off, vm_prot_t type, int flag)
 {
@@ -662,7 +960,7 @@ vm_fault(vm_map_t map, vm_offset_t off, vm_prot_t type, int flag)
 	vmspace_mapping_t *vmsm;
 	struct vm_object *vmo;
 	uint_t prot, map_lvl;
-	pfn_t pfn;
+	pfn_t pfn, lpfn;
 	uintptr_t map_addr;
 
 	mutex_enter(&vms->vms_lock);
@@ -693,11 +991,13 @@ vm_fault(vm_map_t map, vm_offset_t off, vm_prot_t type, int flag)
 	vmo = vmsm->vmsm_object;
 	prot = vmsm->vmsm_prot;
 
-	/* XXXJOY: punt on large pages for now */
-	pfn = vmo->vmo_pager(vmo, VMSM_OFFSET(vmsm, addr), NULL, NULL);
-	map_lvl = 0;
-	map_addr = P2ALIGN((uintptr_t)addr, LEVEL_SIZE(map_lvl));
+	pfn = vmo->vmo_pager(vmo, VMSM_OFFSET(vmsm, addr), &lpfn, &map_lvl);
 	VERIFY(pfn != PFN_INVALID);
+	map_lvl = vm_mapping_level(vmsm, addr, pfn, lpfn, map_lvl);
+	if (map_lvl != 0) {
+		pfn = lpfn;
+	}
+	map_addr = P2ALIGN((uintptr_t)addr, LEVEL_SIZE(map_lvl));
 
 	/*
 	 * If pmap failure is to be handled, the previously acquired page locks
@@ -871,21 +1171,25 @@ vm_map_wire(vm_map_t map, vm_offset_t start, vm_offset_t end, int flags)
 	prot = vmsm->vmsm_prot;
 
 	for (uintptr_t pos = addr; pos < end; ) {
-		pfn_t pfn;
+		pfn_t pfn, lpfn;
 		uintptr_t pg_size, map_addr;
-		uint_t map_lvl = 0;
+		uint_t map_lvl;
 
-		/* XXXJOY: punt on large pages for now */
-		pfn = vmo->vmo_pager(vmo, VMSM_OFFSET(vmsm, pos), NULL, NULL);
+		pfn = vmo->vmo_pager(vmo, VMSM_OFFSET(vmsm, pos), &lpfn,
+		    &map_lvl);
+		VERIFY(pfn != PFN_INVALID);
+		map_lvl = vm_mapping_level(vmsm, pos, pfn, lpfn, map_lvl);
+		if (map_lvl != 0) {
+			pfn = lpfn;
+		}
 		pg_size = LEVEL_SIZE(map_lvl);
 		map_addr = P2ALIGN(pos, pg_size);
-		VERIFY(pfn != PFN_INVALID);
 
 		VERIFY0(pmap->pm_ops->vpo_map(pmi, map_addr, pfn, map_lvl,
 		    prot, vmo->vmo_attr));
 		vms->vms_pmap.pm_eptgen++;
 
-		pos += pg_size;
+		pos = map_addr + pg_size;
 	}
 
 	mutex_exit(&vms->vms_lock);
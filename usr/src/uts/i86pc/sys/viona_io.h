@@ -31,6 +31,8 @@
 #define	VNA_IOC_SET_FEATURES	(VNA_IOC | 0x21)
 #define	VNA_IOC_GET_FEATURES	(VNA_IOC | 0x22)
 #define	VNA_IOC_SET_NOTIFY_IOP	(VNA_IOC | 0x23)
+#define	VNA_IOC_SET_QPAIRS	(VNA_IOC | 0x24)
+#define	VNA_IOC_INTR_POLL_MQ	(VNA_IOC | 0x25)
 
 typedef struct vioc_create {
 	datalink_id_t	c_linkid;
@@ -55,9 +57,21 @@ enum viona_vq_id {
 	VIONA_VQ_MAX = 2
 };
 
+/*
+ * Rings are laid out in virtio-net queue order: the RX and TX rings of queue
+ * pair N are found at indices (2 * N) + VIONA_VQ_RX and (2 * N) + VIONA_VQ_TX.
+ */
+#define	VIONA_MAX_QPAIRS	8
+#define	VIONA_MAX_QUEUES	(VIONA_MAX_QPAIRS * VIONA_VQ_MAX)
+
 typedef struct vioc_intr_poll {
 	uint32_t	vip_status[VIONA_VQ_MAX];
 } vioc_intr_poll_t;
 
+typedef struct vioc_intr_poll_mq {
+	uint16_t	vipm_nrings;
+	uint32_t	vipm_status[VIONA_MAX_QUEUES];
+} vioc_intr_poll_mq_t;
+
 
 #endif	/* _VIONA_IO_H_ */
@@ -264,6 +264,32 @@ struct vm_readwrite_kernemu_device {
 };
 _Static_assert(sizeof(struct vm_readwrite_kernemu_device) == 24, "ABI");
 
+/*
+ * A doorbell turns guest OUTs to an I/O port into a bit in a pending
+ * mask, handled entirely in the kernel.  The vCPU resumes at once and
+ * the vmm device polls readable while any doorbell is pending, so a
+ * device emulation thread can service the ring asynchronously instead
+ * of the vCPU exiting to userspace for every notify.
+ */
+#define	VM_MAX_DOORBELLS	64
+
+struct vm_doorbell {
+	int		id;	/* bit in the VM_DOORBELL_PENDING mask */
+	uint16_t	port;	/* guest I/O port to watch for writes */
+};
+
+/*
+ * Collect (and clear) the set of guest pages written since the last
+ * harvest of the region.  Bit N of the vdt_pfns bitmap corresponds to the
+ * page at vdt_start_gpa + N * PAGESIZE.  Requires hardware dirty-bit
+ * support in the nested page tables (EPT A/D flags or NPT).
+ */
+struct vm_dirty_tracker {
+	uint64_t	vdt_start_gpa;	/* page-aligned start of region */
+	size_t		vdt_len;	/* length of region, in bytes */
+	void		*vdt_pfns;	/* bitmap of dirty pages, 1 bit/page */
+};
+
 #define	VMMCTL_IOC_BASE		(('V' << 16) | ('M' << 8))
 #define	VMM_IOC_BASE		(('v' << 16) | ('m' << 8))
 #define	VMM_LOCK_IOC_BASE	(('v' << 16) | ('l' << 8))
@@ -304,6 +330,9 @@ _Static_assert(sizeof(struct vm_readwrite_kernemu_device) == 24, "ABI");
 #define	VM_MAP_PPTDEV_MMIO	(VMM_LOCK_IOC_BASE | 0x04)
 #define	VM_ALLOC_MEMSEG		(VMM_LOCK_IOC_BASE | 0x05)
 #define	VM_MMAP_MEMSEG		(VMM_LOCK_IOC_BASE | 0x06)
+#define	VM_DOORBELL_BIND	(VMM_LOCK_IOC_BASE | 0x07)
+#define	VM_DOORBELL_UNBIND	(VMM_LOCK_IOC_BASE | 0x08)
+#define	VM_TRACK_DIRTY_PAGES	(VMM_LOCK_IOC_BASE | 0x09)
 
 #define	VM_WRLOCK_CYCLE		(VMM_LOCK_IOC_BASE | 0xff)
 
@@ -346,6 +375,7 @@ _Static_assert(sizeof(struct vm_readwrite_kernemu_device) == 24, "ABI");
 #define	VM_GET_CPUS			(VMM_IOC_BASE | 0x1c)
 #define	VM_SUSPEND_CPU			(VMM_IOC_BASE | 0x1d)
 #define	VM_RESUME_CPU			(VMM_IOC_BASE | 0x1e)
+#define	VM_DOORBELL_PENDING		(VMM_IOC_BASE | 0x1f)
 
 
 #define	VM_DEVMEM_GETOFFSET		(VMM_IOC_BASE | 0xff)
@@ -298,7 +298,7 @@ static x86pte_t *pcp_page;
  * forward declaration of internal utility routines
  */
 static x86pte_t hati_update_pte(htable_t *ht, uint_t entry, x86pte_t expected,
-	x86pte_t new);
+	x86pte_t new, boolean_t tlb);
 
 /*
  * The kernel address space exists in all non-HAT_COPIED HATs. To implement this
@@ -3147,7 +3147,7 @@ try_again:
 		if (flags == HAT_SYNC_ZERORM) {
 			new = pte;
 			PTE_CLR(new, PT_REF | PT_MOD);
-			pte = hati_update_pte(ht, entry, pte, new);
+			pte = hati_update_pte(ht, entry, pte, new, B_TRUE);
 			if (pte != 0) {
 				x86_hm_exit(pp);
 				goto try_again;
@@ -3231,6 +3231,8 @@ hat_updateattr(hat_t *hat, caddr_t addr, size_t len, uint_t attr, int what)
 	uint_t		entry;
 	x86pte_t	oldpte, newpte;
 	page_t		*pp;
+	tlb_range_t	r = { 0, 0, 0 };
+	boolean_t	defer;
 
 	XPV_DISALLOW_MIGRATE();
 	ASSERT(IS_PAGEALIGNED(vaddr));
@@ -3306,19 +3308,43 @@ try_again:
 
 		/*
 		 * If new PTE really changed, update the table.
+		 *
+		 * Write-protecting a range which has already been written to
+		 * (fork() doing so for a process's anonymous memory being the
+		 * common case) would otherwise cost a shootdown per page.
+		 * Those TLB invalidations are instead collected into
+		 * contiguous ranges and issued before we return.
 		 */
 		if (newpte != oldpte) {
+			defer = (what == HAT_CLR_ATTR &&
+			    PTE_GET(oldpte, PT_MOD) != 0);
 			entry = htable_va2entry(vaddr, ht);
-			oldpte = hati_update_pte(ht, entry, oldpte, newpte);
+			oldpte = hati_update_pte(ht, entry, oldpte, newpte,
+			    !defer);
 			if (oldpte != 0) {
 				x86_hm_exit(pp);
 				goto try_again;
 			}
+			if (defer) {
+				if (r.tr_cnt != 0 &&
+				    (r.tr_level != ht->ht_level ||
+				    r.tr_va + TLB_RANGE_LEN(&r) != vaddr)) {
+					hat_tlb_inval_range(hat, &r);
+					r.tr_cnt = 0;
+				}
+				if (r.tr_cnt == 0) {
+					r.tr_va = vaddr;
+					r.tr_level = ht->ht_level;
+				}
+				r.tr_cnt++;
+			}
 		}
 		x86_hm_exit(pp);
 	}
 	if (ht)
 		htable_release(ht);
+	if (r.tr_cnt != 0)
+		hat_tlb_inval_range(hat, &r);
 	XPV_ALLOW_MIGRATE();
 }
 
@@ -3809,7 +3835,7 @@ next_size:
 			 */
 			new = old;
 			PTE_CLR(new, PT_REF | PT_MOD | PT_WRITABLE);
-			old = hati_update_pte(ht, entry, old, new);
+			old = hati_update_pte(ht, entry, old, new, B_TRUE);
 			if (old != 0)
 				continue;
 
@@ -4349,7 +4375,7 @@ try_again:
 			 */
 			new = old;
 			PTE_CLR(new, PT_REF | PT_MOD);
-			old = hati_update_pte(ht, entry, old, new);
+			old = hati_update_pte(ht, entry, old, new, B_TRUE);
 			if (old != 0)
 				goto try_again;
 
@@ -4727,7 +4753,8 @@ clear_boot_mappings(uintptr_t low, uintptr_t high)
  * with the page_t. Also sync with page_t if clearing ref/mod bits.
  */
 static x86pte_t
-hati_update_pte(htable_t *ht, uint_t entry, x86pte_t expected, x86pte_t new)
+hati_update_pte(htable_t *ht, uint_t entry, x86pte_t expected, x86pte_t new,
+    boolean_t tlb)
 {
 	page_t		*pp;
 	uint_t		rm = 0;
@@ -4748,7 +4775,7 @@ hati_update_pte(htable_t *ht, uint_t entry, x86pte_t expected, x86pte_t new)
 		PTE_CLR(new, PT_MOD | PT_REF);
 	}
 
-	replaced = x86pte_update(ht, entry, expected, new);
+	replaced = x86pte_update(ht, entry, expected, new, tlb);
 	if (replaced != expected)
 		return (replaced);
 
@@ -2307,13 +2307,20 @@ done:
 
 /*
  * Change a page table entry af it currently matches the value in expect.
+ *
+ * If tlb is B_FALSE, the caller takes responsibility for invalidating the
+ * TLB entry for this address.  That is only allowed when either the new PTE
+ * is still writable or the old PTE was already modified, since the check for
+ * a write via a stale TLB entry below depends on the shootdown being done
+ * here.
  */
 x86pte_t
 x86pte_update(
 	htable_t *ht,
 	uint_t entry,
 	x86pte_t expect,
-	x86pte_t new)
+	x86pte_t new,
+	boolean_t tlb)
 {
 	x86pte_t	*ptep;
 	x86pte_t	found;
@@ -2321,12 +2328,13 @@ x86pte_update(
 	ASSERT(new != 0);
 	ASSERT(!(ht->ht_flags & HTABLE_SHARED_PFN));
 	ASSERT(ht->ht_level <= mmu.max_page_level);
+	ASSERT(tlb || (expect & PT_MOD) != 0 || (new & PT_WRITABLE) != 0);
 
 	ptep = x86pte_access_pagetable(ht, entry);
 	XPV_ALLOW_PAGETABLE_UPDATES();
 	found = CAS_PTE(ptep, expect, new);
 	XPV_DISALLOW_PAGETABLE_UPDATES();
-	if (found == expect) {
+	if (found == expect && tlb) {
 		hat_tlb_inval(ht->ht_hat, htable_e2va(ht, entry));
 
 		/*
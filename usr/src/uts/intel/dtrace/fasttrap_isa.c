@@ -25,7 +25,7 @@
  */
 
 /*
- * Copyright (c) 2015, Joyent, Inc. All rights reserved.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #include <sys/fasttrap_isa.h>
@@ -241,6 +241,35 @@ fasttrap_tracepoint_init(proc_t *p, fasttrap_tracepoint_t *tp, uintptr_t pc,
 	int rmindex, size;
 	uint8_t seg, rex = 0;
 
+	/*
+	 * Is-enabled sites linked by newer versions of dtrace(1M) -G are
+	 * "movl $0, %eax" with the tracepoint at the start of the immediate
+	 * operand, rather than the older "xorl %eax, %eax" followed by nops
+	 * with the tracepoint at the first nop.  A new-style site is enabled
+	 * by changing the low byte of the immediate to 1, which is to say
+	 * that the instruction itself serves as the probe's enabled flag:
+	 * the site costs the same whether or not the probe is enabled, and
+	 * never traps.  A single-byte store is as safe against concurrent
+	 * execution here as our trap instruction is elsewhere -- any thread
+	 * runs either the old instruction or the new one.
+	 *
+	 * Since the tracepoint is not on an instruction boundary, no other
+	 * kind of probe can share it.
+	 */
+	if (type == DTFTP_IS_ENABLED) {
+		uint8_t site[5];
+
+		if (pc > 0 && uread(p, site, sizeof (site), pc - 1) == 0 &&
+		    site[0] == FASTTRAP_MOVL_EAX_IMM &&
+		    site[1] == FASTTRAP_ISENABLED_OFF && site[2] == 0 &&
+		    site[3] == 0 && site[4] == 0) {
+			tp->ftt_instr[0] = FASTTRAP_ISENABLED_OFF;
+			tp->ftt_size = 4;
+			tp->ftt_type = FASTTRAP_T_ISENABLED;
+			return (0);
+		}
+	}
+
 	/*
 	 * Read the instruction at the given address out of the process's
 	 * address space. We don't have to worry about a debugger
@@ -611,6 +640,9 @@ fasttrap_tracepoint_install(proc_t *p, fasttrap_tracepoint_t *tp)
 {
 	fasttrap_instr_t instr = FASTTRAP_INSTR;
 
+	if (tp->ftt_type == FASTTRAP_T_ISENABLED)
+		instr = FASTTRAP_ISENABLED_ON;
+
 	if (uwrite(p, &instr, 1, tp->ftt_pc) != 0)
 		return (-1);
 
@@ -628,7 +660,8 @@ fasttrap_tracepoint_remove(proc_t *p, fasttrap_tracepoint_t *tp)
 	 */
 	if (uread(p, &instr, 1, tp->ftt_pc) != 0)
 		return (0);
-	if (instr != FASTTRAP_INSTR)
+	if (instr != (tp->ftt_type == FASTTRAP_T_ISENABLED ?
+	    FASTTRAP_ISENABLED_ON : FASTTRAP_INSTR))
 		return (0);
 	if (uwrite(p, &tp->ftt_instr[0], 1, tp->ftt_pc) != 0)
 		return (-1);
@@ -1060,6 +1093,18 @@ fasttrap_pid_probe(struct regs *rp)
 #endif
 	}
 
+	/*
+	 * An enabled old-style is-enabled site (see below) needs nothing but
+	 * %eax set; unless there are return probes to fire, don't bother
+	 * taking a copy of the tracepoint.
+	 */
+	if (is_enabled && tp->ftt_retids == NULL) {
+		rp->r_pc = pc + tp->ftt_size;
+		mutex_exit(pid_mtx);
+		rp->r_r0 = 1;
+		return (0);
+	}
+
 	/*
 	 * We're about to do a bunch of work so we cache a local copy of
 	 * the tracepoint to emulate the instruction, and then find the
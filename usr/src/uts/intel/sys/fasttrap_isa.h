@@ -21,6 +21,7 @@
 /*
  * Copyright 2006 Sun Microsystems, Inc.  All rights reserved.
  * Use is subject to license terms.
+ * Copyright 2020 Joyent, Inc.
  */
 
 #ifndef	_FASTTRAP_ISA_H
@@ -87,6 +88,18 @@ typedef struct fasttrap_machtp {
 #define	FASTTRAP_T_PUSHL_EBP	0x10	/* pushl %ebp (for function entry) */
 #define	FASTTRAP_T_NOP		0x11	/* nop */
 
+/*
+ * An is-enabled site of the form "movl $0, %eax", whose tracepoint is the
+ * first byte of the immediate operand.  Rather than a trap, enabling it
+ * stores FASTTRAP_ISENABLED_ON there, so that the site evaluates to true
+ * without ever entering the kernel.  See fasttrap_tracepoint_init().
+ */
+#define	FASTTRAP_T_ISENABLED	0x12
+
+#define	FASTTRAP_MOVL_EAX_IMM	0xb8
+#define	FASTTRAP_ISENABLED_OFF	0x00
+#define	FASTTRAP_ISENABLED_ON	0x01
+
 #define	FASTTRAP_RIP_1		0x1
 #define	FASTTRAP_RIP_2		0x2
 #define	FASTTRAP_RIP_X		0x4